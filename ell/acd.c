@@ -15,6 +15,7 @@
 #include <netinet/if_ether.h>
 #include <net/if_arp.h>
 #include <arpa/inet.h>
+#include <linux/filter.h>
 #include <errno.h>
 
 #include "private.h"
@@ -23,9 +24,11 @@
 #include "util.h"
 #include "io.h"
 #include "net.h"
-#include "timeout.h"
+#include "time.h"
+#include "hashmap.h"
 #include "random.h"
 #include "time-private.h"
+#include "retransmit-private.h"
 
 /* IPv4 Address Conflict Detection (RFC 5227) */
 #define PROBE_WAIT		1
@@ -58,6 +61,18 @@ enum acd_state {
 	ACD_STATE_DEFEND,
 };
 
+/*
+ * All the l_acd instances on an interface share one ARP socket, the
+ * received packets are handed to the instances watching the address
+ * involved.
+ */
+struct acd_monitor {
+	int ifindex;
+	struct l_io *io;
+	struct l_hashmap *watches;
+	unsigned int ref;
+};
+
 struct l_acd {
 	int ifindex;
 
@@ -66,9 +81,12 @@ struct l_acd {
 
 	enum acd_state state;
 	enum l_acd_defend_policy policy;
+	enum l_acd_probe_mode probe_mode;
 
-	struct l_io *io;
-	struct l_timeout *timeout;
+	struct acd_monitor *monitor;
+	struct l_acd *watch_next;
+	struct retransmit *timer;
+	void (*timer_func)(struct l_acd *acd);
 	unsigned int retries;
 
 	l_acd_event_func_t event_func;
@@ -78,19 +96,56 @@ struct l_acd {
 	l_acd_debug_cb_t debug_handler;
 	l_acd_destroy_func_t debug_destroy;
 	void *debug_data;
-
-	bool skip_probes : 1;
 };
 
+static struct l_hashmap *monitors;
+
 static int acd_open_socket(int ifindex)
 {
 	struct sockaddr_ll dest;
 	int fd;
+	struct sock_filter filter[] = {
+		/* A <- packet length */
+		BPF_STMT(BPF_LD + BPF_W + BPF_LEN, 0),
+		/* A == sizeof(ether_arp) ? */
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,
+				sizeof(struct ether_arp), 1, 0),
+		/* ignore */
+		BPF_STMT(BPF_RET + BPF_K, 0),
+		/* A <- hardware and protocol address lengths */
+		BPF_STMT(BPF_LD + BPF_H + BPF_ABS,
+				offsetof(struct ether_arp, arp_hln)),
+		/* A == ETH_ALEN << 8 | 4 ? */
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ETH_ALEN << 8 | 4, 1, 0),
+		/* ignore */
+		BPF_STMT(BPF_RET + BPF_K, 0),
+		/* A <- ARP opcode */
+		BPF_STMT(BPF_LD + BPF_H + BPF_ABS,
+				offsetof(struct ether_arp, arp_op)),
+		/* A == Request or Reply ? */
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ARPOP_REQUEST, 1, 0),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ARPOP_REPLY, 0, 1),
+		/* return all */
+		BPF_STMT(BPF_RET + BPF_K, 65535),
+		/* ignore */
+		BPF_STMT(BPF_RET + BPF_K, 0),
+	};
+	const struct sock_fprog fprog = {
+		.len = L_ARRAY_SIZE(filter),
+		.filter = filter
+	};
 
 	fd = socket(PF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
 	if (fd < 0)
 		return -errno;
 
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER,
+					&fprog, sizeof(fprog)) < 0) {
+		int err = errno;
+		close(fd);
+		return -err;
+	}
+
 	memset(&dest, 0, sizeof(dest));
 
 	dest.sll_family = AF_PACKET;
@@ -113,7 +168,7 @@ static int acd_send_packet(struct l_acd *acd, uint32_t source_ip)
 	struct sockaddr_ll dest;
 	struct ether_arp p;
 	int n;
-	int fd = l_io_get_fd(acd->io);
+	int fd = l_io_get_fd(acd->monitor->io);
 
 	memset(&dest, 0, sizeof(dest));
 	memset(&p, 0, sizeof(p));
@@ -145,10 +200,22 @@ static int acd_send_packet(struct l_acd *acd, uint32_t source_ip)
 	return n;
 }
 
-static void announce_wait_timeout(struct l_timeout *timeout, void *user_data)
+static void acd_timer_cb(struct retransmit *rt, void *user_data)
 {
 	struct l_acd *acd = user_data;
 
+	acd->timer_func(acd);
+}
+
+static void acd_schedule_ms(struct l_acd *acd,
+				void (*func)(struct l_acd *acd), uint64_t ms)
+{
+	acd->timer_func = func;
+	_retransmit_schedule_ms(acd->timer, ms);
+}
+
+static void announce_wait_timeout(struct l_acd *acd)
+{
 	if (acd->state == ACD_STATE_PROBE) {
 		ACD_DEBUG("No conflicts found for "NIPQUAD_FMT ", announcing address",
 				NIPQUAD(acd->ip));
@@ -161,9 +228,13 @@ static void announce_wait_timeout(struct l_timeout *timeout, void *user_data)
 		 * "The host may begin legitimately using the IP address
 		 *  immediately after sending the first of the two ARP
 		 *  Announcements"
+		 *
+		 * With parallel probing the address has been in use since the
+		 * first probe, AVAILABLE was signalled then.
 		 */
 
-		if (acd->event_func)
+		if (acd->event_func &&
+				acd->probe_mode != L_ACD_PROBE_MODE_PARALLEL)
 			acd->event_func(L_ACD_EVENT_AVAILABLE, acd->user_data);
 	}
 
@@ -178,22 +249,20 @@ static void announce_wait_timeout(struct l_timeout *timeout, void *user_data)
 			return;
 		}
 
-		l_timeout_modify(acd->timeout, ANNOUNCE_INTERVAL);
+		acd_schedule_ms(acd, announce_wait_timeout,
+				ANNOUNCE_INTERVAL * L_MSEC_PER_SEC);
 
 		return;
 	}
 
-	l_timeout_remove(acd->timeout);
-	acd->timeout = NULL;
-
 	ACD_DEBUG("Done announcing");
 }
 
-static void probe_wait_timeout(struct l_timeout *timeout, void *user_data)
+static void probe_wait_timeout(struct l_acd *acd)
 {
-	struct l_acd *acd = user_data;
 	int err;
 	uint32_t delay;
+	bool first = !acd->retries;
 
 	ACD_DEBUG("Sending ACD Probe");
 
@@ -213,7 +282,7 @@ static void probe_wait_timeout(struct l_timeout *timeout, void *user_data)
 		 * to PROBE_MAX seconds apart."
 		 */
 		delay = _time_pick_interval_secs(PROBE_MIN, PROBE_MAX);
-		l_timeout_modify_ms(acd->timeout, delay);
+		acd_schedule_ms(acd, probe_wait_timeout, delay);
 	} else {
 		/*
 		 * Wait for ANNOUNCE_WAIT seconds after probe period before
@@ -221,60 +290,45 @@ static void probe_wait_timeout(struct l_timeout *timeout, void *user_data)
 		 */
 		ACD_DEBUG("Done probing");
 
-		l_timeout_remove(acd->timeout);
-		acd->timeout = NULL;
-
 		acd->retries = 1;
 
-		acd->timeout = l_timeout_create(ANNOUNCE_WAIT,
-							announce_wait_timeout,
-							acd, NULL);
+		acd_schedule_ms(acd, announce_wait_timeout,
+				ANNOUNCE_WAIT * L_MSEC_PER_SEC);
 	}
+
+	/*
+	 * The user may start using the address once the first parallel
+	 * probe is out, a conflict found later is signalled as LOST.  This
+	 * is done last as the handler may destroy @acd.
+	 */
+	if (acd->probe_mode == L_ACD_PROBE_MODE_PARALLEL && first &&
+			acd->event_func)
+		acd->event_func(L_ACD_EVENT_AVAILABLE, acd->user_data);
 }
 
-static void defend_wait_timeout(struct l_timeout *timeout, void *user_data)
+static void defend_wait_timeout(struct l_acd *acd)
 {
-	struct l_acd *acd = user_data;
-
-	l_timeout_remove(acd->timeout);
-	acd->timeout = NULL;
-
 	/* Successfully defended address */
 	acd->state = ACD_STATE_ANNOUNCED;
 }
 
-static bool acd_read_handler(struct l_io *io, void *user_data)
+static void acd_receive(struct l_acd *acd, const struct ether_arp *arp)
 {
-	struct l_acd *acd = user_data;
-	struct ether_arp arp;
-	ssize_t len;
 	int source_conflict;
 	int target_conflict;
 	bool probe;
 	int err;
 
-	memset(&arp, 0, sizeof(arp));
-	len = read(l_io_get_fd(acd->io), &arp, sizeof(arp));
-	if (len < 0)
-		return false;
-
-	if (len != sizeof(arp))
-		return true;
-
-	if (arp.arp_op != htons(ARPOP_REPLY) &&
-			arp.arp_op != htons(ARPOP_REQUEST))
-		return true;
-
-	if (memcmp(arp.arp_sha, acd->mac, ETH_ALEN) == 0)
-		return true;
+	if (memcmp(arp->arp_sha, acd->mac, ETH_ALEN) == 0)
+		return;
 
-	source_conflict = !memcmp(arp.arp_spa, &acd->ip, sizeof(uint32_t));
-	probe = l_memeqzero(arp.arp_spa, sizeof(uint32_t));
+	source_conflict = !memcmp(arp->arp_spa, &acd->ip, sizeof(uint32_t));
+	probe = l_memeqzero(arp->arp_spa, sizeof(uint32_t));
 	target_conflict = probe &&
-		!memcmp(arp.arp_tpa, &acd->ip, sizeof(uint32_t));
+		!memcmp(arp->arp_tpa, &acd->ip, sizeof(uint32_t));
 
 	if (!source_conflict && !target_conflict)
-		return true;
+		return;
 
 	switch (acd->state) {
 	case ACD_STATE_PROBE:
@@ -285,14 +339,21 @@ static bool acd_read_handler(struct l_io *io, void *user_data)
 
 		l_acd_stop(acd);
 
-		if (acd->event_func)
+		if (!acd->event_func)
+			break;
+
+		/* Parallel probing means the address may already be in use */
+		if (acd->probe_mode == L_ACD_PROBE_MODE_PARALLEL &&
+				acd->retries)
+			acd->event_func(L_ACD_EVENT_LOST, acd->user_data);
+		else
 			acd->event_func(L_ACD_EVENT_CONFLICT, acd->user_data);
 
 		break;
 	case ACD_STATE_ANNOUNCED:
 		/* Only defend packets with a source conflict */
 		if (!source_conflict)
-			return true;
+			return;
 
 		/*
 		 * RFC 5227 - Section 2.4 (a)
@@ -329,9 +390,6 @@ static bool acd_read_handler(struct l_io *io, void *user_data)
 		 * the timeout, send announce now, and still transition to the
 		 * defending state.
 		 */
-		if (acd->timeout)
-			l_timeout_remove(acd->timeout);
-
 		err = acd_send_packet(acd, acd->ip);
 		if (err < 0)
 			ACD_DEBUG("Failed to send initial announcement: %s",
@@ -339,13 +397,13 @@ static bool acd_read_handler(struct l_io *io, void *user_data)
 
 		ACD_DEBUG("Defending address");
 
-		acd->timeout = l_timeout_create(DEFEND_INTERVAL,
-						defend_wait_timeout, acd, NULL);
+		acd_schedule_ms(acd, defend_wait_timeout,
+				DEFEND_INTERVAL * L_MSEC_PER_SEC);
 
 		break;
 	case ACD_STATE_DEFEND:
 		if (!source_conflict)
-			return true;
+			return;
 
 		/*
 		 * RFC 5227 Section 2.4 (c)
@@ -355,7 +413,7 @@ static bool acd_read_handler(struct l_io *io, void *user_data)
 		 */
 		if (acd->policy == L_ACD_DEFEND_POLICY_INFINITE) {
 			ACD_DEBUG("Conflict "MAC" found with infinite policy",
-					MAC_STR(arp.arp_sha));
+					MAC_STR(arp->arp_sha));
 
 			/*
 			 * Nothing to do at this point. We are in the DEFEND
@@ -370,9 +428,6 @@ static bool acd_read_handler(struct l_io *io, void *user_data)
 			break;
 		}
 
-		l_timeout_remove(acd->timeout);
-		acd->timeout = NULL;
-
 		ACD_DEBUG("Lost address");
 		l_acd_stop(acd);
 
@@ -390,15 +445,131 @@ static bool acd_read_handler(struct l_io *io, void *user_data)
 		break;
 	}
 
+}
+
+static bool acd_monitor_read_handler(struct l_io *io, void *user_data)
+{
+	struct acd_monitor *monitor = user_data;
+	struct ether_arp arp;
+	ssize_t len;
+	uint32_t ip;
+	struct l_acd *acd;
+	struct l_acd *next;
+
+	memset(&arp, 0, sizeof(arp));
+	len = read(l_io_get_fd(io), &arp, sizeof(arp));
+	if (len < 0)
+		return false;
+
+	if (len != sizeof(arp))
+		return true;
+
+	/* Probes are matched on the target address, all else on the source */
+	memcpy(&ip, arp.arp_spa, sizeof(ip));
+
+	if (!ip)
+		memcpy(&ip, arp.arp_tpa, sizeof(ip));
+
+	/* Iterate safely since instances may be stopped */
+	for (acd = l_hashmap_lookup(monitor->watches, L_UINT_TO_PTR(ip));
+			acd; acd = next) {
+		next = acd->watch_next;
+		acd_receive(acd, &arp);
+	}
+
 	return true;
 }
 
+static struct acd_monitor *acd_monitor_ref(int ifindex)
+{
+	struct acd_monitor *monitor;
+	int fd;
+
+	monitor = l_hashmap_lookup(monitors, L_INT_TO_PTR(ifindex));
+	if (monitor)
+		goto done;
+
+	fd = acd_open_socket(ifindex);
+	if (fd < 0)
+		return NULL;
+
+	monitor = l_new(struct acd_monitor, 1);
+	monitor->ifindex = ifindex;
+	monitor->io = l_io_new(fd);
+	if (!monitor->io) {
+		close(fd);
+		l_free(monitor);
+		return NULL;
+	}
+
+	l_io_set_close_on_destroy(monitor->io, true);
+	l_io_set_read_handler(monitor->io, acd_monitor_read_handler,
+				monitor, NULL);
+	monitor->watches = l_hashmap_new();
+
+	if (!monitors)
+		monitors = l_hashmap_new();
+
+	l_hashmap_insert(monitors, L_INT_TO_PTR(ifindex), monitor);
+
+done:
+	monitor->ref++;
+	return monitor;
+}
+
+static void acd_monitor_unref(struct acd_monitor *monitor)
+{
+	if (--monitor->ref)
+		return;
+
+	l_hashmap_remove(monitors, L_INT_TO_PTR(monitor->ifindex));
+	l_io_destroy(monitor->io);
+	l_hashmap_destroy(monitor->watches, NULL);
+	l_free(monitor);
+
+	if (l_hashmap_isempty(monitors))
+		l_hashmap_destroy(l_steal_ptr(monitors), NULL);
+}
+
+static void acd_watch_add(struct l_acd *acd)
+{
+	struct l_hashmap *watches = acd->monitor->watches;
+	void *key = L_UINT_TO_PTR(acd->ip);
+
+	acd->watch_next = l_hashmap_lookup(watches, key);
+	l_hashmap_replace(watches, key, acd, NULL);
+}
+
+static void acd_watch_remove(struct l_acd *acd)
+{
+	struct l_hashmap *watches = acd->monitor->watches;
+	void *key = L_UINT_TO_PTR(acd->ip);
+	struct l_acd *head = l_hashmap_lookup(watches, key);
+	struct l_acd **p;
+
+	for (p = &head; *p; p = &(*p)->watch_next)
+		if (*p == acd)
+			break;
+
+	if (!*p)
+		return;
+
+	*p = acd->watch_next;
+	acd->watch_next = NULL;
+
+	if (head)
+		l_hashmap_replace(watches, key, head, NULL);
+	else
+		l_hashmap_remove(watches, key);
+}
+
 LIB_EXPORT struct l_acd *l_acd_new(int ifindex)
 {
 	struct l_acd *acd = l_new(struct l_acd, 1);
 
 	acd->ifindex = ifindex;
 	acd->policy = L_ACD_DEFEND_POLICY_DEFEND;
+	acd->timer = _retransmit_new(acd_timer_cb, acd);
 
 	return acd;
 }
@@ -406,31 +577,27 @@ LIB_EXPORT struct l_acd *l_acd_new(int ifindex)
 LIB_EXPORT bool l_acd_start(struct l_acd *acd, const char *ip)
 {
 	struct in_addr ia;
-	int fd;
 	uint32_t delay;
 
 	if (unlikely(!acd || !ip))
 		return false;
 
-	if (inet_pton(AF_INET, ip, &ia) != 1)
+	if (acd->monitor)
 		return false;
 
-	fd = acd_open_socket(acd->ifindex);
-	if (fd < 0)
+	if (inet_pton(AF_INET, ip, &ia) != 1)
 		return false;
 
 	if (l_memeqzero(acd->mac, ETH_ALEN) &&
 			!l_net_get_mac_address(acd->ifindex, acd->mac))
-		goto err;
-
-	acd->io = l_io_new(fd);
-	if (!acd->io)
-		goto err;
+		return false;
 
-	l_io_set_close_on_destroy(acd->io, true);
-	l_io_set_read_handler(acd->io, acd_read_handler, acd, NULL);
+	acd->monitor = acd_monitor_ref(acd->ifindex);
+	if (!acd->monitor)
+		return false;
 
 	acd->ip = ia.s_addr;
+	acd_watch_add(acd);
 
 	/*
 	 * Optimization to allows skipping the probe stage. The RFC does not
@@ -439,16 +606,28 @@ LIB_EXPORT bool l_acd_start(struct l_acd *acd, const char *ip)
 	 * recommended that probes be used for statically configured IP's where
 	 * no DHCP server is involved.
 	 */
-	if (acd->skip_probes) {
+	if (acd->probe_mode == L_ACD_PROBE_MODE_SKIP) {
 		ACD_DEBUG("Skipping probes and sending announcements");
 
 		acd->retries = 1;
 
-		announce_wait_timeout(NULL, acd);
+		announce_wait_timeout(acd);
 
 		return true;
-	} else
-		acd->state = ACD_STATE_PROBE;
+	}
+
+	acd->state = ACD_STATE_PROBE;
+	acd->retries = 0;
+
+	/*
+	 * For addresses known to be ours, e.g. from an earlier lease on the
+	 * same network, probe right away without holding back their use.
+	 */
+	if (acd->probe_mode == L_ACD_PROBE_MODE_PARALLEL) {
+		ACD_DEBUG("Probing in parallel with address use");
+		acd_schedule_ms(acd, probe_wait_timeout, 0);
+		return true;
+	}
 
 	delay = _time_pick_interval_secs(0, PROBE_WAIT);
 
@@ -460,14 +639,9 @@ LIB_EXPORT bool l_acd_start(struct l_acd *acd, const char *ip)
 	 *  time interval selected uniformly in the range zero to PROBE_WAIT
 	 *  seconds..."
 	 */
-	acd->timeout = l_timeout_create_ms(delay, probe_wait_timeout,
-							acd, NULL);
+	acd_schedule_ms(acd, probe_wait_timeout, delay);
 
 	return true;
-
-err:
-	close(fd);
-	return false;
 }
 
 LIB_EXPORT bool l_acd_set_event_handler(struct l_acd *acd,
@@ -490,14 +664,11 @@ LIB_EXPORT bool l_acd_stop(struct l_acd *acd)
 	if (unlikely(!acd))
 		return false;
 
-	if (acd->timeout) {
-		l_timeout_remove(acd->timeout);
-		acd->timeout = NULL;
-	}
+	_retransmit_cancel(acd->timer);
 
-	if (acd->io) {
-		l_io_destroy(acd->io);
-		acd->io = NULL;
+	if (acd->monitor) {
+		acd_watch_remove(acd);
+		acd_monitor_unref(l_steal_ptr(acd->monitor));
 	}
 
 	return true;
@@ -509,6 +680,7 @@ LIB_EXPORT void l_acd_destroy(struct l_acd *acd)
 		return;
 
 	l_acd_stop(acd);
+	_retransmit_free(acd->timer);
 
 	if (acd->destroy)
 		acd->destroy(acd->user_data);
@@ -536,10 +708,36 @@ LIB_EXPORT bool l_acd_set_skip_probes(struct l_acd *acd, bool skip)
 		return false;
 
 	/* ACD has already been started */
-	if (acd->io)
+	if (acd->monitor)
+		return false;
+
+	acd->probe_mode = skip ? L_ACD_PROBE_MODE_SKIP : L_ACD_PROBE_MODE_FULL;
+
+	return true;
+}
+
+/*
+ * Select how the address is probed before use.  L_ACD_PROBE_MODE_FULL
+ * follows RFC 5227 and only signals L_ACD_EVENT_AVAILABLE after the
+ * probe and announce waits, which add several seconds.  The other modes
+ * are meant for addresses that are known to belong to the host, e.g.
+ * leased earlier on the same network.  L_ACD_PROBE_MODE_SKIP announces
+ * and signals the address right away, the same as l_acd_set_skip_probes.
+ * L_ACD_PROBE_MODE_PARALLEL signals the address as soon as the first
+ * probe is sent and keeps probing as normal, a conflict found by the
+ * probes is then signalled as L_ACD_EVENT_LOST.
+ */
+LIB_EXPORT bool l_acd_set_probe_mode(struct l_acd *acd,
+					enum l_acd_probe_mode mode)
+{
+	if (unlikely(!acd))
+		return false;
+
+	/* ACD has already been started */
+	if (acd->monitor)
 		return false;
 
-	acd->skip_probes = skip;
+	acd->probe_mode = mode;
 
 	return true;
 }
@@ -551,7 +749,7 @@ LIB_EXPORT bool l_acd_set_defend_policy(struct l_acd *acd,
 		return false;
 
 	/* ACD has already been started */
-	if (acd->io)
+	if (acd->monitor)
 		return false;
 
 	acd->policy = policy;
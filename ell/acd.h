@@ -28,6 +28,12 @@ enum l_acd_defend_policy {
 	L_ACD_DEFEND_POLICY_INFINITE,	/* Defend indefinitely */
 };
 
+enum l_acd_probe_mode {
+	L_ACD_PROBE_MODE_FULL,		/* Default, probe before use */
+	L_ACD_PROBE_MODE_SKIP,		/* Announce and defend right away */
+	L_ACD_PROBE_MODE_PARALLEL,	/* Probe while the address is used */
+};
+
 typedef void (*l_acd_event_func_t)(enum l_acd_event event, void *user_data);
 typedef void (*l_acd_destroy_func_t)(void *user_data);
 
@@ -42,6 +48,7 @@ void l_acd_destroy(struct l_acd *acd);
 bool l_acd_set_debug(struct l_acd *acd, l_acd_debug_cb_t function,
 			void *user_data, l_acd_destroy_func_t destroy);
 bool l_acd_set_skip_probes(struct l_acd *acd, bool skip);
+bool l_acd_set_probe_mode(struct l_acd *acd, enum l_acd_probe_mode mode);
 bool l_acd_set_defend_policy(struct l_acd *acd,
 				enum l_acd_defend_policy policy);
 #ifdef __cplusplus
@@ -0,0 +1,26 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+struct alg_parent {
+	int sk;
+	pid_t pid;
+};
+
+int alg_accept(const char *type, const char *name,
+		const void *key, size_t key_len, size_t auth_size,
+		struct alg_parent *out_parent);
+void alg_release(const char *type, const char *name,
+			const struct alg_parent *parent);
+
+struct l_checksum;
+struct l_cipher;
+struct l_aead_cipher;
+
+/* Whether the object uses AF_ALG rather than an in-process implementation */
+bool checksum_uses_alg(const struct l_checksum *checksum);
+bool cipher_uses_alg(const struct l_cipher *cipher);
+bool aead_cipher_uses_alg(const struct l_aead_cipher *cipher);
@@ -0,0 +1,236 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "useful.h"
+#include "private.h"
+#include "alg-private.h"
+
+#ifndef HAVE_LINUX_IF_ALG_H
+#ifndef HAVE_LINUX_TYPES_H
+typedef uint8_t __u8;
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+#else
+#include <linux/types.h>
+#endif
+
+#ifndef AF_ALG
+#define AF_ALG	38
+#define PF_ALG	AF_ALG
+#endif
+
+struct sockaddr_alg {
+	__u16	salg_family;
+	__u8	salg_type[14];
+	__u32	salg_feat;
+	__u32	salg_mask;
+	__u8	salg_name[64];
+};
+
+/* Socket options */
+#define ALG_SET_KEY	1
+#else
+#include <linux/if_alg.h>
+#endif
+
+#ifndef SOL_ALG
+#define SOL_ALG 279
+#endif
+
+#ifndef ALG_SET_AEAD_AUTHSIZE
+#define ALG_SET_AEAD_AUTHSIZE	5
+#endif
+
+/*
+ * Pool of bound AF_ALG transform sockets.  Every l_checksum and l_cipher
+ * backed by the kernel needs an operation socket accepted from a parent
+ * that has been created, bound to the algorithm and possibly keyed.  An
+ * unkeyed parent is shared by all of its operation sockets.  A keyed one
+ * can only be given a new key once all of its operation sockets are
+ * closed, so the object keeps it until freed and then returns it here
+ * for the next object using the same algorithm.  The kernel keeps the old
+ * key until then.
+ *
+ * The pool is per thread.  A parent inherited through fork() could be
+ * re-keyed by both processes at once, so the pool is dropped in the child.
+ */
+#define ALG_POOL_ALGORITHMS	8
+#define ALG_POOL_PARENTS	4
+
+struct alg_pool_entry {
+	char type[14];
+	char name[64];
+	int parents[ALG_POOL_PARENTS];
+	unsigned int n_parents;
+};
+
+static __thread struct alg_pool_entry pool[ALG_POOL_ALGORITHMS];
+static __thread unsigned int pool_size;
+static __thread pid_t pool_pid;
+
+static struct alg_pool_entry *pool_lookup(const char *type, const char *name,
+						bool create)
+{
+	struct alg_pool_entry *entry;
+	pid_t pid = getpid();
+	unsigned int i;
+
+	if (pool_pid != pid) {
+		for (i = 0; i < pool_size; i++)
+			while (pool[i].n_parents)
+				close(pool[i].parents[--pool[i].n_parents]);
+
+		pool_size = 0;
+		pool_pid = pid;
+	}
+
+	for (i = 0; i < pool_size; i++)
+		if (!strcmp(pool[i].type, type) && !strcmp(pool[i].name, name))
+			return &pool[i];
+
+	if (!create || pool_size == ALG_POOL_ALGORITHMS ||
+			strlen(type) >= sizeof(entry->type) ||
+			strlen(name) >= sizeof(entry->name))
+		return NULL;
+
+	entry = &pool[pool_size++];
+	strcpy(entry->type, type);
+	strcpy(entry->name, name);
+	entry->n_parents = 0;
+	return entry;
+}
+
+static int alg_parent_new(const char *type, const char *name)
+{
+	struct sockaddr_alg salg;
+	int sk;
+
+	if (strlen(type) >= sizeof(salg.salg_type) ||
+			strlen(name) >= sizeof(salg.salg_name))
+		return -1;
+
+	sk = socket(PF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sk < 0)
+		return -1;
+
+	memset(&salg, 0, sizeof(salg));
+	salg.salg_family = AF_ALG;
+	strcpy((char *) salg.salg_type, type);
+	strcpy((char *) salg.salg_name, name);
+
+	if (bind(sk, (struct sockaddr *) &salg, sizeof(salg)) < 0) {
+		close(sk);
+		return -1;
+	}
+
+	return sk;
+}
+
+static int alg_parent_setup(int parent, const void *key, size_t key_len,
+				size_t auth_size)
+{
+	if (key && setsockopt(parent, SOL_ALG, ALG_SET_KEY,
+				key, key_len) < 0)
+		return -1;
+
+	if (auth_size && setsockopt(parent, SOL_ALG, ALG_SET_AEAD_AUTHSIZE,
+					NULL, auth_size) < 0)
+		return -1;
+
+	return 0;
+}
+
+static void pool_put(const char *type, const char *name, int parent)
+{
+	struct alg_pool_entry *entry = pool_lookup(type, name, true);
+
+	if (!entry || entry->n_parents == ALG_POOL_PARENTS) {
+		close(parent);
+		return;
+	}
+
+	entry->parents[entry->n_parents++] = parent;
+}
+
+/*
+ * Returns a new operation socket for the algorithm, reusing a pooled
+ * parent when possible.  If @key is given, the parent is returned in
+ * @out_parent and must be handed back with alg_release once the operation
+ * socket and any sockets accepted from it are closed, otherwise
+ * @out_parent->sk is set to -1.
+ */
+int alg_accept(const char *type, const char *name,
+		const void *key, size_t key_len, size_t auth_size,
+		struct alg_parent *out_parent)
+{
+	struct alg_pool_entry *entry = pool_lookup(type, name, false);
+	int parent = -1;
+	int sk;
+
+	if (entry && entry->n_parents)
+		parent = entry->parents[--entry->n_parents];
+
+	/* A pooled parent is busy if a clone of its last user is alive */
+	if (parent >= 0 && alg_parent_setup(parent, key, key_len,
+						auth_size) < 0) {
+		close(parent);
+		parent = -1;
+	}
+
+	if (parent < 0) {
+		parent = alg_parent_new(type, name);
+		if (parent < 0)
+			return -1;
+
+		if (alg_parent_setup(parent, key, key_len, auth_size) < 0) {
+			close(parent);
+			return -1;
+		}
+	}
+
+	sk = accept4(parent, NULL, 0, SOCK_CLOEXEC);
+	if (sk < 0) {
+		close(parent);
+		return -1;
+	}
+
+	if (key) {
+		out_parent->sk = parent;
+		out_parent->pid = pool_pid;
+	} else {
+		pool_put(type, name, parent);
+		out_parent->sk = -1;
+	}
+
+	return sk;
+}
+
+void alg_release(const char *type, const char *name,
+			const struct alg_parent *parent)
+{
+	if (parent->sk < 0)
+		return;
+
+	/* Inherited from the parent process, which may still re-key it */
+	if (parent->pid != getpid()) {
+		close(parent->sk);
+		return;
+	}
+
+	pool_put(type, name, parent->sk);
+}
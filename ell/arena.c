@@ -0,0 +1,417 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "private.h"
+#include "useful.h"
+
+/**
+ * SECTION:arena
+ * @short_description: Region based memory allocator
+ *
+ * Region based memory allocator
+ */
+
+#define ARENA_CHUNK_SIZE	4096
+#define ARENA_MIN_CHUNK_SIZE	256
+#define ARENA_ALIGN		__alignof__(max_align_t)
+
+#define ARENA_ROUND(size, align) (((size) + (align) - 1) & ~((align) - 1))
+
+#define CHUNK_HEADER	ARENA_ROUND(sizeof(struct arena_chunk), ARENA_ALIGN)
+#define CHUNK_DATA(chunk)	((uint8_t *) (chunk) + CHUNK_HEADER)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+};
+
+/**
+ * l_arena:
+ *
+ * Opaque object representing the arena.
+ */
+struct l_arena {
+	size_t chunk_size;
+	struct arena_chunk *chunks;
+	struct arena_chunk *spare;
+	uint8_t *pos;
+	uint8_t *end;
+};
+
+/**
+ * l_arena_new:
+ * @chunk_size: size of the memory blocks obtained from the system, or 0 to
+ *	use a default
+ *
+ * Create a new arena.  Allocating from an arena only moves a pointer
+ * forward within the current block, and individual allocations are never
+ * freed.  Instead, everything is released at once with l_arena_reset() or
+ * l_arena_free().  This suits data structures that are built up piece by
+ * piece and then thrown away together, such as the result of parsing a
+ * message or a file.
+ *
+ * An arena is not thread-safe.
+ *
+ * Returns: a newly allocated #l_arena object
+ **/
+LIB_EXPORT struct l_arena *l_arena_new(size_t chunk_size)
+{
+	struct l_arena *arena;
+
+	if (!chunk_size)
+		chunk_size = ARENA_CHUNK_SIZE;
+
+	arena = l_new(struct l_arena, 1);
+	arena->chunk_size = maxsize(chunk_size, ARENA_MIN_CHUNK_SIZE);
+
+	return arena;
+}
+
+static void chunk_release(struct l_arena *arena, struct arena_chunk *chunk)
+{
+	/* Keep one regular chunk around so that reuse does not hit malloc */
+	if (!arena->spare && chunk->size == arena->chunk_size) {
+		arena->spare = chunk;
+		return;
+	}
+
+	l_free(chunk);
+}
+
+/**
+ * l_arena_free:
+ * @arena: arena object
+ *
+ * Free @arena along with all the memory allocated from it.
+ **/
+LIB_EXPORT void l_arena_free(struct l_arena *arena)
+{
+	struct arena_chunk *chunk;
+
+	if (unlikely(!arena))
+		return;
+
+	while ((chunk = arena->chunks)) {
+		arena->chunks = chunk->next;
+		l_free(chunk);
+	}
+
+	l_free(arena->spare);
+	l_free(arena);
+}
+
+static void arena_grow(struct l_arena *arena, size_t size)
+{
+	struct arena_chunk *chunk;
+
+	/*
+	 * Whatever is left in the current chunk is given up.  Chunks are
+	 * strictly ordered this way, which is what keeps marks simple.
+	 */
+	if (size + CHUNK_HEADER <= arena->chunk_size) {
+		if (arena->spare) {
+			chunk = arena->spare;
+			arena->spare = NULL;
+		} else {
+			chunk = l_malloc(arena->chunk_size);
+			chunk->size = arena->chunk_size;
+		}
+	} else {
+		chunk = l_malloc(size + CHUNK_HEADER);
+		chunk->size = size + CHUNK_HEADER;
+	}
+
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+
+	arena->pos = CHUNK_DATA(chunk);
+	arena->end = (uint8_t *) chunk + chunk->size;
+}
+
+static void *arena_alloc(struct l_arena *arena, size_t size, size_t align)
+{
+	uintptr_t pos = ARENA_ROUND((uintptr_t) arena->pos, align);
+	void *ret;
+
+	if (!arena->pos || pos > (uintptr_t) arena->end ||
+				(uintptr_t) arena->end - pos < size) {
+		arena_grow(arena, size);
+		pos = (uintptr_t) arena->pos;
+	}
+
+	ret = (void *) pos;
+	arena->pos = ret + size;
+
+	return ret;
+}
+
+/**
+ * l_arena_alloc:
+ * @arena: arena object
+ * @size: number of bytes to allocate
+ *
+ * Allocate @size bytes from @arena, suitably aligned for any type.  Like
+ * l_malloc(), the memory is not initialized and allocation failures
+ * abort().
+ *
+ * Returns: pointer to the allocated memory, or NULL if @arena is NULL
+ **/
+LIB_EXPORT void *l_arena_alloc(struct l_arena *arena, size_t size)
+{
+	if (unlikely(!arena))
+		return NULL;
+
+	return arena_alloc(arena, size, ARENA_ALIGN);
+}
+
+/**
+ * l_arena_alloc0:
+ * @arena: arena object
+ * @size: number of bytes to allocate
+ *
+ * Same as l_arena_alloc(), but the memory is zeroed.
+ *
+ * Returns: pointer to the allocated memory, or NULL if @arena is NULL
+ **/
+LIB_EXPORT void *l_arena_alloc0(struct l_arena *arena, size_t size)
+{
+	if (unlikely(!arena))
+		return NULL;
+
+	return memset(arena_alloc(arena, size, ARENA_ALIGN), 0, size);
+}
+
+/**
+ * l_arena_mark:
+ * @arena: arena object
+ *
+ * Record the current allocation position of @arena, for use with
+ * l_arena_reset().
+ *
+ * Returns: an opaque mark, which may be NULL
+ **/
+LIB_EXPORT const void *l_arena_mark(struct l_arena *arena)
+{
+	if (unlikely(!arena))
+		return NULL;
+
+	return arena->pos;
+}
+
+/**
+ * l_arena_reset:
+ * @arena: arena object
+ * @mark: value returned by l_arena_mark() on @arena, or NULL
+ *
+ * Release all the memory allocated from @arena since @mark was taken.  A
+ * NULL @mark releases everything, leaving @arena as if it was just
+ * created.  Marks taken after @mark was are no longer valid afterwards.
+ **/
+LIB_EXPORT void l_arena_reset(struct l_arena *arena, const void *mark)
+{
+	struct arena_chunk *chunk;
+	uintptr_t pos = (uintptr_t) mark;
+
+	if (unlikely(!arena))
+		return;
+
+	while ((chunk = arena->chunks)) {
+		if (pos >= (uintptr_t) CHUNK_DATA(chunk) &&
+				pos <= (uintptr_t) chunk + chunk->size)
+			break;
+
+		arena->chunks = chunk->next;
+		chunk_release(arena, chunk);
+	}
+
+	if (!chunk) {
+		arena->pos = NULL;
+		arena->end = NULL;
+		return;
+	}
+
+	arena->pos = (uint8_t *) mark;
+	arena->end = (uint8_t *) chunk + chunk->size;
+}
+
+/**
+ * l_arena_memdup:
+ * @arena: arena object
+ * @mem: pointer to memory you want to duplicate
+ * @size: memory size
+ *
+ * Copy @size bytes of @mem into memory allocated from @arena.
+ *
+ * Returns: pointer to the copy, or NULL if @arena is NULL
+ **/
+LIB_EXPORT void *l_arena_memdup(struct l_arena *arena, const void *mem,
+								size_t size)
+{
+	if (unlikely(!arena) || !mem)
+		return NULL;
+
+	return memcpy(arena_alloc(arena, size, ARENA_ALIGN), mem, size);
+}
+
+/**
+ * l_arena_strdup:
+ * @arena: arena object
+ * @str: string pointer
+ *
+ * Same as l_strdup(), but the copy is allocated from @arena.
+ *
+ * Returns: pointer to the copy or NULL if @str or @arena is NULL
+ **/
+LIB_EXPORT char *l_arena_strdup(struct l_arena *arena, const char *str)
+{
+	if (!str)
+		return NULL;
+
+	return l_arena_strndup(arena, str, SIZE_MAX);
+}
+
+/**
+ * l_arena_strndup:
+ * @arena: arena object
+ * @str: string pointer
+ * @max: Maximum number of characters to copy
+ *
+ * Same as l_strndup(), but the copy is allocated from @arena.
+ *
+ * Returns: pointer to the copy or NULL if @str or @arena is NULL
+ **/
+LIB_EXPORT char *l_arena_strndup(struct l_arena *arena, const char *str,
+								size_t max)
+{
+	size_t len;
+	char *ret;
+
+	if (unlikely(!arena) || !str)
+		return NULL;
+
+	len = strnlen(str, max);
+	ret = arena_alloc(arena, len + 1, 1);
+	memcpy(ret, str, len);
+	ret[len] = '\0';
+
+	return ret;
+}
+
+/**
+ * l_arena_strdup_vprintf:
+ * @arena: arena object
+ * @format: string format
+ * @args: parameters to insert into format string
+ *
+ * Same as l_strdup_vprintf(), but the string is allocated from @arena.
+ *
+ * Returns: pointer to the string or NULL if @arena is NULL
+ **/
+LIB_EXPORT char *l_arena_strdup_vprintf(struct l_arena *arena,
+					const char *format, va_list args)
+{
+	size_t room;
+	va_list copy;
+	char *ret;
+	int len;
+
+	if (unlikely(!arena) || !format)
+		return NULL;
+
+	/* Try formatting straight into the current chunk first */
+	room = arena->pos ? (size_t) (arena->end - arena->pos) : 0;
+
+	va_copy(copy, args);
+	len = vsnprintf((char *) arena->pos, room, format, copy);
+	va_end(copy);
+
+	if (len < 0)
+		return NULL;
+
+	ret = arena_alloc(arena, len + 1, 1);
+
+	if ((size_t) len >= room)
+		vsnprintf(ret, len + 1, format, args);
+
+	return ret;
+}
+
+/**
+ * l_arena_strdup_printf:
+ * @arena: arena object
+ * @format: string format
+ * @...: parameters to insert into format string
+ *
+ * Same as l_strdup_printf(), but the string is allocated from @arena.
+ *
+ * Returns: pointer to the string or NULL if @arena is NULL
+ **/
+LIB_EXPORT char *l_arena_strdup_printf(struct l_arena *arena,
+						const char *format, ...)
+{
+	va_list args;
+	char *str;
+
+	va_start(args, format);
+	str = l_arena_strdup_vprintf(arena, format, args);
+	va_end(args);
+
+	return str;
+}
+
+/**
+ * l_arena_strsplit:
+ * @arena: arena object
+ * @str: String to split
+ * @sep: The delimiter character
+ *
+ * Same as l_strsplit(), but the array and the strings are allocated from
+ * @arena.  The result must not be freed with l_strfreev().
+ *
+ * Returns: A %NULL terminated string array, or NULL if @str or @arena is
+ * NULL.
+ **/
+LIB_EXPORT char **l_arena_strsplit(struct l_arena *arena, const char *str,
+							const char sep)
+{
+	unsigned int n;
+	unsigned int i;
+	const char *p;
+	char **ret;
+
+	if (unlikely(!arena) || !str)
+		return NULL;
+
+	n = str[0] ? 1 : 0;
+
+	for (p = str; *p; p++)
+		if (*p == sep)
+			n += 1;
+
+	ret = arena_alloc(arena, (n + 1) * sizeof(char *), ARENA_ALIGN);
+
+	for (i = 0, p = str; i < n; i++) {
+		const char *end = strchrnul(p, sep);
+
+		ret[i] = l_arena_strndup(arena, p, end - p);
+		p = end + 1;
+	}
+
+	ret[n] = NULL;
+
+	return ret;
+}
@@ -0,0 +1,44 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef __ELL_ARENA_H
+#define __ELL_ARENA_H
+
+#include <stddef.h>
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct l_arena;
+
+struct l_arena *l_arena_new(size_t chunk_size);
+void l_arena_free(struct l_arena *arena);
+
+void *l_arena_alloc(struct l_arena *arena, size_t size);
+void *l_arena_alloc0(struct l_arena *arena, size_t size);
+
+const void *l_arena_mark(struct l_arena *arena);
+void l_arena_reset(struct l_arena *arena, const void *mark);
+
+void *l_arena_memdup(struct l_arena *arena, const void *mem, size_t size);
+char *l_arena_strdup(struct l_arena *arena, const char *str);
+char *l_arena_strndup(struct l_arena *arena, const char *str, size_t max);
+char *l_arena_strdup_printf(struct l_arena *arena, const char *format, ...)
+					__attribute__((format(printf, 2, 3)));
+char *l_arena_strdup_vprintf(struct l_arena *arena, const char *format,
+					va_list args)
+					__attribute__((format(printf, 2, 0)));
+char **l_arena_strsplit(struct l_arena *arena, const char *str,
+							const char sep);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ELL_ARENA_H */
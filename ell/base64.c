@@ -10,102 +10,532 @@
 #endif
 
 #include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 
 #include "utf8.h"
 #include "base64.h"
 #include "private.h"
 #include "useful.h"
 
-#include <stdio.h>
+struct l_base64_decoder {
+	uint32_t reg;
+	unsigned int n_chars;	/* Characters in reg, always less than 4 */
+	unsigned int n_pad;
+};
 
-LIB_EXPORT uint8_t *l_base64_decode(const char *in, size_t in_len,
-					size_t *n_written)
+static int decode_char(char c)
 {
-	const char *ptr, *in_end = in + in_len;
-	const char *base64_end = NULL;
-	uint8_t *out_buf, *out;
-	int base64_len = 0, pad_len = 0;
-	uint16_t reg = 0;
-
-	for (ptr = in; ptr < in_end; ptr++) {
-		if (l_ascii_isspace(*ptr))
-			/* Whitespace */
-			continue;
-		else if (*ptr == '=') {
-			/* Final padding */
-			if (!pad_len)
-				base64_end = ptr;
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A' + 0;
+	else if (c >= 'a' && c <= 'z')
+		return c - 'a' + 26;
+	else if (c >= '0' && c <= '9')
+		return c - '0' + 52;
+	else if (c == '+')
+		return 62;
+	else if (c == '/')
+		return 63;
+
+	return -1;
+}
+
+static char encode_char(uint8_t idx)
+{
+	if (idx < 26)
+		return idx + 'A';
+	else if (idx < 52)
+		return idx - 26 + 'a';
+	else if (idx < 62)
+		return idx - 52 + '0';
+
+	return (idx == 62) ? '+' : '/';
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/*
+ * Vectorized codecs after Wojciech Muła and Daniel Lemire, "Faster Base64
+ * Encoding and Decoding Using AVX2 Instructions".  The decoders only
+ * handle blocks made up entirely of alphabet characters and leave
+ * whitespace and padding to the scalar code.  Both directions load and
+ * store 16 or 32 bytes at a time while consuming or producing fewer, so
+ * the callers make sure that much input or output space is available.
+ */
+#define BASE64_SSSE3_TARGET __attribute__((target("ssse3")))
+#define BASE64_AVX2_TARGET __attribute__((target("avx2")))
+
+static bool base64_ssse3_is_supported(void)
+{
+	return __builtin_cpu_supports("ssse3");
+}
+
+static bool base64_avx2_is_supported(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+static BASE64_SSSE3_TARGET bool decode_16_ssse3(const char *in, uint8_t *out)
+{
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11,
+						0x11, 0x11, 0x11, 0x11,
+						0x11, 0x11, 0x13, 0x1a,
+						0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02,
+						0x04, 0x08, 0x04, 0x08,
+						0x10, 0x10, 0x10, 0x10,
+						0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+						0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	__m128i str = _mm_loadu_si128((const __m128i *) in);
+	__m128i hi = _mm_and_si128(_mm_srli_epi32(str, 4), nibble);
+	__m128i lo = _mm_and_si128(str, nibble);
+	__m128i bad;
+	__m128i roll;
+
+	bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo),
+				_mm_shuffle_epi8(lut_hi, hi));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) !=
+			0xffff)
+		return false;
+
+	roll = _mm_add_epi8(_mm_cmpeq_epi8(str, _mm_set1_epi8('/')), hi);
+	str = _mm_add_epi8(str, _mm_shuffle_epi8(lut_roll, roll));
+
+	/* Pack the 6-bit values into 24-bit groups, then drop the gaps */
+	str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+	str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+	str = _mm_shuffle_epi8(str, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+							8, 14, 13, 12,
+							-1, -1, -1, -1));
+	_mm_storeu_si128((__m128i *) out, str);
+	return true;
+}
+
+static BASE64_AVX2_TARGET bool decode_32_avx2(const char *in, uint8_t *out)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11,
+						0x11, 0x11, 0x11, 0x11,
+						0x11, 0x11, 0x13, 0x1a,
+						0x1b, 0x1b, 0x1b, 0x1a,
+						0x15, 0x11, 0x11, 0x11,
+						0x11, 0x11, 0x11, 0x11,
+						0x11, 0x11, 0x13, 0x1a,
+						0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02,
+						0x04, 0x08, 0x04, 0x08,
+						0x10, 0x10, 0x10, 0x10,
+						0x10, 0x10, 0x10, 0x10,
+						0x10, 0x10, 0x01, 0x02,
+						0x04, 0x08, 0x04, 0x08,
+						0x10, 0x10, 0x10, 0x10,
+						0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4,
+						-65, -65, -71, -71,
+						0, 0, 0, 0, 0, 0, 0, 0,
+						0, 16, 19, 4,
+						-65, -65, -71, -71,
+						0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	__m256i str = _mm256_loadu_si256((const __m256i *) in);
+	__m256i hi = _mm256_and_si256(_mm256_srli_epi32(str, 4), nibble);
+	__m256i lo = _mm256_and_si256(str, nibble);
+	__m256i bad;
+	__m256i roll;
+
+	bad = _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, lo),
+				_mm256_shuffle_epi8(lut_hi, hi));
+	if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(bad,
+						_mm256_setzero_si256())) != -1)
+		return false;
+
+	roll = _mm256_add_epi8(_mm256_cmpeq_epi8(str, _mm256_set1_epi8('/')),
+				hi);
+	str = _mm256_add_epi8(str, _mm256_shuffle_epi8(lut_roll, roll));
+
+	str = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+	str = _mm256_madd_epi16(str, _mm256_set1_epi32(0x00011000));
+	str = _mm256_shuffle_epi8(str, _mm256_setr_epi8(2, 1, 0, 6, 5, 4,
+							10, 9, 8, 14, 13, 12,
+							-1, -1, -1, -1,
+							2, 1, 0, 6, 5, 4,
+							10, 9, 8, 14, 13, 12,
+							-1, -1, -1, -1));
+	str = _mm256_permutevar8x32_epi32(str,
+				_mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+	_mm256_storeu_si256((__m256i *) out, str);
+	return true;
+}
+
+static BASE64_SSSE3_TARGET __m128i encode_translate_ssse3(__m128i indices)
+{
+	const __m128i lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+						'0' - 52, '0' - 52, '0' - 52,
+						'0' - 52, '0' - 52, '0' - 52,
+						'0' - 52, '0' - 52, '+' - 62,
+						'/' - 63, 'A', 0, 0);
+	__m128i offset = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	__m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+
+	offset = _mm_or_si128(offset, _mm_and_si128(upper, _mm_set1_epi8(13)));
+	return _mm_add_epi8(indices, _mm_shuffle_epi8(lut, offset));
+}
+
+static BASE64_SSSE3_TARGET void encode_12_ssse3(const uint8_t *in, char *out)
+{
+	__m128i str = _mm_loadu_si128((const __m128i *) in);
+	__m128i t0, t1;
+
+	/* Spread each 3 byte group into 4 bytes holding 6 bits each */
+	str = _mm_shuffle_epi8(str, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+							7, 6, 8, 7,
+							10, 9, 11, 10));
+	t0 = _mm_mulhi_epu16(_mm_and_si128(str, _mm_set1_epi32(0x0fc0fc00)),
+				_mm_set1_epi32(0x04000040));
+	t1 = _mm_mullo_epi16(_mm_and_si128(str, _mm_set1_epi32(0x003f03f0)),
+				_mm_set1_epi32(0x01000010));
+
+	_mm_storeu_si128((__m128i *) out,
+				encode_translate_ssse3(_mm_or_si128(t0, t1)));
+}
+
+static BASE64_AVX2_TARGET void encode_24_avx2(const uint8_t *in, char *out)
+{
+	const __m256i lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+						'0' - 52, '0' - 52, '0' - 52,
+						'0' - 52, '0' - 52, '0' - 52,
+						'0' - 52, '0' - 52, '+' - 62,
+						'/' - 63, 'A', 0, 0,
+						'a' - 26, '0' - 52, '0' - 52,
+						'0' - 52, '0' - 52, '0' - 52,
+						'0' - 52, '0' - 52, '0' - 52,
+						'0' - 52, '0' - 52, '+' - 62,
+						'/' - 63, 'A', 0, 0);
+	__m256i str, t0, t1, offset, upper;
+
+	str = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) in));
+	str = _mm256_inserti128_si256(str,
+				_mm_loadu_si128((const __m128i *) (in + 12)),
+				1);
+
+	str = _mm256_shuffle_epi8(str, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+							7, 6, 8, 7,
+							10, 9, 11, 10,
+							1, 0, 2, 1, 4, 3, 5, 4,
+							7, 6, 8, 7,
+							10, 9, 11, 10));
+	t0 = _mm256_mulhi_epu16(_mm256_and_si256(str,
+					_mm256_set1_epi32(0x0fc0fc00)),
+				_mm256_set1_epi32(0x04000040));
+	t1 = _mm256_mullo_epi16(_mm256_and_si256(str,
+					_mm256_set1_epi32(0x003f03f0)),
+				_mm256_set1_epi32(0x01000010));
+	str = _mm256_or_si256(t0, t1);
+
+	offset = _mm256_subs_epu8(str, _mm256_set1_epi8(51));
+	upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), str);
+	offset = _mm256_or_si256(offset,
+				_mm256_and_si256(upper, _mm256_set1_epi8(13)));
+	str = _mm256_add_epi8(str, _mm256_shuffle_epi8(lut, offset));
+
+	_mm256_storeu_si256((__m256i *) out, str);
+}
+#endif
+
+/*
+ * Decodes as much of @in as possible, starting with and leaving behind
+ * the partial quantum in @decoder.  A quantum may be split by whitespace
+ * anywhere, so line-wrapped input is handled without a separate pass.
+ */
+static ssize_t decode_update(struct l_base64_decoder *decoder,
+				const char *in, size_t in_len,
+				uint8_t *out, size_t out_size)
+{
+	const char *in_end = in + in_len;
+	uint8_t *out_start = out, *out_end = out + out_size;
+	uint32_t reg = decoder->reg;
+	unsigned int n_chars = decoder->n_chars;
+	unsigned int n_pad = decoder->n_pad;
+#if defined(__x86_64__) && defined(__GNUC__)
+	bool avx2 = base64_avx2_is_supported();
+	bool ssse3 = base64_ssse3_is_supported();
+#endif
 
-			pad_len++;
-		} else if (!pad_len && (l_ascii_isalnum(*ptr) || *ptr == '+' ||
-					*ptr == '/'))
+	while (in < in_end) {
+		int val;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+		if (!n_chars && !n_pad) {
+			while (avx2 && in_end - in >= 32 &&
+					out_end - out >= 32 &&
+					decode_32_avx2(in, out)) {
+				in += 32;
+				out += 24;
+			}
+
+			while (ssse3 && in_end - in >= 16 &&
+					out_end - out >= 16 &&
+					decode_16_ssse3(in, out)) {
+				in += 16;
+				out += 12;
+			}
+
+			if (in == in_end)
+				break;
+		}
+#endif
+
+		val = decode_char(*in);
+
+		if (val >= 0) {
 			/* Base64 character */
-			base64_len++;
-		else
+			if (n_pad)
+				return -EINVAL;
+
+			reg = (reg << 6) | val;
+
+			if (++n_chars == 4) {
+				if (out_end - out < 3)
+					return -ENOSPC;
+
+				*out++ = reg >> 16;
+				*out++ = reg >> 8;
+				*out++ = reg >> 0;
+				n_chars = 0;
+			}
+		} else if (*in == '=')
+			/* Final padding */
+			n_pad++;
+		else if (!l_ascii_isspace(*in))
 			/* Bad character */
-			return NULL;
+			return -EINVAL;
+
+		in++;
 	}
 
-	if (ptr != in_end)
-		return NULL;
+	decoder->reg = reg;
+	decoder->n_chars = n_chars;
+	decoder->n_pad = n_pad;
 
-	if ((base64_len & 3) == 1)
-		/* Invalid length */
-		return NULL;
+	return out - out_start;
+}
 
-	if (pad_len != align_len(base64_len, 4) - base64_len)
-		return NULL;
+static ssize_t decode_finish(struct l_base64_decoder *decoder,
+				uint8_t *out, size_t out_size)
+{
+	uint32_t reg = decoder->reg;
+	unsigned int n_chars = decoder->n_chars;
+	unsigned int n_pad = decoder->n_pad;
 
-	/* No padding */
-	if (!base64_end)
-		base64_end = ptr;
+	if (n_chars == 1 || n_pad != (4 - n_chars) % 4)
+		return -EINVAL;
 
-	*n_written = base64_len * 3 / 4;
-	out_buf = l_malloc(*n_written);
+	if (n_chars && out_size < n_chars - 1)
+		return -ENOSPC;
 
-	out = out_buf;
-	base64_len = 0;
-
-	for (ptr = in; ptr < base64_end; ptr++) {
-		if (l_ascii_isspace(*ptr))
-			/* Whitespace */
-			continue;
-
-		/* Base64 character */
-		reg <<= 6;
-		if (l_ascii_isupper(*ptr))
-			reg |= *ptr - 'A' + 0;
-		else if (l_ascii_islower(*ptr))
-			reg |= *ptr - 'a' + 26;
-		else if (l_ascii_isdigit(*ptr))
-			reg |= *ptr - '0' + 52;
-		else if (*ptr == '+')
-			reg |= 62;
-		else if (*ptr == '/')
-			reg |= 63;
-
-		if ((base64_len & 3) == 1)
-			*out++ = reg >> 4;
-		else if ((base64_len & 3) == 2)
-			*out++ = reg >> 2;
-		else if ((base64_len & 3) == 3)
-			*out++ = reg >> 0;
-
-		base64_len++;
+	if (n_chars == 2)
+		out[0] = reg >> 4;
+	else if (n_chars == 3) {
+		out[0] = reg >> 10;
+		out[1] = reg >> 2;
 	}
 
+	return n_chars ? n_chars - 1 : 0;
+}
+
+/**
+ * l_base64_decoder_new:
+ *
+ * Creates a decoder for base64 input arriving in chunks, see
+ * l_base64_decoder_update().
+ *
+ * Returns: a newly allocated #l_base64_decoder object
+ **/
+LIB_EXPORT struct l_base64_decoder *l_base64_decoder_new(void)
+{
+	return l_new(struct l_base64_decoder, 1);
+}
+
+/**
+ * l_base64_decoder_free:
+ * @decoder: decoder object
+ *
+ * Frees the decoder and any input it has buffered.
+ **/
+LIB_EXPORT void l_base64_decoder_free(struct l_base64_decoder *decoder)
+{
+	l_free(decoder);
+}
+
+/**
+ * l_base64_decoder_update:
+ * @decoder: decoder object
+ * @in: next chunk of base64 input
+ * @in_len: length of @in
+ * @out: buffer receiving the decoded bytes
+ * @out_size: size of @out
+ *
+ * Decodes the next @in_len characters of the input, which may be split
+ * at any point, including the middle of a line or of a 4 character
+ * group.  Up to three characters of an incomplete group are kept in
+ * @decoder until the next call.  An @out_size of (@in_len + 3) / 4 * 3
+ * is always enough.
+ *
+ * On error the state of @decoder is undefined and it must be freed.
+ *
+ * Returns: the number of bytes written to @out, -EINVAL if the input is
+ * not valid base64 or -ENOSPC if @out is too small
+ **/
+LIB_EXPORT ssize_t l_base64_decoder_update(struct l_base64_decoder *decoder,
+						const char *in, size_t in_len,
+						uint8_t *out, size_t out_size)
+{
+	if (unlikely(!decoder || (in_len && !in)))
+		return -EINVAL;
+
+	return decode_update(decoder, in, in_len, out, out_size);
+}
+
+/**
+ * l_base64_decoder_finish:
+ * @decoder: decoder object
+ * @out: buffer receiving the last decoded bytes
+ * @out_size: size of @out, 2 bytes are always enough
+ *
+ * Checks that the input ended on a group boundary or with valid padding
+ * and writes out the bytes of the final padded group.  The decoder is
+ * reset on success and can be used for new input.
+ *
+ * Returns: the number of bytes written to @out, -EINVAL if the input was
+ * truncated or -ENOSPC if @out is too small
+ **/
+LIB_EXPORT ssize_t l_base64_decoder_finish(struct l_base64_decoder *decoder,
+						uint8_t *out, size_t out_size)
+{
+	ssize_t r;
+
+	if (unlikely(!decoder))
+		return -EINVAL;
+
+	r = decode_finish(decoder, out, out_size);
+	if (r >= 0)
+		memset(decoder, 0, sizeof(*decoder));
+
+	return r;
+}
+
+/**
+ * l_base64_decode_into:
+ * @in: base64 input
+ * @in_len: length of @in
+ * @out: buffer receiving the decoded bytes
+ * @out_size: size of @out
+ *
+ * Decodes @in like l_base64_decode() into a buffer provided by the caller.
+ * An @out_size of @in_len / 4 * 3 + 2 is always enough.
+ *
+ * Returns: the number of bytes written to @out, -EINVAL if the input is
+ * not valid base64 or -ENOSPC if @out is too small
+ **/
+LIB_EXPORT ssize_t l_base64_decode_into(const char *in, size_t in_len,
+					uint8_t *out, size_t out_size)
+{
+	struct l_base64_decoder decoder = {};
+	ssize_t len;
+	ssize_t r;
+
+	if (unlikely(in_len && !in))
+		return -EINVAL;
+
+	len = decode_update(&decoder, in, in_len, out, out_size);
+	if (len < 0)
+		return len;
+
+	r = decode_finish(&decoder, out + len, out_size - len);
+	if (r < 0)
+		return r;
+
+	return len + r;
+}
+
+LIB_EXPORT uint8_t *l_base64_decode(const char *in, size_t in_len,
+					size_t *n_written)
+{
+	size_t size = in_len / 4 * 3 + 2;
+	uint8_t *out_buf;
+	ssize_t len;
+
+	out_buf = l_malloc(size);
+
+	len = l_base64_decode_into(in, in_len, out_buf, size);
+	if (len <= 0) {
+		l_free(out_buf);
+		return NULL;
+	}
+
+	*n_written = len;
 	return out_buf;
 }
 
+/*
+ * Encodes @n_groups complete 3 byte groups from *@in_ptr.  The vectorized
+ * paths read up to 4 bytes past the groups they consume so they are only
+ * used while that much of the input is left before @in_end.
+ */
+static char *encode_groups(const uint8_t **in_ptr, const uint8_t *in_end,
+				size_t n_groups, char *out)
+{
+	const uint8_t *in = *in_ptr;
+	uint32_t reg;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (n_groups >= 8 && base64_avx2_is_supported()) {
+		while (n_groups >= 8 && in_end - in >= 28) {
+			encode_24_avx2(in, out);
+			in += 24;
+			out += 32;
+			n_groups -= 8;
+		}
+	}
+
+	if (n_groups >= 4 && base64_ssse3_is_supported()) {
+		while (n_groups >= 4 && in_end - in >= 16) {
+			encode_12_ssse3(in, out);
+			in += 12;
+			out += 16;
+			n_groups -= 4;
+		}
+	}
+#endif
+
+	while (n_groups--) {
+		reg = (in[0] << 16) | (in[1] << 8) | in[2];
+		in += 3;
+
+		*out++ = encode_char((reg >> 18) & 63);
+		*out++ = encode_char((reg >> 12) & 63);
+		*out++ = encode_char((reg >> 6) & 63);
+		*out++ = encode_char(reg & 63);
+	}
+
+	*in_ptr = in;
+	return out;
+}
+
 LIB_EXPORT char *l_base64_encode(const uint8_t *in, size_t in_len, int columns)
 {
 	const uint8_t *in_end = in + in_len;
+	size_t n_groups = in_len / 3;
+	size_t line_groups = SIZE_MAX;
+	size_t col = 0;
 	char *out_buf, *out;
 	size_t out_len;
 	uint32_t reg;
-	uint8_t idx;
-	int i, pad = 4;
-	int col = 0;
 
 	/* For simplicity allow multiples of 4 only */
 	if (columns & 3)
@@ -113,49 +543,45 @@ LIB_EXPORT char *l_base64_encode(const uint8_t *in, size_t in_len, int columns)
 
 	out_len = (in_len + 2) / 3 * 4;
 
-	if (columns && out_len)
-		out_len += (out_len - 4) / columns;
+	if (columns > 0) {
+		line_groups = columns / 4;
+
+		if (out_len)
+			out_len += (out_len - 4) / columns;
+	}
 
 	out_buf = l_malloc(out_len + 1);
 
 	out = out_buf;
 
-	while (in < in_end) {
-		reg = *in++ << 16;
-
-		if (in < in_end)
-			reg |= *in++ << 8;
-		else
-			pad--;
+	while (n_groups) {
+		size_t n;
 
-		if (in < in_end)
-			reg |= *in++ << 0;
-		else
-			pad--;
-
-		if (columns && col == columns) {
+		if (col == line_groups) {
 			*out++ = '\n';
 			col = 0;
 		}
-		col += 4;
-
-		for (i = 0; i < pad; i++) {
-			idx = (reg >> 18) & 63;
-			reg <<= 6;
-
-			if (idx < 26)
-				*out++ = idx + 'A';
-			else if (idx < 52)
-				*out++ = idx - 26 + 'a';
-			else if (idx < 62)
-				*out++ = idx - 52 + '0';
-			else
-				*out++ = (idx == 62) ? '+' : '/';
-		}
+
+		n = minsize(line_groups - col, n_groups);
+		out = encode_groups(&in, in_end, n, out);
+		col += n;
+		n_groups -= n;
 	}
 
-	for (; pad < 4; pad++)
+	if (in < in_end) {
+		/* Final group of 1 or 2 bytes, padded */
+		if (col == line_groups)
+			*out++ = '\n';
+
+		reg = in[0] << 16;
+		if (in_end - in == 2)
+			reg |= in[1] << 8;
+
+		*out++ = encode_char((reg >> 18) & 63);
+		*out++ = encode_char((reg >> 12) & 63);
+		*out++ = in_end - in == 2 ? encode_char((reg >> 6) & 63) : '=';
 		*out++ = '=';
+	}
 
 	*out = '\0';
 
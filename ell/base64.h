@@ -8,11 +8,26 @@
 #ifndef __ELL_BASE64_H
 #define __ELL_BASE64_H
 
+#include <stdint.h>
+#include <sys/types.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct l_base64_decoder;
+
 uint8_t *l_base64_decode(const char *in, size_t in_len, size_t *n_written);
+ssize_t l_base64_decode_into(const char *in, size_t in_len,
+				uint8_t *out, size_t out_size);
+
+struct l_base64_decoder *l_base64_decoder_new(void);
+void l_base64_decoder_free(struct l_base64_decoder *decoder);
+ssize_t l_base64_decoder_update(struct l_base64_decoder *decoder,
+				const char *in, size_t in_len,
+				uint8_t *out, size_t out_size);
+ssize_t l_base64_decoder_finish(struct l_base64_decoder *decoder,
+				uint8_t *out, size_t out_size);
 
 char *l_base64_encode(const uint8_t *in, size_t in_len, int columns);
 
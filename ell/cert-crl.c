@@ -0,0 +1,618 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "private.h"
+#include "useful.h"
+#include "queue.h"
+#include "hashmap.h"
+#include "file.h"
+#include "checksum.h"
+#include "pem-private.h"
+#include "asn1-private.h"
+#include "cert.h"
+#include "cert-private.h"
+
+/*
+ * Certificate Revocation Lists indexed by issuer DN.  The serial numbers
+ * of each CRL are kept in a sorted array of fixed-size records, with a
+ * Bloom filter in front of it so that the common case, a certificate
+ * that isn't revoked, is answered without the binary search and without
+ * touching the array.  Each CRL's signature is checked against the
+ * issuer certificate the first time the CRL is used.
+ */
+#define CRL_SERIAL_MAX		20
+#define CRL_RECORD_SIZE		(1 + CRL_SERIAL_MAX)
+#define CRL_BLOOM_BITS		10	/* Per serial, about 1% false hits */
+#define CRL_BLOOM_HASHES	7
+
+struct crl {
+	uint8_t *der;
+	size_t der_len;
+	const uint8_t *issuer;
+	size_t issuer_len;
+	uint8_t *serials;
+	unsigned int n_serials;
+	uint64_t *bloom;
+	unsigned int bloom_bits;
+	uint8_t *signer_key;
+	size_t signer_key_len;
+	struct crl *next;
+};
+
+struct l_crl_store {
+	struct l_hashmap *issuers;
+	unsigned int n_crls;
+	pthread_mutex_t lock;
+};
+
+static unsigned int crl_dn_hash(const void *p)
+{
+	const struct crl *crl = p;
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < crl->issuer_len; i++)
+		hash = (hash ^ crl->issuer[i]) * 16777619u;
+
+	return hash;
+}
+
+static int crl_dn_compare(const void *a, const void *b)
+{
+	const struct crl *crl1 = a;
+	const struct crl *crl2 = b;
+
+	if (crl1->issuer_len != crl2->issuer_len)
+		return crl1->issuer_len < crl2->issuer_len ? -1 : 1;
+
+	return memcmp(crl1->issuer, crl2->issuer, crl1->issuer_len);
+}
+
+static void crl_free(void *data)
+{
+	struct crl *crl = data;
+
+	while (crl) {
+		struct crl *next = crl->next;
+
+		l_free(crl->der);
+		l_free(crl->serials);
+		l_free(crl->bloom);
+		l_free(crl->signer_key);
+		l_free(crl);
+		crl = next;
+	}
+}
+
+static const uint8_t *crl_next_elem(const uint8_t **buf, size_t *len,
+					uint8_t *out_tag, size_t *out_len)
+{
+	const uint8_t *ptr = *buf;
+	size_t left = *len;
+	int elem_len;
+
+	if (left < 2)
+		return NULL;
+
+	*out_tag = *ptr++;
+	left--;
+
+	elem_len = asn1_parse_definite_length(&ptr, &left);
+	if (elem_len < 0 || (size_t) elem_len > left)
+		return NULL;
+
+	*buf = ptr + elem_len;
+	*len = left - elem_len;
+	*out_len = elem_len;
+	return ptr;
+}
+
+/*
+ * Serial numbers are compared as unsigned big-endian numbers, ignoring
+ * any leading zeros, in a zero-padded record prefixed by their length.
+ */
+static bool crl_serial_to_record(const uint8_t *serial, size_t len,
+					uint8_t *record)
+{
+	while (len > 1 && serial[0] == 0) {
+		serial++;
+		len--;
+	}
+
+	if (!len || len > CRL_SERIAL_MAX)
+		return false;
+
+	memset(record, 0, CRL_RECORD_SIZE);
+	record[0] = len;
+	memcpy(record + 1, serial, len);
+	return true;
+}
+
+static int crl_record_compare(const void *a, const void *b)
+{
+	return memcmp(a, b, CRL_RECORD_SIZE);
+}
+
+static uint64_t crl_record_hash(const uint8_t *record)
+{
+	uint64_t hash = 14695981039346656037ull;
+	unsigned int i;
+
+	for (i = 0; i <= record[0]; i++)
+		hash = (hash ^ record[i]) * 1099511628211ull;
+
+	return hash;
+}
+
+/* Double hashing, see Kirsch and Mitzenmacher */
+#define CRL_BLOOM_FOREACH(hash, bits, i, bit)				\
+	for (i = 0, bit = (uint32_t) (hash) % (bits);			\
+		i < CRL_BLOOM_HASHES;					\
+		i++, bit = ((uint32_t) (hash) + i *			\
+			(((hash) >> 32) | 1)) % (bits))
+
+static void crl_bloom_add(struct crl *crl, const uint8_t *record)
+{
+	uint64_t hash = crl_record_hash(record);
+	unsigned int i;
+	uint64_t bit;
+
+	CRL_BLOOM_FOREACH(hash, crl->bloom_bits, i, bit)
+		crl->bloom[bit / 64] |= 1ull << (bit % 64);
+}
+
+static bool crl_lookup(const struct crl *crl, const uint8_t *record)
+{
+	uint64_t hash = crl_record_hash(record);
+	unsigned int i;
+	uint64_t bit;
+
+	if (!crl->n_serials)
+		return false;
+
+	CRL_BLOOM_FOREACH(hash, crl->bloom_bits, i, bit)
+		if (!(crl->bloom[bit / 64] & (1ull << (bit % 64))))
+			return false;
+
+	return bsearch(record, crl->serials, crl->n_serials,
+			CRL_RECORD_SIZE, crl_record_compare) != NULL;
+}
+
+/*
+ * RFC 5280 Section 5.3: a CRL with a critical extension that isn't
+ * understood, including one in an entry, must not be used.  None are
+ * understood here, which rules out delta and indirect CRLs.
+ */
+static bool crl_extensions_ok(const uint8_t *exts, size_t exts_len)
+{
+	while (exts_len) {
+		const uint8_t *ext;
+		const uint8_t *critical;
+		size_t ext_len;
+		size_t len;
+		uint8_t tag;
+
+		ext = crl_next_elem(&exts, &exts_len, &tag, &ext_len);
+		if (!ext || tag != ASN1_ID_SEQUENCE)
+			return false;
+
+		if (!crl_next_elem(&ext, &ext_len, &tag, &len) ||
+				tag != ASN1_ID_OID)
+			return false;
+
+		critical = crl_next_elem(&ext, &ext_len, &tag, &len);
+		if (critical && tag == ASN1_ID_BOOLEAN && len == 1 &&
+				critical[0])
+			return false;
+	}
+
+	return true;
+}
+
+static struct crl *crl_parse(const uint8_t *der, size_t der_len)
+{
+	struct crl *crl;
+	const uint8_t *seq;
+	const uint8_t *tbs;
+	const uint8_t *elem;
+	const uint8_t *revoked = NULL;
+	size_t seq_len;
+	size_t tbs_len;
+	size_t elem_len;
+	size_t revoked_len = 0;
+	unsigned int n = 0;
+	uint8_t tag;
+
+	seq = crl_next_elem(&der, &der_len, &tag, &seq_len);
+	if (!seq || tag != ASN1_ID_SEQUENCE)
+		return NULL;
+
+	tbs = crl_next_elem(&seq, &seq_len, &tag, &tbs_len);
+	if (!tbs || tag != ASN1_ID_SEQUENCE)
+		return NULL;
+
+	crl = l_new(struct crl, 1);
+
+	/* Optional version, then the signature algorithm */
+	elem = crl_next_elem(&tbs, &tbs_len, &tag, &elem_len);
+	if (elem && tag == ASN1_ID_INTEGER)
+		elem = crl_next_elem(&tbs, &tbs_len, &tag, &elem_len);
+
+	if (!elem || tag != ASN1_ID_SEQUENCE)
+		goto error;
+
+	crl->issuer = crl_next_elem(&tbs, &tbs_len, &tag, &crl->issuer_len);
+	if (!crl->issuer || tag != ASN1_ID_SEQUENCE)
+		goto error;
+
+	/* thisUpdate, then the optional nextUpdate */
+	elem = crl_next_elem(&tbs, &tbs_len, &tag, &elem_len);
+	if (!elem || (tag != ASN1_ID_UTCTIME &&
+				tag != ASN1_ID_GENERALIZEDTIME))
+		goto error;
+
+	while (tbs_len) {
+		elem = crl_next_elem(&tbs, &tbs_len, &tag, &elem_len);
+		if (!elem)
+			goto error;
+
+		if (tag == ASN1_ID_SEQUENCE) {
+			revoked = elem;
+			revoked_len = elem_len;
+		} else if (tag == ASN1_ID(ASN1_CLASS_CONTEXT, 1, 0)) {
+			elem = crl_next_elem(&elem, &elem_len, &tag,
+						&elem_len);
+			if (!elem || tag != ASN1_ID_SEQUENCE ||
+					!crl_extensions_ok(elem, elem_len))
+				goto error;
+		} else if (tag != ASN1_ID_UTCTIME &&
+				tag != ASN1_ID_GENERALIZEDTIME)
+			goto error;
+	}
+
+	/* Count the entries first so the array is allocated once */
+	for (elem = revoked, elem_len = revoked_len; elem_len; n++) {
+		size_t entry_len;
+
+		if (!crl_next_elem(&elem, &elem_len, &tag, &entry_len) ||
+				tag != ASN1_ID_SEQUENCE)
+			goto error;
+	}
+
+	crl->serials = l_malloc(n * CRL_RECORD_SIZE + 1);
+	crl->bloom_bits = align_len(n * CRL_BLOOM_BITS + 1, 64);
+	crl->bloom = l_new(uint64_t, crl->bloom_bits / 64);
+
+	for (elem = revoked, elem_len = revoked_len; elem_len;
+			crl->n_serials++) {
+		uint8_t *record = crl->serials +
+			crl->n_serials * CRL_RECORD_SIZE;
+		const uint8_t *entry;
+		const uint8_t *serial;
+		size_t entry_len;
+		size_t serial_len;
+
+		entry = crl_next_elem(&elem, &elem_len, &tag, &entry_len);
+		serial = crl_next_elem(&entry, &entry_len, &tag, &serial_len);
+		if (!serial || tag != ASN1_ID_INTEGER ||
+				!crl_serial_to_record(serial, serial_len,
+							record))
+			goto error;
+
+		/* revocationDate, then the optional crlEntryExtensions */
+		if (!crl_next_elem(&entry, &entry_len, &tag, &serial_len))
+			goto error;
+
+		if (entry_len) {
+			const uint8_t *exts;
+			size_t exts_len;
+
+			exts = crl_next_elem(&entry, &entry_len, &tag,
+						&exts_len);
+			if (!exts || tag != ASN1_ID_SEQUENCE ||
+					!crl_extensions_ok(exts, exts_len))
+				goto error;
+		}
+
+		crl_bloom_add(crl, record);
+	}
+
+	qsort(crl->serials, crl->n_serials, CRL_RECORD_SIZE,
+		crl_record_compare);
+	return crl;
+
+error:
+	crl_free(crl);
+	return NULL;
+}
+
+/**
+ * l_crl_store_new:
+ *
+ * Returns: a new, empty, set of Certificate Revocation Lists for
+ * l_certchain_check_revocation and l_tls_set_crl_store.  Like an
+ * l_cert_store it can be shared by l_tls objects on different threads
+ * once all the CRLs have been added.
+ */
+LIB_EXPORT struct l_crl_store *l_crl_store_new(void)
+{
+	struct l_crl_store *store = l_new(struct l_crl_store, 1);
+
+	store->issuers = l_hashmap_new();
+	l_hashmap_set_hash_function(store->issuers, crl_dn_hash);
+	l_hashmap_set_compare_function(store->issuers, crl_dn_compare);
+	pthread_mutex_init(&store->lock, NULL);
+
+	return store;
+}
+
+LIB_EXPORT void l_crl_store_free(struct l_crl_store *store)
+{
+	if (unlikely(!store))
+		return;
+
+	l_hashmap_destroy(store->issuers, crl_free);
+	pthread_mutex_destroy(&store->lock);
+	l_free(store);
+}
+
+/**
+ * l_crl_store_add:
+ * @store: CRL store
+ * @der: DER-encoded CertificateList
+ * @der_len: length of @der
+ *
+ * Adds a CRL to @store.  Its signature is only checked when it's first
+ * used, against the issuer found in the certificate chain or in the
+ * trusted CAs.  CRLs with critical extensions, such as delta and
+ * indirect CRLs, aren't supported.  A CRL is used regardless of its
+ * nextUpdate time since the revocations it lists remain valid.
+ *
+ * Returns: true if the CRL was parsed and added.
+ */
+LIB_EXPORT bool l_crl_store_add(struct l_crl_store *store,
+				const uint8_t *der, size_t der_len)
+{
+	struct crl *crl;
+	struct crl *first;
+	uint8_t *copy;
+
+	if (unlikely(!store || !der || !der_len))
+		return false;
+
+	/* The parsed pointers refer into the stored copy */
+	copy = l_memdup(der, der_len);
+	crl = crl_parse(copy, der_len);
+	if (!crl) {
+		l_free(copy);
+		return false;
+	}
+
+	crl->der = copy;
+	crl->der_len = der_len;
+
+	first = l_hashmap_lookup(store->issuers, crl);
+	if (first) {
+		crl->next = first->next;
+		first->next = crl;
+	} else
+		l_hashmap_insert(store->issuers, crl, crl);
+
+	store->n_crls++;
+	return true;
+}
+
+/**
+ * l_crl_store_add_file:
+ * @store: CRL store
+ * @path: DER-encoded CRL or PEM file with one or more "X509 CRL" blocks
+ *
+ * Returns: true if at least one CRL was added and none failed to parse.
+ */
+LIB_EXPORT bool l_crl_store_add_file(struct l_crl_store *store,
+					const char *path)
+{
+	_auto_(l_free) uint8_t *contents = NULL;
+	const char *ptr;
+	const char *end;
+	size_t len;
+	bool added = false;
+
+	if (unlikely(!store || !path))
+		return false;
+
+	contents = l_file_get_contents(path, &len);
+	if (!contents)
+		return false;
+
+	if (len && contents[0] == ASN1_ID_SEQUENCE)
+		return l_crl_store_add(store, contents, len);
+
+	ptr = (const char *) contents;
+	end = ptr + len;
+
+	while (ptr < end) {
+		_auto_(l_free) uint8_t *der = NULL;
+		_auto_(l_free) char *label = NULL;
+		size_t der_len;
+
+		der = pem_load_buffer(ptr, end - ptr, &label, &der_len,
+					NULL, &ptr);
+		if (!der)
+			break;
+
+		if (strcmp(label, "X509 CRL"))
+			continue;
+
+		if (!l_crl_store_add(store, der, der_len))
+			return false;
+
+		added = true;
+	}
+
+	return added;
+}
+
+LIB_EXPORT unsigned int l_crl_store_get_size(struct l_crl_store *store)
+{
+	if (unlikely(!store))
+		return 0;
+
+	return store->n_crls;
+}
+
+/* Check, once per issuer key, that @crl was signed by @issuer */
+static bool crl_verify(struct l_crl_store *store, struct crl *crl,
+			struct l_cert *issuer)
+{
+	const uint8_t *key;
+	size_t key_len;
+	bool verified;
+
+	key = cert_get_pubkey_bits(issuer, &key_len);
+	if (!key)
+		return false;
+
+	pthread_mutex_lock(&store->lock);
+	verified = crl->signer_key && crl->signer_key_len == key_len &&
+		!memcmp(crl->signer_key, key, key_len);
+	pthread_mutex_unlock(&store->lock);
+
+	if (verified)
+		return true;
+
+	if (!cert_verify_signed_data(crl->der, crl->der_len, issuer))
+		return false;
+
+	pthread_mutex_lock(&store->lock);
+
+	if (!crl->signer_key) {
+		crl->signer_key = l_memdup(key, key_len);
+		crl->signer_key_len = key_len;
+	}
+
+	pthread_mutex_unlock(&store->lock);
+	return true;
+}
+
+static bool crl_collect_certs(struct l_cert *cert, void *user_data)
+{
+	struct l_queue *certs = user_data;
+
+	l_queue_push_tail(certs, cert);
+	return false;
+}
+
+/* Returns true if a CRL from @issuer, signed by it, lists @cert */
+static bool crl_store_is_revoked(struct l_crl_store *store,
+					struct l_cert *cert,
+					struct l_cert *issuer)
+{
+	struct crl key;
+	struct crl *crl;
+	const uint8_t *serial;
+	size_t serial_len;
+	uint8_t record[CRL_RECORD_SIZE];
+
+	key.issuer = l_cert_get_dn(issuer, &key.issuer_len);
+	if (!key.issuer)
+		return false;
+
+	crl = l_hashmap_lookup(store->issuers, &key);
+	if (!crl)
+		return false;
+
+	serial = cert_get_serial(cert, &serial_len);
+	if (!serial || !crl_serial_to_record(serial, serial_len, record))
+		return false;
+
+	for (; crl; crl = crl->next)
+		if (crl_lookup(crl, record) && crl_verify(store, crl, issuer))
+			return true;
+
+	return false;
+}
+
+/**
+ * l_certchain_check_revocation:
+ * @chain: certificate chain, usually already verified
+ * @ca_certs: trusted CAs, used to find the issuer of the top certificate
+ *   of @chain if it isn't self-signed.  May be NULL.
+ * @store: CRLs from l_crl_store_new
+ * @error: set to a description of the revoked certificate on failure
+ *
+ * Checks every certificate of @chain against the CRLs from its issuer.
+ * A CRL is only trusted if it's signed by that issuer.  Certificates
+ * whose issuer has no CRL in @store pass.
+ *
+ * Returns: false if a certificate in @chain is revoked.
+ */
+LIB_EXPORT bool l_certchain_check_revocation(struct l_certchain *chain,
+						struct l_queue *ca_certs,
+						struct l_crl_store *store,
+						const char **error)
+{
+	static __thread char error_buf[128];
+	struct l_queue *certs;
+	const struct l_queue_entry *entry;
+	unsigned int total;
+	unsigned int i;
+	bool revoked = false;
+
+	if (unlikely(!chain || !store))
+		return true;
+
+	if (!store->n_crls)
+		return true;
+
+	certs = l_queue_new();
+	l_certchain_walk_from_leaf(chain, crl_collect_certs, certs);
+	total = l_queue_length(certs);
+
+	for (entry = l_queue_get_entries(certs), i = 0; entry && !revoked;
+			entry = entry->next, i++) {
+		struct l_cert *cert = entry->data;
+		struct l_cert *issuer = NULL;
+
+		/* Self-issued certificates, i.e. roots, aren't checked */
+		if (cert_issued_by(cert, cert))
+			continue;
+
+		if (entry->next && cert_issued_by(entry->next->data, cert))
+			issuer = entry->next->data;
+		else
+			issuer = l_queue_find(ca_certs, cert_issued_by,
+						cert);
+
+		if (issuer && crl_store_is_revoked(store, cert, issuer))
+			revoked = true;
+	}
+
+	l_queue_destroy(certs, NULL);
+
+	if (!revoked)
+		return true;
+
+	if (error) {
+		/* Numbered from the CA like in l_certchain_verify errors */
+		snprintf(error_buf, sizeof(error_buf),
+				"Certificate %u / %u revoked by its issuer",
+				total - i + 1, total);
+		*error = error_buf;
+	}
+
+	return false;
+}
@@ -19,11 +19,13 @@
 #include "cipher.h"
 #include "useful.h"
 #include "utf8.h"
+#include "queue.h"
 #include "asn1-private.h"
 #include "private.h"
 #include "missing.h"
 #include "cert.h"
 #include "cert-private.h"
+#include "checksum-private.h"
 
 /* RFC8018 section 5.1 */
 LIB_EXPORT bool l_cert_pkcs5_pbkdf1(enum l_checksum_type type,
@@ -65,6 +67,9 @@ LIB_EXPORT bool l_cert_pkcs5_pbkdf1(enum l_checksum_type type,
 	memcpy(t + strlen(password), salt, salt_len);
 	t_len = strlen(password) + salt_len;
 
+	if (iter_count && checksum_iterate(type, t, t_len, iter_count, t))
+		iter_count = 0;
+
 	while (iter_count) {
 		l_checksum_reset(checksum);
 
@@ -95,25 +100,12 @@ LIB_EXPORT bool l_cert_pkcs5_pbkdf2(enum l_checksum_type type,
 					unsigned int iter_count,
 					uint8_t *out_dk, size_t dk_len)
 {
-	size_t h_len;
-	struct l_checksum *checksum;
-	unsigned int i;
-
 	switch (type) {
 	case L_CHECKSUM_SHA1:
-		h_len = 20;
-		break;
 	case L_CHECKSUM_SHA224:
-		h_len = 28;
-		break;
 	case L_CHECKSUM_SHA256:
-		h_len = 32;
-		break;
 	case L_CHECKSUM_SHA384:
-		h_len = 48;
-		break;
 	case L_CHECKSUM_SHA512:
-		h_len = 64;
 		break;
 	case L_CHECKSUM_NONE:
 	case L_CHECKSUM_MD4:
@@ -123,51 +115,9 @@ LIB_EXPORT bool l_cert_pkcs5_pbkdf2(enum l_checksum_type type,
 		return false;
 	}
 
-	checksum = l_checksum_new_hmac(type, password, strlen(password));
-	if (!checksum)
-		return false;
-
-	for (i = 1; dk_len; i++) {
-		unsigned int j, k;
-		uint8_t u[salt_len + 64];
-		size_t u_len;
-		size_t block_len = h_len;
-
-		if (block_len > dk_len)
-			block_len = dk_len;
-
-		memset(out_dk, 0, block_len);
-
-		memcpy(u, salt, salt_len);
-		l_put_be32(i, u + salt_len);
-		u_len = salt_len + 4;
-
-		for (j = 0; j < iter_count; j++) {
-			l_checksum_reset(checksum);
-
-			if (!l_checksum_update(checksum, u, u_len))
-				break;
-
-			if (l_checksum_get_digest(checksum, u, h_len) !=
-					(ssize_t) h_len)
-				break;
-
-			u_len = h_len;
-
-			for (k = 0; k < block_len; k++)
-				out_dk[k] ^= u[k];
-		}
-
-		if (j < iter_count)
-			break;
-
-		out_dk += block_len;
-		dk_len -= block_len;
-	}
-
-	l_checksum_free(checksum);
-
-	return !dk_len;
+	return l_checksum_pbkdf2(type, password, strlen(password),
+					salt, salt_len, iter_count,
+					out_dk, dk_len);
 }
 
 /* RFC7292 Appendix B */
@@ -242,7 +192,20 @@ _Pragma("GCC diagnostic pop")
 		uint8_t *input = di;
 		unsigned int input_len = hash->v + s_len + p_len;
 
-		for (j = 0; j < iterations; j++) {
+		/*
+		 * Unless the digest is truncated between iterations this
+		 * can be done in-process with one compression per iteration
+		 */
+		if (hash->u == hash->len &&
+				checksum_iterate(hash->alg, input, input_len,
+							iterations,
+							key + bytes)) {
+			input = key + bytes;
+			j = iterations;
+		} else
+			j = 0;
+
+		for (; j < iterations; j++) {
 			if (!l_checksum_update(h, input, input_len) ||
 					l_checksum_get_digest(h,
 							key + bytes,
@@ -294,6 +257,131 @@ _Pragma("GCC diagnostic pop")
 	return key;
 }
 
+/*
+ * Keys derived while loading one PKCS#12 file.  Some tools use the same
+ * salt and iteration count for all of the encrypted bags so the key
+ * derivation, the bulk of the loading time, is only done once.  The
+ * password is the same for the whole file and is not part of the lookup.
+ */
+struct cert_kdf_cache {
+	struct l_queue *entries;
+};
+
+enum kdf_type {
+	KDF_PBKDF1,
+	KDF_PBKDF2,
+	KDF_PKCS12,
+};
+
+struct kdf_cache_entry {
+	enum kdf_type type;
+	enum l_checksum_type hash;
+	uint8_t id;
+	unsigned int iterations;
+	size_t salt_len;
+	size_t key_len;
+	uint8_t data[];		/* Salt followed by the key */
+};
+
+struct cert_kdf_cache *cert_kdf_cache_new(void)
+{
+	struct cert_kdf_cache *cache = l_new(struct cert_kdf_cache, 1);
+
+	cache->entries = l_queue_new();
+	return cache;
+}
+
+static void kdf_cache_entry_free(void *data)
+{
+	struct kdf_cache_entry *entry = data;
+
+	explicit_bzero(entry->data, entry->salt_len + entry->key_len);
+	l_free(entry);
+}
+
+void cert_kdf_cache_free(struct cert_kdf_cache *cache)
+{
+	if (!cache)
+		return;
+
+	l_queue_destroy(cache->entries, kdf_cache_entry_free);
+	l_free(cache);
+}
+
+static const uint8_t *kdf_cache_lookup(struct cert_kdf_cache *cache,
+					enum kdf_type type,
+					enum l_checksum_type hash, uint8_t id,
+					const uint8_t *salt, size_t salt_len,
+					unsigned int iterations, size_t key_len)
+{
+	const struct l_queue_entry *entry;
+
+	if (!cache)
+		return NULL;
+
+	for (entry = l_queue_get_entries(cache->entries); entry;
+			entry = entry->next) {
+		const struct kdf_cache_entry *e = entry->data;
+
+		if (e->type == type && e->hash == hash && e->id == id &&
+				e->iterations == iterations &&
+				e->key_len == key_len &&
+				e->salt_len == salt_len &&
+				!memcmp(e->data, salt, salt_len))
+			return e->data + salt_len;
+	}
+
+	return NULL;
+}
+
+static void kdf_cache_add(struct cert_kdf_cache *cache, enum kdf_type type,
+				enum l_checksum_type hash, uint8_t id,
+				const uint8_t *salt, size_t salt_len,
+				unsigned int iterations,
+				const uint8_t *key, size_t key_len)
+{
+	struct kdf_cache_entry *e;
+
+	if (!cache)
+		return;
+
+	e = l_malloc(sizeof(*e) + salt_len + key_len);
+	e->type = type;
+	e->hash = hash;
+	e->id = id;
+	e->iterations = iterations;
+	e->salt_len = salt_len;
+	e->key_len = key_len;
+	memcpy(e->data, salt, salt_len);
+	memcpy(e->data + salt_len, key, key_len);
+	l_queue_push_tail(cache->entries, e);
+}
+
+static uint8_t *pkcs12_pbkdf_cached(struct cert_kdf_cache *cache,
+				const char *password,
+				const struct cert_pkcs12_hash *hash,
+				const uint8_t *salt, size_t salt_len,
+				unsigned int iterations, uint8_t id,
+				size_t key_len)
+{
+	const uint8_t *cached = kdf_cache_lookup(cache, KDF_PKCS12,
+							hash->alg, id,
+							salt, salt_len,
+							iterations, key_len);
+	uint8_t *key;
+
+	if (cached)
+		return l_memdup(cached, key_len);
+
+	key = cert_pkcs12_pbkdf(password, hash, salt, salt_len,
+				iterations, id, key_len);
+	if (key)
+		kdf_cache_add(cache, KDF_PKCS12, hash->alg, id,
+				salt, salt_len, iterations, key, key_len);
+
+	return key;
+}
+
 /* RFC7292 Appendix A */
 static const struct cert_pkcs12_hash pkcs12_sha1_hash = {
 	.alg = L_CHECKSUM_SHA1,
@@ -456,7 +544,8 @@ static const struct pkcs5_enc_alg_oid {
 static struct l_cipher *cipher_from_pkcs5_pbes2_params(
 						const uint8_t *pbes2_params,
 						size_t pbes2_params_len,
-						const char *password)
+						const char *password,
+						struct cert_kdf_cache *cache)
 {
 	uint8_t tag;
 	const uint8_t *kdf_sequence, *enc_sequence, *oid, *params,
@@ -466,6 +555,7 @@ static struct l_cipher *cipher_from_pkcs5_pbes2_params(
 	enum l_checksum_type prf_alg = L_CHECKSUM_NONE;
 	const struct pkcs5_enc_alg_oid *enc_scheme = NULL;
 	uint8_t derived_key[64];
+	const uint8_t *cached;
 	struct l_cipher *cipher;
 
 	/* RFC8018 section A.4 */
@@ -591,8 +681,15 @@ static struct l_cipher *cipher_from_pkcs5_pbes2_params(
 
 	/* RFC8018 section 6.2 */
 
-	if (!l_cert_pkcs5_pbkdf2(prf_alg, password, salt, salt_len, iter_count,
-					derived_key, key_len))
+	cached = kdf_cache_lookup(cache, KDF_PBKDF2, prf_alg, 0,
+					salt, salt_len, iter_count, key_len);
+	if (cached)
+		memcpy(derived_key, cached, key_len);
+	else if (l_cert_pkcs5_pbkdf2(prf_alg, password, salt, salt_len,
+					iter_count, derived_key, key_len))
+		kdf_cache_add(cache, KDF_PBKDF2, prf_alg, 0, salt, salt_len,
+				iter_count, derived_key, key_len);
+	else
 		return NULL;
 
 	cipher = l_cipher_new(enc_scheme->cipher_type, derived_key, key_len);
@@ -601,14 +698,16 @@ static struct l_cipher *cipher_from_pkcs5_pbes2_params(
 		cipher = NULL;
 	}
 
-	explicit_bzero(derived_key, 16);
+	explicit_bzero(derived_key, key_len);
 	return cipher;
 }
 
 static struct l_cipher *cipher_from_pkcs12_alg_id(
 				const struct pkcs12_encryption_oid *scheme,
 				const uint8_t *params, size_t params_len,
-				const char *password, bool *out_is_block)
+				const char *password,
+				struct cert_kdf_cache *cache,
+				bool *out_is_block)
 {
 	uint8_t tag;
 	const uint8_t *salt;
@@ -641,8 +740,8 @@ static struct l_cipher *cipher_from_pkcs12_alg_id(
 		return NULL;
 
 	key_len = scheme->key_length;
-	key = cert_pkcs12_pbkdf(password, &pkcs12_sha1_hash, salt, salt_len,
-				iterations, 1, key_len);
+	key = pkcs12_pbkdf_cached(cache, password, &pkcs12_sha1_hash,
+					salt, salt_len, iterations, 1, key_len);
 	if (!key)
 		return NULL;
 
@@ -672,9 +771,11 @@ static struct l_cipher *cipher_from_pkcs12_alg_id(
 		return NULL;
 
 	if (scheme->iv_length) {
-		uint8_t *iv = cert_pkcs12_pbkdf(password, &pkcs12_sha1_hash,
-						salt, salt_len, iterations, 2,
-						scheme->iv_length);
+		uint8_t *iv = pkcs12_pbkdf_cached(cache, password,
+							&pkcs12_sha1_hash,
+							salt, salt_len,
+							iterations, 2,
+							scheme->iv_length);
 
 		if (!iv || !l_cipher_set_iv(cipher, iv, scheme->iv_length)) {
 			l_cipher_free(cipher);
@@ -696,6 +797,7 @@ static struct l_cipher *cipher_from_pkcs12_alg_id(
 struct l_cipher *cert_cipher_from_pkcs_alg_id(const uint8_t *id_asn1,
 						size_t id_asn1_len,
 						const char *password,
+						struct cert_kdf_cache *cache,
 						bool *out_is_block)
 {
 	uint8_t tag;
@@ -704,6 +806,7 @@ struct l_cipher *cert_cipher_from_pkcs_alg_id(const uint8_t *id_asn1,
 	unsigned int i, iter_count;
 	const struct pkcs5_pbes1_encryption_oid *pbes1_scheme = NULL;
 	uint8_t derived_key[16];
+	const uint8_t *cached;
 	struct l_cipher *cipher;
 
 	oid = asn1_der_find_elem(id_asn1, id_asn1_len, 0, &tag, &oid_len);
@@ -722,7 +825,7 @@ struct l_cipher *cert_cipher_from_pkcs_alg_id(const uint8_t *id_asn1,
 			*out_is_block = true;
 
 		return cipher_from_pkcs5_pbes2_params(params, params_len,
-							password);
+							password, cache);
 	}
 
 	/* RFC8018 section A.3 */
@@ -743,7 +846,7 @@ struct l_cipher *cert_cipher_from_pkcs_alg_id(const uint8_t *id_asn1,
 				return cipher_from_pkcs12_alg_id(
 						&pkcs12_encryption_oids[i],
 						params, params_len, password,
-						out_is_block);
+						cache, out_is_block);
 
 		return NULL;
 	}
@@ -768,8 +871,16 @@ struct l_cipher *cert_cipher_from_pkcs_alg_id(const uint8_t *id_asn1,
 
 	/* RFC8018 section 6.1 */
 
-	if (!l_cert_pkcs5_pbkdf1(pbes1_scheme->checksum_type, password,
+	cached = kdf_cache_lookup(cache, KDF_PBKDF1,
+					pbes1_scheme->checksum_type, 0,
+					salt, 8, iter_count, 16);
+	if (cached)
+		memcpy(derived_key, cached, 16);
+	else if (l_cert_pkcs5_pbkdf1(pbes1_scheme->checksum_type, password,
 					salt, 8, iter_count, derived_key, 16))
+		kdf_cache_add(cache, KDF_PBKDF1, pbes1_scheme->checksum_type,
+				0, salt, 8, iter_count, derived_key, 16);
+	else
 		return NULL;
 
 	cipher = l_cipher_new(pbes1_scheme->cipher_type, derived_key + 0, 8);
@@ -6,19 +6,34 @@
  */
 
 struct asn1_oid;
+struct cert_kdf_cache;
+
+struct l_cert *cert_new_from_base64(const char *base64, size_t base64_len);
 
 struct l_certchain *certchain_new_from_leaf(struct l_cert *leaf);
 void certchain_link_issuer(struct l_certchain *chain, struct l_cert *ca);
 
+const uint8_t *cert_get_issuer_dn(struct l_cert *cert, size_t *out_len);
+bool cert_issued_by(const void *a, const void *b);
+const uint8_t *cert_get_serial(struct l_cert *cert, size_t *out_len);
+const uint8_t *cert_get_pubkey_bits(struct l_cert *cert, size_t *out_len);
+uint64_t cert_parse_asn1_time(const uint8_t *data, size_t len, uint8_t tag);
 const uint8_t *cert_get_extension(struct l_cert *cert,
 					const struct asn1_oid *ext_id,
 					bool *out_critical, size_t *out_len);
+bool cert_verify_signature(struct l_cert *signer,
+				const uint8_t *alg_id, size_t alg_id_len,
+				const uint8_t *data, size_t data_len,
+				const uint8_t *sig, size_t sig_len);
+bool cert_verify_signed_data(const uint8_t *der, size_t der_len,
+				struct l_cert *signer);
 
 struct l_key *cert_key_from_pkcs8_private_key_info(const uint8_t *der,
 							size_t der_len);
 struct l_key *cert_key_from_pkcs8_encrypted_private_key_info(const uint8_t *der,
-							size_t der_len,
-							const char *passphrase);
+						size_t der_len,
+						const char *passphrase,
+						struct cert_kdf_cache *cache);
 struct l_key *cert_key_from_pkcs1_rsa_private_key(const uint8_t *der,
 							size_t der_len);
 
@@ -36,7 +51,11 @@ uint8_t *cert_pkcs12_pbkdf(const char *password,
 				unsigned int iterations, uint8_t id,
 				size_t key_len);
 
+struct cert_kdf_cache *cert_kdf_cache_new(void);
+void cert_kdf_cache_free(struct cert_kdf_cache *cache);
+
 struct l_cipher *cert_cipher_from_pkcs_alg_id(const uint8_t *id_asn1,
 						size_t id_asn1_len,
 						const char *password,
+						struct cert_kdf_cache *cache,
 						bool *out_is_block);
@@ -0,0 +1,366 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "private.h"
+#include "useful.h"
+#include "queue.h"
+#include "hashmap.h"
+#include "strv.h"
+#include "pem.h"
+#include "checksum.h"
+#include "asn1-private.h"
+#include "cert.h"
+#include "cert-private.h"
+
+/*
+ * Set of trusted certificates indexed by subject DN so that the issuers
+ * of a certificate are found without scanning the whole set.  Several
+ * certificates may share a subject, e.g. a re-keyed CA, in which case
+ * the Authority and Subject Key Identifiers, when present, pick the
+ * right one.  Files and directories added with l_cert_store_add_path are
+ * only read on the first lookup.
+ */
+struct cert_store_entry {
+	const uint8_t *subject;
+	size_t subject_len;
+	struct l_cert *cert;
+	struct cert_store_entry *next;
+};
+
+struct l_cert_store {
+	struct l_hashmap *subjects;
+	unsigned int n_certs;
+	char **pending_paths;
+	pthread_mutex_t load_lock;
+};
+
+static const struct asn1_oid subject_key_id_oid =
+	{ 3, { 0x55, 0x1d, 0x0e } };
+static const struct asn1_oid authority_key_id_oid =
+	{ 3, { 0x55, 0x1d, 0x23 } };
+
+static unsigned int cert_store_dn_hash(const void *p)
+{
+	const struct cert_store_entry *entry = p;
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < entry->subject_len; i++)
+		hash = (hash ^ entry->subject[i]) * 16777619u;
+
+	return hash;
+}
+
+static int cert_store_dn_compare(const void *a, const void *b)
+{
+	const struct cert_store_entry *entry1 = a;
+	const struct cert_store_entry *entry2 = b;
+
+	if (entry1->subject_len != entry2->subject_len)
+		return entry1->subject_len < entry2->subject_len ? -1 : 1;
+
+	return memcmp(entry1->subject, entry2->subject, entry1->subject_len);
+}
+
+static void cert_store_entry_free(void *data)
+{
+	struct cert_store_entry *entry = data;
+
+	while (entry) {
+		struct cert_store_entry *next = entry->next;
+
+		l_cert_free(entry->cert);
+		l_free(entry);
+		entry = next;
+	}
+}
+
+static const uint8_t *cert_get_subject_key_id(struct l_cert *cert,
+						size_t *out_len)
+{
+	const uint8_t *ext;
+	const uint8_t *key_id;
+	size_t ext_len;
+	uint8_t tag;
+
+	/* RFC 5280 Section 4.2.1.2 */
+	ext = cert_get_extension(cert, &subject_key_id_oid, NULL, &ext_len);
+	if (!ext)
+		return NULL;
+
+	key_id = asn1_der_find_elem(ext, ext_len, 0, &tag, out_len);
+	if (!key_id || tag != ASN1_ID_OCTET_STRING)
+		return NULL;
+
+	return key_id;
+}
+
+static const uint8_t *cert_get_authority_key_id(struct l_cert *cert,
+						size_t *out_len)
+{
+	const uint8_t *ext;
+	const uint8_t *seq;
+	size_t ext_len;
+	size_t seq_len;
+	uint8_t tag;
+
+	/* RFC 5280 Section 4.2.1.1, keyIdentifier is [0] IMPLICIT */
+	ext = cert_get_extension(cert, &authority_key_id_oid, NULL, &ext_len);
+	if (!ext)
+		return NULL;
+
+	seq = asn1_der_find_elem(ext, ext_len, 0, &tag, &seq_len);
+	if (!seq || tag != ASN1_ID_SEQUENCE)
+		return NULL;
+
+	return asn1_der_find_elem(seq, seq_len, ASN1_CONTEXT_IMPLICIT(0),
+					&tag, out_len);
+}
+
+static bool cert_store_insert(struct l_cert_store *store,
+				struct l_cert *cert)
+{
+	struct cert_store_entry key;
+	struct cert_store_entry *first;
+	struct cert_store_entry *entry;
+	const uint8_t *der;
+	size_t der_len;
+
+	key.subject = l_cert_get_dn(cert, &key.subject_len);
+	if (!key.subject)
+		return false;
+
+	der = l_cert_get_der_data(cert, &der_len);
+	first = l_hashmap_lookup(store->subjects, &key);
+
+	for (entry = first; entry; entry = entry->next) {
+		const uint8_t *der2;
+		size_t der2_len;
+
+		der2 = l_cert_get_der_data(entry->cert, &der2_len);
+
+		/* Already present, e.g. through a symlink */
+		if (der_len == der2_len && !memcmp(der, der2, der_len)) {
+			l_cert_free(cert);
+			return true;
+		}
+	}
+
+	entry = l_new(struct cert_store_entry, 1);
+	entry->subject = key.subject;
+	entry->subject_len = key.subject_len;
+	entry->cert = cert;
+
+	if (first) {
+		entry->next = first->next;
+		first->next = entry;
+	} else
+		l_hashmap_insert(store->subjects, entry, entry);
+
+	store->n_certs++;
+	return true;
+}
+
+static void cert_store_load_file(struct l_cert_store *store,
+					const char *path)
+{
+	struct l_queue *list = l_pem_load_certificate_list(path);
+	struct l_cert *cert;
+
+	if (!list)
+		return;
+
+	while ((cert = l_queue_pop_head(list)))
+		if (!cert_store_insert(store, cert))
+			l_cert_free(cert);
+
+	l_queue_destroy(list, NULL);
+}
+
+static void cert_store_load_pending(struct l_cert_store *store)
+{
+	char **path;
+
+	if (likely(!__atomic_load_n(&store->pending_paths, __ATOMIC_ACQUIRE)))
+		return;
+
+	/* The first lookup loads the paths, others on other threads wait */
+	pthread_mutex_lock(&store->load_lock);
+
+	if (!store->pending_paths)
+		goto done;
+
+	for (path = store->pending_paths; *path; path++) {
+		struct dirent *entry;
+		struct stat st;
+		DIR *dp;
+
+		if (stat(*path, &st) < 0)
+			continue;
+
+		if (!S_ISDIR(st.st_mode)) {
+			cert_store_load_file(store, *path);
+			continue;
+		}
+
+		dp = opendir(*path);
+		if (!dp)
+			continue;
+
+		while ((entry = readdir(dp))) {
+			_auto_(l_free) char *file_path = NULL;
+
+			if (entry->d_name[0] == '.')
+				continue;
+
+			file_path = l_strdup_printf("%s/%s", *path,
+							entry->d_name);
+			cert_store_load_file(store, file_path);
+		}
+
+		closedir(dp);
+	}
+
+	l_strv_free(store->pending_paths);
+	__atomic_store_n(&store->pending_paths, NULL, __ATOMIC_RELEASE);
+
+done:
+	pthread_mutex_unlock(&store->load_lock);
+}
+
+/**
+ * l_cert_store_new:
+ *
+ * Returns: a new, empty, store for trusted certificates.  It can be
+ * shared by any number of l_tls objects, including ones driven by
+ * different threads, and must outlive them.  Certificates and paths must
+ * be added before the store is first shared with another thread.
+ */
+LIB_EXPORT struct l_cert_store *l_cert_store_new(void)
+{
+	struct l_cert_store *store = l_new(struct l_cert_store, 1);
+
+	store->subjects = l_hashmap_new();
+	l_hashmap_set_hash_function(store->subjects, cert_store_dn_hash);
+	l_hashmap_set_compare_function(store->subjects,
+					cert_store_dn_compare);
+	pthread_mutex_init(&store->load_lock, NULL);
+
+	return store;
+}
+
+LIB_EXPORT void l_cert_store_free(struct l_cert_store *store)
+{
+	if (unlikely(!store))
+		return;
+
+	l_hashmap_destroy(store->subjects, cert_store_entry_free);
+	l_strv_free(store->pending_paths);
+	pthread_mutex_destroy(&store->load_lock);
+	l_free(store);
+}
+
+/* Takes ownership of @cert on success */
+LIB_EXPORT bool l_cert_store_add(struct l_cert_store *store,
+					struct l_cert *cert)
+{
+	if (unlikely(!store || !cert))
+		return false;
+
+	return cert_store_insert(store, cert);
+}
+
+/**
+ * l_cert_store_add_path:
+ * @store: certificate store
+ * @path: PEM file or directory of PEM files, such as /etc/ssl/certs
+ *
+ * Adds the certificates in @path to @store.  They're only read on the
+ * first lookup so a large directory costs nothing if it's never used.
+ * Files that fail to parse are skipped.
+ */
+LIB_EXPORT bool l_cert_store_add_path(struct l_cert_store *store,
+					const char *path)
+{
+	if (unlikely(!store || !path))
+		return false;
+
+	store->pending_paths = l_strv_append(store->pending_paths, path);
+	return true;
+}
+
+LIB_EXPORT unsigned int l_cert_store_get_size(struct l_cert_store *store)
+{
+	if (unlikely(!store))
+		return 0;
+
+	cert_store_load_pending(store);
+	return store->n_certs;
+}
+
+/**
+ * l_cert_store_find_issuers:
+ * @store: certificate store
+ * @cert: certificate whose issuer is looked up
+ *
+ * Returns: a queue of the certificates in @store whose subject is the
+ * issuer of @cert, including @cert itself if it's self-issued and in
+ * @store.  When @cert has an Authority Key Identifier, candidates with a
+ * different Subject Key Identifier are left out.  The certificates remain
+ * owned by @store, free the queue with l_queue_destroy(queue, NULL).  NULL
+ * if there are none.
+ */
+LIB_EXPORT struct l_queue *l_cert_store_find_issuers(
+						struct l_cert_store *store,
+						struct l_cert *cert)
+{
+	struct cert_store_entry key;
+	struct cert_store_entry *entry;
+	struct l_queue *issuers = NULL;
+	const uint8_t *aki;
+	size_t aki_len = 0;
+
+	if (unlikely(!store || !cert))
+		return NULL;
+
+	cert_store_load_pending(store);
+
+	key.subject = cert_get_issuer_dn(cert, &key.subject_len);
+	if (!key.subject)
+		return NULL;
+
+	aki = cert_get_authority_key_id(cert, &aki_len);
+
+	for (entry = l_hashmap_lookup(store->subjects, &key); entry;
+			entry = entry->next) {
+		if (aki) {
+			const uint8_t *ski;
+			size_t ski_len;
+
+			ski = cert_get_subject_key_id(entry->cert, &ski_len);
+			if (ski && (ski_len != aki_len ||
+					memcmp(ski, aki, aki_len)))
+				continue;
+		}
+
+		if (!issuers)
+			issuers = l_queue_new();
+
+		l_queue_push_tail(issuers, entry->cert);
+	}
+
+	return issuers;
+}
@@ -18,12 +18,17 @@
 #include "useful.h"
 #include "key.h"
 #include "queue.h"
+#include "hashmap.h"
+#include "random.h"
+#include "siphash-private.h"
 #include "asn1-private.h"
 #include "cipher.h"
+#include "checksum.h"
 #include "pem-private.h"
 #include "time.h"
 #include "time-private.h"
 #include "utf8.h"
+#include "base64.h"
 #include "cert.h"
 #include "cert-private.h"
 #include "tls.h"
@@ -49,10 +54,29 @@
 #define   X509_SIGNATURE_ALGORITHM_POS		  1
 #define   X509_SIGNATURE_VALUE_POS		  2
 
+/* Location of a TBSCertificate field's contents, offset is 0 if absent */
+struct cert_field {
+	uint32_t offset;
+	uint32_t len;
+};
+
+enum {
+	VALID_TIMES_UNCACHED = 0,
+	VALID_TIMES_BUSY,
+	VALID_TIMES_CACHED,
+};
+
 struct l_cert {
 	enum l_cert_key_type pubkey_type;
 	struct l_cert *issuer;
 	struct l_cert *issued;
+	struct cert_field issuer_dn;
+	struct cert_field validity;
+	struct cert_field subject_dn;
+	struct cert_field extensions;
+	int valid_times_state;
+	uint64_t not_before_time;
+	uint64_t not_after_time;
 	size_t asn1_len;
 	uint8_t asn1[];
 };
@@ -80,16 +104,15 @@ static const struct pkcs1_encryption_oid {
 	},
 };
 
-static bool cert_set_pubkey_type(struct l_cert *cert)
+static bool cert_set_pubkey_type(struct l_cert *cert,
+					const uint8_t *tbs, size_t tbs_len)
 {
 	const uint8_t *key_type;
 	size_t key_type_len;
 	int i;
 
-	key_type = asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
+	key_type = asn1_der_find_elem_by_path(tbs, tbs_len,
 						ASN1_ID_OID, &key_type_len,
-						X509_CERTIFICATE_POS,
-						X509_TBSCERTIFICATE_POS,
 						X509_TBSCERT_SUBJECT_KEY_POS,
 						X509_SUBJECT_KEY_ALGORITHM_POS,
 						X509_ALGORITHM_ID_ALGORITHM_POS,
@@ -110,22 +133,56 @@ static bool cert_set_pubkey_type(struct l_cert *cert)
 	return true;
 }
 
-LIB_EXPORT struct l_cert *l_cert_new_from_der(const uint8_t *buf,
-						size_t buf_len)
+static void cert_field_find(struct l_cert *cert, struct cert_field *field,
+				const uint8_t *tbs, size_t tbs_len,
+				uint8_t tag, int pos)
+{
+	const uint8_t *data;
+	size_t len;
+
+	data = asn1_der_find_elem_by_path(tbs, tbs_len, tag, &len, pos, -1);
+	if (!data) {
+		field->offset = 0;
+		field->len = 0;
+		return;
+	}
+
+	field->offset = data - cert->asn1;
+	field->len = len;
+}
+
+static const uint8_t *cert_field_get(const struct l_cert *cert,
+					const struct cert_field *field,
+					size_t *out_len)
+{
+	if (!field->offset)
+		return NULL;
+
+	*out_len = field->len;
+	return cert->asn1 + field->offset;
+}
+
+/*
+ * Checks that cert->asn1 is a certificate, up to the public key algorithm,
+ * and records where the TBSCertificate fields used by the accessors are so
+ * that they needn't be looked up again.
+ */
+static bool cert_check(struct l_cert *cert)
 {
-	const uint8_t *seq = buf;
-	size_t seq_len = buf_len;
+	const uint8_t *seq = cert->asn1;
+	size_t seq_len = cert->asn1_len;
 	size_t content_len;
-	struct l_cert *cert;
+	const uint8_t *tbs;
+	size_t tbs_len;
 
 	/* Sanity check: outer element is a SEQUENCE */
 	if (seq_len-- < 1 || *seq++ != ASN1_ID_SEQUENCE)
-		return NULL;
+		return false;
 
 	/* Sanity check: the SEQUENCE spans the whole buffer */
 	content_len = asn1_parse_definite_length(&seq, &seq_len);
 	if (content_len < 64 || content_len != seq_len)
-		return NULL;
+		return false;
 
 	/*
 	 * We could require the signature algorithm and the key algorithm
@@ -134,14 +191,70 @@ LIB_EXPORT struct l_cert *l_cert_new_from_der(const uint8_t *buf,
 	 * get the public key respectively.
 	 */
 
+	tbs = asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
+						ASN1_ID_SEQUENCE, &tbs_len,
+						X509_CERTIFICATE_POS,
+						X509_TBSCERTIFICATE_POS,
+						-1);
+	if (!tbs)
+		return false;
+
+	cert_field_find(cert, &cert->issuer_dn, tbs, tbs_len,
+			ASN1_ID_SEQUENCE, X509_TBSCERT_ISSUER_DN_POS);
+	cert_field_find(cert, &cert->validity, tbs, tbs_len,
+			ASN1_ID_SEQUENCE, X509_TBSCERT_VALIDITY_POS);
+	cert_field_find(cert, &cert->subject_dn, tbs, tbs_len,
+			ASN1_ID_SEQUENCE, X509_TBSCERT_SUBJECT_DN_POS);
+	cert_field_find(cert, &cert->extensions, tbs, tbs_len,
+			ASN1_ID_SEQUENCE, X509_TBSCERT_EXTENSIONS_POS);
+	cert->valid_times_state = VALID_TIMES_UNCACHED;
+
+	/* Sanity check: structure is correct up to the Public Key Algorithm */
+	return cert_set_pubkey_type(cert, tbs, tbs_len);
+}
+
+LIB_EXPORT struct l_cert *l_cert_new_from_der(const uint8_t *buf,
+						size_t buf_len)
+{
+	struct l_cert *cert;
+
 	cert = l_malloc(sizeof(struct l_cert) + buf_len);
 	cert->issuer = NULL;
 	cert->issued = NULL;
 	cert->asn1_len = buf_len;
 	memcpy(cert->asn1, buf, buf_len);
 
-	/* Sanity check: structure is correct up to the Public Key Algorithm */
-	if (!cert_set_pubkey_type(cert)) {
+	if (!cert_check(cert)) {
+		l_free(cert);
+		return NULL;
+	}
+
+	return cert;
+}
+
+/*
+ * Like l_cert_new_from_der() but decodes the base64 encoded DER straight
+ * into the new certificate, saving a temporary copy.
+ */
+struct l_cert *cert_new_from_base64(const char *base64, size_t base64_len)
+{
+	size_t max_len = base64_len / 4 * 3 + 2;
+	struct l_cert *cert;
+	ssize_t len;
+
+	cert = l_malloc(sizeof(struct l_cert) + max_len);
+	cert->issuer = NULL;
+	cert->issued = NULL;
+
+	len = l_base64_decode_into(base64, base64_len, cert->asn1, max_len);
+	if (len <= 0) {
+		l_free(cert);
+		return NULL;
+	}
+
+	cert->asn1_len = len;
+
+	if (!cert_check(cert)) {
 		l_free(cert);
 		return NULL;
 	}
@@ -169,16 +282,65 @@ LIB_EXPORT const uint8_t *l_cert_get_dn(struct l_cert *cert, size_t *out_len)
 	if (unlikely(!cert))
 		return NULL;
 
+	return cert_field_get(cert, &cert->subject_dn, out_len);
+}
+
+const uint8_t *cert_get_issuer_dn(struct l_cert *cert, size_t *out_len)
+{
+	return cert_field_get(cert, &cert->issuer_dn, out_len);
+}
+
+/*
+ * Whether the subject of certificate @a matches the issuer name of
+ * certificate @b, in the form of an l_queue_match_func_t.
+ */
+bool cert_issued_by(const void *a, const void *b)
+{
+	struct l_cert *issuer = (struct l_cert *) a;
+	struct l_cert *cert = (struct l_cert *) b;
+	const uint8_t *dn;
+	const uint8_t *issuer_dn;
+	size_t dn_len;
+	size_t issuer_dn_len;
+
+	dn = l_cert_get_dn(issuer, &dn_len);
+	issuer_dn = cert_get_issuer_dn(cert, &issuer_dn_len);
+
+	return dn && issuer_dn && dn_len == issuer_dn_len &&
+		!memcmp(dn, issuer_dn, dn_len);
+}
+
+const uint8_t *cert_get_serial(struct l_cert *cert, size_t *out_len)
+{
 	return asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
-						ASN1_ID_SEQUENCE, out_len,
+						ASN1_ID_INTEGER, out_len,
 						X509_CERTIFICATE_POS,
 						X509_TBSCERTIFICATE_POS,
-						X509_TBSCERT_SUBJECT_DN_POS,
+						X509_TBSCERT_SERIAL_POS,
 						-1);
 }
 
-static uint64_t cert_parse_asn1_time(const uint8_t *data, size_t len,
-					uint8_t tag)
+/* The subjectPublicKey BIT STRING contents without the unused bits octet */
+const uint8_t *cert_get_pubkey_bits(struct l_cert *cert, size_t *out_len)
+{
+	const uint8_t *key;
+	size_t key_len;
+
+	key = asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
+						ASN1_ID_BIT_STRING, &key_len,
+						X509_CERTIFICATE_POS,
+						X509_TBSCERTIFICATE_POS,
+						X509_TBSCERT_SUBJECT_KEY_POS,
+						X509_SUBJECT_KEY_VALUE_POS,
+						-1);
+	if (!key || key_len < 2 || key[0] != 0)
+		return NULL;
+
+	*out_len = key_len - 1;
+	return key + 1;
+}
+
+uint64_t cert_parse_asn1_time(const uint8_t *data, size_t len, uint8_t tag)
 {
 	struct tm tm = {};
 	int tz_hours;
@@ -285,7 +447,7 @@ static uint64_t cert_parse_asn1_time(const uint8_t *data, size_t len,
 	return (uint64_t) tt * L_USEC_PER_SEC + msecs * L_USEC_PER_MSEC;
 }
 
-LIB_EXPORT bool l_cert_get_valid_times(struct l_cert *cert,
+static bool cert_parse_valid_times(struct l_cert *cert,
 					uint64_t *out_not_before_time,
 					uint64_t *out_not_after_time)
 {
@@ -300,15 +462,7 @@ LIB_EXPORT bool l_cert_get_valid_times(struct l_cert *cert,
 	uint64_t not_before_time = 0;
 	uint64_t not_after_time = 0;
 
-	if (unlikely(!cert))
-		return false;
-
-	validity = asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
-						ASN1_ID_SEQUENCE, &seq_size,
-						X509_CERTIFICATE_POS,
-						X509_TBSCERTIFICATE_POS,
-						X509_TBSCERT_VALIDITY_POS,
-						-1);
+	validity = cert_field_get(cert, &cert->validity, &seq_size);
 	if (unlikely(!validity))
 		return false;
 
@@ -359,6 +513,55 @@ LIB_EXPORT bool l_cert_get_valid_times(struct l_cert *cert,
 	return true;
 }
 
+LIB_EXPORT bool l_cert_get_valid_times(struct l_cert *cert,
+					uint64_t *out_not_before_time,
+					uint64_t *out_not_after_time)
+{
+	uint64_t not_before;
+	uint64_t not_after;
+
+	if (unlikely(!cert))
+		return false;
+
+	/*
+	 * Cache the times for the repeated validity checks on CA sets.  If
+	 * one of them can't be parsed, still return the other as before.
+	 * Certificates in a shared store are checked from several threads,
+	 * only the first one to finish parsing fills in the cache.
+	 */
+	if (__atomic_load_n(&cert->valid_times_state, __ATOMIC_ACQUIRE) ==
+						VALID_TIMES_CACHED) {
+		not_before = cert->not_before_time;
+		not_after = cert->not_after_time;
+	} else {
+		int expected = VALID_TIMES_UNCACHED;
+
+		if (!cert_parse_valid_times(cert, &not_before, &not_after))
+			return cert_parse_valid_times(cert,
+							out_not_before_time,
+							out_not_after_time);
+
+		if (__atomic_compare_exchange_n(&cert->valid_times_state,
+						&expected, VALID_TIMES_BUSY,
+						false, __ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED)) {
+			cert->not_before_time = not_before;
+			cert->not_after_time = not_after;
+			__atomic_store_n(&cert->valid_times_state,
+						VALID_TIMES_CACHED,
+						__ATOMIC_RELEASE);
+		}
+	}
+
+	if (out_not_before_time)
+		*out_not_before_time = not_before;
+
+	if (out_not_after_time)
+		*out_not_after_time = not_after;
+
+	return true;
+}
+
 const uint8_t *cert_get_extension(struct l_cert *cert,
 					const struct asn1_oid *ext_id,
 					bool *out_critical, size_t *out_len)
@@ -369,12 +572,7 @@ const uint8_t *cert_get_extension(struct l_cert *cert,
 	if (unlikely(!cert))
 		return NULL;
 
-	ext = asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
-						ASN1_ID_SEQUENCE, &ext_len,
-						X509_CERTIFICATE_POS,
-						X509_TBSCERTIFICATE_POS,
-						X509_TBSCERT_EXTENSIONS_POS,
-						-1);
+	ext = cert_field_get(cert, &cert->extensions, &ext_len);
 	if (unlikely(!ext))
 		return NULL;
 
@@ -454,6 +652,141 @@ LIB_EXPORT struct l_key *l_cert_get_pubkey(struct l_cert *cert)
 	return NULL;
 }
 
+static const struct cert_sig_alg {
+	enum l_cert_key_type key_type;
+	enum l_checksum_type hash;
+	struct asn1_oid oid;
+} cert_sig_algs[] = {
+	{ /* sha1WithRSAEncryption */
+		L_CERT_KEY_RSA, L_CHECKSUM_SHA1, { 9, {
+			0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x05 } }
+	},
+	{ /* sha256WithRSAEncryption */
+		L_CERT_KEY_RSA, L_CHECKSUM_SHA256, { 9, {
+			0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x0b } }
+	},
+	{ /* sha384WithRSAEncryption */
+		L_CERT_KEY_RSA, L_CHECKSUM_SHA384, { 9, {
+			0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x0c } }
+	},
+	{ /* sha512WithRSAEncryption */
+		L_CERT_KEY_RSA, L_CHECKSUM_SHA512, { 9, {
+			0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x0d } }
+	},
+	{ /* ecdsa-with-SHA256 */
+		L_CERT_KEY_ECC, L_CHECKSUM_SHA256, { 8, {
+			0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x02 } }
+	},
+	{ /* ecdsa-with-SHA384 */
+		L_CERT_KEY_ECC, L_CHECKSUM_SHA384, { 8, {
+			0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x03 } }
+	},
+	{ /* ecdsa-with-SHA512 */
+		L_CERT_KEY_ECC, L_CHECKSUM_SHA512, { 8, {
+			0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x04 } }
+	},
+};
+
+/*
+ * Verify a signature made by @signer's key over @data in userspace,
+ * unlike the certificate chain which is verified by the kernel.
+ * @alg_id is the contents of the AlgorithmIdentifier and @sig the
+ * contents of the signature BIT STRING.
+ */
+bool cert_verify_signature(struct l_cert *signer,
+				const uint8_t *alg_id, size_t alg_id_len,
+				const uint8_t *data, size_t data_len,
+				const uint8_t *sig, size_t sig_len)
+{
+	const struct cert_sig_alg *alg = NULL;
+	struct l_checksum *checksum;
+	struct l_key *key;
+	const uint8_t *oid;
+	size_t oid_len;
+	uint8_t digest[64];
+	ssize_t digest_len;
+	uint8_t tag;
+	unsigned int i;
+	bool r;
+
+	oid = asn1_der_find_elem(alg_id, alg_id_len, 0, &tag, &oid_len);
+	if (!oid || tag != ASN1_ID_OID)
+		return false;
+
+	for (i = 0; i < L_ARRAY_SIZE(cert_sig_algs) && !alg; i++)
+		if (asn1_oid_eq(&cert_sig_algs[i].oid, oid_len, oid))
+			alg = &cert_sig_algs[i];
+
+	if (!alg || l_cert_get_pubkey_type(signer) != alg->key_type)
+		return false;
+
+	/* The signature is a BIT STRING with no unused bits */
+	if (sig_len < 2 || sig[0] != 0)
+		return false;
+
+	checksum = l_checksum_new(alg->hash);
+	if (!checksum)
+		return false;
+
+	r = l_checksum_update(checksum, data, data_len);
+	digest_len = l_checksum_get_digest(checksum, digest, sizeof(digest));
+	l_checksum_free(checksum);
+
+	if (!r || digest_len <= 0)
+		return false;
+
+	key = l_cert_get_pubkey(signer);
+	if (!key)
+		return false;
+
+	r = l_key_verify(key, alg->key_type == L_CERT_KEY_RSA ?
+				L_KEY_RSA_PKCS1_V1_5 : L_KEY_ECDSA_X962,
+				alg->hash, digest, sig + 1,
+				digest_len, sig_len - 1);
+	l_key_free(key);
+	return r;
+}
+
+/*
+ * Check the signature on a certificate, CRL or another structure using
+ * the X.509 SIGNED{} envelope: a SEQUENCE of the signed data, the
+ * AlgorithmIdentifier and the signature BIT STRING.
+ */
+bool cert_verify_signed_data(const uint8_t *der, size_t der_len,
+				struct l_cert *signer)
+{
+	const uint8_t *seq;
+	const uint8_t *tbs;
+	const uint8_t *alg_id;
+	const uint8_t *sig;
+	size_t seq_len;
+	size_t tbs_len;
+	size_t alg_id_len;
+	size_t sig_len;
+	uint8_t tag;
+
+	seq = asn1_der_find_elem(der, der_len, 0, &tag, &seq_len);
+	if (!seq || tag != ASN1_ID_SEQUENCE)
+		return false;
+
+	tbs = asn1_der_find_elem(seq, seq_len, 0, &tag, &tbs_len);
+	if (!tbs || tag != ASN1_ID_SEQUENCE)
+		return false;
+
+	alg_id = asn1_der_find_elem(seq, seq_len, 1, &tag, &alg_id_len);
+	if (!alg_id || tag != ASN1_ID_SEQUENCE)
+		return false;
+
+	sig = asn1_der_find_elem(seq, seq_len, 2, &tag, &sig_len);
+	if (!sig || tag != ASN1_ID_BIT_STRING)
+		return false;
+
+	/* The signed data includes its own tag and length */
+	return cert_verify_signature(signer, alg_id, alg_id_len,
+					seq, tbs + tbs_len - seq,
+					sig, sig_len);
+}
+
 /*
  * Note: takes ownership of the certificate.  The certificate is
  * assumed to be new and not linked into any certchain object.
@@ -652,6 +985,171 @@ static struct l_key *cert_try_link(struct l_cert *cert, struct l_keyring *ring)
 	return NULL;
 }
 
+/*
+ * Signatures already checked by the kernel, so that verifying the same
+ * chain again, e.g. in every EAP-TLS authentication with the same server,
+ * only has to load the last certificate into a keyring instead of every
+ * certificate plus the trusted CAs.  A link is identified by the IDs of
+ * the issuer and of the issued certificate, where the ID is a 128-bit
+ * keyed hash of the DER encoding with a random key per cache.  The
+ * issuer of the top certificate is the set of trusted CAs it was checked
+ * against, or all zeros if it wasn't checked against any CAs.
+ */
+struct cert_verified_link {
+	uint8_t issuer_id[16];
+	uint8_t id[16];
+};
+
+struct l_cert_verify_cache {
+	struct l_hashmap *links;
+	unsigned int max_links;
+	uint8_t keys[2][16];
+};
+
+static unsigned int cert_verified_link_hash(const void *p)
+{
+	const struct cert_verified_link *link = p;
+
+	return l_get_u32(link->id) ^ l_get_u32(link->issuer_id);
+}
+
+static int cert_verified_link_compare(const void *a, const void *b)
+{
+	return memcmp(a, b, sizeof(struct cert_verified_link));
+}
+
+/**
+ * l_cert_verify_cache_new:
+ * @max_links: maximum number of verified signatures to remember
+ *
+ * Returns: a new cache to pass to l_certchain_verify_cached.  Only the
+ * signatures are cached, the certificates' validity times and the
+ * trusted CA set are still checked on every call.
+ */
+LIB_EXPORT struct l_cert_verify_cache *l_cert_verify_cache_new(
+						unsigned int max_links)
+{
+	struct l_cert_verify_cache *cache;
+
+	if (unlikely(!max_links))
+		return NULL;
+
+	cache = l_new(struct l_cert_verify_cache, 1);
+
+	if (!l_getrandom(cache->keys, sizeof(cache->keys))) {
+		l_free(cache);
+		return NULL;
+	}
+
+	cache->max_links = max_links;
+	cache->links = l_hashmap_new();
+	l_hashmap_set_hash_function(cache->links, cert_verified_link_hash);
+	l_hashmap_set_compare_function(cache->links,
+					cert_verified_link_compare);
+
+	return cache;
+}
+
+LIB_EXPORT void l_cert_verify_cache_free(struct l_cert_verify_cache *cache)
+{
+	if (unlikely(!cache))
+		return;
+
+	l_hashmap_destroy(cache->links, l_free);
+	explicit_bzero(cache->keys, sizeof(cache->keys));
+	l_free(cache);
+}
+
+static void cert_verify_cache_id(struct l_cert_verify_cache *cache,
+					const uint8_t *data, size_t len,
+					uint8_t out[static 16])
+{
+	_siphash24(out, data, len, cache->keys[0]);
+	_siphash24(out + 8, data, len, cache->keys[1]);
+}
+
+static void cert_verify_cache_set_id(struct l_cert_verify_cache *cache,
+					struct l_cert **set,
+					uint8_t out[static 16])
+{
+	_auto_(l_free) uint8_t *ids = NULL;
+	size_t count;
+	size_t i;
+
+	for (count = 0; set[count]; count++);
+
+	ids = l_malloc(count * 16);
+
+	for (i = 0; i < count; i++)
+		cert_verify_cache_id(cache, set[i]->asn1, set[i]->asn1_len,
+					ids + i * 16);
+
+	cert_verify_cache_id(cache, ids, count * 16, out);
+}
+
+/* Returns the number of certificates from the top with known good links */
+static int cert_verify_cache_walk(struct l_cert_verify_cache *cache,
+					struct l_certchain *chain,
+					const uint8_t anchor_id[static 16])
+{
+	struct cert_verified_link link;
+	struct l_cert *cert;
+	int count = 0;
+
+	memcpy(link.id, anchor_id, 16);
+
+	for (cert = chain->ca; cert; cert = cert->issued, count++) {
+		memcpy(link.issuer_id, link.id, 16);
+		cert_verify_cache_id(cache, cert->asn1, cert->asn1_len,
+					link.id);
+
+		if (!l_hashmap_lookup(cache->links, &link))
+			break;
+	}
+
+	return count;
+}
+
+static void cert_verify_cache_add(struct l_cert_verify_cache *cache,
+					const uint8_t issuer_id[static 16],
+					struct l_cert *cert)
+{
+	struct cert_verified_link *link = l_new(struct cert_verified_link, 1);
+
+	memcpy(link->issuer_id, issuer_id, 16);
+	cert_verify_cache_id(cache, cert->asn1, cert->asn1_len, link->id);
+
+	if (l_hashmap_lookup(cache->links, link)) {
+		l_free(link);
+		return;
+	}
+
+	/* Make room by dropping an arbitrary link */
+	if (l_hashmap_size(cache->links) >= cache->max_links) {
+		struct l_hashmap_iter iter;
+		const void *key;
+		void *value;
+
+		l_hashmap_iter_init(&iter, cache->links);
+
+		if (l_hashmap_iter_next(&iter, &key, &value))
+			l_free(l_hashmap_remove(cache->links, key));
+	}
+
+	l_hashmap_insert(cache->links, link, link);
+}
+
+static void cert_verify_cache_add_issued(struct l_cert_verify_cache *cache,
+						struct l_cert *issuer,
+						struct l_cert *cert)
+{
+	uint8_t issuer_id[16];
+
+	cert_verify_cache_id(cache, issuer->asn1, issuer->asn1_len,
+				issuer_id);
+	cert_verify_cache_add(cache, issuer_id, cert);
+}
+
 #define RETURN_ERROR(msg, args...)	\
 	do {	\
 		if (error) {	\
@@ -661,8 +1159,19 @@ static struct l_key *cert_try_link(struct l_cert *cert, struct l_keyring *ring)
 		return false;	\
 	} while (0)
 
-LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
+/**
+ * l_certchain_verify_cached:
+ * @chain: certificate chain to verify
+ * @ca_certs: trusted CA certificates or NULL
+ * @cache: cache from l_cert_verify_cache_new or NULL
+ * @error: set to a static error message on failure, if non-NULL
+ *
+ * Same as l_certchain_verify but signatures found in @cache aren't
+ * checked again and the newly checked ones are added to @cache.
+ */
+LIB_EXPORT bool l_certchain_verify_cached(struct l_certchain *chain,
 					struct l_queue *ca_certs,
+					struct l_cert_verify_cache *cache,
 					const char **error)
 {
 	struct l_keyring *ca_ring = NULL;
@@ -672,12 +1181,14 @@ LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
 	int verified = 0;
 	int ca_match = 0;
 	int i;
-	static char error_buf[1024];
+	static __thread char error_buf[1024];
 	int total = 0;
 	uint64_t now;
 	_auto_(l_free) struct l_cert **ca_certs_valid = NULL;
 	int ca_certs_total_count = 0;
 	int ca_certs_valid_count = 0;
+	uint8_t anchor_id[16] = {};
+	int cached = 0;
 
 	if (unlikely(!chain || !chain->leaf))
 		RETURN_ERROR("Chain empty");
@@ -742,12 +1253,30 @@ LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
 			}
 	}
 
+	if (cache) {
+		if (ca_certs && !ca_match)
+			cert_verify_cache_set_id(cache, ca_certs_valid,
+							anchor_id);
+
+		cached = cert_verify_cache_walk(cache, chain, anchor_id);
+		if (cached == total)
+			return true;
+	}
+
 	verify_ring = l_keyring_new();
 	if (!verify_ring)
 		RETURN_ERROR("Can't create verify keyring");
 
 	cert = chain->ca;
 
+	/*
+	 * The certificates down to the last one with a cached link are
+	 * known good, start verification below it the same way as for a
+	 * chain whose root is not checked against trusted CAs.
+	 */
+	for (; verified < cached - 1; verified++)
+		cert = cert->issued;
+
 	/*
 	 * For TLS compatibility the trusted root CA certificate is
 	 * optionally present in the chain.
@@ -775,7 +1304,7 @@ LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
 	 * certificate and the same certificate was at the root of
 	 * the chain.
 	 */
-	if (ca_certs && !ca_match) {
+	if (ca_certs && !ca_match && !cached) {
 		ca_ring = cert_set_to_keyring(ca_certs_valid, error_buf);
 		if (!ca_ring) {
 			if (error)
@@ -811,12 +1340,18 @@ LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
 		l_keyring_free(ca_ring);
 	}
 
+	if (cache && prev_key && !cached)
+		cert_verify_cache_add(cache, anchor_id, cert);
+
 	cert = cert->issued;
 
 	/* Verify the rest of the chain */
 	while (prev_key && cert) {
 		struct l_key *new_key = cert_try_link(cert, verify_ring);
 
+		if (cache && new_key)
+			cert_verify_cache_add_issued(cache, cert->issuer, cert);
+
 		/*
 		 * Free and revoke the issuer's public key again leaving only
 		 * new_key in verify_ring to ensure the next certificate linked
@@ -857,6 +1392,13 @@ LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
 	return true;
 }
 
+LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
+					struct l_queue *ca_certs,
+					const char **error)
+{
+	return l_certchain_verify_cached(chain, ca_certs, NULL, error);
+}
+
 struct l_key *cert_key_from_pkcs8_private_key_info(const uint8_t *der,
 							size_t der_len)
 {
@@ -869,8 +1411,9 @@ struct l_key *cert_key_from_pkcs8_private_key_info(const uint8_t *der,
  * Use l_utf8_validate.
  */
 struct l_key *cert_key_from_pkcs8_encrypted_private_key_info(const uint8_t *der,
-							size_t der_len,
-							const char *passphrase)
+						size_t der_len,
+						const char *passphrase,
+						struct cert_kdf_cache *cache)
 {
 	const uint8_t *key_info, *alg_id, *data;
 	uint8_t tag;
@@ -901,7 +1444,7 @@ struct l_key *cert_key_from_pkcs8_encrypted_private_key_info(const uint8_t *der,
 		return NULL;
 
 	alg = cert_cipher_from_pkcs_alg_id(alg_id, alg_id_len, passphrase,
-						&is_block);
+						cache, &is_block);
 	if (!alg)
 		return NULL;
 
@@ -1065,6 +1608,7 @@ static const uint8_t *cert_unpack_pkcs7_content_info(const uint8_t *container,
 static uint8_t *cert_decrypt_pkcs7_encrypted_data(const uint8_t *data,
 						size_t data_len,
 						const char *password,
+						struct cert_kdf_cache *cache,
 						struct asn1_oid *out_oid,
 						size_t *out_len)
 {
@@ -1116,7 +1660,7 @@ static uint8_t *cert_decrypt_pkcs7_encrypted_data(const uint8_t *data,
 		return NULL;
 
 	if (!(alg = cert_cipher_from_pkcs_alg_id(alg_id, alg_id_len, password,
-							&is_block)))
+							cache, &is_block)))
 		return NULL;
 
 	plaintext = l_malloc(encrypted_len);
@@ -1264,6 +1808,7 @@ static bool cert_parse_pkcs12_cert_bag(const uint8_t *data, size_t data_len,
 
 static bool cert_parse_pkcs12_safe_contents(const uint8_t *data,
 					size_t data_len, const char *password,
+					struct cert_kdf_cache *cache,
 					struct l_certchain **out_certchain,
 					struct l_key **out_privkey)
 {
@@ -1341,7 +1886,8 @@ static bool cert_parse_pkcs12_safe_contents(const uint8_t *data,
 				cert_key_from_pkcs8_encrypted_private_key_info(
 								bag_value,
 								bag_value_len,
-								password);
+								password,
+								cache);
 			if (!*out_privkey)
 				return false;
 		} else if (asn1_oid_eq(&pkcs12_cert_bag_oid,
@@ -1358,6 +1904,7 @@ static bool cert_parse_pkcs12_safe_contents(const uint8_t *data,
 			if (!(cert_parse_pkcs12_safe_contents(bag_value,
 								bag_value_len,
 								password,
+								cache,
 								out_certchain,
 								out_privkey)))
 				return false;
@@ -1486,6 +2033,7 @@ static bool cert_parse_auth_safe_content(const uint8_t *data, size_t data_len,
 					uint8_t tag,
 					const struct asn1_oid *data_oid,
 					const char *password,
+					struct cert_kdf_cache *cache,
 					struct l_certchain **out_certchain,
 					struct l_key **out_privkey)
 {
@@ -1506,7 +2054,8 @@ static bool cert_parse_auth_safe_content(const uint8_t *data, size_t data_len,
 		 */
 		plaintext = cert_decrypt_pkcs7_encrypted_data(data,
 								data_len,
-								password, &oid,
+								password, cache,
+								&oid,
 								&plaintext_len);
 		if (!plaintext)
 			return false;
@@ -1521,7 +2070,7 @@ static bool cert_parse_auth_safe_content(const uint8_t *data, size_t data_len,
 					oid.asn1_len, oid.asn1) &&
 			cert_parse_pkcs12_safe_contents(plaintext,
 							plaintext_len,
-							password,
+							password, cache,
 							out_certchain,
 							out_privkey);
 		explicit_bzero(plaintext, plaintext_len);
@@ -1535,7 +2084,7 @@ static bool cert_parse_auth_safe_content(const uint8_t *data, size_t data_len,
 			return false;
 
 		if (!cert_parse_pkcs12_safe_contents(data, data_len,
-							password,
+							password, cache,
 							out_certchain,
 							out_privkey))
 			return false;
@@ -1560,6 +2109,8 @@ static bool cert_parse_pkcs12_pfx(const uint8_t *ptr, size_t len,
 	size_t auth_safe_seq_len;
 	uint8_t tag;
 	unsigned int i;
+	unsigned int pass, n_passes;
+	struct cert_kdf_cache *cache;
 	struct l_certchain *certchain = NULL;
 	struct l_key *privkey = NULL;
 
@@ -1608,30 +2159,53 @@ integrity_check_done:
 			auth_safe_seq + auth_safe_seq_len)
 		return false;
 
-	i = 0;
-	while (1) {
-		struct asn1_oid data_oid;
-		const uint8_t *data;
-		size_t data_len;
+	cache = cert_kdf_cache_new();
 
-		if (!(data = cert_unpack_pkcs7_content_info(auth_safe_seq,
+	/*
+	 * When only the private key is wanted, the encryptedData contents,
+	 * which normally hold just the certificates, are left for a second
+	 * pass that is skipped if the key is found in the other contents.
+	 */
+	n_passes = out_privkey && !out_certchain ? 2 : 1;
+
+	for (pass = 0; pass < n_passes && !privkey; pass++) {
+		i = 0;
+		while (1) {
+			struct asn1_oid data_oid;
+			const uint8_t *data;
+			size_t data_len;
+			bool encrypted;
+
+			if (!(data = cert_unpack_pkcs7_content_info(
+							auth_safe_seq,
 							auth_safe_seq_len, i++,
 							NULL, &data_oid, &tag,
 							&data_len)))
-			goto error;
+				goto error;
 
-		if (!cert_parse_auth_safe_content(data, data_len, tag,
+			encrypted = asn1_oid_eq(&pkcs7_encrypted_data_oid,
+						data_oid.asn1_len,
+						data_oid.asn1);
+
+			if ((n_passes == 1 || encrypted == (pass == 1)) &&
+					!cert_parse_auth_safe_content(data,
+							data_len, tag,
 							&data_oid, password,
+							cache,
 							out_certchain ?
 							&certchain : NULL,
 							out_privkey ?
 							&privkey : NULL))
-			goto error;
+				goto error;
 
-		if (data + data_len == auth_safe_seq + auth_safe_seq_len)
-			break;
+			if (data + data_len ==
+					auth_safe_seq + auth_safe_seq_len)
+				break;
+		}
 	}
 
+	cert_kdf_cache_free(cache);
+
 	if (out_certchain)
 		*out_certchain = certchain;
 
@@ -1641,6 +2215,8 @@ integrity_check_done:
 	return true;
 
 error:
+	cert_kdf_cache_free(cache);
+
 	if (certchain)
 		l_certchain_free(certchain);
 
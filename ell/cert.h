@@ -18,6 +18,9 @@ extern "C" {
 struct l_queue;
 struct l_cert;
 struct l_certchain;
+struct l_cert_verify_cache;
+struct l_cert_store;
+struct l_crl_store;
 
 enum l_cert_key_type {
 	L_CERT_KEY_RSA,
@@ -50,6 +53,32 @@ void l_certchain_walk_from_ca(struct l_certchain *chain,
 bool l_certchain_verify(struct l_certchain *chain, struct l_queue *ca_certs,
 			const char **error);
 
+struct l_cert_verify_cache *l_cert_verify_cache_new(unsigned int max_links);
+void l_cert_verify_cache_free(struct l_cert_verify_cache *cache);
+bool l_certchain_verify_cached(struct l_certchain *chain,
+				struct l_queue *ca_certs,
+				struct l_cert_verify_cache *cache,
+				const char **error);
+
+struct l_cert_store *l_cert_store_new(void);
+void l_cert_store_free(struct l_cert_store *store);
+bool l_cert_store_add(struct l_cert_store *store, struct l_cert *cert);
+bool l_cert_store_add_path(struct l_cert_store *store, const char *path);
+unsigned int l_cert_store_get_size(struct l_cert_store *store);
+struct l_queue *l_cert_store_find_issuers(struct l_cert_store *store,
+						struct l_cert *cert);
+
+struct l_crl_store *l_crl_store_new(void);
+void l_crl_store_free(struct l_crl_store *store);
+bool l_crl_store_add(struct l_crl_store *store,
+			const uint8_t *der, size_t der_len);
+bool l_crl_store_add_file(struct l_crl_store *store, const char *path);
+unsigned int l_crl_store_get_size(struct l_crl_store *store);
+bool l_certchain_check_revocation(struct l_certchain *chain,
+					struct l_queue *ca_certs,
+					struct l_crl_store *store,
+					const char **error);
+
 bool l_cert_load_container_file(const char *filename, const char *password,
 				struct l_certchain **out_certchain,
 				struct l_key **out_privkey,
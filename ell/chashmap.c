@@ -0,0 +1,781 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "chashmap.h"
+#include "private.h"
+#include "useful.h"
+
+/**
+ * SECTION:chashmap
+ * @short_description: Concurrent hash table support
+ *
+ * Hash table support for state shared between threads
+ */
+
+/*
+ * Entries are kept in singly linked chains which readers walk without
+ * taking any lock.  Writers are serialized by a mutex and publish their
+ * changes with release stores, so a reader always sees either the old or
+ * the new chain.  Memory that was unlinked is only freed once no reader
+ * can still reference it.
+ *
+ * Readers announce themselves by incrementing a counter for the current
+ * epoch, there are two epochs and a number of counter slots to keep the
+ * readers of different threads off each other's cache lines.  To wait
+ * for a grace period, the writer flips the epoch and waits for the
+ * counters of the old one to drain, twice.  A reader that sampled the
+ * epoch just before a flip but only incremented the counter after the
+ * writer checked it started after the unlink and can't see the memory
+ * being freed.  The second flip makes sure such a reader is waited for
+ * by the next writer even though it is counted under a stale epoch.
+ *
+ * Growing the table copies the entries into a new one, so that readers
+ * still walking the old table are never disturbed.
+ */
+
+#define CHASHMAP_MIN_BITS	4
+#define CHASHMAP_MAX_BITS	31
+#define CHASHMAP_READER_SLOTS	16
+
+struct chashmap_entry {
+	void *key;
+	void *value;
+	unsigned int hash;
+	struct chashmap_entry *next;
+};
+
+struct chashmap_table {
+	unsigned int bits;
+	struct chashmap_entry *buckets[];
+};
+
+struct chashmap_readers {
+	unsigned long count[2];
+	/* One slot per cache line */
+	char pad[64 - 2 * sizeof(unsigned long)];
+};
+
+/**
+ * l_chashmap:
+ *
+ * Opaque object representing the concurrent hash table.
+ */
+struct l_chashmap {
+	l_hashmap_hash_func_t hash_func;
+	l_hashmap_compare_func_t compare_func;
+	l_hashmap_key_new_func_t key_new_func;
+	l_hashmap_key_free_func_t key_free_func;
+	struct chashmap_table *table;
+	unsigned int entries;
+	unsigned int epoch;
+	pthread_mutex_t lock;
+	struct chashmap_readers readers[CHASHMAP_READER_SLOTS];
+};
+
+static unsigned int next_reader_slot;
+static __thread unsigned int reader_slot;
+
+static unsigned int direct_hash_func(const void *p)
+{
+	return L_PTR_TO_UINT(p);
+}
+
+static int direct_compare_func(const void *a, const void *b)
+{
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static inline void *get_key_new(const struct l_chashmap *chashmap,
+				const void *key)
+{
+	if (chashmap->key_new_func)
+		return chashmap->key_new_func(key);
+
+	return (void *)key;
+}
+
+static inline void free_key(const struct l_chashmap *chashmap, void *key)
+{
+	if (chashmap->key_free_func)
+		chashmap->key_free_func(key);
+}
+
+static inline unsigned int hash_to_bucket(const struct chashmap_table *table,
+							unsigned int hash)
+{
+	/* Fibonacci hashing, the direct hash of pointers is poor */
+	return (uint32_t) (hash * 0x9e3779b9u) >> (32 - table->bits);
+}
+
+static struct chashmap_table *table_new(unsigned int bits)
+{
+	struct chashmap_table *table;
+
+	table = l_malloc(sizeof(*table) + (sizeof(struct chashmap_entry *)
+								<< bits));
+	table->bits = bits;
+	memset(table->buckets, 0, sizeof(struct chashmap_entry *) << bits);
+
+	return table;
+}
+
+static unsigned int bits_for(unsigned int entries)
+{
+	unsigned int bits = CHASHMAP_MIN_BITS;
+
+	while (bits < CHASHMAP_MAX_BITS && (1U << bits) < entries)
+		bits++;
+
+	return bits;
+}
+
+static unsigned int reader_slot_get(void)
+{
+	if (unlikely(!reader_slot))
+		reader_slot = __atomic_add_fetch(&next_reader_slot, 1,
+							__ATOMIC_RELAXED);
+
+	return reader_slot % CHASHMAP_READER_SLOTS;
+}
+
+/* Called with the lock held, returns once no reader can see unlinked data */
+static void chashmap_synchronize(struct l_chashmap *chashmap)
+{
+	unsigned int i;
+	unsigned int j;
+
+	/* Order the unlinking before the reader counters are checked */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	for (i = 0; i < 2; i++) {
+		unsigned int idx = __atomic_load_n(&chashmap->epoch,
+							__ATOMIC_RELAXED);
+
+		__atomic_store_n(&chashmap->epoch, idx ^ 1, __ATOMIC_SEQ_CST);
+
+		for (j = 0; j < CHASHMAP_READER_SLOTS; j++) {
+			unsigned long *count =
+					&chashmap->readers[j].count[idx];
+
+			while (__atomic_load_n(count, __ATOMIC_SEQ_CST))
+				sched_yield();
+		}
+	}
+}
+
+static struct chashmap_entry **table_link(const struct l_chashmap *chashmap,
+						struct chashmap_table *table,
+						const void *key,
+						unsigned int hash)
+{
+	struct chashmap_entry **link;
+
+	link = &table->buckets[hash_to_bucket(table, hash)];
+
+	for (; *link; link = &(*link)->next) {
+		struct chashmap_entry *entry = *link;
+
+		if (entry->hash == hash &&
+				!chashmap->compare_func(key, entry->key))
+			return link;
+	}
+
+	return NULL;
+}
+
+/* Appends to the chain, entries with duplicate keys stay in order */
+static void table_append(struct chashmap_table *table,
+				struct chashmap_entry *entry)
+{
+	struct chashmap_entry **link;
+
+	link = &table->buckets[hash_to_bucket(table, entry->hash)];
+
+	while (*link)
+		link = &(*link)->next;
+
+	__atomic_store_n(link, entry, __ATOMIC_RELEASE);
+}
+
+static void table_free(struct chashmap_table *table)
+{
+	unsigned int i;
+
+	for (i = 0; i < 1U << table->bits; i++) {
+		struct chashmap_entry *entry = table->buckets[i];
+
+		while (entry) {
+			struct chashmap_entry *next = entry->next;
+
+			l_free(entry);
+			entry = next;
+		}
+	}
+
+	l_free(table);
+}
+
+static void table_resize(struct l_chashmap *chashmap, unsigned int bits)
+{
+	struct chashmap_table *old = chashmap->table;
+	struct chashmap_table *table = table_new(bits);
+	unsigned int i;
+
+	for (i = 0; i < 1U << old->bits; i++) {
+		struct chashmap_entry *entry;
+
+		for (entry = old->buckets[i]; entry; entry = entry->next) {
+			struct chashmap_entry *copy = l_memdup(entry,
+								sizeof(*entry));
+
+			copy->next = NULL;
+			table_append(table, copy);
+		}
+	}
+
+	__atomic_store_n(&chashmap->table, table, __ATOMIC_RELEASE);
+	chashmap_synchronize(chashmap);
+	table_free(old);
+}
+
+static void table_reserve(struct l_chashmap *chashmap)
+{
+	unsigned int bits = chashmap->table->bits;
+
+	if (chashmap->entries < 1U << bits || bits == CHASHMAP_MAX_BITS)
+		return;
+
+	table_resize(chashmap, bits + 1);
+}
+
+static void chashmap_insert(struct l_chashmap *chashmap, void *key,
+					void *value, unsigned int hash)
+{
+	struct chashmap_entry *entry;
+
+	table_reserve(chashmap);
+
+	entry = l_new(struct chashmap_entry, 1);
+	entry->key = key;
+	entry->value = value;
+	entry->hash = hash;
+	table_append(chashmap->table, entry);
+
+	__atomic_store_n(&chashmap->entries, chashmap->entries + 1,
+							__ATOMIC_RELAXED);
+}
+
+/**
+ * l_chashmap_new_sized:
+ * @hint: number of entries to make room for
+ *
+ * Create a new concurrent hash table, like l_chashmap_new(), with room for
+ * at least @hint entries before the table has to grow.
+ *
+ * Returns: a newly allocated #l_chashmap object
+ **/
+LIB_EXPORT struct l_chashmap *l_chashmap_new_sized(unsigned int hint)
+{
+	struct l_chashmap *chashmap;
+
+	chashmap = l_new(struct l_chashmap, 1);
+
+	chashmap->hash_func = direct_hash_func;
+	chashmap->compare_func = direct_compare_func;
+	chashmap->table = table_new(bits_for(hint));
+	pthread_mutex_init(&chashmap->lock, NULL);
+
+	return chashmap;
+}
+
+/**
+ * l_chashmap_new:
+ *
+ * Create a new concurrent hash table.  The keys are managed as pointers,
+ * that is, the pointer value is hashed and looked up.
+ *
+ * Lookups never block and can run in any number of threads at the same
+ * time, while changes are serialized.  Changes that drop references to
+ * values, keys or entries wait for all the lookups in progress to finish,
+ * so they are considerably more expensive than with #l_hashmap.  The
+ * table is meant for state that is read far more often than it changes.
+ *
+ * See also l_chashmap_string_new().
+ *
+ * Returns: a newly allocated #l_chashmap object
+ **/
+LIB_EXPORT struct l_chashmap *l_chashmap_new(void)
+{
+	return l_chashmap_new_sized(0);
+}
+
+/**
+ * l_chashmap_string_new:
+ *
+ * Create a new concurrent hash table.  The keys are considered strings and
+ * are copied.
+ *
+ * See also l_chashmap_new().
+ *
+ * Returns: a newly allocated #l_chashmap object
+ **/
+LIB_EXPORT struct l_chashmap *l_chashmap_string_new(void)
+{
+	struct l_chashmap *chashmap = l_chashmap_new();
+
+	chashmap->hash_func = l_str_hash_fast;
+	chashmap->compare_func = (l_hashmap_compare_func_t) strcmp;
+	chashmap->key_new_func = (l_hashmap_key_new_func_t) l_strdup;
+	chashmap->key_free_func = l_free;
+
+	return chashmap;
+}
+
+/**
+ * l_chashmap_set_hash_function:
+ * @chashmap: concurrent hash table object
+ * @func: Key hashing function
+ *
+ * Sets the hashing function to be used by this object.
+ *
+ * This function can only be called when the @chashmap is empty and not yet
+ * shared with other threads.
+ *
+ * Returns: #true when the hashing function could be updated successfully,
+ * and #false otherwise.
+ **/
+LIB_EXPORT bool l_chashmap_set_hash_function(struct l_chashmap *chashmap,
+						l_hashmap_hash_func_t func)
+{
+	if (unlikely(!chashmap))
+		return false;
+
+	if (chashmap->entries != 0)
+		return false;
+
+	chashmap->hash_func = func;
+
+	return true;
+}
+
+/**
+ * l_chashmap_set_compare_function:
+ * @chashmap: concurrent hash table object
+ * @func: Key compare function
+ *
+ * Sets the key comparison function to be used by this object.
+ *
+ * This function can only be called when the @chashmap is empty and not yet
+ * shared with other threads.
+ *
+ * Returns: #true when the comparison function could be updated successfully,
+ * and #false otherwise.
+ **/
+LIB_EXPORT bool l_chashmap_set_compare_function(struct l_chashmap *chashmap,
+						l_hashmap_compare_func_t func)
+{
+	if (unlikely(!chashmap))
+		return false;
+
+	if (chashmap->entries != 0)
+		return false;
+
+	chashmap->compare_func = func;
+
+	return true;
+}
+
+/**
+ * l_chashmap_set_key_copy_function:
+ * @chashmap: concurrent hash table object
+ * @func: Key duplication function
+ *
+ * Sets the key duplication function to be used by this object.  If the
+ * function is NULL, then the keys are assigned directly.
+ *
+ * This function can only be called when the @chashmap is empty and not yet
+ * shared with other threads.
+ *
+ * Returns: #true when the key copy function could be updated successfully,
+ * and #false otherwise.
+ **/
+LIB_EXPORT bool l_chashmap_set_key_copy_function(struct l_chashmap *chashmap,
+						l_hashmap_key_new_func_t func)
+{
+	if (unlikely(!chashmap))
+		return false;
+
+	if (chashmap->entries != 0)
+		return false;
+
+	chashmap->key_new_func = func;
+
+	return true;
+}
+
+/**
+ * l_chashmap_set_key_free_function:
+ * @chashmap: concurrent hash table object
+ * @func: Key destructor function
+ *
+ * Sets the key destructor function to be used by this object.  This function
+ * should undo the result of the function specified in
+ * l_chashmap_set_key_copy_function(). This function can be NULL, in which
+ * case no destructor is called.
+ *
+ * This function can only be called when the @chashmap is empty and not yet
+ * shared with other threads.
+ *
+ * Returns: #true when the key free function could be updated successfully,
+ * and #false otherwise.
+ **/
+LIB_EXPORT bool l_chashmap_set_key_free_function(struct l_chashmap *chashmap,
+						l_hashmap_key_free_func_t func)
+{
+	if (unlikely(!chashmap))
+		return false;
+
+	if (chashmap->entries != 0)
+		return false;
+
+	chashmap->key_free_func = func;
+
+	return true;
+}
+
+/**
+ * l_chashmap_destroy:
+ * @chashmap: concurrent hash table object
+ * @destroy: destroy function
+ *
+ * Free the concurrent hash table and call @destroy on all remaining
+ * entries.
+ *
+ * NOTE: No other thread may use the @chashmap anymore at this point.
+ **/
+LIB_EXPORT void l_chashmap_destroy(struct l_chashmap *chashmap,
+				l_hashmap_destroy_func_t destroy)
+{
+	struct chashmap_table *table;
+	unsigned int i;
+
+	if (unlikely(!chashmap))
+		return;
+
+	table = chashmap->table;
+
+	for (i = 0; i < 1U << table->bits; i++) {
+		struct chashmap_entry *entry;
+
+		for (entry = table->buckets[i]; entry; entry = entry->next) {
+			if (destroy)
+				destroy(entry->value);
+
+			free_key(chashmap, entry->key);
+		}
+	}
+
+	table_free(table);
+	pthread_mutex_destroy(&chashmap->lock);
+	l_free(chashmap);
+}
+
+/**
+ * l_chashmap_insert:
+ * @chashmap: concurrent hash table object
+ * @key: key pointer
+ * @value: value pointer
+ *
+ * Insert new @value entry with @key.  Note that entries with a duplicate key
+ * are allowed.  If a duplicate entry in inserted, it will be added in order
+ * of insertion.  @l_chashmap_lookup and @l_chashmap_remove will use the
+ * first matching entry.
+ *
+ * Returns: #true when value has been added and #false in case of failure
+ **/
+LIB_EXPORT bool l_chashmap_insert(struct l_chashmap *chashmap,
+					const void *key, void *value)
+{
+	void *key_new;
+
+	if (unlikely(!chashmap))
+		return false;
+
+	key_new = get_key_new(chashmap, key);
+
+	pthread_mutex_lock(&chashmap->lock);
+	chashmap_insert(chashmap, key_new, value,
+				chashmap->hash_func(key_new));
+	pthread_mutex_unlock(&chashmap->lock);
+
+	return true;
+}
+
+/**
+ * l_chashmap_replace:
+ * @chashmap: concurrent hash table object
+ * @key: key pointer
+ * @value: value pointer
+ * @old_value: old value that has been replaced.
+ *
+ * Replace the first entry with @key by @value or insert a new @value entry
+ * with @key.  If the entry was replaced, then the old value is returned
+ * in @old_value, otherwise @old_value is assigned a #NULL.  The old value
+ * is no longer referenced by any lookup by the time this returns, so it
+ * can be freed right away.
+ *
+ * Returns: #true when value has been added and #false in case of failure
+ **/
+LIB_EXPORT bool l_chashmap_replace(struct l_chashmap *chashmap,
+					const void *key, void *value,
+					void **old_value)
+{
+	struct chashmap_entry **link;
+	unsigned int hash;
+	void *key_new;
+
+	if (unlikely(!chashmap))
+		return false;
+
+	key_new = get_key_new(chashmap, key);
+	hash = chashmap->hash_func(key_new);
+
+	pthread_mutex_lock(&chashmap->lock);
+
+	link = table_link(chashmap, chashmap->table, key, hash);
+	if (link) {
+		struct chashmap_entry *entry = *link;
+		void *old = entry->value;
+
+		__atomic_store_n(&entry->value, value, __ATOMIC_RELEASE);
+
+		if (old_value) {
+			chashmap_synchronize(chashmap);
+			*old_value = old;
+		}
+
+		pthread_mutex_unlock(&chashmap->lock);
+		free_key(chashmap, key_new);
+
+		return true;
+	}
+
+	chashmap_insert(chashmap, key_new, value, hash);
+	pthread_mutex_unlock(&chashmap->lock);
+
+	if (old_value)
+		*old_value = NULL;
+
+	return true;
+}
+
+/**
+ * l_chashmap_remove:
+ * @chashmap: concurrent hash table object
+ * @key: key pointer
+ *
+ * Remove entry for @key.  This waits until no lookup can reference the
+ * entry anymore, so the returned value can be freed right away.
+ *
+ * Returns: value pointer of the removed entry or #NULL in case of failure
+ **/
+LIB_EXPORT void *l_chashmap_remove(struct l_chashmap *chashmap,
+							const void *key)
+{
+	struct chashmap_entry **link;
+	struct chashmap_entry *entry;
+	void *value;
+
+	if (unlikely(!chashmap))
+		return NULL;
+
+	pthread_mutex_lock(&chashmap->lock);
+
+	link = table_link(chashmap, chashmap->table, key,
+					chashmap->hash_func(key));
+	if (!link) {
+		pthread_mutex_unlock(&chashmap->lock);
+		return NULL;
+	}
+
+	entry = *link;
+	__atomic_store_n(link, entry->next, __ATOMIC_RELEASE);
+	__atomic_store_n(&chashmap->entries, chashmap->entries - 1,
+							__ATOMIC_RELAXED);
+	chashmap_synchronize(chashmap);
+
+	pthread_mutex_unlock(&chashmap->lock);
+
+	value = entry->value;
+	free_key(chashmap, entry->key);
+	l_free(entry);
+
+	return value;
+}
+
+/**
+ * l_chashmap_read_lock:
+ * @chashmap: concurrent hash table object
+ *
+ * Start a read side critical section.  Values returned by
+ * l_chashmap_lookup() inside the section stay valid until the matching
+ * l_chashmap_read_unlock(), even if they are removed or replaced by another
+ * thread in the meantime.  Sections can be nested, but the table must not
+ * be changed by the same thread from within one.
+ *
+ * Outside of a section, a value returned by l_chashmap_lookup() is only
+ * safe to use as long as the caller knows it is not removed concurrently.
+ *
+ * Returns: a token to be given to l_chashmap_read_unlock()
+ **/
+LIB_EXPORT unsigned int l_chashmap_read_lock(struct l_chashmap *chashmap)
+{
+	unsigned int slot = reader_slot_get();
+	unsigned int idx;
+
+	if (unlikely(!chashmap))
+		return 0;
+
+	idx = __atomic_load_n(&chashmap->epoch, __ATOMIC_RELAXED) & 1;
+	__atomic_fetch_add(&chashmap->readers[slot].count[idx], 1,
+							__ATOMIC_SEQ_CST);
+
+	return slot << 1 | idx;
+}
+
+/**
+ * l_chashmap_read_unlock:
+ * @chashmap: concurrent hash table object
+ * @token: value returned by l_chashmap_read_lock()
+ *
+ * End a read side critical section.
+ **/
+LIB_EXPORT void l_chashmap_read_unlock(struct l_chashmap *chashmap,
+							unsigned int token)
+{
+	if (unlikely(!chashmap))
+		return;
+
+	__atomic_fetch_sub(&chashmap->readers[token >> 1].count[token & 1], 1,
+							__ATOMIC_RELEASE);
+}
+
+/**
+ * l_chashmap_lookup:
+ * @chashmap: concurrent hash table object
+ * @key: key pointer
+ *
+ * Lookup entry for @key.  This never blocks, see l_chashmap_read_lock()
+ * for how long the returned value can be used.
+ *
+ * Returns: value pointer for @key or #NULL in case of failure
+ **/
+LIB_EXPORT void *l_chashmap_lookup(struct l_chashmap *chashmap,
+							const void *key)
+{
+	const struct chashmap_table *table;
+	const struct chashmap_entry *entry;
+	unsigned int token;
+	unsigned int hash;
+	void *value = NULL;
+
+	if (unlikely(!chashmap))
+		return NULL;
+
+	hash = chashmap->hash_func(key);
+	token = l_chashmap_read_lock(chashmap);
+
+	table = __atomic_load_n(&chashmap->table, __ATOMIC_ACQUIRE);
+	entry = __atomic_load_n(&table->buckets[hash_to_bucket(table, hash)],
+							__ATOMIC_ACQUIRE);
+
+	for (; entry; entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE)) {
+		if (entry->hash == hash &&
+				!chashmap->compare_func(key, entry->key)) {
+			value = __atomic_load_n(&entry->value,
+							__ATOMIC_ACQUIRE);
+			break;
+		}
+	}
+
+	l_chashmap_read_unlock(chashmap, token);
+
+	return value;
+}
+
+/**
+ * l_chashmap_foreach:
+ * @chashmap: concurrent hash table object
+ * @function: callback function
+ * @user_data: user data given to callback function
+ *
+ * Call @function for every entry in @chashmap.  The walk is a read side
+ * critical section, entries inserted or removed by other threads while it
+ * is in progress may or may not be seen.  @function must not change the
+ * @chashmap.
+ **/
+LIB_EXPORT void l_chashmap_foreach(struct l_chashmap *chashmap,
+			l_hashmap_foreach_func_t function, void *user_data)
+{
+	const struct chashmap_table *table;
+	unsigned int token;
+	unsigned int i;
+
+	if (unlikely(!chashmap || !function))
+		return;
+
+	token = l_chashmap_read_lock(chashmap);
+	table = __atomic_load_n(&chashmap->table, __ATOMIC_ACQUIRE);
+
+	for (i = 0; i < 1U << table->bits; i++) {
+		const struct chashmap_entry *entry;
+
+		entry = __atomic_load_n(&table->buckets[i], __ATOMIC_ACQUIRE);
+
+		for (; entry; entry = __atomic_load_n(&entry->next,
+							__ATOMIC_ACQUIRE))
+			function(entry->key, __atomic_load_n(&entry->value,
+							__ATOMIC_ACQUIRE),
+					user_data);
+	}
+
+	l_chashmap_read_unlock(chashmap, token);
+}
+
+/**
+ * l_chashmap_size:
+ * @chashmap: concurrent hash table object
+ *
+ * Returns: entries in the concurrent hash table
+ **/
+LIB_EXPORT unsigned int l_chashmap_size(struct l_chashmap *chashmap)
+{
+	if (unlikely(!chashmap))
+		return 0;
+
+	return __atomic_load_n(&chashmap->entries, __ATOMIC_RELAXED);
+}
+
+/**
+ * l_chashmap_isempty:
+ * @chashmap: concurrent hash table object
+ *
+ * Returns: #true if the concurrent hash table is empty and #false otherwise
+ **/
+LIB_EXPORT bool l_chashmap_isempty(struct l_chashmap *chashmap)
+{
+	return l_chashmap_size(chashmap) == 0;
+}
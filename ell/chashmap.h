@@ -0,0 +1,57 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef __ELL_CHASHMAP_H
+#define __ELL_CHASHMAP_H
+
+#include <stdbool.h>
+#include <ell/hashmap.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct l_chashmap;
+
+struct l_chashmap *l_chashmap_new(void);
+struct l_chashmap *l_chashmap_new_sized(unsigned int hint);
+struct l_chashmap *l_chashmap_string_new(void);
+
+bool l_chashmap_set_hash_function(struct l_chashmap *chashmap,
+						l_hashmap_hash_func_t func);
+bool l_chashmap_set_compare_function(struct l_chashmap *chashmap,
+						l_hashmap_compare_func_t func);
+bool l_chashmap_set_key_copy_function(struct l_chashmap *chashmap,
+						l_hashmap_key_new_func_t func);
+bool l_chashmap_set_key_free_function(struct l_chashmap *chashmap,
+					l_hashmap_key_free_func_t func);
+
+void l_chashmap_destroy(struct l_chashmap *chashmap,
+			l_hashmap_destroy_func_t destroy);
+
+bool l_chashmap_insert(struct l_chashmap *chashmap,
+			const void *key, void *value);
+bool l_chashmap_replace(struct l_chashmap *chashmap,
+					const void *key, void *value,
+					void **old_value);
+void *l_chashmap_remove(struct l_chashmap *chashmap, const void *key);
+void *l_chashmap_lookup(struct l_chashmap *chashmap, const void *key);
+
+void l_chashmap_foreach(struct l_chashmap *chashmap,
+			l_hashmap_foreach_func_t function, void *user_data);
+
+unsigned int l_chashmap_read_lock(struct l_chashmap *chashmap);
+void l_chashmap_read_unlock(struct l_chashmap *chashmap, unsigned int token);
+
+unsigned int l_chashmap_size(struct l_chashmap *chashmap);
+bool l_chashmap_isempty(struct l_chashmap *chashmap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ELL_CHASHMAP_H */
@@ -0,0 +1,9 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+bool checksum_iterate(enum l_checksum_type type, const void *data, size_t len,
+			unsigned int iterations, uint8_t *out);
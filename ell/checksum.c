@@ -12,13 +12,22 @@
 #define _GNU_SOURCE
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 
 #include "useful.h"
 #include "checksum.h"
 #include "private.h"
+#include "alg-private.h"
+#include "checksum-private.h"
 
 #ifndef HAVE_LINUX_IF_ALG_H
 #ifndef HAVE_LINUX_TYPES_H
@@ -99,6 +108,9 @@ static const struct {
 
 #define is_valid_index(array, i) ((i) >= 0 && (i) < L_ARRAY_SIZE(array))
 
+/* Upper limit on the data read or spliced at once by l_checksum_update_fd */
+#define CHECKSUM_FD_CHUNK	65536
+
 /**
  * l_checksum:
  *
@@ -106,53 +118,1318 @@ static const struct {
  */
 struct l_checksum {
 	int sk;
+	struct alg_parent parent;
 	const struct checksum_info *alg_info;
+	struct local_checksum *local;
+};
+
+/*
+ * In-process MD5, SHA-1 and SHA-2 used in place of AF_ALG.  A hash socket
+ * costs three syscalls to create and one per update, which dominates when
+ * hashing the many short messages of TLS handshakes, PRFs and EAPOL.  The
+ * kernel is still used for the other algorithms.  SHA-1 and SHA-256 use
+ * the SHA extensions on x86-64 CPUs that have them.
+ */
+#define LOCAL_MAX_BLOCK_SIZE 128
+
+struct local_checksum_impl {
+	unsigned int block_size;
+	bool big_endian;
+	bool wide;
+	unsigned int n_words;
+	const void *iv;
+	void (*compress)(void *h, const uint8_t *blocks, size_t n_blocks);
 };
 
-static int create_alg(const char *alg)
+struct local_checksum_state {
+	union {
+		uint32_t w32[8];
+		uint64_t w64[8];
+	} h;
+	uint64_t len;
+	uint8_t buf[LOCAL_MAX_BLOCK_SIZE];
+	unsigned int buf_len;
+};
+
+struct local_checksum {
+	const struct local_checksum_impl *impl;
+	unsigned int digest_len;
+	bool hmac;
+	struct local_checksum_state state;
+	struct local_checksum_state initial;
+	struct local_checksum_state outer;
+};
+
+static inline uint32_t rol32(uint32_t x, unsigned int n)
 {
-	struct sockaddr_alg salg;
-	int sk;
+	return (x << n) | (x >> (32 - n));
+}
 
-	sk = socket(PF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
-	if (sk < 0)
-		return -1;
+static inline uint32_t ror32(uint32_t x, unsigned int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
 
-	memset(&salg, 0, sizeof(salg));
-	salg.salg_family = AF_ALG;
-	strcpy((char *) salg.salg_type, "hash");
-	strcpy((char *) salg.salg_name, alg);
+static inline uint64_t ror64(uint64_t x, unsigned int n)
+{
+	return (x >> n) | (x << (64 - n));
+}
 
-	if (bind(sk, (struct sockaddr *) &salg, sizeof(salg)) < 0) {
-		close(sk);
-		return -1;
+static const uint32_t md5_iv[4] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476,
+};
+
+static const uint32_t md5_k[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+	0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+	0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+	0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+	0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+	0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint8_t md5_r[16] = {
+	7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21,
+};
+
+static void md5_compress(void *data, const uint8_t *p, size_t n_blocks)
+{
+	uint32_t *h = data;
+	uint32_t w[16];
+	unsigned int i;
+
+	for (; n_blocks; n_blocks--, p += 64) {
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+
+		for (i = 0; i < 16; i++)
+			w[i] = l_get_le32(p + i * 4);
+
+		for (i = 0; i < 64; i++) {
+			uint32_t f, tmp;
+			unsigned int g;
+
+			switch (i / 16) {
+			case 0:
+				f = (b & c) | (~b & d);
+				g = i;
+				break;
+			case 1:
+				f = (d & b) | (~d & c);
+				g = (5 * i + 1) % 16;
+				break;
+			case 2:
+				f = b ^ c ^ d;
+				g = (3 * i + 5) % 16;
+				break;
+			default:
+				f = c ^ (b | ~d);
+				g = (7 * i) % 16;
+				break;
+			}
+
+			tmp = d;
+			d = c;
+			c = b;
+			b += rol32(a + f + md5_k[i] + w[g],
+					md5_r[(i / 16) * 4 + i % 4]);
+			a = tmp;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
 	}
 
-	return sk;
+	explicit_bzero(w, sizeof(w));
 }
 
-static struct l_checksum *checksum_new_common(const char *alg, int sockopt,
-						const void *data, size_t len,
-						struct checksum_info *info)
+static const uint32_t sha1_iv[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+};
+
+static void sha1_compress_generic(uint32_t *h, const uint8_t *p,
+					size_t n_blocks)
 {
-	struct l_checksum *checksum;
-	int fd;
+	uint32_t w[80];
+	unsigned int i;
+
+	for (; n_blocks; n_blocks--, p += 64) {
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+		for (i = 0; i < 16; i++)
+			w[i] = l_get_be32(p + i * 4);
+
+		for (; i < 80; i++)
+			w[i] = rol32(w[i - 3] ^ w[i - 8] ^
+					w[i - 14] ^ w[i - 16], 1);
+
+		for (i = 0; i < 80; i++) {
+			uint32_t f, k, tmp;
+
+			if (i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			} else if (i < 60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+
+			tmp = rol32(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rol32(b, 30);
+			b = a;
+			a = tmp;
+		}
 
-	fd = create_alg(alg);
-	if (fd < 0)
-		return NULL;
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+
+	explicit_bzero(w, sizeof(w));
+}
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256_compress_generic(uint32_t *h, const uint8_t *p,
+					size_t n_blocks)
+{
+	uint32_t w[64];
+	uint32_t s[8];
+	unsigned int i;
+
+	for (; n_blocks; n_blocks--, p += 64) {
+		for (i = 0; i < 16; i++)
+			w[i] = l_get_be32(p + i * 4);
+
+		for (; i < 64; i++) {
+			uint32_t s0 = ror32(w[i - 15], 7) ^
+					ror32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32_t s1 = ror32(w[i - 2], 17) ^
+					ror32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		memcpy(s, h, sizeof(s));
+
+		for (i = 0; i < 64; i++) {
+			uint32_t s1 = ror32(s[4], 6) ^ ror32(s[4], 11) ^
+					ror32(s[4], 25);
+			uint32_t ch = (s[4] & s[5]) ^ (~s[4] & s[6]);
+			uint32_t t1 = s[7] + s1 + ch + sha256_k[i] + w[i];
+			uint32_t s0 = ror32(s[0], 2) ^ ror32(s[0], 13) ^
+					ror32(s[0], 22);
+			uint32_t maj = (s[0] & s[1]) ^ (s[0] & s[2]) ^
+					(s[1] & s[2]);
+
+			memmove(s + 1, s, 7 * sizeof(uint32_t));
+			s[4] += t1;
+			s[0] = t1 + s0 + maj;
+		}
+
+		for (i = 0; i < 8; i++)
+			h[i] += s[i];
+	}
+
+	explicit_bzero(w, sizeof(w));
+	explicit_bzero(s, sizeof(s));
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+/*
+ * SHA-1 and SHA-256 using the SHA-NI instructions, following the Intel
+ * SHA Extensions white paper.  The state is kept in the word order the
+ * instructions expect, ABCD and E for SHA-1, ABEF and CDGH for SHA-256,
+ * while blocks are processed and converted back at the end.
+ */
+#define SHA_NI_TARGET __attribute__((target("sha,sse4.1")))
+
+static bool sha_ni_is_supported(void)
+{
+	return __builtin_cpu_supports("sha") &&
+		__builtin_cpu_supports("sse4.1");
+}
+
+static SHA_NI_TARGET __m128i sha1_rnds4(__m128i abcd, __m128i e,
+					unsigned int func)
+{
+	/* The function selector has to be an immediate */
+	switch (func) {
+	case 0:
+		return _mm_sha1rnds4_epu32(abcd, e, 0);
+	case 1:
+		return _mm_sha1rnds4_epu32(abcd, e, 1);
+	case 2:
+		return _mm_sha1rnds4_epu32(abcd, e, 2);
+	}
+
+	return _mm_sha1rnds4_epu32(abcd, e, 3);
+}
+
+static inline SHA_NI_TARGET void sha1_block_ni(__m128i *abcd, __m128i *e0,
+							__m128i *msg)
+{
+	__m128i abcd_save = *abcd;
+	__m128i e = *e0;
+	__m128i prev = *abcd;
+	unsigned int i;
+
+	/* Four rounds per step, W[4i..4i+3] computed in place */
+#pragma GCC unroll 20
+	for (i = 0; i < 20; i++) {
+		if (i >= 4)
+			msg[i & 3] = _mm_sha1msg2_epu32(
+					_mm_xor_si128(
+					_mm_sha1msg1_epu32(msg[i & 3],
+						msg[(i + 1) & 3]),
+					msg[(i + 2) & 3]),
+					msg[(i + 3) & 3]);
+
+		if (i == 0)
+			e = _mm_add_epi32(e, msg[0]);
+		else
+			e = _mm_sha1nexte_epu32(prev, msg[i & 3]);
+
+		prev = *abcd;
+		*abcd = sha1_rnds4(*abcd, e, i / 5);
+	}
+
+	*e0 = _mm_sha1nexte_epu32(prev, *e0);
+	*abcd = _mm_add_epi32(*abcd, abcd_save);
+}
+
+static SHA_NI_TARGET void sha1_compress_ni(uint32_t *h, const uint8_t *p,
+						size_t n_blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+						0x08090a0b0c0d0e0fULL);
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const void *) h),
+						0x1b);
+	__m128i e0 = _mm_set_epi32(h[4], 0, 0, 0);
+	__m128i msg[4];
+	unsigned int i;
+
+	for (; n_blocks; n_blocks--, p += 64) {
+		for (i = 0; i < 4; i++)
+			msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(
+						(const void *) (p + i * 16)),
+						mask);
+
+		sha1_block_ni(&abcd, &e0, msg);
+	}
+
+	_mm_storeu_si128((void *) h, _mm_shuffle_epi32(abcd, 0x1b));
+	h[4] = _mm_extract_epi32(e0, 3);
+}
+
+/*
+ * PBKDF2 iterations for HMAC-SHA1, RFC 8018 Section 5.2.  Each message is
+ * the previous 20-byte digest so the block is built from the state
+ * registers directly.  @u holds U_1 on entry and the XOR of U_1 to U_c on
+ * return.
+ */
+static SHA_NI_TARGET void sha1_pbkdf2_ni(const uint32_t *inner,
+						const uint32_t *outer,
+						uint32_t *u,
+						unsigned int iter_count)
+{
+	const __m128i pad = _mm_set_epi32(0, 0x80000000, 0, 0);
+	const __m128i len = _mm_set_epi32(0, 0, 0, (64 + 20) * 8);
+	__m128i inner_abcd = _mm_shuffle_epi32(_mm_loadu_si128(
+						(const void *) inner), 0x1b);
+	__m128i inner_e0 = _mm_set_epi32(inner[4], 0, 0, 0);
+	__m128i outer_abcd = _mm_shuffle_epi32(_mm_loadu_si128(
+						(const void *) outer), 0x1b);
+	__m128i outer_e0 = _mm_set_epi32(outer[4], 0, 0, 0);
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const void *) u),
+						0x1b);
+	__m128i e0 = _mm_set_epi32(u[4], 0, 0, 0);
+	__m128i t_abcd = abcd;
+	__m128i t_e0 = e0;
+	__m128i msg[4];
+	unsigned int i;
+
+	for (i = 1; i < iter_count; i++) {
+		msg[0] = abcd;
+		msg[1] = _mm_or_si128(e0, pad);
+		msg[2] = _mm_setzero_si128();
+		msg[3] = len;
+		abcd = inner_abcd;
+		e0 = inner_e0;
+		sha1_block_ni(&abcd, &e0, msg);
+
+		msg[0] = abcd;
+		msg[1] = _mm_or_si128(e0, pad);
+		msg[2] = _mm_setzero_si128();
+		msg[3] = len;
+		abcd = outer_abcd;
+		e0 = outer_e0;
+		sha1_block_ni(&abcd, &e0, msg);
+
+		t_abcd = _mm_xor_si128(t_abcd, abcd);
+		t_e0 = _mm_xor_si128(t_e0, e0);
+	}
+
+	_mm_storeu_si128((void *) u, _mm_shuffle_epi32(t_abcd, 0x1b));
+	u[4] = _mm_extract_epi32(t_e0, 3);
+}
+
+static inline SHA_NI_TARGET void sha256_block_ni(__m128i *state0,
+							__m128i *state1,
+							__m128i *msg)
+{
+	__m128i abef_save = *state0;
+	__m128i cdgh_save = *state1;
+	unsigned int i;
+
+	/* Four rounds per step, W[4i+16..4i+19] computed in place */
+#pragma GCC unroll 16
+	for (i = 0; i < 16; i++) {
+		__m128i wk = _mm_add_epi32(msg[i & 3],
+				_mm_loadu_si128((const void *)
+						(sha256_k + i * 4)));
+
+		*state1 = _mm_sha256rnds2_epu32(*state1, *state0, wk);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		*state0 = _mm_sha256rnds2_epu32(*state0, *state1, wk);
+
+		if (i >= 12)
+			continue;
+
+		msg[i & 3] = _mm_sha256msg2_epu32(
+				_mm_add_epi32(
+				_mm_sha256msg1_epu32(msg[i & 3],
+						msg[(i + 1) & 3]),
+				_mm_alignr_epi8(msg[(i + 3) & 3],
+						msg[(i + 2) & 3], 4)),
+				msg[(i + 3) & 3]);
+	}
+
+	*state0 = _mm_add_epi32(*state0, abef_save);
+	*state1 = _mm_add_epi32(*state1, cdgh_save);
+}
+
+/* Converts between A-D, E-H and ABEF, CDGH in either direction */
+static inline SHA_NI_TARGET void sha256_swap_order_ni(__m128i *x0,
+							__m128i *x1)
+{
+	__m128i tmp = _mm_shuffle_epi32(*x0, 0xb1);
+
+	*x1 = _mm_shuffle_epi32(*x1, 0x1b);
+	*x0 = _mm_alignr_epi8(tmp, *x1, 8);
+	*x1 = _mm_blend_epi16(*x1, tmp, 0xf0);
+}
+
+static inline SHA_NI_TARGET void sha256_unswap_order_ni(__m128i *x0,
+							__m128i *x1)
+{
+	__m128i tmp = _mm_shuffle_epi32(*x0, 0x1b);
+
+	*x1 = _mm_shuffle_epi32(*x1, 0xb1);
+	*x0 = _mm_blend_epi16(tmp, *x1, 0xf0);
+	*x1 = _mm_alignr_epi8(*x1, tmp, 8);
+}
+
+static SHA_NI_TARGET void sha256_compress_ni(uint32_t *h, const uint8_t *p,
+						size_t n_blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+						0x0405060700010203ULL);
+	__m128i state0 = _mm_loadu_si128((const void *) h);
+	__m128i state1 = _mm_loadu_si128((const void *) (h + 4));
+	__m128i msg[4];
+	unsigned int i;
+
+	sha256_swap_order_ni(&state0, &state1);
+
+	for (; n_blocks; n_blocks--, p += 64) {
+		for (i = 0; i < 4; i++)
+			msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(
+						(const void *) (p + i * 16)),
+						mask);
+
+		sha256_block_ni(&state0, &state1, msg);
+	}
+
+	sha256_unswap_order_ni(&state0, &state1);
+	_mm_storeu_si128((void *) h, state0);
+	_mm_storeu_si128((void *) (h + 4), state1);
+}
+
+/* Same as sha1_pbkdf2_ni for HMAC-SHA256 */
+static SHA_NI_TARGET void sha256_pbkdf2_ni(const uint32_t *inner,
+						const uint32_t *outer,
+						uint32_t *u,
+						unsigned int iter_count)
+{
+	const __m128i pad = _mm_set_epi32(0, 0, 0, 0x80000000);
+	const __m128i len = _mm_set_epi32((64 + 32) * 8, 0, 0, 0);
+	__m128i inner0 = _mm_loadu_si128((const void *) inner);
+	__m128i inner1 = _mm_loadu_si128((const void *) (inner + 4));
+	__m128i outer0 = _mm_loadu_si128((const void *) outer);
+	__m128i outer1 = _mm_loadu_si128((const void *) (outer + 4));
+	__m128i t0 = _mm_loadu_si128((const void *) u);
+	__m128i t1 = _mm_loadu_si128((const void *) (u + 4));
+	__m128i state0 = t0;
+	__m128i state1 = t1;
+	__m128i msg[4];
+	unsigned int i;
+
+	sha256_swap_order_ni(&inner0, &inner1);
+	sha256_swap_order_ni(&outer0, &outer1);
+
+	for (i = 1; i < iter_count; i++) {
+		msg[0] = state0;
+		msg[1] = state1;
+		msg[2] = pad;
+		msg[3] = len;
+		state0 = inner0;
+		state1 = inner1;
+		sha256_block_ni(&state0, &state1, msg);
+		sha256_unswap_order_ni(&state0, &state1);
+
+		msg[0] = state0;
+		msg[1] = state1;
+		msg[2] = pad;
+		msg[3] = len;
+		state0 = outer0;
+		state1 = outer1;
+		sha256_block_ni(&state0, &state1, msg);
+		sha256_unswap_order_ni(&state0, &state1);
+
+		t0 = _mm_xor_si128(t0, state0);
+		t1 = _mm_xor_si128(t1, state1);
+	}
+
+	_mm_storeu_si128((void *) u, t0);
+	_mm_storeu_si128((void *) (u + 4), t1);
+}
+
+#endif
+
+static void sha1_compress(void *h, const uint8_t *p, size_t n_blocks)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (sha_ni_is_supported()) {
+		sha1_compress_ni(h, p, n_blocks);
+		return;
+	}
+#endif
+
+	sha1_compress_generic(h, p, n_blocks);
+}
 
-	if (data) {
-		if (setsockopt(fd, SOL_ALG, sockopt, data, len) < 0) {
-			close(fd);
-			return NULL;
+static void sha256_compress(void *h, const uint8_t *p, size_t n_blocks)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (sha_ni_is_supported()) {
+		sha256_compress_ni(h, p, n_blocks);
+		return;
+	}
+#endif
+
+	sha256_compress_generic(h, p, n_blocks);
+}
+
+static const uint64_t sha384_iv[8] = {
+	0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL,
+	0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+	0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL,
+	0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL,
+};
+
+static const uint64_t sha512_iv[8] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+	0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+	0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+static const uint64_t sha512_k[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL,
+	0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+	0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+	0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+	0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+	0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL,
+	0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+	0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+	0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+	0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL,
+	0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL,
+	0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+	0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+	0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+	0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL,
+	0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL,
+	0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+	0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+	0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+	0xd192e819d6ef5218ULL, 0xd69906245565a910ULL,
+	0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+	0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+	0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+	0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+	0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL,
+	0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL,
+	0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+	0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+	0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+	0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+	0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL,
+	0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+	0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+	0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+static void sha512_compress(void *data, const uint8_t *p, size_t n_blocks)
+{
+	uint64_t *h = data;
+	uint64_t w[80];
+	uint64_t s[8];
+	unsigned int i;
+
+	for (; n_blocks; n_blocks--, p += 128) {
+		for (i = 0; i < 16; i++)
+			w[i] = l_get_be64(p + i * 8);
+
+		for (; i < 80; i++) {
+			uint64_t s0 = ror64(w[i - 15], 1) ^
+					ror64(w[i - 15], 8) ^ (w[i - 15] >> 7);
+			uint64_t s1 = ror64(w[i - 2], 19) ^
+					ror64(w[i - 2], 61) ^ (w[i - 2] >> 6);
+
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		memcpy(s, h, sizeof(s));
+
+		for (i = 0; i < 80; i++) {
+			uint64_t s1 = ror64(s[4], 14) ^ ror64(s[4], 18) ^
+					ror64(s[4], 41);
+			uint64_t ch = (s[4] & s[5]) ^ (~s[4] & s[6]);
+			uint64_t t1 = s[7] + s1 + ch + sha512_k[i] + w[i];
+			uint64_t s0 = ror64(s[0], 28) ^ ror64(s[0], 34) ^
+					ror64(s[0], 39);
+			uint64_t maj = (s[0] & s[1]) ^ (s[0] & s[2]) ^
+					(s[1] & s[2]);
+
+			memmove(s + 1, s, 7 * sizeof(uint64_t));
+			s[4] += t1;
+			s[0] = t1 + s0 + maj;
 		}
+
+		for (i = 0; i < 8; i++)
+			h[i] += s[i];
 	}
 
-	checksum = l_new(struct l_checksum, 1);
-	checksum->sk = accept4(fd, NULL, 0, SOCK_CLOEXEC);
-	close(fd);
+	explicit_bzero(w, sizeof(w));
+	explicit_bzero(s, sizeof(s));
+}
+
+static const struct local_checksum_impl local_checksum_impls[] = {
+	[L_CHECKSUM_MD5] = { 64, false, false, 4, md5_iv, md5_compress },
+	[L_CHECKSUM_SHA1] = { 64, true, false, 5, sha1_iv, sha1_compress },
+	[L_CHECKSUM_SHA256] = {
+		64, true, false, 8, sha256_iv, sha256_compress
+	},
+	[L_CHECKSUM_SHA384] = {
+		128, true, true, 8, sha384_iv, sha512_compress
+	},
+	[L_CHECKSUM_SHA512] = {
+		128, true, true, 8, sha512_iv, sha512_compress
+	},
+};
+
+#define HAVE_LOCAL_IMPLEMENTATION(type)				\
+	(is_valid_index(local_checksum_impls, (type)) &&	\
+	 local_checksum_impls[(type)].compress)
+
+static void local_checksum_init(const struct local_checksum_impl *impl,
+				struct local_checksum_state *state)
+{
+	memcpy(&state->h, impl->iv, impl->n_words * (impl->wide ? 8 : 4));
+	state->len = 0;
+	state->buf_len = 0;
+}
+
+static void local_checksum_update(const struct local_checksum_impl *impl,
+					struct local_checksum_state *state,
+					const uint8_t *data, size_t len)
+{
+	size_t n_blocks;
+
+	/* data may be NULL, don't touch the pending partial block */
+	if (!len)
+		return;
+
+	state->len += len;
+
+	if (state->buf_len) {
+		size_t n = minsize(len, impl->block_size - state->buf_len);
+
+		memcpy(state->buf + state->buf_len, data, n);
+		state->buf_len += n;
+		data += n;
+		len -= n;
+
+		if (state->buf_len < impl->block_size)
+			return;
+
+		impl->compress(&state->h, state->buf, 1);
+		state->buf_len = 0;
+	}
+
+	n_blocks = len / impl->block_size;
+	if (n_blocks) {
+		impl->compress(&state->h, data, n_blocks);
+		data += n_blocks * impl->block_size;
+		len -= n_blocks * impl->block_size;
+	}
+
+	memcpy(state->buf, data, len);
+	state->buf_len = len;
+}
+
+/* Writes the length field of the last block of a @len byte message */
+static void local_checksum_put_length(const struct local_checksum_impl *impl,
+					uint8_t *block, uint64_t len)
+{
+	unsigned int len_offset = impl->block_size - (impl->wide ? 16 : 8);
+
+	if (!impl->big_endian)
+		l_put_le64(len << 3, block + len_offset);
+	else if (impl->wide) {
+		l_put_be64(len >> 61, block + len_offset);
+		l_put_be64(len << 3, block + len_offset + 8);
+	} else
+		l_put_be64(len << 3, block + len_offset);
+}
+
+static void local_checksum_put_digest(
+				const struct local_checksum_impl *impl,
+				const struct local_checksum_state *state,
+				uint8_t *out, unsigned int digest_len)
+{
+	unsigned int i;
+
+	if (impl->big_endian && !impl->wide && !(digest_len & 3)) {
+		for (i = 0; i < digest_len / 4; i++)
+			l_put_be32(state->h.w32[i], out + i * 4);
+
+		return;
+	}
+
+	for (i = 0; i < digest_len; i += impl->wide ? 8 : 4) {
+		uint8_t word[8];
+
+		if (impl->wide)
+			l_put_be64(state->h.w64[i / 8], word);
+		else if (impl->big_endian)
+			l_put_be32(state->h.w32[i / 4], word);
+		else
+			l_put_le32(state->h.w32[i / 4], word);
+
+		memcpy(out + i, word, minsize(digest_len - i,
+						impl->wide ? 8 : 4));
+	}
+}
+
+/* Writes the full digest, @state is left in an undefined state */
+static void local_checksum_final(const struct local_checksum_impl *impl,
+					struct local_checksum_state *state,
+					uint8_t *out, unsigned int digest_len)
+{
+	unsigned int len_offset = impl->block_size - (impl->wide ? 16 : 8);
+
+	state->buf[state->buf_len++] = 0x80;
+
+	if (state->buf_len > len_offset) {
+		memset(state->buf + state->buf_len, 0,
+				impl->block_size - state->buf_len);
+		impl->compress(&state->h, state->buf, 1);
+		state->buf_len = 0;
+	}
+
+	memset(state->buf + state->buf_len, 0,
+			impl->block_size - state->buf_len);
+	local_checksum_put_length(impl, state->buf, state->len);
+	impl->compress(&state->h, state->buf, 1);
+	local_checksum_put_digest(impl, state, out, digest_len);
+}
 
+static struct local_checksum *local_checksum_new(enum l_checksum_type type,
+							bool hmac,
+							const uint8_t *key,
+							size_t key_len)
+{
+	const struct local_checksum_impl *impl = &local_checksum_impls[type];
+	struct local_checksum *local = l_new(struct local_checksum, 1);
+	uint8_t k0[LOCAL_MAX_BLOCK_SIZE] = {};
+	unsigned int i;
+
+	local->impl = impl;
+	local->digest_len = checksum_algs[type].digest_len;
+	local_checksum_init(impl, &local->initial);
+
+	/* RFC 2104, the inner and outer pads are hashed once up front */
+	if (hmac) {
+		local->hmac = true;
+
+		if (key_len > impl->block_size) {
+			local_checksum_update(impl, &local->initial,
+						key, key_len);
+			local_checksum_final(impl, &local->initial, k0,
+						local->digest_len);
+			local_checksum_init(impl, &local->initial);
+		} else
+			memcpy(k0, key, key_len);
+
+		local->outer = local->initial;
+
+		for (i = 0; i < impl->block_size; i++)
+			k0[i] ^= 0x36;
+
+		local_checksum_update(impl, &local->initial, k0,
+					impl->block_size);
+
+		for (i = 0; i < impl->block_size; i++)
+			k0[i] ^= 0x36 ^ 0x5c;
+
+		local_checksum_update(impl, &local->outer, k0,
+					impl->block_size);
+		explicit_bzero(k0, sizeof(k0));
+	}
+
+	local->state = local->initial;
+	return local;
+}
+
+static void local_checksum_free(struct local_checksum *local)
+{
+	explicit_bzero(local, sizeof(*local));
+	l_free(local);
+}
+
+static size_t local_checksum_get_digest(struct local_checksum *local,
+					uint8_t *digest, size_t len)
+{
+	const struct local_checksum_impl *impl = local->impl;
+	uint8_t out[64];
+
+	local_checksum_final(impl, &local->state, out, local->digest_len);
+
+	if (local->hmac) {
+		local->state = local->outer;
+		local_checksum_update(impl, &local->state, out,
+					local->digest_len);
+		local_checksum_final(impl, &local->state, out,
+					local->digest_len);
+	}
+
+	/* Like with AF_ALG the next update starts a new message */
+	local->state = local->initial;
+
+	len = minsize(len, local->digest_len);
+	memcpy(digest, out, len);
+	explicit_bzero(out, sizeof(out));
+	return len;
+}
+
+/*
+ * PBKDF2 F() for output block @index, RFC 8018 Section 5.2.  From the
+ * second iteration on each HMAC message is a single digest so the padded
+ * block is built once and an iteration is two compressions starting from
+ * the precomputed inner and outer pad states.
+ */
+static void local_pbkdf2_block(const struct local_checksum *local,
+				const uint8_t *salt, size_t salt_len,
+				uint32_t index, unsigned int iter_count,
+				uint8_t *t)
+{
+	const struct local_checksum_impl *impl = local->impl;
+	unsigned int digest_len = local->digest_len;
+	struct local_checksum_state state = local->initial;
+	uint8_t block[LOCAL_MAX_BLOCK_SIZE];
+	uint8_t index_buf[4];
+	unsigned int i, j;
+
+	l_put_be32(index, index_buf);
+	local_checksum_update(impl, &state, salt, salt_len);
+	local_checksum_update(impl, &state, index_buf, 4);
+	local_checksum_final(impl, &state, block, digest_len);
+
+	state = local->outer;
+	local_checksum_update(impl, &state, block, digest_len);
+	local_checksum_final(impl, &state, block, digest_len);
+	memcpy(t, block, digest_len);
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	if ((impl->compress == sha1_compress ||
+			impl->compress == sha256_compress) &&
+			sha_ni_is_supported()) {
+		if (impl->compress == sha1_compress)
+			sha1_pbkdf2_ni(local->initial.h.w32,
+					local->outer.h.w32, state.h.w32,
+					iter_count);
+		else
+			sha256_pbkdf2_ni(local->initial.h.w32,
+					local->outer.h.w32, state.h.w32,
+					iter_count);
+
+		local_checksum_put_digest(impl, &state, t, digest_len);
+		goto done;
+	}
+#endif
+
+	memset(block + digest_len, 0, impl->block_size - digest_len);
+	block[digest_len] = 0x80;
+	local_checksum_put_length(impl, block, impl->block_size + digest_len);
+
+	for (i = 1; i < iter_count; i++) {
+		state.h = local->initial.h;
+		impl->compress(&state.h, block, 1);
+		local_checksum_put_digest(impl, &state, block, digest_len);
+
+		state.h = local->outer.h;
+		impl->compress(&state.h, block, 1);
+		local_checksum_put_digest(impl, &state, block, digest_len);
+
+		for (j = 0; j < digest_len; j++)
+			t[j] ^= block[j];
+	}
+
+done:
+	explicit_bzero(&state, sizeof(state));
+	explicit_bzero(block, sizeof(block));
+}
+
+/*
+ * Hashes @data and then the resulting digest @iterations - 1 more times,
+ * as in the PKCS#5 v1 and PKCS#12 key derivations, writing the last digest
+ * to @out.  From the second iteration on the message is a single digest so
+ * an iteration is one compression of a padded block built once.  Returns
+ * false if there is no in-process implementation of @type.
+ */
+bool checksum_iterate(enum l_checksum_type type, const void *data, size_t len,
+			unsigned int iterations, uint8_t *out)
+{
+	const struct local_checksum_impl *impl;
+	struct local_checksum_state state;
+	uint8_t block[LOCAL_MAX_BLOCK_SIZE];
+	unsigned int digest_len;
+	unsigned int i;
+
+	if (!HAVE_LOCAL_IMPLEMENTATION(type) || !iterations)
+		return false;
+
+	impl = &local_checksum_impls[type];
+	digest_len = checksum_algs[type].digest_len;
+
+	local_checksum_init(impl, &state);
+	local_checksum_update(impl, &state, data, len);
+	local_checksum_final(impl, &state, block, digest_len);
+
+	memset(block + digest_len, 0, impl->block_size - digest_len);
+	block[digest_len] = 0x80;
+	local_checksum_put_length(impl, block, digest_len);
+
+	for (i = 1; i < iterations; i++) {
+		local_checksum_init(impl, &state);
+		impl->compress(&state.h, block, 1);
+		local_checksum_put_digest(impl, &state, block, digest_len);
+	}
+
+	memcpy(out, block, digest_len);
+	explicit_bzero(&state, sizeof(state));
+	explicit_bzero(block, sizeof(block));
+	return true;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+/*
+ * Multi-buffer SHA-1 and SHA-256 for l_checksum_batch, eight independent
+ * messages at a time in the 32-bit lanes of AVX2 registers.  Lanes whose
+ * message has fewer blocks than the longest one in the group keep their
+ * state through a blend after each block.
+ */
+#define MB_TARGET __attribute__((target("avx2")))
+#define MB_LANES 8
+
+#define ROTL32X8(x, n) _mm256_or_si256(_mm256_slli_epi32((x), (n)),	\
+					_mm256_srli_epi32((x), 32 - (n)))
+#define ROTR32X8(x, n) ROTL32X8((x), 32 - (n))
+
+static bool mb_is_supported(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+static MB_TARGET void mb_load_words(__m256i *w,
+					const uint8_t *blocks[MB_LANES])
+{
+	unsigned int t;
+
+	for (t = 0; t < 16; t++)
+		w[t] = _mm256_set_epi32(l_get_be32(blocks[7] + t * 4),
+					l_get_be32(blocks[6] + t * 4),
+					l_get_be32(blocks[5] + t * 4),
+					l_get_be32(blocks[4] + t * 4),
+					l_get_be32(blocks[3] + t * 4),
+					l_get_be32(blocks[2] + t * 4),
+					l_get_be32(blocks[1] + t * 4),
+					l_get_be32(blocks[0] + t * 4));
+}
+
+static MB_TARGET void sha1_compress_x8(__m256i *h,
+					const uint8_t *blocks[MB_LANES])
+{
+	__m256i w[16];
+	__m256i a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+	unsigned int t;
+
+	mb_load_words(w, blocks);
+
+	for (t = 0; t < 80; t++) {
+		__m256i f, k, tmp;
+
+		if (t >= 16)
+			w[t & 15] = ROTL32X8(_mm256_xor_si256(
+					_mm256_xor_si256(w[(t - 3) & 15],
+							w[(t - 8) & 15]),
+					_mm256_xor_si256(w[(t - 14) & 15],
+							w[t & 15])), 1);
+
+		if (t < 20) {
+			f = _mm256_or_si256(_mm256_and_si256(b, c),
+						_mm256_andnot_si256(b, d));
+			k = _mm256_set1_epi32(0x5a827999);
+		} else if (t < 40) {
+			f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+			k = _mm256_set1_epi32(0x6ed9eba1);
+		} else if (t < 60) {
+			f = _mm256_or_si256(_mm256_and_si256(b, c),
+					_mm256_and_si256(d,
+						_mm256_or_si256(b, c)));
+			k = _mm256_set1_epi32(0x8f1bbcdc);
+		} else {
+			f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+			k = _mm256_set1_epi32(0xca62c1d6);
+		}
+
+		tmp = _mm256_add_epi32(_mm256_add_epi32(ROTL32X8(a, 5), f),
+					_mm256_add_epi32(_mm256_add_epi32(e, k),
+							w[t & 15]));
+		e = d;
+		d = c;
+		c = ROTL32X8(b, 30);
+		b = a;
+		a = tmp;
+	}
+
+	h[0] = _mm256_add_epi32(h[0], a);
+	h[1] = _mm256_add_epi32(h[1], b);
+	h[2] = _mm256_add_epi32(h[2], c);
+	h[3] = _mm256_add_epi32(h[3], d);
+	h[4] = _mm256_add_epi32(h[4], e);
+}
+
+#define SHA256_X8_ROUND(a, b, c, d, e, f, g, h, t) do {			\
+	__m256i t1 = _mm256_add_epi32(_mm256_add_epi32((h),		\
+			_mm256_xor_si256(_mm256_xor_si256(		\
+				ROTR32X8((e), 6), ROTR32X8((e), 11)),	\
+				ROTR32X8((e), 25))),			\
+			_mm256_add_epi32(_mm256_xor_si256(		\
+				_mm256_and_si256((e), (f)),		\
+				_mm256_andnot_si256((e), (g))),		\
+				_mm256_add_epi32(w[(t) & 15],		\
+				_mm256_set1_epi32(sha256_k[(t)]))));	\
+	__m256i t2 = _mm256_add_epi32(					\
+			_mm256_xor_si256(_mm256_xor_si256(		\
+				ROTR32X8((a), 2), ROTR32X8((a), 13)),	\
+				ROTR32X8((a), 22)),			\
+			_mm256_or_si256(_mm256_and_si256((a), (b)),	\
+				_mm256_and_si256((c),			\
+					_mm256_or_si256((a), (b)))));	\
+	(d) = _mm256_add_epi32((d), t1);				\
+	(h) = _mm256_add_epi32(t1, t2);					\
+} while (0)
+
+static MB_TARGET void sha256_x8_schedule(__m256i *w, unsigned int t)
+{
+	__m256i w15 = w[(t - 15) & 15];
+	__m256i w2 = w[(t - 2) & 15];
+	__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR32X8(w15, 7),
+							ROTR32X8(w15, 18)),
+					_mm256_srli_epi32(w15, 3));
+	__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR32X8(w2, 17),
+							ROTR32X8(w2, 19)),
+					_mm256_srli_epi32(w2, 10));
+
+	w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0),
+					_mm256_add_epi32(w[(t - 7) & 15], s1));
+}
+
+static MB_TARGET void sha256_compress_x8(__m256i *h,
+					const uint8_t *blocks[MB_LANES])
+{
+	__m256i w[16];
+	__m256i a = h[0], b = h[1], c = h[2], d = h[3];
+	__m256i e = h[4], f = h[5], g = h[6], hh = h[7];
+	unsigned int t, i;
+
+	mb_load_words(w, blocks);
+
+	/* Eight rounds per iteration so the state stays in registers */
+	for (t = 0; t < 64; t += 8) {
+		if (t >= 16)
+			for (i = 0; i < 8; i++)
+				sha256_x8_schedule(w, t + i);
+
+		SHA256_X8_ROUND(a, b, c, d, e, f, g, hh, t);
+		SHA256_X8_ROUND(hh, a, b, c, d, e, f, g, t + 1);
+		SHA256_X8_ROUND(g, hh, a, b, c, d, e, f, t + 2);
+		SHA256_X8_ROUND(f, g, hh, a, b, c, d, e, t + 3);
+		SHA256_X8_ROUND(e, f, g, hh, a, b, c, d, t + 4);
+		SHA256_X8_ROUND(d, e, f, g, hh, a, b, c, t + 5);
+		SHA256_X8_ROUND(c, d, e, f, g, hh, a, b, t + 6);
+		SHA256_X8_ROUND(b, c, d, e, f, g, hh, a, t + 7);
+	}
+
+	h[0] = _mm256_add_epi32(h[0], a);
+	h[1] = _mm256_add_epi32(h[1], b);
+	h[2] = _mm256_add_epi32(h[2], c);
+	h[3] = _mm256_add_epi32(h[3], d);
+	h[4] = _mm256_add_epi32(h[4], e);
+	h[5] = _mm256_add_epi32(h[5], f);
+	h[6] = _mm256_add_epi32(h[6], g);
+	h[7] = _mm256_add_epi32(h[7], hh);
+}
+
+struct mb_lane {
+	const uint8_t *data;
+	size_t n_blocks;
+	uint8_t tail[128];
+	unsigned int n_tail_blocks;
+};
+
+/*
+ * Splits a message into its whole blocks and the padded final one or
+ * two, @prefix_len bytes have already been hashed into the start state
+ */
+static void mb_lane_init(struct mb_lane *lane, const uint8_t *data,
+				size_t len, uint64_t prefix_len)
+{
+	size_t rem = len % 64;
+
+	lane->data = data;
+	lane->n_blocks = len / 64;
+	lane->n_tail_blocks = rem + 9 > 64 ? 2 : 1;
+
+	if (rem)
+		memcpy(lane->tail, data + len - rem, rem);
+
+	lane->tail[rem] = 0x80;
+	memset(lane->tail + rem + 1, 0,
+			lane->n_tail_blocks * 64 - rem - 1 - 8);
+	l_put_be64((prefix_len + len) << 3,
+			lane->tail + lane->n_tail_blocks * 64 - 8);
+}
+
+static MB_TARGET void mb_run(const struct local_checksum_impl *impl,
+				__m256i *h, struct mb_lane *lanes,
+				unsigned int n_lanes)
+{
+	static const uint8_t idle_block[64];
+	void (*compress)(__m256i *h, const uint8_t *blocks[MB_LANES]) =
+		impl->compress == sha1_compress ?
+		sha1_compress_x8 : sha256_compress_x8;
+	size_t max_blocks = 0;
+	size_t b;
+	unsigned int i, j;
+
+	for (i = 0; i < n_lanes; i++)
+		max_blocks = maxsize(max_blocks, lanes[i].n_blocks +
+						lanes[i].n_tail_blocks);
+
+	for (b = 0; b < max_blocks; b++) {
+		const uint8_t *blocks[MB_LANES];
+		int32_t active[MB_LANES];
+		bool all_active = true;
+		__m256i save[8];
+		__m256i mask;
+
+		for (i = 0; i < MB_LANES; i++) {
+			struct mb_lane *lane = &lanes[i];
+
+			active[i] = -1;
+
+			if (i < n_lanes && b < lane->n_blocks)
+				blocks[i] = lane->data + b * 64;
+			else if (i < n_lanes && b < lane->n_blocks +
+							lane->n_tail_blocks)
+				blocks[i] = lane->tail +
+					(b - lane->n_blocks) * 64;
+			else {
+				blocks[i] = idle_block;
+				active[i] = 0;
+				all_active = false;
+			}
+		}
+
+		if (all_active) {
+			compress(h, blocks);
+			continue;
+		}
+
+		memcpy(save, h, impl->n_words * sizeof(__m256i));
+		compress(h, blocks);
+		mask = _mm256_loadu_si256((const void *) active);
+
+		for (j = 0; j < impl->n_words; j++)
+			h[j] = _mm256_blendv_epi8(save[j], h[j], mask);
+	}
+}
+
+static MB_TARGET void mb_store_digests(const struct local_checksum_impl *impl,
+					__m256i *h, unsigned int n_lanes,
+					unsigned int digest_len,
+					uint8_t *digests)
+{
+	uint32_t words[8][MB_LANES];
+	unsigned int i, j;
+
+	for (j = 0; j < impl->n_words; j++)
+		_mm256_storeu_si256((void *) words[j], h[j]);
+
+	for (i = 0; i < n_lanes; i++)
+		for (j = 0; j < digest_len / 4; j++)
+			l_put_be32(words[j][i], digests + i * digest_len +
+						j * 4);
+
+	explicit_bzero(words, sizeof(words));
+}
+
+/* Up to MB_LANES messages hashed together */
+static MB_TARGET void mb_digest_group(const struct local_checksum *local,
+					const struct iovec *messages,
+					unsigned int n_lanes,
+					uint8_t *digests)
+{
+	const struct local_checksum_impl *impl = local->impl;
+	struct mb_lane lanes[MB_LANES];
+	__m256i h[8];
+	unsigned int i, j;
+
+	for (j = 0; j < impl->n_words; j++)
+		h[j] = _mm256_set1_epi32(local->initial.h.w32[j]);
+
+	for (i = 0; i < n_lanes; i++)
+		mb_lane_init(&lanes[i], messages[i].iov_base,
+				messages[i].iov_len, local->initial.len);
+
+	mb_run(impl, h, lanes, n_lanes);
+	mb_store_digests(impl, h, n_lanes, local->digest_len, digests);
+
+	if (local->hmac) {
+		for (j = 0; j < impl->n_words; j++)
+			h[j] = _mm256_set1_epi32(local->outer.h.w32[j]);
+
+		for (i = 0; i < n_lanes; i++)
+			mb_lane_init(&lanes[i], digests + i * local->digest_len,
+					local->digest_len, local->outer.len);
+
+		mb_run(impl, h, lanes, n_lanes);
+		mb_store_digests(impl, h, n_lanes, local->digest_len,
+					digests);
+	}
+
+	explicit_bzero(lanes, sizeof(lanes));
+	explicit_bzero(h, sizeof(h));
+}
+
+/*
+ * The lanes only pay off against SHA-NI when enough of them are in use,
+ * about half for SHA-1 and all of them for SHA-256
+ */
+static bool mb_is_usable(const struct local_checksum *local,
+				size_t n_messages)
+{
+	bool sha1 = local->impl->compress == sha1_compress;
+
+	if (!sha1 && local->impl->compress != sha256_compress)
+		return false;
+
+	if (!mb_is_supported())
+		return false;
+
+	if (sha_ni_is_supported())
+		return n_messages >= (sha1 ? MB_LANES / 2 : MB_LANES);
+
+	return true;
+}
+
+#endif
+
+static struct l_checksum *checksum_new_common(const char *alg,
+						const void *key, size_t len,
+						struct checksum_info *info)
+{
+	struct l_checksum *checksum = l_new(struct l_checksum, 1);
+
+	checksum->sk = alg_accept("hash", alg, key, len, 0,
+					&checksum->parent);
 	if (checksum->sk < 0) {
 		l_free(checksum);
 		return NULL;
@@ -162,6 +1439,21 @@ static struct l_checksum *checksum_new_common(const char *alg, int sockopt,
 	return checksum;
 }
 
+static struct l_checksum *checksum_new_local(enum l_checksum_type type,
+						bool hmac,
+						const void *key,
+						size_t key_len,
+						struct checksum_info *info)
+{
+	struct l_checksum *checksum = l_new(struct l_checksum, 1);
+
+	checksum->sk = -1;
+	checksum->parent.sk = -1;
+	checksum->local = local_checksum_new(type, hmac, key, key_len);
+	checksum->alg_info = info;
+	return checksum;
+}
+
 /**
  * l_checksum_new:
  * @type: checksum type
@@ -175,14 +1467,18 @@ LIB_EXPORT struct l_checksum *l_checksum_new(enum l_checksum_type type)
 	if (!is_valid_index(checksum_algs, type) || !checksum_algs[type].name)
 		return NULL;
 
-	return checksum_new_common(checksum_algs[type].name, 0, NULL, 0,
+	if (HAVE_LOCAL_IMPLEMENTATION(type))
+		return checksum_new_local(type, false, NULL, 0,
+						&checksum_algs[type]);
+
+	return checksum_new_common(checksum_algs[type].name, NULL, 0,
 					&checksum_algs[type]);
 }
 
 LIB_EXPORT struct l_checksum *l_checksum_new_cmac_aes(const void *key,
 							size_t key_len)
 {
-	return checksum_new_common("cmac(aes)", ALG_SET_KEY, key, key_len,
+	return checksum_new_common("cmac(aes)", key, key_len,
 					&checksum_cmac_aes_alg);
 }
 
@@ -193,8 +1489,12 @@ LIB_EXPORT struct l_checksum *l_checksum_new_hmac(enum l_checksum_type type,
 			!checksum_hmac_algs[type].name)
 		return NULL;
 
+	if (HAVE_LOCAL_IMPLEMENTATION(type))
+		return checksum_new_local(type, true, key, key_len,
+						&checksum_hmac_algs[type]);
+
 	return checksum_new_common(checksum_hmac_algs[type].name,
-					ALG_SET_KEY, key, key_len,
+					key, key_len,
 					&checksum_hmac_algs[type]);
 }
 
@@ -214,6 +1514,16 @@ LIB_EXPORT struct l_checksum *l_checksum_clone(struct l_checksum *checksum)
 		return NULL;
 
 	clone = l_new(struct l_checksum, 1);
+	clone->parent.sk = -1;
+
+	if (checksum->local) {
+		clone->sk = -1;
+		clone->local = l_memdup(checksum->local,
+					sizeof(struct local_checksum));
+		clone->alg_info = checksum->alg_info;
+		return clone;
+	}
+
 	clone->sk = accept4(checksum->sk, NULL, 0, SOCK_CLOEXEC);
 
 	if (clone->sk < 0) {
@@ -236,7 +1546,14 @@ LIB_EXPORT void l_checksum_free(struct l_checksum *checksum)
 	if (unlikely(!checksum))
 		return;
 
-	close(checksum->sk);
+	if (checksum->local)
+		local_checksum_free(checksum->local);
+	else {
+		close(checksum->sk);
+		alg_release("hash", checksum->alg_info->name,
+				&checksum->parent);
+	}
+
 	l_free(checksum);
 }
 
@@ -251,6 +1568,11 @@ LIB_EXPORT void l_checksum_reset(struct l_checksum *checksum)
 	if (unlikely(!checksum))
 		return;
 
+	if (checksum->local) {
+		checksum->local->state = checksum->local->initial;
+		return;
+	}
+
 	send(checksum->sk, NULL, 0, 0);
 }
 
@@ -272,6 +1594,12 @@ LIB_EXPORT bool l_checksum_update(struct l_checksum *checksum,
 	if (unlikely(!checksum))
 		return false;
 
+	if (checksum->local) {
+		local_checksum_update(checksum->local->impl,
+					&checksum->local->state, data, len);
+		return true;
+	}
+
 	written = send(checksum->sk, data, len, MSG_MORE);
 	if (written < 0)
 		return false;
@@ -302,6 +1630,18 @@ LIB_EXPORT bool l_checksum_updatev(struct l_checksum *checksum,
 	if (unlikely(!iov) || unlikely(!iov_len))
 		return false;
 
+	if (checksum->local) {
+		size_t i;
+
+		for (i = 0; i < iov_len; i++)
+			local_checksum_update(checksum->local->impl,
+						&checksum->local->state,
+						iov[i].iov_base,
+						iov[i].iov_len);
+
+		return true;
+	}
+
 	memset(&msg, 0, sizeof(msg));
 	msg.msg_iov = (struct iovec *) iov;
 	msg.msg_iovlen = iov_len;
@@ -313,6 +1653,110 @@ LIB_EXPORT bool l_checksum_updatev(struct l_checksum *checksum,
 	return true;
 }
 
+/* The data goes from the page cache to the socket through a pipe */
+static bool checksum_splice_fd(struct l_checksum *checksum, int fd,
+				int64_t offset, size_t len)
+{
+	loff_t off = offset;
+	int pipefd[2];
+	bool r = true;
+
+	if (pipe2(pipefd, O_CLOEXEC) < 0)
+		return false;
+
+	while (len) {
+		ssize_t in = splice(fd, offset < 0 ? NULL : &off, pipefd[1],
+					NULL, minsize(len, CHECKSUM_FD_CHUNK),
+					SPLICE_F_MOVE | SPLICE_F_MORE);
+		ssize_t out;
+
+		if (in <= 0) {
+			r = false;
+			break;
+		}
+
+		len -= in;
+
+		for (; in; in -= out) {
+			out = splice(pipefd[0], NULL, checksum->sk, NULL, in,
+					SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (out <= 0) {
+				r = false;
+				goto done;
+			}
+		}
+	}
+
+done:
+	close(pipefd[0]);
+	close(pipefd[1]);
+	return r;
+}
+
+static bool checksum_read_fd(struct l_checksum *checksum, int fd,
+				int64_t offset, size_t len)
+{
+	uint8_t *buf = l_malloc(minsize(len, CHECKSUM_FD_CHUNK));
+	bool r = true;
+
+	while (len) {
+		size_t n = minsize(len, CHECKSUM_FD_CHUNK);
+		ssize_t in;
+
+		if (offset < 0)
+			in = read(fd, buf, n);
+		else
+			in = pread(fd, buf, n, offset);
+
+		if (in < 0 && errno == EINTR)
+			continue;
+
+		if (in <= 0) {
+			r = false;
+			break;
+		}
+
+		local_checksum_update(checksum->local->impl,
+					&checksum->local->state, buf, in);
+		len -= in;
+
+		if (offset >= 0)
+			offset += in;
+	}
+
+	l_free(buf);
+	return r;
+}
+
+/**
+ * l_checksum_update_fd:
+ * @checksum: checksum object
+ * @fd: file descriptor to read the data from
+ * @offset: offset in @fd to start at, or -1 to read from the current file
+ *   position, e.g. for pipes
+ * @len: number of bytes to hash
+ *
+ * Updates the checksum with @len bytes read from @fd.  For kernel-backed
+ * checksums the data is spliced into the kernel without being copied
+ * through user memory.  When @offset is given the file position of @fd is
+ * not changed.
+ *
+ * Returns: true if the operation succeeded, false on a read error or if
+ * @fd ends before @len bytes.  The state of @checksum is undefined after
+ * a failure until l_checksum_reset.
+ **/
+LIB_EXPORT bool l_checksum_update_fd(struct l_checksum *checksum, int fd,
+					int64_t offset, size_t len)
+{
+	if (unlikely(!checksum || fd < 0))
+		return false;
+
+	if (checksum->local)
+		return checksum_read_fd(checksum, fd, offset, len);
+
+	return checksum_splice_fd(checksum, fd, offset, len);
+}
+
 /**
  * l_checksum_get_digest:
  * @checksum: checksum object
@@ -339,6 +1783,9 @@ LIB_EXPORT ssize_t l_checksum_get_digest(struct l_checksum *checksum,
 	if (unlikely(!len))
 		return -EINVAL;
 
+	if (checksum->local)
+		return local_checksum_get_digest(checksum->local, digest, len);
+
 	result = recv(checksum->sk, digest, len, 0);
 	if (result < 0)
 		return -errno;
@@ -369,18 +1816,298 @@ LIB_EXPORT char *l_checksum_get_string(struct l_checksum *checksum)
 	return l_util_hexstring(digest, checksum->alg_info->digest_len);
 }
 
-static void init_supported()
+static bool checksum_batch_is_parallel(struct l_checksum *checksum,
+						size_t n_messages)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	return checksum->local && mb_is_usable(checksum->local, n_messages);
+#else
+	return false;
+#endif
+}
+
+/**
+ * l_checksum_batch:
+ * @checksum: checksum object used as a template
+ * @messages: messages to hash, one per iovec entry
+ * @n_messages: number of entries in @messages
+ * @digests: output buffer for @n_messages digests, in the same order
+ *
+ * Computes the digest of each message in @messages as l_checksum_update
+ * followed by l_checksum_get_digest on a reset @checksum would, using the
+ * HMAC key if @checksum has one.  Where the CPU allows, independent messages
+ * are hashed in parallel.  Each digest takes the full digest length of the
+ * algorithm.  @checksum is left reset.
+ *
+ * Returns: true if the operation succeeded, false otherwise.
+ **/
+LIB_EXPORT bool l_checksum_batch(struct l_checksum *checksum,
+					const struct iovec *messages,
+					size_t n_messages, void *digests)
+{
+	uint8_t *out = digests;
+	size_t digest_len;
+	size_t i;
+
+	if (unlikely(!checksum || !messages || !digests))
+		return false;
+
+	digest_len = checksum->alg_info->digest_len;
+	l_checksum_reset(checksum);
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (checksum_batch_is_parallel(checksum, n_messages)) {
+		for (i = 0; i < n_messages; i += MB_LANES)
+			mb_digest_group(checksum->local, messages + i,
+					minsize(n_messages - i, MB_LANES),
+					out + i * digest_len);
+
+		return true;
+	}
+#endif
+
+	for (i = 0; i < n_messages; i++) {
+		if (l_checksum_update(checksum, messages[i].iov_base,
+					messages[i].iov_len) &&
+				l_checksum_get_digest(checksum,
+						out + i * digest_len,
+						digest_len) ==
+						(ssize_t) digest_len)
+			continue;
+
+		l_checksum_reset(checksum);
+		return false;
+	}
+
+	return true;
+}
+
+/* All output blocks advanced together so that they can use the lanes */
+static bool pbkdf2_batch(struct l_checksum *hmac,
+				const uint8_t *salt, size_t salt_len,
+				unsigned int iter_count, size_t n_blocks,
+				uint8_t *out_dk, size_t dk_len)
+{
+	size_t h_len = hmac->alg_info->digest_len;
+	size_t u_size = maxsize(salt_len + 4, h_len);
+	uint8_t *u = l_malloc(n_blocks * u_size);
+	uint8_t *t = l_new(uint8_t, n_blocks * h_len);
+	uint8_t *digests = l_malloc(n_blocks * h_len);
+	struct iovec *iov = l_new(struct iovec, n_blocks);
+	size_t i, k;
+	unsigned int j;
+
+	for (i = 0; i < n_blocks; i++) {
+		if (salt_len)
+			memcpy(u + i * u_size, salt, salt_len);
+
+		l_put_be32(i + 1, u + i * u_size + salt_len);
+		iov[i].iov_base = u + i * u_size;
+		iov[i].iov_len = salt_len + 4;
+	}
+
+	for (j = 0; j < iter_count; j++) {
+		if (!l_checksum_batch(hmac, iov, n_blocks, digests))
+			break;
+
+		for (i = 0; i < n_blocks; i++) {
+			memcpy(u + i * u_size, digests + i * h_len, h_len);
+			iov[i].iov_len = h_len;
+		}
+
+		for (k = 0; k < n_blocks * h_len; k++)
+			t[k] ^= digests[k];
+	}
+
+	if (j == iter_count)
+		memcpy(out_dk, t, dk_len);
+
+	explicit_bzero(u, n_blocks * u_size);
+	explicit_bzero(t, n_blocks * h_len);
+	explicit_bzero(digests, n_blocks * h_len);
+	l_free(u);
+	l_free(t);
+	l_free(digests);
+	l_free(iov);
+
+	return j == iter_count;
+}
+
+/**
+ * l_checksum_pbkdf2:
+ * @type: hash function for the HMAC-based PRF
+ * @password: password, need not be NUL-terminated
+ * @password_len: length of @password in bytes
+ * @salt: salt
+ * @salt_len: length of @salt in bytes
+ * @iter_count: number of iterations, at least 1
+ * @out_dk: output buffer for the derived key
+ * @dk_len: length of the key to derive
+ *
+ * Derives a key using PBKDF2 as defined in RFC 8018 Section 5.2.
+ *
+ * Returns: true if the key was derived, false otherwise.
+ **/
+LIB_EXPORT bool l_checksum_pbkdf2(enum l_checksum_type type,
+					const void *password,
+					size_t password_len,
+					const void *salt, size_t salt_len,
+					unsigned int iter_count,
+					void *out_dk, size_t dk_len)
+{
+	struct l_checksum *hmac;
+	uint8_t *out = out_dk;
+	size_t h_len;
+	size_t n_blocks;
+	size_t i;
+	bool r = true;
+
+	if (unlikely((!password && password_len) || (!salt && salt_len) ||
+			!iter_count || !out_dk))
+		return false;
+
+	if (!dk_len)
+		return true;
+
+	hmac = l_checksum_new_hmac(type, password, password_len);
+	if (!hmac)
+		return false;
+
+	h_len = hmac->alg_info->digest_len;
+	n_blocks = (dk_len + h_len - 1) / h_len;
+
+	if (hmac->local && !checksum_batch_is_parallel(hmac, n_blocks)) {
+		uint8_t t[64];
+
+		for (i = 0; i < n_blocks; i++) {
+			local_pbkdf2_block(hmac->local, salt, salt_len, i + 1,
+						iter_count, t);
+			memcpy(out + i * h_len, t,
+				minsize(dk_len - i * h_len, h_len));
+		}
+
+		explicit_bzero(t, sizeof(t));
+	} else
+		r = pbkdf2_batch(hmac, salt, salt_len, iter_count, n_blocks,
+					out, dk_len);
+
+	l_checksum_free(hmac);
+	return r;
+}
+
+/**
+ * l_checksum_hkdf_extract:
+ * @type: hash function for HMAC
+ * @salt: optional salt, NULL for a string of zeros as long as the digest
+ * @salt_len: length of @salt in bytes
+ * @ikm: input keying material
+ * @ikm_len: length of @ikm in bytes
+ * @out_prk: output buffer for the pseudorandom key, which takes the full
+ *   digest length of @type
+ *
+ * HKDF-Extract as defined in RFC 5869 Section 2.2.
+ *
+ * Returns: true if the operation succeeded, false otherwise.
+ **/
+LIB_EXPORT bool l_checksum_hkdf_extract(enum l_checksum_type type,
+					const void *salt, size_t salt_len,
+					const void *ikm, size_t ikm_len,
+					void *out_prk)
+{
+	static const uint8_t zeros[64];
+	ssize_t digest_len = l_checksum_digest_length(type);
+	struct l_checksum *hmac;
+	bool r;
+
+	if (unlikely(digest_len <= 0 || (!ikm && ikm_len) || !out_prk))
+		return false;
+
+	if (!salt) {
+		salt = zeros;
+		salt_len = digest_len;
+	}
+
+	hmac = l_checksum_new_hmac(type, salt, salt_len);
+	if (!hmac)
+		return false;
+
+	r = l_checksum_update(hmac, ikm, ikm_len) &&
+		l_checksum_get_digest(hmac, out_prk, digest_len) ==
+								digest_len;
+
+	l_checksum_free(hmac);
+	return r;
+}
+
+/**
+ * l_checksum_hkdf_expand:
+ * @type: hash function for HMAC
+ * @prk: pseudorandom key, usually from l_checksum_hkdf_extract
+ * @prk_len: length of @prk in bytes
+ * @info: optional context and application specific information
+ * @info_len: length of @info in bytes
+ * @out: output buffer for the keying material
+ * @out_len: number of bytes to produce, at most 255 times the digest length
+ *
+ * HKDF-Expand as defined in RFC 5869 Section 2.3.
+ *
+ * Returns: true if the operation succeeded, false otherwise.
+ **/
+LIB_EXPORT bool l_checksum_hkdf_expand(enum l_checksum_type type,
+					const void *prk, size_t prk_len,
+					const void *info, size_t info_len,
+					void *out, size_t out_len)
+{
+	ssize_t digest_len = l_checksum_digest_length(type);
+	struct l_checksum *hmac;
+	uint8_t *ptr = out;
+	uint8_t t[64];
+	uint8_t i;
+	bool r = true;
+
+	if (unlikely(digest_len <= 0 || !prk || (!info && info_len) ||
+			(!out && out_len)))
+		return false;
+
+	if (out_len > 255 * (size_t) digest_len)
+		return false;
+
+	hmac = l_checksum_new_hmac(type, prk, prk_len);
+	if (!hmac)
+		return false;
+
+	for (i = 1; out_len; i++) {
+		size_t n = minsize(out_len, digest_len);
+
+		if (i > 1)
+			l_checksum_update(hmac, t, digest_len);
+
+		l_checksum_update(hmac, info, info_len);
+		l_checksum_update(hmac, &i, 1);
+
+		if (l_checksum_get_digest(hmac, t, digest_len) != digest_len) {
+			r = false;
+			break;
+		}
+
+		memcpy(ptr, t, n);
+		ptr += n;
+		out_len -= n;
+	}
+
+	explicit_bzero(t, sizeof(t));
+	l_checksum_free(hmac);
+	return r;
+}
+
+static pthread_once_t supported_once = PTHREAD_ONCE_INIT;
+
+static void probe_supported(void)
 {
-	static bool initialized = false;
 	struct sockaddr_alg salg;
 	int sk;
 	unsigned int i, j;
 
-	if (likely(initialized))
-		return;
-
-	initialized = true;
-
 	sk = socket(PF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
 	if (sk < 0)
 		return;
@@ -409,11 +2136,25 @@ static void init_supported()
 	close(sk);
 }
 
+/* Callers may be on any thread, none must see a partial result */
+static void init_supported(void)
+{
+	pthread_once(&supported_once, probe_supported);
+}
+
+bool checksum_uses_alg(const struct l_checksum *checksum)
+{
+	return !checksum->local;
+}
+
 LIB_EXPORT bool l_checksum_is_supported(enum l_checksum_type type,
 							bool check_hmac)
 {
 	const struct checksum_info *list;
 
+	if (HAVE_LOCAL_IMPLEMENTATION(type))
+		return true;
+
 	init_supported();
 
 	if (!check_hmac) {
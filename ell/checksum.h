@@ -44,9 +44,27 @@ bool l_checksum_update(struct l_checksum *checksum,
 bool l_checksum_updatev(struct l_checksum *checksum,
 					const struct iovec *iov,
 					size_t iov_len);
+bool l_checksum_update_fd(struct l_checksum *checksum, int fd,
+					int64_t offset, size_t len);
 ssize_t l_checksum_get_digest(struct l_checksum *checksum,
 					void *digest, size_t len);
 char *l_checksum_get_string(struct l_checksum *checksum);
+bool l_checksum_batch(struct l_checksum *checksum,
+			const struct iovec *messages, size_t n_messages,
+			void *digests);
+
+bool l_checksum_pbkdf2(enum l_checksum_type type,
+			const void *password, size_t password_len,
+			const void *salt, size_t salt_len,
+			unsigned int iter_count, void *out_dk, size_t dk_len);
+bool l_checksum_hkdf_extract(enum l_checksum_type type,
+				const void *salt, size_t salt_len,
+				const void *ikm, size_t ikm_len,
+				void *out_prk);
+bool l_checksum_hkdf_expand(enum l_checksum_type type,
+				const void *prk, size_t prk_len,
+				const void *info, size_t info_len,
+				void *out, size_t out_len);
 
 bool l_checksum_is_supported(enum l_checksum_type type, bool check_hmac);
 bool l_checksum_cmac_aes_supported(void);
@@ -16,12 +16,19 @@
 #include <errno.h>
 #include <sys/socket.h>
 #include <alloca.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#endif
 
 #include "useful.h"
 #include "cipher.h"
 #include "private.h"
 #include "random.h"
 #include "missing.h"
+#include "alg-private.h"
 
 #ifndef HAVE_LINUX_IF_ALG_H
 #ifndef HAVE_LINUX_TYPES_H
@@ -70,10 +77,6 @@ struct af_alg_iv {
 #define ALG_SET_AEAD_ASSOCLEN	4
 #endif
 
-#ifndef ALG_SET_AEAD_AUTHSIZE
-#define ALG_SET_AEAD_AUTHSIZE	5
-#endif
-
 #define is_valid_type(type)  ((type) <= L_CIPHER_RC2_CBC)
 
 static uint32_t supported_ciphers;
@@ -81,6 +84,7 @@ static uint32_t supported_aead_ciphers;
 
 struct l_cipher {
 	int type;
+	struct alg_parent parent;
 	const struct local_impl *local;
 	union {
 		int sk;
@@ -90,7 +94,12 @@ struct l_cipher {
 
 struct l_aead_cipher {
 	int type;
-	int sk;
+	struct alg_parent parent;
+	const struct local_aead_impl *local;
+	union {
+		int sk;
+		void *local_data;
+	};
 };
 
 struct local_impl {
@@ -103,43 +112,18 @@ struct local_impl {
 				const struct iovec *out, size_t out_cnt);
 };
 
-static int create_alg(const char *alg_type, const char *alg_name,
-			const void *key, size_t key_length, size_t tag_length)
-{
-	struct sockaddr_alg salg;
-	int sk;
-	int ret;
-
-	sk = socket(PF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
-	if (sk < 0)
-		return -errno;
-
-	memset(&salg, 0, sizeof(salg));
-	salg.salg_family = AF_ALG;
-	strcpy((char *) salg.salg_type, alg_type);
-	strcpy((char *) salg.salg_name, alg_name);
-
-	if (bind(sk, (struct sockaddr *) &salg, sizeof(salg)) < 0) {
-		close(sk);
-		return -1;
-	}
-
-	if (setsockopt(sk, SOL_ALG, ALG_SET_KEY, key, key_length) < 0) {
-		close(sk);
-		return -1;
-	}
-
-	if (tag_length && setsockopt(sk, SOL_ALG, ALG_SET_AEAD_AUTHSIZE, NULL,
-					tag_length)) {
-		close(sk);
-		return -1;
-	}
-
-	ret = accept4(sk, NULL, 0, SOCK_CLOEXEC);
-	close(sk);
-
-	return ret;
-}
+struct local_aead_impl {
+	bool (*is_supported)(void);
+	void *(*cipher_new)(enum l_aead_cipher_type,
+				const void *key, size_t key_length,
+				size_t tag_length);
+	void (*cipher_free)(void *data);
+	ssize_t (*operate)(void *data, __u32 operation,
+				const uint8_t *in, size_t in_len,
+				const uint8_t *ad, size_t ad_len,
+				const uint8_t *iv, size_t iv_len,
+				uint8_t *out, size_t out_len);
+};
 
 static const char *cipher_type_to_name(enum l_cipher_type type)
 {
@@ -205,7 +189,8 @@ LIB_EXPORT struct l_cipher *l_cipher_new(enum l_cipher_type type,
 		return cipher;
 	}
 
-	cipher->sk = create_alg("skcipher", alg_name, key, key_length, 0);
+	cipher->sk = alg_accept("skcipher", alg_name, key, key_length, 0,
+					&cipher->parent);
 	if (cipher->sk < 0)
 		goto error_free;
 
@@ -228,6 +213,23 @@ static const char *aead_cipher_type_to_name(enum l_aead_cipher_type type)
 	return NULL;
 }
 
+#if defined(__x86_64__) && defined(__GNUC__)
+static const struct local_aead_impl local_aes_gcm;
+#endif
+
+static const struct local_aead_impl *local_impl_aead_ciphers[
+						L_AEAD_CIPHER_AES_GCM + 1] = {
+#if defined(__x86_64__) && defined(__GNUC__)
+	[L_AEAD_CIPHER_AES_GCM] = &local_aes_gcm,
+#endif
+};
+
+/* The local AEAD implementations depend on CPU features */
+#define HAVE_LOCAL_AEAD_IMPLEMENTATION(type)			\
+	((type) < L_ARRAY_SIZE(local_impl_aead_ciphers) &&	\
+	 local_impl_aead_ciphers[(type)] &&			\
+	 local_impl_aead_ciphers[(type)]->is_supported())
+
 LIB_EXPORT struct l_aead_cipher *l_aead_cipher_new(enum l_aead_cipher_type type,
 							const void *key,
 							size_t key_length,
@@ -246,7 +248,23 @@ LIB_EXPORT struct l_aead_cipher *l_aead_cipher_new(enum l_aead_cipher_type type,
 	cipher->type = type;
 	alg_name = aead_cipher_type_to_name(type);
 
-	cipher->sk = create_alg("aead", alg_name, key, key_length, tag_length);
+	/*
+	 * Avoids a sendmsg() and read() per operation, fall back to the
+	 * kernel for key or tag lengths not handled locally
+	 */
+	if (HAVE_LOCAL_AEAD_IMPLEMENTATION(type)) {
+		cipher->local = local_impl_aead_ciphers[type];
+		cipher->local_data = cipher->local->cipher_new(type,
+							key, key_length,
+							tag_length);
+		if (cipher->local_data)
+			return cipher;
+
+		cipher->local = NULL;
+	}
+
+	cipher->sk = alg_accept("aead", alg_name, key, key_length, tag_length,
+					&cipher->parent);
 	if (cipher->sk >= 0)
 		return cipher;
 
@@ -261,8 +279,11 @@ LIB_EXPORT void l_cipher_free(struct l_cipher *cipher)
 
 	if (cipher->local)
 		cipher->local->cipher_free(cipher->local_data);
-	else
+	else {
 		close(cipher->sk);
+		alg_release("skcipher", cipher_type_to_name(cipher->type),
+				&cipher->parent);
+	}
 
 	l_free(cipher);
 }
@@ -272,7 +293,13 @@ LIB_EXPORT void l_aead_cipher_free(struct l_aead_cipher *cipher)
 	if (unlikely(!cipher))
 		return;
 
-	close(cipher->sk);
+	if (cipher->local)
+		cipher->local->cipher_free(cipher->local_data);
+	else {
+		close(cipher->sk);
+		alg_release("aead", aead_cipher_type_to_name(cipher->type),
+				&cipher->parent);
+	}
 
 	l_free(cipher);
 }
@@ -617,6 +644,13 @@ LIB_EXPORT bool l_aead_cipher_encrypt(struct l_aead_cipher *cipher,
 		iv_len = nonce_len;
 	}
 
+	if (cipher->local)
+		return cipher->local->operate(cipher->local_data,
+						ALG_OP_ENCRYPT, in, in_len,
+						ad, ad_len, iv, iv_len,
+						out, out_len) ==
+			(ssize_t)out_len;
+
 	return operate_cipher(cipher->sk, ALG_OP_ENCRYPT, in, in_len,
 				ad, ad_len, iv, iv_len, out, out_len) ==
 			(ssize_t)out_len;
@@ -652,28 +686,35 @@ LIB_EXPORT bool l_aead_cipher_decrypt(struct l_aead_cipher *cipher,
 		iv_len = nonce_len;
 	}
 
+	if (cipher->local)
+		return cipher->local->operate(cipher->local_data,
+						ALG_OP_DECRYPT, in, in_len,
+						ad, ad_len, iv, iv_len,
+						out, out_len) ==
+			(ssize_t)out_len;
+
 	return operate_cipher(cipher->sk, ALG_OP_DECRYPT, in, in_len,
 				ad, ad_len, iv, iv_len, out, out_len) ==
 			(ssize_t)out_len;
 }
 
-static void init_supported()
+static pthread_once_t supported_once = PTHREAD_ONCE_INIT;
+
+static void probe_supported(void)
 {
-	static bool initialized = false;
 	struct sockaddr_alg salg;
 	int sk;
 	enum l_cipher_type c;
 	enum l_aead_cipher_type a;
 
-	if (likely(initialized))
-		return;
-
-	initialized = true;
-
 	for (c = 0; c < L_ARRAY_SIZE(local_impl_ciphers); c++)
 		if (HAVE_LOCAL_IMPLEMENTATION(c))
 			supported_ciphers |= 1 << c;
 
+	for (a = 0; a < L_ARRAY_SIZE(local_impl_aead_ciphers); a++)
+		if (HAVE_LOCAL_AEAD_IMPLEMENTATION(a))
+			supported_aead_ciphers |= 1 << a;
+
 	sk = socket(PF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
 	if (sk < 0)
 		return;
@@ -709,6 +750,12 @@ static void init_supported()
 	close(sk);
 }
 
+/* Callers may be on any thread, none must see a partial result */
+static void init_supported(void)
+{
+	pthread_once(&supported_once, probe_supported);
+}
+
 LIB_EXPORT bool l_cipher_is_supported(enum l_cipher_type type)
 {
 	if (!is_valid_type(type))
@@ -729,6 +776,16 @@ LIB_EXPORT bool l_aead_cipher_is_supported(enum l_aead_cipher_type type)
 	return supported_aead_ciphers & (1 << type);
 }
 
+bool cipher_uses_alg(const struct l_cipher *cipher)
+{
+	return !cipher->local;
+}
+
+bool aead_cipher_uses_alg(const struct l_aead_cipher *cipher)
+{
+	return !cipher->local;
+}
+
 /* ARC4 implementation copyright (c) 2001 Niels Möller */
 
 static void arc4_set_key(uint8_t *S, const uint8_t *key, size_t key_length)
@@ -1100,3 +1157,462 @@ static const struct local_impl local_rc2_cbc = {
 	local_rc2_cbc_set_iv,
 	local_rc2_cbc_operate,
 };
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+/*
+ * AES-GCM (NIST SP 800-38D) using the AES-NI and PCLMULQDQ instructions,
+ * following the Intel white papers on AES-NI key expansion and on
+ * carry-less multiplication for GCM.  Four counter blocks are encrypted
+ * at a time and their GHASH products are summed up before a single
+ * reduction using the precomputed powers H, H^2, H^3 and H^4.  GHASH
+ * works on byte reflected blocks.
+ */
+
+#define AES_GCM_TARGET __attribute__((target("aes,pclmul,ssse3")))
+
+#define GCM_BLOCK_SIZE 16
+
+struct aes_gcm_state {
+	__m128i round_keys[15];
+	__m128i h[4];
+	unsigned int rounds;
+	size_t tag_length;
+};
+
+static bool local_aes_gcm_is_supported(void)
+{
+	return __builtin_cpu_supports("aes") &&
+		__builtin_cpu_supports("pclmul") &&
+		__builtin_cpu_supports("ssse3");
+}
+
+static AES_GCM_TARGET __m128i aes_key_shift_xor(__m128i k)
+{
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	return _mm_xor_si128(k, _mm_slli_si128(k, 4));
+}
+
+/* Round key following @k, with RotWord and SubWord applied to @prev */
+#define AES_ROUND_KEY(k, prev, rcon)					\
+	_mm_xor_si128(aes_key_shift_xor(k),				\
+		_mm_shuffle_epi32(_mm_aeskeygenassist_si128(prev, rcon), 0xff))
+
+#define AES_128_ROUND_KEY(k, rcon) AES_ROUND_KEY(k, k, rcon)
+
+static AES_GCM_TARGET void aes_128_expand_key(__m128i *rk, const uint8_t *key)
+{
+	rk[0] = _mm_loadu_si128((const __m128i *) key);
+	rk[1] = AES_128_ROUND_KEY(rk[0], 0x01);
+	rk[2] = AES_128_ROUND_KEY(rk[1], 0x02);
+	rk[3] = AES_128_ROUND_KEY(rk[2], 0x04);
+	rk[4] = AES_128_ROUND_KEY(rk[3], 0x08);
+	rk[5] = AES_128_ROUND_KEY(rk[4], 0x10);
+	rk[6] = AES_128_ROUND_KEY(rk[5], 0x20);
+	rk[7] = AES_128_ROUND_KEY(rk[6], 0x40);
+	rk[8] = AES_128_ROUND_KEY(rk[7], 0x80);
+	rk[9] = AES_128_ROUND_KEY(rk[8], 0x1b);
+	rk[10] = AES_128_ROUND_KEY(rk[9], 0x36);
+}
+
+/* @t3 holds the last 64 bits of the previous 192 bits of key material */
+#define AES_192_ROUND_KEYS(t1, t3, rcon)				\
+	do {								\
+		__m128i t2 = _mm_shuffle_epi32(				\
+				_mm_aeskeygenassist_si128(t3, rcon), 0x55); \
+									\
+		t1 = _mm_xor_si128(aes_key_shift_xor(t1), t2);		\
+		t2 = _mm_shuffle_epi32(t1, 0xff);			\
+		t3 = _mm_xor_si128(t3, _mm_slli_si128(t3, 4));		\
+		t3 = _mm_xor_si128(t3, t2);				\
+	} while (0)
+
+#define AES_192_MERGE(a, b, imm)					\
+	_mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(a),		\
+					_mm_castsi128_pd(b), imm))
+
+static AES_GCM_TARGET void aes_192_expand_key(__m128i *rk, const uint8_t *key)
+{
+	uint8_t tail[16] = {};
+	__m128i t1;
+	__m128i t3;
+
+	memcpy(tail, key + 16, 8);
+	t1 = _mm_loadu_si128((const __m128i *) key);
+	t3 = _mm_loadu_si128((const __m128i *) tail);
+
+	rk[0] = t1;
+	rk[1] = t3;
+	AES_192_ROUND_KEYS(t1, t3, 0x01);
+	rk[1] = AES_192_MERGE(rk[1], t1, 0);
+	rk[2] = AES_192_MERGE(t1, t3, 1);
+	AES_192_ROUND_KEYS(t1, t3, 0x02);
+	rk[3] = t1;
+	rk[4] = t3;
+	AES_192_ROUND_KEYS(t1, t3, 0x04);
+	rk[4] = AES_192_MERGE(rk[4], t1, 0);
+	rk[5] = AES_192_MERGE(t1, t3, 1);
+	AES_192_ROUND_KEYS(t1, t3, 0x08);
+	rk[6] = t1;
+	rk[7] = t3;
+	AES_192_ROUND_KEYS(t1, t3, 0x10);
+	rk[7] = AES_192_MERGE(rk[7], t1, 0);
+	rk[8] = AES_192_MERGE(t1, t3, 1);
+	AES_192_ROUND_KEYS(t1, t3, 0x20);
+	rk[9] = t1;
+	rk[10] = t3;
+	AES_192_ROUND_KEYS(t1, t3, 0x40);
+	rk[10] = AES_192_MERGE(rk[10], t1, 0);
+	rk[11] = AES_192_MERGE(t1, t3, 1);
+	AES_192_ROUND_KEYS(t1, t3, 0x80);
+	rk[12] = t1;
+
+	explicit_bzero(tail, sizeof(tail));
+}
+
+/* Odd round keys only apply SubWord to the previous round key */
+#define AES_256_ROUND_KEY_ODD(k, prev)					\
+	_mm_xor_si128(aes_key_shift_xor(k),				\
+		_mm_shuffle_epi32(_mm_aeskeygenassist_si128(prev, 0), 0xaa))
+
+static AES_GCM_TARGET void aes_256_expand_key(__m128i *rk, const uint8_t *key)
+{
+	rk[0] = _mm_loadu_si128((const __m128i *) key);
+	rk[1] = _mm_loadu_si128((const __m128i *) (key + 16));
+	rk[2] = AES_ROUND_KEY(rk[0], rk[1], 0x01);
+	rk[3] = AES_256_ROUND_KEY_ODD(rk[1], rk[2]);
+	rk[4] = AES_ROUND_KEY(rk[2], rk[3], 0x02);
+	rk[5] = AES_256_ROUND_KEY_ODD(rk[3], rk[4]);
+	rk[6] = AES_ROUND_KEY(rk[4], rk[5], 0x04);
+	rk[7] = AES_256_ROUND_KEY_ODD(rk[5], rk[6]);
+	rk[8] = AES_ROUND_KEY(rk[6], rk[7], 0x08);
+	rk[9] = AES_256_ROUND_KEY_ODD(rk[7], rk[8]);
+	rk[10] = AES_ROUND_KEY(rk[8], rk[9], 0x10);
+	rk[11] = AES_256_ROUND_KEY_ODD(rk[9], rk[10]);
+	rk[12] = AES_ROUND_KEY(rk[10], rk[11], 0x20);
+	rk[13] = AES_256_ROUND_KEY_ODD(rk[11], rk[12]);
+	rk[14] = AES_ROUND_KEY(rk[12], rk[13], 0x40);
+}
+
+static AES_GCM_TARGET __m128i aes_encrypt_block(const struct aes_gcm_state *s,
+						__m128i b)
+{
+	unsigned int i;
+
+	b = _mm_xor_si128(b, s->round_keys[0]);
+
+	for (i = 1; i < s->rounds; i++)
+		b = _mm_aesenc_si128(b, s->round_keys[i]);
+
+	return _mm_aesenclast_si128(b, s->round_keys[s->rounds]);
+}
+
+static AES_GCM_TARGET void aes_encrypt_4_blocks(const struct aes_gcm_state *s,
+						__m128i b[static 4])
+{
+	unsigned int i;
+	unsigned int j;
+
+	for (j = 0; j < 4; j++)
+		b[j] = _mm_xor_si128(b[j], s->round_keys[0]);
+
+	for (i = 1; i < s->rounds; i++)
+		for (j = 0; j < 4; j++)
+			b[j] = _mm_aesenc_si128(b[j], s->round_keys[i]);
+
+	for (j = 0; j < 4; j++)
+		b[j] = _mm_aesenclast_si128(b[j], s->round_keys[s->rounds]);
+}
+
+static AES_GCM_TARGET __m128i gcm_bswap(__m128i b)
+{
+	return _mm_shuffle_epi8(b, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+						8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+/* Adds the unreduced 256-bit carry-less product of @a and @b to @lo, @hi */
+static AES_GCM_TARGET void gcm_clmul_add(__m128i a, __m128i b,
+						__m128i *lo, __m128i *hi)
+{
+	__m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+					_mm_clmulepi64_si128(a, b, 0x01));
+
+	*lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, b, 0x00));
+	*lo = _mm_xor_si128(*lo, _mm_slli_si128(mid, 8));
+	*hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, b, 0x11));
+	*hi = _mm_xor_si128(*hi, _mm_srli_si128(mid, 8));
+}
+
+/*
+ * Shifts the 256-bit product left by one bit to account for the bit
+ * reflection and reduces it modulo x^128 + x^7 + x^2 + x + 1
+ */
+static AES_GCM_TARGET __m128i gcm_reduce(__m128i lo, __m128i hi)
+{
+	__m128i t1 = _mm_srli_epi32(lo, 31);
+	__m128i t2 = _mm_srli_epi32(hi, 31);
+	__m128i t3;
+
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	t3 = _mm_srli_si128(t1, 12);
+	t2 = _mm_slli_si128(t2, 4);
+	t1 = _mm_slli_si128(t1, 4);
+	lo = _mm_or_si128(lo, t1);
+	hi = _mm_or_si128(hi, t2);
+	hi = _mm_or_si128(hi, t3);
+
+	t1 = _mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30));
+	t1 = _mm_xor_si128(t1, _mm_slli_epi32(lo, 25));
+	t2 = _mm_srli_si128(t1, 4);
+	t1 = _mm_slli_si128(t1, 12);
+	lo = _mm_xor_si128(lo, t1);
+
+	t3 = _mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2));
+	t3 = _mm_xor_si128(t3, _mm_srli_epi32(lo, 7));
+	t3 = _mm_xor_si128(t3, t2);
+	lo = _mm_xor_si128(lo, t3);
+
+	return _mm_xor_si128(hi, lo);
+}
+
+static AES_GCM_TARGET __m128i gcm_mul(__m128i a, __m128i b)
+{
+	__m128i lo = _mm_setzero_si128();
+	__m128i hi = _mm_setzero_si128();
+
+	gcm_clmul_add(a, b, &lo, &hi);
+
+	return gcm_reduce(lo, hi);
+}
+
+/* Y = (Y ^ X1) * H^4 ^ X2 * H^3 ^ X3 * H^2 ^ X4 * H */
+static AES_GCM_TARGET __m128i gcm_ghash_4_blocks(const struct aes_gcm_state *s,
+						__m128i y,
+						const __m128i x[static 4])
+{
+	__m128i lo = _mm_setzero_si128();
+	__m128i hi = _mm_setzero_si128();
+
+	gcm_clmul_add(_mm_xor_si128(y, gcm_bswap(x[0])), s->h[3], &lo, &hi);
+	gcm_clmul_add(gcm_bswap(x[1]), s->h[2], &lo, &hi);
+	gcm_clmul_add(gcm_bswap(x[2]), s->h[1], &lo, &hi);
+	gcm_clmul_add(gcm_bswap(x[3]), s->h[0], &lo, &hi);
+
+	return gcm_reduce(lo, hi);
+}
+
+/* Hashes @len bytes, the last block is zero padded */
+static AES_GCM_TARGET __m128i gcm_ghash(const struct aes_gcm_state *s,
+					__m128i y, const uint8_t *data,
+					size_t len)
+{
+	uint8_t last[GCM_BLOCK_SIZE] = {};
+	__m128i x;
+
+	for (; len >= GCM_BLOCK_SIZE; data += GCM_BLOCK_SIZE,
+						len -= GCM_BLOCK_SIZE) {
+		x = _mm_loadu_si128((const __m128i *) data);
+		y = gcm_mul(_mm_xor_si128(y, gcm_bswap(x)), s->h[0]);
+	}
+
+	if (!len)
+		return y;
+
+	memcpy(last, data, len);
+	x = _mm_loadu_si128((const __m128i *) last);
+
+	return gcm_mul(_mm_xor_si128(y, gcm_bswap(x)), s->h[0]);
+}
+
+static AES_GCM_TARGET void local_aes_gcm_init_h(struct aes_gcm_state *s)
+{
+	__m128i h = gcm_bswap(aes_encrypt_block(s, _mm_setzero_si128()));
+
+	s->h[0] = h;
+	s->h[1] = gcm_mul(s->h[0], h);
+	s->h[2] = gcm_mul(s->h[1], h);
+	s->h[3] = gcm_mul(s->h[2], h);
+}
+
+/*
+ * Encrypts or decrypts @len bytes and computes the full tag.  The input
+ * blocks are loaded before the output is stored so @in may equal @out.
+ */
+static AES_GCM_TARGET void aes_gcm_crypt(const struct aes_gcm_state *s,
+					bool encrypt,
+					const uint8_t *in, size_t len,
+					const uint8_t *ad, size_t ad_len,
+					const uint8_t *iv, uint8_t *out,
+					uint8_t tag[static 16])
+{
+	const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+	uint8_t block[GCM_BLOCK_SIZE];
+	size_t text_len = len;
+	__m128i j0;
+	__m128i ctr;
+	__m128i y;
+	__m128i x[4];
+	__m128i ks[4];
+	unsigned int i;
+
+	memcpy(block, iv, 12);
+	l_put_be32(1, block + 12);
+	j0 = _mm_loadu_si128((const __m128i *) block);
+
+	/* The 32-bit counter ends up in the lowest lane */
+	ctr = gcm_bswap(j0);
+	y = gcm_ghash(s, _mm_setzero_si128(), ad, ad_len);
+
+	for (; len >= 4 * GCM_BLOCK_SIZE; in += 4 * GCM_BLOCK_SIZE,
+			out += 4 * GCM_BLOCK_SIZE, len -= 4 * GCM_BLOCK_SIZE) {
+		for (i = 0; i < 4; i++) {
+			ctr = _mm_add_epi32(ctr, one);
+			ks[i] = gcm_bswap(ctr);
+			x[i] = _mm_loadu_si128((const __m128i *)
+						(in + i * GCM_BLOCK_SIZE));
+		}
+
+		aes_encrypt_4_blocks(s, ks);
+
+		for (i = 0; i < 4; i++) {
+			ks[i] = _mm_xor_si128(ks[i], x[i]);
+			_mm_storeu_si128((__m128i *) (out + i * GCM_BLOCK_SIZE),
+						ks[i]);
+		}
+
+		y = gcm_ghash_4_blocks(s, y, encrypt ? ks : x);
+	}
+
+	for (; len; in += GCM_BLOCK_SIZE, out += GCM_BLOCK_SIZE,
+			len -= minsize(len, GCM_BLOCK_SIZE)) {
+		size_t n = minsize(len, GCM_BLOCK_SIZE);
+
+		ctr = _mm_add_epi32(ctr, one);
+		ks[0] = aes_encrypt_block(s, gcm_bswap(ctr));
+
+		memset(block, 0, sizeof(block));
+		memcpy(block, in, n);
+		x[0] = _mm_loadu_si128((const __m128i *) block);
+		ks[0] = _mm_xor_si128(ks[0], x[0]);
+		_mm_storeu_si128((__m128i *) block, ks[0]);
+		memcpy(out, block, n);
+
+		/* GHASH covers the zero padded ciphertext */
+		if (encrypt) {
+			memset(block + n, 0, sizeof(block) - n);
+			x[0] = _mm_loadu_si128((const __m128i *) block);
+		}
+
+		y = gcm_mul(_mm_xor_si128(y, gcm_bswap(x[0])), s->h[0]);
+	}
+
+	l_put_be64((uint64_t) ad_len * 8, block);
+	l_put_be64((uint64_t) text_len * 8, block + 8);
+	x[0] = _mm_loadu_si128((const __m128i *) block);
+	y = gcm_mul(_mm_xor_si128(y, gcm_bswap(x[0])), s->h[0]);
+
+	y = _mm_xor_si128(gcm_bswap(y), aes_encrypt_block(s, j0));
+	_mm_storeu_si128((__m128i *) tag, y);
+
+	explicit_bzero(block, sizeof(block));
+}
+
+static void *local_aes_gcm_new(enum l_aead_cipher_type type,
+				const void *key, size_t key_length,
+				size_t tag_length)
+{
+	struct aes_gcm_state *s;
+
+	/* Same tag lengths as accepted by the kernel */
+	if (tag_length != 4 && tag_length != 8 &&
+			(tag_length < 12 || tag_length > 16))
+		return NULL;
+
+	s = l_new(struct aes_gcm_state, 1);
+	s->tag_length = tag_length;
+
+	switch (key_length) {
+	case 16:
+		s->rounds = 10;
+		aes_128_expand_key(s->round_keys, key);
+		break;
+	case 24:
+		s->rounds = 12;
+		aes_192_expand_key(s->round_keys, key);
+		break;
+	case 32:
+		s->rounds = 14;
+		aes_256_expand_key(s->round_keys, key);
+		break;
+	default:
+		l_free(s);
+		return NULL;
+	}
+
+	local_aes_gcm_init_h(s);
+
+	return s;
+}
+
+static void local_aes_gcm_free(void *data)
+{
+	explicit_bzero(data, sizeof(struct aes_gcm_state));
+	l_free(data);
+}
+
+static ssize_t local_aes_gcm_operate(void *data, __u32 operation,
+					const uint8_t *in, size_t in_len,
+					const uint8_t *ad, size_t ad_len,
+					const uint8_t *iv, size_t iv_len,
+					uint8_t *out, size_t out_len)
+{
+	struct aes_gcm_state *s = data;
+	uint8_t tag[GCM_BLOCK_SIZE];
+	size_t len;
+	int r;
+
+	if (iv_len != 12)
+		return -EINVAL;
+
+	if (operation == ALG_OP_ENCRYPT) {
+		if (out_len != in_len + s->tag_length)
+			return -EINVAL;
+
+		len = in_len;
+	} else {
+		if (in_len < s->tag_length ||
+				out_len != in_len - s->tag_length)
+			return -EINVAL;
+
+		len = out_len;
+	}
+
+	aes_gcm_crypt(s, operation == ALG_OP_ENCRYPT, in, len, ad, ad_len,
+			iv, out, tag);
+
+	if (operation == ALG_OP_ENCRYPT) {
+		memcpy(out + len, tag, s->tag_length);
+		return out_len;
+	}
+
+	r = l_secure_memcmp(tag, in + len, s->tag_length);
+	explicit_bzero(tag, sizeof(tag));
+
+	if (r) {
+		explicit_bzero(out, out_len);
+		return -EBADMSG;
+	}
+
+	return out_len;
+}
+
+static const struct local_aead_impl local_aes_gcm = {
+	local_aes_gcm_is_supported,
+	local_aes_gcm_new,
+	local_aes_gcm_free,
+	local_aes_gcm_operate,
+};
+
+#endif
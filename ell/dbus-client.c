@@ -13,6 +13,7 @@
 #include "dbus.h"
 #include "dbus-client.h"
 #include "queue.h"
+#include "hashmap.h"
 #include "useful.h"
 #include "private.h"
 
@@ -21,6 +22,7 @@ struct l_dbus_client {
 	unsigned int watch;
 	unsigned int added_watch;
 	unsigned int removed_watch;
+	unsigned int properties_watch;
 	char *service;
 	uint32_t objects_call;
 
@@ -45,8 +47,8 @@ struct l_dbus_client {
 	struct l_queue *proxies;
 };
 
+/* The value of an invalidated property is NULL until it is fetched again */
 struct proxy_property {
-	char *name;
 	struct l_dbus_message *msg;
 };
 
@@ -54,10 +56,11 @@ struct l_dbus_proxy {
 	struct l_dbus_client *client;
 	char *interface;
 	char *path;
-	uint32_t properties_watch;
+	uint32_t refresh_call;
+	bool refresh_again;
 	bool ready;
 
-	struct l_queue *properties;
+	struct l_hashmap *properties;
 	struct l_queue *pending_calls;
 };
 
@@ -77,18 +80,10 @@ LIB_EXPORT const char *l_dbus_proxy_get_interface(struct l_dbus_proxy *proxy)
 	return proxy->interface;
 }
 
-static bool property_match_by_name(const void *a, const void *b)
-{
-	const struct proxy_property *prop = a;
-	const char *name = b;
-
-	return !strcmp(prop->name, name);
-}
-
 static struct proxy_property *find_property(struct l_dbus_proxy *proxy,
 							const char *name)
 {
-	return l_queue_find(proxy->properties, property_match_by_name, name);
+	return l_hashmap_lookup(proxy->properties, name);
 }
 
 static struct proxy_property *get_property(struct l_dbus_proxy *proxy,
@@ -101,9 +96,7 @@ static struct proxy_property *get_property(struct l_dbus_proxy *proxy,
 		return prop;
 
 	prop = l_new(struct proxy_property, 1);
-	prop->name = l_strdup(name);
-
-	l_queue_push_tail(proxy->properties, prop);
+	l_hashmap_insert(proxy->properties, name, prop);
 
 	return prop;
 }
@@ -120,7 +113,7 @@ LIB_EXPORT bool l_dbus_proxy_get_property(struct l_dbus_proxy *proxy,
 		return false;
 
 	prop = find_property(proxy, name);
-	if (!prop)
+	if (!prop || !prop->msg)
 		return false;
 
 	va_start(args, signature);
@@ -137,7 +130,6 @@ static void property_free(void *data)
 	if (prop->msg)
 		l_dbus_message_unref(prop->msg);
 
-	l_free(prop->name);
 	l_free(prop);
 }
 
@@ -158,13 +150,12 @@ static void dbus_proxy_destroy(struct l_dbus_proxy *proxy)
 	if (unlikely(!proxy))
 		return;
 
-	if (proxy->properties_watch)
-		l_dbus_remove_signal_watch(proxy->client->dbus,
-						proxy->properties_watch);
+	if (proxy->refresh_call)
+		l_dbus_cancel(proxy->client->dbus, proxy->refresh_call);
 
 	cancel_pending_calls(proxy);
 	l_queue_destroy(proxy->pending_calls, NULL);
-	l_queue_destroy(proxy->properties, property_free);
+	l_hashmap_destroy(proxy->properties, property_free);
 	l_free(proxy->interface);
 	l_free(proxy->path);
 	l_free(proxy);
@@ -215,7 +206,7 @@ LIB_EXPORT bool l_dbus_proxy_set_property(struct l_dbus_proxy *proxy,
 				void *user_data, l_dbus_destroy_func_t destroy,
 				const char *name, const char *signature, ...)
 {
-	struct l_dbus_client *client = proxy->client;
+	struct l_dbus_client *client;
 	struct l_dbus_message_builder *builder;
 	struct method_call_request *req;
 	struct l_dbus_message *message;
@@ -225,8 +216,10 @@ LIB_EXPORT bool l_dbus_proxy_set_property(struct l_dbus_proxy *proxy,
 	if (unlikely(!proxy))
 		return false;
 
+	client = proxy->client;
+
 	prop = find_property(proxy, name);
-	if (!prop)
+	if (!prop || !prop->msg)
 		return false;
 
 	if (strcmp(l_dbus_message_get_signature(prop->msg), signature))
@@ -343,29 +336,99 @@ done:
 					proxy->client->proxy_cb_data);
 }
 
-static void proxy_invalidate_properties(struct l_dbus_proxy *proxy,
+static void proxy_update_properties(struct l_dbus_proxy *proxy,
 					struct l_dbus_message_iter* props)
 {
+	struct l_dbus_message_iter variant;
 	const char *name;
 
-	while (l_dbus_message_iter_next_entry(props, &name))
-		proxy_update_property(proxy, name, NULL);
+	while (l_dbus_message_iter_next_entry(props, &name, &variant))
+		proxy_update_property(proxy, name, &variant);
 }
 
-static void proxy_update_properties(struct l_dbus_proxy *proxy,
-					struct l_dbus_message_iter* props)
+static void proxy_refresh_properties(struct l_dbus_proxy *proxy);
+
+static void get_all_setup(struct l_dbus_message *message, void *user_data)
+{
+	struct l_dbus_proxy *proxy = user_data;
+
+	l_dbus_message_set_arguments(message, "s", proxy->interface);
+}
+
+static void get_all_reply(struct l_dbus_message *message, void *user_data)
 {
+	struct l_dbus_proxy *proxy = user_data;
+	struct l_dbus_message_iter props;
 	struct l_dbus_message_iter variant;
+	struct proxy_property *prop;
 	const char *name;
 
-	while (l_dbus_message_iter_next_entry(props, &name, &variant))
-		proxy_update_property(proxy, name, &variant);
+	proxy->refresh_call = 0;
+
+	/* Values may predate the newer invalidations, fetch them again */
+	if (proxy->refresh_again) {
+		proxy->refresh_again = false;
+		proxy_refresh_properties(proxy);
+		return;
+	}
+
+	if (l_dbus_message_is_error(message) ||
+			!l_dbus_message_get_arguments(message, "a{sv}", &props))
+		return;
+
+	/* The other values are kept current by PropertiesChanged already */
+	while (l_dbus_message_iter_next_entry(&props, &name, &variant)) {
+		prop = find_property(proxy, name);
+
+		if (!prop || !prop->msg)
+			proxy_update_property(proxy, name, &variant);
+	}
+}
+
+/*
+ * Fetch the values of invalidated properties with one GetAll.  A burst
+ * of invalidations arriving while that call is pending is covered by a
+ * single further GetAll issued once it returns.
+ */
+static void proxy_refresh_properties(struct l_dbus_proxy *proxy)
+{
+	struct l_dbus_client *client = proxy->client;
+
+	if (proxy->refresh_call) {
+		proxy->refresh_again = true;
+		return;
+	}
+
+	proxy->refresh_call = l_dbus_method_call(client->dbus, client->service,
+						proxy->path,
+						L_DBUS_INTERFACE_PROPERTIES,
+						"GetAll", get_all_setup,
+						get_all_reply, proxy, NULL);
+}
+
+static void proxy_invalidate_properties(struct l_dbus_proxy *proxy,
+					struct l_dbus_message_iter* props)
+{
+	const char *name;
+	bool invalidated = false;
+
+	while (l_dbus_message_iter_next_entry(props, &name)) {
+		proxy_update_property(proxy, name, NULL);
+		invalidated = true;
+	}
+
+	if (invalidated)
+		proxy_refresh_properties(proxy);
 }
 
+static struct l_dbus_proxy *find_proxy(struct l_dbus_client *client,
+					const char *path, const char *interface);
+
 static void properties_changed_callback(struct l_dbus_message *message,
 								void *user_data)
 {
-	struct l_dbus_proxy *proxy = user_data;
+	struct l_dbus_client *client = user_data;
+	struct l_dbus_proxy *proxy;
 	const char *interface;
 	struct l_dbus_message_iter changed;
 	struct l_dbus_message_iter invalidated;
@@ -374,6 +437,11 @@ static void properties_changed_callback(struct l_dbus_message *message,
 							&changed, &invalidated))
 		return;
 
+	proxy = find_proxy(client, l_dbus_message_get_path(message),
+								interface);
+	if (!proxy)
+		return;
+
 	proxy_update_properties(proxy, &changed);
 	proxy_invalidate_properties(proxy, &invalidated);
 }
@@ -383,23 +451,10 @@ static struct l_dbus_proxy *dbus_proxy_new(struct l_dbus_client *client,
 {
 	struct l_dbus_proxy *proxy = l_new(struct l_dbus_proxy, 1);
 
-	proxy->properties_watch = l_dbus_add_signal_watch(client->dbus,
-						client->service, path,
-						L_DBUS_INTERFACE_PROPERTIES,
-						"PropertiesChanged",
-						L_DBUS_MATCH_ARGUMENT(0),
-						interface, L_DBUS_MATCH_NONE,
-						properties_changed_callback,
-						proxy);
-	if (!proxy->properties_watch) {
-		l_free(proxy);
-		return NULL;
-	}
-
 	proxy->client = client;
 	proxy->interface = l_strdup(interface);
 	proxy->path = l_strdup(path);
-	proxy->properties = l_queue_new();
+	proxy->properties = l_hashmap_string_new();
 	proxy->pending_calls = l_queue_new();
 
 	l_queue_push_tail(client->proxies, proxy);
@@ -593,21 +648,40 @@ LIB_EXPORT struct l_dbus_client *l_dbus_client_new(struct l_dbus *dbus,
 	struct l_dbus_client *client = l_new(struct l_dbus_client, 1);
 
 	client->dbus = dbus;
+	client->service = l_strdup(service);
+	client->proxies = l_queue_new();
+
+	/*
+	 * One watch covers the properties of every proxy, rather than a
+	 * match rule and a bus round-trip for each interface found.
+	 */
+	client->properties_watch = l_dbus_add_signal_watch(dbus, service,
+						NULL,
+						L_DBUS_INTERFACE_PROPERTIES,
+						"PropertiesChanged",
+						L_DBUS_MATCH_NONE,
+						properties_changed_callback,
+						client);
+	if (!client->properties_watch)
+		goto error;
 
+	/* The owner may be known already, in which case this calls back */
 	client->watch = l_dbus_add_service_watch(dbus, service,
 						service_appeared_callback,
 						service_disappeared_callback,
 						client, NULL);
-
 	if (!client->watch) {
-		l_free(client);
-		return NULL;
+		l_dbus_remove_signal_watch(dbus, client->properties_watch);
+		goto error;
 	}
 
-	client->service = l_strdup(service);
-	client->proxies = l_queue_new();
-
 	return client;
+
+error:
+	l_queue_destroy(client->proxies, NULL);
+	l_free(client->service);
+	l_free(client);
+	return NULL;
 }
 
 LIB_EXPORT void l_dbus_client_destroy(struct l_dbus_client *client)
@@ -624,6 +698,10 @@ LIB_EXPORT void l_dbus_client_destroy(struct l_dbus_client *client)
 	if (client->removed_watch)
 		l_dbus_remove_signal_watch(client->dbus, client->removed_watch);
 
+	if (client->properties_watch)
+		l_dbus_remove_signal_watch(client->dbus,
+						client->properties_watch);
+
 	if (client->connect_cb_data_destroy)
 		client->connect_cb_data_destroy(client->connect_cb_data);
 
@@ -25,13 +25,41 @@
 
 #define NODE_TYPE_CALLBACK	L_DBUS_MATCH_NONE
 
+/*
+ * Match nodes that share a parent are indexed by (type, value) so that a
+ * message only descends into the children whose condition it satisfies,
+ * instead of comparing against every sibling.  The types bitmap records
+ * which condition types are present among the children.
+ */
+struct filter_index {
+	struct l_hashmap *nodes;
+	uint64_t types[2];
+	unsigned int wellknown_senders;
+};
+
+/*
+ * A match rule installed on the bus, shared by all the tree nodes that
+ * need the same conditions.  Rules stay inactive, without a bus side
+ * counterpart, while a broader active rule already routes everything they
+ * would match to us.
+ */
+struct remote_rule {
+	char *match;
+	struct _dbus_filter_condition *conditions;
+	int len;
+	unsigned int refcount;
+	unsigned int id;
+	bool active;
+};
+
 struct filter_node {
 	enum l_dbus_match_type type;
 	union {
 		struct {
 			char *value;
 			struct filter_node *children;
-			bool remote_rule;
+			struct filter_index index;
+			struct remote_rule *remote_rule;
 		} match;
 		struct {
 			l_dbus_message_func_t func;
@@ -45,12 +73,71 @@ struct filter_node {
 struct _dbus_filter {
 	struct l_dbus *dbus;
 	struct filter_node *root;
+	struct filter_index root_index;
 	unsigned int signal_id;
 	unsigned int last_id;
 	const struct _dbus_filter_ops *driver;
 	struct _dbus_name_cache *name_cache;
+	struct l_hashmap *remote_rules;
+	struct l_queue *remote_list;
 };
 
+static unsigned int filter_node_hash(const void *p)
+{
+	const struct filter_node *node = p;
+
+	return l_str_hash_fast(node->match.value) ^ node->type;
+}
+
+static int filter_node_compare(const void *a, const void *b)
+{
+	const struct filter_node *node_a = a, *node_b = b;
+
+	if (node_a->type != node_b->type)
+		return node_a->type - node_b->type;
+
+	return strcmp(node_a->match.value, node_b->match.value);
+}
+
+static bool filter_node_is_wellknown_sender(const struct filter_node *node)
+{
+	return node->type == L_DBUS_MATCH_SENDER &&
+			!_dbus_parse_unique_name(node->match.value, NULL);
+}
+
+static void filter_index_add(struct filter_index *index,
+				struct filter_node *node)
+{
+	if (!index->nodes) {
+		index->nodes = l_hashmap_new();
+		l_hashmap_set_hash_function(index->nodes, filter_node_hash);
+		l_hashmap_set_compare_function(index->nodes,
+						filter_node_compare);
+	}
+
+	l_hashmap_insert(index->nodes, node, node);
+	index->types[node->type / 64] |= 1ULL << (node->type % 64);
+
+	if (filter_node_is_wellknown_sender(node))
+		index->wellknown_senders++;
+}
+
+static void filter_index_remove(struct filter_index *index,
+				const struct filter_node *siblings,
+				struct filter_node *node)
+{
+	l_hashmap_remove(index->nodes, node);
+
+	if (filter_node_is_wellknown_sender(node))
+		index->wellknown_senders--;
+
+	for (; siblings; siblings = siblings->next)
+		if (siblings != node && siblings->type == node->type)
+			return;
+
+	index->types[node->type / 64] &= ~(1ULL << (node->type % 64));
+}
+
 static void filter_subtree_free(struct filter_node *node)
 {
 	struct filter_node *child, *next;
@@ -62,6 +149,7 @@ static void filter_subtree_free(struct filter_node *node)
 
 	next = node->match.children;
 
+	l_hashmap_destroy(node->match.index.nodes, NULL);
 	l_free(node->match.value);
 	l_free(node);
 
@@ -73,75 +161,171 @@ static void filter_subtree_free(struct filter_node *node)
 	}
 }
 
+static void remote_rule_free(void *data)
+{
+	struct remote_rule *rule = data;
+	int i;
+
+	for (i = 0; i < rule->len; i++)
+		l_free((char *) rule->conditions[i].value);
+
+	l_free(rule->conditions);
+	l_free(rule->match);
+	l_free(rule);
+}
+
 static void dbus_filter_destroy(void *data)
 {
 	struct _dbus_filter *filter = data;
 
-	if (filter->root)
-		filter_subtree_free(filter->root);
+	struct filter_node *node, *next;
+
+	for (node = filter->root; node; node = next) {
+		next = node->next;
+		filter_subtree_free(node);
+	}
 
+	l_hashmap_destroy(filter->root_index.nodes, NULL);
+	l_hashmap_destroy(filter->remote_rules, NULL);
+	l_queue_destroy(filter->remote_list, remote_rule_free);
 	l_free(filter);
 }
 
-static void filter_dispatch_match_recurse(struct _dbus_filter *filter,
-						struct filter_node *node,
-						struct l_dbus_message *message)
+static const char *filter_message_value(struct l_dbus_message *message,
+						int type)
 {
-	const char *value = NULL;
-	const char *alt_value = NULL;
-	struct filter_node *child;
-
-	switch ((int) node->type) {
-	case NODE_TYPE_CALLBACK:
-		node->callback.func(message, node->callback.user_data);
-		return;
-
+	switch (type) {
 	case L_DBUS_MATCH_SENDER:
-		value = l_dbus_message_get_sender(message);
-		break;
-
+		return l_dbus_message_get_sender(message);
 	case L_DBUS_MATCH_TYPE:
-		value = _dbus_message_get_type_as_string(message);
-		break;
-
+		return _dbus_message_get_type_as_string(message);
 	case L_DBUS_MATCH_PATH:
-		value = l_dbus_message_get_path(message);
-		break;
-
+		return l_dbus_message_get_path(message);
 	case L_DBUS_MATCH_INTERFACE:
-		value = l_dbus_message_get_interface(message);
-		break;
-
+		return l_dbus_message_get_interface(message);
 	case L_DBUS_MATCH_MEMBER:
-		value = l_dbus_message_get_member(message);
-		break;
-
+		return l_dbus_message_get_member(message);
 	case L_DBUS_MATCH_ARG0...(L_DBUS_MATCH_ARG0 + 63):
-		value = _dbus_message_get_nth_string_argument(message,
-						node->type - L_DBUS_MATCH_ARG0);
-		break;
+		return _dbus_message_get_nth_string_argument(message,
+						type - L_DBUS_MATCH_ARG0);
 	}
 
+	return NULL;
+}
+
+/*
+ * The message fields compared while dispatching.  Each is extracted at
+ * most once per message, however many levels of the tree match on it,
+ * as getting to an argument means walking the body up to it.
+ */
+struct filter_fields {
+	struct l_dbus_message *message;
+	uint64_t fetched[2];
+	const char *values[L_DBUS_MATCH_ARG0 + 64];
+};
+
+static const char *filter_field(struct filter_fields *fields, int type)
+{
+	uint64_t bit = 1ULL << (type % 64);
+
+	if (!(fields->fetched[type / 64] & bit)) {
+		fields->values[type] = filter_message_value(fields->message,
+									type);
+		fields->fetched[type / 64] |= bit;
+	}
+
+	return fields->values[type];
+}
+
+static void filter_dispatch_children(struct _dbus_filter *filter,
+					struct filter_node *children,
+					const struct filter_index *index,
+					struct filter_fields *fields);
+
+static void filter_dispatch_type(struct _dbus_filter *filter,
+					struct filter_node *children,
+					const struct filter_index *index,
+					int type,
+					struct filter_fields *fields)
+{
+	struct filter_node key;
+	struct filter_node *child;
+	const char *value;
+	const char *alt_value;
+
+	value = filter_field(fields, type);
 	if (!value)
 		return;
 
-	if (node->type == L_DBUS_MATCH_SENDER && filter->name_cache)
-		alt_value = _dbus_name_cache_lookup(filter->name_cache,
-							node->match.value);
+	key.type = type;
+	key.match.value = (char *) value;
+
+	child = l_hashmap_lookup(index->nodes, &key);
+	if (child)
+		filter_dispatch_children(filter, child->match.children,
+						&child->match.index, fields);
 
-	if (strcmp(value, node->match.value) &&
-			(!alt_value || strcmp(value, alt_value)))
+	/*
+	 * Well-known sender names can't be looked up directly since the
+	 * message carries the owner's unique name, compare those against
+	 * the name cache instead.
+	 */
+	if (type != L_DBUS_MATCH_SENDER || !filter->name_cache ||
+			!index->wellknown_senders)
 		return;
 
-	for (child = node->match.children; child; child = child->next)
-		filter_dispatch_match_recurse(filter, child, message);
+	for (child = children; child; child = child->next) {
+		if (!filter_node_is_wellknown_sender(child))
+			continue;
+
+		alt_value = _dbus_name_cache_lookup(filter->name_cache,
+							child->match.value);
+		if (!alt_value || strcmp(value, alt_value) ||
+				!strcmp(value, child->match.value))
+			continue;
+
+		filter_dispatch_children(filter, child->match.children,
+						&child->match.index, fields);
+	}
+}
+
+static void filter_dispatch_children(struct _dbus_filter *filter,
+					struct filter_node *children,
+					const struct filter_index *index,
+					struct filter_fields *fields)
+{
+	struct filter_node *child;
+	unsigned int i;
+	uint64_t types;
+
+	/* Callbacks are always kept in front of the match nodes */
+	for (child = children; child && child->type == NODE_TYPE_CALLBACK;
+							child = child->next)
+		child->callback.func(fields->message,
+					child->callback.user_data);
+
+	for (i = 0; i < L_ARRAY_SIZE(index->types); i++) {
+		types = index->types[i];
+
+		while (types) {
+			filter_dispatch_type(filter, children, index,
+						i * 64 + __builtin_ctzll(types),
+						fields);
+			types &= types - 1;
+		}
+	}
 }
 
 void _dbus_filter_dispatch(struct l_dbus_message *message, void *user_data)
 {
 	struct _dbus_filter *filter = user_data;
+	struct filter_fields fields;
+
+	fields.message = message;
+	memset(fields.fetched, 0, sizeof(fields.fetched));
 
-	filter_dispatch_match_recurse(filter, filter->root, message);
+	filter_dispatch_children(filter, filter->root, &filter->root_index,
+					&fields);
 }
 
 struct _dbus_filter *_dbus_filter_new(struct l_dbus *dbus,
@@ -155,6 +339,8 @@ struct _dbus_filter *_dbus_filter_new(struct l_dbus *dbus,
 	filter->dbus = dbus;
 	filter->driver = driver;
 	filter->name_cache = name_cache;
+	filter->remote_rules = l_hashmap_string_new();
+	filter->remote_list = l_queue_new();
 
 	if (!filter->driver->skip_register)
 		filter->signal_id = l_dbus_register(dbus, _dbus_filter_dispatch,
@@ -179,12 +365,159 @@ static int condition_compare(const void *a, const void *b)
 {
 	const struct _dbus_filter_condition *condition_a = a, *condition_b = b;
 
-	return condition_a->type - condition_b->type;
+	if (condition_a->type != condition_b->type)
+		return condition_a->type - condition_b->type;
+
+	return strcmp(condition_a->value, condition_b->value);
+}
+
+/*
+ * True if everything matched by @rule is also matched by @broader, that is
+ * if each condition of @broader is also one of @rule's.  Both are sorted.
+ */
+static bool remote_rule_covers(const struct remote_rule *broader,
+				const struct remote_rule *rule)
+{
+	int i, j = 0;
+
+	if (broader->len > rule->len)
+		return false;
+
+	for (i = 0; i < broader->len; i++) {
+		while (j < rule->len && condition_compare(&rule->conditions[j],
+						&broader->conditions[i]) < 0)
+			j++;
+
+		if (j == rule->len || condition_compare(&rule->conditions[j],
+						&broader->conditions[i]))
+			return false;
+
+		j++;
+	}
+
+	return true;
+}
+
+static bool remote_rule_is_covered(struct _dbus_filter *filter,
+					const struct remote_rule *rule)
+{
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(filter->remote_list); entry;
+			entry = entry->next) {
+		const struct remote_rule *other = entry->data;
+
+		if (other != rule && other->active &&
+				remote_rule_covers(other, rule))
+			return true;
+	}
+
+	return false;
+}
+
+static bool remote_rule_activate(struct _dbus_filter *filter,
+					struct remote_rule *rule)
+{
+	const struct l_queue_entry *entry;
+
+	if (!filter->driver->add_match(filter->dbus, rule->id,
+					rule->conditions, rule->len))
+		return false;
+
+	rule->active = true;
+
+	/* Drop the narrower rules only after the new one is in place */
+	for (entry = l_queue_get_entries(filter->remote_list); entry;
+			entry = entry->next) {
+		struct remote_rule *other = entry->data;
+
+		if (other == rule || !other->active ||
+				!remote_rule_covers(rule, other))
+			continue;
+
+		filter->driver->remove_match(filter->dbus, other->id);
+		other->active = false;
+	}
+
+	return true;
+}
+
+static struct remote_rule *remote_rule_ref(struct _dbus_filter *filter,
+				const struct _dbus_filter_condition *sorted,
+				int len, unsigned int id)
+{
+	struct remote_rule *rule;
+	char *match = _dbus_filter_rule_to_str(sorted, len);
+	int i;
+
+	rule = l_hashmap_lookup(filter->remote_rules, match);
+	if (rule) {
+		l_free(match);
+		rule->refcount += 1;
+		return rule;
+	}
+
+	rule = l_new(struct remote_rule, 1);
+	rule->match = match;
+	rule->conditions = l_new(struct _dbus_filter_condition, len);
+	rule->len = len;
+	rule->refcount = 1;
+	rule->id = id;
+
+	for (i = 0; i < len; i++) {
+		rule->conditions[i].type = sorted[i].type;
+		rule->conditions[i].value = l_strdup(sorted[i].value);
+	}
+
+	if (!remote_rule_is_covered(filter, rule) &&
+			!remote_rule_activate(filter, rule)) {
+		remote_rule_free(rule);
+		return NULL;
+	}
+
+	l_hashmap_insert(filter->remote_rules, rule->match, rule);
+	l_queue_push_tail(filter->remote_list, rule);
+
+	return rule;
+}
+
+static void remote_rule_unref(struct _dbus_filter *filter,
+				struct remote_rule *rule)
+{
+	const struct l_queue_entry *entry;
+
+	if (--rule->refcount)
+		return;
+
+	l_hashmap_remove(filter->remote_rules, rule->match);
+	l_queue_remove(filter->remote_list, rule);
+
+	if (!rule->active)
+		goto done;
+
+	/* Install the rules this one was standing in for before removing it */
+	for (entry = l_queue_get_entries(filter->remote_list); entry;
+			entry = entry->next) {
+		struct remote_rule *other = entry->data;
+
+		if (other->active || !remote_rule_covers(rule, other) ||
+				remote_rule_is_covered(filter, other))
+			continue;
+
+		remote_rule_activate(filter, other);
+	}
+
+	filter->driver->remove_match(filter->dbus, rule->id);
+
+done:
+	remote_rule_free(rule);
 }
 
 static bool remove_recurse(struct _dbus_filter *filter,
-				struct filter_node **node, unsigned int id)
+				struct filter_node **node,
+				struct filter_index *index, unsigned int id)
 {
+	struct filter_node **head = node;
 	struct filter_node *tmp;
 
 	for (; *node; node = &(*node)->next) {
@@ -193,7 +526,7 @@ static bool remove_recurse(struct _dbus_filter *filter,
 
 		if ((*node)->type != NODE_TYPE_CALLBACK &&
 				remove_recurse(filter, &(*node)->match.children,
-						id))
+						&(*node)->match.index, id))
 			break;
 	}
 
@@ -204,8 +537,11 @@ static bool remove_recurse(struct _dbus_filter *filter,
 		tmp = *node;
 		*node = tmp->next;
 
-		if (tmp->match.remote_rule)
-			filter->driver->remove_match(filter->dbus, tmp->id);
+		if (tmp->type != NODE_TYPE_CALLBACK)
+			filter_index_remove(index, *head, tmp);
+
+		if (tmp->type != NODE_TYPE_CALLBACK && tmp->match.remote_rule)
+			remote_rule_unref(filter, tmp->match.remote_rule);
 
 		if (tmp->type == L_DBUS_MATCH_SENDER && filter->name_cache &&
 				!_dbus_parse_unique_name(tmp->match.value,
@@ -226,16 +562,19 @@ unsigned int _dbus_filter_add_rule(struct _dbus_filter *filter,
 				void *user_data)
 {
 	struct filter_node **node_ptr = &filter->root;
+	struct filter_index *index = &filter->root_index;
 	struct filter_node *node;
 	struct filter_node *parent = filter->root;
 	bool remote_rule = false;
 	struct _dbus_filter_condition sorted[rule_len];
+	struct _dbus_filter_condition canonical[rule_len];
 	struct _dbus_filter_condition *unused;
 	struct _dbus_filter_condition *condition;
 	struct _dbus_filter_condition *end = sorted + rule_len;
 
 	memcpy(sorted, rule, sizeof(sorted));
 	qsort(sorted, rule_len, sizeof(*condition), condition_compare);
+	memcpy(canonical, sorted, sizeof(canonical));
 
 	/*
 	 * Find or create a path in the tree with a node for each
@@ -283,6 +622,7 @@ unsigned int _dbus_filter_add_rule(struct _dbus_filter *filter,
 			node->match.value = l_strdup(condition->value);
 
 			*node_ptr = node;
+			filter_index_add(index, node);
 
 			if (node->type == L_DBUS_MATCH_SENDER &&
 					filter->name_cache &&
@@ -309,6 +649,7 @@ _Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
 			unused++;
 
 		node_ptr = &node->match.children;
+		index = &node->match.index;
 
 		parent = node;
 
@@ -316,7 +657,7 @@ _Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
 		 * Only have to call AddMatch if none of the parent nodes
 		 * have yet created an AddMatch rule on the server.
 		 */
-		remote_rule |= node->match.remote_rule;
+		remote_rule |= node->match.remote_rule != NULL;
 _Pragma("GCC diagnostic pop")
 	}
 
@@ -330,14 +671,15 @@ _Pragma("GCC diagnostic pop")
 	*node_ptr = node;
 
 	if (!remote_rule) {
-		if (!filter->driver->add_match(filter->dbus, node->id,
-						rule, rule_len))
+		struct remote_rule *remote = remote_rule_ref(filter, canonical,
+							rule_len, node->id);
+
+		if (!remote)
 			goto err;
 
 _Pragma("GCC diagnostic push")
 _Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
-		parent->id = node->id;
-		parent->match.remote_rule = true;
+		parent->match.remote_rule = remote;
 _Pragma("GCC diagnostic pop")
 	}
 
@@ -346,14 +688,16 @@ _Pragma("GCC diagnostic pop")
 err:
 	/* Remove all the nodes we may have added */
 	node->id = (unsigned int) -1;
-	remove_recurse(filter, &filter->root, node->id);
+	remove_recurse(filter, &filter->root, &filter->root_index,
+			node->id);
 
 	return 0;
 }
 
 bool _dbus_filter_remove_rule(struct _dbus_filter *filter, unsigned int id)
 {
-	return remove_recurse(filter, &filter->root, id);
+	return remove_recurse(filter, &filter->root, &filter->root_index,
+				id);
 }
 
 char *_dbus_filter_rule_to_str(const struct _dbus_filter_condition *rule,
@@ -13,6 +13,8 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "util.h"
 #include "private.h"
@@ -20,6 +22,9 @@
 #include "dbus.h"
 #include "dbus-private.h"
 #include "gvariant-private.h"
+#include "memory-private.h"
+
+#define DBUS_BLOB_MEMFD_THRESHOLD	(64 * 1024)
 
 #define DBUS_MESSAGE_LITTLE_ENDIAN	('l')
 #define DBUS_MESSAGE_BIG_ENDIAN		('B')
@@ -41,6 +46,14 @@
 
 #define DBUS_MAX_NESTING	32
 
+/* Where a top-level argument starts, relative to the message body */
+struct arg_offset {
+	size_t pos;
+	ptrdiff_t offsets;
+	uint8_t sig_pos;
+	bool has_offsets : 1;
+};
+
 struct l_dbus_message {
 	int refcount;
 	void *header;
@@ -58,9 +71,17 @@ struct l_dbus_message {
 	char *sender;
 	int fds[16];
 	uint32_t num_fds;
+	struct _dbus_buffer *buffer;
+	struct l_dbus_message_template *template;
+	struct l_dbus_message_iter args_iter;
+	struct arg_offset *args;
+	uint8_t n_args;
 
 	bool sealed : 1;
 	bool signature_free : 1;
+	bool body_unshared : 1;
+	bool args_indexed : 1;
+	bool sender_owned : 1;
 };
 
 struct l_dbus_message_builder {
@@ -69,6 +90,18 @@ struct l_dbus_message_builder {
 	struct builder_driver *driver;
 };
 
+struct l_dbus_message_template {
+	int refcount;
+	char *destination;
+	char *path;
+	char *interface;
+	char *member;
+	char *signature;
+	void *header;
+	size_t header_size;
+	size_t header_end;
+};
+
 static inline bool _dbus_message_is_gvariant(struct l_dbus_message *msg)
 {
 	struct dbus_header *hdr = msg->header;
@@ -201,6 +234,7 @@ LIB_EXPORT bool l_dbus_message_get_no_autostart(struct l_dbus_message *msg)
 static struct l_dbus_message *message_new_common(uint8_t type, uint8_t flags,
 						uint8_t version)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_DBUS);
 	struct l_dbus_message *message;
 	struct dbus_header *hdr;
 
@@ -407,54 +441,159 @@ LIB_EXPORT void l_dbus_message_unref(struct l_dbus_message *message)
 		l_free(message->member);
 		l_free(message->error_name);
 		l_free(message->sender);
-	}
+	} else if (message->sender_owned)
+		l_free(message->sender);
 
 	if (message->signature_free)
 		l_free(message->signature);
 
-	l_free(message->header);
-	l_free(message->body);
+	l_dbus_message_template_unref(message->template);
+	l_free(message->args);
+
+	if (message->buffer) {
+		_dbus_buffer_unref(message->buffer);
+
+		if (message->body_unshared)
+			l_free(message->body);
+	} else {
+		l_free(message->header);
+		l_free(message->body);
+	}
+
 	l_free(message);
 }
 
-const char *_dbus_message_get_nth_string_argument(
-					struct l_dbus_message *message, int n)
+struct _dbus_buffer *_dbus_buffer_new(size_t size)
+{
+	struct _dbus_buffer *buffer;
+
+	buffer = l_malloc(sizeof(struct _dbus_buffer) + size);
+	buffer->refcount = 1;
+	buffer->size = size;
+
+	return buffer;
+}
+
+struct _dbus_buffer *_dbus_buffer_ref(struct _dbus_buffer *buffer)
+{
+	__atomic_fetch_add(&buffer->refcount, 1, __ATOMIC_SEQ_CST);
+
+	return buffer;
+}
+
+void _dbus_buffer_unref(struct _dbus_buffer *buffer)
+{
+	if (__atomic_sub_fetch(&buffer->refcount, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	l_free(buffer);
+}
+
+static bool message_iter_init(struct l_dbus_message *message,
+					struct l_dbus_message_iter *iter)
+{
+	if (_dbus_message_is_gvariant(message))
+		return _gvariant_iter_init(iter, message, message->signature,
+						NULL, message->body,
+						message->body_size);
+
+	_dbus1_iter_init(iter, message, message->signature, NULL,
+				message->body, message->body_size);
+	return true;
+}
+
+/*
+ * Walks the top-level arguments once and records where each of them
+ * starts, so that any of them can be reached without skipping over the
+ * ones in front of it again.  Offsets are kept relative to the body in
+ * case it gets moved, see message_align_fixed_array().
+ */
+static void message_index_args(struct l_dbus_message *message)
 {
 	struct l_dbus_message_iter iter;
-	const char *signature, *value;
-	void *body;
-	size_t size;
-	char type;
 	bool (*skip_entry)(struct l_dbus_message_iter *);
-	bool (*get_basic)(struct l_dbus_message_iter *, char, void *);
-
-	signature = l_dbus_message_get_signature(message);
-	body = _dbus_message_get_body(message, &size);
+	unsigned int n_alloc = 0;
 
-	if (!signature)
-		return NULL;
+	message->args_indexed = true;
 
-	if (_dbus_message_is_gvariant(message)) {
-		if (!_gvariant_iter_init(&iter, message, signature, NULL,
-						body, size))
-			return NULL;
+	if (!message->signature || !message_iter_init(message, &iter))
+		return;
 
+	if (_dbus_message_is_gvariant(message))
 		skip_entry = _gvariant_iter_skip_entry;
-		get_basic = _gvariant_iter_next_entry_basic;
-	} else {
-		_dbus1_iter_init(&iter, message, signature, NULL, body, size);
-
+	else
 		skip_entry = _dbus1_iter_skip_entry;
-		get_basic = _dbus1_iter_next_entry_basic;
-	}
 
-	while (n--)
+	message->args_iter = iter;
+
+	while (iter.sig_pos < iter.sig_len) {
+		struct arg_offset *arg;
+
+		if (message->n_args == n_alloc) {
+			n_alloc += 8;
+			message->args = l_realloc(message->args,
+					n_alloc * sizeof(struct arg_offset));
+		}
+
+		arg = &message->args[message->n_args];
+		arg->pos = iter.pos;
+		arg->sig_pos = iter.sig_pos;
+		arg->has_offsets = iter.offsets != NULL;
+		arg->offsets = arg->has_offsets ?
+				(const uint8_t *) iter.offsets -
+				(const uint8_t *) iter.data : 0;
+
 		if (!skip_entry(&iter))
-			return NULL;
+			break;
+
+		message->n_args += 1;
+	}
+}
+
+static bool message_iter_nth_arg(struct l_dbus_message *message,
+					unsigned int n,
+					struct l_dbus_message_iter *iter)
+{
+	const struct arg_offset *arg;
+
+	if (!message->sealed)
+		return false;
+
+	if (!message->args_indexed)
+		message_index_args(message);
+
+	if (n >= message->n_args)
+		return false;
+
+	arg = &message->args[n];
+
+	*iter = message->args_iter;
+	iter->data = message->body;
+	iter->pos = arg->pos;
+	iter->sig_pos = arg->sig_pos;
+	iter->offsets = arg->has_offsets ?
+				(const uint8_t *) message->body + arg->offsets :
+				NULL;
+
+	return true;
+}
 
-	if (!iter.sig_start)
+const char *_dbus_message_get_nth_string_argument(
+					struct l_dbus_message *message, int n)
+{
+	struct l_dbus_message_iter iter;
+	const char *value;
+	char type;
+	bool (*get_basic)(struct l_dbus_message_iter *, char, void *);
+
+	if (n < 0 || !message_iter_nth_arg(message, n, &iter))
 		return NULL;
 
+	if (_dbus_message_is_gvariant(message))
+		get_basic = _gvariant_iter_next_entry_basic;
+	else
+		get_basic = _dbus1_iter_next_entry_basic;
+
 	type = iter.sig_start[iter.sig_pos];
 	if (!strchr("sog", type))
 		return NULL;
@@ -795,9 +934,14 @@ free:
 	return NULL;
 }
 
+/*
+ * Creates a message that takes over @header and @body.  If @buffer is given
+ * they point into it instead, and the message keeps a reference to it.
+ */
 struct l_dbus_message *dbus_message_build(void *header, size_t header_size,
 						void *body, size_t body_size,
-						int fds[], uint32_t num_fds)
+						int fds[], uint32_t num_fds,
+						struct _dbus_buffer *buffer)
 {
 	const struct dbus_header *hdr = header;
 	struct l_dbus_message *message;
@@ -847,6 +991,9 @@ struct l_dbus_message *dbus_message_build(void *header, size_t header_size,
 		memcpy(message->fds, fds, num_fds * sizeof(int));
 	}
 
+	if (buffer)
+		message->buffer = _dbus_buffer_ref(buffer);
+
 	/* If the field is absent message->signature will remain NULL */
 	get_header_field(message, DBUS_MESSAGE_FIELD_SIGNATURE, 'g',
 						&message->signature);
@@ -889,6 +1036,8 @@ done:
 
 struct builder_driver {
 	bool (*append_basic)(struct dbus_builder *, char, const void *);
+	bool (*append_fixed_array)(struct dbus_builder *, char, const void *,
+					uint32_t);
 	bool (*enter_struct)(struct dbus_builder *, const char *);
 	bool (*leave_struct)(struct dbus_builder *);
 	bool (*enter_dict)(struct dbus_builder *, const char *);
@@ -900,12 +1049,15 @@ struct builder_driver {
 	char *(*finish)(struct dbus_builder *, void **, size_t *);
 	bool (*mark)(struct dbus_builder *);
 	bool (*rewind)(struct dbus_builder *);
+	void (*reserve)(struct dbus_builder *, size_t);
+	size_t (*get_size)(struct dbus_builder *);
 	struct dbus_builder *(*new)(void *, size_t);
 	void (*free)(struct dbus_builder *);
 };
 
 static struct builder_driver dbus1_driver = {
 	.append_basic = _dbus1_builder_append_basic,
+	.append_fixed_array = _dbus1_builder_append_fixed_array,
 	.enter_struct = _dbus1_builder_enter_struct,
 	.leave_struct = _dbus1_builder_leave_struct,
 	.enter_dict = _dbus1_builder_enter_dict,
@@ -917,12 +1069,15 @@ static struct builder_driver dbus1_driver = {
 	.finish = _dbus1_builder_finish,
 	.mark = _dbus1_builder_mark,
 	.rewind = _dbus1_builder_rewind,
+	.reserve = _dbus1_builder_reserve,
+	.get_size = _dbus1_builder_get_size,
 	.new = _dbus1_builder_new,
 	.free = _dbus1_builder_free,
 };
 
 static struct builder_driver gvariant_driver = {
 	.append_basic = _gvariant_builder_append_basic,
+	.append_fixed_array = _gvariant_builder_append_fixed_array,
 	.enter_struct = _gvariant_builder_enter_struct,
 	.leave_struct = _gvariant_builder_leave_struct,
 	.enter_dict = _gvariant_builder_enter_dict,
@@ -934,6 +1089,8 @@ static struct builder_driver gvariant_driver = {
 	.finish = _gvariant_builder_finish,
 	.mark = _gvariant_builder_mark,
 	.rewind = _gvariant_builder_rewind,
+	.reserve = _gvariant_builder_reserve,
+	.get_size = _gvariant_builder_get_size,
 	.new = _gvariant_builder_new,
 	.free = _gvariant_builder_free,
 };
@@ -1064,6 +1221,228 @@ static void build_header(struct l_dbus_message *message, const char *signature)
 	message->header_end = header_size;
 }
 
+static struct l_dbus_message_template *template_new(
+					struct l_dbus_message *message,
+					const char *signature)
+{
+	struct l_dbus_message_template *tmpl;
+
+	tmpl = l_new(struct l_dbus_message_template, 1);
+	tmpl->refcount = 1;
+	tmpl->destination = l_strdup(message->destination);
+	tmpl->path = l_strdup(message->path);
+	tmpl->interface = l_strdup(message->interface);
+	tmpl->member = l_strdup(message->member);
+	tmpl->signature = l_strdup(signature ?: "");
+
+	/* Body length and serial are left as zero, they are patched later */
+	build_header(message, tmpl->signature);
+
+	tmpl->header = message->header;
+	tmpl->header_size = message->header_size;
+	tmpl->header_end = message->header_end;
+	message->header = NULL;
+	l_dbus_message_unref(message);
+
+	return tmpl;
+}
+
+struct l_dbus_message_template *_dbus_message_template_new_method_call(
+							uint8_t version,
+							const char *destination,
+							const char *path,
+							const char *interface,
+							const char *method,
+							const char *signature)
+{
+	struct l_dbus_message *message;
+
+	message = _dbus_message_new_method_call(version, destination, path,
+							interface, method);
+
+	return template_new(message, signature);
+}
+
+struct l_dbus_message_template *_dbus_message_template_new_signal(
+						uint8_t version,
+						const char *path,
+						const char *interface,
+						const char *name,
+						const char *signature)
+{
+	struct l_dbus_message *message;
+
+	message = _dbus_message_new_signal(version, path, interface, name);
+
+	return template_new(message, signature);
+}
+
+/**
+ * l_dbus_message_template_new_method_call:
+ * @dbus: D-Bus connection the messages will be sent on
+ * @destination: bus name of the destination, or NULL
+ * @path: object path
+ * @interface: interface name, or NULL
+ * @method: method name
+ * @signature: signature of the arguments the calls will carry, or NULL
+ *	for none
+ *
+ * Creates a template for method calls that only differ in their arguments.
+ * The message header is built once here, and messages created with
+ * l_dbus_message_new_from_template only get the body length and serial
+ * filled in when they are finalized.
+ *
+ * Returns: a newly allocated template, or NULL on error
+ **/
+LIB_EXPORT struct l_dbus_message_template *
+l_dbus_message_template_new_method_call(struct l_dbus *dbus,
+					const char *destination,
+					const char *path,
+					const char *interface,
+					const char *method,
+					const char *signature)
+{
+	if (unlikely(!dbus || !path || !method))
+		return NULL;
+
+	if (unlikely(signature && !_dbus_valid_signature(signature)))
+		return NULL;
+
+	return _dbus_message_template_new_method_call(_dbus_get_version(dbus),
+							destination, path,
+							interface, method,
+							signature);
+}
+
+/**
+ * l_dbus_message_template_new_signal:
+ * @dbus: D-Bus connection the messages will be sent on
+ * @path: object path
+ * @interface: interface name
+ * @name: signal name
+ * @signature: signature of the arguments the signals will carry, or NULL
+ *	for none
+ *
+ * Creates a template for signals that only differ in their arguments, see
+ * l_dbus_message_template_new_method_call.
+ *
+ * Returns: a newly allocated template, or NULL on error
+ **/
+LIB_EXPORT struct l_dbus_message_template *l_dbus_message_template_new_signal(
+							struct l_dbus *dbus,
+							const char *path,
+							const char *interface,
+							const char *name,
+							const char *signature)
+{
+	if (unlikely(!dbus || !path || !interface || !name))
+		return NULL;
+
+	if (unlikely(signature && !_dbus_valid_signature(signature)))
+		return NULL;
+
+	return _dbus_message_template_new_signal(_dbus_get_version(dbus),
+							path, interface, name,
+							signature);
+}
+
+LIB_EXPORT struct l_dbus_message_template *l_dbus_message_template_ref(
+				struct l_dbus_message_template *tmpl)
+{
+	if (unlikely(!tmpl))
+		return NULL;
+
+	__atomic_fetch_add(&tmpl->refcount, 1, __ATOMIC_SEQ_CST);
+
+	return tmpl;
+}
+
+LIB_EXPORT void l_dbus_message_template_unref(
+				struct l_dbus_message_template *tmpl)
+{
+	if (unlikely(!tmpl))
+		return;
+
+	if (__atomic_sub_fetch(&tmpl->refcount, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	l_free(tmpl->destination);
+	l_free(tmpl->path);
+	l_free(tmpl->interface);
+	l_free(tmpl->member);
+	l_free(tmpl->signature);
+	l_free(tmpl->header);
+	l_free(tmpl);
+}
+
+/**
+ * l_dbus_message_new_from_template:
+ * @tmpl: message template
+ *
+ * Creates a new message with the header of @tmpl.  The arguments are added
+ * the same way as for any other new message, and if their signature is the
+ * one given to the template, the pre-built header is used as is.  With any
+ * other signature, or when file descriptors are attached, the header is
+ * built from scratch instead.
+ *
+ * Returns: a new message, or NULL on error
+ **/
+LIB_EXPORT struct l_dbus_message *l_dbus_message_new_from_template(
+				struct l_dbus_message_template *tmpl)
+{
+	struct l_dbus_message *message;
+
+	if (unlikely(!tmpl))
+		return NULL;
+
+	message = l_new(struct l_dbus_message, 1);
+	message->refcount = 1;
+	message->header = l_memdup(tmpl->header, tmpl->header_size);
+	message->header_size = tmpl->header_size;
+	message->header_end = tmpl->header_end;
+	message->template = l_dbus_message_template_ref(tmpl);
+
+	return message;
+}
+
+/*
+ * Keeps the header copied from the template if nothing that went into it
+ * has changed since.  Otherwise moves the template fields into the message
+ * and leaves it to build_header().
+ */
+static bool stamp_header(struct l_dbus_message *message,
+						const char *signature)
+{
+	struct l_dbus_message_template *tmpl = message->template;
+	struct dbus_header *hdr = message->header;
+	bool gvariant = _dbus_message_is_gvariant(message);
+	bool match;
+
+	message->template = NULL;
+
+	/* GVariant keeps the body signature out of the header */
+	match = !message->num_fds && !message->sender &&
+			!message->destination &&
+			(gvariant || !strcmp(signature, tmpl->signature));
+
+	if (match) {
+		if (!gvariant)
+			hdr->dbus1.body_length = message->body_size;
+	} else {
+		if (!message->destination)
+			message->destination = l_strdup(tmpl->destination);
+
+		message->path = l_strdup(tmpl->path);
+		message->interface = l_strdup(tmpl->interface);
+		message->member = l_strdup(tmpl->member);
+		message->header_size = gvariant ? 16 : 12;
+	}
+
+	l_dbus_message_template_unref(tmpl);
+
+	return match;
+}
+
 struct container {
 	char type;
 	const char *sig_start;
@@ -1164,14 +1543,8 @@ LIB_EXPORT bool l_dbus_message_get_arguments_valist(
 	if (!signature || strcmp(message->signature, signature))
 		return false;
 
-	if (_dbus_message_is_gvariant(message)) {
-		if (!_gvariant_iter_init(&iter, message, message->signature,
-						NULL, message->body,
-						message->body_size))
-			return false;
-	} else
-		_dbus1_iter_init(&iter, message, message->signature, NULL,
-				message->body, message->body_size);
+	if (!message_iter_init(message, &iter))
+		return false;
 
 	return message_iter_next_entry_valist(&iter, args);
 }
@@ -1237,6 +1610,9 @@ LIB_EXPORT const char *l_dbus_message_get_path(struct l_dbus_message *message)
 		get_header_field(message, DBUS_MESSAGE_FIELD_PATH, 'o',
 					&message->path);
 
+	if (!message->path && message->template)
+		return message->template->path;
+
 	return message->path;
 }
 
@@ -1249,6 +1625,9 @@ LIB_EXPORT const char *l_dbus_message_get_interface(struct l_dbus_message *messa
 		get_header_field(message, DBUS_MESSAGE_FIELD_INTERFACE, 's',
 					&message->interface);
 
+	if (!message->interface && message->template)
+		return message->template->interface;
+
 	return message->interface;
 }
 
@@ -1261,6 +1640,9 @@ LIB_EXPORT const char *l_dbus_message_get_member(struct l_dbus_message *message)
 		get_header_field(message, DBUS_MESSAGE_FIELD_MEMBER, 's',
 					&message->member);
 
+	if (!message->member && message->template)
+		return message->template->member;
+
 	return message->member;
 }
 
@@ -1273,6 +1655,9 @@ LIB_EXPORT const char *l_dbus_message_get_destination(struct l_dbus_message *mes
 		get_header_field(message, DBUS_MESSAGE_FIELD_DESTINATION, 's',
 							&message->destination);
 
+	if (!message->destination && message->template)
+		return message->template->destination;
+
 	return message->destination;
 }
 
@@ -1399,6 +1784,34 @@ LIB_EXPORT bool l_dbus_message_iter_get_variant(
 	return result;
 }
 
+/*
+ * Received messages point into the shared receive buffer, where the sender
+ * may have left them at any alignment.  Arrays are handed out as C arrays,
+ * so switch to an aligned private copy of the body if needed.
+ */
+static void message_align_fixed_array(struct l_dbus_message *message,
+								void *out)
+{
+	const void **array = out;
+	size_t offset;
+
+	if (!message->buffer || !((uintptr_t) message->body & 7))
+		return;
+
+	if (*array < message->body ||
+			*array > message->body + message->body_size)
+		return;
+
+	offset = *array - message->body;
+
+	if (!message->body_unshared) {
+		message->body = l_memdup(message->body, message->body_size);
+		message->body_unshared = true;
+	}
+
+	*array = message->body + offset;
+}
+
 LIB_EXPORT bool l_dbus_message_iter_get_fixed_array(
 					struct l_dbus_message_iter *iter,
 					void *out, uint32_t *n_elem)
@@ -1406,21 +1819,140 @@ LIB_EXPORT bool l_dbus_message_iter_get_fixed_array(
 	if (unlikely(!iter))
 		return false;
 
-	if (_dbus_message_is_gvariant(iter->message))
+	if (_dbus_message_is_gvariant(iter->message)) {
+		if (!_gvariant_iter_get_fixed_array(iter, out, n_elem))
+			return false;
+	} else if (!_dbus1_iter_get_fixed_array(iter, out, n_elem))
 		return false;
 
-	return _dbus1_iter_get_fixed_array(iter, out, n_elem);
+	message_align_fixed_array(iter->message, out);
+
+	return true;
 }
 
-void _dbus_message_set_sender(struct l_dbus_message *message,
-					const char *sender)
+struct l_dbus_blob {
+	struct l_dbus_message *message;
+	void *map;
+	const void *data;
+	size_t len;
+};
+
+static struct l_dbus_blob *blob_map_memfd(int fd)
 {
-	if (!_dbus_message_is_gvariant(message))
+	struct l_dbus_blob *blob;
+	struct stat st;
+	void *map = NULL;
+	int seals;
+
+	/* Without these seals the sender could still change or truncate it */
+	seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_WRITE)) !=
+					(F_SEAL_SHRINK | F_SEAL_WRITE))
+		return NULL;
+
+	if (fstat(fd, &st) < 0)
+		return NULL;
+
+	if (st.st_size) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED)
+			return NULL;
+	}
+
+	blob = l_new(struct l_dbus_blob, 1);
+	blob->map = map;
+	blob->data = map;
+	blob->len = st.st_size;
+
+	return blob;
+}
+
+/**
+ * l_dbus_message_iter_get_blob:
+ * @iter: message iterator over the contents of a variant, as returned for
+ *	a 'v' argument by l_dbus_message_get_arguments
+ *
+ * Reads a blob written with l_dbus_message_builder_append_blob.  Inline
+ * blobs point into the message, which is kept alive by the returned
+ * object.  Blobs passed in a memfd are mapped read-only, provided the
+ * sender sealed the memfd against writing and shrinking.
+ *
+ * Returns: a new #l_dbus_blob to be freed with l_dbus_blob_free, or NULL
+ *	if the variant does not hold a valid blob
+ **/
+LIB_EXPORT struct l_dbus_blob *l_dbus_message_iter_get_blob(
+					struct l_dbus_message_iter *iter)
+{
+	struct l_dbus_message_iter array;
+	struct l_dbus_blob *blob;
+	const void *data;
+	uint32_t n;
+	int fd;
+
+	if (unlikely(!iter || !iter->sig_start))
+		return NULL;
+
+	if (iter->sig_len == 1 && iter->sig_start[0] == 'h') {
+		if (!l_dbus_message_iter_next_entry(iter, &fd) || fd < 0)
+			return NULL;
+
+		blob = blob_map_memfd(fd);
+		close(fd);
+
+		return blob;
+	}
+
+	if (iter->sig_len != 2 || memcmp(iter->sig_start, "ay", 2))
+		return NULL;
+
+	if (!l_dbus_message_iter_next_entry(iter, &array) ||
+			!l_dbus_message_iter_get_fixed_array(&array, &data, &n))
+		return NULL;
+
+	blob = l_new(struct l_dbus_blob, 1);
+	blob->message = l_dbus_message_ref(iter->message);
+	blob->data = data;
+	blob->len = n;
+
+	return blob;
+}
+
+LIB_EXPORT const void *l_dbus_blob_get_data(const struct l_dbus_blob *blob,
+								size_t *out_len)
+{
+	if (unlikely(!blob))
+		return NULL;
+
+	if (out_len)
+		*out_len = blob->len;
+
+	return blob->data;
+}
+
+LIB_EXPORT void l_dbus_blob_free(struct l_dbus_blob *blob)
+{
+	if (unlikely(!blob))
 		return;
 
-	l_free(message->sender);
+	if (blob->map)
+		munmap(blob->map, blob->len);
+
+	l_dbus_message_unref(blob->message);
+	l_free(blob);
+}
+
+/*
+ * For messages that did not come from a bus, which would have filled the
+ * sender in.  A sealed message otherwise points into its header.
+ */
+void _dbus_message_set_sender(struct l_dbus_message *message,
+					const char *sender)
+{
+	if (!message->sealed || message->sender_owned)
+		l_free(message->sender);
 
 	message->sender = l_strdup(sender);
+	message->sender_owned = message->sealed;
 }
 
 void _dbus_message_set_destination(struct l_dbus_message *message,
@@ -1480,6 +2012,124 @@ LIB_EXPORT bool l_dbus_message_builder_append_basic(
 	return builder->driver->append_basic(builder->builder, type, value);
 }
 
+/**
+ * l_dbus_message_builder_append_fixed_array:
+ * @builder: message builder
+ * @type: element type, one of the fixed size basic types except 'h'
+ * @data: pointer to @n elements of @type, in the same layout as the values
+ *	taken by l_dbus_message_builder_append_basic
+ * @n: number of elements
+ *
+ * Appends @n elements to the array that was last entered with
+ * l_dbus_message_builder_enter_array, which must have @type as its element
+ * signature.  This is equivalent to calling
+ * l_dbus_message_builder_append_basic once for each element, but the data
+ * is copied in a single step.  It can be called more than once for the
+ * same array.
+ *
+ * Returns: true on success, false if @type does not match the array
+ **/
+LIB_EXPORT bool l_dbus_message_builder_append_fixed_array(
+					struct l_dbus_message_builder *builder,
+					char type, const void *data, uint32_t n)
+{
+	if (unlikely(!builder))
+		return false;
+
+	if (unlikely(!data && n))
+		return false;
+
+	return builder->driver->append_fixed_array(builder->builder, type,
+								data, n);
+}
+
+static int blob_memfd_new(const void *data, size_t len)
+{
+	void *addr;
+	int fd;
+
+	fd = memfd_create("ell-dbus-blob", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return -1;
+
+	if (ftruncate(fd, len) < 0)
+		goto error;
+
+	addr = mmap(NULL, len, PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED)
+		goto error;
+
+	memcpy(addr, data, len);
+	munmap(addr, len);
+
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+					F_SEAL_WRITE | F_SEAL_SEAL) < 0)
+		goto error;
+
+	return fd;
+
+error:
+	close(fd);
+	return -1;
+}
+
+/**
+ * l_dbus_message_builder_append_blob:
+ * @builder: message builder
+ * @data: bytes to append
+ * @len: number of bytes
+ *
+ * Appends @data as a variant, which must be allowed by the signature at
+ * this point.  Small blobs are sent inline as an 'ay'.  Blobs of 64 KiB
+ * and above are copied into a sealed memfd that is passed as an 'h', so
+ * the bytes do not travel through the bus daemon.  The receiver reads
+ * either form with l_dbus_message_iter_get_blob.
+ *
+ * Returns: true on success
+ **/
+LIB_EXPORT bool l_dbus_message_builder_append_blob(
+					struct l_dbus_message_builder *builder,
+					const void *data, size_t len)
+{
+	struct l_dbus_message *message;
+	int fd = -1;
+
+	if (unlikely(!builder))
+		return false;
+
+	if (unlikely(!data && len))
+		return false;
+
+	message = builder->message;
+
+	if (len >= DBUS_BLOB_MEMFD_THRESHOLD &&
+			message->num_fds < L_ARRAY_SIZE(message->fds))
+		fd = blob_memfd_new(data, len);
+
+	if (fd < 0) {
+		if (len > UINT32_MAX)
+			return false;
+
+		return l_dbus_message_builder_enter_variant(builder, "ay") &&
+			l_dbus_message_builder_enter_array(builder, "y") &&
+			l_dbus_message_builder_append_fixed_array(builder, 'y',
+								data, len) &&
+			l_dbus_message_builder_leave_array(builder) &&
+			l_dbus_message_builder_leave_variant(builder);
+	}
+
+	if (!l_dbus_message_builder_enter_variant(builder, "h") ||
+			!builder->driver->append_basic(builder->builder, 'h',
+							&message->num_fds)) {
+		close(fd);
+		return false;
+	}
+
+	message->fds[message->num_fds++] = fd;
+
+	return l_dbus_message_builder_leave_variant(builder);
+}
+
 LIB_EXPORT bool l_dbus_message_builder_enter_container(
 					struct l_dbus_message_builder *builder,
 					char container_type,
@@ -1949,7 +2599,10 @@ LIB_EXPORT struct l_dbus_message *l_dbus_message_builder_finalize(
 						&builder->message->body,
 						&builder->message->body_size);
 
-	build_header(builder->message, generated_signature);
+	if (!builder->message->template ||
+			!stamp_header(builder->message, generated_signature))
+		build_header(builder->message, generated_signature);
+
 	builder->message->sealed = true;
 	builder->message->signature = generated_signature;
 	builder->message->signature_free = true;
@@ -1972,3 +2625,21 @@ bool _dbus_message_builder_rewind(struct l_dbus_message_builder *builder)
 
 	return builder->driver->rewind(builder->builder);
 }
+
+/* Makes room for @len more bytes of body so it is not grown piecemeal */
+void _dbus_message_builder_reserve(struct l_dbus_message_builder *builder,
+					size_t len)
+{
+	if (unlikely(!builder))
+		return;
+
+	builder->driver->reserve(builder->builder, len);
+}
+
+size_t _dbus_message_builder_get_size(struct l_dbus_message_builder *builder)
+{
+	if (unlikely(!builder))
+		return 0;
+
+	return builder->driver->get_size(builder->builder);
+}
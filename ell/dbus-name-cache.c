@@ -19,12 +19,23 @@
 #include "dbus.h"
 #include "dbus-private.h"
 
+/*
+ * Once the ListNames reply is in, bus_names holds every name present on
+ * the bus and is kept current from NameOwnerChanged.  A name missing from
+ * it is known to have no owner and unique names are their own owner, so
+ * only the owners of well-known names ever need a GetNameOwner call.
+ */
+static char bus_name_owner_unknown[] = "";
+
 struct _dbus_name_cache {
 	struct l_dbus *bus;
 	struct l_hashmap *names;
 	const struct _dbus_name_ops *driver;
 	unsigned int last_watch_id;
 	struct l_idle *watch_remove_work;
+	struct l_hashmap *bus_names;
+	bool list_requested;
+	struct l_dbus_name_cache_stats stats;
 };
 
 struct service_watch {
@@ -82,6 +93,36 @@ static void name_cache_entry_destroy(void *data)
 	l_free(entry);
 }
 
+static void bus_name_owner_free(void *data)
+{
+	if (data != bus_name_owner_unknown)
+		l_free(data);
+}
+
+static void bus_name_set_owner(struct _dbus_name_cache *cache,
+				const char *name, const char *owner)
+{
+	char *value;
+	void *old_value;
+
+	if (!cache->bus_names)
+		return;
+
+	if (!owner || *owner == '\0') {
+		bus_name_owner_free(l_hashmap_remove(cache->bus_names, name));
+		return;
+	}
+
+	value = l_strdup(owner);
+
+	if (!l_hashmap_replace(cache->bus_names, name, value, &old_value)) {
+		l_free(value);
+		return;
+	}
+
+	bus_name_owner_free(old_value);
+}
+
 void _dbus_name_cache_free(struct _dbus_name_cache *cache)
 {
 	if (!cache)
@@ -91,10 +132,45 @@ void _dbus_name_cache_free(struct _dbus_name_cache *cache)
 		l_idle_remove(cache->watch_remove_work);
 
 	l_hashmap_destroy(cache->names, name_cache_entry_destroy);
+	l_hashmap_destroy(cache->bus_names, bus_name_owner_free);
 
 	l_free(cache);
 }
 
+static void name_cache_resolve(struct _dbus_name_cache *cache,
+				const char *name,
+				struct name_cache_entry *entry)
+{
+	const char *owner;
+
+	cache->stats.lookups += 1;
+
+	/* Ask for the full list once, replies to it then answer locally */
+	if (!cache->list_requested && cache->driver->list_names) {
+		cache->list_requested = true;
+		cache->driver->list_names(cache->bus);
+	}
+
+	if (cache->bus_names) {
+		owner = l_hashmap_lookup(cache->bus_names, name);
+
+		if (!owner) {
+			cache->stats.hits += 1;
+			cache->stats.negative_hits += 1;
+			return;
+		}
+
+		if (owner != bus_name_owner_unknown) {
+			cache->stats.hits += 1;
+			entry->unique_name = l_strdup(owner);
+			return;
+		}
+	}
+
+	if (cache->driver->get_name_owner(cache->bus, name))
+		cache->stats.requests += 1;
+}
+
 bool _dbus_name_cache_add(struct _dbus_name_cache *cache, const char *name)
 {
 	struct name_cache_entry *entry;
@@ -112,7 +188,7 @@ bool _dbus_name_cache_add(struct _dbus_name_cache *cache, const char *name)
 
 		l_hashmap_insert(cache->names, name, entry);
 
-		cache->driver->get_name_owner(cache->bus, name);
+		name_cache_resolve(cache, name, entry);
 	}
 
 	entry->ref_count++;
@@ -162,6 +238,8 @@ void _dbus_name_cache_notify(struct _dbus_name_cache *cache,
 	if (!cache)
 		return;
 
+	bus_name_set_owner(cache, name, owner);
+
 	entry = l_hashmap_lookup(cache->names, name);
 
 	if (!entry)
@@ -188,6 +266,48 @@ void _dbus_name_cache_notify(struct _dbus_name_cache *cache,
 			watch->disconnect_func(cache->bus, watch->user_data);
 }
 
+/*
+ * Takes the ListNames reply.  Whatever NameOwnerChanged reported before
+ * this point is already reflected in @names.
+ */
+void _dbus_name_cache_set_bus_names(struct _dbus_name_cache *cache,
+					char **names)
+{
+	const struct name_cache_entry *entry;
+	const char *owner;
+
+	if (!cache)
+		return;
+
+	l_hashmap_destroy(cache->bus_names, bus_name_owner_free);
+	cache->bus_names = l_hashmap_string_new();
+
+	for (; *names; names++) {
+		entry = l_hashmap_lookup(cache->names, *names);
+
+		if (_dbus_parse_unique_name(*names, NULL))
+			owner = l_strdup(*names);
+		else if (entry && entry->unique_name)
+			owner = l_strdup(entry->unique_name);
+		else
+			owner = bus_name_owner_unknown;
+
+		if (!l_hashmap_insert(cache->bus_names, *names, (void *) owner))
+			bus_name_owner_free((char *) owner);
+	}
+}
+
+bool _dbus_name_cache_get_stats(struct _dbus_name_cache *cache,
+				struct l_dbus_name_cache_stats *stats)
+{
+	if (!cache)
+		return false;
+
+	*stats = cache->stats;
+
+	return true;
+}
+
 unsigned int _dbus_name_cache_add_watch(struct _dbus_name_cache *cache,
 					const char *name,
 					l_dbus_watch_func_t connect_func,
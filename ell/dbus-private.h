@@ -45,6 +45,16 @@ struct dbus_header {
 } __attribute__ ((packed));
 #define DBUS_HEADER_SIZE 16
 
+/*
+ * Refcounted block of received data.  Messages parsed out of it point
+ * straight into the block and hold a reference for as long as they live.
+ */
+struct _dbus_buffer {
+	int refcount;
+	size_t size;
+	uint8_t data[];
+};
+
 struct dbus_builder;
 struct l_string;
 struct l_dbus_interface;
@@ -78,6 +88,9 @@ struct dbus_builder *_dbus1_builder_new(void *body, size_t body_size);
 void _dbus1_builder_free(struct dbus_builder *builder);
 bool _dbus1_builder_append_basic(struct dbus_builder *builder,
 					char type, const void *value);
+bool _dbus1_builder_append_fixed_array(struct dbus_builder *builder,
+					char type, const void *data,
+					uint32_t n);
 bool _dbus1_builder_enter_struct(struct dbus_builder *builder,
 					const char *signature);
 bool _dbus1_builder_leave_struct(struct dbus_builder *builder);
@@ -94,6 +107,8 @@ char *_dbus1_builder_finish(struct dbus_builder *builder,
 				void **body, size_t *body_size);
 bool _dbus1_builder_mark(struct dbus_builder *builder);
 bool _dbus1_builder_rewind(struct dbus_builder *builder);
+void _dbus1_builder_reserve(struct dbus_builder *builder, size_t len);
+size_t _dbus1_builder_get_size(struct dbus_builder *builder);
 
 void *_dbus_message_get_body(struct l_dbus_message *msg, size_t *out_size);
 void *_dbus_message_get_header(struct l_dbus_message *msg, size_t *out_size);
@@ -124,6 +139,19 @@ struct l_dbus_message *_dbus_message_new_signal(uint8_t version,
 						const char *path,
 						const char *interface,
 						const char *name);
+struct l_dbus_message_template *_dbus_message_template_new_method_call(
+							uint8_t version,
+							const char *destination,
+							const char *path,
+							const char *interface,
+							const char *method,
+							const char *signature);
+struct l_dbus_message_template *_dbus_message_template_new_signal(
+						uint8_t version,
+						const char *path,
+						const char *interface,
+						const char *name,
+						const char *signature);
 struct l_dbus_message *_dbus_message_new_error(uint8_t version,
 						uint32_t reply_serial,
 						const char *destination,
@@ -134,12 +162,20 @@ struct l_dbus_message *dbus_message_from_blob(const void *data, size_t size,
 						int fds[], uint32_t num_fds);
 struct l_dbus_message *dbus_message_build(void *header, size_t header_size,
 						void *body, size_t body_size,
-						int fds[], uint32_t num_fds);
+						int fds[], uint32_t num_fds,
+						struct _dbus_buffer *buffer);
+
+struct _dbus_buffer *_dbus_buffer_new(size_t size);
+struct _dbus_buffer *_dbus_buffer_ref(struct _dbus_buffer *buffer);
+void _dbus_buffer_unref(struct _dbus_buffer *buffer);
 bool dbus_message_compare(struct l_dbus_message *message,
 					const void *data, size_t size);
 
 bool _dbus_message_builder_mark(struct l_dbus_message_builder *builder);
 bool _dbus_message_builder_rewind(struct l_dbus_message_builder *builder);
+void _dbus_message_builder_reserve(struct l_dbus_message_builder *builder,
+					size_t len);
+size_t _dbus_message_builder_get_size(struct l_dbus_message_builder *builder);
 
 unsigned int _dbus_message_unix_fds_from_header(const void *data, size_t size);
 
@@ -148,6 +184,14 @@ const char *_dbus_signature_end(const char *signature);
 bool _dbus_valid_object_path(const char *path);
 bool _dbus_valid_signature(const char *sig);
 int _dbus_num_children(const char *sig);
+
+struct _dbus_signature_info {
+	int16_t num_children;	/* -1 if the signature is not valid */
+	uint8_t alignment;	/* GVariant only */
+};
+
+struct _dbus_signature_info *_dbus_signature_cache_get(const char *sig,
+								bool gvariant);
 bool _dbus_valid_interface(const char *interface);
 bool _dbus_valid_method(const char *method);
 bool _dbus_parse_unique_name(const char *name, uint64_t *out_id);
@@ -222,6 +266,8 @@ struct l_dbus_message *_dbus_object_tree_get_objects(
 					struct l_dbus *dbus,
 					const char *path,
 					struct l_dbus_message *message);
+bool _dbus_object_tree_set_max_reply_size(struct _dbus_object_tree *tree,
+						const char *path, size_t size);
 
 bool _dbus_object_tree_property_changed(struct l_dbus *dbus,
 					const char *path,
@@ -241,6 +287,7 @@ struct _dbus_object_tree *_dbus_get_tree(struct l_dbus *dbus);
 
 struct _dbus_name_ops {
 	bool (*get_name_owner)(struct l_dbus *bus, const char *name);
+	bool (*list_names)(struct l_dbus *bus);
 };
 
 struct _dbus_name_cache;
@@ -254,6 +301,11 @@ bool _dbus_name_cache_remove(struct _dbus_name_cache *cache, const char *name);
 const char *_dbus_name_cache_lookup(struct _dbus_name_cache *cache,
 					const char *name);
 
+void _dbus_name_cache_set_bus_names(struct _dbus_name_cache *cache,
+					char **names);
+bool _dbus_name_cache_get_stats(struct _dbus_name_cache *cache,
+				struct l_dbus_name_cache_stats *stats);
+
 void _dbus_name_cache_notify(struct _dbus_name_cache *cache,
 				const char *name, const char *owner);
 
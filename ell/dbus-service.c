@@ -16,6 +16,7 @@
 
 #include "useful.h"
 #include "queue.h"
+#include "vector.h"
 #include "string.h"
 #include "hashmap.h"
 #include "dbus.h"
@@ -23,6 +24,10 @@
 #include "dbus-private.h"
 #include "private.h"
 #include "idle.h"
+#include "timeout.h"
+#include "time.h"
+#include "log.h"
+#include "log-private.h"
 
 #define XML_ID "-//freedesktop//DTD D-BUS Object Introspection 1.0//EN"
 #define XML_DTD "http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd"
@@ -51,36 +56,60 @@ struct _dbus_property {
 	l_dbus_property_get_cb_t getter;
 	l_dbus_property_set_cb_t setter;
 	uint32_t flags;
+	unsigned int index;
 	unsigned char name_len;
 	char metainfo[];
 };
 
 struct l_dbus_interface {
-	struct l_queue *methods;
-	struct l_queue *signals;
-	struct l_queue *properties;
+	struct l_vector *methods;
+	struct l_vector *signals;
+	struct l_vector *properties;
+	struct l_hashmap *method_index;
+	struct l_hashmap *signal_index;
+	struct l_hashmap *property_index;
 	bool handle_old_style_properties;
+	unsigned int coalesce_interval;
 	void (*instance_destroy)(void *);
+	char *xml;		/* Introspection, rendered on first use */
 	char name[];
 };
 
 struct child_node {
 	struct object_node *node;
 	struct child_node *next;
+	struct child_node *prev;
 	char subpath[];
 };
 
+/* Nodes with at least this many children also index them by name */
+#define CHILD_INDEX_MIN	8
+
+/*
+ * Values of the L_DBUS_PROPERTY_FLAG_CACHED properties, indexed by
+ * property, each kept as the body of a message of its own.
+ */
 struct interface_instance {
 	struct l_dbus_interface *interface;
 	void *user_data;
+	uint64_t last_changed;
+	struct l_dbus_message **cache;
+	unsigned int n_cache;
 };
 
 struct object_node {
 	struct object_node *parent;
+	struct child_node *link;
 	struct l_queue *instances;
 	struct child_node *children;
+	unsigned int n_children;
+	struct l_hashmap *child_index;
+	char *children_xml;		/* <node/> elements, rendered on use */
 	void *user_data;
 	void (*destroy) (void *);
+	/* Method last called on this object, checked before any lookups */
+	struct interface_instance *last_instance;
+	struct _dbus_method *last_method;
 };
 
 struct object_manager {
@@ -88,6 +117,27 @@ struct object_manager {
 	struct l_dbus *dbus;
 	struct l_queue *announce_added;
 	struct l_queue *announce_removed;
+	size_t max_reply_size;
+	size_t reply_size_hint;
+};
+
+/*
+ * GetManagedObjects replies are built this many objects at a time, going
+ * back to the main loop in between, so that a large tree does not stall
+ * everything else while its properties are collected.
+ */
+#define MANAGED_OBJECTS_BATCH	64
+
+struct managed_objects_walk {
+	struct _dbus_object_tree *tree;
+	struct l_dbus *dbus;
+	struct l_dbus_message *message;
+	struct l_dbus_message *reply;
+	struct l_dbus_message_builder *builder;
+	char *manager_path;
+	size_t max_reply_size;
+	struct l_queue *paths;
+	struct l_idle *idle;
 };
 
 struct interface_add_record {
@@ -102,11 +152,18 @@ struct interface_remove_record {
 	struct l_queue *interface_names;
 };
 
+/*
+ * Held back property changes that are due within this many microseconds
+ * are sent right away rather than arming the timer for almost nothing.
+ */
+#define COALESCE_SLACK	1000
+
 struct property_change_record {
 	char *path;
 	struct object_node *object;
 	struct interface_instance *instance;
 	struct l_queue *properties;
+	uint64_t due;
 };
 
 struct _dbus_object_tree {
@@ -116,6 +173,8 @@ struct _dbus_object_tree {
 	struct l_queue *object_managers;
 	struct l_queue *property_changes;
 	struct l_idle *emit_signals_work;
+	struct l_timeout *coalesce_work;
+	struct l_queue *object_walks;
 	bool flushing;
 };
 
@@ -234,16 +293,41 @@ void _dbus_interface_introspection(struct l_dbus_interface *interface,
 	l_string_append_printf(buf, "\t<interface name=\"%s\">\n",
 				interface->name);
 
-	l_queue_foreach(interface->methods,
-		(l_queue_foreach_func_t) _dbus_method_introspection, buf);
-	l_queue_foreach(interface->signals,
-		(l_queue_foreach_func_t) _dbus_signal_introspection, buf);
-	l_queue_foreach(interface->properties,
-		(l_queue_foreach_func_t) _dbus_property_introspection, buf);
+	l_vector_foreach(interface->methods,
+		(l_vector_foreach_func_t) _dbus_method_introspection, buf);
+	l_vector_foreach(interface->signals,
+		(l_vector_foreach_func_t) _dbus_signal_introspection, buf);
+	l_vector_foreach(interface->properties,
+		(l_vector_foreach_func_t) _dbus_property_introspection, buf);
 
 	l_string_append(buf, "\t</interface>\n");
 }
 
+/*
+ * Interfaces and the children of a node rarely change while introspection
+ * requests can come in floods from tools or reconnecting clients, so the
+ * XML of each is kept until they do.
+ */
+static const char *interface_get_xml(struct l_dbus_interface *interface)
+{
+	struct l_string *buf;
+
+	if (interface->xml)
+		return interface->xml;
+
+	buf = l_string_new(0);
+	_dbus_interface_introspection(interface, buf);
+	interface->xml = l_string_unwrap(buf);
+
+	return interface->xml;
+}
+
+static void interface_xml_invalidate(struct l_dbus_interface *interface)
+{
+	l_free(interface->xml);
+	interface->xml = NULL;
+}
+
 #define COPY_PARAMS(dest, signature, args)	\
 	do {	\
 		const char *pname;	\
@@ -273,6 +357,53 @@ void _dbus_interface_introspection(struct l_dbus_interface *interface,
 		len;	\
 	})
 
+static struct l_hashmap *member_index_new(void)
+{
+	struct l_hashmap *index = l_hashmap_new();
+
+	/* Keys point into the metainfo of the indexed entries */
+	l_hashmap_set_hash_function(index, l_str_hash_fast);
+	l_hashmap_set_compare_function(index,
+					(l_hashmap_compare_func_t) strcmp);
+
+	return index;
+}
+
+static void index_member(struct l_hashmap *index, const char *name,
+								void *info)
+{
+	/* The first one added wins if a name is used twice */
+	if (!l_hashmap_lookup(index, name))
+		l_hashmap_insert(index, name, info);
+}
+
+/**
+ * l_dbus_interface_set_coalesce_interval:
+ * @interface: interface being set up
+ * @interval_ms: minimum time between PropertiesChanged signals, in
+ *	milliseconds, or 0 to emit them as soon as possible
+ *
+ * Limits how often PropertiesChanged is emitted for any one object
+ * implementing @interface.  A change that comes in sooner than
+ * @interval_ms after the last signal is held back until the interval has
+ * passed, and all properties changed in the meantime are sent together,
+ * each with its value at that point.  This is meant for properties that
+ * change rapidly, such as signal strength or counters.
+ *
+ * Returns: true on success, false if @interface is NULL
+ **/
+LIB_EXPORT bool l_dbus_interface_set_coalesce_interval(
+					struct l_dbus_interface *interface,
+					unsigned int interval_ms)
+{
+	if (unlikely(!interface))
+		return false;
+
+	interface->coalesce_interval = interval_ms;
+
+	return true;
+}
+
 LIB_EXPORT bool l_dbus_interface_method(struct l_dbus_interface *interface,
 					const char *name, uint32_t flags,
 					l_dbus_interface_method_cb_t cb,
@@ -329,7 +460,9 @@ LIB_EXPORT bool l_dbus_interface_method(struct l_dbus_interface *interface,
 
 	va_end(args);
 
-	l_queue_push_tail(interface->methods, info);
+	l_vector_push_tail(interface->methods, info);
+	index_member(interface->method_index, info->metainfo, info);
+	interface_xml_invalidate(interface);
 
 	return true;
 }
@@ -372,7 +505,9 @@ LIB_EXPORT bool l_dbus_interface_signal(struct l_dbus_interface *interface,
 	COPY_PARAMS(p, signature, args);
 	va_end(args);
 
-	l_queue_push_tail(interface->signals, info);
+	l_vector_push_tail(interface->signals, info);
+	index_member(interface->signal_index, info->metainfo, info);
+	interface_xml_invalidate(interface);
 
 	return true;
 }
@@ -402,6 +537,7 @@ LIB_EXPORT bool l_dbus_interface_property(struct l_dbus_interface *interface,
 
 	info = l_malloc(sizeof(*info) + metainfo_len);
 	info->flags = flags;
+	info->index = l_vector_length(interface->properties);
 	info->name_len = strlen(name);
 	info->getter = getter;
 	info->setter = setter;
@@ -409,7 +545,9 @@ LIB_EXPORT bool l_dbus_interface_property(struct l_dbus_interface *interface,
 	p = stpcpy(info->metainfo, name) + 1;
 	strcpy(p, signature);
 
-	l_queue_push_tail(interface->properties, info);
+	l_vector_push_tail(interface->properties, info);
+	index_member(interface->property_index, info->metainfo, info);
+	interface_xml_invalidate(interface);
 
 	return true;
 }
@@ -420,9 +558,14 @@ struct l_dbus_interface *_dbus_interface_new(const char *name)
 
 	interface = l_malloc(sizeof(*interface) + strlen(name) + 1);
 
-	interface->methods = l_queue_new();
-	interface->signals = l_queue_new();
-	interface->properties = l_queue_new();
+	interface->methods = l_vector_new(0);
+	interface->signals = l_vector_new(0);
+	interface->properties = l_vector_new(0);
+	interface->method_index = member_index_new();
+	interface->signal_index = member_index_new();
+	interface->property_index = member_index_new();
+	interface->coalesce_interval = 0;
+	interface->xml = NULL;
 
 	strcpy(interface->name, name);
 
@@ -431,70 +574,121 @@ struct l_dbus_interface *_dbus_interface_new(const char *name)
 
 void _dbus_interface_free(struct l_dbus_interface *interface)
 {
-	l_queue_destroy(interface->methods, l_free);
-	l_queue_destroy(interface->signals, l_free);
-	l_queue_destroy(interface->properties, l_free);
+	l_hashmap_destroy(interface->method_index, NULL);
+	l_hashmap_destroy(interface->signal_index, NULL);
+	l_hashmap_destroy(interface->property_index, NULL);
+	l_vector_destroy(interface->methods, l_free);
+	l_vector_destroy(interface->signals, l_free);
+	l_vector_destroy(interface->properties, l_free);
+	l_free(interface->xml);
 
 	l_free(interface);
 }
 
-static bool match_method(const void *a, const void *b)
+struct _dbus_method *_dbus_interface_find_method(struct l_dbus_interface *i,
+							const char *method)
 {
-	const struct _dbus_method *method = a;
-	const char *name = b;
-
-	if (!strcmp(method->metainfo, name))
-		return true;
+	return l_hashmap_lookup(i->method_index, method);
+}
 
-	return false;
+struct _dbus_signal *_dbus_interface_find_signal(struct l_dbus_interface *i,
+							const char *signal)
+{
+	return l_hashmap_lookup(i->signal_index, signal);
 }
 
-struct _dbus_method *_dbus_interface_find_method(struct l_dbus_interface *i,
-							const char *method)
+struct _dbus_property *_dbus_interface_find_property(struct l_dbus_interface *i,
+							const char *property)
 {
-	return l_queue_find(i->methods, match_method, (char *) method);
+	return l_hashmap_lookup(i->property_index, property);
 }
 
-static bool match_signal(const void *a, const void *b)
+static void interface_instance_free(struct interface_instance *instance)
 {
-	const struct _dbus_signal *signal = a;
-	const char *name = b;
+	unsigned int i;
 
-	if (!strcmp(signal->metainfo, name))
-		return true;
+	if (instance->interface->instance_destroy)
+		instance->interface->instance_destroy(instance->user_data);
 
-	return false;
+	for (i = 0; i < instance->n_cache; i++)
+		l_dbus_message_unref(instance->cache[i]);
+
+	l_free(instance->cache);
+	l_free(instance);
 }
 
-struct _dbus_signal *_dbus_interface_find_signal(struct l_dbus_interface *i,
-							const char *signal)
+static void property_cache_drop(const struct interface_instance *instance,
+				const struct _dbus_property *property)
 {
-	return l_queue_find(i->signals, match_signal, (char *) signal);
+	if (property->index >= instance->n_cache)
+		return;
+
+	l_dbus_message_unref(instance->cache[property->index]);
+	instance->cache[property->index] = NULL;
 }
 
-static bool match_property(const void *a, const void *b)
+static struct l_dbus_message *property_cache_fill(struct l_dbus *dbus,
+					struct l_dbus_message *message,
+					const struct _dbus_property *property,
+					void *user_data)
 {
-	const struct _dbus_property *property = a;
-	const char *name = b;
+	const char *signature = property->metainfo +
+					strlen(property->metainfo) + 1;
+	struct l_dbus_message *value;
+	struct l_dbus_message_builder *builder;
 
-	if (!strcmp(property->metainfo, name))
-		return true;
+	value = _dbus_message_new_signal(_dbus_get_version(dbus), "/",
+						L_DBUS_INTERFACE_PROPERTIES,
+						"PropertiesChanged");
+	builder = l_dbus_message_builder_new(value);
+	l_dbus_message_builder_enter_variant(builder, signature);
 
-	return false;
-}
+	if (!property->getter(dbus, message, builder, user_data)) {
+		l_dbus_message_builder_destroy(builder);
+		l_dbus_message_unref(value);
+		return NULL;
+	}
 
-struct _dbus_property *_dbus_interface_find_property(struct l_dbus_interface *i,
-							const char *property)
-{
-	return l_queue_find(i->properties, match_property, (char *) property);
+	l_dbus_message_builder_leave_variant(builder);
+	l_dbus_message_builder_finalize(builder);
+	l_dbus_message_builder_destroy(builder);
+
+	return value;
 }
 
-static void interface_instance_free(struct interface_instance *instance)
+/*
+ * Appends the value of @property inside the variant @builder has just
+ * entered.  Cached properties are only asked for their value once until
+ * l_dbus_property_changed() is called for them, the value is copied from
+ * the cache otherwise.  @instance is NULL for old style properties.
+ */
+static bool property_get_value(struct l_dbus *dbus,
+				struct l_dbus_message *message,
+				struct l_dbus_message_builder *builder,
+				const struct interface_instance *instance,
+				const struct _dbus_property *property,
+				void *user_data)
 {
-	if (instance->interface->instance_destroy)
-		instance->interface->instance_destroy(instance->user_data);
+	struct l_dbus_message **cached;
+	struct l_dbus_message_iter iter;
 
-	l_free(instance);
+	if (!instance || property->index >= instance->n_cache ||
+			!(property->flags & L_DBUS_PROPERTY_FLAG_CACHED))
+		return property->getter(dbus, message, builder, user_data);
+
+	cached = &instance->cache[property->index];
+
+	if (!*cached) {
+		*cached = property_cache_fill(dbus, message, property,
+						user_data);
+		if (!*cached)
+			return false;
+	}
+
+	if (!l_dbus_message_get_arguments(*cached, "v", &iter))
+		return false;
+
+	return l_dbus_message_builder_append_from_iter(builder, &iter);
 }
 
 static bool match_interface_instance(const void *a, const void *b)
@@ -544,6 +738,8 @@ static void property_change_record_free(void *data)
 
 static void properties_setup_func(struct l_dbus_interface *);
 static void object_manager_setup_func(struct l_dbus_interface *);
+static void debug_setup_func(struct l_dbus_interface *);
+static void managed_objects_walk_free(void *data);
 
 struct _dbus_object_tree *_dbus_object_tree_new()
 {
@@ -567,12 +763,16 @@ struct _dbus_object_tree *_dbus_object_tree_new()
 						false);
 
 	tree->object_managers = l_queue_new();
+	tree->object_walks = l_queue_new();
 
 	_dbus_object_tree_register_interface(tree,
 						L_DBUS_INTERFACE_OBJECT_MANAGER,
 						object_manager_setup_func, NULL,
 						false);
 
+	_dbus_object_tree_register_interface(tree, L_DBUS_INTERFACE_DEBUG,
+						debug_setup_func, NULL, false);
+
 	return tree;
 }
 
@@ -588,6 +788,9 @@ static void subtree_free(struct object_node *node)
 		l_free(child);
 	}
 
+	l_hashmap_destroy(node->child_index, NULL);
+	l_free(node->children_xml);
+
 	l_queue_destroy(node->instances,
 			(l_queue_destroy_func_t) interface_instance_free);
 
@@ -616,6 +819,7 @@ void _dbus_object_tree_free(struct _dbus_object_tree *tree)
 			(l_hashmap_destroy_func_t) _dbus_interface_free);
 	l_hashmap_destroy(tree->objects, NULL);
 
+	l_queue_destroy(tree->object_walks, managed_objects_walk_free);
 	l_queue_destroy(tree->object_managers, object_manager_free);
 
 	l_queue_destroy(tree->property_changes, property_change_record_free);
@@ -623,9 +827,121 @@ void _dbus_object_tree_free(struct _dbus_object_tree *tree)
 	if (tree->emit_signals_work)
 		l_idle_remove(tree->emit_signals_work);
 
+	l_timeout_remove(tree->coalesce_work);
+
 	l_free(tree);
 }
 
+/*
+ * Child names are matched against path segments in place, which end at
+ * either the next '/' or the end of the path.
+ */
+static unsigned int segment_hash(const void *p)
+{
+	const unsigned char *s = p;
+	unsigned int hash = 2166136261u;
+
+	for (; *s && *s != '/'; s++)
+		hash = (hash ^ *s) * 16777619u;
+
+	return hash;
+}
+
+static int segment_compare(const void *a, const void *b)
+{
+	const char *s1 = a;
+	const char *s2 = b;
+
+	while (*s1 == *s2 && *s1 && *s1 != '/') {
+		s1++;
+		s2++;
+	}
+
+	if ((!*s1 || *s1 == '/') && (!*s2 || *s2 == '/'))
+		return 0;
+
+	return (unsigned char) *s1 - (unsigned char) *s2;
+}
+
+static void child_index_build(struct object_node *node)
+{
+	struct child_node *child;
+
+	node->child_index = l_hashmap_new_sized(node->n_children * 2);
+	l_hashmap_set_hash_function(node->child_index, segment_hash);
+	l_hashmap_set_compare_function(node->child_index, segment_compare);
+
+	for (child = node->children; child; child = child->next)
+		l_hashmap_insert(node->child_index, child->subpath, child);
+}
+
+static struct child_node *find_child(struct object_node *node,
+					const char *segment, const char *end)
+{
+	struct child_node *child;
+
+	if (node->child_index)
+		return l_hashmap_lookup(node->child_index, segment);
+
+	for (child = node->children; child; child = child->next)
+		if (!strncmp(child->subpath, segment, end - segment) &&
+				child->subpath[end - segment] == '\0')
+			return child;
+
+	return NULL;
+}
+
+static struct child_node *add_child(struct object_node *node,
+					const char *segment, const char *end)
+{
+	struct child_node *child;
+
+	child = l_malloc(sizeof(*child) + end - segment + 1);
+	child->node = l_new(struct object_node, 1);
+	child->node->parent = node;
+	child->node->link = child;
+	memcpy(child->subpath, segment, end - segment);
+	child->subpath[end - segment] = '\0';
+
+	child->prev = NULL;
+	child->next = node->children;
+
+	if (node->children)
+		node->children->prev = child;
+
+	node->children = child;
+	node->n_children += 1;
+
+	l_free(node->children_xml);
+	node->children_xml = NULL;
+
+	if (node->child_index)
+		l_hashmap_insert(node->child_index, child->subpath, child);
+	else if (node->n_children >= CHILD_INDEX_MIN)
+		child_index_build(node);
+
+	return child;
+}
+
+static void remove_child(struct object_node *node, struct child_node *child)
+{
+	if (child->prev)
+		child->prev->next = child->next;
+	else
+		node->children = child->next;
+
+	if (child->next)
+		child->next->prev = child->prev;
+
+	node->n_children -= 1;
+
+	if (node->child_index)
+		l_hashmap_remove(node->child_index, child->subpath);
+
+	l_free(node->children_xml);
+	node->children_xml = NULL;
+}
+
 static struct object_node *makepath_recurse(struct object_node *node,
 						const char *path)
 {
@@ -637,25 +953,11 @@ static struct object_node *makepath_recurse(struct object_node *node,
 
 	path += 1;
 	end = strchrnul(path, '/');
-	child = node->children;
 
-	while (child) {
-		if (!strncmp(child->subpath, path, end - path) &&
-				child->subpath[end - path] == '\0')
-			goto done;
-
-		child = child->next;
-	}
+	child = find_child(node, path, end);
+	if (!child)
+		child = add_child(node, path, end);
 
-	child = l_malloc(sizeof(*child) + end - path + 1);
-	child->node = l_new(struct object_node, 1);
-	child->node->parent = node;
-	memcpy(child->subpath, path, end - path);
-	child->subpath[end-path] = '\0';
-	child->next = node->children;
-	node->children = child;
-
-done:
 	return makepath_recurse(child->node, end);
 }
 
@@ -679,48 +981,38 @@ static struct object_node *lookup_recurse(struct object_node *node,
 
 	path += 1;
 	end = strchrnul(path, '/');
-	child = node->children;
 
-	while (child) {
-		if (!strncmp(child->subpath, path, end - path) &&
-				child->subpath[end - path] == '\0')
-			return lookup_recurse(child->node, end);
-
-		child = child->next;
-	}
+	child = find_child(node, path, end);
+	if (!child)
+		return NULL;
 
-	return NULL;
+	return lookup_recurse(child->node, end);
 }
 
 struct object_node *_dbus_object_tree_lookup(struct _dbus_object_tree *tree,
 						const char *path)
 {
+	struct object_node *node;
+
 	if (path[0] == '/' && path[1] == '\0')
 		return tree->root;
 
+	/* Registered objects are all in the flat index */
+	node = l_hashmap_lookup(tree->objects, path);
+	if (node)
+		return node;
+
 	return lookup_recurse(tree->root, path);
 }
 
 void _dbus_object_tree_prune_node(struct object_node *node)
 {
 	struct object_node *parent = node->parent;
-	struct child_node *p = NULL, *c;
 
 	while (parent) {
-		for (c = parent->children, p = NULL; c; p = c, c = c->next) {
-			if (c->node != node)
-				continue;
-
-			if (p)
-				p->next = c->next;
-			else
-				parent->children = c->next;
-
-			subtree_free(c->node);
-			l_free(c);
-
-			break;
-		}
+		remove_child(parent, node->link);
+		l_free(node->link);
+		subtree_free(node);
 
 		if (parent->children != NULL)
 			return;
@@ -802,18 +1094,18 @@ static bool get_properties_dict(struct l_dbus *dbus,
 				struct l_dbus_message *message,
 				struct l_dbus_message_builder *builder,
 				const struct l_dbus_interface *interface,
+				const struct interface_instance *instance,
 				void *user_data)
 {
-	const struct l_queue_entry *entry;
 	const struct _dbus_property *property;
 	const char *signature;
+	unsigned int i;
 
 	l_dbus_message_builder_enter_array(builder, "{sv}");
 	_dbus_message_builder_mark(builder);
 
-	for (entry = l_queue_get_entries(interface->properties); entry;
-			entry = entry->next) {
-		property = entry->data;
+	for (i = 0; i < l_vector_length(interface->properties); i++) {
+		property = l_vector_at(interface->properties, i);
 		signature = property->metainfo + strlen(property->metainfo) + 1;
 
 		l_dbus_message_builder_enter_dict(builder, "sv");
@@ -821,7 +1113,8 @@ static bool get_properties_dict(struct l_dbus *dbus,
 							property->metainfo);
 		l_dbus_message_builder_enter_variant(builder, signature);
 
-		if (!property->getter(dbus, message, builder, user_data)) {
+		if (!property_get_value(dbus, message, builder, instance,
+						property, user_data)) {
 			if (!_dbus_message_builder_rewind(builder))
 				return false;
 
@@ -867,24 +1160,26 @@ static struct l_dbus_message *build_interfaces_removed_signal(
 }
 
 static struct l_dbus_message *build_interfaces_added_signal(
-					const struct object_manager *manager,
-					const struct interface_add_record *rec)
+						struct l_dbus *dbus,
+						const char *manager_path,
+						const char *path,
+						struct l_queue *instances)
 {
 	struct l_dbus_message *signal;
 	struct l_dbus_message_builder *builder;
 	const struct l_queue_entry *entry;
 	const struct interface_instance *instance;
 
-	signal = l_dbus_message_new_signal(manager->dbus, manager->path,
+	signal = l_dbus_message_new_signal(dbus, manager_path,
 						L_DBUS_INTERFACE_OBJECT_MANAGER,
 						"InterfacesAdded");
 
 	builder = l_dbus_message_builder_new(signal);
 
-	l_dbus_message_builder_append_basic(builder, 'o', rec->path);
+	l_dbus_message_builder_append_basic(builder, 'o', path);
 	l_dbus_message_builder_enter_array(builder, "{sa{sv}}");
 
-	for (entry = l_queue_get_entries(rec->instances); entry;
+	for (entry = l_queue_get_entries(instances); entry;
 			entry = entry->next) {
 		instance = entry->data;
 
@@ -892,8 +1187,8 @@ static struct l_dbus_message *build_interfaces_added_signal(
 		l_dbus_message_builder_append_basic(builder, 's',
 						instance->interface->name);
 
-		if (!get_properties_dict(manager->dbus, signal, builder,
-						instance->interface,
+		if (!get_properties_dict(dbus, signal, builder,
+						instance->interface, instance,
 						instance->user_data)) {
 			l_dbus_message_builder_destroy(builder);
 			l_dbus_message_unref(signal);
@@ -931,8 +1226,8 @@ static struct l_dbus_message *build_old_property_changed_signal(
 	l_dbus_message_builder_append_basic(builder, 's', property->metainfo);
 	l_dbus_message_builder_enter_variant(builder, signature);
 
-	if (!property->getter(dbus, signal, builder,
-				rec->instance->user_data)) {
+	if (!property_get_value(dbus, signal, builder, rec->instance,
+					property, rec->instance->user_data)) {
 		l_dbus_message_builder_destroy(builder);
 		l_dbus_message_unref(signal);
 
@@ -982,8 +1277,8 @@ static struct l_dbus_message *build_properties_changed_signal(
 							property->metainfo);
 		l_dbus_message_builder_enter_variant(builder, signature);
 
-		if (!property->getter(dbus, signal, builder,
-					rec->instance->user_data)) {
+		if (!property_get_value(dbus, signal, builder, rec->instance,
+					property, rec->instance->user_data)) {
 			if (!_dbus_message_builder_rewind(builder)) {
 				l_dbus_message_unref(signal);
 				signal = NULL;
@@ -1022,6 +1317,7 @@ struct emit_signals_data {
 	struct l_dbus *dbus;
 	struct object_manager *manager;
 	struct object_node *node;
+	uint64_t now;
 };
 
 static bool emit_interfaces_removed(void *data, void *user_data)
@@ -1051,7 +1347,9 @@ static bool emit_interfaces_added(void *data, void *user_data)
 	if (es->node && rec->object != es->node)
 		return false;
 
-	signal = build_interfaces_added_signal(es->manager, rec);
+	signal = build_interfaces_added_signal(es->manager->dbus,
+						es->manager->path, rec->path,
+						rec->instances);
 	interface_add_record_free(rec);
 
 	if (signal)
@@ -1070,6 +1368,15 @@ static bool emit_properties_changed(void *data, void *user_data)
 	if (es->node && rec->object != es->node)
 		return false;
 
+	/*
+	 * Held back changes go out early if something else is sent from
+	 * the same object, so that signal order is preserved.
+	 */
+	if (!es->node && rec->due > es->now + COALESCE_SLACK)
+		return false;
+
+	rec->instance->last_changed = es->now;
+
 	if (rec->instance->interface->handle_old_style_properties)
 		for (entry = l_queue_get_entries(rec->properties);
 				entry; entry = entry->next) {
@@ -1091,6 +1398,8 @@ static bool emit_properties_changed(void *data, void *user_data)
 	return true;
 }
 
+static void schedule_coalesce(struct l_dbus *dbus, uint64_t due);
+
 void _dbus_object_tree_signals_flush(struct l_dbus *dbus, const char *path)
 {
 	struct _dbus_object_tree *tree = _dbus_get_tree(dbus);
@@ -1098,7 +1407,8 @@ void _dbus_object_tree_signals_flush(struct l_dbus *dbus, const char *path)
 	struct emit_signals_data data;
 	bool all_done = true;
 
-	if (!tree->emit_signals_work || tree->flushing)
+	if ((!tree->emit_signals_work && !tree->coalesce_work) ||
+			tree->flushing)
 		return;
 
 	tree->flushing = true;
@@ -1123,13 +1433,22 @@ void _dbus_object_tree_signals_flush(struct l_dbus *dbus, const char *path)
 			all_done = false;
 	}
 
+	data.now = l_time_now();
+
 	l_queue_foreach_remove(tree->property_changes,
 				emit_properties_changed, &data);
 
-	if (!l_queue_isempty(tree->property_changes))
-		all_done = false;
+	for (entry = l_queue_get_entries(tree->property_changes); entry;
+			entry = entry->next) {
+		const struct property_change_record *rec = entry->data;
+
+		if (rec->due > data.now + COALESCE_SLACK)
+			schedule_coalesce(dbus, rec->due);
+		else
+			all_done = false;
+	}
 
-	if (all_done) {
+	if (all_done && tree->emit_signals_work) {
 		l_idle_remove(tree->emit_signals_work);
 		tree->emit_signals_work = NULL;
 	}
@@ -1154,6 +1473,38 @@ static void schedule_emit_signals(struct l_dbus *dbus)
 	tree->emit_signals_work = l_idle_create(emit_signals, dbus, NULL);
 }
 
+static void coalesce_timeout(struct l_timeout *timeout, void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+	struct _dbus_object_tree *tree = _dbus_get_tree(dbus);
+
+	l_timeout_remove(tree->coalesce_work);
+	tree->coalesce_work = NULL;
+
+	schedule_emit_signals(dbus);
+}
+
+/* Arms the timer for held back property changes, if not armed earlier */
+static void schedule_coalesce(struct l_dbus *dbus, uint64_t due)
+{
+	struct _dbus_object_tree *tree = _dbus_get_tree(dbus);
+	uint64_t now = l_time_now();
+	uint64_t ms = due > now ? l_time_to_msecs(due - now + 999) : 0;
+	uint64_t remaining;
+
+	if (!tree->coalesce_work) {
+		tree->coalesce_work = l_timeout_create_ms(ms, coalesce_timeout,
+								dbus, NULL);
+		return;
+	}
+
+	if (l_timeout_remaining(tree->coalesce_work, &remaining) &&
+			remaining <= l_time_to_msecs(due - now))
+		return;
+
+	l_timeout_modify_ms(tree->coalesce_work, ms);
+}
+
 static bool match_property_changes_instance(const void *a, const void *b)
 {
 	const struct property_change_record *rec = a;
@@ -1191,6 +1542,8 @@ bool _dbus_object_tree_property_changed(struct l_dbus *dbus,
 	if (!property)
 		return false;
 
+	property_cache_drop(instance, property);
+
 	rec = l_queue_find(tree->property_changes,
 				match_property_changes_instance, instance);
 
@@ -1198,18 +1551,27 @@ bool _dbus_object_tree_property_changed(struct l_dbus *dbus,
 		if (l_queue_find(rec->properties, match_pointer, property))
 			return true;
 	} else {
+		unsigned int interval = instance->interface->coalesce_interval;
+
 		rec = l_new(struct property_change_record, 1);
 		rec->path = l_strdup(path);
 		rec->object = object;
 		rec->instance = instance;
 		rec->properties = l_queue_new();
 
+		if (interval && instance->last_changed)
+			rec->due = instance->last_changed +
+					interval * L_USEC_PER_MSEC;
+
 		l_queue_push_tail(tree->property_changes, rec);
 	}
 
 	l_queue_push_tail(rec->properties, property);
 
-	schedule_emit_signals(dbus);
+	if (rec->due > l_time_now())
+		schedule_coalesce(dbus, rec->due);
+	else
+		schedule_emit_signals(dbus);
 
 	return true;
 }
@@ -1336,7 +1698,7 @@ static struct l_dbus_message *old_get_properties(struct l_dbus *dbus,
 	reply = l_dbus_message_new_method_return(message);
 	builder = l_dbus_message_builder_new(reply);
 
-	if (!get_properties_dict(dbus, message, builder, interface,
+	if (!get_properties_dict(dbus, message, builder, interface, NULL,
 					user_data)) {
 		l_dbus_message_unref(reply);
 
@@ -1495,6 +1857,7 @@ bool _dbus_object_tree_add_interface(struct _dbus_object_tree *tree,
 	struct object_manager *manager;
 	size_t path_len;
 	struct interface_add_record *change_rec;
+	unsigned int i;
 
 	dbi = l_hashmap_lookup(tree->interfaces, interface);
 	if (!dbi)
@@ -1519,6 +1882,18 @@ bool _dbus_object_tree_add_interface(struct _dbus_object_tree *tree,
 	instance->interface = dbi;
 	instance->user_data = user_data;
 
+	for (i = 0; i < l_vector_length(dbi->properties); i++) {
+		const struct _dbus_property *property =
+						l_vector_at(dbi->properties, i);
+
+		if (property->flags & L_DBUS_PROPERTY_FLAG_CACHED) {
+			instance->n_cache = l_vector_length(dbi->properties);
+			instance->cache = l_new(struct l_dbus_message *,
+							instance->n_cache);
+			break;
+		}
+	}
+
 	l_queue_push_tail(object->instances, instance);
 
 	for (entry = l_queue_get_entries(tree->object_managers); entry;
@@ -1640,6 +2015,11 @@ bool _dbus_object_tree_remove_interface(struct _dbus_object_tree *tree,
 	if (!instance)
 		return false;
 
+	if (node->last_instance == instance) {
+		node->last_instance = NULL;
+		node->last_method = NULL;
+	}
+
 	if (!strcmp(interface, L_DBUS_INTERFACE_OBJECT_MANAGER)) {
 		manager = l_queue_remove_if(tree->object_managers,
 						match_object_manager_path,
@@ -1706,19 +2086,30 @@ bool _dbus_object_tree_remove_interface(struct _dbus_object_tree *tree,
 	return true;
 }
 
-static void generate_interface_instance(void *data, void *user)
+static const char *node_get_children_xml(struct object_node *node)
 {
-	struct interface_instance *instance = data;
-	struct l_string *buf = user;
+	struct l_string *buf;
+	struct child_node *child;
+
+	if (node->children_xml)
+		return node->children_xml;
+
+	buf = l_string_new(0);
 
-	_dbus_interface_introspection(instance->interface, buf);
+	for (child = node->children; child; child = child->next)
+		l_string_append_printf(buf, "\t<node name=\"%s\"/>\n",
+					child->subpath);
+
+	node->children_xml = l_string_unwrap(buf);
+
+	return node->children_xml;
 }
 
 void _dbus_object_tree_introspect(struct _dbus_object_tree *tree,
 					const char *path, struct l_string *buf)
 {
 	struct object_node *node;
-	struct child_node *child;
+	const struct l_queue_entry *entry;
 	bool path_is_object = true;
 
 	node = l_hashmap_lookup(tree->objects, path);
@@ -1742,12 +2133,15 @@ void _dbus_object_tree_introspect(struct _dbus_object_tree *tree,
 		if (path_is_object)
 			l_string_append(buf, static_introspectable);
 
-		l_queue_foreach(node->instances,
-					generate_interface_instance, buf);
+		for (entry = l_queue_get_entries(node->instances); entry;
+				entry = entry->next) {
+			const struct interface_instance *instance = entry->data;
 
-		for (child = node->children; child; child = child->next)
-			l_string_append_printf(buf, "\t<node name=\"%s\"/>\n",
-						child->subpath);
+			l_string_append(buf,
+					interface_get_xml(instance->interface));
+		}
+
+		l_string_append(buf, node_get_children_xml(node));
 	}
 
 	l_string_append(buf, "</node>\n");
@@ -1808,14 +2202,25 @@ bool _dbus_object_tree_dispatch(struct _dbus_object_tree *tree,
 	if (!node)
 		return false;
 
-	instance = l_queue_find(node->instances,
-				match_interface_instance, (char *) interface);
-	if (!instance)
-		return false;
+	instance = node->last_instance;
+	method = node->last_method;
 
-	method = _dbus_interface_find_method(instance->interface, member);
-	if (!method)
-		return false;
+	if (!instance || strcmp(instance->interface->name, interface) ||
+			strcmp(method->metainfo, member)) {
+		instance = l_queue_find(node->instances,
+					match_interface_instance,
+					(char *) interface);
+		if (!instance)
+			return false;
+
+		method = _dbus_interface_find_method(instance->interface,
+								member);
+		if (!method)
+			return false;
+
+		node->last_instance = instance;
+		node->last_method = method;
+	}
 
 	sig = method->metainfo + method->name_len + 1;
 
@@ -1887,7 +2292,8 @@ static struct l_dbus_message *properties_get(struct l_dbus *dbus,
 
 	l_dbus_message_builder_enter_variant(builder, signature);
 
-	if (property->getter(dbus, message, builder, instance->user_data)) {
+	if (property_get_value(dbus, message, builder, instance, property,
+						instance->user_data)) {
 		l_dbus_message_builder_leave_variant(builder);
 		l_dbus_message_builder_finalize(builder);
 	} else {
@@ -2011,7 +2417,7 @@ static struct l_dbus_message *properties_get_all(struct l_dbus *dbus,
 	builder = l_dbus_message_builder_new(reply);
 
 	if (!get_properties_dict(dbus, message, builder, instance->interface,
-					instance->user_data)) {
+					instance, instance->user_data)) {
 		l_dbus_message_unref(reply);
 
 		reply = l_dbus_message_new_error(message,
@@ -2044,19 +2450,13 @@ static void properties_setup_func(struct l_dbus_interface *interface)
 				"invalidated_properties");
 }
 
-static bool collect_objects(struct l_dbus *dbus, struct l_dbus_message *message,
+static bool append_object(struct l_dbus *dbus, struct l_dbus_message *message,
 				struct l_dbus_message_builder *builder,
 				const struct object_node *node,
 				const char *path)
 {
 	const struct l_queue_entry *entry;
-	const struct child_node *child;
-	char *child_path;
 	const struct interface_instance *instance;
-	bool r;
-
-	if (!node->instances)
-		goto recurse;
 
 	l_dbus_message_builder_enter_dict(builder, "oa{sa{sv}}");
 	l_dbus_message_builder_append_basic(builder, 'o', path);
@@ -2071,7 +2471,7 @@ static bool collect_objects(struct l_dbus *dbus, struct l_dbus_message *message,
 						instance->interface->name);
 
 		if (!get_properties_dict(dbus, message, builder,
-						instance->interface,
+						instance->interface, instance,
 						instance->user_data))
 			return false;
 
@@ -2081,7 +2481,22 @@ static bool collect_objects(struct l_dbus *dbus, struct l_dbus_message *message,
 	l_dbus_message_builder_leave_array(builder);
 	l_dbus_message_builder_leave_dict(builder);
 
-recurse:
+	return true;
+}
+
+static bool collect_objects(struct l_dbus *dbus, struct l_dbus_message *message,
+				struct l_dbus_message_builder *builder,
+				const struct object_node *node,
+				const char *path)
+{
+	const struct child_node *child;
+	char *child_path;
+	bool r;
+
+	if (node->instances && !append_object(dbus, message, builder,
+						node, path))
+		return false;
+
 	if (!strcmp(path, "/"))
 		path = "";
 
@@ -2100,6 +2515,13 @@ recurse:
 	return true;
 }
 
+static struct l_dbus_message *get_objects_error(struct l_dbus_message *message)
+{
+	return l_dbus_message_new_error(message,
+					"org.freedesktop.DBus.Error.Failed",
+					"Getting property values failed");
+}
+
 struct l_dbus_message *_dbus_object_tree_get_objects(
 						struct _dbus_object_tree *tree,
 						struct l_dbus *dbus,
@@ -2121,11 +2543,7 @@ struct l_dbus_message *_dbus_object_tree_get_objects(
 		l_dbus_message_builder_destroy(builder);
 		l_dbus_message_unref(reply);
 
-		return l_dbus_message_new_error(message,
-						"org.freedesktop.DBus.Error."
-						"Failed",
-						"Getting property values "
-						"failed");
+		return get_objects_error(message);
 	}
 
 	l_dbus_message_builder_leave_array(builder);
@@ -2136,14 +2554,190 @@ struct l_dbus_message *_dbus_object_tree_get_objects(
 	return reply;
 }
 
+bool _dbus_object_tree_set_max_reply_size(struct _dbus_object_tree *tree,
+						const char *path, size_t size)
+{
+	struct object_manager *manager;
+
+	manager = l_queue_find(tree->object_managers,
+				match_object_manager_path, path);
+	if (!manager)
+		return false;
+
+	manager->max_reply_size = size;
+
+	return true;
+}
+
+/*
+ * Records the paths up front rather than node pointers, since the tree
+ * can change while the reply is being built.  Objects removed in the
+ * meantime are skipped, objects added in the meantime are announced
+ * with InterfacesAdded like any other.
+ */
+static void collect_object_paths(const struct object_node *node,
+					const char *path, struct l_queue *paths)
+{
+	const struct child_node *child;
+
+	if (node->instances)
+		l_queue_push_tail(paths, l_strdup(path));
+
+	if (!strcmp(path, "/"))
+		path = "";
+
+	for (child = node->children; child; child = child->next) {
+		char *child_path = l_strdup_printf("%s/%s", path,
+							child->subpath);
+
+		collect_object_paths(child->node, child_path, paths);
+		l_free(child_path);
+	}
+}
+
+static void managed_objects_walk_free(void *data)
+{
+	struct managed_objects_walk *walk = data;
+
+	l_idle_remove(walk->idle);
+	l_dbus_message_builder_destroy(walk->builder);
+	l_dbus_message_unref(walk->reply);
+	l_dbus_message_unref(walk->message);
+	l_queue_destroy(walk->paths, l_free);
+	l_free(walk->manager_path);
+	l_free(walk);
+}
+
+static void managed_objects_walk_reply(struct managed_objects_walk *walk)
+{
+	struct object_manager *manager;
+
+	l_dbus_message_builder_leave_array(walk->builder);
+	l_dbus_message_builder_finalize(walk->builder);
+
+	manager = l_queue_find(walk->tree->object_managers,
+				match_object_manager_path, walk->manager_path);
+	if (manager)
+		manager->reply_size_hint =
+			_dbus_message_builder_get_size(walk->builder);
+
+	l_dbus_message_builder_destroy(walk->builder);
+	walk->builder = NULL;
+
+	l_dbus_send(walk->dbus, walk->reply);
+	walk->reply = NULL;
+}
+
+/* Returns true once there is nothing left to send */
+static bool managed_objects_walk_step(struct managed_objects_walk *walk)
+{
+	unsigned int i;
+
+	for (i = 0; i < MANAGED_OBJECTS_BATCH; i++) {
+		char *path = l_queue_pop_head(walk->paths);
+		struct object_node *node;
+		struct l_dbus_message *signal;
+
+		if (!path)
+			break;
+
+		node = l_hashmap_lookup(walk->tree->objects, path);
+
+		if (!node)
+			goto next;
+
+		if (!walk->builder) {
+			/* Past the size limit, the rest go out as signals */
+			signal = build_interfaces_added_signal(walk->dbus,
+							walk->manager_path,
+							path, node->instances);
+			if (signal)
+				l_dbus_send(walk->dbus, signal);
+
+			goto next;
+		}
+
+		if (!append_object(walk->dbus, walk->message, walk->builder,
+								node, path)) {
+			l_free(path);
+			l_dbus_message_builder_destroy(walk->builder);
+			walk->builder = NULL;
+			l_dbus_send(walk->dbus,
+					get_objects_error(walk->message));
+
+			return true;
+		}
+
+		if (walk->max_reply_size && _dbus_message_builder_get_size(
+					walk->builder) >= walk->max_reply_size)
+			managed_objects_walk_reply(walk);
+
+next:
+		l_free(path);
+	}
+
+	if (!l_queue_isempty(walk->paths))
+		return false;
+
+	if (walk->builder)
+		managed_objects_walk_reply(walk);
+
+	return true;
+}
+
+static void managed_objects_walk_idle(struct l_idle *idle, void *user_data)
+{
+	struct managed_objects_walk *walk = user_data;
+
+	if (!managed_objects_walk_step(walk))
+		return;
+
+	l_queue_remove(walk->tree->object_walks, walk);
+	managed_objects_walk_free(walk);
+}
+
 static struct l_dbus_message *get_managed_objects(struct l_dbus *dbus,
 						struct l_dbus_message *message,
 						void *user_data)
 {
 	struct _dbus_object_tree *tree = _dbus_get_tree(dbus);
 	const char *path = l_dbus_message_get_path(message);
+	const struct object_node *node;
+	const struct object_manager *manager;
+	struct managed_objects_walk *walk;
+
+	node = l_hashmap_lookup(tree->objects, path);
+	manager = l_queue_find(tree->object_managers,
+				match_object_manager_path, path);
+
+	walk = l_new(struct managed_objects_walk, 1);
+	walk->tree = tree;
+	walk->dbus = dbus;
+	walk->message = l_dbus_message_ref(message);
+	walk->reply = l_dbus_message_new_method_return(message);
+	walk->builder = l_dbus_message_builder_new(walk->reply);
+	walk->manager_path = l_strdup(path);
+	walk->paths = l_queue_new();
+
+	if (manager) {
+		walk->max_reply_size = manager->max_reply_size;
+		_dbus_message_builder_reserve(walk->builder,
+						manager->reply_size_hint);
+	}
+
+	l_dbus_message_builder_enter_array(walk->builder, "{oa{sa{sv}}}");
+	collect_object_paths(node, path, walk->paths);
+
+	/* Small trees are answered right away */
+	if (managed_objects_walk_step(walk)) {
+		managed_objects_walk_free(walk);
+		return NULL;
+	}
 
-	return _dbus_object_tree_get_objects(tree, dbus, path, message);
+	walk->idle = l_idle_create(managed_objects_walk_idle, walk, NULL);
+	l_queue_push_tail(tree->object_walks, walk);
+
+	return NULL;
 }
 
 static void object_manager_setup_func(struct l_dbus_interface *interface)
@@ -2157,3 +2751,118 @@ static void object_manager_setup_func(struct l_dbus_interface *interface)
 	l_dbus_interface_signal(interface, "InterfacesRemoved", 0, "oas",
 				"object_path", "interfaces");
 }
+
+static struct l_dbus_message *debug_set(struct l_dbus_message *message,
+					bool enabled)
+{
+	struct l_dbus_message *reply;
+	const char *pattern;
+	unsigned int count;
+
+	if (!l_dbus_message_get_arguments(message, "s", &pattern) ||
+			!*pattern)
+		return l_dbus_message_new_error(message,
+						"org.freedesktop.DBus.Error."
+						"InvalidArgs",
+						"Invalid arguments");
+
+	count = l_debug_set_enabled(pattern, enabled);
+
+	reply = l_dbus_message_new_method_return(message);
+	l_dbus_message_set_arguments(reply, "u", count);
+
+	return reply;
+}
+
+static struct l_dbus_message *debug_enable(struct l_dbus *dbus,
+						struct l_dbus_message *message,
+						void *user_data)
+{
+	return debug_set(message, true);
+}
+
+static struct l_dbus_message *debug_disable(struct l_dbus *dbus,
+						struct l_dbus_message *message,
+						void *user_data)
+{
+	return debug_set(message, false);
+}
+
+struct debug_list_data {
+	struct l_dbus_message_builder *builder;
+	const struct l_debug_desc *last;
+};
+
+static void debug_list_append(const char *file, const char *func,
+				bool enabled, void *user_data)
+{
+	struct debug_list_data *data = user_data;
+
+	l_dbus_message_builder_enter_struct(data->builder, "ssb");
+	l_dbus_message_builder_append_basic(data->builder, 's', file);
+	l_dbus_message_builder_append_basic(data->builder, 's', func);
+	l_dbus_message_builder_append_basic(data->builder, 'b', &enabled);
+	l_dbus_message_builder_leave_struct(data->builder);
+}
+
+/* The sites of a function are adjacent, list the function once */
+static void debug_list_site(const struct l_debug_desc *desc, void *user_data)
+{
+	struct debug_list_data *data = user_data;
+	const struct l_debug_desc *last = data->last;
+
+	if (last && !strcmp(last->file, desc->file) &&
+			!strcmp(last->func, desc->func)) {
+		if (desc->flags & L_DEBUG_FLAG_PRINT)
+			data->last = desc;
+
+		return;
+	}
+
+	if (last)
+		debug_list_append(last->file, last->func,
+				last->flags & L_DEBUG_FLAG_PRINT, data);
+
+	data->last = desc;
+}
+
+static struct l_dbus_message *debug_list(struct l_dbus *dbus,
+						struct l_dbus_message *message,
+						void *user_data)
+{
+	struct debug_list_data data = {};
+	struct l_dbus_message *reply;
+	const char *pattern;
+
+	if (!l_dbus_message_get_arguments(message, "s", &pattern))
+		return l_dbus_message_new_error(message,
+						"org.freedesktop.DBus.Error."
+						"InvalidArgs",
+						"Invalid arguments");
+
+	reply = l_dbus_message_new_method_return(message);
+	data.builder = l_dbus_message_builder_new(reply);
+
+	l_dbus_message_builder_enter_array(data.builder, "(ssb)");
+	debug_foreach(*pattern ? pattern : NULL, debug_list_site, &data);
+
+	if (data.last)
+		debug_list_append(data.last->file, data.last->func,
+				data.last->flags & L_DEBUG_FLAG_PRINT, &data);
+
+	l_dbus_message_builder_leave_array(data.builder);
+	l_dbus_message_builder_finalize(data.builder);
+	l_dbus_message_builder_destroy(data.builder);
+
+	return reply;
+}
+
+static void debug_setup_func(struct l_dbus_interface *interface)
+{
+	l_dbus_interface_method(interface, "Enable", 0, debug_enable,
+				"u", "s", "count", "pattern");
+	l_dbus_interface_method(interface, "Disable", 0, debug_disable,
+				"u", "s", "count", "pattern");
+	l_dbus_interface_method(interface, "List", 0, debug_list,
+				"a(ssb)", "s", "sites", "pattern");
+}
@@ -32,6 +32,7 @@ enum l_dbus_signal_flag {
 enum l_dbus_property_flag {
 	L_DBUS_PROPERTY_FLAG_DEPRECATED = 1,
 	L_DBUS_PROPERTY_FLAG_AUTO_EMIT	= 2,
+	L_DBUS_PROPERTY_FLAG_CACHED	= 4,
 };
 
 typedef struct l_dbus_message *(*l_dbus_interface_method_cb_t) (struct l_dbus *,
@@ -69,6 +70,10 @@ bool l_dbus_interface_property(struct l_dbus_interface *interface,
 				l_dbus_property_get_cb_t getter,
 				l_dbus_property_set_cb_t setter);
 
+bool l_dbus_interface_set_coalesce_interval(
+					struct l_dbus_interface *interface,
+					unsigned int interval_ms);
+
 bool l_dbus_property_changed(struct l_dbus *dbus, const char *path,
 				const char *interface, const char *property);
 
@@ -222,21 +222,56 @@ static bool valid_dict_signature(const char *sig)
 	return true;
 }
 
-bool _dbus_valid_signature(const char *sig)
+/*
+ * Builders and iterators check the same few signatures over and over, so
+ * the results for short ones are kept in a small direct mapped table.  A
+ * colliding signature simply replaces the entry.
+ */
+#define SIGNATURE_CACHE_SIZE	64
+#define SIGNATURE_CACHE_LEN	24
+
+static struct signature_cache_entry {
+	char sig[SIGNATURE_CACHE_LEN];
+	bool gvariant;
+	struct _dbus_signature_info info;
+} signature_cache[SIGNATURE_CACHE_SIZE];
+
+/*
+ * Returns the cache entry for sig in the given format, or NULL if sig is
+ * too long to be cached.  The entry's num_children is 0 if it has just
+ * been claimed for sig and needs to be filled in by the caller.
+ */
+struct _dbus_signature_info *_dbus_signature_cache_get(const char *sig,
+								bool gvariant)
 {
-	const char *s = sig;
+	struct signature_cache_entry *entry;
+	unsigned int hash = gvariant;
+	size_t len;
 
-	do {
-		s = validate_next_type(s);
+	for (len = 0; sig[len]; len++) {
+		if (len == SIGNATURE_CACHE_LEN - 1)
+			return NULL;
 
-		if (!s)
-			return false;
-	} while (*s);
+		hash = hash * 31 + sig[len];
+	}
 
-	return true;
+	/* Empty slots never match as the empty signature is not cached */
+	if (!len)
+		return NULL;
+
+	entry = &signature_cache[hash % SIGNATURE_CACHE_SIZE];
+
+	if (entry->gvariant == gvariant && !memcmp(entry->sig, sig, len + 1))
+		return &entry->info;
+
+	memcpy(entry->sig, sig, len + 1);
+	entry->gvariant = gvariant;
+	memset(&entry->info, 0, sizeof(entry->info));
+
+	return &entry->info;
 }
 
-int _dbus_num_children(const char *sig)
+static int count_children(const char *sig)
 {
 	const char *s = sig;
 	int num_children = 0;
@@ -253,6 +288,25 @@ int _dbus_num_children(const char *sig)
 	return num_children;
 }
 
+bool _dbus_valid_signature(const char *sig)
+{
+	return _dbus_num_children(sig) > 0;
+}
+
+int _dbus_num_children(const char *sig)
+{
+	struct _dbus_signature_info *info;
+
+	info = _dbus_signature_cache_get(sig, false);
+	if (!info)
+		return count_children(sig);
+
+	if (!info->num_children)
+		info->num_children = count_children(sig);
+
+	return info->num_children;
+}
+
 static bool valid_member_name(const char *start, const char *end,
 				bool bus_name)
 {
@@ -842,7 +896,8 @@ struct dbus_builder {
 	void *body;
 	size_t body_size;
 	size_t body_pos;
-	struct l_queue *containers;
+	struct container *containers;
+	unsigned int depth;
 	struct {
 		struct container *container;
 		int sig_end;
@@ -855,6 +910,7 @@ struct container {
 	enum dbus_container_type type;
 	char signature[256];
 	uint8_t sigindex;
+	struct container *parent;
 };
 
 static struct container *container_new(enum dbus_container_type type,
@@ -876,6 +932,24 @@ static void container_free(struct container *container)
 	l_free(container);
 }
 
+/*
+ * The open containers are kept as a plain linked stack, builders do not
+ * touch any per-thread state so they can be used on worker threads.
+ */
+static void container_push(struct dbus_builder *builder,
+				struct container *container)
+{
+	container->parent = builder->containers;
+	builder->containers = container;
+	builder->depth += 1;
+}
+
+static void container_pop(struct dbus_builder *builder)
+{
+	builder->containers = builder->containers->parent;
+	builder->depth -= 1;
+}
+
 static inline size_t grow_body(struct dbus_builder *builder,
 					size_t len, unsigned int alignment)
 {
@@ -903,9 +977,8 @@ struct dbus_builder *_dbus1_builder_new(void *body, size_t body_size)
 	builder = l_new(struct dbus_builder, 1);
 	builder->signature = l_string_new(63);
 
-	builder->containers = l_queue_new();
 	root = container_new(DBUS_CONTAINER_TYPE_STRUCT, "", 0);
-	l_queue_push_head(builder->containers, root);
+	container_push(builder, root);
 
 	builder->body = body;
 	builder->body_size = body_size;
@@ -924,8 +997,14 @@ void _dbus1_builder_free(struct dbus_builder *builder)
 		return;
 
 	l_string_free(builder->signature);
-	l_queue_destroy(builder->containers,
-				(l_queue_destroy_func_t) container_free);
+
+	while (builder->containers) {
+		struct container *container = builder->containers;
+
+		container_pop(builder);
+		container_free(container);
+	}
+
 	l_free(builder->body);
 
 	l_free(builder);
@@ -934,7 +1013,7 @@ void _dbus1_builder_free(struct dbus_builder *builder)
 bool _dbus1_builder_append_basic(struct dbus_builder *builder,
 					char type, const void *value)
 {
-	struct container *container = l_queue_peek_head(builder->containers);
+	struct container *container = builder->containers;
 	size_t start;
 	unsigned int alignment;
 	size_t len;
@@ -949,7 +1028,7 @@ bool _dbus1_builder_append_basic(struct dbus_builder *builder,
 	if (!alignment)
 		return false;
 
-	if (l_queue_length(builder->containers) == 1)
+	if (builder->depth == 1)
 		l_string_append_c(builder->signature, type);
 	else if (container->signature[container->sigindex] != type)
 		return false;
@@ -991,14 +1070,54 @@ bool _dbus1_builder_append_basic(struct dbus_builder *builder,
 	return true;
 }
 
+bool _dbus1_builder_append_fixed_array(struct dbus_builder *builder,
+					char type, const void *data, uint32_t n)
+{
+	struct container *container = builder->containers;
+	size_t size = get_basic_size(type);
+	size_t start;
+	uint32_t i;
+
+	/* Only valid for appending to an array of fixed size elements */
+	if (!size || type == 'h')
+		return false;
+
+	if (container->type != DBUS_CONTAINER_TYPE_ARRAY ||
+			container->signature[0] != type ||
+			container->signature[1] != '\0')
+		return false;
+
+	if (n > UINT32_MAX / size)
+		return false;
+
+	/* Elements are naturally aligned, so no padding goes in between */
+	start = grow_body(builder, n * size, get_alignment(type));
+
+	if (type != 'b') {
+		/* data may be NULL for an empty array */
+		if (n)
+			memcpy(builder->body + start, data, n * size);
+
+		return true;
+	}
+
+	for (i = 0; i < n; i++) {
+		uint32_t b = ((const bool *) data)[i];
+
+		memcpy(builder->body + start + i * size, &b, size);
+	}
+
+	return true;
+}
+
 static bool enter_struct_dict_common(struct dbus_builder *builder,
 					const char *signature,
 					enum dbus_container_type type,
 					const char open,
 					const char close)
 {
-	size_t qlen = l_queue_length(builder->containers);
-	struct container *container = l_queue_peek_head(builder->containers);
+	size_t qlen = builder->depth;
+	struct container *container = builder->containers;
 	size_t start;
 
 	if (qlen == 1) {
@@ -1027,7 +1146,7 @@ static bool enter_struct_dict_common(struct dbus_builder *builder,
 	start = grow_body(builder, 0, 8);
 
 	container = container_new(type, signature, start);
-	l_queue_push_head(builder->containers, container);
+	container_push(builder, container);
 
 	return true;
 }
@@ -1061,8 +1180,8 @@ static bool leave_struct_dict_common(struct dbus_builder *builder,
 					const char open,
 					const char close)
 {
-	struct container *container = l_queue_peek_head(builder->containers);
-	size_t qlen = l_queue_length(builder->containers);
+	struct container *container = builder->containers;
+	size_t qlen = builder->depth;
 	struct container *parent;
 
 	if (unlikely(qlen <= 1))
@@ -1071,9 +1190,9 @@ static bool leave_struct_dict_common(struct dbus_builder *builder,
 	if (unlikely(container->type != type))
 		return false;
 
-	l_queue_pop_head(builder->containers);
+	container_pop(builder);
 	qlen -= 1;
-	parent = l_queue_peek_head(builder->containers);
+	parent = builder->containers;
 
 	if (qlen == 1)
 		l_string_append_printf(builder->signature, "%c%s%c",
@@ -1104,8 +1223,8 @@ bool _dbus1_builder_leave_dict(struct dbus_builder *builder)
 bool _dbus1_builder_enter_variant(struct dbus_builder *builder,
 					const char *signature)
 {
-	size_t qlen = l_queue_length(builder->containers);
-	struct container *container = l_queue_peek_head(builder->containers);
+	size_t qlen = builder->depth;
+	struct container *container = builder->containers;
 	size_t start;
 	size_t siglen;
 
@@ -1125,15 +1244,15 @@ bool _dbus1_builder_enter_variant(struct dbus_builder *builder,
 
 	container = container_new(DBUS_CONTAINER_TYPE_VARIANT,
 					signature, start);
-	l_queue_push_head(builder->containers, container);
+	container_push(builder, container);
 
 	return true;
 }
 
 bool _dbus1_builder_leave_variant(struct dbus_builder *builder)
 {
-	struct container *container = l_queue_peek_head(builder->containers);
-	size_t qlen = l_queue_length(builder->containers);
+	struct container *container = builder->containers;
+	size_t qlen = builder->depth;
 	struct container *parent;
 
 	if (unlikely(qlen <= 1))
@@ -1142,9 +1261,9 @@ bool _dbus1_builder_leave_variant(struct dbus_builder *builder)
 	if (unlikely(container->type != DBUS_CONTAINER_TYPE_VARIANT))
 		return false;
 
-	l_queue_pop_head(builder->containers);
+	container_pop(builder);
 	qlen -= 1;
-	parent = l_queue_peek_head(builder->containers);
+	parent = builder->containers;
 
 	if (qlen == 1)
 		l_string_append_c(builder->signature, 'v');
@@ -1159,8 +1278,8 @@ bool _dbus1_builder_leave_variant(struct dbus_builder *builder)
 bool _dbus1_builder_enter_array(struct dbus_builder *builder,
 					const char *signature)
 {
-	size_t qlen = l_queue_length(builder->containers);
-	struct container *container = l_queue_peek_head(builder->containers);
+	size_t qlen = builder->depth;
+	struct container *container = builder->containers;
 	size_t start;
 	int alignment;
 
@@ -1199,15 +1318,15 @@ bool _dbus1_builder_enter_array(struct dbus_builder *builder,
 	grow_body(builder, 0, alignment);
 
 	container = container_new(DBUS_CONTAINER_TYPE_ARRAY, signature, start);
-	l_queue_push_head(builder->containers, container);
+	container_push(builder, container);
 
 	return true;
 }
 
 bool _dbus1_builder_leave_array(struct dbus_builder *builder)
 {
-	struct container *container = l_queue_peek_head(builder->containers);
-	size_t qlen = l_queue_length(builder->containers);
+	struct container *container = builder->containers;
+	size_t qlen = builder->depth;
 	struct container *parent;
 	size_t alignment;
 	size_t array_start;
@@ -1218,9 +1337,9 @@ bool _dbus1_builder_leave_array(struct dbus_builder *builder)
 	if (unlikely(container->type != DBUS_CONTAINER_TYPE_ARRAY))
 		return false;
 
-	l_queue_pop_head(builder->containers);
+	container_pop(builder);
 	qlen -= 1;
-	parent = l_queue_peek_head(builder->containers);
+	parent = builder->containers;
 
 	if (qlen == 1)
 		l_string_append_printf(builder->signature, "a%s",
@@ -1242,11 +1361,11 @@ bool _dbus1_builder_leave_array(struct dbus_builder *builder)
 
 bool _dbus1_builder_mark(struct dbus_builder *builder)
 {
-	struct container *container = l_queue_peek_head(builder->containers);
+	struct container *container = builder->containers;
 
 	builder->mark.container = container;
 
-	if (l_queue_length(builder->containers) == 1)
+	if (builder->depth == 1)
 		builder->mark.sig_end = l_string_length(builder->signature);
 	else
 		builder->mark.sig_end = container->sigindex;
@@ -1256,19 +1375,33 @@ bool _dbus1_builder_mark(struct dbus_builder *builder)
 	return true;
 }
 
+void _dbus1_builder_reserve(struct dbus_builder *builder, size_t len)
+{
+	if (builder->body_pos + len <= builder->body_size)
+		return;
+
+	builder->body = l_realloc(builder->body, builder->body_pos + len);
+	builder->body_size = builder->body_pos + len;
+}
+
+size_t _dbus1_builder_get_size(struct dbus_builder *builder)
+{
+	return builder->body_pos;
+}
+
 bool _dbus1_builder_rewind(struct dbus_builder *builder)
 {
 	struct container *container;
 
-	while ((container = l_queue_peek_head(builder->containers)) !=
+	while ((container = builder->containers) !=
 				builder->mark.container) {
+		container_pop(builder);
 		container_free(container);
-		l_queue_pop_head(builder->containers);
 	}
 
 	builder->body_pos = builder->mark.body_pos;
 
-	if (l_queue_length(builder->containers) == 1)
+	if (builder->depth == 1)
 		l_string_truncate(builder->signature, builder->mark.sig_end);
 	else
 		container->sigindex = builder->mark.sig_end;
@@ -1284,12 +1417,16 @@ char *_dbus1_builder_finish(struct dbus_builder *builder,
 	if (unlikely(!builder))
 		return NULL;
 
-	if (unlikely(l_queue_length(builder->containers) != 1))
+	if (unlikely(builder->depth != 1))
 		return NULL;
 
 	signature = l_string_unwrap(builder->signature);
 	builder->signature = NULL;
 
+	/* Give back whatever was reserved but not used */
+	if (builder->body_size > builder->body_pos && builder->body_pos)
+		builder->body = l_realloc(builder->body, builder->body_pos);
+
 	*body = builder->body;
 	*body_size = builder->body_pos;
 	builder->body = NULL;
@@ -24,12 +24,18 @@
 #include "util.h"
 #include "io.h"
 #include "idle.h"
+#include "main.h"
+#include "timeout.h"
+#include "time.h"
 #include "queue.h"
 #include "hashmap.h"
 #include "dbus.h"
+#include "dbus-service.h"
 #include "private.h"
 #include "useful.h"
 #include "dbus-private.h"
+#include "memory-private.h"
+#include "probe-private.h"
 
 #define DEFAULT_SYSTEM_BUS_ADDRESS "unix:path=/var/run/dbus/system_bus_socket"
 
@@ -39,6 +45,45 @@
 
 #define DBUS_MAXIMUM_MATCH_RULE_LENGTH	1024
 
+#define DBUS_SEND_BATCH		16
+#define DBUS_RECV_BUFFER_SIZE	32768
+
+/*
+ * Reply deadlines are kept in a wheel of REPLY_WHEEL_SLOTS lists, one per
+ * REPLY_WHEEL_TICK milliseconds, driven by a single timeout that only runs
+ * while calls with a deadline are pending.  Deadlines further away than a
+ * full turn share slots with closer ones and are skipped until due.
+ */
+#define REPLY_WHEEL_SLOTS	256
+#define REPLY_WHEEL_TICK	50
+
+#define REPLY_HISTOGRAM_SIZE	32
+
+/*
+ * Outgoing messages wait in one lane per kind.  By default the oldest
+ * message of all lanes is written first, as if there was a single queue.
+ * With priority lanes enabled each round takes up to the lane's weight in
+ * messages from every lane, in lane order, so a burst of signals cannot
+ * hold back replies that other peers are blocked on.  Order is then only
+ * kept within a lane.
+ */
+enum message_lane {
+	MESSAGE_LANE_REPLY,
+	MESSAGE_LANE_CALL,
+	MESSAGE_LANE_SIGNAL,
+	MESSAGE_LANE_COUNT,
+};
+
+static const unsigned int message_lane_weight[MESSAGE_LANE_COUNT] = {
+	[MESSAGE_LANE_REPLY] = 4,
+	[MESSAGE_LANE_CALL] = 2,
+	[MESSAGE_LANE_SIGNAL] = 1,
+};
+
+#define DBUS_ERROR_NO_REPLY	"org.freedesktop.DBus.Error.NoReply"
+
+#define DBUS_INTERFACE_PEER_LINK	"org.ell.PeerLink"
+
 enum auth_state {
 	WAITING_FOR_OK,
 	WAITING_FOR_AGREE_UNIX_FD,
@@ -47,8 +92,9 @@ enum auth_state {
 
 struct l_dbus_ops {
 	char version;
-	bool (*send_message)(struct l_dbus *bus,
-				struct l_dbus_message *message);
+	bool (*send_messages)(struct l_dbus *bus,
+				struct l_dbus_message **messages,
+				unsigned int count);
 	struct l_dbus_message *(*recv_message)(struct l_dbus *bus);
 	void (*free)(struct l_dbus *bus);
 	struct _dbus_name_ops name_ops;
@@ -68,7 +114,9 @@ struct l_dbus {
 	char *unique_name;
 	unsigned int next_id;
 	uint32_t next_serial;
-	struct l_queue *message_queue;
+	struct l_queue *message_lanes[MESSAGE_LANE_COUNT];
+	unsigned int lane_credits[MESSAGE_LANE_COUNT];
+	bool priority_lanes;
 	struct l_hashmap *message_list;
 	struct l_hashmap *signal_list;
 	l_dbus_ready_func_t ready_handler;
@@ -84,26 +132,86 @@ struct l_dbus {
 	struct _dbus_name_cache *name_cache;
 	struct _dbus_filter *filter;
 	bool name_notify_enabled;
+	bool *destroyed;
+	struct message_callback *reply_wheel[REPLY_WHEEL_SLOTS];
+	unsigned int reply_wheel_count;
+	uint64_t reply_wheel_tick;
+	struct l_timeout *reply_timeout;
+	struct l_hashmap *reply_stats;
+	unsigned int signals_high_water;
+	bool signals_congested;
+	bool signals_congested_notified;
+	struct l_idle *backpressure_work;
+	l_dbus_backpressure_func_t backpressure_handler;
+	l_dbus_destroy_func_t backpressure_destroy;
+	void *backpressure_data;
+	struct l_dbus_traffic_stats *traffic;
+	struct l_hashmap *member_stats;
+	uint64_t slow_threshold;
+	l_dbus_slow_handler_func_t slow_handler;
+	l_dbus_destroy_func_t slow_destroy;
+	void *slow_data;
+	struct l_queue *peer_links;
+	bool peer_links_accepted;
+	struct l_dbus *peer_parent;
+	char *peer_name;
+	char *peer_alias;
+	struct l_idle *peer_close_work;
+	struct l_main_loop *loop;
+	struct thread_handoff *handoff;
 
 	const struct l_dbus_ops *driver;
 };
 
+/* Outlives the connection while sends from other threads are in flight */
+struct thread_handoff {
+	int refcount;
+	struct l_dbus *dbus;
+};
+
 struct l_dbus_classic {
 	struct l_dbus super;
 	void *auth_command;
 	enum auth_state auth_state;
+	bool auth_pipelined;
+	char auth_buf[128];
+	size_t auth_len;
 	bool skip_hello;
 	struct l_hashmap *match_strings;
 	int *fd_buf;
 	unsigned int num_fds;
+	struct _dbus_buffer *recv_buf;
+	size_t recv_start;
+	size_t recv_end;
+	bool recv_drained;
 };
 
+/* Per destination counters of the calls expecting a reply */
+struct reply_stats {
+	uint64_t in_flight;
+	uint64_t replies;
+	uint64_t timeouts;
+	uint64_t histogram[REPLY_HISTOGRAM_SIZE];
+};
+
+/*
+ * Calls expecting a reply are in message_list from the moment they are
+ * queued.  Cancelling or timing out one that is still queued only marks
+ * it as cancelled, the queue then drops it instead of sending it.
+ */
 struct message_callback {
 	uint32_t serial;
 	struct l_dbus_message *message;
 	l_dbus_message_func_t callback;
 	l_dbus_destroy_func_t destroy;
 	void *user_data;
+	struct reply_stats *stats;
+	uint64_t send_time;
+	uint64_t expiry;
+	struct message_callback *wheel_next;
+	struct message_callback **wheel_prev;
+	bool queued:1;
+	bool cancelled:1;
 };
 
 struct signal_callback {
@@ -125,1299 +233,3031 @@ static void message_queue_destroy(void *data)
 	l_free(callback);
 }
 
+static void message_callback_cancel(struct message_callback *callback)
+{
+	callback->cancelled = true;
+	callback->callback = NULL;
+
+	if (callback->destroy)
+		callback->destroy(callback->user_data);
+
+	callback->destroy = NULL;
+}
+
 static void message_list_destroy(void *value)
 {
-	message_queue_destroy(value);
+	struct message_callback *callback = value;
+
+	/* The message queue still holds it and frees it */
+	if (callback->queued) {
+		message_callback_cancel(callback);
+		return;
+	}
+
+	message_queue_destroy(callback);
 }
 
-static void signal_list_destroy(void *value)
+static void reply_wheel_remove(struct l_dbus *dbus,
+				struct message_callback *callback)
 {
-	struct signal_callback *callback = value;
+	if (!callback->wheel_prev)
+		return;
 
-	if (callback->destroy)
-		callback->destroy(callback->user_data);
+	*callback->wheel_prev = callback->wheel_next;
 
-	l_free(callback);
+	if (callback->wheel_next)
+		callback->wheel_next->wheel_prev = callback->wheel_prev;
+
+	callback->wheel_next = NULL;
+	callback->wheel_prev = NULL;
+	dbus->reply_wheel_count--;
 }
 
-static bool message_write_handler(struct l_io *io, void *user_data)
+/* Bucket i holds values in [2^(i - 1), 2^i), the last one everything above */
+static unsigned int reply_stats_bucket(uint64_t value)
 {
-	struct l_dbus *dbus = user_data;
-	struct l_dbus_message *message;
-	struct message_callback *callback;
-	const void *header, *body;
-	size_t header_size, body_size;
+	unsigned int bucket = value ? 64 - __builtin_clzll(value) : 0;
 
-	callback = l_queue_pop_head(dbus->message_queue);
-	if (!callback)
-		return false;
+	return minsize(bucket, REPLY_HISTOGRAM_SIZE - 1);
+}
 
-	message = callback->message;
-	if (_dbus_message_get_type(message) == DBUS_MESSAGE_TYPE_METHOD_CALL &&
-			callback->callback == NULL)
-		l_dbus_message_set_no_reply(message, true);
+static struct reply_stats *reply_stats_get(struct l_dbus *dbus,
+						const char *destination)
+{
+	struct reply_stats *stats;
 
-	_dbus_message_set_serial(message, callback->serial);
+	if (!destination)
+		destination = "";
 
-	if (!dbus->driver->send_message(dbus, message)) {
-		message_queue_destroy(callback);
-		return false;
-	}
+	if (!dbus->reply_stats)
+		dbus->reply_stats = l_hashmap_string_new();
 
-	header = _dbus_message_get_header(message, &header_size);
-	body = _dbus_message_get_body(message, &body_size);
-	l_util_hexdump_two(false, header, header_size, body, body_size,
-				dbus->debug_handler, dbus->debug_data);
+	stats = l_hashmap_lookup(dbus->reply_stats, destination);
+	if (stats)
+		return stats;
 
-	if (callback->callback == NULL) {
-		message_queue_destroy(callback);
-		goto done;
-	}
+	stats = l_new(struct reply_stats, 1);
+	l_hashmap_insert(dbus->reply_stats, destination, stats);
 
-	l_hashmap_insert(dbus->message_list,
-				L_UINT_TO_PTR(callback->serial), callback);
+	return stats;
+}
 
-done:
-	if (l_queue_isempty(dbus->message_queue))
-		return false;
+enum reply_result {
+	REPLY_RECEIVED,
+	REPLY_TIMED_OUT,
+	REPLY_DROPPED,
+};
 
-	/* Only continue sending messges if the connection is ready */
-	return dbus->is_ready;
+/* Takes a reply callback that was just removed from message_list */
+static void message_callback_done(struct l_dbus *dbus,
+					struct message_callback *callback,
+					enum reply_result result)
+{
+	reply_wheel_remove(dbus, callback);
+
+	callback->stats->in_flight--;
+
+	switch (result) {
+	case REPLY_RECEIVED:
+		callback->stats->replies++;
+		callback->stats->histogram[reply_stats_bucket(l_time_now() -
+						callback->send_time)]++;
+		break;
+	case REPLY_TIMED_OUT:
+		callback->stats->timeouts++;
+		break;
+	case REPLY_DROPPED:
+		break;
+	}
 }
 
-static void handle_method_return(struct l_dbus *dbus,
-					struct l_dbus_message *message)
+static void reply_abort(struct l_dbus *dbus,
+				struct message_callback *callback,
+				enum reply_result result, const char *reason)
 {
-	struct message_callback *callback;
-	uint32_t reply_serial;
+	l_dbus_message_func_t function = callback->callback;
+	struct l_dbus_message *error;
+	const char *destination;
 
-	reply_serial = _dbus_message_get_reply_serial(message);
-	if (reply_serial == 0)
-		return;
+	l_hashmap_remove(dbus->message_list, L_UINT_TO_PTR(callback->serial));
+	message_callback_done(dbus, callback, result);
 
-	callback = l_hashmap_remove(dbus->message_list,
-					L_UINT_TO_PTR(reply_serial));
-	if (!callback)
-		return;
+	error = _dbus_message_new_error(dbus->driver->version,
+					callback->serial, dbus->unique_name,
+					DBUS_ERROR_NO_REPLY, reason);
 
-	if (callback->callback)
-		callback->callback(message, callback->user_data);
+	destination = l_dbus_message_get_destination(callback->message);
+	if (error && destination)
+		_dbus_message_set_sender(error, destination);
 
-	message_queue_destroy(callback);
+	/* Still queued, so the write handler has to drop it instead */
+	if (callback->queued) {
+		void *user_data = callback->user_data;
+		l_dbus_destroy_func_t destroy = callback->destroy;
+
+		callback->destroy = NULL;
+		message_callback_cancel(callback);
+
+		if (error)
+			function(error, user_data);
+
+		if (destroy)
+			destroy(user_data);
+	} else {
+		if (error)
+			function(error, callback->user_data);
+
+		message_queue_destroy(callback);
+	}
+
+	l_dbus_message_unref(error);
 }
 
-static void handle_error(struct l_dbus *dbus, struct l_dbus_message *message)
+static void reply_wheel_expire(struct l_timeout *timeout, void *user_data)
 {
-	struct message_callback *callback;
-	uint32_t reply_serial;
+	struct l_dbus *dbus = user_data;
+	uint64_t now = l_time_to_msecs(l_time_now()) / REPLY_WHEEL_TICK;
+	struct message_callback *expired = NULL;
+	struct message_callback *callback, *next;
+	struct message_callback **slot;
+	uint64_t tick;
+	bool destroyed = false;
+
+	/*
+	 * Move everything due to a list of its own first, the callbacks may
+	 * add to the wheel or cancel other calls that are due.  The links
+	 * are the same so removing from either works alike.
+	 */
+	for (tick = dbus->reply_wheel_tick + 1; tick <= now &&
+			tick <= dbus->reply_wheel_tick + REPLY_WHEEL_SLOTS;
+			tick++) {
+		slot = &dbus->reply_wheel[tick % REPLY_WHEEL_SLOTS];
+
+		for (callback = *slot; callback; callback = next) {
+			next = callback->wheel_next;
+
+			if (callback->expiry > now)
+				continue;
 
-	reply_serial = _dbus_message_get_reply_serial(message);
-	if (reply_serial == 0)
-		return;
+			*callback->wheel_prev = next;
+			if (next)
+				next->wheel_prev = callback->wheel_prev;
 
-	callback = l_hashmap_remove(dbus->message_list,
-					L_UINT_TO_PTR(reply_serial));
-	if (!callback)
+			callback->wheel_next = expired;
+			callback->wheel_prev = &expired;
+			if (expired)
+				expired->wheel_prev = &callback->wheel_next;
+
+			expired = callback;
+		}
+	}
+
+	dbus->reply_wheel_tick = now;
+	dbus->destroyed = &destroyed;
+
+	while ((callback = expired)) {
+		reply_abort(dbus, callback, REPLY_TIMED_OUT,
+				"Did not receive a reply in time");
+
+		if (destroyed)
+			return;
+	}
+
+	dbus->destroyed = NULL;
+
+	if (!dbus->reply_wheel_count) {
+		l_timeout_remove(dbus->reply_timeout);
+		dbus->reply_timeout = NULL;
 		return;
+	}
 
-	if (callback->callback)
-		callback->callback(message, callback->user_data);
+	l_timeout_modify_ms(dbus->reply_timeout, REPLY_WHEEL_TICK);
+}
 
-	message_queue_destroy(callback);
+static void reply_wheel_insert(struct l_dbus *dbus,
+				struct message_callback *callback,
+				unsigned int timeout_ms)
+{
+	uint64_t now = l_time_to_msecs(l_time_now());
+	struct message_callback **slot;
+
+	if (!dbus->reply_timeout) {
+		dbus->reply_wheel_tick = now / REPLY_WHEEL_TICK;
+		dbus->reply_timeout = l_timeout_create_ms(REPLY_WHEEL_TICK,
+							reply_wheel_expire,
+							dbus, NULL);
+	}
+
+	/* Round up so that no call times out early */
+	callback->expiry = (now + timeout_ms + REPLY_WHEEL_TICK - 1) /
+							REPLY_WHEEL_TICK;
+	if (callback->expiry <= dbus->reply_wheel_tick)
+		callback->expiry = dbus->reply_wheel_tick + 1;
+
+	slot = &dbus->reply_wheel[callback->expiry % REPLY_WHEEL_SLOTS];
+
+	callback->wheel_next = *slot;
+	if (*slot)
+		(*slot)->wheel_prev = &callback->wheel_next;
+
+	callback->wheel_prev = slot;
+	*slot = callback;
+	dbus->reply_wheel_count++;
 }
 
-static void process_signal(const void *key, void *value, void *user_data)
+static void signal_list_destroy(void *value)
 {
 	struct signal_callback *callback = value;
-	struct l_dbus_message *message = user_data;
 
-	if (callback->callback)
-		callback->callback(message, callback->user_data);
+	if (callback->destroy)
+		callback->destroy(callback->user_data);
+
+	l_free(callback);
 }
 
-static void handle_signal(struct l_dbus *dbus, struct l_dbus_message *message)
+static void member_stats_free(void *data)
 {
-	l_hashmap_foreach(dbus->signal_list, process_signal, message);
+	struct l_dbus_member_stats *stats = data;
+
+	l_free((char *) stats->interface);
+	l_free((char *) stats->member);
+	l_free(stats);
 }
 
-static bool message_read_handler(struct l_io *io, void *user_data)
+static struct l_dbus_member_stats *member_stats_get(struct l_dbus *dbus,
+					struct l_dbus_message *message)
 {
-	struct l_dbus *dbus = user_data;
-	struct l_dbus_message *message;
-	const void *header, *body;
-	size_t header_size, body_size;
-	enum dbus_message_type msgtype;
+	const char *interface = l_dbus_message_get_interface(message);
+	const char *member = l_dbus_message_get_member(message);
+	struct l_dbus_member_stats *stats;
+	char key[512];
 
-	message = dbus->driver->recv_message(dbus);
-	if (!message)
-		return true;
+	if (!dbus->member_stats)
+		return NULL;
 
-	header = _dbus_message_get_header(message, &header_size);
-	body = _dbus_message_get_body(message, &body_size);
-	l_util_hexdump_two(true, header, header_size, body, body_size,
-				dbus->debug_handler, dbus->debug_data);
+	if (!interface)
+		interface = "";
 
-	msgtype = _dbus_message_get_type(message);
+	if (!member)
+		member = "";
 
-	switch (msgtype) {
+	/* Member names can't contain dots so the key is unambiguous */
+	snprintf(key, sizeof(key), "%s.%s", interface, member);
+
+	stats = l_hashmap_lookup(dbus->member_stats, key);
+	if (stats)
+		return stats;
+
+	stats = l_new(struct l_dbus_member_stats, 1);
+	stats->interface = l_strdup(interface);
+	stats->member = l_strdup(member);
+	l_hashmap_insert(dbus->member_stats, key, stats);
+
+	return stats;
+}
+
+static void traffic_count(struct l_dbus *dbus, struct l_dbus_message *message,
+						size_t size, bool in)
+{
+	struct l_dbus_traffic_stats *traffic = dbus->traffic;
+	struct l_dbus_traffic_counter *counter;
+	struct l_dbus_member_stats *stats;
+	bool by_member = false;
+
+	if (!traffic)
+		return;
+
+	/* Replies carry no member, their handlers count for the call */
+	switch (_dbus_message_get_type(message)) {
+	case DBUS_MESSAGE_TYPE_METHOD_CALL:
+		counter = in ? &traffic->method_calls_in :
+						&traffic->method_calls_out;
+		by_member = true;
+		break;
 	case DBUS_MESSAGE_TYPE_METHOD_RETURN:
-		handle_method_return(dbus, message);
+		counter = in ? &traffic->method_returns_in :
+						&traffic->method_returns_out;
 		break;
 	case DBUS_MESSAGE_TYPE_ERROR:
-		handle_error(dbus, message);
+		counter = in ? &traffic->errors_in : &traffic->errors_out;
 		break;
 	case DBUS_MESSAGE_TYPE_SIGNAL:
-		handle_signal(dbus, message);
+		counter = in ? &traffic->signals_in : &traffic->signals_out;
+		by_member = true;
 		break;
-	case DBUS_MESSAGE_TYPE_METHOD_CALL:
-		if (!_dbus_object_tree_dispatch(dbus->tree, dbus, message)) {
-			struct l_dbus_message *error;
+	default:
+		return;
+	}
 
-			error = l_dbus_message_new_error(message,
-					"org.freedesktop.DBus.Error.NotFound",
-					"No matching method found");
-			l_dbus_send(dbus, error);
-		}
+	counter->messages++;
+	counter->bytes += size;
 
-		break;
-	}
+	if (!by_member)
+		return;
 
-	l_dbus_message_unref(message);
+	stats = member_stats_get(dbus, message);
 
-	return true;
+	if (in) {
+		stats->messages_in++;
+		stats->bytes_in += size;
+	} else {
+		stats->messages_out++;
+		stats->bytes_out += size;
+	}
 }
 
-static uint32_t send_message(struct l_dbus *dbus, bool priority,
-				struct l_dbus_message *message,
-				l_dbus_message_func_t function,
-				void *user_data, l_dbus_destroy_func_t destroy)
+static uint64_t handler_start(struct l_dbus *dbus)
 {
-	struct message_callback *callback;
-	enum dbus_message_type type;
-	const char *path;
+	if (!dbus->traffic && !dbus->slow_handler)
+		return 0;
 
-	type = _dbus_message_get_type(message);
+	return l_time_now();
+}
 
-	if ((type == DBUS_MESSAGE_TYPE_METHOD_RETURN ||
-				type == DBUS_MESSAGE_TYPE_ERROR) &&
-			_dbus_message_get_reply_serial(message) == 0) {
-		l_dbus_message_unref(message);
-		return 0;
+/*
+ * Accounts a handler run for @message, a method call either received or
+ * sent.  The slow handler is called last as it may destroy the connection.
+ */
+static void handler_done(struct l_dbus *dbus, struct l_dbus_message *message,
+							uint64_t start)
+{
+	uint64_t duration = l_time_diff(start, l_time_now());
+	struct l_dbus_member_stats *stats = member_stats_get(dbus, message);
+	const char *interface, *member;
+	bool slow = dbus->slow_handler && duration >= dbus->slow_threshold;
+
+	if (stats) {
+		stats->handler_calls++;
+		stats->handler_time += duration;
+		stats->handler_max_time = maxsize(stats->handler_max_time,
+								duration);
+
+		if (slow)
+			stats->slow_calls++;
 	}
 
-	/* Default empty signature for method return messages */
-	if (type == DBUS_MESSAGE_TYPE_METHOD_RETURN &&
-			!l_dbus_message_get_signature(message))
-		l_dbus_message_set_arguments(message, "");
+	if (!slow)
+		return;
 
-	callback = l_new(struct message_callback, 1);
+	interface = l_dbus_message_get_interface(message);
+	member = l_dbus_message_get_member(message);
 
-	callback->serial = dbus->next_serial++;
-	callback->message = message;
-	callback->callback = function;
-	callback->destroy = destroy;
-	callback->user_data = user_data;
+	dbus->slow_handler(interface ? interface : "", member ? member : "",
+					duration, dbus->slow_data);
+}
 
-	if (priority) {
-		l_queue_push_head(dbus->message_queue, callback);
+static bool message_lanes_empty(struct l_dbus *dbus)
+{
+	unsigned int i;
 
-		l_io_set_write_handler(dbus->io, message_write_handler,
-							dbus, NULL);
+	for (i = 0; i < MESSAGE_LANE_COUNT; i++)
+		if (!l_queue_isempty(dbus->message_lanes[i]))
+			return false;
 
-		return callback->serial;
-	}
+	return true;
+}
 
-	path = l_dbus_message_get_path(message);
-	if (path)
-		_dbus_object_tree_signals_flush(dbus, path);
+static struct l_queue *message_lane_next_weighted(struct l_dbus *dbus,
+						unsigned int *out_lane)
+{
+	unsigned int i;
+
+	for (i = 0; i < MESSAGE_LANE_COUNT; i++) {
+		if (!dbus->lane_credits[i] ||
+				l_queue_isempty(dbus->message_lanes[i]))
+			continue;
 
-	l_queue_push_tail(dbus->message_queue, callback);
+		*out_lane = i;
+		return dbus->message_lanes[i];
+	}
 
-	if (dbus->is_ready)
-		l_io_set_write_handler(dbus->io, message_write_handler,
-							dbus, NULL);
+	if (message_lanes_empty(dbus))
+		return NULL;
 
-	return callback->serial;
+	/* Every non-empty lane has used up its share, start a new round */
+	memcpy(dbus->lane_credits, message_lane_weight,
+					sizeof(dbus->lane_credits));
+
+	return message_lane_next_weighted(dbus, out_lane);
 }
 
-static void bus_ready(struct l_dbus *dbus)
+static struct l_queue *message_lane_next(struct l_dbus *dbus,
+						unsigned int *out_lane)
 {
-	dbus->is_ready = true;
+	struct message_callback *head, *oldest = NULL;
+	unsigned int i;
 
-	if (dbus->ready_handler)
-		dbus->ready_handler(dbus->ready_data);
+	/*
+	 * Before the connection is ready only the Hello call goes out, and
+	 * it is at the head of the reply lane which comes first.
+	 */
+	if (dbus->priority_lanes || !dbus->is_ready)
+		return message_lane_next_weighted(dbus, out_lane);
 
-	l_io_set_read_handler(dbus->io, message_read_handler, dbus, NULL);
+	for (i = 0; i < MESSAGE_LANE_COUNT; i++) {
+		head = l_queue_peek_head(dbus->message_lanes[i]);
+		if (!head)
+			continue;
 
-	/* Check for messages added before the connection was ready */
-	if (l_queue_isempty(dbus->message_queue))
-		return;
+		if (oldest && (int32_t) (head->serial - oldest->serial) > 0)
+			continue;
 
-	l_io_set_write_handler(dbus->io, message_write_handler, dbus, NULL);
+		oldest = head;
+		*out_lane = i;
+	}
+
+	return oldest ? dbus->message_lanes[*out_lane] : NULL;
 }
 
-static void hello_callback(struct l_dbus_message *message, void *user_data)
+static void backpressure_notify(struct l_idle *idle, void *user_data)
 {
 	struct l_dbus *dbus = user_data;
-	const char *signature;
-	const char *unique_name;
+	bool congested = dbus->signals_congested;
 
-	signature = l_dbus_message_get_signature(message);
-	if (!signature || strcmp(signature, "s")) {
-		close(l_io_get_fd(dbus->io));
-		return;
-	}
+	l_idle_remove(dbus->backpressure_work);
+	dbus->backpressure_work = NULL;
 
-	if (!l_dbus_message_get_arguments(message, "s", &unique_name)) {
-		close(l_io_get_fd(dbus->io));
+	/* The lane may have filled up and drained again in the meantime */
+	if (congested == dbus->signals_congested_notified)
 		return;
-	}
 
-	dbus->unique_name = l_strdup(unique_name);
+	dbus->signals_congested_notified = congested;
 
-	bus_ready(dbus);
+	if (dbus->backpressure_handler)
+		dbus->backpressure_handler(congested, dbus->backpressure_data);
 }
 
-static bool auth_write_handler(struct l_io *io, void *user_data)
+/*
+ * Called whenever the signal lane grows or shrinks.  Relief is only
+ * reported once the lane is down to half of the high-water mark so that
+ * a lane hovering around the mark does not keep flipping.
+ */
+static void backpressure_update(struct l_dbus *dbus)
 {
-	struct l_dbus_classic *classic = user_data;
-	struct l_dbus *dbus = &classic->super;
-	ssize_t written, len;
-	int fd;
+	unsigned int length;
+	bool congested;
 
-	fd = l_io_get_fd(io);
+	if (!dbus->signals_high_water)
+		return;
 
-	if (!classic->auth_command)
-		return false;
+	length = l_queue_length(dbus->message_lanes[MESSAGE_LANE_SIGNAL]);
 
-	len = strlen(classic->auth_command);
-	if (!len)
-		return false;
+	if (dbus->signals_congested)
+		congested = length > dbus->signals_high_water / 2;
+	else
+		congested = length >= dbus->signals_high_water;
 
-	written = L_TFR(send(fd, classic->auth_command, len, 0));
-	if (written < 0)
-		return false;
+	if (congested == dbus->signals_congested)
+		return;
 
-	l_util_hexdump(false, classic->auth_command, written,
-					dbus->debug_handler, dbus->debug_data);
+	dbus->signals_congested = congested;
 
-	if (written < len) {
-		memmove(classic->auth_command, classic->auth_command + written,
-				len + 1 - written);
-		return true;
-	}
+	if (!dbus->backpressure_work)
+		dbus->backpressure_work = l_idle_create(backpressure_notify,
+								dbus, NULL);
+}
 
-	l_free(classic->auth_command);
-	classic->auth_command = NULL;
+static bool message_write_handler(struct l_io *io, void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+	struct message_callback *batch[DBUS_SEND_BATCH];
+	struct l_dbus_message *messages[DBUS_SEND_BATCH];
+	struct message_callback *callback;
+	struct l_dbus_message *message;
+	struct l_queue *lane;
+	unsigned int lane_id;
+	const void *header, *body;
+	size_t header_size, body_size;
+	unsigned int max = dbus->is_ready ? DBUS_SEND_BATCH : 1;
+	unsigned int count = 0;
+	unsigned int i;
 
-	if (classic->auth_state == SETUP_DONE) {
-		struct l_dbus_message *message;
+	/*
+	 * Coalesce queued messages into a single write.  Passed file
+	 * descriptors travel with the first byte of a write, so a message
+	 * carrying any always starts a batch of its own and ends it.
+	 */
+	while (count < max) {
+		uint32_t num_fds = 0;
 
-		if (classic->skip_hello) {
-			bus_ready(dbus);
-			return true;
-		}
+		lane = message_lane_next(dbus, &lane_id);
+		if (!lane)
+			break;
 
-		l_io_set_read_handler(dbus->io, message_read_handler,
-							dbus, NULL);
+		callback = l_queue_peek_head(lane);
 
-		message = l_dbus_message_new_method_call(dbus,
-							DBUS_SERVICE_DBUS,
-							DBUS_PATH_DBUS,
-							L_DBUS_INTERFACE_DBUS,
-							"Hello");
-		l_dbus_message_set_arguments(message, "");
+		if (callback->cancelled) {
+			l_queue_pop_head(lane);
+			message_queue_destroy(callback);
+			continue;
+		}
 
-		send_message(dbus, true, message, hello_callback, dbus, NULL);
+		message = callback->message;
 
-		return true;
-	}
+		if (dbus->support_unix_fd)
+			_dbus_message_get_fds(message, &num_fds);
 
-	return false;
-}
+		if (num_fds && count)
+			break;
 
-static bool auth_read_handler(struct l_io *io, void *user_data)
-{
-	struct l_dbus_classic *classic = user_data;
-	struct l_dbus *dbus = &classic->super;
-	char buffer[64];
-	char *ptr, *end;
-	ssize_t offset, len;
-	int fd;
+		l_queue_pop_head(lane);
+		dbus->lane_credits[lane_id]--;
 
-	fd = l_io_get_fd(io);
+		if (_dbus_message_get_type(message) ==
+					DBUS_MESSAGE_TYPE_METHOD_CALL &&
+				callback->callback == NULL)
+			l_dbus_message_set_no_reply(message, true);
 
-	ptr = buffer;
-	offset = 0;
+		_dbus_message_set_serial(message, callback->serial);
 
-	while (1) {
-		len = L_TFR(recv(fd, ptr + offset,
-						sizeof(buffer) - offset,
-						MSG_DONTWAIT));
-		if (len < 0) {
-			if (errno != EAGAIN)
-				return false;
+		batch[count] = callback;
+		messages[count++] = message;
 
+		if (num_fds)
 			break;
-		}
-
-		offset += len;
 	}
 
-	ptr = buffer;
-	len = offset;
+	backpressure_update(dbus);
 
-	if (!ptr || len < 3)
-		return true;
+	if (!count)
+		return false;
 
-	end = strstr(ptr, "\r\n");
-	if (!end)
-		return true;
+	if (!dbus->driver->send_messages(dbus, messages, count)) {
+		for (i = 0; i < count; i++) {
+			callback = batch[i];
 
-	if (end - ptr + 2 != len)
-		return true;
+			if (callback->callback) {
+				l_hashmap_remove(dbus->message_list,
+					L_UINT_TO_PTR(callback->serial));
+				message_callback_done(dbus, callback,
+							REPLY_DROPPED);
+			}
 
-	l_util_hexdump(true, ptr, len, dbus->debug_handler, dbus->debug_data);
+			message_queue_destroy(callback);
+		}
 
-	*end = '\0';
+		return false;
+	}
 
-	switch (classic->auth_state) {
-	case WAITING_FOR_OK:
-		if (!strncmp(ptr, "OK ", 3)) {
-			enum auth_state state;
-			const char *command;
+	for (i = 0; i < count; i++) {
+		callback = batch[i];
 
-			if (dbus->negotiate_unix_fd) {
-				command = "NEGOTIATE_UNIX_FD\r\n";
-				state = WAITING_FOR_AGREE_UNIX_FD;
-			} else {
-				command = "BEGIN\r\n";
-				state = SETUP_DONE;
-			}
+		header = _dbus_message_get_header(messages[i], &header_size);
+		body = _dbus_message_get_body(messages[i], &body_size);
+		l_util_hexdump_two(false, header, header_size, body, body_size,
+					dbus->debug_handler, dbus->debug_data);
+		traffic_count(dbus, messages[i], header_size + body_size, false);
 
-			l_free(dbus->guid);
-			dbus->guid = l_strdup(ptr + 3);
+		if (callback->callback == NULL) {
+			message_queue_destroy(callback);
+			continue;
+		}
 
-			classic->auth_command = l_strdup(command);
-			classic->auth_state = state;
-			break;
-		} else if (!strncmp(ptr, "REJECTED ", 9)) {
-			static const char *command = "AUTH ANONYMOUS\r\n";
+		callback->queued = false;
+	}
 
-			dbus->negotiate_unix_fd = true;
+	if (message_lanes_empty(dbus))
+		return false;
 
-			classic->auth_command = l_strdup(command);
-			classic->auth_state = WAITING_FOR_OK;
-		}
-		break;
+	/* Only continue sending messges if the connection is ready */
+	return dbus->is_ready;
+}
 
-	case WAITING_FOR_AGREE_UNIX_FD:
-		if (!strncmp(ptr, "AGREE_UNIX_FD", 13)) {
-			static const char *command = "BEGIN\r\n";
+static void handle_method_return(struct l_dbus *dbus,
+					struct l_dbus_message *message)
+{
+	struct message_callback *callback;
+	uint32_t reply_serial;
 
-			dbus->support_unix_fd = true;
+	reply_serial = _dbus_message_get_reply_serial(message);
+	if (reply_serial == 0)
+		return;
 
-			classic->auth_command = l_strdup(command);
-			classic->auth_state = SETUP_DONE;
-			break;
-		} else if (!strncmp(ptr, "ERROR", 5)) {
-			static const char *command = "BEGIN\r\n";
+	callback = l_hashmap_remove(dbus->message_list,
+					L_UINT_TO_PTR(reply_serial));
+	if (!callback)
+		return;
 
-			dbus->support_unix_fd = false;
+	message_callback_done(dbus, callback, REPLY_RECEIVED);
 
-			classic->auth_command = l_strdup(command);
-			classic->auth_state = SETUP_DONE;
-			break;
-		}
-		break;
+	if (callback->callback) {
+		bool *destroyed = dbus->destroyed;
+		uint64_t start = handler_start(dbus);
 
-	case SETUP_DONE:
-		break;
-	}
+		callback->callback(message, callback->user_data);
 
-	l_io_set_write_handler(io, auth_write_handler, dbus, NULL);
+		if (start && !(destroyed && *destroyed))
+			handler_done(dbus, callback->message, start);
+	}
 
-	return true;
+	message_queue_destroy(callback);
 }
 
-static void disconnect_handler(struct l_io *io, void *user_data)
+static void handle_error(struct l_dbus *dbus, struct l_dbus_message *message)
 {
-	struct l_dbus *dbus = user_data;
+	struct message_callback *callback;
+	uint32_t reply_serial;
 
-	dbus->is_ready = false;
+	reply_serial = _dbus_message_get_reply_serial(message);
+	if (reply_serial == 0)
+		return;
 
-	l_util_debug(dbus->debug_handler, dbus->debug_data, "disconnect");
+	callback = l_hashmap_remove(dbus->message_list,
+					L_UINT_TO_PTR(reply_serial));
+	if (!callback)
+		return;
 
-	if (dbus->disconnect_handler)
-		dbus->disconnect_handler(dbus->disconnect_data);
-}
+	message_callback_done(dbus, callback, REPLY_RECEIVED);
 
-static void dbus_init(struct l_dbus *dbus, int fd)
-{
-	dbus->io = l_io_new(fd);
-	l_io_set_close_on_destroy(dbus->io, true);
-	l_io_set_disconnect_handler(dbus->io, disconnect_handler, dbus, NULL);
+	if (callback->callback) {
+		bool *destroyed = dbus->destroyed;
+		uint64_t start = handler_start(dbus);
 
-	dbus->is_ready = false;
-	dbus->next_id = 1;
-	dbus->next_serial = 1;
+		callback->callback(message, callback->user_data);
 
-	dbus->message_queue = l_queue_new();
-	dbus->message_list = l_hashmap_new();
-	dbus->signal_list = l_hashmap_new();
+		if (start && !(destroyed && *destroyed))
+			handler_done(dbus, callback->message, start);
+	}
 
-	dbus->tree = _dbus_object_tree_new();
+	message_queue_destroy(callback);
 }
 
-static void classic_free(struct l_dbus *dbus)
+static void process_signal(const void *key, void *value, void *user_data)
 {
-	struct l_dbus_classic *classic =
-		l_container_of(dbus, struct l_dbus_classic, super);
-	unsigned int i;
+	struct signal_callback *callback = value;
+	struct l_dbus_message *message = user_data;
 
-	for (i = 0; i < classic->num_fds; i++)
-		close(classic->fd_buf[i]);
-	l_free(classic->fd_buf);
+	if (callback->callback)
+		callback->callback(message, callback->user_data);
+}
 
-	l_free(classic->auth_command);
-	l_hashmap_destroy(classic->match_strings, l_free);
-	l_free(classic);
+static void handle_signal(struct l_dbus *dbus, struct l_dbus_message *message)
+{
+	l_hashmap_foreach(dbus->signal_list, process_signal, message);
 }
 
-static bool classic_send_message(struct l_dbus *dbus,
+static void handle_method_call(struct l_dbus *dbus,
 					struct l_dbus_message *message)
 {
-	int fd = l_io_get_fd(dbus->io);
-	struct msghdr msg;
-	struct iovec iov[2], *iovpos;
-	ssize_t r;
-	int *fds = NULL;
-	uint32_t num_fds = 0;
-	struct cmsghdr *cmsg;
-	int iovlen;
+	bool *destroyed = dbus->destroyed;
+	uint64_t start = handler_start(dbus);
 
-	iov[0].iov_base = _dbus_message_get_header(message, &iov[0].iov_len);
-	iov[1].iov_base = _dbus_message_get_body(message, &iov[1].iov_len);
+	if (!_dbus_object_tree_dispatch(dbus->tree, dbus, message)) {
+		struct l_dbus_message *error;
 
-	if (dbus->support_unix_fd)
-		fds = _dbus_message_get_fds(message, &num_fds);
+		error = l_dbus_message_new_error(message,
+					"org.freedesktop.DBus.Error.NotFound",
+					"No matching method found");
+		l_dbus_send(dbus, error);
+		return;
+	}
 
-	iovpos = iov;
-	iovlen = 2;
+	if (start && !(destroyed && *destroyed))
+		handler_done(dbus, message, start);
+}
 
-	while (1) {
-		memset(&msg, 0, sizeof(msg));
-		msg.msg_iov = iovpos;
-		msg.msg_iovlen = iovlen;
+static bool peer_link_match(const void *a, const void *b)
+{
+	const struct l_dbus *link = a;
+	const char *name = b;
 
-		if (num_fds) {
-			msg.msg_control =
-				alloca(CMSG_SPACE(num_fds * sizeof(int)));
-			msg.msg_controllen = CMSG_LEN(num_fds * sizeof(int));
+	if (!link->is_ready)
+		return false;
 
-			cmsg = CMSG_FIRSTHDR(&msg);
-			cmsg->cmsg_len = msg.msg_controllen;
-			cmsg->cmsg_level = SOL_SOCKET;
-			cmsg->cmsg_type = SCM_RIGHTS;
-			memcpy(CMSG_DATA(cmsg), fds, num_fds * sizeof(int));
-		}
+	return !strcmp(link->peer_name, name) ||
+		(link->peer_alias && !strcmp(link->peer_alias, name));
+}
 
-		r = L_TFR(sendmsg(fd, &msg, 0));
-		if (r < 0)
-			return false;
+static struct l_dbus *peer_link_find(struct l_dbus *dbus, const char *name)
+{
+	if (!dbus->peer_links || !name)
+		return NULL;
 
-		while ((size_t) r >= iovpos->iov_len) {
-			r -= iovpos->iov_len;
-			iovpos++;
-			iovlen--;
+	return l_queue_find(dbus->peer_links, peer_link_match, name);
+}
 
-			if (!iovlen)
-				break;
-		}
+/*
+ * There is no bus on a peer link to fill in the sender.  Calls and
+ * signals are handled by the bus connection as if they came from the
+ * bus, replies can be to calls sent either way while the link came up.
+ */
+static void dispatch_peer_message(struct l_dbus *link,
+					struct l_dbus_message *message)
+{
+	struct l_dbus *dbus = link->peer_parent;
+	enum dbus_message_type msgtype = _dbus_message_get_type(message);
+	uint32_t reply_serial;
 
-		if (!iovlen)
-			break;
+	_dbus_message_set_sender(message, link->peer_name);
 
-		iovpos->iov_base += r;
-		iovpos->iov_len -= r;
+	switch (msgtype) {
+	case DBUS_MESSAGE_TYPE_METHOD_RETURN:
+	case DBUS_MESSAGE_TYPE_ERROR:
+		reply_serial = _dbus_message_get_reply_serial(message);
 
-		/* The FDs have been transmitted, don't retransmit */
-		num_fds = 0;
-	}
+		if (l_hashmap_lookup(link->message_list,
+						L_UINT_TO_PTR(reply_serial)))
+			dbus = link;
 
-	return true;
+		if (msgtype == DBUS_MESSAGE_TYPE_ERROR)
+			handle_error(dbus, message);
+		else
+			handle_method_return(dbus, message);
+
+		break;
+	case DBUS_MESSAGE_TYPE_SIGNAL:
+		handle_signal(dbus, message);
+		break;
+	case DBUS_MESSAGE_TYPE_METHOD_CALL:
+		handle_method_call(dbus, message);
+		break;
+	}
 }
 
-static struct l_dbus_message *classic_recv_message(struct l_dbus *dbus)
+static void dispatch_message(struct l_dbus *dbus,
+					struct l_dbus_message *message)
 {
-	struct l_dbus_classic *classic =
-		l_container_of(dbus, struct l_dbus_classic, super);
-	int fd = l_io_get_fd(dbus->io);
-	struct dbus_header hdr;
-	struct msghdr msg;
-	struct iovec iov[2], *iovpos;
-	struct cmsghdr *cmsg;
-	ssize_t len, r;
-	void *header, *body;
+	const void *header, *body;
 	size_t header_size, body_size;
-	union {
-		uint8_t bytes[CMSG_SPACE(16 * sizeof(int))];
-		struct cmsghdr align;
-	} fd_buf;
-	int *fds = NULL;
-	uint32_t num_fds = 0;
-	int iovlen;
+	enum dbus_message_type msgtype;
+
+	header = _dbus_message_get_header(message, &header_size);
+	body = _dbus_message_get_body(message, &body_size);
+	l_util_hexdump_two(true, header, header_size, body, body_size,
+				dbus->debug_handler, dbus->debug_data);
+	traffic_count(dbus, message, header_size + body_size, true);
+
+	if (dbus->peer_parent) {
+		dispatch_peer_message(dbus, message);
+		return;
+	}
+
+	msgtype = _dbus_message_get_type(message);
+
+	switch (msgtype) {
+	case DBUS_MESSAGE_TYPE_METHOD_RETURN:
+		handle_method_return(dbus, message);
+		break;
+	case DBUS_MESSAGE_TYPE_ERROR:
+		handle_error(dbus, message);
+		break;
+	case DBUS_MESSAGE_TYPE_SIGNAL:
+		handle_signal(dbus, message);
+		break;
+	case DBUS_MESSAGE_TYPE_METHOD_CALL:
+		handle_method_call(dbus, message);
+		break;
+	}
+}
+
+static bool message_read_handler(struct l_io *io, void *user_data)
+{
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_DBUS);
+	struct l_dbus *dbus = user_data;
 	struct l_dbus_message *message;
+	bool destroyed = false;
+
+	/*
+	 * A single read can bring in several messages.  Any of the handlers
+	 * may destroy the connection, so stop as soon as that happens.
+	 */
+	dbus->destroyed = &destroyed;
+
+	while ((message = dbus->driver->recv_message(dbus))) {
+		dispatch_message(dbus, message);
+		l_dbus_message_unref(message);
+
+		if (destroyed)
+			return true;
+	}
+
+	dbus->destroyed = NULL;
+
+	return true;
+}
+
+static uint32_t send_message_timeout(struct l_dbus *dbus, bool priority,
+				struct l_dbus_message *message,
+				l_dbus_message_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy,
+				unsigned int timeout_ms)
+{
+	struct message_callback *callback;
+	struct l_dbus *link;
+	enum dbus_message_type type;
+	enum message_lane lane;
+	const char *path;
+
+	link = peer_link_find(dbus,
+				l_dbus_message_get_destination(message));
+	if (link)
+		return send_message_timeout(link, priority, message, function,
+						user_data, destroy, timeout_ms);
+
+	type = _dbus_message_get_type(message);
+
+	if ((type == DBUS_MESSAGE_TYPE_METHOD_RETURN ||
+				type == DBUS_MESSAGE_TYPE_ERROR) &&
+			_dbus_message_get_reply_serial(message) == 0) {
+		l_dbus_message_unref(message);
+		return 0;
+	}
+
+	/* Default empty signature for method return messages */
+	if (type == DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+			!l_dbus_message_get_signature(message))
+		l_dbus_message_set_arguments(message, "");
+
+	callback = l_new(struct message_callback, 1);
+
+	/* Serials come from the bus connection for l_dbus_cancel */
+	if (dbus->peer_parent)
+		callback->serial = dbus->peer_parent->next_serial++;
+	else
+		callback->serial = dbus->next_serial++;
+
+	callback->message = message;
+	callback->callback = function;
+	callback->destroy = destroy;
+	callback->user_data = user_data;
+
+	if (function) {
+		callback->queued = true;
+		callback->send_time = l_time_now();
+		callback->stats = reply_stats_get(dbus,
+				l_dbus_message_get_destination(message));
+		callback->stats->in_flight++;
+
+		l_hashmap_insert(dbus->message_list,
+				L_UINT_TO_PTR(callback->serial), callback);
+
+		if (timeout_ms)
+			reply_wheel_insert(dbus, callback, timeout_ms);
+	}
+
+	/* The reply lane is always served first in a new round */
+	if (priority) {
+		l_queue_push_head(dbus->message_lanes[MESSAGE_LANE_REPLY],
+								callback);
+
+		l_io_set_write_handler(dbus->io, message_write_handler,
+							dbus, NULL);
+
+		return callback->serial;
+	}
+
+	path = l_dbus_message_get_path(message);
+	if (path)
+		_dbus_object_tree_signals_flush(dbus, path);
+
+	switch (type) {
+	case DBUS_MESSAGE_TYPE_METHOD_CALL:
+		lane = MESSAGE_LANE_CALL;
+		break;
+	case DBUS_MESSAGE_TYPE_SIGNAL:
+		lane = MESSAGE_LANE_SIGNAL;
+		break;
+	case DBUS_MESSAGE_TYPE_METHOD_RETURN:
+	case DBUS_MESSAGE_TYPE_ERROR:
+	default:
+		lane = MESSAGE_LANE_REPLY;
+		break;
+	}
+
+	l_queue_push_tail(dbus->message_lanes[lane], callback);
+
+	if (lane == MESSAGE_LANE_SIGNAL)
+		backpressure_update(dbus);
+
+	if (dbus->is_ready)
+		l_io_set_write_handler(dbus->io, message_write_handler,
+							dbus, NULL);
+
+	return callback->serial;
+}
+
+static uint32_t send_message(struct l_dbus *dbus, bool priority,
+				struct l_dbus_message *message,
+				l_dbus_message_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy)
+{
+	return send_message_timeout(dbus, priority, message, function,
+					user_data, destroy, 0);
+}
+
+static void bus_ready(struct l_dbus *dbus)
+{
+	dbus->is_ready = true;
+
+	if (dbus->ready_handler)
+		dbus->ready_handler(dbus->ready_data);
+
+	l_io_set_read_handler(dbus->io, message_read_handler, dbus, NULL);
+
+	/* Check for messages added before the connection was ready */
+	if (message_lanes_empty(dbus))
+		return;
+
+	l_io_set_write_handler(dbus->io, message_write_handler, dbus, NULL);
+}
+
+static void hello_callback(struct l_dbus_message *message, void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+	const char *signature;
+	const char *unique_name;
+
+	signature = l_dbus_message_get_signature(message);
+	if (!signature || strcmp(signature, "s")) {
+		close(l_io_get_fd(dbus->io));
+		return;
+	}
+
+	if (!l_dbus_message_get_arguments(message, "s", &unique_name)) {
+		close(l_io_get_fd(dbus->io));
+		return;
+	}
+
+	dbus->unique_name = l_strdup(unique_name);
+
+	bus_ready(dbus);
+}
+
+static bool auth_write_handler(struct l_io *io, void *user_data)
+{
+	struct l_dbus_classic *classic = user_data;
+	struct l_dbus *dbus = &classic->super;
+	ssize_t written, len;
+	int fd;
+
+	fd = l_io_get_fd(io);
+
+	if (!classic->auth_command)
+		return false;
+
+	len = strlen(classic->auth_command);
+	if (!len)
+		return false;
+
+	written = L_TFR(send(fd, classic->auth_command, len, 0));
+	if (written < 0)
+		return false;
+
+	l_util_hexdump(false, classic->auth_command, written,
+					dbus->debug_handler, dbus->debug_data);
+
+	if (written < len) {
+		memmove(classic->auth_command, classic->auth_command + written,
+				len + 1 - written);
+		return true;
+	}
+
+	l_free(classic->auth_command);
+	classic->auth_command = NULL;
+
+	if (classic->auth_state == SETUP_DONE && !classic->auth_pipelined) {
+		struct l_dbus_message *message;
+
+		if (classic->skip_hello) {
+			bus_ready(dbus);
+			return true;
+		}
+
+		l_io_set_read_handler(dbus->io, message_read_handler,
+							dbus, NULL);
+
+		message = l_dbus_message_new_method_call(dbus,
+							DBUS_SERVICE_DBUS,
+							DBUS_PATH_DBUS,
+							L_DBUS_INTERFACE_DBUS,
+							"Hello");
+		l_dbus_message_set_arguments(message, "");
+
+		send_message(dbus, true, message, hello_callback, dbus, NULL);
+
+		return true;
+	}
+
+	return false;
+}
+
+/* Returns the next command to send, if any */
+static const char *auth_process_line(struct l_dbus_classic *classic,
+							const char *line)
+{
+	struct l_dbus *dbus = &classic->super;
+
+	switch (classic->auth_state) {
+	case WAITING_FOR_OK:
+		if (!strncmp(line, "OK ", 3)) {
+			l_free(dbus->guid);
+			dbus->guid = l_strdup(line + 3);
+
+			if (dbus->negotiate_unix_fd) {
+				classic->auth_state = WAITING_FOR_AGREE_UNIX_FD;
+				return "NEGOTIATE_UNIX_FD\r\n";
+			}
+
+			classic->auth_state = SETUP_DONE;
+			return "BEGIN\r\n";
+		} else if (!strncmp(line, "REJECTED ", 9)) {
+			dbus->negotiate_unix_fd = true;
+			classic->auth_state = WAITING_FOR_OK;
+			return "AUTH ANONYMOUS\r\n";
+		}
+		break;
+
+	case WAITING_FOR_AGREE_UNIX_FD:
+		if (!strncmp(line, "AGREE_UNIX_FD", 13)) {
+			dbus->support_unix_fd = true;
+			classic->auth_state = SETUP_DONE;
+			return "BEGIN\r\n";
+		} else if (!strncmp(line, "ERROR", 5)) {
+			dbus->support_unix_fd = false;
+			classic->auth_state = SETUP_DONE;
+			return "BEGIN\r\n";
+		}
+		break;
+
+	case SETUP_DONE:
+		break;
+	}
+
+	return NULL;
+}
+
+static bool auth_read_handler(struct l_io *io, void *user_data)
+{
+	struct l_dbus_classic *classic = user_data;
+	struct l_dbus *dbus = &classic->super;
+	char discard[sizeof(classic->auth_buf)];
+	const char *command = NULL;
+	char *line, *end;
+	size_t avail, pos = 0;
+	ssize_t len;
+	int fd;
+
+	fd = l_io_get_fd(io);
+
+	/*
+	 * With a pipelined handshake the reply to Hello can follow the last
+	 * line in the same read, so only peek and take out what is ours.
+	 */
+	len = L_TFR(recv(fd, classic->auth_buf + classic->auth_len,
+				sizeof(classic->auth_buf) - classic->auth_len,
+				MSG_PEEK | MSG_DONTWAIT));
+	if (len < 0)
+		return errno == EAGAIN;
+
+	if (!len)
+		return false;
+
+	avail = classic->auth_len + len;
+
+	while (classic->auth_state != SETUP_DONE) {
+		line = classic->auth_buf + pos;
+		end = memmem(line, avail - pos, "\r\n", 2);
+		if (!end)
+			break;
+
+		l_util_hexdump(true, line, end - line + 2,
+				dbus->debug_handler, dbus->debug_data);
+
+		*end = '\0';
+		pos = end + 2 - classic->auth_buf;
+
+		command = auth_process_line(classic, line);
+
+		/* BEGIN has already been sent, nothing to fall back to */
+		if (classic->auth_pipelined && classic->auth_state !=
+						WAITING_FOR_AGREE_UNIX_FD &&
+				classic->auth_state != SETUP_DONE) {
+			close(fd);
+			return false;
+		}
+	}
+
+	/* Bytes of an incomplete line can only belong to the handshake */
+	if (classic->auth_state == SETUP_DONE)
+		len = pos - classic->auth_len;
+
+	if (L_TFR(recv(fd, discard, len, MSG_DONTWAIT)) != len)
+		return false;
+
+	classic->auth_len = avail - pos;
+	memmove(classic->auth_buf, classic->auth_buf + pos, classic->auth_len);
+
+	if (classic->auth_len == sizeof(classic->auth_buf))
+		return false;
+
+	if (!classic->auth_pipelined) {
+		if (command) {
+			classic->auth_command = l_strdup(command);
+			l_io_set_write_handler(io, auth_write_handler,
+								dbus, NULL);
+		}
+
+		return true;
+	}
+
+	if (classic->auth_state != SETUP_DONE)
+		return true;
+
+	if (classic->skip_hello)
+		bus_ready(dbus);
+	else
+		l_io_set_read_handler(io, message_read_handler, dbus, NULL);
+
+	return true;
+}
+
+static void disconnect_handler(struct l_io *io, void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+
+	dbus->is_ready = false;
+
+	l_util_debug(dbus->debug_handler, dbus->debug_data, "disconnect");
+
+	if (dbus->disconnect_handler)
+		dbus->disconnect_handler(dbus->disconnect_data);
+}
+
+static struct thread_handoff *thread_handoff_ref(
+					struct thread_handoff *handoff)
+{
+	__atomic_fetch_add(&handoff->refcount, 1, __ATOMIC_RELAXED);
+
+	return handoff;
+}
+
+static void thread_handoff_unref(struct thread_handoff *handoff)
+{
+	if (__atomic_sub_fetch(&handoff->refcount, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	l_free(handoff);
+}
+
+static void dbus_init(struct l_dbus *dbus, int fd)
+{
+	unsigned int i;
+
+	dbus->io = l_io_new(fd);
+	dbus->loop = l_main_get_loop();
+	dbus->handoff = l_new(struct thread_handoff, 1);
+	dbus->handoff->refcount = 1;
+	dbus->handoff->dbus = dbus;
+	l_io_set_close_on_destroy(dbus->io, true);
+	l_io_set_disconnect_handler(dbus->io, disconnect_handler, dbus, NULL);
+
+	dbus->is_ready = false;
+	dbus->next_id = 1;
+	dbus->next_serial = 1;
+
+	for (i = 0; i < MESSAGE_LANE_COUNT; i++)
+		dbus->message_lanes[i] = l_queue_new();
+
+	memcpy(dbus->lane_credits, message_lane_weight,
+					sizeof(dbus->lane_credits));
+	dbus->message_list = l_hashmap_new();
+	dbus->signal_list = l_hashmap_new();
+
+	dbus->tree = _dbus_object_tree_new();
+}
+
+static void classic_free(struct l_dbus *dbus)
+{
+	struct l_dbus_classic *classic =
+		l_container_of(dbus, struct l_dbus_classic, super);
+	unsigned int i;
+
+	for (i = 0; i < classic->num_fds; i++)
+		close(classic->fd_buf[i]);
+	l_free(classic->fd_buf);
+
+	if (classic->recv_buf)
+		_dbus_buffer_unref(classic->recv_buf);
+
+	l_free(classic->auth_command);
+	l_hashmap_destroy(classic->match_strings, l_free);
+	l_free(classic);
+}
+
+static bool classic_send_messages(struct l_dbus *dbus,
+					struct l_dbus_message **messages,
+					unsigned int count)
+{
+	struct l_dbus_classic *classic =
+				l_container_of(dbus, struct l_dbus_classic, super);
+	int fd = l_io_get_fd(dbus->io);
+	struct msghdr msg;
+	struct iovec iov[1 + 2 * DBUS_SEND_BATCH], *iovpos;
+	ssize_t r;
+	int *fds = NULL;
+	uint32_t num_fds = 0;
+	struct cmsghdr *cmsg;
+	int iovlen;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		iov[1 + 2 * i].iov_base = _dbus_message_get_header(messages[i],
+						&iov[1 + 2 * i].iov_len);
+		iov[2 + 2 * i].iov_base = _dbus_message_get_body(messages[i],
+						&iov[2 + 2 * i].iov_len);
+	}
+
+	/* Only the first message of a batch may carry file descriptors */
+	if (dbus->support_unix_fd)
+		fds = _dbus_message_get_fds(messages[0], &num_fds);
+
+	iovpos = iov + 1;
+	iovlen = 2 * count;
+
+	/* A pipelined handshake goes out together with the Hello call */
+	if (classic->auth_command) {
+		iov[0].iov_base = classic->auth_command;
+		iov[0].iov_len = strlen(classic->auth_command);
+
+		l_util_hexdump(false, iov[0].iov_base, iov[0].iov_len,
+					dbus->debug_handler, dbus->debug_data);
+
+		iovpos = iov;
+		iovlen += 1;
+	}
+
+	while (1) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iovpos;
+		msg.msg_iovlen = iovlen;
+
+		if (num_fds) {
+			msg.msg_control =
+				alloca(CMSG_SPACE(num_fds * sizeof(int)));
+			msg.msg_controllen = CMSG_LEN(num_fds * sizeof(int));
+
+			cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_len = msg.msg_controllen;
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			memcpy(CMSG_DATA(cmsg), fds, num_fds * sizeof(int));
+		}
+
+		r = L_TFR(sendmsg(fd, &msg, 0));
+		if (r < 0)
+			return false;
+
+		while ((size_t) r >= iovpos->iov_len) {
+			r -= iovpos->iov_len;
+			iovpos++;
+			iovlen--;
+
+			if (!iovlen)
+				break;
+		}
+
+		if (!iovlen)
+			break;
+
+		iovpos->iov_base += r;
+		iovpos->iov_len -= r;
+
+		/* The FDs have been transmitted, don't retransmit */
+		num_fds = 0;
+	}
+
+	for (i = 0; i < count; i++)
+		PROBE(dbus_send, messages[i],
+			_dbus_message_get_serial(messages[i]));
+
+	l_free(classic->auth_command);
+	classic->auth_command = NULL;
+
+	return true;
+}
+
+static void classic_consume_fds(struct l_dbus_classic *classic,
+							unsigned int count)
+{
+	if (classic->num_fds > count) {
+		memmove(classic->fd_buf, classic->fd_buf + count,
+				(classic->num_fds - count) * sizeof(int));
+		classic->num_fds -= count;
+		return;
+	}
+
+	l_free(classic->fd_buf);
+
+	classic->fd_buf = NULL;
+	classic->num_fds = 0;
+}
+
+static void classic_close_fds(struct l_dbus_classic *classic,
+							unsigned int count)
+{
+	unsigned int i;
+
+	count = minsize(count, classic->num_fds);
+
+	for (i = 0; i < count; i++)
+		close(classic->fd_buf[i]);
+
+	classic_consume_fds(classic, count);
+}
+
+/*
+ * Receives into @iov, queueing up any file descriptors passed along with
+ * the data.  Returns the number of bytes received, 0 if nothing is pending
+ * and a negative value on errors.
+ */
+static ssize_t classic_recvmsg(struct l_dbus_classic *classic, int fd,
+					struct iovec *iov, int iovlen,
+					int flags)
+{
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	union {
+		uint8_t bytes[CMSG_SPACE(16 * sizeof(int))];
+		struct cmsghdr align;
+	} fd_buf;
+	int *fds;
+	uint32_t num_fds;
+	ssize_t r;
+	unsigned int i;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovlen;
+	msg.msg_control = &fd_buf;
+	msg.msg_controllen = sizeof(fd_buf);
+
+	r = L_TFR(recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | flags));
+	if (r < 0)
+		return errno == EAGAIN ? 0 : -errno;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+			cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+				cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		fds = (void *) CMSG_DATA(cmsg);
+
+		/* Set FD_CLOEXEC on all file descriptors */
+		for (i = 0; i < num_fds; i++) {
+			long flags;
+
+			flags = fcntl(fds[i], F_GETFD, NULL);
+			if (flags < 0)
+				continue;
+
+			if (!(flags & FD_CLOEXEC))
+				fcntl(fds[i], F_SETFD, flags | FD_CLOEXEC);
+		}
+
+		classic->fd_buf = l_realloc(classic->fd_buf,
+					(classic->num_fds + num_fds) *
+					sizeof(int));
+		memcpy(classic->fd_buf + classic->num_fds, fds,
+			num_fds * sizeof(int));
+		classic->num_fds += num_fds;
+	}
+
+	return r;
+}
+
+static bool recv_buf_shared(struct l_dbus_classic *classic)
+{
+	return __atomic_load_n(&classic->recv_buf->refcount,
+						__ATOMIC_SEQ_CST) > 1;
+}
+
+/*
+ * Moves the unparsed data to the start of the receive buffer.  If messages
+ * still point into the buffer, it is left to them and a new one is used.
+ */
+static void recv_buf_compact(struct l_dbus_classic *classic)
+{
+	struct _dbus_buffer *buf = classic->recv_buf;
+	size_t len = classic->recv_end - classic->recv_start;
+
+	if (recv_buf_shared(classic)) {
+		classic->recv_buf = _dbus_buffer_new(DBUS_RECV_BUFFER_SIZE);
+		memcpy(classic->recv_buf->data, buf->data + classic->recv_start,
+									len);
+		_dbus_buffer_unref(buf);
+	} else
+		memmove(buf->data, buf->data + classic->recv_start, len);
+
+	classic->recv_start = 0;
+	classic->recv_end = len;
+}
+
+/*
+ * Tops up the receive buffer with a single non-blocking read, making sure
+ * there is room for at least @want bytes of unparsed data.
+ */
+static bool recv_buf_fill(struct l_dbus_classic *classic, int fd,
+								size_t want)
+{
+	size_t len = classic->recv_end - classic->recv_start;
+	size_t room = classic->recv_buf->size - classic->recv_end;
+	struct iovec iov;
+	ssize_t r;
+
+	if (room < want - len || room < DBUS_RECV_BUFFER_SIZE / 4 ||
+			(!len && !recv_buf_shared(classic)))
+		recv_buf_compact(classic);
+
+	iov.iov_base = classic->recv_buf->data + classic->recv_end;
+	iov.iov_len = classic->recv_buf->size - classic->recv_end;
+
+	r = classic_recvmsg(classic, fd, &iov, 1, MSG_DONTWAIT);
+	if (r <= 0)
+		return false;
+
+	classic->recv_end += r;
+
+	/* A short read means the socket has been emptied for now */
+	if ((size_t) r < iov.iov_len)
+		classic->recv_drained = true;
+
+	return true;
+}
+
+/* Makes sure @want bytes are buffered, reading from the socket if needed */
+static bool recv_buf_want(struct l_dbus_classic *classic, int fd,
+								size_t want)
+{
+	while (classic->recv_end - classic->recv_start < want) {
+		if (classic->recv_drained) {
+			classic->recv_drained = false;
+			return false;
+		}
+
+		if (!recv_buf_fill(classic, fd, want))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Reads the remainder of a message that does not fit into the receive
+ * buffer straight into its final location.
+ */
+static bool recv_large_message(struct l_dbus_classic *classic, int fd,
+					void *header, size_t header_size,
+					void *body, size_t body_size)
+{
+	const uint8_t *have = classic->recv_buf->data + classic->recv_start;
+	size_t have_len = classic->recv_end - classic->recv_start;
+	struct iovec iov[2], *iovpos;
+	int iovlen;
+	ssize_t r;
+
+	iov[0].iov_base = header;
+	iov[0].iov_len = header_size;
+	iov[1].iov_base = body;
+	iov[1].iov_len = body_size;
+
+	iovpos = iov;
+	iovlen = 2;
+
+	/* Start with whatever was already buffered */
+	while (have_len >= iovpos->iov_len) {
+		memcpy(iovpos->iov_base, have, iovpos->iov_len);
+		have += iovpos->iov_len;
+		have_len -= iovpos->iov_len;
+		iovpos++;
+		iovlen--;
+	}
+
+	memcpy(iovpos->iov_base, have, have_len);
+	iovpos->iov_base += have_len;
+	iovpos->iov_len -= have_len;
+
+	classic->recv_start = classic->recv_end;
+
+	while (1) {
+		r = classic_recvmsg(classic, fd, iovpos, iovlen, MSG_WAITALL);
+		if (r <= 0)
+			return false;
+
+		while ((size_t) r >= iovpos->iov_len) {
+			r -= iovpos->iov_len;
+			iovpos++;
+			iovlen--;
+
+			if (!iovlen)
+				return true;
+		}
+
+		iovpos->iov_base += r;
+		iovpos->iov_len -= r;
+	}
+}
+
+static struct l_dbus_message *classic_recv_message(struct l_dbus *dbus)
+{
+	struct l_dbus_classic *classic =
+		l_container_of(dbus, struct l_dbus_classic, super);
+	int fd = l_io_get_fd(dbus->io);
+	struct dbus_header hdr;
+	struct _dbus_buffer *borrowed = NULL;
+	uint8_t *data;
+	void *header, *body;
+	size_t header_size, body_size;
+	uint32_t num_fds;
+	struct l_dbus_message *message;
+
+	if (!classic->recv_buf)
+		classic->recv_buf = _dbus_buffer_new(DBUS_RECV_BUFFER_SIZE);
+
+next:
+	/*
+	 * Parse as many messages as possible out of the buffered data and
+	 * only go back to the socket once a partial message is left.
+	 */
+	if (!recv_buf_want(classic, fd, DBUS_HEADER_SIZE))
+		return NULL;
+
+	memcpy(&hdr, classic->recv_buf->data + classic->recv_start,
+							DBUS_HEADER_SIZE);
+
+	header_size = align_len(DBUS_HEADER_SIZE + hdr.dbus1.field_length, 8);
+	body_size = hdr.dbus1.body_length;
+
+	if (header_size + body_size > classic->recv_buf->size) {
+		header = l_malloc(header_size);
+		body = l_malloc(body_size);
+
+		if (!recv_large_message(classic, fd, header, header_size,
+							body, body_size)) {
+			classic_close_fds(classic, classic->num_fds);
+			goto free_msg;
+		}
+
+		goto parse;
+	}
+
+	if (!recv_buf_want(classic, fd, header_size + body_size))
+		return NULL;
+
+	data = classic->recv_buf->data + classic->recv_start;
+	classic->recv_start += header_size + body_size;
+
+	/* The message is used in place, without copying it out */
+	borrowed = classic->recv_buf;
+	header = data;
+	body = data + header_size;
+
+parse:
+	if (hdr.endian != DBUS_NATIVE_ENDIAN) {
+		l_util_debug(dbus->debug_handler,
+				dbus->debug_data, "Endianness incorrect");
+		goto bad_msg;
+	}
+
+	if (hdr.version != 1) {
+		l_util_debug(dbus->debug_handler,
+				dbus->debug_data, "Protocol version incorrect");
+		goto bad_msg;
+	}
+
+	num_fds = _dbus_message_unix_fds_from_header(header, header_size);
+	if (num_fds > classic->num_fds) {
+		classic_close_fds(classic, classic->num_fds);
+		goto free_msg;
+	}
+
+	message = dbus_message_build(header, header_size, body, body_size,
+					classic->fd_buf, num_fds, borrowed);
+	if (message) {
+		classic_consume_fds(classic, num_fds);
+		PROBE(dbus_recv, message, header_size + body_size);
+		return message;
+	}
+
+bad_msg:
+	num_fds = _dbus_message_unix_fds_from_header(header, header_size);
+	classic_close_fds(classic, num_fds);
+
+free_msg:
+	if (!borrowed) {
+		l_free(header);
+		l_free(body);
+	}
+
+	borrowed = NULL;
+
+	/* Later messages may already be buffered, carry on with those */
+	goto next;
+}
+
+static bool classic_add_match(struct l_dbus *dbus, unsigned int id,
+				const struct _dbus_filter_condition *rule,
+				int rule_len)
+{
+	struct l_dbus_classic *classic =
+		l_container_of(dbus, struct l_dbus_classic, super);
+	char *match_str;
+	struct l_dbus_message *message;
+
+	match_str = _dbus_filter_rule_to_str(rule, rule_len);
+
+	l_hashmap_insert(classic->match_strings, L_UINT_TO_PTR(id), match_str);
+
+	message = l_dbus_message_new_method_call(dbus,
+						DBUS_SERVICE_DBUS,
+						DBUS_PATH_DBUS,
+						L_DBUS_INTERFACE_DBUS,
+						"AddMatch");
+
+	l_dbus_message_set_arguments(message, "s", match_str);
+
+	send_message(dbus, false, message, NULL, NULL, NULL);
+
+	return true;
+}
+
+static bool classic_remove_match(struct l_dbus *dbus, unsigned int id)
+{
+	struct l_dbus_classic *classic =
+		l_container_of(dbus, struct l_dbus_classic, super);
+	char *match_str = l_hashmap_remove(classic->match_strings,
+						L_UINT_TO_PTR(id));
+	struct l_dbus_message *message;
+
+	if (!match_str)
+		return false;
+
+	message = l_dbus_message_new_method_call(dbus,
+						DBUS_SERVICE_DBUS,
+						DBUS_PATH_DBUS,
+						L_DBUS_INTERFACE_DBUS,
+						"RemoveMatch");
+
+	l_dbus_message_set_arguments(message, "s", match_str);
+
+	send_message(dbus, false, message, NULL, NULL, NULL);
+
+	l_free(match_str);
+
+	return true;
+}
+
+static void name_owner_changed_cb(struct l_dbus_message *message,
+					void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+	char *name, *old, *new;
+
+	if (!l_dbus_message_get_arguments(message, "sss", &name, &old, &new))
+		return;
+
+	_dbus_name_cache_notify(dbus->name_cache, name, new);
+}
+
+static void enable_name_notify(struct l_dbus *bus)
+{
+	static struct _dbus_filter_condition rule[] = {
+		{ L_DBUS_MATCH_TYPE,		"signal" },
+		{ L_DBUS_MATCH_SENDER,		DBUS_SERVICE_DBUS },
+		{ L_DBUS_MATCH_PATH,		DBUS_PATH_DBUS },
+		{ L_DBUS_MATCH_INTERFACE,	L_DBUS_INTERFACE_DBUS },
+		{ L_DBUS_MATCH_MEMBER,		"NameOwnerChanged" },
+	};
+
+	if (bus->name_notify_enabled)
+		return;
+
+	/* Adding the rule watches DBUS_SERVICE_DBUS and gets us back here */
+	bus->name_notify_enabled = true;
+
+	if (!bus->filter)
+		bus->filter = _dbus_filter_new(bus, &bus->driver->filter_ops,
+						bus->name_cache);
+
+	_dbus_filter_add_rule(bus->filter, rule, L_ARRAY_SIZE(rule),
+				name_owner_changed_cb, bus);
+}
+
+struct get_name_owner_request {
+	struct l_dbus_message *message;
+	struct l_dbus *dbus;
+};
+
+static void get_name_owner_reply_cb(struct l_dbus_message *reply,
+					void *user_data)
+{
+	struct get_name_owner_request *req = user_data;
+	const char *name, *owner;
+
+	/* Shouldn't happen */
+	if (!l_dbus_message_get_arguments(req->message, "s", &name))
+		return;
+
+	/* No name owner yet, remember that too */
+	if (l_dbus_message_is_error(reply)) {
+		_dbus_name_cache_notify(req->dbus->name_cache, name, NULL);
+		return;
+	}
+
+	/* Shouldn't happen */
+	if (!l_dbus_message_get_arguments(reply, "s", &owner))
+		return;
+
+	_dbus_name_cache_notify(req->dbus->name_cache, name, owner);
+}
+
+static bool classic_get_name_owner(struct l_dbus *bus, const char *name)
+{
+	struct get_name_owner_request *req;
+
+	/* Name resolution is not performed for DBUS_SERVICE_DBUS */
+	if (!strcmp(name, DBUS_SERVICE_DBUS))
+		return false;
+
+	req = l_new(struct get_name_owner_request, 1);
+	req->dbus = bus;
+	req->message = l_dbus_message_new_method_call(bus,
+							DBUS_SERVICE_DBUS,
+							DBUS_PATH_DBUS,
+							L_DBUS_INTERFACE_DBUS,
+							"GetNameOwner");
+
+	l_dbus_message_set_arguments(req->message, "s", name);
+
+	send_message(bus, false, req->message, get_name_owner_reply_cb,
+			req, l_free);
+
+	enable_name_notify(bus);
+
+	return true;
+}
+
+static void list_names_reply_cb(struct l_dbus_message *reply, void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+	struct l_dbus_message_iter iter, count_iter;
+	const char *name;
+	const char **names;
+	unsigned int n = 0;
+
+	if (!l_dbus_message_get_arguments(reply, "as", &iter))
+		return;
+
+	count_iter = iter;
+
+	while (l_dbus_message_iter_next_entry(&count_iter, &name))
+		n++;
+
+	names = l_new(const char *, n + 1);
+	n = 0;
+
+	while (l_dbus_message_iter_next_entry(&iter, &name))
+		names[n++] = name;
+
+	_dbus_name_cache_set_bus_names(dbus->name_cache, (char **) names);
+	l_free(names);
+}
+
+static bool classic_list_names(struct l_dbus *bus)
+{
+	struct l_dbus_message *message;
+
+	/* Changes after the snapshot must reach us, so subscribe first */
+	enable_name_notify(bus);
+
+	message = l_dbus_message_new_method_call(bus, DBUS_SERVICE_DBUS,
+							DBUS_PATH_DBUS,
+							L_DBUS_INTERFACE_DBUS,
+							"ListNames");
+
+	l_dbus_message_set_arguments(message, "");
+
+	send_message(bus, false, message, list_names_reply_cb, bus, NULL);
+
+	return true;
+}
+
+struct name_request {
+	l_dbus_name_acquire_func_t callback;
+	void *user_data;
+	struct l_dbus *dbus;
+};
+
+enum dbus_name_flag {
+	DBUS_NAME_FLAG_ALLOW_REPLACEMENT	= 0x1,
+	DBUS_NAME_FLAG_REPLACE_EXISTING		= 0x2,
+	DBUS_NAME_FLAG_DO_NOT_QUEUE		= 0x4,
+};
+
+enum dbus_name_reply {
+	DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER	= 1,
+	DBUS_REQUEST_NAME_REPLY_IN_QUEUE	= 2,
+	DBUS_REQUEST_NAME_REPLY_EXISTS		= 3,
+	DBUS_REQUEST_NAME_REPLY_ALREADY_OWNER	= 4,
+};
+
+static void request_name_reply_cb(struct l_dbus_message *reply, void *user_data)
+{
+	struct name_request *req = user_data;
+	bool success = false, queued = false;
+	uint32_t retval;
+
+	if (!req->callback)
+		return;
+
+	/* No name owner yet */
+	if (l_dbus_message_is_error(reply))
+		goto call_back;
+
+	/* Shouldn't happen */
+	if (!l_dbus_message_get_arguments(reply, "u", &retval))
+		goto call_back;
+
+	success = (retval == DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) ||
+		(retval == DBUS_REQUEST_NAME_REPLY_ALREADY_OWNER) ||
+		(retval == DBUS_REQUEST_NAME_REPLY_IN_QUEUE);
+	queued = (retval == DBUS_REQUEST_NAME_REPLY_IN_QUEUE);
+
+call_back:
+	req->callback(req->dbus, success, queued, req->user_data);
+}
+
+static uint32_t classic_name_acquire(struct l_dbus *dbus, const char *name,
+					bool allow_replacement,
+					bool replace_existing, bool queue,
+					l_dbus_name_acquire_func_t callback,
+					void *user_data)
+{
+	struct name_request *req;
+	struct l_dbus_message *message;
+	uint32_t flags = 0;
+
+	req = l_new(struct name_request, 1);
+	req->dbus = dbus;
+	req->user_data = user_data;
+	req->callback = callback;
+
+	message = l_dbus_message_new_method_call(dbus, DBUS_SERVICE_DBUS,
+							DBUS_PATH_DBUS,
+							L_DBUS_INTERFACE_DBUS,
+							"RequestName");
+
+	if (allow_replacement)
+		flags |= DBUS_NAME_FLAG_ALLOW_REPLACEMENT;
+
+	if (replace_existing)
+		flags |= DBUS_NAME_FLAG_REPLACE_EXISTING;
+
+	if (!queue)
+		flags |= DBUS_NAME_FLAG_DO_NOT_QUEUE;
+
+	l_dbus_message_set_arguments(message, "su", name, flags);
+
+	return send_message(dbus, false, message, request_name_reply_cb,
+				req, free);
+}
+
+static const struct l_dbus_ops classic_ops = {
+	.version = 1,
+	.send_messages = classic_send_messages,
+	.recv_message = classic_recv_message,
+	.free = classic_free,
+	.name_ops = {
+		.get_name_owner = classic_get_name_owner,
+		.list_names = classic_list_names,
+	},
+	.filter_ops = {
+		.add_match = classic_add_match,
+		.remove_match = classic_remove_match,
+	},
+	.name_acquire = classic_name_acquire,
+};
+
+static struct l_dbus *setup_dbus1(int fd, const char *guid, bool skip_hello)
+{
+	static const unsigned char creds = 0x00;
+	char uid[6], hexuid[12], *ptr = hexuid;
+	struct l_dbus *dbus;
+	struct l_dbus_classic *classic;
+	struct l_dbus_message *message;
+	ssize_t written;
 	unsigned int i;
 
-	len = recv(fd, &hdr, DBUS_HEADER_SIZE, MSG_PEEK | MSG_DONTWAIT);
-	if (len != DBUS_HEADER_SIZE)
+	if (snprintf(uid, sizeof(uid), "%d", geteuid()) < 1) {
+		close(fd);
 		return NULL;
+	}
 
-	header_size = align_len(DBUS_HEADER_SIZE + hdr.dbus1.field_length, 8);
-	header = l_malloc(header_size);
+	for (i = 0; i < strlen(uid); i++)
+		ptr += sprintf(ptr, "%02x", uid[i]);
 
-	body_size = hdr.dbus1.body_length;
-	body = l_malloc(body_size);
+	/* Send special credentials-passing nul byte */
+	written = L_TFR(send(fd, &creds, 1, 0));
+	if (written < 1) {
+		close(fd);
+		return NULL;
+	}
 
-	iov[0].iov_base = header;
-	iov[0].iov_len  = header_size;
-	iov[1].iov_base = body;
-	iov[1].iov_len  = body_size;
+	classic = l_new(struct l_dbus_classic, 1);
+	dbus = &classic->super;
+	dbus->driver = &classic_ops;
 
-	iovpos = iov;
-	iovlen = 2;
+	classic->match_strings = l_hashmap_new();
 
-	while (1) {
-		memset(&msg, 0, sizeof(msg));
-		msg.msg_iov = iovpos;
-		msg.msg_iovlen = iovlen;
-		msg.msg_control = &fd_buf;
-		msg.msg_controllen = sizeof(fd_buf);
+	dbus_init(dbus, fd);
+	dbus->guid = l_strdup(guid);
 
-		r = L_TFR(recvmsg(fd, &msg,
-					MSG_CMSG_CLOEXEC | MSG_WAITALL));
-		if (r < 0)
-			goto cmsg_fail;
+	/*
+	 * Send the whole handshake up front, followed by Hello in the same
+	 * write, so that connecting takes a single round-trip.  This gives
+	 * up the fallback to ANONYMOUS, which unix sockets do not need.
+	 */
+	classic->auth_command = l_strdup_printf("AUTH EXTERNAL %s\r\n"
+						"NEGOTIATE_UNIX_FD\r\n"
+						"BEGIN\r\n", hexuid);
+	classic->auth_state = WAITING_FOR_OK;
+	classic->auth_pipelined = true;
+	classic->skip_hello = skip_hello;
 
-		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
-				cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-			if (cmsg->cmsg_level != SOL_SOCKET ||
-					cmsg->cmsg_type != SCM_RIGHTS)
-				continue;
+	dbus->negotiate_unix_fd = true;
+	dbus->support_unix_fd = false;
 
-			num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
-			fds = (void *) CMSG_DATA(cmsg);
+	l_io_set_read_handler(dbus->io, auth_read_handler, dbus, NULL);
 
-			/* Set FD_CLOEXEC on all file descriptors */
-			for (i = 0; i < num_fds; i++) {
-				long flags;
+	if (skip_hello) {
+		l_io_set_write_handler(dbus->io, auth_write_handler,
+								dbus, NULL);
+		return dbus;
+	}
 
-				flags = fcntl(fds[i], F_GETFD, NULL);
-				if (flags < 0)
-					continue;
+	message = l_dbus_message_new_method_call(dbus, DBUS_SERVICE_DBUS,
+							DBUS_PATH_DBUS,
+							L_DBUS_INTERFACE_DBUS,
+							"Hello");
+	l_dbus_message_set_arguments(message, "");
 
-				if (!(flags & FD_CLOEXEC))
-					fcntl(fds[i], F_SETFD,
-						flags | FD_CLOEXEC);
-			}
+	send_message(dbus, true, message, hello_callback, dbus, NULL);
 
-			classic->fd_buf = l_realloc(classic->fd_buf,
-						(classic->num_fds + num_fds) *
-						sizeof(int));
-			memcpy(classic->fd_buf + classic->num_fds, fds,
-				num_fds * sizeof(int));
-			classic->num_fds += num_fds;
-		}
+	return dbus;
+}
 
-		while ((size_t) r >= iovpos->iov_len) {
-			r -= iovpos->iov_len;
-			iovpos++;
-			iovlen--;
+static struct l_dbus *setup_unix(char *params)
+{
+	char *path = NULL, *guid = NULL;
+	bool abstract = false;
+	struct sockaddr_un addr;
+	size_t len;
+	int fd;
 
-			if (!iovlen)
-				break;
-		}
+	while (params) {
+		char *key = strsep(&params, ",");
+		char *value;
 
-		if (!iovlen)
+		if (!key)
 			break;
 
-		iovpos->iov_base += r;
-		iovpos->iov_len -= r;
+		value = strchr(key, '=');
+		if (!value)
+			continue;
+
+		*value++ = '\0';
+
+		if (!strcmp(key, "path")) {
+			path = value;
+			abstract = false;
+		} else if (!strcmp(key, "abstract")) {
+			path = value;
+			abstract = true;
+		} else if (!strcmp(key, "guid"))
+			guid = value;
 	}
 
-	if (hdr.endian != DBUS_NATIVE_ENDIAN) {
-		l_util_debug(dbus->debug_handler,
-				dbus->debug_data, "Endianness incorrect");
-		goto bad_msg;
+	if (!path)
+		return NULL;
+
+	fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return NULL;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	len = strlen(path);
+
+	if (abstract) {
+		if (len > sizeof(addr.sun_path) - 1) {
+			close(fd);
+			return NULL;
+		}
+
+		addr.sun_path[0] = '\0';
+		strncpy(addr.sun_path + 1, path, sizeof(addr.sun_path) - 2);
+		len++;
+	} else {
+		if (len > sizeof(addr.sun_path)) {
+			close(fd);
+			return NULL;
+		}
+
+		strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
 	}
 
-	if (hdr.version != 1) {
-		l_util_debug(dbus->debug_handler,
-				dbus->debug_data, "Protocol version incorrect");
-		goto bad_msg;
+	if (connect(fd, (struct sockaddr *) &addr,
+				sizeof(addr.sun_family) + len) < 0) {
+		close(fd);
+		return NULL;
 	}
 
-	num_fds = _dbus_message_unix_fds_from_header(header, header_size);
-	if (num_fds > classic->num_fds)
-		goto bad_msg;
+	return setup_dbus1(fd, guid, false);
+}
 
-	message = dbus_message_build(header, header_size, body, body_size,
-					classic->fd_buf, num_fds);
-
-	if (message && num_fds) {
-		if (classic->num_fds > num_fds) {
-			memmove(classic->fd_buf, classic->fd_buf + num_fds,
-				(classic->num_fds - num_fds) * sizeof(int));
-			classic->num_fds -= num_fds;
-		} else {
-			l_free(classic->fd_buf);
-
-			classic->fd_buf = NULL;
-			classic->num_fds = 0;
+static bool setup_tcp_cb(struct l_io *io, void *user_data)
+{
+	static const unsigned char creds = 0x00;
+	struct l_dbus *dbus = user_data;
+	struct l_dbus_classic *classic;
+	ssize_t written;
+	int fd = l_io_get_fd(io);
+
+	/* Send special credentials-passing nul byte */
+	written = L_TFR(send(fd, &creds, 1, 0));
+	if (written < 1) {
+		l_util_debug(dbus->debug_handler, dbus->debug_handler,
+						"error writing NUL byte");
+		close(fd);
+		return false;
+	}
+
+	dbus->driver = &classic_ops;
+	dbus->negotiate_unix_fd = false;
+	dbus->support_unix_fd = false;
+
+	classic = l_container_of(dbus, struct l_dbus_classic, super);
+	classic->match_strings = l_hashmap_new();
+	classic->auth_command = l_strdup("AUTH ANONYMOUS\r\n");
+	classic->auth_state = WAITING_FOR_OK;
+
+	l_io_set_read_handler(dbus->io, auth_read_handler, dbus, NULL);
+	l_io_set_write_handler(dbus->io, auth_write_handler, dbus, NULL);
+
+	return auth_write_handler(dbus->io, dbus);
+}
+
+static struct l_dbus *setup_tcp(char *params)
+{
+	char *host = NULL;
+	char *port = NULL;
+	char *family = NULL;
+	struct addrinfo hints = { 0 };
+	struct addrinfo *res;
+	struct addrinfo *iter;
+	struct l_dbus *dbus = NULL;
+
+	while (params) {
+		char *key = strsep(&params, ",");
+		char *value;
+
+		value = strchr(key, '=');
+		if (!value)
+			continue;
+
+		*value++ = '\0';
+
+		if (!strcmp(key, "host"))
+			host = value;
+		else if (!strcmp(key, "port"))
+			port = value;
+		else if (!strcmp(key, "family"))
+			family = value;
+	}
+
+	if (!host || !port)
+		return NULL;
+
+	if (!family)
+		hints.ai_family = AF_UNSPEC;
+	else if (!strcmp(family, "ipv4"))
+		hints.ai_family = AF_INET;
+	else if (!strcmp(family, "ipv6"))
+		hints.ai_family = AF_INET6;
+	else
+		return NULL;
+
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	if (getaddrinfo(host, port, &hints, &res) != 0)
+		return NULL;
+
+	for (iter = res; iter; iter = iter->ai_next) {
+		int fd;
+		struct l_dbus_classic *classic;
+
+		fd = socket(iter->ai_family, iter->ai_socktype | SOCK_NONBLOCK,
+					iter->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		if (connect(fd, iter->ai_addr, iter->ai_addrlen) < 0) {
+			if (errno != EINPROGRESS) {
+				close(fd);
+				continue;
+			}
 		}
+
+		classic = l_new(struct l_dbus_classic, 1);
+		dbus = &classic->super;
+		dbus_init(dbus, fd);
+		l_io_set_write_handler(dbus->io, setup_tcp_cb, dbus, NULL);
+		break;
 	}
 
-	if (message)
-		return message;
+	freeaddrinfo(res);
+	return dbus;
+}
 
-bad_msg:
-cmsg_fail:
-	for (i = 0; i < classic->num_fds; i++)
-		close(classic->fd_buf[i]);
+static struct l_dbus *setup_address(const char *address)
+{
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_DBUS);
+	struct l_dbus *dbus = NULL;
+	char *address_copy;
 
-	l_free(classic->fd_buf);
+	address_copy = strdupa(address);
+
+	while (address_copy) {
+		char *transport = strsep(&address_copy, ";");
+		char *params;
+
+		if (!transport)
+			break;
+
+		params = strchr(transport, ':');
+		if (params)
+			*params++ = '\0';
+
+		if (!strcmp(transport, "unix")) {
+			/* Function will modify params string */
+			dbus = setup_unix(params);
+			break;
+		} else if (!strcmp(transport, "tcp")) {
+			dbus = setup_tcp(params);
+			break;
+		}
+	}
 
-	classic->fd_buf = NULL;
-	classic->num_fds = 0;
+	return dbus;
+}
 
-	l_free(header);
-	l_free(body);
+LIB_EXPORT struct l_dbus *l_dbus_new(const char *address)
+{
+	if (unlikely(!address))
+		return NULL;
 
-	return NULL;
+	return setup_address(address);
 }
 
-static bool classic_add_match(struct l_dbus *dbus, unsigned int id,
-				const struct _dbus_filter_condition *rule,
-				int rule_len)
+LIB_EXPORT struct l_dbus *l_dbus_new_default(enum l_dbus_bus bus)
 {
-	struct l_dbus_classic *classic =
-		l_container_of(dbus, struct l_dbus_classic, super);
-	char *match_str;
-	struct l_dbus_message *message;
+	const char *address;
 
-	match_str = _dbus_filter_rule_to_str(rule, rule_len);
+	switch (bus) {
+	case L_DBUS_SYSTEM_BUS:
+		address = getenv("DBUS_SYSTEM_BUS_ADDRESS");
+		if (!address)
+			address = DEFAULT_SYSTEM_BUS_ADDRESS;
+		break;
+	case L_DBUS_SESSION_BUS:
+		address = getenv("DBUS_SESSION_BUS_ADDRESS");
+		if (!address)
+			return NULL;
+		break;
+	default:
+		return NULL;
+	}
 
-	l_hashmap_insert(classic->match_strings, L_UINT_TO_PTR(id), match_str);
+	return setup_address(address);
+}
 
-	message = l_dbus_message_new_method_call(dbus,
-						DBUS_SERVICE_DBUS,
-						DBUS_PATH_DBUS,
-						L_DBUS_INTERFACE_DBUS,
-						"AddMatch");
+LIB_EXPORT struct l_dbus *l_dbus_new_private(int fd)
+{
+	return setup_dbus1(fd, NULL, true);
+}
 
-	l_dbus_message_set_arguments(message, "s", match_str);
+LIB_EXPORT void l_dbus_destroy(struct l_dbus *dbus)
+{
+	unsigned int i;
 
-	send_message(dbus, false, message, NULL, NULL, NULL);
+	if (unlikely(!dbus))
+		return;
 
-	return true;
-}
+	if (dbus->destroyed)
+		*dbus->destroyed = true;
 
-static bool classic_remove_match(struct l_dbus *dbus, unsigned int id)
-{
-	struct l_dbus_classic *classic =
-		l_container_of(dbus, struct l_dbus_classic, super);
-	char *match_str = l_hashmap_remove(classic->match_strings,
-						L_UINT_TO_PTR(id));
-	struct l_dbus_message *message;
+	l_queue_destroy(dbus->peer_links,
+				(l_queue_destroy_func_t) l_dbus_destroy);
 
-	if (!match_str)
-		return false;
+	if (dbus->handoff) {
+		dbus->handoff->dbus = NULL;
+		thread_handoff_unref(dbus->handoff);
+	}
+	l_free(dbus->peer_name);
+	l_free(dbus->peer_alias);
 
-	message = l_dbus_message_new_method_call(dbus,
-						DBUS_SERVICE_DBUS,
-						DBUS_PATH_DBUS,
-						L_DBUS_INTERFACE_DBUS,
-						"RemoveMatch");
+	if (dbus->ready_destroy)
+		dbus->ready_destroy(dbus->ready_data);
 
-	l_dbus_message_set_arguments(message, "s", match_str);
+	_dbus_filter_free(dbus->filter);
 
-	send_message(dbus, false, message, NULL, NULL, NULL);
+	_dbus_name_cache_free(dbus->name_cache);
 
-	l_free(match_str);
+	l_hashmap_destroy(dbus->signal_list, signal_list_destroy);
+	l_hashmap_destroy(dbus->message_list, message_list_destroy);
+	for (i = 0; i < MESSAGE_LANE_COUNT; i++)
+		l_queue_destroy(dbus->message_lanes[i], message_queue_destroy);
 
-	return true;
-}
+	l_idle_remove(dbus->backpressure_work);
 
-static void name_owner_changed_cb(struct l_dbus_message *message,
-					void *user_data)
-{
-	struct l_dbus *dbus = user_data;
-	char *name, *old, *new;
+	if (dbus->backpressure_destroy)
+		dbus->backpressure_destroy(dbus->backpressure_data);
+	l_timeout_remove(dbus->reply_timeout);
+	l_hashmap_destroy(dbus->reply_stats, l_free);
+	l_free(dbus->traffic);
+	l_hashmap_destroy(dbus->member_stats, member_stats_free);
 
-	if (!l_dbus_message_get_arguments(message, "sss", &name, &old, &new))
-		return;
+	if (dbus->slow_destroy)
+		dbus->slow_destroy(dbus->slow_data);
 
-	_dbus_name_cache_notify(dbus->name_cache, name, new);
-}
+	l_io_destroy(dbus->io);
 
-struct get_name_owner_request {
-	struct l_dbus_message *message;
-	struct l_dbus *dbus;
-};
+	/* Set up by the disconnect handler of a peer link */
+	l_idle_remove(dbus->peer_close_work);
 
-static void get_name_owner_reply_cb(struct l_dbus_message *reply,
-					void *user_data)
-{
-	struct get_name_owner_request *req = user_data;
-	const char *name, *owner;
+	if (dbus->disconnect_destroy)
+		dbus->disconnect_destroy(dbus->disconnect_data);
 
-	/* No name owner yet */
-	if (l_dbus_message_is_error(reply))
-		return;
+	if (dbus->debug_destroy)
+		dbus->debug_destroy(dbus->debug_data);
 
-	/* Shouldn't happen */
-	if (!l_dbus_message_get_arguments(reply, "s", &owner))
-		return;
+	l_free(dbus->guid);
+	l_free(dbus->unique_name);
 
-	/* Shouldn't happen */
-	if (!l_dbus_message_get_arguments(req->message, "s", &name))
-		return;
+	_dbus_object_tree_free(dbus->tree);
 
-	_dbus_name_cache_notify(req->dbus->name_cache, name, owner);
+	dbus->driver->free(dbus);
 }
 
-static bool classic_get_name_owner(struct l_dbus *bus, const char *name)
+LIB_EXPORT bool l_dbus_set_ready_handler(struct l_dbus *dbus,
+				l_dbus_ready_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy)
 {
-	struct get_name_owner_request *req;
-
-	/* Name resolution is not performed for DBUS_SERVICE_DBUS */
-	if (!strcmp(name, DBUS_SERVICE_DBUS))
+	if (unlikely(!dbus))
 		return false;
 
-	req = l_new(struct get_name_owner_request, 1);
-	req->dbus = bus;
-	req->message = l_dbus_message_new_method_call(bus,
-							DBUS_SERVICE_DBUS,
-							DBUS_PATH_DBUS,
-							L_DBUS_INTERFACE_DBUS,
-							"GetNameOwner");
+	if (dbus->ready_destroy)
+		dbus->ready_destroy(dbus->ready_data);
 
-	l_dbus_message_set_arguments(req->message, "s", name);
+	dbus->ready_handler = function;
+	dbus->ready_destroy = destroy;
+	dbus->ready_data = user_data;
 
-	send_message(bus, false, req->message, get_name_owner_reply_cb,
-			req, l_free);
+	return true;
+}
 
-	if (!bus->name_notify_enabled) {
-		static struct _dbus_filter_condition rule[] = {
-			{ L_DBUS_MATCH_TYPE,		"signal" },
-			{ L_DBUS_MATCH_SENDER,		DBUS_SERVICE_DBUS },
-			{ L_DBUS_MATCH_PATH,		DBUS_PATH_DBUS },
-			{ L_DBUS_MATCH_INTERFACE,	L_DBUS_INTERFACE_DBUS },
-			{ L_DBUS_MATCH_MEMBER,		"NameOwnerChanged" },
-		};
-
-		if (!bus->filter)
-			bus->filter = _dbus_filter_new(bus,
-						&bus->driver->filter_ops,
-						bus->name_cache);
+LIB_EXPORT bool l_dbus_set_disconnect_handler(struct l_dbus *dbus,
+				l_dbus_disconnect_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy)
+{
+	if (unlikely(!dbus))
+		return false;
 
-		_dbus_filter_add_rule(bus->filter, rule, L_ARRAY_SIZE(rule),
-					name_owner_changed_cb, bus);
+	if (dbus->disconnect_destroy)
+		dbus->disconnect_destroy(dbus->disconnect_data);
 
-		bus->name_notify_enabled = true;
-	}
+	dbus->disconnect_handler = function;
+	dbus->disconnect_destroy = destroy;
+	dbus->disconnect_data = user_data;
 
 	return true;
 }
 
-struct name_request {
-	l_dbus_name_acquire_func_t callback;
-	void *user_data;
-	struct l_dbus *dbus;
-};
+/**
+ * l_dbus_set_priority_lanes:
+ * @dbus: D-Bus connection
+ * @enabled: whether replies and method calls may overtake queued signals
+ *
+ * By default messages are written in the order they were sent.  When
+ * enabled, queued replies, method calls and signals are written in a
+ * weighted round-robin that favours replies, so that a burst of signals
+ * does not hold up replies.  Only enable this if no peer relies on the
+ * order of signals relative to replies on this connection, for example
+ * to keep a cache filled by GetManagedObjects up to date.
+ *
+ * Returns: true on success
+ **/
+LIB_EXPORT bool l_dbus_set_priority_lanes(struct l_dbus *dbus, bool enabled)
+{
+	if (unlikely(!dbus))
+		return false;
 
-enum dbus_name_flag {
-	DBUS_NAME_FLAG_ALLOW_REPLACEMENT	= 0x1,
-	DBUS_NAME_FLAG_REPLACE_EXISTING		= 0x2,
-	DBUS_NAME_FLAG_DO_NOT_QUEUE		= 0x4,
-};
+	dbus->priority_lanes = enabled;
 
-enum dbus_name_reply {
-	DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER	= 1,
-	DBUS_REQUEST_NAME_REPLY_IN_QUEUE	= 2,
-	DBUS_REQUEST_NAME_REPLY_EXISTS		= 3,
-	DBUS_REQUEST_NAME_REPLY_ALREADY_OWNER	= 4,
-};
+	return true;
+}
 
-static void request_name_reply_cb(struct l_dbus_message *reply, void *user_data)
+/**
+ * l_dbus_set_signal_backpressure_handler:
+ * @dbus: D-Bus connection
+ * @high_water: number of queued signals that counts as congested, 0 to
+ *	stop watching
+ * @function: called with true once @high_water signals are waiting to be
+ *	written, and with false once no more than half as many are left
+ * @user_data: user data passed to @function
+ * @destroy: called to destroy @user_data
+ *
+ * Lets a busy signal emitter throttle itself.  @function is called from
+ * an idle callback, never from inside l_dbus_send.
+ *
+ * Returns: true on success
+ **/
+LIB_EXPORT bool l_dbus_set_signal_backpressure_handler(struct l_dbus *dbus,
+				unsigned int high_water,
+				l_dbus_backpressure_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy)
 {
-	struct name_request *req = user_data;
-	bool success = false, queued = false;
-	uint32_t retval;
-
-	if (!req->callback)
-		return;
+	if (unlikely(!dbus))
+		return false;
 
-	/* No name owner yet */
-	if (l_dbus_message_is_error(reply))
-		goto call_back;
+	if (dbus->backpressure_destroy)
+		dbus->backpressure_destroy(dbus->backpressure_data);
 
-	/* Shouldn't happen */
-	if (!l_dbus_message_get_arguments(reply, "u", &retval))
-		goto call_back;
+	dbus->backpressure_handler = function;
+	dbus->backpressure_destroy = destroy;
+	dbus->backpressure_data = user_data;
 
-	success = (retval == DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) ||
-		(retval == DBUS_REQUEST_NAME_REPLY_ALREADY_OWNER) ||
-		(retval == DBUS_REQUEST_NAME_REPLY_IN_QUEUE);
-	queued = (retval == DBUS_REQUEST_NAME_REPLY_IN_QUEUE);
+	dbus->signals_high_water = high_water;
+	dbus->signals_congested = false;
+	dbus->signals_congested_notified = false;
+	backpressure_update(dbus);
 
-call_back:
-	req->callback(req->dbus, success, queued, req->user_data);
+	return true;
 }
 
-static uint32_t classic_name_acquire(struct l_dbus *dbus, const char *name,
-					bool allow_replacement,
-					bool replace_existing, bool queue,
-					l_dbus_name_acquire_func_t callback,
-					void *user_data)
+static void peer_link_collect(const void *key, void *value, void *user_data)
 {
-	struct name_request *req;
-	struct l_dbus_message *message;
-	uint32_t flags = 0;
-
-	req = l_new(struct name_request, 1);
-	req->dbus = dbus;
-	req->user_data = user_data;
-	req->callback = callback;
-
-	message = l_dbus_message_new_method_call(dbus, DBUS_SERVICE_DBUS,
-							DBUS_PATH_DBUS,
-							L_DBUS_INTERFACE_DBUS,
-							"RequestName");
-
-	if (allow_replacement)
-		flags |= DBUS_NAME_FLAG_ALLOW_REPLACEMENT;
+	l_queue_push_tail(user_data, value);
+}
 
-	if (replace_existing)
-		flags |= DBUS_NAME_FLAG_REPLACE_EXISTING;
+/* Fails the calls still waiting for a reply instead of dropping them */
+static void peer_link_free(struct l_dbus *link)
+{
+	struct l_queue *pending = l_queue_new();
+	struct message_callback *callback;
 
-	if (!queue)
-		flags |= DBUS_NAME_FLAG_DO_NOT_QUEUE;
+	l_hashmap_foreach(link->message_list, peer_link_collect, pending);
 
-	l_dbus_message_set_arguments(message, "su", name, flags);
+	while ((callback = l_queue_pop_head(pending)))
+		reply_abort(link, callback, REPLY_DROPPED, "Peer link closed");
 
-	return send_message(dbus, false, message, request_name_reply_cb,
-				req, free);
+	l_queue_destroy(pending, NULL);
+	l_dbus_destroy(link);
 }
 
-static const struct l_dbus_ops classic_ops = {
-	.version = 1,
-	.send_message = classic_send_message,
-	.recv_message = classic_recv_message,
-	.free = classic_free,
-	.name_ops = {
-		.get_name_owner = classic_get_name_owner,
-	},
-	.filter_ops = {
-		.add_match = classic_add_match,
-		.remove_match = classic_remove_match,
-	},
-	.name_acquire = classic_name_acquire,
-};
-
-static struct l_dbus *setup_dbus1(int fd, const char *guid, bool skip_hello)
+static void peer_link_close_work(struct l_idle *idle, void *user_data)
 {
-	static const unsigned char creds = 0x00;
-	char uid[6], hexuid[12], *ptr = hexuid;
-	struct l_dbus *dbus;
-	struct l_dbus_classic *classic;
-	ssize_t written;
-	unsigned int i;
+	struct l_dbus *link = user_data;
 
-	if (snprintf(uid, sizeof(uid), "%d", geteuid()) < 1) {
-		close(fd);
-		return NULL;
-	}
+	l_queue_remove(link->peer_parent->peer_links, link);
+	peer_link_free(link);
+}
 
-	for (i = 0; i < strlen(uid); i++)
-		ptr += sprintf(ptr, "%02x", uid[i]);
+static void peer_link_disconnected(void *user_data)
+{
+	struct l_dbus *link = user_data;
 
-	/* Send special credentials-passing nul byte */
-	written = L_TFR(send(fd, &creds, 1, 0));
-	if (written < 1) {
-		close(fd);
-		return NULL;
-	}
+	l_util_debug(link->peer_parent->debug_handler,
+			link->peer_parent->debug_data,
+			"peer link to %s closed", link->peer_name);
+
+	/* No longer routed to, freed once out of the l_io callback */
+	if (!link->peer_close_work)
+		link->peer_close_work = l_idle_create(peer_link_close_work,
+							link, NULL);
+}
+
+static struct l_dbus *peer_link_new(struct l_dbus *dbus, int fd,
+					const char *name, const char *alias)
+{
+	struct l_dbus_classic *classic;
+	struct l_dbus *link;
 
 	classic = l_new(struct l_dbus_classic, 1);
-	dbus = &classic->super;
-	dbus->driver = &classic_ops;
+	link = &classic->super;
+	link->driver = &classic_ops;
 
 	classic->match_strings = l_hashmap_new();
 
-	dbus_init(dbus, fd);
-	dbus->guid = l_strdup(guid);
+	dbus_init(link, fd);
 
-	classic->auth_command = l_strdup_printf("AUTH EXTERNAL %s\r\n", hexuid);
-	classic->auth_state = WAITING_FOR_OK;
-	classic->skip_hello = skip_hello;
+	/* Both ends come from one socketpair, there is nobody to AUTH to */
+	classic->auth_state = SETUP_DONE;
+	link->support_unix_fd = true;
+	link->unique_name = l_strdup(dbus->unique_name);
+	link->debug_handler = dbus->debug_handler;
+	link->debug_data = dbus->debug_data;
 
-	dbus->negotiate_unix_fd = true;
-	dbus->support_unix_fd = false;
+	link->peer_parent = dbus;
+	link->peer_name = l_strdup(name);
 
-	l_io_set_read_handler(dbus->io, auth_read_handler, dbus, NULL);
-	l_io_set_write_handler(dbus->io, auth_write_handler, dbus, NULL);
+	if (alias && strcmp(alias, name))
+		link->peer_alias = l_strdup(alias);
 
-	return dbus;
+	l_dbus_set_disconnect_handler(link, peer_link_disconnected,
+								link, NULL);
+
+	if (!dbus->peer_links)
+		dbus->peer_links = l_queue_new();
+
+	l_queue_push_tail(dbus->peer_links, link);
+
+	l_util_debug(dbus->debug_handler, dbus->debug_data,
+			"peer link to %s open", name);
+
+	bus_ready(link);
+
+	return link;
 }
 
-static struct l_dbus *setup_unix(char *params)
+static void peer_link_close(struct l_dbus *dbus, struct l_dbus *link)
 {
-	char *path = NULL, *guid = NULL;
-	bool abstract = false;
-	struct sockaddr_un addr;
-	size_t len;
+	l_queue_remove(dbus->peer_links, link);
+	peer_link_free(link);
+}
+
+static struct l_dbus_message *peer_link_connect(struct l_dbus *dbus,
+						struct l_dbus_message *message,
+						void *user_data)
+{
+	const char *sender = l_dbus_message_get_sender(message);
+	struct l_dbus *link;
+	struct l_dbus_message *reply;
 	int fd;
 
-	while (params) {
-		char *key = strsep(&params, ",");
-		char *value;
+	if (!sender || !l_dbus_message_get_arguments(message, "h", &fd) ||
+			fd < 0)
+		return l_dbus_message_new_error(message,
+						"org.freedesktop.DBus.Error."
+						"InvalidArgs",
+						"Invalid arguments");
 
-		if (!key)
-			break;
+	link = peer_link_find(dbus, sender);
+	if (link)
+		peer_link_close(dbus, link);
 
-		value = strchr(key, '=');
-		if (!value)
-			continue;
+	/*
+	 * The reply has to be queued before the link exists, otherwise it
+	 * would be routed over the link that the caller is not reading yet.
+	 */
+	reply = l_dbus_message_new_method_return(message);
+	l_dbus_message_set_arguments(reply, "");
+	l_dbus_send(dbus, reply);
 
-		*value++ = '\0';
+	peer_link_new(dbus, fd, sender, NULL);
 
-		if (!strcmp(key, "path")) {
-			path = value;
-			abstract = false;
-		} else if (!strcmp(key, "abstract")) {
-			path = value;
-			abstract = true;
-		} else if (!strcmp(key, "guid"))
-			guid = value;
+	return NULL;
+}
+
+static void setup_peer_link_interface(struct l_dbus_interface *interface)
+{
+	l_dbus_interface_method(interface, "Connect", 0, peer_link_connect,
+							"", "h", "fd");
+}
+
+/**
+ * l_dbus_peer_link_accept:
+ * @dbus: D-Bus connection
+ * @enabled: whether to accept peer link requests
+ *
+ * Lets other processes move their traffic with this one off the bus with
+ * l_dbus_peer_link_request.  This exports the org.ell.PeerLink interface
+ * on the root object, the bus policy has to allow calling it.
+ *
+ * Returns: true on success
+ **/
+LIB_EXPORT bool l_dbus_peer_link_accept(struct l_dbus *dbus, bool enabled)
+{
+	if (unlikely(!dbus || dbus->peer_parent))
+		return false;
+
+	if (dbus->peer_links_accepted == enabled)
+		return true;
+
+	if (!enabled) {
+		l_dbus_object_remove_interface(dbus, "/",
+						DBUS_INTERFACE_PEER_LINK);
+		l_dbus_unregister_interface(dbus, DBUS_INTERFACE_PEER_LINK);
+		dbus->peer_links_accepted = false;
+		return true;
 	}
 
-	if (!path)
-		return NULL;
+	if (!l_dbus_register_interface(dbus, DBUS_INTERFACE_PEER_LINK,
+					setup_peer_link_interface,
+					NULL, false))
+		return false;
 
-	fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
-	if (fd < 0)
-		return NULL;
+	if (!l_dbus_object_add_interface(dbus, "/", DBUS_INTERFACE_PEER_LINK,
+								NULL)) {
+		l_dbus_unregister_interface(dbus, DBUS_INTERFACE_PEER_LINK);
+		return false;
+	}
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sun_family = AF_UNIX;
+	dbus->peer_links_accepted = true;
 
-	len = strlen(path);
+	return true;
+}
 
-	if (abstract) {
-		if (len > sizeof(addr.sun_path) - 1) {
-			close(fd);
-			return NULL;
-		}
+struct peer_link_request {
+	struct l_dbus *dbus;
+	char *name;
+	int fd;
+	l_dbus_peer_link_func_t function;
+	l_dbus_destroy_func_t destroy;
+	void *user_data;
+};
 
-		addr.sun_path[0] = '\0';
-		strncpy(addr.sun_path + 1, path, sizeof(addr.sun_path) - 2);
-		len++;
-	} else {
-		if (len > sizeof(addr.sun_path)) {
-			close(fd);
-			return NULL;
-		}
+static void peer_link_request_free(void *user_data)
+{
+	struct peer_link_request *req = user_data;
 
-		strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
-	}
+	if (req->fd >= 0)
+		close(req->fd);
 
-	if (connect(fd, (struct sockaddr *) &addr,
-				sizeof(addr.sun_family) + len) < 0) {
-		close(fd);
-		return NULL;
+	if (req->destroy)
+		req->destroy(req->user_data);
+
+	l_free(req->name);
+	l_free(req);
+}
+
+static void peer_link_request_reply(struct l_dbus_message *message,
+							void *user_data)
+{
+	struct peer_link_request *req = user_data;
+	struct l_dbus *dbus = req->dbus;
+	const char *sender = l_dbus_message_get_sender(message);
+	bool success = !l_dbus_message_is_error(message) && sender;
+
+	if (success) {
+		peer_link_new(dbus, req->fd, sender, req->name);
+		req->fd = -1;
 	}
 
-	return setup_dbus1(fd, guid, false);
+	if (req->function)
+		req->function(dbus, success, req->user_data);
 }
 
-static bool setup_tcp_cb(struct l_io *io, void *user_data)
+/**
+ * l_dbus_peer_link_request:
+ * @dbus: D-Bus connection
+ * @name: bus name of the peer, which has called l_dbus_peer_link_accept
+ * @function: called with the outcome
+ * @user_data: user data passed to @function
+ * @destroy: called to destroy @user_data
+ *
+ * Sets up a private connection with @name, for peers exchanging enough
+ * messages that going through the bus daemon shows.  One end of a new
+ * socketpair is passed to the peer over the bus.  From then on method
+ * calls, replies and signals that are addressed to the peer, by @name or
+ * by its unique name, go over the private connection on either side.
+ * The object tree, method and signal handlers and proxies keep working
+ * unchanged, messages coming over the link carry the peer's unique name
+ * as the sender.  Broadcast signals still go over the bus, as do
+ * messages already queued when the link came up, so their ordering with
+ * respect to the link traffic is not guaranteed.
+ *
+ * If the link closes, calls waiting for a reply over it fail with a
+ * NoReply error and traffic goes over the bus again.  A link by
+ * well-known @name is not updated when the name changes owners.
+ *
+ * Returns: true if the request was sent
+ **/
+LIB_EXPORT bool l_dbus_peer_link_request(struct l_dbus *dbus,
+					const char *name,
+					l_dbus_peer_link_func_t function,
+					void *user_data,
+					l_dbus_destroy_func_t destroy)
 {
-	static const unsigned char creds = 0x00;
-	struct l_dbus *dbus = user_data;
-	struct l_dbus_classic *classic;
-	ssize_t written;
-	int fd = l_io_get_fd(io);
+	struct peer_link_request *req;
+	struct l_dbus_message *message;
+	int fds[2];
 
-	/* Send special credentials-passing nul byte */
-	written = L_TFR(send(fd, &creds, 1, 0));
-	if (written < 1) {
-		l_util_debug(dbus->debug_handler, dbus->debug_handler,
-						"error writing NUL byte");
-		close(fd);
+	if (unlikely(!dbus || !name || dbus->peer_parent))
 		return false;
-	}
 
-	dbus->driver = &classic_ops;
-	dbus->negotiate_unix_fd = false;
-	dbus->support_unix_fd = false;
+	if (!dbus->support_unix_fd || peer_link_find(dbus, name))
+		return false;
 
-	classic = l_container_of(dbus, struct l_dbus_classic, super);
-	classic->match_strings = l_hashmap_new();
-	classic->auth_command = l_strdup("AUTH ANONYMOUS\r\n");
-	classic->auth_state = WAITING_FOR_OK;
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+		return false;
 
-	l_io_set_read_handler(dbus->io, auth_read_handler, dbus, NULL);
-	l_io_set_write_handler(dbus->io, auth_write_handler, dbus, NULL);
+	message = l_dbus_message_new_method_call(dbus, name, "/",
+						DBUS_INTERFACE_PEER_LINK,
+						"Connect");
+	l_dbus_message_set_arguments(message, "h", fds[1]);
+	close(fds[1]);
 
-	return auth_write_handler(dbus->io, dbus);
+	req = l_new(struct peer_link_request, 1);
+	req->dbus = dbus;
+	req->name = l_strdup(name);
+	req->fd = fds[0];
+	req->function = function;
+	req->destroy = destroy;
+	req->user_data = user_data;
+
+	send_message(dbus, false, message, peer_link_request_reply, req,
+						peer_link_request_free);
+
+	return true;
 }
 
-static struct l_dbus *setup_tcp(char *params)
+/**
+ * l_dbus_peer_link_close:
+ * @dbus: D-Bus connection
+ * @name: bus name the link was requested for, or its unique name
+ *
+ * Closes the private connection with @name, going back to the bus.
+ *
+ * Returns: true if there was a link to close
+ **/
+LIB_EXPORT bool l_dbus_peer_link_close(struct l_dbus *dbus, const char *name)
 {
-	char *host = NULL;
-	char *port = NULL;
-	char *family = NULL;
-	struct addrinfo hints = { 0 };
-	struct addrinfo *res;
-	struct addrinfo *iter;
-	struct l_dbus *dbus = NULL;
+	struct l_dbus *link;
 
-	while (params) {
-		char *key = strsep(&params, ",");
-		char *value;
+	if (unlikely(!dbus || !name))
+		return false;
 
-		value = strchr(key, '=');
-		if (!value)
-			continue;
+	link = peer_link_find(dbus, name);
+	if (!link)
+		return false;
 
-		*value++ = '\0';
+	peer_link_close(dbus, link);
 
-		if (!strcmp(key, "host"))
-			host = value;
-		else if (!strcmp(key, "port"))
-			port = value;
-		else if (!strcmp(key, "family"))
-			family = value;
-	}
+	return true;
+}
 
-	if (!host || !port)
-		return NULL;
+/**
+ * l_dbus_peer_link_is_active:
+ * @dbus: D-Bus connection
+ * @name: bus name of the peer
+ *
+ * Returns: true if messages to @name go over a private connection
+ **/
+LIB_EXPORT bool l_dbus_peer_link_is_active(struct l_dbus *dbus,
+							const char *name)
+{
+	if (unlikely(!dbus || !name))
+		return false;
 
-	if (!family)
-		hints.ai_family = AF_UNSPEC;
-	else if (!strcmp(family, "ipv4"))
-		hints.ai_family = AF_INET;
-	else if (!strcmp(family, "ipv6"))
-		hints.ai_family = AF_INET6;
-	else
-		return NULL;
+	return peer_link_find(dbus, name) != NULL;
+}
 
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
-	hints.ai_protocol = IPPROTO_TCP;
+LIB_EXPORT bool l_dbus_set_debug(struct l_dbus *dbus,
+				l_dbus_debug_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy)
+{
+	if (unlikely(!dbus))
+		return false;
 
-	if (getaddrinfo(host, port, &hints, &res) != 0)
-		return NULL;
+	if (dbus->debug_destroy)
+		dbus->debug_destroy(dbus->debug_data);
 
-	for (iter = res; iter; iter = iter->ai_next) {
-		int fd;
-		struct l_dbus_classic *classic;
+	dbus->debug_handler = function;
+	dbus->debug_destroy = destroy;
+	dbus->debug_data = user_data;
 
-		fd = socket(iter->ai_family, iter->ai_socktype | SOCK_NONBLOCK,
-					iter->ai_protocol);
-		if (fd < 0)
-			continue;
+	/* l_io_set_debug(dbus->io, function, user_data, NULL); */
 
-		if (connect(fd, iter->ai_addr, iter->ai_addrlen) < 0) {
-			if (errno != EINPROGRESS) {
-				close(fd);
-				continue;
-			}
-		}
+	return true;
+}
 
-		classic = l_new(struct l_dbus_classic, 1);
-		dbus = &classic->super;
-		dbus_init(dbus, fd);
-		l_io_set_write_handler(dbus->io, setup_tcp_cb, dbus, NULL);
-		break;
-	}
+LIB_EXPORT uint32_t l_dbus_send_with_reply(struct l_dbus *dbus,
+						struct l_dbus_message *message,
+						l_dbus_message_func_t function,
+						void *user_data,
+						l_dbus_destroy_func_t destroy)
+{
+	if (unlikely(!dbus || !message))
+		return 0;
 
-	freeaddrinfo(res);
-	return dbus;
+	return send_message(dbus, false, message, function, user_data, destroy);
 }
 
-static struct l_dbus *setup_address(const char *address)
+/**
+ * l_dbus_send_with_reply_timeout:
+ * @dbus: D-Bus connection
+ * @message: method call to send
+ * @function: function called with the reply
+ * @user_data: user data passed to @function and @destroy
+ * @destroy: function called to destroy @user_data
+ * @timeout_ms: milliseconds to wait for a reply or 0 to wait forever
+ *
+ * Like l_dbus_send_with_reply(), but if no reply comes in within
+ * @timeout_ms, @function is called with an
+ * org.freedesktop.DBus.Error.NoReply error instead and a reply coming in
+ * later is ignored.  Deadlines are checked with a granularity of
+ * a few tens of milliseconds, never earlier than requested.
+ *
+ * Returns: a non-zero request serial that can be passed to l_dbus_cancel
+ * while waiting for the reply, or zero on failure
+ **/
+LIB_EXPORT uint32_t l_dbus_send_with_reply_timeout(struct l_dbus *dbus,
+						struct l_dbus_message *message,
+						l_dbus_message_func_t function,
+						void *user_data,
+						l_dbus_destroy_func_t destroy,
+						unsigned int timeout_ms)
 {
-	struct l_dbus *dbus = NULL;
-	char *address_copy;
+	if (unlikely(!dbus || !message || !function))
+		return 0;
 
-	address_copy = strdupa(address);
+	return send_message_timeout(dbus, false, message, function, user_data,
+					destroy, timeout_ms);
+}
 
-	while (address_copy) {
-		char *transport = strsep(&address_copy, ";");
-		char *params;
+LIB_EXPORT uint32_t l_dbus_send(struct l_dbus *dbus,
+				struct l_dbus_message *message)
+{
+	if (unlikely(!dbus || !message))
+		return 0;
 
-		if (!transport)
-			break;
+	return send_message(dbus, false, message, NULL, NULL, NULL);
+}
 
-		params = strchr(transport, ':');
-		if (params)
-			*params++ = '\0';
+struct thread_send {
+	struct thread_handoff *handoff;
+	struct l_dbus_message *message;
+};
 
-		if (!strcmp(transport, "unix")) {
-			/* Function will modify params string */
-			dbus = setup_unix(params);
-			break;
-		} else if (!strcmp(transport, "tcp")) {
-			dbus = setup_tcp(params);
-			break;
-		}
-	}
+static void thread_send_invoke(void *user_data)
+{
+	struct thread_send *send = user_data;
+	struct l_dbus *dbus = send->handoff->dbus;
 
-	return dbus;
+	/* Runs on the connection's thread, so this can't race with destroy */
+	if (!dbus)
+		return;
+
+	send_message(dbus, false, send->message, NULL, NULL, NULL);
+	send->message = NULL;
 }
 
-LIB_EXPORT struct l_dbus *l_dbus_new(const char *address)
+static void thread_send_free(void *user_data)
 {
-	if (unlikely(!address))
-		return NULL;
+	struct thread_send *send = user_data;
 
-	return setup_address(address);
+	l_dbus_message_unref(send->message);
+	thread_handoff_unref(send->handoff);
+	l_free(send);
 }
 
-LIB_EXPORT struct l_dbus *l_dbus_new_default(enum l_dbus_bus bus)
+/**
+ * l_dbus_send_from_thread:
+ * @dbus: D-Bus connection
+ * @message: message to send, the reference is taken over
+ *
+ * Like l_dbus_send, but may be called from any thread.  Messages can be
+ * built and filled in on worker threads without touching state shared
+ * with the thread running the connection, including with templates and
+ * reference counting.  A message must only be used by one thread at a
+ * time though, this hands it over.  Messages sent from the same thread
+ * go out in order.
+ *
+ * The caller must ensure that @dbus is not destroyed during the call.
+ * Messages still being handed over when it is destroyed are dropped.
+ *
+ * Returns: true if @message was handed over to the connection's thread
+ **/
+LIB_EXPORT bool l_dbus_send_from_thread(struct l_dbus *dbus,
+					struct l_dbus_message *message)
 {
-	const char *address;
+	struct thread_send *send;
 
-	switch (bus) {
-	case L_DBUS_SYSTEM_BUS:
-		address = getenv("DBUS_SYSTEM_BUS_ADDRESS");
-		if (!address)
-			address = DEFAULT_SYSTEM_BUS_ADDRESS;
-		break;
-	case L_DBUS_SESSION_BUS:
-		address = getenv("DBUS_SESSION_BUS_ADDRESS");
-		if (!address)
-			return NULL;
-		break;
-	default:
-		return NULL;
+	if (unlikely(!dbus || !message || !dbus->handoff)) {
+		l_dbus_message_unref(message);
+		return false;
 	}
 
-	return setup_address(address);
-}
+	send = l_new(struct thread_send, 1);
+	send->handoff = thread_handoff_ref(dbus->handoff);
+	send->message = message;
 
-LIB_EXPORT struct l_dbus *l_dbus_new_private(int fd)
-{
-	return setup_dbus1(fd, NULL, true);
+	if (!l_main_invoke(dbus->loop, thread_send_invoke, send,
+							thread_send_free)) {
+		thread_send_free(send);
+		return false;
+	}
+
+	return true;
 }
 
-LIB_EXPORT void l_dbus_destroy(struct l_dbus *dbus)
+static void reply_stats_add(const void *key, void *value, void *user_data)
 {
-	if (unlikely(!dbus))
-		return;
+	const struct reply_stats *stats = value;
+	struct reply_stats *total = user_data;
+	unsigned int i;
 
-	if (dbus->ready_destroy)
-		dbus->ready_destroy(dbus->ready_data);
+	total->in_flight += stats->in_flight;
+	total->replies += stats->replies;
+	total->timeouts += stats->timeouts;
 
-	_dbus_filter_free(dbus->filter);
+	for (i = 0; i < REPLY_HISTOGRAM_SIZE; i++)
+		total->histogram[i] += stats->histogram[i];
+}
 
-	_dbus_name_cache_free(dbus->name_cache);
+/**
+ * l_dbus_get_reply_stats:
+ * @dbus: D-Bus connection
+ * @destination: bus name the calls were sent to, or NULL for all calls
+ * @stats: structure to fill in with the counters
+ *
+ * Obtains the counters of the method calls sent to @destination with a
+ * reply callback.  Calls without a destination, such as those on peer to
+ * peer connections, are counted under the empty string.  The reported
+ * 99th percentile latency, in microseconds, is the upper bound of the
+ * power of two bucket it falls in.
+ *
+ * Returns: #true on success and #false if no call to @destination is known
+ **/
+LIB_EXPORT bool l_dbus_get_reply_stats(struct l_dbus *dbus,
+					const char *destination,
+					struct l_dbus_reply_stats *stats)
+{
+	struct reply_stats total = {};
+	const struct reply_stats *found;
+	uint64_t target, count = 0;
+	unsigned int i;
 
-	l_hashmap_destroy(dbus->signal_list, signal_list_destroy);
-	l_hashmap_destroy(dbus->message_list, message_list_destroy);
-	l_queue_destroy(dbus->message_queue, message_queue_destroy);
+	if (unlikely(!dbus || !stats))
+		return false;
 
-	l_io_destroy(dbus->io);
+	if (!dbus->reply_stats)
+		return false;
 
-	if (dbus->disconnect_destroy)
-		dbus->disconnect_destroy(dbus->disconnect_data);
+	if (destination) {
+		found = l_hashmap_lookup(dbus->reply_stats, destination);
+		if (!found)
+			return false;
+	} else {
+		l_hashmap_foreach(dbus->reply_stats, reply_stats_add, &total);
+		found = &total;
+	}
 
-	if (dbus->debug_destroy)
-		dbus->debug_destroy(dbus->debug_data);
+	memset(stats, 0, sizeof(*stats));
+	stats->in_flight = found->in_flight;
+	stats->replies = found->replies;
+	stats->timeouts = found->timeouts;
 
-	l_free(dbus->guid);
-	l_free(dbus->unique_name);
+	target = (found->replies * 99 + 99) / 100;
 
-	_dbus_object_tree_free(dbus->tree);
+	for (i = 0; i < REPLY_HISTOGRAM_SIZE && target; i++) {
+		count += found->histogram[i];
 
-	dbus->driver->free(dbus);
+		if (count >= target) {
+			stats->p99_latency = i ? 1ULL << i : 0;
+			break;
+		}
+	}
+
+	return true;
 }
 
-LIB_EXPORT bool l_dbus_set_ready_handler(struct l_dbus *dbus,
-				l_dbus_ready_func_t function,
-				void *user_data, l_dbus_destroy_func_t destroy)
+/**
+ * l_dbus_set_traffic_stats:
+ * @dbus: D-Bus connection
+ * @enabled: whether to count traffic
+ *
+ * Starts or stops counting the messages and bytes sent and received on
+ * @dbus, by message type and by interface and member, along with the
+ * time spent in method handlers and reply callbacks.  Disabling discards
+ * the counters collected so far.
+ *
+ * Returns: true on success
+ **/
+LIB_EXPORT bool l_dbus_set_traffic_stats(struct l_dbus *dbus, bool enabled)
 {
 	if (unlikely(!dbus))
 		return false;
 
-	if (dbus->ready_destroy)
-		dbus->ready_destroy(dbus->ready_data);
+	if (!enabled) {
+		l_free(dbus->traffic);
+		dbus->traffic = NULL;
+		l_hashmap_destroy(dbus->member_stats, member_stats_free);
+		dbus->member_stats = NULL;
+		return true;
+	}
 
-	dbus->ready_handler = function;
-	dbus->ready_destroy = destroy;
-	dbus->ready_data = user_data;
+	if (dbus->traffic)
+		return true;
+
+	dbus->traffic = l_new(struct l_dbus_traffic_stats, 1);
+	dbus->member_stats = l_hashmap_string_new();
 
 	return true;
 }
 
-LIB_EXPORT bool l_dbus_set_disconnect_handler(struct l_dbus *dbus,
-				l_dbus_disconnect_func_t function,
-				void *user_data, l_dbus_destroy_func_t destroy)
+LIB_EXPORT bool l_dbus_get_traffic_stats(struct l_dbus *dbus,
+					struct l_dbus_traffic_stats *stats)
 {
-	if (unlikely(!dbus))
+	if (unlikely(!dbus || !stats))
 		return false;
 
-	if (dbus->disconnect_destroy)
-		dbus->disconnect_destroy(dbus->disconnect_data);
+	if (!dbus->traffic)
+		return false;
 
-	dbus->disconnect_handler = function;
-	dbus->disconnect_destroy = destroy;
-	dbus->disconnect_data = user_data;
+	*stats = *dbus->traffic;
 
 	return true;
 }
 
-LIB_EXPORT bool l_dbus_set_debug(struct l_dbus *dbus,
-				l_dbus_debug_func_t function,
-				void *user_data, l_dbus_destroy_func_t destroy)
+struct member_stats_foreach_data {
+	l_dbus_member_stats_func_t function;
+	void *user_data;
+};
+
+static void member_stats_foreach(const void *key, void *value,
+							void *user_data)
 {
-	if (unlikely(!dbus))
-		return false;
+	struct member_stats_foreach_data *data = user_data;
 
-	if (dbus->debug_destroy)
-		dbus->debug_destroy(dbus->debug_data);
+	data->function(value, data->user_data);
+}
 
-	dbus->debug_handler = function;
-	dbus->debug_destroy = destroy;
-	dbus->debug_data = user_data;
+/**
+ * l_dbus_foreach_member_stats:
+ * @dbus: D-Bus connection
+ * @function: called once for every interface and member seen
+ * @user_data: user data passed to @function
+ *
+ * Method calls and signals are counted by their interface and member.
+ * The handler counters of a member cover both the method handlers run
+ * for calls received and the reply callbacks run for calls sent.  Times
+ * are in microseconds.
+ *
+ * Returns: false if traffic stats are not enabled
+ **/
+LIB_EXPORT bool l_dbus_foreach_member_stats(struct l_dbus *dbus,
+					l_dbus_member_stats_func_t function,
+					void *user_data)
+{
+	struct member_stats_foreach_data data = { function, user_data };
 
-	/* l_io_set_debug(dbus->io, function, user_data, NULL); */
+	if (unlikely(!dbus || !function))
+		return false;
+
+	if (!dbus->member_stats)
+		return false;
+
+	l_hashmap_foreach(dbus->member_stats, member_stats_foreach, &data);
 
 	return true;
 }
 
-LIB_EXPORT uint32_t l_dbus_send_with_reply(struct l_dbus *dbus,
-						struct l_dbus_message *message,
-						l_dbus_message_func_t function,
-						void *user_data,
-						l_dbus_destroy_func_t destroy)
+/**
+ * l_dbus_set_slow_handler:
+ * @dbus: D-Bus connection
+ * @threshold_us: handler run time in microseconds from which on a handler
+ *	is reported
+ * @function: called with the interface, member and run time of every
+ *	method handler or reply callback that took at least @threshold_us,
+ *	or NULL to stop reporting
+ * @user_data: user data passed to @function
+ * @destroy: called to destroy @user_data
+ *
+ * Returns: true on success
+ **/
+LIB_EXPORT bool l_dbus_set_slow_handler(struct l_dbus *dbus,
+				unsigned int threshold_us,
+				l_dbus_slow_handler_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy)
 {
-	if (unlikely(!dbus || !message))
-		return 0;
+	if (unlikely(!dbus))
+		return false;
 
-	return send_message(dbus, false, message, function, user_data, destroy);
-}
+	if (dbus->slow_destroy)
+		dbus->slow_destroy(dbus->slow_data);
 
-LIB_EXPORT uint32_t l_dbus_send(struct l_dbus *dbus,
-				struct l_dbus_message *message)
-{
-	if (unlikely(!dbus || !message))
-		return 0;
+	dbus->slow_threshold = threshold_us;
+	dbus->slow_handler = function;
+	dbus->slow_destroy = destroy;
+	dbus->slow_data = user_data;
 
-	return send_message(dbus, false, message, NULL, NULL, NULL);
+	return true;
 }
 
 static bool remove_entry(void *data, void *user_data)
@@ -1425,7 +3265,7 @@ static bool remove_entry(void *data, void *user_data)
 	struct message_callback *callback = data;
 	uint32_t serial = L_PTR_TO_UINT(user_data);
 
-	if (callback->serial == serial) {
+	if (callback->serial == serial && !callback->cancelled) {
 		message_queue_destroy(callback);
 		return true;
 	}
@@ -1436,23 +3276,45 @@ static bool remove_entry(void *data, void *user_data)
 LIB_EXPORT bool l_dbus_cancel(struct l_dbus *dbus, uint32_t serial)
 {
 	struct message_callback *callback;
+	const struct l_queue_entry *entry;
 	unsigned int count;
+	unsigned int i;
 
 	if (unlikely(!dbus || !serial))
 		return false;
 
 	callback = l_hashmap_remove(dbus->message_list, L_UINT_TO_PTR(serial));
-        if (callback) {
-		message_queue_destroy(callback);
+	if (callback) {
+		message_callback_done(dbus, callback, REPLY_DROPPED);
+
+		if (callback->queued)
+			message_callback_cancel(callback);
+		else
+			message_queue_destroy(callback);
+
 		return true;
 	}
 
-	count = l_queue_foreach_remove(dbus->message_queue, remove_entry,
-							L_UINT_TO_PTR(serial));
-	if (!count)
-		return false;
+	for (i = 0; i < MESSAGE_LANE_COUNT; i++) {
+		count = l_queue_foreach_remove(dbus->message_lanes[i],
+						remove_entry,
+						L_UINT_TO_PTR(serial));
+		if (!count)
+			continue;
 
-	return true;
+		if (i == MESSAGE_LANE_SIGNAL)
+			backpressure_update(dbus);
+
+		return true;
+	}
+
+	/* The message may have been routed over a peer link */
+	for (entry = l_queue_get_entries(dbus->peer_links); entry;
+							entry = entry->next)
+		if (l_dbus_cancel(entry->data, serial))
+			return true;
+
+	return false;
 }
 
 LIB_EXPORT unsigned int l_dbus_register(struct l_dbus *dbus,
@@ -1733,6 +3595,60 @@ LIB_EXPORT bool l_dbus_object_manager_enable(struct l_dbus *dbus,
 						dbus);
 }
 
+/**
+ * l_dbus_object_manager_set_max_reply_size:
+ * @dbus: D-Bus connection
+ * @root: path of an object manager enabled with l_dbus_object_manager_enable
+ * @size: reply size limit in bytes, or 0 for no limit
+ *
+ * Limits the size of GetManagedObjects replies from the object manager at
+ * @root.  Once a reply has grown past @size, it is sent with the objects
+ * collected so far.  The remaining objects are then announced with one
+ * InterfacesAdded signal each, so that a client doing its initial sync
+ * still learns about all of them.
+ *
+ * Returns: true on success, false if @root has no object manager
+ **/
+LIB_EXPORT bool l_dbus_object_manager_set_max_reply_size(struct l_dbus *dbus,
+							const char *root,
+							size_t size)
+{
+	if (unlikely(!dbus || !root))
+		return false;
+
+	if (unlikely(!dbus->tree))
+		return false;
+
+	return _dbus_object_tree_set_max_reply_size(dbus->tree, root, size);
+}
+
+/**
+ * l_dbus_debug_control_enable:
+ * @dbus: D-Bus connection
+ * @path: object path to add the interface to
+ *
+ * Adds the org.ell.Debug interface to the object at @path so that debug
+ * output can be narrowed down on a running process.  Its Enable and
+ * Disable methods take a pattern as for l_debug_set_enabled() and return
+ * the number of matching sites.  List returns the file, function and
+ * state of the debug sites matching a pattern, or of all sites for an
+ * empty pattern.  Access should be restricted by the bus policy.
+ *
+ * Returns: true on success, false otherwise
+ **/
+LIB_EXPORT bool l_dbus_debug_control_enable(struct l_dbus *dbus,
+						const char *path)
+{
+	if (unlikely(!dbus || !path))
+		return false;
+
+	if (unlikely(!dbus->tree))
+		return false;
+
+	return _dbus_object_tree_add_interface(dbus->tree, path,
+						L_DBUS_INTERFACE_DEBUG, NULL);
+}
+
 LIB_EXPORT unsigned int l_dbus_add_disconnect_watch(struct l_dbus *dbus,
 					const char *name,
 					l_dbus_watch_func_t disconnect_func,
@@ -1770,6 +3686,28 @@ LIB_EXPORT bool l_dbus_remove_watch(struct l_dbus *dbus, unsigned int id)
 	return _dbus_name_cache_remove_watch(dbus->name_cache, id);
 }
 
+/**
+ * l_dbus_get_name_cache_stats:
+ * @dbus: D-Bus connection
+ * @stats: structure to fill in with the name cache counters
+ *
+ * Obtains the counters of the bus name owner cache used by service and
+ * signal watches.  Every name that starts being watched counts as a lookup
+ * and is either answered from what is already known about the bus, which
+ * counts as a hit, or with a GetNameOwner request.  Hits for names known
+ * to have no owner are also counted as negative hits.
+ *
+ * Returns: #true on success and #false if no name has been watched yet
+ **/
+LIB_EXPORT bool l_dbus_get_name_cache_stats(struct l_dbus *dbus,
+				struct l_dbus_name_cache_stats *stats)
+{
+	if (unlikely(!dbus || !stats))
+		return false;
+
+	return _dbus_name_cache_get_stats(dbus->name_cache, stats);
+}
+
 /**
  * l_dbus_add_signal_watch:
  * @dbus: D-Bus connection
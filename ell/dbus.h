@@ -21,6 +21,7 @@ extern "C" {
 #define L_DBUS_INTERFACE_INTROSPECTABLE	"org.freedesktop.DBus.Introspectable"
 #define L_DBUS_INTERFACE_PROPERTIES	"org.freedesktop.DBus.Properties"
 #define L_DBUS_INTERFACE_OBJECT_MANAGER	"org.freedesktop.DBus.ObjectManager"
+#define L_DBUS_INTERFACE_DEBUG		"org.ell.Debug"
 
 enum l_dbus_bus {
 	L_DBUS_SYSTEM_BUS,
@@ -42,12 +43,15 @@ enum l_dbus_match_type {
 struct l_dbus;
 struct l_dbus_interface;
 struct l_dbus_message_builder;
+struct l_dbus_blob;
+struct l_dbus_message_template;
 
 typedef void (*l_dbus_ready_func_t) (void *user_data);
 typedef void (*l_dbus_disconnect_func_t) (void *user_data);
 
 typedef void (*l_dbus_debug_func_t) (const char *str, void *user_data);
 typedef void (*l_dbus_destroy_func_t) (void *user_data);
+typedef void (*l_dbus_backpressure_func_t) (bool congested, void *user_data);
 typedef void (*l_dbus_interface_setup_func_t) (struct l_dbus_interface *);
 
 typedef void (*l_dbus_watch_func_t) (struct l_dbus *dbus, void *user_data);
@@ -55,6 +59,9 @@ typedef void (*l_dbus_watch_func_t) (struct l_dbus *dbus, void *user_data);
 typedef void (*l_dbus_name_acquire_func_t) (struct l_dbus *dbus, bool success,
 						bool queued, void *user_data);
 
+typedef void (*l_dbus_peer_link_func_t) (struct l_dbus *dbus, bool success,
+						void *user_data);
+
 struct l_dbus *l_dbus_new(const char *address);
 struct l_dbus *l_dbus_new_default(enum l_dbus_bus bus);
 struct l_dbus *l_dbus_new_private(int fd);
@@ -69,6 +76,19 @@ bool l_dbus_set_disconnect_handler(struct l_dbus *dbus,
 bool l_dbus_set_debug(struct l_dbus *dbus, l_dbus_debug_func_t function,
 				void *user_data, l_dbus_destroy_func_t destroy);
 
+bool l_dbus_set_priority_lanes(struct l_dbus *dbus, bool enabled);
+bool l_dbus_set_signal_backpressure_handler(struct l_dbus *dbus,
+				unsigned int high_water,
+				l_dbus_backpressure_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy);
+
+bool l_dbus_peer_link_accept(struct l_dbus *dbus, bool enabled);
+bool l_dbus_peer_link_request(struct l_dbus *dbus, const char *name,
+				l_dbus_peer_link_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy);
+bool l_dbus_peer_link_close(struct l_dbus *dbus, const char *name);
+bool l_dbus_peer_link_is_active(struct l_dbus *dbus, const char *name);
+
 struct l_dbus_message;
 
 struct l_dbus_message_iter {
@@ -108,6 +128,26 @@ struct l_dbus_message *l_dbus_message_new_error(
 					const char *format, ...)
 					__attribute__((format(printf, 3, 4)));
 
+struct l_dbus_message_template *l_dbus_message_template_new_method_call(
+							struct l_dbus *dbus,
+							const char *destination,
+							const char *path,
+							const char *interface,
+							const char *method,
+							const char *signature);
+struct l_dbus_message_template *l_dbus_message_template_new_signal(
+							struct l_dbus *dbus,
+							const char *path,
+							const char *interface,
+							const char *name,
+							const char *signature);
+struct l_dbus_message_template *l_dbus_message_template_ref(
+				struct l_dbus_message_template *tmpl);
+void l_dbus_message_template_unref(struct l_dbus_message_template *tmpl);
+
+struct l_dbus_message *l_dbus_message_new_from_template(
+				struct l_dbus_message_template *tmpl);
+
 struct l_dbus_message *l_dbus_message_ref(struct l_dbus_message *message);
 void l_dbus_message_unref(struct l_dbus_message *message);
 
@@ -131,10 +171,74 @@ uint32_t l_dbus_send_with_reply(struct l_dbus *dbus,
 				struct l_dbus_message *message,
 				l_dbus_message_func_t function,
 				void *user_data, l_dbus_destroy_func_t destroy);
+uint32_t l_dbus_send_with_reply_timeout(struct l_dbus *dbus,
+				struct l_dbus_message *message,
+				l_dbus_message_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy,
+				unsigned int timeout_ms);
 uint32_t l_dbus_send(struct l_dbus *dbus,
 				struct l_dbus_message *message);
+bool l_dbus_send_from_thread(struct l_dbus *dbus,
+				struct l_dbus_message *message);
 bool l_dbus_cancel(struct l_dbus *dbus, uint32_t serial);
 
+struct l_dbus_reply_stats {
+	uint64_t in_flight;
+	uint64_t replies;
+	uint64_t timeouts;
+	uint64_t p99_latency;
+};
+
+bool l_dbus_get_reply_stats(struct l_dbus *dbus, const char *destination,
+				struct l_dbus_reply_stats *stats);
+
+struct l_dbus_traffic_counter {
+	uint64_t messages;
+	uint64_t bytes;
+};
+
+struct l_dbus_traffic_stats {
+	struct l_dbus_traffic_counter method_calls_in;
+	struct l_dbus_traffic_counter method_calls_out;
+	struct l_dbus_traffic_counter method_returns_in;
+	struct l_dbus_traffic_counter method_returns_out;
+	struct l_dbus_traffic_counter errors_in;
+	struct l_dbus_traffic_counter errors_out;
+	struct l_dbus_traffic_counter signals_in;
+	struct l_dbus_traffic_counter signals_out;
+};
+
+struct l_dbus_member_stats {
+	const char *interface;
+	const char *member;
+	uint64_t messages_in;
+	uint64_t messages_out;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t handler_calls;
+	uint64_t handler_time;
+	uint64_t handler_max_time;
+	uint64_t slow_calls;
+};
+
+typedef void (*l_dbus_member_stats_func_t) (
+					const struct l_dbus_member_stats *stats,
+					void *user_data);
+typedef void (*l_dbus_slow_handler_func_t) (const char *interface,
+						const char *member,
+						uint64_t duration,
+						void *user_data);
+
+bool l_dbus_set_traffic_stats(struct l_dbus *dbus, bool enabled);
+bool l_dbus_get_traffic_stats(struct l_dbus *dbus,
+				struct l_dbus_traffic_stats *stats);
+bool l_dbus_foreach_member_stats(struct l_dbus *dbus,
+				l_dbus_member_stats_func_t function,
+				void *user_data);
+bool l_dbus_set_slow_handler(struct l_dbus *dbus, unsigned int threshold_us,
+				l_dbus_slow_handler_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy);
+
 unsigned int l_dbus_register(struct l_dbus *dbus,
 				l_dbus_message_func_t function,
 				void *user_data, l_dbus_destroy_func_t destroy);
@@ -161,6 +265,12 @@ bool l_dbus_message_iter_get_variant(struct l_dbus_message_iter *iter,
 bool l_dbus_message_iter_get_fixed_array(struct l_dbus_message_iter *iter,
 						void *out, uint32_t *n_elem);
 
+struct l_dbus_blob *l_dbus_message_iter_get_blob(
+					struct l_dbus_message_iter *iter);
+const void *l_dbus_blob_get_data(const struct l_dbus_blob *blob,
+							size_t *out_len);
+void l_dbus_blob_free(struct l_dbus_blob *blob);
+
 bool l_dbus_message_set_arguments(struct l_dbus_message *message,
 						const char *signature, ...);
 bool l_dbus_message_set_arguments_valist(struct l_dbus_message *message,
@@ -172,6 +282,11 @@ void l_dbus_message_builder_destroy(struct l_dbus_message_builder *builder);
 
 bool l_dbus_message_builder_append_basic(struct l_dbus_message_builder *builder,
 					char type, const void *value);
+bool l_dbus_message_builder_append_fixed_array(
+					struct l_dbus_message_builder *builder,
+					char type, const void *data, uint32_t n);
+bool l_dbus_message_builder_append_blob(struct l_dbus_message_builder *builder,
+					const void *data, size_t len);
 
 bool l_dbus_message_builder_enter_container(
 					struct l_dbus_message_builder *builder,
@@ -232,6 +347,10 @@ bool l_dbus_object_set_data(struct l_dbus *dbus, const char *object,
 				const char *interface, void *user_data);
 
 bool l_dbus_object_manager_enable(struct l_dbus *dbus, const char *root);
+bool l_dbus_object_manager_set_max_reply_size(struct l_dbus *dbus,
+						const char *root, size_t size);
+
+bool l_dbus_debug_control_enable(struct l_dbus *dbus, const char *path);
 
 unsigned int l_dbus_add_service_watch(struct l_dbus *dbus,
 					const char *name,
@@ -247,6 +366,16 @@ unsigned int l_dbus_add_disconnect_watch(struct l_dbus *dbus,
 					l_dbus_destroy_func_t destroy);
 bool l_dbus_remove_watch(struct l_dbus *dbus, unsigned int id);
 
+struct l_dbus_name_cache_stats {
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t negative_hits;
+	uint64_t requests;
+};
+
+bool l_dbus_get_name_cache_stats(struct l_dbus *dbus,
+				struct l_dbus_name_cache_stats *stats);
+
 unsigned int l_dbus_add_signal_watch(struct l_dbus *dbus,
 					const char *sender,
 					const char *path,
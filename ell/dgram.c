@@ -0,0 +1,615 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "dgram.h"
+#include "io.h"
+#include "idle.h"
+#include "pool.h"
+#include "time.h"
+#include "time-private.h"
+#include "private.h"
+#include "useful.h"
+
+/**
+ * SECTION:dgram
+ * @short_description: Batched datagram socket I/O
+ *
+ * Batched datagram socket I/O
+ */
+
+#define DGRAM_DEFAULT_BATCH	16
+#define DGRAM_DEFAULT_BUF_SIZE	2048
+
+/* Room for a timestamp, packet info and hop limit, with some to spare */
+#define DGRAM_CONTROL_SIZE	256
+
+struct dgram_tx {
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	void *buf;
+	size_t len;
+};
+
+/**
+ * l_dgram:
+ *
+ * Opaque object representing a datagram socket.
+ */
+struct l_dgram {
+	struct l_io *io;
+	unsigned int batch;
+	size_t buf_size;
+	unsigned int rx_budget;
+	unsigned int tx_budget;
+	uint8_t *rx_bufs;
+	uint8_t *rx_control;
+	struct sockaddr_storage *rx_addrs;
+	struct iovec *rx_iov;
+	struct mmsghdr *rx_msgs;
+	struct dgram_tx *tx;
+	unsigned int tx_head;
+	unsigned int tx_len;
+	struct iovec *tx_iov;
+	struct mmsghdr *tx_msgs;
+	struct l_pool *tx_pool;
+	unsigned int tx_dropped;
+	struct l_idle *flush_idle;
+	l_dgram_recv_cb_t recv_cb;
+	void *recv_data;
+	l_dgram_destroy_cb_t recv_destroy;
+	bool tx_blocked : 1;
+	bool in_dispatch : 1;
+	bool destroyed : 1;
+};
+
+static void dgram_tx_pop(struct l_dgram *dgram)
+{
+	l_pool_free(dgram->tx_pool, dgram->tx[dgram->tx_head].buf);
+	dgram->tx_head = (dgram->tx_head + 1) % dgram->tx_budget;
+	dgram->tx_len--;
+}
+
+static bool dgram_write_handler(struct l_io *io, void *user_data);
+
+static int dgram_tx_flush(struct l_dgram *dgram)
+{
+	int fd = l_io_get_fd(dgram->io);
+	int err = 0;
+
+	while (dgram->tx_len) {
+		unsigned int n = minsize(dgram->tx_len, dgram->batch);
+		unsigned int i;
+		int r;
+
+		for (i = 0; i < n; i++) {
+			struct dgram_tx *tx = &dgram->tx[(dgram->tx_head + i) %
+							dgram->tx_budget];
+			struct msghdr *hdr = &dgram->tx_msgs[i].msg_hdr;
+
+			dgram->tx_iov[i].iov_base = tx->buf;
+			dgram->tx_iov[i].iov_len = tx->len;
+
+			memset(hdr, 0, sizeof(*hdr));
+			hdr->msg_name = tx->addr_len ? &tx->addr : NULL;
+			hdr->msg_namelen = tx->addr_len;
+			hdr->msg_iov = &dgram->tx_iov[i];
+			hdr->msg_iovlen = 1;
+		}
+
+		r = sendmmsg(fd, dgram->tx_msgs, n, MSG_DONTWAIT);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				dgram->tx_blocked = true;
+				l_io_set_write_handler(dgram->io,
+							dgram_write_handler,
+							dgram, NULL);
+				return -EAGAIN;
+			}
+
+			/* Datagram semantics, drop the one that failed */
+			err = -errno;
+			dgram->tx_dropped++;
+			dgram_tx_pop(dgram);
+			continue;
+		}
+
+		while (r--)
+			dgram_tx_pop(dgram);
+	}
+
+	return err;
+}
+
+static bool dgram_write_handler(struct l_io *io, void *user_data)
+{
+	struct l_dgram *dgram = user_data;
+
+	if (dgram->destroyed)
+		return false;
+
+	dgram->tx_blocked = false;
+
+	return dgram_tx_flush(dgram) == -EAGAIN;
+}
+
+static void dgram_flush_idle(struct l_idle *idle, void *user_data)
+{
+	struct l_dgram *dgram = user_data;
+
+	l_idle_remove(dgram->flush_idle);
+	dgram->flush_idle = NULL;
+
+	if (!dgram->tx_blocked)
+		dgram_tx_flush(dgram);
+}
+
+static void dgram_deliver(struct l_dgram *dgram, unsigned int n)
+{
+	uint64_t now = 0;
+	unsigned int i;
+
+	for (i = 0; i < n && dgram->recv_cb; i++) {
+		struct msghdr *hdr = &dgram->rx_msgs[i].msg_hdr;
+		const struct timeval *tv;
+		struct l_dgram_msg msg;
+
+		msg.data = dgram->rx_bufs + i * dgram->buf_size;
+		msg.len = dgram->rx_msgs[i].msg_len;
+		msg.addr = hdr->msg_namelen ? hdr->msg_name : NULL;
+		msg.addr_len = hdr->msg_namelen;
+		msg.control = hdr->msg_control;
+		msg.control_len = hdr->msg_controllen;
+		msg.truncated = hdr->msg_flags & MSG_TRUNC;
+
+		tv = l_dgram_msg_get_cmsg(&msg, SOL_SOCKET, SCM_TIMESTAMP,
+						sizeof(struct timeval));
+		if (tv)
+			msg.timestamp = _time_realtime_to_boottime(tv);
+		else {
+			if (!now)
+				now = l_time_now();
+
+			msg.timestamp = now;
+		}
+
+		dgram->recv_cb(dgram, &msg, dgram->recv_data);
+	}
+}
+
+static void dgram_destroy(void *user_data)
+{
+	struct l_dgram *dgram = user_data;
+
+	while (dgram->tx_len)
+		dgram_tx_pop(dgram);
+
+	l_idle_remove(dgram->flush_idle);
+	l_io_destroy(dgram->io);
+	l_pool_destroy(dgram->tx_pool);
+	l_free(dgram->tx);
+	l_free(dgram->tx_iov);
+	l_free(dgram->tx_msgs);
+	l_free(dgram->rx_bufs);
+	l_free(dgram->rx_control);
+	l_free(dgram->rx_addrs);
+	l_free(dgram->rx_iov);
+	l_free(dgram->rx_msgs);
+	l_free(dgram);
+}
+
+static bool dgram_read_handler(struct l_io *io, void *user_data)
+{
+	struct l_dgram *dgram = user_data;
+	unsigned int n_read = 0;
+	bool ret = true;
+
+	dgram->in_dispatch = true;
+
+	while (n_read < dgram->rx_budget && dgram->recv_cb) {
+		unsigned int n = minsize(dgram->batch,
+						dgram->rx_budget - n_read);
+		unsigned int i;
+		int r;
+
+		/* The kernel overwrites the lengths on every call */
+		for (i = 0; i < n; i++) {
+			struct msghdr *hdr = &dgram->rx_msgs[i].msg_hdr;
+
+			hdr->msg_namelen = sizeof(struct sockaddr_storage);
+			hdr->msg_controllen = DGRAM_CONTROL_SIZE;
+			hdr->msg_flags = 0;
+		}
+
+		r = recvmmsg(l_io_get_fd(io), dgram->rx_msgs, n,
+							MSG_DONTWAIT, NULL);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				ret = false;
+
+			break;
+		}
+
+		dgram_deliver(dgram, r);
+		n_read += r;
+
+		/* The socket has been drained */
+		if ((unsigned int) r < n)
+			break;
+	}
+
+	/* Replies queued by the callbacks go out in as few calls as possible */
+	if (!dgram->tx_blocked)
+		dgram_tx_flush(dgram);
+
+	dgram->in_dispatch = false;
+
+	if (dgram->destroyed) {
+		l_idle_oneshot(dgram_destroy, dgram, NULL);
+		return false;
+	}
+
+	/* The handler was removed from one of the callbacks */
+	if (!dgram->recv_cb)
+		return false;
+
+	return ret;
+}
+
+/**
+ * l_dgram_new:
+ * @fd: datagram socket
+ * @batch: number of datagrams moved by a single system call, or 0
+ * @buf_size: size of the largest datagram received or sent, or 0
+ *
+ * Wrap @fd so that datagrams are received with recvmmsg() into a set of
+ * @batch buffers allocated up front, and sent from a queue that is
+ * flushed with sendmmsg().  @batch defaults to 16 and @buf_size to 2048.
+ *
+ * Returns: a newly allocated #l_dgram object, or NULL if @fd is invalid
+ **/
+LIB_EXPORT struct l_dgram *l_dgram_new(int fd, unsigned int batch,
+					size_t buf_size)
+{
+	struct l_dgram *dgram;
+	struct l_io *io;
+	unsigned int i;
+
+	io = l_io_new(fd);
+	if (!io)
+		return NULL;
+
+	if (!batch)
+		batch = DGRAM_DEFAULT_BATCH;
+
+	if (!buf_size)
+		buf_size = DGRAM_DEFAULT_BUF_SIZE;
+
+	dgram = l_new(struct l_dgram, 1);
+	dgram->io = io;
+	dgram->batch = batch;
+	dgram->buf_size = buf_size;
+	dgram->rx_budget = batch * 4;
+	dgram->tx_budget = batch * 4;
+
+	dgram->rx_bufs = l_malloc(batch * buf_size);
+	dgram->rx_control = l_malloc(batch * DGRAM_CONTROL_SIZE);
+	dgram->rx_addrs = l_new(struct sockaddr_storage, batch);
+	dgram->rx_iov = l_new(struct iovec, batch);
+	dgram->rx_msgs = l_new(struct mmsghdr, batch);
+
+	for (i = 0; i < batch; i++) {
+		struct msghdr *hdr = &dgram->rx_msgs[i].msg_hdr;
+
+		dgram->rx_iov[i].iov_base = dgram->rx_bufs + i * buf_size;
+		dgram->rx_iov[i].iov_len = buf_size;
+
+		hdr->msg_name = &dgram->rx_addrs[i];
+		hdr->msg_iov = &dgram->rx_iov[i];
+		hdr->msg_iovlen = 1;
+		hdr->msg_control = dgram->rx_control + i * DGRAM_CONTROL_SIZE;
+	}
+
+	dgram->tx = l_new(struct dgram_tx, dgram->tx_budget);
+	dgram->tx_iov = l_new(struct iovec, batch);
+	dgram->tx_msgs = l_new(struct mmsghdr, batch);
+	dgram->tx_pool = l_pool_new(buf_size);
+
+	return dgram;
+}
+
+/**
+ * l_dgram_free:
+ * @dgram: datagram object
+ *
+ * Free @dgram, making one last attempt at sending the datagrams that are
+ * still queued.  The socket is closed if l_dgram_set_close_on_free() was
+ * enabled.  This may be called from the receive handler.
+ **/
+LIB_EXPORT void l_dgram_free(struct l_dgram *dgram)
+{
+	if (unlikely(!dgram || dgram->destroyed))
+		return;
+
+	l_dgram_set_recv_handler(dgram, NULL, NULL, NULL);
+
+	if (!dgram->tx_blocked)
+		dgram_tx_flush(dgram);
+
+	if (dgram->in_dispatch) {
+		dgram->destroyed = true;
+		return;
+	}
+
+	dgram_destroy(dgram);
+}
+
+/**
+ * l_dgram_get_fd:
+ * @dgram: datagram object
+ *
+ * Returns: the socket wrapped by @dgram
+ **/
+LIB_EXPORT int l_dgram_get_fd(struct l_dgram *dgram)
+{
+	if (unlikely(!dgram))
+		return -1;
+
+	return l_io_get_fd(dgram->io);
+}
+
+/**
+ * l_dgram_set_close_on_free:
+ * @dgram: datagram object
+ * @do_close: setting for free handling
+ *
+ * Set the automatic closing of the socket when freeing @dgram.
+ *
+ * Returns: true on success and false on failure
+ **/
+LIB_EXPORT bool l_dgram_set_close_on_free(struct l_dgram *dgram,
+							bool do_close)
+{
+	if (unlikely(!dgram))
+		return false;
+
+	return l_io_set_close_on_destroy(dgram->io, do_close);
+}
+
+/**
+ * l_dgram_set_budget:
+ * @dgram: datagram object
+ * @rx_budget: most datagrams received per wakeup, or 0 for the default
+ * @tx_budget: most datagrams queued for sending, or 0 for the default
+ *
+ * Once @rx_budget datagrams have been handled the receive handler returns
+ * to the main loop even if more are pending, so that a busy socket cannot
+ * starve other sources.  l_dgram_send() fails with -ENOBUFS once
+ * @tx_budget datagrams are waiting for the socket to become writable.
+ * Both default to four times the batch size.
+ *
+ * Returns: true on success, false if more than @tx_budget datagrams are
+ * currently queued
+ **/
+LIB_EXPORT bool l_dgram_set_budget(struct l_dgram *dgram,
+					unsigned int rx_budget,
+					unsigned int tx_budget)
+{
+	struct dgram_tx *tx;
+	unsigned int i;
+
+	if (unlikely(!dgram))
+		return false;
+
+	if (!rx_budget)
+		rx_budget = dgram->batch * 4;
+
+	if (!tx_budget)
+		tx_budget = dgram->batch * 4;
+
+	if (dgram->tx_len > tx_budget)
+		return false;
+
+	tx = l_new(struct dgram_tx, tx_budget);
+
+	for (i = 0; i < dgram->tx_len; i++)
+		tx[i] = dgram->tx[(dgram->tx_head + i) % dgram->tx_budget];
+
+	l_free(dgram->tx);
+	dgram->tx = tx;
+	dgram->tx_head = 0;
+	dgram->tx_budget = tx_budget;
+	dgram->rx_budget = rx_budget;
+
+	return true;
+}
+
+/**
+ * l_dgram_set_recv_handler:
+ * @dgram: datagram object
+ * @callback: receive handler, or NULL to stop receiving
+ * @user_data: user data provided to receive handler
+ * @destroy: destroy function for user data
+ *
+ * Set the handler called for each received datagram.  The contents of the
+ * #l_dgram_msg are only valid for the duration of the call.
+ *
+ * Returns: true on success and false on failure
+ **/
+LIB_EXPORT bool l_dgram_set_recv_handler(struct l_dgram *dgram,
+					l_dgram_recv_cb_t callback,
+					void *user_data,
+					l_dgram_destroy_cb_t destroy)
+{
+	if (unlikely(!dgram || dgram->destroyed))
+		return false;
+
+	if (dgram->recv_destroy)
+		dgram->recv_destroy(dgram->recv_data);
+
+	dgram->recv_cb = callback;
+	dgram->recv_data = user_data;
+	dgram->recv_destroy = destroy;
+
+	/* The read handler notices the change once the batch is done */
+	if (dgram->in_dispatch)
+		return true;
+
+	return l_io_set_read_handler(dgram->io,
+					callback ? dgram_read_handler : NULL,
+					dgram, NULL);
+}
+
+/**
+ * l_dgram_send:
+ * @dgram: datagram object
+ * @addr: destination address, or NULL for a connected socket
+ * @addr_len: length of @addr
+ * @data: datagram contents
+ * @len: length of @data
+ *
+ * Queue a datagram for sending.  Datagrams queued from the receive handler
+ * are sent once the received batch has been handled, others on the next
+ * main loop iteration or as soon as a full batch is waiting.  Errors that
+ * occur at that point cause the datagram to be dropped, and are counted by
+ * l_dgram_get_tx_dropped().
+ *
+ * Returns: 0 if the datagram was queued, -EMSGSIZE if it is larger than
+ * the buffer size, -ENOBUFS if the queue is full, or -EINVAL
+ **/
+LIB_EXPORT int l_dgram_send(struct l_dgram *dgram,
+				const struct sockaddr *addr,
+				socklen_t addr_len,
+				const void *data, size_t len)
+{
+	struct dgram_tx *tx;
+
+	if (unlikely(!dgram || dgram->destroyed || (!data && len)))
+		return -EINVAL;
+
+	if (unlikely(addr_len > sizeof(tx->addr) || (!addr && addr_len)))
+		return -EINVAL;
+
+	if (len > dgram->buf_size)
+		return -EMSGSIZE;
+
+	if (dgram->tx_len == dgram->tx_budget) {
+		if (!dgram->tx_blocked)
+			dgram_tx_flush(dgram);
+
+		if (dgram->tx_len == dgram->tx_budget)
+			return -ENOBUFS;
+	}
+
+	tx = &dgram->tx[(dgram->tx_head + dgram->tx_len) % dgram->tx_budget];
+
+	if (addr_len)
+		memcpy(&tx->addr, addr, addr_len);
+
+	tx->addr_len = addr_len;
+	tx->buf = l_pool_alloc(dgram->tx_pool);
+	memcpy(tx->buf, data, len);
+	tx->len = len;
+	dgram->tx_len++;
+
+	if (dgram->tx_blocked || dgram->in_dispatch)
+		return 0;
+
+	if (dgram->tx_len >= dgram->batch)
+		dgram_tx_flush(dgram);
+	else if (!dgram->flush_idle)
+		dgram->flush_idle = l_idle_create(dgram_flush_idle, dgram,
+							NULL);
+
+	return 0;
+}
+
+/**
+ * l_dgram_flush:
+ * @dgram: datagram object
+ *
+ * Send the queued datagrams right away.
+ *
+ * Returns: 0 if all of them were sent, -EAGAIN if some are left waiting
+ * for the socket to become writable, or the negative errno of the last
+ * datagram that had to be dropped
+ **/
+LIB_EXPORT int l_dgram_flush(struct l_dgram *dgram)
+{
+	if (unlikely(!dgram))
+		return -EINVAL;
+
+	if (dgram->tx_blocked)
+		return -EAGAIN;
+
+	return dgram_tx_flush(dgram);
+}
+
+/**
+ * l_dgram_get_tx_dropped:
+ * @dgram: datagram object
+ *
+ * Returns: the number of queued datagrams that could not be sent
+ **/
+LIB_EXPORT unsigned int l_dgram_get_tx_dropped(struct l_dgram *dgram)
+{
+	if (unlikely(!dgram))
+		return 0;
+
+	return dgram->tx_dropped;
+}
+
+/**
+ * l_dgram_msg_get_cmsg:
+ * @msg: received datagram
+ * @level: control message level, e.g. SOL_SOCKET
+ * @type: control message type, e.g. SCM_TIMESTAMP
+ * @len: expected length of the control message data
+ *
+ * Find the ancillary data of the given @level and @type received along
+ * with @msg.  The socket options that enable it have to be set by the
+ * owner of the socket.
+ *
+ * Returns: pointer to the data, or NULL if not present or not @len long
+ **/
+LIB_EXPORT const void *l_dgram_msg_get_cmsg(const struct l_dgram_msg *msg,
+						int level, int type,
+						size_t len)
+{
+	struct msghdr hdr = {};
+	struct cmsghdr *cmsg;
+
+	if (unlikely(!msg || !msg->control))
+		return NULL;
+
+	hdr.msg_control = (void *) msg->control;
+	hdr.msg_controllen = msg->control_len;
+
+	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg;
+					cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+		if (cmsg->cmsg_level == level && cmsg->cmsg_type == type &&
+				cmsg->cmsg_len == CMSG_LEN(len))
+			return CMSG_DATA(cmsg);
+	}
+
+	return NULL;
+}
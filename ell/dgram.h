@@ -0,0 +1,62 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef __ELL_DGRAM_H
+#define __ELL_DGRAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct l_dgram;
+
+struct l_dgram_msg {
+	const void *data;
+	size_t len;
+	const struct sockaddr *addr;
+	socklen_t addr_len;
+	const void *control;
+	size_t control_len;
+	uint64_t timestamp;
+	bool truncated;
+};
+
+typedef void (*l_dgram_recv_cb_t)(struct l_dgram *dgram,
+					const struct l_dgram_msg *msg,
+					void *user_data);
+typedef void (*l_dgram_destroy_cb_t)(void *user_data);
+
+struct l_dgram *l_dgram_new(int fd, unsigned int batch, size_t buf_size);
+void l_dgram_free(struct l_dgram *dgram);
+
+int l_dgram_get_fd(struct l_dgram *dgram);
+bool l_dgram_set_close_on_free(struct l_dgram *dgram, bool do_close);
+bool l_dgram_set_budget(struct l_dgram *dgram, unsigned int rx_budget,
+					unsigned int tx_budget);
+
+bool l_dgram_set_recv_handler(struct l_dgram *dgram,
+				l_dgram_recv_cb_t callback, void *user_data,
+				l_dgram_destroy_cb_t destroy);
+
+int l_dgram_send(struct l_dgram *dgram, const struct sockaddr *addr,
+			socklen_t addr_len, const void *data, size_t len);
+int l_dgram_flush(struct l_dgram *dgram);
+unsigned int l_dgram_get_tx_dropped(struct l_dgram *dgram);
+
+const void *l_dgram_msg_get_cmsg(const struct l_dgram_msg *msg,
+					int level, int type, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ELL_DGRAM_H */
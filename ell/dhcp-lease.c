@@ -9,6 +9,8 @@
 #include <config.h>
 #endif
 
+#include <stddef.h>
+#include <string.h>
 #include <linux/types.h>
 #include <netinet/ip.h>
 #include <arpa/inet.h>
@@ -19,6 +21,10 @@
 #include "dhcp-private.h"
 #include "utf8.h"
 #include "net.h"
+#include "settings.h"
+#include "strv.h"
+#include "time.h"
+#include "time-private.h"
 
 struct l_dhcp_lease *_dhcp_lease_new(void)
 {
@@ -32,116 +38,175 @@ void _dhcp_lease_free(struct l_dhcp_lease *lease)
 	if (!lease)
 		return;
 
-	l_free(lease->dns);
-	l_free(lease->domain_name);
-	l_free(lease->client_id);
+	/* Parsed leases carry these in the same allocation */
+	if (!lease->packed) {
+		l_free(lease->dns);
+		l_free(lease->domain_name);
+		l_free(lease->client_id);
+	}
 
 	l_free(lease);
 }
 
-struct l_dhcp_lease *_dhcp_lease_parse_options(struct dhcp_message_iter *iter)
+/* Copies the client side fields of @lease */
+struct l_dhcp_lease *_dhcp_lease_copy(const struct l_dhcp_lease *lease)
 {
-	struct l_dhcp_lease *lease = _dhcp_lease_new();
-	uint8_t t, l;
-	const void *v;
+	struct l_dhcp_lease *copy = _dhcp_lease_new();
+	unsigned int n_dns = 0;
+
+	copy->address = lease->address;
+	copy->server_address = lease->server_address;
+	copy->subnet_mask = lease->subnet_mask;
+	copy->broadcast = lease->broadcast;
+	copy->lifetime = lease->lifetime;
+	copy->t1 = lease->t1;
+	copy->t2 = lease->t2;
+	copy->bound_time = lease->bound_time;
+	copy->router = lease->router;
+	memcpy(copy->server_mac, lease->server_mac, sizeof(copy->server_mac));
+
+	if (lease->dns) {
+		while (lease->dns[n_dns])
+			n_dns++;
+
+		copy->dns = l_memdup(lease->dns, (n_dns + 1) * 4);
+	}
 
-	while (_dhcp_message_iter_next(iter, &t, &l, &v)) {
-		switch (t) {
-		case L_DHCP_OPTION_IP_ADDRESS_LEASE_TIME:
-			if (l == 4)
-				lease->lifetime = l_get_be32(v);
-			break;
-		case L_DHCP_OPTION_SERVER_IDENTIFIER:
-			if (l == 4)
-				lease->server_address = l_get_u32(v);
-			break;
-		case L_DHCP_OPTION_SUBNET_MASK:
-			if (l == 4)
-				lease->subnet_mask = l_get_u32(v);
-			break;
-		case L_DHCP_OPTION_ROUTER:
-			if (l == 4)
-				lease->router = l_get_u32(v);
-			break;
-		case L_DHCP_OPTION_RENEWAL_T1_TIME:
-			if (l == 4)
-				lease->t1 = l_get_be32(v);
-			break;
-		case L_DHCP_OPTION_REBINDING_T2_TIME:
-			if (l == 4)
-				lease->t2 = l_get_be32(v);
-			break;
-		case L_DHCP_OPTION_BROADCAST_ADDRESS:
-			if (l == 4)
-				lease->broadcast = l_get_u32(v);
-			break;
-		case L_DHCP_OPTION_DOMAIN_NAME_SERVER:
-			if (lease->dns)
-				goto error;
+	copy->domain_name = l_strdup(lease->domain_name);
 
-			if (l >= 4 && !(l % 4)) {
-				unsigned i = 0;
+	return copy;
+}
 
-				lease->dns = l_new(uint32_t, l / 4 + 1);
+/*
+ * Options with a fixed 4 byte value that are stored straight into a lease
+ * field, indexed by option code.  An entry with a zero offset is not one
+ * of those.
+ */
+struct lease_option {
+	uint16_t offset;
+	bool be32 : 1;
+};
+
+#define LEASE_U32(field) { offsetof(struct l_dhcp_lease, field), false }
+#define LEASE_BE32(field) { offsetof(struct l_dhcp_lease, field), true }
+
+static const struct lease_option lease_options[256] = {
+	[L_DHCP_OPTION_IP_ADDRESS_LEASE_TIME]	= LEASE_BE32(lifetime),
+	[L_DHCP_OPTION_SERVER_IDENTIFIER]	= LEASE_U32(server_address),
+	[L_DHCP_OPTION_SUBNET_MASK]		= LEASE_U32(subnet_mask),
+	[L_DHCP_OPTION_ROUTER]			= LEASE_U32(router),
+	[L_DHCP_OPTION_RENEWAL_T1_TIME]		= LEASE_BE32(t1),
+	[L_DHCP_OPTION_REBINDING_T2_TIME]	= LEASE_BE32(t2),
+	[L_DHCP_OPTION_BROADCAST_ADDRESS]	= LEASE_U32(broadcast),
+};
+
+static bool lease_parse_domain_name(const void *v, uint8_t *len)
+{
+	char name[254];
+	uint8_t l = *len;
 
-				while (l >= 4) {
-					lease->dns[i] = l_get_u32(v + i * 4);
-					l -= 4;
+	if (l < 1 || l > 253)
+		return false;
 
-					if (lease->dns[i])
-						i++;
-				}
-			}
-			break;
-		case L_DHCP_OPTION_DOMAIN_NAME:
-			if (l < 1 || l > 253 || lease->domain_name)
-				goto error;
+	/* Disallow embedded NUL bytes. */
+	if (memchr(v, 0, l - 1))
+		return false;
 
-			/* Disallow embedded NUL bytes. */
-			if (memchr(v, 0, l - 1))
-				goto error;
+	/*
+	 * RFC2132 doesn't say whether ending NULLs are present
+	 * or not.  However, section 2 recommends that trailing
+	 * NULLs should not be used but must not be treated
+	 * as an error
+	 */
+	if (l_get_u8(v + l - 1) == 0)
+		l -= 1;
 
-			/*
-			 * RFC2132 doesn't say whether ending NULLs are present
-			 * or not.  However, section 2 recommends that trailing
-			 * NULLs should not be used but must not be treated
-			 * as an error
-			 */
-			if (l_get_u8(v + l - 1) == 0)
-				l -= 1;
+	if (!l_utf8_validate(v, l, NULL))
+		return false;
 
-			if (!l_utf8_validate(v, l, NULL))
-				goto error;
+	memcpy(name, v, l);
+	name[l] = '\0';
 
-			lease->domain_name = l_new(char, l + 1);
+	if (l_net_hostname_is_root(name))
+		return false;
 
-			memcpy(lease->domain_name, v, l);
+	if (l_net_hostname_is_localhost(name))
+		return false;
 
-			if (l_net_hostname_is_root(lease->domain_name))
-				goto error;
+	*len = l;
+	return true;
+}
 
-			if (l_net_hostname_is_localhost(lease->domain_name))
-				goto error;
+/*
+ * Parse the options in one pass.  Fixed size options are decoded through
+ * lease_options, the variable length ones are only located and then
+ * copied after the lease so that it takes a single allocation.
+ */
+struct l_dhcp_lease *_dhcp_lease_parse_options(struct dhcp_message_iter *iter)
+{
+	struct l_dhcp_lease fixed = {};
+	struct l_dhcp_lease *lease;
+	const void *dns = NULL;
+	const void *domain_name = NULL;
+	const void *client_id = NULL;
+	uint8_t dns_len = 0;
+	uint8_t domain_name_len = 0;
+	uint8_t client_id_len = 0;
+	unsigned int n_dns = 0;
+	size_t size;
+	uint8_t *tail;
+	uint8_t t, l;
+	const void *v;
+	unsigned int i;
+
+	while (_dhcp_message_iter_next(iter, &t, &l, &v)) {
+		const struct lease_option *opt = &lease_options[t];
+
+		if (opt->offset) {
+			uint32_t *field = (void *) &fixed + opt->offset;
+
+			if (l == 4)
+				*field = opt->be32 ? l_get_be32(v) :
+							l_get_u32(v);
+
+			continue;
+		}
+
+		switch (t) {
+		case L_DHCP_OPTION_DOMAIN_NAME_SERVER:
+			if (dns)
+				return NULL;
+
+			if (l >= 4 && !(l % 4)) {
+				dns = v;
+				dns_len = l;
+			}
 
+			break;
+		case L_DHCP_OPTION_DOMAIN_NAME:
+			if (domain_name || !lease_parse_domain_name(v, &l))
+				return NULL;
+
+			domain_name = v;
+			domain_name_len = l;
 			break;
 		case DHCP_OPTION_CLIENT_IDENTIFIER:
-			if (l < 1 || l > 253 || lease->client_id)
-				goto error;
+			if (l < 1 || l > 253 || client_id)
+				return NULL;
 
-			lease->client_id = l_malloc(l + 1);
-			lease->client_id[0] = l;
-			memcpy(lease->client_id + 1, v, l);
+			client_id = v;
+			client_id_len = l;
 			break;
 		default:
 			break;
 		}
 	}
 
-	if (!lease->server_address || !lease->lifetime)
-		goto error;
+	if (!fixed.server_address || !fixed.lifetime)
+		return NULL;
 
-	if (lease->lifetime < 10)
-		goto error;
+	if (fixed.lifetime < 10)
+		return NULL;
 
 	/*
 	 * RFC2131, Section 3.3:
@@ -151,25 +216,66 @@ struct l_dhcp_lease *_dhcp_lease_parse_options(struct dhcp_message_iter *iter)
 	 *
 	 * Don't bother checking t1/t2 for infinite leases
 	 */
-	if (lease->lifetime == 0xffffffffu)
-		return lease;
+	if (fixed.lifetime != 0xffffffffu) {
+		if (!fixed.t1)
+			fixed.t1 = fixed.lifetime / 2;
 
-	if (!lease->t1)
-		lease->t1 = lease->lifetime / 2;
+		if (!fixed.t2)
+			fixed.t2 = fixed.lifetime / 8 * 7;
 
-	if (!lease->t2)
-		lease->t2 = lease->lifetime / 8 * 7;
+		if (fixed.t1 > fixed.t2)
+			return NULL;
 
-	if (lease->t1 > lease->t2)
-		goto error;
+		if (fixed.t2 > fixed.lifetime)
+			return NULL;
+	}
 
-	if (lease->t2 > lease->lifetime)
-		goto error;
+	/* Zero DNS addresses are skipped, the list is zero terminated */
+	for (i = 0; i < dns_len; i += 4)
+		if (l_get_u32(dns + i))
+			n_dns++;
+
+	size = sizeof(fixed);
+
+	if (dns)
+		size += (n_dns + 1) * 4;
+
+	if (client_id)
+		size += client_id_len + 1;
+
+	if (domain_name)
+		size += domain_name_len + 1;
+
+	lease = l_malloc(size);
+	memcpy(lease, &fixed, sizeof(fixed));
+	lease->packed = true;
+	tail = (uint8_t *) (lease + 1);
+
+	if (dns) {
+		lease->dns = (uint32_t *) tail;
+
+		for (i = 0, n_dns = 0; i < dns_len; i += 4)
+			if (l_get_u32(dns + i))
+				lease->dns[n_dns++] = l_get_u32(dns + i);
+
+		lease->dns[n_dns] = 0;
+		tail += (n_dns + 1) * 4;
+	}
+
+	if (client_id) {
+		lease->client_id = tail;
+		lease->client_id[0] = client_id_len;
+		memcpy(lease->client_id + 1, client_id, client_id_len);
+		tail += client_id_len + 1;
+	}
+
+	if (domain_name) {
+		lease->domain_name = (char *) tail;
+		memcpy(lease->domain_name, domain_name, domain_name_len);
+		lease->domain_name[domain_name_len] = '\0';
+	}
 
 	return lease;
-error:
-	_dhcp_lease_free(lease);
-	return NULL;
 }
 
 static inline char *get_ip(uint32_t ip)
@@ -312,6 +418,28 @@ LIB_EXPORT char *l_dhcp_lease_get_domain_name(const struct l_dhcp_lease *lease)
 	return l_strdup(lease->domain_name);
 }
 
+/*
+ * Borrowed views of the DNS and domain name options.  These stay valid for
+ * as long as @lease does and spare the caller the string conversions.
+ */
+LIB_EXPORT const uint32_t *l_dhcp_lease_get_dns_u32(
+					const struct l_dhcp_lease *lease)
+{
+	if (unlikely(!lease))
+		return NULL;
+
+	return lease->dns;
+}
+
+LIB_EXPORT const char *l_dhcp_lease_peek_domain_name(
+					const struct l_dhcp_lease *lease)
+{
+	if (unlikely(!lease))
+		return NULL;
+
+	return lease->domain_name;
+}
+
 LIB_EXPORT uint32_t l_dhcp_lease_get_t1(const struct l_dhcp_lease *lease)
 {
 	if (unlikely(!lease))
@@ -352,3 +480,186 @@ LIB_EXPORT const uint8_t *l_dhcp_lease_get_mac(const struct l_dhcp_lease *lease)
 
 	return lease->mac;
 }
+
+static void settings_set_ip(struct l_settings *settings, const char *group,
+					const char *key, uint32_t ip)
+{
+	char *str = get_ip(ip);
+
+	if (str)
+		l_settings_set_string(settings, group, key, str);
+
+	l_free(str);
+}
+
+static bool settings_get_ip(const struct l_settings *settings,
+				const char *group, const char *key,
+				uint32_t *out_ip)
+{
+	const char *str = l_settings_get_value(settings, group, key);
+	struct in_addr addr;
+
+	*out_ip = 0;
+
+	if (!str)
+		return true;
+
+	if (inet_pton(AF_INET, str, &addr) != 1)
+		return false;
+
+	*out_ip = addr.s_addr;
+	return true;
+}
+
+/**
+ * l_dhcp_lease_save:
+ * @lease: Lease obtained by a DHCP client
+ * @settings: Settings object to store the lease in
+ * @group: Name of the group to use in @settings
+ *
+ * Stores @lease so that it can be restored with l_dhcp_lease_load, possibly
+ * after a restart, and handed to l_dhcp_client_set_lease.  The time the
+ * lease was obtained is kept as wall clock time.
+ *
+ * Returns: #true on success, #false otherwise.
+ **/
+LIB_EXPORT bool l_dhcp_lease_save(const struct l_dhcp_lease *lease,
+					struct l_settings *settings,
+					const char *group)
+{
+	uint64_t bound_realtime;
+	char **dns;
+
+	if (unlikely(!lease || !settings || !group || !lease->address))
+		return false;
+
+	if (!l_settings_add_group(settings, group))
+		return false;
+
+	bound_realtime = time_realtime_now() -
+			l_time_diff(l_time_now(), lease->bound_time);
+
+	settings_set_ip(settings, group, "Address", lease->address);
+	settings_set_ip(settings, group, "ServerAddress",
+						lease->server_address);
+	l_settings_set_bytes(settings, group, "ServerMAC", lease->server_mac,
+						sizeof(lease->server_mac));
+	settings_set_ip(settings, group, "SubnetMask", lease->subnet_mask);
+	settings_set_ip(settings, group, "Broadcast", lease->broadcast);
+	settings_set_ip(settings, group, "Router", lease->router);
+	l_settings_set_uint(settings, group, "Lifetime", lease->lifetime);
+	l_settings_set_uint(settings, group, "T1", lease->t1);
+	l_settings_set_uint(settings, group, "T2", lease->t2);
+	l_settings_set_uint64(settings, group, "BoundTime", bound_realtime);
+
+	dns = l_dhcp_lease_get_dns(lease);
+	if (dns)
+		l_settings_set_string_list(settings, group, "DNS", dns, ',');
+
+	l_strfreev(dns);
+
+	if (lease->domain_name)
+		l_settings_set_string(settings, group, "DomainName",
+							lease->domain_name);
+
+	return true;
+}
+
+/**
+ * l_dhcp_lease_load:
+ * @settings: Settings object holding a lease stored by l_dhcp_lease_save
+ * @group: Name of the group the lease was stored under
+ *
+ * Returns: A newly allocated lease to be freed with l_dhcp_lease_free, or
+ * #NULL if no valid lease was found or the lease has already expired.
+ **/
+LIB_EXPORT struct l_dhcp_lease *l_dhcp_lease_load(
+					const struct l_settings *settings,
+					const char *group)
+{
+	struct l_dhcp_lease *lease;
+	uint64_t bound_realtime;
+	uint64_t now_realtime = time_realtime_now();
+	uint64_t now = l_time_now();
+	uint64_t elapsed;
+	uint8_t *server_mac;
+	size_t mac_len;
+	char **dns;
+	unsigned int i;
+
+	if (unlikely(!settings || !group))
+		return NULL;
+
+	if (!l_settings_has_group(settings, group))
+		return NULL;
+
+	lease = _dhcp_lease_new();
+
+	if (!settings_get_ip(settings, group, "Address", &lease->address) ||
+			!lease->address ||
+			!settings_get_ip(settings, group, "ServerAddress",
+						&lease->server_address) ||
+			!settings_get_ip(settings, group, "SubnetMask",
+						&lease->subnet_mask) ||
+			!settings_get_ip(settings, group, "Broadcast",
+						&lease->broadcast) ||
+			!settings_get_ip(settings, group, "Router",
+						&lease->router))
+		goto error;
+
+	if (!l_settings_get_uint(settings, group, "Lifetime",
+							&lease->lifetime) ||
+			!l_settings_get_uint64(settings, group, "BoundTime",
+							&bound_realtime))
+		goto error;
+
+	l_settings_get_uint(settings, group, "T1", &lease->t1);
+	l_settings_get_uint(settings, group, "T2", &lease->t2);
+
+	elapsed = l_time_diff(now_realtime, bound_realtime);
+
+	if (lease->lifetime != 0xffffffffu &&
+			(l_time_after(bound_realtime, now_realtime) ||
+			 elapsed >= lease->lifetime * L_USEC_PER_SEC))
+		goto error;
+
+	lease->bound_time = now > elapsed ? now - elapsed : 0;
+
+	server_mac = l_settings_get_bytes(settings, group, "ServerMAC",
+								&mac_len);
+	if (server_mac && mac_len == sizeof(lease->server_mac))
+		memcpy(lease->server_mac, server_mac, mac_len);
+
+	l_free(server_mac);
+
+	dns = l_settings_get_string_list(settings, group, "DNS", ',');
+	if (dns) {
+		lease->dns = l_new(uint32_t, l_strv_length(dns) + 1);
+
+		for (i = 0; dns[i]; i++) {
+			struct in_addr addr;
+
+			if (inet_pton(AF_INET, dns[i], &addr) != 1) {
+				l_strfreev(dns);
+				goto error;
+			}
+
+			lease->dns[i] = addr.s_addr;
+		}
+
+		l_strfreev(dns);
+	}
+
+	lease->domain_name = l_settings_get_string(settings, group,
+							"DomainName");
+	return lease;
+
+error:
+	_dhcp_lease_free(lease);
+	return NULL;
+}
+
+LIB_EXPORT void l_dhcp_lease_free(struct l_dhcp_lease *lease)
+{
+	_dhcp_lease_free(lease);
+}
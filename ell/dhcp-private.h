@@ -5,6 +5,8 @@
  * SPDX-License-Identifier: LGPL-2.1-or-later
  */
 
+#include "pqueue.h"
+
 struct l_dhcp_client;
 struct l_dhcp_server;
 
@@ -51,6 +53,7 @@ enum dhcp_option_overload {
 #define DHCP_OPTION_MAXIMUM_MESSAGE_SIZE 57 /* Section 9.10 */
 #define DHCP_OPTION_CLIENT_IDENTIFIER 61 /* Section 9.14 */
 #define DHCP_OPTION_RAPID_COMMIT 80 /* RFC 4039 Section 4 */
+#define DHCP_OPTION_RELAY_AGENT_INFORMATION 82 /* RFC 3046 */
 
 /* RFC 2131, Figure 2 */
 #define DHCP_FLAG_BROADCAST (1 << 15)
@@ -115,6 +118,10 @@ struct dhcp_transport {
 struct dhcp_transport *_dhcp_default_transport_new(uint32_t ifindex,
 							const char *ifname,
 							uint16_t port);
+struct dhcp_transport *_dhcp_shared_transport_new(uint32_t ifindex,
+							const char *ifname,
+							uint16_t port);
+struct dhcp_transport *_dhcp_relay_transport_new(uint16_t port);
 void _dhcp_transport_free(struct dhcp_transport *transport);
 void _dhcp_transport_set_rx_callback(struct dhcp_transport *transport,
 					dhcp_transport_rx_cb_t rx_cb,
@@ -133,12 +140,28 @@ bool _dhcp_client_set_transport(struct l_dhcp_client *client,
 struct dhcp_transport *_dhcp_client_get_transport(struct l_dhcp_client *client);
 void _dhcp_client_override_xid(struct l_dhcp_client *client, uint32_t xid);
 
+typedef void (*dhcp_client_trace_func_t)(struct l_dhcp_client *client,
+						uint8_t msg_type,
+						void *user_data);
+void _dhcp_client_set_trace(struct l_dhcp_client *client,
+				dhcp_client_trace_func_t func,
+				void *user_data);
+
 bool _dhcp_server_set_transport(struct l_dhcp_server *server,
 					struct dhcp_transport *transport);
+bool _dhcp_server_set_relay_transport(struct l_dhcp_server *server,
+					struct dhcp_transport *transport);
 struct dhcp_transport *_dhcp_server_get_transport(struct l_dhcp_server *server);
 
 bool _dhcp_server_set_max_expired_clients(struct l_dhcp_server *server,
 						unsigned int max_expired);
+bool _dhcp_server_set_max_offers(struct l_dhcp_server *server,
+					unsigned int max_offers);
+bool _dhcp_server_set_rate_limit(struct l_dhcp_server *server,
+					unsigned int mac_rate,
+					unsigned int mac_burst,
+					unsigned int global_rate,
+					unsigned int global_burst);
 
 struct l_dhcp_lease {
 	uint32_t address;
@@ -156,13 +179,18 @@ struct l_dhcp_lease {
 	/* for server */
 	uint8_t mac[6];
 	uint8_t *client_id;
+	/* position in the server's expiry queue while offered or active */
+	struct l_pqueue_node expiry_node;
 
 	/* set for an offered lease, but not ACK'ed */
 	bool offering : 1;
+	/* dns, domain_name and client_id share the lease allocation */
+	bool packed : 1;
 };
 
 struct l_dhcp_lease *_dhcp_lease_new(void);
 void _dhcp_lease_free(struct l_dhcp_lease *lease);
+struct l_dhcp_lease *_dhcp_lease_copy(const struct l_dhcp_lease *lease);
 struct l_dhcp_lease *_dhcp_lease_parse_options(struct dhcp_message_iter *iter);
 
 struct dhcp_message_builder {
@@ -177,6 +205,8 @@ bool _dhcp_message_builder_init(struct dhcp_message_builder *builder,
 bool _dhcp_message_builder_append(struct dhcp_message_builder *builder,
 					uint8_t code, size_t optlen,
 					const void *optval);
+bool _dhcp_message_builder_append_encoded(struct dhcp_message_builder *builder,
+						const void *options, size_t len);
 bool _dhcp_message_builder_append_prl(struct dhcp_message_builder *builder,
 					const unsigned long *reqopts);
 uint8_t *_dhcp_message_builder_finalize(struct dhcp_message_builder *builder,
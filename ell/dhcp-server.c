@@ -12,23 +12,35 @@
 #include <linux/types.h>
 #include <net/ethernet.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <time.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdlib.h>
 
 #include "private.h"
 #include "time.h"
 #include "net.h"
 #include "dhcp.h"
 #include "dhcp-private.h"
+#include "memory-private.h"
 #include "queue.h"
+#include "hashmap.h"
+#include "uintset.h"
 #include "useful.h"
 #include "strv.h"
 #include "timeout.h"
+#include "log.h"
+#include "idle.h"
+#include "file.h"
 #include "acd.h"
 #include "log.h"
 #include "util.h"
+#include "probe-private.h"
 
 /* 8 hours */
 #define DEFAULT_DHCP_LEASE_SEC (8*60*60)
@@ -38,26 +50,112 @@
 
 #define MAX_EXPIRED_LEASES 50
 
+/* Offers not yet turned into a lease, the oldest is dropped beyond this */
+#define MAX_PENDING_OFFERS 256
+
+/*
+ * Token bucket limits in packets per second.  Each client MAC gets a bucket
+ * (hashed into a fixed table, so unrelated clients may share one) and
+ * clients without an offer or lease also draw from a global bucket.
+ */
+#define MAC_RATE 4
+#define MAC_BURST 16
+#define MAC_BUCKETS 1024
+#define GLOBAL_RATE 200
+#define GLOBAL_BURST 400
+
+/* Replies are built on the stack, this fits any of them */
+#define REPLY_BUF_SIZE (sizeof(struct dhcp_message) + DHCP_MIN_OPTIONS_SIZE)
+
 static const uint8_t MAC_BCAST_ADDR[ETH_ALEN] = {
 	0xff, 0xff, 0xff, 0xff, 0xff, 0xff
 };
 
+struct rate_bucket {
+	uint64_t tokens;	/* In millionths of a packet */
+	uint64_t last;
+};
+
+/*
+ * An address range handed out on one subnet.  start_ip, end_ip and network
+ * are in host order, netmask and gateway in network order.
+ */
+struct dhcp_pool {
+	uint32_t network;
+	uint32_t start_ip;
+	uint32_t end_ip;
+	uint32_t netmask;
+	uint32_t gateway;
+
+	/*
+	 * A bit is set for every address in [start_ip, end_ip] that is
+	 * leased, expired or reserved, built on first use.
+	 */
+	struct l_uintset *ip_pool;
+
+	/* Encoded subnet mask, router and DNS server options */
+	uint8_t options[2 * 6 + 2 + 255];
+	size_t options_len;
+	bool options_valid : 1;
+};
+
 struct l_dhcp_server {
 	bool started;
 	int ifindex;
 	char *ifname;
-	uint32_t start_ip;
-	uint32_t end_ip;
 	uint32_t address;
-	uint32_t netmask;
-	uint32_t gateway;
 	uint32_t *dns_list;
 	uint32_t lease_seconds;
 	unsigned int max_expired;
 
-	struct l_queue *lease_list;
+	/* Offered and active leases, ordered by expiry time */
+	struct l_pqueue *lease_queue;
 	struct l_queue *expired_list;
 
+	/* Offered leases, oldest first */
+	struct l_queue *offer_list;
+	unsigned int max_offers;
+
+	/* Flood protection, see rate_limit_check() */
+	struct rate_bucket *mac_buckets;
+	struct rate_bucket global_bucket;
+	unsigned int mac_rate;
+	unsigned int mac_burst;
+	unsigned int global_rate;
+	unsigned int global_burst;
+
+	/* The directly attached subnet */
+	struct dhcp_pool local;
+
+	/*
+	 * Subnets served through relay agents, one map per prefix length
+	 * keyed by the network address.  relay_prefixes has bit N set if
+	 * relay_pools[N] is not empty.  See relay_pool_lookup().
+	 */
+	struct l_hashmap *relay_pools[33];
+	uint64_t relay_prefixes;
+	struct dhcp_transport *relay_transport;
+
+	/*
+	 * Lookup indexes over the offered/active and expired leases.
+	 * Addresses are unique across both sets, MACs and client IDs are
+	 * only indexed for the offered/active leases and map to a queue of
+	 * leases.
+	 */
+	struct l_hashmap *leases_by_ip;
+	struct l_hashmap *expired_by_ip;
+	struct l_hashmap *leases_by_mac;
+	struct l_hashmap *leases_by_client_id;
+
+	/* Optional persistent lease file, see lease_store_load() */
+	char *lease_file;
+	int lease_fd;
+	uint8_t *lease_buf;
+	size_t lease_buf_len;
+	size_t lease_buf_size;
+	unsigned int lease_records;
+	struct l_idle *lease_flush;
+
 	/* Next lease expiring */
 	struct l_timeout *next_expire;
 
@@ -75,6 +173,7 @@ struct l_dhcp_server {
 
 	bool authoritative : 1;
 	bool rapid_commit : 1;
+	bool shared_socket : 1;
 };
 
 #define MAC "%02x:%02x:%02x:%02x:%02x:%02x"
@@ -90,6 +189,16 @@ struct l_dhcp_server {
 	l_util_debug(server->debug_handler, server->debug_data,		\
 			"%s:%i " fmt, __func__, __LINE__, ## args)
 
+/* For paths a client can make us hit for every packet it sends */
+#define SERVER_DEBUG_RATELIMITED(fmt, args...)				\
+	do {								\
+		static struct l_log_ratelimit ratelimit;		\
+		l_util_debug_ratelimited(&ratelimit,			\
+				server->debug_handler,			\
+				server->debug_data, "%s:%i " fmt,	\
+				__func__, __LINE__, ## args);		\
+	} while (0)
+
 static uint64_t get_lease_expiry_time(const struct l_dhcp_lease *lease)
 {
 	return lease->bound_time + lease->lifetime * L_USEC_PER_SEC;
@@ -97,9 +206,18 @@ static uint64_t get_lease_expiry_time(const struct l_dhcp_lease *lease)
 
 static bool is_expired_lease(const struct l_dhcp_lease *lease)
 {
-	return !l_time_after(get_lease_expiry_time(lease), l_time_now());
+	return !l_time_after(get_lease_expiry_time(lease), l_time_now_cached());
+}
+
+static bool lease_expires_before(const struct l_dhcp_lease *a,
+					const struct l_dhcp_lease *b)
+{
+	return get_lease_expiry_time(a) < get_lease_expiry_time(b);
 }
 
+L_PQUEUE_DEFINE(lease_queue, struct l_dhcp_lease, expiry_node,
+		lease_expires_before)
+
 static bool match_lease_client_id(const void *data, const void *user_data)
 {
 	const struct l_dhcp_lease *lease = data;
@@ -109,6 +227,14 @@ static bool match_lease_client_id(const void *data, const void *user_data)
 		!memcmp(lease->client_id, client_id, client_id[0] + 1);
 }
 
+static bool client_id_equal(const uint8_t *a, const uint8_t *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return a[0] == b[0] && !memcmp(a + 1, b + 1, a[0]);
+}
+
 static bool match_lease_mac(const void *data, const void *user_data)
 {
 	const struct l_dhcp_lease *lease = data;
@@ -117,36 +243,522 @@ static bool match_lease_mac(const void *data, const void *user_data)
 	return !memcmp(lease->mac, mac, 6);
 }
 
-static bool match_lease_ip(const void *data, const void *user_data)
+static unsigned int mac_hash(const void *p)
 {
-	const struct l_dhcp_lease *lease = data;
+	const uint8_t *mac = p;
+	unsigned int hash = 2166136261u;
+	unsigned int i;
+
+	for (i = 0; i < ETH_ALEN; i++)
+		hash = (hash ^ mac[i]) * 16777619u;
+
+	return hash;
+}
+
+static int mac_compare(const void *a, const void *b)
+{
+	return memcmp(a, b, ETH_ALEN);
+}
+
+static void *mac_copy(const void *p)
+{
+	return l_memdup(p, ETH_ALEN);
+}
+
+/* Client IDs are stored with their length in the first byte */
+static unsigned int client_id_hash(const void *p)
+{
+	const uint8_t *id = p;
+	unsigned int hash = 2166136261u;
+	unsigned int i;
+
+	for (i = 0; i <= id[0]; i++)
+		hash = (hash ^ id[i]) * 16777619u;
+
+	return hash;
+}
+
+static int client_id_compare(const void *a, const void *b)
+{
+	const uint8_t *id1 = a;
+	const uint8_t *id2 = b;
+
+	if (id1[0] != id2[0])
+		return id1[0] - id2[0];
+
+	return memcmp(id1 + 1, id2 + 1, id1[0]);
+}
+
+static void *client_id_copy(const void *p)
+{
+	const uint8_t *id = p;
+
+	return l_memdup(id, id[0] + 1);
+}
+
+static bool is_reserved_ip(struct l_dhcp_server *server, uint32_t ip)
+{
+	/* e.g. 192.168.55.0 or 192.168.55.255 */
+	if ((ip & 0xff) == 0 || (ip & 0xff) == 0xff)
+		return true;
+
+	return htonl(ip) == server->address;
+}
+
+static bool pool_contains(const struct dhcp_pool *pool, uint32_t ip)
+{
+	return ip >= pool->start_ip && ip <= pool->end_ip;
+}
+
+static uint32_t prefix_to_mask(uint8_t prefix_len)
+{
+	return prefix_len ? 0xffffffffu << (32 - prefix_len) : 0;
+}
+
+/*
+ * Longest prefix match of @ip (host order) over the relay subnets, one
+ * lookup for each prefix length in use.
+ */
+static struct dhcp_pool *relay_pool_lookup(struct l_dhcp_server *server,
+						uint32_t ip)
+{
+	uint64_t prefixes = server->relay_prefixes;
+
+	while (prefixes) {
+		unsigned int len = 63 - __builtin_clzll(prefixes);
+		struct dhcp_pool *pool;
+
+		pool = l_hashmap_lookup(server->relay_pools[len],
+				L_UINT_TO_PTR(ip & prefix_to_mask(len)));
+		if (pool)
+			return pool;
+
+		prefixes &= ~(1ULL << len);
+	}
+
+	return NULL;
+}
+
+/* The pool that @nip is handed out from, if any */
+static struct dhcp_pool *pool_for_ip(struct l_dhcp_server *server,
+					uint32_t nip)
+{
+	uint32_t ip = ntohl(nip);
+	struct dhcp_pool *pool;
+
+	if (pool_contains(&server->local, ip))
+		return &server->local;
+
+	pool = relay_pool_lookup(server, ip);
+	if (pool && pool_contains(pool, ip))
+		return pool;
+
+	return NULL;
+}
+
+static void ip_pool_update(struct l_dhcp_server *server, uint32_t nip,
+				bool used)
+{
+	uint32_t ip = ntohl(nip);
+	struct dhcp_pool *pool = pool_for_ip(server, nip);
+
+	if (!pool || !pool->ip_pool || is_reserved_ip(server, ip))
+		return;
+
+	if (used)
+		l_uintset_put(pool->ip_pool, ip);
+	else
+		l_uintset_take(pool->ip_pool, ip);
+}
+
+/* Addresses outside of the pool are ignored by l_uintset_put */
+static void ip_pool_put_lease(const void *key, void *value, void *user_data)
+{
+	struct l_dhcp_lease *lease = value;
+	struct dhcp_pool *pool = user_data;
+
+	l_uintset_put(pool->ip_pool, ntohl(lease->address));
+}
+
+static void ip_pool_build(struct l_dhcp_server *server,
+				struct dhcp_pool *pool)
+{
+	unsigned int n_leases = l_hashmap_size(server->leases_by_ip) +
+				l_hashmap_size(server->expired_by_ip);
+	uint64_t ip;
+
+	pool->ip_pool = l_uintset_new_from_range(pool->start_ip, pool->end_ip);
+	if (!pool->ip_pool)
+		return;
+
+	for (ip = pool->start_ip & ~0xffu; ip <= pool->end_ip; ip += 256) {
+		l_uintset_put(pool->ip_pool, ip);
+		l_uintset_put(pool->ip_pool, ip | 0xff);
+	}
+
+	l_uintset_put(pool->ip_pool, ntohl(server->address));
+
+	/*
+	 * With many small relay subnets probing each address of the range
+	 * is cheaper than walking all the leases of the server.
+	 */
+	if (pool->end_ip - pool->start_ip >= n_leases) {
+		l_hashmap_foreach(server->leases_by_ip, ip_pool_put_lease,
+					pool);
+		l_hashmap_foreach(server->expired_by_ip, ip_pool_put_lease,
+					pool);
+		return;
+	}
+
+	for (ip = pool->start_ip; ip <= pool->end_ip; ip++) {
+		void *key = L_UINT_TO_PTR(htonl(ip));
+
+		if (l_hashmap_lookup(server->leases_by_ip, key) ||
+				l_hashmap_lookup(server->expired_by_ip, key))
+			l_uintset_put(pool->ip_pool, ip);
+	}
+}
+
+static void ip_pool_invalidate(struct dhcp_pool *pool)
+{
+	l_uintset_free(pool->ip_pool);
+	pool->ip_pool = NULL;
+}
+
+static void relay_pool_free(void *data)
+{
+	struct dhcp_pool *pool = data;
+
+	l_uintset_free(pool->ip_pool);
+	l_free(pool);
+}
+
+static void relay_pool_invalidate_options(const void *key, void *value,
+						void *user_data)
+{
+	struct dhcp_pool *pool = value;
+
+	pool->options_valid = false;
+}
+
+/* DNS servers are common to all pools */
+static void options_invalidate(struct l_dhcp_server *server)
+{
+	unsigned int i;
+
+	server->local.options_valid = false;
+
+	for (i = 0; i < L_ARRAY_SIZE(server->relay_pools); i++)
+		l_hashmap_foreach(server->relay_pools[i],
+					relay_pool_invalidate_options, NULL);
+}
+
+static void id_index_add(struct l_hashmap *index, const void *key,
+				struct l_dhcp_lease *lease)
+{
+	struct l_queue *leases = l_hashmap_lookup(index, key);
+
+	if (!leases) {
+		leases = l_queue_new();
+		l_hashmap_insert(index, key, leases);
+	}
+
+	l_queue_push_tail(leases, lease);
+}
+
+static void id_index_remove(struct l_hashmap *index, const void *key,
+				struct l_dhcp_lease *lease)
+{
+	struct l_queue *leases = l_hashmap_lookup(index, key);
+
+	if (!leases || !l_queue_remove(leases, lease))
+		return;
+
+	if (l_queue_isempty(leases))
+		l_queue_destroy(l_hashmap_remove(index, key), NULL);
+}
+
+static void id_index_destroy(void *data)
+{
+	l_queue_destroy(data, NULL);
+}
+
+/*
+ * The lease file starts with a header and is followed by a log of bind and
+ * unbind records, each a fixed-size part followed by the client ID bytes,
+ * if any.  Expiry times are wall clock seconds so that leases survive a
+ * reboot.  Integers are little endian, the address is in network order.
+ *
+ *	0	type		8	address
+ *	1	client ID len	12	expiry
+ *	2	MAC		20	lifetime
+ */
+#define LEASE_FILE_MAGIC "ELLLEASE"
+#define LEASE_FILE_VERSION 1
+#define LEASE_FILE_HEADER_LEN 12
+#define LEASE_RECORD_LEN 24
+#define LEASE_RECORD_BIND 1
+#define LEASE_RECORD_UNBIND 2
+
+/* Rewrite the file once the log is this much larger than the lease set */
+#define LEASE_FILE_COMPACT_MIN 1024
+
+static void lease_buf_reserve(struct l_dhcp_server *server, size_t len)
+{
+	if (server->lease_buf_len + len <= server->lease_buf_size)
+		return;
+
+	server->lease_buf_size = (server->lease_buf_len + len) * 2;
+	server->lease_buf = l_realloc(server->lease_buf,
+					server->lease_buf_size);
+}
+
+static void lease_record_put(struct l_dhcp_server *server, uint8_t type,
+				const struct l_dhcp_lease *lease)
+{
+	uint8_t id_len = lease->client_id ? lease->client_id[0] : 0;
+	uint64_t expiry = get_lease_expiry_time(lease);
+	uint64_t now = l_time_now();
+	uint8_t *rec;
+
+	lease_buf_reserve(server, LEASE_RECORD_LEN + id_len);
+	rec = server->lease_buf + server->lease_buf_len;
+
+	rec[0] = type;
+	rec[1] = id_len;
+	memcpy(rec + 2, lease->mac, ETH_ALEN);
+	memcpy(rec + 8, &lease->address, 4);
+	l_put_le64(time(NULL) + (l_time_after(expiry, now) ?
+				l_time_to_secs(expiry - now) : 0), rec + 12);
+	l_put_le32(lease->lifetime, rec + 20);
+
+	if (id_len)
+		memcpy(rec + LEASE_RECORD_LEN, lease->client_id + 1, id_len);
+
+	server->lease_buf_len += LEASE_RECORD_LEN + id_len;
+}
+
+static void lease_snapshot_put(const void *key, void *value, void *user_data)
+{
+	struct l_dhcp_lease *lease = value;
+	struct l_dhcp_server *server = user_data;
+
+	if (lease->offering)
+		return;
+
+	lease_record_put(server, LEASE_RECORD_BIND, lease);
+	server->lease_records++;
+}
+
+/*
+ * Replace the lease file with one bind record for each active lease and
+ * reopen it for appending.  Any pending records are covered by the new
+ * contents and are dropped.
+ */
+static bool lease_store_snapshot(struct l_dhcp_server *server)
+{
+	int err;
+
+	if (server->lease_fd >= 0) {
+		L_TFR(close(server->lease_fd));
+		server->lease_fd = -1;
+	}
+
+	server->lease_buf_len = 0;
+	server->lease_records = 0;
+
+	lease_buf_reserve(server, LEASE_FILE_HEADER_LEN);
+	memcpy(server->lease_buf, LEASE_FILE_MAGIC, 8);
+	l_put_le32(LEASE_FILE_VERSION, server->lease_buf + 8);
+	server->lease_buf_len = LEASE_FILE_HEADER_LEN;
+
+	l_hashmap_foreach(server->leases_by_ip, lease_snapshot_put, server);
+
+	err = l_file_set_contents(server->lease_file, server->lease_buf,
+					server->lease_buf_len);
+	server->lease_buf_len = 0;
+
+	if (err < 0) {
+		SERVER_DEBUG("Writing %s failed: %s", server->lease_file,
+				strerror(-err));
+		return false;
+	}
+
+	server->lease_fd = L_TFR(open(server->lease_file,
+					O_WRONLY | O_APPEND | O_CLOEXEC));
+	if (server->lease_fd < 0) {
+		SERVER_DEBUG("Opening %s failed: %s", server->lease_file,
+				strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+static void lease_store_flush(struct l_dhcp_server *server)
+{
+	ssize_t written;
+
+	if (server->lease_flush) {
+		l_idle_remove(server->lease_flush);
+		server->lease_flush = NULL;
+	}
+
+	if (server->lease_fd < 0 || !server->lease_buf_len)
+		return;
+
+	if (server->lease_records > LEASE_FILE_COMPACT_MIN &&
+			server->lease_records >
+			2 * l_hashmap_size(server->leases_by_ip)) {
+		lease_store_snapshot(server);
+		return;
+	}
+
+	written = L_TFR(write(server->lease_fd, server->lease_buf,
+				server->lease_buf_len));
+	if (written != (ssize_t) server->lease_buf_len)
+		SERVER_DEBUG("Writing %s failed", server->lease_file);
+
+	server->lease_buf_len = 0;
+}
+
+static void lease_store_flush_cb(struct l_idle *idle, void *user_data)
+{
+	struct l_dhcp_server *server = user_data;
+
+	lease_store_flush(server);
+}
+
+/*
+ * Queue a record to be written out once the main loop is idle so that all
+ * the changes made while handling a burst of requests end up in a single
+ * write that happens after the replies went out.
+ */
+static void lease_store_append(struct l_dhcp_server *server, uint8_t type,
+				const struct l_dhcp_lease *lease)
+{
+	if (server->lease_fd < 0)
+		return;
+
+	lease_record_put(server, type, lease);
+	server->lease_records++;
+
+	if (!server->lease_flush)
+		server->lease_flush = l_idle_create(lease_store_flush_cb,
+							server, NULL);
+}
+
+/* Must be called for every lease added to or removed from lease_queue */
+static void lease_index_add(struct l_dhcp_server *server,
+				struct l_dhcp_lease *lease)
+{
+	l_hashmap_insert(server->leases_by_ip, L_UINT_TO_PTR(lease->address),
+				lease);
+	id_index_add(server->leases_by_mac, lease->mac, lease);
+
+	if (lease->client_id)
+		id_index_add(server->leases_by_client_id, lease->client_id,
+				lease);
+
+	ip_pool_update(server, lease->address, true);
+}
+
+static void lease_index_remove(struct l_dhcp_server *server,
+				struct l_dhcp_lease *lease)
+{
+	l_hashmap_remove(server->leases_by_ip, L_UINT_TO_PTR(lease->address));
+	id_index_remove(server->leases_by_mac, lease->mac, lease);
+
+	if (lease->client_id)
+		id_index_remove(server->leases_by_client_id, lease->client_id,
+				lease);
+
+	ip_pool_update(server, lease->address, false);
+}
+
+static bool lease_queue_del(struct l_dhcp_server *server,
+				struct l_dhcp_lease *lease)
+{
+	if (!lease_queue_remove(server->lease_queue, lease))
+		return false;
+
+	lease_index_remove(server, lease);
+
+	if (lease->offering)
+		l_queue_remove(server->offer_list, lease);
+	else
+		lease_store_append(server, LEASE_RECORD_UNBIND, lease);
+
+	return true;
+}
+
+static struct l_dhcp_lease *expired_list_pop(struct l_dhcp_server *server)
+{
+	struct l_dhcp_lease *lease = l_queue_pop_head(server->expired_list);
+
+	if (!lease)
+		return NULL;
+
+	l_hashmap_remove(server->expired_by_ip, L_UINT_TO_PTR(lease->address));
+	ip_pool_update(server, lease->address, false);
+	return lease;
+}
+
+static bool expired_list_remove(struct l_dhcp_server *server,
+				struct l_dhcp_lease *lease)
+{
+	if (!l_queue_remove(server->expired_list, lease))
+		return false;
 
-	return lease->address == L_PTR_TO_UINT(user_data);
+	l_hashmap_remove(server->expired_by_ip, L_UINT_TO_PTR(lease->address));
+	ip_pool_update(server, lease->address, false);
+	return true;
 }
 
-static struct l_dhcp_lease *find_lease_by_ip(struct l_queue *lease_list,
+/* Append to expired_list, dropping the oldest lease if it is full */
+static void expired_list_push(struct l_dhcp_server *server,
+				struct l_dhcp_lease *lease)
+{
+	if (l_queue_length(server->expired_list) > server->max_expired)
+		_dhcp_lease_free(expired_list_pop(server));
+
+	l_queue_push_tail(server->expired_list, lease);
+	l_hashmap_insert(server->expired_by_ip, L_UINT_TO_PTR(lease->address),
+				lease);
+	ip_pool_update(server, lease->address, true);
+}
+
+static struct l_dhcp_lease *find_lease_by_ip(struct l_hashmap *index,
 						uint32_t nip)
 {
-	return l_queue_find(lease_list, match_lease_ip, L_UINT_TO_PTR(nip));
+	return l_hashmap_lookup(index, L_UINT_TO_PTR(nip));
 }
 
-static struct l_dhcp_lease *find_lease_by_id(struct l_queue *lease_list,
+static struct l_dhcp_lease *find_lease_by_id(struct l_dhcp_server *server,
 						const uint8_t *client_id,
 						const uint8_t *mac)
 {
+	struct l_queue *leases;
+
 	if (client_id)
-		return l_queue_find(lease_list, match_lease_client_id,
-					client_id);
+		leases = l_hashmap_lookup(server->leases_by_client_id,
+						client_id);
+	else
+		leases = l_hashmap_lookup(server->leases_by_mac, mac);
+
+	if (!leases)
+		return NULL;
 
-	return l_queue_find(lease_list, match_lease_mac, mac);
+	/* If several leases share the ID prefer the most recent one */
+	return l_queue_peek_tail(leases);
 }
 
-static struct l_dhcp_lease *find_lease_by_id_and_ip(struct l_queue *lease_list,
+static struct l_dhcp_lease *find_lease_by_id_and_ip(struct l_hashmap *index,
 						const uint8_t *client_id,
 						const uint8_t *mac,
 						uint32_t ip)
 {
-	struct l_dhcp_lease *lease = find_lease_by_ip(lease_list, ip);
+	struct l_dhcp_lease *lease = find_lease_by_ip(index, ip);
 
 	if (!lease)
 		return NULL;
@@ -172,10 +784,7 @@ static int get_lease(struct l_dhcp_server *server, uint32_t yiaddr,
 	if (yiaddr == 0)
 		return -ENXIO;
 
-	if (ntohl(yiaddr) < server->start_ip)
-		return -ENXIO;
-
-	if (ntohl(yiaddr) > server->end_ip)
+	if (!pool_for_ip(server, yiaddr))
 		return -ENXIO;
 
 	if (l_memeq(mac, ETH_ALEN, 0xff))
@@ -184,16 +793,16 @@ static int get_lease(struct l_dhcp_server *server, uint32_t yiaddr,
 	if (l_memeqzero(mac, ETH_ALEN))
 		return -ENXIO;
 
-	lease = find_lease_by_ip(server->lease_list, yiaddr);
+	/* An offered or active lease stays queued and is updated in place */
+	lease = find_lease_by_ip(server->leases_by_ip, yiaddr);
 	if (lease) {
-		l_queue_remove(server->lease_list, lease);
 		*lease_out = lease;
 		return 0;
 	}
 
-	lease = find_lease_by_ip(server->expired_list, yiaddr);
-	if (lease && lease->address == yiaddr) {
-		l_queue_remove(server->expired_list, lease);
+	lease = find_lease_by_ip(server->expired_by_ip, yiaddr);
+	if (lease) {
+		expired_list_remove(server, lease);
 		*lease_out = lease;
 		return 0;
 	}
@@ -203,54 +812,16 @@ static int get_lease(struct l_dhcp_server *server, uint32_t yiaddr,
 	return 0;
 }
 
-static int compare_expiry_or_offering(const void *a, const void *b,
-					void *user_data)
-{
-	const struct l_dhcp_lease *lease1 = a;
-	const struct l_dhcp_lease *lease2 = b;
-	int64_t diff;
-
-	/*
-	 * Ensures offered but not active leases stay at the head of the queue.
-	 * This lets us peek at the tail to find the next expiring (active)
-	 */
-	if (lease1->offering)
-		return 1;
-
-	diff = (int64_t) lease2->bound_time - lease1->bound_time +
-		((int64_t) lease2->lifetime - lease1->lifetime) * L_USEC_PER_SEC;
-	return diff >= 0 ? diff > 0 ? 1 : 0 : -1;
-}
-
 static void lease_expired_cb(struct l_timeout *timeout, void *user_data);
 
-static void set_next_expire_timer(struct l_dhcp_server *server,
-					struct l_dhcp_lease *expired)
+static void set_next_expire_timer(struct l_dhcp_server *server)
 {
 	struct l_dhcp_lease *next;
 	uint64_t expiry;
 	uint64_t now;
 	uint64_t next_timeout;
 
-	/*
-	 * If this is an expiring lease put it into the expired queue, removing
-	 * a lease if we have reached the max
-	 */
-	if (expired) {
-		l_queue_remove(server->lease_list, expired);
-
-		if (!expired->offering) {
-			if (l_queue_length(server->expired_list) >
-					server->max_expired)
-				_dhcp_lease_free(l_queue_pop_head(
-							server->expired_list));
-
-			l_queue_push_tail(server->expired_list, expired);
-		} else
-			_dhcp_lease_free(expired);
-	}
-
-	next = l_queue_peek_tail(server->lease_list);
+	next = lease_queue_peek(server->lease_queue);
 	if (!next) {
 		l_timeout_remove(server->next_expire);
 		server->next_expire = NULL;
@@ -270,16 +841,50 @@ static void set_next_expire_timer(struct l_dhcp_server *server,
 							server, NULL);
 }
 
+/*
+ * Move an expiring lease into the expired list, removing a lease if we have
+ * reached the max.  Offered leases are simply dropped.
+ */
+static void lease_expire(struct l_dhcp_server *server,
+				struct l_dhcp_lease *lease)
+{
+	lease_queue_del(server, lease);
+
+	if (!lease->offering)
+		expired_list_push(server, lease);
+	else
+		_dhcp_lease_free(lease);
+}
+
 static void lease_expired_cb(struct l_timeout *timeout, void *user_data)
 {
 	struct l_dhcp_server *server = user_data;
-	struct l_dhcp_lease *lease = l_queue_peek_tail(server->lease_list);
-
-	if (!lease->offering && server->event_handler)
-		server->event_handler(server, L_DHCP_SERVER_EVENT_LEASE_EXPIRED,
+	struct l_dhcp_lease *lease;
+	uint64_t now = l_time_now_cached();
+
+	/* Expire every lease that is due, not just the first one */
+	while ((lease = lease_queue_peek(server->lease_queue)) &&
+			!l_time_after(get_lease_expiry_time(lease), now)) {
+		if (!lease->offering && server->event_handler)
+			server->event_handler(server,
+					L_DHCP_SERVER_EVENT_LEASE_EXPIRED,
 					server->user_data, lease);
 
-	set_next_expire_timer(server, lease);
+		lease_expire(server, lease);
+	}
+
+	set_next_expire_timer(server);
+}
+
+static bool remove_lease(struct l_dhcp_server *server,
+				struct l_dhcp_lease *lease)
+{
+	if (!lease_queue_del(server, lease))
+		return false;
+
+	_dhcp_lease_free(lease);
+	set_next_expire_timer(server);
+	return true;
 }
 
 static struct l_dhcp_lease *add_lease(struct l_dhcp_server *server,
@@ -288,54 +893,92 @@ static struct l_dhcp_lease *add_lease(struct l_dhcp_server *server,
 					uint64_t timestamp)
 {
 	struct l_dhcp_lease *lease = NULL;
+	struct dhcp_pool *pool;
+	struct l_pqueue_node expiry_node;
+	bool queued;
+	bool was_bound;
+	bool was_offering;
+	bool reindex;
+	L_AUTO_FREE_VAR(uint32_t *, dns) = NULL;
+	L_AUTO_FREE_VAR(uint8_t *, old_client_id) = NULL;
 	int ret;
 
 	ret = get_lease(server, yiaddr, client_id, chaddr, &lease);
 	if (ret != 0)
 		return NULL;
 
-	l_free(lease->dns);
-	l_free(lease->client_id);
+	pool = pool_for_ip(server, yiaddr);
+
+	queued = l_pqueue_node_is_queued(&lease->expiry_node);
+	was_bound = queued && !lease->offering;
+	was_offering = queued && lease->offering;
+
+	/*
+	 * Leave the indexes alone if the lease keeps its keys, which is the
+	 * case for repeated DISCOVERs and for renewals.  Note that @client_id
+	 * may point at lease->client_id.
+	 */
+	reindex = !queued || memcmp(lease->mac, chaddr, ETH_ALEN) ||
+			!client_id_equal(lease->client_id, client_id);
+	if (queued && reindex)
+		lease_index_remove(server, lease);
+
+	dns = l_steal_ptr(lease->dns);
+	old_client_id = l_steal_ptr(lease->client_id);
+	expiry_node = lease->expiry_node;
 	memset(lease, 0, sizeof(*lease));
+	lease->expiry_node = expiry_node;
 
 	memcpy(lease->mac, chaddr, ETH_ALEN);
 	lease->address = yiaddr;
-	lease->subnet_mask = server->netmask;
-	lease->router = server->gateway;
+	lease->subnet_mask = pool->netmask;
+	lease->router = pool->gateway;
 
 	if (server->dns_list) {
 		unsigned int i;
 
 		for (i = 0; server->dns_list[i]; i++);
-		lease->dns = l_memdup(server->dns_list, (i + 1) * 4);
+
+		if (dns && !memcmp(dns, server->dns_list, (i + 1) * 4))
+			lease->dns = l_steal_ptr(dns);
+		else
+			lease->dns = l_memdup(server->dns_list, (i + 1) * 4);
 	}
 
-	if (client_id)
+	if (client_id && client_id_equal(old_client_id, client_id))
+		lease->client_id = l_steal_ptr(old_client_id);
+	else if (client_id)
 		lease->client_id = l_memdup(client_id, client_id[0] + 1);
 
 	lease->offering = offering;
 	lease->bound_time = timestamp;
 
-	if (!offering) {
-		lease->lifetime = server->lease_seconds;
+	lease->lifetime = offering ? OFFER_TIME : server->lease_seconds;
 
-		/*
-		 * Insert into queue by lifetime (skipping any offered leases
-		 * at the head)
-		 */
-		l_queue_insert(server->lease_list, lease,
-					compare_expiry_or_offering, NULL);
-	} else {
-		lease->lifetime = OFFER_TIME;
-		/* Push offered leases to head, active leases after those */
-		l_queue_push_head(server->lease_list, lease);
-	}
+	/* A renewed lease only needs its position in the queue updated */
+	if (l_pqueue_node_is_queued(&lease->expiry_node))
+		lease_queue_update(server->lease_queue, lease);
+	else
+		lease_queue_push(server->lease_queue, lease);
 
-	/*
-	 * This is a new (or renewed) lease so pass NULL for expired so the
-	 * queues are not modified, only the next_expire timer.
-	 */
-	set_next_expire_timer(server, NULL);
+	if (reindex)
+		lease_index_add(server, lease);
+
+	if (was_offering && !offering)
+		l_queue_remove(server->offer_list, lease);
+	else if (!was_offering && offering)
+		l_queue_push_tail(server->offer_list, lease);
+
+	/* Drop the oldest pending offer rather than grow without bound */
+	if (l_queue_length(server->offer_list) > server->max_offers)
+		remove_lease(server, l_queue_peek_head(server->offer_list));
+
+	set_next_expire_timer(server);
+
+	if (!offering)
+		lease_store_append(server, LEASE_RECORD_BIND, lease);
+	else if (was_bound)
+		lease_store_append(server, LEASE_RECORD_UNBIND, lease);
 
 	SERVER_DEBUG("added lease IP "NIPQUAD_FMT " for "MAC " lifetime=%u",
 			NIPQUAD(yiaddr), MAC_STR(chaddr),
@@ -344,17 +987,6 @@ static struct l_dhcp_lease *add_lease(struct l_dhcp_server *server,
 	return lease;
 }
 
-static bool remove_lease(struct l_dhcp_server *server,
-				struct l_dhcp_lease *lease)
-{
-	if (!l_queue_remove(server->lease_list, lease))
-		return false;
-
-	_dhcp_lease_free(lease);
-	set_next_expire_timer(server, NULL);
-	return true;
-}
-
 static void lease_release(struct l_dhcp_server *server,
 			struct l_dhcp_lease *lease)
 {
@@ -362,10 +994,124 @@ static void lease_release(struct l_dhcp_server *server,
 		server->event_handler(server, L_DHCP_SERVER_EVENT_LEASE_EXPIRED,
 					server->user_data, lease);
 
-	set_next_expire_timer(server, lease);
+	lease_expire(server, lease);
+	set_next_expire_timer(server);
+}
+
+static void lease_store_restore(const void *key, void *value,
+				void *user_data)
+{
+	struct l_dhcp_server *server = user_data;
+	const uint8_t *rec = value;
+	uint8_t client_id[256];
+	uint32_t address;
+	uint64_t expiry = l_get_le64(rec + 12);
+	uint64_t now = time(NULL);
+	struct l_dhcp_lease *lease;
+
+	if (rec[1]) {
+		client_id[0] = rec[1];
+		memcpy(client_id + 1, rec + LEASE_RECORD_LEN, rec[1]);
+	}
+
+	memcpy(&address, rec + 8, 4);
+
+	lease = add_lease(server, false, rec[1] ? client_id : NULL, rec + 2,
+				address, l_time_now());
+	if (!lease)
+		return;
+
+	if (expiry <= now) {
+		lease_expire(server, lease);
+		return;
+	}
+
+	lease->lifetime = expiry - now;
+	lease_queue_update(server->lease_queue, lease);
+}
+
+/*
+ * Replay the lease file into the lease set, keeping the last record for
+ * each address, then compact it and keep it open for appending.
+ */
+static bool lease_store_load(struct l_dhcp_server *server)
+{
+	struct l_hashmap *records;
+	struct stat st;
+	const uint8_t *data = MAP_FAILED;
+	size_t pos;
+	int fd;
+
+	fd = L_TFR(open(server->lease_file, O_RDONLY | O_CLOEXEC));
+	if (fd < 0) {
+		if (errno != ENOENT)
+			return false;
+
+		return lease_store_snapshot(server);
+	}
+
+	if (fstat(fd, &st) == 0 && st.st_size >= LEASE_FILE_HEADER_LEN)
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	L_TFR(close(fd));
+
+	if (data == MAP_FAILED || memcmp(data, LEASE_FILE_MAGIC, 8) ||
+			l_get_le32(data + 8) != LEASE_FILE_VERSION) {
+		SERVER_DEBUG("Ignoring invalid lease file %s",
+				server->lease_file);
+
+		if (data != MAP_FAILED)
+			munmap((void *) data, st.st_size);
+
+		return lease_store_snapshot(server);
+	}
+
+	records = l_hashmap_new();
+
+	/* A truncated record at the end is the result of a crash, skip it */
+	for (pos = LEASE_FILE_HEADER_LEN; pos + LEASE_RECORD_LEN <=
+				(size_t) st.st_size; ) {
+		const uint8_t *rec = data + pos;
+		uint32_t address;
+
+		if (pos + LEASE_RECORD_LEN + rec[1] > (size_t) st.st_size)
+			break;
+
+		memcpy(&address, rec + 8, 4);
+
+		if (rec[0] == LEASE_RECORD_BIND)
+			l_hashmap_replace(records, L_UINT_TO_PTR(address),
+						(void *) rec, NULL);
+		else
+			l_hashmap_remove(records, L_UINT_TO_PTR(address));
+
+		pos += LEASE_RECORD_LEN + rec[1];
+	}
+
+	SERVER_DEBUG("Restoring %u leases from %s", l_hashmap_size(records),
+			server->lease_file);
+
+	l_hashmap_foreach(records, lease_store_restore, server);
+	l_hashmap_destroy(records, NULL);
+	munmap((void *) data, st.st_size);
+
+	set_next_expire_timer(server);
+
+	return lease_store_snapshot(server);
+}
+
+static void lease_store_close(struct l_dhcp_server *server)
+{
+	lease_store_flush(server);
+
+	if (server->lease_fd >= 0) {
+		L_TFR(close(server->lease_fd));
+		server->lease_fd = -1;
+	}
 }
 
 static bool check_requested_ip(struct l_dhcp_server *server,
+				const struct dhcp_pool *pool,
 				uint32_t requested_nip)
 {
 	struct l_dhcp_lease *lease;
@@ -373,16 +1119,13 @@ static bool check_requested_ip(struct l_dhcp_server *server,
 	if (requested_nip == 0)
 		return false;
 
-	if (ntohl(requested_nip) < server->start_ip)
-		return false;
-
-	if (ntohl(requested_nip) > server->end_ip)
+	if (!pool_contains(pool, ntohl(requested_nip)))
 		return false;
 
 	if (requested_nip == server->address)
 		return false;
 
-	lease = find_lease_by_ip(server->lease_list, requested_nip);
+	lease = find_lease_by_ip(server->leases_by_ip, requested_nip);
 	if (!lease)
 		return true;
 
@@ -399,49 +1142,61 @@ static bool arp_check(uint32_t ip, const uint8_t *safe_mac)
 	return true;
 }
 
+static bool match_lease_in_pool(const void *data, const void *user_data)
+{
+	const struct l_dhcp_lease *lease = data;
+
+	return pool_contains(user_data, ntohl(lease->address));
+}
+
 static uint32_t find_free_or_expired_ip(struct l_dhcp_server *server,
+						struct dhcp_pool *pool,
 						const uint8_t *safe_mac)
 {
-	uint32_t ip_addr;
+	const struct l_queue_entry *entry;
 	struct l_dhcp_lease *lease;
+	uint32_t ip_addr;
 
-	for (ip_addr = server->start_ip; ip_addr <= server->end_ip; ip_addr++) {
-		/* Get IP in network order to return/check for matches */
-		uint32_t ip_nl = htonl(ip_addr);
+	if (!pool->ip_pool)
+		ip_pool_build(server, pool);
 
-		/* e.g. 192.168.55.0 */
-		if ((ip_addr & 0xff) == 0)
-			continue;
+	/*
+	 * ip_pool gives the lowest address not taken by an active, expired
+	 * or reserved address.  An expired lease of the same client may be
+	 * reused too so check whether one of those has a lower address.
+	 */
+	ip_addr = l_uintset_find_unused_min(pool->ip_pool);
 
-		/* e.g. 192.168.55.255 */
-		if ((ip_addr & 0xff) == 0xff)
-			continue;
+	for (entry = l_queue_get_entries(server->expired_list); entry;
+			entry = entry->next) {
+		uint32_t ip;
 
-		if (ip_nl == server->address)
-			continue;
+		lease = entry->data;
+		ip = ntohl(lease->address);
 
-		/*
-		 * Search both active and expired leases. If this exausts all
-		 * IP's in the range pop the expired list (oldest expired lease)
-		 * and use that IP. If the expired list is empty we have reached
-		 * our maximum number of clients.
-		 */
-		lease = find_lease_by_ip(server->lease_list, ip_nl);
-		if (lease)
+		if (ip >= ip_addr || ip < pool->start_ip ||
+				is_reserved_ip(server, ip))
 			continue;
 
-		lease = find_lease_by_ip(server->expired_list, ip_nl);
-		if (lease && memcmp(lease->mac, safe_mac, ETH_ALEN))
-			continue;
-
-		if (arp_check(ip_nl, safe_mac))
-			return ip_nl;
+		if (!memcmp(lease->mac, safe_mac, ETH_ALEN))
+			ip_addr = ip;
 	}
 
-	lease = l_queue_pop_head(server->expired_list);
+	if (pool_contains(pool, ip_addr) &&
+			arp_check(htonl(ip_addr), safe_mac))
+		return htonl(ip_addr);
+
+	/*
+	 * If this exausts all IP's in the range take the oldest expired lease
+	 * of the pool and use that IP. If there is none we have reached our
+	 * maximum number of clients.
+	 */
+	lease = l_queue_find(server->expired_list, match_lease_in_pool, pool);
 	if (!lease)
 		return 0;
 
+	expired_list_remove(server, lease);
+
 	ip_addr = lease->address;
 	_dhcp_lease_free(lease);
 	return ip_addr;
@@ -512,37 +1267,71 @@ static bool server_message_send(struct l_dhcp_server *server,
 		}
 	}
 
+	/* Relays off the local link are reached through the UDP socket */
+	if (reply->giaddr && server->relay_transport) {
+		struct sockaddr_in dest = {
+			.sin_family = AF_INET,
+			.sin_port = L_CPU_TO_BE16(DHCP_PORT_SERVER),
+			.sin_addr.s_addr = reply->giaddr,
+		};
+
+		if (server->relay_transport->send(server->relay_transport,
+							&dest, reply, len) < 0)
+			goto error;
+
+		return true;
+	}
+
 	if (server->transport->l2_send(server->transport, server->address,
 					DHCP_PORT_SERVER, daddr, dport,
-					dest_mac, reply, len) < 0) {
-		SERVER_DEBUG("Failed to send %s",
-				_dhcp_message_type_to_string(type));
-		return false;
-	}
+					dest_mac, reply, len) < 0)
+		goto error;
 
 	return true;
+
+error:
+	SERVER_DEBUG_RATELIMITED("Failed to send %s",
+				_dhcp_message_type_to_string(type));
+	return false;
 }
 
+/*
+ * The options describing the network are the same in every reply from a
+ * pool so they are encoded once and copied in as a block.
+ */
 static void add_server_options(struct l_dhcp_server *server,
+				struct dhcp_pool *pool,
 				struct dhcp_message_builder *builder)
 {
+	uint8_t *pos = pool->options;
+	size_t left = sizeof(pool->options);
 	int i;
 
-	if (server->netmask)
-		_dhcp_message_builder_append(builder, L_DHCP_OPTION_SUBNET_MASK,
-						4, &server->netmask);
+	if (pool->options_valid)
+		goto done;
 
-	if (server->gateway)
-		_dhcp_message_builder_append(builder, L_DHCP_OPTION_ROUTER,
-						4, &server->gateway);
+	if (pool->netmask)
+		_dhcp_option_append(&pos, &left, L_DHCP_OPTION_SUBNET_MASK,
+					4, &pool->netmask);
+
+	if (pool->gateway)
+		_dhcp_option_append(&pos, &left, L_DHCP_OPTION_ROUTER,
+					4, &pool->gateway);
 
 	if (server->dns_list) {
-		for (i = 0; server->dns_list[i]; i++);
+		for (i = 0; server->dns_list[i] && i < 255 / 4; i++);
 
-		_dhcp_message_builder_append(builder,
+		_dhcp_option_append(&pos, &left,
 					L_DHCP_OPTION_DOMAIN_NAME_SERVER,
 					i * 4, server->dns_list);
 	}
+
+	pool->options_len = pos - pool->options;
+	pool->options_valid = true;
+
+done:
+	_dhcp_message_builder_append_encoded(builder, pool->options,
+						pool->options_len);
 }
 
 /* Copy the client identifier option from the client message per RFC6842 */
@@ -555,24 +1344,40 @@ static void copy_client_id(struct dhcp_message_builder *builder,
 						client_id[0], client_id + 1);
 }
 
+/*
+ * RFC3046 Section 2.2: "DHCP servers claiming to support the Relay Agent
+ * Information option SHALL echo the entire contents of the Relay Agent
+ * Information option in all replies."  Stored with the length in the first
+ * byte like the client ID.
+ */
+static void copy_agent_info(struct dhcp_message_builder *builder,
+				const uint8_t *agent_info)
+{
+	if (agent_info)
+		_dhcp_message_builder_append(builder,
+					DHCP_OPTION_RELAY_AGENT_INFORMATION,
+					agent_info[0], agent_info + 1);
+}
+
 static void send_offer(struct l_dhcp_server *server,
 			const struct dhcp_message *client_msg,
+			struct dhcp_pool *pool,
 			struct l_dhcp_lease *lease, uint32_t requested_ip,
-			const uint8_t *client_id, uint64_t timestamp)
+			const uint8_t *client_id, const uint8_t *agent_info,
+			uint64_t timestamp)
 {
 	struct dhcp_message_builder builder;
-	size_t len = sizeof(struct dhcp_message) + DHCP_MIN_OPTIONS_SIZE;
-	L_AUTO_FREE_VAR(struct dhcp_message *, reply);
+	uint8_t buf[REPLY_BUF_SIZE] = {};
+	size_t len = sizeof(buf);
+	struct dhcp_message *reply = (struct dhcp_message *) buf;
 	uint32_t lease_time = L_CPU_TO_BE32(server->lease_seconds);
 
-	reply = (struct dhcp_message *) l_new(uint8_t, len);
-
 	if (lease)
 		reply->yiaddr = lease->address;
-	else if (check_requested_ip(server, requested_ip))
+	else if (check_requested_ip(server, pool, requested_ip))
 		reply->yiaddr = requested_ip;
 	else
-		reply->yiaddr = find_free_or_expired_ip(server,
+		reply->yiaddr = find_free_or_expired_ip(server, pool,
 							client_msg->chaddr);
 
 	if (!reply->yiaddr) {
@@ -599,8 +1404,9 @@ static void send_offer(struct l_dhcp_server *server,
 	_dhcp_message_builder_append(&builder, L_DHCP_OPTION_SERVER_IDENTIFIER,
 					4, &server->address);
 
-	add_server_options(server, &builder);
+	add_server_options(server, pool, &builder);
 	copy_client_id(&builder, client_id);
+	copy_agent_info(&builder, agent_info);
 
 	_dhcp_message_builder_finalize(&builder, &len);
 
@@ -612,20 +1418,22 @@ static void send_offer(struct l_dhcp_server *server,
 
 static void send_inform(struct l_dhcp_server *server,
 				const struct dhcp_message *client_msg,
-				const uint8_t *client_id)
+				struct dhcp_pool *pool,
+				const uint8_t *client_id,
+				const uint8_t *agent_info)
 {
 	struct dhcp_message_builder builder;
-	size_t len = sizeof(struct dhcp_message) + DHCP_MIN_OPTIONS_SIZE;
-	L_AUTO_FREE_VAR(struct dhcp_message *, reply);
-
-	reply = (struct dhcp_message *) l_new(uint8_t, len);
+	uint8_t buf[REPLY_BUF_SIZE] = {};
+	size_t len = sizeof(buf);
+	struct dhcp_message *reply = (struct dhcp_message *) buf;
 
 	server_message_init(server, client_msg, reply);
 
 	_dhcp_message_builder_init(&builder, reply, len, DHCP_MESSAGE_TYPE_ACK);
 
-	add_server_options(server, &builder);
+	add_server_options(server, pool, &builder);
 	copy_client_id(&builder, client_id);
+	copy_agent_info(&builder, agent_info);
 
 	_dhcp_message_builder_finalize(&builder, &len);
 
@@ -634,93 +1442,214 @@ static void send_inform(struct l_dhcp_server *server,
 
 static void send_nak(struct l_dhcp_server *server,
 			const struct dhcp_message *client_msg,
-			const uint8_t *client_id)
+			const uint8_t *client_id, const uint8_t *agent_info)
 {
 	struct dhcp_message_builder builder;
-	size_t len = sizeof(struct dhcp_message) + DHCP_MIN_OPTIONS_SIZE;
-	L_AUTO_FREE_VAR(struct dhcp_message *, reply);
-
-	reply = (struct dhcp_message *) l_new(uint8_t, len);
+	uint8_t buf[REPLY_BUF_SIZE] = {};
+	size_t len = sizeof(buf);
+	struct dhcp_message *reply = (struct dhcp_message *) buf;
 
 	server_message_init(server, client_msg, reply);
 
 	_dhcp_message_builder_init(&builder, reply, len, DHCP_MESSAGE_TYPE_NAK);
 	copy_client_id(&builder, client_id);
+	copy_agent_info(&builder, agent_info);
+	_dhcp_message_builder_finalize(&builder, &len);
+
+	server_message_send(server, reply, len, DHCP_MESSAGE_TYPE_NAK);
+}
+
+static void send_ack(struct l_dhcp_server *server,
+			const struct dhcp_message *client_msg,
+			struct dhcp_pool *pool,
+			struct l_dhcp_lease *lease,
+			bool rapid_commit, const uint8_t *agent_info,
+			uint64_t timestamp)
+{
+	struct dhcp_message_builder builder;
+	uint8_t buf[REPLY_BUF_SIZE] = {};
+	size_t len = sizeof(buf);
+	struct dhcp_message *reply = (struct dhcp_message *) buf;
+	uint32_t lease_time = L_CPU_TO_BE32(server->lease_seconds);
+	const uint8_t *client_id = lease->client_id;
+
+	server_message_init(server, client_msg, reply);
+
+	_dhcp_message_builder_init(&builder, reply, len, DHCP_MESSAGE_TYPE_ACK);
+
+	reply->yiaddr = lease->address;
+
+	_dhcp_message_builder_append(&builder,
+					L_DHCP_OPTION_IP_ADDRESS_LEASE_TIME,
+					4, &lease_time);
+
+	add_server_options(server, pool, &builder);
+	copy_client_id(&builder, client_id);
+
+	_dhcp_message_builder_append(&builder, L_DHCP_OPTION_SERVER_IDENTIFIER,
+					4, &server->address);
+
+	if (rapid_commit)
+		_dhcp_message_builder_append(&builder, DHCP_OPTION_RAPID_COMMIT,
+						0, "");
+
+	copy_agent_info(&builder, agent_info);
+
 	_dhcp_message_builder_finalize(&builder, &len);
 
-	server_message_send(server, reply, len, DHCP_MESSAGE_TYPE_NAK);
+	SERVER_DEBUG("Sending ACK to "NIPQUAD_FMT, NIPQUAD(reply->yiaddr));
+
+	if (!server_message_send(server, reply, len, DHCP_MESSAGE_TYPE_ACK))
+		return;
+
+	lease = add_lease(server, false, client_id, reply->chaddr,
+				reply->yiaddr, timestamp);
+
+	if (server->event_handler)
+		server->event_handler(server, L_DHCP_SERVER_EVENT_NEW_LEASE,
+					server->user_data, lease);
+}
+
+static bool rate_bucket_take(struct rate_bucket *bucket, unsigned int rate,
+				unsigned int burst, uint64_t now)
+{
+	uint64_t max = burst * L_USEC_PER_SEC;
+
+	if (!rate)
+		return true;
+
+	if (!bucket->last)
+		bucket->tokens = max;
+	else if (l_time_after(now, bucket->last))
+		bucket->tokens += l_time_diff(bucket->last, now) * rate;
+
+	if (bucket->tokens > max)
+		bucket->tokens = max;
+
+	bucket->last = now;
+
+	if (bucket->tokens < L_USEC_PER_SEC)
+		return false;
+
+	bucket->tokens -= L_USEC_PER_SEC;
+	return true;
+}
+
+static bool rate_limit_check(struct l_dhcp_server *server, const uint8_t *mac)
+{
+	uint64_t now = l_time_now_cached();
+	struct rate_bucket *bucket;
+
+	bucket = &server->mac_buckets[mac_hash(mac) % MAC_BUCKETS];
+	if (!rate_bucket_take(bucket, server->mac_rate, server->mac_burst, now))
+		return false;
+
+	/*
+	 * Clients holding an offer or a lease skip the global limit so that
+	 * they keep being served while a flood of new MACs is throttled.
+	 */
+	if (l_hashmap_lookup(server->leases_by_mac, mac))
+		return true;
+
+	return rate_bucket_take(&server->global_bucket, server->global_rate,
+				server->global_burst, now);
 }
 
-static void send_ack(struct l_dhcp_server *server,
-			const struct dhcp_message *client_msg,
-			struct l_dhcp_lease *lease,
-			bool rapid_commit,
-			uint64_t timestamp)
+/* The pool serving the link a message was sent from */
+static struct dhcp_pool *pool_for_giaddr(struct l_dhcp_server *server,
+						uint32_t giaddr)
 {
-	struct dhcp_message_builder builder;
-	size_t len = sizeof(struct dhcp_message) + DHCP_MIN_OPTIONS_SIZE;
-	L_AUTO_FREE_VAR(struct dhcp_message *, reply);
-	uint32_t lease_time = L_CPU_TO_BE32(server->lease_seconds);
-	L_AUTO_FREE_VAR(uint8_t *, client_id) = l_steal_ptr(lease->client_id);
+	struct dhcp_pool *pool;
 
-	reply = (struct dhcp_message *) l_new(uint8_t, len);
-
-	server_message_init(server, client_msg, reply);
+	if (!giaddr)
+		return &server->local;
 
-	_dhcp_message_builder_init(&builder, reply, len, DHCP_MESSAGE_TYPE_ACK);
+	pool = relay_pool_lookup(server, ntohl(giaddr));
+	if (pool)
+		return pool;
 
-	reply->yiaddr = lease->address;
+	/* Without relay subnets every relayed client gets a local address */
+	if (!server->relay_prefixes)
+		return &server->local;
 
-	_dhcp_message_builder_append(&builder,
-					L_DHCP_OPTION_IP_ADDRESS_LEASE_TIME,
-					4, &lease_time);
+	return NULL;
+}
 
-	add_server_options(server, &builder);
-	copy_client_id(&builder, client_id);
+/* A client that moved to another subnet can't keep its old address */
+static struct l_dhcp_lease *lease_in_pool(struct l_dhcp_server *server,
+						struct l_dhcp_lease *lease,
+						struct dhcp_pool *pool)
+{
+	if (lease && pool_for_ip(server, lease->address) != pool)
+		return NULL;
 
-	_dhcp_message_builder_append(&builder, L_DHCP_OPTION_SERVER_IDENTIFIER,
-					4, &server->address);
+	return lease;
+}
 
-	if (rapid_commit)
-		_dhcp_message_builder_append(&builder, DHCP_OPTION_RAPID_COMMIT,
-						0, "");
+static struct l_dhcp_lease *server_discover(struct l_dhcp_server *server,
+						struct dhcp_pool *pool,
+						uint32_t requested_ip_opt,
+						const uint8_t *client_id,
+						const uint8_t *mac)
+{
+	struct l_dhcp_lease *lease;
 
-	_dhcp_message_builder_finalize(&builder, &len);
+	SERVER_DEBUG("Requested IP " NIPQUAD_FMT " for " MAC,
+			NIPQUAD(requested_ip_opt), MAC_STR(mac));
 
-	SERVER_DEBUG("Sending ACK to "NIPQUAD_FMT, NIPQUAD(reply->yiaddr));
+	lease = lease_in_pool(server, find_lease_by_id(server, client_id, mac),
+				pool);
+	if (lease)
+		requested_ip_opt = lease->address;
+	else if (!check_requested_ip(server, pool, requested_ip_opt)) {
+		requested_ip_opt = find_free_or_expired_ip(server, pool, mac);
 
-	if (!server_message_send(server, reply, len, DHCP_MESSAGE_TYPE_ACK))
-		return;
+		if (unlikely(!requested_ip_opt)) {
+			SERVER_DEBUG("Could not find any free addresses");
+			return NULL;
+		}
+	}
 
-	lease = add_lease(server, false, client_id, reply->chaddr,
-				reply->yiaddr, timestamp);
+	lease = add_lease(server, true, client_id, mac, requested_ip_opt,
+				l_time_now());
+	if (unlikely(!lease)) {
+		SERVER_DEBUG("add_lease() failed");
+		return NULL;
+	}
 
-	if (server->event_handler)
-		server->event_handler(server, L_DHCP_SERVER_EVENT_NEW_LEASE,
-					server->user_data, lease);
+	SERVER_DEBUG("Offering " NIPQUAD_FMT " to " MAC,
+			NIPQUAD(requested_ip_opt), MAC_STR(mac));
+	return lease;
 }
 
-static void listener_event(const void *data, size_t len, void *user_data,
+static void server_receive(struct l_dhcp_server *server,
+				const struct dhcp_message *message, size_t len,
 				const uint8_t *saddr, uint64_t timestamp)
 {
-	struct l_dhcp_server *server = user_data;
-	const struct dhcp_message *message = data;
 	struct dhcp_message_iter iter;
 	uint8_t t, l;
 	const void *v;
+	struct dhcp_pool *pool;
 	struct l_dhcp_lease *lease;
 	uint8_t type = 0;
 	bool server_id_opt = false;
 	bool server_id_match = true;
 	uint32_t requested_ip_opt = 0;
-	L_AUTO_FREE_VAR(uint8_t *, client_id_opt) = NULL;
+	uint8_t client_id_buf[256];
+	uint8_t *client_id_opt = NULL;
+	uint8_t agent_info_buf[256];
+	uint8_t *agent_info_opt = NULL;
 	bool rapid_commit_opt = false;
 
-	SERVER_DEBUG("");
-
 	if (saddr && memcmp(saddr, message->chaddr, ETH_ALEN))
 		return;
 
+	if (!rate_limit_check(server, message->chaddr)) {
+		SERVER_DEBUG_RATELIMITED("Rate limited "MAC,
+						MAC_STR(message->chaddr));
+		return;
+	}
+
 	if (!_dhcp_message_iter_init(&iter, message, len))
 		return;
 
@@ -747,31 +1676,47 @@ static void listener_event(const void *data, size_t len, void *user_data,
 			if (l < 1 || l > 253 || client_id_opt)
 				break;
 
-			client_id_opt = l_malloc(l + 1);
+			client_id_opt = client_id_buf;
 			client_id_opt[0] = l;
 			memcpy(client_id_opt + 1, v, l);
 			break;
 		case DHCP_OPTION_RAPID_COMMIT:
 			rapid_commit_opt = true;
 			break;
+		case DHCP_OPTION_RELAY_AGENT_INFORMATION:
+			if (l < 1 || agent_info_opt)
+				break;
+
+			agent_info_opt = agent_info_buf;
+			agent_info_opt[0] = l;
+			memcpy(agent_info_opt + 1, v, l);
+			break;
 		}
 	}
 
 	if (type == 0)
 		return;
 
+	pool = pool_for_giaddr(server, message->giaddr);
+	if (!pool) {
+		SERVER_DEBUG_RATELIMITED("No subnet for relay "NIPQUAD_FMT,
+						NIPQUAD(message->giaddr));
+		return;
+	}
+
 	if (requested_ip_opt)
-		lease = find_lease_by_id_and_ip(server->lease_list,
+		lease = find_lease_by_id_and_ip(server->leases_by_ip,
 						client_id_opt, message->chaddr,
 						requested_ip_opt);
 
 	if (!requested_ip_opt || !lease)
-		lease = find_lease_by_id(server->lease_list, client_id_opt,
+		lease = find_lease_by_id(server, client_id_opt,
 						message->chaddr);
 
+	lease = lease_in_pool(server, lease, pool);
 	if (!lease)
-		SERVER_DEBUG("No lease found for "MAC,
-					MAC_STR(message->chaddr));
+		SERVER_DEBUG_RATELIMITED("No lease found for "MAC,
+						MAC_STR(message->chaddr));
 
 	switch (type) {
 	case DHCP_MESSAGE_TYPE_DISCOVER:
@@ -782,21 +1727,22 @@ static void listener_event(const void *data, size_t len, void *user_data,
 			break;
 
 		if (rapid_commit_opt && server->rapid_commit) {
-			lease = l_dhcp_server_discover(server, requested_ip_opt,
-							client_id_opt,
-							message->chaddr);
+			lease = server_discover(server, pool, requested_ip_opt,
+						client_id_opt, message->chaddr);
 			if (!lease) {
-				send_nak(server, message, client_id_opt);
+				send_nak(server, message, client_id_opt,
+						agent_info_opt);
 				break;
 			}
 
-			send_ack(server, message, lease, rapid_commit_opt,
+			send_ack(server, message, pool, lease,
+					rapid_commit_opt, agent_info_opt,
 					timestamp);
 			break;
 		}
 
-		send_offer(server, message, lease, requested_ip_opt,
-				client_id_opt, timestamp);
+		send_offer(server, message, pool, lease, requested_ip_opt,
+				client_id_opt, agent_info_opt, timestamp);
 		break;
 	case DHCP_MESSAGE_TYPE_REQUEST:
 		SERVER_DEBUG("Received REQUEST, requested IP "NIPQUAD_FMT,
@@ -809,7 +1755,8 @@ static void listener_event(const void *data, size_t len, void *user_data,
 		 */
 		if (!server_id_match) {
 			if (server->authoritative) {
-				send_nak(server, message, client_id_opt);
+				send_nak(server, message, client_id_opt,
+						agent_info_opt);
 				break;
 			}
 
@@ -825,11 +1772,13 @@ static void listener_event(const void *data, size_t len, void *user_data,
 		 * the requested IP and the client ID/mac and if so, allow the
 		 * lease to be re-activated.
 		 */
-		if (!lease && requested_ip_opt)
-			lease = find_lease_by_id_and_ip(server->expired_list,
+		if (!lease && requested_ip_opt) {
+			lease = find_lease_by_id_and_ip(server->expired_by_ip,
 							client_id_opt,
 							message->chaddr,
 							requested_ip_opt);
+			lease = lease_in_pool(server, lease, pool);
+		}
 
 		/*
 		 * RFC2131 Section 3.5: "If the selected server is unable to
@@ -842,7 +1791,8 @@ static void listener_event(const void *data, size_t len, void *user_data,
 		 */
 		if (!lease) {
 			if (server_id_opt || server->authoritative)
-				send_nak(server, message, client_id_opt);
+				send_nak(server, message, client_id_opt,
+						agent_info_opt);
 
 			break;
 		}
@@ -874,7 +1824,8 @@ static void listener_event(const void *data, size_t len, void *user_data,
 			if (!lease->offering ||
 					(requested_ip_opt &&
 					 requested_ip_opt != lease->address)) {
-				send_nak(server, message, client_id_opt);
+				send_nak(server, message, client_id_opt,
+						agent_info_opt);
 				break;
 			}
 		} else {
@@ -886,12 +1837,14 @@ static void listener_event(const void *data, size_t len, void *user_data,
 			if (lease->offering ||
 					(requested_ip_opt &&
 					 requested_ip_opt != lease->address)) {
-				send_nak(server, message, client_id_opt);
+				send_nak(server, message, client_id_opt,
+						agent_info_opt);
 				break;
 			}
 		}
 
-		send_ack(server, message, lease, false, timestamp);
+		send_ack(server, message, pool, lease, false, agent_info_opt,
+				timestamp);
 		break;
 	case DHCP_MESSAGE_TYPE_DECLINE:
 		SERVER_DEBUG("Received DECLINE");
@@ -921,11 +1874,76 @@ static void listener_event(const void *data, size_t len, void *user_data,
 		if (!server_id_match)
 			break;
 
-		send_inform(server, message, client_id_opt);
+		send_inform(server, message, pool, client_id_opt,
+				agent_info_opt);
 		break;
 	}
 }
 
+static void listener_event(const void *data, size_t len, void *user_data,
+				const uint8_t *saddr, uint64_t timestamp)
+{
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_DHCP);
+	struct l_dhcp_server *server = user_data;
+	const struct dhcp_message *message = data;
+
+	SERVER_DEBUG("");
+
+	PROBE(dhcp_server_rx, server, len);
+
+	/* Cheap checks first, before any option parsing or lease lookups */
+	if (len < sizeof(struct dhcp_message) ||
+			message->op != DHCP_OP_CODE_BOOTREQUEST ||
+			message->hlen != ETH_ALEN)
+		return;
+
+	/*
+	 * The packet socket also sees relayed messages sent to us over the
+	 * local link, they are taken from the relay socket when it is open.
+	 */
+	if (message->giaddr && server->relay_transport)
+		return;
+
+	server_receive(server, message, len, saddr, timestamp);
+}
+
+static void relay_listener_event(const void *data, size_t len,
+					void *user_data, const uint8_t *saddr,
+					uint64_t timestamp)
+{
+	struct l_dhcp_server *server = user_data;
+	const struct dhcp_message *message = data;
+
+	SERVER_DEBUG("");
+
+	if (len < sizeof(struct dhcp_message) ||
+			message->op != DHCP_OP_CODE_BOOTREQUEST ||
+			message->hlen != ETH_ALEN || !message->giaddr)
+		return;
+
+	server_receive(server, message, len, NULL, timestamp);
+}
+
+static bool relay_listener_open(struct l_dhcp_server *server)
+{
+	struct dhcp_transport *transport = server->relay_transport;
+
+	if (!transport)
+		transport = _dhcp_relay_transport_new(DHCP_PORT_SERVER);
+
+	if (!transport)
+		return false;
+
+	server->relay_transport = transport;
+
+	if (transport->open && transport->open(transport, 0) < 0)
+		return false;
+
+	_dhcp_transport_set_rx_callback(transport, relay_listener_event,
+					server);
+	return true;
+}
+
 bool _dhcp_server_set_max_expired_clients(struct l_dhcp_server *server,
 						unsigned int max_expired)
 {
@@ -937,6 +1955,41 @@ bool _dhcp_server_set_max_expired_clients(struct l_dhcp_server *server,
 	return true;
 }
 
+bool _dhcp_server_set_max_offers(struct l_dhcp_server *server,
+					unsigned int max_offers)
+{
+	if (unlikely(!server || !max_offers))
+		return false;
+
+	server->max_offers = max_offers;
+
+	return true;
+}
+
+/* A rate of 0 disables the corresponding limit */
+bool _dhcp_server_set_rate_limit(struct l_dhcp_server *server,
+					unsigned int mac_rate,
+					unsigned int mac_burst,
+					unsigned int global_rate,
+					unsigned int global_burst)
+{
+	if (unlikely(!server))
+		return false;
+
+	if ((mac_rate && !mac_burst) || (global_rate && !global_burst))
+		return false;
+
+	server->mac_rate = mac_rate;
+	server->mac_burst = mac_burst;
+	server->global_rate = global_rate;
+	server->global_burst = global_burst;
+	memset(server->mac_buckets, 0,
+		MAC_BUCKETS * sizeof(struct rate_bucket));
+	memset(&server->global_bucket, 0, sizeof(server->global_bucket));
+
+	return true;
+}
+
 bool _dhcp_server_set_transport(struct l_dhcp_server *server,
 					struct dhcp_transport *transport)
 {
@@ -950,6 +2003,19 @@ bool _dhcp_server_set_transport(struct l_dhcp_server *server,
 	return true;
 }
 
+bool _dhcp_server_set_relay_transport(struct l_dhcp_server *server,
+					struct dhcp_transport *transport)
+{
+	if (unlikely(!server))
+		return false;
+
+	if (server->relay_transport)
+		_dhcp_transport_free(server->relay_transport);
+
+	server->relay_transport = transport;
+	return true;
+}
+
 struct dhcp_transport *_dhcp_server_get_transport(struct l_dhcp_server *server)
 {
 	if (unlikely(!server))
@@ -960,10 +2026,31 @@ struct dhcp_transport *_dhcp_server_get_transport(struct l_dhcp_server *server)
 
 LIB_EXPORT struct l_dhcp_server *l_dhcp_server_new(int ifindex)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_DHCP);
 	struct l_dhcp_server *server = l_new(struct l_dhcp_server, 1);
 
-	server->lease_list = l_queue_new();
+	server->lease_queue = lease_queue_new();
 	server->expired_list = l_queue_new();
+	server->offer_list = l_queue_new();
+	server->mac_buckets = l_new(struct rate_bucket, MAC_BUCKETS);
+
+	server->leases_by_ip = l_hashmap_new();
+	server->expired_by_ip = l_hashmap_new();
+
+	server->leases_by_mac = l_hashmap_new();
+	l_hashmap_set_hash_function(server->leases_by_mac, mac_hash);
+	l_hashmap_set_compare_function(server->leases_by_mac, mac_compare);
+	l_hashmap_set_key_copy_function(server->leases_by_mac, mac_copy);
+	l_hashmap_set_key_free_function(server->leases_by_mac, l_free);
+
+	server->leases_by_client_id = l_hashmap_new();
+	l_hashmap_set_hash_function(server->leases_by_client_id,
+					client_id_hash);
+	l_hashmap_set_compare_function(server->leases_by_client_id,
+					client_id_compare);
+	l_hashmap_set_key_copy_function(server->leases_by_client_id,
+					client_id_copy);
+	l_hashmap_set_key_free_function(server->leases_by_client_id, l_free);
 
 	server->started = false;
 	server->authoritative = true;
@@ -971,6 +2058,12 @@ LIB_EXPORT struct l_dhcp_server *l_dhcp_server_new(int ifindex)
 
 	server->lease_seconds = DEFAULT_DHCP_LEASE_SEC;
 	server->max_expired = MAX_EXPIRED_LEASES;
+	server->max_offers = MAX_PENDING_OFFERS;
+	server->mac_rate = MAC_RATE;
+	server->mac_burst = MAC_BURST;
+	server->global_rate = GLOBAL_RATE;
+	server->global_burst = GLOBAL_BURST;
+	server->lease_fd = -1;
 
 	server->ifindex = ifindex;
 	server->debug_handler = NULL;
@@ -981,21 +2074,38 @@ LIB_EXPORT struct l_dhcp_server *l_dhcp_server_new(int ifindex)
 
 LIB_EXPORT void l_dhcp_server_destroy(struct l_dhcp_server *server)
 {
+	unsigned int i;
+
 	if (unlikely(!server))
 		return;
 
 	l_dhcp_server_stop(server);
+	lease_store_close(server);
 
 	if (server->event_destroy)
 		server->event_destroy(server->user_data);
 
 	_dhcp_transport_free(server->transport);
+	_dhcp_transport_free(server->relay_transport);
 	l_free(server->ifname);
 
-	l_queue_destroy(server->lease_list,
-				(l_queue_destroy_func_t) _dhcp_lease_free);
+	for (i = 0; i < L_ARRAY_SIZE(server->relay_pools); i++)
+		l_hashmap_destroy(server->relay_pools[i], relay_pool_free);
+
+	l_pqueue_free(server->lease_queue);
 	l_queue_destroy(server->expired_list,
 				(l_queue_destroy_func_t) _dhcp_lease_free);
+	l_queue_destroy(server->offer_list, NULL);
+	l_free(server->mac_buckets);
+
+	l_hashmap_destroy(server->leases_by_mac, id_index_destroy);
+	l_hashmap_destroy(server->leases_by_client_id, id_index_destroy);
+	l_hashmap_destroy(server->leases_by_ip,
+				(l_hashmap_destroy_func_t) _dhcp_lease_free);
+	l_hashmap_destroy(server->expired_by_ip, NULL);
+	l_uintset_free(server->local.ip_pool);
+	l_free(server->lease_file);
+	l_free(server->lease_buf);
 
 	if (server->dns_list)
 		l_free(server->dns_list);
@@ -1005,6 +2115,7 @@ LIB_EXPORT void l_dhcp_server_destroy(struct l_dhcp_server *server)
 
 LIB_EXPORT bool l_dhcp_server_start(struct l_dhcp_server *server)
 {
+	struct dhcp_pool *local;
 	char buf[INET_ADDRSTRLEN];
 	struct in_addr ia;
 
@@ -1014,6 +2125,8 @@ LIB_EXPORT bool l_dhcp_server_start(struct l_dhcp_server *server)
 	if (server->started)
 		return false;
 
+	local = &server->local;
+
 	if (!server->address) {
 		if (!l_net_get_address(server->ifindex, &ia))
 			return false;
@@ -1022,28 +2135,29 @@ LIB_EXPORT bool l_dhcp_server_start(struct l_dhcp_server *server)
 	}
 
 	/* Assign a default netmask if not already */
-	if (!server->netmask) {
+	if (!local->netmask) {
 		if (inet_pton(AF_INET,"255.255.255.0", &ia) != 1)
 			return false;
 
-		server->netmask = ia.s_addr;
+		local->netmask = ia.s_addr;
+		local->options_valid = false;
 	}
 
 	/*
 	 * Assign a default ip range if not already. This will default to
 	 * server->address + 1 ... subnet end address - 1
 	 */
-	if (!server->start_ip) {
-		server->start_ip = ntohl(server->address) + 1;
-		server->end_ip = (ntohl(server->address) |
-			(~ntohl(server->netmask))) - 1;
+	if (!local->start_ip) {
+		local->start_ip = ntohl(server->address) + 1;
+		local->end_ip = (ntohl(server->address) |
+			(~ntohl(local->netmask))) - 1;
 	} else {
-		if ((server->start_ip ^ ntohl(server->address)) &
-				ntohl(server->netmask))
+		if ((local->start_ip ^ ntohl(server->address)) &
+				ntohl(local->netmask))
 			return false;
 
-		if ((server->end_ip ^ ntohl(server->address)) &
-				ntohl(server->netmask))
+		if ((local->end_ip ^ ntohl(server->address)) &
+				ntohl(local->netmask))
 			return false;
 
 		/*
@@ -1051,7 +2165,7 @@ LIB_EXPORT bool l_dhcp_server_start(struct l_dhcp_server *server)
 		 * include the subnet address or the broadcast address so that
 		 * we have fewer checks to make when selecting a free address
 		 * from that range.  Additionally this ensures end_ip is not
-		 * 0xffffffff so we can use the condition "<= server->end_ip"
+		 * 0xffffffff so we can use the condition "<= pool->end_ip"
 		 * safely on uint32_t values.
 		 * In find_free_or_expired_ip we skip over IPs ending in .0 or
 		 * .255 even for netmasks other than 24-bit just to avoid
@@ -1060,16 +2174,22 @@ LIB_EXPORT bool l_dhcp_server_start(struct l_dhcp_server *server)
 		 * explicitly requested by the client, i.e. in
 		 * check_requested_ip.
 		 */
-		if ((server->start_ip & (~ntohl(server->netmask))) == 0)
-			server->start_ip++;
+		if ((local->start_ip & (~ntohl(local->netmask))) == 0)
+			local->start_ip++;
 
-		if ((server->end_ip | ntohl(server->netmask)) == 0xffffffff)
-			server->end_ip--;
+		if ((local->end_ip | ntohl(local->netmask)) == 0xffffffff)
+			local->end_ip--;
 	}
 
-	if (server->start_ip >= server->end_ip)
+	if (local->start_ip >= local->end_ip)
 		return false;
 
+	ip_pool_invalidate(local);
+
+	if (server->lease_file && !lease_store_load(server))
+		SERVER_DEBUG("Lease file %s not usable, leases won't persist",
+				server->lease_file);
+
 	if (!server->ifname) {
 		server->ifname = l_net_get_name(server->ifindex);
 
@@ -1077,12 +2197,15 @@ LIB_EXPORT bool l_dhcp_server_start(struct l_dhcp_server *server)
 			return false;
 	}
 
-	if (!server->transport) {
+	if (!server->transport && server->shared_socket)
+		server->transport = _dhcp_shared_transport_new(server->ifindex,
+					server->ifname, DHCP_PORT_SERVER);
+	else if (!server->transport)
 		server->transport = _dhcp_default_transport_new(server->ifindex,
 					server->ifname, DHCP_PORT_SERVER);
-		if (!server->transport)
-			return false;
-	}
+
+	if (!server->transport)
+		return false;
 
 	SERVER_DEBUG("Starting DHCP server on %s", server->ifname);
 
@@ -1093,6 +2216,13 @@ LIB_EXPORT bool l_dhcp_server_start(struct l_dhcp_server *server)
 	_dhcp_transport_set_rx_callback(server->transport, listener_event,
 						server);
 
+	if (server->relay_prefixes && !relay_listener_open(server)) {
+		if (server->transport->close)
+			server->transport->close(server->transport);
+
+		return false;
+	}
+
 	server->started = true;
 
 	server->acd = l_acd_new(server->ifindex);
@@ -1125,6 +2255,9 @@ LIB_EXPORT bool l_dhcp_server_stop(struct l_dhcp_server *server)
 	if (server->transport->close)
 		server->transport->close(server->transport);
 
+	if (server->relay_transport && server->relay_transport->close)
+		server->relay_transport->close(server->relay_transport);
+
 	server->started = false;
 
 	if (server->next_expire) {
@@ -1137,7 +2270,7 @@ LIB_EXPORT bool l_dhcp_server_stop(struct l_dhcp_server *server)
 		server->acd = NULL;
 	}
 
-	/* TODO: Add ability to save leases */
+	lease_store_close(server);
 
 	return true;
 }
@@ -1160,8 +2293,21 @@ LIB_EXPORT bool l_dhcp_server_set_ip_range(struct l_dhcp_server *server,
 	if (inet_pton(AF_INET, (const char *) end_ip, &_host_addr) != 1)
 		return false;
 
-	server->start_ip = start;
-	server->end_ip = ntohl(_host_addr.s_addr);
+	server->local.start_ip = start;
+	server->local.end_ip = ntohl(_host_addr.s_addr);
+	ip_pool_invalidate(&server->local);
+
+	return true;
+}
+
+LIB_EXPORT bool l_dhcp_server_set_lease_file(struct l_dhcp_server *server,
+						const char *path)
+{
+	if (unlikely(!server || server->started))
+		return false;
+
+	l_free(server->lease_file);
+	server->lease_file = l_strdup(path);
 
 	return true;
 }
@@ -1218,6 +2364,7 @@ LIB_EXPORT bool l_dhcp_server_set_ip_address(struct l_dhcp_server *server,
 		return false;
 
 	server->address = ia.s_addr;
+	ip_pool_invalidate(&server->local);
 
 	return true;
 }
@@ -1245,7 +2392,8 @@ LIB_EXPORT bool l_dhcp_server_set_netmask(struct l_dhcp_server *server,
 	if (inet_pton(AF_INET, mask, &ia) != 1)
 		return false;
 
-	server->netmask = ia.s_addr;
+	server->local.netmask = ia.s_addr;
+	server->local.options_valid = false;
 
 	return true;
 }
@@ -1261,7 +2409,8 @@ LIB_EXPORT bool l_dhcp_server_set_gateway(struct l_dhcp_server *server,
 	if (inet_pton(AF_INET, ip, &ia) != 1)
 		return false;
 
-	server->gateway = ia.s_addr;
+	server->local.gateway = ia.s_addr;
+	server->local.options_valid = false;
 
 	return true;
 }
@@ -1289,6 +2438,7 @@ LIB_EXPORT bool l_dhcp_server_set_dns(struct l_dhcp_server *server, char **dns)
 		l_free(server->dns_list);
 
 	server->dns_list = dns_list;
+	options_invalidate(server);
 
 	return true;
 
@@ -1297,6 +2447,109 @@ failed:
 	return false;
 }
 
+/*
+ * Serve @subnet, given as "address/prefix", to clients behind a relay agent
+ * whose giaddr falls in it.  The most specific subnet is used if several
+ * match.  A NULL @start_ip and @end_ip hand out the whole subnet, a NULL
+ * @gateway leaves out the router option.  Relayed messages are received
+ * and answered on a UDP socket bound to the server port, opened when the
+ * server is started if any relay subnets are configured.  Once one is,
+ * relayed messages from other subnets are ignored.
+ */
+LIB_EXPORT bool l_dhcp_server_add_relay_subnet(struct l_dhcp_server *server,
+						const char *subnet,
+						const char *start_ip,
+						const char *end_ip,
+						const char *gateway)
+{
+	char buf[INET_ADDRSTRLEN];
+	const char *slash;
+	char *end;
+	unsigned long prefix_len;
+	struct in_addr ia;
+	struct dhcp_pool *pool;
+	uint32_t mask;
+
+	if (unlikely(!server || !subnet || server->started))
+		return false;
+
+	if (!start_ip != !end_ip)
+		return false;
+
+	slash = strchr(subnet, '/');
+	if (!slash || slash == subnet || slash - subnet >= (int) sizeof(buf))
+		return false;
+
+	memcpy(buf, subnet, slash - subnet);
+	buf[slash - subnet] = '\0';
+
+	if (inet_pton(AF_INET, buf, &ia) != 1)
+		return false;
+
+	prefix_len = strtoul(slash + 1, &end, 10);
+	if (*end || end == slash + 1 || prefix_len < 1 || prefix_len > 30)
+		return false;
+
+	mask = prefix_to_mask(prefix_len);
+
+	pool = l_new(struct dhcp_pool, 1);
+	pool->network = ntohl(ia.s_addr) & mask;
+	pool->netmask = htonl(mask);
+
+	if (!pool->network || l_hashmap_lookup(server->relay_pools[prefix_len],
+					L_UINT_TO_PTR(pool->network)))
+		goto error;
+
+	if (start_ip) {
+		if (inet_pton(AF_INET, start_ip, &ia) != 1)
+			goto error;
+
+		pool->start_ip = ntohl(ia.s_addr);
+
+		if (inet_pton(AF_INET, end_ip, &ia) != 1)
+			goto error;
+
+		pool->end_ip = ntohl(ia.s_addr);
+
+		if ((pool->start_ip & mask) != pool->network ||
+				(pool->end_ip & mask) != pool->network)
+			goto error;
+	} else {
+		pool->start_ip = pool->network;
+		pool->end_ip = pool->network | ~mask;
+	}
+
+	/* Same as for the local range, see l_dhcp_server_start */
+	if (pool->start_ip == pool->network)
+		pool->start_ip++;
+
+	if (pool->end_ip == (pool->network | ~mask))
+		pool->end_ip--;
+
+	if (pool->start_ip > pool->end_ip)
+		goto error;
+
+	if (gateway) {
+		if (inet_pton(AF_INET, gateway, &ia) != 1)
+			goto error;
+
+		pool->gateway = ia.s_addr;
+	}
+
+	if (!server->relay_pools[prefix_len])
+		server->relay_pools[prefix_len] = l_hashmap_new();
+
+	l_hashmap_insert(server->relay_pools[prefix_len],
+				L_UINT_TO_PTR(pool->network), pool);
+	server->relay_prefixes |= 1ULL << prefix_len;
+
+	return true;
+
+error:
+	l_free(pool);
+	return false;
+}
+
 LIB_EXPORT void l_dhcp_server_set_authoritative(struct l_dhcp_server *server,
 						bool authoritative)
 {
@@ -1306,6 +2559,21 @@ LIB_EXPORT void l_dhcp_server_set_authoritative(struct l_dhcp_server *server,
 	server->authoritative = authoritative;
 }
 
+/*
+ * Serve this interface through a packet socket shared by all the servers
+ * that enable this option, instead of one socket per server.  Must be set
+ * before the server is first started.
+ */
+LIB_EXPORT bool l_dhcp_server_set_shared_socket(struct l_dhcp_server *server,
+						bool enable)
+{
+	if (unlikely(!server || server->transport))
+		return false;
+
+	server->shared_socket = enable;
+	return true;
+}
+
 LIB_EXPORT void l_dhcp_server_set_enable_rapid_commit(
 						struct l_dhcp_server *server,
 						bool enable)
@@ -1322,32 +2590,8 @@ LIB_EXPORT struct l_dhcp_lease *l_dhcp_server_discover(
 						const uint8_t *client_id,
 						const uint8_t *mac)
 {
-	struct l_dhcp_lease *lease;
-
-	SERVER_DEBUG("Requested IP " NIPQUAD_FMT " for " MAC,
-			NIPQUAD(requested_ip_opt), MAC_STR(mac));
-
-	if ((lease = find_lease_by_id(server->lease_list, client_id, mac)))
-		requested_ip_opt = lease->address;
-	else if (!check_requested_ip(server, requested_ip_opt)) {
-		requested_ip_opt = find_free_or_expired_ip(server, mac);
-
-		if (unlikely(!requested_ip_opt)) {
-			SERVER_DEBUG("Could not find any free addresses");
-			return NULL;
-		}
-	}
-
-	lease = add_lease(server, true, client_id, mac, requested_ip_opt,
-				l_time_now());
-	if (unlikely(!lease)) {
-		SERVER_DEBUG("add_lease() failed");
-		return NULL;
-	}
-
-	SERVER_DEBUG("Offering " NIPQUAD_FMT " to " MAC,
-			NIPQUAD(requested_ip_opt), MAC_STR(mac));
-	return lease;
+	return server_discover(server, &server->local, requested_ip_opt,
+				client_id, mac);
 }
 
 LIB_EXPORT bool l_dhcp_server_request(struct l_dhcp_server *server,
@@ -1404,54 +2648,34 @@ LIB_EXPORT bool l_dhcp_server_lease_remove(struct l_dhcp_server *server,
 	if (unlikely(!lease))
 		return false;
 
-	if (unlikely(!l_queue_remove(server->lease_list, lease) &&
-			!l_queue_remove(server->expired_list, lease)))
+	if (unlikely(!lease_queue_del(server, lease) &&
+			!expired_list_remove(server, lease)))
 		return false;
 
 	_dhcp_lease_free(lease);
-	set_next_expire_timer(server, NULL);
-	return true;
-}
-
-struct dhcp_expire_by_mac_data {
-	struct l_dhcp_server *server;
-	const uint8_t *mac;
-	unsigned int expired_cnt;
-};
-
-static bool dhcp_expire_by_mac(void *data, void *user_data)
-{
-	struct l_dhcp_lease *lease = data;
-	struct dhcp_expire_by_mac_data *expire_data = user_data;
-	struct l_dhcp_server *server = expire_data->server;
-
-	if (!match_lease_mac(lease, expire_data->mac))
-		return false;
-
-	if (server->event_handler)
-		server->event_handler(server, L_DHCP_SERVER_EVENT_LEASE_EXPIRED,
-					server->user_data, lease);
-
-	if (!lease->offering) {
-		if (l_queue_length(server->expired_list) > server->max_expired)
-			_dhcp_lease_free(l_queue_pop_head(server->expired_list));
-
-		l_queue_push_tail(server->expired_list, lease);
-	} else
-		_dhcp_lease_free(lease);
-
-	expire_data->expired_cnt++;
+	set_next_expire_timer(server);
 	return true;
 }
 
 LIB_EXPORT void l_dhcp_server_expire_by_mac(struct l_dhcp_server *server,
 						const uint8_t *mac)
 {
-	struct dhcp_expire_by_mac_data expire_data = { server, mac, 0 };
+	struct l_queue *leases;
+	struct l_dhcp_lease *lease;
+	unsigned int expired_cnt = 0;
+
+	/* The index entry goes away along with the last lease for the MAC */
+	while ((leases = l_hashmap_lookup(server->leases_by_mac, mac)) &&
+			(lease = l_queue_peek_head(leases))) {
+		if (server->event_handler)
+			server->event_handler(server,
+					L_DHCP_SERVER_EVENT_LEASE_EXPIRED,
+					server->user_data, lease);
 
-	l_queue_foreach_remove(server->lease_list, dhcp_expire_by_mac,
-				&expire_data);
+		lease_expire(server, lease);
+		expired_cnt++;
+	}
 
-	if (expire_data.expired_cnt)
-		set_next_expire_timer(server, NULL);
+	if (expired_cnt)
+		set_next_expire_timer(server);
 }
@@ -26,22 +26,73 @@
 #include <net/if_arp.h>
 #include <errno.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 
 #include "io.h"
 #include "util.h"
+#include "queue.h"
+#include "hashmap.h"
+#include "idle.h"
 #include "private.h"
 #include "time.h"
 #include "time-private.h"
 #include "dhcp-private.h"
 
+struct dhcp_shared_socket;
+
 struct dhcp_default_transport {
 	struct dhcp_transport super;
 	struct l_io *io;
 	int udp_fd;
 	char ifname[IFNAMSIZ];
 	uint16_t port;
+	struct dhcp_shared_socket *shared;
+};
+
+/*
+ * A packet socket not bound to any interface, shared by all the shared
+ * transports on the same port.  Received packets are handed to the
+ * transport for the interface they arrived on.
+ */
+/*
+ * TPACKET_V3 receive ring.  The kernel fills whole blocks of packets and
+ * hands them over once a block is full or its timeout retires it, so a
+ * burst of requests costs one wakeup per block instead of one per packet.
+ */
+#define RING_BLOCK_SIZE		(1 << 16)
+#define RING_BLOCK_NR		16
+#define RING_FRAME_SIZE		2048
+#define RING_BLOCK_TIMEOUT_MS	2
+
+struct dhcp_packet_ring {
+	uint8_t *map;
+	unsigned int block;
 };
 
+/* Replies sent while a ring block is dispatched go out in one sendmmsg */
+#define TX_BATCH_MAX 32
+
+struct dhcp_tx_slot {
+	struct sockaddr_ll addr;
+	struct iphdr ip;
+	struct udphdr udp;
+	void *data;
+	size_t len;
+};
+
+struct dhcp_shared_socket {
+	struct l_io *io;
+	uint16_t port;
+	struct l_hashmap *transports;
+	struct dhcp_packet_ring ring;
+	struct dhcp_tx_slot tx[TX_BATCH_MAX];
+	unsigned int n_tx;
+	bool in_dispatch : 1;
+	bool destroyed : 1;
+};
+
+static struct l_queue *shared_sockets;
+
 struct dhcp_packet {
 	struct iphdr ip;
 	struct udphdr udp;
@@ -90,46 +141,31 @@ uint16_t _dhcp_checksum(const void *buf, size_t len)
 	return _dhcp_checksumv(iov, 1);
 }
 
-static bool _dhcp_default_transport_read_handler(struct l_io *io,
-							void *userdata)
+/*
+ * Validate the IP and UDP headers of a packet received on a raw socket.
+ * Returns the length of the DHCP message at @out_msg, or 0 if the packet
+ * should be ignored.  The checksum fields in @buf are clobbered.
+ */
+static size_t dhcp_packet_validate(void *buf, size_t len,
+					struct dhcp_message **out_msg)
 {
-	struct dhcp_default_transport *transport = userdata;
-	int fd = l_io_get_fd(io);
-	char buf[2048];
-	ssize_t len;
-	struct dhcp_packet *p;
+	struct dhcp_packet *p = buf;
 	uint16_t c;
-	struct sockaddr_ll saddr;
-	uint64_t timestamp = 0;
-	struct cmsghdr *cmsg;
-	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
-	struct msghdr msg = {};
-	unsigned char control[32 + CMSG_SPACE(sizeof(struct timeval))];
-
-	msg.msg_name = &saddr;
-	msg.msg_namelen = sizeof(saddr);
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-	msg.msg_control = control;
-	msg.msg_controllen = sizeof(control);
-
-	len = recvmsg(fd, &msg, 0);
-	if (len < 0)
-		return false;
 
-	p = (struct dhcp_packet *) buf;
+	if (len < sizeof(struct dhcp_packet))
+		return 0;
 
 	if (len < L_BE16_TO_CPU(p->ip.tot_len))
-		return true;
+		return 0;
 
-	if (len < (ssize_t) (L_BE16_TO_CPU(p->udp.len) + sizeof(struct iphdr)))
-		return true;
+	if (len < L_BE16_TO_CPU(p->udp.len) + sizeof(struct iphdr))
+		return 0;
 
 	c = p->ip.check;
 	p->ip.check = 0;
 
 	if (c != _dhcp_checksum(&p->ip, sizeof(struct iphdr)))
-		return true;
+		return 0;
 
 	/* only compute if the UDP checksum is present, e.g. non-zero */
 	if (p->udp.check) {
@@ -144,10 +180,45 @@ static bool _dhcp_default_transport_read_handler(struct l_io *io,
 		 */
 		if (c != _dhcp_checksum(&p->ip.ttl,
 					L_BE16_TO_CPU(p->udp.len) + 12))
-			return true;
+			return 0;
 	}
 
-	len -= sizeof(struct udphdr) - sizeof(struct iphdr);
+	*out_msg = &p->dhcp;
+	return len - sizeof(struct udphdr) - sizeof(struct iphdr);
+}
+
+/*
+ * Receive and validate a single packet.  Returns the length of the DHCP
+ * message at @out_msg, 0 if the packet should be ignored, or a negative
+ * errno if the socket failed.
+ */
+static ssize_t dhcp_packet_recv(int fd, void *buf, size_t size,
+				struct sockaddr_ll *saddr, socklen_t *saddr_len,
+				uint64_t *timestamp,
+				struct dhcp_message **out_msg)
+{
+	ssize_t len;
+	struct cmsghdr *cmsg;
+	struct iovec iov = { .iov_base = buf, .iov_len = size };
+	struct msghdr msg = {};
+	unsigned char control[32 + CMSG_SPACE(sizeof(struct timeval))];
+
+	msg.msg_name = saddr;
+	msg.msg_namelen = sizeof(*saddr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	len = recvmsg(fd, &msg, 0);
+	if (len < 0)
+		return -errno;
+
+	len = dhcp_packet_validate(buf, len, out_msg);
+	if (!len)
+		return 0;
+
+	*timestamp = 0;
 
 	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
 					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
@@ -157,27 +228,286 @@ static bool _dhcp_default_transport_read_handler(struct l_io *io,
 				CMSG_LEN(sizeof(struct timeval))) {
 			const struct timeval *tv = (void *) CMSG_DATA(cmsg);
 
-			timestamp = _time_realtime_to_boottime(tv);
+			*timestamp = _time_realtime_to_boottime(tv);
 		}
 	}
 
-	if (!timestamp)
-		timestamp = l_time_now();
+	if (!*timestamp)
+		*timestamp = l_time_now();
+
+	*saddr_len = msg.msg_namelen;
+	return len;
+}
+
+static void dhcp_packet_deliver(struct dhcp_default_transport *transport,
+				const struct dhcp_message *message, size_t len,
+				const struct sockaddr_ll *saddr,
+				socklen_t saddr_len, uint64_t timestamp)
+{
+	const uint8_t *src_mac = NULL;
 
-	if (transport->super.rx_cb) {
-		const uint8_t *src_mac = NULL;
+	if (!transport->super.rx_cb)
+		return;
 
-		if (msg.msg_namelen >= sizeof(saddr) &&
-				saddr.sll_halen == ETH_ALEN)
-			src_mac = saddr.sll_addr;
+	if (saddr_len >= sizeof(*saddr) && saddr->sll_halen == ETH_ALEN)
+		src_mac = saddr->sll_addr;
 
-		transport->super.rx_cb(&p->dhcp, len, transport->super.rx_data,
-					src_mac, timestamp);
+	transport->super.rx_cb(message, len, transport->super.rx_data,
+				src_mac, timestamp);
+}
+
+static bool _dhcp_default_transport_read_handler(struct l_io *io,
+							void *userdata)
+{
+	struct dhcp_default_transport *transport = userdata;
+	char buf[2048];
+	struct sockaddr_ll saddr;
+	socklen_t saddr_len;
+	uint64_t timestamp;
+	struct dhcp_message *message;
+	ssize_t len;
+
+	len = dhcp_packet_recv(l_io_get_fd(io), buf, sizeof(buf),
+				&saddr, &saddr_len, &timestamp, &message);
+	if (len < 0)
+		return false;
+
+	if (len)
+		dhcp_packet_deliver(transport, message, len, &saddr, saddr_len,
+					timestamp);
+
+	return true;
+}
+
+static void dhcp_shared_socket_deliver(struct dhcp_shared_socket *shared,
+					const struct dhcp_message *message,
+					size_t len,
+					const struct sockaddr_ll *saddr,
+					socklen_t saddr_len, uint64_t timestamp)
+{
+	struct dhcp_default_transport *transport;
+
+	if (saddr_len < offsetof(struct sockaddr_ll, sll_addr))
+		return;
+
+	transport = l_hashmap_lookup(shared->transports,
+					L_UINT_TO_PTR(saddr->sll_ifindex));
+	if (transport)
+		dhcp_packet_deliver(transport, message, len, saddr, saddr_len,
+					timestamp);
+}
+
+static void dhcp_shared_tx_flush(struct dhcp_shared_socket *shared)
+{
+	struct mmsghdr msgs[TX_BATCH_MAX];
+	struct iovec iov[TX_BATCH_MAX][3];
+	unsigned int sent = 0;
+	unsigned int i;
+
+	if (!shared->n_tx)
+		return;
+
+	memset(msgs, 0, sizeof(msgs));
+
+	for (i = 0; i < shared->n_tx; i++) {
+		struct dhcp_tx_slot *slot = &shared->tx[i];
+
+		iov[i][0].iov_base = &slot->ip;
+		iov[i][0].iov_len = sizeof(slot->ip);
+		iov[i][1].iov_base = &slot->udp;
+		iov[i][1].iov_len = sizeof(slot->udp);
+		iov[i][2].iov_base = slot->data;
+		iov[i][2].iov_len = slot->len;
+
+		msgs[i].msg_hdr.msg_name = &slot->addr;
+		msgs[i].msg_hdr.msg_namelen = sizeof(slot->addr);
+		msgs[i].msg_hdr.msg_iov = iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 3;
+	}
+
+	while (sent < shared->n_tx) {
+		int r = sendmmsg(l_io_get_fd(shared->io), msgs + sent,
+					shared->n_tx - sent, 0);
+
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/* Skip the packet that failed and carry on */
+			sent++;
+			continue;
+		}
+
+		sent += r;
+	}
+
+	for (i = 0; i < shared->n_tx; i++)
+		l_free(shared->tx[i].data);
+
+	shared->n_tx = 0;
+}
+
+static void dhcp_shared_tx_queue(struct dhcp_shared_socket *shared,
+					const struct sockaddr_ll *addr,
+					const struct iphdr *ip,
+					const struct udphdr *udp,
+					const void *data, size_t len)
+{
+	struct dhcp_tx_slot *slot;
+
+	if (shared->n_tx == TX_BATCH_MAX)
+		dhcp_shared_tx_flush(shared);
+
+	slot = &shared->tx[shared->n_tx++];
+	slot->addr = *addr;
+	slot->ip = *ip;
+	slot->udp = *udp;
+	slot->data = l_memdup(data, len);
+	slot->len = len;
+}
+
+static bool packet_ring_setup(int fd, struct dhcp_packet_ring *ring)
+{
+	int version = TPACKET_V3;
+	struct tpacket_req3 req;
+	void *map;
+
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION,
+					&version, sizeof(version)) < 0)
+		return false;
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = RING_BLOCK_SIZE;
+	req.tp_block_nr = RING_BLOCK_NR;
+	req.tp_frame_size = RING_FRAME_SIZE;
+	req.tp_frame_nr = RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_NR;
+	req.tp_retire_blk_tov = RING_BLOCK_TIMEOUT_MS;
+
+	if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+		return false;
+
+	map = mmap(NULL, RING_BLOCK_SIZE * RING_BLOCK_NR,
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		/* Tear the ring down again so that recvmsg keeps working */
+		memset(&req, 0, sizeof(req));
+		setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+		return false;
 	}
 
+	ring->map = map;
+	ring->block = 0;
 	return true;
 }
 
+static void packet_ring_dispatch_block(struct dhcp_shared_socket *shared,
+					struct tpacket_block_desc *desc)
+{
+	uint8_t *frame = (uint8_t *) desc + desc->hdr.bh1.offset_to_first_pkt;
+	uint32_t n_pkts = desc->hdr.bh1.num_pkts;
+	uint32_t i;
+
+	for (i = 0; i < n_pkts && !shared->destroyed; i++) {
+		struct tpacket3_hdr *hdr = (struct tpacket3_hdr *) frame;
+		const struct sockaddr_ll *saddr = (const void *)
+			(frame + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+		struct dhcp_message *message;
+		struct timeval tv;
+		size_t len;
+
+		frame += hdr->tp_next_offset;
+
+		len = dhcp_packet_validate((uint8_t *) hdr + hdr->tp_mac,
+						hdr->tp_snaplen, &message);
+		if (!len)
+			continue;
+
+		tv.tv_sec = hdr->tp_sec;
+		tv.tv_usec = hdr->tp_nsec / 1000;
+
+		dhcp_shared_socket_deliver(shared, message, len, saddr,
+					sizeof(*saddr),
+					_time_realtime_to_boottime(&tv));
+	}
+}
+
+static void shared_socket_free(void *data)
+{
+	struct dhcp_shared_socket *shared = data;
+	unsigned int i;
+
+	l_io_destroy(shared->io);
+
+	if (shared->ring.map)
+		munmap(shared->ring.map, RING_BLOCK_SIZE * RING_BLOCK_NR);
+
+	for (i = 0; i < shared->n_tx; i++)
+		l_free(shared->tx[i].data);
+
+	l_hashmap_destroy(shared->transports, NULL);
+	l_free(shared);
+}
+
+static void dhcp_shared_socket_ring_read(struct dhcp_shared_socket *shared)
+{
+	unsigned int n_blocks;
+
+	for (n_blocks = 0; n_blocks < RING_BLOCK_NR && !shared->destroyed;
+								n_blocks++) {
+		struct tpacket_block_desc *desc = (void *) (shared->ring.map +
+				shared->ring.block * RING_BLOCK_SIZE);
+
+		if (!(__atomic_load_n(&desc->hdr.bh1.block_status,
+					__ATOMIC_ACQUIRE) & TP_STATUS_USER))
+			break;
+
+		packet_ring_dispatch_block(shared, desc);
+
+		__atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL,
+					__ATOMIC_RELEASE);
+		shared->ring.block = (shared->ring.block + 1) % RING_BLOCK_NR;
+	}
+}
+
+static bool dhcp_shared_socket_read_handler(struct l_io *io, void *userdata)
+{
+	struct dhcp_shared_socket *shared = userdata;
+	bool ret = true;
+
+	shared->in_dispatch = true;
+
+	if (shared->ring.map)
+		dhcp_shared_socket_ring_read(shared);
+	else {
+		char buf[2048];
+		struct sockaddr_ll saddr;
+		socklen_t saddr_len;
+		uint64_t timestamp;
+		struct dhcp_message *message;
+		ssize_t len;
+
+		len = dhcp_packet_recv(l_io_get_fd(io), buf, sizeof(buf),
+					&saddr, &saddr_len, &timestamp,
+					&message);
+		if (len < 0)
+			ret = false;
+		else if (len)
+			dhcp_shared_socket_deliver(shared, message, len,
+						&saddr, saddr_len, timestamp);
+	}
+
+	dhcp_shared_tx_flush(shared);
+	shared->in_dispatch = false;
+
+	/* The last transport went away from one of the callbacks */
+	if (shared->destroyed) {
+		l_idle_oneshot(shared_socket_free, shared, NULL);
+		return false;
+	}
+
+	return ret;
+}
+
 static void dhcp_set_ip_udp_headers(struct iphdr *ip, struct udphdr *udp,
 					uint32_t saddr, uint16_t sport,
 					uint32_t daddr, uint16_t dport,
@@ -252,13 +582,21 @@ static int _dhcp_default_transport_l2_send(struct dhcp_transport *s,
 	else
 		memcpy(addr.sll_addr, dest_mac, ETH_ALEN);
 
+	if (transport->shared && transport->shared->in_dispatch) {
+		dhcp_shared_tx_queue(transport->shared, &addr, &ip, &udp,
+					data, len);
+		return 0;
+	}
+
 	memset(&msg, 0, sizeof(msg));
 	msg.msg_name = &addr;
 	msg.msg_namelen = sizeof(addr);
 	msg.msg_iov = iov;
 	msg.msg_iovlen = 3;
 
-	if (sendmsg(l_io_get_fd(transport->io), &msg, 0) < 0)
+	if (sendmsg(l_io_get_fd(transport->shared ? transport->shared->io :
+							transport->io),
+			&msg, 0) < 0)
 		goto error;
 
 	errno = 0;
@@ -360,7 +698,12 @@ static int _dhcp_default_transport_bind(struct dhcp_transport *s,
 	return 0;
 }
 
-static int kernel_raw_socket_open(uint32_t ifindex, uint16_t port, uint32_t xid)
+/*
+ * If @ring is not NULL, a receive ring is set up when the kernel supports
+ * it.  Otherwise, or if that fails, packets are read with recvmsg.
+ */
+static int kernel_raw_socket_open(uint32_t ifindex, uint16_t port, uint32_t xid,
+					struct dhcp_packet_ring *ring)
 {
 	int s;
 	struct sockaddr_ll addr;
@@ -463,6 +806,11 @@ static int kernel_raw_socket_open(uint32_t ifindex, uint16_t port, uint32_t xid)
 	if (setsockopt(s, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one)) < 0)
 		goto error;
 
+	/* The ring has to be in place before packets start being queued */
+	if (ring && !packet_ring_setup(s, ring))
+		ring->map = NULL;
+
+	/* An ifindex of 0 receives from all interfaces */
 	memset(&addr, 0, sizeof(addr));
 	addr.sll_family = AF_PACKET;
 	addr.sll_protocol = htons(ETH_P_IP);
@@ -476,6 +824,11 @@ static int kernel_raw_socket_open(uint32_t ifindex, uint16_t port, uint32_t xid)
 	return s;
 
 error:
+	if (ring && ring->map) {
+		munmap(ring->map, RING_BLOCK_SIZE * RING_BLOCK_NR);
+		ring->map = NULL;
+	}
+
 	L_TFR(close(s));
 	return -errno;
 }
@@ -489,7 +842,7 @@ static int _dhcp_default_transport_open(struct dhcp_transport *s, uint32_t xid)
 	if (transport->io)
 		return -EALREADY;
 
-	fd = kernel_raw_socket_open(s->ifindex, transport->port, xid);
+	fd = kernel_raw_socket_open(s->ifindex, transport->port, xid, NULL);
 	if (fd < 0)
 		return fd;
 
@@ -542,6 +895,235 @@ struct dhcp_transport *_dhcp_default_transport_new(uint32_t ifindex,
 	return &transport->super;
 }
 
+static bool shared_socket_match_port(const void *data, const void *user_data)
+{
+	const struct dhcp_shared_socket *shared = data;
+
+	return shared->port == L_PTR_TO_UINT(user_data);
+}
+
+static struct dhcp_shared_socket *shared_socket_get(uint16_t port)
+{
+	struct dhcp_shared_socket *shared;
+	struct dhcp_packet_ring ring;
+	int fd;
+
+	shared = l_queue_find(shared_sockets, shared_socket_match_port,
+				L_UINT_TO_PTR(port));
+	if (shared)
+		return shared;
+
+	fd = kernel_raw_socket_open(0, port, 0, &ring);
+	if (fd < 0)
+		return NULL;
+
+	shared = l_new(struct dhcp_shared_socket, 1);
+	shared->port = port;
+	shared->ring = ring;
+	shared->transports = l_hashmap_new();
+	shared->io = l_io_new(fd);
+	l_io_set_close_on_destroy(shared->io, true);
+	l_io_set_read_handler(shared->io, dhcp_shared_socket_read_handler,
+				shared, NULL);
+
+	if (!shared_sockets)
+		shared_sockets = l_queue_new();
+
+	l_queue_push_tail(shared_sockets, shared);
+	return shared;
+}
+
+static void shared_socket_put(struct dhcp_shared_socket *shared)
+{
+	if (!l_hashmap_isempty(shared->transports))
+		return;
+
+	l_queue_remove(shared_sockets, shared);
+
+	if (l_queue_isempty(shared_sockets)) {
+		l_queue_destroy(shared_sockets, NULL);
+		shared_sockets = NULL;
+	}
+
+	/* Freed once the read handler returns */
+	if (shared->in_dispatch) {
+		shared->destroyed = true;
+		return;
+	}
+
+	shared_socket_free(shared);
+}
+
+static int dhcp_shared_transport_open(struct dhcp_transport *s, uint32_t xid)
+{
+	struct dhcp_default_transport *transport =
+		l_container_of(s, struct dhcp_default_transport, super);
+	struct dhcp_shared_socket *shared;
+
+	if (transport->shared)
+		return -EALREADY;
+
+	shared = shared_socket_get(transport->port);
+	if (!shared)
+		return -EIO;
+
+	if (l_hashmap_lookup(shared->transports, L_UINT_TO_PTR(s->ifindex))) {
+		shared_socket_put(shared);
+		return -EBUSY;
+	}
+
+	l_hashmap_insert(shared->transports, L_UINT_TO_PTR(s->ifindex),
+				transport);
+
+	transport->shared = shared;
+	return 0;
+}
+
+static void dhcp_shared_transport_close(struct dhcp_transport *s)
+{
+	struct dhcp_default_transport *transport =
+		l_container_of(s, struct dhcp_default_transport, super);
+
+	if (!transport->shared)
+		return;
+
+	l_hashmap_remove(transport->shared->transports,
+				L_UINT_TO_PTR(s->ifindex));
+	shared_socket_put(transport->shared);
+	transport->shared = NULL;
+}
+
+/*
+ * Like the default transport but receiving and sending through a packet
+ * socket shared with the other shared transports on @port, so that serving
+ * many interfaces needs a single descriptor.  Only the raw l2_send path is
+ * available.
+ */
+struct dhcp_transport *_dhcp_shared_transport_new(uint32_t ifindex,
+							const char *ifname,
+							uint16_t port)
+{
+	struct dhcp_default_transport *transport;
+	transport = l_new(struct dhcp_default_transport, 1);
+
+	transport->super.open = dhcp_shared_transport_open;
+	transport->super.close = dhcp_shared_transport_close;
+	transport->super.l2_send = _dhcp_default_transport_l2_send;
+
+	transport->super.ifindex = ifindex;
+	l_strlcpy(transport->ifname, ifname, IFNAMSIZ);
+	transport->port = port;
+	transport->udp_fd = -1;
+
+	return &transport->super;
+}
+
+static bool dhcp_relay_transport_read_handler(struct l_io *io, void *userdata)
+{
+	struct dhcp_default_transport *transport = userdata;
+	uint32_t buf[512];
+	ssize_t len;
+
+	len = recv(l_io_get_fd(io), buf, sizeof(buf), 0);
+	if (len < 0)
+		return errno == EAGAIN || errno == EINTR;
+
+	if (transport->super.rx_cb)
+		transport->super.rx_cb(buf, len, transport->super.rx_data,
+					NULL, l_time_now());
+
+	return true;
+}
+
+static int dhcp_relay_transport_open(struct dhcp_transport *s, uint32_t xid)
+{
+	struct dhcp_default_transport *transport =
+		l_container_of(s, struct dhcp_default_transport, super);
+	struct sockaddr_in addr;
+	int one = 1;
+	int fd;
+
+	if (transport->io)
+		return -EALREADY;
+
+	fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0)
+		goto error;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = L_CPU_TO_BE16(transport->port);
+	addr.sin_addr.s_addr = INADDR_ANY;
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		goto error;
+
+	transport->io = l_io_new(fd);
+	if (!transport->io) {
+		L_TFR(close(fd));
+		return -EMFILE;
+	}
+
+	l_io_set_close_on_destroy(transport->io, true);
+	l_io_set_read_handler(transport->io, dhcp_relay_transport_read_handler,
+				transport, NULL);
+
+	return 0;
+
+error:
+	L_TFR(close(fd));
+	return -errno;
+}
+
+static int dhcp_relay_transport_send(struct dhcp_transport *s,
+					const struct sockaddr_in *dest,
+					const void *data, size_t len)
+{
+	struct dhcp_default_transport *transport =
+		l_container_of(s, struct dhcp_default_transport, super);
+
+	if (!transport->io)
+		return -ENOTCONN;
+
+	if (sendto(l_io_get_fd(transport->io), data, len, 0,
+			(const struct sockaddr *) dest, sizeof(*dest)) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static void dhcp_relay_transport_close(struct dhcp_transport *s)
+{
+	struct dhcp_default_transport *transport =
+		l_container_of(s, struct dhcp_default_transport, super);
+
+	l_io_destroy(transport->io);
+	transport->io = NULL;
+}
+
+/*
+ * A UDP socket on @port bound to no address or interface, for a server
+ * talking to relay agents which may sit behind any interface.  Messages
+ * are sent with the send method and are received without a source MAC.
+ */
+struct dhcp_transport *_dhcp_relay_transport_new(uint16_t port)
+{
+	struct dhcp_default_transport *transport;
+	transport = l_new(struct dhcp_default_transport, 1);
+
+	transport->super.open = dhcp_relay_transport_open;
+	transport->super.close = dhcp_relay_transport_close;
+	transport->super.send = dhcp_relay_transport_send;
+
+	transport->port = port;
+	transport->udp_fd = -1;
+
+	return &transport->super;
+}
+
 void _dhcp_transport_free(struct dhcp_transport *transport)
 {
 	if (!transport)
@@ -74,6 +74,18 @@ bool _dhcp_message_builder_append(struct dhcp_message_builder *builder,
 	return true;
 }
 
+/* Append options that are already encoded, e.g. cached from earlier */
+bool _dhcp_message_builder_append_encoded(struct dhcp_message_builder *builder,
+						const void *options, size_t len)
+{
+	LEN_CHECK(builder, len);
+
+	memcpy(builder->pos, options, len);
+	builder->pos += len;
+
+	return true;
+}
+
 bool _dhcp_message_builder_append_prl(struct dhcp_message_builder *builder,
 					const unsigned long *reqopts)
 {
@@ -21,10 +21,12 @@
 #include "random.h"
 #include "time.h"
 #include "time-private.h"
+#include "retransmit-private.h"
 #include "net.h"
 #include "timeout.h"
 #include "dhcp.h"
 #include "dhcp-private.h"
+#include "memory-private.h"
 #include "netlink.h"
 #include "rtnl.h"
 #include "acd.h"
@@ -42,11 +44,13 @@
 	CLIENT_LOG(L_LOG_WARNING, fmt, ## args)
 #define CLIENT_ENTER_STATE(s)						\
 	CLIENT_INFO("Entering state: " #s);				\
+	dhcp_client_drop_message(client);				\
 	client->state = (s)
 
 #define BITS_PER_LONG (sizeof(unsigned long) * 8)
 #define CLIENT_MAX_ATTEMPT_LIMIT 30
 #define CLIENT_MIN_ATTEMPT_LIMIT 3
+#define CLIENT_REBOOT_ATTEMPT_LIMIT 2
 
 enum dhcp_state {
 	DHCP_STATE_INIT,
@@ -154,9 +158,12 @@ struct l_dhcp_client {
 	uint32_t xid;
 	struct dhcp_transport *transport;
 	uint64_t start_t;
-	struct l_timeout *timeout_resend;
+	struct dhcp_message *tx_message;
+	size_t tx_len;
+	struct retransmit *resend;
 	struct l_timeout *timeout_lease;
 	struct l_dhcp_lease *lease;
+	struct l_dhcp_lease *reboot_lease;
 	struct l_netlink *rtnl;
 	uint32_t rtnl_add_cmdid;
 	struct l_rtnl_address *rtnl_configured_address;
@@ -170,8 +177,11 @@ struct l_dhcp_client {
 	int debug_level;
 	struct l_acd *acd;
 	void *debug_data;
+	dhcp_client_trace_func_t trace_func;
+	void *trace_data;
 	bool have_addr : 1;
 	bool override_xid : 1;
+	bool reboot_acd : 1;
 };
 
 static inline void dhcp_enable_option(struct l_dhcp_client *client,
@@ -225,7 +235,7 @@ static uint64_t dhcp_fuzz_secs(uint32_t secs)
  */
 static uint64_t dhcp_fuzz_msecs(uint64_t ms)
 {
-	uint32_t r = l_getrandom_uint32();
+	uint32_t r = l_getrandom_buffered_uint32();
 
 	if (r & 0x80000000)
 		ms += r & 0x3f;
@@ -304,6 +314,13 @@ static int client_message_init(struct l_dhcp_client *client,
 	return 0;
 }
 
+/* Marks the DISCOVER, OFFER and ACK of each exchange for timing purposes */
+static void dhcp_client_trace(struct l_dhcp_client *client, uint8_t msg_type)
+{
+	if (client->trace_func)
+		client->trace_func(client, msg_type, client->trace_data);
+}
+
 static void dhcp_client_event_notify(struct l_dhcp_client *client,
 						enum l_dhcp_client_event event)
 {
@@ -311,16 +328,83 @@ static void dhcp_client_event_notify(struct l_dhcp_client *client,
 		client->event_handler(client, event, client->event_data);
 }
 
+static void dhcp_client_drop_message(struct l_dhcp_client *client)
+{
+	l_free(client->tx_message);
+	client->tx_message = NULL;
+	client->tx_len = 0;
+}
+
+static int dhcp_client_send_unicast(struct l_dhcp_client *client,
+					struct dhcp_message *request,
+					unsigned int len)
+{
+	struct sockaddr_in si;
+	int r;
+
+	memset(&si, 0, sizeof(si));
+	si.sin_family = AF_INET;
+	si.sin_port = L_CPU_TO_BE16(DHCP_PORT_SERVER);
+	si.sin_addr.s_addr = client->lease->server_address;
+
+	/*
+	 * sendto() might fail with an EPERM error, which most likely means
+	 * that the unicast was prevented by netfilter.  Ignore this case
+	 * and assume that once the REBINDING timeout is hit, a broadcast
+	 * will go through which will have a chance of renewing the lease
+	 */
+	r = client->transport->send(client->transport, &si, request, len);
+	if (r == -EPERM) {
+		CLIENT_DEBUG("transport->send() failed with EPERM -> ignore");
+		CLIENT_DEBUG("Is a firewall denying unicast DHCP packets?");
+		return 0;
+	}
+
+	return r;
+}
+
+/*
+ * RFC 2131, Section 4.1 has retransmissions reuse the 'xid' and the
+ * contents of the original message, the only thing that changes is the
+ * 'secs' field.  The DISCOVER or REQUEST of the current state is therefore
+ * built on the first attempt and kept until the client moves to another
+ * state, retransmissions only update 'secs' in the cached copy.
+ */
+static int dhcp_client_send_message(struct l_dhcp_client *client)
+{
+	client->tx_message->secs =
+			L_CPU_TO_BE16(dhcp_attempt_secs(client->start_t));
+
+	/*
+	 * RFC2131, Section 4.1:
+	 * "DHCP clients MUST use the IP address provided in the
+	 * 'server identifier' option for any unicast requests to the DHCP
+	 * server.
+	 */
+	if (client->state == DHCP_STATE_RENEWING)
+		return dhcp_client_send_unicast(client, client->tx_message,
+							client->tx_len);
+
+	return client->transport->l2_send(client->transport,
+					INADDR_ANY, DHCP_PORT_CLIENT,
+					INADDR_BROADCAST, DHCP_PORT_SERVER,
+					NULL, client->tx_message,
+					client->tx_len);
+}
+
 static int dhcp_client_send_discover(struct l_dhcp_client *client)
 {
 	struct dhcp_message_builder builder;
 	size_t optlen = DHCP_MIN_OPTIONS_SIZE;
 	size_t len = sizeof(struct dhcp_message) + optlen;
-	L_AUTO_FREE_VAR(struct dhcp_message *, discover);
+	L_AUTO_FREE_VAR(struct dhcp_message *, discover) = NULL;
 	int err;
 
 	CLIENT_DEBUG("");
 
+	if (client->tx_message)
+		return dhcp_client_send_message(client);
+
 	discover = (struct dhcp_message *) l_new(uint8_t, len);
 
 	_dhcp_message_builder_init(&builder, discover, len,
@@ -341,39 +425,10 @@ static int dhcp_client_send_discover(struct l_dhcp_client *client)
 					0, "");
 	_dhcp_message_builder_finalize(&builder, &len);
 
-	return client->transport->l2_send(client->transport,
-					INADDR_ANY, DHCP_PORT_CLIENT,
-					INADDR_BROADCAST, DHCP_PORT_SERVER,
-					NULL,
-					discover, len);
-}
-
-static int dhcp_client_send_unicast(struct l_dhcp_client *client,
-					struct dhcp_message *request,
-					unsigned int len)
-{
-	struct sockaddr_in si;
-	int r;
-
-	memset(&si, 0, sizeof(si));
-	si.sin_family = AF_INET;
-	si.sin_port = L_CPU_TO_BE16(DHCP_PORT_SERVER);
-	si.sin_addr.s_addr = client->lease->server_address;
+	client->tx_message = l_steal_ptr(discover);
+	client->tx_len = len;
 
-	/*
-	 * sendto() might fail with an EPERM error, which most likely means
-	 * that the unicast was prevented by netfilter.  Ignore this case
-	 * and assume that once the REBINDING timeout is hit, a broadcast
-	 * will go through which will have a chance of renewing the lease
-	 */
-	r = client->transport->send(client->transport, &si, request, len);
-	if (r == -EPERM) {
-		CLIENT_DEBUG("transport->send() failed with EPERM -> ignore");
-		CLIENT_DEBUG("Is a firewall denying unicast DHCP packets?");
-		return 0;
-	}
-
-	return r;
+	return dhcp_client_send_message(client);
 }
 
 static int dhcp_client_send_request(struct l_dhcp_client *client)
@@ -381,11 +436,14 @@ static int dhcp_client_send_request(struct l_dhcp_client *client)
 	struct dhcp_message_builder builder;
 	size_t optlen = DHCP_MIN_OPTIONS_SIZE;
 	size_t len = sizeof(struct dhcp_message) + optlen;
-	L_AUTO_FREE_VAR(struct dhcp_message *, request);
+	L_AUTO_FREE_VAR(struct dhcp_message *, request) = NULL;
 	int err;
 
 	CLIENT_DEBUG("");
 
+	if (client->tx_message)
+		return dhcp_client_send_message(client);
+
 	request = (struct dhcp_message *) l_new(uint8_t, len);
 
 	_dhcp_message_builder_init(&builder, request, len,
@@ -427,6 +485,22 @@ static int dhcp_client_send_request(struct l_dhcp_client *client)
 			return -EINVAL;
 		}
 
+		break;
+	case DHCP_STATE_REBOOTING:
+		/*
+		 * RFC 2131, Section 4.3.2:
+		 * "DHCPREQUEST generated during INIT-REBOOT state:
+		 * 'server identifier' MUST NOT be filled in, 'requested IP
+		 * address' option MUST be filled in with client's notion of
+		 * its previously assigned address. 'ciaddr' MUST be zero."
+		 */
+		if (!_dhcp_message_builder_append(&builder,
+					L_DHCP_OPTION_REQUESTED_IP_ADDRESS,
+					4, &client->lease->address)) {
+			CLIENT_WARN("Failed to append requested IP");
+			return -EINVAL;
+		}
+
 		break;
 	case DHCP_STATE_RENEWING:
 	case DHCP_STATE_REBINDING:
@@ -436,7 +510,6 @@ static int dhcp_client_send_request(struct l_dhcp_client *client)
 	case DHCP_STATE_INIT:
 	case DHCP_STATE_SELECTING:
 	case DHCP_STATE_INIT_REBOOT:
-	case DHCP_STATE_REBOOTING:
 	case DHCP_STATE_BOUND:
 		return -EINVAL;
 	}
@@ -453,19 +526,10 @@ static int dhcp_client_send_request(struct l_dhcp_client *client)
 
 	_dhcp_message_builder_finalize(&builder, &len);
 
-	/*
-	 * RFC2131, Section 4.1:
-	 * "DHCP clients MUST use the IP address provided in the
-	 * 'server identifier' option for any unicast requests to the DHCP
-	 * server.
-	 */
-	if (client->state == DHCP_STATE_RENEWING)
-		return dhcp_client_send_unicast(client, request, len);
+	client->tx_message = l_steal_ptr(request);
+	client->tx_len = len;
 
-	return client->transport->l2_send(client->transport,
-					INADDR_ANY, DHCP_PORT_CLIENT,
-					INADDR_BROADCAST, DHCP_PORT_SERVER,
-					NULL, request, len);
+	return dhcp_client_send_message(client);
 }
 
 static void dhcp_client_send_release(struct l_dhcp_client *client)
@@ -507,7 +571,129 @@ static void dhcp_client_send_release(struct l_dhcp_client *client)
 	dhcp_client_send_unicast(client, request, len);
 }
 
-static void dhcp_client_timeout_resend(struct l_timeout *timeout,
+static int dhcp_client_start_discover(struct l_dhcp_client *client)
+{
+	int err;
+
+	CLIENT_ENTER_STATE(DHCP_STATE_SELECTING);
+	client->attempt = 1;
+
+	err = dhcp_client_send_discover(client);
+	if (err < 0)
+		return err;
+
+	_retransmit_schedule_ms(client->resend, dhcp_fuzz_msecs(600));
+	dhcp_client_trace(client, DHCP_MESSAGE_TYPE_DISCOVER);
+
+	return 0;
+}
+
+/* Gives up on the remembered address and starts over from DISCOVER */
+static void dhcp_client_restart_discover(struct l_dhcp_client *client)
+{
+	int err;
+
+	_retransmit_cancel(client->resend);
+
+	if (client->acd) {
+		l_acd_destroy(client->acd);
+		client->acd = NULL;
+	}
+
+	_dhcp_lease_free(client->lease);
+	client->lease = NULL;
+
+	err = dhcp_client_start_discover(client);
+	if (err < 0) {
+		CLIENT_WARN("Sending discover failed: %s", strerror(-err));
+		l_dhcp_client_stop(client);
+	}
+}
+
+static void dhcp_client_reboot_acd_event(enum l_acd_event event,
+							void *user_data)
+{
+	struct l_dhcp_client *client = user_data;
+
+	if (event != L_ACD_EVENT_CONFLICT)
+		return;
+
+	/* Once bound, conflicts are handled the same as without probing */
+	if (client->state != DHCP_STATE_REBOOTING)
+		return;
+
+	CLIENT_INFO("Remembered address is in use, starting over");
+	dhcp_client_restart_discover(client);
+}
+
+/*
+ * Probes for the remembered address while the INIT-REBOOT request is out.
+ * The same ACD instance then defends the address once the lease is bound.
+ */
+static void dhcp_client_start_reboot_acd(struct l_dhcp_client *client)
+{
+	char buf[INET_ADDRSTRLEN];
+	struct in_addr ia;
+
+	client->acd = l_acd_new(client->ifindex);
+
+	if (client->debug_handler && client->debug_level == L_LOG_DEBUG)
+		l_acd_set_debug(client->acd, client->debug_handler,
+				client->debug_data, NULL);
+
+	l_acd_set_defend_policy(client->acd, L_ACD_DEFEND_POLICY_INFINITE);
+	l_acd_set_event_handler(client->acd, dhcp_client_reboot_acd_event,
+				client, NULL);
+
+	ia.s_addr = client->lease->address;
+	inet_ntop(AF_INET, &ia, buf, INET_ADDRSTRLEN);
+
+	if (!l_acd_start(client->acd, buf)) {
+		CLIENT_WARN("Failed to start ACD on %s, continuing", buf);
+		l_acd_destroy(client->acd);
+		client->acd = NULL;
+	}
+}
+
+static int dhcp_client_start_reboot(struct l_dhcp_client *client)
+{
+	int err;
+
+	CLIENT_ENTER_STATE(DHCP_STATE_REBOOTING);
+	client->attempt = 1;
+	client->lease = l_steal_ptr(client->reboot_lease);
+
+	err = dhcp_client_send_request(client);
+	if (err < 0) {
+		_dhcp_lease_free(client->lease);
+		client->lease = NULL;
+		return err;
+	}
+
+	_retransmit_schedule_ms(client->resend, dhcp_fuzz_msecs(600));
+	dhcp_client_trace(client, DHCP_MESSAGE_TYPE_REQUEST);
+
+	if (client->reboot_acd)
+		dhcp_client_start_reboot_acd(client);
+
+	return 0;
+}
+
+static bool dhcp_client_reboot_lease_valid(struct l_dhcp_client *client)
+{
+	const struct l_dhcp_lease *lease = client->reboot_lease;
+
+	if (!lease)
+		return false;
+
+	if (lease->lifetime == 0xffffffffu)
+		return true;
+
+	return l_time_diff(l_time_now(), lease->bound_time) <
+				lease->lifetime * L_USEC_PER_SEC;
+}
+
+static void dhcp_client_timeout_resend(struct retransmit *rt,
 								void *user_data)
 {
 	struct l_dhcp_client *client = user_data;
@@ -527,6 +713,15 @@ static void dhcp_client_timeout_resend(struct l_timeout *timeout,
 		}
 
 		break;
+	case DHCP_STATE_REBOOTING:
+		/* The server might not know us, go look for another one */
+		if (client->attempt >= CLIENT_REBOOT_ATTEMPT_LIMIT) {
+			CLIENT_INFO("No reply to INIT-REBOOT request");
+			dhcp_client_restart_discover(client);
+			return;
+		}
+
+		/* Fall through */
 	case DHCP_STATE_RENEWING:
 	case DHCP_STATE_REQUESTING:
 	case DHCP_STATE_REBINDING:
@@ -540,7 +735,6 @@ static void dhcp_client_timeout_resend(struct l_timeout *timeout,
 		break;
 	case DHCP_STATE_INIT:
 	case DHCP_STATE_INIT_REBOOT:
-	case DHCP_STATE_REBOOTING:
 	case DHCP_STATE_BOUND:
 		break;
 	}
@@ -571,15 +765,17 @@ static void dhcp_client_timeout_resend(struct l_timeout *timeout,
 		dhcp_client_event_notify(client,
 				L_DHCP_CLIENT_EVENT_MAX_ATTEMPTS_REACHED);
 		return;
+	case DHCP_STATE_REBOOTING:
+		next_timeout = 2 << client->attempt++;
+		break;
 	case DHCP_STATE_INIT:
 	case DHCP_STATE_INIT_REBOOT:
-	case DHCP_STATE_REBOOTING:
 	case DHCP_STATE_BOUND:
 		break;
 	}
 
 	if (next_timeout)
-		l_timeout_modify_ms(timeout, dhcp_fuzz_secs(next_timeout));
+		_retransmit_schedule_ms(rt, dhcp_fuzz_secs(next_timeout));
 
 	return;
 
@@ -643,10 +839,7 @@ static void dhcp_client_t1_expired(struct l_timeout *timeout, void *user_data)
 
 	next_timeout = dhcp_rebind_renew_retry_time(client->lease->bound_time,
 							client->lease->t2);
-	client->timeout_resend =
-		l_timeout_create_ms(dhcp_fuzz_secs(next_timeout),
-					dhcp_client_timeout_resend,
-					client, NULL);
+	_retransmit_schedule_ms(client->resend, dhcp_fuzz_secs(next_timeout));
 	return;
 
 error:
@@ -805,6 +998,7 @@ static bool dhcp_client_handle_offer(struct l_dhcp_client *client,
 
 	CLIENT_ENTER_STATE(DHCP_STATE_REQUESTING);
 	client->attempt = 1;
+	dhcp_client_trace(client, DHCP_MESSAGE_TYPE_OFFER);
 
 	if (dhcp_client_send_request(client) < 0) {
 		l_dhcp_client_stop(client);
@@ -812,7 +1006,7 @@ static bool dhcp_client_handle_offer(struct l_dhcp_client *client,
 		return false;
 	}
 
-	l_timeout_modify_ms(client->timeout_resend, dhcp_fuzz_secs(4));
+	_retransmit_schedule_ms(client->resend, dhcp_fuzz_secs(4));
 
 	return true;
 }
@@ -821,6 +1015,7 @@ static void dhcp_client_rx_message(const void *data, size_t len, void *userdata,
 					const uint8_t *saddr,
 					uint64_t timestamp)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_DHCP);
 	struct l_dhcp_client *client = userdata;
 	const struct dhcp_message *message = data;
 	struct dhcp_message_iter iter;
@@ -887,6 +1082,21 @@ static void dhcp_client_rx_message(const void *data, size_t len, void *userdata,
 		}
 
 		event = L_DHCP_CLIENT_EVENT_NO_LEASE;
+		/* Fall through */
+	case DHCP_STATE_REBOOTING:
+		/*
+		 * RFC 2131, Section 3.2:
+		 * "If the client receives a DHCPNAK message, it cannot reuse
+		 * its remembered network address.  It must instead request a
+		 * new address by restarting the configuration process"
+		 */
+		if (client->state == DHCP_STATE_REBOOTING &&
+				msg_type == DHCP_MESSAGE_TYPE_NAK) {
+			CLIENT_INFO("Cached lease refused, starting over");
+			dhcp_client_restart_discover(client);
+			return;
+		}
+
 		/* Fall through */
 	case DHCP_STATE_RENEWING:
 	case DHCP_STATE_REBINDING:
@@ -908,9 +1118,9 @@ static void dhcp_client_rx_message(const void *data, size_t len, void *userdata,
 			return;
 
 		CLIENT_ENTER_STATE(DHCP_STATE_BOUND);
-		l_timeout_remove(client->timeout_resend);
-		client->timeout_resend = NULL;
+		_retransmit_cancel(client->resend);
 		client->lease->bound_time = timestamp;
+		dhcp_client_trace(client, DHCP_MESSAGE_TYPE_ACK);
 
 		if (client->transport->bind) {
 			e = client->transport->bind(client->transport,
@@ -984,7 +1194,6 @@ static void dhcp_client_rx_message(const void *data, size_t len, void *userdata,
 
 		break;
 	case DHCP_STATE_INIT_REBOOT:
-	case DHCP_STATE_REBOOTING:
 	case DHCP_STATE_BOUND:
 		break;
 	}
@@ -992,6 +1201,7 @@ static void dhcp_client_rx_message(const void *data, size_t len, void *userdata,
 
 LIB_EXPORT struct l_dhcp_client *l_dhcp_client_new(uint32_t ifindex)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_DHCP);
 	struct l_dhcp_client *client;
 
 	client = l_new(struct l_dhcp_client, 1);
@@ -999,6 +1209,7 @@ LIB_EXPORT struct l_dhcp_client *l_dhcp_client_new(uint32_t ifindex)
 	client->state = DHCP_STATE_INIT;
 	client->ifindex = ifindex;
 	client->max_attempts = CLIENT_MAX_ATTEMPT_LIMIT;
+	client->resend = _retransmit_new(dhcp_client_timeout_resend, client);
 
 	/* Enable these options by default */
 	dhcp_enable_option(client, L_DHCP_OPTION_SUBNET_MASK);
@@ -1023,6 +1234,9 @@ LIB_EXPORT void l_dhcp_client_destroy(struct l_dhcp_client *client)
 		client->event_destroy(client->event_data);
 
 	_dhcp_transport_free(client->transport);
+	_retransmit_free(client->resend);
+	dhcp_client_drop_message(client);
+	_dhcp_lease_free(client->reboot_lease);
 	l_free(client->ifname);
 	l_free(client->hostname);
 
@@ -1146,6 +1360,14 @@ void _dhcp_client_override_xid(struct l_dhcp_client *client, uint32_t xid)
 	client->xid = xid;
 }
 
+void _dhcp_client_set_trace(struct l_dhcp_client *client,
+				dhcp_client_trace_func_t func,
+				void *user_data)
+{
+	client->trace_func = func;
+	client->trace_data = user_data;
+}
+
 LIB_EXPORT const struct l_dhcp_lease *l_dhcp_client_get_lease(
 					const struct l_dhcp_client *client)
 {
@@ -1155,8 +1377,58 @@ LIB_EXPORT const struct l_dhcp_lease *l_dhcp_client_get_lease(
 	return client->lease;
 }
 
+/**
+ * l_dhcp_client_set_lease:
+ * @client: DHCP client
+ * @lease: Lease remembered from an earlier run, or NULL to forget it
+ *
+ * Makes the next l_dhcp_client_start request the address of @lease
+ * directly, as in the INIT-REBOOT state of RFC 2131, instead of starting
+ * with a DISCOVER.  If the server refuses the address or does not reply,
+ * the client falls back to a DISCOVER on its own.  An expired @lease is
+ * ignored.  The lease is copied and is only used for a single start.
+ *
+ * Returns: #true on success, #false if the client is already running.
+ **/
+LIB_EXPORT bool l_dhcp_client_set_lease(struct l_dhcp_client *client,
+					const struct l_dhcp_lease *lease)
+{
+	if (unlikely(!client))
+		return false;
+
+	if (unlikely(client->state != DHCP_STATE_INIT))
+		return false;
+
+	if (lease && !lease->address)
+		return false;
+
+	_dhcp_lease_free(client->reboot_lease);
+	client->reboot_lease = lease ? _dhcp_lease_copy(lease) : NULL;
+
+	return true;
+}
+
+/*
+ * Probe for conflicts on the remembered address while the INIT-REBOOT
+ * request is in flight, and start over with a DISCOVER if one is found.
+ */
+LIB_EXPORT bool l_dhcp_client_set_reboot_acd(struct l_dhcp_client *client,
+							bool enable)
+{
+	if (unlikely(!client))
+		return false;
+
+	if (unlikely(client->state != DHCP_STATE_INIT))
+		return false;
+
+	client->reboot_acd = enable;
+
+	return true;
+}
+
 LIB_EXPORT bool l_dhcp_client_start(struct l_dhcp_client *client)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_DHCP);
 	int err;
 
 	if (unlikely(!client))
@@ -1192,7 +1464,7 @@ LIB_EXPORT bool l_dhcp_client_start(struct l_dhcp_client *client)
 	}
 
 	if (!client->override_xid)
-		l_getrandom(&client->xid, sizeof(client->xid));
+		l_getrandom_buffered(&client->xid, sizeof(client->xid));
 
 	if (client->transport->open)
 		if (client->transport->open(client->transport,
@@ -1205,15 +1477,18 @@ LIB_EXPORT bool l_dhcp_client_start(struct l_dhcp_client *client)
 
 	client->start_t = l_time_now();
 
-	err = dhcp_client_send_discover(client);
-	if (err < 0)
-		return false;
+	if (dhcp_client_reboot_lease_valid(client))
+		err = dhcp_client_start_reboot(client);
+	else
+		err = dhcp_client_start_discover(client);
 
-	client->timeout_resend = l_timeout_create_ms(dhcp_fuzz_msecs(600),
-						dhcp_client_timeout_resend,
-						client, NULL);
-	CLIENT_ENTER_STATE(DHCP_STATE_SELECTING);
-	client->attempt = 1;
+	_dhcp_lease_free(client->reboot_lease);
+	client->reboot_lease = NULL;
+
+	if (err < 0) {
+		CLIENT_ENTER_STATE(DHCP_STATE_INIT);
+		return false;
+	}
 
 	return true;
 }
@@ -1247,8 +1522,7 @@ LIB_EXPORT bool l_dhcp_client_stop(struct l_dhcp_client *client)
 		client->rtnl_configured_address = NULL;
 	}
 
-	l_timeout_remove(client->timeout_resend);
-	client->timeout_resend = NULL;
+	_retransmit_cancel(client->resend);
 
 	l_timeout_remove(client->timeout_lease);
 	client->timeout_lease = NULL;
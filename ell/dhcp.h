@@ -18,6 +18,7 @@ struct l_dhcp_client;
 struct l_dhcp_lease;
 struct l_netlink;
 struct l_dhcp_server;
+struct l_settings;
 
 /* RFC 2132 */
 enum l_dhcp_option {
@@ -79,6 +80,9 @@ bool l_dhcp_client_set_max_attempts(struct l_dhcp_client *client,
 
 const struct l_dhcp_lease *l_dhcp_client_get_lease(
 					const struct l_dhcp_client *client);
+bool l_dhcp_client_set_lease(struct l_dhcp_client *client,
+					const struct l_dhcp_lease *lease);
+bool l_dhcp_client_set_reboot_acd(struct l_dhcp_client *client, bool enable);
 
 bool l_dhcp_client_start(struct l_dhcp_client *client);
 bool l_dhcp_client_stop(struct l_dhcp_client *client);
@@ -106,6 +110,8 @@ char *l_dhcp_lease_get_server_id(const struct l_dhcp_lease *lease);
 const uint8_t *l_dhcp_lease_get_server_mac(const struct l_dhcp_lease *lease);
 char **l_dhcp_lease_get_dns(const struct l_dhcp_lease *lease);
 char *l_dhcp_lease_get_domain_name(const struct l_dhcp_lease *lease);
+const uint32_t *l_dhcp_lease_get_dns_u32(const struct l_dhcp_lease *lease);
+const char *l_dhcp_lease_peek_domain_name(const struct l_dhcp_lease *lease);
 const uint8_t *l_dhcp_lease_get_mac(const struct l_dhcp_lease *lease);
 
 uint32_t l_dhcp_lease_get_t1(const struct l_dhcp_lease *lease);
@@ -113,6 +119,12 @@ uint32_t l_dhcp_lease_get_t2(const struct l_dhcp_lease *lease);
 uint32_t l_dhcp_lease_get_lifetime(const struct l_dhcp_lease *lease);
 uint64_t l_dhcp_lease_get_start_time(const struct l_dhcp_lease *lease);
 
+bool l_dhcp_lease_save(const struct l_dhcp_lease *lease,
+			struct l_settings *settings, const char *group);
+struct l_dhcp_lease *l_dhcp_lease_load(const struct l_settings *settings,
+					const char *group);
+void l_dhcp_lease_free(struct l_dhcp_lease *lease);
+
 struct l_dhcp_server *l_dhcp_server_new(int ifindex);
 void l_dhcp_server_destroy(struct l_dhcp_server *server);
 bool l_dhcp_server_start(struct l_dhcp_server *server);
@@ -127,6 +139,8 @@ bool l_dhcp_server_set_event_handler(struct l_dhcp_server *server,
 					l_dhcp_server_event_cb_t handler,
 					void *user_data,
 					l_dhcp_destroy_cb_t destroy);
+bool l_dhcp_server_set_lease_file(struct l_dhcp_server *server,
+					const char *path);
 bool l_dhcp_server_set_lease_time(struct l_dhcp_server *server,
 					unsigned int lease_time);
 bool l_dhcp_server_set_interface_name(struct l_dhcp_server *server,
@@ -136,8 +150,15 @@ bool l_dhcp_server_set_ip_address(struct l_dhcp_server *server,
 bool l_dhcp_server_set_netmask(struct l_dhcp_server *server, const char *mask);
 bool l_dhcp_server_set_gateway(struct l_dhcp_server *server, const char *ip);
 bool l_dhcp_server_set_dns(struct l_dhcp_server *server, char **dns);
+bool l_dhcp_server_add_relay_subnet(struct l_dhcp_server *server,
+					const char *subnet,
+					const char *start_ip,
+					const char *end_ip,
+					const char *gateway);
 void l_dhcp_server_set_authoritative(struct l_dhcp_server *server,
 					bool authoritative);
+bool l_dhcp_server_set_shared_socket(struct l_dhcp_server *server,
+					bool enable);
 void l_dhcp_server_set_enable_rapid_commit(struct l_dhcp_server *server,
 						bool enable);
 
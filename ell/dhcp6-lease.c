@@ -44,8 +44,12 @@ void _dhcp6_lease_free(struct l_dhcp6_lease *lease)
 	if (!lease)
 		return;
 
-	l_free(lease->server_id);
-	l_free(lease->dns);
+	/* Parsed leases carry these in the same allocation */
+	if (!lease->packed) {
+		l_free(lease->server_id);
+		l_free(lease->dns);
+	}
+
 	l_strfreev(lease->domain_list);
 
 	l_free(lease);
@@ -246,11 +250,20 @@ static int parse_ia(const void *ia, uint16_t ia_len, uint16_t tag,
 	return 0;
 }
 
+/*
+ * The server ID and DNS server options are only located while walking the
+ * options and copied after the lease at the end, in a single allocation.
+ */
 struct l_dhcp6_lease *_dhcp6_lease_parse_options(
 					struct dhcp6_option_iter *iter,
 					const uint8_t expected_iaid[static 4])
 {
-	struct l_dhcp6_lease *lease = _dhcp6_lease_new();
+	struct l_dhcp6_lease fixed = {};
+	struct l_dhcp6_lease *lease;
+	const void *server_id = NULL;
+	const void *dns = NULL;
+	uint16_t server_id_len = 0;
+	uint16_t dns_len = 0;
 	uint16_t t;
 	uint16_t l;
 	const void *v;
@@ -258,57 +271,74 @@ struct l_dhcp6_lease *_dhcp6_lease_parse_options(
 	while (_dhcp6_option_iter_next(iter, &t, &l, &v)) {
 		switch (t) {
 		case DHCP6_OPTION_SERVER_ID:
-			lease->server_id = l_memdup(v, l);
-			lease->server_id_len = l;
+			server_id = v;
+			server_id_len = l;
 			break;
 		case DHCP6_OPTION_PREFERENCE:
 			if (l != 1)
 				goto error;
 
-			lease->preference = l_get_u8(v);
+			fixed.preference = l_get_u8(v);
 			break;
 		case DHCP6_OPTION_IA_NA:
-			if (lease->have_na ||
+			if (fixed.have_na ||
 					parse_ia(v, l, t, expected_iaid,
-							&lease->ia_na) < 0)
+							&fixed.ia_na) < 0)
 				continue;
 
-			lease->have_na = true;
+			fixed.have_na = true;
 			break;
 		case DHCP6_OPTION_IA_PD:
-			if (lease->have_pd ||
+			if (fixed.have_pd ||
 					parse_ia(v, l, t, expected_iaid,
-							&lease->ia_pd) < 0)
+							&fixed.ia_pd) < 0)
 				continue;
 
-			lease->have_pd = true;
+			fixed.have_pd = true;
 			break;
 		case L_DHCP6_OPTION_DNS_SERVERS:
 			if (!l || l % sizeof(struct in6_addr))
 				goto error;
 
-			lease->dns = l_memdup(v, l);
-			lease->dns_len = l;
+			dns = v;
+			dns_len = l;
 			break;
 		case DHCP6_OPTION_RAPID_COMMIT:
 			if (l != 0)
 				goto error;
 
-			lease->rapid_commit = true;
+			fixed.rapid_commit = true;
 			break;
 		case L_DHCP6_OPTION_DOMAIN_LIST:
-			lease->domain_list = net_domain_list_parse(v, l, false);
-			if (!lease->domain_list)
+			l_strfreev(fixed.domain_list);
+			fixed.domain_list = net_domain_list_parse(v, l, false);
+			if (!fixed.domain_list)
 				goto error;
 
 			break;
 		}
 	}
 
+	lease = l_malloc(sizeof(fixed) + server_id_len + dns_len);
+	memcpy(lease, &fixed, sizeof(fixed));
+	lease->packed = true;
+
+	if (server_id) {
+		lease->server_id = (uint8_t *) (lease + 1);
+		lease->server_id_len = server_id_len;
+		memcpy(lease->server_id, server_id, server_id_len);
+	}
+
+	if (dns) {
+		lease->dns = (uint8_t *) (lease + 1) + server_id_len;
+		lease->dns_len = dns_len;
+		memcpy(lease->dns, dns, dns_len);
+	}
+
 	return lease;
 
 error:
-	_dhcp6_lease_free(lease);
+	l_strfreev(fixed.domain_list);
 	return NULL;
 }
 
@@ -323,6 +353,30 @@ LIB_EXPORT char *l_dhcp6_lease_get_address(const struct l_dhcp6_lease *lease)
 	return get_ip(lease->ia_na.info.addr);
 }
 
+LIB_EXPORT char *l_dhcp6_lease_get_delegated_prefix(
+					const struct l_dhcp6_lease *lease)
+{
+	if (unlikely(!lease))
+		return NULL;
+
+	if (!lease->have_pd)
+		return NULL;
+
+	return get_ip(lease->ia_pd.info.addr);
+}
+
+LIB_EXPORT uint8_t l_dhcp6_lease_get_delegated_prefix_length(
+					const struct l_dhcp6_lease *lease)
+{
+	if (unlikely(!lease))
+		return 0;
+
+	if (!lease->have_pd)
+		return 0;
+
+	return lease->ia_pd.info.prefix_len;
+}
+
 LIB_EXPORT char **l_dhcp6_lease_get_dns(const struct l_dhcp6_lease *lease)
 {
 	if (unlikely(!lease))
@@ -342,6 +396,32 @@ LIB_EXPORT char **l_dhcp6_lease_get_domains(const struct l_dhcp6_lease *lease)
 	return l_strv_copy(lease->domain_list);
 }
 
+/*
+ * Borrowed views of the DNS servers, as an array of 16 byte addresses, and
+ * of the domain list.  These stay valid for as long as @lease does.
+ */
+LIB_EXPORT const uint8_t *l_dhcp6_lease_peek_dns(
+					const struct l_dhcp6_lease *lease,
+					unsigned int *out_count)
+{
+	if (unlikely(!lease))
+		return NULL;
+
+	if (out_count)
+		*out_count = lease->dns_len / 16;
+
+	return lease->dns;
+}
+
+LIB_EXPORT const char *const *l_dhcp6_lease_peek_domains(
+					const struct l_dhcp6_lease *lease)
+{
+	if (unlikely(!lease))
+		return NULL;
+
+	return (const char *const *) lease->domain_list;
+}
+
 LIB_EXPORT uint8_t l_dhcp6_lease_get_prefix_length(
 					const struct l_dhcp6_lease *lease)
 {
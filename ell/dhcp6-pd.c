@@ -0,0 +1,187 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "private.h"
+#include "useful.h"
+#include "uintset.h"
+#include "dhcp6.h"
+
+/*
+ * Carves a delegated prefix into equally sized sub-prefixes, e.g. /64s for
+ * downstream links out of a /56.  Sub-prefix N is the delegated prefix with
+ * N in the bits between the two prefix lengths, the used ones are tracked
+ * in a bitmap.  Allocations always return the lowest free sub-prefix, the
+ * search starts at a hint below which everything is known to be in use so
+ * that allocating in sequence does not rescan the bitmap.
+ */
+#define PREFIX_POOL_MAX_BITS	20
+
+struct l_dhcp6_prefix_pool {
+	uint8_t prefix[16];
+	uint8_t prefix_len;
+	uint8_t sub_prefix_len;
+	uint32_t size;
+	uint32_t first_free;
+	struct l_uintset *used;
+};
+
+static void prefix_pool_get(const struct l_dhcp6_prefix_pool *pool,
+				uint32_t index, uint8_t out[static 16])
+{
+	uint64_t hi = l_get_be64(pool->prefix);
+	uint64_t lo = l_get_be64(pool->prefix + 8);
+	unsigned int shift = 128 - pool->sub_prefix_len;
+
+	if (shift >= 64)
+		hi |= (uint64_t) index << (shift - 64);
+	else {
+		lo |= (uint64_t) index << shift;
+
+		if (shift)
+			hi |= (uint64_t) index >> (64 - shift);
+	}
+
+	l_put_be64(hi, out);
+	l_put_be64(lo, out + 8);
+}
+
+static char *prefix_to_string(const uint8_t prefix[static 16])
+{
+	char buf[INET6_ADDRSTRLEN];
+
+	if (!inet_ntop(AF_INET6, prefix, buf, sizeof(buf)))
+		return NULL;
+
+	return l_strdup(buf);
+}
+
+/*
+ * Pool of the sub-prefixes of length @sub_prefix_len of @prefix, which
+ * would usually come from l_dhcp6_lease_get_delegated_prefix().  At most
+ * 2^PREFIX_POOL_MAX_BITS sub-prefixes are supported.
+ */
+LIB_EXPORT struct l_dhcp6_prefix_pool *l_dhcp6_prefix_pool_new(
+						const char *prefix,
+						uint8_t prefix_len,
+						uint8_t sub_prefix_len)
+{
+	struct l_dhcp6_prefix_pool *pool;
+	struct in6_addr addr;
+	unsigned int i;
+
+	if (unlikely(!prefix))
+		return NULL;
+
+	if (sub_prefix_len > 128 || prefix_len >= sub_prefix_len ||
+			sub_prefix_len - prefix_len > PREFIX_POOL_MAX_BITS)
+		return NULL;
+
+	if (inet_pton(AF_INET6, prefix, &addr) != 1)
+		return NULL;
+
+	pool = l_new(struct l_dhcp6_prefix_pool, 1);
+
+	/* Clear the host bits */
+	for (i = 0; i < 16; i++) {
+		if (prefix_len >= (i + 1) * 8)
+			pool->prefix[i] = addr.s6_addr[i];
+		else if (prefix_len > i * 8)
+			pool->prefix[i] = addr.s6_addr[i] &
+					(0xff << ((i + 1) * 8 - prefix_len));
+	}
+
+	pool->prefix_len = prefix_len;
+	pool->sub_prefix_len = sub_prefix_len;
+	pool->size = 1U << (sub_prefix_len - prefix_len);
+	pool->used = l_uintset_new_from_range(0, pool->size - 1);
+
+	return pool;
+}
+
+LIB_EXPORT void l_dhcp6_prefix_pool_free(struct l_dhcp6_prefix_pool *pool)
+{
+	if (unlikely(!pool))
+		return;
+
+	l_uintset_free(pool->used);
+	l_free(pool);
+}
+
+/* Returns the lowest free sub-prefix or NULL if the pool is exhausted */
+LIB_EXPORT char *l_dhcp6_prefix_pool_alloc(struct l_dhcp6_prefix_pool *pool)
+{
+	uint8_t out[16];
+	uint32_t index;
+
+	if (unlikely(!pool))
+		return NULL;
+
+	if (pool->first_free >= pool->size)
+		return NULL;
+
+	index = l_uintset_find_unused(pool->used, pool->first_free);
+	if (index >= pool->size)
+		return NULL;
+
+	l_uintset_put(pool->used, index);
+	pool->first_free = index + 1;
+
+	prefix_pool_get(pool, index, out);
+	return prefix_to_string(out);
+}
+
+LIB_EXPORT bool l_dhcp6_prefix_pool_release(struct l_dhcp6_prefix_pool *pool,
+						const char *prefix)
+{
+	struct in6_addr addr;
+	uint8_t expected[16];
+	unsigned int shift;
+	uint64_t hi;
+	uint64_t lo;
+	uint32_t index;
+
+	if (unlikely(!pool || !prefix))
+		return false;
+
+	if (inet_pton(AF_INET6, prefix, &addr) != 1)
+		return false;
+
+	hi = l_get_be64(addr.s6_addr);
+	lo = l_get_be64(addr.s6_addr + 8);
+	shift = 128 - pool->sub_prefix_len;
+
+	if (shift >= 64)
+		index = hi >> (shift - 64);
+	else if (shift)
+		index = (lo >> shift) | (hi << (64 - shift));
+	else
+		index = lo;
+
+	index &= pool->size - 1;
+
+	/* Rejects prefixes outside of the pool or with host bits set */
+	prefix_pool_get(pool, index, expected);
+	if (memcmp(expected, addr.s6_addr, 16))
+		return false;
+
+	if (!l_uintset_contains(pool->used, index))
+		return false;
+
+	l_uintset_take(pool->used, index);
+
+	if (index < pool->first_free)
+		pool->first_free = index;
+
+	return true;
+}
@@ -12,6 +12,22 @@ enum {
 	DHCP6_PORT_CLIENT = 546,
 };
 
+enum dhcp6_message_type {
+	DHCP6_MESSAGE_TYPE_SOLICIT = 1,
+	DHCP6_MESSAGE_TYPE_ADVERTISE = 2,
+	DHCP6_MESSAGE_TYPE_REQUEST = 3,
+	DHCP6_MESSAGE_TYPE_CONFIRM = 4,
+	DHCP6_MESSAGE_TYPE_RENEW = 5,
+	DHCP6_MESSAGE_TYPE_REBIND = 6,
+	DHCP6_MESSAGE_TYPE_REPLY = 7,
+	DHCP6_MESSAGE_TYPE_RELEASE = 8,
+	DHCP6_MESSAGE_TYPE_DECLINE = 9,
+	DHCP6_MESSAGE_TYPE_RECONFIGURE = 10,
+	DHCP6_MESSAGE_TYPE_INFORMATION_REQUEST = 11,
+	DHCP6_MESSAGE_TYPE_RELAY_FORW = 12,
+	DHCP6_MESSAGE_TYPE_RELAY_REPL = 13,
+};
+
 enum {
 	DHCP6_OPTION_CLIENT_ID			= 1,
 	DHCP6_OPTION_SERVER_ID			= 2,
@@ -126,6 +142,8 @@ struct l_dhcp6_lease {
 	bool have_na : 1;
 	bool have_pd : 1;
 	bool rapid_commit : 1;
+	/* server_id and dns share the lease allocation */
+	bool packed : 1;
 };
 
 struct l_dhcp6_lease *_dhcp6_lease_new(void);
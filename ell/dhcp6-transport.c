@@ -18,66 +18,33 @@
 #include <netinet/udp.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
+#include <linux/filter.h>
 #include <unistd.h>
 #include <errno.h>
-#include <sys/time.h>
 
 #include "private.h"
 #include "missing.h"
-#include "io.h"
-#include "time.h"
-#include "time-private.h"
+#include "dgram.h"
 #include "dhcp6-private.h"
 
 struct dhcp6_default_transport {
 	struct dhcp6_transport super;
-	struct l_io *io;
+	struct l_dgram *dgram;
 	uint16_t port;
 	struct in6_addr local;
 };
 
-static bool _dhcp6_default_transport_read_handler(struct l_io *io,
-							void *userdata)
+static void _dhcp6_default_transport_recv(struct l_dgram *dgram,
+						const struct l_dgram_msg *msg,
+						void *userdata)
 {
 	struct dhcp6_default_transport *transport = userdata;
-	int fd = l_io_get_fd(io);
-	char buf[2048];
-	ssize_t len;
-	uint64_t timestamp = 0;
-	struct cmsghdr *cmsg;
-	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
-	struct msghdr msg = {};
-	unsigned char control[32 + CMSG_SPACE(sizeof(struct timeval))];
-
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-	msg.msg_control = control;
-	msg.msg_controllen = sizeof(control);
-
-	len = recvmsg(fd, &msg, 0);
-	if (len < 0)
-		return false;
 
 	if (!transport->super.rx_cb)
-		return true;
-
-	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
-					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-		if (cmsg->cmsg_level == SOL_SOCKET &&
-				cmsg->cmsg_type == SCM_TIMESTAMP &&
-				cmsg->cmsg_len ==
-				CMSG_LEN(sizeof(struct timeval))) {
-			const struct timeval *tv = (void *) CMSG_DATA(cmsg);
-
-			timestamp = _time_realtime_to_boottime(tv);
-		}
-	}
-
-	if (!timestamp)
-		timestamp = l_time_now();
+		return;
 
-	transport->super.rx_cb(&buf, len, timestamp, transport->super.rx_data);
-	return true;
+	transport->super.rx_cb(msg->data, msg->len, msg->timestamp,
+				transport->super.rx_data);
 }
 
 static int _dhcp6_default_transport_send(struct dhcp6_transport *s,
@@ -94,11 +61,15 @@ static int _dhcp6_default_transport_send(struct dhcp6_transport *s,
 	addr.sin6_port = L_CPU_TO_BE16(DHCP6_PORT_SERVER);
 	memcpy(&addr.sin6_addr, dest, sizeof(addr.sin6_addr));
 
-	err = sendto(l_io_get_fd(transport->io), data, len, 0,
-				(struct sockaddr *) &addr, sizeof(addr));
-
+	err = l_dgram_send(transport->dgram, (struct sockaddr *) &addr,
+				sizeof(addr), data, len);
 	if (err < 0)
-		return -errno;
+		return err;
+
+	/* Send right away so that errors are still reported to the caller */
+	err = l_dgram_flush(transport->dgram);
+	if (err < 0 && err != -EAGAIN)
+		return err;
 
 	return 0;
 }
@@ -111,12 +82,50 @@ static int kernel_raw_socket_open(uint32_t ifindex,
 	static int no = 0;
 	int s;
 	struct sockaddr_in6 addr;
+	/* The socket filter sees the packet from the UDP header on */
+	struct sock_filter filter[] = {
+		/* A <- packet length */
+		BPF_STMT(BPF_LD + BPF_W + BPF_LEN, 0),
+		/* A >= sizeof(udphdr) + msg_type and transaction_id ? */
+		BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, sizeof(struct udphdr) +
+				sizeof(struct dhcp6_message), 1, 0),
+		/* ignore */
+		BPF_STMT(BPF_RET + BPF_K, 0),
+		/* A <- UDP source port */
+		BPF_STMT(BPF_LD + BPF_H + BPF_ABS,
+				offsetof(struct udphdr, source)),
+		/* A == server port ? */
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, DHCP6_PORT_SERVER, 1, 0),
+		/* ignore */
+		BPF_STMT(BPF_RET + BPF_K, 0),
+		/* A <- DHCPv6 message type */
+		BPF_STMT(BPF_LD + BPF_B + BPF_ABS, sizeof(struct udphdr)),
+		/* A == Advertise, Reply or Reconfigure ? */
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,
+				DHCP6_MESSAGE_TYPE_ADVERTISE, 3, 0),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,
+				DHCP6_MESSAGE_TYPE_REPLY, 2, 0),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,
+				DHCP6_MESSAGE_TYPE_RECONFIGURE, 1, 0),
+		/* ignore */
+		BPF_STMT(BPF_RET + BPF_K, 0),
+		/* return all */
+		BPF_STMT(BPF_RET + BPF_K, 65535),
+	};
+	const struct sock_fprog fprog = {
+		.len = L_ARRAY_SIZE(filter),
+		.filter = filter
+	};
 
 	s = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
 								IPPROTO_UDP);
 	if (s < 0)
 		return -errno;
 
+	if (setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER,
+						&fprog, sizeof(fprog)) < 0)
+		goto error;
+
 	if (setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &yes, sizeof(yes)) < 0)
 		goto error;
 
@@ -178,7 +187,7 @@ static int _dhcp6_default_transport_open(struct dhcp6_transport *s)
 		l_container_of(s, struct dhcp6_default_transport, super);
 	int fd;
 
-	if (transport->io)
+	if (transport->dgram)
 		return -EALREADY;
 
 	fd = kernel_raw_socket_open(s->ifindex, &transport->local,
@@ -186,15 +195,15 @@ static int _dhcp6_default_transport_open(struct dhcp6_transport *s)
 	if (fd < 0)
 		return fd;
 
-	transport->io = l_io_new(fd);
-	if (!transport->io) {
+	transport->dgram = l_dgram_new(fd, 0, 0);
+	if (!transport->dgram) {
 		close(fd);
 		return -EMFILE;
 	}
 
-	l_io_set_close_on_destroy(transport->io, true);
-	l_io_set_read_handler(transport->io,
-					_dhcp6_default_transport_read_handler,
+	l_dgram_set_close_on_free(transport->dgram, true);
+	l_dgram_set_recv_handler(transport->dgram,
+					_dhcp6_default_transport_recv,
 					transport, NULL);
 
 	return 0;
@@ -205,8 +214,8 @@ static void _dhcp6_default_transport_close(struct dhcp6_transport *s)
 	struct dhcp6_default_transport *transport =
 		l_container_of(s, struct dhcp6_default_transport, super);
 
-	l_io_destroy(transport->io);
-	transport->io = NULL;
+	l_dgram_free(transport->dgram);
+	transport->dgram = NULL;
 }
 
 void _dhcp6_transport_set_rx_callback(struct dhcp6_transport *transport,
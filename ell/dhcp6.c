@@ -20,6 +20,7 @@
 #include "random.h"
 #include "time.h"
 #include "time-private.h"
+#include "retransmit-private.h"
 #include "net.h"
 #include "timeout.h"
 #include "uintset.h"
@@ -29,6 +30,7 @@
 #include "netlink.h"
 #include "rtnl.h"
 #include "dhcp6-private.h"
+#include "memory-private.h"
 #include "dhcp6.h"
 
 #define CLIENT_DEBUG(fmt, args...)					\
@@ -54,22 +56,6 @@
 #define REL_TIMEOUT	1
 #define REL_MAX_RC	4
 
-enum dhcp6_message_type {
-	DHCP6_MESSAGE_TYPE_SOLICIT = 1,
-	DHCP6_MESSAGE_TYPE_ADVERTISE = 2,
-	DHCP6_MESSAGE_TYPE_REQUEST = 3,
-	DHCP6_MESSAGE_TYPE_CONFIRM = 4,
-	DHCP6_MESSAGE_TYPE_RENEW = 5,
-	DHCP6_MESSAGE_TYPE_REBIND = 6,
-	DHCP6_MESSAGE_TYPE_REPLY = 7,
-	DHCP6_MESSAGE_TYPE_RELEASE = 8,
-	DHCP6_MESSAGE_TYPE_DECLINE = 9,
-	DHCP6_MESSAGE_TYPE_RECONFIGURE = 10,
-	DHCP6_MESSAGE_TYPE_INFORMATION_REQUEST = 11,
-	DHCP6_MESSAGE_TYPE_RELAY_FORW = 12,
-	DHCP6_MESSAGE_TYPE_RELAY_REPL = 13,
-};
-
 static const char *message_type_to_string(uint8_t t)
 {
 	switch (t) {
@@ -296,31 +282,33 @@ static struct dhcp6_message *dhcp6_message_builder_free(
 	return ret;
 }
 
-static void option_append_elapsed_time(struct dhcp6_message_builder *builder,
-					uint64_t transaction_start_t)
+static uint16_t dhcp6_elapsed_time(uint64_t transaction_start_t)
 {
-	uint16_t elapsed_time;
 	uint64_t time_diff;
 
-	if (!transaction_start_t) {
-		/*
-		 * Field is set to 0 in the first message in the message
-		 * exchange.
-		 */
-		elapsed_time = 0;
-		goto done;
-	}
+	/* Field is set to 0 in the first message in the message exchange. */
+	if (!transaction_start_t)
+		return 0;
 
 	time_diff = l_time_now() - transaction_start_t;
 
 	if (time_diff < UINT16_MAX * L_USEC_PER_MSEC * 10)
-		elapsed_time = l_time_to_msecs(time_diff) / 10;
-	else
-		elapsed_time = UINT16_MAX;
+		return l_time_to_msecs(time_diff) / 10;
+
+	return UINT16_MAX;
+}
+
+/* Returns the offset of the value within the options */
+static uint16_t option_append_elapsed_time(
+					struct dhcp6_message_builder *builder,
+					uint64_t transaction_start_t)
+{
+	uint16_t offset = builder->options_pos + OPTION_HEADER_LEN;
 
-done:
 	option_append_uint16(builder, DHCP6_OPTION_ELAPSED_TIME,
-							elapsed_time);
+				dhcp6_elapsed_time(transaction_start_t));
+
+	return offset;
 }
 
 enum dhcp6_state {
@@ -364,6 +352,10 @@ struct l_dhcp6_client {
 	uint32_t transaction_id;
 	uint64_t transaction_start_t;
 
+	struct dhcp6_message *tx_message;
+	size_t tx_len;
+	uint16_t tx_elapsed_offset;
+
 	struct duid *duid;
 	uint16_t duid_len;
 
@@ -376,7 +368,8 @@ struct l_dhcp6_client {
 	uint64_t attempt_delay;
 	uint8_t attempt;
 
-	struct l_timeout *timeout_send;
+	struct retransmit *send;
+	struct l_timeout *timeout_ra;
 	struct l_dhcp6_lease *lease;
 	struct l_timeout *timeout_lease;
 
@@ -511,12 +504,28 @@ done:
 static void option_append_ia_pd(struct l_dhcp6_client *client,
 				struct dhcp6_message_builder *builder)
 {
+	const struct dhcp6_address_info *info;
+	void *ia_prefix;
+
 	if (option_append_ia_common(client, builder, DHCP6_OPTION_IA_PD) < 0)
 		return;
 
 	l_put_be32(0, option_reserve(builder, 4));
 	l_put_be32(0, option_reserve(builder, 4));
 
+	if (!client->lease || !client->lease->have_pd)
+		goto done;
+
+	info = &client->lease->ia_pd.info;
+	ia_prefix = option_reserve(builder, 29);
+	l_put_be16(DHCP6_OPTION_IA_PREFIX, ia_prefix);
+	l_put_be16(25, ia_prefix + 2);
+	l_put_be32(info->preferred_lifetime, ia_prefix + 4);
+	l_put_be32(info->valid_lifetime, ia_prefix + 8);
+	l_put_u8(info->prefix_len, ia_prefix + 12);
+	memcpy(ia_prefix + 13, info->addr, 16);
+
+done:
 	option_finalize(builder);
 }
 
@@ -606,22 +615,9 @@ static void set_retransmission_delay(struct l_dhcp6_client *client,
 	irt_ms = irt_sec * L_MSEC_PER_SEC;
 	mrt_ms = mrt_sec * L_MSEC_PER_SEC;
 
-	/* RFC 8415, Section 15:
-	 * RT for the first message transmission is based on IRT:
-	 * 	RT = IRT + RAND*IRT
-	 *
-	 * RT for each subsequent message transmission is based on the
-	 * previous value of RT:
-	 * 	RT = 2*RTprev + RAND*RTprev
-	 *
-	 * MRT specifies an upper bound on the value of RT (disregarding the
-	 * randomization added by the use of RAND).  If MRT has a value of 0,
-	 * there is no upper limit on the value of RT.  Otherwise:
-	 * 	if (RT > MRT)
-	 * 		RT = MRT + RAND*MRT
-	 */
+	/* RFC 8415, Section 15 */
 	if (!client->attempt_delay) {
-		client->attempt_delay = _time_fuzz_msecs(irt_ms);
+		client->attempt_delay = _retransmit_backoff_ms(0, irt_ms, mrt_ms);
 
 		/*
 		 * RFC 8415, Section 18.2.1:
@@ -631,26 +627,33 @@ static void set_retransmission_delay(struct l_dhcp6_client *client,
 		if (client->state == DHCP6_STATE_SOLICITING &&
 				client->attempt_delay < irt_ms)
 			client->attempt_delay += irt_ms / 10;
-	} else {
-		if (mrt_ms && client->attempt_delay > mrt_ms)
-			client->attempt_delay = _time_fuzz_msecs(mrt_ms);
-		else
-			client->attempt_delay +=
-					_time_fuzz_msecs(client->attempt_delay);
-	}
+	} else
+		client->attempt_delay = _retransmit_backoff_ms(
+							client->attempt_delay,
+							irt_ms, mrt_ms);
 
-	l_timeout_modify_ms(client->timeout_send, client->attempt_delay);
+	_retransmit_schedule_ms(client->send, client->attempt_delay);
 }
 
 static struct dhcp6_message *dhcp6_client_build_message(
 						struct l_dhcp6_client *client,
 						enum dhcp6_message_type type,
-						size_t *out_len)
+						size_t *out_len,
+						uint16_t *out_elapsed_offset)
 {
 	struct dhcp6_message_builder *builder;
 
 	builder = dhcp6_message_builder_new(type, client->transaction_id, 128);
 
+	if (type == DHCP6_MESSAGE_TYPE_INFORMATION_REQUEST) {
+		*out_elapsed_offset = option_append_elapsed_time(builder,
+						client->transaction_start_t);
+		option_append_option_request(builder, client->request_options,
+					DHCP6_STATE_REQUESTING_INFORMATION);
+
+		return dhcp6_message_builder_free(builder, false, out_len);
+	}
+
 	option_append_bytes(builder, DHCP6_OPTION_CLIENT_ID,
 					client->duid, client->duid_len);
 
@@ -666,7 +669,8 @@ static struct dhcp6_message *dhcp6_client_build_message(
 	option_append_option_request(builder, client->request_options,
 						client->state);
 
-	option_append_elapsed_time(builder, client->transaction_start_t);
+	*out_elapsed_offset = option_append_elapsed_time(builder,
+						client->transaction_start_t);
 
 	if (type == DHCP6_MESSAGE_TYPE_SOLICIT && !client->no_rapid_commit)
 		option_append_bytes(builder, DHCP6_OPTION_RAPID_COMMIT,
@@ -678,87 +682,35 @@ static struct dhcp6_message *dhcp6_client_build_message(
 	return dhcp6_message_builder_free(builder, false, out_len);
 }
 
-static int dhcp6_client_send_solicit(struct l_dhcp6_client *client)
-{
-	L_AUTO_FREE_VAR(struct dhcp6_message *, solicit);
-	size_t solicit_len;
-
-	CLIENT_DEBUG("");
-
-	solicit = dhcp6_client_build_message(client,
-						DHCP6_MESSAGE_TYPE_SOLICIT,
-						&solicit_len);
-	return client->transport->send(client->transport, &all_nodes,
-						solicit, solicit_len);
-}
-
-static int dhcp6_client_send_request(struct l_dhcp6_client *client)
-{
-	L_AUTO_FREE_VAR(struct dhcp6_message *, request);
-	size_t request_len;
-
-	CLIENT_DEBUG("");
-
-	request = dhcp6_client_build_message(client,
-						DHCP6_MESSAGE_TYPE_REQUEST,
-						&request_len);
-	return client->transport->send(client->transport, &all_nodes,
-							request, request_len);
-}
-
-static int dhcp6_client_send_information_request(struct l_dhcp6_client *client)
+static void dhcp6_client_drop_message(struct l_dhcp6_client *client)
 {
-	static const struct in6_addr all_nodes = DHCP6_ADDR_LINKLOCAL_ALL_NODES;
-	struct dhcp6_message_builder *builder;
-	L_AUTO_FREE_VAR(struct dhcp6_message *, information_request);
-	size_t information_request_len;
-	int error;
-
-	CLIENT_DEBUG("");
-
-	builder = dhcp6_message_builder_new(
-					DHCP6_MESSAGE_TYPE_INFORMATION_REQUEST,
-					client->transaction_id, 128);
-
-	option_append_elapsed_time(builder, client->transaction_start_t);
-	option_append_option_request(builder, client->request_options,
-					DHCP6_STATE_REQUESTING_INFORMATION);
-
-	information_request = dhcp6_message_builder_free(builder, false,
-						&information_request_len);
-
-	error = client->transport->send(client->transport, &all_nodes,
-						information_request,
-						information_request_len);
-	return error;
+	l_free(client->tx_message);
+	client->tx_message = NULL;
+	client->tx_len = 0;
 }
 
-static int dhcp6_client_send_renew(struct l_dhcp6_client *client)
+/*
+ * RFC 8415, Section 15: retransmissions keep the transaction ID and only
+ * update the Elapsed Time option.  The message is therefore built on the
+ * first attempt of a transaction and later attempts only patch that one
+ * option in the cached copy.
+ */
+static int dhcp6_client_send_message(struct l_dhcp6_client *client,
+					enum dhcp6_message_type type)
 {
-	L_AUTO_FREE_VAR(struct dhcp6_message *, renew);
-	size_t renew_len;
-
 	CLIENT_DEBUG("");
 
-	renew = dhcp6_client_build_message(client,
-						DHCP6_MESSAGE_TYPE_RENEW,
-						&renew_len);
-	return client->transport->send(client->transport, &all_nodes,
-						renew, renew_len);
-}
-
-static int dhcp6_client_send_rebind(struct l_dhcp6_client *client)
-{
-	L_AUTO_FREE_VAR(struct dhcp6_message *, rebind);
-	size_t rebind_len;
-
-	CLIENT_DEBUG("");
+	if (!client->tx_message)
+		client->tx_message = dhcp6_client_build_message(client, type,
+						&client->tx_len,
+						&client->tx_elapsed_offset);
+	else
+		l_put_be16(dhcp6_elapsed_time(client->transaction_start_t),
+				client->tx_message->options +
+				client->tx_elapsed_offset);
 
-	rebind = dhcp6_client_build_message(client,
-						DHCP6_MESSAGE_TYPE_REBIND,
-						&rebind_len);
 	return client->transport->send(client->transport, &all_nodes,
-						rebind, rebind_len);
+					client->tx_message, client->tx_len);
 }
 
 static int dhcp6_client_send_release(struct l_dhcp6_client *client)
@@ -772,21 +724,24 @@ static int dhcp6_client_send_next(struct l_dhcp6_client *client)
 
 	switch (client->state) {
 	case DHCP6_STATE_SOLICITING:
-		r = dhcp6_client_send_solicit(client);
+		r = dhcp6_client_send_message(client,
+					DHCP6_MESSAGE_TYPE_SOLICIT);
 		if (r < 0)
 			return r;
 
 		set_retransmission_delay(client, SOL_TIMEOUT, SOL_MAX_RT, 0);
 		break;
 	case DHCP6_STATE_REQUESTING_INFORMATION:
-		r = dhcp6_client_send_information_request(client);
+		r = dhcp6_client_send_message(client,
+					DHCP6_MESSAGE_TYPE_INFORMATION_REQUEST);
 		if (r < 0)
 			return r;
 
 		set_retransmission_delay(client, INF_TIMEOUT, INF_MAX_RT, 0);
 		break;
 	case DHCP6_STATE_REQUESTING:
-		r = dhcp6_client_send_request(client);
+		r = dhcp6_client_send_message(client,
+					DHCP6_MESSAGE_TYPE_REQUEST);
 		if (r < 0)
 			return r;
 
@@ -794,14 +749,16 @@ static int dhcp6_client_send_next(struct l_dhcp6_client *client)
 								REQ_MAX_RC);
 		break;
 	case DHCP6_STATE_RENEWING:
-		r = dhcp6_client_send_renew(client);
+		r = dhcp6_client_send_message(client,
+					DHCP6_MESSAGE_TYPE_RENEW);
 		if (r < 0)
 			return r;
 
 		set_retransmission_delay(client, REN_TIMEOUT, REN_MAX_RT, 0);
 		break;
 	case DHCP6_STATE_REBINDING:
-		r = dhcp6_client_send_rebind(client);
+		r = dhcp6_client_send_message(client,
+					DHCP6_MESSAGE_TYPE_REBIND);
 		if (r < 0)
 			return r;
 
@@ -847,13 +804,14 @@ static inline void dhcp6_client_new_transaction(struct l_dhcp6_client *client,
 {
 	client->attempt = 0;
 	client->attempt_delay = 0;
-	client->transaction_id = l_getrandom_uint32() & 0x00FFFFFFU;
+	client->transaction_id = l_getrandom_buffered_uint32() & 0x00FFFFFFU;
 	client->transaction_start_t = 0;
+	dhcp6_client_drop_message(client);
 
 	dhcp6_client_enter_state(client, new_state);
 }
 
-static void dhcp6_client_timeout_send(struct l_timeout *timeout,
+static void dhcp6_client_timeout_send(struct retransmit *rt,
 								void *user_data)
 {
 	struct l_dhcp6_client *client = user_data;
@@ -910,10 +868,6 @@ static void dhcp6_client_t1_expired(struct l_timeout *timeout, void *user_data)
 
 	CLIENT_DEBUG("");
 
-	/* timeout_send was destroyed when entering BOUND, re-create */
-	client->timeout_send = l_timeout_create_ms(0,
-						dhcp6_client_timeout_send,
-						client, NULL);
 	dhcp6_client_new_transaction(client, DHCP6_STATE_RENEWING);
 
 	if (dhcp6_client_send_next(client) < 0) {
@@ -982,7 +936,8 @@ static void dhcp6_client_setup_lease(struct l_dhcp6_client *client,
 							dhcp6_client_t1_expired,
 							client, NULL);
 
-	if (client->rtnl) {
+	/* Delegated prefixes are left for the user to assign downstream */
+	if (client->rtnl && client->lease->have_na) {
 		struct l_rtnl_address *a;
 		L_AUTO_FREE_VAR(char *, ip) =
 			l_dhcp6_lease_get_address(client->lease);
@@ -1350,6 +1305,7 @@ bad_lease:
 static void dhcp6_client_rx_message(const void *data, size_t len,
 					uint64_t timestamp, void *userdata)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_DHCP);
 	struct l_dhcp6_client *client = userdata;
 	const struct dhcp6_message *message = data;
 	int r = client->state;
@@ -1407,8 +1363,7 @@ static void dhcp6_client_rx_message(const void *data, size_t len,
 		return;
 
 	if (r == DHCP6_STATE_BOUND) {
-		l_timeout_remove(client->timeout_send);
-		client->timeout_send = NULL;
+		_retransmit_cancel(client->send);
 		dhcp6_client_setup_lease(client, timestamp);
 		return;
 	}
@@ -1423,7 +1378,7 @@ static void dhcp6_client_send_initial(struct l_dhcp6_client *client)
 {
 	uint32_t delay;
 
-	if (client->stateless) {
+	if (client->stateless && !client->request_pd) {
 		dhcp6_client_new_transaction(client,
 					DHCP6_STATE_REQUESTING_INFORMATION);
 		delay = _time_pick_interval_secs(0, INF_MAX_DELAY);
@@ -1453,12 +1408,10 @@ static void dhcp6_client_send_initial(struct l_dhcp6_client *client)
 	if (client->nodelay)
 		delay = 0;
 
-	client->timeout_send = l_timeout_create_ms(delay,
-						dhcp6_client_timeout_send,
-						client, NULL);
-
 	if (client->nodelay)
-		dhcp6_client_timeout_send(NULL, client);
+		dhcp6_client_timeout_send(client->send, client);
+	else
+		_retransmit_schedule_ms(client->send, delay);
 }
 
 static void dhcp6_client_icmp6_event(struct l_icmp6_client *icmp6,
@@ -1483,11 +1436,11 @@ static void dhcp6_client_icmp6_event(struct l_icmp6_client *icmp6,
 				other ? "yes" : "no");
 
 		/* We only process the first RA received for now */
-		if (!client->timeout_send)
+		if (!client->timeout_ra)
 			return;
 
-		l_timeout_remove(client->timeout_send);
-		client->timeout_send = NULL;
+		l_timeout_remove(client->timeout_ra);
+		client->timeout_ra = NULL;
 
 		if (!managed && !other) {
 			l_dhcp6_client_stop(client);
@@ -1515,12 +1468,14 @@ static void dhcp6_client_no_ra(struct l_timeout *timeout, void *user_data)
 
 LIB_EXPORT struct l_dhcp6_client *l_dhcp6_client_new(uint32_t ifindex)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_DHCP);
 	struct l_dhcp6_client *client;
 
 	client = l_new(struct l_dhcp6_client, 1);
 
 	client->state = DHCP6_STATE_INIT;
 	client->ifindex = ifindex;
+	client->send = _retransmit_new(dhcp6_client_timeout_send, client);
 
 	client->icmp6 = l_icmp6_client_new(ifindex);
 	l_icmp6_client_add_event_handler(client->icmp6,
@@ -1548,6 +1503,7 @@ LIB_EXPORT void l_dhcp6_client_destroy(struct l_dhcp6_client *client)
 		client->event_destroy(client->event_data);
 
 	_dhcp6_transport_free(client->transport);
+	_retransmit_free(client->send);
 	l_uintset_free(client->request_options);
 	l_free(client->duid);
 
@@ -1751,6 +1707,25 @@ LIB_EXPORT bool l_dhcp6_client_set_stateless(struct l_dhcp6_client *client,
 	return true;
 }
 
+/*
+ * Also request a delegated prefix (IA_PD).  Combined with stateless mode
+ * only the prefix is requested, without a non-temporary address.
+ */
+LIB_EXPORT bool l_dhcp6_client_set_prefix_delegation(
+						struct l_dhcp6_client *client,
+						bool enable)
+{
+	if (unlikely(!client))
+		return false;
+
+	if (unlikely(client->state != DHCP6_STATE_INIT))
+		return false;
+
+	client->request_pd = enable;
+
+	return true;
+}
+
 LIB_EXPORT struct l_icmp6_client *l_dhcp6_client_get_icmp6(
 						struct l_dhcp6_client *client)
 {
@@ -1840,7 +1815,7 @@ LIB_EXPORT bool l_dhcp6_client_start(struct l_dhcp6_client *client)
 	 * Start a timer.  In case there are no router advertisements that
 	 * come back in a reasonable time, fail with a NO_LEASE event
 	 */
-	client->timeout_send = l_timeout_create(10, dhcp6_client_no_ra,
+	client->timeout_ra = l_timeout_create(10, dhcp6_client_no_ra,
 						client, NULL);
 	return true;
 }
@@ -1871,8 +1846,10 @@ LIB_EXPORT bool l_dhcp6_client_stop(struct l_dhcp6_client *client)
 	if (!client->nora)
 		l_icmp6_client_stop(client->icmp6);
 
-	l_timeout_remove(client->timeout_send);
-	client->timeout_send = NULL;
+	_retransmit_cancel(client->send);
+
+	l_timeout_remove(client->timeout_ra);
+	client->timeout_ra = NULL;
 
 	l_timeout_remove(client->timeout_lease);
 	client->timeout_lease = NULL;
@@ -1880,6 +1857,8 @@ LIB_EXPORT bool l_dhcp6_client_stop(struct l_dhcp6_client *client)
 	l_free(client->duid);
 	client->duid = NULL;
 
+	dhcp6_client_drop_message(client);
+
 	if (client->transport && client->transport->close)
 		client->transport->close(client->transport);
 
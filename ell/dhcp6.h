@@ -16,6 +16,7 @@ extern "C" {
 
 struct l_dhcp6_client;
 struct l_dhcp6_lease;
+struct l_dhcp6_prefix_pool;
 struct l_netlink;
 struct l_icmp6_client;
 
@@ -66,6 +67,8 @@ bool l_dhcp6_client_set_rtnl(struct l_dhcp6_client *client,
 						struct l_netlink *rtnl);
 bool l_dhcp6_client_set_stateless(struct l_dhcp6_client *client,
 								bool stateless);
+bool l_dhcp6_client_set_prefix_delegation(struct l_dhcp6_client *client,
+								bool enable);
 
 struct l_icmp6_client *l_dhcp6_client_get_icmp6(struct l_dhcp6_client *client);
 
@@ -76,14 +79,29 @@ bool l_dhcp6_client_start(struct l_dhcp6_client *client);
 bool l_dhcp6_client_stop(struct l_dhcp6_client *client);
 
 char *l_dhcp6_lease_get_address(const struct l_dhcp6_lease *lease);
+char *l_dhcp6_lease_get_delegated_prefix(const struct l_dhcp6_lease *lease);
+uint8_t l_dhcp6_lease_get_delegated_prefix_length(
+					const struct l_dhcp6_lease *lease);
 char **l_dhcp6_lease_get_dns(const struct l_dhcp6_lease *lease);
 char **l_dhcp6_lease_get_domains(const struct l_dhcp6_lease *lease);
+const uint8_t *l_dhcp6_lease_peek_dns(const struct l_dhcp6_lease *lease,
+					unsigned int *out_count);
+const char *const *l_dhcp6_lease_peek_domains(
+					const struct l_dhcp6_lease *lease);
 uint8_t l_dhcp6_lease_get_prefix_length(const struct l_dhcp6_lease *lease);
 uint32_t l_dhcp6_lease_get_valid_lifetime(const struct l_dhcp6_lease *lease);
 uint32_t l_dhcp6_lease_get_preferred_lifetime(
 					const struct l_dhcp6_lease *lease);
 uint64_t l_dhcp6_lease_get_start_time(const struct l_dhcp6_lease *lease);
 
+struct l_dhcp6_prefix_pool *l_dhcp6_prefix_pool_new(const char *prefix,
+							uint8_t prefix_len,
+							uint8_t sub_prefix_len);
+void l_dhcp6_prefix_pool_free(struct l_dhcp6_prefix_pool *pool);
+char *l_dhcp6_prefix_pool_alloc(struct l_dhcp6_prefix_pool *pool);
+bool l_dhcp6_prefix_pool_release(struct l_dhcp6_prefix_pool *pool,
+					const char *prefix);
+
 #ifdef __cplusplus
 }
 #endif
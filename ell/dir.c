@@ -14,27 +14,46 @@
 #include <dirent.h>
 #include <limits.h>
 #include <sys/inotify.h>
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
 #include <sys/stat.h>
 
 #include "private.h"
 #include "useful.h"
 #include "queue.h"
+#include "hashmap.h"
 #include "io.h"
+#include "timeout.h"
+#include "util.h"
 #include "dir.h"
 
 struct l_dir_watch {
 	struct watch_desc *desc;
+	struct l_queue *subdirs;
+	bool recursive;
+	struct fan_mark *mark;
+	unsigned int coalesce_interval;
+	struct l_timeout *coalesce_timeout;
+	struct l_queue *pending;
+	struct l_hashmap *pending_index;
+	bool in_dispatch;
+	bool destroyed;
 	l_dir_watch_event_func_t function;
 	void *user_data;
 	l_dir_watch_destroy_func_t destroy;
 };
 
 struct watch_desc {
-	int wd;
+	int wd;				/* -1 for the fanotify backend */
 	char *pathname;
 	struct l_queue *events;
 	struct l_queue *callbacks;
+	struct l_queue *recursive;
 };
 
 struct watch_event {
@@ -42,8 +61,27 @@ struct watch_event {
 	uint32_t mask;
 };
 
+struct pending_event {
+	char *filename;
+	enum l_dir_watch_event event;
+};
+
+#define WATCH_MASK	(IN_ALL_EVENTS | IN_ONLYDIR | IN_DONT_FOLLOW | \
+				IN_EXCL_UNLINK)
+
 static struct l_io *inotify_io = NULL;
-static struct l_queue *watch_list = NULL;
+static struct l_hashmap *watches_by_wd = NULL;
+static struct l_hashmap *watches_by_path = NULL;
+
+static enum l_dir_watch_backend dir_backend = L_DIR_WATCH_BACKEND_INOTIFY;
+static struct l_hashmap *fan_descs = NULL;
+static struct l_hashmap *fan_handles = NULL;
+
+static int setup_inotify(void);
+static void shutdown_inotify(void);
+static void fan_handles_flush(void);
+static void watch_add_subdir(struct l_dir_watch *watch, const char *pathname,
+								bool report);
 
 static void free_event(void *user_data)
 {
@@ -53,20 +91,17 @@ static void free_event(void *user_data)
 	l_free(event);
 }
 
-static bool desc_match_wd(const void *a, const void *b)
+static void free_pending_event(void *user_data)
 {
-	const struct watch_desc *desc = a;
-	int wd = L_PTR_TO_INT(b);
+	struct pending_event *pending = user_data;
 
-	return (desc->wd == wd);
+	l_free(pending->filename);
+	l_free(pending);
 }
 
-static bool desc_match_pathname(const void *a, const void *b)
+static bool match_ptr(const void *a, const void *b)
 {
-	const struct watch_desc *desc = a;
-	const char *pathname = b;
-
-	return !strcmp(desc->pathname, pathname);
+	return a == b;
 }
 
 static bool event_match_pathname(const void *a, const void *b)
@@ -77,20 +112,295 @@ static bool event_match_pathname(const void *a, const void *b)
 	return !strcmp(event->pathname, pathname);
 }
 
+/*
+ * Merges @event into what is already pending for @filename so that each
+ * file is reported at most once per coalescing interval, with the event
+ * that sums up its changes.
+ */
+static void watch_coalesce(struct l_dir_watch *watch, const char *filename,
+						enum l_dir_watch_event event)
+{
+	struct pending_event *pending;
+
+	if (!watch->pending) {
+		watch->pending = l_queue_new();
+		watch->pending_index = l_hashmap_string_new();
+	}
+
+	pending = l_hashmap_lookup(watch->pending_index, filename);
+	if (!pending) {
+		pending = l_new(struct pending_event, 1);
+		pending->filename = l_strdup(filename);
+		pending->event = event;
+		l_queue_push_tail(watch->pending, pending);
+		l_hashmap_insert(watch->pending_index, filename, pending);
+		return;
+	}
+
+	switch (pending->event) {
+	case L_DIR_WATCH_EVENT_CREATED:
+		/* Nothing to report if the file came and went */
+		if (event == L_DIR_WATCH_EVENT_REMOVED) {
+			l_hashmap_remove(watch->pending_index, filename);
+			l_queue_remove(watch->pending, pending);
+			free_pending_event(pending);
+		}
+
+		return;
+	case L_DIR_WATCH_EVENT_REMOVED:
+		/* Replaced by a new file */
+		if (event == L_DIR_WATCH_EVENT_CREATED)
+			pending->event = L_DIR_WATCH_EVENT_MODIFIED;
+
+		return;
+	case L_DIR_WATCH_EVENT_MODIFIED:
+		if (event == L_DIR_WATCH_EVENT_REMOVED)
+			pending->event = event;
+
+		return;
+	case L_DIR_WATCH_EVENT_ATTRIB:
+		if (event != L_DIR_WATCH_EVENT_ACCESSED)
+			pending->event = event;
+
+		return;
+	case L_DIR_WATCH_EVENT_ACCESSED:
+		pending->event = event;
+		return;
+	}
+}
+
+static void watch_free(struct l_dir_watch *watch)
+{
+	l_queue_destroy(watch->subdirs, NULL);
+	l_queue_destroy(watch->pending, free_pending_event);
+	l_hashmap_destroy(watch->pending_index, NULL);
+	l_free(watch);
+}
+
+static void coalesce_timeout(struct l_timeout *timeout, void *user_data)
+{
+	struct l_dir_watch *watch = user_data;
+	struct l_queue *pending = l_steal_ptr(watch->pending);
+	struct pending_event *event;
+
+	l_timeout_remove(l_steal_ptr(watch->coalesce_timeout));
+	l_hashmap_destroy(l_steal_ptr(watch->pending_index), NULL);
+
+	watch->in_dispatch = true;
+
+	while ((event = l_queue_pop_head(pending))) {
+		if (!watch->destroyed)
+			watch->function(event->filename, event->event,
+							watch->user_data);
+
+		free_pending_event(event);
+	}
+
+	l_queue_destroy(pending, NULL);
+	watch->in_dispatch = false;
+
+	if (watch->destroyed)
+		watch_free(watch);
+}
+
+static void watch_notify(struct l_dir_watch *watch, const char *filename,
+						enum l_dir_watch_event event)
+{
+	if (!watch->function)
+		return;
+
+	if (!watch->coalesce_interval) {
+		watch->function(filename, event, watch->user_data);
+		return;
+	}
+
+	watch_coalesce(watch, filename, event);
+
+	if (!watch->coalesce_timeout)
+		watch->coalesce_timeout = l_timeout_create_ms(
+						watch->coalesce_interval,
+						coalesce_timeout, watch, NULL);
+}
+
+/* Name of @pathname in @desc relative to the top of recursive @watch */
+static char *watch_relative_name(struct l_dir_watch *watch,
+					struct watch_desc *desc,
+					const char *pathname)
+{
+	const char *subdir = desc->pathname + strlen(watch->desc->pathname);
+
+	while (*subdir == '/')
+		subdir++;
+
+	return l_strdup_printf("%s/%s", subdir, pathname);
+}
+
 static void handle_callback(struct watch_desc *desc, const char *pathname,
 						enum l_dir_watch_event event)
 {
 	const struct l_queue_entry *entry;
 
 	for (entry = l_queue_get_entries(desc->callbacks); entry;
+							entry = entry->next)
+		watch_notify(entry->data, pathname, event);
+
+	for (entry = l_queue_get_entries(desc->recursive); entry;
 							entry = entry->next) {
 		struct l_dir_watch *watch = entry->data;
+		char *filename = watch_relative_name(watch, desc, pathname);
 
-		if (watch->function)
-			watch->function(pathname, event, watch->user_data);
+		watch_notify(watch, filename, event);
+		l_free(filename);
 	}
 }
 
+static struct watch_desc *desc_get(const char *pathname)
+{
+	struct watch_desc *desc;
+	int fd;
+
+	desc = l_hashmap_lookup(watches_by_path, pathname);
+	if (desc)
+		return desc;
+
+	/*
+	 * Returns the inotify file descriptor. It will create a new one
+	 * if it doesn't exist yet or return the already opened one.
+	 */
+	fd = setup_inotify();
+	if (fd < 0)
+		return NULL;
+
+	desc = l_new(struct watch_desc, 1);
+
+	desc->wd = inotify_add_watch(fd, pathname, WATCH_MASK);
+	if (desc->wd < 0) {
+		/*
+		 * If the setup_inotify() created the inotify file descriptor,
+		 * then this will close it. Otherwise it will do nothing.
+		 */
+		shutdown_inotify();
+		l_free(desc);
+		return NULL;
+	}
+
+	desc->pathname = l_strdup(pathname);
+	desc->events = l_queue_new();
+	desc->callbacks = l_queue_new();
+	desc->recursive = l_queue_new();
+
+	l_hashmap_insert(watches_by_wd, L_INT_TO_PTR(desc->wd), desc);
+	l_hashmap_insert(watches_by_path, desc->pathname, desc);
+
+	return desc;
+}
+
+static void desc_put(struct watch_desc *desc)
+{
+	/*
+	 * As long as the watch descriptor has callbacks registered, it is
+	 * still needed to be active.
+	 */
+	if (!l_queue_isempty(desc->callbacks) ||
+			!l_queue_isempty(desc->recursive))
+		return;
+
+	if (desc->wd < 0) {
+		l_hashmap_remove(fan_descs, desc->pathname);
+	} else {
+		l_hashmap_remove(watches_by_wd, L_INT_TO_PTR(desc->wd));
+		l_hashmap_remove(watches_by_path, desc->pathname);
+		inotify_rm_watch(l_io_get_fd(inotify_io), desc->wd);
+	}
+
+	l_queue_destroy(desc->callbacks, NULL);
+	l_queue_destroy(desc->recursive, NULL);
+	l_queue_destroy(desc->events, free_event);
+	l_free(desc->pathname);
+	l_free(desc);
+
+	/*
+	 * When the number of watches goes to zero, then this will close
+	 * the inotify file descriptor, otherwise it will do nothing.
+	 */
+	shutdown_inotify();
+}
+
+/* Whether @pathname is @dir or somewhere below it */
+static bool path_is_below(const char *pathname, const char *dir)
+{
+	size_t len = strlen(dir);
+
+	if (strncmp(pathname, dir, len))
+		return false;
+
+	return !pathname[len] || pathname[len] == '/' ||
+		(len && dir[len - 1] == '/');
+}
+
+/* Stops watching @pathname and the directories below it for @watch */
+static void watch_remove_subdir(struct l_dir_watch *watch,
+						const char *pathname)
+{
+	const struct l_queue_entry *entry = l_queue_get_entries(watch->subdirs);
+
+	while (entry) {
+		struct watch_desc *desc = entry->data;
+
+		entry = entry->next;
+
+		if (!path_is_below(desc->pathname, pathname))
+			continue;
+
+		l_queue_remove(watch->subdirs, desc);
+		l_queue_remove(desc->recursive, watch);
+		desc_put(desc);
+	}
+}
+
+/* A directory came or went in @desc, update the recursive watches */
+static void process_dir_event(struct watch_desc *desc, const char *pathname,
+								uint32_t mask)
+{
+	struct l_queue *watches;
+	const struct l_queue_entry *entry;
+	char *subdir;
+	struct l_dir_watch *watch;
+
+	/* fanotify sees the whole filesystem, only paths can go stale */
+	if (desc->wd < 0) {
+		if (mask & (IN_DELETE | IN_MOVED_FROM))
+			fan_handles_flush();
+
+		return;
+	}
+
+	watches = l_queue_new();
+	subdir = l_strdup_printf("%s/%s", desc->pathname, pathname);
+
+	for (entry = l_queue_get_entries(desc->callbacks); entry;
+							entry = entry->next) {
+		watch = entry->data;
+
+		if (watch->recursive)
+			l_queue_push_tail(watches, watch);
+	}
+
+	for (entry = l_queue_get_entries(desc->recursive); entry;
+							entry = entry->next)
+		l_queue_push_tail(watches, entry->data);
+
+	while ((watch = l_queue_pop_head(watches))) {
+		if (mask & (IN_CREATE | IN_MOVED_TO))
+			watch_add_subdir(watch, subdir, true);
+		else
+			watch_remove_subdir(watch, subdir);
+	}
+
+	l_queue_destroy(watches, NULL);
+	l_free(subdir);
+}
+
 static void process_event(struct watch_desc *desc, const char *pathname,
 								uint32_t mask)
 {
@@ -99,6 +409,28 @@ static void process_event(struct watch_desc *desc, const char *pathname,
 	if (!pathname)
 		return;
 
+	/*
+	 * Directories are never opened for writing, only report them
+	 * coming and going.
+	 */
+	if (mask & IN_ISDIR) {
+		if (mask & (IN_CREATE | IN_MOVED_TO | IN_DELETE |
+							IN_MOVED_FROM))
+			process_dir_event(desc, pathname, mask);
+
+		if (mask & (IN_CREATE | IN_MOVED_TO))
+			handle_callback(desc, pathname,
+					L_DIR_WATCH_EVENT_CREATED);
+		else if (mask & (IN_DELETE | IN_MOVED_FROM))
+			handle_callback(desc, pathname,
+					L_DIR_WATCH_EVENT_REMOVED);
+		else if (mask & IN_ATTRIB)
+			handle_callback(desc, pathname,
+					L_DIR_WATCH_EVENT_ATTRIB);
+
+		return;
+	}
+
 	if (mask & (IN_ACCESS | IN_MODIFY | IN_OPEN | IN_CREATE)) {
 		event = l_queue_find(desc->events, event_match_pathname,
 								pathname);
@@ -165,7 +497,8 @@ static void process_event(struct watch_desc *desc, const char *pathname,
 static bool inotify_read_cb(struct l_io *io, void *user_data)
 {
 	int fd = l_io_get_fd(io);
-	uint8_t buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+	/* Room for many events, a bulk change is then read in few calls */
+	uint8_t buf[4096]
 		__attribute__ ((aligned(__alignof__(struct inotify_event))));
 	const void *ptr = buf;
 	ssize_t len;
@@ -179,7 +512,7 @@ static bool inotify_read_cb(struct l_io *io, void *user_data)
 		const char *name = event->len ? event->name : NULL;
 		struct watch_desc *desc;
 
-		desc = l_queue_find(watch_list, desc_match_wd,
+		desc = l_hashmap_lookup(watches_by_wd,
 						L_INT_TO_PTR(event->wd));
 		if (desc)
 			process_event(desc, name, event->mask);
@@ -216,7 +549,8 @@ static int setup_inotify(void)
 		return -1;
 	}
 
-	watch_list = l_queue_new();
+	watches_by_wd = l_hashmap_new();
+	watches_by_path = l_hashmap_string_new();
 	inotify_io = io;
 
 done:
@@ -228,115 +562,728 @@ static void shutdown_inotify(void)
 	if (!inotify_io)
 		return;
 
-	if (l_queue_isempty(watch_list)) {
+	if (l_hashmap_isempty(watches_by_wd)) {
 		l_io_destroy(inotify_io);
 		inotify_io = NULL;
 
-		l_queue_destroy(watch_list, NULL);
-		watch_list = NULL;
+		l_hashmap_destroy(watches_by_wd, NULL);
+		watches_by_wd = NULL;
+		l_hashmap_destroy(watches_by_path, NULL);
+		watches_by_path = NULL;
 	}
 }
 
-LIB_EXPORT struct l_dir_watch *l_dir_watch_new(const char *pathname,
+/*
+ * Watches the directories below @desc for recursive @watch.  With @report
+ * the entries already there are reported as created, since they may have
+ * appeared before the directory could be watched.
+ */
+static void watch_scan_dir(struct l_dir_watch *watch, struct watch_desc *desc,
+								bool report)
+{
+	struct dirent *dirent;
+	DIR *dir;
+
+	dir = opendir(desc->pathname);
+	if (!dir)
+		return;
+
+	while ((dirent = readdir(dir))) {
+		_auto_(l_free) char *subdir = NULL;
+		struct stat st;
+
+		if (!strcmp(dirent->d_name, ".") ||
+				!strcmp(dirent->d_name, ".."))
+			continue;
+
+		if (report) {
+			_auto_(l_free) char *filename =
+				watch_relative_name(watch, desc,
+							dirent->d_name);
+
+			watch_notify(watch, filename,
+					L_DIR_WATCH_EVENT_CREATED);
+		}
+
+		subdir = l_strdup_printf("%s/%s", desc->pathname,
+							dirent->d_name);
+
+		if (dirent->d_type == DT_DIR || (dirent->d_type == DT_UNKNOWN &&
+					!lstat(subdir, &st) &&
+					S_ISDIR(st.st_mode)))
+			watch_add_subdir(watch, subdir, report);
+	}
+
+	closedir(dir);
+}
+
+static void watch_add_subdir(struct l_dir_watch *watch, const char *pathname,
+								bool report)
+{
+	struct watch_desc *desc;
+
+	desc = desc_get(pathname);
+	if (!desc)
+		return;
+
+	if (desc == watch->desc || l_queue_find(desc->recursive,
+							match_ptr, watch))
+		return;
+
+	l_queue_push_tail(desc->recursive, watch);
+	l_queue_push_tail(watch->subdirs, desc);
+	watch_scan_dir(watch, desc, report);
+}
+
+/*
+ * With the fanotify backend a recursive watch marks the whole filesystem
+ * its directory is on.  Events name the directory by file handle, which
+ * is resolved to a path only when not already cached, and only events in
+ * directories below a watched one are processed.  Each such directory
+ * gets a watch_desc, with wd -1, tracking its pending events as for
+ * inotify.
+ */
+static void fan_handles_flush(void)
+{
+	if (!fan_handles || l_hashmap_isempty(fan_handles))
+		return;
+
+	l_hashmap_destroy(fan_handles, NULL);
+	fan_handles = l_hashmap_string_new();
+}
+
+#ifdef FAN_REPORT_DFID_NAME
+
+#define FAN_HANDLE_CACHE_MAX	4096
+
+#define FAN_WATCH_MASK	(FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | \
+				FAN_MOVED_TO | FAN_ATTRIB | FAN_CLOSE_WRITE | \
+				FAN_ONDIR)
+
+struct fan_mark {
+	fsid_t fsid;
+	int mount_fd;
+	unsigned int refs;
+};
+
+static struct l_io *fanotify_io = NULL;
+static struct l_queue *fan_marks = NULL;
+static struct l_queue *fan_watches = NULL;
+static char fan_no_match;
+
+static struct watch_desc *fan_desc_new(const char *pathname)
+{
+	struct watch_desc *desc = l_new(struct watch_desc, 1);
+
+	desc->wd = -1;
+	desc->pathname = l_strdup(pathname);
+	desc->events = l_queue_new();
+	desc->callbacks = l_queue_new();
+	desc->recursive = l_queue_new();
+	l_hashmap_insert(fan_descs, desc->pathname, desc);
+
+	return desc;
+}
+
+static bool fan_mark_match_fsid(const void *a, const void *b)
+{
+	const struct fan_mark *mark = a;
+
+	return !memcmp(&mark->fsid, b, sizeof(mark->fsid));
+}
+
+static struct fan_mark *fan_mark_get(const char *pathname)
+{
+	struct fan_mark *mark;
+	struct statfs sfs;
+	int fd;
+
+	if (statfs(pathname, &sfs) < 0)
+		return NULL;
+
+	mark = l_queue_find(fan_marks, fan_mark_match_fsid, &sfs.f_fsid);
+	if (mark) {
+		mark->refs++;
+		return mark;
+	}
+
+	/*
+	 * Kept open to resolve the file handles on this filesystem, and
+	 * to remove the mark.  fanotify_mark() doesn't take O_PATH fds.
+	 */
+	fd = open(pathname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fanotify_mark(l_io_get_fd(fanotify_io),
+				FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+				FAN_WATCH_MASK, fd, NULL) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	mark = l_new(struct fan_mark, 1);
+	mark->fsid = sfs.f_fsid;
+	mark->mount_fd = fd;
+	mark->refs = 1;
+	l_queue_push_tail(fan_marks, mark);
+
+	return mark;
+}
+
+static void fan_mark_put(struct fan_mark *mark)
+{
+	if (--mark->refs)
+		return;
+
+	fanotify_mark(l_io_get_fd(fanotify_io),
+				FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM,
+				FAN_WATCH_MASK, mark->mount_fd, NULL);
+	close(mark->mount_fd);
+	l_queue_remove(fan_marks, mark);
+	l_free(mark);
+}
+
+/* Finds or creates the watch_desc of @pathname if it is being watched */
+static struct watch_desc *fan_desc_lookup(const char *pathname)
+{
+	struct watch_desc *desc = l_hashmap_lookup(fan_descs, pathname);
+	const struct l_queue_entry *entry;
+
+	if (desc)
+		return desc;
+
+	for (entry = l_queue_get_entries(fan_watches); entry;
+							entry = entry->next) {
+		struct l_dir_watch *watch = entry->data;
+
+		if (!path_is_below(pathname, watch->desc->pathname))
+			continue;
+
+		if (!desc)
+			desc = fan_desc_new(pathname);
+
+		l_queue_push_tail(desc->recursive, watch);
+		l_queue_push_tail(watch->subdirs, desc);
+	}
+
+	return desc;
+}
+
+static struct watch_desc *fan_resolve(
+				const struct fanotify_event_info_fid *fid,
+				struct file_handle *handle)
+{
+	uint8_t key[sizeof(fid->fsid) + sizeof(int) + MAX_HANDLE_SZ];
+	_auto_(l_free) char *key_str = NULL;
+	struct watch_desc *desc;
+	struct fan_mark *mark;
+	char proc_path[32];
+	char pathname[PATH_MAX];
+	ssize_t len;
+	int fd;
+
+	if (handle->handle_bytes > MAX_HANDLE_SZ)
+		return NULL;
+
+	memcpy(key, &fid->fsid, sizeof(fid->fsid));
+	memcpy(key + sizeof(fid->fsid), &handle->handle_type, sizeof(int));
+	memcpy(key + sizeof(fid->fsid) + sizeof(int), handle->f_handle,
+						handle->handle_bytes);
+	key_str = l_util_hexstring(key, sizeof(fid->fsid) + sizeof(int) +
+						handle->handle_bytes);
+
+	desc = l_hashmap_lookup(fan_handles, key_str);
+	if (desc)
+		return desc == (void *) &fan_no_match ? NULL : desc;
+
+	mark = l_queue_find(fan_marks, fan_mark_match_fsid, &fid->fsid);
+	if (!mark)
+		return NULL;
+
+	fd = open_by_handle_at(mark->mount_fd, handle, O_PATH | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+	len = readlink(proc_path, pathname, sizeof(pathname) - 1);
+	close(fd);
+
+	if (len < 0)
+		return NULL;
+
+	pathname[len] = '\0';
+	desc = fan_desc_lookup(pathname);
+
+	if (l_hashmap_size(fan_handles) >= FAN_HANDLE_CACHE_MAX)
+		fan_handles_flush();
+
+	l_hashmap_insert(fan_handles, key_str,
+				desc ? desc : (void *) &fan_no_match);
+	return desc;
+}
+
+/*
+ * Unlike inotify, fanotify merges consecutive events on the same entry
+ * into one, feed them to process_event() one at a time in the order they
+ * most likely happened.
+ */
+static void fan_process_event(struct watch_desc *desc, const char *name,
+								uint32_t mask)
+{
+	uint32_t dir = mask & FAN_ONDIR;
+	uint32_t added = mask & (FAN_CREATE | FAN_MOVED_TO);
+	uint32_t removed = mask & (FAN_DELETE | FAN_MOVED_FROM);
+	bool removed_first = !added;
+
+	/* Whether the entry is there now tells what came last */
+	if (added && removed) {
+		_auto_(l_free) char *pathname = l_strdup_printf("%s/%s",
+							desc->pathname, name);
+		struct stat st;
+
+		removed_first = !lstat(pathname, &st);
+	}
+
+	if (removed && removed_first)
+		process_event(desc, name, removed | dir);
+
+	if (added)
+		process_event(desc, name, added | dir);
+
+	if (mask & FAN_CLOSE_WRITE)
+		process_event(desc, name, FAN_CLOSE_WRITE | dir);
+
+	if (mask & FAN_ATTRIB)
+		process_event(desc, name, FAN_ATTRIB | dir);
+
+	if (removed && !removed_first)
+		process_event(desc, name, removed | dir);
+}
+
+static bool fanotify_read_cb(struct l_io *io, void *user_data)
+{
+	int fd = l_io_get_fd(io);
+	uint8_t buf[4096];
+	uint8_t handle_buf[sizeof(struct file_handle) + MAX_HANDLE_SZ]
+		__attribute__ ((aligned(__alignof__(struct file_handle))));
+	struct file_handle *handle = (void *) handle_buf;
+	const size_t fid_len = offsetof(struct fanotify_event_info_fid, handle);
+	const size_t handle_len = offsetof(struct file_handle, f_handle);
+	struct fanotify_event_metadata meta;
+	size_t pos;
+	ssize_t len;
+
+	len = L_TFR(read(fd, buf, sizeof(buf)));
+	if (len <= 0)
+		return true;
+
+	/*
+	 * Records are only padded to 4 bytes with FAN_REPORT_DFID_NAME so
+	 * the headers are copied out rather than accessed in place.
+	 */
+	for (pos = 0; pos + sizeof(meta) <= (size_t) len;
+						pos += meta.event_len) {
+		uint8_t *ptr;
+		uint8_t *end;
+
+		memcpy(&meta, buf + pos, sizeof(meta));
+
+		if (meta.event_len < sizeof(meta) ||
+				meta.event_len > len - pos)
+			break;
+
+		if (meta.vers != FANOTIFY_METADATA_VERSION)
+			break;
+
+		if (meta.fd >= 0)
+			close(meta.fd);
+
+		ptr = buf + pos + meta.metadata_len;
+		end = buf + pos + meta.event_len;
+
+		while (ptr + sizeof(struct fanotify_event_info_header) <= end) {
+			struct fanotify_event_info_fid fid;
+			const uint8_t *info = ptr;
+			struct watch_desc *desc;
+			const char *name;
+
+			memcpy(&fid.hdr, info, sizeof(fid.hdr));
+
+			if (!fid.hdr.len || ptr + fid.hdr.len > end)
+				break;
+
+			ptr += fid.hdr.len;
+
+			if (fid.hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+				continue;
+
+			if (fid.hdr.len < fid_len + handle_len)
+				continue;
+
+			memcpy(&fid, info, fid_len);
+			memcpy(handle, info + fid_len, handle_len);
+
+			if (handle->handle_bytes > MAX_HANDLE_SZ ||
+					fid.hdr.len <= fid_len + handle_len +
+							handle->handle_bytes)
+				continue;
+
+			memcpy(handle->f_handle, info + fid_len + handle_len,
+							handle->handle_bytes);
+			name = (const char *) info + fid_len + handle_len +
+							handle->handle_bytes;
+
+			/* Events on the directory itself */
+			if (!strcmp(name, "."))
+				continue;
+
+			desc = fan_resolve(&fid, handle);
+			if (desc)
+				fan_process_event(desc, name, meta.mask);
+		}
+	}
+
+	return true;
+}
+
+static bool setup_fanotify(void)
+{
+	int fd;
+
+	if (fanotify_io)
+		return true;
+
+	fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK |
+				FAN_REPORT_DFID_NAME, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	fanotify_io = l_io_new(fd);
+	if (!fanotify_io) {
+		close(fd);
+		return false;
+	}
+
+	l_io_set_close_on_destroy(fanotify_io, true);
+
+	if (!l_io_set_read_handler(fanotify_io, fanotify_read_cb,
+							NULL, NULL)) {
+		l_io_destroy(fanotify_io);
+		fanotify_io = NULL;
+		return false;
+	}
+
+	fan_marks = l_queue_new();
+	fan_watches = l_queue_new();
+	fan_descs = l_hashmap_string_new();
+	fan_handles = l_hashmap_string_new();
+
+	return true;
+}
+
+static void shutdown_fanotify(void)
+{
+	if (!fanotify_io || !l_queue_isempty(fan_watches))
+		return;
+
+	l_io_destroy(fanotify_io);
+	fanotify_io = NULL;
+
+	l_queue_destroy(fan_marks, NULL);
+	fan_marks = NULL;
+	l_queue_destroy(fan_watches, NULL);
+	fan_watches = NULL;
+	l_hashmap_destroy(fan_descs, NULL);
+	fan_descs = NULL;
+	l_hashmap_destroy(fan_handles, NULL);
+	fan_handles = NULL;
+}
+
+struct fan_attach_data {
+	struct l_dir_watch *watch;
+	const char *pathname;
+};
+
+static void fan_attach_desc(const void *key, void *value, void *user_data)
+{
+	struct watch_desc *desc = value;
+	struct fan_attach_data *data = user_data;
+
+	if (!strcmp(desc->pathname, data->pathname) ||
+			!path_is_below(desc->pathname, data->pathname))
+		return;
+
+	l_queue_push_tail(desc->recursive, data->watch);
+	l_queue_push_tail(data->watch->subdirs, desc);
+}
+
+static struct l_dir_watch *fan_watch_new(const char *pathname,
 					l_dir_watch_event_func_t function,
 					void *user_data,
 					l_dir_watch_destroy_func_t destroy)
 {
+	struct fan_attach_data data;
 	struct l_dir_watch *watch;
 	struct watch_desc *desc;
-	int fd;
+	struct fan_mark *mark;
+	_auto_(l_free) char *real_path = realpath(pathname, NULL);
 
-	if (!pathname)
+	if (!real_path || !setup_fanotify())
 		return NULL;
 
+	mark = fan_mark_get(real_path);
+	if (!mark) {
+		shutdown_fanotify();
+		return NULL;
+	}
+
 	watch = l_new(struct l_dir_watch, 1);
 	watch->function = function;
 	watch->user_data = user_data;
 	watch->destroy = destroy;
+	watch->recursive = true;
+	watch->subdirs = l_queue_new();
+	watch->mark = mark;
 
-	desc = l_queue_find(watch_list, desc_match_pathname, pathname);
-	if (desc)
-		goto done;
+	desc = l_hashmap_lookup(fan_descs, real_path);
+	if (!desc)
+		desc = fan_desc_new(real_path);
 
-	/*
-	 * Returns the inotify file descriptor. It will create a new one
-	 * if it doesn't exist yet or return the already opened one.
-	 */
-	fd = setup_inotify();
-	if (fd < 0) {
-		l_free(watch);
-		return NULL;
-	}
+	l_queue_push_tail(desc->callbacks, watch);
+	watch->desc = desc;
 
-	desc = l_new(struct watch_desc, 1);
+	data.watch = watch;
+	data.pathname = real_path;
+	l_hashmap_foreach(fan_descs, fan_attach_desc, &data);
 
-	desc->wd = inotify_add_watch(fd, pathname, IN_ALL_EVENTS |
-							IN_ONLYDIR |
-							IN_DONT_FOLLOW |
-							IN_EXCL_UNLINK);
-	if (desc->wd < 0) {
-		/*
-		 * If the setup_inotify() created the inotify file descriptor,
-		 * then this will close it. Otherwise it will do nothing.
-		 */
-		shutdown_inotify();
-		l_free(desc);
-		l_free(watch);
+	/* Directories that didn't match before may now */
+	fan_handles_flush();
+	l_queue_push_tail(fan_watches, watch);
+
+	return watch;
+}
+
+static void fan_watch_release(struct l_dir_watch *watch)
+{
+	l_queue_remove(fan_watches, watch);
+	fan_mark_put(watch->mark);
+	fan_handles_flush();
+	shutdown_fanotify();
+}
+
+static bool fan_supported(void)
+{
+	int fd;
+
+	if (fanotify_io)
+		return true;
+
+	fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC |
+				FAN_REPORT_DFID_NAME, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	close(fd);
+	return true;
+}
+
+#else
+
+static struct l_dir_watch *fan_watch_new(const char *pathname,
+					l_dir_watch_event_func_t function,
+					void *user_data,
+					l_dir_watch_destroy_func_t destroy)
+{
+	return NULL;
+}
+
+static void fan_watch_release(struct l_dir_watch *watch)
+{
+}
+
+static bool fan_supported(void)
+{
+	return false;
+}
+
+#endif
+
+static struct l_dir_watch *dir_watch_new(const char *pathname,
+					bool recursive,
+					l_dir_watch_event_func_t function,
+					void *user_data,
+					l_dir_watch_destroy_func_t destroy)
+{
+	struct l_dir_watch *watch;
+	struct watch_desc *desc;
+
+	if (!pathname)
 		return NULL;
+
+	if (recursive && dir_backend == L_DIR_WATCH_BACKEND_FANOTIFY) {
+		watch = fan_watch_new(pathname, function, user_data, destroy);
+		if (watch)
+			return watch;
 	}
 
-	desc->pathname = l_strdup(pathname);
-	desc->events = l_queue_new();
-	desc->callbacks = l_queue_new();
+	desc = desc_get(pathname);
+	if (!desc)
+		return NULL;
 
-	l_queue_push_tail(watch_list, desc);
+	watch = l_new(struct l_dir_watch, 1);
+	watch->function = function;
+	watch->user_data = user_data;
+	watch->destroy = destroy;
+	watch->recursive = recursive;
+	watch->subdirs = l_queue_new();
 
-done:
 	l_queue_push_tail(desc->callbacks, watch);
 	watch->desc = desc;
+
+	if (recursive)
+		watch_scan_dir(watch, desc, false);
+
 	return watch;
 }
 
+/**
+ * l_dir_watch_new:
+ * @pathname: Directory to watch
+ * @function: Called with the name of a file in @pathname and what
+ *	happened to it
+ * @user_data: User data passed to @function
+ * @destroy: Called to free @user_data when the watch is destroyed
+ *
+ * Watches the files directly inside @pathname.
+ *
+ * Returns: A newly allocated #l_dir_watch, or NULL on failure
+ **/
+LIB_EXPORT struct l_dir_watch *l_dir_watch_new(const char *pathname,
+					l_dir_watch_event_func_t function,
+					void *user_data,
+					l_dir_watch_destroy_func_t destroy)
+{
+	return dir_watch_new(pathname, false, function, user_data, destroy);
+}
+
+/**
+ * l_dir_watch_new_recursive:
+ * @pathname: Directory to watch
+ * @function: Called with the path of a file relative to @pathname and
+ *	what happened to it
+ * @user_data: User data passed to @function
+ * @destroy: Called to free @user_data when the watch is destroyed
+ *
+ * Like l_dir_watch_new but also watches all the directories below
+ * @pathname, including those created later on.  The contents of a
+ * directory that is created or moved in are reported as created.
+ * Symbolic links to directories are not followed.
+ *
+ * Returns: A newly allocated #l_dir_watch, or NULL on failure
+ **/
+LIB_EXPORT struct l_dir_watch *l_dir_watch_new_recursive(
+					const char *pathname,
+					l_dir_watch_event_func_t function,
+					void *user_data,
+					l_dir_watch_destroy_func_t destroy)
+{
+	return dir_watch_new(pathname, true, function, user_data, destroy);
+}
+
+/**
+ * l_dir_watch_set_coalesce_interval:
+ * @watch: Directory watch
+ * @interval_ms: Time to collect events for, in milliseconds, or 0 to
+ *	report each event as it comes
+ *
+ * Holds events back for up to @interval_ms after the first one, then
+ * reports each file that changed in the meantime once, in the order they
+ * first changed.  A file created and modified is reported as created, a
+ * file removed and created again as modified, and a file created and then
+ * removed is not reported at all.  This keeps bulk changes, such as a
+ * package manager installing many files, from calling @function for every
+ * system call.
+ *
+ * Returns: true on success, false if @watch is NULL
+ **/
+LIB_EXPORT bool l_dir_watch_set_coalesce_interval(struct l_dir_watch *watch,
+						unsigned int interval_ms)
+{
+	if (unlikely(!watch))
+		return false;
+
+	watch->coalesce_interval = interval_ms;
+
+	if (!interval_ms && watch->coalesce_timeout)
+		coalesce_timeout(watch->coalesce_timeout, watch);
+
+	return true;
+}
+
+/**
+ * l_dir_watch_set_backend:
+ * @backend: Mechanism for recursive watches created from now on
+ *
+ * Selects how l_dir_watch_new_recursive watches a directory tree.  The
+ * default, %L_DIR_WATCH_BACKEND_INOTIFY, adds an inotify watch for every
+ * directory, which can run into the fs.inotify.max_user_watches limit on
+ * large trees.  %L_DIR_WATCH_BACKEND_FANOTIFY watches the whole
+ * filesystem with a single fanotify mark instead, and needs the
+ * CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH capabilities.  It does not report
+ * %L_DIR_WATCH_EVENT_ACCESSED, nor modifications without a close such as
+ * truncate().  A tree whose filesystem can't be marked falls back to
+ * inotify.
+ *
+ * Returns: true on success, false if @backend is not available
+ **/
+LIB_EXPORT bool l_dir_watch_set_backend(enum l_dir_watch_backend backend)
+{
+	switch (backend) {
+	case L_DIR_WATCH_BACKEND_INOTIFY:
+		break;
+	case L_DIR_WATCH_BACKEND_FANOTIFY:
+		if (!fan_supported())
+			return false;
+
+		break;
+	default:
+		return false;
+	}
+
+	dir_backend = backend;
+	return true;
+}
+
 LIB_EXPORT void l_dir_watch_destroy(struct l_dir_watch *watch)
 {
 	struct watch_desc *desc;
-	int fd;
 
 	if (!watch)
 		return;
 
-	desc = watch->desc;
-	l_queue_remove(desc->callbacks, watch);
-
-	/*
-	 * As long as the watch descriptor has callbacks registered, it is
-	 * still needed to be active.
-	 */
-	if (!l_queue_isempty(desc->callbacks))
-		goto done;
-
-	if (!l_queue_remove(watch_list, desc))
-		goto done;
+	while ((desc = l_queue_pop_head(watch->subdirs))) {
+		l_queue_remove(desc->recursive, watch);
+		desc_put(desc);
+	}
 
-	fd = l_io_get_fd(inotify_io);
-	inotify_rm_watch(fd, desc->wd);
+	l_queue_remove(watch->desc->callbacks, watch);
+	desc_put(watch->desc);
 
-	l_queue_destroy(desc->callbacks, NULL);
-	l_queue_destroy(desc->events, free_event);
-	l_free(desc->pathname);
-	l_free(desc);
+	if (watch->mark)
+		fan_watch_release(watch);
 
-	/*
-	 * When the number of watches goes to zero, then this will close
-	 * the inotify file descriptor, otherwise it will do nothing.
-	 */
-	shutdown_inotify();
+	l_timeout_remove(l_steal_ptr(watch->coalesce_timeout));
 
-done:
 	if (watch->destroy)
 		watch->destroy(watch->user_data);
 
-	l_free(watch);
+	if (watch->in_dispatch) {
+		watch->destroyed = true;
+		return;
+	}
+
+	watch_free(watch);
 }
 
 /**
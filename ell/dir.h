@@ -8,6 +8,8 @@
 #ifndef __ELL_DIR_H
 #define __ELL_DIR_H
 
+#include <stdbool.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -22,6 +24,11 @@ enum l_dir_watch_event {
 	L_DIR_WATCH_EVENT_ATTRIB,
 };
 
+enum l_dir_watch_backend {
+	L_DIR_WATCH_BACKEND_INOTIFY,
+	L_DIR_WATCH_BACKEND_FANOTIFY,
+};
+
 typedef void (*l_dir_watch_event_func_t) (const char *filename,
 						enum l_dir_watch_event event,
 						void *user_data);
@@ -31,6 +38,13 @@ struct l_dir_watch *l_dir_watch_new(const char *pathname,
 					l_dir_watch_event_func_t function,
 					void *user_data,
 					l_dir_watch_destroy_func_t destroy);
+struct l_dir_watch *l_dir_watch_new_recursive(const char *pathname,
+					l_dir_watch_event_func_t function,
+					void *user_data,
+					l_dir_watch_destroy_func_t destroy);
+bool l_dir_watch_set_coalesce_interval(struct l_dir_watch *watch,
+						unsigned int interval_ms);
+bool l_dir_watch_set_backend(enum l_dir_watch_backend backend);
 void l_dir_watch_destroy(struct l_dir_watch *watch);
 
 int l_dir_create(const char *abspath);
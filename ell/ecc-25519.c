@@ -0,0 +1,402 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "private.h"
+#include "ecc.h"
+#include "ecc-private.h"
+
+/*
+ * X25519 as specified in RFC 7748.  Field elements modulo 2^255 - 19 are
+ * kept in five 51-bit limbs so that the products of two limbs plus the
+ * sums needed by a multiplication fit in 128 bits and the reduction is a
+ * multiplication by 19.  Limbs may grow to 52 bits between
+ * multiplications, which allows adding two reduced values without a
+ * carry pass.  Nothing branches on or indexes by secret data.
+ */
+#define FE_MASK		0x7ffffffffffffull
+
+typedef uint64_t fe[5];
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 fe_wide;
+
+static inline fe_wide wide_mul(uint64_t a, uint64_t b)
+{
+	return (fe_wide) a * b;
+}
+
+static inline void wide_add(fe_wide *acc, fe_wide v)
+{
+	*acc += v;
+}
+
+static inline void wide_add_u64(fe_wide *acc, uint64_t v)
+{
+	*acc += v;
+}
+
+static inline uint64_t wide_lo51(fe_wide v)
+{
+	return (uint64_t) v & FE_MASK;
+}
+
+static inline uint64_t wide_shr51(fe_wide v)
+{
+	return (uint64_t) (v >> 51);
+}
+#else
+typedef struct {
+	uint64_t lo;
+	uint64_t hi;
+} fe_wide;
+
+static inline fe_wide wide_mul(uint64_t a, uint64_t b)
+{
+	uint64_t a0 = a & 0xffffffffull;
+	uint64_t a1 = a >> 32;
+	uint64_t b0 = b & 0xffffffffull;
+	uint64_t b1 = b >> 32;
+	uint64_t m0 = a0 * b0;
+	uint64_t m1 = a0 * b1;
+	uint64_t m2 = a1 * b0;
+	uint64_t m3 = a1 * b1;
+	fe_wide r;
+
+	/* Operands are below 2^58 so the middle sum can't overflow */
+	m1 += m2 + (m0 >> 32);
+	r.lo = (m0 & 0xffffffffull) | (m1 << 32);
+	r.hi = m3 + (m1 >> 32);
+
+	return r;
+}
+
+static inline void wide_add(fe_wide *acc, fe_wide v)
+{
+	acc->lo += v.lo;
+	acc->hi += v.hi + (acc->lo < v.lo);
+}
+
+static inline void wide_add_u64(fe_wide *acc, uint64_t v)
+{
+	acc->lo += v;
+	acc->hi += acc->lo < v;
+}
+
+static inline uint64_t wide_lo51(fe_wide v)
+{
+	return v.lo & FE_MASK;
+}
+
+static inline uint64_t wide_shr51(fe_wide v)
+{
+	return (v.lo >> 51) | (v.hi << 13);
+}
+#endif
+
+static void fe_from_digits(fe h, const uint64_t *in)
+{
+	/* The top bit is ignored, RFC 7748 Section 5 */
+	h[0] = in[0] & FE_MASK;
+	h[1] = ((in[0] >> 51) | (in[1] << 13)) & FE_MASK;
+	h[2] = ((in[1] >> 38) | (in[2] << 26)) & FE_MASK;
+	h[3] = ((in[2] >> 25) | (in[3] << 39)) & FE_MASK;
+	h[4] = (in[3] >> 12) & FE_MASK;
+}
+
+static void fe_carry(fe h)
+{
+	uint64_t c;
+	unsigned int i;
+
+	for (i = 0; i < 4; i++) {
+		c = h[i] >> 51;
+		h[i] &= FE_MASK;
+		h[i + 1] += c;
+	}
+
+	c = h[4] >> 51;
+	h[4] &= FE_MASK;
+	h[0] += c * 19;
+}
+
+/* Fully reduces h modulo p */
+static void fe_to_digits(uint64_t *out, const fe f)
+{
+	fe h;
+	uint64_t q;
+	unsigned int i;
+
+	memcpy(h, f, sizeof(h));
+	fe_carry(h);
+	fe_carry(h);
+
+	/* q = 1 if h >= p, i.e. if h + 19 overflows 2^255 */
+	q = (h[0] + 19) >> 51;
+
+	for (i = 1; i < 5; i++)
+		q = (h[i] + q) >> 51;
+
+	h[0] += 19 * q;
+
+	for (i = 0; i < 4; i++) {
+		h[i + 1] += h[i] >> 51;
+		h[i] &= FE_MASK;
+	}
+
+	h[4] &= FE_MASK;
+
+	out[0] = h[0] | (h[1] << 51);
+	out[1] = (h[1] >> 13) | (h[2] << 38);
+	out[2] = (h[2] >> 26) | (h[3] << 25);
+	out[3] = (h[3] >> 39) | (h[4] << 12);
+}
+
+static void fe_add(fe h, const fe f, const fe g)
+{
+	unsigned int i;
+
+	for (i = 0; i < 5; i++)
+		h[i] = f[i] + g[i];
+}
+
+/* Adds 2p first so that no limb goes negative */
+static void fe_sub(fe h, const fe f, const fe g)
+{
+	h[0] = f[0] + 0xfffffffffffdaull - g[0];
+	h[1] = f[1] + 0xffffffffffffeull - g[1];
+	h[2] = f[2] + 0xffffffffffffeull - g[2];
+	h[3] = f[3] + 0xffffffffffffeull - g[3];
+	h[4] = f[4] + 0xffffffffffffeull - g[4];
+	fe_carry(h);
+}
+
+static void fe_reduce_wide(fe h, fe_wide r[5])
+{
+	uint64_t c;
+	unsigned int i;
+
+	for (i = 0; i < 4; i++) {
+		c = wide_shr51(r[i]);
+		h[i] = wide_lo51(r[i]);
+		wide_add_u64(&r[i + 1], c);
+	}
+
+	c = wide_shr51(r[4]);
+	h[4] = wide_lo51(r[4]);
+	h[0] += c * 19;
+	h[1] += h[0] >> 51;
+	h[0] &= FE_MASK;
+}
+
+static void fe_mul(fe h, const fe f, const fe g)
+{
+	uint64_t g1_19 = g[1] * 19;
+	uint64_t g2_19 = g[2] * 19;
+	uint64_t g3_19 = g[3] * 19;
+	uint64_t g4_19 = g[4] * 19;
+	fe_wide r[5];
+
+	r[0] = wide_mul(f[0], g[0]);
+	wide_add(&r[0], wide_mul(f[1], g4_19));
+	wide_add(&r[0], wide_mul(f[2], g3_19));
+	wide_add(&r[0], wide_mul(f[3], g2_19));
+	wide_add(&r[0], wide_mul(f[4], g1_19));
+
+	r[1] = wide_mul(f[0], g[1]);
+	wide_add(&r[1], wide_mul(f[1], g[0]));
+	wide_add(&r[1], wide_mul(f[2], g4_19));
+	wide_add(&r[1], wide_mul(f[3], g3_19));
+	wide_add(&r[1], wide_mul(f[4], g2_19));
+
+	r[2] = wide_mul(f[0], g[2]);
+	wide_add(&r[2], wide_mul(f[1], g[1]));
+	wide_add(&r[2], wide_mul(f[2], g[0]));
+	wide_add(&r[2], wide_mul(f[3], g4_19));
+	wide_add(&r[2], wide_mul(f[4], g3_19));
+
+	r[3] = wide_mul(f[0], g[3]);
+	wide_add(&r[3], wide_mul(f[1], g[2]));
+	wide_add(&r[3], wide_mul(f[2], g[1]));
+	wide_add(&r[3], wide_mul(f[3], g[0]));
+	wide_add(&r[3], wide_mul(f[4], g4_19));
+
+	r[4] = wide_mul(f[0], g[4]);
+	wide_add(&r[4], wide_mul(f[1], g[3]));
+	wide_add(&r[4], wide_mul(f[2], g[2]));
+	wide_add(&r[4], wide_mul(f[3], g[1]));
+	wide_add(&r[4], wide_mul(f[4], g[0]));
+
+	fe_reduce_wide(h, r);
+}
+
+static void fe_sq(fe h, const fe f)
+{
+	uint64_t f0_2 = f[0] * 2;
+	uint64_t f1_2 = f[1] * 2;
+	uint64_t f1_38 = f[1] * 38;
+	uint64_t f2_38 = f[2] * 38;
+	uint64_t f3_38 = f[3] * 38;
+	uint64_t f3_19 = f[3] * 19;
+	uint64_t f4_19 = f[4] * 19;
+	fe_wide r[5];
+
+	r[0] = wide_mul(f[0], f[0]);
+	wide_add(&r[0], wide_mul(f1_38, f[4]));
+	wide_add(&r[0], wide_mul(f2_38, f[3]));
+
+	r[1] = wide_mul(f0_2, f[1]);
+	wide_add(&r[1], wide_mul(f2_38, f[4]));
+	wide_add(&r[1], wide_mul(f3_19, f[3]));
+
+	r[2] = wide_mul(f0_2, f[2]);
+	wide_add(&r[2], wide_mul(f[1], f[1]));
+	wide_add(&r[2], wide_mul(f3_38, f[4]));
+
+	r[3] = wide_mul(f0_2, f[3]);
+	wide_add(&r[3], wide_mul(f1_2, f[2]));
+	wide_add(&r[3], wide_mul(f4_19, f[4]));
+
+	r[4] = wide_mul(f0_2, f[4]);
+	wide_add(&r[4], wide_mul(f1_2, f[3]));
+	wide_add(&r[4], wide_mul(f[2], f[2]));
+
+	fe_reduce_wide(h, r);
+}
+
+static void fe_sq_n(fe h, const fe f, unsigned int n)
+{
+	fe_sq(h, f);
+
+	while (--n)
+		fe_sq(h, h);
+}
+
+static void fe_mul_small(fe h, const fe f, uint64_t n)
+{
+	fe_wide r[5];
+	unsigned int i;
+
+	for (i = 0; i < 5; i++)
+		r[i] = wide_mul(f[i], n);
+
+	fe_reduce_wide(h, r);
+}
+
+/* Swaps f and g if mask is all ones */
+static void fe_cswap(fe f, fe g, uint64_t mask)
+{
+	unsigned int i;
+
+	for (i = 0; i < 5; i++) {
+		uint64_t t = (f[i] ^ g[i]) & mask;
+
+		f[i] ^= t;
+		g[i] ^= t;
+	}
+}
+
+/* h = z^(p - 2), the usual addition chain for 2^255 - 21 */
+static void fe_invert(fe h, const fe z)
+{
+	fe z2, z9, z11, z2_5_0, z2_10_0, z2_20_0, z2_50_0, z2_100_0, t;
+
+	fe_sq(z2, z);
+	fe_sq_n(t, z2, 2);
+	fe_mul(z9, t, z);
+	fe_mul(z11, z9, z2);
+	fe_sq(t, z11);
+	fe_mul(z2_5_0, t, z9);
+	fe_sq_n(t, z2_5_0, 5);
+	fe_mul(z2_10_0, t, z2_5_0);
+	fe_sq_n(t, z2_10_0, 10);
+	fe_mul(z2_20_0, t, z2_10_0);
+	fe_sq_n(t, z2_20_0, 20);
+	fe_mul(t, t, z2_20_0);
+	fe_sq_n(t, t, 10);
+	fe_mul(z2_50_0, t, z2_10_0);
+	fe_sq_n(t, z2_50_0, 50);
+	fe_mul(z2_100_0, t, z2_50_0);
+	fe_sq_n(t, z2_100_0, 100);
+	fe_mul(t, t, z2_100_0);
+	fe_sq_n(t, t, 50);
+	fe_mul(t, t, z2_50_0);
+	fe_sq_n(t, t, 5);
+	fe_mul(h, t, z11);
+}
+
+/*
+ * Computes the X25519 function of RFC 7748 Section 5 on 4-digit native
+ * integers: the scalar is clamped and the result is fully reduced.
+ */
+void _ecc_x25519(uint64_t *result, const uint64_t *scalar, const uint64_t *u)
+{
+	uint64_t k[4];
+	fe x1, x2, z2, x3, z3;
+	fe a, aa, b, bb, e, c, d, da, cb;
+	uint64_t swap = 0;
+	int t;
+
+	memcpy(k, scalar, sizeof(k));
+	k[0] &= ~7ull;
+	k[3] &= ~(1ull << 63);
+	k[3] |= 1ull << 62;
+
+	fe_from_digits(x1, u);
+	memset(x2, 0, sizeof(x2));
+	x2[0] = 1;
+	memset(z2, 0, sizeof(z2));
+	memcpy(x3, x1, sizeof(x3));
+	memset(z3, 0, sizeof(z3));
+	z3[0] = 1;
+
+	for (t = 254; t >= 0; t--) {
+		uint64_t bit = (k[t / 64] >> (t % 64)) & 1;
+
+		swap ^= bit;
+		fe_cswap(x2, x3, -swap);
+		fe_cswap(z2, z3, -swap);
+		swap = bit;
+
+		fe_add(a, x2, z2);
+		fe_sq(aa, a);
+		fe_sub(b, x2, z2);
+		fe_sq(bb, b);
+		fe_sub(e, aa, bb);
+		fe_add(c, x3, z3);
+		fe_sub(d, x3, z3);
+		fe_mul(da, d, a);
+		fe_mul(cb, c, b);
+
+		fe_add(x3, da, cb);
+		fe_sq(x3, x3);
+		fe_sub(z3, da, cb);
+		fe_sq(z3, z3);
+		fe_mul(z3, z3, x1);
+		fe_mul(x2, aa, bb);
+		/* a24 = (486662 - 2) / 4 */
+		fe_mul_small(z2, e, 121665);
+		fe_add(z2, z2, aa);
+		fe_mul(z2, z2, e);
+	}
+
+	fe_cswap(x2, x3, -swap);
+	fe_cswap(z2, z3, -swap);
+
+	fe_invert(z2, z2);
+	fe_mul(x2, x2, z2);
+	fe_to_digits(result, x2);
+
+	explicit_bzero(k, sizeof(k));
+}
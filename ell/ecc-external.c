@@ -41,6 +41,15 @@ typedef struct {
 	uint64_t m_high;
 } uint128_t;
 
+/*
+ * The field arithmetic below is written so that the digit count is a
+ * compile time constant for each curve, which lets the compiler unroll
+ * the loops and keep the digits in registers, and so that neither
+ * branches nor memory accesses depend on the values.
+ */
+#define ECC_INLINE static inline __attribute__((always_inline))
+#define ECC_UNROLL _Pragma("GCC unroll 12")
+
 static void vli_clear(uint64_t *vli, unsigned int ndigits)
 {
 	unsigned int i;
@@ -62,17 +71,13 @@ static bool vli_is_zero(const uint64_t *vli, unsigned int ndigits)
 	return true;
 }
 
-/* Returns nonzero if bit bit of vli is set. */
-static uint64_t vli_test_bit(const uint64_t *vli, unsigned int bit)
-{
-	return (vli[bit / 64] & ((uint64_t) 1 << (bit % 64)));
-}
-
 /* Sets dest = src. */
-static void vli_set(uint64_t *dest, const uint64_t *src, unsigned int ndigits)
+ECC_INLINE void vli_set(uint64_t *dest, const uint64_t *src,
+				unsigned int ndigits)
 {
 	unsigned int i;
 
+ECC_UNROLL
 	for (i = 0; i < ndigits; i++)
 		dest[i] = src[i];
 }
@@ -95,13 +100,14 @@ int _vli_cmp(const uint64_t *left, const uint64_t *right, unsigned int ndigits)
 /* Computes result = in << c, returning carry. Can modify in place
  * (if result == in). 0 < shift < 64.
  */
-static uint64_t vli_lshift(uint64_t *result, const uint64_t *in,
-							unsigned int shift,
-							unsigned int ndigits)
+ECC_INLINE uint64_t vli_lshift(uint64_t *result, const uint64_t *in,
+						unsigned int shift,
+						unsigned int ndigits)
 {
 	uint64_t carry = 0;
 	unsigned int i;
 
+ECC_UNROLL
 	for (i = 0; i < ndigits; i++) {
 		uint64_t temp = in[i];
 
@@ -128,47 +134,93 @@ void _vli_rshift1(uint64_t *vli, unsigned int ndigits)
 }
 
 /* Computes result = left + right, returning carry. Can modify in place. */
-uint64_t _vli_add(uint64_t *result, const uint64_t *left,
+ECC_INLINE uint64_t vli_add(uint64_t *result, const uint64_t *left,
 				const uint64_t *right, unsigned int ndigits)
 {
 	uint64_t carry = 0;
 	unsigned int i;
 
+ECC_UNROLL
 	for (i = 0; i < ndigits; i++) {
-		uint64_t sum;
+#ifdef __SIZEOF_INT128__
+		unsigned __int128 sum = (unsigned __int128) left[i] +
+							right[i] + carry;
 
-		sum = left[i] + right[i] + carry;
-		if (sum != left[i])
-			carry = (sum < left[i]);
+		result[i] = sum;
+		carry = sum >> 64;
+#else
+		uint64_t sum = left[i] + carry;
 
+		carry = sum < carry;
+		sum += right[i];
+		carry += sum < right[i];
 		result[i] = sum;
+#endif
 	}
 
 	return carry;
 }
 
 /* Computes result = left - right, returning borrow. Can modify in place. */
-uint64_t _vli_sub(uint64_t *result, const uint64_t *left,
+ECC_INLINE uint64_t vli_sub(uint64_t *result, const uint64_t *left,
 				const uint64_t *right, unsigned int ndigits)
 {
 	uint64_t borrow = 0;
 	unsigned int i;
 
+ECC_UNROLL
 	for (i = 0; i < ndigits; i++) {
-		uint64_t diff;
-
-		diff = left[i] - right[i] - borrow;
-		if (diff != left[i])
-			borrow = (diff > left[i]);
+#ifdef __SIZEOF_INT128__
+		unsigned __int128 diff = (unsigned __int128) left[i] -
+							right[i] - borrow;
 
 		result[i] = diff;
+		borrow = (diff >> 64) & 1;
+#else
+		uint64_t diff = left[i] - right[i];
+		uint64_t b = diff > left[i];
+
+		b += diff < borrow;
+		result[i] = diff - borrow;
+		borrow = b;
+#endif
 	}
 
 	return borrow;
 }
 
-static uint128_t mul_64_64(uint64_t left, uint64_t right)
+/* Sets result = mask ? a : b, mask being all ones or all zeros */
+ECC_INLINE void vli_select(uint64_t *result, const uint64_t *a,
+				const uint64_t *b, uint64_t mask,
+				unsigned int ndigits)
 {
+	unsigned int i;
+
+ECC_UNROLL
+	for (i = 0; i < ndigits; i++)
+		result[i] = (a[i] & mask) | (b[i] & ~mask);
+}
+
+uint64_t _vli_add(uint64_t *result, const uint64_t *left,
+				const uint64_t *right, unsigned int ndigits)
+{
+	return vli_add(result, left, right, ndigits);
+}
+
+uint64_t _vli_sub(uint64_t *result, const uint64_t *left,
+				const uint64_t *right, unsigned int ndigits)
+{
+	return vli_sub(result, left, right, ndigits);
+}
+
+ECC_INLINE uint128_t mul_64_64(uint64_t left, uint64_t right)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 m = (unsigned __int128) left * right;
+	uint128_t result = { m, m >> 64 };
+
+	return result;
+#else
 	uint64_t a0 = left & 0xffffffffull;
 	uint64_t a1 = left >> 32;
 	uint64_t b0 = right & 0xffffffffull;
@@ -190,21 +242,37 @@ static uint128_t mul_64_64(uint64_t left, uint64_t right)
 	result.m_high = m3 + (m2 >> 32);
 
 	return result;
+#endif
 }
 
-static uint128_t add_128_128(uint128_t a, uint128_t b)
+/* Computes a += b, returning the carry out of the 128 bits */
+ECC_INLINE uint64_t add_128_128(uint128_t *a, uint128_t b)
 {
-	uint128_t result;
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 x = (unsigned __int128) a->m_high << 64 | a->m_low;
+	unsigned __int128 y = (unsigned __int128) b.m_high << 64 | b.m_low;
 
-	result.m_low = a.m_low + b.m_low;
-	result.m_high = a.m_high + b.m_high + (result.m_low < a.m_low);
+	x += y;
+	a->m_low = x;
+	a->m_high = x >> 64;
 
-	return result;
+	return x < y;
+#else
+	uint64_t carry;
+
+	a->m_low += b.m_low;
+	carry = a->m_low < b.m_low;
+	a->m_high += carry;
+	carry = a->m_high < carry;
+	a->m_high += b.m_high;
+
+	return carry + (a->m_high < b.m_high);
+#endif
 }
 
-static void vli_mult(uint64_t *result, const uint64_t *left,
-							const uint64_t *right,
-							unsigned int ndigits)
+ECC_INLINE void vli_mult(uint64_t *result, const uint64_t *left,
+						const uint64_t *right,
+						unsigned int ndigits)
 {
 	uint128_t r01 = { 0, 0 };
 	uint64_t r2 = 0;
@@ -213,6 +281,7 @@ static void vli_mult(uint64_t *result, const uint64_t *left,
 	/* Compute each digit of result in sequence, maintaining the
 	 * carries.
 	 */
+ECC_UNROLL
 	for (k = 0; k < ndigits * 2 - 1; k++) {
 		unsigned int min;
 
@@ -221,13 +290,13 @@ static void vli_mult(uint64_t *result, const uint64_t *left,
 		else
 			min = (k + 1) - ndigits;
 
+ECC_UNROLL
 		for (i = min; i <= k && i < ndigits; i++) {
 			uint128_t product;
 
 			product = mul_64_64(left[i], right[k - i]);
 
-			r01 = add_128_128(r01, product);
-			r2 += (r01.m_high < product.m_high);
+			r2 += add_128_128(&r01, product);
 		}
 
 		result[k] = r01.m_low;
@@ -239,13 +308,14 @@ static void vli_mult(uint64_t *result, const uint64_t *left,
 	result[ndigits * 2 - 1] = r01.m_low;
 }
 
-static void vli_square(uint64_t *result, const uint64_t *left,
-			unsigned int ndigits)
+ECC_INLINE void vli_square(uint64_t *result, const uint64_t *left,
+				unsigned int ndigits)
 {
 	uint128_t r01 = { 0, 0 };
 	uint64_t r2 = 0;
 	unsigned int i, k;
 
+ECC_UNROLL
 	for (k = 0; k < ndigits * 2 - 1; k++) {
 		unsigned int min;
 
@@ -266,8 +336,7 @@ static void vli_square(uint64_t *result, const uint64_t *left,
 				product.m_low <<= 1;
 			}
 
-			r01 = add_128_128(r01, product);
-			r2 += (r01.m_high < product.m_high);
+			r2 += add_128_128(&r01, product);
 		}
 
 		result[k] = r01.m_low;
@@ -282,36 +351,69 @@ static void vli_square(uint64_t *result, const uint64_t *left,
 /* Computes result = (left + right) % mod.
  * Assumes that left < mod and right < mod, result != mod.
  */
-void _vli_mod_add(uint64_t *result, const uint64_t *left,
+ECC_INLINE void vli_mod_add(uint64_t *result, const uint64_t *left,
 				const uint64_t *right, const uint64_t *mod,
 				unsigned int ndigits)
 {
+	uint64_t tmp[L_ECC_MAX_DIGITS];
 	uint64_t carry;
+	uint64_t borrow;
 
-	carry = _vli_add(result, left, right, ndigits);
+	carry = vli_add(result, left, right, ndigits);
+	borrow = vli_sub(tmp, result, mod, ndigits);
 
-	/* result > mod (result = mod + remainder), so subtract mod to
-	 * get remainder.
-	 */
-	if (carry || _vli_cmp(result, mod, ndigits) >= 0)
-		_vli_sub(result, result, mod, ndigits);
+	/* result >= mod (result = mod + remainder), so take the remainder */
+	vli_select(result, tmp, result, -(carry | (borrow ^ 1)), ndigits);
 }
 
 /* Computes result = (left - right) % mod.
  * Assumes that left < mod and right < mod, result != mod.
  */
-void _vli_mod_sub(uint64_t *result, const uint64_t *left,
+ECC_INLINE void vli_mod_sub(uint64_t *result, const uint64_t *left,
 				const uint64_t *right, const uint64_t *mod,
 				unsigned int ndigits)
 {
-	uint64_t borrow = _vli_sub(result, left, right, ndigits);
+	uint64_t tmp[L_ECC_MAX_DIGITS];
+	uint64_t borrow = vli_sub(result, left, right, ndigits);
 
 	/* In this case, p_result == -diff == (max int) - diff.
 	 * Since -x % d == d - x, we can get the correct result from
 	 * result + mod (with overflow).
 	 */
-	if (borrow)
-		_vli_add(result, result, mod, ndigits);
+	vli_add(tmp, result, mod, ndigits);
+	vli_select(result, tmp, result, -borrow, ndigits);
+}
+
+void _vli_mod_add(uint64_t *result, const uint64_t *left,
+				const uint64_t *right, const uint64_t *mod,
+				unsigned int ndigits)
+{
+	switch (ndigits) {
+	case 4:
+		vli_mod_add(result, left, right, mod, 4);
+		break;
+	case 6:
+		vli_mod_add(result, left, right, mod, 6);
+		break;
+	default:
+		vli_mod_add(result, left, right, mod, ndigits);
+	}
+}
+
+void _vli_mod_sub(uint64_t *result, const uint64_t *left,
+				const uint64_t *right, const uint64_t *mod,
+				unsigned int ndigits)
+{
+	switch (ndigits) {
+	case 4:
+		vli_mod_sub(result, left, right, mod, 4);
+		break;
+	case 6:
+		vli_mod_sub(result, left, right, mod, 6);
+		break;
+	default:
+		vli_mod_sub(result, left, right, mod, ndigits);
+	}
 }
 
 /* Counts the number of 64-bit "digits" in vli. */
@@ -389,12 +491,64 @@ void _vli_mmod_slow(uint64_t *result, const uint64_t *product,
 	vli_set(result, v[i], ndigits);
 }
 
+/*
+ * Finishes the reductions below, where result + carry * 2^(64 * ndigits)
+ * is congruent to the product and carry is a small signed number.  Since
+ * 2^(64 * ndigits) = 2^(64 * ndigits) - prime (mod prime), and that is
+ * much smaller than prime for these curves, folding carry back in leaves
+ * at most one more addition or subtraction of prime, done in constant
+ * time.  @tmp must have room for 2 * ndigits digits.
+ */
+ECC_INLINE void vli_mmod_fold(uint64_t *result, int carry,
+				const uint64_t *curve_prime, uint64_t *tmp,
+				unsigned int ndigits)
+{
+	uint64_t *fixed = tmp + ndigits;
+	uint64_t neg = -(uint64_t) (carry < 0);
+	uint64_t q = ((uint64_t) carry ^ neg) - neg;
+	uint64_t borrow = 0;
+	uint64_t top = 0;
+	uint64_t out;
+	uint64_t mask;
+	unsigned int i;
+
+	/* tmp = |carry| * (2^(64 * ndigits) - prime), which fits */
+ECC_UNROLL
+	for (i = 0; i < ndigits; i++) {
+		uint64_t r = -curve_prime[i] - borrow;
+		uint128_t product = mul_64_64(r, q);
+
+		borrow |= curve_prime[i] != 0;
+		product.m_low += top;
+		tmp[i] = product.m_low;
+		top = product.m_high + (product.m_low < top);
+	}
+
+	out = vli_add(fixed, result, tmp, ndigits);
+	borrow = vli_sub(result, result, tmp, ndigits);
+	vli_select(result, result, fixed, neg, ndigits);
+	out = (borrow & neg) | (out & ~neg);
+
+	/*
+	 * Now either -prime < result - 2^(64 * ndigits) < 0 with a borrow
+	 * out, or 0 <= result + out * 2^(64 * ndigits) < 2 * prime
+	 */
+	mask = -out & neg;
+	vli_add(tmp, result, curve_prime, ndigits);
+	borrow = vli_sub(fixed, result, curve_prime, ndigits);
+	vli_select(result, tmp, result, mask, ndigits);
+	vli_select(result, fixed, result, ~mask & -(out | (borrow ^ 1)),
+			ndigits);
+}
+
 /* Computes p_result = p_product % curve_p.
  * See algorithm 5 and 6 from
  * http://www.isys.uni-klu.ac.at/PDF/2001-0126-MT.pdf
  */
-static void vli_mmod_fast_192(uint64_t *result, const uint64_t *product,
-				const uint64_t *curve_prime, uint64_t *tmp)
+ECC_INLINE void vli_mmod_fast_192(uint64_t *result,
+					const uint64_t *product,
+					const uint64_t *curve_prime,
+					uint64_t *tmp)
 {
 	const unsigned int ndigits = 3;
 	int carry;
@@ -402,26 +556,27 @@ static void vli_mmod_fast_192(uint64_t *result, const uint64_t *product,
 	vli_set(result, product, ndigits);
 
 	vli_set(tmp, &product[3], ndigits);
-	carry = _vli_add(result, result, tmp, ndigits);
+	carry = vli_add(result, result, tmp, ndigits);
 
 	tmp[0] = 0;
 	tmp[1] = product[3];
 	tmp[2] = product[4];
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	tmp[0] = tmp[1] = product[5];
 	tmp[2] = 0;
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
-	while (carry || _vli_cmp(curve_prime, result, ndigits) != 1)
-		carry -= _vli_sub(result, result, curve_prime, ndigits);
+	vli_mmod_fold(result, carry, curve_prime, tmp, ndigits);
 }
 
 /* Computes result = product % curve_prime
  * from http://www.nsa.gov/ia/_files/nist-routines.pdf
  */
-static void vli_mmod_fast_256(uint64_t *result, const uint64_t *product,
-				const uint64_t *curve_prime, uint64_t *tmp)
+ECC_INLINE void vli_mmod_fast_256(uint64_t *result,
+					const uint64_t *product,
+					const uint64_t *curve_prime,
+					uint64_t *tmp)
 {
 	int carry;
 	const unsigned int ndigits = 4;
@@ -435,65 +590,58 @@ static void vli_mmod_fast_256(uint64_t *result, const uint64_t *product,
 	tmp[2] = product[6];
 	tmp[3] = product[7];
 	carry = vli_lshift(tmp, tmp, 1, ndigits);
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	/* s2 */
 	tmp[1] = product[6] << 32;
 	tmp[2] = (product[6] >> 32) | (product[7] << 32);
 	tmp[3] = product[7] >> 32;
 	carry += vli_lshift(tmp, tmp, 1, ndigits);
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	/* s3 */
 	tmp[0] = product[4];
 	tmp[1] = product[5] & 0xffffffff;
 	tmp[2] = 0;
 	tmp[3] = product[7];
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	/* s4 */
 	tmp[0] = (product[4] >> 32) | (product[5] << 32);
 	tmp[1] = (product[5] >> 32) | (product[6] & 0xffffffff00000000ull);
 	tmp[2] = product[7];
 	tmp[3] = (product[6] >> 32) | (product[4] << 32);
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	/* d1 */
 	tmp[0] = (product[5] >> 32) | (product[6] << 32);
 	tmp[1] = (product[6] >> 32);
 	tmp[2] = 0;
 	tmp[3] = (product[4] & 0xffffffff) | (product[5] << 32);
-	carry -= _vli_sub(result, result, tmp, ndigits);
+	carry -= vli_sub(result, result, tmp, ndigits);
 
 	/* d2 */
 	tmp[0] = product[6];
 	tmp[1] = product[7];
 	tmp[2] = 0;
 	tmp[3] = (product[4] >> 32) | (product[5] & 0xffffffff00000000ull);
-	carry -= _vli_sub(result, result, tmp, ndigits);
+	carry -= vli_sub(result, result, tmp, ndigits);
 
 	/* d3 */
 	tmp[0] = (product[6] >> 32) | (product[7] << 32);
 	tmp[1] = (product[7] >> 32) | (product[4] << 32);
 	tmp[2] = (product[4] >> 32) | (product[5] << 32);
 	tmp[3] = (product[6] << 32);
-	carry -= _vli_sub(result, result, tmp, ndigits);
+	carry -= vli_sub(result, result, tmp, ndigits);
 
 	/* d4 */
 	tmp[0] = product[7];
 	tmp[1] = product[4] & 0xffffffff00000000ull;
 	tmp[2] = product[5];
 	tmp[3] = product[6] & 0xffffffff00000000ull;
-	carry -= _vli_sub(result, result, tmp, ndigits);
-
-	if (carry < 0) {
-		do {
-			carry += _vli_add(result, result, curve_prime, ndigits);
-		} while (carry < 0);
-	} else {
-		while (carry || _vli_cmp(curve_prime, result, ndigits) != 1)
-			carry -= _vli_sub(result, result, curve_prime, ndigits);
-	}
+	carry -= vli_sub(result, result, tmp, ndigits);
+
+	vli_mmod_fold(result, carry, curve_prime, tmp, ndigits);
 }
 
 /*
@@ -521,8 +669,10 @@ static void vli_mmod_fast_256(uint64_t *result, const uint64_t *product,
 	r;							\
 })
 
-static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
-				const uint64_t *curve_prime, uint64_t *tmp)
+ECC_INLINE void vli_mmod_fast_384(uint64_t *result,
+					const uint64_t *product,
+					const uint64_t *curve_prime,
+					uint64_t *tmp)
 {
 	int carry;
 	const unsigned int ndigits = 6;
@@ -538,7 +688,7 @@ static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
 	tmp[4] = 0;
 	tmp[5] = 0;
 	carry = vli_lshift(tmp, tmp, 1, ndigits);
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	/* s2 */
 	tmp[0] = product[6];
@@ -547,7 +697,7 @@ static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
 	tmp[3] = product[9];
 	tmp[4] = product[10];
 	tmp[5] = product[11];
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	/* s3 */
 	tmp[0] = ECC_SET_S(product, 22, 21);
@@ -556,7 +706,7 @@ static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
 	tmp[3] = ECC_SET_S(product, 16, 15);
 	tmp[4] = ECC_SET_S(product, 18, 17);
 	tmp[5] = ECC_SET_S(product, 20, 19);
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	/* s4 */
 	tmp[0] = ECC_SET_S(product, 23, -1);
@@ -565,7 +715,7 @@ static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
 	tmp[3] = ECC_SET_S(product, 15, 14);
 	tmp[4] = ECC_SET_S(product, 17, 16);
 	tmp[5] = ECC_SET_S(product, 19, 18);
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	/* s5 */
 	tmp[0] = 0;
@@ -574,7 +724,7 @@ static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
 	tmp[3] = ECC_SET_S(product, 23, 22);
 	tmp[4] = 0;
 	tmp[5] = 0;
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	/* s6 */
 	tmp[0] = ECC_SET_S(product, -1, 20);
@@ -583,7 +733,7 @@ static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
 	tmp[3] = 0;
 	tmp[4] = 0;
 	tmp[5] = 0;
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	/* s7 */
 	tmp[0] = ECC_SET_S(product, 12, 23);
@@ -592,7 +742,7 @@ static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
 	tmp[3] = ECC_SET_S(product, 18, 17);
 	tmp[4] = ECC_SET_S(product, 20, 19);
 	tmp[5] = ECC_SET_S(product, 22, 21);
-	carry -= _vli_sub(result, result, tmp, ndigits);
+	carry -= vli_sub(result, result, tmp, ndigits);
 
 	/* s8 */
 	tmp[0] = ECC_SET_S(product, 20, -1);
@@ -601,7 +751,7 @@ static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
 	tmp[3] = 0;
 	tmp[4] = 0;
 	tmp[5] = 0;
-	carry -= _vli_sub(result, result, tmp, ndigits);
+	carry -= vli_sub(result, result, tmp, ndigits);
 
 	/* s9 */
 	tmp[0] = 0;
@@ -610,16 +760,9 @@ static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
 	tmp[3] = 0;
 	tmp[4] = 0;
 	tmp[5] = 0;
-	carry -= _vli_sub(result, result, tmp, ndigits);
-
-	if (carry < 0) {
-		do {
-			carry += _vli_add(result, result, curve_prime, ndigits);
-		} while (carry < 0);
-	} else {
-		while (carry || _vli_cmp(curve_prime, result, ndigits) != 1)
-			carry -= _vli_sub(result, result, curve_prime, ndigits);
-	}
+	carry -= vli_sub(result, result, tmp, ndigits);
+
+	vli_mmod_fold(result, carry, curve_prime, tmp, ndigits);
 }
 
 /* Computes result = product % curve_prime
@@ -647,6 +790,32 @@ bool _vli_mmod_fast(uint64_t *result, const uint64_t *product,
 	return true;
 }
 
+/* Curve specific kernels with the digit count fixed at compile time */
+#define ECC_FIELD_OPS(bits, ndigits)					\
+static void vli_mod_mult_##bits(uint64_t *result, const uint64_t *left,	\
+				const uint64_t *right,			\
+				const uint64_t *curve_prime)		\
+{									\
+	uint64_t product[2 * ndigits];					\
+	uint64_t tmp[2 * ndigits];					\
+									\
+	vli_mult(product, left, right, ndigits);			\
+	vli_mmod_fast_##bits(result, product, curve_prime, tmp);	\
+}									\
+									\
+static void vli_mod_square_##bits(uint64_t *result, const uint64_t *left,\
+					const uint64_t *curve_prime)	\
+{									\
+	uint64_t product[2 * ndigits];					\
+	uint64_t tmp[2 * ndigits];					\
+									\
+	vli_square(product, left, ndigits);				\
+	vli_mmod_fast_##bits(result, product, curve_prime, tmp);	\
+}
+
+ECC_FIELD_OPS(256, 4)
+ECC_FIELD_OPS(384, 6)
+
 /* Computes result = (left * right) % curve_p. */
 void _vli_mod_mult_fast(uint64_t *result, const uint64_t *left,
 			const uint64_t *right, const uint64_t *curve_prime,
@@ -654,6 +823,15 @@ void _vli_mod_mult_fast(uint64_t *result, const uint64_t *left,
 {
 	uint64_t product[2 * L_ECC_MAX_DIGITS];
 
+	switch (ndigits) {
+	case 4:
+		vli_mod_mult_256(result, left, right, curve_prime);
+		return;
+	case 6:
+		vli_mod_mult_384(result, left, right, curve_prime);
+		return;
+	}
+
 	vli_mult(product, left, right, ndigits);
 	_vli_mmod_fast(result, product, curve_prime, ndigits);
 }
@@ -665,88 +843,264 @@ void _vli_mod_square_fast(uint64_t *result, const uint64_t *left,
 {
 	uint64_t product[2 * L_ECC_MAX_DIGITS];
 
+	switch (ndigits) {
+	case 4:
+		vli_mod_square_256(result, left, curve_prime);
+		return;
+	case 6:
+		vli_mod_square_384(result, left, curve_prime);
+		return;
+	}
+
 	vli_square(product, left, ndigits);
 	_vli_mmod_fast(result, product, curve_prime, ndigits);
 }
 
-#define EVEN(vli) (!(vli[0] & 1))
-/* Computes result = (1 / p_input) % mod. All VLIs are the same size.
- * See "From Euclid's GCD to Montgomery Multiplication to the Great Divide"
- * https://labs.oracle.com/techrep/2001/smli_tr-2001-95.pdf
+/*
+ * Modular inversion using the safegcd algorithm by Bernstein and Yang,
+ * "Fast constant-time gcd computation and modular inversion"
+ * https://gcd.cr.yp.to/safegcd-20190413.pdf
+ *
+ * The divsteps are applied 62 at a time to the low bits of f and g, the
+ * resulting transition matrix is then applied to the full width values,
+ * which are kept as signed 62-bit limbs.  The number of divsteps only
+ * depends on the size of the modulus, so neither the running time nor
+ * the memory accesses depend on the input.  The modulus must be odd.
+ */
+#define S62_MASK (UINT64_MAX >> 2)
+#define S62_MAX_LIMBS (L_ECC_MAX_DIGITS * 64 / 62 + 1)
+
+struct divstep_matrix {
+	int64_t u, v, q, r;
+};
+
+static void vli_to_s62(int64_t *out, const uint64_t *in, unsigned int ndigits,
+							unsigned int nlimbs)
+{
+	unsigned int i;
+
+	for (i = 0; i < nlimbs; i++) {
+		unsigned int w = i * 62 / 64;
+		unsigned int s = i * 62 % 64;
+		uint64_t limb = in[w] >> s;
+
+		if (s > 2 && w + 1 < ndigits)
+			limb |= in[w + 1] << (64 - s);
+
+		out[i] = limb & S62_MASK;
+	}
+}
+
+static void vli_from_s62(uint64_t *out, const int64_t *in,
+				unsigned int ndigits, unsigned int nlimbs)
+{
+	unsigned int i;
+
+	vli_clear(out, ndigits);
+
+	for (i = 0; i < nlimbs; i++) {
+		unsigned int w = i * 62 / 64;
+		unsigned int s = i * 62 % 64;
+
+		if (w >= ndigits)
+			break;
+
+		out[w] |= (uint64_t) in[i] << s;
+
+		if (s > 2 && w + 1 < ndigits)
+			out[w + 1] |= (uint64_t) in[i] >> (64 - s);
+	}
+}
+
+/*
+ * Performs 62 divsteps on the low bits of f and g and returns the new
+ * delta.  The matrix t is such that t * [f, g] / 2^62 gives the values
+ * of f and g after these steps.
  */
+static int64_t vli_divsteps_62(int64_t delta, uint64_t f, uint64_t g,
+					struct divstep_matrix *t)
+{
+	uint64_t u = 1, v = 0, q = 0, r = 1;
+	uint64_t c1, c2, x;
+	int i;
+
+	for (i = 0; i < 62; i++) {
+		/* Swap and negate if delta > 0 and g is odd */
+		c2 = -(g & 1);
+		c1 = (uint64_t) (-delta >> 63) & c2;
+
+		x = (f ^ g) & c1;
+		f ^= x;
+		g ^= x;
+		g = (g ^ c1) - c1;
+		x = (u ^ q) & c1;
+		u ^= x;
+		q ^= x;
+		q = (q ^ c1) - c1;
+		x = (v ^ r) & c1;
+		v ^= x;
+		r ^= x;
+		r = (r ^ c1) - c1;
+		delta = (delta ^ (int64_t) c1) - (int64_t) c1;
+
+		/* f is always odd, so is g if it was odd before the swap */
+		g += f & c2;
+		q += u & c2;
+		r += v & c2;
+
+		delta += 1;
+		g >>= 1;
+		u <<= 1;
+		v <<= 1;
+	}
+
+	t->u = (int64_t) u;
+	t->v = (int64_t) v;
+	t->q = (int64_t) q;
+	t->r = (int64_t) r;
+
+	return delta;
+}
+
+/* [f, g] = t * [f, g] / 2^62, the division is exact */
+static void vli_update_fg_62(int64_t *f, int64_t *g,
+				const struct divstep_matrix *t,
+				unsigned int nlimbs)
+{
+	__int128 cf, cg;
+	unsigned int i;
+
+	cf = (__int128) t->u * f[0] + (__int128) t->v * g[0];
+	cg = (__int128) t->q * f[0] + (__int128) t->r * g[0];
+	cf >>= 62;
+	cg >>= 62;
+
+	for (i = 1; i < nlimbs; i++) {
+		cf += (__int128) t->u * f[i] + (__int128) t->v * g[i];
+		cg += (__int128) t->q * f[i] + (__int128) t->r * g[i];
+		f[i - 1] = (int64_t) cf & S62_MASK;
+		g[i - 1] = (int64_t) cg & S62_MASK;
+		cf >>= 62;
+		cg >>= 62;
+	}
+
+	f[nlimbs - 1] = (int64_t) cf;
+	g[nlimbs - 1] = (int64_t) cg;
+}
+
+/*
+ * [d, e] = t * [d, e] / 2^62 modulo mod.  A multiple of mod is added to
+ * make the low 62 bits zero before dividing.  d and e are kept in the
+ * range (-2 * mod, mod).
+ */
+static void vli_update_de_62(int64_t *d, int64_t *e,
+				const struct divstep_matrix *t,
+				const int64_t *mod, uint64_t mod_inv62,
+				unsigned int nlimbs)
+{
+	int64_t sd = d[nlimbs - 1] >> 63;
+	int64_t se = e[nlimbs - 1] >> 63;
+	int64_t md = (t->u & sd) + (t->v & se);
+	int64_t me = (t->q & sd) + (t->r & se);
+	__int128 cd, ce;
+	unsigned int i;
+
+	cd = (__int128) t->u * d[0] + (__int128) t->v * e[0];
+	ce = (__int128) t->q * d[0] + (__int128) t->r * e[0];
+
+	md -= (mod_inv62 * (uint64_t) cd + md) & S62_MASK;
+	me -= (mod_inv62 * (uint64_t) ce + me) & S62_MASK;
+
+	cd += (__int128) mod[0] * md;
+	ce += (__int128) mod[0] * me;
+	cd >>= 62;
+	ce >>= 62;
+
+	for (i = 1; i < nlimbs; i++) {
+		cd += (__int128) t->u * d[i] + (__int128) t->v * e[i] +
+					(__int128) mod[i] * md;
+		ce += (__int128) t->q * d[i] + (__int128) t->r * e[i] +
+					(__int128) mod[i] * me;
+		d[i - 1] = (int64_t) cd & S62_MASK;
+		e[i - 1] = (int64_t) ce & S62_MASK;
+		cd >>= 62;
+		ce >>= 62;
+	}
+
+	d[nlimbs - 1] = (int64_t) cd;
+	e[nlimbs - 1] = (int64_t) ce;
+}
+
+static void vli_s62_carry(int64_t *r, unsigned int nlimbs)
+{
+	unsigned int i;
+
+	for (i = 0; i < nlimbs - 1; i++) {
+		r[i + 1] += r[i] >> 62;
+		r[i] &= S62_MASK;
+	}
+}
+
+/* Bring r from (-2 * mod, mod) to [0, mod), negating it if sign < 0 */
+static void vli_normalize_62(int64_t *r, int64_t sign, const int64_t *mod,
+							unsigned int nlimbs)
+{
+	int64_t cond_add = r[nlimbs - 1] >> 63;
+	int64_t cond_negate = sign >> 63;
+	unsigned int i;
+
+	for (i = 0; i < nlimbs; i++) {
+		r[i] += mod[i] & cond_add;
+		r[i] = (r[i] ^ cond_negate) - cond_negate;
+	}
+
+	vli_s62_carry(r, nlimbs);
+	cond_add = r[nlimbs - 1] >> 63;
+
+	for (i = 0; i < nlimbs; i++)
+		r[i] += mod[i] & cond_add;
+
+	vli_s62_carry(r, nlimbs);
+}
+
+/* Computes result = (1 / input) % mod, or 0 if input is 0 */
 void _vli_mod_inv(uint64_t *result, const uint64_t *input,
 						const uint64_t *mod,
 						unsigned int ndigits)
 {
-	uint64_t a[L_ECC_MAX_DIGITS], b[L_ECC_MAX_DIGITS];
-	uint64_t u[L_ECC_MAX_DIGITS], v[L_ECC_MAX_DIGITS];
-	uint64_t carry;
-	int cmp_result;
+	unsigned int nlimbs = ndigits * 64 / 62 + 1;
+	unsigned int bits = ndigits * 64;
+	/* Bound on the number of divsteps from Theorem 11.2 of the paper */
+	unsigned int nbatches = ((49 * bits + 57) / 17 + 62) / 62;
+	int64_t m[S62_MAX_LIMBS];
+	int64_t f[S62_MAX_LIMBS];
+	int64_t g[S62_MAX_LIMBS];
+	int64_t d[S62_MAX_LIMBS] = { 0 };
+	int64_t e[S62_MAX_LIMBS] = { 1 };
+	struct divstep_matrix t;
+	uint64_t mod_inv62 = mod[0];
+	int64_t delta = 1;
+	unsigned int i;
 
-	if (vli_is_zero(input, ndigits)) {
-		vli_clear(result, ndigits);
-		return;
-	}
+	/* Newton iteration, each step doubles the number of correct bits */
+	for (i = 0; i < 5; i++)
+		mod_inv62 *= 2 - mod[0] * mod_inv62;
 
-	vli_set(a, input, ndigits);
-	vli_set(b, mod, ndigits);
-	vli_clear(u, ndigits);
-	u[0] = 1;
-	vli_clear(v, ndigits);
-
-	while ((cmp_result = _vli_cmp(a, b, ndigits)) != 0) {
-		carry = 0;
-
-		if (EVEN(a)) {
-			_vli_rshift1(a, ndigits);
-
-			if (!EVEN(u))
-				carry = _vli_add(u, u, mod, ndigits);
-
-			_vli_rshift1(u, ndigits);
-			if (carry)
-				u[ndigits - 1] |= 0x8000000000000000ull;
-		} else if (EVEN(b)) {
-			_vli_rshift1(b, ndigits);
-
-			if (!EVEN(v))
-				carry = _vli_add(v, v, mod, ndigits);
-
-			_vli_rshift1(v, ndigits);
-			if (carry)
-				v[ndigits - 1] |= 0x8000000000000000ull;
-		} else if (cmp_result > 0) {
-			_vli_sub(a, a, b, ndigits);
-			_vli_rshift1(a, ndigits);
-
-			if (_vli_cmp(u, v, ndigits) < 0)
-				_vli_add(u, u, mod, ndigits);
-
-			_vli_sub(u, u, v, ndigits);
-			if (!EVEN(u))
-				carry = _vli_add(u, u, mod, ndigits);
-
-			_vli_rshift1(u, ndigits);
-			if (carry)
-				u[ndigits - 1] |= 0x8000000000000000ull;
-		} else {
-			_vli_sub(b, b, a, ndigits);
-			_vli_rshift1(b, ndigits);
-
-			if (_vli_cmp(v, u, ndigits) < 0)
-				_vli_add(v, v, mod, ndigits);
-
-			_vli_sub(v, v, u, ndigits);
-			if (!EVEN(v))
-				carry = _vli_add(v, v, mod, ndigits);
-
-			_vli_rshift1(v, ndigits);
-			if (carry)
-				v[ndigits - 1] |= 0x8000000000000000ull;
-		}
+	mod_inv62 &= S62_MASK;
+
+	vli_to_s62(m, mod, ndigits, nlimbs);
+	vli_to_s62(f, mod, ndigits, nlimbs);
+	vli_to_s62(g, input, ndigits, nlimbs);
+
+	for (i = 0; i < nbatches; i++) {
+		delta = vli_divsteps_62(delta, f[0], g[0], &t);
+		vli_update_fg_62(f, g, &t, nlimbs);
+		vli_update_de_62(d, e, &t, m, mod_inv62, nlimbs);
 	}
 
-	vli_set(result, u, ndigits);
+	/* g is now 0 and f is +/- 1, the gcd of the input and mod */
+	vli_normalize_62(d, f[nlimbs - 1], m, nlimbs);
+	vli_from_s62(result, d, ndigits, nlimbs);
 }
 
 /* ------ Point operations ------ */
@@ -763,6 +1117,9 @@ static void ecc_point_double_jacobian(uint64_t *x1, uint64_t *y1, uint64_t *z1,
 	/* t1 = x, t2 = y, t3 = z */
 	uint64_t t4[L_ECC_MAX_DIGITS];
 	uint64_t t5[L_ECC_MAX_DIGITS];
+	uint64_t t6[L_ECC_MAX_DIGITS];
+	uint64_t odd;
+	uint64_t carry;
 
 	if (vli_is_zero(z1, ndigits))
 		return;
@@ -791,13 +1148,12 @@ static void ecc_point_double_jacobian(uint64_t *x1, uint64_t *y1, uint64_t *z1,
 	_vli_mod_add(z1, x1, x1, curve_prime, ndigits);
 	/* t1 = 3*(x1^2 - z1^4) */
 	_vli_mod_add(x1, x1, z1, curve_prime, ndigits);
-	if (vli_test_bit(x1, 0)) {
-		uint64_t carry = _vli_add(x1, x1, curve_prime, ndigits);
-		_vli_rshift1(x1, ndigits);
-		x1[ndigits - 1] |= carry << 63;
-	} else {
-		_vli_rshift1(x1, ndigits);
-	}
+	/* Halve, adding curve_prime first if odd */
+	odd = -(x1[0] & 1);
+	carry = vli_add(t6, x1, curve_prime, ndigits) & odd;
+	vli_select(x1, t6, x1, odd, ndigits);
+	_vli_rshift1(x1, ndigits);
+	x1[ndigits - 1] |= carry << 63;
 	/* t1 = 3/2*(x1^2 - z1^4) = B */
 
 	/* t3 = B^2 */
@@ -952,6 +1308,36 @@ static void xycz_add_c(uint64_t *x1, uint64_t *y1, uint64_t *x2, uint64_t *y2,
 	vli_set(x1, t7, ndigits);
 }
 
+/* Swaps a and b if mask is all ones, without branching on it */
+ECC_INLINE void vli_cswap(uint64_t *a, uint64_t *b, uint64_t mask,
+				unsigned int ndigits)
+{
+	unsigned int i;
+
+ECC_UNROLL
+	for (i = 0; i < ndigits; i++) {
+		uint64_t t = (a[i] ^ b[i]) & mask;
+
+		a[i] ^= t;
+		b[i] ^= t;
+	}
+}
+
+ECC_INLINE void ecc_point_cswap(uint64_t rx[][L_ECC_MAX_DIGITS],
+				uint64_t ry[][L_ECC_MAX_DIGITS],
+				uint64_t mask, unsigned int ndigits)
+{
+	vli_cswap(rx[0], rx[1], mask, ndigits);
+	vli_cswap(ry[0], ry[1], mask, ndigits);
+}
+
+/*
+ * The ladder steps work on R[b] and R[!b] for the current scalar bit b.
+ * Rather than indexing with the secret bit the two points are swapped in
+ * place so that rx[0] always holds R[b], and the memory access pattern
+ * doesn't depend on the scalar.  @swapped tracks whether rx[0] currently
+ * holds R1.
+ */
 void _ecc_point_mult(struct l_ecc_point *result,
 			const struct l_ecc_point *point, const uint64_t *scalar,
 			uint64_t *initial_z, const uint64_t *curve_prime)
@@ -962,14 +1348,17 @@ void _ecc_point_mult(struct l_ecc_point *result,
 	uint64_t ry[2][L_ECC_MAX_DIGITS];
 	uint64_t z[L_ECC_MAX_DIGITS];
 	uint64_t sk[2][L_ECC_MAX_DIGITS];
-	int i, nb;
+	uint64_t swapped = 0;
+	uint64_t bit;
+	int i;
 	unsigned int ndigits = curve->ndigits;
 	int num_bits;
-	int carry;
+	uint64_t carry;
 
 	carry = _vli_add(sk[0], scalar, curve->n, ndigits);
 	_vli_add(sk[1], sk[0], curve->n, ndigits);
-	scalar = sk[!carry];
+	vli_select(sk[0], sk[1], sk[0], -(carry ^ 1), ndigits);
+	scalar = sk[0];
 	num_bits = sizeof(uint64_t) * ndigits * 8 + 1;
 
 	vli_set(rx[1], point->x, ndigits);
@@ -978,23 +1367,28 @@ void _ecc_point_mult(struct l_ecc_point *result,
 	xycz_initial_double(rx[1], ry[1], rx[0], ry[0], initial_z, curve_prime,
 				ndigits);
 
-	for (i = num_bits - 2; i > 0; i--) {
-		nb = !vli_test_bit(scalar, i);
-		xycz_add_c(rx[1 - nb], ry[1 - nb], rx[nb], ry[nb], curve_prime,
-				ndigits);
-		xycz_add(rx[nb], ry[nb], rx[1 - nb], ry[1 - nb], curve_prime,
-				ndigits);
-	}
+	for (i = num_bits - 2; i >= 0; i--) {
+		bit = (scalar[i / 64] >> (i % 64)) & 1;
+		ecc_point_cswap(rx, ry, -(swapped ^ bit), ndigits);
+		swapped = bit;
 
-	nb = !vli_test_bit(scalar, 0);
-	xycz_add_c(rx[1 - nb], ry[1 - nb], rx[nb], ry[nb], curve_prime,
-			ndigits);
+		xycz_add_c(rx[0], ry[0], rx[1], ry[1], curve_prime, ndigits);
+
+		if (i)
+			xycz_add(rx[1], ry[1], rx[0], ry[0], curve_prime,
+					ndigits);
+	}
 
 	/* Find final 1/Z value. */
 	/* X1 - X0 */
 	_vli_mod_sub(z, rx[1], rx[0], curve_prime, ndigits);
+
+	/* Fix the sign if R0 and R1 are swapped */
+	vli_sub(sk[1], curve_prime, z, ndigits);
+	vli_select(z, sk[1], z, -swapped, ndigits);
+
 	/* Yb * (X1 - X0) */
-	_vli_mod_mult_fast(z, z, ry[1 - nb], curve_prime, ndigits);
+	_vli_mod_mult_fast(z, z, ry[0], curve_prime, ndigits);
 	/* xP * Yb * (X1 - X0) */
 	_vli_mod_mult_fast(z, z, point->x, curve_prime, ndigits);
 
@@ -1004,17 +1398,286 @@ void _ecc_point_mult(struct l_ecc_point *result,
 	/* yP / (xP * Yb * (X1 - X0)) */
 	_vli_mod_mult_fast(z, z, point->y, curve_prime, ndigits);
 	/* Xb * yP / (xP * Yb * (X1 - X0)) */
-	_vli_mod_mult_fast(z, z, rx[1 - nb], curve_prime, ndigits);
+	_vli_mod_mult_fast(z, z, rx[0], curve_prime, ndigits);
 	/* End 1/Z calculation */
 
-	xycz_add(rx[nb], ry[nb], rx[1 - nb], ry[1 - nb], curve_prime, ndigits);
+	xycz_add(rx[1], ry[1], rx[0], ry[0], curve_prime, ndigits);
 
+	ecc_point_cswap(rx, ry, -swapped, ndigits);
 	apply_z(rx[0], ry[0], z, curve_prime, ndigits);
 
 	vli_set(result->x, rx[0], ndigits);
 	vli_set(result->y, ry[0], ndigits);
 }
 
+/* (x1, y1, z1) += (x2, y2, 1), the two points must differ */
+static void ecc_point_madd(uint64_t *x1, uint64_t *y1, uint64_t *z1,
+				const uint64_t *x2, const uint64_t *y2,
+				const uint64_t *curve_prime,
+				unsigned int ndigits)
+{
+	uint64_t t1[L_ECC_MAX_DIGITS];
+	uint64_t t2[L_ECC_MAX_DIGITS];
+	uint64_t t3[L_ECC_MAX_DIGITS];
+	uint64_t t4[L_ECC_MAX_DIGITS];
+
+	/* t2 = x2 * z1^2 = U2 */
+	_vli_mod_square_fast(t1, z1, curve_prime, ndigits);
+	_vli_mod_mult_fast(t2, x2, t1, curve_prime, ndigits);
+	/* t1 = y2 * z1^3 = S2 */
+	_vli_mod_mult_fast(t1, t1, z1, curve_prime, ndigits);
+	_vli_mod_mult_fast(t1, t1, y2, curve_prime, ndigits);
+	/* t2 = U2 - x1 = H */
+	_vli_mod_sub(t2, t2, x1, curve_prime, ndigits);
+	/* t1 = S2 - y1 = R */
+	_vli_mod_sub(t1, t1, y1, curve_prime, ndigits);
+	/* z3 = z1 * H */
+	_vli_mod_mult_fast(z1, z1, t2, curve_prime, ndigits);
+	/* t3 = H^2, t4 = H^3 */
+	_vli_mod_square_fast(t3, t2, curve_prime, ndigits);
+	_vli_mod_mult_fast(t4, t3, t2, curve_prime, ndigits);
+	/* t3 = x1 * H^2 = V */
+	_vli_mod_mult_fast(t3, x1, t3, curve_prime, ndigits);
+	/* x3 = R^2 - H^3 - 2 * V */
+	_vli_mod_square_fast(x1, t1, curve_prime, ndigits);
+	_vli_mod_sub(x1, x1, t4, curve_prime, ndigits);
+	_vli_mod_sub(x1, x1, t3, curve_prime, ndigits);
+	_vli_mod_sub(x1, x1, t3, curve_prime, ndigits);
+	/* y3 = R * (V - x3) - y1 * H^3 */
+	_vli_mod_sub(t3, t3, x1, curve_prime, ndigits);
+	_vli_mod_mult_fast(t3, t1, t3, curve_prime, ndigits);
+	_vli_mod_mult_fast(t4, y1, t4, curve_prime, ndigits);
+	_vli_mod_sub(y1, t3, t4, curve_prime, ndigits);
+}
+
+/*
+ * Fixed-base tables for multiplying the generator, built on first use.
+ * Row i holds j * 16^i * G for j = 1..15 in affine coordinates, so k * G
+ * is the sum of one entry per row picked by the 4-bit digits of k, with
+ * no doublings at all.  The partial sum is always a smaller multiple of
+ * G than the entry added to it, which keeps the addition formula valid
+ * for any 0 < k < n.  About 60 KiB for P-256 and 135 KiB for P-384.
+ */
+#define ECC_G_WINDOW		4
+#define ECC_G_ENTRIES		((1 << ECC_G_WINDOW) - 1)
+
+struct ecc_g_table {
+	const struct l_ecc_curve *curve;
+	unsigned int rows;
+	uint64_t entries[];
+};
+
+static struct ecc_g_table *ecc_g_tables[2];
+
+/* Offset of the x coordinate of j * 16^row * G, y follows it */
+static size_t ecc_g_offset(unsigned int ndigits, unsigned int row,
+				unsigned int j)
+{
+	return (row * ECC_G_ENTRIES + j - 1) * 2 * ndigits;
+}
+
+/*
+ * Computes the rows one at a time in Jacobian coordinates from the row's
+ * base 16^i * G, which is the 16th multiple computed for the previous
+ * row, and converts each row with a single inversion.
+ */
+static struct ecc_g_table *ecc_g_table_new(const struct l_ecc_curve *curve)
+{
+	unsigned int ndigits = curve->ndigits;
+	unsigned int rows = ndigits * 64 / ECC_G_WINDOW;
+	struct ecc_g_table *table;
+	uint64_t x[ECC_G_ENTRIES + 1][L_ECC_MAX_DIGITS];
+	uint64_t y[ECC_G_ENTRIES + 1][L_ECC_MAX_DIGITS];
+	uint64_t z[ECC_G_ENTRIES + 1][L_ECC_MAX_DIGITS];
+	uint64_t prefix[ECC_G_ENTRIES + 1][L_ECC_MAX_DIGITS];
+	uint64_t base_x[L_ECC_MAX_DIGITS];
+	uint64_t base_y[L_ECC_MAX_DIGITS];
+	uint64_t inv[L_ECC_MAX_DIGITS];
+	uint64_t zinv[L_ECC_MAX_DIGITS];
+	unsigned int row;
+	int j;
+
+	table = l_malloc(sizeof(*table) +
+			rows * ECC_G_ENTRIES * 2 * ndigits * sizeof(uint64_t));
+	table->curve = curve;
+	table->rows = rows;
+
+	vli_set(base_x, curve->g.x, ndigits);
+	vli_set(base_y, curve->g.y, ndigits);
+
+	for (row = 0; row < rows; row++) {
+		vli_set(x[0], base_x, ndigits);
+		vli_set(y[0], base_y, ndigits);
+		vli_clear(z[0], ndigits);
+		z[0][0] = 1;
+
+		vli_set(x[1], base_x, ndigits);
+		vli_set(y[1], base_y, ndigits);
+		vli_set(z[1], z[0], ndigits);
+		ecc_point_double_jacobian(x[1], y[1], z[1], curve->p, ndigits);
+
+		for (j = 2; j <= ECC_G_ENTRIES; j++) {
+			vli_set(x[j], x[j - 1], ndigits);
+			vli_set(y[j], y[j - 1], ndigits);
+			vli_set(z[j], z[j - 1], ndigits);
+			ecc_point_madd(x[j], y[j], z[j], base_x, base_y,
+					curve->p, ndigits);
+		}
+
+		/* Montgomery's trick: invert all the z values at once */
+		vli_set(prefix[0], z[0], ndigits);
+
+		for (j = 1; j <= ECC_G_ENTRIES; j++)
+			_vli_mod_mult_fast(prefix[j], prefix[j - 1], z[j],
+						curve->p, ndigits);
+
+		_vli_mod_inv(inv, prefix[ECC_G_ENTRIES], curve->p, ndigits);
+
+		for (j = ECC_G_ENTRIES; j >= 0; j--) {
+			if (j) {
+				_vli_mod_mult_fast(zinv, inv, prefix[j - 1],
+							curve->p, ndigits);
+				_vli_mod_mult_fast(inv, inv, z[j],
+							curve->p, ndigits);
+			} else
+				vli_set(zinv, inv, ndigits);
+
+			apply_z(x[j], y[j], zinv, curve->p, ndigits);
+		}
+
+		for (j = 0; j < ECC_G_ENTRIES; j++) {
+			uint64_t *entry = table->entries +
+					ecc_g_offset(ndigits, row, j + 1);
+
+			vli_set(entry, x[j], ndigits);
+			vli_set(entry + ndigits, y[j], ndigits);
+		}
+
+		/* x[15] = 16 * base is the next row's base */
+		vli_set(base_x, x[ECC_G_ENTRIES], ndigits);
+		vli_set(base_y, y[ECC_G_ENTRIES], ndigits);
+	}
+
+	return table;
+}
+
+static const struct ecc_g_table *ecc_g_table_get(
+					const struct l_ecc_curve *curve)
+{
+	struct ecc_g_table **slot;
+	struct ecc_g_table *table;
+	struct ecc_g_table *expected = NULL;
+
+	switch (curve->ndigits) {
+	case 4:
+		slot = &ecc_g_tables[0];
+		break;
+	case 6:
+		slot = &ecc_g_tables[1];
+		break;
+	default:
+		return NULL;
+	}
+
+	table = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	if (table)
+		return table->curve == curve ? table : NULL;
+
+	table = ecc_g_table_new(curve);
+
+	/* Another thread may have built it first */
+	if (!__atomic_compare_exchange_n(slot, &expected, table, false,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE)) {
+		l_free(table);
+		table = expected;
+	}
+
+	return table->curve == curve ? table : NULL;
+}
+
+/*
+ * Computes scalar * G using the curve's fixed-base table.  Every row is
+ * scanned in full and the additions are always performed, with the
+ * results selected by masks, so neither the timing nor the memory access
+ * pattern depends on the scalar.
+ */
+void _ecc_point_mult_g(struct l_ecc_point *result,
+			const struct l_ecc_curve *curve,
+			const uint64_t *scalar)
+{
+	const struct ecc_g_table *table = ecc_g_table_get(curve);
+	unsigned int ndigits = curve->ndigits;
+	uint64_t x[L_ECC_MAX_DIGITS];
+	uint64_t y[L_ECC_MAX_DIGITS];
+	uint64_t z[L_ECC_MAX_DIGITS];
+	uint64_t tx[L_ECC_MAX_DIGITS];
+	uint64_t ty[L_ECC_MAX_DIGITS];
+	uint64_t tz[L_ECC_MAX_DIGITS];
+	uint64_t ax[L_ECC_MAX_DIGITS];
+	uint64_t ay[L_ECC_MAX_DIGITS];
+	uint64_t one[L_ECC_MAX_DIGITS];
+	uint64_t empty = -1;
+	unsigned int row;
+	unsigned int j;
+
+	/* The table sums are only valid for 0 < scalar < n */
+	if (!table || vli_is_zero(scalar, ndigits) ||
+			_vli_cmp(scalar, curve->n, ndigits) >= 0) {
+		_ecc_point_mult(result, &curve->g, scalar, NULL, curve->p);
+		return;
+	}
+
+	vli_clear(one, ndigits);
+	one[0] = 1;
+	vli_set(x, curve->g.x, ndigits);
+	vli_set(y, curve->g.y, ndigits);
+	vli_set(z, one, ndigits);
+
+	for (row = 0; row < table->rows; row++) {
+		unsigned int shift = (row % (64 / ECC_G_WINDOW)) * ECC_G_WINDOW;
+		uint64_t digit = (scalar[row / (64 / ECC_G_WINDOW)] >> shift) &
+							ECC_G_ENTRIES;
+		uint64_t nonzero = -((digit | -digit) >> 63);
+
+		vli_clear(ax, ndigits);
+		vli_clear(ay, ndigits);
+
+		for (j = 1; j <= ECC_G_ENTRIES; j++) {
+			const uint64_t *entry = table->entries +
+					ecc_g_offset(ndigits, row, j);
+			uint64_t diff = digit ^ j;
+			uint64_t mask = ((diff | -diff) >> 63) - 1;
+
+			vli_select(ax, entry, ax, mask, ndigits);
+			vli_select(ay, entry + ndigits, ay, mask, ndigits);
+		}
+
+		vli_set(tx, x, ndigits);
+		vli_set(ty, y, ndigits);
+		vli_set(tz, z, ndigits);
+		ecc_point_madd(tx, ty, tz, ax, ay, curve->p, ndigits);
+
+		/* Nothing accumulated yet: take the entry as is */
+		vli_select(tx, ax, tx, empty, ndigits);
+		vli_select(ty, ay, ty, empty, ndigits);
+		vli_select(tz, one, tz, empty, ndigits);
+
+		/* Zero digit: keep what was accumulated */
+		vli_select(x, tx, x, nonzero, ndigits);
+		vli_select(y, ty, y, nonzero, ndigits);
+		vli_select(z, tz, z, nonzero, ndigits);
+
+		empty &= ~nonzero;
+	}
+
+	_vli_mod_inv(z, z, curve->p, ndigits);
+	apply_z(x, y, z, curve->p, ndigits);
+
+	vli_set(result->x, x, ndigits);
+	vli_set(result->y, y, ndigits);
+}
+
 /* Returns true if p_point is the point at infinity, false otherwise. */
 bool _ecc_point_is_zero(const struct l_ecc_point *point)
 {
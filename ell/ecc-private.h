@@ -29,6 +29,10 @@ struct l_ecc_curve {
 	uint64_t n[L_ECC_MAX_DIGITS];
 	uint64_t b[L_ECC_MAX_DIGITS];
 	int z;
+	/* sqrt(-z)^3 modulo p, used by the SSWU map */
+	uint64_t sswu_c2[L_ECC_MAX_DIGITS];
+	/* x-only Montgomery curve, only usable for ECDH, see ecc-25519.c */
+	bool montgomery;
 };
 
 struct l_ecc_scalar {
@@ -121,6 +125,10 @@ bool _ecc_compute_y(const struct l_ecc_curve *curve, uint64_t *y,
 void _ecc_point_mult(struct l_ecc_point *result,
 			const struct l_ecc_point *point, const uint64_t *scalar,
 			uint64_t *initial_z, const uint64_t *curve_prime);
+void _ecc_point_mult_g(struct l_ecc_point *result,
+			const struct l_ecc_curve *curve,
+			const uint64_t *scalar);
+void _ecc_x25519(uint64_t *result, const uint64_t *scalar, const uint64_t *u);
 void _ecc_point_add(struct l_ecc_point *ret, const struct l_ecc_point *p,
 			const struct l_ecc_point *q,
 			const uint64_t *curve_prime);
@@ -16,6 +16,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "ecc.h"
 #include "ecc-private.h"
@@ -37,6 +38,9 @@
 			0xFFFFFFFFFFFFFFFFull, 0xFFFFFFFF00000000ull }
 #define P256_CURVE_B { 0x3BCE3C3E27D2604Bull, 0x651D06B0CC53B0F6ull,   \
 			0xB3EBBD55769886BCull, 0x5AC635D8AA3A93E7ull }
+/* sqrt(-z)^3 for z = -10, see l_ecc_point_from_sswu() */
+#define P256_SSWU_C2 { 0xC004098EEA05ACFEull, 0xD3833FAAFB5A591Dull, \
+			0xDEB9DC092F06AAF8ull, 0x87438E5ED27613F9ull }
 
 static const struct l_ecc_curve p256 = {
 	.name = "secp256r1",
@@ -52,6 +56,7 @@ static const struct l_ecc_curve p256 = {
 	.n = P256_CURVE_N,
 	.b = P256_CURVE_B,
 	.z = -10,
+	.sswu_c2 = P256_SSWU_C2,
 };
 
 /*
@@ -72,6 +77,10 @@ static const struct l_ecc_curve p256 = {
 #define P384_CURVE_B {	0x2A85C8EDD3EC2AEFull, 0xC656398D8A2ED19Dull, \
 			0x0314088F5013875Aull, 0x181D9C6EFE814112ull, \
 			0x988E056BE3F82D19ull, 0xB3312FA7E23EE7E4ull }
+/* sqrt(-z)^3 for z = -12, see l_ecc_point_from_sswu() */
+#define P384_SSWU_C2 { 0xFAA314F583C9D066ull, 0xD0A697A9E0B9E92Cull, \
+			0x7A563D8B598A0940ull, 0xFB2AAA2E0E87EA55ull, \
+			0x5743C0AE2E3A3E61ull, 0x019877CC1041B755ull }
 
 static const struct l_ecc_curve p384 = {
 	.name = "secp384r1",
@@ -87,59 +96,83 @@ static const struct l_ecc_curve p384 = {
 	.n = P384_CURVE_N,
 	.b = P384_CURVE_B,
 	.z = -12,
+	.sswu_c2 = P384_SSWU_C2,
+};
+
+/*
+ * RFC 7748 - Section 4.1 Curve25519, only usable for X25519 key exchange.
+ * Points are represented by their u coordinate alone and all encodings
+ * are little-endian as in RFC 7748.  Not defined for IKE here because
+ * the IKE users expect the full set of point operations.
+ */
+#define X25519_CURVE_P { 0xFFFFFFFFFFFFFFEDull, 0xFFFFFFFFFFFFFFFFull, \
+			0xFFFFFFFFFFFFFFFFull, 0x7FFFFFFFFFFFFFFFull }
+#define X25519_CURVE_N { 0x5812631A5CF5D3EDull, 0x14DEF9DEA2F79CD6ull, \
+			0x0000000000000000ull, 0x1000000000000000ull }
+
+static const struct l_ecc_curve x25519 = {
+	.name = "x25519",
+	.tls_group = 29,
+	.ndigits = 4,
+	.g = {
+		.x = { 9 },
+		.curve = &x25519
+	},
+	.p = X25519_CURVE_P,
+	.n = X25519_CURVE_N,
+	.montgomery = true,
 };
 
 static const struct l_ecc_curve *curves[] = {
 	&p384,
+	&x25519,
 	&p256,
 };
 
-/* Returns supported IKE groups, sorted by the highest effective key size */
-LIB_EXPORT const unsigned int *l_ecc_supported_ike_groups(void)
-{
-	static unsigned int supported_ike_groups[L_ARRAY_SIZE(curves) + 1];
-	static bool ike_first = true;
+static unsigned int supported_ike_groups[L_ARRAY_SIZE(curves) + 1];
+static unsigned int supported_tls_groups[L_ARRAY_SIZE(curves) + 1];
+static pthread_once_t supported_groups_once = PTHREAD_ONCE_INIT;
 
-	if (ike_first) {
-		unsigned int i;
+static void init_supported_groups(void)
+{
+	unsigned int i;
+	unsigned int n = 0;
 
-		for (i = 0; i < L_ARRAY_SIZE(curves); i++)
-			supported_ike_groups[i] = curves[i]->ike_group;
+	for (i = 0; i < L_ARRAY_SIZE(curves); i++) {
+		supported_tls_groups[i] = curves[i]->tls_group;
 
-		supported_ike_groups[i] = 0;
-		ike_first = false;
+		if (curves[i]->ike_group)
+			supported_ike_groups[n++] = curves[i]->ike_group;
 	}
 
+	supported_tls_groups[i] = 0;
+	supported_ike_groups[n] = 0;
+}
+
+/* Returns supported IKE groups, sorted by the highest effective key size */
+LIB_EXPORT const unsigned int *l_ecc_supported_ike_groups(void)
+{
+	pthread_once(&supported_groups_once, init_supported_groups);
+
 	return supported_ike_groups;
 }
 
 /* Returns supported TLS groups, sorted by the highest effective key size */
 LIB_EXPORT const unsigned int *l_ecc_supported_tls_groups(void)
 {
-	static unsigned int supported_tls_groups[L_ARRAY_SIZE(curves) + 1];
-	static bool tls_first = true;
-
-	if (tls_first) {
-		unsigned int i;
-
-		for (i = 0; i < L_ARRAY_SIZE(curves); i++)
-			supported_tls_groups[i] = curves[i]->tls_group;
-
-		supported_tls_groups[i] = 0;
-		tls_first = false;
-	}
+	pthread_once(&supported_groups_once, init_supported_groups);
 
 	return supported_tls_groups;
 }
 
 LIB_EXPORT const struct l_ecc_curve *l_ecc_curve_from_name(const char *name)
 {
-	int i;
+	unsigned int i;
 
 	if (unlikely(!name))
 		return NULL;
 
-	for (i = 0; curves[i]; i++) {
+	for (i = 0; i < L_ARRAY_SIZE(curves); i++) {
 		if (!strcmp(curves[i]->name, name))
 			return curves[i];
 	}
@@ -152,6 +185,9 @@ LIB_EXPORT const struct l_ecc_curve *l_ecc_curve_from_ike_group(
 {
 	unsigned int i;
 
+	if (!group)
+		return NULL;
+
 	for (i = 0; i < L_ARRAY_SIZE(curves); i++) {
 		if (curves[i]->ike_group == group)
 			return curves[i];
@@ -255,6 +291,24 @@ static bool ecc_valid_point(struct l_ecc_point *point)
 	return (_vli_cmp(tmp1, tmp2, ndigits) == 0);
 }
 
+static void ecc_le2native(uint64_t *dest, const void *bytes,
+				unsigned int ndigits)
+{
+	unsigned int i;
+
+	for (i = 0; i < ndigits; i++)
+		dest[i] = l_get_le64(bytes + i * 8);
+}
+
+static void ecc_native2le(void *dest, const uint64_t *native,
+				unsigned int ndigits)
+{
+	unsigned int i;
+
+	for (i = 0; i < ndigits; i++)
+		l_put_le64(native[i], dest + i * 8);
+}
+
 void _ecc_be2native(uint64_t *dest, const uint64_t *bytes,
 							unsigned int ndigits)
 {
@@ -429,29 +483,47 @@ void _ecc_point_add(struct l_ecc_point *ret, const struct l_ecc_point *p,
 	memcpy(ret->y, resy, ndigits * 8);
 }
 
-/* result = (base ^ exp) % p */
+/*
+ * result = (base ^ exp) % p
+ *
+ * Uses fixed 4-bit windows, which for the dense exponents used here needs
+ * about a quarter of the non-squaring multiplications of plain
+ * square-and-multiply.  The exponent is not treated as secret, all the
+ * exponents used are derived from the curve prime.
+ */
 void _vli_mod_exp(uint64_t *result, const uint64_t *base, const uint64_t *exp,
 			const uint64_t *mod, unsigned int ndigits)
 {
-	unsigned int i;
-	int bit;
-	uint64_t n[L_ECC_MAX_DIGITS];
+	uint64_t table[16][L_ECC_MAX_DIGITS];
 	uint64_t r[L_ECC_MAX_DIGITS] = { 1 };
+	bool started = false;
+	unsigned int w;
+	int i;
 
-	memcpy(n, base, ndigits * 8);
+	memcpy(table[1], base, ndigits * 8);
 
-	for (i = 0; i < ndigits; i++) {
-		for (bit = 0; bit < 64; bit++) {
-			uint64_t tmp[L_ECC_MAX_DIGITS];
+	for (w = 2; w < 16; w++)
+		_vli_mod_mult_fast(table[w], table[w - 1], base, mod, ndigits);
 
-			if (exp[i] & (1ull << bit)) {
-				_vli_mod_mult_fast(tmp, r, n, mod, ndigits);
-				memcpy(r, tmp, ndigits * 8);
-			}
+	for (i = ndigits * 16 - 1; i >= 0; i--) {
+		w = (exp[i / 16] >> (i % 16 * 4)) & 0xf;
 
-			_vli_mod_mult_fast(tmp, n, n, mod, ndigits);
-			memcpy(n, tmp, ndigits * 8);
+		if (started) {
+			_vli_mod_square_fast(r, r, mod, ndigits);
+			_vli_mod_square_fast(r, r, mod, ndigits);
+			_vli_mod_square_fast(r, r, mod, ndigits);
+			_vli_mod_square_fast(r, r, mod, ndigits);
 		}
+
+		if (!w)
+			continue;
+
+		if (started)
+			_vli_mod_mult_fast(r, r, table[w], mod, ndigits);
+		else
+			memcpy(r, table[w], ndigits * 8);
+
+		started = true;
 	}
 
 	memcpy(result, r, ndigits * 8);
@@ -525,6 +597,15 @@ LIB_EXPORT struct l_ecc_point *l_ecc_point_from_data(
 	if (!data)
 		return NULL;
 
+	if (curve->montgomery) {
+		if (type != L_ECC_POINT_TYPE_COMPLIANT || len != bytes)
+			return NULL;
+
+		p = l_ecc_point_new(curve);
+		ecc_le2native(p->x, data, curve->ndigits);
+		return p;
+	}
+
 	/* Verify the data length matches a full point or X coordinate */
 	if (type == L_ECC_POINT_TYPE_FULL) {
 		if (len != bytes * 2)
@@ -593,67 +674,58 @@ LIB_EXPORT struct l_ecc_point *l_ecc_point_from_sswu(
 	const struct l_ecc_curve *curve = u->curve;
 	unsigned int ndigits = curve->ndigits;
 	uint64_t z[L_ECC_MAX_DIGITS] = { abs(curve->z) };
+	uint64_t _1[L_ECC_MAX_DIGITS] = { 1ull };
 	uint64_t _3[L_ECC_MAX_DIGITS] = { 3ull }; /* -a = 3 */
+	uint64_t u2[L_ECC_MAX_DIGITS];
 	uint64_t u2z[L_ECC_MAX_DIGITS];
 	uint64_t t1[L_ECC_MAX_DIGITS];
 	uint64_t t2[L_ECC_MAX_DIGITS];
 	uint64_t m[L_ECC_MAX_DIGITS];
-	uint64_t t[L_ECC_MAX_DIGITS];
-	uint64_t x1l[L_ECC_MAX_DIGITS];
-	uint64_t x1r[L_ECC_MAX_DIGITS];
 	uint64_t x1[L_ECC_MAX_DIGITS];
 	uint64_t gx1[L_ECC_MAX_DIGITS];
 	uint64_t x2[L_ECC_MAX_DIGITS];
-	uint64_t gx2[L_ECC_MAX_DIGITS];
-	/* reuse m/t/x1l,x1r, they are unused by the time x/v/y/p-y is needed */
+	uint64_t y1[L_ECC_MAX_DIGITS];
+	uint64_t y2[L_ECC_MAX_DIGITS];
+	/* reuse m/t1/t2, they are unused by the time x/y/p-y is needed */
 	uint64_t *x = m;
-	uint64_t *v = t;
-	uint64_t *yl = x1l;
-	uint64_t *yr = x1r;
+	uint64_t *yl = t1;
+	uint64_t *yr = t2;
 	bool l;
 	struct l_ecc_point *P;
 
+	if (curve->montgomery)
+		return NULL;
+
 	/*
 	 * m = (z^2 * u^4 + z * u^2) modulo p
 	 * u2z = u^2 * z
 	 * t2 = u2z^2
 	 * m = t2 - u2z since for all our curves z is negative
 	 */
-	_vli_mod_square_fast(u2z, u->c, curve->p, ndigits);
-	_vli_mod_mult_fast(u2z, u2z, z, curve->p, ndigits);
+	_vli_mod_square_fast(u2, u->c, curve->p, ndigits);
+	_vli_mod_mult_fast(u2z, u2, z, curve->p, ndigits);
 	_vli_mod_square_fast(t2, u2z, curve->p, ndigits);
 	_vli_mod_sub(m, t2, u2z, curve->p, ndigits);
 
+	/* l = CEQ(m, 0) */
+	l = l_secure_memeq(m, ndigits * 8, 0);
+
 	/*
-	 * l = CEQ(m, 0)
-	 * t = inv0(m) where inv0(x) is calculated as x^(p-2) modulo p
+	 * x1 = CSEL(l, (b / (z*a) modulo p), ((-b/a) * (1 + inv0(m))) modulo p)
+	 *
+	 * Both z and a are negative, so with t = inv0(m) this is the same as
+	 * CSEL(l, b / (3 * |z|), b * (m + 1) / (3 * m)), which only needs a
+	 * single inversion of a value that is never zero.
 	 */
-	l = l_secure_memeq(m, sizeof(m), 0);
-
-	memset(t2, 0, sizeof(t2));
-	t2[0] = 2ull;
-	_vli_mod_sub(t1, curve->p, t2, curve->p, ndigits);
-	_vli_mod_exp(t, m, t1, curve->p, ndigits);
-
-	/* Calculate: b / z*a, both z and a are negative */
-	_vli_mod_mult_fast(t1, z, _3, curve->p, ndigits);
+	l_secure_select(l, z, m, t1, ndigits * 8);
+	_vli_mod_mult_fast(t1, t1, _3, curve->p, ndigits);
 	_vli_mod_inv(t1, t1, curve->p, ndigits);
-	_vli_mod_mult_fast(x1l, curve->b, t1, curve->p, ndigits);
-
-	/* t = 1 + t */
-	memset(t2, 0, sizeof(t2));
-	t2[0] = 1ull;
-	_vli_mod_add(t, t, t2, curve->p, ndigits);
-
-	/* t1 = 1 / a */
-	_vli_mod_inv(t1, _3, curve->p, ndigits);
 
-	/* x1r = b * t1 * t */
-	_vli_mod_mult_fast(x1r, curve->b, t1, curve->p, ndigits);
-	_vli_mod_mult_fast(x1r, x1r, t, curve->p, ndigits);
+	_vli_mod_add(t2, m, _1, curve->p, ndigits);
+	l_secure_select(l, _1, t2, t2, ndigits * 8);
 
-	/* x1 = CSEL(l, (b / (z*a) modulo p), ((-b/a) * (1 + t)) modulo p) */
-	l_secure_select(l, x1l, x1r, x1, ndigits * 8);
+	_vli_mod_mult_fast(x1, curve->b, t2, curve->p, ndigits);
+	_vli_mod_mult_fast(x1, x1, t1, curve->p, ndigits);
 
 	/* gx1 = (x1^3 + a*x1 + b) modulo p */
 	ecc_compute_y_sqr(curve, gx1, x1);
@@ -662,24 +734,24 @@ LIB_EXPORT struct l_ecc_point *l_ecc_point_from_sswu(
 	_vli_mod_mult_fast(x2, u2z, x1, curve->p, ndigits);
 	_vli_mod_sub(x2, curve->p, x2, curve->p, ndigits);
 
-	/* gx2 = (x2^3 + a*x2 + b) modulo p */
-	ecc_compute_y_sqr(curve, gx2, x2);
-
 	/*
-	 * l = gx1 is a quadratic residue modulo p
-	 * x is a quadratic residue if x^((p-1)/2) modulo p is zero or one
+	 * y1 = gx1^((p + 1) / 4) is a square root of gx1 if gx1 is a
+	 * quadratic residue, otherwise y1^2 = -gx1.  In that case, since
+	 * gx2 = z^3 * u^6 * gx1, the square root of gx2 is
+	 * sqrt(-z)^3 * u^3 * y1, which saves a second exponentiation.
 	 */
-	_vli_mod_sub(t1, curve->p, t2, curve->p, ndigits);
-	_vli_rshift1(t1, ndigits);
-	_vli_mod_exp(t2, gx1, t1, curve->p, ndigits);
-	l = _vli_is_zero_or_one(t2, ndigits);
+	ecc_compute_sqrt(curve, y1, gx1);
+	_vli_mod_square_fast(t1, y1, curve->p, ndigits);
+	l = vli_equal(t1, gx1, ndigits);
+
+	_vli_mod_mult_fast(y2, u2, u->c, curve->p, ndigits);
+	_vli_mod_mult_fast(y2, y2, curve->sswu_c2, curve->p, ndigits);
+	_vli_mod_mult_fast(y2, y2, y1, curve->p, ndigits);
 
-	/* v = CSEL(l, gx1, gx2) */
-	l_secure_select(l, gx1, gx2, v, ndigits * 8);
 	/* x = CSEL(l, x1, x2) */
 	l_secure_select(l, x1, x2, x, ndigits * 8);
-	/* y = sqrt(v) */
-	ecc_compute_sqrt(curve, yl, v);
+	/* y = CSEL(l, y1, y2) */
+	l_secure_select(l, y1, y2, yl, ndigits * 8);
 	/* l = CEQ(LSB(u), LSB(y)) */
 	l = !((u->c[0] & 1ull) ^ (yl[0] & 1ull));
 
@@ -717,6 +789,11 @@ LIB_EXPORT ssize_t l_ecc_point_get_x(const struct l_ecc_point *p, void *x,
 	if (xlen < p->curve->ndigits * 8)
 		return -EMSGSIZE;
 
+	if (p->curve->montgomery) {
+		ecc_native2le(x, p->x, p->curve->ndigits);
+		return p->curve->ndigits * 8;
+	}
+
 	_ecc_native2be(x, p->x, p->curve->ndigits);
 
 	return p->curve->ndigits * 8;
@@ -725,6 +802,9 @@ LIB_EXPORT ssize_t l_ecc_point_get_x(const struct l_ecc_point *p, void *x,
 LIB_EXPORT ssize_t l_ecc_point_get_y(const struct l_ecc_point *p, void *y,
 					size_t ylen)
 {
+	if (p->curve->montgomery)
+		return -ENOTSUP;
+
 	if (ylen < p->curve->ndigits * 8)
 		return -EMSGSIZE;
 
@@ -741,6 +821,10 @@ LIB_EXPORT bool l_ecc_point_y_isodd(const struct l_ecc_point *p)
 LIB_EXPORT ssize_t l_ecc_point_get_data(const struct l_ecc_point *p, void *buf,
 					size_t len)
 {
+	/* RFC 7748 Section 5: just the u coordinate */
+	if (p->curve->montgomery)
+		return l_ecc_point_get_x(p, buf, len);
+
 	if (len < (p->curve->ndigits * 8) * 2)
 		return -EMSGSIZE;
 
@@ -795,6 +879,17 @@ LIB_EXPORT struct l_ecc_scalar *l_ecc_scalar_new(
 	if (!buf)
 		return c;
 
+	/* Any string of 32 bytes, clamped when used, RFC 7748 Section 5 */
+	if (curve->montgomery) {
+		if (len != curve->ndigits * 8) {
+			l_ecc_scalar_free(c);
+			return NULL;
+		}
+
+		ecc_le2native(c->c, buf, curve->ndigits);
+		return c;
+	}
+
 	_ecc_be2native(c->c, buf, curve->ndigits);
 
 	if (!_vli_is_zero_or_one(c->c, curve->ndigits) &&
@@ -827,7 +922,7 @@ LIB_EXPORT struct l_ecc_scalar *l_ecc_scalar_new_modp(
 	uint64_t tmp[2 * L_ECC_MAX_DIGITS];
 	unsigned int ndigits = len / 8;
 
-	if (!bytes)
+	if (!bytes || curve->montgomery)
 		return NULL;
 
 	if (len % 8)
@@ -862,7 +957,7 @@ LIB_EXPORT struct l_ecc_scalar *l_ecc_scalar_new_modn(
 	uint64_t tmp[2 * L_ECC_MAX_DIGITS];
 	unsigned int ndigits = len / 8;
 
-	if (!bytes)
+	if (!bytes || curve->montgomery)
 		return NULL;
 
 	if (len % 8)
@@ -902,7 +997,7 @@ LIB_EXPORT struct l_ecc_scalar *l_ecc_scalar_new_reduced_1_to_n(
 	uint64_t tmp[L_ECC_MAX_DIGITS];
 	struct l_ecc_scalar *c;
 
-	if (!buf)
+	if (!buf || curve->montgomery)
 		return NULL;
 
 	if (len != curve->ndigits * 8)
@@ -930,6 +1025,10 @@ LIB_EXPORT struct l_ecc_scalar *l_ecc_scalar_new_random(
 
 	l_getrandom(r, curve->ndigits * 8);
 
+	/* Any 32 bytes are a valid X25519 private key */
+	if (curve->montgomery)
+		return _ecc_constant_new(curve, r, curve->ndigits * 8);
+
 	while (_vli_cmp(r, curve->p, curve->ndigits) > 0 ||
 			_vli_cmp(r, curve->n, curve->ndigits) > 0 ||
 			_vli_is_zero_or_one(r, curve->ndigits))
@@ -944,7 +1043,10 @@ LIB_EXPORT ssize_t l_ecc_scalar_get_data(const struct l_ecc_scalar *c,
 	if (len < c->curve->ndigits * 8)
 		return -EMSGSIZE;
 
-	_ecc_native2be(buf, (uint64_t *) c->c, c->curve->ndigits);
+	if (c->curve->montgomery)
+		ecc_native2le(buf, c->c, c->curve->ndigits);
+	else
+		_ecc_native2be(buf, (uint64_t *) c->c, c->curve->ndigits);
 
 	return c->curve->ndigits * 8;
 }
@@ -978,6 +1080,11 @@ LIB_EXPORT bool l_ecc_point_multiply(struct l_ecc_point *ret,
 	if (unlikely(!ret || !scalar || !point))
 		return false;
 
+	if (scalar->curve->montgomery) {
+		_ecc_x25519(ret->x, scalar->c, point->x);
+		return true;
+	}
+
 	_ecc_point_mult(ret, point, scalar->c, NULL, scalar->curve->p);
 
 	return true;
@@ -989,8 +1096,12 @@ LIB_EXPORT bool l_ecc_point_multiply_g(struct l_ecc_point *ret,
 	if (unlikely(!ret || !scalar))
 		return false;
 
-	_ecc_point_mult(ret, &scalar->curve->g, scalar->c, NULL,
-						scalar->curve->p);
+	if (scalar->curve->montgomery) {
+		_ecc_x25519(ret->x, scalar->c, scalar->curve->g.x);
+		return true;
+	}
+
+	_ecc_point_mult_g(ret, scalar->curve, scalar->c);
 
 	return true;
 }
@@ -999,7 +1110,7 @@ LIB_EXPORT bool l_ecc_point_add(struct l_ecc_point *ret,
 					const struct l_ecc_point *a,
 					const struct l_ecc_point *b)
 {
-	if (unlikely(!ret || !a || !b))
+	if (unlikely(!ret || !a || !b || a->curve->montgomery))
 		return false;
 
 	_ecc_point_add(ret, a, b, a->curve->p);
@@ -1009,7 +1120,7 @@ LIB_EXPORT bool l_ecc_point_add(struct l_ecc_point *ret,
 
 LIB_EXPORT bool l_ecc_point_inverse(struct l_ecc_point *p)
 {
-	if (unlikely(!p))
+	if (unlikely(!p || p->curve->montgomery))
 		return false;
 
 	_vli_mod_sub(p->y, p->curve->p, p->y, p->curve->p, p->curve->ndigits);
@@ -1021,7 +1132,7 @@ LIB_EXPORT bool l_ecc_scalar_multiply(struct l_ecc_scalar *ret,
 					const struct l_ecc_scalar *a,
 					const struct l_ecc_scalar *b)
 {
-	if (unlikely(!ret || !a || !b))
+	if (unlikely(!ret || !a || !b || a->curve->montgomery))
 		return false;
 
 	_vli_mod_mult_fast(ret->c, a->c, b->c, a->curve->p, a->curve->ndigits);
@@ -1031,7 +1142,7 @@ LIB_EXPORT bool l_ecc_scalar_multiply(struct l_ecc_scalar *ret,
 
 LIB_EXPORT int l_ecc_scalar_legendre(struct l_ecc_scalar *value)
 {
-	if (unlikely(!value))
+	if (unlikely(!value || value->curve->montgomery))
 		return -1;
 
 	return _vli_legendre(value->c, value->curve->p, value->curve->ndigits);
@@ -1040,7 +1151,7 @@ LIB_EXPORT int l_ecc_scalar_legendre(struct l_ecc_scalar *value)
 LIB_EXPORT bool l_ecc_scalar_sum_x(struct l_ecc_scalar *ret,
 					const struct l_ecc_scalar *x)
 {
-	if (unlikely(!ret || !x))
+	if (unlikely(!ret || !x || x->curve->montgomery))
 		return false;
 
 	ecc_compute_y_sqr(x->curve, ret->c, x->c);
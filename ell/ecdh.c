@@ -10,6 +10,7 @@
 #endif
 
 #include <stdint.h>
+#include <string.h>
 
 #include "private.h"
 #include "ecc-private.h"
@@ -45,6 +46,14 @@ LIB_EXPORT bool l_ecdh_generate_key_pair(const struct l_ecc_curve *curve,
 	if (unlikely(!curve || !out_private || !out_public))
 		return false;
 
+	/* RFC 7748 Section 6.1, every 32-byte string is a valid key */
+	if (curve->montgomery) {
+		*out_private = l_ecc_scalar_new_random(curve);
+		*out_public = l_ecc_point_new(curve);
+		_ecc_x25519((*out_public)->x, (*out_private)->c, curve->g.x);
+		return true;
+	}
+
 	_ecc_calculate_p2(curve, p2);
 
 	*out_public = l_ecc_point_new(curve);
@@ -52,8 +61,7 @@ LIB_EXPORT bool l_ecdh_generate_key_pair(const struct l_ecc_curve *curve,
 	while (!compliant && iter++ < ECDH_MAX_ITERATIONS) {
 		*out_private = l_ecc_scalar_new_random(curve);
 
-		_ecc_point_mult(*out_public, &curve->g, (*out_private)->c,
-					NULL, curve->p);
+		_ecc_point_mult_g(*out_public, curve, (*out_private)->c);
 
 		/* ensure public key is compliant */
 		if (_vli_cmp((*out_public)->y, p2, curve->ndigits) >= 0) {
@@ -84,6 +92,23 @@ LIB_EXPORT bool l_ecdh_generate_shared_secret(
 	if (unlikely(!private_key || !other_public || !secret))
 		return false;
 
+	if (curve->montgomery) {
+		uint64_t k[L_ECC_MAX_DIGITS] = {};
+
+		if (other_public->curve != curve)
+			return false;
+
+		_ecc_x25519(k, private_key->c, other_public->x);
+
+		/* A low-order public value gives the all-zero secret */
+		if (l_secure_memeq(k, curve->ndigits * 8, 0))
+			return false;
+
+		*secret = _ecc_constant_new(curve, k, curve->ndigits * 8);
+		explicit_bzero(k, sizeof(k));
+		return true;
+	}
+
 	z = l_ecc_scalar_new_random(curve);
 
 	product = l_ecc_point_new(curve);
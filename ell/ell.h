@@ -10,6 +10,9 @@
 #include <ell/strv.h>
 #include <ell/utf8.h>
 #include <ell/queue.h>
+#include <ell/pool.h>
+#include <ell/arena.h>
+#include <ell/vector.h>
 #include <ell/hashmap.h>
 #include <ell/string.h>
 #include <ell/main.h>
@@ -53,4 +56,9 @@
 #include <ell/netconfig.h>
 #include <ell/sysctl.h>
 #include <ell/minheap.h>
+#include <ell/pqueue.h>
 #include <ell/notifylist.h>
+#include <ell/dgram.h>
+#include <ell/chashmap.h>
+#include <ell/skiplist.h>
+#include <ell/idalloc.h>
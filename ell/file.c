@@ -17,10 +17,16 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "file.h"
 #include "private.h"
 #include "useful.h"
+#include "queue.h"
+#include "hashmap.h"
+#include "main.h"
+#include "work-private.h"
 
 /**
  * l_file_get_contents:
@@ -76,6 +82,37 @@ error:
 	return NULL;
 }
 
+/*
+ * Writes @contents to a new temporary file next to @filename.  Returns the
+ * open file descriptor, or a negative errno in which case the temporary
+ * file has already been removed.
+ */
+static int write_temp_file(const char *filename, const void *contents,
+					size_t len, char **out_tmp_path)
+{
+	char *tmp_path = l_strdup_printf("%s.XXXXXX.tmp", filename);
+	ssize_t r;
+	int fd;
+
+	fd = L_TFR(mkostemps(tmp_path, 4, O_CLOEXEC));
+	if (fd == -1) {
+		fd = -errno;
+		l_free(tmp_path);
+		return fd;
+	}
+
+	r = L_TFR(write(fd, contents, len));
+	if (r != (ssize_t) len) {
+		L_TFR(close(fd));
+		unlink(tmp_path);
+		l_free(tmp_path);
+		return -EIO;
+	}
+
+	*out_tmp_path = tmp_path;
+	return fd;
+}
+
 /**
  * l_file_set_contents:
  * @filename: Destination filename
@@ -93,38 +130,314 @@ LIB_EXPORT int l_file_set_contents(const char *filename,
 					const void *contents, size_t len)
 {
 	_auto_(l_free) char *tmp_path = NULL;
-	ssize_t r;
 	int fd;
 
 	if (!filename || !contents)
 		return -EINVAL;
 
-	tmp_path = l_strdup_printf("%s.XXXXXX.tmp", filename);
-
-	fd = L_TFR(mkostemps(tmp_path, 4, O_CLOEXEC));
-	if (fd == -1)
-		return -errno;
+	fd = write_temp_file(filename, contents, len, &tmp_path);
+	if (fd < 0)
+		return fd;
 
-	r = L_TFR(write(fd, contents, len));
 	L_TFR(close(fd));
 
-	if (r != (ssize_t) len) {
-		r = -EIO;
-		goto error_write;
-	}
-
 	/*
 	 * Now that the file contents are written, rename to the real
 	 * file name; this way we are uniquely sure that the whole
 	 * thing is there.
-	 * conserve @r's value from 'write'
 	 */
-	if (rename(tmp_path, filename) == -1)
-		r = -errno;
+	if (rename(tmp_path, filename) == -1) {
+		int r = -errno;
 
-error_write:
-	if (r < 0)
 		unlink(tmp_path);
+		return r;
+	}
+
+	return 0;
+}
+
+/*
+ * Asynchronous writes are collected into batches, one batch per thread
+ * at a time is open for new writes until a worker picks it up.  Writing
+ * the same file twice within a batch only writes the newer contents.  A
+ * batch waits for the previous batch of its thread to be done so files
+ * are never renamed out of order.
+ */
+struct file_write {
+	char *filename;
+	void *contents;
+	size_t len;
+	char *tmp_path;
+	dev_t dev;
+	int result;
+};
+
+struct file_write_req {
+	struct file_write *write;
+	l_file_write_cb_t callback;
+	void *user_data;
+	l_file_destroy_cb_t destroy;
+};
+
+struct file_batch {
+	struct l_queue *writes;
+	struct l_hashmap *by_name;
+	struct l_queue *reqs;
+	bool sync;
+	bool started;
+	bool finished;
+	struct file_batch *prev;
+	struct file_batch *next;
+};
+
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_cond = PTHREAD_COND_INITIALIZER;
+static __thread struct file_batch *current_batch;
+
+static void file_write_free(void *data)
+{
+	struct file_write *write = data;
+
+	l_free(write->filename);
+	l_free(write->contents);
+	l_free(write->tmp_path);
+	l_free(write);
+}
+
+static void file_write_req_free(void *data)
+{
+	struct file_write_req *req = data;
+
+	if (req->destroy)
+		req->destroy(req->user_data);
+
+	l_free(req);
+}
+
+/* Writes every file to a temporary, syncs each filesystem once, renames */
+static void file_batch_run(void *data)
+{
+	struct file_batch *batch = data;
+	const struct l_queue_entry *entry;
+	_auto_(l_free) int *sync_fds = NULL;
+	_auto_(l_free) dev_t *sync_devs = NULL;
+	unsigned int n_sync = 0;
+	unsigned int i;
+
+	pthread_mutex_lock(&batch_lock);
+
+	while (batch->prev)
+		pthread_cond_wait(&batch_cond, &batch_lock);
+
+	batch->started = true;
+	pthread_mutex_unlock(&batch_lock);
+
+	if (batch->sync) {
+		sync_fds = l_new(int, l_queue_length(batch->writes));
+		sync_devs = l_new(dev_t, l_queue_length(batch->writes));
+	}
+
+	for (entry = l_queue_get_entries(batch->writes); entry;
+							entry = entry->next) {
+		struct file_write *write = entry->data;
+		struct stat st;
+		int fd;
+
+		fd = write_temp_file(write->filename, write->contents,
+					write->len, &write->tmp_path);
+		if (fd < 0) {
+			write->result = fd;
+			continue;
+		}
+
+		if (!batch->sync || fstat(fd, &st) < 0) {
+			L_TFR(close(fd));
+			continue;
+		}
+
+		write->dev = st.st_dev;
+
+		for (i = 0; i < n_sync; i++)
+			if (sync_devs[i] == st.st_dev)
+				break;
+
+		if (i < n_sync) {
+			L_TFR(close(fd));
+			continue;
+		}
+
+		sync_devs[n_sync] = st.st_dev;
+		sync_fds[n_sync++] = fd;
+	}
+
+	for (i = 0; i < n_sync; i++) {
+		int r = 0;
+
+		if (syncfs(sync_fds[i]) < 0)
+			r = -errno;
+
+		L_TFR(close(sync_fds[i]));
+
+		if (!r)
+			continue;
+
+		for (entry = l_queue_get_entries(batch->writes); entry;
+							entry = entry->next) {
+			struct file_write *write = entry->data;
+
+			if (write->tmp_path && write->dev == sync_devs[i])
+				write->result = r;
+		}
+	}
+
+	for (entry = l_queue_get_entries(batch->writes); entry;
+							entry = entry->next) {
+		struct file_write *write = entry->data;
+
+		if (!write->tmp_path)
+			continue;
+
+		if (!write->result && rename(write->tmp_path,
+						write->filename) < 0)
+			write->result = -errno;
+
+		if (write->result)
+			unlink(write->tmp_path);
+	}
+
+	pthread_mutex_lock(&batch_lock);
+	batch->finished = true;
+
+	if (batch->next) {
+		batch->next->prev = NULL;
+		batch->next = NULL;
+		pthread_cond_broadcast(&batch_cond);
+	}
+
+	pthread_mutex_unlock(&batch_lock);
+}
+
+static void file_batch_done(void *data)
+{
+	struct file_batch *batch = data;
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(batch->reqs); entry;
+							entry = entry->next) {
+		struct file_write_req *req = entry->data;
+
+		if (req->callback)
+			req->callback(req->write->result, req->user_data);
+	}
+}
+
+static void file_batch_free(void *data)
+{
+	struct file_batch *batch = data;
+
+	pthread_mutex_lock(&batch_lock);
+
+	if (batch->prev)
+		batch->prev->next = NULL;
+
+	if (batch->next)
+		batch->next->prev = NULL;
+
+	pthread_mutex_unlock(&batch_lock);
+
+	if (current_batch == batch)
+		current_batch = NULL;
+
+	l_queue_destroy(batch->reqs, file_write_req_free);
+	l_queue_destroy(batch->writes, file_write_free);
+	l_hashmap_destroy(batch->by_name, NULL);
+	l_free(batch);
+}
+
+/**
+ * l_file_set_contents_async:
+ * @filename: Destination filename
+ * @contents: Pointer to the contents, copied
+ * @len: Length in bytes of the contents buffer
+ * @sync: Whether the contents should be on disk before @filename is replaced
+ * @callback: called from the main loop with 0 or a negative errno once
+ *   @filename has been replaced, can be NULL
+ * @user_data: user data passed to @callback
+ * @destroy: called to free @user_data once the write is over
+ *
+ * Like l_file_set_contents but the file is written by a worker thread so
+ * that the main loop of the calling thread does not block on the disk.
+ * Writes issued while earlier ones are still in progress are batched,
+ * only the latest contents of a file are written and all its callbacks
+ * get the result of that write.  If any write of a batch asks for @sync,
+ * each filesystem involved is flushed once with syncfs() before the
+ * files of the batch are renamed into place.
+ *
+ * Returns: true if the write was queued, false otherwise in which case
+ * @destroy is not called.
+ **/
+LIB_EXPORT bool l_file_set_contents_async(const char *filename,
+					const void *contents, size_t len,
+					bool sync,
+					l_file_write_cb_t callback,
+					void *user_data,
+					l_file_destroy_cb_t destroy)
+{
+	struct file_batch *batch;
+	struct file_write *write;
+	struct file_write_req *req;
+	bool submit = false;
+
+	if (unlikely(!filename || !contents || !l_main_get_loop()))
+		return false;
+
+	pthread_mutex_lock(&batch_lock);
+	batch = current_batch;
+
+	if (!batch || batch->started) {
+		batch = l_new(struct file_batch, 1);
+		batch->writes = l_queue_new();
+		batch->by_name = l_hashmap_string_new();
+		batch->reqs = l_queue_new();
+
+		if (current_batch && !current_batch->finished) {
+			batch->prev = current_batch;
+			current_batch->next = batch;
+		}
+
+		current_batch = batch;
+		submit = true;
+	}
+
+	write = l_hashmap_lookup(batch->by_name, filename);
+	if (!write) {
+		write = l_new(struct file_write, 1);
+		write->filename = l_strdup(filename);
+		l_queue_push_tail(batch->writes, write);
+		l_hashmap_insert(batch->by_name, write->filename, write);
+	}
+
+	l_free(write->contents);
+	write->contents = l_malloc(len);
+	memcpy(write->contents, contents, len);
+	write->len = len;
+	batch->sync |= sync;
+
+	req = l_new(struct file_write_req, 1);
+	req->write = write;
+	req->callback = callback;
+	req->user_data = user_data;
+	l_queue_push_tail(batch->reqs, req);
+
+	pthread_mutex_unlock(&batch_lock);
+
+	if (submit && !work_submit(file_batch_run, file_batch_done,
+					file_batch_free, batch)) {
+		file_batch_free(batch);
+		return false;
+	}
 
-	return r < 0 ? r : 0;
+	/* Only call @destroy once the write has been accepted */
+	req->destroy = destroy;
+	return true;
 }
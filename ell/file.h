@@ -8,6 +8,9 @@
 #ifndef __ELL_FILE_H
 #define __ELL_FILE_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -15,6 +18,14 @@ extern "C" {
 void *l_file_get_contents(const char *filename, size_t *out_len);
 int l_file_set_contents(const char *filename, const void *data, size_t len);
 
+typedef void (*l_file_write_cb_t)(int result, void *user_data);
+typedef void (*l_file_destroy_cb_t)(void *user_data);
+
+bool l_file_set_contents_async(const char *filename, const void *data,
+				size_t len, bool sync,
+				l_file_write_cb_t callback, void *user_data,
+				l_file_destroy_cb_t destroy);
+
 #ifdef __cplusplus
 }
 #endif
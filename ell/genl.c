@@ -9,7 +9,10 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <linux/genetlink.h>
@@ -17,13 +20,31 @@
 #include "useful.h"
 #include "log.h"
 #include "queue.h"
+#include "hashmap.h"
 #include "io.h"
+#include "time.h"
 #include "private.h"
 #include "netlink.h"
 #include "netlink-private.h"
+#include "memory-private.h"
 #include "notifylist.h"
+#include "settings.h"
+#include "string.h"
+#include "strv.h"
+#include "file.h"
+#include "idle.h"
 #include "genl.h"
 
+/* Datagrams read with a single recvmmsg() call per wakeup */
+#define GENL_RECV_BATCH 8
+#define GENL_RECV_SIZE 8192
+
+/* Most multicast messages held back for batched callbacks */
+#define GENL_BATCH_MAX 64
+
+/* Command value used by notifications that match any command */
+#define MCAST_CMD_ANY 0x100
+
 #define GENL_DEBUG(fmt, args...)	\
 	l_util_debug(genl->debug_callback, genl->debug_data, "%s:%i " fmt, \
 			__func__, __LINE__, ## args)
@@ -59,6 +80,15 @@ struct l_genl {
 	struct l_queue *request_queue;
 	struct l_queue *pending_list;
 	struct l_queue *notify_list;
+	struct l_hashmap *mcast_dispatch;
+	struct genl_batch_msg *batch;
+	unsigned int batch_count;
+	struct genl_msg_view *view;
+	void *recv_buf;
+	bool *destroyed;
+	struct l_netlink_stats *stats;
+	struct l_hashmap *cmd_stats;
+	struct netlink_capture *capture;
 	unsigned int next_request_id;
 	unsigned int next_notify_id;
 	struct genl_discovery *discovery;
@@ -67,6 +97,8 @@ struct l_genl {
 	struct l_queue *family_watches;
 	struct l_queue *family_infos;
 	struct l_genl_family *nlctrl;
+	char *cache_path;
+	char *boot_id;
 	uint32_t next_handle_id;
 	l_genl_debug_func_t debug_callback;
 	l_genl_destroy_func_t debug_destroy;
@@ -76,6 +108,7 @@ struct l_genl {
 	bool in_unicast_watch_notify : 1;
 	bool in_mcast_notify : 1;
 	bool writer_active : 1;
+	bool cache_dirty : 1;
 };
 
 struct l_genl_msg {
@@ -84,6 +117,7 @@ struct l_genl_msg {
 	char *error_msg;
 	uint8_t cmd;
 	uint8_t version;
+	bool borrowed : 1;
 	struct l_netlink_message *nlm;
 };
 
@@ -97,18 +131,43 @@ struct genl_request {
 	l_genl_msg_func_t callback;
 	l_genl_destroy_func_t destroy;
 	void *user_data;
+	uint64_t sent_time;
 };
 
 struct mcast_notify {
 	unsigned int id;
 	uint32_t handle_id;
 	uint16_t type;
+	uint16_t cmd;
 	uint32_t group;
 	l_genl_msg_func_t callback;
+	l_genl_msg_batch_func_t batch_callback;
 	l_genl_destroy_func_t destroy;
 	void *user_data;
 };
 
+/*
+ * A multicast message handed to batched callbacks.  The message refers
+ * to the datagram in the receive buffer instead of holding a copy.
+ */
+struct genl_batch_msg {
+	uint32_t group;
+	struct l_genl_msg msg;
+	struct l_netlink_message nlm;
+};
+
+/*
+ * A received message handed to callbacks as a view of the receive buffer.
+ * One that is still referenced once the callbacks return gets a copy of
+ * its data and is left to its holders, so only retained messages cost an
+ * allocation and a copy.  @msg comes first so that l_genl_msg_unref()
+ * frees the whole view.
+ */
+struct genl_msg_view {
+	struct l_genl_msg msg;
+	struct l_netlink_message nlm;
+};
+
 struct genl_op {
 	uint32_t id;
 	uint32_t flags;
@@ -128,6 +187,7 @@ struct l_genl_family_info {
 	uint32_t maxattr;
 	struct l_queue *op_list;
 	struct l_queue *mcast_list;
+	bool cached;
 };
 
 struct l_genl_family {
@@ -153,6 +213,14 @@ static bool family_info_match(const void *a, const void *b)
 	return ia->id == id;
 }
 
+static bool family_info_match_name(const void *a, const void *b)
+{
+	const struct l_genl_family_info *ia = a;
+	const char *name = b;
+
+	return !strncmp(ia->name, name, GENL_NAMSIZ);
+}
+
 static struct l_genl_family_info *family_info_new(const char *name)
 {
 	struct l_genl_family_info *info = l_new(struct l_genl_family_info, 1);
@@ -279,12 +347,24 @@ static void family_mcast_groups(struct l_genl_family_info *info,
 	}
 }
 
+static const struct l_netlink_attr_policy newfamily_policy[] = {
+	[CTRL_ATTR_FAMILY_ID] = { L_NETLINK_ATTR_POLICY_U16 },
+	[CTRL_ATTR_FAMILY_NAME] = { L_NETLINK_ATTR_POLICY_STRING,
+							GENL_NAMSIZ - 1 },
+	[CTRL_ATTR_VERSION] = { L_NETLINK_ATTR_POLICY_U32 },
+	[CTRL_ATTR_HDRSIZE] = { L_NETLINK_ATTR_POLICY_U32 },
+	[CTRL_ATTR_MAXATTR] = { L_NETLINK_ATTR_POLICY_U32 },
+	[CTRL_ATTR_OPS] = { L_NETLINK_ATTR_POLICY_NESTED },
+	[CTRL_ATTR_MCAST_GROUPS] = { L_NETLINK_ATTR_POLICY_NESTED },
+};
+
+#define NEWFAMILY_MAX_ATTR (L_ARRAY_SIZE(newfamily_policy) - 1)
+
 static int parse_cmd_newfamily(struct l_genl_family_info *info,
 					struct l_genl_msg *msg)
 {
+	struct l_netlink_attr_value table[NEWFAMILY_MAX_ATTR + 1];
 	struct l_genl_attr attr, nested;
-	uint16_t type, len;
-	const void *data;
 	int error;
 
 	error = l_genl_msg_get_error(msg);
@@ -294,33 +374,37 @@ static int parse_cmd_newfamily(struct l_genl_family_info *info,
 	if (!l_genl_attr_init(&attr, msg))
 		return -EINVAL;
 
-	while (l_genl_attr_next(&attr, &type, &len, &data)) {
-		switch (type) {
-		case CTRL_ATTR_FAMILY_ID:
-			info->id = *((uint16_t *) data);
-			break;
-		case CTRL_ATTR_FAMILY_NAME:
-			l_strlcpy(info->name, data, GENL_NAMSIZ);
-			break;
-		case CTRL_ATTR_VERSION:
-			info->version = l_get_u32(data);
-			break;
-		case CTRL_ATTR_HDRSIZE:
-			info->hdrsize = l_get_u32(data);
-			break;
-		case CTRL_ATTR_MAXATTR:
-			info->maxattr = l_get_u32(data);
-			break;
-		case CTRL_ATTR_OPS:
-			if (l_genl_attr_recurse(&attr, &nested))
-				family_ops(info, &nested);
-			break;
-		case CTRL_ATTR_MCAST_GROUPS:
-			if (l_genl_attr_recurse(&attr, &nested))
-				family_mcast_groups(info, &nested);
-			break;
-		}
-	}
+	if (!l_genl_attr_parse(&attr, newfamily_policy, NEWFAMILY_MAX_ATTR,
+								table))
+		return -EBADMSG;
+
+	if (table[CTRL_ATTR_FAMILY_ID].data)
+		info->id = l_get_u16(table[CTRL_ATTR_FAMILY_ID].data);
+
+	if (table[CTRL_ATTR_FAMILY_NAME].data)
+		l_strlcpy(info->name, table[CTRL_ATTR_FAMILY_NAME].data,
+								GENL_NAMSIZ);
+
+	if (table[CTRL_ATTR_VERSION].data)
+		info->version = l_get_u32(table[CTRL_ATTR_VERSION].data);
+
+	if (table[CTRL_ATTR_HDRSIZE].data)
+		info->hdrsize = l_get_u32(table[CTRL_ATTR_HDRSIZE].data);
+
+	if (table[CTRL_ATTR_MAXATTR].data)
+		info->maxattr = l_get_u32(table[CTRL_ATTR_MAXATTR].data);
+
+	if (table[CTRL_ATTR_OPS].data &&
+			!l_netlink_attr_init((struct l_netlink_attr *) &nested,
+						0, table[CTRL_ATTR_OPS].data,
+						table[CTRL_ATTR_OPS].len))
+		family_ops(info, &nested);
+
+	if (table[CTRL_ATTR_MCAST_GROUPS].data &&
+			!l_netlink_attr_init((struct l_netlink_attr *) &nested,
+					0, table[CTRL_ATTR_MCAST_GROUPS].data,
+					table[CTRL_ATTR_MCAST_GROUPS].len))
+		family_mcast_groups(info, &nested);
 
 	return 0;
 }
@@ -492,12 +576,80 @@ static bool family_watch_match(const void *a, const void *b)
 	return watch->id == id;
 }
 
+static bool family_info_match_stale(const void *a, const void *b)
+{
+	const struct l_genl_family_info *ia = a;
+	const struct l_genl_family_info *ib = b;
+
+	if (!ia->cached)
+		return false;
+
+	if (ia->id == ib->id)
+		return strcmp(ia->name, ib->name);
+
+	return !strcmp(ia->name, ib->name);
+}
+
+/*
+ * Takes over the ops and groups of a freshly received @info into the
+ * cached entry @old, keeping the group subscriptions in place.
+ */
+static void family_info_refresh(struct l_genl_family_info *old,
+					struct l_genl_family_info *info)
+{
+	const struct l_queue_entry *entry;
+	struct l_queue *tmp;
+
+	for (entry = l_queue_get_entries(info->mcast_list); entry;
+							entry = entry->next) {
+		struct genl_mcast *mcast = entry->data;
+		struct genl_mcast *prev = l_queue_find(old->mcast_list,
+							match_mcast_name,
+							mcast->name);
+
+		if (prev)
+			mcast->users = prev->users;
+	}
+
+	old->version = info->version;
+	old->hdrsize = info->hdrsize;
+	old->maxattr = info->maxattr;
+	old->cached = false;
+
+	tmp = old->op_list;
+	old->op_list = info->op_list;
+	info->op_list = tmp;
+
+	tmp = old->mcast_list;
+	old->mcast_list = info->mcast_list;
+	info->mcast_list = tmp;
+
+	family_info_free(info);
+}
+
 static struct l_genl_family_info *family_info_update(struct l_genl *genl,
 					struct l_genl_family_info *info)
 {
-	struct l_genl_family_info *old =
-		l_queue_find(genl->family_infos, family_info_match,
+	struct l_genl_family_info *old;
+
+	/* Drop cache entries whose name or id the kernel now uses elsewhere */
+	while ((old = l_queue_remove_if(genl->family_infos,
+						family_info_match_stale,
+						info))) {
+		GENL_DEBUG("Dropping stale cached family info: %s", old->name);
+		family_info_free(old);
+		genl->cache_dirty = true;
+	}
+
+	old = l_queue_find(genl->family_infos, family_info_match,
 						L_UINT_TO_PTR(info->id));
+	if (old && old->cached) {
+		GENL_DEBUG("Refreshing cached family info: %s", old->name);
+		family_info_refresh(old, info);
+		genl->cache_dirty = true;
+		return old;
+	}
+
 	if (old) {
 		GENL_DEBUG("Keeping old family info: %s", old->name);
 		family_info_free(info);
@@ -506,9 +658,217 @@ static struct l_genl_family_info *family_info_update(struct l_genl *genl,
 
 	GENL_DEBUG("Added new family info: %s", info->name);
 	l_queue_push_head(genl->family_infos, info);
+	genl->cache_dirty = true;
+	return info;
+}
+
+#define CACHE_GROUP_PREFIX "Family "
+
+static char *family_info_ops_to_string(const struct l_genl_family_info *info)
+{
+	struct l_string *str = l_string_new(64);
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(info->op_list); entry;
+							entry = entry->next) {
+		struct genl_op *op = entry->data;
+
+		l_string_append_printf(str, "%s%u:%u",
+					l_string_length(str) ? "," : "",
+					op->id, op->flags);
+	}
+
+	return l_string_unwrap(str);
+}
+
+static char *family_info_groups_to_string(
+				const struct l_genl_family_info *info)
+{
+	struct l_string *str = l_string_new(64);
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(info->mcast_list); entry;
+							entry = entry->next) {
+		struct genl_mcast *mcast = entry->data;
+
+		l_string_append_printf(str, "%s%s:%u",
+					l_string_length(str) ? "," : "",
+					mcast->name, mcast->id);
+	}
+
+	return l_string_unwrap(str);
+}
+
+static void family_cache_save(struct l_genl *genl)
+{
+	struct l_settings *settings = l_settings_new();
+	const struct l_queue_entry *entry;
+	char *data;
+	size_t len;
+
+	l_settings_set_string(settings, "Cache", "BootId", genl->boot_id);
+
+	for (entry = l_queue_get_entries(genl->family_infos); entry;
+							entry = entry->next) {
+		const struct l_genl_family_info *info = entry->data;
+		char group[sizeof(CACHE_GROUP_PREFIX) + GENL_NAMSIZ];
+		char *value;
+
+		if (info->id == GENL_ID_CTRL)
+			continue;
+
+		snprintf(group, sizeof(group), CACHE_GROUP_PREFIX "%s",
+								info->name);
+
+		l_settings_set_uint(settings, group, "Id", info->id);
+		l_settings_set_uint(settings, group, "Version", info->version);
+		l_settings_set_uint(settings, group, "HdrSize", info->hdrsize);
+		l_settings_set_uint(settings, group, "MaxAttr", info->maxattr);
+
+		value = family_info_ops_to_string(info);
+		l_settings_set_value(settings, group, "Ops", value);
+		l_free(value);
+
+		value = family_info_groups_to_string(info);
+		l_settings_set_value(settings, group, "Groups", value);
+		l_free(value);
+	}
+
+	data = l_settings_to_data(settings, &len);
+	l_settings_free(settings);
+
+	if (l_file_set_contents(genl->cache_path, data, len) < 0)
+		GENL_DEBUG("Unable to write %s", genl->cache_path);
+
+	l_free(data);
+}
+
+/* Called once a batch of family info changes has been applied */
+static void family_cache_sync(struct l_genl *genl)
+{
+	if (!genl->cache_path || !genl->cache_dirty)
+		return;
+
+	genl->cache_dirty = false;
+	family_cache_save(genl);
+}
+
+static bool family_cache_parse_pair(const char *str, char *name,
+							uint32_t *value)
+{
+	const char *sep = strrchr(str, ':');
+
+	if (!sep || sep - str >= GENL_NAMSIZ)
+		return false;
+
+	if (l_safe_atou32(sep + 1, value) < 0)
+		return false;
+
+	if (name)
+		l_strlcpy(name, str, sep - str + 1);
+
+	return true;
+}
+
+static struct l_genl_family_info *family_cache_load_info(
+					const struct l_settings *settings,
+					const char *group)
+{
+	struct l_genl_family_info *info;
+	unsigned int id;
+	char **list;
+	char **i;
+
+	if (strlen(group) >= sizeof(CACHE_GROUP_PREFIX) + GENL_NAMSIZ - 1)
+		return NULL;
+
+	if (!l_settings_get_uint(settings, group, "Id", &id) ||
+			id <= GENL_ID_CTRL || id > UINT16_MAX)
+		return NULL;
+
+	info = family_info_new(group + strlen(CACHE_GROUP_PREFIX));
+	info->id = id;
+	info->cached = true;
+	l_settings_get_uint(settings, group, "Version", &info->version);
+	l_settings_get_uint(settings, group, "HdrSize", &info->hdrsize);
+	l_settings_get_uint(settings, group, "MaxAttr", &info->maxattr);
+
+	list = l_settings_get_string_list(settings, group, "Ops", ',');
+
+	for (i = list; i && *i; i++) {
+		char op[GENL_NAMSIZ];
+		uint32_t flags;
+
+		if (family_cache_parse_pair(*i, op, &flags) &&
+				!l_safe_atou32(op, &id))
+			family_info_add_op(info, id, flags);
+	}
+
+	l_strfreev(list);
+	list = l_settings_get_string_list(settings, group, "Groups", ',');
+
+	for (i = list; i && *i; i++) {
+		char name[GENL_NAMSIZ];
+		uint32_t mcast_id;
+
+		if (family_cache_parse_pair(*i, name, &mcast_id) && mcast_id)
+			family_info_add_mcast(info, name, mcast_id);
+	}
+
+	l_strfreev(list);
 	return info;
 }
 
+static void family_cache_load(struct l_genl *genl)
+{
+	struct l_settings *settings = l_settings_new();
+	char **groups = NULL;
+	char **i;
+	char *boot_id;
+
+	if (!l_settings_load_from_file(settings, genl->cache_path))
+		goto done;
+
+	boot_id = l_settings_get_string(settings, "Cache", "BootId");
+	if (!boot_id || strcmp(boot_id, genl->boot_id)) {
+		GENL_DEBUG("Ignoring family cache from a previous boot");
+		l_free(boot_id);
+		genl->cache_dirty = true;
+		goto done;
+	}
+
+	l_free(boot_id);
+	groups = l_settings_get_groups(settings);
+
+	for (i = groups; i && *i; i++) {
+		struct l_genl_family_info *info;
+
+		if (!l_str_has_prefix(*i, CACHE_GROUP_PREFIX))
+			continue;
+
+		info = family_cache_load_info(settings, *i);
+		if (!info)
+			continue;
+
+		/* Anything learned from the kernel already takes precedence */
+		if (l_queue_find(genl->family_infos, family_info_match,
+						L_UINT_TO_PTR(info->id)) ||
+				l_queue_find(genl->family_infos,
+						family_info_match_name,
+						info->name)) {
+			family_info_free(info);
+			continue;
+		}
+
+		GENL_DEBUG("Loaded cached family info: %s", info->name);
+		l_queue_push_tail(genl->family_infos, info);
+	}
+
+done:
+	l_strfreev(groups);
+	l_settings_free(settings);
+}
+
 static void family_watch_prune(struct l_genl *genl)
 {
 	struct family_watch *watch;
@@ -551,6 +911,7 @@ static void nlctrl_newfamily(struct l_genl_msg *msg, struct l_genl *genl)
 
 	genl->in_family_watch_notify = false;
 	family_watch_prune(genl);
+	family_cache_sync(genl);
 }
 
 static void nlctrl_delfamily(struct l_genl_msg *msg, struct l_genl *genl)
@@ -606,7 +967,10 @@ static void nlctrl_delfamily(struct l_genl_msg *msg, struct l_genl *genl)
 	if (old) {
 		GENL_DEBUG("Removing old family info: %s", old->name);
 		family_info_free(old);
+		genl->cache_dirty = true;
 	}
+
+	family_cache_sync(genl);
 }
 
 static void nlctrl_notify(struct l_genl_msg *msg, void *user_data)
@@ -679,14 +1043,55 @@ static bool mcast_notify_match(const void *a, const void *b)
 	return notify->id == id;
 }
 
+static void *mcast_dispatch_key(uint16_t type, uint16_t cmd)
+{
+	return L_UINT_TO_PTR((uint32_t) type << 16 | cmd);
+}
+
+static void mcast_dispatch_add(struct l_genl *genl,
+					struct mcast_notify *notify)
+{
+	void *key = mcast_dispatch_key(notify->type, notify->cmd);
+	struct l_queue *queue = l_hashmap_lookup(genl->mcast_dispatch, key);
+
+	if (!queue) {
+		queue = l_queue_new();
+		l_hashmap_insert(genl->mcast_dispatch, key, queue);
+	}
+
+	l_queue_push_tail(queue, notify);
+}
+
+static void mcast_dispatch_remove(struct l_genl *genl,
+					struct mcast_notify *notify)
+{
+	void *key = mcast_dispatch_key(notify->type, notify->cmd);
+	struct l_queue *queue = l_hashmap_lookup(genl->mcast_dispatch, key);
+
+	if (!l_queue_remove(queue, notify))
+		return;
+
+	if (l_queue_isempty(queue)) {
+		l_hashmap_remove(genl->mcast_dispatch, key);
+		l_queue_destroy(queue, NULL);
+	}
+}
+
+static void mcast_dispatch_queue_free(void *data)
+{
+	l_queue_destroy(data, NULL);
+}
+
 static void mcast_notify_prune(struct l_genl *genl)
 {
 	struct mcast_notify *notify;
 
 	while ((notify = l_queue_remove_if(genl->notify_list,
 						mcast_notify_match,
-						L_UINT_TO_PTR(0))))
+						L_UINT_TO_PTR(0)))) {
+		mcast_dispatch_remove(genl, notify);
 		mcast_notify_free(notify);
+	}
 }
 
 static bool match_request_id(const void *a, const void *b)
@@ -705,6 +1110,25 @@ static bool match_request_hid(const void *a, const void *b)
 	return request->handle_id == id;
 }
 
+/*
+ * Sizes of the last requests sent per command, so that a message created
+ * without a size hint starts out large enough for what usually goes in.
+ * Commands of different families share slots, which only costs a grow.
+ */
+static uint16_t msg_size_history[256];
+
+static void msg_size_record(const struct l_genl_msg *msg)
+{
+	uint32_t len = msg->nlm->hdr->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN;
+	uint16_t *hint = &msg_size_history[msg->cmd];
+
+	/* Follow growth at once, shrink slowly */
+	if (len >= *hint)
+		*hint = minsize(len, UINT16_MAX);
+	else
+		*hint -= (*hint - len) / 4;
+}
+
 static struct l_genl_msg *msg_create(const struct nlmsghdr *nlmsg)
 {
 	struct l_genl_msg *msg;
@@ -737,6 +1161,65 @@ done:
 	return l_genl_msg_ref(msg);
 }
 
+static struct l_genl_msg *msg_view_get(struct l_genl *genl,
+					const struct nlmsghdr *nlmsg)
+{
+	struct genl_msg_view *view;
+
+	/* Errors may carry an extended ack message, keep those simple */
+	if (nlmsg->nlmsg_type == NLMSG_ERROR)
+		return msg_create(nlmsg);
+
+	view = genl->view ?: l_new(struct genl_msg_view, 1);
+	genl->view = NULL;
+
+	memset(view, 0, sizeof(*view));
+	view->nlm.ref_count = 1;
+	view->nlm.size = nlmsg->nlmsg_len;
+	view->nlm.data = (void *) nlmsg;
+	view->nlm.sealed = true;
+
+	view->msg.ref_count = 1;
+	view->msg.borrowed = true;
+	view->msg.nlm = &view->nlm;
+
+	if (nlmsg->nlmsg_len >= NLMSG_LENGTH(GENL_HDRLEN)) {
+		const struct genlmsghdr *genlmsg = NLMSG_DATA(nlmsg);
+
+		view->msg.cmd = genlmsg->cmd;
+		view->msg.version = genlmsg->version;
+	}
+
+	return &view->msg;
+}
+
+/* @genl is NULL if it was destroyed by one of the callbacks */
+static void msg_view_put(struct l_genl *genl, struct l_genl_msg *msg)
+{
+	struct genl_msg_view *view;
+
+	if (!msg || !msg->borrowed) {
+		l_genl_msg_unref(msg);
+		return;
+	}
+
+	view = l_container_of(msg, struct genl_msg_view, msg);
+
+	if (__atomic_load_n(&msg->ref_count, __ATOMIC_SEQ_CST) > 1) {
+		msg->nlm = netlink_message_from_nlmsg(view->nlm.hdr);
+		msg->borrowed = false;
+		l_genl_msg_unref(msg);
+		return;
+	}
+
+	if (genl && !genl->view) {
+		genl->view = view;
+		return;
+	}
+
+	l_free(view);
+}
+
 static const void *msg_as_bytes(struct l_genl_msg *msg, uint16_t type,
 				uint16_t flags, uint32_t seq, uint32_t pid,
 				size_t *out_size)
@@ -770,6 +1253,68 @@ static void write_watch_destroy(void *user_data)
 	genl->writer_active = false;
 }
 
+static struct l_genl_cmd_stats *cmd_stats_get(struct l_genl *genl,
+						struct genl_request *request)
+{
+	struct l_genl_cmd_stats *stats;
+	void *key = L_UINT_TO_PTR(request->type << 8 | request->msg->cmd);
+
+	stats = l_hashmap_lookup(genl->cmd_stats, key);
+	if (stats)
+		return stats;
+
+	stats = l_new(struct l_genl_cmd_stats, 1);
+	stats->family = request->type;
+	stats->cmd = request->msg->cmd;
+	l_hashmap_insert(genl->cmd_stats, key, stats);
+
+	return stats;
+}
+
+static void stats_request_sent(struct l_genl *genl,
+					struct genl_request *request)
+{
+	if (!genl->stats)
+		return;
+
+	request->sent_time = l_time_now();
+	genl->stats->requests++;
+	cmd_stats_get(genl, request)->requests++;
+}
+
+static void stats_request_reply(struct l_genl *genl,
+					struct genl_request *request,
+					const struct nlmsghdr *nlmsg)
+{
+	struct l_genl_cmd_stats *stats;
+	uint64_t latency;
+
+	if (!genl->stats || !request->sent_time)
+		return;
+
+	stats = cmd_stats_get(genl, request);
+
+	if ((nlmsg->nlmsg_flags & NLM_F_MULTI) &&
+					nlmsg->nlmsg_type != NLMSG_DONE) {
+		genl->stats->dump_messages++;
+		genl->stats->dump_bytes += nlmsg->nlmsg_len;
+		stats->dump_messages++;
+		stats->dump_bytes += nlmsg->nlmsg_len;
+		return;
+	}
+
+	latency = l_time_now() - request->sent_time;
+	netlink_stats_add_latency(genl->stats, latency);
+	stats->latency_total += latency;
+	stats->latency_max = maxsize(stats->latency_max, latency);
+
+	if (nlmsg->nlmsg_type == NLMSG_ERROR &&
+			((const struct nlmsgerr *) NLMSG_DATA(nlmsg))->error) {
+		genl->stats->errors++;
+		stats->errors++;
+	}
+}
+
 static bool can_write_data(struct l_io *io, void *user_data)
 {
 	struct l_genl *genl = user_data;
@@ -794,6 +1339,9 @@ static bool can_write_data(struct l_io *io, void *user_data)
 
 	l_util_hexdump(false, data, bytes_written,
 				genl->debug_callback, genl->debug_data);
+	netlink_capture_write(genl->capture, NETLINK_GENERIC, true,
+						data, bytes_written);
+	stats_request_sent(genl, request);
 
 	l_queue_push_tail(genl->pending_list, request);
 
@@ -834,7 +1382,7 @@ static void process_unicast(struct l_genl *genl, const struct nlmsghdr *nlmsg)
 					nlmsg->nlmsg_type == NLMSG_OVERRUN)
 		return;
 
-	msg = msg_create(nlmsg);
+	msg = msg_view_get(genl, nlmsg);
 	if (!nlmsg->nlmsg_seq) {
 		struct l_genl_family_info *info =
 			l_queue_find(genl->family_infos, family_info_match,
@@ -853,6 +1401,8 @@ static void process_unicast(struct l_genl *genl, const struct nlmsghdr *nlmsg)
 	if (!request)
 		goto done;
 
+	stats_request_reply(genl, request, nlmsg);
+
 	if (!msg)
 		goto free_request;
 
@@ -869,108 +1419,269 @@ free_request:
 	destroy_request(request);
 	wakeup_writer(genl);
 done:
-	l_genl_msg_unref(msg);
+	msg_view_put(genl, msg);
 }
 
-static void process_multicast(struct l_genl *genl, uint32_t group,
-						const struct nlmsghdr *nlmsg)
+static bool batch_flush(struct l_genl *genl)
 {
+	struct l_genl_msg *msgs[GENL_BATCH_MAX];
 	const struct l_queue_entry *entry;
-	struct l_genl_msg *msg = msg_create(nlmsg);
+	bool *destroyed = genl->destroyed;
 
-	if (!msg)
-		return;
+	if (!genl->batch_count)
+		return true;
 
 	genl->in_mcast_notify = true;
 
 	for (entry = l_queue_get_entries(genl->notify_list);
 						entry; entry = entry->next) {
 		struct mcast_notify *notify = entry->data;
+		unsigned int count = 0;
+		unsigned int i;
+
+		if (!notify->id || !notify->batch_callback)
+			continue;
+
+		for (i = 0; i < genl->batch_count; i++) {
+			struct genl_batch_msg *batch = &genl->batch[i];
+
+			if (batch->group != notify->group)
+				continue;
+
+			if (batch->nlm.hdr->nlmsg_type != notify->type)
+				continue;
+
+			msgs[count++] = &batch->msg;
+		}
+
+		if (!count)
+			continue;
+
+		notify->batch_callback(msgs, count, notify->user_data);
+
+		if (*destroyed)
+			return false;
+	}
+
+	genl->batch_count = 0;
+	genl->in_mcast_notify = false;
+	mcast_notify_prune(genl);
+
+	return true;
+}
+
+static bool batch_add(struct l_genl *genl, uint32_t group,
+					const struct nlmsghdr *nlmsg)
+{
+	const struct genlmsghdr *genlmsg = NLMSG_DATA(nlmsg);
+	struct genl_batch_msg *batch;
+
+	if (genl->batch_count == GENL_BATCH_MAX && !batch_flush(genl))
+		return false;
+
+	if (!genl->batch)
+		genl->batch = l_new(struct genl_batch_msg, GENL_BATCH_MAX);
+
+	batch = &genl->batch[genl->batch_count++];
+	memset(batch, 0, sizeof(*batch));
+	batch->group = group;
+
+	batch->nlm.ref_count = 1;
+	batch->nlm.size = nlmsg->nlmsg_len;
+	batch->nlm.data = (void *) nlmsg;
+	batch->nlm.sealed = true;
+
+	batch->msg.ref_count = 1;
+	batch->msg.cmd = genlmsg->cmd;
+	batch->msg.version = genlmsg->version;
+	batch->msg.nlm = &batch->nlm;
+
+	return true;
+}
+
+/* Returns false if @genl was destroyed by one of the callbacks */
+static bool process_multicast(struct l_genl *genl, uint32_t group,
+						const struct nlmsghdr *nlmsg)
+{
+	const struct genlmsghdr *genlmsg = NLMSG_DATA(nlmsg);
+	const struct l_queue_entry *by_cmd;
+	const struct l_queue_entry *any;
+	struct l_genl_msg *msg = NULL;
+	bool *destroyed = genl->destroyed;
+	bool batch = false;
+
+	if (nlmsg->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN))
+		return true;
+
+	if (genl->stats)
+		genl->stats->notifications++;
+
+	by_cmd = l_queue_get_entries(l_hashmap_lookup(genl->mcast_dispatch,
+				mcast_dispatch_key(nlmsg->nlmsg_type,
+							genlmsg->cmd)));
+	any = l_queue_get_entries(l_hashmap_lookup(genl->mcast_dispatch,
+				mcast_dispatch_key(nlmsg->nlmsg_type,
+							MCAST_CMD_ANY)));
+
+	genl->in_mcast_notify = true;
+
+	/* Merge both lists so callbacks still run in registration order */
+	while (by_cmd || any) {
+		struct mcast_notify *notify;
+
+		if (!any || (by_cmd && ((struct mcast_notify *)
+					by_cmd->data)->id <
+				((struct mcast_notify *) any->data)->id)) {
+			notify = by_cmd->data;
+			by_cmd = by_cmd->next;
+		} else {
+			notify = any->data;
+			any = any->next;
+		}
 
 		/* Skip those that might have been removed due this mcast */
 		if (!notify->id)
 			continue;
 
-		if (notify->type != nlmsg->nlmsg_type)
-			continue;
+		if (notify->group != group)
+			continue;
+
+		if (notify->batch_callback) {
+			batch = true;
+			continue;
+		}
+
+		if (!notify->callback)
+			continue;
+
+		if (!msg)
+			msg = msg_view_get(genl, nlmsg);
+
+		notify->callback(msg, notify->user_data);
+
+		if (*destroyed) {
+			msg_view_put(NULL, msg);
+			return false;
+		}
+	}
+
+	genl->in_mcast_notify = false;
+	mcast_notify_prune(genl);
+
+	msg_view_put(genl, msg);
+
+	if (batch)
+		return batch_add(genl, group, nlmsg);
+
+	return true;
+}
+
+static void read_watch_destroy(void *user_data)
+{
+}
+
+/* Returns false if @genl was destroyed by one of the callbacks */
+static bool process_datagram(struct l_genl *genl, struct msghdr *msg,
+					void *data, size_t len)
+{
+	bool *destroyed = genl->destroyed;
+	struct cmsghdr *cmsg;
+	struct nlmsghdr *nlmsg;
+	uint32_t group = 0;
+
+	l_util_hexdump(true, data, len, genl->debug_callback, genl->debug_data);
+	netlink_capture_write(genl->capture, NETLINK_GENERIC, false, data, len);
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+					cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		struct nl_pktinfo pktinfo;
+
+		if (cmsg->cmsg_level != SOL_NETLINK)
+			continue;
+
+		if (cmsg->cmsg_type != NETLINK_PKTINFO)
+			continue;
+
+		memcpy(&pktinfo, CMSG_DATA(cmsg), sizeof(pktinfo));
+
+		group = pktinfo.group;
+	}
+
+	for (nlmsg = data; NLMSG_OK(nlmsg, len);
+				nlmsg = NLMSG_NEXT(nlmsg, len)) {
+		if (group > 0) {
+			if (!process_multicast(genl, group, nlmsg))
+				return false;
 
-		if (notify->group != group)
 			continue;
+		}
 
-		if (!notify->callback)
-			continue;
+		process_unicast(genl, nlmsg);
 
-		notify->callback(msg, notify->user_data);
+		if (*destroyed)
+			return false;
 	}
 
-	genl->in_mcast_notify = false;
-	mcast_notify_prune(genl);
-
-	l_genl_msg_unref(msg);
-}
-
-static void read_watch_destroy(void *user_data)
-{
+	return true;
 }
 
 static bool received_data(struct l_io *io, void *user_data)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_NETLINK);
 	struct l_genl *genl = user_data;
-	struct cmsghdr *cmsg;
-	struct msghdr msg;
-	struct iovec iov;
-	unsigned char buf[8192];
-	unsigned char control[32];
-	ssize_t bytes_read;
-	struct nlmsghdr *nlmsg;
-	size_t nlmsg_len;
-	uint32_t group = 0;
+	struct mmsghdr msgs[GENL_RECV_BATCH];
+	struct iovec iov[GENL_RECV_BATCH];
+	unsigned char control[GENL_RECV_BATCH][32];
+	bool destroyed = false;
+	int count;
+	int i;
 
-	memset(&iov, 0, sizeof(iov));
-	iov.iov_base = buf;
-	iov.iov_len = sizeof(buf);
+	if (!genl->recv_buf)
+		genl->recv_buf = l_malloc(GENL_RECV_BATCH * GENL_RECV_SIZE);
 
-	memset(&msg, 0, sizeof(msg));
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-	msg.msg_control = control;
-	msg.msg_controllen = sizeof(control);
+	memset(msgs, 0, sizeof(msgs));
 
-	bytes_read = recvmsg(genl->fd, &msg, 0);
-	if (bytes_read < 0) {
-		if (errno != EAGAIN && errno != EINTR)
-			return false;
+	for (i = 0; i < GENL_RECV_BATCH; i++) {
+		iov[i].iov_base = genl->recv_buf + i * GENL_RECV_SIZE;
+		iov[i].iov_len = GENL_RECV_SIZE;
 
-		return true;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = control[i];
+		msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
 	}
 
-	nlmsg_len = bytes_read;
+	count = recvmmsg(genl->fd, msgs, GENL_RECV_BATCH, 0, NULL);
+	if (count < 0) {
+		/* Messages were dropped, but the socket itself is fine */
+		if (errno == ENOBUFS) {
+			if (genl->stats)
+				genl->stats->overruns++;
 
-	l_util_hexdump(true, buf, nlmsg_len,
-				genl->debug_callback, genl->debug_data);
+			return true;
+		}
 
-	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
-					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-		struct nl_pktinfo pktinfo;
+		if (errno != EAGAIN && errno != EINTR)
+			return false;
 
-		if (cmsg->cmsg_level != SOL_NETLINK)
-			continue;
+		return true;
+	}
 
-		if (cmsg->cmsg_type != NETLINK_PKTINFO)
-			continue;
+	genl->destroyed = &destroyed;
 
-		memcpy(&pktinfo, CMSG_DATA(cmsg), sizeof(pktinfo));
+	/*
+	 * Batched callbacks see the multicast messages of every datagram
+	 * read here, which stay in the receive buffer until the flush.
+	 */
+	for (i = 0; i < count; i++)
+		if (!process_datagram(genl, &msgs[i].msg_hdr,
+					iov[i].iov_base, msgs[i].msg_len))
+			return false;
 
-		group = pktinfo.group;
-	}
+	if (!batch_flush(genl))
+		return false;
 
-	for (nlmsg = iov.iov_base; NLMSG_OK(nlmsg, nlmsg_len);
-				nlmsg = NLMSG_NEXT(nlmsg, nlmsg_len)) {
-		if (group > 0)
-			process_multicast(genl, group, nlmsg);
-		else
-			process_unicast(genl, nlmsg);
-	}
+	genl->destroyed = NULL;
 
 	return true;
 }
@@ -988,6 +1699,7 @@ static struct l_genl_family_info *build_nlctrl_info()
 
 LIB_EXPORT struct l_genl *l_genl_new(void)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_NETLINK);
 	struct l_genl *genl;
 	struct l_io *io;
 	struct sockaddr_nl addr;
@@ -1034,6 +1746,7 @@ LIB_EXPORT struct l_genl *l_genl_new(void)
 	genl->request_queue = l_queue_new();
 	genl->pending_list = l_queue_new();
 	genl->notify_list = l_queue_new();
+	genl->mcast_dispatch = l_hashmap_new();
 	genl->family_watches = l_queue_new();
 	genl->family_infos = l_queue_new();
 	genl->unicast_watches = l_notifylist_new(&unicast_watch_ops);
@@ -1079,9 +1792,14 @@ LIB_EXPORT void l_genl_unref(struct l_genl *genl)
 
 	l_genl_family_free(genl->nlctrl);
 
+	family_cache_sync(genl);
+	l_free(genl->cache_path);
+	l_free(genl->boot_id);
+
 	l_notifylist_free(genl->unicast_watches);
 	l_queue_destroy(genl->family_watches, family_watch_free);
 	l_queue_destroy(genl->family_infos, family_info_free);
+	l_hashmap_destroy(genl->mcast_dispatch, mcast_dispatch_queue_free);
 	l_queue_destroy(genl->notify_list, mcast_notify_free);
 	l_queue_destroy(genl->pending_list, destroy_request);
 	l_queue_destroy(genl->request_queue, destroy_request);
@@ -1096,6 +1814,16 @@ LIB_EXPORT void l_genl_unref(struct l_genl *genl)
 	if (genl->debug_destroy)
 		genl->debug_destroy(genl->debug_data);
 
+	if (genl->destroyed)
+		*genl->destroyed = true;
+
+	l_free(genl->stats);
+	l_hashmap_destroy(genl->cmd_stats, l_free);
+	netlink_capture_close(genl->capture);
+
+	l_free(genl->batch);
+	l_free(genl->view);
+	l_free(genl->recv_buf);
 	l_free(genl);
 }
 
@@ -1117,6 +1845,162 @@ LIB_EXPORT bool l_genl_set_debug(struct l_genl *genl,
 	return true;
 }
 
+/*
+ * Starts or stops counting requests, their latencies and dump sizes, by
+ * family and command as well, along with multicast messages and receive
+ * buffer overruns.  Disabling discards the counters collected so far.
+ */
+LIB_EXPORT bool l_genl_set_stats(struct l_genl *genl, bool enabled)
+{
+	if (unlikely(!genl))
+		return false;
+
+	if (!enabled) {
+		l_free(genl->stats);
+		genl->stats = NULL;
+		l_hashmap_destroy(genl->cmd_stats, l_free);
+		genl->cmd_stats = NULL;
+		return true;
+	}
+
+	if (genl->stats)
+		return true;
+
+	genl->stats = l_new(struct l_netlink_stats, 1);
+	genl->cmd_stats = l_hashmap_new();
+
+	return true;
+}
+
+LIB_EXPORT bool l_genl_get_stats(struct l_genl *genl,
+					struct l_netlink_stats *stats)
+{
+	if (unlikely(!genl || !stats))
+		return false;
+
+	if (!genl->stats)
+		return false;
+
+	*stats = *genl->stats;
+	stats->queue_depth = l_queue_length(genl->request_queue) +
+				l_queue_length(genl->pending_list);
+
+	return true;
+}
+
+struct cmd_stats_foreach_data {
+	l_genl_cmd_stats_func_t function;
+	void *user_data;
+};
+
+static void cmd_stats_foreach(const void *key, void *value, void *user_data)
+{
+	struct cmd_stats_foreach_data *data = user_data;
+
+	data->function(value, data->user_data);
+}
+
+/* Latencies are in microseconds, @family is the id of the family */
+LIB_EXPORT bool l_genl_foreach_cmd_stats(struct l_genl *genl,
+					l_genl_cmd_stats_func_t function,
+					void *user_data)
+{
+	struct cmd_stats_foreach_data data = { function, user_data };
+
+	if (unlikely(!genl || !function))
+		return false;
+
+	if (!genl->cmd_stats)
+		return false;
+
+	l_hashmap_foreach(genl->cmd_stats, cmd_stats_foreach, &data);
+
+	return true;
+}
+
+/*
+ * Writes all traffic on @genl to the file at @path in the same pcap format
+ * as l_netlink_set_capture, or stops when @path is NULL.
+ */
+LIB_EXPORT bool l_genl_set_capture(struct l_genl *genl, const char *path)
+{
+	struct netlink_capture *capture = NULL;
+
+	if (unlikely(!genl))
+		return false;
+
+	if (path) {
+		capture = netlink_capture_open(path);
+		if (!capture)
+			return false;
+	}
+
+	netlink_capture_close(genl->capture);
+	genl->capture = capture;
+
+	return true;
+}
+
+/* Family ids are only stable until the next boot */
+static char *read_boot_id(void)
+{
+	char buf[64];
+	ssize_t len;
+	int fd;
+
+	fd = open("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	len = L_TFR(read(fd, buf, sizeof(buf) - 1));
+	close(fd);
+
+	if (len <= 0)
+		return NULL;
+
+	buf[len] = '\0';
+
+	return l_strndup(buf, strcspn(buf, "\n"));
+}
+
+/**
+ * l_genl_set_family_cache:
+ * @genl: GENL connection
+ * @path: File to keep the family information in, or NULL to stop using it
+ *
+ * Loads the families recorded at @path by an earlier process, so that
+ * l_genl_family_new and l_genl_request_family can be used for them without
+ * first querying the kernel.  The file is only trusted if it was written
+ * since the last boot.  Families learned from the kernel, including through
+ * nlctrl notifications, are written back to @path.
+ *
+ * Returns: #true if the cache could be set up, #false otherwise.  A missing
+ * or outdated file is not an error.
+ **/
+LIB_EXPORT bool l_genl_set_family_cache(struct l_genl *genl, const char *path)
+{
+	if (unlikely(!genl))
+		return false;
+
+	l_free(genl->cache_path);
+	genl->cache_path = NULL;
+
+	if (!path)
+		return true;
+
+	if (!genl->boot_id) {
+		genl->boot_id = read_boot_id();
+		if (!genl->boot_id)
+			return false;
+	}
+
+	genl->cache_path = l_strdup(path);
+	family_cache_load(genl);
+	family_cache_sync(genl);
+
+	return true;
+}
+
 static void dump_family_callback(struct l_genl_msg *msg, void *user_data)
 {
 	struct l_genl *genl = user_data;
@@ -1141,6 +2025,8 @@ static void dump_family_done(void *user_data)
 	struct l_genl *genl = user_data;
 	struct genl_discovery *discovery = genl->discovery;
 
+	family_cache_sync(genl);
+
 	if (discovery->destroy)
 		discovery->destroy(discovery->user_data);
 
@@ -1326,6 +2212,7 @@ struct family_request {
 	l_genl_discover_func_t appeared_func;
 	l_genl_destroy_func_t destroy;
 	struct l_genl *genl;
+	uint16_t cached_id;
 };
 
 static void request_family_callback(struct l_genl_msg *msg, void *user_data)
@@ -1343,6 +2230,7 @@ static void request_family_callback(struct l_genl_msg *msg, void *user_data)
 	}
 
 	info = family_info_update(req->genl, info);
+	family_cache_sync(req->genl);
 
 	/*
 	 * watch events should trigger as a result of new_family event.
@@ -1364,6 +2252,29 @@ static void family_request_free(void *user_data)
 	l_free(req);
 }
 
+static void cached_family_reply(void *user_data)
+{
+	struct family_request *req = user_data;
+	const struct l_genl_family_info *info;
+
+	if (!req->appeared_func)
+		return;
+
+	/* The entry may have been dropped by a DELFAMILY in the meantime */
+	info = l_queue_find(req->genl->family_infos, family_info_match,
+					L_UINT_TO_PTR(req->cached_id));
+	req->appeared_func(info, req->user_data);
+}
+
+static void cached_family_request_free(void *user_data)
+{
+	struct family_request *req = user_data;
+	struct l_genl *genl = req->genl;
+
+	family_request_free(req);
+	l_genl_unref(genl);
+}
+
 /**
  * l_genl_request_family:
  * @genl: GENL connection
@@ -1379,6 +2290,10 @@ static void family_request_free(void *user_data)
  * is called with the family information.  If auto-loading failed, a NULL
  * will be given as a parameter to @appeared_func.
  *
+ * If the family was loaded from the cache set with l_genl_set_family_cache,
+ * @appeared_func is called from an idle callback without a request to the
+ * kernel.
+ *
  * Returns: #true if the request could be started successfully,
  * false otherwise.
  **/
@@ -1390,6 +2305,7 @@ LIB_EXPORT bool l_genl_request_family(struct l_genl *genl, const char *name,
 	size_t len;
 	struct l_genl_msg *msg;
 	struct family_request *req;
+	const struct l_genl_family_info *info;
 
 	if (unlikely(!genl) || unlikely(!name))
 		return false;
@@ -1404,6 +2320,20 @@ LIB_EXPORT bool l_genl_request_family(struct l_genl *genl, const char *name,
 	req->destroy = destroy;
 	req->genl = genl;
 
+	info = l_queue_find(genl->family_infos, family_info_match_name, name);
+	if (info && info->cached) {
+		req->cached_id = info->id;
+		req->genl = l_genl_ref(genl);
+
+		if (l_idle_oneshot(cached_family_reply, req,
+						cached_family_request_free))
+			return true;
+
+		l_genl_unref(genl);
+		l_free(req);
+		return false;
+	}
+
 	msg = l_genl_msg_new_sized(CTRL_CMD_GETFAMILY,
 						NLA_HDRLEN + GENL_NAMSIZ);
 	l_genl_msg_append_attr(msg, CTRL_ATTR_FAMILY_NAME, len + 1, name);
@@ -1417,11 +2347,12 @@ LIB_EXPORT bool l_genl_request_family(struct l_genl *genl, const char *name,
 
 LIB_EXPORT struct l_genl_msg *l_genl_msg_new(uint8_t cmd)
 {
-	return l_genl_msg_new_sized(cmd, 0);
+	return l_genl_msg_new_sized(cmd, msg_size_history[cmd]);
 }
 
 LIB_EXPORT struct l_genl_msg *l_genl_msg_new_sized(uint8_t cmd, uint32_t size)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_NETLINK);
 	struct l_genl_msg *msg = l_new(struct l_genl_msg, 1);
 
 	msg->cmd = cmd;
@@ -1432,6 +2363,41 @@ LIB_EXPORT struct l_genl_msg *l_genl_msg_new_sized(uint8_t cmd, uint32_t size)
 	return l_genl_msg_ref(msg);
 }
 
+/*
+ * Empties @msg for reuse as a request for @cmd, keeping its buffer.  Fails
+ * while @msg is still referenced elsewhere, e.g. by a pending request.
+ */
+LIB_EXPORT bool l_genl_msg_reset(struct l_genl_msg *msg, uint8_t cmd)
+{
+	if (unlikely(!msg))
+		return false;
+
+	if (__atomic_load_n(&msg->ref_count, __ATOMIC_SEQ_CST) > 1)
+		return false;
+
+	/* Received messages may still refer to the receive buffer */
+	if (msg->borrowed)
+		return false;
+
+	if (!msg->nlm)
+		msg->nlm = l_netlink_message_new_sized(0, 0,
+						msg_size_history[cmd] +
+						GENL_HDRLEN);
+	else if (l_netlink_message_reset(msg->nlm, 0, 0) < 0)
+		return false;
+
+	netlink_message_reserve_header(msg->nlm,
+					sizeof(struct genlmsghdr), NULL);
+
+	l_free(msg->error_msg);
+	msg->error_msg = NULL;
+	msg->error = 0;
+	msg->cmd = cmd;
+	msg->version = 0;
+
+	return true;
+}
+
 LIB_EXPORT struct l_genl_msg *l_genl_msg_new_from_data(const void *data,
 							size_t size)
 {
@@ -1454,6 +2420,11 @@ LIB_EXPORT const void *l_genl_msg_to_data(struct l_genl_msg *msg, uint16_t type,
 	return msg_as_bytes(msg, type, flags, seq, pid, out_size);
 }
 
+/*
+ * Messages given to callbacks refer to the receive buffer.  Taking a
+ * reference from a callback is what keeps a message valid beyond it, its
+ * data is then copied once the callbacks are done with it.
+ */
 LIB_EXPORT struct l_genl_msg *l_genl_msg_ref(struct l_genl_msg *msg)
 {
 	if (unlikely(!msg))
@@ -1643,6 +2614,9 @@ static unsigned int send_common(struct l_genl_family *family, uint16_t flags,
 	if (!genl)
 		return 0;
 
+	if (msg->nlm)
+		msg_size_record(msg);
+
 	request = l_new(struct genl_request, 1);
 	request->type = family->id;
 	request->flags = NLM_F_REQUEST | flags;
@@ -1654,6 +2628,11 @@ static unsigned int send_common(struct l_genl_family *family, uint16_t flags,
 	request->handle_id = family->handle_id;
 	l_queue_push_tail(genl->request_queue, request);
 
+	if (genl->stats)
+		netlink_stats_set_queue_depth(genl->stats,
+				l_queue_length(genl->request_queue) +
+				l_queue_length(genl->pending_list));
+
 	wakeup_writer(genl);
 
 	return request->id;
@@ -1679,6 +2658,108 @@ LIB_EXPORT unsigned int l_genl_family_dump(struct l_genl_family *family,
 							user_data, destroy);
 }
 
+struct genl_dump_filter {
+	struct l_genl_dump_filter *filters;
+	unsigned int n_filters;
+	l_genl_msg_func_t callback;
+	void *user_data;
+	l_genl_destroy_func_t destroy;
+};
+
+static void genl_dump_filter_free(struct genl_dump_filter *filter)
+{
+	l_free(filter->filters);
+	l_free(filter);
+}
+
+static void genl_dump_filter_destroy(void *user_data)
+{
+	struct genl_dump_filter *filter = user_data;
+
+	if (filter->destroy)
+		filter->destroy(filter->user_data);
+
+	genl_dump_filter_free(filter);
+}
+
+/*
+ * Families that don't know a filter attribute ignore it and dump
+ * everything, so replies carrying a different value are dropped here.
+ */
+static void genl_dump_filter_callback(struct l_genl_msg *msg, void *user_data)
+{
+	struct genl_dump_filter *filter = user_data;
+	struct l_genl_attr attr;
+	uint16_t type;
+	uint16_t len;
+	const void *data;
+	unsigned int i;
+
+	if (!l_genl_attr_init(&attr, msg))
+		goto done;
+
+	while (l_genl_attr_next(&attr, &type, &len, &data)) {
+		if (len != sizeof(uint32_t))
+			continue;
+
+		for (i = 0; i < filter->n_filters; i++) {
+			if (filter->filters[i].type != type)
+				continue;
+
+			if (filter->filters[i].value != l_get_u32(data))
+				return;
+		}
+	}
+
+done:
+	if (filter->callback)
+		filter->callback(msg, filter->user_data);
+}
+
+/*
+ * Like l_genl_family_dump, but each of @filters is added to @msg as a u32
+ * attribute so that families supporting it only dump matching objects,
+ * e.g. the stations of one interface.
+ */
+LIB_EXPORT unsigned int l_genl_family_dump_filtered(
+				struct l_genl_family *family,
+				struct l_genl_msg *msg,
+				const struct l_genl_dump_filter *filters,
+				unsigned int n_filters,
+				l_genl_msg_func_t callback,
+				void *user_data,
+				l_genl_destroy_func_t destroy)
+{
+	struct genl_dump_filter *filter;
+	unsigned int i;
+	unsigned int id;
+
+	if (unlikely(!family || !msg) || unlikely(n_filters && !filters))
+		return 0;
+
+	for (i = 0; i < n_filters; i++)
+		if (!l_genl_msg_append_attr(msg, filters[i].type,
+						sizeof(uint32_t),
+						&filters[i].value))
+			return 0;
+
+	filter = l_new(struct genl_dump_filter, 1);
+	filter->filters = l_memdup(filters,
+				n_filters * sizeof(struct l_genl_dump_filter));
+	filter->n_filters = n_filters;
+	filter->callback = callback;
+	filter->user_data = user_data;
+	filter->destroy = destroy;
+
+	id = send_common(family, NLM_F_ACK | NLM_F_DUMP, msg,
+				genl_dump_filter_callback, filter,
+				genl_dump_filter_destroy);
+	if (!id)
+		genl_dump_filter_free(filter);
+
+	return id;
+}
+
 LIB_EXPORT bool l_genl_family_cancel(struct l_genl_family *family,
 							unsigned int id)
 {
@@ -1764,11 +2845,12 @@ static void drop_membership(struct l_genl *genl, struct genl_mcast *mcast)
 							&group, sizeof(group));
 }
 
-LIB_EXPORT unsigned int l_genl_family_register(struct l_genl_family *family,
-						const char *group,
-						l_genl_msg_func_t callback,
-						void *user_data,
-						l_genl_destroy_func_t destroy)
+static unsigned int family_register(struct l_genl_family *family,
+					const char *group, uint16_t cmd,
+					l_genl_msg_func_t callback,
+					l_genl_msg_batch_func_t batch_callback,
+					void *user_data,
+					l_genl_destroy_func_t destroy)
 {
 	struct l_genl *genl;
 	struct l_genl_family_info *info;
@@ -1793,19 +2875,68 @@ LIB_EXPORT unsigned int l_genl_family_register(struct l_genl_family *family,
 
 	notify = l_new(struct mcast_notify, 1);
 	notify->type = info->id;
+	notify->cmd = cmd;
 	notify->group = mcast->id;
 	notify->callback = callback;
+	notify->batch_callback = batch_callback;
 	notify->destroy = destroy;
 	notify->user_data = user_data;
 	notify->id = get_next_id(&genl->next_notify_id);
 	notify->handle_id = family->handle_id;
 	l_queue_push_tail(genl->notify_list, notify);
+	mcast_dispatch_add(genl, notify);
 
 	add_membership(genl, mcast);
 
 	return notify->id;
 }
 
+LIB_EXPORT unsigned int l_genl_family_register(struct l_genl_family *family,
+						const char *group,
+						l_genl_msg_func_t callback,
+						void *user_data,
+						l_genl_destroy_func_t destroy)
+{
+	return family_register(family, group, MCAST_CMD_ANY, callback, NULL,
+						user_data, destroy);
+}
+
+/*
+ * Like l_genl_family_register, but @callback is only called for messages
+ * carrying command @cmd.  These are looked up directly by command, which
+ * is cheaper than filtering every message of a busy group in the callback.
+ */
+LIB_EXPORT unsigned int l_genl_family_register_cmd(
+					struct l_genl_family *family,
+					const char *group, uint8_t cmd,
+					l_genl_msg_func_t callback,
+					void *user_data,
+					l_genl_destroy_func_t destroy)
+{
+	return family_register(family, group, cmd, callback, NULL,
+						user_data, destroy);
+}
+
+/*
+ * Messages of @group are collected while the socket is read and handed
+ * to @callback together, once per wakeup.  The messages are not copied
+ * out of the receive buffer, so they are only valid during the callback
+ * and must not be referenced beyond it.
+ */
+LIB_EXPORT unsigned int l_genl_family_register_batch(
+					struct l_genl_family *family,
+					const char *group,
+					l_genl_msg_batch_func_t callback,
+					void *user_data,
+					l_genl_destroy_func_t destroy)
+{
+	if (unlikely(!callback))
+		return 0;
+
+	return family_register(family, group, MCAST_CMD_ANY, NULL, callback,
+						user_data, destroy);
+}
+
 LIB_EXPORT bool l_genl_family_unregister(struct l_genl_family *family,
 							unsigned int id)
 {
@@ -1834,6 +2965,8 @@ LIB_EXPORT bool l_genl_family_unregister(struct l_genl_family *family,
 							L_UINT_TO_PTR(id));
 		if (!notify)
 			return false;
+
+		mcast_dispatch_remove(genl, notify);
 	}
 
 	info = l_queue_find(genl->family_infos, family_info_match,
@@ -22,13 +22,29 @@ struct l_genl;
 struct l_genl_family_info;
 struct l_genl_family;
 struct l_genl_msg;
+struct l_netlink_stats;
+
+struct l_genl_cmd_stats {
+	uint16_t family;
+	uint8_t cmd;
+	uint64_t requests;
+	uint64_t errors;
+	uint64_t dump_messages;
+	uint64_t dump_bytes;
+	uint64_t latency_total;
+	uint64_t latency_max;
+};
 
 typedef void (*l_genl_destroy_func_t)(void *user_data);
 typedef void (*l_genl_debug_func_t)(const char *str, void *user_data);
 typedef void (*l_genl_msg_func_t)(struct l_genl_msg *msg, void *user_data);
+typedef void (*l_genl_msg_batch_func_t)(struct l_genl_msg **msgs,
+					unsigned int count, void *user_data);
 typedef void (*l_genl_discover_func_t)(const struct l_genl_family_info *info,
 						void *user_data);
 typedef void (*l_genl_vanished_func_t)(const char *name, void *user_data);
+typedef void (*l_genl_cmd_stats_func_t)(const struct l_genl_cmd_stats *stats,
+						void *user_data);
 
 struct l_genl *l_genl_new(void);
 struct l_genl *l_genl_ref(struct l_genl *genl);
@@ -37,6 +53,14 @@ void l_genl_unref(struct l_genl *genl);
 bool l_genl_set_debug(struct l_genl *genl, l_genl_debug_func_t callback,
 				void *user_data, l_genl_destroy_func_t destroy);
 
+bool l_genl_set_stats(struct l_genl *genl, bool enabled);
+bool l_genl_get_stats(struct l_genl *genl, struct l_netlink_stats *stats);
+bool l_genl_foreach_cmd_stats(struct l_genl *genl,
+				l_genl_cmd_stats_func_t function,
+				void *user_data);
+bool l_genl_set_capture(struct l_genl *genl, const char *path);
+bool l_genl_set_family_cache(struct l_genl *genl, const char *path);
+
 bool l_genl_discover_families(struct l_genl *genl,
 				l_genl_discover_func_t cb, void *user_data,
 				l_genl_destroy_func_t destroy);
@@ -67,8 +91,14 @@ struct l_genl_attr {
 	uint32_t next_len;
 };
 
+struct l_genl_dump_filter {
+	uint16_t type;
+	uint32_t value;
+};
+
 struct l_genl_msg* l_genl_msg_new(uint8_t cmd);
 struct l_genl_msg *l_genl_msg_new_sized(uint8_t cmd, uint32_t size);
+bool l_genl_msg_reset(struct l_genl_msg *msg, uint8_t cmd);
 struct l_genl_msg *l_genl_msg_new_from_data(const void *data, size_t size);
 
 const void *l_genl_msg_to_data(struct l_genl_msg *msg, uint16_t type,
@@ -106,6 +136,15 @@ static inline bool l_genl_attr_recurse(const struct l_genl_attr *attr,
 					(struct l_netlink_attr *) nested) == 0;
 }
 
+static inline bool l_genl_attr_parse(const struct l_genl_attr *attr,
+				const struct l_netlink_attr_policy *policy,
+				uint16_t max_type,
+				struct l_netlink_attr_value *table)
+{
+	return l_netlink_attr_parse((const struct l_netlink_attr *) attr,
+					policy, max_type, table) == 0;
+}
+
 bool l_genl_family_info_has_group(const struct l_genl_family_info *info,
 					const char *group);
 bool l_genl_family_info_can_send(const struct l_genl_family_info *info,
@@ -135,12 +174,27 @@ unsigned int l_genl_family_dump(struct l_genl_family *family,
 				l_genl_msg_func_t callback,
 				void *user_data,
 				l_genl_destroy_func_t destroy);
+unsigned int l_genl_family_dump_filtered(struct l_genl_family *family,
+				struct l_genl_msg *msg,
+				const struct l_genl_dump_filter *filters,
+				unsigned int n_filters,
+				l_genl_msg_func_t callback,
+				void *user_data,
+				l_genl_destroy_func_t destroy);
 bool l_genl_family_cancel(struct l_genl_family *family, unsigned int id);
 bool l_genl_family_request_sent(struct l_genl_family *family, unsigned int id);
 
 unsigned int l_genl_family_register(struct l_genl_family *family,
 				const char *group, l_genl_msg_func_t callback,
 				void *user_data, l_genl_destroy_func_t destroy);
+unsigned int l_genl_family_register_cmd(struct l_genl_family *family,
+				const char *group, uint8_t cmd,
+				l_genl_msg_func_t callback,
+				void *user_data, l_genl_destroy_func_t destroy);
+unsigned int l_genl_family_register_batch(struct l_genl_family *family,
+				const char *group,
+				l_genl_msg_batch_func_t callback,
+				void *user_data, l_genl_destroy_func_t destroy);
 bool l_genl_family_unregister(struct l_genl_family *family, unsigned int id);
 
 #ifdef __cplusplus
@@ -12,6 +12,7 @@
 #define _GNU_SOURCE
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
 #include <string.h>
 #include <dirent.h>
 #include <sys/stat.h>
@@ -21,6 +22,8 @@
 #include "private.h"
 #include "strv.h"
 #include "useful.h"
+#include "io.h"
+#include "idle.h"
 #include "gpio.h"
 
 struct l_gpio_chip {
@@ -40,6 +43,15 @@ struct l_gpio_reader {
 	uint32_t n_offsets;
 };
 
+struct l_gpio_monitor {
+	struct l_io *io;
+	l_gpio_monitor_cb_t callback;
+	void *user_data;
+	l_gpio_destroy_cb_t destroy;
+	bool in_dispatch;
+	bool destroyed;
+};
+
 static bool chip_has_line_label(const char *chip_name, const char *line_label)
 {
 	struct l_gpio_chip *chip;
@@ -383,3 +395,243 @@ LIB_EXPORT bool l_gpio_reader_get(struct l_gpio_reader *reader,
 
 	return true;
 }
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+
+/* Events taken off the line request fd with each read() */
+#define GPIO_MONITOR_BATCH 64
+
+static void monitor_free(void *user_data)
+{
+	struct l_gpio_monitor *monitor = user_data;
+
+	l_io_destroy(monitor->io);
+
+	if (monitor->destroy)
+		monitor->destroy(monitor->user_data);
+
+	l_free(monitor);
+}
+
+static bool monitor_read(struct l_io *io, void *user_data)
+{
+	struct l_gpio_monitor *monitor = user_data;
+	struct gpio_v2_line_event events[GPIO_MONITOR_BATCH];
+	ssize_t len;
+	size_t i;
+
+	monitor->in_dispatch = true;
+
+	do {
+		len = read(l_io_get_fd(io), events, sizeof(events));
+		if (len < 0)
+			break;
+
+		for (i = 0; i < len / sizeof(events[0]) &&
+						!monitor->destroyed; i++) {
+			enum l_gpio_edge edge;
+
+			if (events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE)
+				edge = L_GPIO_EDGE_RISING;
+			else
+				edge = L_GPIO_EDGE_FALLING;
+
+			monitor->callback(events[i].offset, edge,
+						events[i].timestamp_ns,
+						monitor->user_data);
+		}
+	} while (len == sizeof(events) && !monitor->destroyed);
+
+	monitor->in_dispatch = false;
+
+	/* The l_io can't be destroyed from within its own read handler */
+	if (monitor->destroyed) {
+		l_idle_oneshot(monitor_free, monitor, NULL);
+		return false;
+	}
+
+	return true;
+}
+
+static bool monitor_set_debounce(struct gpio_v2_line_config *config,
+					uint32_t n_offsets,
+					const uint32_t debounce_us[])
+{
+	uint32_t i;
+	uint32_t j;
+
+	for (i = 0; i < n_offsets; i++) {
+		struct gpio_v2_line_config_attribute *attr;
+
+		if (!debounce_us[i])
+			continue;
+
+		/* Lines sharing a debounce period share one attribute */
+		for (j = 0; j < config->num_attrs; j++) {
+			attr = &config->attrs[j];
+
+			if (attr->attr.debounce_period_us == debounce_us[i])
+				break;
+		}
+
+		if (j == config->num_attrs) {
+			if (j == GPIO_V2_LINE_NUM_ATTRS_MAX)
+				return false;
+
+			attr = &config->attrs[config->num_attrs++];
+			attr->attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+			attr->attr.debounce_period_us = debounce_us[i];
+		}
+
+		attr->mask |= 1ULL << i;
+	}
+
+	return true;
+}
+
+/**
+ * l_gpio_monitor_new:
+ * @chip: GPIO chip the lines belong to
+ * @consumer: Consumer label reported for the requested lines
+ * @n_offsets: Number of lines in @offsets
+ * @offsets: Offsets of the lines to monitor
+ * @edges: Which edges to report
+ * @debounce_us: Optional per line debounce period in microseconds, in the
+ *	same order as @offsets.  A period of zero disables debouncing
+ * @callback: Called for each edge event
+ * @user_data: User data passed to @callback
+ * @destroy: Called to free @user_data when the monitor is freed
+ *
+ * Requests the lines as inputs with edge detection and reports edge
+ * events from the main loop, along with the kernel timestamp of each
+ * event.  Events are buffered by the kernel and several are read on
+ * each wakeup, so no edges are lost between main loop iterations.
+ * Debouncing is done by the kernel.  At most %GPIO_V2_LINE_NUM_ATTRS_MAX
+ * distinct debounce periods can be used.
+ *
+ * Returns: A newly allocated #l_gpio_monitor or NULL on failure
+ **/
+LIB_EXPORT struct l_gpio_monitor *l_gpio_monitor_new(
+					struct l_gpio_chip *chip,
+					const char *consumer,
+					uint32_t n_offsets,
+					const uint32_t offsets[],
+					enum l_gpio_edge edges,
+					const uint32_t debounce_us[],
+					l_gpio_monitor_cb_t callback,
+					void *user_data,
+					l_gpio_destroy_cb_t destroy)
+{
+	struct l_gpio_monitor *monitor;
+	struct gpio_v2_line_request request;
+	uint32_t i;
+
+	if (unlikely(!chip || !callback))
+		return NULL;
+
+	if (unlikely(n_offsets == 0 || n_offsets > GPIO_V2_LINES_MAX))
+		return NULL;
+
+	if (unlikely(!offsets))
+		return NULL;
+
+	if (unlikely(!edges || (edges & ~L_GPIO_EDGE_BOTH)))
+		return NULL;
+
+	memset(&request, 0, sizeof(request));
+	l_strlcpy(request.consumer, consumer, sizeof(request.consumer));
+	request.num_lines = n_offsets;
+	request.event_buffer_size = n_offsets * 16;
+	request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+
+	if (edges & L_GPIO_EDGE_RISING)
+		request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+
+	if (edges & L_GPIO_EDGE_FALLING)
+		request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+	for (i = 0; i < n_offsets; i++) {
+		if (offsets[i] >= chip->n_lines)
+			return NULL;
+
+		request.offsets[i] = offsets[i];
+	}
+
+	if (debounce_us && !monitor_set_debounce(&request.config, n_offsets,
+								debounce_us))
+		return NULL;
+
+	if (ioctl(chip->fd, GPIO_V2_GET_LINE_IOCTL, &request) < 0)
+		return NULL;
+
+	if (request.fd <= 0)
+		return NULL;
+
+	if (fcntl(request.fd, F_SETFL, O_NONBLOCK) < 0) {
+		close(request.fd);
+		return NULL;
+	}
+
+	monitor = l_new(struct l_gpio_monitor, 1);
+	monitor->io = l_io_new(request.fd);
+	if (!monitor->io) {
+		close(request.fd);
+		l_free(monitor);
+		return NULL;
+	}
+
+	l_io_set_close_on_destroy(monitor->io, true);
+
+	if (!l_io_set_read_handler(monitor->io, monitor_read, monitor, NULL)) {
+		l_io_destroy(monitor->io);
+		l_free(monitor);
+		return NULL;
+	}
+
+	monitor->callback = callback;
+	monitor->user_data = user_data;
+	monitor->destroy = destroy;
+
+	return monitor;
+}
+
+/**
+ * l_gpio_monitor_free:
+ * @monitor: GPIO monitor to free
+ *
+ * Releases the monitored lines.  Can be called from the event callback.
+ **/
+LIB_EXPORT void l_gpio_monitor_free(struct l_gpio_monitor *monitor)
+{
+	if (unlikely(!monitor))
+		return;
+
+	if (monitor->in_dispatch) {
+		monitor->destroyed = true;
+		return;
+	}
+
+	monitor_free(monitor);
+}
+
+#else
+
+LIB_EXPORT struct l_gpio_monitor *l_gpio_monitor_new(
+					struct l_gpio_chip *chip,
+					const char *consumer,
+					uint32_t n_offsets,
+					const uint32_t offsets[],
+					enum l_gpio_edge edges,
+					const uint32_t debounce_us[],
+					l_gpio_monitor_cb_t callback,
+					void *user_data,
+					l_gpio_destroy_cb_t destroy)
+{
+	return NULL;
+}
+
+LIB_EXPORT void l_gpio_monitor_free(struct l_gpio_monitor *monitor)
+{
+}
+
+#endif
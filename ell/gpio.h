@@ -18,6 +18,18 @@ extern "C" {
 struct l_gpio_chip;
 struct l_gpio_writer;
 struct l_gpio_reader;
+struct l_gpio_monitor;
+
+enum l_gpio_edge {
+	L_GPIO_EDGE_RISING = 0x1,
+	L_GPIO_EDGE_FALLING = 0x2,
+	L_GPIO_EDGE_BOTH = L_GPIO_EDGE_RISING | L_GPIO_EDGE_FALLING,
+};
+
+typedef void (*l_gpio_monitor_cb_t)(uint32_t offset, enum l_gpio_edge edge,
+					uint64_t timestamp_ns,
+					void *user_data);
+typedef void (*l_gpio_destroy_cb_t)(void *user_data);
 
 char **l_gpio_chips_with_line_label(const char *line_label);
 struct l_gpio_chip *l_gpio_chip_new(const char *chip_name);
@@ -48,6 +60,17 @@ void l_gpio_reader_free(struct l_gpio_reader *reader);
 bool l_gpio_reader_get(struct l_gpio_reader *reader, uint32_t n_values,
 			uint32_t values[]);
 
+struct l_gpio_monitor *l_gpio_monitor_new(struct l_gpio_chip *chip,
+					const char *consumer,
+					uint32_t n_offsets,
+					const uint32_t offsets[],
+					enum l_gpio_edge edges,
+					const uint32_t debounce_us[],
+					l_gpio_monitor_cb_t callback,
+					void *user_data,
+					l_gpio_destroy_cb_t destroy);
+void l_gpio_monitor_free(struct l_gpio_monitor *monitor);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,6 +20,8 @@ bool _gvariant_iter_enter_variant(struct l_dbus_message_iter *iter,
 					struct l_dbus_message_iter *variant);
 bool _gvariant_iter_enter_array(struct l_dbus_message_iter *iter,
 					struct l_dbus_message_iter *array);
+bool _gvariant_iter_get_fixed_array(struct l_dbus_message_iter *iter,
+					void *out, uint32_t *n_elem);
 bool _gvariant_iter_skip_entry(struct l_dbus_message_iter *iter);
 
 bool _gvariant_valid_signature(const char *sig);
@@ -32,8 +34,13 @@ struct dbus_builder *_gvariant_builder_new(void *body, size_t body_size);
 void _gvariant_builder_free(struct dbus_builder *builder);
 bool _gvariant_builder_append_basic(struct dbus_builder *builder,
 					char type, const void *value);
+bool _gvariant_builder_append_fixed_array(struct dbus_builder *builder,
+					char type, const void *data,
+					uint32_t n);
 bool _gvariant_builder_mark(struct dbus_builder *builder);
 bool _gvariant_builder_rewind(struct dbus_builder *builder);
+void _gvariant_builder_reserve(struct dbus_builder *builder, size_t len);
+size_t _gvariant_builder_get_size(struct dbus_builder *builder);
 char *_gvariant_builder_finish(struct dbus_builder *builder,
 				void **body, size_t *body_size);
 bool _gvariant_builder_enter_struct(struct dbus_builder *builder,
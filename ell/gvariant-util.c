@@ -159,25 +159,7 @@ static const char *validate_next_type(const char *sig, int *out_alignment)
 	return NULL;
 }
 
-bool _gvariant_valid_signature(const char *sig)
-{
-	const char *s = sig;
-	int a;
-
-	if (strlen(sig) > 255)
-		return false;
-
-	do {
-		s = validate_next_type(s, &a);
-
-		if (!s)
-			return false;
-	} while (*s);
-
-	return true;
-}
-
-int _gvariant_num_children(const char *sig)
+static int count_children(const char *sig)
 {
 	const char *s = sig;
 	int a;
@@ -198,7 +180,7 @@ int _gvariant_num_children(const char *sig)
 	return num_children;
 }
 
-int _gvariant_get_alignment(const char *sig)
+static int get_alignment(const char *sig)
 {
 	int max_alignment = 1, alignment;
 	const char *s = sig;
@@ -216,6 +198,44 @@ int _gvariant_get_alignment(const char *sig)
 	return max_alignment;
 }
 
+static struct _dbus_signature_info *signature_info(const char *sig)
+{
+	struct _dbus_signature_info *info;
+
+	info = _dbus_signature_cache_get(sig, true);
+	if (!info || info->num_children)
+		return info;
+
+	info->num_children = count_children(sig);
+
+	if (info->num_children > 0)
+		info->alignment = get_alignment(sig);
+
+	return info;
+}
+
+bool _gvariant_valid_signature(const char *sig)
+{
+	return _gvariant_num_children(sig) > 0;
+}
+
+int _gvariant_num_children(const char *sig)
+{
+	struct _dbus_signature_info *info = signature_info(sig);
+
+	return info ? info->num_children : count_children(sig);
+}
+
+int _gvariant_get_alignment(const char *sig)
+{
+	struct _dbus_signature_info *info = signature_info(sig);
+
+	if (info && info->num_children > 0)
+		return info->alignment;
+
+	return get_alignment(sig);
+}
+
 bool _gvariant_is_fixed_size(const char *sig)
 {
 	while (*sig != 0) {
@@ -284,6 +304,93 @@ int _gvariant_get_fixed_size(const char *sig)
 	return size;
 }
 
+/*
+ * Walks the single complete type at the start of sig once, obtaining both
+ * its alignment and, if it is fixed size, its size.  This is what
+ * validate_next_type(), _gvariant_is_fixed_size() and
+ * _gvariant_get_fixed_size() together return, without needing a NUL
+ * terminated copy of the type.  The size is 0 for variable size types.
+ */
+static const char *get_type_layout(const char *sig, int *out_alignment,
+							int *out_size)
+{
+	const char *end;
+	char close;
+	int max_alignment = 1;
+	int alignment;
+	int offset = 0;
+	int size;
+	int n_children = 0;
+	bool fixed = true;
+
+	switch (*sig) {
+	case 'b':
+	case 'y':
+	case 'n':
+	case 'q':
+	case 'i':
+	case 'u':
+	case 'x':
+	case 't':
+	case 'd':
+	case 'h':
+		*out_alignment = get_basic_alignment(*sig);
+		*out_size = get_basic_fixed_size(*sig);
+		return sig + 1;
+	case 's':
+	case 'o':
+	case 'g':
+	case 'v':
+		*out_alignment = get_basic_alignment(*sig);
+		*out_size = 0;
+		return sig + 1;
+	case 'a':
+		end = get_type_layout(sig + 1, out_alignment, &size);
+		*out_size = 0;
+		return end;
+	case '{':
+		/* Dictionary keys can only be simple types */
+		if (!strchr(simple_types, sig[1]))
+			return NULL;
+
+		close = '}';
+		break;
+	case '(':
+		close = ')';
+		break;
+	default:
+		return NULL;
+	}
+
+	for (end = sig + 1; *end != close; ) {
+		end = get_type_layout(end, &alignment, &size);
+		if (!end)
+			return NULL;
+
+		if (alignment > max_alignment)
+			max_alignment = alignment;
+
+		if (!size)
+			fixed = false;
+
+		offset = align_len(offset, alignment) + size;
+		n_children++;
+	}
+
+	if (close == '}' && n_children != 2)
+		return NULL;
+
+	*out_alignment = max_alignment;
+
+	/* Handle special case of unit type */
+	if (!n_children)
+		*out_size = 1;
+	else
+		*out_size = fixed ? align_len(offset, max_alignment) : 0;
+
+	return end + 1;
+}
+
 static inline size_t offset_length(size_t size, size_t n_offsets)
 {
 	if (size + n_offsets <= 0xff)
@@ -351,12 +458,10 @@ static bool gvariant_iter_init_internal(struct l_dbus_message_iter *iter,
 	unsigned int offset_len = offset_length(len, 0);
 	size_t last_offset;
 	struct gvariant_type_info {
-		uint8_t sig_start;
-		uint8_t sig_end;
 		bool fixed_size : 1;
 		unsigned int alignment : 4;
 		size_t end;		/* Index past the end of the type */
-	} *children;
+	} *children, small_children[16];
 	int n_children;
 
 	if (sig_end) {
@@ -379,7 +484,12 @@ static bool gvariant_iter_init_internal(struct l_dbus_message_iter *iter,
 		if (n_children < 0)
 			return false;
 
-		children = l_new(struct gvariant_type_info, n_children);
+		/* Most containers are small enough to skip the allocation */
+		if (n_children <= (int) L_ARRAY_SIZE(small_children))
+			children = small_children;
+		else
+			children = l_new(struct gvariant_type_info,
+						n_children);
 	} else {
 		n_children = 0;
 
@@ -388,24 +498,15 @@ static bool gvariant_iter_init_internal(struct l_dbus_message_iter *iter,
 
 	for (p = sig_start, i = 0; i < n_children; i++) {
 		int alignment;
-		size_t size;
-		size_t len;
+		int size;
 
-		children[i].sig_start = p - sig_start;
-		p = validate_next_type(p, &alignment);
-		children[i].sig_end = p - sig_start;
-
-		len = children[i].sig_end - children[i].sig_start;
-		memcpy(subsig, sig_start + children[i].sig_start, len);
-		subsig[len] = '\0';
+		p = get_type_layout(p, &alignment, &size);
 
 		children[i].alignment = alignment;
-		children[i].fixed_size = _gvariant_is_fixed_size(subsig);
+		children[i].fixed_size = size != 0;
+		children[i].end = size;
 
-		if (children[i].fixed_size) {
-			size = _gvariant_get_fixed_size(subsig);
-			children[i].end = size;
-		} else if (i + 1 < n_children)
+		if (!size && i + 1 < n_children)
 			num_variable += 1;
 	}
 
@@ -459,12 +560,15 @@ static bool gvariant_iter_init_internal(struct l_dbus_message_iter *iter,
 		iter->offsets = iter->data + offset;
 	}
 
-	l_free(children);
+	if (children != small_children)
+		l_free(children);
 
 	return true;
 
 fail:
-	l_free(children);
+	if (children != small_children)
+		l_free(children);
+
 	return false;
 }
 
@@ -482,41 +586,34 @@ static const void *next_item(struct l_dbus_message_iter *iter,
 							size_t *out_item_size)
 {
 	const void *start;
+	const char *sig = iter->sig_start + iter->sig_pos;
 	const char *p;
-	char sig[256];
 	int alignment;
-	bool fixed_size;
+	int fixed_size;
 	bool last_member;
-	unsigned int sig_len;
 	unsigned int offset_len;
 
-	memcpy(sig, iter->sig_start + iter->sig_pos,
-			iter->sig_len - iter->sig_pos);
-	sig[iter->sig_len - iter->sig_pos] = '\0';
+	if (iter->sig_pos >= iter->sig_len)
+		return NULL;
 
 	/*
 	 * Find the next type and make a note whether it is the last in the
 	 * structure.  Arrays will always have a single complete type, so
 	 * last_member will always be true.
 	 */
-	p = validate_next_type(sig, &alignment);
+	p = get_type_layout(sig, &alignment, &fixed_size);
 	if (!p)
 		return NULL;
 
-	sig_len = p - sig;
-
-	last_member = *p == '\0';
-	sig[sig_len] = '\0';
-
-	fixed_size = _gvariant_is_fixed_size(sig);
+	last_member = p == iter->sig_start + iter->sig_len;
 
 	if (iter->container_type != DBUS_CONTAINER_TYPE_ARRAY)
-		iter->sig_pos += sig_len;
+		iter->sig_pos += p - sig;
 
 	iter->pos = align_len(iter->pos, alignment);
 
 	if (fixed_size) {
-		*out_item_size = _gvariant_get_fixed_size(sig);
+		*out_item_size = fixed_size;
 		goto done;
 	}
 
@@ -731,6 +828,32 @@ bool _gvariant_iter_enter_array(struct l_dbus_message_iter *iter,
 						start, item_size);
 }
 
+bool _gvariant_iter_get_fixed_array(struct l_dbus_message_iter *iter,
+					void *out, uint32_t *n_elem)
+{
+	char type;
+	size_t size;
+
+	if (iter->container_type != DBUS_CONTAINER_TYPE_ARRAY)
+		return false;
+
+	type = iter->sig_start[iter->sig_pos];
+	size = get_basic_fixed_size(type);
+
+	/* Fail if the array is not a fixed size or contains file descriptors */
+	if (!size || type == 'h')
+		return false;
+
+	/*
+	 * Arrays of fixed size elements carry no framing offsets, the
+	 * elements are laid out back to back from the aligned start.
+	 */
+	*(const void **) out = iter->data + iter->pos;
+	*n_elem = (iter->len - iter->pos) / size;
+
+	return true;
+}
+
 bool _gvariant_iter_skip_entry(struct l_dbus_message_iter *iter)
 {
 	size_t size;
@@ -828,11 +951,44 @@ static void container_free(struct container *container)
 	l_free(container);
 }
 
+/*
+ * Writes out a container's framing offsets, last one first if reverse is
+ * set.  The width is picked once for all of them so that each case is a
+ * plain loop over the array.
+ */
+static void write_offsets_le(void *p, const size_t *offsets, size_t n,
+					size_t sz, bool reverse)
+{
+	ptrdiff_t step = reverse ? -1 : 1;
+	size_t i;
+
+	if (reverse)
+		offsets += n - 1;
+
+	switch (sz) {
+	case 1:
+		for (i = 0; i < n; i++, offsets += step)
+			l_put_u8(*offsets, p + i);
+		break;
+	case 2:
+		for (i = 0; i < n; i++, offsets += step)
+			l_put_le16(*offsets, p + i * 2);
+		break;
+	case 4:
+		for (i = 0; i < n; i++, offsets += step)
+			l_put_le32(*offsets, p + i * 4);
+		break;
+	default:
+		for (i = 0; i < n; i++, offsets += step)
+			l_put_le64(*offsets, p + i * 8);
+		break;
+	}
+}
+
 static void container_append_struct_offsets(struct container *container,
 					struct dbus_builder *builder)
 {
 	size_t offset_size;
-	int i;
 	size_t start;
 
 	if (container->variable_is_last)
@@ -846,18 +1002,14 @@ static void container_append_struct_offsets(struct container *container,
 
 	start = grow_body(builder, offset_size * container->offset_index, 1);
 
-	for (i = container->offset_index - 1; i >= 0; i--) {
-		write_word_le(builder->body + start,
-				container->offsets[i], offset_size);
-		start += offset_size;
-	}
+	write_offsets_le(builder->body + start, container->offsets,
+				container->offset_index, offset_size, true);
 }
 
 static void container_append_array_offsets(struct container *container,
 					struct dbus_builder *builder)
 {
 	size_t offset_size;
-	unsigned int i;
 	size_t start;
 
 	if (container->offset_index == 0)
@@ -867,11 +1019,8 @@ static void container_append_array_offsets(struct container *container,
 						container->offset_index);
 	start = grow_body(builder, offset_size * container->offset_index, 1);
 
-	for (i = 0; i < container->offset_index; i++) {
-		write_word_le(builder->body + start,
-				container->offsets[i], offset_size);
-		start += offset_size;
-	}
+	write_offsets_le(builder->body + start, container->offsets,
+				container->offset_index, offset_size, false);
 }
 
 struct dbus_builder *_gvariant_builder_new(void *body, size_t body_size)
@@ -1245,6 +1394,37 @@ bool _gvariant_builder_append_basic(struct dbus_builder *builder,
 	return true;
 }
 
+bool _gvariant_builder_append_fixed_array(struct dbus_builder *builder,
+					char type, const void *data, uint32_t n)
+{
+	struct container *container = l_queue_peek_head(builder->containers);
+	size_t size = get_basic_fixed_size(type);
+	size_t start;
+
+	/* Only valid for appending to an array of fixed size elements */
+	if (!size || type == 'h')
+		return false;
+
+	if (container->type != DBUS_CONTAINER_TYPE_ARRAY ||
+			container->signature[0] != type ||
+			container->signature[1] != '\0')
+		return false;
+
+	if (n > UINT32_MAX / size)
+		return false;
+
+	/* Arrays of fixed size elements carry no framing offsets */
+	start = grow_body(builder, n * size, get_basic_alignment(type));
+
+	/* data may be NULL for an empty array */
+	if (n)
+		memcpy(builder->body + start, data, n * size);
+
+	container->variable_is_last = false;
+
+	return true;
+}
+
 bool _gvariant_builder_mark(struct dbus_builder *builder)
 {
 	struct container *container = l_queue_peek_head(builder->containers);
@@ -1263,6 +1443,20 @@ bool _gvariant_builder_mark(struct dbus_builder *builder)
 	return true;
 }
 
+void _gvariant_builder_reserve(struct dbus_builder *builder, size_t len)
+{
+	if (builder->body_pos + len <= builder->body_size)
+		return;
+
+	builder->body = l_realloc(builder->body, builder->body_pos + len);
+	builder->body_size = builder->body_pos + len;
+}
+
+size_t _gvariant_builder_get_size(struct dbus_builder *builder)
+{
+	return builder->body_pos;
+}
+
 bool _gvariant_builder_rewind(struct dbus_builder *builder)
 {
 	struct container *container;
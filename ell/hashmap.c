@@ -9,9 +9,14 @@
 #include <config.h>
 #endif
 
+#include <stdint.h>
+
 #include "hashmap.h"
+#include "random.h"
+#include "time.h"
 #include "private.h"
 #include "useful.h"
+#include "siphash-private.h"
 
 /**
  * SECTION:hashmap
@@ -20,13 +25,26 @@
  * Hash table support
  */
 
-#define NBUCKETS 127
+/*
+ * Entries live in an open addressing table using Robin Hood linear probing.
+ * The capacity is a power of two and the table grows once it is more than
+ * 7/8 full.  Hashes are stored along with the entries, so growing never
+ * needs to call back into the hash function.
+ *
+ * Within a run of occupied slots, entries are kept sorted by their home
+ * slot, and entries with the same home slot by order of insertion.  This
+ * preserves the semantics of the chained implementation this replaces:
+ * of entries with duplicate keys, the first inserted one is found first.
+ */
+
+#define HASHMAP_MIN_SIZE	8
+#define HASHMAP_MAX_SIZE	(1U << 31)
 
 struct entry {
 	void *key;
 	void *value;
-	struct entry *next;
 	unsigned int hash;
+	unsigned int dist;	/* Probe distance plus one, 0 when unused */
 };
 
 /**
@@ -40,7 +58,9 @@ struct l_hashmap {
 	l_hashmap_key_new_func_t key_new_func;
 	l_hashmap_key_free_func_t key_free_func;
 	unsigned int entries;
-	struct entry buckets[NBUCKETS];
+	unsigned int capacity;
+	unsigned int shift;
+	struct entry *table;
 };
 
 static inline void *get_key_new(const struct l_hashmap *hashmap,
@@ -58,6 +78,170 @@ static inline void free_key(const struct l_hashmap *hashmap, void *key)
 		hashmap->key_free_func(key);
 }
 
+/*
+ * Fibonacci hashing spreads the hash over the table, since hash functions
+ * such as the direct pointer hash leave the low bits mostly constant.
+ */
+static inline uint32_t hash_spread(unsigned int hash)
+{
+	return hash * 2654435769u;
+}
+
+static inline unsigned int hash_to_slot(const struct l_hashmap *hashmap,
+							unsigned int hash)
+{
+	return hash_spread(hash) >> hashmap->shift;
+}
+
+static inline unsigned int slot_next(const struct l_hashmap *hashmap,
+							unsigned int slot)
+{
+	return (slot + 1) & (hashmap->capacity - 1);
+}
+
+static void table_insert(struct l_hashmap *hashmap, void *key, void *value,
+							unsigned int hash)
+{
+	struct entry new_entry = {
+		.key = key,
+		.value = value,
+		.hash = hash,
+		.dist = 1,
+	};
+	unsigned int slot = hash_to_slot(hashmap, hash);
+	bool displaced = false;
+
+	for (;; slot = slot_next(hashmap, slot), new_entry.dist++) {
+		struct entry *entry = &hashmap->table[slot];
+
+		if (!entry->dist) {
+			*entry = new_entry;
+			return;
+		}
+
+		/*
+		 * A new entry goes behind the ones sharing its home slot, but a
+		 * displaced entry was inserted before them and stays ahead.
+		 */
+		if (entry->dist < new_entry.dist ||
+				(displaced && entry->dist == new_entry.dist)) {
+			SWAP(*entry, new_entry);
+			displaced = true;
+		}
+	}
+}
+
+/* Returns the slot of the first matching entry or capacity if not found */
+static unsigned int table_find(const struct l_hashmap *hashmap,
+				const void *key, unsigned int hash)
+{
+	unsigned int slot;
+	unsigned int dist;
+
+	if (!hashmap->entries)
+		return hashmap->capacity;
+
+	slot = hash_to_slot(hashmap, hash);
+
+	for (dist = 1;; slot = slot_next(hashmap, slot), dist++) {
+		const struct entry *entry = &hashmap->table[slot];
+
+		/* Any match would have displaced this richer entry */
+		if (entry->dist < dist)
+			return hashmap->capacity;
+
+		if (entry->hash == hash &&
+				!hashmap->compare_func(key, entry->key))
+			return slot;
+	}
+}
+
+/* Backward shift deletion, no tombstones are left behind */
+static void table_delete(struct l_hashmap *hashmap, unsigned int slot)
+{
+	unsigned int next = slot_next(hashmap, slot);
+
+	while (hashmap->table[next].dist > 1) {
+		hashmap->table[slot] = hashmap->table[next];
+		hashmap->table[slot].dist -= 1;
+		slot = next;
+		next = slot_next(hashmap, next);
+	}
+
+	memset(&hashmap->table[slot], 0, sizeof(struct entry));
+	hashmap->entries -= 1;
+}
+
+/*
+ * Returns a slot at which a run of occupied slots starts or which is free.
+ * Walking the table from there visits every run from start to end, even
+ * the one wrapping around the end of the table.
+ */
+static unsigned int table_walk_start(const struct l_hashmap *hashmap)
+{
+	unsigned int slot;
+
+	for (slot = 0; slot < hashmap->capacity; slot++)
+		if (hashmap->table[slot].dist <= 1)
+			break;
+
+	return slot;
+}
+
+static void table_resize(struct l_hashmap *hashmap, unsigned int capacity)
+{
+	struct entry *old_table = hashmap->table;
+	unsigned int old_capacity = hashmap->capacity;
+	unsigned int slot = 0;
+	unsigned int i;
+
+	if (old_table)
+		slot = table_walk_start(hashmap);
+
+	hashmap->table = l_new(struct entry, capacity);
+	hashmap->capacity = capacity;
+	hashmap->shift = 32 - __builtin_ctz(capacity);
+
+	/* Reinserting in walk order keeps duplicates in insertion order */
+	for (i = 0; i < old_capacity; i++, slot = (slot + 1) &
+							(old_capacity - 1)) {
+		struct entry *entry = &old_table[slot];
+
+		if (entry->dist)
+			table_insert(hashmap, entry->key, entry->value,
+								entry->hash);
+	}
+
+	l_free(old_table);
+}
+
+static unsigned int capacity_for(unsigned int entries)
+{
+	unsigned int capacity = HASHMAP_MIN_SIZE;
+
+	while (capacity < HASHMAP_MAX_SIZE &&
+				entries > capacity - capacity / 8)
+		capacity *= 2;
+
+	return capacity;
+}
+
+/* Makes room for one more entry */
+static bool table_reserve(struct l_hashmap *hashmap)
+{
+	unsigned int capacity = hashmap->capacity;
+
+	if (hashmap->entries < capacity - capacity / 8)
+		return true;
+
+	if (capacity == HASHMAP_MAX_SIZE)
+		return false;
+
+	table_resize(hashmap, capacity ? capacity * 2 : HASHMAP_MIN_SIZE);
+
+	return true;
+}
+
 static inline unsigned int hash_superfast(const uint8_t *key, unsigned int len)
 {
 	/*
@@ -111,6 +295,113 @@ static inline unsigned int hash_superfast(const uint8_t *key, unsigned int len)
 	return hash;
 }
 
+/*
+ * wyhash by Wang Yi, released into the public domain.  This is the final
+ * version 4 of the algorithm, with its default secret.
+ */
+static const uint64_t wyhash_secret[4] = {
+	0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+	0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+
+static inline void wyhash_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t) *a * *b;
+
+	*a = (uint64_t) r;
+	*b = (uint64_t) (r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32;
+	uint64_t la = (uint32_t) *a, lb = (uint32_t) *b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32);
+	uint64_t lo = t + (rm1 << 32);
+	uint64_t c = (t < rl) + (lo < t);
+
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t wyhash_mix(uint64_t a, uint64_t b)
+{
+	wyhash_mum(&a, &b);
+
+	return a ^ b;
+}
+
+static inline uint64_t wyhash_r3(const uint8_t *p, size_t k)
+{
+	return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) |
+								p[k - 1];
+}
+
+static uint64_t wyhash(const uint8_t *p, size_t len, uint64_t seed)
+{
+	const uint64_t *secret = wyhash_secret;
+	uint64_t a, b;
+
+	seed ^= wyhash_mix(seed ^ secret[0], secret[1]);
+
+	if (len <= 16) {
+		if (len >= 4) {
+			size_t off = (len >> 3) << 2;
+
+			a = ((uint64_t) l_get_le32(p) << 32) |
+						l_get_le32(p + off);
+			b = ((uint64_t) l_get_le32(p + len - 4) << 32) |
+						l_get_le32(p + len - 4 - off);
+		} else if (len > 0) {
+			a = wyhash_r3(p, len);
+			b = 0;
+		} else
+			a = b = 0;
+	} else {
+		size_t i = len;
+
+		if (i > 48) {
+			uint64_t see1 = seed, see2 = seed;
+
+			do {
+				seed = wyhash_mix(l_get_le64(p) ^ secret[1],
+						l_get_le64(p + 8) ^ seed);
+				see1 = wyhash_mix(l_get_le64(p + 16) ^
+						secret[2],
+						l_get_le64(p + 24) ^ see1);
+				see2 = wyhash_mix(l_get_le64(p + 32) ^
+						secret[3],
+						l_get_le64(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+
+			seed ^= see1 ^ see2;
+		}
+
+		while (i > 16) {
+			seed = wyhash_mix(l_get_le64(p) ^ secret[1],
+						l_get_le64(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+
+		a = l_get_le64(p + i - 16);
+		b = l_get_le64(p + i - 8);
+	}
+
+	a ^= secret[1];
+	b ^= seed;
+	wyhash_mum(&a, &b);
+
+	return wyhash_mix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+static inline unsigned int hash_fold(uint64_t hash)
+{
+	return hash ^ (hash >> 32);
+}
+
 static unsigned int direct_hash_func(const void *p)
 {
 	return L_PTR_TO_UINT(p);
@@ -147,6 +438,35 @@ LIB_EXPORT struct l_hashmap *l_hashmap_new(void)
 	return hashmap;
 }
 
+/**
+ * l_hashmap_new_sized:
+ * @hint: number of entries to make room for
+ *
+ * Create a new hash table, like l_hashmap_new(), with room for at least
+ * @hint entries.  The table holds that many entries without having to grow,
+ * which avoids rehashing when the number of entries is known in advance.
+ *
+ * Returns: a newly allocated #l_hashmap object
+ **/
+LIB_EXPORT struct l_hashmap *l_hashmap_new_sized(unsigned int hint)
+{
+	struct l_hashmap *hashmap = l_hashmap_new();
+
+	if (hint)
+		table_resize(hashmap, capacity_for(hint));
+
+	return hashmap;
+}
+
+/**
+ * l_str_hash:
+ * @p: NUL-terminated string
+ *
+ * Hashes @p with Paul Hsieh's SuperFastHash.  This is kept for
+ * compatibility, l_str_hash_fast() is quicker and distributes better.
+ *
+ * Returns: the hash of @p
+ **/
 LIB_EXPORT unsigned int l_str_hash(const void *p)
 {
 	const char *s = p;
@@ -155,6 +475,92 @@ LIB_EXPORT unsigned int l_str_hash(const void *p)
 	return hash_superfast((const uint8_t *)s, len);
 }
 
+/**
+ * l_str_hash_fast:
+ * @p: NUL-terminated string
+ *
+ * Hashes @p with wyhash.  This is the default hash function of maps created
+ * with l_hashmap_string_new().  Like l_str_hash(), it is not suitable for
+ * keys chosen by an adversary trying to provoke collisions, see
+ * l_str_hash_keyed() for those.
+ *
+ * Returns: the hash of @p
+ **/
+LIB_EXPORT unsigned int l_str_hash_fast(const void *p)
+{
+	const char *s = p;
+
+	return hash_fold(wyhash((const uint8_t *) s, strlen(s), 0));
+}
+
+static uint8_t siphash_key[16];
+static int siphash_key_state;
+
+static const uint8_t *get_siphash_key(void)
+{
+	int state = 0;
+
+	if (likely(__atomic_load_n(&siphash_key_state, __ATOMIC_ACQUIRE) == 2))
+		return siphash_key;
+
+	/* Whoever wins the race generates the key, others wait for it */
+	if (__atomic_compare_exchange_n(&siphash_key_state, &state, 1, false,
+					__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+		if (!l_getrandom(siphash_key, sizeof(siphash_key))) {
+			uint64_t fallback = l_time_now() ^
+					(uintptr_t) &siphash_key_state;
+
+			memcpy(siphash_key, &fallback, sizeof(fallback));
+		}
+
+		__atomic_store_n(&siphash_key_state, 2, __ATOMIC_RELEASE);
+		return siphash_key;
+	}
+
+	while (__atomic_load_n(&siphash_key_state, __ATOMIC_ACQUIRE) != 2)
+		;
+
+	return siphash_key;
+}
+
+/**
+ * l_str_hash_keyed:
+ * @p: NUL-terminated string
+ *
+ * Hashes @p with SipHash-2-4, keyed with a random key generated once per
+ * process.  Use this for maps whose keys come from untrusted peers, such as
+ * D-Bus names, since without the key collisions can't be precomputed.
+ *
+ * Returns: the hash of @p
+ **/
+LIB_EXPORT unsigned int l_str_hash_keyed(const void *p)
+{
+	const char *s = p;
+	uint8_t out[8];
+
+	_siphash24(out, (const uint8_t *) s, strlen(s), get_siphash_key());
+
+	return hash_fold(l_get_le64(out));
+}
+
+/**
+ * l_ptr_hash:
+ * @p: pointer
+ *
+ * Hashes the value of @p, mixing all of its bits.  Maps created with
+ * l_hashmap_new() use the pointer value itself, which the table spreads
+ * well enough for addresses of heap objects.  This is better suited for
+ * integer keys with patterns in their upper bits, or 64-bit pointer values
+ * differing only above the lower 32 bits.
+ *
+ * Returns: the hash of @p
+ **/
+LIB_EXPORT unsigned int l_ptr_hash(const void *p)
+{
+	return hash_fold(wyhash_mix((uintptr_t) p ^ wyhash_secret[0],
+							wyhash_secret[1]));
+}
+
 /**
  * l_hashmap_string_new:
  *
@@ -174,7 +580,7 @@ LIB_EXPORT struct l_hashmap *l_hashmap_string_new(void)
 
 	hashmap = l_new(struct l_hashmap, 1);
 
-	hashmap->hash_func = l_str_hash;
+	hashmap->hash_func = l_str_hash_fast;
 	hashmap->compare_func = (l_hashmap_compare_func_t) strcmp;
 	hashmap->key_new_func = (l_hashmap_key_new_func_t) l_strdup;
 	hashmap->key_free_func = l_free;
@@ -188,7 +594,9 @@ LIB_EXPORT struct l_hashmap *l_hashmap_string_new(void)
  * @hashmap: hash table object
  * @func: Key hashing function
  *
- * Sets the hashing function to be used by this object.
+ * Sets the hashing function to be used by this object.  Besides custom
+ * functions, l_str_hash_fast(), l_str_hash_keyed() or l_str_hash() can be
+ * used for string keys and l_ptr_hash() for pointer keys.
  *
  * This function can only be called when the @hashmap is empty.
  *
@@ -310,28 +718,19 @@ LIB_EXPORT void l_hashmap_destroy(struct l_hashmap *hashmap,
 	if (unlikely(!hashmap))
 		return;
 
-	for (i = 0; i < NBUCKETS; i++) {
-		struct entry *entry, *next, *head = &hashmap->buckets[i];
+	for (i = 0; i < hashmap->capacity; i++) {
+		struct entry *entry = &hashmap->table[i];
 
-		if (!head->next)
+		if (!entry->dist)
 			continue;
 
-		for (entry = head;; entry = next) {
-			if (destroy)
-				destroy(entry->value);
-
-			free_key(hashmap, entry->key);
+		if (destroy)
+			destroy(entry->value);
 
-			next = entry->next;
-
-			if (entry != head)
-				l_free(entry);
-
-			if (next == head)
-				break;
-		}
+		free_key(hashmap, entry->key);
 	}
 
+	l_free(hashmap->table);
 	l_free(hashmap);
 }
 
@@ -351,37 +750,18 @@ LIB_EXPORT void l_hashmap_destroy(struct l_hashmap *hashmap,
 LIB_EXPORT bool l_hashmap_insert(struct l_hashmap *hashmap,
 				const void *key, void *value)
 {
-	struct entry *entry, *head;
 	unsigned int hash;
 	void *key_new;
 
 	if (unlikely(!hashmap))
 		return false;
 
+	if (unlikely(!table_reserve(hashmap)))
+		return false;
+
 	key_new = get_key_new(hashmap, key);
 	hash = hashmap->hash_func(key_new);
-	head = &hashmap->buckets[hash % NBUCKETS];
-
-	if (!head->next) {
-		head->key = key_new;
-		head->value = value;
-		head->hash = hash;
-		head->next = head;
-		goto done;
-	}
-
-	entry = l_new(struct entry, 1);
-	entry->key = key_new;
-	entry->value = value;
-	entry->hash = hash;
-	entry->next = head;
-
-	while (head->next != entry->next)
-		head = head->next;
-
-	head->next = entry;
-
-done:
+	table_insert(hashmap, key_new, value, hash);
 	hashmap->entries++;
 
 	return true;
@@ -404,9 +784,8 @@ LIB_EXPORT bool l_hashmap_replace(struct l_hashmap *hashmap,
 					const void *key, void *value,
 					void **old_value)
 {
-	struct entry *entry;
-	struct entry *head;
 	unsigned int hash;
+	unsigned int slot;
 	void *key_new;
 
 	if (unlikely(!hashmap))
@@ -414,22 +793,10 @@ LIB_EXPORT bool l_hashmap_replace(struct l_hashmap *hashmap,
 
 	key_new = get_key_new(hashmap, key);
 	hash = hashmap->hash_func(key_new);
-	head = &hashmap->buckets[hash % NBUCKETS];
-
-	if (!head->next) {
-		head->key = key_new;
-		head->value = value;
-		head->hash = hash;
-		head->next = head;
-		goto done;
-	}
-
-	for (entry = head;; entry = entry->next) {
-		if (entry->hash != hash)
-			goto next;
 
-		if (hashmap->compare_func(key, entry->key))
-			goto next;
+	slot = table_find(hashmap, key, hash);
+	if (slot < hashmap->capacity) {
+		struct entry *entry = &hashmap->table[slot];
 
 		if (old_value)
 			*old_value = entry->value;
@@ -438,29 +805,19 @@ LIB_EXPORT bool l_hashmap_replace(struct l_hashmap *hashmap,
 		free_key(hashmap, key_new);
 
 		return true;
-
-next:
-		if (entry->next == head)
-			break;
 	}
 
-	entry = l_new(struct entry, 1);
-	entry->key = key_new;
-	entry->value = value;
-	entry->hash = hash;
-	entry->next = head;
-
-	while (head->next != entry->next)
-		head = head->next;
+	if (unlikely(!table_reserve(hashmap))) {
+		free_key(hashmap, key_new);
+		return false;
+	}
 
-	head->next = entry;
+	table_insert(hashmap, key_new, value, hash);
+	hashmap->entries++;
 
-done:
 	if (old_value)
 		*old_value = NULL;
 
-	hashmap->entries++;
-
 	return true;
 }
 
@@ -475,61 +832,23 @@ done:
  **/
 LIB_EXPORT void *l_hashmap_remove(struct l_hashmap *hashmap, const void *key)
 {
-	struct entry *entry, *head, *prev;
-	unsigned int hash;
+	struct entry *entry;
+	unsigned int slot;
+	void *value;
 
 	if (unlikely(!hashmap))
 		return NULL;
 
-	hash = hashmap->hash_func(key);
-	head = &hashmap->buckets[hash % NBUCKETS];
-
-	if (!head->next)
+	slot = table_find(hashmap, key, hashmap->hash_func(key));
+	if (slot == hashmap->capacity)
 		return NULL;
 
-	for (entry = head, prev = NULL;; prev = entry, entry = entry->next) {
-		void *value;
-
-		if (entry->hash != hash)
-			goto next;
-
-		if (hashmap->compare_func(key, entry->key))
-			goto next;
-
-		value = entry->value;
-
-		if (entry == head) {
-			if (entry->next == head) {
-				free_key(hashmap, entry->key);
-				head->key = NULL;
-				head->value = NULL;
-				head->hash = 0;
-				head->next = NULL;
-			} else {
-				entry = entry->next;
-				free_key(hashmap, head->key);
-				head->key = entry->key;
-				head->value = entry->value;
-				head->hash = entry->hash;
-				head->next = entry->next;
-				l_free(entry);
-			}
-		} else {
-			prev->next = entry->next;
-			free_key(hashmap, entry->key);
-			l_free(entry);
-		}
-
-		hashmap->entries--;
-
-		return value;
+	entry = &hashmap->table[slot];
+	value = entry->value;
+	free_key(hashmap, entry->key);
+	table_delete(hashmap, slot);
 
-next:
-		if (entry->next == head)
-			break;
-	}
-
-	return NULL;
+	return value;
 }
 
 /**
@@ -543,28 +862,16 @@ next:
  **/
 LIB_EXPORT void *l_hashmap_lookup(struct l_hashmap *hashmap, const void *key)
 {
-	struct entry *entry, *head;
-	unsigned int hash;
+	unsigned int slot;
 
 	if (unlikely(!hashmap))
 		return NULL;
 
-	hash = hashmap->hash_func(key);
-	head = &hashmap->buckets[hash % NBUCKETS];
-
-	if (!head->next)
+	slot = table_find(hashmap, key, hashmap->hash_func(key));
+	if (slot == hashmap->capacity)
 		return NULL;
 
-	for (entry = head;; entry = entry->next) {
-		if (entry->hash == hash &&
-				!hashmap->compare_func(key, entry->key))
-			return entry->value;
-
-		if (entry->next == head)
-			break;
-	}
-
-	return NULL;
+	return hashmap->table[slot].value;
 }
 
 /**
@@ -587,18 +894,11 @@ LIB_EXPORT void l_hashmap_foreach(struct l_hashmap *hashmap,
 	if (unlikely(!hashmap || !function))
 		return;
 
-	for (i = 0; i < NBUCKETS; i++) {
-		struct entry *entry, *head = &hashmap->buckets[i];
-
-		if (!head->next)
-			continue;
+	for (i = 0; i < hashmap->capacity; i++) {
+		struct entry *entry = &hashmap->table[i];
 
-		for (entry = head;; entry = entry->next) {
+		if (entry->dist)
 			function(entry->key, entry->value, user_data);
-
-			if (entry->next == head)
-				break;
-		}
 	}
 }
 
@@ -621,74 +921,178 @@ LIB_EXPORT unsigned int l_hashmap_foreach_remove(struct l_hashmap *hashmap,
 					l_hashmap_remove_func_t function,
 					void *user_data)
 {
-	unsigned int i;
 	unsigned int nremoved = 0;
+	unsigned int slot;
+	unsigned int i;
 
 	if (unlikely(!hashmap || !function))
 		return 0;
 
-	for (i = 0; i < NBUCKETS; i++) {
-		struct entry *head = &hashmap->buckets[i];
-		struct entry *entry;
-		struct entry *prev;
-		bool remove;
-
-		if (head->next == NULL)
-			continue;
+	if (!hashmap->entries)
+		return 0;
 
-		entry = head;
-		prev = NULL;
+	/*
+	 * Start at a free slot, deletions then only ever shift entries that
+	 * have not been visited yet into the current slot.
+	 */
+	for (slot = 0; hashmap->table[slot].dist; slot++)
+		;
 
-		while (true) {
-			remove = function(entry->key, entry->value, user_data);
+	for (i = 0; i < hashmap->capacity; i++) {
+		struct entry *entry;
 
-			if (!remove)
-				goto next;
+		slot = slot_next(hashmap, slot);
+		entry = &hashmap->table[slot];
 
+		while (entry->dist && function(entry->key, entry->value,
+							user_data)) {
+			free_key(hashmap, entry->key);
+			table_delete(hashmap, slot);
 			nremoved += 1;
-			hashmap->entries -= 1;
-
-			if (entry == head) {
-				if (entry->next == head) {
-					free_key(hashmap, entry->key);
-					head->key = NULL;
-					head->value = NULL;
-					head->hash = 0;
-					head->next = NULL;
-					break;
-				} else {
-					entry = entry->next;
-					free_key(hashmap, head->key);
-					head->key = entry->key;
-					head->value = entry->value;
-					head->hash = entry->hash;
-					head->next = entry->next;
-					l_free(entry);
-					entry = head;
-					continue;
-				}
-			} else {
-				prev->next = entry->next;
-				free_key(hashmap, entry->key);
-				l_free(entry);
-				entry = prev->next;
-				if (entry == head)
-					break;
-				continue;
-			}
-
-next:
-			if (entry->next == head)
-				break;
-
-			prev = entry;
-			entry = entry->next;
 		}
 	}
 
 	return nremoved;
 }
 
+/**
+ * l_hashmap_iter_init:
+ * @iter: iterator to initialize
+ * @hashmap: hash table object
+ *
+ * Sets up @iter to walk over all entries of @hashmap with
+ * l_hashmap_iter_next().  This provides the same traversal as
+ * l_hashmap_foreach() without a callback, and the same rules apply: the
+ * hashmap must not be modified until the iteration is over.
+ **/
+LIB_EXPORT void l_hashmap_iter_init(struct l_hashmap_iter *iter,
+					struct l_hashmap *hashmap)
+{
+	if (unlikely(!iter))
+		return;
+
+	iter->hashmap = hashmap;
+	iter->slot = 0;
+}
+
+/**
+ * l_hashmap_iter_next:
+ * @iter: iterator
+ * @key: location to store the key of the next entry, or NULL
+ * @value: location to store the value of the next entry, or NULL
+ *
+ * Advances @iter to the next entry of the hashmap.
+ *
+ * Returns: #true if an entry was returned, #false once all entries have
+ * been visited.
+ **/
+LIB_EXPORT bool l_hashmap_iter_next(struct l_hashmap_iter *iter,
+					const void **key, void **value)
+{
+	struct l_hashmap *hashmap;
+
+	if (unlikely(!iter || !iter->hashmap))
+		return false;
+
+	hashmap = iter->hashmap;
+
+	while (iter->slot < hashmap->capacity) {
+		struct entry *entry = &hashmap->table[iter->slot++];
+
+		if (!entry->dist)
+			continue;
+
+		if (key)
+			*key = entry->key;
+
+		if (value)
+			*value = entry->value;
+
+		return true;
+	}
+
+	return false;
+}
+
+/* Visits the entries whose home is @home, returns how many there were */
+static unsigned int scan_home(struct l_hashmap *hashmap, unsigned int home,
+				l_hashmap_foreach_func_t function,
+				void *user_data)
+{
+	unsigned int slot = home;
+	unsigned int dist;
+	unsigned int visited = 0;
+
+	/* Entries displaced from earlier homes come first, then ours */
+	for (dist = 1; hashmap->table[slot].dist >= dist;
+				slot = slot_next(hashmap, slot), dist++) {
+		struct entry *entry = &hashmap->table[slot];
+
+		if (entry->dist != dist)
+			continue;
+
+		function(entry->key, entry->value, user_data);
+		visited += 1;
+	}
+
+	return visited;
+}
+
+/**
+ * l_hashmap_scan:
+ * @hashmap: hash table object
+ * @cursor: 0 to start a new scan, or the value returned by the last call
+ * @count: approximate number of entries to visit
+ * @function: callback function
+ * @user_data: user data given to callback function
+ *
+ * Calls @function for some of the entries of @hashmap, starting where the
+ * previous call with the returned cursor left off.  This allows a large map
+ * to be walked in steps, e.g. from an idle or timeout, without stalling the
+ * main loop.
+ *
+ * Unlike with l_hashmap_foreach(), @hashmap may be modified in between
+ * calls, and even grow.  Entries present during the whole scan are visited
+ * exactly once.  Entries that were added or removed in the meantime may or
+ * may not be visited.  Within a single call, the same rules as for
+ * l_hashmap_foreach() apply.
+ *
+ * Returns: the cursor to pass to the next call, or 0 when the scan is done.
+ **/
+LIB_EXPORT unsigned int l_hashmap_scan(struct l_hashmap *hashmap,
+					unsigned int cursor, unsigned int count,
+					l_hashmap_foreach_func_t function,
+					void *user_data)
+{
+	unsigned int visited = 0;
+	unsigned int home;
+
+	if (unlikely(!hashmap || !function))
+		return 0;
+
+	if (!hashmap->entries)
+		return 0;
+
+	/*
+	 * The cursor is a position in the spread hash space, whose upper bits
+	 * give the home slot in a table of any size.  Cursors always point to
+	 * the start of a home slot, which stays a home boundary when the
+	 * table grows, and entries are visited one whole home at a time.
+	 */
+	for (home = cursor >> hashmap->shift; home < hashmap->capacity;
+								home++) {
+		if (visited >= maxsize(count, 1))
+			break;
+
+		visited += scan_home(hashmap, home, function, user_data);
+	}
+
+	if (home == hashmap->capacity)
+		return 0;
+
+	return home << hashmap->shift;
+}
+
 /**
  * l_hashmap_size:
  * @hashmap: hash table object
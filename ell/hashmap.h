@@ -26,9 +26,18 @@ typedef bool (*l_hashmap_remove_func_t)(const void *key, void *value,
 
 struct l_hashmap;
 
+struct l_hashmap_iter {
+	struct l_hashmap *hashmap;
+	unsigned int slot;
+};
+
 unsigned int l_str_hash(const void *p);
+unsigned int l_str_hash_fast(const void *p);
+unsigned int l_str_hash_keyed(const void *p);
+unsigned int l_ptr_hash(const void *p);
 
 struct l_hashmap *l_hashmap_new(void);
+struct l_hashmap *l_hashmap_new_sized(unsigned int hint);
 struct l_hashmap *l_hashmap_string_new(void);
 
 bool l_hashmap_set_hash_function(struct l_hashmap *hashmap,
@@ -56,6 +65,16 @@ void l_hashmap_foreach(struct l_hashmap *hashmap,
 unsigned int l_hashmap_foreach_remove(struct l_hashmap *hashmap,
 			l_hashmap_remove_func_t function, void *user_data);
 
+void l_hashmap_iter_init(struct l_hashmap_iter *iter,
+				struct l_hashmap *hashmap);
+bool l_hashmap_iter_next(struct l_hashmap_iter *iter, const void **key,
+				void **value);
+
+unsigned int l_hashmap_scan(struct l_hashmap *hashmap, unsigned int cursor,
+				unsigned int count,
+				l_hashmap_foreach_func_t function,
+				void *user_data);
+
 unsigned int l_hashmap_size(struct l_hashmap *hashmap);
 bool l_hashmap_isempty(struct l_hashmap *hashmap);
 
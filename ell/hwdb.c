@@ -19,7 +19,9 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 
+#include "useful.h"
 #include "util.h"
+#include "arena.h"
 #include "hwdb.h"
 #include "private.h"
 
@@ -182,8 +184,36 @@ LIB_EXPORT void l_hwdb_unref(struct l_hwdb *hwdb)
 	l_free(hwdb);
 }
 
+static void add_entries(const void *addr, const void *addr_ptr,
+				uint64_t entry_count, struct l_arena *arena,
+				struct l_hwdb_entry **entries)
+{
+	uint64_t i;
+
+	for (i = 0; i < entry_count; i++) {
+		const struct trie_entry *entry = addr_ptr;
+		const char *key_str = addr + L_LE64_TO_CPU(entry->key_offset);
+		const char *val_str = addr + L_LE64_TO_CPU(entry->value_offset);
+		struct l_hwdb_entry *result;
+
+		if (key_str[0] == ' ') {
+			if (arena)
+				result = l_arena_alloc(arena, sizeof(*result));
+			else
+				result = l_new(struct l_hwdb_entry, 1);
+
+			result->key = key_str + 1;
+			result->value = val_str;
+			result->next = (*entries);
+			*entries = result;
+		}
+
+		addr_ptr += sizeof(*entry);
+	}
+}
+
 static void trie_fnmatch(const void *addr, uint64_t offset, const char *prefix,
-				const char *string,
+				const char *string, struct l_arena *arena,
 				struct l_hwdb_entry **entries)
 {
 	const struct trie_node *node = addr + offset;
@@ -218,7 +248,7 @@ static void trie_fnmatch(const void *addr, uint64_t offset, const char *prefix,
 		scratch_buf[scratch_len] = child->c;
 
 		trie_fnmatch(addr, L_LE64_TO_CPU(child->child_offset),
-				scratch_buf, string, entries);
+				scratch_buf, string, arena, entries);
 
 		addr_ptr += sizeof(*child);
 	}
@@ -231,23 +261,281 @@ static void trie_fnmatch(const void *addr, uint64_t offset, const char *prefix,
 	if (fnmatch(scratch_buf, string, 0))
 		return;
 
-	for (i = 0; i < entry_count; i++) {
-		const struct trie_entry *entry = addr_ptr;
-		const char *key_str = addr + L_LE64_TO_CPU(entry->key_offset);
-		const char *val_str = addr + L_LE64_TO_CPU(entry->value_offset);
-		struct l_hwdb_entry *result;
+	add_entries(addr, addr_ptr, entry_count, arena, entries);
+}
 
-		if (key_str[0] == ' ') {
-			result = l_new(struct l_hwdb_entry, 1);
+/*
+ * Matches the patterns along a trie path incrementally, instead of running
+ * fnmatch() on the whole path so far at every node.  The state of each
+ * modalias is the set of its positions that the pattern so far can have
+ * consumed up to, a bitmap of len + 1 bits, so that each pattern character
+ * costs a few word operations.  Several modaliases can share a walk, each
+ * one dropping out once its set is empty.  Bracket expressions and escapes
+ * span several trie characters and are rare in hwdb, subtrees using them
+ * fall back to trie_fnmatch().
+ */
+struct trie_match {
+	const char *string;
+	size_t len;
+	unsigned int words;
+	uint64_t *masks;		/* Any character mask, then per char */
+	uint16_t char_index[256];	/* Index into masks, 0 if absent */
+	struct l_hwdb_entry **entries;
+};
 
-			result->key = key_str + 1;
-			result->value = val_str;
-			result->next = (*entries);
-			*entries = result;
+struct trie_walk {
+	const void *addr;
+	struct l_arena *arena;
+	const struct trie_match *matches;
+};
+
+static void trie_match_init(struct trie_match *match, const char *string,
+				struct l_hwdb_entry **entries)
+{
+	unsigned int n_masks = 1;
+	size_t p;
+
+	memset(match->char_index, 0, sizeof(match->char_index));
+	match->string = string;
+	match->len = strlen(string);
+	match->words = match->len / 64 + 1;
+	match->entries = entries;
+
+	for (p = 0; p < match->len; p++) {
+		unsigned char c = string[p];
+
+		if (!match->char_index[c])
+			match->char_index[c] = n_masks++;
+	}
+
+	match->masks = l_new(uint64_t, n_masks * match->words);
+
+	for (p = 0; p < match->len; p++) {
+		unsigned char c = string[p];
+		uint64_t *mask = match->masks +
+				match->char_index[c] * match->words;
+
+		mask[p / 64] |= 1ULL << p % 64;
+		match->masks[p / 64] |= 1ULL << p % 64;
+	}
+}
+
+static bool match_step(const struct trie_match *match, const uint64_t *in,
+			uint64_t *out, unsigned char c)
+{
+	const uint64_t *mask;
+	uint64_t any = 0;
+	uint64_t carry = 0;
+	unsigned int i;
+
+	if (c == '*') {
+		for (i = 0; i < match->words && !in[i]; i++)
+			out[i] = 0;
+
+		if (i == match->words)
+			return false;
+
+		/* Every position from the first reachable one on */
+		out[i] = ~((in[i] & -in[i]) - 1);
+
+		while (++i < match->words)
+			out[i] = ~0ULL;
+
+		out[match->words - 1] &= ~0ULL >> (63 - match->len % 64);
+		return true;
+	}
+
+	if (c != '?' && !match->char_index[c])
+		return false;
+
+	mask = match->masks + (c == '?' ? 0 : match->char_index[c]) *
+								match->words;
+
+	/* Each position that can consume the character advances by one */
+	for (i = 0; i < match->words; i++) {
+		uint64_t bits = in[i] & mask[i];
+
+		out[i] = bits << 1 | carry;
+		carry = bits >> 63;
+		any |= out[i];
+	}
+
+	return any;
+}
+
+/* Steps the modaliases in @in_active, returns how many can still match */
+static unsigned int walk_step(const struct trie_walk *walk, unsigned char c,
+				unsigned int n_active,
+				const unsigned int *in_active,
+				const uint64_t *in_states,
+				unsigned int *out_active, uint64_t *out_states)
+{
+	unsigned int n_out = 0;
+	unsigned int k;
+
+	for (k = 0; k < n_active; k++) {
+		const struct trie_match *match = &walk->matches[in_active[k]];
+
+		if (match_step(match, in_states, out_states, c)) {
+			out_active[n_out++] = in_active[k];
+			out_states += match->words;
 		}
 
-		addr_ptr += sizeof(*entry);
+		in_states += match->words;
+	}
+
+	return n_out;
+}
+
+static void walk_fnmatch(const struct trie_walk *walk, uint64_t offset,
+				const char *prefix, unsigned int n_active,
+				const unsigned int *active)
+{
+	unsigned int k;
+
+	for (k = 0; k < n_active; k++) {
+		const struct trie_match *match = &walk->matches[active[k]];
+
+		trie_fnmatch(walk->addr, offset, prefix, match->string,
+				walk->arena, match->entries);
+	}
+}
+
+static bool is_match_special(char c)
+{
+	return c == '[' || c == '\\';
+}
+
+static void trie_walk_node(const struct trie_walk *walk, uint64_t offset,
+				const char *prefix, unsigned int n_active,
+				const unsigned int *active,
+				const uint64_t *states)
+{
+	const void *addr = walk->addr;
+	const struct trie_node *node = addr + offset;
+	const void *addr_ptr = addr + offset + sizeof(*node);
+	const char *prefix_str = addr + L_LE64_TO_CPU(node->prefix_offset);
+	uint64_t child_count = L_LE64_TO_CPU(node->child_count);
+	uint64_t entry_count = L_LE64_TO_CPU(node->entry_count);
+	unsigned int *node_active;
+	unsigned int *child_active;
+	uint64_t *node_states;
+	uint64_t *child_states;
+	const uint64_t *state;
+	size_t total = 0;
+	void *buf;
+	uint64_t i;
+	unsigned int k;
+	size_t scratch_len;
+	char *scratch_buf;
+	const char *c;
+
+	for (k = 0; k < n_active; k++)
+		total += walk->matches[active[k]].words;
+
+	buf = l_malloc(total * 2 * sizeof(uint64_t) +
+				n_active * 2 * sizeof(unsigned int));
+	node_states = buf;
+	child_states = node_states + total;
+	node_active = (unsigned int *) (child_states + total);
+	child_active = node_active + n_active;
+
+	memcpy(node_states, states, total * sizeof(uint64_t));
+	memcpy(node_active, active, n_active * sizeof(unsigned int));
+
+	for (c = prefix_str; *c; c++) {
+		if (is_match_special(*c)) {
+			walk_fnmatch(walk, offset, prefix,
+					n_active, node_active);
+			goto done;
+		}
+
+		n_active = walk_step(walk, *c, n_active, node_active,
+					node_states, child_active,
+					child_states);
+		if (!n_active)
+			goto done;
+
+		SWAP(node_active, child_active);
+		SWAP(node_states, child_states);
+	}
+
+	scratch_len = strlen(prefix) + strlen(prefix_str);
+	scratch_buf = alloca(scratch_len + 2);
+	sprintf(scratch_buf, "%s%s", prefix, prefix_str);
+	scratch_buf[scratch_len + 1] = '\0';
+
+	for (i = 0; i < child_count; i++) {
+		const struct trie_child *child = addr_ptr;
+		uint64_t child_offset = L_LE64_TO_CPU(child->child_offset);
+		unsigned int n_child;
+
+		scratch_buf[scratch_len] = child->c;
+		addr_ptr += sizeof(*child);
+
+		if (is_match_special(child->c)) {
+			walk_fnmatch(walk, child_offset, scratch_buf,
+					n_active, node_active);
+			continue;
+		}
+
+		n_child = walk_step(walk, child->c, n_active, node_active,
+					node_states, child_active,
+					child_states);
+		if (n_child)
+			trie_walk_node(walk, child_offset, scratch_buf,
+					n_child, child_active, child_states);
+	}
+
+	if (!entry_count)
+		goto done;
+
+	/* Entries apply to the modaliases consumed entirely */
+	for (k = 0, state = node_states; k < n_active; k++) {
+		const struct trie_match *match = &walk->matches[node_active[k]];
+
+		if (state[match->len / 64] & (1ULL << match->len % 64))
+			add_entries(addr, addr_ptr, entry_count, walk->arena,
+					match->entries);
+
+		state += match->words;
+	}
+
+done:
+	l_free(buf);
+}
+
+static void trie_walk(const void *addr, uint64_t root,
+			const struct trie_match *matches,
+			unsigned int n_matches, struct l_arena *arena)
+{
+	struct trie_walk walk = {
+		.addr = addr,
+		.arena = arena,
+		.matches = matches,
+	};
+	unsigned int *active = l_new(unsigned int, n_matches);
+	uint64_t *states;
+	size_t total = 0;
+	unsigned int k;
+
+	for (k = 0; k < n_matches; k++) {
+		active[k] = k;
+		total += matches[k].words;
+	}
+
+	states = l_new(uint64_t, total);
+
+	/* Nothing consumed yet */
+	for (k = 0, total = 0; k < n_matches; k++) {
+		states[total] = 1;
+		total += matches[k].words;
 	}
+
+	trie_walk_node(&walk, root, "", n_matches, active, states);
+
+	l_free(states);
+	l_free(active);
 }
 
 LIB_EXPORT struct l_hwdb_entry *l_hwdb_lookup(struct l_hwdb *hwdb,
@@ -267,6 +555,7 @@ LIB_EXPORT struct l_hwdb_entry *l_hwdb_lookup_valist(struct l_hwdb *hwdb,
 					const char *format, va_list args)
 {
 	struct l_hwdb_entry *entries = NULL;
+	struct trie_match match;
 	char *modalias;
 	int len;
 
@@ -277,13 +566,81 @@ LIB_EXPORT struct l_hwdb_entry *l_hwdb_lookup_valist(struct l_hwdb *hwdb,
 	if (len < 0)
 		return NULL;
 
-	trie_fnmatch(hwdb->addr, hwdb->root, "", modalias, &entries);
+	trie_match_init(&match, modalias, &entries);
+	trie_walk(hwdb->addr, hwdb->root, &match, 1, NULL);
+	l_free(match.masks);
 
 	free(modalias);
 
 	return entries;
 }
 
+static int modalias_compare(const void *a, const void *b, void *user_data)
+{
+	const char * const *modaliases = user_data;
+
+	return strcmp(modaliases[*(const unsigned int *) a],
+			modaliases[*(const unsigned int *) b]);
+}
+
+/*
+ * Looks up all of @modaliases in one walk of the trie, so that the
+ * patterns they have in common are only matched once.  Returns an array
+ * with the entries of each modalias at the same index, NULL if it has
+ * none.  The array and the entries are allocated from @arena, the keys
+ * and values point into the hwdb like those of l_hwdb_lookup().
+ */
+LIB_EXPORT struct l_hwdb_entry **l_hwdb_lookup_batch(struct l_hwdb *hwdb,
+					const char * const *modaliases,
+					unsigned int n_modaliases,
+					struct l_arena *arena)
+{
+	struct l_hwdb_entry **results;
+	struct trie_match *matches;
+	unsigned int *order;
+	unsigned int n_matches = 0;
+	unsigned int k;
+
+	if (!hwdb || !modaliases || !n_modaliases || !arena)
+		return NULL;
+
+	results = l_arena_alloc0(arena, n_modaliases * sizeof(*results));
+
+	/* Sorted so that repeated modaliases are only looked up once */
+	order = l_new(unsigned int, n_modaliases);
+
+	for (k = 0; k < n_modaliases; k++)
+		order[k] = k;
+
+	qsort_r(order, n_modaliases, sizeof(*order), modalias_compare,
+			(void *) modaliases);
+
+	matches = l_new(struct trie_match, n_modaliases);
+
+	for (k = 0; k < n_modaliases; k++) {
+		if (k && !strcmp(modaliases[order[k]],
+					modaliases[order[k - 1]]))
+			continue;
+
+		trie_match_init(&matches[n_matches++], modaliases[order[k]],
+						&results[order[k]]);
+	}
+
+	trie_walk(hwdb->addr, hwdb->root, matches, n_matches, arena);
+
+	for (k = 1; k < n_modaliases; k++)
+		if (!strcmp(modaliases[order[k]], modaliases[order[k - 1]]))
+			results[order[k]] = results[order[k - 1]];
+
+	for (k = 0; k < n_matches; k++)
+		l_free(matches[k].masks);
+
+	l_free(matches);
+	l_free(order);
+
+	return results;
+}
+
 LIB_EXPORT void l_hwdb_lookup_free(struct l_hwdb_entry *entries)
 {
 	while (entries) {
@@ -329,23 +686,7 @@ static void foreach_node(const void *addr, uint64_t offset, const char *prefix,
 
 	scratch_buf[scratch_len] = '\0';
 
-	for (i = 0; i < entry_count; i++) {
-		const struct trie_entry *entry = addr_ptr;
-		const char *key_str = addr + L_LE64_TO_CPU(entry->key_offset);
-		const char *val_str = addr + L_LE64_TO_CPU(entry->value_offset);
-		struct l_hwdb_entry *result;
-
-		if (key_str[0] == ' ') {
-			result = l_new(struct l_hwdb_entry, 1);
-
-			result->key = key_str + 1;
-			result->value = val_str;
-			result->next = entries;
-			entries = result;
-		}
-
-		addr_ptr += sizeof(*entry);
-	}
+	add_entries(addr, addr_ptr, entry_count, NULL, &entries);
 
 	func(scratch_buf, entries, user_data);
 
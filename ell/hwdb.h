@@ -15,6 +15,7 @@ extern "C" {
 #endif
 
 struct l_hwdb;
+struct l_arena;
 
 struct l_hwdb *l_hwdb_new(const char *pathname);
 struct l_hwdb *l_hwdb_new_default(void);
@@ -34,6 +35,10 @@ struct l_hwdb_entry *l_hwdb_lookup_valist(struct l_hwdb *hwdb,
 					const char *format, va_list args)
 					__attribute__((format(printf, 2, 0)));
 void l_hwdb_lookup_free(struct l_hwdb_entry *entries);
+struct l_hwdb_entry **l_hwdb_lookup_batch(struct l_hwdb *hwdb,
+					const char * const *modaliases,
+					unsigned int n_modaliases,
+					struct l_arena *arena);
 
 typedef void (*l_hwdb_foreach_func_t)(const char *modalias,
 					struct l_hwdb_entry *entries,
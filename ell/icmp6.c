@@ -34,7 +34,9 @@
 #include "time.h"
 #include "io.h"
 #include "time-private.h"
+#include "retransmit-private.h"
 #include "queue.h"
+#include "hashmap.h"
 #include "net.h"
 #include "net-private.h"
 #include "netlink.h"
@@ -104,6 +106,13 @@ static int icmp6_open_router_solicitation(int ifindex)
 		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ND_ROUTER_ADVERT, 1, 0),
 		/* ignore */
 		BPF_STMT(BPF_RET | BPF_K, 0),
+		/* A <- Hop Limit */
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS,
+				offsetof(struct ip6_hdr, ip6_hops)),
+		/* A == 255 ? */
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 255, 1, 0),
+		/* ignore */
+		BPF_STMT(BPF_RET | BPF_K, 0),
 		/* A <- Payload Length */
 		BPF_STMT(BPF_LD | BPF_H | BPF_ABS,
 				offsetof(struct ip6_hdr, ip6_plen)),
@@ -326,6 +335,136 @@ static int icmp6_receive(int s, void *buf, ssize_t *buf_len,
 	return 0;
 }
 
+static int icmp6_open_router_advertisement(void)
+{
+	struct icmp6_filter filter;
+	/* The socket filter sees the packet from the ICMPv6 header on */
+	struct sock_filter bpf[] = {
+		/* A <- packet length */
+		BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+		/* A >= sizeof(nd_router_advert) ? */
+		BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K,
+				sizeof(struct nd_router_advert), 1, 0),
+		/* ignore */
+		BPF_STMT(BPF_RET | BPF_K, 0),
+		/* A <- Hop Limit */
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF + (int)
+				offsetof(struct ip6_hdr, ip6_hops)),
+		/* A == 255 ? */
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 255, 1, 0),
+		/* ignore */
+		BPF_STMT(BPF_RET | BPF_K, 0),
+		/* return all */
+		BPF_STMT(BPF_RET | BPF_K, 65535),
+	};
+	const struct sock_fprog fprog = {
+		.len = L_ARRAY_SIZE(bpf),
+		.filter = bpf
+	};
+	int one = 1;
+	int s;
+
+	s = socket(AF_INET6, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_ICMPV6);
+	if (s < 0)
+		return -errno;
+
+	/* Drop everything but Router Advertisements in the kernel */
+	ICMP6_FILTER_SETBLOCKALL(&filter);
+	ICMP6_FILTER_SETPASS(ND_ROUTER_ADVERT, &filter);
+
+	if (setsockopt(s, IPPROTO_ICMPV6, ICMP6_FILTER,
+						&filter, sizeof(filter)) < 0)
+		goto error;
+
+	if (setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER,
+						&fprog, sizeof(fprog)) < 0)
+		goto error;
+
+	if (setsockopt(s, IPPROTO_IPV6, IPV6_RECVPKTINFO,
+						&one, sizeof(one)) < 0)
+		goto error;
+
+	if (setsockopt(s, IPPROTO_IPV6, IPV6_RECVHOPLIMIT,
+						&one, sizeof(one)) < 0)
+		goto error;
+
+	if (setsockopt(s, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one)) < 0)
+		goto error;
+
+	return s;
+
+error:
+	L_TFR(close(s));
+	return -errno;
+}
+
+/*
+ * Same as icmp6_receive() but for the raw ICMPv6 socket, where the kernel
+ * has already validated the IPv6 header and the checksum.
+ */
+static int icmp6_receive_raw(int s, void *buf, ssize_t *buf_len,
+				struct in6_addr *src, uint64_t *out_timestamp,
+				uint32_t *out_ifindex)
+{
+	char c_msg_buf[CMSG_SPACE(sizeof(struct in6_pktinfo)) +
+			CMSG_SPACE(sizeof(int)) +
+			CMSG_SPACE(sizeof(struct timeval))];
+	struct iovec iov = { .iov_base = buf, .iov_len = *buf_len };
+	struct sockaddr_in6 saddr;
+	struct msghdr msg = {
+		.msg_name = (void *)&saddr,
+		.msg_namelen = sizeof(saddr),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = c_msg_buf,
+		.msg_controllen = sizeof(c_msg_buf),
+	};
+	struct cmsghdr *cmsg;
+	ssize_t l;
+	uint64_t timestamp = 0;
+	uint32_t ifindex = 0;
+	int hops = -1;
+
+	l = recvmsg(s, &msg, MSG_DONTWAIT);
+	if (l < 0)
+		return -errno;
+
+	if (l != *buf_len)
+		return -EINVAL;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+				cmsg->cmsg_type == SCM_TIMESTAMP &&
+				cmsg->cmsg_len ==
+				CMSG_LEN(sizeof(struct timeval))) {
+			const struct timeval *tv = (void *) CMSG_DATA(cmsg);
+
+			timestamp = _time_realtime_to_boottime(tv);
+		} else if (cmsg->cmsg_level == IPPROTO_IPV6 &&
+				cmsg->cmsg_type == IPV6_PKTINFO &&
+				cmsg->cmsg_len ==
+				CMSG_LEN(sizeof(struct in6_pktinfo))) {
+			const struct in6_pktinfo *pi = (void *) CMSG_DATA(cmsg);
+
+			ifindex = pi->ipi6_ifindex;
+		} else if (cmsg->cmsg_level == IPPROTO_IPV6 &&
+				cmsg->cmsg_type == IPV6_HOPLIMIT &&
+				cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+			hops = l_get_u32(CMSG_DATA(cmsg));
+	}
+
+	if (hops != 255)
+		return -EMULTIHOP;
+
+	if (!ifindex)
+		return -ENXIO;
+
+	memcpy(src, &saddr.sin6_addr, 16);
+	*out_timestamp = timestamp ?: l_time_now();
+	*out_ifindex = ifindex;
+	return 0;
+}
+
 struct icmp6_event_handler_entry {
 	l_icmp6_client_event_cb_t handle;
 	void *user_data;
@@ -335,7 +474,7 @@ struct icmp6_event_handler_entry {
 struct l_icmp6_client {
 	uint32_t ifindex;
 	uint8_t mac[6];
-	struct l_timeout *timeout_send;
+	struct retransmit *send;
 	uint64_t retransmit_time;
 	struct l_io *io;
 	struct in6_addr src_ip;
@@ -348,14 +487,54 @@ struct l_icmp6_client {
 
 	struct l_queue *event_handlers;
 
+	/*
+	 * The last RA received after the first one and its parsed form,
+	 * routers repeat the same RA every few seconds.
+	 */
+	uint8_t *last_ra;
+	size_t last_ra_len;
+	size_t last_ra_size;
+	struct in6_addr last_ra_src;
+	struct l_icmp6_router *last_router;
+
+	uint8_t *rx_buf;
+	size_t rx_buf_size;
+
 	l_icmp6_debug_cb_t debug_handler;
 	l_icmp6_destroy_cb_t debug_destroy;
 	void *debug_data;
 
 	bool nodelay : 1;
 	bool have_mac : 1;
+	bool shared_socket : 1;
 };
 
+/*
+ * Clients that enable the shared socket receive Router Advertisements
+ * through a single raw ICMPv6 socket for all interfaces, the messages are
+ * handed to the client by the interface index they arrived on.  Router
+ * Solicitations still need a packet socket since they may be sent before
+ * the interface has a usable source address, a single unbound one with no
+ * protocol, which therefore receives nothing, serves all the clients.
+ */
+static struct l_io *shared_io;
+static int shared_tx_fd = -1;
+static struct l_hashmap *shared_clients;
+static uint8_t *shared_rx_buf;
+static size_t shared_rx_buf_size;
+
+/* Receive buffers are kept and only grow, to the largest RA seen */
+static void *icmp6_rx_buf(uint8_t **buf, size_t *size, size_t needed)
+{
+	if (*size < needed) {
+		l_free(*buf);
+		*buf = l_malloc(needed);
+		*size = needed;
+	}
+
+	return *buf;
+}
+
 static inline void icmp6_client_event_notify(struct l_icmp6_client *client,
 					enum l_icmp6_client_event event,
 					void *event_data)
@@ -440,40 +619,114 @@ static void icmp6_client_setup_routes(struct l_icmp6_client *client)
 	}
 }
 
+static void icmp6_client_clear_last_ra(struct l_icmp6_client *client)
+{
+	l_free(l_steal_ptr(client->last_ra));
+	client->last_ra_len = 0;
+	client->last_ra_size = 0;
+
+	if (client->last_router) {
+		_icmp6_router_free(client->last_router);
+		client->last_router = NULL;
+	}
+}
+
+/*
+ * Returns the router parsed from a byte for byte identical RA from the
+ * same source, if that was the last one received, updated for @timestamp.
+ */
+static struct l_icmp6_router *icmp6_client_lookup_last_ra(
+					struct l_icmp6_client *client,
+					const struct nd_router_advert *ra,
+					size_t len,
+					const struct in6_addr *src,
+					uint64_t timestamp)
+{
+	if (!client->last_router || client->last_ra_len != len)
+		return NULL;
+
+	if (memcmp(&client->last_ra_src, src, sizeof(*src)) ||
+			memcmp(client->last_ra, ra, len))
+		return NULL;
+
+	client->last_router->start_time = timestamp;
+	return client->last_router;
+}
+
+static void icmp6_client_set_last_ra(struct l_icmp6_client *client,
+					const struct nd_router_advert *ra,
+					size_t len,
+					const struct in6_addr *src,
+					struct l_icmp6_router *r)
+{
+	if (client->last_router)
+		_icmp6_router_free(client->last_router);
+
+	client->last_router = r;
+	client->last_ra_src = *src;
+	client->last_ra_len = len;
+	memcpy(icmp6_rx_buf(&client->last_ra, &client->last_ra_size, len),
+		ra, len);
+}
+
 static int icmp6_client_handle_message(struct l_icmp6_client *client,
 						struct nd_router_advert *ra,
 						size_t len,
 						const struct in6_addr *src,
 						uint64_t timestamp)
 {
-	struct l_icmp6_router *r =
-		_icmp6_router_parse(ra, len, src->s6_addr, timestamp);
+	struct l_icmp6_router *r;
+	bool first = !client->ra;
 
-	if (!r)
-		return -EBADMSG;
+	r = icmp6_client_lookup_last_ra(client, ra, len, src, timestamp);
+	if (!r) {
+		r = _icmp6_router_parse(ra, len, src->s6_addr, timestamp);
+		if (!r)
+			return -EBADMSG;
+
+		/* The first RA is kept as client->ra instead */
+		if (!first)
+			icmp6_client_set_last_ra(client, ra, len, src, r);
+	}
 
 	icmp6_client_event_notify(client,
 					L_ICMP6_CLIENT_EVENT_ROUTER_FOUND,
 					r);
 
 	/* DHCP6 client may have stopped us */
-	if (!client->io)
+	if (!client->io) {
+		if (first)
+			_icmp6_router_free(r);
+
 		return -ECANCELED;
+	}
 
-	if (!client->ra) {
+	if (first) {
 		client->ra = r;
 		icmp6_client_setup_routes(client);
-		return 0;
 	}
 
 	/*
 	 * TODO: Figure out if the RA has updated info and update routes
 	 * accordingly.
 	 */
-	_icmp6_router_free(r);
 	return 0;
 }
 
+static void icmp6_client_receive(struct l_icmp6_client *client,
+					struct nd_router_advert *ra,
+					size_t len,
+					const struct in6_addr *src,
+					uint64_t timestamp)
+{
+	if (icmp6_client_handle_message(client, ra, len, src, timestamp) < 0)
+		return;
+
+	/* Stop solicitations */
+	client->retransmit_time = 0;
+	_retransmit_cancel(client->send);
+}
+
 static bool icmp6_client_read_handler(struct l_io *io, void *userdata)
 {
 	struct l_icmp6_client *client = userdata;
@@ -498,28 +751,125 @@ static bool icmp6_client_read_handler(struct l_io *io, void *userdata)
 		return true;
 	}
 
-	ra = l_malloc(l);
+	ra = icmp6_rx_buf(&client->rx_buf, &client->rx_buf_size, l);
 	r = icmp6_receive(s, ra, &l, &src, &timestamp);
 	if (r < 0) {
 		CLIENT_DEBUG("icmp6_receive(): %s (%i)", strerror(-r), -r);
-		goto done;
+		return true;
 	}
 
-	r = icmp6_client_handle_message(client, ra, l, &src, timestamp);
-	if (r < 0)
-		goto done;
+	icmp6_client_receive(client, ra, l, &src, timestamp);
+	return true;
+}
 
-	/* Stop solicitations */
-	client->retransmit_time = 0;
-	l_timeout_remove(client->timeout_send);
-	client->timeout_send = NULL;
+static bool icmp6_shared_read_handler(struct l_io *io, void *userdata)
+{
+	int s = l_io_get_fd(io);
+	struct l_icmp6_client *client;
+	struct nd_router_advert *ra;
+	ssize_t l;
+	struct in6_addr src;
+	uint64_t timestamp = 0;
+	uint32_t ifindex = 0;
+
+	l = recv(s, NULL, 0, MSG_PEEK|MSG_TRUNC);
+	if (l < 0)
+		return false;
+
+	/* Should have been dropped by the socket filter */
+	if ((size_t) l < sizeof(struct nd_router_advert)) {
+		recv(s, NULL, 0, MSG_DONTWAIT);
+		return true;
+	}
+
+	ra = icmp6_rx_buf(&shared_rx_buf, &shared_rx_buf_size, l);
+
+	if (icmp6_receive_raw(s, ra, &l, &src, &timestamp, &ifindex) < 0)
+		return true;
+
+	client = l_hashmap_lookup(shared_clients, L_UINT_TO_PTR(ifindex));
+	if (client)
+		icmp6_client_receive(client, ra, l, &src, timestamp);
 
-done:
-	l_free(ra);
 	return true;
 }
 
-static void icmp6_client_timeout_send(struct l_timeout *timeout,
+static struct l_io *icmp6_shared_socket_ref(struct l_icmp6_client *client)
+{
+	void *key = L_UINT_TO_PTR(client->ifindex);
+	int s;
+
+	/* Only one client per interface can use the shared socket */
+	if (l_hashmap_lookup(shared_clients, key))
+		return NULL;
+
+	if (!shared_io) {
+		shared_tx_fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+		if (shared_tx_fd < 0)
+			return NULL;
+
+		s = icmp6_open_router_advertisement();
+		if (s < 0)
+			goto error;
+
+		shared_io = l_io_new(s);
+		if (!shared_io) {
+			close(s);
+			goto error;
+		}
+
+		l_io_set_close_on_destroy(shared_io, true);
+		l_io_set_read_handler(shared_io, icmp6_shared_read_handler,
+					NULL, NULL);
+		shared_clients = l_hashmap_new();
+	}
+
+	l_hashmap_insert(shared_clients, key, client);
+	return shared_io;
+
+error:
+	close(shared_tx_fd);
+	shared_tx_fd = -1;
+	return NULL;
+}
+
+static void icmp6_shared_socket_unref(struct l_icmp6_client *client)
+{
+	l_hashmap_remove(shared_clients, L_UINT_TO_PTR(client->ifindex));
+
+	if (!l_hashmap_isempty(shared_clients))
+		return;
+
+	l_hashmap_destroy(l_steal_ptr(shared_clients), NULL);
+	l_io_destroy(l_steal_ptr(shared_io));
+	close(shared_tx_fd);
+	shared_tx_fd = -1;
+
+	l_free(l_steal_ptr(shared_rx_buf));
+	shared_rx_buf_size = 0;
+}
+
+static struct l_io *icmp6_client_open(struct l_icmp6_client *client)
+{
+	struct l_io *io;
+	int s;
+
+	s = icmp6_open_router_solicitation(client->ifindex);
+	if (s < 0)
+		return NULL;
+
+	io = l_io_new(s);
+	if (!io) {
+		close(s);
+		return NULL;
+	}
+
+	l_io_set_close_on_destroy(io, true);
+	l_io_set_read_handler(io, icmp6_client_read_handler, client, NULL);
+	return io;
+}
+
+static void icmp6_client_timeout_send(struct retransmit *rt,
 							void *user_data)
 {
 	static const uint64_t MAX_SOLICITATION_INTERVAL =
@@ -530,15 +880,15 @@ static void icmp6_client_timeout_send(struct l_timeout *timeout,
 
 	CLIENT_DEBUG("");
 
-	if (client->retransmit_time > MAX_SOLICITATION_INTERVAL / 2)
-		client->retransmit_time =
-				_time_fuzz_msecs(MAX_SOLICITATION_INTERVAL);
-	else
-		client->retransmit_time +=
-			_time_fuzz_msecs(client->retransmit_time ?:
-						SOLICITATION_INTERVAL);
+	/* RFC 7559, Section 2 */
+	client->retransmit_time = _retransmit_backoff_ms(
+						client->retransmit_time,
+						SOLICITATION_INTERVAL,
+						MAX_SOLICITATION_INTERVAL);
 
-	r = icmp6_send_router_solicitation(l_io_get_fd(client->io),
+	r = icmp6_send_router_solicitation(client->shared_socket ?
+						shared_tx_fd :
+						l_io_get_fd(client->io),
 						client->ifindex, client->mac,
 						&client->src_ip,
 						client->src_ip_optimistic);
@@ -551,7 +901,7 @@ static void icmp6_client_timeout_send(struct l_timeout *timeout,
 
 	CLIENT_DEBUG("Sent router solicitation, next attempt in %"PRIu64" ms",
 			client->retransmit_time);
-	l_timeout_modify_ms(timeout, client->retransmit_time);
+	_retransmit_schedule_ms(rt, client->retransmit_time);
 }
 
 LIB_EXPORT struct l_icmp6_client *l_icmp6_client_new(uint32_t ifindex)
@@ -560,6 +910,7 @@ LIB_EXPORT struct l_icmp6_client *l_icmp6_client_new(uint32_t ifindex)
 
 	client->ifindex = ifindex;
 	client->routes = l_queue_new();
+	client->send = _retransmit_new(icmp6_client_timeout_send, client);
 
 	return client;
 }
@@ -580,16 +931,18 @@ LIB_EXPORT void l_icmp6_client_free(struct l_icmp6_client *client)
 		return;
 
 	l_icmp6_client_stop(client);
+	_retransmit_free(client->send);
 	l_queue_destroy(client->routes, NULL);
 	l_icmp6_client_set_debug(client, NULL, NULL, NULL);
 	l_queue_destroy(client->event_handlers, icmp6_event_handler_destroy);
+	icmp6_client_clear_last_ra(client);
+	l_free(client->rx_buf);
 	l_free(client);
 }
 
 LIB_EXPORT bool l_icmp6_client_start(struct l_icmp6_client *client)
 {
 	uint64_t delay = 0;
-	int s;
 
 	if (unlikely(!client))
 		return false;
@@ -599,40 +952,33 @@ LIB_EXPORT bool l_icmp6_client_start(struct l_icmp6_client *client)
 
 	CLIENT_DEBUG("Starting ICMPv6 Client");
 
-	s = icmp6_open_router_solicitation(client->ifindex);
-	if (s < 0)
-		return false;
+	/* Not freed on stop, the event handlers may be using it */
+	icmp6_client_clear_last_ra(client);
 
 	if (!client->have_mac) {
 		if (!l_net_get_mac_address(client->ifindex, client->mac))
-			goto err;
+			return false;
 
 		client->have_mac = true;
 	}
 
-	client->io = l_io_new(s);
-	if (!client->io)
-		goto err;
+	if (client->shared_socket)
+		client->io = icmp6_shared_socket_ref(client);
+	else
+		client->io = icmp6_client_open(client);
 
-	l_io_set_close_on_destroy(client->io, true);
-	l_io_set_read_handler(client->io, icmp6_client_read_handler,
-					client, NULL);
+	if (!client->io)
+		return false;
 
 	if (!client->nodelay)
 		delay = _time_pick_interval_secs(0, 1);
 
-	client->timeout_send = l_timeout_create_ms(delay,
-						icmp6_client_timeout_send,
-						client, NULL);
-
 	if (client->nodelay)
-		icmp6_client_timeout_send(client->timeout_send, client);
+		icmp6_client_timeout_send(client->send, client);
+	else
+		_retransmit_schedule_ms(client->send, delay);
 
 	return true;
-
-err:
-	close(s);
-	return false;
 }
 
 LIB_EXPORT bool l_icmp6_client_stop(struct l_icmp6_client *client)
@@ -645,15 +991,18 @@ LIB_EXPORT bool l_icmp6_client_stop(struct l_icmp6_client *client)
 
 	CLIENT_DEBUG("Stopping...");
 
-	l_io_destroy(client->io);
+	if (client->shared_socket)
+		icmp6_shared_socket_unref(client);
+	else
+		l_io_destroy(client->io);
+
 	client->io = NULL;
 
 	l_queue_foreach_remove(client->routes,
 					icmp6_client_remove_route, client);
 
 	client->retransmit_time = 0;
-	l_timeout_remove(client->timeout_send);
-	client->timeout_send = NULL;
+	_retransmit_cancel(client->send);
 
 	if (client->ra) {
 		_icmp6_router_free(client->ra);
@@ -737,6 +1086,22 @@ LIB_EXPORT bool l_icmp6_client_set_nodelay(struct l_icmp6_client *client,
 	return true;
 }
 
+/*
+ * Receive Router Advertisements through a raw socket shared by all the
+ * clients that enable this option, instead of one socket per client.  Must
+ * be set while the client is stopped.
+ */
+LIB_EXPORT bool l_icmp6_client_set_shared_socket(
+						struct l_icmp6_client *client,
+						bool enable)
+{
+	if (unlikely(!client || client->io))
+		return false;
+
+	client->shared_socket = enable;
+	return true;
+}
+
 LIB_EXPORT bool l_icmp6_client_set_rtnl(struct l_icmp6_client *client,
 						struct l_netlink *rtnl)
 {
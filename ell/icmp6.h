@@ -46,6 +46,8 @@ bool l_icmp6_client_set_debug(struct l_icmp6_client *client,
 bool l_icmp6_client_set_address(struct l_icmp6_client *client,
 					const uint8_t addr[static 6]);
 bool l_icmp6_client_set_nodelay(struct l_icmp6_client *client, bool nodelay);
+bool l_icmp6_client_set_shared_socket(struct l_icmp6_client *client,
+						bool enable);
 bool l_icmp6_client_set_rtnl(struct l_icmp6_client *client,
 						struct l_netlink *rtnl);
 bool l_icmp6_client_set_route_priority(struct l_icmp6_client *client,
@@ -0,0 +1,259 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <limits.h>
+
+#include "idalloc.h"
+#include "private.h"
+#include "useful.h"
+
+/**
+ * SECTION:idalloc
+ * @short_description: Thread safe ID allocator
+ *
+ * Thread safe ID allocator
+ */
+
+/*
+ * One bit per ID in a flat array of words, set while the ID is in use.
+ * IDs are claimed with a compare-and-swap on their word and released
+ * with an atomic AND, so any number of threads can allocate and release
+ * without a lock.  Allocation continues after the last ID handed out
+ * rather than from the lowest free one, which keeps a released ID from
+ * being reused until the whole range has been gone through, as with a
+ * plain counter.
+ */
+
+/**
+ * l_idalloc:
+ *
+ * Opaque object representing the ID allocator.
+ */
+struct l_idalloc {
+	uint64_t *words;
+	uint32_t n_words;
+	uint32_t min;
+	uint32_t max;
+	uint32_t next;
+};
+
+static inline uint64_t bits_from(unsigned int bit)
+{
+	return ~0ULL << bit;
+}
+
+/* Claims the first free bit of @word at or after @bit, returns -1 if none */
+static int word_claim(uint64_t *word, unsigned int bit)
+{
+	uint64_t old = __atomic_load_n(word, __ATOMIC_RELAXED);
+	uint64_t free_bits;
+
+	while ((free_bits = ~old & bits_from(bit))) {
+		uint64_t mask = free_bits & -free_bits;
+
+		if (__atomic_compare_exchange_n(word, &old, old | mask, true,
+							__ATOMIC_ACQUIRE,
+							__ATOMIC_RELAXED))
+			return __builtin_ctzll(mask);
+	}
+
+	return -1;
+}
+
+/**
+ * l_idalloc_new:
+ * @min: smallest ID to hand out
+ * @max: largest ID to hand out
+ *
+ * Create an allocator for the IDs in the range [@min, @max], which can be
+ * used from any thread.  It takes one bit of memory per ID in the range.
+ *
+ * Returns: a newly allocated #l_idalloc object, or #NULL if @min is
+ *          greater than @max
+ **/
+LIB_EXPORT struct l_idalloc *l_idalloc_new(uint32_t min, uint32_t max)
+{
+	struct l_idalloc *ida;
+	uint64_t size;
+	unsigned int tail;
+
+	if (unlikely(min > max))
+		return NULL;
+
+	size = (uint64_t) max - min + 1;
+
+	ida = l_new(struct l_idalloc, 1);
+	ida->n_words = (size + 63) / 64;
+	ida->words = l_new(uint64_t, ida->n_words);
+	ida->min = min;
+	ida->max = max;
+
+	/* The bits past @max are never free */
+	tail = size % 64;
+	if (tail)
+		ida->words[ida->n_words - 1] = bits_from(tail);
+
+	return ida;
+}
+
+/**
+ * l_idalloc_free:
+ * @ida: ID allocator
+ *
+ * Free @ida, no other thread may be using it anymore.
+ **/
+LIB_EXPORT void l_idalloc_free(struct l_idalloc *ida)
+{
+	if (unlikely(!ida))
+		return;
+
+	l_free(ida->words);
+	l_free(ida);
+}
+
+/**
+ * l_idalloc_get:
+ * @ida: ID allocator
+ *
+ * Allocate an ID, the next free one after the last one allocated,
+ * wrapping around at the end of the range.
+ *
+ * Returns: the ID, l_idalloc_get_max() + 1 if all the IDs are in use or
+ *          UINT_MAX if @ida is NULL
+ **/
+LIB_EXPORT uint32_t l_idalloc_get(struct l_idalloc *ida)
+{
+	uint32_t start;
+	uint32_t i;
+	int bit;
+
+	if (unlikely(!ida))
+		return UINT_MAX;
+
+	start = __atomic_load_n(&ida->next, __ATOMIC_RELAXED);
+
+	/*
+	 * The word holding @start is visited twice, from @start on first
+	 * and from its beginning after wrapping around.
+	 */
+	for (i = 0; i <= ida->n_words; i++) {
+		uint32_t w = (start / 64 + i) % ida->n_words;
+		unsigned int from = i ? 0 : start % 64;
+		uint32_t offset;
+
+		bit = word_claim(&ida->words[w], from);
+		if (bit < 0)
+			continue;
+
+		offset = w * 64 + bit;
+
+		/* Racing threads may move it back, it is only a hint */
+		__atomic_store_n(&ida->next,
+				offset + 1ULL < ida->n_words * 64ULL ?
+				offset + 1 : 0, __ATOMIC_RELAXED);
+
+		return ida->min + offset;
+	}
+
+	return ida->max + 1;
+}
+
+/**
+ * l_idalloc_take:
+ * @ida: ID allocator
+ * @id: ID to mark as in use
+ *
+ * Returns: #true if @id was free and is now in use
+ **/
+LIB_EXPORT bool l_idalloc_take(struct l_idalloc *ida, uint32_t id)
+{
+	uint32_t offset;
+	uint64_t mask;
+
+	if (unlikely(!ida || id < ida->min || id > ida->max))
+		return false;
+
+	offset = id - ida->min;
+	mask = 1ULL << (offset % 64);
+
+	return !(__atomic_fetch_or(&ida->words[offset / 64], mask,
+						__ATOMIC_ACQUIRE) & mask);
+}
+
+/**
+ * l_idalloc_put:
+ * @ida: ID allocator
+ * @id: ID to release
+ *
+ * Returns: #true if @id was in use and is now free
+ **/
+LIB_EXPORT bool l_idalloc_put(struct l_idalloc *ida, uint32_t id)
+{
+	uint32_t offset;
+	uint64_t mask;
+
+	if (unlikely(!ida || id < ida->min || id > ida->max))
+		return false;
+
+	offset = id - ida->min;
+	mask = 1ULL << (offset % 64);
+
+	return __atomic_fetch_and(&ida->words[offset / 64], ~mask,
+						__ATOMIC_RELEASE) & mask;
+}
+
+/**
+ * l_idalloc_contains:
+ * @ida: ID allocator
+ * @id: ID to check
+ *
+ * Returns: #true if @id is in use
+ **/
+LIB_EXPORT bool l_idalloc_contains(struct l_idalloc *ida, uint32_t id)
+{
+	uint32_t offset;
+
+	if (unlikely(!ida || id < ida->min || id > ida->max))
+		return false;
+
+	offset = id - ida->min;
+
+	return __atomic_load_n(&ida->words[offset / 64], __ATOMIC_RELAXED) &
+						(1ULL << (offset % 64));
+}
+
+/**
+ * l_idalloc_get_min:
+ * @ida: ID allocator
+ *
+ * Returns: the smallest ID of the range, UINT_MAX if @ida is NULL
+ **/
+LIB_EXPORT uint32_t l_idalloc_get_min(struct l_idalloc *ida)
+{
+	if (unlikely(!ida))
+		return UINT_MAX;
+
+	return ida->min;
+}
+
+/**
+ * l_idalloc_get_max:
+ * @ida: ID allocator
+ *
+ * Returns: the largest ID of the range, UINT_MAX if @ida is NULL
+ **/
+LIB_EXPORT uint32_t l_idalloc_get_max(struct l_idalloc *ida)
+{
+	if (unlikely(!ida))
+		return UINT_MAX;
+
+	return ida->max;
+}
@@ -0,0 +1,35 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef __ELL_IDALLOC_H
+#define __ELL_IDALLOC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct l_idalloc;
+
+struct l_idalloc *l_idalloc_new(uint32_t min, uint32_t max);
+void l_idalloc_free(struct l_idalloc *ida);
+
+uint32_t l_idalloc_get(struct l_idalloc *ida);
+bool l_idalloc_take(struct l_idalloc *ida, uint32_t id);
+bool l_idalloc_put(struct l_idalloc *ida, uint32_t id);
+bool l_idalloc_contains(struct l_idalloc *ida, uint32_t id);
+
+uint32_t l_idalloc_get_min(struct l_idalloc *ida);
+uint32_t l_idalloc_get_max(struct l_idalloc *ida);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ELL_IDALLOC_H */
@@ -38,7 +38,8 @@ struct l_idle {
 
 	l_idle_destroy_cb_t destroy;
 	void *user_data;
-	int id;
+	struct l_main_loop *loop;
+	struct idle_data *data;
 };
 
 static void idle_destroy(void *user_data)
@@ -66,7 +67,7 @@ static void oneshot_callback(void *user_data)
 	if (idle->oneshot)
 		idle->oneshot(idle->user_data);
 
-	idle_remove(idle->id);
+	idle_remove(idle->loop, idle->data);
 }
 
 /**
@@ -95,8 +96,9 @@ LIB_EXPORT struct l_idle *l_idle_create(l_idle_notify_cb_t callback,
 	idle->destroy = destroy;
 	idle->user_data = user_data;
 
-	idle->id = idle_add(idle_callback, idle, 0, idle_destroy);
-	if (idle->id < 0) {
+	idle->loop = main_loop_get();
+	idle->data = idle_add(idle->loop, idle_callback, idle, 0, idle_destroy);
+	if (!idle->data) {
 		l_free(idle);
 		return NULL;
 	}
@@ -129,9 +131,10 @@ LIB_EXPORT bool l_idle_oneshot(l_idle_oneshot_cb_t callback, void *user_data,
 	idle->destroy = destroy;
 	idle->user_data = user_data;
 
-	idle->id = idle_add(oneshot_callback, idle,
+	idle->loop = main_loop_get();
+	idle->data = idle_add(idle->loop, oneshot_callback, idle,
 				IDLE_FLAG_NO_WARN_DANGLING, idle_destroy);
-	if (idle->id < 0) {
+	if (!idle->data) {
 		l_free(idle);
 		return false;
 	}
@@ -149,5 +152,5 @@ LIB_EXPORT void l_idle_remove(struct l_idle *idle)
 	if (unlikely(!idle))
 		return;
 
-	idle_remove(idle->id);
+	idle_remove(idle->loop, idle->data);
 }
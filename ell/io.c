@@ -15,9 +15,11 @@
 #include <sys/epoll.h>
 
 #include "useful.h"
+#include "missing.h"
 #include "main-private.h"
 #include "io.h"
 #include "private.h"
+#include "probe-private.h"
 
 /**
  * SECTION:io
@@ -32,6 +34,7 @@
  * Opaque object representing the IO.
  */
 struct l_io {
+	struct l_main_loop *loop;
 	int fd;
 	uint32_t events;
 	bool close_on_destroy;
@@ -94,6 +97,49 @@ static void io_closed(struct l_io *io)
 		destroy(disconnect_data);
 }
 
+/*
+ * In edge-triggered mode the EPOLLIN and EPOLLOUT bits are left in place
+ * when a handler goes away.  No further edges are reported until the
+ * socket is drained, so this saves an epoll_ctl per handler toggle.
+ */
+static int io_clear_events(struct l_io *io, uint32_t mask)
+{
+	if (io->events & EPOLLET)
+		return 0;
+
+	io->events &= ~mask;
+
+	return watch_modify(io->loop, io->fd, io->events, false);
+}
+
+static bool io_set_events(struct l_io *io, uint32_t mask, bool set)
+{
+	uint32_t events;
+	int err;
+
+	if (set)
+		events = io->events | mask;
+	else if (io->events & EPOLLET)
+		events = io->events;
+	else
+		events = io->events & ~mask;
+
+	/*
+	 * A new handler in edge-triggered mode must pick up readiness that
+	 * was signaled before it was installed, which an EPOLL_CTL_MOD does.
+	 */
+	if (events == io->events && !(set && (events & EPOLLET)))
+		return true;
+
+	err = watch_modify(io->loop, io->fd, events, set);
+	if (err)
+		return false;
+
+	io->events = events;
+
+	return true;
+}
+
 static void io_callback(int fd, uint32_t events, void *user_data)
 {
 	struct l_io *io = user_data;
@@ -101,6 +147,7 @@ static void io_callback(int fd, uint32_t events, void *user_data)
 	if ((events & EPOLLIN) && io->read_handler) {
 		l_util_debug(io->debug_handler, io->debug_data,
 						"read event <%p>", io);
+		PROBE(io_read, io, io->fd);
 
 		if (!io->read_handler(io, io->read_data)) {
 			if (io->read_destroy)
@@ -110,11 +157,9 @@ static void io_callback(int fd, uint32_t events, void *user_data)
 			io->read_destroy = NULL;
 			io->read_data = NULL;
 
-			io->events &= ~EPOLLIN;
-
-			if (watch_modify(io->fd, io->events, false) == -EBADF) {
+			if (io_clear_events(io, EPOLLIN) == -EBADF) {
 				io->close_on_destroy = false;
-				watch_clear(io->fd);
+				watch_clear(io->loop, io->fd);
 				io_closed(io);
 				return;
 			}
@@ -127,14 +172,16 @@ static void io_callback(int fd, uint32_t events, void *user_data)
 
 		l_util_debug(io->debug_handler, io->debug_data,
 						"disconnect event <%p>", io);
+		PROBE(io_disconnect, io, fd);
 		io_closed(io);
-		watch_remove(fd, !close_on_destroy);
+		watch_remove(io->loop, fd, !close_on_destroy);
 		return;
 	}
 
 	if ((events & EPOLLOUT) && io->write_handler) {
 		l_util_debug(io->debug_handler, io->debug_data,
 						"write event <%p>", io);
+		PROBE(io_write, io, io->fd);
 
 		if (!io->write_handler(io, io->write_data)) {
 			if (io->write_destroy)
@@ -144,11 +191,9 @@ static void io_callback(int fd, uint32_t events, void *user_data)
 			io->write_destroy = NULL;
 			io->write_data = NULL;
 
-			io->events &= ~EPOLLOUT;
-
-			if (watch_modify(io->fd, io->events, false) == -EBADF) {
+			if (io_clear_events(io, EPOLLOUT) == -EBADF) {
 				io->close_on_destroy = false;
-				watch_clear(io->fd);
+				watch_clear(io->loop, io->fd);
 				io_closed(io);
 				return;
 			}
@@ -174,11 +219,13 @@ LIB_EXPORT struct l_io *l_io_new(int fd)
 
 	io = l_new(struct l_io, 1);
 
+	io->loop = main_loop_get();
 	io->fd = fd;
 	io->events = EPOLLHUP | EPOLLERR;
 	io->close_on_destroy = false;
 
-	err = watch_add(io->fd, io->events, io_callback, io, io_cleanup);
+	err = watch_add(io->loop, io->fd, io->events, io_callback, io,
+								io_cleanup);
 	if (err) {
 		l_free(io);
 		return NULL;
@@ -199,7 +246,7 @@ LIB_EXPORT void l_io_destroy(struct l_io *io)
 		return;
 
 	if (io->fd != -1)
-		watch_remove(io->fd, !io->close_on_destroy);
+		watch_remove(io->loop, io->fd, !io->close_on_destroy);
 
 	io_closed(io);
 
@@ -256,9 +303,6 @@ LIB_EXPORT bool l_io_set_close_on_destroy(struct l_io *io, bool do_close)
 LIB_EXPORT bool l_io_set_read_handler(struct l_io *io, l_io_read_cb_t callback,
 				void *user_data, l_io_destroy_cb_t destroy)
 {
-	uint32_t events;
-	int err;
-
 	if (unlikely(!io || io->fd < 0))
 		return false;
 
@@ -268,25 +312,11 @@ LIB_EXPORT bool l_io_set_read_handler(struct l_io *io, l_io_read_cb_t callback,
 	if (io->read_destroy)
 		io->read_destroy(io->read_data);
 
-	if (callback)
-		events = io->events | EPOLLIN;
-	else
-		events = io->events & ~EPOLLIN;
-
 	io->read_handler = callback;
 	io->read_destroy = destroy;
 	io->read_data = user_data;
 
-	if (events == io->events)
-		return true;
-
-	err = watch_modify(io->fd, events, false);
-	if (err)
-		return false;
-
-	io->events = events;
-
-	return true;
+	return io_set_events(io, EPOLLIN, callback);
 }
 
 /**
@@ -303,9 +333,6 @@ LIB_EXPORT bool l_io_set_read_handler(struct l_io *io, l_io_read_cb_t callback,
 LIB_EXPORT bool l_io_set_write_handler(struct l_io *io, l_io_write_cb_t callback,
 				void *user_data, l_io_destroy_cb_t destroy)
 {
-	uint32_t events;
-	int err;
-
 	if (unlikely(!io || io->fd < 0))
 		return false;
 
@@ -319,25 +346,11 @@ LIB_EXPORT bool l_io_set_write_handler(struct l_io *io, l_io_write_cb_t callback
 	if (io->write_destroy)
 		io->write_destroy(io->write_data);
 
-	if (callback)
-		events = io->events | EPOLLOUT;
-	else
-		events = io->events & ~EPOLLOUT;
-
 	io->write_handler = callback;
 	io->write_destroy = destroy;
 	io->write_data = user_data;
 
-	if (events == io->events)
-		return true;
-
-	err = watch_modify(io->fd, events, false);
-	if (err)
-		return false;
-
-	io->events = events;
-
-	return true;
+	return io_set_events(io, EPOLLOUT, callback);
 }
 
 /**
@@ -371,6 +384,72 @@ LIB_EXPORT bool l_io_set_disconnect_handler(struct l_io *io,
 	return true;
 }
 
+static bool io_set_flag(struct l_io *io, uint32_t flag, bool enabled)
+{
+	uint32_t events;
+	int err;
+
+	if (unlikely(!io || io->fd < 0))
+		return false;
+
+	events = enabled ? io->events | flag : io->events & ~flag;
+	if (events == io->events)
+		return true;
+
+	/* Make sure not to leave events enabled that no handler wants */
+	if (!enabled && flag == EPOLLET) {
+		if (!io->read_handler)
+			events &= ~EPOLLIN;
+
+		if (!io->write_handler)
+			events &= ~EPOLLOUT;
+	}
+
+	err = watch_modify(io->loop, io->fd, events, false);
+	if (err)
+		return false;
+
+	io->events = events;
+
+	return true;
+}
+
+/**
+ * l_io_set_edge_triggered:
+ * @io: IO object
+ * @enabled: whether events are edge-triggered
+ *
+ * Switches @io between level-triggered (the default) and edge-triggered
+ * event notification.  In edge-triggered mode, read and write handlers are
+ * only called when new data arrives or the socket becomes writable again,
+ * so handlers must read or write until the operation fails with EAGAIN.
+ * In exchange, installing and removing handlers requires fewer epoll_ctl
+ * calls.
+ *
+ * Returns: #true on success and #false on failure
+ **/
+LIB_EXPORT bool l_io_set_edge_triggered(struct l_io *io, bool enabled)
+{
+	return io_set_flag(io, EPOLLET, enabled);
+}
+
+/**
+ * l_io_set_exclusive:
+ * @io: IO object
+ * @enabled: whether wakeups are exclusive
+ *
+ * Sets up exclusive wakeups for @io.  This is useful for a listening socket
+ * watched by several main loops, each running on its own thread: when a
+ * connection comes in, only one of the loops is woken up instead of all of
+ * them.  Changing the handlers of an exclusive @io is more expensive.
+ *
+ * Returns: #true on success and #false on failure
+ **/
+LIB_EXPORT bool l_io_set_exclusive(struct l_io *io, bool enabled)
+{
+	return io_set_flag(io, EPOLLEXCLUSIVE, enabled);
+}
+
 /**
  * l_io_set_debug:
  * @io: IO object
@@ -397,3 +476,22 @@ LIB_EXPORT bool l_io_set_debug(struct l_io *io, l_io_debug_cb_t callback,
 
 	return true;
 }
+
+/**
+ * l_io_get_stats:
+ * @io: IO object
+ * @stats: structure to fill in with the dispatch statistics of @io
+ *
+ * Obtains the callback statistics of @io.  Statistics are only collected
+ * while enabled with l_main_set_stats_enabled().
+ *
+ * Returns: #true on success and #false on failure
+ **/
+LIB_EXPORT bool l_io_get_stats(struct l_io *io,
+				struct l_main_watch_stats *stats)
+{
+	if (unlikely(!io || !stats || io->fd < 0))
+		return false;
+
+	return watch_get_stats(io->loop, io->fd, stats);
+}
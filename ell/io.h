@@ -15,6 +15,7 @@ extern "C" {
 #endif
 
 struct l_io;
+struct l_main_watch_stats;
 
 typedef void (*l_io_debug_cb_t) (const char *str, void *user_data);
 
@@ -37,9 +38,14 @@ bool l_io_set_disconnect_handler(struct l_io *io,
 				l_io_disconnect_cb_t callback,
 				void *user_data, l_io_destroy_cb_t destroy);
 
+bool l_io_set_edge_triggered(struct l_io *io, bool enabled);
+bool l_io_set_exclusive(struct l_io *io, bool enabled);
+
 bool l_io_set_debug(struct l_io *io, l_io_debug_cb_t callback,
 				void *user_data, l_io_destroy_cb_t destroy);
 
+bool l_io_get_stats(struct l_io *io, struct l_main_watch_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,6 +15,7 @@
 #include <sys/syscall.h>
 #include <linux/keyctl.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "private.h"
 #include "useful.h"
@@ -22,6 +23,7 @@
 #include "string.h"
 #include "random.h"
 #include "missing.h"
+#include "work-private.h"
 
 #ifndef KEYCTL_DH_COMPUTE
 #define KEYCTL_DH_COMPUTE 23
@@ -80,6 +82,7 @@ struct dh_params {
 #endif
 
 static int32_t internal_keyring;
+static pthread_mutex_t internal_keyring_lock = PTHREAD_MUTEX_INITIALIZER;
 
 struct l_key {
 	int type;
@@ -255,17 +258,33 @@ static long kernel_key_verify(int32_t serial,
 	return result >= 0 ? result : -errno;
 }
 
+/*
+ * The keyring is linked to the process keyring so that keys created on one
+ * thread can be used and freed on any other.  A failed attempt is retried
+ * the next time a key is needed.
+ */
 static bool setup_internal_keyring(void)
 {
-	internal_keyring = kernel_add_key("keyring", "ell-internal", NULL, 0,
-						KEY_SPEC_THREAD_KEYRING);
+	int32_t serial;
 
-	if (internal_keyring <= 0) {
-		internal_keyring = 0;
-		return false;
+	if (__atomic_load_n(&internal_keyring, __ATOMIC_ACQUIRE))
+		return true;
+
+	pthread_mutex_lock(&internal_keyring_lock);
+
+	serial = internal_keyring;
+	if (!serial) {
+		serial = kernel_add_key("keyring", "ell-internal", NULL, 0,
+						KEY_SPEC_PROCESS_KEYRING);
+		if (serial < 0)
+			serial = 0;
+
+		__atomic_store_n(&internal_keyring, serial, __ATOMIC_RELEASE);
 	}
 
-	return true;
+	pthread_mutex_unlock(&internal_keyring_lock);
+
+	return serial > 0;
 }
 
 LIB_EXPORT struct l_key *l_key_new(enum l_key_type type, const void *payload,
@@ -281,12 +300,13 @@ LIB_EXPORT struct l_key *l_key_new(enum l_key_type type, const void *payload,
 	if (unlikely((size_t)type >= L_ARRAY_SIZE(key_type_names)))
 		return NULL;
 
-	if (!internal_keyring && !setup_internal_keyring())
+	if (!setup_internal_keyring())
 		return NULL;
 
 	key = l_new(struct l_key, 1);
 	key->type = type;
-	description = l_strdup_printf("ell-key-%lu", key_idx++);
+	description = l_strdup_printf("ell-key-%lu",
+			__atomic_fetch_add(&key_idx, 1, __ATOMIC_RELAXED));
 	key->serial = kernel_add_key(key_type_names[type], description, payload,
 					payload_length, internal_keyring);
 	l_free(description);
@@ -638,17 +658,230 @@ LIB_EXPORT bool l_key_verify(struct l_key *key,
 	return result >= 0;
 }
 
+struct key_async_op {
+	int op;
+	int32_t serial;
+	int32_t prime_serial;
+	int32_t base_serial;
+	const char *encoding;
+	const char *hash;
+	void *in;
+	size_t len_in;
+	void *out;
+	size_t len_out;
+	ssize_t result;
+	l_key_async_cb_t callback;
+	void *user_data;
+	l_key_destroy_cb_t destroy;
+};
+
+static void key_async_run(void *data)
+{
+	struct key_async_op *op = data;
+
+	if (op->op == KEYCTL_DH_COMPUTE)
+		op->result = kernel_dh_compute(op->serial, op->prime_serial,
+						op->base_serial, op->out,
+						op->len_out);
+	else
+		op->result = kernel_key_eds(op->op, op->serial, op->encoding,
+						op->hash, op->in, op->out,
+						op->len_in, op->len_out);
+}
+
+static void key_async_done(void *data)
+{
+	struct key_async_op *op = data;
+
+	op->callback(op->result, op->result >= 0 ? op->out : NULL,
+			op->user_data);
+}
+
+static void key_async_free(void *data)
+{
+	struct key_async_op *op = data;
+
+	if (op->destroy)
+		op->destroy(op->user_data);
+
+	if (op->in) {
+		explicit_bzero(op->in, op->len_in);
+		l_free(op->in);
+	}
+
+	explicit_bzero(op->out, op->len_out);
+	l_free(op->out);
+	l_free(op);
+}
+
+static uint32_t key_async_submit(struct key_async_op *op, const void *in,
+					size_t len_in, size_t len_out,
+					l_key_async_cb_t callback,
+					void *user_data,
+					l_key_destroy_cb_t destroy)
+{
+	uint32_t id;
+
+	if (in) {
+		op->in = l_memdup(in, len_in);
+		op->len_in = len_in;
+	}
+
+	op->out = l_malloc(len_out);
+	op->len_out = len_out;
+	op->callback = callback;
+	op->user_data = user_data;
+
+	id = work_submit(key_async_run, key_async_done, key_async_free, op);
+	if (!id) {
+		key_async_free(op);
+		return 0;
+	}
+
+	/* Only call @destroy once the operation has been accepted */
+	op->destroy = destroy;
+	return id;
+}
+
+static uint32_t eds_async_common(struct l_key *key,
+					enum l_key_cipher_type cipher,
+					enum l_checksum_type checksum,
+					const void *in, size_t len_in,
+					size_t len_out, int opcode,
+					l_key_async_cb_t callback,
+					void *user_data,
+					l_key_destroy_cb_t destroy)
+{
+	struct key_async_op *op;
+
+	if (unlikely(!key || !in || !len_out || !callback))
+		return 0;
+
+	op = l_new(struct key_async_op, 1);
+	op->op = opcode;
+	op->serial = key->serial;
+	op->encoding = lookup_cipher(cipher);
+	op->hash = lookup_checksum(checksum);
+
+	return key_async_submit(op, in, len_in, len_out,
+				callback, user_data, destroy);
+}
+
+/**
+ * l_key_sign_async:
+ * @key: private key
+ * @cipher: signature scheme
+ * @checksum: hash algorithm @in was computed with
+ * @in: digest to sign, copied
+ * @len_in: length of @in
+ * @len_out: size of the signature buffer
+ * @callback: called from the main loop with the signature length, or a
+ *   negative errno, and the signature
+ * @user_data: user data passed to @callback
+ * @destroy: called to free @user_data once the operation is over
+ *
+ * Like l_key_sign but runs in a worker thread so that the main loop of
+ * the calling thread keeps running while the kernel computes the
+ * signature.  If @key is freed before @callback is called the operation
+ * fails.
+ *
+ * Returns: an id for l_key_cancel_async, or 0 on failure in which case
+ * @destroy is not called.
+ */
+LIB_EXPORT uint32_t l_key_sign_async(struct l_key *key,
+					enum l_key_cipher_type cipher,
+					enum l_checksum_type checksum,
+					const void *in, size_t len_in,
+					size_t len_out,
+					l_key_async_cb_t callback,
+					void *user_data,
+					l_key_destroy_cb_t destroy)
+{
+	return eds_async_common(key, cipher, checksum, in, len_in, len_out,
+				KEYCTL_PKEY_SIGN, callback, user_data,
+				destroy);
+}
+
+/**
+ * l_key_decrypt_async:
+ *
+ * Like l_key_sign_async but decrypts @in, see l_key_decrypt.
+ */
+LIB_EXPORT uint32_t l_key_decrypt_async(struct l_key *key,
+					enum l_key_cipher_type cipher,
+					enum l_checksum_type checksum,
+					const void *in, size_t len_in,
+					size_t len_out,
+					l_key_async_cb_t callback,
+					void *user_data,
+					l_key_destroy_cb_t destroy)
+{
+	return eds_async_common(key, cipher, checksum, in, len_in, len_out,
+				KEYCTL_PKEY_DECRYPT, callback, user_data,
+				destroy);
+}
+
+/**
+ * l_key_compute_dh_secret_async:
+ *
+ * Like l_key_compute_dh_secret but runs in a worker thread, the shared
+ * secret of up to @len bytes is passed to @callback.  See
+ * l_key_sign_async.
+ */
+LIB_EXPORT uint32_t l_key_compute_dh_secret_async(struct l_key *other_public,
+					struct l_key *private_key,
+					struct l_key *prime, size_t len,
+					l_key_async_cb_t callback,
+					void *user_data,
+					l_key_destroy_cb_t destroy)
+{
+	struct key_async_op *op;
+
+	if (unlikely(!other_public || !private_key || !prime || !len ||
+			!callback))
+		return 0;
+
+	op = l_new(struct key_async_op, 1);
+	op->op = KEYCTL_DH_COMPUTE;
+	op->serial = private_key->serial;
+	op->prime_serial = prime->serial;
+	op->base_serial = other_public->serial;
+
+	return key_async_submit(op, NULL, 0, len, callback, user_data, destroy);
+}
+
+/**
+ * l_key_cancel_async:
+ * @id: id returned by one of the l_key_*_async functions
+ *
+ * Stops the operation's callback from being called.  Its destroy
+ * callback is called before returning.  Must be called from the thread
+ * that started the operation.
+ */
+LIB_EXPORT void l_key_cancel_async(uint32_t id)
+{
+	struct key_async_op *op = work_cancel(id);
+	l_key_destroy_cb_t destroy;
+
+	if (!op || !op->destroy)
+		return;
+
+	destroy = l_steal_ptr(op->destroy);
+	destroy(op->user_data);
+}
+
 LIB_EXPORT struct l_keyring *l_keyring_new(void)
 {
 	struct l_keyring *keyring;
 	char *description;
 	static unsigned long keyring_idx;
 
-	if (!internal_keyring && !setup_internal_keyring())
+	if (!setup_internal_keyring())
 		return NULL;
 
 	keyring = l_new(struct l_keyring, 1);
-	description = l_strdup_printf("ell-keyring-%lu", keyring_idx++);
+	description = l_strdup_printf("ell-keyring-%lu",
+			__atomic_fetch_add(&keyring_idx, 1, __ATOMIC_RELAXED));
 	keyring->serial = kernel_add_key("keyring", description, NULL, 0,
 						internal_keyring);
 	l_free(description);
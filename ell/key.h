@@ -90,6 +90,31 @@ bool l_key_verify(struct l_key *key, enum l_key_cipher_type cipher,
 			enum l_checksum_type checksum, const void *data,
 			const void *sig, size_t len_data, size_t len_sig);
 
+typedef void (*l_key_async_cb_t)(ssize_t result, const void *out,
+					void *user_data);
+typedef void (*l_key_destroy_cb_t)(void *user_data);
+
+uint32_t l_key_sign_async(struct l_key *key, enum l_key_cipher_type cipher,
+				enum l_checksum_type checksum, const void *in,
+				size_t len_in, size_t len_out,
+				l_key_async_cb_t callback, void *user_data,
+				l_key_destroy_cb_t destroy);
+
+uint32_t l_key_decrypt_async(struct l_key *key, enum l_key_cipher_type cipher,
+				enum l_checksum_type checksum, const void *in,
+				size_t len_in, size_t len_out,
+				l_key_async_cb_t callback, void *user_data,
+				l_key_destroy_cb_t destroy);
+
+uint32_t l_key_compute_dh_secret_async(struct l_key *other_public,
+					struct l_key *private_key,
+					struct l_key *prime, size_t len,
+					l_key_async_cb_t callback,
+					void *user_data,
+					l_key_destroy_cb_t destroy);
+
+void l_key_cancel_async(uint32_t id);
+
 struct l_keyring *l_keyring_new(void);
 
 bool l_keyring_restrict(struct l_keyring *keyring, enum l_keyring_restriction res,
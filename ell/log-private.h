@@ -0,0 +1,23 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+struct l_debug_desc;
+struct l_log_ratelimit;
+
+typedef void (*debug_foreach_func_t)(const struct l_debug_desc *desc,
+					void *user_data);
+
+/* Calls @function for the debug sites matching @pattern, or all if NULL */
+unsigned int debug_foreach(const char *pattern, debug_foreach_func_t function,
+				void *user_data);
+
+bool log_ratelimit_begin(struct l_log_ratelimit *ratelimit, uint64_t *now);
+bool log_ratelimit_end(struct l_log_ratelimit *ratelimit, uint64_t now,
+			const char *msg, unsigned int *out_repeated,
+			unsigned int *out_suppressed);
+
+void log_set_syslog_fd(int fd);
@@ -15,13 +15,27 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <errno.h>
 #include <fnmatch.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/un.h>
 
+#include "useful.h"
+#include "util.h"
+#include "utf8.h"
 #include "queue.h"
+#include "hashmap.h"
+#include "time.h"
 #include "log.h"
 #include "private.h"
+#include "log-private.h"
 
 struct debug_section {
 	struct l_debug_desc *start;
@@ -53,8 +67,92 @@ static const char *log_ident = "";
 static int log_fd = -1;
 static unsigned long log_pid;
 
+/*
+ * Buffered mode, see l_log_set_buffered().  Messages are formatted straight
+ * into the slots of a preallocated ring which a writer thread drains with
+ * sendmmsg().  Producers claim a slot by advancing the tail with a single
+ * compare-and-swap and publish it through the slot sequence number, so
+ * logging threads never block on each other or on the socket.  The lock
+ * is only taken to wake the writer once it has gone to sleep.
+ *
+ * Producers announce themselves in log_producers before picking up the
+ * ring, so stopping can unpublish the ring and then wait for the ones
+ * still formatting into a slot before the slots are freed.
+ */
+#define LOG_SLOT_SIZE		1024
+#define LOG_MAX_SLOTS		65536
+#define LOG_BATCH		32
+
+typedef size_t (*log_format_func_t)(char *buf, size_t size, int priority,
+					const char *file, const char *line,
+					const char *func, const char *format,
+					va_list ap);
+
+struct log_slot {
+	unsigned long seq;
+	unsigned int len;
+	char data[LOG_SLOT_SIZE - sizeof(unsigned long) - sizeof(unsigned int)];
+};
+
+struct log_ring {
+	struct log_slot *slots;
+	unsigned long mask;
+	unsigned long tail;		/* Next slot to claim, producers */
+	unsigned long head;		/* Next slot to send, writer only */
+	unsigned long dropped;
+	enum l_log_overflow overflow;
+	log_format_func_t format;
+	l_log_func_t direct;		/* Backend to restore when stopped */
+	bool sleeping;
+	bool stopping;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static struct log_ring *log_ring;
+static unsigned int log_producers;
+static l_log_func_t log_ring_direct;
+static bool log_atfork_registered;
+
+static void log_ring_free(struct log_ring *ring)
+{
+	l_free(ring->slots);
+	l_free(ring);
+}
+
+static void log_ring_stop(void)
+{
+	struct log_ring *ring = log_ring;
+
+	if (!ring)
+		return;
+
+	__atomic_store_n(&log_ring, NULL, __ATOMIC_SEQ_CST);
+
+	/*
+	 * Those that got hold of the ring finish their message, any other
+	 * sees it gone and logs directly.  Every claimed slot is published
+	 * once this returns.
+	 */
+	while (__atomic_load_n(&log_producers, __ATOMIC_SEQ_CST))
+		sched_yield();
+
+	/* The writer sends whatever is queued before exiting */
+	pthread_mutex_lock(&ring->lock);
+	ring->stopping = true;
+	pthread_cond_signal(&ring->cond);
+	pthread_mutex_unlock(&ring->lock);
+
+	pthread_join(ring->thread, NULL);
+
+	log_ring_free(ring);
+}
+
 static inline void close_log(void)
 {
+	log_ring_stop();
+
 	if (log_fd > 0) {
 		close(log_fd);
 		log_fd = -1;
@@ -192,6 +290,17 @@ LIB_EXPORT void l_log_set_syslog(void)
 	log_func = log_syslog;
 }
 
+/* The syslog backend on a socket that is already connected */
+void log_set_syslog_fd(int fd)
+{
+	close_log();
+
+	log_fd = fd;
+	log_pid = getpid();
+
+	log_func = log_syslog;
+}
+
 __attribute__((format(printf, 5, 0)))
 static void log_journal(int priority, const char *file, const char *line,
 			const char *func, const char *format, va_list ap)
@@ -260,6 +369,335 @@ LIB_EXPORT void l_log_set_journal(void)
 	log_func = log_journal;
 }
 
+__attribute__((format(printf, 5, 0)))
+static size_t format_syslog(char *buf, size_t size, int priority,
+				const char *file, const char *line,
+				const char *func, const char *format,
+				va_list ap)
+{
+	int hdr_len, str_len;
+
+	hdr_len = snprintf(buf, size, "<%i>%s[%lu]: ", priority,
+					log_ident, (unsigned long) log_pid);
+	if (hdr_len < 0 || (size_t) hdr_len >= size)
+		return 0;
+
+	str_len = vsnprintf(buf + hdr_len, size - hdr_len, format, ap);
+	if (str_len < 0)
+		return 0;
+
+	return minsize(hdr_len + str_len, size - 1);
+}
+
+/* MESSAGE goes last so that a truncated message leaves the rest intact */
+__attribute__((format(printf, 5, 0)))
+static size_t format_journal(char *buf, size_t size, int priority,
+				const char *file, const char *line,
+				const char *func, const char *format,
+				va_list ap)
+{
+	int hdr_len, str_len;
+
+	hdr_len = snprintf(buf, size, "PRIORITY=%u\nCODE_FILE=%s\n"
+					"CODE_LINE=%s\nCODE_FUNC=%s\nMESSAGE=",
+					priority, file, line, func);
+	if (hdr_len < 0 || (size_t) hdr_len >= size - 1)
+		return 0;
+
+	str_len = vsnprintf(buf + hdr_len, size - hdr_len, format, ap);
+	if (str_len < 0)
+		return 0;
+
+	if ((size_t) (hdr_len + str_len) < size - 1)
+		return hdr_len + str_len;
+
+	buf[size - 2] = '\n';
+	return size - 1;
+}
+
+__attribute__((format(printf, 5, 0)))
+static void log_buffered(int priority, const char *file, const char *line,
+			const char *func, const char *format, va_list ap)
+{
+	struct log_ring *ring;
+	struct log_slot *slot;
+	unsigned long pos;
+
+	__atomic_fetch_add(&log_producers, 1, __ATOMIC_SEQ_CST);
+
+	ring = __atomic_load_n(&log_ring, __ATOMIC_SEQ_CST);
+	if (!ring) {
+		/* Buffering was stopped after log_func was read */
+		log_ring_direct(priority, file, line, func, format, ap);
+		goto done;
+	}
+
+	pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+	while (true) {
+		long diff;
+
+		slot = &ring->slots[pos & ring->mask];
+		diff = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos;
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->tail, &pos,
+						pos + 1, true,
+						__ATOMIC_RELAXED,
+						__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* Full, the writer hasn't released this slot yet */
+			if (ring->overflow == L_LOG_OVERFLOW_COUNT)
+				__atomic_fetch_add(&ring->dropped, 1,
+							__ATOMIC_RELAXED);
+			goto done;
+		} else
+			pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	}
+
+	slot->len = ring->format(slot->data, sizeof(slot->data), priority,
+					file, line, func, format, ap);
+
+	/*
+	 * Sequentially consistent, like the accesses in log_writer_wait(),
+	 * so that either the writer sees the slot or we see it sleeping
+	 */
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&ring->lock);
+		pthread_cond_signal(&ring->cond);
+		pthread_mutex_unlock(&ring->lock);
+	}
+
+done:
+	__atomic_fetch_sub(&log_producers, 1, __ATOMIC_RELEASE);
+}
+
+static bool log_ring_ready(struct log_ring *ring)
+{
+	struct log_slot *slot = &ring->slots[ring->head & ring->mask];
+
+	return __atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) == ring->head + 1;
+}
+
+/* Returns false once stopped with nothing left to send */
+static bool log_writer_wait(struct log_ring *ring)
+{
+	bool ready;
+
+	if (log_ring_ready(ring))
+		return true;
+
+	pthread_mutex_lock(&ring->lock);
+	__atomic_store_n(&ring->sleeping, true, __ATOMIC_SEQ_CST);
+
+	while (!(ready = log_ring_ready(ring)) && !ring->stopping)
+		pthread_cond_wait(&ring->cond, &ring->lock);
+
+	__atomic_store_n(&ring->sleeping, false, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&ring->lock);
+
+	return ready;
+}
+
+static void log_writer_send(struct mmsghdr *msgs, unsigned int n)
+{
+	unsigned int i = 0;
+
+	while (i < n) {
+		int r = sendmmsg(log_fd, msgs + i, n - i, 0);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		/* Skip the message the socket refused, as log_syslog would */
+		i += r > 0 ? (unsigned int) r : 1;
+	}
+}
+
+__attribute__((format(printf, 3, 4)))
+static void log_writer_notice(struct log_ring *ring, int priority,
+				const char *format, ...)
+{
+	char buf[128];
+	va_list ap;
+	size_t len;
+
+	va_start(ap, format);
+	len = ring->format(buf, sizeof(buf), priority, __FILE__,
+				L_STRINGIFY(__LINE__), __func__, format, ap);
+	va_end(ap);
+
+	if (len)
+		send(log_fd, buf, len, 0);
+}
+
+static void log_writer_report_dropped(struct log_ring *ring)
+{
+	unsigned long dropped = __atomic_exchange_n(&ring->dropped, 0,
+							__ATOMIC_RELAXED);
+
+	if (dropped)
+		log_writer_notice(ring, L_LOG_WARNING,
+					"%lu log messages dropped\n", dropped);
+}
+
+static void *log_writer(void *user_data)
+{
+	struct log_ring *ring = user_data;
+	struct mmsghdr msgs[LOG_BATCH];
+	struct iovec iov[LOG_BATCH];
+
+	while (log_writer_wait(ring)) {
+		unsigned int n_slots;
+		unsigned int n_msgs = 0;
+		unsigned int i;
+
+		for (n_slots = 0; n_slots < LOG_BATCH; n_slots++) {
+			unsigned long pos = ring->head + n_slots;
+			struct log_slot *slot = &ring->slots[pos & ring->mask];
+
+			if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) !=
+					pos + 1)
+				break;
+
+			if (!slot->len)
+				continue;
+
+			iov[n_msgs].iov_base = slot->data;
+			iov[n_msgs].iov_len = slot->len;
+			memset(&msgs[n_msgs], 0, sizeof(struct mmsghdr));
+			msgs[n_msgs].msg_hdr.msg_iov = &iov[n_msgs];
+			msgs[n_msgs].msg_hdr.msg_iovlen = 1;
+			n_msgs++;
+		}
+
+		log_writer_send(msgs, n_msgs);
+
+		for (i = 0; i < n_slots; i++) {
+			unsigned long pos = ring->head + i;
+
+			__atomic_store_n(&ring->slots[pos & ring->mask].seq,
+						pos + ring->mask + 1,
+						__ATOMIC_RELEASE);
+		}
+
+		ring->head += n_slots;
+		log_writer_report_dropped(ring);
+	}
+
+	/* Messages dropped since the last batch */
+	log_writer_report_dropped(ring);
+
+	return NULL;
+}
+
+/* The writer doesn't survive fork(), the child logs unbuffered */
+static void log_atfork_child(void)
+{
+	struct log_ring *ring = log_ring;
+
+	if (!ring)
+		return;
+
+	log_func = ring->direct;
+	log_ring = NULL;
+	log_producers = 0;
+	log_ring_free(ring);
+}
+
+/**
+ * l_log_set_buffered:
+ * @depth: maximum number of queued messages, or 0 to stop buffering
+ * @overflow: what to do with messages logged while the queue is full
+ *
+ * Makes the syslog or journal backend asynchronous.  Messages are then
+ * formatted into a preallocated queue without further allocations and sent
+ * in batches by a separate thread, so logging no longer blocks on the
+ * socket.  @depth is rounded up to a power of two, messages longer than
+ * about 1 KiB are truncated.  Changing the backend or calling this again
+ * sends out the queued messages first.  With %L_LOG_OVERFLOW_COUNT the
+ * number of dropped messages is logged once there is room again.
+ *
+ * This must be called after l_log_set_syslog() or l_log_set_journal().
+ * Unlike them it may be called while other threads are logging, messages
+ * being logged while buffering stops are either queued and sent before
+ * this returns or sent directly.  A child process created with fork()
+ * logs unbuffered.
+ *
+ * Returns: true if buffering was set up or stopped as requested
+ **/
+LIB_EXPORT bool l_log_set_buffered(unsigned int depth,
+					enum l_log_overflow overflow)
+{
+	struct log_ring *ring;
+	log_format_func_t format;
+	sigset_t mask, oldmask;
+	unsigned long n_slots;
+	unsigned long i;
+	int err;
+
+	if (log_ring) {
+		__atomic_store_n(&log_func, log_ring->direct,
+						__ATOMIC_RELAXED);
+		log_ring_stop();
+	}
+
+	if (!depth)
+		return true;
+
+	if (depth > LOG_MAX_SLOTS)
+		return false;
+
+	if (log_func == log_syslog)
+		format = format_syslog;
+	else if (log_func == log_journal)
+		format = format_journal;
+	else
+		return false;
+
+	if (!log_atfork_registered) {
+		if (pthread_atfork(NULL, NULL, log_atfork_child))
+			return false;
+
+		log_atfork_registered = true;
+	}
+
+	for (n_slots = 2; n_slots < depth; n_slots <<= 1)
+		;
+
+	ring = l_new(struct log_ring, 1);
+	ring->slots = l_new(struct log_slot, n_slots);
+	ring->mask = n_slots - 1;
+	ring->overflow = overflow;
+	ring->format = format;
+	ring->direct = log_func;
+	pthread_mutex_init(&ring->lock, NULL);
+	pthread_cond_init(&ring->cond, NULL);
+
+	for (i = 0; i < n_slots; i++)
+		ring->slots[i].seq = i;
+
+	/* Leave signal delivery to the application's threads */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &oldmask);
+	err = pthread_create(&ring->thread, NULL, log_writer, ring);
+	pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+	if (err) {
+		log_ring_free(ring);
+		return false;
+	}
+
+	log_ring_direct = log_func;
+	__atomic_store_n(&log_ring, ring, __ATOMIC_RELEASE);
+	__atomic_store_n(&log_func, log_buffered, __ATOMIC_RELEASE);
+
+	return true;
+}
+
 /**
  * l_log_with_location:
  * @priority: priority level
@@ -278,10 +716,132 @@ LIB_EXPORT void l_log_with_location(int priority,
 	va_list ap;
 
 	va_start(ap, format);
-	log_func(priority, file, line, func, format, ap);
+	__atomic_load_n(&log_func, __ATOMIC_ACQUIRE)(priority, file, line,
+							func, format, ap);
 	va_end(ap);
 }
 
+/*
+ * Rate limiting gives every call site a bucket of RATELIMIT_BURST tokens,
+ * refilled at that many per RATELIMIT_INTERVAL.  A site out of tokens only
+ * counts its messages, without formatting them.  A message identical to
+ * the last one logged from the site is counted too, unless an interval has
+ * passed.  The counts are reported along with the next message logged.
+ */
+#define RATELIMIT_BURST		10
+#define RATELIMIT_INTERVAL	(5 * L_USEC_PER_SEC)
+#define RATELIMIT_MSG_SIZE	1024
+
+bool log_ratelimit_begin(struct l_log_ratelimit *ratelimit, uint64_t *now)
+{
+	uint64_t refill;
+
+	*now = l_time_now();
+
+	if (!ratelimit->refilled) {
+		ratelimit->tokens = RATELIMIT_BURST;
+		ratelimit->refilled = *now;
+	}
+
+	refill = (*now - ratelimit->refilled) * RATELIMIT_BURST /
+							RATELIMIT_INTERVAL;
+	if (refill) {
+		ratelimit->tokens = minsize(ratelimit->tokens + refill,
+						RATELIMIT_BURST);
+
+		if (ratelimit->tokens == RATELIMIT_BURST)
+			ratelimit->refilled = *now;
+		else
+			ratelimit->refilled += refill * RATELIMIT_INTERVAL /
+							RATELIMIT_BURST;
+	}
+
+	if (ratelimit->tokens)
+		return true;
+
+	ratelimit->suppressed++;
+	return false;
+}
+
+bool log_ratelimit_end(struct l_log_ratelimit *ratelimit, uint64_t now,
+			const char *msg, unsigned int *out_repeated,
+			unsigned int *out_suppressed)
+{
+	uint32_t hash = l_str_hash(msg);
+
+	if (ratelimit->logged && ratelimit->hash == hash &&
+			now - ratelimit->logged < RATELIMIT_INTERVAL) {
+		ratelimit->repeated++;
+		return false;
+	}
+
+	ratelimit->tokens--;
+	ratelimit->hash = hash;
+	ratelimit->logged = now;
+
+	*out_repeated = ratelimit->repeated;
+	*out_suppressed = ratelimit->suppressed;
+	ratelimit->repeated = 0;
+	ratelimit->suppressed = 0;
+
+	return true;
+}
+
+/**
+ * l_log_ratelimited_with_location:
+ * @ratelimit: rate limiting state of the call site
+ * @priority: priority level
+ * @file: source file
+ * @line: source line
+ * @func: source function
+ * @format: format string
+ * @...: format arguments
+ *
+ * Logs like l_log_with_location(), but at most 10 messages per 5 seconds
+ * from the same call site, and collapsing repeats of the last message.
+ * Messages held back are summarized when the next message is logged.
+ * Messages are truncated to 1 KiB.  Usually called through
+ * l_log_ratelimited() and l_error_ratelimited() etc, which keep a
+ * @ratelimit per call site.
+ **/
+LIB_EXPORT void l_log_ratelimited_with_location(
+					struct l_log_ratelimit *ratelimit,
+					int priority, const char *file,
+					const char *line, const char *func,
+					const char *format, ...)
+{
+	char msg[RATELIMIT_MSG_SIZE];
+	unsigned int repeated;
+	unsigned int suppressed;
+	uint64_t now;
+	va_list ap;
+
+	if (log_func == log_null)
+		return;
+
+	if (!log_ratelimit_begin(ratelimit, &now))
+		return;
+
+	va_start(ap, format);
+	vsnprintf(msg, sizeof(msg), format, ap);
+	va_end(ap);
+
+	if (!log_ratelimit_end(ratelimit, now, msg, &repeated, &suppressed))
+		return;
+
+	if (repeated)
+		l_log_with_location(priority, file, line, func,
+					"last message repeated %u times\n",
+					repeated);
+
+	if (suppressed)
+		l_log_with_location(priority, file, line, func,
+					"%u messages suppressed\n",
+					suppressed);
+
+	l_log_with_location(priority, file, line, func, "%s", msg);
+}
+
 /**
  * l_error:
  * @format: format string
@@ -311,36 +871,180 @@ LIB_EXPORT void l_log_with_location(int priority,
 
 static const char *debug_pattern;
 
-static void debug_enable(struct l_debug_desc *start, struct l_debug_desc *stop)
+/*
+ * Patterns are split into their globs once and each glob is classified, so
+ * that the common plain names, "prefix*" and "*suffix" forms are matched
+ * against every debug site without going through fnmatch().
+ */
+enum debug_glob_type {
+	DEBUG_GLOB_EXACT,
+	DEBUG_GLOB_PREFIX,
+	DEBUG_GLOB_SUFFIX,
+	DEBUG_GLOB_FNMATCH,
+};
+
+struct debug_glob {
+	const char *str;
+	size_t len;
+	enum debug_glob_type type;
+};
+
+struct debug_pattern {
+	char *buf;
+	unsigned int n_globs;
+	struct debug_glob globs[];
+};
+
+static void debug_pattern_free(struct debug_pattern *pattern)
 {
-	struct l_debug_desc *desc;
-	char *pattern_copy;
+	l_free(pattern->buf);
+	l_free(pattern);
+}
 
-	if (!debug_pattern)
-		return;
+static struct debug_pattern *debug_pattern_compile(const char *str)
+{
+	struct debug_pattern *pattern;
+	unsigned int n_globs = 1;
+	const char *p;
+	char *buf;
+	char *glob;
+
+	for (p = str; *p; p++)
+		if (*p == ':' || *p == ',')
+			n_globs++;
+
+	pattern = l_malloc(sizeof(struct debug_pattern) +
+				n_globs * sizeof(struct debug_glob));
+	pattern->buf = l_strdup(str);
+	pattern->n_globs = 0;
+	buf = pattern->buf;
+
+	while ((glob = strsep(&buf, ":,"))) {
+		struct debug_glob *g = &pattern->globs[pattern->n_globs];
+		size_t special = strcspn(glob, "*?[\\");
+
+		if (!*glob)
+			continue;
+
+		g->str = glob;
+		g->len = strlen(glob);
+
+		if (special == g->len)
+			g->type = DEBUG_GLOB_EXACT;
+		else if (special == g->len - 1 && glob[special] == '*')
+			g->type = DEBUG_GLOB_PREFIX;
+		else if (special == 0 && glob[0] == '*' &&
+				strcspn(glob + 1, "*?[\\") == g->len - 1) {
+			g->type = DEBUG_GLOB_SUFFIX;
+			g->str++;
+			g->len--;
+		} else
+			g->type = DEBUG_GLOB_FNMATCH;
+
+		pattern->n_globs++;
+	}
 
-	pattern_copy = strdupa(debug_pattern);
+	return pattern;
+}
 
-	while (pattern_copy) {
-		char *str = strsep(&pattern_copy, ":,");
-		if (!str)
-			break;
+static bool debug_glob_match(const struct debug_glob *glob, const char *str)
+{
+	size_t len;
+
+	switch (glob->type) {
+	case DEBUG_GLOB_EXACT:
+		return !strcmp(str, glob->str);
+	case DEBUG_GLOB_PREFIX:
+		return !strncmp(str, glob->str, glob->len - 1);
+	case DEBUG_GLOB_SUFFIX:
+		len = strlen(str);
+		return len >= glob->len &&
+			!memcmp(str + len - glob->len, glob->str, glob->len);
+	case DEBUG_GLOB_FNMATCH:
+		return !fnmatch(glob->str, str, 0);
+	}
+
+	return false;
+}
+
+static bool debug_pattern_match(const struct debug_pattern *pattern,
+				const struct l_debug_desc *desc)
+{
+	unsigned int i;
+
+	for (i = 0; i < pattern->n_globs; i++)
+		if (debug_glob_match(&pattern->globs[i], desc->file) ||
+				debug_glob_match(&pattern->globs[i],
+							desc->func))
+			return true;
+
+	return false;
+}
+
+/* Sets or clears @flag in place on all sites matching @pattern */
+static unsigned int debug_set_flag(const struct debug_pattern *pattern,
+					unsigned int flag, bool set)
+{
+	const struct l_queue_entry *entry;
+	unsigned int count = 0;
+
+	for (entry = l_queue_get_entries(debug_sections); entry;
+					entry = entry->next) {
+		const struct debug_section *section = entry->data;
+		struct l_debug_desc *desc;
 
-		for (desc = start; desc < stop; desc++) {
-			if (!fnmatch(str, desc->file, 0))
-				desc->flags |= L_DEBUG_FLAG_PRINT;
-			if (!fnmatch(str, desc->func, 0))
-				desc->flags |= L_DEBUG_FLAG_PRINT;
+		for (desc = section->start; desc < section->end; desc++) {
+			if (pattern && !debug_pattern_match(pattern, desc))
+				continue;
+
+			if (set)
+				desc->flags |= flag;
+			else
+				desc->flags &= ~flag;
+
+			count++;
 		}
 	}
+
+	return count;
+}
+
+static void debug_enable(const char *str, unsigned int flag)
+{
+	struct debug_pattern *pattern = debug_pattern_compile(str);
+
+	debug_set_flag(pattern, flag, true);
+	debug_pattern_free(pattern);
 }
 
-static void debug_disable(struct l_debug_desc *start, struct l_debug_desc *stop)
+unsigned int debug_foreach(const char *str, debug_foreach_func_t function,
+				void *user_data)
 {
-	struct l_debug_desc *desc;
+	const struct l_queue_entry *entry;
+	struct debug_pattern *pattern = NULL;
+	unsigned int count = 0;
+
+	if (str)
+		pattern = debug_pattern_compile(str);
+
+	for (entry = l_queue_get_entries(debug_sections); entry;
+					entry = entry->next) {
+		const struct debug_section *section = entry->data;
+		const struct l_debug_desc *desc;
+
+		for (desc = section->start; desc < section->end; desc++) {
+			if (pattern && !debug_pattern_match(pattern, desc))
+				continue;
 
-	for (desc = start; desc < stop; desc++)
-		desc->flags &= ~L_DEBUG_FLAG_PRINT;
+			function(desc, user_data);
+			count++;
+		}
+	}
+
+	if (pattern)
+		debug_pattern_free(pattern);
+
+	return count;
 }
 
 /**
@@ -392,21 +1096,13 @@ LIB_EXPORT void l_debug_enable_full(const char *pattern,
 					struct l_debug_desc *start,
 					struct l_debug_desc *end)
 {
-	const struct l_queue_entry *entry;
-
 	if (!pattern)
 		return;
 
 	debug_pattern = pattern;
 
 	l_debug_add_section(start, end);
-
-	for (entry = l_queue_get_entries(debug_sections); entry;
-					entry = entry->next) {
-		const struct debug_section *section = entry->data;
-
-		debug_enable(section->start, section->end);
-	}
+	debug_enable(debug_pattern, L_DEBUG_FLAG_PRINT);
 }
 
 /**
@@ -416,16 +1112,580 @@ LIB_EXPORT void l_debug_enable_full(const char *pattern,
  **/
 LIB_EXPORT void l_debug_disable(void)
 {
-	const struct l_queue_entry *entry;
+	debug_set_flag(NULL, L_DEBUG_FLAG_PRINT, false);
+	debug_pattern = NULL;
+}
 
-	for (entry = l_queue_get_entries(debug_sections); entry;
-					entry = entry->next) {
-		const struct debug_section *section = entry->data;
+/**
+ * l_debug_set_enabled:
+ * @pattern: debug pattern
+ * @enabled: whether to enable or disable the matching sites
+ *
+ * Enables or disables the debug sites matching @pattern in all sections
+ * added so far, leaving the other sites as they are.  @pattern uses the
+ * same syntax as for l_debug_enable_full().  This allows narrowing down
+ * debug output at runtime, e.g. from a D-Bus method, see
+ * l_dbus_debug_control_enable().
+ *
+ * Returns: the number of debug sites matching @pattern
+ **/
+LIB_EXPORT unsigned int l_debug_set_enabled(const char *pattern, bool enabled)
+{
+	struct debug_pattern *compiled;
+	unsigned int count;
+
+	if (unlikely(!pattern))
+		return 0;
+
+	compiled = debug_pattern_compile(pattern);
+	count = debug_set_flag(compiled, L_DEBUG_FLAG_PRINT, enabled);
+	debug_pattern_free(compiled);
+
+	return count;
+}
+
+/*
+ * Trace mode records enabled l_debug() sites into a fixed ring of binary
+ * records instead of formatting them.  A record holds the time, thread,
+ * site and format string pointers and the raw arguments, strings being
+ * copied and truncated to fit.  The text is only produced when the ring
+ * is dumped, and the oldest records are overwritten as in ftrace.
+ */
+#define TRACE_RECORDS		4096
+#define TRACE_DATA_SIZE		88
+
+struct trace_record {
+	unsigned long seq;
+	uint64_t timestamp;
+	const struct l_debug_desc *desc;
+	const char *format;
+	uint32_t tid;
+	uint16_t len;
+	bool truncated;
+	uint8_t data[TRACE_DATA_SIZE];
+};
+
+enum trace_arg {
+	TRACE_ARG_NONE,
+	TRACE_ARG_INT,
+	TRACE_ARG_LONG,
+	TRACE_ARG_DOUBLE,
+	TRACE_ARG_POINTER,
+	TRACE_ARG_STRING,
+	TRACE_ARG_ERRNO,
+};
+
+struct trace_spec {
+	const char *start;
+	const char *end;
+	const char *modifier;
+	unsigned int modifier_len;
+	unsigned int n_stars;
+	bool precision_star;
+	int precision;
+	char conversion;
+	enum trace_arg type;
+};
 
-		debug_disable(section->start, section->end);
+static struct trace_record *trace_ring;
+static unsigned long trace_next;
+static const char *trace_pattern;
+static __thread uint32_t trace_tid;
+
+/* Parses the conversion specification starting at the '%' in @str */
+static void trace_parse_spec(const char *str, struct trace_spec *spec)
+{
+	const char *p = str + 1;
+
+	memset(spec, 0, sizeof(*spec));
+	spec->start = str;
+	spec->precision = -1;
+
+	while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' ||
+			*p == '0' || *p == '\'')
+		p++;
+
+	if (*p == '*') {
+		spec->n_stars++;
+		p++;
+	} else
+		while (l_ascii_isdigit(*p))
+			p++;
+
+	if (*p == '.') {
+		p++;
+
+		if (*p == '*') {
+			spec->precision_star = true;
+			spec->n_stars++;
+			p++;
+		} else {
+			spec->precision = 0;
+
+			while (l_ascii_isdigit(*p))
+				spec->precision = spec->precision * 10 +
+								*p++ - '0';
+		}
 	}
 
-	debug_pattern = NULL;
+	spec->modifier = p;
+
+	while (*p == 'h' || *p == 'l' || *p == 'L' || *p == 'q' ||
+			*p == 'j' || *p == 'z' || *p == 't')
+		p++;
+
+	spec->modifier_len = p - spec->modifier;
+	spec->conversion = *p;
+	spec->end = *p ? p + 1 : p;
+
+	switch (spec->conversion) {
+	case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+		if (!spec->modifier_len || spec->modifier[0] == 'h')
+			spec->type = TRACE_ARG_INT;
+		else
+			spec->type = TRACE_ARG_LONG;
+		break;
+	case 'c':
+		spec->type = TRACE_ARG_INT;
+		break;
+	case 'e': case 'E': case 'f': case 'F':
+	case 'g': case 'G': case 'a': case 'A':
+		spec->type = TRACE_ARG_DOUBLE;
+		break;
+	case 'p':
+	case 'n':
+		spec->type = TRACE_ARG_POINTER;
+		break;
+	case 's':
+		spec->type = TRACE_ARG_STRING;
+		break;
+	case 'm':
+		spec->type = TRACE_ARG_ERRNO;
+		break;
+	default:
+		spec->type = TRACE_ARG_NONE;
+		break;
+	}
+}
+
+static uint64_t trace_va_long(const struct trace_spec *spec, va_list *ap)
+{
+	bool is_signed = spec->conversion == 'd' || spec->conversion == 'i';
+
+	switch (spec->modifier[0]) {
+	case 'z':
+		return is_signed ? (uint64_t) va_arg(*ap, ssize_t) :
+						va_arg(*ap, size_t);
+	case 'j':
+		return is_signed ? (uint64_t) va_arg(*ap, intmax_t) :
+						va_arg(*ap, uintmax_t);
+	case 't':
+		return va_arg(*ap, ptrdiff_t);
+	}
+
+	if (spec->modifier_len == 1 && spec->modifier[0] == 'l')
+		return is_signed ? (uint64_t) va_arg(*ap, long) :
+						va_arg(*ap, unsigned long);
+
+	return va_arg(*ap, unsigned long long);
+}
+
+static size_t trace_encode(uint8_t *data, size_t size, const char *format,
+				va_list *ap, bool *truncated)
+{
+	struct trace_spec spec;
+	const char *str;
+	size_t pos = 0;
+	uint64_t value = 0;
+	int precision;
+	size_t len;
+	int err = errno;
+	unsigned int i;
+
+	for (str = strchr(format, '%'); str; str = strchr(spec.end, '%')) {
+		trace_parse_spec(str, &spec);
+
+		precision = spec.precision;
+
+		/* The precision comes last if both are given as arguments */
+		for (i = 0; i < spec.n_stars; i++) {
+			value = precision = va_arg(*ap, int);
+
+			if (size - pos < sizeof(value))
+				goto truncated;
+
+			memcpy(data + pos, &value, sizeof(value));
+			pos += sizeof(value);
+		}
+
+		if (!spec.precision_star)
+			precision = spec.precision;
+
+		switch (spec.type) {
+		case TRACE_ARG_NONE:
+			continue;
+		case TRACE_ARG_INT:
+			value = va_arg(*ap, int);
+			break;
+		case TRACE_ARG_LONG:
+			value = trace_va_long(&spec, ap);
+			break;
+		case TRACE_ARG_DOUBLE:
+			if (spec.modifier_len && spec.modifier[0] == 'L') {
+				double d = va_arg(*ap, long double);
+
+				memcpy(&value, &d, sizeof(value));
+			} else {
+				double d = va_arg(*ap, double);
+
+				memcpy(&value, &d, sizeof(value));
+			}
+			break;
+		case TRACE_ARG_POINTER:
+			value = (uintptr_t) va_arg(*ap, void *);
+			break;
+		case TRACE_ARG_STRING:
+			str = va_arg(*ap, const char *);
+			if (!str)
+				str = "(null)";
+
+			len = precision >= 0 ? strnlen(str, precision) :
+						strlen(str);
+			if (pos == size)
+				goto truncated;
+
+			if (len >= size - pos) {
+				memcpy(data + pos, str, size - pos - 1);
+				data[size - 1] = '\0';
+				pos = size;
+				goto truncated;
+			}
+
+			memcpy(data + pos, str, len);
+			data[pos + len] = '\0';
+			pos += len + 1;
+			continue;
+		case TRACE_ARG_ERRNO:
+			value = err;
+			break;
+		}
+
+		if (size - pos < sizeof(value))
+			goto truncated;
+
+		memcpy(data + pos, &value, sizeof(value));
+		pos += sizeof(value);
+	}
+
+	*truncated = false;
+	return pos;
+
+truncated:
+	*truncated = true;
+	return pos;
+}
+
+/**
+ * l_debug_trace:
+ * @desc: debug descriptor of the calling site
+ * @format: format string
+ * @...: format arguments
+ *
+ * Records a message in the trace buffer, see l_debug_trace_enable_full().
+ * This is called by l_debug() for sites with tracing enabled.
+ **/
+LIB_EXPORT void l_debug_trace(const struct l_debug_desc *desc,
+				const char *format, ...)
+{
+	struct trace_record *record;
+	struct timespec ts;
+	unsigned long seq;
+	va_list ap;
+
+	if (unlikely(!trace_ring))
+		return;
+
+	seq = __atomic_fetch_add(&trace_next, 1, __ATOMIC_RELAXED);
+	record = &trace_ring[seq % TRACE_RECORDS];
+
+	/* Invalidate the record while it's being overwritten */
+	__atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if (unlikely(!trace_tid))
+		trace_tid = syscall(SYS_gettid);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	record->timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	record->desc = desc;
+	record->format = format;
+	record->tid = trace_tid;
+
+	va_start(ap, format);
+	record->len = trace_encode(record->data, sizeof(record->data), format,
+					&ap, &record->truncated);
+	va_end(ap);
+
+	__atomic_store_n(&record->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+__attribute__((format(printf, 3, 4)))
+static size_t trace_print(char *buf, size_t size, const char *format, ...)
+{
+	va_list ap;
+	int len;
+
+	if (!size)
+		return 0;
+
+	va_start(ap, format);
+	len = vsnprintf(buf, size, format, ap);
+	va_end(ap);
+
+	return len < 0 ? 0 : minsize(len, size - 1);
+}
+
+#define TRACE_PRINT_ARG(buf, size, fmt, star, n_stars, value)		\
+	((n_stars) == 0 ? trace_print(buf, size, fmt, value) :		\
+	 (n_stars) == 1 ? trace_print(buf, size, fmt, star[0], value) :	\
+	 trace_print(buf, size, fmt, star[0], star[1], value))
+
+/* Formats the message of @record, without allocating, into @buf */
+static size_t trace_decode(const struct trace_record *record,
+				char *buf, size_t size)
+{
+	const uint8_t *data = record->data;
+	const char *format = record->format;
+	struct trace_spec spec;
+	const char *str;
+	size_t pos = 0;
+	size_t data_pos = 0;
+	uint64_t value;
+	char fmt[32];
+	int star[2];
+	unsigned int i;
+
+	for (str = strchr(format, '%'); str; str = strchr(spec.end, '%')) {
+		size_t fmt_len;
+
+		pos += trace_print(buf + pos, size - pos, "%.*s",
+					(int) (str - format), format);
+		trace_parse_spec(str, &spec);
+		format = spec.end;
+
+		if (spec.end - spec.start >= (int) sizeof(fmt) - 2)
+			goto truncated;
+
+		for (i = 0; i < spec.n_stars; i++) {
+			if (record->len - data_pos < sizeof(value))
+				goto truncated;
+
+			memcpy(&value, data + data_pos, sizeof(value));
+			star[i] = (int) value;
+			data_pos += sizeof(value);
+		}
+
+		/* Integers wider than int are all stored as long long */
+		fmt_len = spec.modifier - spec.start;
+		memcpy(fmt, spec.start, fmt_len);
+
+		if (spec.type == TRACE_ARG_LONG) {
+			memcpy(fmt + fmt_len, "ll", 2);
+			fmt_len += 2;
+		} else if (spec.type == TRACE_ARG_INT) {
+			memcpy(fmt + fmt_len, spec.modifier,
+						spec.modifier_len);
+			fmt_len += spec.modifier_len;
+		}
+
+		fmt[fmt_len++] = spec.conversion;
+		fmt[fmt_len] = '\0';
+
+		if (spec.type == TRACE_ARG_NONE) {
+			if (spec.conversion == '%')
+				pos += trace_print(buf + pos, size - pos, "%%");
+
+			continue;
+		}
+
+		if (spec.type == TRACE_ARG_STRING) {
+			if (data_pos >= record->len)
+				goto truncated;
+
+			str = (const char *) data + data_pos;
+			data_pos += strnlen(str, record->len - data_pos) + 1;
+			pos += TRACE_PRINT_ARG(buf + pos, size - pos, fmt,
+						star, spec.n_stars, str);
+
+			/* The string was cut short to fill the record */
+			if (record->truncated && data_pos >= record->len)
+				goto truncated;
+
+			continue;
+		}
+
+		if (record->len - data_pos < sizeof(value))
+			goto truncated;
+
+		memcpy(&value, data + data_pos, sizeof(value));
+		data_pos += sizeof(value);
+
+		switch (spec.type) {
+		case TRACE_ARG_INT:
+			pos += TRACE_PRINT_ARG(buf + pos, size - pos, fmt,
+						star, spec.n_stars,
+						(int) value);
+			break;
+		case TRACE_ARG_LONG:
+			pos += TRACE_PRINT_ARG(buf + pos, size - pos, fmt,
+						star, spec.n_stars,
+						(long long) value);
+			break;
+		case TRACE_ARG_DOUBLE:
+		{
+			double d;
+
+			memcpy(&d, &value, sizeof(d));
+			pos += TRACE_PRINT_ARG(buf + pos, size - pos, fmt,
+						star, spec.n_stars, d);
+			break;
+		}
+		case TRACE_ARG_POINTER:
+			if (spec.conversion == 'p')
+				pos += trace_print(buf + pos, size - pos, "%p",
+						(void *) (uintptr_t) value);
+			break;
+		case TRACE_ARG_ERRNO:
+		{
+			int err = errno;
+
+			errno = value;
+			pos += trace_print(buf + pos, size - pos, "%m");
+			errno = err;
+			break;
+		}
+		case TRACE_ARG_NONE:
+		case TRACE_ARG_STRING:
+			break;
+		}
+	}
+
+	pos += trace_print(buf + pos, size - pos, "%s", format);
+	if (!record->truncated)
+		return pos;
+
+truncated:
+	pos += trace_print(buf + pos, size - pos, "...");
+	return pos;
+}
+
+static void trace_write(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t r = write(fd, buf, len);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r <= 0)
+			return;
+
+		buf += r;
+		len -= r;
+	}
+}
+
+/**
+ * l_debug_trace_dump:
+ * @fd: file descriptor to write to
+ *
+ * Writes the records in the trace buffer to @fd as text, oldest first.
+ * Each line starts with the monotonic time in seconds, the thread id and
+ * the site.  This doesn't allocate memory, so it can be used to dump the
+ * buffer from a handler for fatal signals.
+ **/
+LIB_EXPORT void l_debug_trace_dump(int fd)
+{
+	unsigned long end;
+	unsigned long seq;
+
+	if (!trace_ring)
+		return;
+
+	end = __atomic_load_n(&trace_next, __ATOMIC_RELAXED);
+	seq = end > TRACE_RECORDS ? end - TRACE_RECORDS : 0;
+
+	for (; seq < end; seq++) {
+		const struct trace_record *slot =
+					&trace_ring[seq % TRACE_RECORDS];
+		struct trace_record record;
+		char line[512];
+		size_t len;
+
+		/* Skip records being overwritten while copied */
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq + 1)
+			continue;
+
+		memcpy(&record, slot, sizeof(record));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq + 1)
+			continue;
+
+		len = trace_print(line, sizeof(line) - 1,
+					"[%llu.%09llu] %u %s:%s() ",
+					(unsigned long long)
+					(record.timestamp / 1000000000),
+					(unsigned long long)
+					(record.timestamp % 1000000000),
+					record.tid, record.desc->file,
+					record.desc->func);
+		len += trace_decode(&record, line + len,
+					sizeof(line) - 1 - len);
+		line[len++] = '\n';
+
+		trace_write(fd, line, len);
+	}
+}
+
+/**
+ * l_debug_trace_enable_full:
+ * @pattern: debug pattern
+ * @start: start of the debug section
+ * @stop: end of the debug section
+ *
+ * Enables tracing of the l_debug() sites matching @pattern, using the same
+ * patterns as l_debug_enable_full().  A traced site only records its raw
+ * arguments in a per-process buffer of the last 4096 messages, to be
+ * written out with l_debug_trace_dump().  Strings are truncated to the
+ * space left in the 88 bytes available per message.
+ **/
+LIB_EXPORT void l_debug_trace_enable_full(const char *pattern,
+						struct l_debug_desc *start,
+						struct l_debug_desc *end)
+{
+	if (!pattern)
+		return;
+
+	if (!trace_ring)
+		trace_ring = l_new(struct trace_record, TRACE_RECORDS);
+
+	trace_pattern = pattern;
+
+	l_debug_add_section(start, end);
+	debug_enable(trace_pattern, L_DEBUG_FLAG_TRACE);
+}
+
+/**
+ * l_debug_trace_disable:
+ *
+ * Disables tracing for all debug sections.  The records already in the
+ * trace buffer are kept.
+ **/
+LIB_EXPORT void l_debug_trace_disable(void)
+{
+	debug_set_flag(NULL, L_DEBUG_FLAG_TRACE, false);
+	trace_pattern = NULL;
 }
 
 __attribute__((constructor)) static void register_debug_section()
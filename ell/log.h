@@ -10,6 +10,7 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,6 +32,13 @@ void l_log_set_stderr(void);
 void l_log_set_syslog(void);
 void l_log_set_journal(void);
 
+enum l_log_overflow {
+	L_LOG_OVERFLOW_DROP,
+	L_LOG_OVERFLOW_COUNT,
+};
+
+bool l_log_set_buffered(unsigned int depth, enum l_log_overflow overflow);
+
 void l_log_with_location(int priority, const char *file, const char *line,
 				const char *func, const char *format, ...)
 				__attribute__((format(printf, 5, 6)));
@@ -39,11 +47,35 @@ void l_log_with_location(int priority, const char *file, const char *line,
 					__FILE__, L_STRINGIFY(__LINE__), \
 					__func__, format "\n", ##__VA_ARGS__)
 
+/* Per call site state of the rate limited logging, zero initialized */
+struct l_log_ratelimit {
+	uint64_t refilled;
+	uint64_t logged;
+	uint32_t hash;
+	uint32_t tokens;
+	uint32_t repeated;
+	uint32_t suppressed;
+};
+
+void l_log_ratelimited_with_location(struct l_log_ratelimit *ratelimit,
+				int priority, const char *file,
+				const char *line, const char *func,
+				const char *format, ...)
+				__attribute__((format(printf, 6, 7)));
+
+#define l_log_ratelimited(priority, format, ...) do { \
+	static struct l_log_ratelimit __ratelimit; \
+	l_log_ratelimited_with_location(&__ratelimit, priority, \
+					__FILE__, L_STRINGIFY(__LINE__), \
+					__func__, format "\n", ##__VA_ARGS__); \
+} while (0)
+
 struct l_debug_desc {
 	const char *file;
 	const char *func;
 #define L_DEBUG_FLAG_DEFAULT (0)
 #define L_DEBUG_FLAG_PRINT   (1 << 0)
+#define L_DEBUG_FLAG_TRACE   (1 << 1)
 	unsigned int flags;
 } __attribute__((aligned(8)));
 
@@ -64,8 +96,13 @@ _Pragma("GCC diagnostic pop") \
 	if (symbol.flags & L_DEBUG_FLAG_PRINT) \
 		l_log(L_LOG_DEBUG, "%s:%s() " format, __FILE__, \
 					__func__ , ##__VA_ARGS__); \
+	if (symbol.flags & L_DEBUG_FLAG_TRACE) \
+		l_debug_trace(&symbol, format, ##__VA_ARGS__); \
 } while (0)
 
+/* Arguments already checked against the format by the l_log() call above */
+void l_debug_trace(const struct l_debug_desc *desc, const char *format, ...);
+
 void l_debug_enable_full(const char *pattern,
 				struct l_debug_desc *start,
 				struct l_debug_desc *end);
@@ -82,6 +119,24 @@ _Pragma("GCC diagnostic pop") \
 } while (0)
 
 void l_debug_disable(void);
+unsigned int l_debug_set_enabled(const char *pattern, bool enabled);
+
+void l_debug_trace_enable_full(const char *pattern,
+				struct l_debug_desc *start,
+				struct l_debug_desc *end);
+
+#define l_debug_trace_enable(pattern) do { \
+_Pragma("GCC diagnostic push") \
+_Pragma("GCC diagnostic ignored \"-Wredundant-decls\"") \
+	extern struct l_debug_desc __start___ell_debug[]; \
+	extern struct l_debug_desc __stop___ell_debug[]; \
+	l_debug_trace_enable_full(pattern, __start___ell_debug, \
+						__stop___ell_debug); \
+_Pragma("GCC diagnostic pop") \
+} while (0)
+
+void l_debug_trace_disable(void);
+void l_debug_trace_dump(int fd);
 
 #define l_error(format, ...)  l_log(L_LOG_ERR, format, ##__VA_ARGS__)
 #define l_warn(format, ...)   l_log(L_LOG_WARNING, format, ##__VA_ARGS__)
@@ -89,6 +144,15 @@ void l_debug_disable(void);
 #define l_info(format, ...)   l_log(L_LOG_INFO, format, ##__VA_ARGS__)
 #define l_debug(format, ...)  L_DEBUG_SYMBOL(__debug_desc, format, ##__VA_ARGS__)
 
+#define l_error_ratelimited(format, ...) \
+	l_log_ratelimited(L_LOG_ERR, format, ##__VA_ARGS__)
+#define l_warn_ratelimited(format, ...) \
+	l_log_ratelimited(L_LOG_WARNING, format, ##__VA_ARGS__)
+#define l_notice_ratelimited(format, ...) \
+	l_log_ratelimited(L_LOG_NOTICE, format, ##__VA_ARGS__)
+#define l_info_ratelimited(format, ...) \
+	l_log_ratelimited(L_LOG_INFO, format, ##__VA_ARGS__)
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,19 +5,46 @@
  * SPDX-License-Identifier: LGPL-2.1-or-later
  */
 
+struct l_main_loop;
+struct timeout_queue;
+struct idle_data;
+struct l_main_watch_stats;
+
 typedef void (*watch_event_cb_t) (int fd, uint32_t events, void *user_data);
 typedef void (*watch_destroy_cb_t) (void *user_data);
 
 typedef void (*idle_event_cb_t) (void *user_data);
 typedef void (*idle_destroy_cb_t) (void *user_data);
 
-int watch_add(int fd, uint32_t events, watch_event_cb_t callback,
-				void *user_data, watch_destroy_cb_t destroy);
-int watch_modify(int fd, uint32_t events, bool force);
-int watch_remove(int fd, bool epoll_del);
-int watch_clear(int fd);
+enum main_backend {
+	MAIN_BACKEND_AUTO,
+	MAIN_BACKEND_EPOLL,
+	MAIN_BACKEND_URING,
+};
+
+void main_set_backend(enum main_backend backend);
+
+struct l_main_loop *main_loop_get(void);
+struct timeout_queue *main_loop_get_timeouts(struct l_main_loop *loop);
+void main_loop_set_timeouts(struct l_main_loop *loop,
+					struct timeout_queue *timeouts);
+
+bool timeout_queue_next_deadline(struct timeout_queue *queue,
+							uint64_t *out_deadline);
+void timeout_queue_dispatch_expired(struct timeout_queue *queue);
+
+int watch_add(struct l_main_loop *loop, int fd, uint32_t events,
+			watch_event_cb_t callback, void *user_data,
+			watch_destroy_cb_t destroy);
+int watch_modify(struct l_main_loop *loop, int fd, uint32_t events,
+								bool force);
+int watch_remove(struct l_main_loop *loop, int fd, bool epoll_del);
+int watch_clear(struct l_main_loop *loop, int fd);
+bool watch_get_stats(struct l_main_loop *loop, int fd,
+				struct l_main_watch_stats *stats);
 
 #define IDLE_FLAG_NO_WARN_DANGLING 0x10000000
-int idle_add(idle_event_cb_t callback, void *user_data, uint32_t flags,
-		idle_destroy_cb_t destroy);
-void idle_remove(int id);
+struct idle_data *idle_add(struct l_main_loop *loop, idle_event_cb_t callback,
+				void *user_data, uint32_t flags,
+				idle_destroy_cb_t destroy);
+void idle_remove(struct l_main_loop *loop, struct idle_data *idle);
@@ -11,23 +11,32 @@
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <limits.h>
 #include <signal.h>
+#include <stdio.h>
+#include <inttypes.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
 #include "signal.h"
-#include "queue.h"
 #include "log.h"
 #include "useful.h"
 #include "main.h"
 #include "main-private.h"
+#include "work-private.h"
+#include "uring-private.h"
 #include "private.h"
+#include "missing.h"
 #include "timeout.h"
+#include "time.h"
+#include "time-private.h"
+#include "probe-private.h"
 
 /**
  * SECTION:main
@@ -37,6 +46,7 @@
  */
 
 #define MAX_EPOLL_EVENTS 10
+#define EPOLL_EVENTS_LIMIT (INT_MAX / sizeof(struct epoll_event))
 
 #define IDLE_FLAG_DISPATCHING	1
 #define IDLE_FLAG_DESTROYED	2
@@ -46,16 +56,16 @@
 
 #define WATCHDOG_TRIGGER_FREQ	2
 
-static int epoll_fd = -1;
-static bool epoll_running;
-static bool epoll_terminate;
-static int idle_id;
+#define WATCH_PAGE_SHIFT	7
+#define WATCH_PAGE_SIZE		(1U << WATCH_PAGE_SHIFT)
 
-static int notify_fd;
+#define URING_ENTRIES 256
 
-static struct l_timeout *watchdog;
-
-static struct l_queue *idle_list;
+#ifdef HAVE_IO_URING
+#define URING_DEFAULT true
+#else
+#define URING_DEFAULT false
+#endif
 
 struct watch_data {
 	int fd;
@@ -64,12 +74,19 @@ struct watch_data {
 	watch_event_cb_t callback;
 	watch_destroy_cb_t destroy;
 	void *user_data;
+	struct l_main_watch_stats *stats;
+	uint32_t seq;
 };
 
-#define DEFAULT_WATCH_ENTRIES 128
-
-static unsigned int watch_entries;
-static struct watch_data **watch_list;
+/*
+ * Watches are looked up by fd through a two-level table.  Pages are only
+ * allocated for ranges of fds that are in use, and growing the table only
+ * copies page pointers, never live entries.
+ */
+struct watch_page {
+	unsigned int used;
+	struct watch_data *entries[WATCH_PAGE_SIZE];
+};
 
 struct idle_data {
 	idle_event_cb_t callback;
@@ -77,40 +94,381 @@ struct idle_data {
 	void *user_data;
 	uint32_t flags;
 	int id;
+	struct idle_data *prev;
+	struct idle_data *next;
+};
+
+struct invoke_data {
+	l_main_invoke_cb_t callback;
+	l_main_destroy_cb_t destroy;
+	void *user_data;
+	struct invoke_data *next;
+};
+
+/**
+ * l_main_loop:
+ *
+ * Opaque object representing a main loop.  Each thread can run its own
+ * main loop, which is created by calling l_main_init() on that thread.
+ */
+struct l_main_loop {
+	int epoll_fd;
+	struct uring *uring;
+	uint32_t uring_seq;
+	bool running;
+	bool terminate;
+	int idle_id;
+	int notify_fd;
+	struct l_timeout *watchdog;
+	struct idle_data *idle_head;
+	struct idle_data *idle_tail;
+	struct epoll_event *events;
+	unsigned int events_size;
+	uint64_t saturated;
+	unsigned int watch_pages_size;
+	struct watch_page **watch_pages;
+	struct timeout_queue *timeouts;
+	int invoke_fd;
+	struct invoke_data *invoke_list;
+	struct l_main_stats *stats;
+	bool stats_notify;
 };
 
-static inline bool __attribute__ ((always_inline)) create_epoll(void)
+/*
+ * The main loop of the calling thread.  Objects such as l_io, l_timeout
+ * and l_idle attach to the loop of the thread that created them.
+ */
+static __thread struct l_main_loop *current_loop;
+
+static __thread unsigned int epoll_max_events = MAX_EPOLL_EVENTS;
+static __thread bool epoll_adaptive;
+
+static enum main_backend main_backend = MAIN_BACKEND_AUTO;
+
+static void watch_free(struct watch_data *data)
 {
-	unsigned int i;
+	l_free(data->stats);
+	l_free(data);
+}
 
-	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
-	if (epoll_fd < 0)
-		return false;
+static struct watch_data *watch_lookup(struct l_main_loop *loop,
+							unsigned int fd)
+{
+	unsigned int index = fd >> WATCH_PAGE_SHIFT;
+	struct watch_page *page;
+
+	if (index >= loop->watch_pages_size)
+		return NULL;
+
+	page = loop->watch_pages[index];
+	if (!page)
+		return NULL;
+
+	return page->entries[fd & (WATCH_PAGE_SIZE - 1)];
+}
+
+static void watch_insert(struct l_main_loop *loop, struct watch_data *data)
+{
+	unsigned int index = (unsigned int) data->fd >> WATCH_PAGE_SHIFT;
+	struct watch_page *page;
+
+	if (index >= loop->watch_pages_size) {
+		unsigned int size = maxsize(loop->watch_pages_size * 2,
+								index + 1);
+
+		loop->watch_pages = l_realloc(loop->watch_pages,
+					size * sizeof(struct watch_page *));
+		memset(loop->watch_pages + loop->watch_pages_size, 0,
+			(size - loop->watch_pages_size) *
+					sizeof(struct watch_page *));
+		loop->watch_pages_size = size;
+	}
+
+	page = loop->watch_pages[index];
+	if (!page) {
+		page = l_new(struct watch_page, 1);
+		loop->watch_pages[index] = page;
+	}
+
+	page->entries[data->fd & (WATCH_PAGE_SIZE - 1)] = data;
+	page->used += 1;
+}
+
+static void watch_unlink(struct l_main_loop *loop, unsigned int fd)
+{
+	unsigned int index = fd >> WATCH_PAGE_SHIFT;
+	struct watch_page *page = loop->watch_pages[index];
+
+	page->entries[fd & (WATCH_PAGE_SIZE - 1)] = NULL;
+
+	if (--page->used)
+		return;
+
+	l_free(page);
+	loop->watch_pages[index] = NULL;
+}
+
+/* Bucket i holds values in [2^(i - 1), 2^i), the last one everything above */
+static unsigned int stats_bucket(uint64_t value)
+{
+	unsigned int bucket = value ? 64 - __builtin_clzll(value) : 0;
+
+	return minsize(bucket, L_MAIN_HISTOGRAM_SIZE - 1);
+}
+
+static void stats_record_stall(struct l_main_stats *stats, uint64_t duration,
+								int fd)
+{
+	if (duration <= stats->longest_stall)
+		return;
+
+	stats->longest_stall = duration;
+	stats->longest_stall_fd = fd;
+}
+
+static void watch_dispatch(struct l_main_loop *loop, struct watch_data *data,
+							uint32_t events)
+{
+	struct l_main_watch_stats *wstats;
+	uint64_t start;
+	uint64_t duration;
+
+	if (!loop->stats) {
+		data->callback(data->fd, events, data->user_data);
+		return;
+	}
 
-	watch_list = malloc(DEFAULT_WATCH_ENTRIES * sizeof(void *));
-	if (!watch_list)
-		goto close_epoll;
+	if (!data->stats)
+		data->stats = l_new(struct l_main_watch_stats, 1);
 
-	idle_list = l_queue_new();
+	/* Watches removed by their callback are only freed after dispatch */
+	wstats = data->stats;
 
-	idle_id = 0;
+	start = l_time_now();
+	data->callback(data->fd, events, data->user_data);
+	duration = l_time_now() - start;
 
-	watch_entries = DEFAULT_WATCH_ENTRIES;
+	/* Stats might have been disabled from within the callback */
+	if (!loop->stats)
+		return;
+
+	loop->stats->callback_histogram[stats_bucket(duration)] += 1;
+	stats_record_stall(loop->stats, duration, data->fd);
+
+	wstats->dispatches += 1;
+	wstats->total_time += duration;
+	wstats->histogram[stats_bucket(duration)] += 1;
+
+	if (duration > wstats->longest_time)
+		wstats->longest_time = duration;
+}
+
+static void invoke_free(struct invoke_data *data)
+{
+	if (data->destroy)
+		data->destroy(data->user_data);
+
+	l_free(data);
+}
+
+/*
+ * Submissions are pushed onto a lock-free LIFO list, only the submission
+ * finding the list empty needs to wake up the loop.  The loop detaches the
+ * whole list at once and restores submission order before dispatching.
+ */
+static struct invoke_data *invoke_take_all(struct l_main_loop *loop)
+{
+	struct invoke_data *list;
+	struct invoke_data *fifo = NULL;
+
+	list = __atomic_exchange_n(&loop->invoke_list, NULL, __ATOMIC_ACQUIRE);
+
+	while (list) {
+		struct invoke_data *next = list->next;
+
+		list->next = fifo;
+		fifo = list;
+		list = next;
+	}
+
+	return fifo;
+}
+
+static void invoke_callback(int fd, uint32_t events, void *user_data)
+{
+	struct l_main_loop *loop = user_data;
+	struct invoke_data *data;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return;
+
+	data = invoke_take_all(loop);
+
+	while (data) {
+		struct invoke_data *next = data->next;
 
-	for (i = 0; i < watch_entries; i++)
-		watch_list[i] = NULL;
+		data->callback(data->user_data);
+		invoke_free(data);
+		data = next;
+	}
+}
+
+static void invoke_destroy(void *user_data)
+{
+	struct l_main_loop *loop = user_data;
+	struct invoke_data *data = invoke_take_all(loop);
+
+	while (data) {
+		struct invoke_data *next = data->next;
+
+		invoke_free(data);
+		data = next;
+	}
+
+	close(loop->invoke_fd);
+	loop->invoke_fd = -1;
+}
+
+static bool create_invoke(struct l_main_loop *loop)
+{
+	loop->invoke_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (loop->invoke_fd < 0)
+		return false;
+
+	if (watch_add(loop, loop->invoke_fd, EPOLLIN, invoke_callback,
+						loop, invoke_destroy) < 0) {
+		close(loop->invoke_fd);
+		return false;
+	}
 
 	return true;
+}
+
+static struct l_main_loop *create_loop(void)
+{
+	struct l_main_loop *loop;
+
+	loop = l_new(struct l_main_loop, 1);
+
+	/*
+	 * Fall back to epoll when io_uring is not enabled or not usable,
+	 * unless it was asked for explicitly.
+	 */
+	if (main_backend == MAIN_BACKEND_URING ||
+			(main_backend == MAIN_BACKEND_AUTO && URING_DEFAULT)) {
+		loop->uring = uring_new(URING_ENTRIES);
+		if (!loop->uring && main_backend == MAIN_BACKEND_URING)
+			goto free_loop;
+	}
+
+	if (loop->uring)
+		loop->epoll_fd = -1;
+	else {
+		loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (loop->epoll_fd < 0)
+			goto free_loop;
+	}
 
-close_epoll:
-	close(epoll_fd);
-	epoll_fd = -1;
+	loop->idle_id = 0;
 
-	return false;
+	loop->events_size = epoll_adaptive ?
+			minsize(epoll_max_events, MAX_EPOLL_EVENTS) :
+			epoll_max_events;
+	loop->events = l_new(struct epoll_event, loop->events_size);
+
+	if (!create_invoke(loop))
+		goto free_events;
+
+	return loop;
+
+free_events:
+	l_free(loop->events);
+
+	if (loop->uring)
+		uring_free(loop->uring);
+	else
+		close(loop->epoll_fd);
+free_loop:
+	l_free(loop);
+
+	return NULL;
 }
 
-int watch_add(int fd, uint32_t events, watch_event_cb_t callback,
-				void *user_data, watch_destroy_cb_t destroy)
+/*
+ * Selects the watch layer of the loops created from now on, in any thread.
+ * Meant for the unit tests so that both backends get exercised.
+ */
+void main_set_backend(enum main_backend backend)
+{
+	main_backend = backend;
+}
+
+struct l_main_loop *main_loop_get(void)
+{
+	return current_loop;
+}
+
+struct timeout_queue *main_loop_get_timeouts(struct l_main_loop *loop)
+{
+	return loop->timeouts;
+}
+
+void main_loop_set_timeouts(struct l_main_loop *loop,
+					struct timeout_queue *timeouts)
+{
+	loop->timeouts = timeouts;
+}
+
+/*
+ * With io_uring, every poll request is tagged with the descriptor and a
+ * sequence number.  Completions of requests that were cancelled or belong
+ * to a previous user of the descriptor no longer match and are dropped.
+ */
+static uint64_t watch_uring_tag(struct watch_data *data)
+{
+	return (uint64_t) data->seq << 32 | (uint32_t) data->fd;
+}
+
+/*
+ * Level-triggered watches use single-shot polls, re-armed after each
+ * dispatch, so that readiness is evaluated again as epoll would.  The
+ * re-arm is batched with the next wait.  Edge-triggered watches stay armed
+ * as multishot polls, unless exclusive wakeups are requested, which the
+ * kernel does not support for multishot polls.
+ */
+static int watch_uring_arm(struct l_main_loop *loop, struct watch_data *data)
+{
+	bool multishot = (data->events & EPOLLET) &&
+					!(data->events & EPOLLEXCLUSIVE);
+	int err;
+
+	if (!++loop->uring_seq)
+		loop->uring_seq = 1;
+
+	data->seq = loop->uring_seq;
+
+	err = uring_poll_add(loop->uring, data->fd, data->events, multishot,
+						watch_uring_tag(data));
+	if (err < 0)
+		data->seq = 0;
+
+	return err;
+}
+
+static void watch_uring_disarm(struct l_main_loop *loop,
+						struct watch_data *data)
+{
+	if (!data->seq)
+		return;
+
+	uring_poll_remove(loop->uring, watch_uring_tag(data));
+	data->seq = 0;
+}
+
+int watch_add(struct l_main_loop *loop, int fd, uint32_t events,
+			watch_event_cb_t callback, void *user_data,
+			watch_destroy_cb_t destroy)
 {
 	struct watch_data *data;
 	struct epoll_event ev;
@@ -119,11 +477,11 @@ int watch_add(int fd, uint32_t events, watch_event_cb_t callback,
 	if (unlikely(fd < 0 || !callback))
 		return -EINVAL;
 
-	if (epoll_fd < 0)
+	if (!loop)
 		return -EIO;
 
-	if (L_WARN_ON((unsigned int) fd > watch_entries - 1))
-		return -ERANGE;
+	if (watch_lookup(loop, fd))
+		return -EEXIST;
 
 	data = l_new(struct watch_data, 1);
 
@@ -134,22 +492,65 @@ int watch_add(int fd, uint32_t events, watch_event_cb_t callback,
 	data->destroy = destroy;
 	data->user_data = user_data;
 
+	if (loop->uring) {
+		/* Poll requests only fail once submitted, check early */
+		if (fcntl(fd, F_GETFD) < 0)
+			err = -errno;
+		else
+			err = watch_uring_arm(loop, data);
+
+		if (err < 0) {
+			l_free(data);
+			return err;
+		}
+
+		goto done;
+	}
+
 	memset(&ev, 0, sizeof(ev));
 	ev.events = events;
 	ev.data.ptr = data;
 
-	err = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, data->fd, &ev);
+	err = epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, data->fd, &ev);
 	if (err < 0) {
 		l_free(data);
 		return -errno;
 	}
 
-	watch_list[fd] = data;
+done:
+	watch_insert(loop, data);
 
 	return 0;
 }
 
-int watch_modify(int fd, uint32_t events, bool force)
+/*
+ * EPOLLEXCLUSIVE can only be given with EPOLL_CTL_ADD, and watches added
+ * with it can't be modified.  Such watches are removed and added again.
+ */
+static int watch_readd(struct l_main_loop *loop, struct watch_data *data,
+						struct epoll_event *ev)
+{
+	int err;
+
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, data->fd, NULL) < 0)
+		return -errno;
+
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, data->fd, ev) == 0) {
+		data->events = ev->events;
+		return 0;
+	}
+
+	err = -errno;
+
+	/* Try to restore the previous registration */
+	ev->events = data->events;
+	epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, data->fd, ev);
+
+	return err;
+}
+
+int watch_modify(struct l_main_loop *loop, int fd, uint32_t events,
+								bool force)
 {
 	struct watch_data *data;
 	struct epoll_event ev;
@@ -158,21 +559,31 @@ int watch_modify(int fd, uint32_t events, bool force)
 	if (unlikely(fd < 0))
 		return -EINVAL;
 
-	if ((unsigned int) fd > watch_entries - 1)
-		return -ERANGE;
+	if (!loop)
+		return -EIO;
 
-	data = watch_list[fd];
+	data = watch_lookup(loop, fd);
 	if (!data)
 		return -ENXIO;
 
 	if (data->events == events && !force)
 		return 0;
 
+	if (loop->uring) {
+		watch_uring_disarm(loop, data);
+		data->events = events;
+
+		return watch_uring_arm(loop, data);
+	}
+
 	memset(&ev, 0, sizeof(ev));
 	ev.events = events;
 	ev.data.ptr = data;
 
-	err = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, data->fd, &ev);
+	if ((events | data->events) & EPOLLEXCLUSIVE)
+		return watch_readd(loop, data, &ev);
+
+	err = epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, data->fd, &ev);
 	if (err < 0)
 		return -errno;
 
@@ -181,21 +592,30 @@ int watch_modify(int fd, uint32_t events, bool force)
 	return 0;
 }
 
-int watch_clear(int fd)
+int watch_clear(struct l_main_loop *loop, int fd)
 {
 	struct watch_data *data;
 
 	if (unlikely(fd < 0))
 		return -EINVAL;
 
-	if ((unsigned int) fd > watch_entries - 1)
-		return -ERANGE;
+	if (!loop)
+		return -EIO;
 
-	data = watch_list[fd];
+	data = watch_lookup(loop, fd);
 	if (!data)
 		return -ENXIO;
 
-	watch_list[fd] = NULL;
+	watch_unlink(loop, fd);
+
+	/*
+	 * A pending poll request holds a reference to the file, submit the
+	 * cancellation right away since the caller is likely to close it.
+	 */
+	if (loop->uring && data->seq) {
+		watch_uring_disarm(loop, data);
+		uring_submit(loop->uring);
+	}
 
 	if (data->destroy)
 		data->destroy(data->user_data);
@@ -203,22 +623,22 @@ int watch_clear(int fd)
 	if (data->flags & WATCH_FLAG_DISPATCHING)
 		data->flags |= WATCH_FLAG_DESTROYED;
 	else
-		l_free(data);
+		watch_free(data);
 
 	return 0;
 }
 
-int watch_remove(int fd, bool epoll_del)
+int watch_remove(struct l_main_loop *loop, int fd, bool epoll_del)
 {
-	int err = watch_clear(fd);
+	int err = watch_clear(loop, fd);
 
 	if (err < 0)
 		return err;
 
-	if (!epoll_del)
+	if (!epoll_del || loop->uring)
 		goto done;
 
-	err = epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	err = epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
 	if (err < 0)
 		return -errno;
 
@@ -226,49 +646,30 @@ done:
 	return err;
 }
 
-static bool idle_remove_by_id(void *data, void *user_data)
+static void idle_unlink(struct l_main_loop *loop, struct idle_data *idle)
 {
-	struct idle_data *idle = data;
-	int id = L_PTR_TO_INT(user_data);
-
-	if (idle->id != id)
-		return false;
-
-	if (idle->destroy)
-		idle->destroy(idle->user_data);
-
-	if (idle->flags & IDLE_FLAG_DISPATCHING) {
-		idle->flags |= IDLE_FLAG_DESTROYED;
-		return false;
-	}
-
-	l_free(idle);
-
-	return true;
-}
-
-static bool idle_prune(void *data, void *user_data)
-{
-	struct idle_data *idle = data;
-
-	if ((idle->flags & IDLE_FLAG_DESTROYED) == 0)
-		return false;
-
-	l_free(idle);
+	if (idle->prev)
+		idle->prev->next = idle->next;
+	else
+		loop->idle_head = idle->next;
 
-	return true;
+	if (idle->next)
+		idle->next->prev = idle->prev;
+	else
+		loop->idle_tail = idle->prev;
 }
 
-int idle_add(idle_event_cb_t callback, void *user_data, uint32_t flags,
-		idle_destroy_cb_t destroy)
+struct idle_data *idle_add(struct l_main_loop *loop, idle_event_cb_t callback,
+				void *user_data, uint32_t flags,
+				idle_destroy_cb_t destroy)
 {
 	struct idle_data *data;
 
 	if (unlikely(!callback))
-		return -EINVAL;
+		return NULL;
 
-	if (epoll_fd < 0)
-		return -EIO;
+	if (!loop)
+		return NULL;
 
 	data = l_new(struct idle_data, 1);
 
@@ -277,23 +678,38 @@ int idle_add(idle_event_cb_t callback, void *user_data, uint32_t flags,
 	data->user_data = user_data;
 	data->flags = flags;
 
-	if (!l_queue_push_tail(idle_list, data)) {
-		l_free(data);
-		return -ENOMEM;
-	}
+	data->prev = loop->idle_tail;
+	if (loop->idle_tail)
+		loop->idle_tail->next = data;
+	else
+		loop->idle_head = data;
 
-	data->id = idle_id++;
+	loop->idle_tail = data;
 
-	if (idle_id == INT_MAX)
-		idle_id = 0;
+	data->id = loop->idle_id++;
 
-	return data->id;
+	if (loop->idle_id == INT_MAX)
+		loop->idle_id = 0;
+
+	return data;
 }
 
-void idle_remove(int id)
+void idle_remove(struct l_main_loop *loop, struct idle_data *idle)
 {
-	l_queue_foreach_remove(idle_list, idle_remove_by_id,
-					L_INT_TO_PTR(id));
+	if (!loop || !idle)
+		return;
+
+	if (idle->destroy)
+		idle->destroy(idle->user_data);
+
+	/* Freed by idle_dispatch once the callback returns */
+	if (idle->flags & IDLE_FLAG_DISPATCHING) {
+		idle->flags |= IDLE_FLAG_DESTROYED;
+		return;
+	}
+
+	idle_unlink(loop, idle);
+	l_free(idle);
 }
 
 static void idle_destroy(void *data)
@@ -310,26 +726,47 @@ static void idle_destroy(void *data)
 	l_free(idle);
 }
 
-static void idle_dispatch(void *data, void *user_data)
+/*
+ * Idles added by a callback are appended and dispatched in the same pass.
+ * An idle can only be freed from under us while it is not dispatching, so
+ * the next pointer is only looked up after its callback has returned.
+ */
+static void idle_dispatch(struct l_main_loop *loop)
 {
-	struct idle_data *idle = data;
+	struct idle_data *idle = loop->idle_head;
+	struct idle_data *next;
 
-	if (!idle->callback)
-		return;
+	while (idle) {
+		idle->flags |= IDLE_FLAG_DISPATCHING;
+		idle->callback(idle->user_data);
+		idle->flags &= ~IDLE_FLAG_DISPATCHING;
+
+		next = idle->next;
+
+		if (idle->flags & IDLE_FLAG_DESTROYED) {
+			idle_unlink(loop, idle);
+			l_free(idle);
+		}
+
+		idle = next;
+	}
+}
 
-	idle->flags |= IDLE_FLAG_DISPATCHING;
-	idle->callback(idle->user_data);
-	idle->flags &= ~IDLE_FLAG_DISPATCHING;
+static void epoll_events_resize(struct l_main_loop *loop, unsigned int size)
+{
+	loop->events = l_realloc(loop->events,
+					size * sizeof(struct epoll_event));
+	loop->events_size = size;
 }
 
-static int sd_notify(const char *state)
+static int sd_notify(struct l_main_loop *loop, const char *state)
 {
 	int err;
 
-	if (notify_fd <= 0)
+	if (loop->notify_fd <= 0)
 		return -ENOTCONN;
 
-	err = send(notify_fd, state, strlen(state), MSG_NOSIGNAL);
+	err = send(loop->notify_fd, state, strlen(state), MSG_NOSIGNAL);
 	if (err < 0)
 		return -errno;
 
@@ -338,14 +775,28 @@ static int sd_notify(const char *state)
 
 static void watchdog_callback(struct l_timeout *timeout, void *user_data)
 {
+	struct l_main_loop *loop = current_loop;
+	struct l_main_stats *stats = loop->stats;
 	int msec = L_PTR_TO_INT(user_data);
-
-	sd_notify("WATCHDOG=1");
+	char state[256];
+
+	if (stats && loop->stats_notify) {
+		snprintf(state, sizeof(state), "WATCHDOG=1\nSTATUS="
+				"wakeups=%" PRIu64 " events=%" PRIu64
+				" max_events=%" PRIu64
+				" idle_time=%" PRIu64 "us"
+				" longest_stall=%" PRIu64 "us fd=%d",
+				stats->wakeups, stats->events,
+				stats->max_events, stats->idle_time,
+				stats->longest_stall, stats->longest_stall_fd);
+		sd_notify(loop, state);
+	} else
+		sd_notify(loop, "WATCHDOG=1");
 
 	l_timeout_modify_ms(timeout, msec);
 }
 
-static void create_sd_notify_socket(void)
+static void create_sd_notify_socket(struct l_main_loop *loop)
 {
 	const char *sock;
 	struct sockaddr_un addr;
@@ -361,9 +812,9 @@ static void create_sd_notify_socket(void)
 	if (sock[0] != '@' && sock[0] != '/')
 		return;
 
-	notify_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
-	if (notify_fd < 0) {
-		notify_fd = 0;
+	loop->notify_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (loop->notify_fd < 0) {
+		loop->notify_fd = 0;
 		return;
 	}
 
@@ -374,9 +825,10 @@ static void create_sd_notify_socket(void)
 	if (addr.sun_path[0] == '@')
 		addr.sun_path[0] = '\0';
 
-	if (bind(notify_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
-		close(notify_fd);
-		notify_fd = 0;
+	if (bind(loop->notify_fd, (struct sockaddr *) &addr,
+						sizeof(addr)) < 0) {
+		close(loop->notify_fd);
+		loop->notify_fd = 0;
 		return;
 	}
 
@@ -390,35 +842,62 @@ static void create_sd_notify_socket(void)
 
 	msec /= WATCHDOG_TRIGGER_FREQ;
 
-	watchdog = l_timeout_create_ms(msec, watchdog_callback,
-					L_INT_TO_PTR(msec), NULL);
+	loop->watchdog = l_timeout_create_ms(msec, watchdog_callback,
+						L_INT_TO_PTR(msec), NULL);
 }
 
 /**
  * l_main_init:
  *
- * Initialize the main loop. This must be called before l_main_run()
- * and any other function that directly or indirectly sets up an idle
- * or watch. A safe rule-of-thumb is to call it before any function
- * prefixed with "l_".
+ * Initialize the main loop of the calling thread. This must be called
+ * before l_main_run() and any other function that directly or indirectly
+ * sets up an idle or watch. A safe rule-of-thumb is to call it before any
+ * function prefixed with "l_".
+ *
+ * Every thread can have its own independent main loop.  Objects created by
+ * a thread are attached to the main loop of that thread and must only be
+ * used from it.
  *
  * Returns: true if initialization was successful, false otherwise.
  **/
 LIB_EXPORT bool l_main_init(void)
 {
-	if (unlikely(epoll_running))
-		return false;
+	struct l_main_loop *loop;
+
+	if (current_loop)
+		return !current_loop->running;
 
-	if (!create_epoll())
+	loop = create_loop();
+	if (!loop)
 		return false;
 
-	create_sd_notify_socket();
+	current_loop = loop;
+
+	create_sd_notify_socket(loop);
 
-	epoll_terminate = false;
+	loop->terminate = false;
 
 	return true;
 }
 
+/**
+ * l_main_get_loop:
+ *
+ * Returns the main loop of the calling thread, as set up by l_main_init().
+ *
+ * Returns: The #l_main_loop of the calling thread or NULL if it has not
+ * been initialized.
+ **/
+LIB_EXPORT struct l_main_loop *l_main_get_loop(void)
+{
+	return current_loop;
+}
+
+static int main_prepare(struct l_main_loop *loop)
+{
+	return loop->idle_head ? 0 : -1;
+}
+
 /**
  * l_main_prepare:
  *
@@ -430,21 +909,27 @@ LIB_EXPORT bool l_main_init(void)
  */
 LIB_EXPORT int l_main_prepare(void)
 {
-	return l_queue_isempty(idle_list) ? -1 : 0;
+	if (unlikely(!current_loop))
+		return -1;
+
+	/*
+	 * When the loop is polled from outside, poll requests queued since
+	 * the last iteration have to reach the kernel before it goes to sleep
+	 */
+	if (current_loop->uring)
+		uring_submit(current_loop->uring);
+
+	return main_prepare(current_loop);
 }
 
-/**
- * l_main_iterate:
- *
- * Run one iteration of the main event loop
- */
-LIB_EXPORT void l_main_iterate(int timeout)
+static int epoll_dispatch(struct l_main_loop *loop, int timeout)
 {
-	struct epoll_event events[MAX_EPOLL_EVENTS];
+	struct epoll_event *events = loop->events;
 	struct watch_data *data;
 	int n, nfds;
 
-	nfds = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, timeout);
+	nfds = epoll_wait(loop->epoll_fd, events, loop->events_size, timeout);
+	_time_cache_refresh();
 
 	for (n = 0; n < nfds; n++) {
 		data = events[n].data.ptr;
@@ -458,21 +943,217 @@ LIB_EXPORT void l_main_iterate(int timeout)
 		if (data->flags & WATCH_FLAG_DESTROYED)
 			continue;
 
-		data->callback(data->fd, events[n].events,
-							data->user_data);
+		watch_dispatch(loop, data, events[n].events);
 	}
 
 	for (n = 0; n < nfds; n++) {
 		data = events[n].data.ptr;
 
 		if (data->flags & WATCH_FLAG_DESTROYED)
-			l_free(data);
+			watch_free(data);
 		else
 			data->flags = 0;
 	}
 
-	l_queue_foreach(idle_list, idle_dispatch, NULL);
-	l_queue_foreach_remove(idle_list, idle_prune, NULL);
+	return nfds;
+}
+
+/*
+ * Completions are looked up by descriptor and sequence number as they are
+ * consumed, so watches removed by an earlier callback are never touched.
+ */
+static int uring_dispatch(struct l_main_loop *loop, int timeout)
+{
+	struct watch_data *data;
+	uint64_t tag;
+	int32_t res;
+	bool more;
+	unsigned int fd;
+	int n = 0;
+
+	if (uring_wait(loop->uring, timeout) < 0)
+		return -1;
+
+	_time_cache_refresh();
+
+	while ((unsigned int) n < loop->events_size &&
+			uring_next_cqe(loop->uring, &tag, &res, &more)) {
+		/* Completion of a cancellation */
+		if (!(tag >> 32))
+			continue;
+
+		fd = (uint32_t) tag;
+		data = watch_lookup(loop, fd);
+		if (!data || data->seq != tag >> 32)
+			continue;
+
+		if (!more)
+			data->seq = 0;
+
+		if (res == -ECANCELED)
+			goto rearm;
+
+		n += 1;
+
+		data->flags |= WATCH_FLAG_DISPATCHING;
+		watch_dispatch(loop, data, res < 0 ? EPOLLERR : (uint32_t) res);
+		data->flags &= ~WATCH_FLAG_DISPATCHING;
+
+		if (data->flags & WATCH_FLAG_DESTROYED) {
+			watch_free(data);
+			continue;
+		}
+
+rearm:
+		if (!data->seq)
+			watch_uring_arm(loop, data);
+	}
+
+	return n;
+}
+
+static void main_dispatch_events(struct l_main_loop *loop, int timeout)
+{
+	int nfds;
+
+	/* Apply any change made by l_main_set_max_events */
+	if (loop->events_size > epoll_max_events ||
+			(!epoll_adaptive &&
+				loop->events_size != epoll_max_events))
+		epoll_events_resize(loop, epoll_max_events);
+
+	if (loop->uring)
+		nfds = uring_dispatch(loop, timeout);
+	else
+		nfds = epoll_dispatch(loop, timeout);
+
+	PROBE(main_wakeup, timeout, nfds);
+
+	if (loop->stats && nfds >= 0) {
+		loop->stats->wakeups += 1;
+		loop->stats->events += nfds;
+		loop->stats->events_histogram[stats_bucket(nfds)] += 1;
+
+		if ((uint64_t) nfds > loop->stats->max_events)
+			loop->stats->max_events = nfds;
+	}
+
+	/* The event array is only resized when it is not being walked */
+	if (nfds == (int) loop->events_size) {
+		loop->saturated += 1;
+
+		if (epoll_adaptive && loop->events_size < epoll_max_events)
+			epoll_events_resize(loop,
+					minsize(loop->events_size * 2ULL,
+							epoll_max_events));
+	}
+}
+
+static void main_dispatch_idles(struct l_main_loop *loop)
+{
+	uint64_t start;
+	uint64_t duration;
+
+	if (!loop->stats || !loop->idle_head)
+		idle_dispatch(loop);
+	else {
+		start = l_time_now();
+		idle_dispatch(loop);
+		duration = l_time_now() - start;
+
+		if (loop->stats) {
+			loop->stats->idle_dispatches += 1;
+			loop->stats->idle_time += duration;
+			stats_record_stall(loop->stats, duration, -1);
+		}
+	}
+
+	/* This is the last step of every iteration */
+	_time_cache_clear();
+}
+
+/**
+ * l_main_iterate:
+ *
+ * Run one iteration of the main event loop
+ */
+LIB_EXPORT void l_main_iterate(int timeout)
+{
+	struct l_main_loop *loop = current_loop;
+
+	if (unlikely(!loop))
+		return;
+
+	main_dispatch_events(loop, timeout);
+	main_dispatch_idles(loop);
+}
+
+/**
+ * l_main_get_next_deadline:
+ * @out_deadline: Set to the time the loop next needs to run
+ *
+ * For use when the main loop is driven by another event loop.  Reports
+ * the latest time, on the l_time_now() clock, by which
+ * l_main_dispatch_ready() should be called even if the descriptor
+ * returned by l_main_get_epoll_fd() does not become readable.  This lets
+ * the host compute its own poll timeout without waking up early or
+ * waiting for the timeout to make it through the nested descriptor.  The
+ * deadline is 0 when idle work is pending.  Like l_main_prepare(), this
+ * must be called before the host goes to sleep.
+ *
+ * Returns: #true if @out_deadline was set, #false if the loop only has to
+ * run once its descriptor becomes readable.
+ **/
+LIB_EXPORT bool l_main_get_next_deadline(uint64_t *out_deadline)
+{
+	struct l_main_loop *loop = current_loop;
+
+	if (unlikely(!loop || !out_deadline))
+		return false;
+
+	if (loop->uring)
+		uring_submit(loop->uring);
+
+	if (loop->idle_head) {
+		*out_deadline = 0;
+		return true;
+	}
+
+	if (!loop->timeouts)
+		return false;
+
+	return timeout_queue_next_deadline(loop->timeouts, out_deadline);
+}
+
+/**
+ * l_main_dispatch_ready:
+ * @fd_ready: Whether the host saw the l_main_get_epoll_fd() descriptor
+ *	become readable
+ *
+ * For use when the main loop is driven by another event loop, instead of
+ * l_main_iterate(0).  Events are only collected from the kernel when the
+ * host reports the descriptor as readable, otherwise just the timeouts
+ * that are due and the pending idle work are dispatched, which takes no
+ * system calls at all.  With the io_uring backend, the completion for a
+ * timeout dispatched this way stays queued and makes the descriptor
+ * readable once more, collecting it then does no harm.
+ **/
+LIB_EXPORT void l_main_dispatch_ready(bool fd_ready)
+{
+	struct l_main_loop *loop = current_loop;
+
+	if (unlikely(!loop))
+		return;
+
+	if (fd_ready)
+		main_dispatch_events(loop, 0);
+	else
+		_time_cache_refresh();
+
+	if (loop->timeouts)
+		timeout_queue_dispatch_expired(loop->timeouts);
+
+	main_dispatch_idles(loop);
 }
 
 /**
@@ -489,32 +1170,33 @@ LIB_EXPORT void l_main_iterate(int timeout)
  **/
 LIB_EXPORT int l_main_run(void)
 {
+	struct l_main_loop *loop = current_loop;
 	int timeout;
 
 	/* Has l_main_init() been called? */
-	if (unlikely(epoll_fd < 0))
+	if (unlikely(!loop))
 		return EXIT_FAILURE;
 
-	if (unlikely(epoll_running))
+	if (unlikely(loop->running))
 		return EXIT_FAILURE;
 
-	epoll_running = true;
+	loop->running = true;
 
 	for (;;) {
-		if (epoll_terminate)
+		if (loop->terminate)
 			break;
 
-		timeout = l_main_prepare();
+		timeout = main_prepare(loop);
 		l_main_iterate(timeout);
 	}
 
-	epoll_running = false;
+	loop->running = false;
 
-	if (notify_fd) {
-		close(notify_fd);
-		notify_fd = 0;
-		l_timeout_remove(watchdog);
-		watchdog = NULL;
+	if (loop->notify_fd) {
+		close(loop->notify_fd);
+		loop->notify_fd = 0;
+		l_timeout_remove(loop->watchdog);
+		loop->watchdog = NULL;
 	}
 
 	return EXIT_SUCCESS;
@@ -528,39 +1210,64 @@ LIB_EXPORT int l_main_run(void)
  **/
 LIB_EXPORT bool l_main_exit(void)
 {
+	struct l_main_loop *loop = current_loop;
 	unsigned int i;
 
-	if (epoll_running) {
+	if (unlikely(!loop))
+		return false;
+
+	if (loop->running) {
 		l_error("Cleanup attempted on running main loop");
 		return false;
 	}
 
-	for (i = 0; i < watch_entries; i++) {
-		struct watch_data *data = watch_list[i];
+	work_drain(loop);
+
+	for (i = 0; i < loop->watch_pages_size * WATCH_PAGE_SIZE; i++) {
+		struct watch_data *data = watch_lookup(loop, i);
 
 		if (!data)
 			continue;
 
-		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, data->fd, NULL);
+		watch_unlink(loop, i);
+
+		if (!loop->uring)
+			epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, data->fd,
+									NULL);
 
 		if (data->destroy)
 			data->destroy(data->user_data);
 		else
 			l_error("Dangling file descriptor %d found", data->fd);
 
-		l_free(data);
+		watch_free(data);
+	}
+
+	loop->watch_pages_size = 0;
+
+	l_free(loop->watch_pages);
+	loop->watch_pages = NULL;
+
+	while (loop->idle_head) {
+		struct idle_data *idle = loop->idle_head;
+
+		loop->idle_head = idle->next;
+		idle_destroy(idle);
 	}
 
-	watch_entries = 0;
+	loop->idle_tail = NULL;
 
-	free(watch_list);
-	watch_list = NULL;
+	l_free(loop->events);
+	l_free(loop->stats);
 
-	l_queue_destroy(idle_list, idle_destroy);
-	idle_list = NULL;
+	/* Tearing down the ring cancels any request still in flight */
+	if (loop->uring)
+		uring_free(loop->uring);
+	else
+		close(loop->epoll_fd);
 
-	close(epoll_fd);
-	epoll_fd = -1;
+	l_free(loop);
+	current_loop = NULL;
 
 	return true;
 }
@@ -574,10 +1281,10 @@ LIB_EXPORT bool l_main_exit(void)
  **/
 LIB_EXPORT bool l_main_quit(void)
 {
-	if (unlikely(!epoll_running))
+	if (unlikely(!current_loop || !current_loop->running))
 		return false;
 
-	epoll_terminate = true;
+	current_loop->terminate = true;
 
 	return true;
 }
@@ -637,15 +1344,236 @@ LIB_EXPORT int l_main_run_with_signal(l_main_signal_cb_t callback,
 	return result;
 }
 
+/**
+ * l_main_invoke:
+ * @loop: main loop to run @callback on
+ * @callback: function to call
+ * @user_data: user data provided to @callback
+ * @destroy: destroy function for @user_data
+ *
+ * Schedules @callback to be called from within @loop.  This function may be
+ * called from any thread, making it possible for worker threads to hand
+ * results to the thread running @loop.  Callbacks are dispatched in
+ * submission order, batched together in a single main loop iteration.
+ *
+ * The caller must ensure that @loop is not destroyed with l_main_exit()
+ * while submissions are still being made.  Submissions pending when @loop
+ * is destroyed are discarded, only their @destroy function is called.
+ *
+ * Returns: #true if @callback has been scheduled, #false otherwise.
+ **/
+LIB_EXPORT bool l_main_invoke(struct l_main_loop *loop,
+				l_main_invoke_cb_t callback,
+				void *user_data, l_main_destroy_cb_t destroy)
+{
+	struct invoke_data *data;
+	struct invoke_data *head;
+	uint64_t one = 1;
+
+	if (unlikely(!loop || !callback))
+		return false;
+
+	data = l_new(struct invoke_data, 1);
+	data->callback = callback;
+	data->destroy = destroy;
+	data->user_data = user_data;
+	head = __atomic_load_n(&loop->invoke_list, __ATOMIC_RELAXED);
+
+	do {
+		data->next = head;
+	} while (!__atomic_compare_exchange_n(&loop->invoke_list, &head,
+						data, true, __ATOMIC_RELEASE,
+						__ATOMIC_RELAXED));
+
+	/*
+	 * Only the transition from empty to non-empty wakes the loop.  @data
+	 * may already have been run and freed by the loop thread, so the
+	 * decision is based on the head the CAS succeeded against.
+	 */
+	if (!head)
+		L_WARN_ON(write(loop->invoke_fd, &one, sizeof(one)) < 0);
+
+	return true;
+}
+
+/**
+ * l_main_set_max_events:
+ * @max_events: maximum number of events to retrieve per iteration
+ * @adaptive: whether the number of events should grow on demand
+ *
+ * Sets the maximum number of events retrieved from epoll in a single
+ * iteration of the main loop.  If @adaptive is false, exactly @max_events
+ * are requested on every iteration.  Otherwise the event array starts out
+ * small and doubles whenever an iteration fills it up completely, until
+ * @max_events is reached.
+ *
+ * The setting applies to the main loop of the calling thread.  It may be
+ * set before l_main_init() and is kept across l_main_exit().  Changes made
+ * while the main loop is running take effect on the next iteration.
+ *
+ * Returns: #true if the setting was applied, #false if @max_events is
+ * out of range.
+ **/
+LIB_EXPORT bool l_main_set_max_events(unsigned int max_events, bool adaptive)
+{
+	if (unlikely(!max_events || max_events > EPOLL_EVENTS_LIMIT))
+		return false;
+
+	epoll_max_events = max_events;
+	epoll_adaptive = adaptive;
+
+	return true;
+}
+
+/**
+ * l_main_get_saturated_iterations:
+ *
+ * Returns the number of iterations of the calling thread's main loop since
+ * l_main_init() in which epoll returned as many events as the event array
+ * could hold.  A steadily increasing value indicates that more file
+ * descriptors were ready than could be dispatched in one iteration, see
+ * l_main_set_max_events().
+ *
+ * Returns: number of saturated iterations
+ **/
+LIB_EXPORT uint64_t l_main_get_saturated_iterations(void)
+{
+	if (unlikely(!current_loop))
+		return 0;
+
+	return current_loop->saturated;
+}
+
+/**
+ * l_main_set_stats_enabled:
+ * @enabled: whether to collect statistics
+ * @notify: whether to report statistics along with watchdog notifications
+ *
+ * Enables or disables collection of dispatch statistics for the main loop
+ * of the calling thread.  When enabled, every watch callback and idle
+ * dispatch pass is timed, adding two clock reads to each.  Enabling resets
+ * the statistics.
+ *
+ * If @notify is true and the process is run under a systemd watchdog, a
+ * summary of the statistics is sent as STATUS= with every watchdog
+ * notification.
+ *
+ * Returns: #true on success, #false if the main loop is not initialized.
+ **/
+LIB_EXPORT bool l_main_set_stats_enabled(bool enabled, bool notify)
+{
+	struct l_main_loop *loop = current_loop;
+
+	if (unlikely(!loop))
+		return false;
+
+	loop->stats_notify = enabled && notify;
+
+	if (!enabled) {
+		l_free(l_steal_ptr(loop->stats));
+		return true;
+	}
+
+	if (!loop->stats)
+		loop->stats = l_new(struct l_main_stats, 1);
+
+	l_main_reset_stats();
+
+	return true;
+}
+
+/**
+ * l_main_get_stats:
+ * @stats: structure to fill in with the current statistics
+ *
+ * Obtains the dispatch statistics of the calling thread's main loop.
+ * Durations are given in microseconds.  Histogram bucket i counts values
+ * in the range [2^(i - 1), 2^i), bucket 0 counts zero values and the last
+ * bucket counts everything that does not fit in the other buckets.
+ *
+ * Returns: #true on success, #false if statistics are not enabled.
+ **/
+LIB_EXPORT bool l_main_get_stats(struct l_main_stats *stats)
+{
+	if (unlikely(!stats))
+		return false;
+
+	if (unlikely(!current_loop || !current_loop->stats))
+		return false;
+
+	memcpy(stats, current_loop->stats, sizeof(*stats));
+
+	return true;
+}
+
+static void reset_watch_stats(struct watch_data *data)
+{
+	if (data && data->stats)
+		memset(data->stats, 0, sizeof(*data->stats));
+}
+
+/**
+ * l_main_reset_stats:
+ *
+ * Resets the dispatch statistics of the calling thread's main loop,
+ * including the per-watch statistics.
+ **/
+LIB_EXPORT void l_main_reset_stats(void)
+{
+	struct l_main_loop *loop = current_loop;
+	unsigned int i;
+
+	if (unlikely(!loop || !loop->stats))
+		return;
+
+	memset(loop->stats, 0, sizeof(*loop->stats));
+	loop->stats->longest_stall_fd = -1;
+
+	for (i = 0; i < loop->watch_pages_size * WATCH_PAGE_SIZE; i++)
+		reset_watch_stats(watch_lookup(loop, i));
+}
+
+bool watch_get_stats(struct l_main_loop *loop, int fd,
+				struct l_main_watch_stats *stats)
+{
+	struct watch_data *data;
+
+	if (unlikely(fd < 0))
+		return false;
+
+	if (!loop || !loop->stats)
+		return false;
+
+	data = watch_lookup(loop, fd);
+	if (!data)
+		return false;
+
+	if (data->stats)
+		memcpy(stats, data->stats, sizeof(*stats));
+	else
+		memset(stats, 0, sizeof(*stats));
+
+	return true;
+}
+
 /**
  * l_main_get_epoll_fd:
  *
  * Can be used to obtain the epoll file descriptor in order to integrate
- * the ell main event loop with other event loops.
+ * the ell main event loop with other event loops.  When the loop runs on
+ * top of io_uring, the ring descriptor is returned instead.  Either becomes
+ * readable when l_main_iterate() has events to process, provided that
+ * l_main_prepare() was called before polling it.
  *
  * Returns: epoll file descriptor
  **/
 LIB_EXPORT int l_main_get_epoll_fd(void)
 {
-	return epoll_fd;
+	if (unlikely(!current_loop))
+		return -1;
+
+	if (current_loop->uring)
+		return uring_get_fd(current_loop->uring);
+
+	return current_loop->epoll_fd;
 }
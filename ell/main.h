@@ -15,7 +15,31 @@
 extern "C" {
 #endif
 
+struct l_main_loop;
+
+#define L_MAIN_HISTOGRAM_SIZE 20
+
+struct l_main_stats {
+	uint64_t wakeups;
+	uint64_t events;
+	uint64_t max_events;
+	uint64_t events_histogram[L_MAIN_HISTOGRAM_SIZE];
+	uint64_t callback_histogram[L_MAIN_HISTOGRAM_SIZE];
+	uint64_t idle_dispatches;
+	uint64_t idle_time;
+	uint64_t longest_stall;
+	int longest_stall_fd;
+};
+
+struct l_main_watch_stats {
+	uint64_t dispatches;
+	uint64_t total_time;
+	uint64_t longest_time;
+	uint64_t histogram[L_MAIN_HISTOGRAM_SIZE];
+};
+
 bool l_main_init(void);
+struct l_main_loop *l_main_get_loop(void);
 int l_main_prepare(void);
 void l_main_iterate(int timeout);
 int l_main_run(void);
@@ -28,6 +52,21 @@ typedef void (*l_main_signal_cb_t) (uint32_t signo, void *user_data);
 int l_main_run_with_signal(l_main_signal_cb_t callback, void *user_data);
 
 int l_main_get_epoll_fd(void);
+bool l_main_get_next_deadline(uint64_t *out_deadline);
+void l_main_dispatch_ready(bool fd_ready);
+
+typedef void (*l_main_invoke_cb_t) (void *user_data);
+typedef void (*l_main_destroy_cb_t) (void *user_data);
+
+bool l_main_invoke(struct l_main_loop *loop, l_main_invoke_cb_t callback,
+				void *user_data, l_main_destroy_cb_t destroy);
+
+bool l_main_set_max_events(unsigned int max_events, bool adaptive);
+uint64_t l_main_get_saturated_iterations(void);
+
+bool l_main_set_stats_enabled(bool enabled, bool notify);
+bool l_main_get_stats(struct l_main_stats *stats);
+void l_main_reset_stats(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,28 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+extern bool memory_accounting;
+
+static inline bool memory_accounting_enabled(void)
+{
+	return __atomic_load_n(&memory_accounting, __ATOMIC_RELAXED);
+}
+
+/* A negative tag means the one currently set for the thread */
+void memory_account_add(void *ptr, size_t size, int tag);
+int memory_account_take(void *ptr);
+
+static inline void memory_tag_restore(enum l_memory_tag *saved)
+{
+	l_memory_tag_pop(*saved);
+}
+
+/* Attributes the allocations until the end of the scope to @tag */
+#define MEMORY_TAG_SCOPE(tag)						\
+	enum l_memory_tag __memory_tag_saved				\
+		__attribute__((cleanup(memory_tag_restore), unused)) =	\
+						l_memory_tag_push(tag)
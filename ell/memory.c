@@ -0,0 +1,302 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "util.h"
+#include "useful.h"
+#include "private.h"
+#include "memory-private.h"
+
+/*
+ * Allocation accounting.  Once enabled, every block handed out by
+ * l_malloc() and friends is recorded in an open addressing table along
+ * with its size and the tag that was current for the allocating thread.
+ * The table itself is allocated with plain calloc() so that it does not
+ * account for itself.  Blocks allocated before accounting was enabled
+ * are not in the table and are ignored when freed.
+ */
+
+#define MEMORY_TAG_COUNT	(L_MEMORY_TAG_SETTINGS + 1)
+#define RECORDS_MIN_SIZE	1024
+
+struct alloc_record {
+	void *ptr;
+	size_t size;
+	unsigned int tag;
+};
+
+bool memory_accounting;
+
+static __thread enum l_memory_tag current_tag;
+
+static pthread_mutex_t records_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct alloc_record *records;
+static size_t records_size;
+static size_t records_used;
+static struct l_memory_stats stats[MEMORY_TAG_COUNT];
+
+static const char *tag_names[MEMORY_TAG_COUNT] = {
+	[L_MEMORY_TAG_OTHER] = "other",
+	[L_MEMORY_TAG_DBUS] = "dbus",
+	[L_MEMORY_TAG_NETLINK] = "netlink",
+	[L_MEMORY_TAG_TLS] = "tls",
+	[L_MEMORY_TAG_DHCP] = "dhcp",
+	[L_MEMORY_TAG_SETTINGS] = "settings",
+};
+
+static inline size_t record_home(const void *ptr, size_t size)
+{
+	uint64_t hash = (uintptr_t) ptr * 0x9e3779b97f4a7c15ull;
+
+	return (hash >> 32) & (size - 1);
+}
+
+static void records_move(struct alloc_record *table, size_t size,
+				const struct alloc_record *record)
+{
+	size_t i = record_home(record->ptr, size);
+
+	while (table[i].ptr)
+		i = (i + 1) & (size - 1);
+
+	table[i] = *record;
+}
+
+static bool records_reserve(void)
+{
+	struct alloc_record *table;
+	size_t size;
+	size_t i;
+
+	if (records_used < records_size / 2)
+		return true;
+
+	size = records_size ? records_size * 2 : RECORDS_MIN_SIZE;
+	table = calloc(size, sizeof(struct alloc_record));
+	if (!table)
+		return false;
+
+	for (i = 0; i < records_size; i++)
+		if (records[i].ptr)
+			records_move(table, size, &records[i]);
+
+	free(records);
+	records = table;
+	records_size = size;
+
+	return true;
+}
+
+/* Linear probing deletion, moves back the entries that probed past @i */
+static void records_delete(size_t i)
+{
+	size_t mask = records_size - 1;
+	size_t j = i;
+
+	records[i].ptr = NULL;
+
+	while (true) {
+		size_t home;
+
+		j = (j + 1) & mask;
+
+		if (!records[j].ptr)
+			break;
+
+		home = record_home(records[j].ptr, records_size);
+
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+
+		records[i] = records[j];
+		records[j].ptr = NULL;
+		i = j;
+	}
+
+	records_used--;
+}
+
+void memory_account_add(void *ptr, size_t size, int tag)
+{
+	struct alloc_record record = {
+		.ptr = ptr,
+		.size = size,
+		.tag = tag < 0 ? current_tag : (unsigned int) tag,
+	};
+	struct l_memory_stats *s = &stats[record.tag];
+	size_t i;
+
+	pthread_mutex_lock(&records_lock);
+
+	/* Without room to record the block it is simply not accounted */
+	if (!records_reserve())
+		goto done;
+
+	for (i = record_home(ptr, records_size); records[i].ptr;
+					i = (i + 1) & (records_size - 1))
+		if (records[i].ptr == ptr)
+			break;
+
+	/*
+	 * A stale record means the block was released with plain free(),
+	 * drop it in favour of the new one.
+	 */
+	if (records[i].ptr) {
+		stats[records[i].tag].live_bytes -= records[i].size;
+		stats[records[i].tag].live_allocs--;
+	} else
+		records_used++;
+
+	records[i] = record;
+
+	s->live_bytes += size;
+	s->live_allocs++;
+	s->total_allocs++;
+
+	if (s->live_bytes > s->peak_bytes)
+		s->peak_bytes = s->live_bytes;
+
+done:
+	pthread_mutex_unlock(&records_lock);
+}
+
+int memory_account_take(void *ptr)
+{
+	int tag = -1;
+	size_t i;
+
+	pthread_mutex_lock(&records_lock);
+
+	if (!records)
+		goto done;
+
+	for (i = record_home(ptr, records_size); records[i].ptr;
+					i = (i + 1) & (records_size - 1)) {
+		struct l_memory_stats *s;
+
+		if (records[i].ptr != ptr)
+			continue;
+
+		tag = records[i].tag;
+		s = &stats[tag];
+		s->live_bytes -= records[i].size;
+		s->live_allocs--;
+		records_delete(i);
+		break;
+	}
+
+done:
+	pthread_mutex_unlock(&records_lock);
+
+	return tag;
+}
+
+/**
+ * l_memory_accounting_enable:
+ *
+ * Start accounting the memory allocated with l_malloc(), l_realloc(),
+ * l_strdup() and friends, per #l_memory_tag.  Memory allocated before
+ * this call is not accounted.  Accounting can't be disabled again, it is
+ * meant to be turned on early, e.g. based on a command line option, by
+ * long running daemons that need to track down leaks or bloat.
+ *
+ * Each allocation is recorded, which makes allocating and freeing memory
+ * more expensive while accounting is enabled.
+ **/
+LIB_EXPORT void l_memory_accounting_enable(void)
+{
+	__atomic_store_n(&memory_accounting, true, __ATOMIC_RELAXED);
+}
+
+/**
+ * l_memory_accounting_is_enabled:
+ *
+ * Returns: #true if l_memory_accounting_enable() has been called
+ **/
+LIB_EXPORT bool l_memory_accounting_is_enabled(void)
+{
+	return memory_accounting_enabled();
+}
+
+/**
+ * l_memory_tag_push:
+ * @tag: tag to attribute allocations to
+ *
+ * Attribute the allocations made by the calling thread to @tag, until
+ * the matching l_memory_tag_pop().  Calls can be nested, ell tags the
+ * entry points of its own subsystems, so memory allocated from callbacks
+ * of, e.g., a D-Bus method handler is attributed to D-Bus unless the
+ * handler sets a tag of its own.
+ *
+ * Returns: the previous tag, to be given to l_memory_tag_pop()
+ **/
+LIB_EXPORT enum l_memory_tag l_memory_tag_push(enum l_memory_tag tag)
+{
+	enum l_memory_tag saved = current_tag;
+
+	if ((unsigned int) tag < MEMORY_TAG_COUNT)
+		current_tag = tag;
+
+	return saved;
+}
+
+/**
+ * l_memory_tag_pop:
+ * @saved: value returned by l_memory_tag_push()
+ *
+ * Restore the tag that was current before l_memory_tag_push().
+ **/
+LIB_EXPORT void l_memory_tag_pop(enum l_memory_tag saved)
+{
+	current_tag = saved;
+}
+
+/**
+ * l_memory_get_stats:
+ * @tag: tag to get the statistics for
+ * @out: filled in with the statistics
+ *
+ * Get the memory currently allocated under @tag, the most that ever was
+ * and the number of allocations made.  Everything is zero unless
+ * l_memory_accounting_enable() has been called.
+ *
+ * Returns: #false if @tag is not valid, #true otherwise
+ **/
+LIB_EXPORT bool l_memory_get_stats(enum l_memory_tag tag,
+					struct l_memory_stats *out)
+{
+	if (unlikely((unsigned int) tag >= MEMORY_TAG_COUNT || !out))
+		return false;
+
+	pthread_mutex_lock(&records_lock);
+	*out = stats[tag];
+	pthread_mutex_unlock(&records_lock);
+
+	return true;
+}
+
+/**
+ * l_memory_tag_to_string:
+ * @tag: memory tag
+ *
+ * Returns: a short name for @tag, suitable for logging, or #NULL if @tag
+ * is not valid
+ **/
+LIB_EXPORT const char *l_memory_tag_to_string(enum l_memory_tag tag)
+{
+	if ((unsigned int) tag >= MEMORY_TAG_COUNT)
+		return NULL;
+
+	return tag_names[tag];
+}
@@ -10,9 +10,219 @@
 #include <config.h>
 #endif
 
+#include "minheap.h"
+#include "private.h"
+#include "useful.h"
+
 /**
  * SECTION:minheap
  * @short_description: Minimum Heap Support
  *
  * Minimum Heap support
  */
+
+#define RADIXHEAP_BUCKETS	65
+#define RADIXHEAP_MIN_SIZE	16
+
+struct radixheap_entry {
+	uint64_t key;
+	void *data;
+};
+
+struct radixheap_bucket {
+	struct radixheap_entry *entries;
+	uint32_t used;
+	uint32_t capacity;
+};
+
+/*
+ * Entries are kept in unordered arrays, bucket 0 holding the keys equal to
+ * the last key taken out and bucket n those that first differ from it in
+ * bit n - 1.  Once bucket 0 is empty, the lowest non-empty bucket is spread
+ * over the lower ones around its minimum.  Entries only ever move to lower
+ * buckets, making pop O(log C) amortized for keys spanning C values.  The
+ * keys are stored next to the data, so that spreading a bucket is a linear
+ * pass over memory, and the bucket arrays are kept once grown.
+ */
+struct l_radixheap {
+	uint64_t last;
+	uint32_t used;
+	struct radixheap_bucket buckets[RADIXHEAP_BUCKETS];
+};
+
+static inline unsigned int radixheap_index(uint64_t last, uint64_t key)
+{
+	return key == last ? 0 : 64 - __builtin_clzll(key ^ last);
+}
+
+static void radixheap_append(struct radixheap_bucket *bucket,
+					uint64_t key, void *data)
+{
+	struct radixheap_entry *entry;
+
+	if (bucket->used == bucket->capacity) {
+		bucket->capacity = maxsize(bucket->capacity * 2,
+						RADIXHEAP_MIN_SIZE);
+		bucket->entries = l_realloc(bucket->entries,
+				bucket->capacity * sizeof(*bucket->entries));
+	}
+
+	entry = &bucket->entries[bucket->used++];
+	entry->key = key;
+	entry->data = data;
+}
+
+/**
+ * l_radixheap_new:
+ *
+ * Create a new radix heap, a priority queue for integer keys where the
+ * smallest key is taken out first and keys smaller than the last one
+ * taken out can't be added, e.g. timestamps of future events.  It needs
+ * no comparisons between entries and touches memory sequentially, which
+ * makes it faster than a binary heap for large sets of such keys.
+ *
+ * Returns: a newly allocated #l_radixheap object
+ **/
+LIB_EXPORT struct l_radixheap *l_radixheap_new(void)
+{
+	return l_new(struct l_radixheap, 1);
+}
+
+/**
+ * l_radixheap_free:
+ * @heap: radix heap
+ *
+ * Free @heap, the data of the entries still queued is not touched.
+ **/
+LIB_EXPORT void l_radixheap_free(struct l_radixheap *heap)
+{
+	unsigned int i;
+
+	if (unlikely(!heap))
+		return;
+
+	for (i = 0; i < RADIXHEAP_BUCKETS; i++)
+		l_free(heap->buckets[i].entries);
+
+	l_free(heap);
+}
+
+/**
+ * l_radixheap_push:
+ * @heap: radix heap
+ * @key: key of the entry
+ * @data: data of the entry
+ *
+ * Add an entry in O(1).
+ *
+ * Returns: #false if @key is smaller than the last key returned by
+ * l_radixheap_peek() or l_radixheap_pop()
+ **/
+LIB_EXPORT bool l_radixheap_push(struct l_radixheap *heap, uint64_t key,
+							void *data)
+{
+	if (unlikely(!heap))
+		return false;
+
+	if (key < heap->last)
+		return false;
+
+	radixheap_append(&heap->buckets[radixheap_index(heap->last, key)],
+								key, data);
+	heap->used += 1;
+
+	return true;
+}
+
+/**
+ * l_radixheap_peek:
+ * @heap: radix heap
+ * @key: set to the smallest key
+ * @data: set to the data of its entry
+ *
+ * The order of entries with equal keys is unspecified.
+ *
+ * Returns: #false if @heap is empty
+ **/
+LIB_EXPORT bool l_radixheap_peek(struct l_radixheap *heap, uint64_t *key,
+							void **data)
+{
+	struct radixheap_bucket *bucket;
+	struct radixheap_entry *entry;
+	uint64_t min;
+	uint32_t i;
+
+	if (unlikely(!heap) || !heap->used)
+		return false;
+
+	bucket = &heap->buckets[0];
+
+	if (!bucket->used) {
+		while (!(++bucket)->used)
+			;
+
+		min = bucket->entries[0].key;
+
+		for (i = 1; i < bucket->used; i++)
+			if (bucket->entries[i].key < min)
+				min = bucket->entries[i].key;
+
+		heap->last = min;
+
+		for (i = 0; i < bucket->used; i++) {
+			entry = &bucket->entries[i];
+			radixheap_append(&heap->buckets[radixheap_index(min,
+								entry->key)],
+						entry->key, entry->data);
+		}
+
+		bucket->used = 0;
+		bucket = &heap->buckets[0];
+	}
+
+	entry = &bucket->entries[bucket->used - 1];
+
+	if (key)
+		*key = entry->key;
+
+	if (data)
+		*data = entry->data;
+
+	return true;
+}
+
+/**
+ * l_radixheap_pop:
+ * @heap: radix heap
+ * @key: set to the smallest key
+ * @data: set to the data of its entry
+ *
+ * Take out the entry with the smallest key.
+ *
+ * Returns: #false if @heap is empty
+ **/
+LIB_EXPORT bool l_radixheap_pop(struct l_radixheap *heap, uint64_t *key,
+							void **data)
+{
+	if (!l_radixheap_peek(heap, key, data))
+		return false;
+
+	heap->buckets[0].used -= 1;
+	heap->used -= 1;
+
+	return true;
+}
+
+/**
+ * l_radixheap_length:
+ * @heap: radix heap
+ *
+ * Returns: the number of entries in @heap
+ **/
+LIB_EXPORT unsigned int l_radixheap_length(const struct l_radixheap *heap)
+{
+	if (unlikely(!heap))
+		return 0;
+
+	return heap->used;
+}
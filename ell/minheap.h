@@ -10,6 +10,8 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,11 +22,17 @@ extern "C" {
  * is declared static const and passed in to the individual operations
  * directly.  Using a const member inside l_minheap doesn't have the same
  * effect.
+ *
+ * @arity is the number of children per node, 0 meaning 2.  With 4 the
+ * heap is half as deep and the children of a node tend to share a cache
+ * line, which pays off with large heaps of small elements.  It is folded
+ * in at compile time the same way, so it must not change for a heap.
  */
 struct l_minheap_ops {
 	size_t elem_size;
 	bool (*less)(const void *lhs, const void *rhs);
 	void (*swap)(void *lhs, void *rhs);
+	unsigned int arity;
 };
 
 struct l_minheap {
@@ -33,23 +41,30 @@ struct l_minheap {
 	uint32_t capacity;
 };
 
+static inline __attribute__((always_inline))
+uint32_t __minheap_arity(const struct l_minheap_ops *ops)
+{
+	return ops->arity ? ops->arity : 2;
+}
+
 static inline __attribute__((always_inline))
 void __minheap_sift_down(void *data, uint32_t used, uint32_t pos,
 					const struct l_minheap_ops *ops)
 {
-	uint32_t left;
-	uint32_t right;
+	uint32_t arity = __minheap_arity(ops);
+	uint32_t first;
+	uint32_t last;
+	uint32_t child;
 	uint32_t smallest;
 
-	while ((left = pos * 2 + 1) < used) {
-		smallest = ops->less(data + left * ops->elem_size,
-				data + pos * ops->elem_size) ? left : pos;
+	while ((first = pos * arity + 1) < used) {
+		last = first + arity < used ? first + arity : used;
+		smallest = pos;
 
-		if ((right = pos * 2 + 2) < used) {
-			if (ops->less(data + right * ops->elem_size,
+		for (child = first; child < last; child++)
+			if (ops->less(data + child * ops->elem_size,
 					data + smallest * ops->elem_size))
-				smallest = right;
-		}
+				smallest = child;
 
 		if (smallest == pos)
 			break;
@@ -67,7 +82,7 @@ void __minheap_sift_up(void *data, uint32_t pos,
 	uint32_t parent;
 
 	while (pos) {
-		parent = (pos - 1) / 2;
+		parent = (pos - 1) / __minheap_arity(ops);
 
 		if (ops->less(data + parent * ops->elem_size,
 					data + pos * ops->elem_size))
@@ -83,7 +98,7 @@ static inline __attribute__((always_inline))
 void __minheap_sift_updown(void *data, uint32_t used, uint32_t pos,
 					const struct l_minheap_ops *ops)
 {
-	uint32_t parent = (pos - 1) / 2;
+	uint32_t parent = (pos - 1) / __minheap_arity(ops);
 
 	if (ops->less(data + pos * ops->elem_size,
 				data + parent * ops->elem_size)) {
@@ -103,7 +118,7 @@ void l_minheap_init(struct l_minheap *minheap, void *data,
 {
 	int i;
 
-	for (i = used >> 1; i >= 0; i--)
+	for (i = used / __minheap_arity(ops); i >= 0; i--)
 		__minheap_sift_down(data, used, i, ops);
 
 	minheap->data = data;
@@ -183,11 +198,56 @@ bool l_minheap_delete(struct l_minheap *minheap, uint32_t pos,
 	memcpy(minheap->data + pos * ops->elem_size,
 			minheap->data + minheap->used * ops->elem_size,
 			ops->elem_size);
-	__minheap_sift_down(minheap->data, minheap->used, pos, ops);
+
+	/* The element moved into pos may be smaller than its new parent */
+	if (pos)
+		__minheap_sift_updown(minheap->data, minheap->used, pos, ops);
+	else
+		__minheap_sift_down(minheap->data, minheap->used, pos, ops);
 
 	return true;
 }
 
+/*
+ * Defines name##_ops for a heap of @type elements ordered by their @key
+ * member, which must be comparable with <, with @heap_arity children per
+ * node.  The generated less and swap operations get inlined into the
+ * l_minheap functions given the resulting ops.
+ */
+#define L_MINHEAP_DEFINE_OPS(name, type, key, heap_arity)		\
+static inline bool name##_less(const void *lhs, const void *rhs)	\
+{									\
+	return ((const type *) lhs)->key < ((const type *) rhs)->key;	\
+}									\
+									\
+static inline void name##_swap(void *lhs, void *rhs)			\
+{									\
+	type tmp = *(type *) lhs;					\
+									\
+	*(type *) lhs = *(type *) rhs;					\
+	*(type *) rhs = tmp;						\
+}									\
+									\
+static const struct l_minheap_ops name##_ops = {			\
+	.elem_size = sizeof(type),					\
+	.less = name##_less,						\
+	.swap = name##_swap,						\
+	.arity = heap_arity,						\
+}
+
+/*
+ * Radix heap for integer keys that never go below the last key taken out,
+ * such as timer expiry times.
+ */
+struct l_radixheap;
+
+struct l_radixheap *l_radixheap_new(void);
+void l_radixheap_free(struct l_radixheap *heap);
+bool l_radixheap_push(struct l_radixheap *heap, uint64_t key, void *data);
+bool l_radixheap_peek(struct l_radixheap *heap, uint64_t *key, void **data);
+bool l_radixheap_pop(struct l_radixheap *heap, uint64_t *key, void **data);
+unsigned int l_radixheap_length(const struct l_radixheap *heap);
+
 #ifdef __cplusplus
 }
 #endif
@@ -49,6 +49,10 @@ static inline void explicit_bzero(void *s, size_t n)
 }
 #endif
 
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
 #ifndef SO_BINDTOIFINDEX
 #define SO_BINDTOIFINDEX 62
 #endif
@@ -5,6 +5,10 @@
  * SPDX-License-Identifier: LGPL-2.1-or-later
  */
 
+struct l_rtnl_cache;
+
+void _net_rtnl_cache_freed(const struct l_rtnl_cache *cache);
+
 char *net_domain_name_parse(const uint8_t *raw, size_t raw_len);
 char **net_domain_list_parse(const uint8_t *raw, size_t raw_len, bool padded);
 
@@ -20,6 +20,9 @@
 
 #include "net.h"
 #include "net-private.h"
+#include "netlink.h"
+#include "rtnl.h"
+#include "rtnl-private.h"
 #include "string.h"
 #include "utf8.h"
 #include "useful.h"
@@ -32,6 +35,75 @@
  * Network Interface utilities
  */
 
+/* Set by l_net_set_rtnl_cache(), only used once it has been populated */
+static __thread struct l_rtnl_cache *net_cache;
+
+static struct l_rtnl_cache *net_cache_get(void)
+{
+	if (!net_cache || !l_rtnl_cache_is_ready(net_cache))
+		return NULL;
+
+	return net_cache;
+}
+
+void _net_rtnl_cache_freed(const struct l_rtnl_cache *cache)
+{
+	if (net_cache == cache)
+		net_cache = NULL;
+}
+
+struct net_cache_address {
+	uint8_t family;
+	const struct l_rtnl_address *found;
+};
+
+static void net_cache_find_address(uint32_t ifindex,
+					const struct l_rtnl_address *addr,
+					void *user_data)
+{
+	struct net_cache_address *search = user_data;
+
+	if (search->found || addr->family != search->family)
+		return;
+
+	/* What SIOCGIFADDR reports, the primary address */
+	if (addr->family == AF_INET && !(addr->flags & IFA_F_SECONDARY))
+		search->found = addr;
+
+	if (addr->family == AF_INET6 &&
+			IN6_IS_ADDR_LINKLOCAL(&addr->in6_addr))
+		search->found = addr;
+}
+
+static const struct l_rtnl_address *net_cache_get_address(
+						struct l_rtnl_cache *cache,
+						uint32_t ifindex,
+						uint8_t family)
+{
+	struct net_cache_address search = { .family = family };
+
+	l_rtnl_cache_foreach_address(cache, ifindex, net_cache_find_address,
+					&search);
+
+	return search.found;
+}
+
+/**
+ * l_net_set_rtnl_cache:
+ * @cache: rtnl cache to answer queries from, or NULL
+ *
+ * Have l_net_get_name(), l_net_get_mac_address(), l_net_get_address() and
+ * l_net_get_link_local_address() look interfaces up in @cache instead of
+ * opening a socket and querying the kernel on every call.  The cache is
+ * only consulted once it is ready, and only from the calling thread.  It
+ * stops being used when it is freed.  Changes to the interfaces can be
+ * followed with the watches of @cache.
+ **/
+LIB_EXPORT void l_net_set_rtnl_cache(struct l_rtnl_cache *cache)
+{
+	net_cache = cache;
+}
+
 /**
  * l_net_get_mac_address:
  * @ifindex: Interface index to query
@@ -43,9 +115,22 @@
  **/
 LIB_EXPORT bool l_net_get_mac_address(uint32_t ifindex, uint8_t *out_addr)
 {
+	struct l_rtnl_cache *cache = net_cache_get();
 	struct ifreq ifr;
 	int sk, err;
 
+	if (cache) {
+		const struct l_rtnl_link *link =
+			l_rtnl_cache_get_link(cache, ifindex);
+
+		if (!link || link->type != ARPHRD_ETHER ||
+				link->address_len != 6)
+			return false;
+
+		memcpy(out_addr, link->address, 6);
+		return true;
+	}
+
 	sk = socket(PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
 	if (sk < 0)
 		return false;
@@ -84,9 +169,17 @@ error:
  **/
 LIB_EXPORT char *l_net_get_name(uint32_t ifindex)
 {
+	struct l_rtnl_cache *cache = net_cache_get();
 	struct ifreq ifr;
 	int sk, err;
 
+	if (cache) {
+		const struct l_rtnl_link *link =
+			l_rtnl_cache_get_link(cache, ifindex);
+
+		return link ? l_strdup(link->ifname) : NULL;
+	}
+
 	sk = socket(PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
 	if (sk < 0)
 		return NULL;
@@ -334,11 +427,23 @@ char **net_domain_list_parse(const uint8_t *raw, size_t raw_len, bool padded)
 
 LIB_EXPORT bool l_net_get_address(int ifindex, struct in_addr *out)
 {
+	struct l_rtnl_cache *cache = net_cache_get();
 	struct ifreq ifr;
 	int sk, err;
 	struct sockaddr_in *server_ip;
 	bool ret = false;
 
+	if (cache) {
+		const struct l_rtnl_address *addr =
+			net_cache_get_address(cache, ifindex, AF_INET);
+
+		if (!addr)
+			return false;
+
+		*out = addr->in_addr;
+		return true;
+	}
+
 	sk = socket(PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
 	if (sk < 0)
 		return false;
@@ -367,11 +472,24 @@ done:
 
 LIB_EXPORT bool l_net_get_link_local_address(int ifindex, struct in6_addr *out)
 {
-	L_AUTO_FREE_VAR(char *, ifname) = l_net_get_name(ifindex);
+	struct l_rtnl_cache *cache = net_cache_get();
+	L_AUTO_FREE_VAR(char *, ifname) = NULL;
 	struct ifaddrs *ifa;
 	struct ifaddrs *cur;
 	bool r = false;
 
+	if (cache) {
+		const struct l_rtnl_address *addr =
+			net_cache_get_address(cache, ifindex, AF_INET6);
+
+		if (!addr)
+			return false;
+
+		*out = addr->in6_addr;
+		return true;
+	}
+
+	ifname = l_net_get_name(ifindex);
 	if (!ifname)
 		return false;
 
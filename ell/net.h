@@ -14,6 +14,7 @@
 
 struct in_addr;
 struct in6_addr;
+struct l_rtnl_cache;
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,6 +26,7 @@ bool l_net_hostname_is_root(const char *hostname);
 bool l_net_hostname_is_localhost(const char *hostname);
 bool l_net_get_address(int ifindex, struct in_addr *out);
 bool l_net_get_link_local_address(int ifindex, struct in6_addr *out);
+void l_net_set_rtnl_cache(struct l_rtnl_cache *cache);
 
 static inline bool l_net_prefix_matches(const void *a, const void *b,
 					uint8_t prefix_len)
@@ -40,6 +40,8 @@
 #include "rtnl.h"
 #include "rtnl-private.h"
 #include "queue.h"
+#include "pqueue.h"
+#include "hashmap.h"
 #include "time.h"
 #include "idle.h"
 #include "strv.h"
@@ -48,6 +50,7 @@
 #include "acd.h"
 #include "timeout.h"
 #include "sysctl.h"
+#include "settings.h"
 #include "netconfig.h"
 
 struct l_netconfig {
@@ -67,6 +70,7 @@ struct l_netconfig {
 	char **v6_dns_override;
 	char **v6_domain_names_override;
 	bool optimistic_dad_enabled;
+	unsigned int update_settle_ms;
 
 	bool started;
 	struct l_idle *do_static_work;
@@ -77,7 +81,10 @@ struct l_netconfig {
 	struct l_dhcp6_client *dhcp6_client;
 	struct l_idle *signal_expired_work;
 	unsigned int ifaddr6_dump_cmd_id;
+	struct l_netconfig *addr_wait_next;
 	struct l_queue *icmp_route_data;
+	struct l_pqueue *icmp_route_expiry;
+	struct l_timeout *icmp_route_expiry_timeout;
 	struct l_acd *acd;
 	uint32_t orig_disable_ipv6;
 	uint32_t orig_optimistic_dad;
@@ -92,6 +99,10 @@ struct l_netconfig {
 	} v6_auto_method;
 	struct l_queue *slaac_dnses;
 	struct l_queue *slaac_domains;
+	struct l_icmp6_router *v6_cached_ra;
+	struct l_idle *do_cached_ra_work;
+	struct l_timeout *update_timeout;
+	uint8_t update_pending;
 
 	/* These objects, if not NULL, are owned by @addresses and @routes */
 	struct l_rtnl_address *v4_address;
@@ -99,6 +110,12 @@ struct l_netconfig {
 	struct l_rtnl_route *v4_default_route;
 	struct l_rtnl_address *v6_address;
 
+	/* Expiry times of the SLAAC @v6_address last passed to the kernel */
+	uint64_t v6_kernel_p_expiry;
+	uint64_t v6_kernel_v_expiry;
+	uint64_t v6_last_ra_time;
+	uint64_t v6_max_ra_interval;
+
 	struct {
 		struct l_queue *current;
 
@@ -127,6 +144,12 @@ struct l_netconfig {
 		void *user_data;
 		l_netconfig_destroy_cb_t destroy;
 	} handler;
+
+	struct {
+		l_netconfig_trace_cb_t callback;
+		void *user_data;
+		l_netconfig_destroy_cb_t destroy;
+	} trace;
 };
 
 struct netconfig_route_data {
@@ -134,20 +157,48 @@ struct netconfig_route_data {
 	uint64_t last_ra_time;
 	uint64_t kernel_expiry;
 	uint64_t max_ra_interval;
+	struct l_pqueue_node expiry_node;
 };
 
+static bool netconfig_route_expires_before(
+					const struct netconfig_route_data *a,
+					const struct netconfig_route_data *b)
+{
+	return a->kernel_expiry < b->kernel_expiry;
+}
+
+/*
+ * Routes with a finite lifetime in the kernel, ordered by that expiry
+ * so that only the earliest one needs checking and a single timeout
+ * covers all of them.
+ */
+L_PQUEUE_DEFINE(route_expiry_queue, struct netconfig_route_data, expiry_node,
+		netconfig_route_expires_before)
+
 union netconfig_addr {
 	struct in_addr v4;
 	struct in6_addr v6;
 };
 
-static struct l_queue *addr_wait_list;
+/*
+ * Instances waiting for their link-local address, keyed by ifindex so that
+ * RTM_NEWADDR notifications don't need to walk every instance.  Instances
+ * on the same interface are chained through .addr_wait_next.
+ */
+static struct l_hashmap *addr_wait_map;
 static unsigned int rtnl_id;
 
 static const unsigned int max_icmp6_routes = 100;
 static const unsigned int max_icmp6_dnses = 10;
 static const unsigned int max_icmp6_domains = 10;
 
+/*
+ * Lifetime, in seconds, of everything applied from a cached RA.  Long
+ * enough to cover the wait for the first real RA, short enough that
+ * stale entries go away on their own if the network has changed.
+ */
+static const unsigned int cached_ra_lifetime = 30;
+
 static void netconfig_update_cleanup(struct l_netconfig *nc)
 {
 	l_queue_clear(nc->addresses.added, NULL);
@@ -164,11 +215,19 @@ static void netconfig_update_cleanup(struct l_netconfig *nc)
 			(l_queue_destroy_func_t) l_rtnl_route_free);
 }
 
-static void netconfig_emit_event(struct l_netconfig *nc, uint8_t family,
+static void netconfig_trace(struct l_netconfig *nc, uint8_t family,
+				enum l_netconfig_trace_point point)
+{
+	if (nc->trace.callback)
+		nc->trace.callback(nc, family, point, l_time_now(),
+					nc->trace.user_data);
+}
+
+static void netconfig_dispatch_event(struct l_netconfig *nc, uint8_t family,
 					enum l_netconfig_event event)
 {
-	if (!nc->handler.callback)
-		return;
+	if (event == L_NETCONFIG_EVENT_CONFIGURE)
+		netconfig_trace(nc, family, L_NETCONFIG_TRACE_CONFIGURE);
 
 	nc->handler.callback(nc, family, event, nc->handler.user_data);
 
@@ -178,6 +237,82 @@ static void netconfig_emit_event(struct l_netconfig *nc, uint8_t family,
 		netconfig_update_cleanup(nc);
 }
 
+#define UPDATE_PENDING_V4	0x1
+#define UPDATE_PENDING_V6	0x2
+
+static void netconfig_update_cancel(struct l_netconfig *nc)
+{
+	l_timeout_remove(l_steal_ptr(nc->update_timeout));
+	nc->update_pending = 0;
+}
+
+static void netconfig_update_flush(struct l_netconfig *nc)
+{
+	uint8_t pending = nc->update_pending;
+
+	netconfig_update_cancel(nc);
+
+	if (!nc->handler.callback)
+		return;
+
+	/*
+	 * The change lists are shared between the families so the first
+	 * event carries all of the accumulated changes.
+	 */
+	if (pending & UPDATE_PENDING_V4)
+		netconfig_dispatch_event(nc, AF_INET,
+						L_NETCONFIG_EVENT_UPDATE);
+
+	if (pending & UPDATE_PENDING_V6)
+		netconfig_dispatch_event(nc, AF_INET6,
+						L_NETCONFIG_EVENT_UPDATE);
+}
+
+static void netconfig_update_timeout_cb(struct l_timeout *timeout,
+					void *user_data)
+{
+	netconfig_update_flush(user_data);
+}
+
+static void netconfig_emit_event(struct l_netconfig *nc, uint8_t family,
+					enum l_netconfig_event event)
+{
+	if (!nc->handler.callback)
+		return;
+
+	/*
+	 * With a settle time set, UPDATE events are held back while the
+	 * changes keep accumulating in the added/updated/removed/expired
+	 * lists, and are delivered once the window started by the first
+	 * one runs out.  CONFIGURE and UNCONFIGURE report the same lists
+	 * and therefore replace the pending UPDATEs, FAILED doesn't so
+	 * those are delivered first.
+	 */
+	if (nc->update_settle_ms) {
+		if (event == L_NETCONFIG_EVENT_FAILED)
+			netconfig_update_flush(nc);
+		else if (event != L_NETCONFIG_EVENT_UPDATE)
+			netconfig_update_cancel(nc);
+
+		if (event != L_NETCONFIG_EVENT_UPDATE)
+			goto dispatch;
+
+		nc->update_pending |= family == AF_INET ?
+			UPDATE_PENDING_V4 : UPDATE_PENDING_V6;
+
+		if (!nc->update_timeout)
+			nc->update_timeout = l_timeout_create_ms(
+						nc->update_settle_ms,
+						netconfig_update_timeout_cb,
+						nc, NULL);
+
+		return;
+	}
+
+dispatch:
+	netconfig_dispatch_event(nc, family, event);
+}
+
 static void netconfig_addr_wait_unregister(struct l_netconfig *nc,
 						bool in_notify);
 
@@ -191,6 +326,7 @@ static void netconfig_failed(struct l_netconfig *nc, uint8_t family)
 		l_dhcp6_client_stop(nc->dhcp6_client);
 		l_icmp6_client_stop(nc->icmp6_client);
 		l_timeout_remove(l_steal_ptr(nc->ra_timeout));
+		l_idle_remove(l_steal_ptr(nc->do_cached_ra_work));
 	}
 
 	netconfig_emit_event(nc, family, L_NETCONFIG_EVENT_FAILED);
@@ -637,6 +773,8 @@ static void netconfig_dhcp6_event_handler(struct l_dhcp6_client *client,
 		if (L_WARN_ON(nc->v6_configured))
 			break;
 
+		netconfig_trace(nc, AF_INET6, L_NETCONFIG_TRACE_DHCP6_LEASE);
+
 		if (nc->v6_auto_method == NETCONFIG_V6_METHOD_DHCP) {
 			netconfig_add_dhcp6_address(nc);
 			netconfig_set_dhcp6_address_lifetimes(nc, false);
@@ -772,16 +910,20 @@ static void netconfig_add_slaac_address(struct l_netconfig *nc,
 
 	nc->v6_address = l_rtnl_address_new(addr_str, 128);
 	l_rtnl_address_set_noprefixroute(nc->v6_address, true);
+	nc->v6_kernel_p_expiry = p != 0xffffffff ?
+		r->start_time + p * L_USEC_PER_SEC : 0;
+	nc->v6_kernel_v_expiry = v != 0xffffffff ?
+		r->start_time + v * L_USEC_PER_SEC : 0;
+	nc->v6_last_ra_time = r->start_time;
+	nc->v6_max_ra_interval = 0;
 
 	if (p != 0xffffffff || v != 0xffffffff) {
 		l_rtnl_address_set_lifetimes(nc->v6_address,
 					p != 0xffffffff ? p : 0,
 					v != 0xffffffff ? v : 0);
 		l_rtnl_address_set_expiry(nc->v6_address,
-					p != 0xffffffff ?
-					r->start_time + p * L_USEC_PER_SEC : 0,
-					v != 0xffffffff ?
-					r->start_time + v * L_USEC_PER_SEC : 0);
+					nc->v6_kernel_p_expiry,
+					nc->v6_kernel_v_expiry);
 	}
 
 	l_queue_push_tail(nc->addresses.current, nc->v6_address);
@@ -797,6 +939,50 @@ static void netconfig_add_slaac_address(struct l_netconfig *nc,
 	/* TODO: set a renew timeout */
 }
 
+static bool netconfig_check_lifetime_need_update(uint64_t kernel_expiry,
+						uint64_t max_ra_interval,
+						const struct l_icmp6_router *ra,
+						uint64_t new_expiry)
+{
+	/*
+	 * Decide whether a route or address is close enough to the expiry
+	 * time last passed to the kernel that,
+	 * based on the expected Router Advertisement frequency, we should
+	 * notify the user and have them update the route's lifetime in the
+	 * kernel.  This is an optimization to avoid triggering a syscall and
+	 * potentially multiple context-switches in case we expect to have
+	 * many more opportunities to update the lifetime before we even get
+	 * close to the last expiry time we passed to the kernel.  Without
+	 * this we might be wasting a lot of cycles over time if the RAs are
+	 * frequent.
+	 *
+	 * Always update if we have no RA interval information or if the
+	 * expiry is moved forward.
+	 */
+	if (!max_ra_interval || new_expiry < kernel_expiry)
+		return true;
+
+	return kernel_expiry < ra->start_time + max_ra_interval * 10;
+}
+
+static bool netconfig_slaac_expiry_need_update(struct l_netconfig *nc,
+						const struct l_icmp6_router *r,
+						uint64_t kernel_expiry,
+						uint64_t new_expiry)
+{
+	/* Finite to infinite or back */
+	if (!kernel_expiry || !new_expiry)
+		return kernel_expiry != new_expiry;
+
+	/* Same skew allowance as in netconfig_set_icmp6_route_data() */
+	if (l_time_diff(new_expiry, kernel_expiry) <= L_USEC_PER_SEC)
+		return false;
+
+	return netconfig_check_lifetime_need_update(kernel_expiry,
+						nc->v6_max_ra_interval,
+						r, new_expiry);
+}
+
 static void netconfig_set_slaac_address_lifetimes(struct l_netconfig *nc,
 						const struct l_icmp6_router *r)
 {
@@ -833,21 +1019,39 @@ static void netconfig_set_slaac_address_lifetimes(struct l_netconfig *nc,
 		p_expiry = p != 0xffffffff ? r->start_time + p * L_USEC_PER_SEC : 0;
 		v_expiry = v != 0xffffffff ? r->start_time + v * L_USEC_PER_SEC : 0;
 		l_rtnl_address_set_expiry(nc->v6_address, p_expiry, v_expiry);
-		updated = true;
 
 		/*
-		 * TODO: modify the renew timeout.
-		 *
-		 * Also we probably want to apply a mechanism similar to that
-		 * in netconfig_check_route_need_update() to avoid generating
-		 * and UPDATED event for every RA that covers this prefix
-		 * with constant lifetime values.
+		 * Like with the routes, only resubmit the address when the
+		 * lifetimes the kernel has are about to run out or are being
+		 * shortened, not for every RA refreshing them.
 		 */
+		if (netconfig_slaac_expiry_need_update(nc, r,
+						nc->v6_kernel_p_expiry,
+						p_expiry) ||
+				netconfig_slaac_expiry_need_update(nc, r,
+						nc->v6_kernel_v_expiry,
+						v_expiry))
+			updated = true;
+
+		if (r->start_time - nc->v6_last_ra_time > nc->v6_max_ra_interval)
+			nc->v6_max_ra_interval =
+				r->start_time - nc->v6_last_ra_time;
+
+		nc->v6_last_ra_time = r->start_time;
+
+		/* TODO: modify the renew timeout. */
 	}
 
-	if (updated && !l_queue_find(nc->addresses.added, netconfig_match,
-					nc->v6_address))
+	if (l_queue_find(nc->addresses.added, netconfig_match,
+				nc->v6_address))
+		updated = true;
+	else if (updated)
 		l_queue_push_tail(nc->addresses.updated, nc->v6_address);
+
+	if (updated) {
+		nc->v6_kernel_p_expiry = p_expiry;
+		nc->v6_kernel_v_expiry = v_expiry;
+	}
 }
 
 static bool netconfig_process_slaac_dns_info(struct l_netconfig *nc,
@@ -932,44 +1136,105 @@ static bool netconfig_process_slaac_dns_info(struct l_netconfig *nc,
 	return updated;
 }
 
-static uint64_t now;
+static void netconfig_expire_routes(struct l_netconfig *nc);
 
-static bool netconfig_check_route_expired(void *data, void *user_data)
+static void netconfig_route_expiry_timeout_cb(struct l_timeout *timeout,
+						void *user_data)
 {
-	struct l_netconfig *nc = user_data;
-	struct netconfig_route_data *rd = data;
+	netconfig_expire_routes(user_data);
+}
 
-	if (!rd->kernel_expiry || now < rd->kernel_expiry)
-		return false;
+static void netconfig_route_expiry_rearm(struct l_netconfig *nc)
+{
+	struct netconfig_route_data *rd =
+		route_expiry_queue_peek(nc->icmp_route_expiry);
+	uint64_t now = l_time_now_cached();
+	uint64_t ms;
 
-	/*
-	 * Since we set lifetimes on the routes we submit to the kernel with
-	 * RTM_NEWROUTE, we count on them being deleted automatically so no
-	 * need to send an RTM_DELROUTE.  We signal the fact that the route
-	 * expired to the user by having it on the expired list but there's
-	 * nothing that the user needs to do with the routes on that list
-	 * like they do with the added, updated and removed lists.
-	 *
-	 * If for some reason the route is still on the added list, drop it
-	 * from there and there's nothing to notify the user of.
-	 */
-	if (!l_queue_remove(nc->routes.added, rd->route))
-		l_queue_push_tail(nc->routes.expired, rd->route);
+	if (!rd) {
+		l_timeout_remove(l_steal_ptr(nc->icmp_route_expiry_timeout));
+		return;
+	}
 
-	l_queue_remove(nc->routes.current, rd->route);
-	l_queue_remove(nc->routes.updated, rd->route);
-	l_queue_remove(nc->routes.removed, rd->route);
-	return true;
+	/* Round up so that we never look before the kernel expiry time */
+	ms = l_time_after(rd->kernel_expiry, now) ?
+		l_time_to_msecs(l_time_diff(now, rd->kernel_expiry) +
+				L_USEC_PER_MSEC - 1) : 0;
+
+	if (nc->icmp_route_expiry_timeout)
+		l_timeout_modify_ms(nc->icmp_route_expiry_timeout, ms ?: 1);
+	else
+		nc->icmp_route_expiry_timeout = l_timeout_create_ms(ms ?: 1,
+					netconfig_route_expiry_timeout_cb,
+					nc, NULL);
+}
+
+static void netconfig_route_set_kernel_expiry(struct l_netconfig *nc,
+						struct netconfig_route_data *rd,
+						uint64_t expiry)
+{
+	if (rd->kernel_expiry == expiry &&
+			(!expiry || l_pqueue_node_is_queued(&rd->expiry_node)))
+		return;
+
+	rd->kernel_expiry = expiry;
+
+	if (!expiry)
+		route_expiry_queue_remove(nc->icmp_route_expiry, rd);
+	else if (!route_expiry_queue_update(nc->icmp_route_expiry, rd))
+		route_expiry_queue_push(nc->icmp_route_expiry, rd);
+
+	netconfig_route_expiry_rearm(nc);
+}
+
+static void netconfig_route_expiry_clear(struct l_netconfig *nc)
+{
+	while (route_expiry_queue_pop(nc->icmp_route_expiry))
+		;
+
+	l_timeout_remove(l_steal_ptr(nc->icmp_route_expiry_timeout));
 }
 
 static void netconfig_expire_routes(struct l_netconfig *nc)
 {
-	now = l_time_now();
+	uint64_t now = l_time_now_cached();
+	struct netconfig_route_data *rd;
+	bool expired = false;
 
-	if (l_queue_foreach_remove(nc->icmp_route_data,
-					netconfig_check_route_expired, nc) &&
-			!l_queue_isempty(nc->routes.expired) &&
-			!nc->signal_expired_work)
+	while ((rd = route_expiry_queue_peek(nc->icmp_route_expiry)) &&
+			now >= rd->kernel_expiry) {
+		route_expiry_queue_pop(nc->icmp_route_expiry);
+		l_queue_remove(nc->icmp_route_data, rd);
+		l_queue_remove(nc->routes.current, rd->route);
+		l_queue_remove(nc->routes.updated, rd->route);
+		l_queue_remove(nc->routes.removed, rd->route);
+
+		/*
+		 * Since we set lifetimes on the routes we submit to the
+		 * kernel with RTM_NEWROUTE, we count on them being deleted
+		 * automatically so no need to send an RTM_DELROUTE.  We
+		 * signal the fact that the route expired to the user by
+		 * having it on the expired list but there's nothing that the
+		 * user needs to do with the routes on that list like they do
+		 * with the added, updated and removed lists.
+		 *
+		 * If for some reason the route is still on the added list,
+		 * drop it from there and there's nothing to notify the user
+		 * of.
+		 */
+		if (l_queue_remove(nc->routes.added, rd->route))
+			l_rtnl_route_free(rd->route);
+		else {
+			l_queue_push_tail(nc->routes.expired, rd->route);
+			expired = true;
+		}
+
+		l_free(rd);
+	}
+
+	netconfig_route_expiry_rearm(nc);
+
+	if (expired && !nc->signal_expired_work)
 		nc->signal_expired_work = l_idle_create(
 						netconfig_signal_expired,
 						nc, NULL);
@@ -1037,32 +1302,6 @@ static struct netconfig_route_data *netconfig_add_icmp6_route(
 	return rd;
 }
 
-static bool netconfig_check_route_need_update(
-					const struct netconfig_route_data *rd,
-					const struct l_icmp6_router *ra,
-					uint64_t new_expiry,
-					uint64_t old_expiry)
-{
-	/*
-	 * Decide whether the route is close enough to its expiry time that,
-	 * based on the expected Router Advertisement frequency, we should
-	 * notify the user and have them update the route's lifetime in the
-	 * kernel.  This is an optimization to avoid triggering a syscall and
-	 * potentially multiple context-switches in case we expect to have
-	 * many more opportunities to update the lifetime before we even get
-	 * close to the last expiry time we passed to the kernel.  Without
-	 * this we might be wasting a lot of cycles over time if the RAs are
-	 * frequent.
-	 *
-	 * Always update if we have no RA interval information or if the
-	 * expiry is moved forward.
-	 */
-	if (!rd->max_ra_interval || new_expiry < rd->kernel_expiry)
-		return true;
-
-	return rd->kernel_expiry < ra->start_time + rd->max_ra_interval * 10;
-}
-
 static void netconfig_set_icmp6_route_data(struct l_netconfig *nc,
 						struct netconfig_route_data *rd,
 						const struct l_icmp6_router *ra,
@@ -1119,15 +1358,26 @@ static void netconfig_set_icmp6_route_data(struct l_netconfig *nc,
 		l_rtnl_route_set_expiry(rd->route, expiry);
 
 		differs = differs || !expiry || !old_expiry ||
-			netconfig_check_route_need_update(rd, ra,
-							expiry, old_expiry);
+			netconfig_check_lifetime_need_update(rd->kernel_expiry,
+							rd->max_ra_interval,
+							ra, expiry);
 	}
 
-	if (updated && differs && !netconfig_route_exists(nc->routes.added,
-								rd->route)) {
+	/*
+	 * A route still on the added list will be committed with the
+	 * current values.  For one already in the kernel only generate an
+	 * update when needed, steady state RAs then cause no netlink
+	 * traffic at all.
+	 */
+	if (updated && !netconfig_route_exists(nc->routes.added, rd->route)) {
+		if (!differs)
+			return;
+
 		l_queue_push_tail(nc->routes.updated, rd->route);
-		rd->kernel_expiry = expiry;
 	}
+
+	netconfig_route_set_kernel_expiry(nc, rd,
+					l_rtnl_route_get_expiry(rd->route));
 }
 
 static void netconfig_remove_icmp6_route(struct l_netconfig *nc,
@@ -1139,6 +1389,122 @@ static void netconfig_remove_icmp6_route(struct l_netconfig *nc,
 
 	if (!l_queue_remove(nc->routes.added, rd->route))
 		l_queue_push_tail(nc->routes.removed, rd->route);
+	else
+		l_rtnl_route_free(rd->route);
+
+	netconfig_route_set_kernel_expiry(nc, rd, 0);
+	l_free(rd);
+}
+
+static bool netconfig_remove_stale_dns(void *data, void *user_data)
+{
+	const struct l_icmp6_router *r = user_data;
+	unsigned int i;
+
+	for (i = 0; i < r->n_dns; i++)
+		if (r->dns_list[i].lifetime &&
+				!memcmp(r->dns_list[i].address, data, 16))
+			return false;
+
+	l_free(data);
+	return true;
+}
+
+static bool netconfig_remove_stale_domain(void *data, void *user_data)
+{
+	const struct l_icmp6_router *r = user_data;
+	unsigned int i;
+
+	for (i = 0; i < r->n_domains; i++)
+		if (r->domains[i].lifetime &&
+				!strcmp(r->domains[i].domain, data))
+			return false;
+
+	l_free(data);
+	return true;
+}
+
+/*
+ * Called on the first real RA after a cached one has been applied.  The
+ * cached routes are left to expire on their short lifetimes unless the
+ * real RA refreshes them.  The cached DNS information doesn't have
+ * lifetimes so drop whatever the real RA doesn't confirm, and drop the
+ * SLAAC address if it's not covered by the real RA or the method has
+ * changed so that the regular logic starts over.
+ */
+static bool netconfig_reconcile_cached_ra(struct l_netconfig *nc,
+						const struct l_icmp6_router *r,
+						bool *dns_updated)
+{
+	unsigned int method = NETCONFIG_V6_METHOD_UNSET;
+	const uint8_t *addr;
+	unsigned int i;
+
+	_icmp6_router_free(l_steal_ptr(nc->v6_cached_ra));
+
+	/* Real RA came first, nothing has been applied */
+	if (nc->do_cached_ra_work) {
+		l_idle_remove(l_steal_ptr(nc->do_cached_ra_work));
+		return true;
+	}
+
+	if (l_queue_foreach_remove(nc->slaac_dnses,
+					netconfig_remove_stale_dns, (void *) r))
+		*dns_updated = true;
+
+	if (l_queue_foreach_remove(nc->slaac_domains,
+					netconfig_remove_stale_domain,
+					(void *) r))
+		*dns_updated = true;
+
+	if (l_icmp6_router_get_managed(r))
+		method = NETCONFIG_V6_METHOD_DHCP;
+	else if (r->n_ac_prefixes)
+		method = l_icmp6_router_get_other(r) ?
+			NETCONFIG_V6_METHOD_SLAAC_DHCP :
+			NETCONFIG_V6_METHOD_SLAAC;
+
+	if (nc->v6_auto_method == NETCONFIG_V6_METHOD_UNSET)
+		return true;
+
+	addr = nc->v6_address ?
+		l_rtnl_address_get_in_addr(nc->v6_address) : NULL;
+
+	for (i = 0; addr && i < r->n_ac_prefixes; i++)
+		if (r->ac_prefixes[i].valid_lifetime &&
+				!memcmp(r->ac_prefixes[i].prefix, addr, 8))
+			break;
+
+	if (nc->v6_auto_method != method ||
+			(addr && i == r->n_ac_prefixes)) {
+		if (nc->v6_address) {
+			l_queue_remove(nc->addresses.current, nc->v6_address);
+
+			if (l_queue_remove(nc->addresses.added,
+						nc->v6_address))
+				l_rtnl_address_free(nc->v6_address);
+			else
+				l_queue_push_tail(nc->addresses.removed,
+							nc->v6_address);
+
+			nc->v6_address = NULL;
+		}
+
+		nc->v6_auto_method = NETCONFIG_V6_METHOD_UNSET;
+		nc->v6_configured = false;
+		return true;
+	}
+
+	/* DHCPv6 was held back while we only had the cached RA */
+	l_dhcp6_client_set_stateless(nc->dhcp6_client, method ==
+					NETCONFIG_V6_METHOD_SLAAC_DHCP);
+
+	if (!netconfig_check_start_dhcp6(nc)) {
+		netconfig_failed(nc, AF_INET6);
+		return false;
+	}
+
+	return true;
 }
 
 static void netconfig_icmp6_event_handler(struct l_icmp6_client *client,
@@ -1157,8 +1523,16 @@ static void netconfig_icmp6_event_handler(struct l_icmp6_client *client,
 
 	r = event_data;
 
-	if (nc->ra_timeout)
+	/* Only set until the first real RA */
+	if (nc->ra_timeout && r != nc->v6_cached_ra) {
 		l_timeout_remove(l_steal_ptr(nc->ra_timeout));
+		netconfig_trace(nc, AF_INET6, L_NETCONFIG_TRACE_ROUTER_FOUND);
+
+		if (nc->v6_cached_ra &&
+				!netconfig_reconcile_cached_ra(nc, r,
+								&dns_updated))
+			return;
+	}
 
 	netconfig_expire_routes(nc);
 
@@ -1227,7 +1601,8 @@ process_nondefault_routes:
 		if (!nc->slaac_domains && r->n_domains)
 			nc->slaac_domains = l_queue_new();
 
-		dns_updated = netconfig_process_slaac_dns_info(nc, r);
+		if (netconfig_process_slaac_dns_info(nc, r))
+			dns_updated = true;
 	}
 
 	/*
@@ -1312,10 +1687,24 @@ emit_event:
 			!l_queue_isempty(nc->routes.removed) ||
 			!l_queue_isempty(nc->routes.expired) ||
 			!l_queue_isempty(nc->addresses.updated) ||
+			!l_queue_isempty(nc->addresses.removed) ||
 			dns_updated)
 		netconfig_emit_event(nc, AF_INET6, L_NETCONFIG_EVENT_UPDATE);
 }
 
+static void netconfig_do_cached_ra(struct l_idle *idle, void *user_data)
+{
+	struct l_netconfig *nc = user_data;
+
+	l_idle_remove(l_steal_ptr(nc->do_cached_ra_work));
+
+	/* The lifetimes in the cached RA count from now */
+	nc->v6_cached_ra->start_time = l_time_now();
+	netconfig_icmp6_event_handler(nc->icmp6_client,
+					L_ICMP6_CLIENT_EVENT_ROUTER_FOUND,
+					nc->v6_cached_ra, nc);
+}
+
 static int netconfig_proc_write_ipv6_uint_setting(struct l_netconfig *nc,
 							const char *setting,
 							unsigned int value)
@@ -1358,6 +1747,7 @@ LIB_EXPORT struct l_netconfig *l_netconfig_new(uint32_t ifindex)
 	nc->routes.updated = l_queue_new();
 	nc->routes.removed = l_queue_new();
 	nc->icmp_route_data = l_queue_new();
+	nc->icmp_route_expiry = route_expiry_queue_new();
 
 	nc->dhcp_client = l_dhcp_client_new(ifindex);
 	l_dhcp_client_set_event_handler(nc->dhcp_client,
@@ -1398,6 +1788,7 @@ LIB_EXPORT void l_netconfig_destroy(struct l_netconfig *netconfig)
 	l_netconfig_set_dns_override(netconfig, AF_INET6, NULL);
 	l_netconfig_set_domain_names_override(netconfig, AF_INET6, NULL);
 
+	l_netconfig_set_trace_handler(netconfig, NULL, NULL, NULL);
 	l_dhcp_client_destroy(netconfig->dhcp_client);
 	l_dhcp6_client_destroy(netconfig->dhcp6_client);
 	l_netconfig_set_event_handler(netconfig, NULL, NULL, NULL);
@@ -1410,8 +1801,13 @@ LIB_EXPORT void l_netconfig_destroy(struct l_netconfig *netconfig)
 	l_queue_destroy(netconfig->routes.updated, NULL);
 	l_queue_destroy(netconfig->routes.removed, NULL);
 	l_queue_destroy(netconfig->icmp_route_data, NULL);
+	l_pqueue_free(netconfig->icmp_route_expiry);
 	l_queue_destroy(netconfig->slaac_domains, NULL);
 	l_queue_destroy(netconfig->slaac_dnses, NULL);
+
+	if (netconfig->v6_cached_ra)
+		_icmp6_router_free(netconfig->v6_cached_ra);
+
 	l_free(netconfig);
 }
 
@@ -1616,6 +2012,23 @@ LIB_EXPORT bool l_netconfig_set_optimistic_dad_enabled(
 	return true;
 }
 
+/*
+ * Coalesce L_NETCONFIG_EVENT_UPDATE events: instead of one event per
+ * address, route or DNS change, changes arriving within @settle_ms of the
+ * first one are delivered together in a single event per family.  0, the
+ * default, delivers every change immediately.
+ */
+LIB_EXPORT bool l_netconfig_set_update_settle_time(
+						struct l_netconfig *netconfig,
+						unsigned int settle_ms)
+{
+	if (unlikely(!netconfig || netconfig->started))
+		return false;
+
+	netconfig->update_settle_ms = settle_ms;
+	return true;
+}
+
 static bool netconfig_check_family_config(struct l_netconfig *nc,
 						uint8_t family)
 {
@@ -1739,6 +2152,8 @@ static void netconfig_ipv4_acd_event(enum l_acd_event event, void *user_data)
 		if (L_WARN_ON(nc->v4_configured))
 			break;
 
+		netconfig_trace(nc, AF_INET, L_NETCONFIG_TRACE_ACD_DONE);
+
 		netconfig_add_v4_static_address_routes(nc);
 		nc->v4_configured = true;
 		netconfig_emit_event(nc, AF_INET, L_NETCONFIG_EVENT_CONFIGURE);
@@ -1810,14 +2225,46 @@ static void netconfig_rtnl_unregister(void *user_data)
 {
 	struct l_netlink *rtnl = user_data;
 
-	if (!addr_wait_list || !l_queue_isempty(addr_wait_list))
+	if (!addr_wait_map || !l_hashmap_isempty(addr_wait_map))
 		return;
 
-	l_queue_destroy(l_steal_ptr(addr_wait_list), NULL);
+	l_hashmap_destroy(l_steal_ptr(addr_wait_map), NULL);
 	l_netlink_unregister(rtnl, rtnl_id);
 	rtnl_id = 0;
 }
 
+static void netconfig_addr_wait_add(struct l_netconfig *nc)
+{
+	void *key = L_UINT_TO_PTR(nc->ifindex);
+
+	nc->addr_wait_next = l_hashmap_lookup(addr_wait_map, key);
+	l_hashmap_replace(addr_wait_map, key, nc, NULL);
+}
+
+static bool netconfig_addr_wait_remove(struct l_netconfig *nc)
+{
+	void *key = L_UINT_TO_PTR(nc->ifindex);
+	struct l_netconfig *head = l_hashmap_lookup(addr_wait_map, key);
+	struct l_netconfig **p;
+
+	for (p = &head; *p; p = &(*p)->addr_wait_next)
+		if (*p == nc)
+			break;
+
+	if (!*p)
+		return false;
+
+	*p = nc->addr_wait_next;
+	nc->addr_wait_next = NULL;
+
+	if (head)
+		l_hashmap_replace(addr_wait_map, key, head, NULL);
+	else
+		l_hashmap_remove(addr_wait_map, key);
+
+	return true;
+}
+
 static void netconfig_addr_wait_unregister(struct l_netconfig *nc,
 						bool in_notify)
 {
@@ -1830,10 +2277,10 @@ static void netconfig_addr_wait_unregister(struct l_netconfig *nc,
 		l_netlink_cancel(rtnl, cmd_id);
 	}
 
-	if (!l_queue_remove(addr_wait_list, nc))
+	if (!netconfig_addr_wait_remove(nc))
 		return;
 
-	if (!l_queue_isempty(addr_wait_list))
+	if (!l_hashmap_isempty(addr_wait_map))
 		return;
 
 	/* We can't do l_netlink_unregister() inside a notification */
@@ -1867,9 +2314,13 @@ static void netconfig_ifaddr_ipv6_added(struct l_netconfig *nc,
 	new_lla = !nc->have_lla;
 	nc->have_lla = true;
 
-	if (!(ifa->ifa_flags & IFA_F_TENTATIVE))
+	if (new_lla)
+		netconfig_trace(nc, AF_INET6, L_NETCONFIG_TRACE_LINK_LOCAL);
+
+	if (!(ifa->ifa_flags & IFA_F_TENTATIVE)) {
+		netconfig_trace(nc, AF_INET6, L_NETCONFIG_TRACE_DAD_DONE);
 		netconfig_addr_wait_unregister(nc, true);
-	else if (nc->ifaddr6_dump_cmd_id) {
+	} else if (nc->ifaddr6_dump_cmd_id) {
 		struct l_netlink *rtnl = l_rtnl_get();
 		unsigned int cmd_id = nc->ifaddr6_dump_cmd_id;
 
@@ -1894,19 +2345,16 @@ static void netconfig_ifaddr_ipv6_notify(uint16_t type, const void *data,
 {
 	const struct ifaddrmsg *ifa = data;
 	uint32_t bytes = len - NLMSG_ALIGN(sizeof(struct ifaddrmsg));
-	const struct l_queue_entry *entry, *next;
+	struct l_netconfig *nc, *next;
 
 	switch (type) {
 	case RTM_NEWADDR:
 		/* Iterate safely since elements may be removed */
-		for (entry = l_queue_get_entries(addr_wait_list); entry;
-				entry = next) {
-			struct l_netconfig *nc = entry->data;
-
-			next = entry->next;
-
-			if (ifa->ifa_index == nc->ifindex)
-				netconfig_ifaddr_ipv6_added(nc, ifa, bytes);
+		for (nc = l_hashmap_lookup(addr_wait_map,
+						L_UINT_TO_PTR(ifa->ifa_index));
+				nc; nc = next) {
+			next = nc->addr_wait_next;
+			netconfig_ifaddr_ipv6_added(nc, ifa, bytes);
 		}
 
 		break;
@@ -1936,6 +2384,13 @@ static void netconfig_ifaddr_ipv6_dump_cb(int error, uint16_t type,
 static void netconfig_ifaddr_ipv6_dump_done_cb(void *user_data)
 {
 	struct l_netconfig *nc = user_data;
+	static const struct l_sysctl_u32_setting regen_ll[] = {
+		/* "do not generate a link-local address" */
+		{ "addr_gen_mode", 1 },
+		/* "generate address based on EUI64 (default)" */
+		{ "addr_gen_mode", 0 },
+	};
+	char ifname[IF_NAMESIZE];
 	int r;
 
 	/*
@@ -1952,10 +2407,9 @@ static void netconfig_ifaddr_ipv6_dump_done_cb(void *user_data)
 
 	nc->ifaddr6_dump_cmd_id = 0;
 
-	/* "do not generate a link-local address" */
-	netconfig_proc_write_ipv6_uint_setting(nc, "addr_gen_mode", 1);
-	/* "generate address based on EUI64 (default)" */
-	netconfig_proc_write_ipv6_uint_setting(nc, "addr_gen_mode", 0);
+	if (if_indextoname(nc->ifindex, ifname))
+		l_sysctl_set_u32_batch(regen_ll, L_ARRAY_SIZE(regen_ll),
+					"/proc/sys/net/ipv6/conf/%s", ifname);
 
 	/* "enable IPv6 operation" */
 	r = netconfig_proc_read_ipv6_uint_setting(nc, "disable_ipv6",
@@ -1978,6 +2432,8 @@ LIB_EXPORT bool l_netconfig_start(struct l_netconfig *netconfig)
 	if (!netconfig_check_config(netconfig))
 		return false;
 
+	netconfig_trace(netconfig, AF_UNSPEC, L_NETCONFIG_TRACE_START);
+
 	if (!l_net_get_mac_address(netconfig->ifindex, netconfig->mac))
 		return false;
 
@@ -2045,7 +2501,7 @@ configure_ipv6:
 	netconfig->v6_auto_method = NETCONFIG_V6_METHOD_UNSET;
 
 	/*
-	 * We only care about being on addr_wait_list if we're waiting for
+	 * We only care about being on addr_wait_map if we're waiting for
 	 * the link-local address for DHCP6.  Add ourself to the list here
 	 * before we start the dump, instead of after it ends, to eliminate
 	 * the possibility of missing an RTM_NEWADDR between the end of
@@ -2054,12 +2510,12 @@ configure_ipv6:
 	 * We stay on that list until we receive a non-tentative LL address.
 	 * Note that we may set .have_lla earlier, specifically when we
 	 * receive a tentative LL address that is also optimistic.  We will
-	 * however stay on addr_wait_list because we want to notify
+	 * however stay on addr_wait_map because we want to notify
 	 * l_icmp6_client again when the LL address completes DAD and becomes
 	 * non-tentative.
 	 */
-	if (!addr_wait_list) {
-		addr_wait_list = l_queue_new();
+	if (!addr_wait_map) {
+		addr_wait_map = l_hashmap_new();
 
 		rtnl_id = l_netlink_register(l_rtnl_get(), RTNLGRP_IPV6_IFADDR,
 						netconfig_ifaddr_ipv6_notify,
@@ -2075,7 +2531,7 @@ configure_ipv6:
 	if (!netconfig->ifaddr6_dump_cmd_id)
 		goto unregister;
 
-	l_queue_push_tail(addr_wait_list, netconfig);
+	netconfig_addr_wait_add(netconfig);
 	netconfig->have_lla = false;
 
 	l_dhcp6_client_set_address(netconfig->dhcp6_client, ARPHRD_ETHER,
@@ -2104,6 +2560,16 @@ configure_ipv6:
 	netconfig->ra_timeout = l_timeout_create(10, netconfig_ra_timeout_cb,
 							netconfig, NULL);
 
+	/*
+	 * Apply the state loaded with l_netconfig_load_ipv6_state() while
+	 * the Router Solicitation is out, the real RA is still required
+	 * within the same timeout and reconciles it.
+	 */
+	if (netconfig->v6_cached_ra)
+		netconfig->do_cached_ra_work = l_idle_create(
+						netconfig_do_cached_ra,
+						netconfig, NULL);
+
 done:
 	netconfig->started = true;
 	return true;
@@ -2139,6 +2605,13 @@ LIB_EXPORT void l_netconfig_stop(struct l_netconfig *netconfig)
 	if (netconfig->ra_timeout)
 		l_timeout_remove(l_steal_ptr(netconfig->ra_timeout));
 
+	if (netconfig->do_cached_ra_work)
+		l_idle_remove(l_steal_ptr(netconfig->do_cached_ra_work));
+
+	if (netconfig->v6_cached_ra)
+		_icmp6_router_free(l_steal_ptr(netconfig->v6_cached_ra));
+
+	netconfig_update_cancel(netconfig);
 	netconfig_addr_wait_unregister(netconfig, false);
 
 	netconfig_update_cleanup(netconfig);
@@ -2146,6 +2619,7 @@ LIB_EXPORT void l_netconfig_stop(struct l_netconfig *netconfig)
 			(l_queue_destroy_func_t) l_rtnl_address_free);
 	l_queue_clear(netconfig->routes.current,
 			(l_queue_destroy_func_t) l_rtnl_route_free);
+	netconfig_route_expiry_clear(netconfig);
 	l_queue_clear(netconfig->icmp_route_data, l_free);
 	l_queue_clear(netconfig->slaac_dnses, l_free);
 	l_queue_clear(netconfig->slaac_domains, l_free);
@@ -2218,6 +2692,7 @@ LIB_EXPORT void l_netconfig_unconfigure(struct l_netconfig *netconfig)
 	l_queue_clear(netconfig->routes.added, NULL);
 	l_queue_clear(netconfig->routes.updated, NULL);
 	l_queue_clear(netconfig->routes.current, NULL);
+	netconfig_route_expiry_clear(netconfig);
 	l_queue_clear(netconfig->icmp_route_data, l_free);
 
 	if (!l_queue_isempty(netconfig->addresses.removed) ||
@@ -2269,41 +2744,276 @@ LIB_EXPORT void l_netconfig_set_event_handler(struct l_netconfig *netconfig,
 	netconfig->handler.destroy = destroy;
 }
 
-LIB_EXPORT void l_netconfig_apply_rtnl(struct l_netconfig *netconfig)
+static void netconfig_dhcp_trace(struct l_dhcp_client *client,
+					uint8_t msg_type, void *user_data)
+{
+	struct l_netconfig *nc = user_data;
+
+	switch (msg_type) {
+	case DHCP_MESSAGE_TYPE_DISCOVER:
+		netconfig_trace(nc, AF_INET, L_NETCONFIG_TRACE_DHCP_DISCOVER);
+		break;
+	case DHCP_MESSAGE_TYPE_OFFER:
+		netconfig_trace(nc, AF_INET, L_NETCONFIG_TRACE_DHCP_OFFER);
+		break;
+	case DHCP_MESSAGE_TYPE_ACK:
+		netconfig_trace(nc, AF_INET, L_NETCONFIG_TRACE_DHCP_ACK);
+		break;
+	}
+}
+
+/*
+ * Report the time at which each step of the configuration is reached, see
+ * enum l_netconfig_trace_point.  Only meant for measurements, the
+ * configuration itself is only signalled through the event handler.
+ */
+LIB_EXPORT void l_netconfig_set_trace_handler(struct l_netconfig *netconfig,
+					l_netconfig_trace_cb_t handler,
+					void *user_data,
+					l_netconfig_destroy_cb_t destroy)
+{
+	if (unlikely(!netconfig))
+		return;
+
+	if (netconfig->trace.destroy)
+		netconfig->trace.destroy(netconfig->trace.user_data);
+
+	netconfig->trace.callback = handler;
+	netconfig->trace.user_data = user_data;
+	netconfig->trace.destroy = destroy;
+
+	_dhcp_client_set_trace(netconfig->dhcp_client,
+				handler ? netconfig_dhcp_trace : NULL,
+				netconfig);
+}
+
+struct netconfig_apply {
+	unsigned int pending;
+	int error;
+	l_netconfig_apply_cb_t callback;
+	void *user_data;
+	l_netconfig_destroy_cb_t destroy;
+};
+
+static void netconfig_apply_unref(void *user_data)
+{
+	struct netconfig_apply *apply = user_data;
+
+	if (--apply->pending)
+		return;
+
+	if (apply->callback)
+		apply->callback(apply->error, apply->user_data);
+
+	if (apply->destroy)
+		apply->destroy(apply->user_data);
+
+	l_free(apply);
+}
+
+static void netconfig_apply_add_cb(int error, uint16_t type,
+					const void *data, uint32_t len,
+					void *user_data)
+{
+	struct netconfig_apply *apply = user_data;
+
+	if (error < 0 && !apply->error)
+		apply->error = error;
+}
+
+/* Whatever we were deleting may already be gone, e.g. with the link */
+static void netconfig_apply_delete_cb(int error, uint16_t type,
+					const void *data, uint32_t len,
+					void *user_data)
+{
+	if (L_IN_SET(error, -ESRCH, -ENOENT, -EADDRNOTAVAIL, -ENODEV))
+		return;
+
+	netconfig_apply_add_cb(error, type, data, len, user_data);
+}
+
+static void netconfig_apply_sent(struct netconfig_apply *apply, uint32_t id)
+{
+	if (id)
+		apply->pending++;
+	else if (!apply->error)
+		apply->error = -EIO;
+}
+
+static bool netconfig_address_same_key(const struct l_rtnl_address *a,
+					const struct l_rtnl_address *b)
+{
+	uint8_t family = l_rtnl_address_get_family(a);
+
+	return family == l_rtnl_address_get_family(b) &&
+		l_rtnl_address_get_prefix_length(a) ==
+		l_rtnl_address_get_prefix_length(b) &&
+		!memcmp(l_rtnl_address_get_in_addr(a),
+			l_rtnl_address_get_in_addr(b),
+			family == AF_INET ? 4 : 16);
+}
+
+static bool netconfig_route_same_key(const struct l_rtnl_route *a,
+					const struct l_rtnl_route *b)
+{
+	uint8_t family = l_rtnl_route_get_family(a);
+	uint8_t a_prefix_len;
+	uint8_t b_prefix_len;
+	const void *a_dst = l_rtnl_route_get_dst_in_addr(a, &a_prefix_len);
+	const void *b_dst = l_rtnl_route_get_dst_in_addr(b, &b_prefix_len);
+
+	return family == l_rtnl_route_get_family(b) &&
+		l_rtnl_route_get_priority(a) == l_rtnl_route_get_priority(b) &&
+		a_prefix_len == b_prefix_len &&
+		!memcmp(a_dst, b_dst, family == AF_INET ? 4 : 16);
+}
+
+/*
+ * A delete followed by an add of the same address or route is sent as the
+ * add alone, which replaces the kernel object in place instead of briefly
+ * removing it.
+ */
+static bool netconfig_address_replaced(struct l_netconfig *nc,
+					const struct l_rtnl_address *addr)
 {
 	const struct l_queue_entry *entry;
 
-	for (entry = l_queue_get_entries(netconfig->addresses.removed); entry;
+	for (entry = l_queue_get_entries(nc->addresses.added); entry;
 			entry = entry->next)
-		l_rtnl_ifaddr_delete(l_rtnl_get(), netconfig->ifindex,
-					entry->data, NULL, NULL, NULL);
+		if (netconfig_address_same_key(entry->data, addr))
+			return true;
 
-	for (entry = l_queue_get_entries(netconfig->addresses.added); entry;
+	for (entry = l_queue_get_entries(nc->addresses.updated); entry;
+			entry = entry->next)
+		if (netconfig_address_same_key(entry->data, addr))
+			return true;
+
+	return false;
+}
+
+static bool netconfig_route_replaced(struct l_netconfig *nc,
+					const struct l_rtnl_route *route)
+{
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(nc->routes.added); entry;
 			entry = entry->next)
-		l_rtnl_ifaddr_add(l_rtnl_get(), netconfig->ifindex,
-					entry->data, NULL, NULL, NULL);
+		if (netconfig_route_same_key(entry->data, route))
+			return true;
+
+	for (entry = l_queue_get_entries(nc->routes.updated); entry;
+			entry = entry->next)
+		if (netconfig_route_same_key(entry->data, route))
+			return true;
+
+	return false;
+}
+
+/*
+ * Commit the changes of the current event to the kernel.  Only the
+ * difference is sent: deletes made redundant by a replacing add are
+ * dropped and objects both added and updated are sent once.  All the
+ * commands are queued before returning to the main loop so they go out to
+ * the kernel together in as few datagrams as possible.  @callback is called
+ * once all of them have been acknowledged with the first error, if any.
+ * Deletes of objects that are already gone don't count as errors.  There's
+ * no rollback, on error the interface is left with whatever changes did
+ * succeed.
+ */
+LIB_EXPORT bool l_netconfig_apply_rtnl_full(struct l_netconfig *netconfig,
+					l_netconfig_apply_cb_t callback,
+					void *user_data,
+					l_netconfig_destroy_cb_t destroy)
+{
+	struct l_netlink *rtnl = l_rtnl_get();
+	struct netconfig_apply *apply;
+	const struct l_queue_entry *entry;
+	uint32_t id;
+
+	if (unlikely(!netconfig || !rtnl))
+		return false;
+
+	apply = l_new(struct netconfig_apply, 1);
+	apply->callback = callback;
+	apply->user_data = user_data;
+	apply->destroy = destroy;
+
+	/* Held until all commands are queued */
+	apply->pending = 1;
+
+	for (entry = l_queue_get_entries(netconfig->addresses.removed); entry;
+			entry = entry->next) {
+		if (netconfig_address_replaced(netconfig, entry->data))
+			continue;
+
+		id = l_rtnl_ifaddr_delete(rtnl, netconfig->ifindex,
+						entry->data,
+						netconfig_apply_delete_cb,
+						apply, netconfig_apply_unref);
+		netconfig_apply_sent(apply, id);
+	}
+
+	for (entry = l_queue_get_entries(netconfig->addresses.added); entry;
+			entry = entry->next) {
+		id = l_rtnl_ifaddr_add(rtnl, netconfig->ifindex, entry->data,
+					netconfig_apply_add_cb,
+					apply, netconfig_apply_unref);
+		netconfig_apply_sent(apply, id);
+	}
 
 	/* We can use l_rtnl_ifaddr_add here since that uses NLM_F_REPLACE */
 	for (entry = l_queue_get_entries(netconfig->addresses.updated); entry;
-			entry = entry->next)
-		l_rtnl_ifaddr_add(l_rtnl_get(), netconfig->ifindex,
-					entry->data, NULL, NULL, NULL);
+			entry = entry->next) {
+		if (netconfig_address_exists(netconfig->addresses.added,
+						entry->data))
+			continue;
+
+		id = l_rtnl_ifaddr_add(rtnl, netconfig->ifindex, entry->data,
+					netconfig_apply_add_cb,
+					apply, netconfig_apply_unref);
+		netconfig_apply_sent(apply, id);
+	}
 
 	for (entry = l_queue_get_entries(netconfig->routes.removed); entry;
-			entry = entry->next)
-		l_rtnl_route_delete(l_rtnl_get(), netconfig->ifindex,
-					entry->data, NULL, NULL, NULL);
+			entry = entry->next) {
+		if (netconfig_route_replaced(netconfig, entry->data))
+			continue;
+
+		id = l_rtnl_route_delete(rtnl, netconfig->ifindex,
+						entry->data,
+						netconfig_apply_delete_cb,
+						apply, netconfig_apply_unref);
+		netconfig_apply_sent(apply, id);
+	}
 
 	for (entry = l_queue_get_entries(netconfig->routes.added); entry;
-			entry = entry->next)
-		l_rtnl_route_add(l_rtnl_get(), netconfig->ifindex,
-					entry->data, NULL, NULL, NULL);
+			entry = entry->next) {
+		id = l_rtnl_route_add(rtnl, netconfig->ifindex, entry->data,
+					netconfig_apply_add_cb,
+					apply, netconfig_apply_unref);
+		netconfig_apply_sent(apply, id);
+	}
 
 	/* We can use l_rtnl_route_add here since that uses NLM_F_REPLACE */
 	for (entry = l_queue_get_entries(netconfig->routes.updated); entry;
-			entry = entry->next)
-		l_rtnl_route_add(l_rtnl_get(), netconfig->ifindex,
-					entry->data, NULL, NULL, NULL);
+			entry = entry->next) {
+		if (netconfig_route_exists(netconfig->routes.added,
+						entry->data))
+			continue;
+
+		id = l_rtnl_route_add(rtnl, netconfig->ifindex, entry->data,
+					netconfig_apply_add_cb,
+					apply, netconfig_apply_unref);
+		netconfig_apply_sent(apply, id);
+	}
+
+	netconfig_apply_unref(apply);
+	return true;
+}
+
+LIB_EXPORT void l_netconfig_apply_rtnl(struct l_netconfig *netconfig)
+{
+	l_netconfig_apply_rtnl_full(netconfig, NULL, NULL, NULL);
 }
 
 LIB_EXPORT const struct l_queue_entry *l_netconfig_get_addresses(
@@ -2488,3 +3198,293 @@ append_v6:
 done:
 	return ret;
 }
+
+static char *netconfig_prefix_to_str(const uint8_t *addr, uint8_t prefix_len)
+{
+	char buf[INET6_ADDRSTRLEN];
+
+	if (!inet_ntop(AF_INET6, addr, buf, sizeof(buf)))
+		return NULL;
+
+	return l_strdup_printf("%s/%u", buf, prefix_len);
+}
+
+static bool netconfig_prefix_from_str(const char *str, uint8_t *out_addr,
+					uint8_t *out_prefix_len)
+{
+	const char *slash = strchr(str, '/');
+	_auto_(l_free) char *addr = NULL;
+	char *endp;
+	unsigned long prefix_len;
+
+	if (!slash)
+		return false;
+
+	addr = l_strndup(str, slash - str);
+	if (inet_pton(AF_INET6, addr, out_addr) != 1)
+		return false;
+
+	prefix_len = strtoul(slash + 1, &endp, 10);
+	if (*endp || endp == slash + 1 || prefix_len > 128)
+		return false;
+
+	*out_prefix_len = prefix_len;
+	return true;
+}
+
+/*
+ * Save the Router Advertisement information received in the current
+ * session under @group, which would normally identify the network, e.g.
+ * contain the SSID or the gateway's MAC address.  Must be called before
+ * l_netconfig_stop().  Lifetimes are not saved since the state is only
+ * ever applied with short lifetimes, see l_netconfig_load_ipv6_state().
+ */
+LIB_EXPORT bool l_netconfig_save_ipv6_state(struct l_netconfig *netconfig,
+						struct l_settings *settings,
+						const char *group)
+{
+	const struct l_icmp6_router *r;
+	_auto_(l_strv_builder_free) struct l_strv_builder *routes = NULL;
+	_auto_(l_strv_builder_free) struct l_strv_builder *onlink = NULL;
+	_auto_(l_strv_builder_free) struct l_strv_builder *prefixes = NULL;
+	_auto_(l_strv_builder_free) struct l_strv_builder *dnses = NULL;
+	_auto_(l_strv_builder_free) struct l_strv_builder *domains = NULL;
+	char buf[INET6_ADDRSTRLEN];
+	char **list;
+	unsigned int i;
+
+	if (unlikely(!netconfig || !settings || !group))
+		return false;
+
+	r = l_icmp6_client_get_router(netconfig->icmp6_client);
+	if (!r || !inet_ntop(AF_INET6, r->address, buf, sizeof(buf)))
+		return false;
+
+	routes = l_strv_builder_new(r->n_routes);
+	onlink = l_strv_builder_new(r->n_routes);
+	prefixes = l_strv_builder_new(r->n_ac_prefixes);
+	dnses = l_strv_builder_new(r->n_dns);
+	domains = l_strv_builder_new(r->n_domains);
+
+	for (i = 0; i < r->n_routes; i++) {
+		const struct route_info *info = &r->routes[i];
+		char *str;
+
+		if (!info->valid_lifetime)
+			continue;
+
+		str = netconfig_prefix_to_str(info->address, info->prefix_len);
+		if (!str)
+			continue;
+
+		l_strv_builder_append(info->onlink ? onlink : routes, str);
+		l_free(str);
+	}
+
+	for (i = 0; i < r->n_ac_prefixes; i++) {
+		uint8_t addr[16] = {};
+		char *str;
+
+		if (!r->ac_prefixes[i].valid_lifetime)
+			continue;
+
+		memcpy(addr, r->ac_prefixes[i].prefix, 8);
+		str = netconfig_prefix_to_str(addr, 64);
+		if (!str)
+			continue;
+
+		l_strv_builder_append(prefixes, str);
+		l_free(str);
+	}
+
+	for (i = 0; i < r->n_dns; i++) {
+		char dns[INET6_ADDRSTRLEN];
+
+		if (r->dns_list[i].lifetime &&
+				inet_ntop(AF_INET6, r->dns_list[i].address,
+						dns, sizeof(dns)))
+			l_strv_builder_append(dnses, dns);
+	}
+
+	for (i = 0; i < r->n_domains; i++)
+		if (r->domains[i].lifetime)
+			l_strv_builder_append(domains, r->domains[i].domain);
+
+	l_settings_remove_group(settings, group);
+	l_settings_set_string(settings, group, "Router", buf);
+	l_settings_set_bool(settings, group, "DefaultRouter", !!r->lifetime);
+	l_settings_set_uint(settings, group, "Preference", r->pref);
+	l_settings_set_uint(settings, group, "MTU", r->mtu);
+	l_settings_set_bool(settings, group, "Managed",
+				l_icmp6_router_get_managed(r));
+	l_settings_set_bool(settings, group, "Other",
+				l_icmp6_router_get_other(r));
+
+	list = l_strv_builder_unwrap(l_steal_ptr(routes));
+	l_settings_set_string_list(settings, group, "Routes", list, ',');
+	l_strv_free(list);
+
+	list = l_strv_builder_unwrap(l_steal_ptr(onlink));
+	l_settings_set_string_list(settings, group, "OnLinkPrefixes", list,
+					',');
+	l_strv_free(list);
+
+	list = l_strv_builder_unwrap(l_steal_ptr(prefixes));
+	l_settings_set_string_list(settings, group, "AutoconfPrefixes", list,
+					',');
+	l_strv_free(list);
+
+	list = l_strv_builder_unwrap(l_steal_ptr(dnses));
+	l_settings_set_string_list(settings, group, "DNS", list, ',');
+	l_strv_free(list);
+
+	list = l_strv_builder_unwrap(l_steal_ptr(domains));
+	l_settings_set_string_list(settings, group, "Domains", list, ',');
+	l_strv_free(list);
+
+	return true;
+}
+
+static void netconfig_load_routes(struct l_icmp6_router *r,
+					const struct l_settings *settings,
+					const char *group, const char *key,
+					bool onlink)
+{
+	_auto_(l_strv_free) char **list =
+		l_settings_get_string_list(settings, group, key, ',');
+	unsigned int n = l_strv_length(list);
+	unsigned int i;
+
+	if (!n)
+		return;
+
+	r->routes = l_realloc(r->routes,
+				sizeof(struct route_info) * (r->n_routes + n));
+
+	for (i = 0; i < n; i++) {
+		struct route_info *info = &r->routes[r->n_routes];
+
+		memset(info, 0, sizeof(*info));
+
+		if (!netconfig_prefix_from_str(list[i], info->address,
+						&info->prefix_len))
+			continue;
+
+		info->onlink = onlink;
+		info->valid_lifetime = cached_ra_lifetime;
+		r->n_routes++;
+	}
+}
+
+/*
+ * Load the state saved with l_netconfig_save_ipv6_state() on an earlier
+ * connection to the same network.  On the next l_netconfig_start() it is
+ * applied right away, before any Router Advertisement is received, with
+ * all lifetimes capped to a few seconds.  When the real RA arrives the
+ * cached state is reconciled with it: routes and addresses it refreshes
+ * get their real lifetimes, DNS information it doesn't confirm is
+ * dropped and the SLAAC address is replaced if its prefix is gone.
+ * DHCPv6, if the network uses it, is still only started after the real
+ * RA.  The state is used for one l_netconfig_start() call.
+ */
+LIB_EXPORT bool l_netconfig_load_ipv6_state(struct l_netconfig *netconfig,
+					const struct l_settings *settings,
+					const char *group)
+{
+	struct l_icmp6_router *r;
+	_auto_(l_free) char *router = NULL;
+	_auto_(l_strv_free) char **prefixes = NULL;
+	_auto_(l_strv_free) char **dnses = NULL;
+	_auto_(l_strv_free) char **domains = NULL;
+	bool default_router = false;
+	bool managed = false;
+	bool other = false;
+	unsigned int pref = 0;
+	unsigned int mtu = 0;
+	unsigned int i;
+
+	if (unlikely(!netconfig || netconfig->started || !settings || !group))
+		return false;
+
+	router = l_settings_get_string(settings, group, "Router");
+	if (!router)
+		return false;
+
+	r = _icmp6_router_new();
+
+	if (inet_pton(AF_INET6, router, r->address) != 1)
+		goto error;
+
+	l_settings_get_bool(settings, group, "DefaultRouter", &default_router);
+	l_settings_get_bool(settings, group, "Managed", &managed);
+	l_settings_get_bool(settings, group, "Other", &other);
+	l_settings_get_uint(settings, group, "Preference", &pref);
+	l_settings_get_uint(settings, group, "MTU", &mtu);
+
+	r->managed = managed;
+	r->other = other;
+	r->pref = pref;
+	r->mtu = mtu;
+	r->lifetime = default_router ? cached_ra_lifetime : 0;
+
+	netconfig_load_routes(r, settings, group, "Routes", false);
+	netconfig_load_routes(r, settings, group, "OnLinkPrefixes", true);
+
+	prefixes = l_settings_get_string_list(settings, group,
+						"AutoconfPrefixes", ',');
+	r->ac_prefixes = l_new(struct autoconf_prefix_info,
+				l_strv_length(prefixes));
+
+	for (i = 0; prefixes && prefixes[i]; i++) {
+		struct autoconf_prefix_info *info =
+			&r->ac_prefixes[r->n_ac_prefixes];
+		uint8_t addr[16];
+		uint8_t prefix_len;
+
+		if (!netconfig_prefix_from_str(prefixes[i], addr,
+						&prefix_len) ||
+				prefix_len != 64)
+			continue;
+
+		memcpy(info->prefix, addr, 8);
+		info->preferred_lifetime = cached_ra_lifetime;
+		info->valid_lifetime = cached_ra_lifetime;
+		r->n_ac_prefixes++;
+	}
+
+	/* Same check as for the first real RA, one method must be usable */
+	if (!r->managed && !r->n_ac_prefixes)
+		goto error;
+
+	dnses = l_settings_get_string_list(settings, group, "DNS", ',');
+	r->dns_list = l_new(struct dns_info, l_strv_length(dnses));
+
+	for (i = 0; dnses && dnses[i]; i++) {
+		struct dns_info *info = &r->dns_list[r->n_dns];
+
+		if (inet_pton(AF_INET6, dnses[i], info->address) != 1)
+			continue;
+
+		info->lifetime = cached_ra_lifetime;
+		r->n_dns++;
+	}
+
+	domains = l_settings_get_string_list(settings, group, "Domains", ',');
+	r->domains = l_new(struct domain_info, l_strv_length(domains));
+
+	for (i = 0; domains && domains[i]; i++) {
+		r->domains[i].domain = l_strdup(domains[i]);
+		r->domains[i].lifetime = cached_ra_lifetime;
+		r->n_domains++;
+	}
+
+	if (netconfig->v6_cached_ra)
+		_icmp6_router_free(netconfig->v6_cached_ra);
+
+	netconfig->v6_cached_ra = r;
+	return true;
+
+error:
+	_icmp6_router_free(r);
+	return false;
+}
@@ -22,6 +22,7 @@ struct l_queue_entry;
 struct l_netconfig;
 struct l_rtnl_address;
 struct l_rtnl_route;
+struct l_settings;
 
 enum l_netconfig_event {
 	L_NETCONFIG_EVENT_CONFIGURE,
@@ -34,7 +35,30 @@ typedef void (*l_netconfig_event_cb_t)(struct l_netconfig *netconfig,
 					uint8_t family,
 					enum l_netconfig_event event,
 					void *user_data);
+/*
+ * Milestones of the configuration process, reported with the time they
+ * were reached to measure where time-to-address is spent
+ */
+enum l_netconfig_trace_point {
+	L_NETCONFIG_TRACE_START,
+	L_NETCONFIG_TRACE_DHCP_DISCOVER,
+	L_NETCONFIG_TRACE_DHCP_OFFER,
+	L_NETCONFIG_TRACE_DHCP_ACK,
+	L_NETCONFIG_TRACE_ACD_DONE,
+	L_NETCONFIG_TRACE_LINK_LOCAL,
+	L_NETCONFIG_TRACE_DAD_DONE,
+	L_NETCONFIG_TRACE_ROUTER_FOUND,
+	L_NETCONFIG_TRACE_DHCP6_LEASE,
+	L_NETCONFIG_TRACE_CONFIGURE,
+};
+
+typedef void (*l_netconfig_trace_cb_t)(struct l_netconfig *netconfig,
+					uint8_t family,
+					enum l_netconfig_trace_point point,
+					uint64_t timestamp,
+					void *user_data);
 typedef void (*l_netconfig_destroy_cb_t)(void *user_data);
+typedef void (*l_netconfig_apply_cb_t)(int error, void *user_data);
 
 struct l_netconfig *l_netconfig_new(uint32_t ifindex);
 void l_netconfig_destroy(struct l_netconfig *netconfig);
@@ -56,6 +80,8 @@ bool l_netconfig_set_domain_names_override(struct l_netconfig *netconfig,
 bool l_netconfig_set_acd_enabled(struct l_netconfig *netconfig, bool enabled);
 bool l_netconfig_set_optimistic_dad_enabled(struct l_netconfig *netconfig,
 						bool enabled);
+bool l_netconfig_set_update_settle_time(struct l_netconfig *netconfig,
+					unsigned int settle_ms);
 bool l_netconfig_check_config(struct l_netconfig *netconfig);
 bool l_netconfig_reset_config(struct l_netconfig *netconfig);
 
@@ -74,8 +100,16 @@ void l_netconfig_set_event_handler(struct l_netconfig *netconfig,
 					l_netconfig_event_cb_t handler,
 					void *user_data,
 					l_netconfig_destroy_cb_t destroy);
+void l_netconfig_set_trace_handler(struct l_netconfig *netconfig,
+					l_netconfig_trace_cb_t handler,
+					void *user_data,
+					l_netconfig_destroy_cb_t destroy);
 
 void l_netconfig_apply_rtnl(struct l_netconfig *netconfig);
+bool l_netconfig_apply_rtnl_full(struct l_netconfig *netconfig,
+					l_netconfig_apply_cb_t callback,
+					void *user_data,
+					l_netconfig_destroy_cb_t destroy);
 const struct l_queue_entry *l_netconfig_get_addresses(
 				struct l_netconfig *netconfig,
 				const struct l_queue_entry **out_added,
@@ -91,6 +125,13 @@ const struct l_queue_entry *l_netconfig_get_routes(
 char **l_netconfig_get_dns_list(struct l_netconfig *netconfig);
 char **l_netconfig_get_domain_names(struct l_netconfig *netconfig);
 
+bool l_netconfig_save_ipv6_state(struct l_netconfig *netconfig,
+					struct l_settings *settings,
+					const char *group);
+bool l_netconfig_load_ipv6_state(struct l_netconfig *netconfig,
+					const struct l_settings *settings,
+					const char *group);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,6 +20,10 @@
 #define NLA_DATA(nla)		((void*)(((char*)(nla)) + NLA_LENGTH(0)))
 #define NLA_PAYLOAD(nla)	((int)((nla)->nla_len) - NLA_LENGTH(0))
 
+#ifndef NETLINK_GET_STRICT_CHK
+#define NETLINK_GET_STRICT_CHK 12
+#endif
+
 #ifndef NETLINK_EXT_ACK
 #define NETLINK_EXT_ACK 11
 enum nlmsgerr_attrs {
@@ -50,3 +54,16 @@ int netlink_message_reserve_header(struct l_netlink_message *message,
 					size_t header_len, void **out_header);
 struct l_netlink_message *netlink_message_from_nlmsg(
 						const struct nlmsghdr *nlmsg);
+
+struct l_netlink_stats;
+struct netlink_capture;
+
+struct netlink_capture *netlink_capture_open(const char *path);
+void netlink_capture_close(struct netlink_capture *capture);
+bool netlink_capture_write(struct netlink_capture *capture, int protocol,
+				bool outgoing, const void *data, size_t len);
+
+void netlink_stats_add_latency(struct l_netlink_stats *stats,
+					uint64_t latency);
+void netlink_stats_set_queue_depth(struct l_netlink_stats *stats,
+					uint32_t depth);
@@ -9,8 +9,13 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <linux/netlink.h>
 #include <limits.h>
 
@@ -18,9 +23,29 @@
 #include "hashmap.h"
 #include "queue.h"
 #include "io.h"
+#include "time.h"
+#include "log.h"
+#include "util.h"
 #include "private.h"
 #include "netlink-private.h"
+#include "memory-private.h"
 #include "netlink.h"
+#include "probe-private.h"
+
+/*
+ * Datagrams fetched per recvmmsg call and the size of each buffer.  The
+ * kernel sizes dump datagrams after the largest buffer seen, so anything
+ * above a page means fewer and fuller datagrams during large dumps.
+ */
+#define NETLINK_RECV_BATCH 8
+#define NETLINK_RECV_SIZE 8192
+
+/* Datagrams handled per wakeup before giving other sources a turn */
+#define NETLINK_RECV_BUDGET 64
+
+/* Upper bounds on the commands and bytes packed into one datagram */
+#define NETLINK_SEND_BATCH 64
+#define NETLINK_SEND_BUDGET 32768
 
 struct command {
 	unsigned int id;
@@ -28,6 +53,8 @@ struct command {
 	l_netlink_destroy_func_t destroy;
 	void *user_data;
 	struct l_netlink_message *message;
+	uint64_t sent_time;
+	struct l_netlink_dump *dump;
 };
 
 struct notify {
@@ -37,9 +64,20 @@ struct notify {
 	void *user_data;
 };
 
+/*
+ * A socket that only receives notifications, either of one group or of
+ * every group without a socket of its own when @group is 0.
+ */
+struct notify_sock {
+	uint32_t group;
+	struct l_io *io;
+};
+
 struct l_netlink {
+	int protocol;
 	uint32_t pid;
 	struct l_io *io;
+	struct l_queue *notify_socks;
 	uint32_t next_seq;
 	struct l_queue *command_queue;
 	struct l_hashmap *command_pending;
@@ -51,6 +89,37 @@ struct l_netlink {
 	l_netlink_debug_func_t debug_handler;
 	l_netlink_destroy_func_t debug_destroy;
 	void *debug_data;
+	l_netlink_overrun_func_t overrun_handler;
+	l_netlink_destroy_func_t overrun_destroy;
+	void *overrun_data;
+	unsigned char *recv_buf;
+	struct l_netlink_stats *stats;
+	struct l_hashmap *type_stats;
+	struct netlink_capture *capture;
+	unsigned int read_blocked;
+	bool *destroyed;
+};
+
+struct dump_entry {
+	uint16_t type;
+	uint32_t len;
+	uint8_t data[];
+};
+
+struct l_netlink_dump {
+	struct l_netlink *netlink;
+	unsigned int id;
+	unsigned int max_queued;
+	struct l_queue *entries;
+	struct dump_entry *current;
+	int error;
+	bool done : 1;
+	bool blocking : 1;
+	bool waiting : 1;
+	bool freeing : 1;
+	l_netlink_dump_ready_func_t ready;
+	l_netlink_destroy_func_t destroy;
+	void *user_data;
 };
 
 static void destroy_command(void *data)
@@ -81,40 +150,191 @@ static void destroy_notify_group(void *data)
 	l_hashmap_destroy(notify_list, destroy_notify);
 }
 
+static void destroy_notify_sock(void *data)
+{
+	struct notify_sock *sock = data;
+
+	l_io_destroy(sock->io);
+	l_free(sock);
+}
+
+static bool match_notify_sock(const void *a, const void *b)
+{
+	const struct notify_sock *sock = a;
+
+	return sock->group == L_PTR_TO_UINT(b);
+}
+
+/* The socket holding the membership of @group */
+static struct l_io *group_io(struct l_netlink *netlink, uint32_t group)
+{
+	struct notify_sock *sock;
+
+	sock = l_queue_find(netlink->notify_socks, match_notify_sock,
+						L_UINT_TO_PTR(group));
+	if (!sock)
+		sock = l_queue_find(netlink->notify_socks, match_notify_sock,
+							L_UINT_TO_PTR(0));
+
+	return sock ? sock->io : netlink->io;
+}
+
+static struct l_netlink_type_stats *type_stats_get(struct l_netlink *netlink,
+							uint16_t type)
+{
+	struct l_netlink_type_stats *stats;
+
+	stats = l_hashmap_lookup(netlink->type_stats, L_UINT_TO_PTR(type));
+	if (stats)
+		return stats;
+
+	stats = l_new(struct l_netlink_type_stats, 1);
+	stats->type = type;
+	l_hashmap_insert(netlink->type_stats, L_UINT_TO_PTR(type), stats);
+
+	return stats;
+}
+
+static void stats_command_sent(struct l_netlink *netlink,
+					struct command *command)
+{
+	if (!netlink->stats)
+		return;
+
+	command->sent_time = l_time_now();
+	netlink->stats->requests++;
+	type_stats_get(netlink, command->message->hdr->nlmsg_type)->requests++;
+}
+
+static void stats_command_done(struct l_netlink *netlink,
+					struct command *command, int error)
+{
+	struct l_netlink_type_stats *stats;
+	uint64_t latency;
+
+	PROBE(netlink_ack, netlink, command->id, error);
+
+	if (!netlink->stats || !command->sent_time)
+		return;
+
+	latency = l_time_now() - command->sent_time;
+	stats = type_stats_get(netlink, command->message->hdr->nlmsg_type);
+
+	netlink_stats_add_latency(netlink->stats, latency);
+	stats->latency_total += latency;
+	stats->latency_max = maxsize(stats->latency_max, latency);
+
+	if (error) {
+		netlink->stats->errors++;
+		stats->errors++;
+	}
+}
+
+static void stats_dump_message(struct l_netlink *netlink,
+					struct command *command,
+					const struct nlmsghdr *nlmsg)
+{
+	struct l_netlink_type_stats *stats;
+
+	if (!netlink->stats)
+		return;
+
+	stats = type_stats_get(netlink, command->message->hdr->nlmsg_type);
+
+	netlink->stats->dump_messages++;
+	netlink->stats->dump_bytes += nlmsg->nlmsg_len;
+	stats->dump_messages++;
+	stats->dump_bytes += nlmsg->nlmsg_len;
+}
+
 static bool can_write_data(struct l_io *io, void *user_data)
 {
+	static const uint8_t padding[NLMSG_ALIGNTO];
 	struct l_netlink *netlink = user_data;
+	struct command *batch[NETLINK_SEND_BATCH];
+	struct iovec iov[NETLINK_SEND_BATCH * 2];
 	struct command *command;
 	struct nlmsghdr *hdr;
 	struct sockaddr_nl addr;
+	struct msghdr msg;
+	size_t total = 0;
+	unsigned int count = 0, n_iov = 0, i;
 	ssize_t written;
 	int sk;
 
-	command = l_queue_pop_head(netlink->command_queue);
-	if (!command)
+	/*
+	 * The kernel walks every message in a datagram, so queued commands
+	 * go out together up to the byte budget.  Each one is still matched
+	 * to its replies by sequence number.  Only one dump can run at a
+	 * time per socket, so a dump request ends the batch.
+	 */
+	while (count < NETLINK_SEND_BATCH) {
+		command = l_queue_peek_head(netlink->command_queue);
+		if (!command)
+			break;
+
+		hdr = command->message->hdr;
+
+		if (count && total + NLMSG_ALIGN(hdr->nlmsg_len) >
+							NETLINK_SEND_BUDGET)
+			break;
+
+		l_queue_pop_head(netlink->command_queue);
+		batch[count++] = command;
+
+		iov[n_iov].iov_base = hdr;
+		iov[n_iov++].iov_len = hdr->nlmsg_len;
+
+		if (NLMSG_ALIGN(hdr->nlmsg_len) != hdr->nlmsg_len) {
+			iov[n_iov].iov_base = (void *) padding;
+			iov[n_iov++].iov_len = NLMSG_ALIGN(hdr->nlmsg_len) -
+								hdr->nlmsg_len;
+		}
+
+		total += NLMSG_ALIGN(hdr->nlmsg_len);
+
+		if (hdr->nlmsg_flags & NLM_F_DUMP)
+			break;
+	}
+
+	if (!count)
 		return false;
 
-	hdr = command->message->hdr;
 	sk = l_io_get_fd(io);
 
 	memset(&addr, 0, sizeof(addr));
 	addr.nl_family = AF_NETLINK;
 	addr.nl_pid = 0;
 
-	written = sendto(sk, hdr, hdr->nlmsg_len, 0,
-			(struct sockaddr *) &addr, sizeof(addr));
-	if (written < 0 || (uint32_t) written != hdr->nlmsg_len) {
-		l_hashmap_remove(netlink->command_lookup,
-					L_UINT_TO_PTR(command->id));
-		destroy_command(command);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &addr;
+	msg.msg_namelen = sizeof(addr);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = n_iov;
+
+	written = sendmsg(sk, &msg, 0);
+	if (written < 0 || (size_t) written != total) {
+		for (i = 0; i < count; i++) {
+			l_hashmap_remove(netlink->command_lookup,
+					L_UINT_TO_PTR(batch[i]->id));
+			destroy_command(batch[i]);
+		}
+
 		return true;
 	}
 
-	l_util_hexdump(false, hdr, hdr->nlmsg_len,
+	for (i = 0; i < count; i++) {
+		hdr = batch[i]->message->hdr;
+
+		l_util_hexdump(false, hdr, hdr->nlmsg_len,
 				netlink->debug_handler, netlink->debug_data);
+		netlink_capture_write(netlink->capture, netlink->protocol,
+					true, hdr, hdr->nlmsg_len);
+		stats_command_sent(netlink, batch[i]);
 
-	l_hashmap_insert(netlink->command_pending,
-				L_UINT_TO_PTR(hdr->nlmsg_seq), command);
+		l_hashmap_insert(netlink->command_pending,
+				L_UINT_TO_PTR(hdr->nlmsg_seq), batch[i]);
+	}
 
 	return l_queue_length(netlink->command_queue) > 0;
 }
@@ -135,6 +355,9 @@ static void process_broadcast(struct l_netlink *netlink, uint32_t group,
 {
 	struct l_hashmap *notify_list;
 
+	if (netlink->stats)
+		netlink->stats->notifications++;
+
 	notify_list = l_hashmap_lookup(netlink->notify_groups,
 						L_UINT_TO_PTR(group));
 	if (!notify_list)
@@ -146,9 +369,10 @@ static void process_broadcast(struct l_netlink *netlink, uint32_t group,
 static void process_ext_ack(struct l_netlink *netlink,
 				const struct nlmsghdr *nlmsg)
 {
+	/* Every failed request comes with one, keep a flood in check */
+	static struct l_log_ratelimit ratelimit;
 	const char *err_str = NULL;
 	uint32_t err_offset = -1U;
-	_auto_(l_free) char *dbg_str = NULL;
 
 	if (!netlink->debug_handler)
 		return;
@@ -158,16 +382,44 @@ static void process_ext_ack(struct l_netlink *netlink,
 		return;
 
 	if (err_str && err_offset != -1U)
-		dbg_str = l_strdup_printf("Extended error: '%s', offset of "
+		l_util_debug_ratelimited(&ratelimit, netlink->debug_handler,
+					netlink->debug_data,
+					"Extended error: '%s', offset of "
 					" offending element within request: "
 					"%i bytes", err_str, (int) err_offset);
 	else if (err_str)
-		dbg_str = l_strdup_printf("Extended error: '%s'", err_str);
+		l_util_debug_ratelimited(&ratelimit, netlink->debug_handler,
+					netlink->debug_data,
+					"Extended error: '%s'", err_str);
 	else
-		dbg_str = l_strdup_printf("Offset of offending element within "
+		l_util_debug_ratelimited(&ratelimit, netlink->debug_handler,
+					netlink->debug_data,
+					"Offset of offending element within "
 					"request: %i bytes", (int) err_offset);
+}
+
+static int message_error(const struct nlmsghdr *nlmsg)
+{
+	const struct nlmsgerr *err = NLMSG_DATA(nlmsg);
 
-	netlink->debug_handler(dbg_str, netlink->debug_data);
+	if (nlmsg->nlmsg_type != NLMSG_ERROR)
+		return 0;
+
+	return err->error;
+}
+
+/* A failed dump ends with the error in place of the NLMSG_DONE payload */
+static int dump_done_error(const struct nlmsghdr *nlmsg)
+{
+	const int *error = NLMSG_DATA(nlmsg);
+
+	if (nlmsg->nlmsg_type == NLMSG_ERROR)
+		return message_error(nlmsg);
+
+	if (nlmsg->nlmsg_len < NLMSG_LENGTH(sizeof(int)))
+		return 0;
+
+	return *error < 0 ? *error : 0;
 }
 
 static void process_message(struct l_netlink *netlink, struct nlmsghdr *nlmsg)
@@ -180,6 +432,14 @@ static void process_message(struct l_netlink *netlink, struct nlmsghdr *nlmsg)
 	if (!command)
 		return;
 
+	stats_command_done(netlink, command, message_error(nlmsg));
+
+	if (command->dump)
+		command->dump->error = message_error(nlmsg);
+
+	/* The command is done, cancelling it from the handler is a no-op */
+	l_hashmap_remove(netlink->command_lookup, L_UINT_TO_PTR(command->id));
+
 	if (!command->handler)
 		goto done;
 
@@ -203,8 +463,6 @@ static void process_message(struct l_netlink *netlink, struct nlmsghdr *nlmsg)
 	}
 
 done:
-	l_hashmap_remove(netlink->command_lookup, L_UINT_TO_PTR(command->id));
-
 	destroy_command(command);
 }
 
@@ -219,6 +477,11 @@ static void process_multi(struct l_netlink *netlink, struct nlmsghdr *nlmsg)
 		if (!command)
 			return;
 
+		stats_command_done(netlink, command, message_error(nlmsg));
+
+		if (command->dump)
+			command->dump->error = dump_done_error(nlmsg);
+
 		l_hashmap_remove(netlink->command_lookup,
 					L_UINT_TO_PTR(command->id));
 
@@ -229,6 +492,8 @@ static void process_multi(struct l_netlink *netlink, struct nlmsghdr *nlmsg)
 		if (!command)
 			return;
 
+		stats_dump_message(netlink, command, nlmsg);
+
 		if (!command->handler)
 			return;
 
@@ -238,42 +503,23 @@ static void process_multi(struct l_netlink *netlink, struct nlmsghdr *nlmsg)
 	}
 }
 
-static bool can_read_data(struct l_io *io, void *user_data)
+/* Returns false if @netlink was destroyed by one of the handlers */
+static bool process_datagram(struct l_netlink *netlink,
+				const struct msghdr *msg, void *data,
+				uint32_t len)
 {
-	struct l_netlink *netlink = user_data;
 	struct cmsghdr *cmsg;
-	struct msghdr msg;
-	struct iovec iov;
 	struct nlmsghdr *nlmsg;
-	unsigned char buffer[4096];
-	unsigned char control[32];
 	uint32_t group = 0;
-	ssize_t len;
-	int sk;
-
-	memset(buffer, 0, sizeof(buffer));
-	memset(control, 0, sizeof(control));
-
-	sk = l_io_get_fd(io);
-
-	iov.iov_base = buffer;
-	iov.iov_len = sizeof(buffer);
-
-	memset(&msg, 0, sizeof(msg));
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-	msg.msg_control = control;
-	msg.msg_controllen = sizeof(control);
-
-	len = recvmsg(sk, &msg, 0);
-	if (len < 0)
-		return false;
+	bool destroyed = false;
 
-	l_util_hexdump(true, buffer, len, netlink->debug_handler,
+	l_util_hexdump(true, data, len, netlink->debug_handler,
 						netlink->debug_data);
+	netlink_capture_write(netlink->capture, netlink->protocol, false,
+								data, len);
 
-	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
-					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+				cmsg = CMSG_NXTHDR((struct msghdr *) msg, cmsg)) {
 		struct nl_pktinfo *pktinfo;
 
 		if (cmsg->cmsg_level != SOL_NETLINK)
@@ -287,20 +533,104 @@ static bool can_read_data(struct l_io *io, void *user_data)
 		group = pktinfo->group;
 	}
 
-	for (nlmsg = iov.iov_base; NLMSG_OK(nlmsg, (uint32_t) len);
+	netlink->destroyed = &destroyed;
+
+	for (nlmsg = data; NLMSG_OK(nlmsg, len);
 					nlmsg = NLMSG_NEXT(nlmsg, len)) {
-		if (group > 0) {
+		if (group > 0)
 			process_broadcast(netlink, group, nlmsg);
+		else if (nlmsg->nlmsg_pid != netlink->pid)
 			continue;
+		else if (nlmsg->nlmsg_flags & NLM_F_MULTI)
+			process_multi(netlink, nlmsg);
+		else
+			process_message(netlink, nlmsg);
+
+		if (destroyed)
+			return false;
+	}
+
+	netlink->destroyed = NULL;
+
+	return true;
+}
+
+static bool can_read_data(struct l_io *io, void *user_data)
+{
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_NETLINK);
+	struct l_netlink *netlink = user_data;
+	struct mmsghdr msgs[NETLINK_RECV_BATCH];
+	struct iovec iov[NETLINK_RECV_BATCH];
+	unsigned char control[NETLINK_RECV_BATCH][32];
+	unsigned int budget = NETLINK_RECV_BUDGET;
+	int sk = l_io_get_fd(io);
+	int i;
+
+	if (!netlink->recv_buf)
+		netlink->recv_buf = l_malloc(NETLINK_RECV_BATCH *
+							NETLINK_RECV_SIZE);
+
+	/*
+	 * Drain the socket, stopping once the budget is used up or a dump
+	 * consumer falls behind and blocks reading from the main socket.
+	 */
+	while (budget && !(netlink->read_blocked && io == netlink->io)) {
+		unsigned int batch = minsize(budget, NETLINK_RECV_BATCH);
+		int count;
+
+		memset(msgs, 0, sizeof(msgs));
+
+		for (i = 0; i < (int) batch; i++) {
+			iov[i].iov_base = netlink->recv_buf +
+							i * NETLINK_RECV_SIZE;
+			iov[i].iov_len = NETLINK_RECV_SIZE;
+
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_control = control[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
 		}
 
-		if (nlmsg->nlmsg_pid != netlink->pid)
+		count = recvmmsg(sk, msgs, batch, 0, NULL);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno != ENOBUFS)
+				break;
+
+			if (netlink->stats)
+				netlink->stats->overruns++;
+
+			/*
+			 * Messages were dropped, the socket itself is fine
+			 * and the next read continues with what is queued.
+			 */
+			if (netlink->overrun_handler) {
+				bool destroyed = false;
+
+				netlink->destroyed = &destroyed;
+				netlink->overrun_handler(netlink->overrun_data);
+
+				if (destroyed)
+					return false;
+
+				netlink->destroyed = NULL;
+			}
+
 			continue;
+		}
 
-		if (nlmsg->nlmsg_flags & NLM_F_MULTI)
-			process_multi(netlink, nlmsg);
-		else
-			process_message(netlink, nlmsg);
+		for (i = 0; i < count; i++)
+			if (!process_datagram(netlink, &msgs[i].msg_hdr,
+						iov[i].iov_base,
+						msgs[i].msg_len))
+				return false;
+
+		budget -= count;
+
+		if ((unsigned int) count < batch)
+			break;
 	}
 
 	return true;
@@ -344,6 +674,7 @@ static int create_netlink_socket(int protocol, uint32_t *pid)
 
 LIB_EXPORT struct l_netlink *l_netlink_new(int protocol)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_NETLINK);
 	struct l_netlink *netlink;
 	int sk;
 	struct l_io *io;
@@ -361,6 +692,7 @@ LIB_EXPORT struct l_netlink *l_netlink_new(int protocol)
 
 	netlink = l_new(struct l_netlink, 1);
 
+	netlink->protocol = protocol;
 	netlink->pid = pid;
 	netlink->next_seq = 1;
 	netlink->next_command_id = 1;
@@ -385,6 +717,9 @@ LIB_EXPORT void l_netlink_destroy(struct l_netlink *netlink)
 	if (unlikely(!netlink))
 		return;
 
+	if (netlink->destroyed)
+		*netlink->destroyed = true;
+
 	l_hashmap_destroy(netlink->notify_lookup, NULL);
 	l_hashmap_destroy(netlink->notify_groups, destroy_notify_group);
 
@@ -392,8 +727,17 @@ LIB_EXPORT void l_netlink_destroy(struct l_netlink *netlink)
 	l_hashmap_destroy(netlink->command_pending, NULL);
 	l_hashmap_destroy(netlink->command_lookup, destroy_command);
 
+	l_queue_destroy(netlink->notify_socks, destroy_notify_sock);
 	l_io_destroy(netlink->io);
 
+	if (netlink->overrun_destroy)
+		netlink->overrun_destroy(netlink->overrun_data);
+
+	l_free(netlink->stats);
+	l_hashmap_destroy(netlink->type_stats, l_free);
+	netlink_capture_close(netlink->capture);
+
+	l_free(netlink->recv_buf);
 	l_free(netlink);
 }
 
@@ -440,6 +784,13 @@ LIB_EXPORT unsigned int l_netlink_send(struct l_netlink *netlink,
 	l_queue_push_tail(netlink->command_queue, command);
 	l_io_set_write_handler(netlink->io, can_write_data, netlink, NULL);
 
+	PROBE(netlink_submit, netlink, command->id, nlmsg->nlmsg_type,
+							nlmsg->nlmsg_seq);
+
+	if (netlink->stats)
+		netlink_stats_set_queue_depth(netlink->stats,
+				l_hashmap_size(netlink->command_lookup));
+
 	return command->id;
 }
 
@@ -485,11 +836,233 @@ LIB_EXPORT bool l_netlink_request_sent(struct l_netlink *netlink,
 					L_UINT_TO_PTR(hdr->nlmsg_seq));
 }
 
+static void read_block(struct l_netlink *netlink)
+{
+	if (netlink->read_blocked++)
+		return;
+
+	l_io_set_read_handler(netlink->io, NULL, NULL, NULL);
+}
+
+static void read_unblock(struct l_netlink *netlink)
+{
+	if (--netlink->read_blocked)
+		return;
+
+	l_io_set_read_handler(netlink->io, can_read_data, netlink, NULL);
+}
+
+static void dump_notify(struct l_netlink_dump *dump)
+{
+	if (!dump->waiting)
+		return;
+
+	dump->waiting = false;
+
+	if (dump->ready)
+		dump->ready(dump, dump->user_data);
+}
+
+static void dump_command_cb(int error, uint16_t type, const void *data,
+					uint32_t len, void *user_data)
+{
+	struct l_netlink_dump *dump = user_data;
+	struct dump_entry *entry;
+
+	/* The request was refused, the error is recorded already */
+	if (error)
+		return;
+
+	entry = l_malloc(sizeof(struct dump_entry) + len);
+	entry->type = type;
+	entry->len = len;
+	memcpy(entry->data, data, len);
+
+	l_queue_push_tail(dump->entries, entry);
+
+	if (!dump->blocking &&
+			l_queue_length(dump->entries) >= dump->max_queued) {
+		dump->blocking = true;
+		read_block(dump->netlink);
+	}
+
+	dump_notify(dump);
+}
+
+static void dump_command_destroy(void *user_data)
+{
+	struct l_netlink_dump *dump = user_data;
+
+	if (dump->freeing)
+		return;
+
+	dump->id = 0;
+	dump->done = true;
+
+	if (dump->blocking) {
+		dump->blocking = false;
+		read_unblock(dump->netlink);
+	}
+
+	dump_notify(dump);
+}
+
+/**
+ * l_netlink_dump_new:
+ * @netlink: netlink object
+ * @message: the dump request, usually with NLM_F_DUMP set
+ * @max_queued: number of received entries after which reading stops
+ * @ready: called when entries or the end of the dump become available
+ * @user_data: user data passed to @ready
+ * @destroy: destroy function for @user_data
+ *
+ * Send @message and hand out the replies through l_netlink_dump_next()
+ * at the pace of the consumer rather than through a callback as fast as
+ * they are received.  Once @max_queued entries are waiting to be taken,
+ * @netlink stops reading its socket, which makes the kernel hold back
+ * the rest of the dump, and reading resumes when half of them have been
+ * taken.  The entries fetched by the read that reached the limit are
+ * still queued, so the limit may be exceeded by that much.
+ *
+ * While reading is stopped the replies to other requests sent on
+ * @netlink are held back as well, as are the notifications unless they
+ * have a socket of their own, see l_netlink_set_notify_socket().
+ *
+ * @ready is called when the first entry arrives and, each time
+ * l_netlink_dump_next() has returned -EAGAIN, when the next one does or
+ * the dump ends.  On success @message is owned by @netlink, otherwise by
+ * the caller.
+ *
+ * Returns: a new dump object, or #NULL on failure
+ **/
+LIB_EXPORT struct l_netlink_dump *l_netlink_dump_new(
+					struct l_netlink *netlink,
+					struct l_netlink_message *message,
+					unsigned int max_queued,
+					l_netlink_dump_ready_func_t ready,
+					void *user_data,
+					l_netlink_destroy_func_t destroy)
+{
+	struct l_netlink_dump *dump;
+	struct command *command;
+
+	if (unlikely(!netlink || !message || !max_queued))
+		return NULL;
+
+	dump = l_new(struct l_netlink_dump, 1);
+	dump->netlink = netlink;
+	dump->max_queued = max_queued;
+	dump->entries = l_queue_new();
+	dump->waiting = true;
+
+	/* Unless a reply says otherwise, e.g. if @netlink is destroyed */
+	dump->error = -ECANCELED;
+
+	dump->id = l_netlink_send(netlink, message, dump_command_cb, dump,
+						dump_command_destroy);
+	if (!dump->id) {
+		l_queue_destroy(dump->entries, NULL);
+		l_free(dump);
+		return NULL;
+	}
+
+	command = l_hashmap_lookup(netlink->command_lookup,
+						L_UINT_TO_PTR(dump->id));
+	command->dump = dump;
+
+	dump->ready = ready;
+	dump->destroy = destroy;
+	dump->user_data = user_data;
+
+	return dump;
+}
+
+/**
+ * l_netlink_dump_next:
+ * @dump: dump object
+ * @type: set to the message type of the entry
+ * @data: set to the payload of the entry
+ * @len: set to the length of @data
+ *
+ * Take the next entry of @dump.  @data stays valid until the next call
+ * or until @dump is freed.  Taking entries is what lets @netlink resume
+ * reading the rest of the dump.
+ *
+ * Returns: 1 if an entry was taken, -EAGAIN if none was received yet, in
+ * which case the ready callback is called once there is, 0 at the end of
+ * a successful dump or a negative errno if the dump failed
+ **/
+LIB_EXPORT int l_netlink_dump_next(struct l_netlink_dump *dump,
+					uint16_t *type, const void **data,
+					uint32_t *len)
+{
+	if (unlikely(!dump))
+		return -EINVAL;
+
+	l_free(dump->current);
+	dump->current = l_queue_pop_head(dump->entries);
+
+	if (!dump->current) {
+		if (dump->done)
+			return dump->error;
+
+		dump->waiting = true;
+		return -EAGAIN;
+	}
+
+	if (dump->blocking &&
+			l_queue_length(dump->entries) <= dump->max_queued / 2) {
+		dump->blocking = false;
+		read_unblock(dump->netlink);
+	}
+
+	if (type)
+		*type = dump->current->type;
+
+	if (data)
+		*data = dump->current->data;
+
+	if (len)
+		*len = dump->current->len;
+
+	return 1;
+}
+
+/**
+ * l_netlink_dump_free:
+ * @dump: dump object
+ *
+ * Free @dump, cancelling the request if it is still running.  If the
+ * #l_netlink it was created on is destroyed first, the dump ends with
+ * -ECANCELED instead.
+ **/
+LIB_EXPORT void l_netlink_dump_free(struct l_netlink_dump *dump)
+{
+	if (unlikely(!dump))
+		return;
+
+	dump->freeing = true;
+
+	if (dump->id)
+		l_netlink_cancel(dump->netlink, dump->id);
+
+	if (dump->blocking)
+		read_unblock(dump->netlink);
+
+	l_queue_destroy(dump->entries, l_free);
+	l_free(dump->current);
+
+	if (dump->destroy)
+		dump->destroy(dump->user_data);
+
+	l_free(dump);
+}
+
 static bool add_membership(struct l_netlink *netlink, uint32_t group)
 {
 	int sk, value = group;
 
-	sk = l_io_get_fd(netlink->io);
+	sk = l_io_get_fd(group_io(netlink, group));
 
 	if (setsockopt(sk, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
 						&value, sizeof(value)) < 0)
@@ -502,7 +1075,7 @@ static bool drop_membership(struct l_netlink *netlink, uint32_t group)
 {
 	int sk, value = group;
 
-	sk = l_io_get_fd(netlink->io);
+	sk = l_io_get_fd(group_io(netlink, group));
 
 	if (setsockopt(sk, SOL_NETLINK, NETLINK_DROP_MEMBERSHIP,
 						&value, sizeof(value)) < 0)
@@ -630,6 +1203,376 @@ LIB_EXPORT bool l_netlink_set_debug(struct l_netlink *netlink,
 	return true;
 }
 
+/*
+ * Sets the socket receive buffer to @size bytes.  SO_RCVBUFFORCE is tried
+ * first so that privileged processes can go above rmem_max, anyone else
+ * gets SO_RCVBUF capped by the kernel.
+ */
+static bool set_rcvbuf(int sk, size_t size)
+{
+	int value;
+
+	if (!size || size > INT_MAX)
+		return false;
+
+	value = size;
+
+	if (setsockopt(sk, SOL_SOCKET, SO_RCVBUFFORCE,
+					&value, sizeof(value)) == 0)
+		return true;
+
+	return setsockopt(sk, SOL_SOCKET, SO_RCVBUF,
+					&value, sizeof(value)) == 0;
+}
+
+LIB_EXPORT bool l_netlink_set_rcvbuf(struct l_netlink *netlink, size_t size)
+{
+	if (unlikely(!netlink))
+		return false;
+
+	return set_rcvbuf(l_io_get_fd(netlink->io), size);
+}
+
+struct move_membership_data {
+	struct l_netlink *netlink;
+	struct notify_sock *sock;
+	struct l_io *from;
+};
+
+static void move_membership(const void *key, void *value, void *user_data)
+{
+	struct move_membership_data *data = user_data;
+	int group = L_PTR_TO_UINT(key);
+
+	if (!l_hashmap_size(value))
+		return;
+
+	if (group_io(data->netlink, group) != data->sock->io)
+		return;
+
+	setsockopt(l_io_get_fd(data->sock->io), SOL_NETLINK,
+				NETLINK_ADD_MEMBERSHIP, &group, sizeof(group));
+	setsockopt(l_io_get_fd(data->from), SOL_NETLINK,
+				NETLINK_DROP_MEMBERSHIP, &group, sizeof(group));
+}
+
+/*
+ * Moves notifications to a socket of their own, so that a flood of them
+ * doesn't hold up the replies to commands and each socket can get its
+ * own receive buffer size, @rcvbuf, unless 0.  With @group set to 0 the
+ * socket is shared by every group that doesn't have a socket of its own.
+ * Existing registrations are moved over.
+ */
+LIB_EXPORT bool l_netlink_set_notify_socket(struct l_netlink *netlink,
+						uint32_t group, size_t rcvbuf)
+{
+	struct move_membership_data data;
+	struct notify_sock *sock;
+	struct l_io *io;
+	int sk;
+
+	if (unlikely(!netlink))
+		return false;
+
+	if (l_queue_find(netlink->notify_socks, match_notify_sock,
+						L_UINT_TO_PTR(group)))
+		return false;
+
+	sk = create_netlink_socket(netlink->protocol, NULL);
+	if (sk < 0)
+		return false;
+
+	if (rcvbuf && !set_rcvbuf(sk, rcvbuf)) {
+		close(sk);
+		return false;
+	}
+
+	io = l_io_new(sk);
+	if (!io) {
+		close(sk);
+		return false;
+	}
+
+	l_io_set_close_on_destroy(io, true);
+	l_io_set_read_handler(io, can_read_data, netlink, NULL);
+
+	/* Where the memberships being moved are held right now */
+	data.from = group ? group_io(netlink, 0) : netlink->io;
+
+	if (!netlink->notify_socks)
+		netlink->notify_socks = l_queue_new();
+
+	sock = l_new(struct notify_sock, 1);
+	sock->group = group;
+	sock->io = io;
+	l_queue_push_tail(netlink->notify_socks, sock);
+
+	data.netlink = netlink;
+	data.sock = sock;
+	l_hashmap_foreach(netlink->notify_groups, move_membership, &data);
+
+	return true;
+}
+
+/*
+ * With strict checking the kernel validates dump requests and applies the
+ * filters given in them, such as the interface index of address dumps or
+ * the table of route dumps.  It is off by default since malformed requests
+ * that used to be accepted are then rejected.
+ */
+LIB_EXPORT bool l_netlink_set_strict_check(struct l_netlink *netlink,
+							bool enable)
+{
+	int value = enable;
+
+	if (unlikely(!netlink))
+		return false;
+
+	return setsockopt(l_io_get_fd(netlink->io), SOL_NETLINK,
+				NETLINK_GET_STRICT_CHK,
+				&value, sizeof(value)) == 0;
+}
+
+/*
+ * The overrun handler is called when the kernel had to drop messages
+ * because the receive buffer was full.  Any cached state derived from
+ * notifications may be stale at that point and should be dumped again.
+ */
+LIB_EXPORT bool l_netlink_set_overrun_handler(struct l_netlink *netlink,
+					l_netlink_overrun_func_t function,
+					void *user_data,
+					l_netlink_destroy_func_t destroy)
+{
+	if (unlikely(!netlink))
+		return false;
+
+	if (netlink->overrun_destroy)
+		netlink->overrun_destroy(netlink->overrun_data);
+
+	netlink->overrun_handler = function;
+	netlink->overrun_destroy = destroy;
+	netlink->overrun_data = user_data;
+
+	return true;
+}
+
+void netlink_stats_add_latency(struct l_netlink_stats *stats,
+					uint64_t latency)
+{
+	unsigned int bucket = latency ? 64 - __builtin_clzll(latency) : 0;
+
+	stats->latency[minsize(bucket, L_NETLINK_LATENCY_BUCKETS - 1)]++;
+}
+
+void netlink_stats_set_queue_depth(struct l_netlink_stats *stats,
+					uint32_t depth)
+{
+	stats->queue_depth = depth;
+	stats->queue_depth_max = maxsize(stats->queue_depth_max, depth);
+}
+
+/*
+ * Starts or stops counting requests, their latencies and dump sizes, by
+ * message type as well, along with notifications and receive buffer
+ * overruns.  Disabling discards the counters collected so far.
+ */
+LIB_EXPORT bool l_netlink_set_stats(struct l_netlink *netlink, bool enabled)
+{
+	if (unlikely(!netlink))
+		return false;
+
+	if (!enabled) {
+		l_free(netlink->stats);
+		netlink->stats = NULL;
+		l_hashmap_destroy(netlink->type_stats, l_free);
+		netlink->type_stats = NULL;
+		return true;
+	}
+
+	if (netlink->stats)
+		return true;
+
+	netlink->stats = l_new(struct l_netlink_stats, 1);
+	netlink->type_stats = l_hashmap_new();
+
+	return true;
+}
+
+LIB_EXPORT bool l_netlink_get_stats(struct l_netlink *netlink,
+					struct l_netlink_stats *stats)
+{
+	if (unlikely(!netlink || !stats))
+		return false;
+
+	if (!netlink->stats)
+		return false;
+
+	*stats = *netlink->stats;
+	stats->queue_depth = l_hashmap_size(netlink->command_lookup);
+
+	return true;
+}
+
+struct type_stats_foreach_data {
+	l_netlink_type_stats_func_t function;
+	void *user_data;
+};
+
+static void type_stats_foreach(const void *key, void *value, void *user_data)
+{
+	struct type_stats_foreach_data *data = user_data;
+
+	data->function(value, data->user_data);
+}
+
+/* Latencies are in microseconds, keyed by the type of the request */
+LIB_EXPORT bool l_netlink_foreach_type_stats(struct l_netlink *netlink,
+					l_netlink_type_stats_func_t function,
+					void *user_data)
+{
+	struct type_stats_foreach_data data = { function, user_data };
+
+	if (unlikely(!netlink || !function))
+		return false;
+
+	if (!netlink->type_stats)
+		return false;
+
+	l_hashmap_foreach(netlink->type_stats, type_stats_foreach, &data);
+
+	return true;
+}
+
+/*
+ * Traffic is captured in the pcap format with the LINKTYPE_NETLINK link
+ * type, which is what an nlmon interface produces, so that it can be
+ * opened in Wireshark.  Every record starts with the 16 byte cooked
+ * header giving the direction and the netlink protocol.
+ */
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_SNAPLEN		65535
+#define LINKTYPE_NETLINK	253
+#define ARPHRD_NETLINK		824
+#define PACKET_HOST		0
+#define PACKET_OUTGOING		4
+#define COOKED_HEADER_LEN	16
+
+struct netlink_capture {
+	int fd;
+};
+
+struct pcap_file_header {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+} __attribute__ ((packed));
+
+struct pcap_record_header {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t incl_len;
+	uint32_t orig_len;
+	uint16_t pkttype;
+	uint16_t hatype;
+	uint16_t halen;
+	uint8_t addr[8];
+	uint16_t protocol;
+} __attribute__ ((packed));
+
+struct netlink_capture *netlink_capture_open(const char *path)
+{
+	struct netlink_capture *capture;
+	struct pcap_file_header hdr = {
+		.magic = PCAP_MAGIC,
+		.version_major = 2,
+		.version_minor = 4,
+		.snaplen = PCAP_SNAPLEN,
+		.linktype = LINKTYPE_NETLINK,
+	};
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return NULL;
+
+	if (L_TFR(write(fd, &hdr, sizeof(hdr))) != sizeof(hdr)) {
+		close(fd);
+		return NULL;
+	}
+
+	capture = l_new(struct netlink_capture, 1);
+	capture->fd = fd;
+
+	return capture;
+}
+
+void netlink_capture_close(struct netlink_capture *capture)
+{
+	if (!capture)
+		return;
+
+	close(capture->fd);
+	l_free(capture);
+}
+
+/* A failed write only loses the record, the traffic itself is unaffected */
+bool netlink_capture_write(struct netlink_capture *capture, int protocol,
+				bool outgoing, const void *data, size_t len)
+{
+	struct pcap_record_header hdr;
+	struct timeval tv;
+	struct iovec iov[2];
+
+	if (!capture)
+		return false;
+
+	gettimeofday(&tv, NULL);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ts_sec = tv.tv_sec;
+	hdr.ts_usec = tv.tv_usec;
+	hdr.orig_len = COOKED_HEADER_LEN + len;
+	hdr.incl_len = minsize(hdr.orig_len, PCAP_SNAPLEN);
+	hdr.pkttype = L_CPU_TO_BE16(outgoing ? PACKET_OUTGOING : PACKET_HOST);
+	hdr.hatype = L_CPU_TO_BE16(ARPHRD_NETLINK);
+	hdr.protocol = L_CPU_TO_BE16(protocol);
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = (void *) data;
+	iov[1].iov_len = hdr.incl_len - COOKED_HEADER_LEN;
+
+	return writev(capture->fd, iov, 2) >= 0;
+}
+
+/*
+ * Writes all traffic on @netlink to the file at @path, see above for the
+ * format, or stops when @path is NULL.
+ */
+LIB_EXPORT bool l_netlink_set_capture(struct l_netlink *netlink,
+							const char *path)
+{
+	struct netlink_capture *capture = NULL;
+
+	if (unlikely(!netlink))
+		return false;
+
+	if (path) {
+		capture = netlink_capture_open(path);
+		if (!capture)
+			return false;
+	}
+
+	netlink_capture_close(netlink->capture);
+	netlink->capture = capture;
+
+	return true;
+}
+
 /*
  * Parses extended error info from the extended ack.  It is assumed that the
  * caller has already checked the type of @nlmsg and it is of type NLMSG_ERROR.
@@ -685,6 +1628,64 @@ bool netlink_parse_ext_ack_error(const struct nlmsghdr *nlmsg,
 	return true;
 }
 
+/*
+ * Freed messages with buffers of up to a page are kept for reuse, so that
+ * building and sending requests at a steady rate stays off the allocator.
+ */
+#define MESSAGE_POOL_SIZE 8
+
+static struct l_netlink_message *message_pool[MESSAGE_POOL_SIZE];
+static unsigned int message_pool_count;
+
+static struct l_netlink_message *message_alloc(uint32_t size)
+{
+	struct l_netlink_message *message;
+	void *data;
+	uint32_t capacity;
+	unsigned int i;
+
+	if (!message_pool_count) {
+		message = l_new(struct l_netlink_message, 1);
+		message->data = l_malloc(size);
+		message->size = size;
+		return message;
+	}
+
+	/* Prefer the most recently freed buffer that is large enough */
+	for (i = message_pool_count; i > 1; i--)
+		if (message_pool[i - 1]->size >= size)
+			break;
+
+	message = message_pool[i - 1];
+	message_pool[i - 1] = message_pool[--message_pool_count];
+
+	data = message->data;
+	capacity = message->size;
+
+	if (capacity < size) {
+		data = l_realloc(data, size);
+		capacity = size;
+	}
+
+	memset(message, 0, sizeof(*message));
+	message->data = data;
+	message->size = capacity;
+
+	return message;
+}
+
+static void message_free(struct l_netlink_message *message)
+{
+	if (message_pool_count < MESSAGE_POOL_SIZE &&
+			message->size <= l_util_pagesize()) {
+		message_pool[message_pool_count++] = message;
+		return;
+	}
+
+	l_free(message->hdr);
+	l_free(message);
+}
+
 static int message_grow(struct l_netlink_message *message, uint32_t needed)
 {
 	uint32_t grow_to;
@@ -756,15 +1757,13 @@ static int add_attribute(struct l_netlink_message *message,
 LIB_EXPORT struct l_netlink_message *l_netlink_message_new_sized(uint16_t type,
 					uint16_t flags, size_t initial_len)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_NETLINK);
 	struct l_netlink_message *message;
 
 	if (flags & 0xff)
 		return NULL;
 
-	message = l_new(struct l_netlink_message, 1);
-
-	message->size = initial_len + NLMSG_HDRLEN;
-	message->hdr = l_realloc(NULL, message->size);
+	message = message_alloc(initial_len + NLMSG_HDRLEN);
 	memset(message->hdr, 0, NLMSG_HDRLEN);
 
 	message->hdr->nlmsg_len = NLMSG_HDRLEN;
@@ -786,10 +1785,9 @@ LIB_EXPORT struct l_netlink_message *l_netlink_message_new(uint16_t type,
 struct l_netlink_message *netlink_message_from_nlmsg(
 						const struct nlmsghdr *nlmsg)
 {
-	struct l_netlink_message *message = l_new(struct l_netlink_message, 1);
+	struct l_netlink_message *message = message_alloc(nlmsg->nlmsg_len);
 
-	message->hdr = l_memdup(nlmsg, nlmsg->nlmsg_len);
-	message->size = nlmsg->nlmsg_len;
+	memcpy(message->hdr, nlmsg, nlmsg->nlmsg_len);
 
 	return l_netlink_message_ref(message);
 }
@@ -813,8 +1811,35 @@ LIB_EXPORT void l_netlink_message_unref(struct l_netlink_message *message)
 	if (__atomic_sub_fetch(&message->ref_count, 1, __ATOMIC_SEQ_CST))
 		return;
 
-	l_free(message->hdr);
-	l_free(message);
+	message_free(message);
+}
+
+/*
+ * Empties @message so it can be built up again with a new @type and
+ * @flags, keeping its buffer.  A message passed to l_netlink_send can be
+ * reset once the caller holds the only reference again, that is after
+ * the command completed or was cancelled.
+ */
+LIB_EXPORT int l_netlink_message_reset(struct l_netlink_message *message,
+					uint16_t type, uint16_t flags)
+{
+	if (unlikely(!message))
+		return -EINVAL;
+
+	if (flags & 0xff)
+		return -EINVAL;
+
+	if (__atomic_load_n(&message->ref_count, __ATOMIC_SEQ_CST) > 1)
+		return -EBUSY;
+
+	memset(message->hdr, 0, NLMSG_HDRLEN);
+	message->hdr->nlmsg_len = NLMSG_HDRLEN;
+	message->hdr->nlmsg_type = type;
+	message->hdr->nlmsg_flags = flags;
+	message->nest_level = 0;
+	message->sealed = false;
+
+	return 0;
 }
 
 LIB_EXPORT int l_netlink_message_append(struct l_netlink_message *message,
@@ -1037,3 +2062,76 @@ LIB_EXPORT int l_netlink_attr_recurse(const struct l_netlink_attr *iter,
 
 	return 0;
 }
+
+static bool attr_policy_ok(const struct l_netlink_attr_policy *policy,
+				const void *data, uint16_t len)
+{
+	switch (policy->type) {
+	case L_NETLINK_ATTR_POLICY_UNSPEC:
+		return len >= policy->len;
+	case L_NETLINK_ATTR_POLICY_U8:
+		return len == sizeof(uint8_t);
+	case L_NETLINK_ATTR_POLICY_U16:
+		return len == sizeof(uint16_t);
+	case L_NETLINK_ATTR_POLICY_U32:
+		return len == sizeof(uint32_t);
+	case L_NETLINK_ATTR_POLICY_U64:
+		return len == sizeof(uint64_t);
+	case L_NETLINK_ATTR_POLICY_FLAG:
+		return len == 0;
+	case L_NETLINK_ATTR_POLICY_STRING:
+	{
+		const char *nul = memchr(data, '\0', len);
+
+		if (!nul)
+			return false;
+
+		return !policy->len || nul - (const char *) data <= policy->len;
+	}
+	case L_NETLINK_ATTR_POLICY_BINARY:
+		return !policy->len || len <= policy->len;
+	case L_NETLINK_ATTR_POLICY_NESTED:
+		return len == 0 || len >= NLA_HDRLEN;
+	}
+
+	return false;
+}
+
+/*
+ * Fills @table, which has room for @max_type + 1 entries, with the payload
+ * of every attribute left in @iter, indexed by type, in a single pass.
+ * Each attribute is checked against the policy entry for its type.
+ * Attributes above @max_type are skipped and a repeated attribute replaces
+ * the earlier one.  A nested payload can be walked by passing it to
+ * l_netlink_attr_init with a header length of 0.  @iter is not advanced.
+ */
+LIB_EXPORT int l_netlink_attr_parse(const struct l_netlink_attr *iter,
+				const struct l_netlink_attr_policy *policy,
+				uint16_t max_type,
+				struct l_netlink_attr_value *table)
+{
+	const struct nlattr *nla;
+	uint32_t len;
+
+	if (unlikely(!iter || !policy || !table))
+		return -EINVAL;
+
+	memset(table, 0, sizeof(*table) * (max_type + 1));
+
+	for (nla = iter->next_data, len = iter->next_len; NLA_OK(nla, len);
+						nla = NLA_NEXT(nla, len)) {
+		uint16_t type = nla->nla_type & NLA_TYPE_MASK;
+
+		if (type > max_type)
+			continue;
+
+		if (!attr_policy_ok(&policy[type], NLA_DATA(nla),
+							NLA_PAYLOAD(nla)))
+			return -EBADMSG;
+
+		table[type].data = NLA_DATA(nla);
+		table[type].len = NLA_PAYLOAD(nla);
+	}
+
+	return 0;
+}
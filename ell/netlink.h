@@ -24,9 +24,46 @@ typedef void (*l_netlink_command_func_t) (int error,
 typedef void (*l_netlink_notify_func_t) (uint16_t type, const void *data,
 						uint32_t len, void *user_data);
 typedef void (*l_netlink_destroy_func_t) (void *user_data);
+typedef void (*l_netlink_overrun_func_t) (void *user_data);
 
 struct l_netlink;
 struct l_netlink_message;
+struct l_netlink_dump;
+
+typedef void (*l_netlink_dump_ready_func_t) (struct l_netlink_dump *dump,
+						void *user_data);
+
+/*
+ * Latency bucket 0 counts replies within a microsecond, bucket n those
+ * from 2^(n - 1) up to 2^n microseconds and the last one anything slower.
+ */
+#define L_NETLINK_LATENCY_BUCKETS 20
+
+struct l_netlink_stats {
+	uint64_t requests;
+	uint64_t errors;
+	uint64_t notifications;
+	uint64_t dump_messages;
+	uint64_t dump_bytes;
+	uint64_t overruns;
+	uint32_t queue_depth;
+	uint32_t queue_depth_max;
+	uint64_t latency[L_NETLINK_LATENCY_BUCKETS];
+};
+
+struct l_netlink_type_stats {
+	uint16_t type;
+	uint64_t requests;
+	uint64_t errors;
+	uint64_t dump_messages;
+	uint64_t dump_bytes;
+	uint64_t latency_total;
+	uint64_t latency_max;
+};
+
+typedef void (*l_netlink_type_stats_func_t) (
+				const struct l_netlink_type_stats *stats,
+				void *user_data);
 
 struct l_netlink *l_netlink_new(int protocol);
 void l_netlink_destroy(struct l_netlink *netlink);
@@ -39,6 +76,16 @@ unsigned int l_netlink_send(struct l_netlink *netlink,
 bool l_netlink_cancel(struct l_netlink *netlink, unsigned int id);
 bool l_netlink_request_sent(struct l_netlink *netlink, unsigned int id);
 
+struct l_netlink_dump *l_netlink_dump_new(struct l_netlink *netlink,
+					struct l_netlink_message *message,
+					unsigned int max_queued,
+					l_netlink_dump_ready_func_t ready,
+					void *user_data,
+					l_netlink_destroy_func_t destroy);
+int l_netlink_dump_next(struct l_netlink_dump *dump, uint16_t *type,
+					const void **data, uint32_t *len);
+void l_netlink_dump_free(struct l_netlink_dump *dump);
+
 unsigned int l_netlink_register(struct l_netlink *netlink,
 			uint32_t group, l_netlink_notify_func_t function,
 			void *user_data, l_netlink_destroy_func_t destroy);
@@ -48,6 +95,23 @@ bool l_netlink_set_debug(struct l_netlink *netlink,
 			l_netlink_debug_func_t function,
 			void *user_data, l_netlink_destroy_func_t destroy);
 
+bool l_netlink_set_rcvbuf(struct l_netlink *netlink, size_t size);
+bool l_netlink_set_strict_check(struct l_netlink *netlink, bool enable);
+bool l_netlink_set_notify_socket(struct l_netlink *netlink, uint32_t group,
+							size_t rcvbuf);
+bool l_netlink_set_overrun_handler(struct l_netlink *netlink,
+					l_netlink_overrun_func_t function,
+					void *user_data,
+					l_netlink_destroy_func_t destroy);
+
+bool l_netlink_set_stats(struct l_netlink *netlink, bool enabled);
+bool l_netlink_get_stats(struct l_netlink *netlink,
+				struct l_netlink_stats *stats);
+bool l_netlink_foreach_type_stats(struct l_netlink *netlink,
+					l_netlink_type_stats_func_t function,
+					void *user_data);
+bool l_netlink_set_capture(struct l_netlink *netlink, const char *path);
+
 struct l_netlink_message *l_netlink_message_new(uint16_t type, uint16_t flags);
 struct l_netlink_message *l_netlink_message_new_sized(uint16_t type,
 							uint16_t flags,
@@ -55,6 +119,8 @@ struct l_netlink_message *l_netlink_message_new_sized(uint16_t type,
 struct l_netlink_message *l_netlink_message_ref(
 					struct l_netlink_message *message);
 void l_netlink_message_unref(struct l_netlink_message *message);
+int l_netlink_message_reset(struct l_netlink_message *message,
+					uint16_t type, uint16_t flags);
 int l_netlink_message_append(struct l_netlink_message *message, uint16_t type,
 					const void *data, size_t len);
 int l_netlink_message_appendv(struct l_netlink_message *message,
@@ -144,6 +210,37 @@ int l_netlink_attr_next(struct l_netlink_attr *attr,
 int l_netlink_attr_recurse(const struct l_netlink_attr *iter,
 					struct l_netlink_attr *nested);
 
+enum l_netlink_attr_policy_type {
+	L_NETLINK_ATTR_POLICY_UNSPEC = 0,
+	L_NETLINK_ATTR_POLICY_U8,
+	L_NETLINK_ATTR_POLICY_U16,
+	L_NETLINK_ATTR_POLICY_U32,
+	L_NETLINK_ATTR_POLICY_U64,
+	L_NETLINK_ATTR_POLICY_FLAG,
+	L_NETLINK_ATTR_POLICY_STRING,
+	L_NETLINK_ATTR_POLICY_BINARY,
+	L_NETLINK_ATTR_POLICY_NESTED,
+};
+
+/*
+ * @len is the minimum payload length for UNSPEC, and the maximum string
+ * or payload length for STRING and BINARY, 0 meaning no limit.
+ */
+struct l_netlink_attr_policy {
+	enum l_netlink_attr_policy_type type;
+	uint16_t len;
+};
+
+struct l_netlink_attr_value {
+	const void *data;
+	uint16_t len;
+};
+
+int l_netlink_attr_parse(const struct l_netlink_attr *iter,
+				const struct l_netlink_attr_policy *policy,
+				uint16_t max_type,
+				struct l_netlink_attr_value *table);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,28 +9,51 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include "private.h"
-#include "queue.h"
 #include "notifylist.h"
 #include "useful.h"
 
+/*
+ * Entries live in arrays kept in the order they were added, which is also
+ * increasing id order, so that they can be found with a binary search.
+ * Entries added with l_notifylist_add_keyed() go into a bucket of their
+ * own and are only visited by notifications of that type.
+ *
+ * Removed entries leave a tombstone behind.  During a notification the
+ * entry itself is kept and marked with an id of 0, and is freed once the
+ * outermost notification completes.  Otherwise the entry is freed right
+ * away and its slot cleared.  Tombstones are compacted out in bulk, so
+ * removal never shifts the array.  A notification only visits the entries
+ * present when it started, entries added from a callback are left for
+ * the next one.
+ */
+struct notify_slot {
+	uint32_t id;
+	struct l_notifylist_entry *entry;
+};
+
+struct notify_bucket {
+	int type;
+	struct notify_slot *slots;
+	unsigned int n_slots;
+	unsigned int alloc;
+	unsigned int n_stale;
+};
+
 struct l_notifylist {
 	uint32_t next_id;
-	struct l_queue *entries;
-	bool in_notify : 1;
+	unsigned int notify_depth;
+	struct notify_bucket all;
+	struct notify_bucket *keyed;
+	unsigned int n_keyed;
+	bool wrapped : 1;
 	bool stale_entries : 1;
 	bool pending_destroy : 1;
 	const struct l_notifylist_ops *ops;
 };
 
-static bool __notifylist_entry_match(const void *a, const void *b)
-{
-	const struct l_notifylist_entry *entry = a;
-	uint32_t id = L_PTR_TO_UINT(b);
-
-	return entry->id == id;
-}
-
 static void __notifylist_entry_free(struct l_notifylist *list,
 						struct l_notifylist_entry *e)
 {
@@ -40,31 +63,130 @@ static void __notifylist_entry_free(struct l_notifylist *list,
 	list->ops->free_entry(e);
 }
 
-static void __notifylist_clear(struct l_notifylist *list)
+static void __bucket_push(struct notify_bucket *bucket,
+					struct l_notifylist_entry *entry)
 {
-	struct l_notifylist_entry *entry;
+	if (bucket->n_slots == bucket->alloc) {
+		bucket->alloc = bucket->alloc ? bucket->alloc * 2 : 4;
+		bucket->slots = l_realloc(bucket->slots,
+				bucket->alloc * sizeof(struct notify_slot));
+	}
 
-	while ((entry = l_queue_pop_head(list->entries)))
-		__notifylist_entry_free(list, entry);
+	bucket->slots[bucket->n_slots].id = entry->id;
+	bucket->slots[bucket->n_slots].entry = entry;
+	bucket->n_slots += 1;
 }
 
-static void __notifylist_prune_stale(struct l_notifylist *list)
+static int __bucket_find(const struct l_notifylist *list,
+				const struct notify_bucket *bucket, uint32_t id)
+{
+	unsigned int lo = 0;
+	unsigned int hi = bucket->n_slots;
+	unsigned int i;
+
+	/* Ids are no longer in order once the counter has wrapped */
+	if (list->wrapped) {
+		for (i = 0; i < bucket->n_slots; i++)
+			if (bucket->slots[i].id == id)
+				return i;
+
+		return -1;
+	}
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (bucket->slots[mid].id == id)
+			return mid;
+
+		if (bucket->slots[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return -1;
+}
+
+static void __bucket_compact(struct notify_bucket *bucket)
+{
+	unsigned int i;
+	unsigned int n = 0;
+
+	for (i = 0; i < bucket->n_slots; i++)
+		if (bucket->slots[i].entry)
+			bucket->slots[n++] = bucket->slots[i];
+
+	bucket->n_slots = n;
+	bucket->n_stale = 0;
+}
+
+static void __bucket_prune_stale(struct l_notifylist *list,
+					struct notify_bucket *bucket)
 {
-	struct l_notifylist_entry *e;
+	unsigned int i;
 
-	while ((e = l_queue_remove_if(list->entries, __notifylist_entry_match,
-							L_UINT_TO_PTR(0))))
+	for (i = 0; i < bucket->n_slots; i++) {
+		struct l_notifylist_entry *e = bucket->slots[i].entry;
+
+		if (!e || e->id)
+			continue;
+
+		bucket->slots[i].entry = NULL;
+		bucket->n_stale += 1;
 		__notifylist_entry_free(list, e);
+	}
+
+	if (bucket->n_stale)
+		__bucket_compact(bucket);
+}
+
+static void __bucket_clear(struct l_notifylist *list,
+					struct notify_bucket *bucket)
+{
+	unsigned int i;
+
+	for (i = 0; i < bucket->n_slots; i++)
+		if (bucket->slots[i].entry)
+			__notifylist_entry_free(list, bucket->slots[i].entry);
+
+	l_free(bucket->slots);
+}
+
+static struct notify_bucket *__notifylist_find_keyed(
+					struct l_notifylist *list, int type)
+{
+	unsigned int i;
+
+	for (i = 0; i < list->n_keyed; i++)
+		if (list->keyed[i].type == type)
+			return &list->keyed[i];
+
+	return NULL;
+}
+
+static void __notifylist_prune_stale(struct l_notifylist *list)
+{
+	unsigned int i;
+
+	__bucket_prune_stale(list, &list->all);
+
+	for (i = 0; i < list->n_keyed; i++)
+		__bucket_prune_stale(list, &list->keyed[i]);
 
 	list->stale_entries = false;
 }
 
 static void __notifylist_destroy(struct l_notifylist *list)
 {
-	__notifylist_clear(list);
-	l_queue_destroy(list->entries, NULL);
-	list->entries = NULL;
+	unsigned int i;
+
+	__bucket_clear(list, &list->all);
+
+	for (i = 0; i < list->n_keyed; i++)
+		__bucket_clear(list, &list->keyed[i]);
 
+	l_free(list->keyed);
 	l_free(list);
 }
 
@@ -73,15 +195,34 @@ static void __notifylist_notify(struct l_notifylist *list,
 				const void *match_data,
 				int type, va_list args)
 {
-	const struct l_queue_entry *entry = l_queue_get_entries(list->entries);
-
-	list->in_notify = true;
-
-	for (; entry; entry = entry->next) {
-		const struct l_notifylist_entry *e = entry->data;
+	struct notify_bucket *keyed = __notifylist_find_keyed(list, type);
+	/* The keyed array may move if a callback adds a new bucket */
+	unsigned int keyed_idx = keyed ? keyed - list->keyed : 0;
+	unsigned int n_all = list->all.n_slots;
+	unsigned int n_keyed = keyed ? keyed->n_slots : 0;
+	unsigned int i = 0;
+	unsigned int j = 0;
+
+	list->notify_depth += 1;
+
+	/* Merge both buckets in id order, which is the order of addition */
+	while (i < n_all || j < n_keyed) {
+		const struct l_notifylist_entry *e;
+		const struct notify_slot *a = i < n_all ?
+					&list->all.slots[i] : NULL;
+		const struct notify_slot *k = j < n_keyed ?
+					&list->keyed[keyed_idx].slots[j] : NULL;
 		va_list copy;
 
-		if (e->id == 0)
+		if (a && (!k || a->id < k->id)) {
+			e = a->entry;
+			i++;
+		} else {
+			e = k->entry;
+			j++;
+		}
+
+		if (!e || e->id == 0)
 			continue;
 
 		if (match_func && !match_func(e, match_data))
@@ -95,7 +236,10 @@ static void __notifylist_notify(struct l_notifylist *list,
 			break;
 	}
 
-	list->in_notify = false;
+	list->notify_depth -= 1;
+
+	if (list->notify_depth)
+		return;
 
 	if (list->pending_destroy)
 		__notifylist_destroy(list);
@@ -108,71 +252,129 @@ LIB_EXPORT struct l_notifylist *l_notifylist_new(
 {
 	struct l_notifylist *list = l_new(struct l_notifylist, 1);
 
-	list->entries = l_queue_new();
 	list->ops = ops;
 	list->next_id = 1;
 
 	return list;
 }
 
-LIB_EXPORT uint32_t l_notifylist_add(struct l_notifylist *list,
+static uint32_t __notifylist_add(struct l_notifylist *list,
+					struct notify_bucket *bucket,
 					struct l_notifylist_entry *entry)
 {
-	if (!list)
-		return 0;
-
 	entry->id = list->next_id++;
 
-	if (!list->next_id)
+	if (!list->next_id) {
 		list->next_id = 1;
+		list->wrapped = true;
+	}
 
-	l_queue_push_tail(list->entries, entry);
+	__bucket_push(bucket, entry);
 
 	return entry->id;
 }
 
-LIB_EXPORT bool l_notifylist_remove(struct l_notifylist *list, uint32_t id)
+LIB_EXPORT uint32_t l_notifylist_add(struct l_notifylist *list,
+					struct l_notifylist_entry *entry)
 {
-	struct l_notifylist_entry *entry;
+	if (!list)
+		return 0;
+
+	return __notifylist_add(list, &list->all, entry);
+}
+
+/**
+ * l_notifylist_add_keyed:
+ * @list: notifylist object
+ * @type: the notification type the entry is interested in
+ * @entry: the entry to add
+ *
+ * Adds an entry that is only visited by notifications of @type.  Entries
+ * are bucketed by type, so notifications of other types never look at
+ * them.  Entries added with l_notifylist_add() see all notifications.
+ *
+ * Returns: The id of the entry, or 0 on failure
+ **/
+LIB_EXPORT uint32_t l_notifylist_add_keyed(struct l_notifylist *list,
+					int type,
+					struct l_notifylist_entry *entry)
+{
+	struct notify_bucket *bucket;
 
 	if (!list)
-		return false;
+		return 0;
 
-	if (list->in_notify) {
-		entry = l_queue_find(list->entries, __notifylist_entry_match,
-							L_UINT_TO_PTR(id));
-		if (!entry)
-			return false;
+	bucket = __notifylist_find_keyed(list, type);
+	if (!bucket) {
+		list->keyed = l_realloc(list->keyed, (list->n_keyed + 1) *
+						sizeof(struct notify_bucket));
+		bucket = &list->keyed[list->n_keyed++];
+		memset(bucket, 0, sizeof(*bucket));
+		bucket->type = type;
+	}
 
+	return __notifylist_add(list, bucket, entry);
+}
+
+static bool __bucket_remove(struct l_notifylist *list,
+				struct notify_bucket *bucket, int idx)
+{
+	struct notify_slot *slot = &bucket->slots[idx];
+	struct l_notifylist_entry *entry = slot->entry;
+
+	if (!entry || entry->id == 0)
+		return false;
+
+	if (list->notify_depth) {
 		entry->id = 0;	/* Mark stale */
 		list->stale_entries = true;
-
 		return true;
 	}
 
-	entry = l_queue_remove_if(list->entries, __notifylist_entry_match,
-							L_UINT_TO_PTR(id));
-	if (!entry)
-		return false;
-
+	slot->entry = NULL;
+	bucket->n_stale += 1;
 	__notifylist_entry_free(list, entry);
 
+	/* Compacting once half of the slots are gone keeps removal O(1) */
+	if (bucket->n_stale * 2 > bucket->n_slots)
+		__bucket_compact(bucket);
+
 	return true;
 }
 
+LIB_EXPORT bool l_notifylist_remove(struct l_notifylist *list, uint32_t id)
+{
+	unsigned int i;
+	int idx;
+
+	if (!list || !id)
+		return false;
+
+	idx = __bucket_find(list, &list->all, id);
+	if (idx >= 0)
+		return __bucket_remove(list, &list->all, idx);
+
+	for (i = 0; i < list->n_keyed; i++) {
+		idx = __bucket_find(list, &list->keyed[i], id);
+		if (idx >= 0)
+			return __bucket_remove(list, &list->keyed[i], idx);
+	}
+
+	return false;
+}
+
 LIB_EXPORT void l_notifylist_free(struct l_notifylist *list)
 {
 	if (!list)
 		return;
 
-	if (list->in_notify) {
+	if (list->notify_depth) {
 		list->pending_destroy = true;
 		return;
 	}
 
 	__notifylist_destroy(list);
 }
-
 LIB_EXPORT bool l_notifylist_notify(struct l_notifylist *list,
 							int type, ...)
 {
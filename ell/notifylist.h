@@ -40,6 +40,8 @@ struct l_notifylist *l_notifylist_new(const struct l_notifylist_ops *ops);
 void l_notifylist_free(struct l_notifylist *list);
 uint32_t l_notifylist_add(struct l_notifylist *list,
 					struct l_notifylist_entry *entry);
+uint32_t l_notifylist_add_keyed(struct l_notifylist *list, int type,
+					struct l_notifylist_entry *entry);
 bool l_notifylist_remove(struct l_notifylist *list, uint32_t id);
 bool l_notifylist_notify(struct l_notifylist *list, int type, ...);
 bool l_notifylist_notify_matches(struct l_notifylist *list,
@@ -260,7 +260,7 @@ LIB_EXPORT uint8_t *l_pem_load_buffer(const void *buf, size_t buf_len,
 
 int pem_file_open(struct pem_file_info *info, const char *filename)
 {
-	info->fd = open(filename, O_RDONLY);
+	info->fd = open(filename, O_RDONLY | O_CLOEXEC);
 	if (info->fd < 0)
 		return -errno;
 
@@ -398,77 +398,190 @@ int pem_write_certificate_chain(const struct l_certchain *chain,
 	return err < 0 ? err : 0;
 }
 
-LIB_EXPORT struct l_queue *l_pem_load_certificate_list_from_data(
-						const void *buf, size_t len)
+struct l_pem_certificate_iter {
+	struct pem_file_info file;
+	bool mapped;
+	const char *ptr;
+	const char *end;
+};
+
+/**
+ * l_pem_certificate_iter_new:
+ * @filename: PEM file containing one or more certificates
+ *
+ * Maps @filename, typically a CA bundle, for reading its certificates one
+ * at a time with l_pem_certificate_iter_next().  Unlike
+ * l_pem_load_certificate_list() nothing is decoded up front and each
+ * certificate can be freed as soon as the caller is done with it.
+ *
+ * Returns: a new iterator or NULL if the file could not be mapped
+ **/
+LIB_EXPORT struct l_pem_certificate_iter *l_pem_certificate_iter_new(
+							const char *filename)
 {
-	const char *ptr, *end;
-	struct l_queue *list = NULL;
+	struct l_pem_certificate_iter *iter;
 
-	ptr = buf;
-	end = buf + len;
-
-	while (ptr && ptr < end) {
-		uint8_t *der;
-		size_t der_len;
-		char *label = NULL;
-		struct l_cert *cert;
-		const char *base64;
-		size_t base64_len;
-		bool is_certificate;
-
-		base64 = pem_next(ptr, end - ptr, &label,
-					&base64_len, &ptr, false);
-		if (!base64) {
-			if (!ptr)
-				break;
+	if (unlikely(!filename))
+		return NULL;
 
-			/* if ptr was not reset to NULL; parse error */
-			goto error;
-		}
+	iter = l_new(struct l_pem_certificate_iter, 1);
+
+	if (pem_file_open(&iter->file, filename) < 0) {
+		l_free(iter);
+		return NULL;
+	}
+
+	iter->mapped = true;
+	iter->ptr = (const char *) iter->file.data;
+	iter->end = iter->ptr + iter->file.st.st_size;
+
+	return iter;
+}
 
-		is_certificate = !strcmp(label, "CERTIFICATE");
-		l_free(label);
+/**
+ * l_pem_certificate_iter_new_from_data:
+ * @buf: PEM data containing one or more certificates
+ * @len: length of @buf
+ *
+ * Like l_pem_certificate_iter_new() for data in memory.  @buf must stay
+ * valid until the iterator is freed.
+ *
+ * Returns: a new iterator
+ **/
+LIB_EXPORT struct l_pem_certificate_iter *l_pem_certificate_iter_new_from_data(
+							const void *buf,
+							size_t len)
+{
+	struct l_pem_certificate_iter *iter;
 
-		if (!is_certificate)
-			goto error;
+	if (unlikely(!buf && len))
+		return NULL;
 
-		der = l_base64_decode(base64, base64_len, &der_len);
-		if (!der)
-			goto error;
+	iter = l_new(struct l_pem_certificate_iter, 1);
+	iter->ptr = buf;
+	iter->end = iter->ptr + len;
 
-		cert = l_cert_new_from_der(der, der_len);
-		l_free(der);
+	return iter;
+}
 
-		if (!cert)
-			goto error;
+/**
+ * l_pem_certificate_iter_free:
+ * @iter: iterator object
+ *
+ * Frees the iterator and unmaps its file.  Certificates already returned
+ * by the iterator are not affected.
+ **/
+LIB_EXPORT void l_pem_certificate_iter_free(
+					struct l_pem_certificate_iter *iter)
+{
+	if (unlikely(!iter))
+		return;
+
+	if (iter->mapped)
+		pem_file_close(&iter->file);
+
+	l_free(iter);
+}
 
+/**
+ * l_pem_certificate_iter_next:
+ * @iter: iterator object
+ * @out_cert: return location for the next certificate
+ *
+ * Finds and decodes the next PEM block, which must be a certificate.  The
+ * certificate's fields are only parsed when accessed.  The iteration ends
+ * after the first error.
+ *
+ * Returns: 0 if a new certificate was returned in @out_cert, owned by the
+ * caller, -ENOENT at the end of the input or -EBADMSG if a block is
+ * malformed or not a certificate
+ **/
+LIB_EXPORT int l_pem_certificate_iter_next(struct l_pem_certificate_iter *iter,
+						struct l_cert **out_cert)
+{
+	const char *base64;
+	size_t base64_len;
+	char *label;
+	bool is_certificate;
+	struct l_cert *cert;
+
+	if (unlikely(!iter || !out_cert))
+		return -EINVAL;
+
+	if (!iter->ptr || iter->ptr >= iter->end)
+		return -ENOENT;
+
+	base64 = pem_next(iter->ptr, iter->end - iter->ptr, &label,
+				&base64_len, &iter->ptr, false);
+	if (!base64) {
+		/* pem_next resets the pointer to NULL if no label was found */
+		if (!iter->ptr)
+			return -ENOENT;
+
+		goto error;
+	}
+
+	is_certificate = !strcmp(label, "CERTIFICATE");
+	l_free(label);
+
+	if (!is_certificate)
+		goto error;
+
+	cert = cert_new_from_base64(base64, base64_len);
+	if (!cert)
+		goto error;
+
+	*out_cert = cert;
+	return 0;
+
+error:
+	iter->ptr = NULL;
+	return -EBADMSG;
+}
+
+static struct l_queue *pem_load_certificate_list(
+					struct l_pem_certificate_iter *iter)
+{
+	struct l_queue *list = NULL;
+	struct l_cert *cert;
+	int r;
+
+	while ((r = l_pem_certificate_iter_next(iter, &cert)) == 0) {
 		if (!list)
 			list = l_queue_new();
 
 		l_queue_push_tail(list, cert);
 	}
 
-	return list;
+	if (r == -ENOENT)
+		return list;
 
-error:
 	l_queue_destroy(list, (l_queue_destroy_func_t) l_cert_free);
 	return NULL;
 }
 
-LIB_EXPORT struct l_queue *l_pem_load_certificate_list(const char *filename)
+LIB_EXPORT struct l_queue *l_pem_load_certificate_list_from_data(
+						const void *buf, size_t len)
 {
-	struct pem_file_info file;
-	struct l_queue *list = NULL;
+	struct l_pem_certificate_iter iter = {
+		.ptr = buf,
+		.end = (const char *) buf + len,
+	};
 
-	if (unlikely(!filename))
-		return NULL;
+	return pem_load_certificate_list(&iter);
+}
 
-	if (pem_file_open(&file, filename) < 0)
+LIB_EXPORT struct l_queue *l_pem_load_certificate_list(const char *filename)
+{
+	struct l_pem_certificate_iter *iter;
+	struct l_queue *list;
+
+	iter = l_pem_certificate_iter_new(filename);
+	if (!iter)
 		return NULL;
 
-	list = l_pem_load_certificate_list_from_data(file.data,
-							file.st.st_size);
-	pem_file_close(&file);
+	list = pem_load_certificate_list(iter);
+	l_pem_certificate_iter_free(iter);
 
 	return list;
 }
@@ -676,7 +789,8 @@ struct l_key *pem_load_private_key(uint8_t *content, size_t len, char *label,
 
 		pkey = cert_key_from_pkcs8_encrypted_private_key_info(content,
 								len,
-								passphrase);
+								passphrase,
+								NULL);
 		goto done;
 	}
 
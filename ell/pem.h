@@ -16,6 +16,7 @@ struct l_queue;
 struct l_key;
 struct l_cert;
 struct l_certchain;
+struct l_pem_certificate_iter;
 
 uint8_t *l_pem_load_buffer(const void *buf, size_t buf_len, char **type_label,
 				size_t *out_len);
@@ -28,6 +29,15 @@ struct l_queue *l_pem_load_certificate_list(const char *filename);
 struct l_queue *l_pem_load_certificate_list_from_data(const void *buf,
 							size_t len);
 
+struct l_pem_certificate_iter *l_pem_certificate_iter_new(
+							const char *filename);
+struct l_pem_certificate_iter *l_pem_certificate_iter_new_from_data(
+							const void *buf,
+							size_t len);
+void l_pem_certificate_iter_free(struct l_pem_certificate_iter *iter);
+int l_pem_certificate_iter_next(struct l_pem_certificate_iter *iter,
+				struct l_cert **out_cert);
+
 struct l_key *l_pem_load_private_key(const char *filename,
 					const char *passphrase,
 					bool *encrypted);
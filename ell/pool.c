@@ -0,0 +1,162 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdint.h>
+
+#include "pool.h"
+#include "private.h"
+#include "useful.h"
+
+/**
+ * SECTION:pool
+ * @short_description: Fixed size object pool
+ *
+ * Fixed size object pool
+ */
+
+#define POOL_SLAB_SIZE		4096
+#define POOL_MIN_ELEMS		8
+#define POOL_ALIGN		__alignof__(max_align_t)
+
+#define POOL_ROUND(size)	(((size) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1))
+
+struct pool_slab {
+	struct pool_slab *next;
+};
+
+struct pool_free {
+	struct pool_free *next;
+};
+
+/**
+ * l_pool:
+ *
+ * Opaque object representing the pool.
+ */
+struct l_pool {
+	size_t elem_size;
+	size_t slab_size;
+	struct pool_slab *slabs;
+	struct pool_free *free_list;
+	uint8_t *fresh;
+	uint8_t *fresh_end;
+};
+
+/**
+ * l_pool_new:
+ * @elem_size: size of the objects handed out by the pool
+ *
+ * Create a new pool of @elem_size sized objects.  Memory is obtained in
+ * slabs holding many objects and freed objects are kept on a free list
+ * for reuse, which makes allocating and freeing small objects cheaper and
+ * denser than going through the system allocator for each of them.
+ *
+ * A pool is not thread-safe and objects are only returned to the system
+ * when the pool is destroyed.
+ *
+ * Returns: a newly allocated #l_pool object
+ **/
+LIB_EXPORT struct l_pool *l_pool_new(size_t elem_size)
+{
+	struct l_pool *pool;
+
+	pool = l_new(struct l_pool, 1);
+	pool->elem_size = POOL_ROUND(maxsize(elem_size,
+						sizeof(struct pool_free)));
+	pool->slab_size = maxsize(POOL_SLAB_SIZE,
+				POOL_ROUND(sizeof(struct pool_slab)) +
+				pool->elem_size * POOL_MIN_ELEMS);
+
+	return pool;
+}
+
+/**
+ * l_pool_destroy:
+ * @pool: pool object
+ *
+ * Free @pool along with all the objects allocated from it, whether or not
+ * they have been returned with l_pool_free().
+ **/
+LIB_EXPORT void l_pool_destroy(struct l_pool *pool)
+{
+	struct pool_slab *slab;
+
+	if (unlikely(!pool))
+		return;
+
+	while ((slab = pool->slabs)) {
+		pool->slabs = slab->next;
+		l_free(slab);
+	}
+
+	l_free(pool);
+}
+
+static void pool_grow(struct l_pool *pool)
+{
+	struct pool_slab *slab = l_malloc(pool->slab_size);
+
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	/* Objects are carved out of the new slab only as they are needed */
+	pool->fresh = (uint8_t *) slab + POOL_ROUND(sizeof(*slab));
+	pool->fresh_end = (uint8_t *) slab + pool->slab_size;
+}
+
+/**
+ * l_pool_alloc:
+ * @pool: pool object
+ *
+ * Allocate an object from @pool.  Like l_new(), the memory is zeroed and
+ * allocation failures abort().
+ *
+ * Returns: pointer to the object, or NULL if @pool is NULL
+ **/
+LIB_EXPORT void *l_pool_alloc(struct l_pool *pool)
+{
+	void *elem;
+
+	if (unlikely(!pool))
+		return NULL;
+
+	if (pool->free_list) {
+		elem = pool->free_list;
+		pool->free_list = pool->free_list->next;
+	} else {
+		if ((size_t) (pool->fresh_end - pool->fresh) < pool->elem_size)
+			pool_grow(pool);
+
+		elem = pool->fresh;
+		pool->fresh += pool->elem_size;
+	}
+
+	return memset(elem, 0, pool->elem_size);
+}
+
+/**
+ * l_pool_free:
+ * @pool: pool object
+ * @elem: object previously returned by l_pool_alloc() on @pool
+ *
+ * Return @elem to @pool for reuse by a later l_pool_alloc().
+ **/
+LIB_EXPORT void l_pool_free(struct l_pool *pool, void *elem)
+{
+	struct pool_free *entry = elem;
+
+	if (unlikely(!pool || !elem))
+		return;
+
+	entry->next = pool->free_list;
+	pool->free_list = entry;
+}
@@ -0,0 +1,29 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef __ELL_POOL_H
+#define __ELL_POOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct l_pool;
+
+struct l_pool *l_pool_new(size_t elem_size);
+void l_pool_destroy(struct l_pool *pool);
+
+void *l_pool_alloc(struct l_pool *pool);
+void l_pool_free(struct l_pool *pool, void *elem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ELL_POOL_H */
@@ -0,0 +1,256 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "pqueue.h"
+#include "private.h"
+#include "useful.h"
+
+/**
+ * SECTION:pqueue
+ * @short_description: Priority queue support
+ *
+ * Priority queue support
+ */
+
+#define PQUEUE_MIN_SIZE 16
+
+/*
+ * The l_minheap helpers only inline the compare function when it is known
+ * at compile time, which is what L_PQUEUE_DEFINE() provides.  The generic
+ * functions below use the same layout but call the less function given at
+ * creation time.
+ */
+static bool pqueue_less(struct l_pqueue *pqueue, uint32_t a, uint32_t b)
+{
+	struct l_pqueue_node **data = pqueue->heap.data;
+
+	return pqueue->less(data[a], data[b]);
+}
+
+static void pqueue_swap(struct l_pqueue *pqueue, uint32_t a, uint32_t b)
+{
+	struct l_pqueue_node **data = pqueue->heap.data;
+
+	__l_pqueue_swap(&data[a], &data[b]);
+}
+
+static void pqueue_sift_up(struct l_pqueue *pqueue, uint32_t pos)
+{
+	uint32_t parent;
+
+	while (pos) {
+		parent = (pos - 1) / 2;
+
+		if (pqueue_less(pqueue, parent, pos))
+			break;
+
+		pqueue_swap(pqueue, parent, pos);
+		pos = parent;
+	}
+}
+
+static void pqueue_sift_down(struct l_pqueue *pqueue, uint32_t pos)
+{
+	uint32_t used = pqueue->heap.used;
+	uint32_t left;
+	uint32_t smallest;
+
+	while ((left = pos * 2 + 1) < used) {
+		smallest = pqueue_less(pqueue, left, pos) ? left : pos;
+
+		if (left + 1 < used && pqueue_less(pqueue, left + 1, smallest))
+			smallest = left + 1;
+
+		if (smallest == pos)
+			break;
+
+		pqueue_swap(pqueue, pos, smallest);
+		pos = smallest;
+	}
+}
+
+static void pqueue_sift(struct l_pqueue *pqueue, uint32_t pos)
+{
+	if (pos && pqueue_less(pqueue, pos, (pos - 1) / 2))
+		pqueue_sift_up(pqueue, pos);
+	else
+		pqueue_sift_down(pqueue, pos);
+}
+
+/**
+ * l_pqueue_new:
+ * @less: function returning true if @a is to be dequeued before @b
+ *
+ * Create a new priority queue.  Objects are queued through a struct
+ * l_pqueue_node embedded in them.  The node also acts as a stable handle
+ * that lets an object be removed, or repositioned after its priority
+ * changed, in O(log n).
+ *
+ * Returns: a newly allocated #l_pqueue object
+ **/
+LIB_EXPORT struct l_pqueue *l_pqueue_new(l_pqueue_less_func_t less)
+{
+	struct l_pqueue *pqueue;
+
+	if (unlikely(!less))
+		return NULL;
+
+	pqueue = l_new(struct l_pqueue, 1);
+	pqueue->less = less;
+
+	return pqueue;
+}
+
+/**
+ * l_pqueue_free:
+ * @pqueue: priority queue object
+ *
+ * Free @pqueue.  Objects still queued are marked as not queued, but are
+ * not otherwise touched.
+ **/
+LIB_EXPORT void l_pqueue_free(struct l_pqueue *pqueue)
+{
+	struct l_pqueue_node **data;
+	uint32_t i;
+
+	if (unlikely(!pqueue))
+		return;
+
+	data = pqueue->heap.data;
+
+	for (i = 0; i < pqueue->heap.used; i++)
+		data[i]->index = 0;
+
+	l_free(pqueue->heap.data);
+	l_free(pqueue);
+}
+
+/**
+ * l_pqueue_reserve:
+ * @pqueue: priority queue object
+ * @count: number of objects to make room for
+ *
+ * Grow the storage of @pqueue so that it can hold at least @count objects
+ * without further allocations.  Pushing grows the storage as needed, this
+ * is only useful to preallocate.
+ **/
+LIB_EXPORT void l_pqueue_reserve(struct l_pqueue *pqueue, unsigned int count)
+{
+	uint32_t capacity;
+
+	if (unlikely(!pqueue) || count <= pqueue->heap.capacity)
+		return;
+
+	capacity = maxsize(pqueue->heap.capacity, PQUEUE_MIN_SIZE / 2);
+
+	while (capacity < count)
+		capacity *= 2;
+
+	pqueue->heap.data = l_realloc(pqueue->heap.data,
+				capacity * sizeof(struct l_pqueue_node *));
+	pqueue->heap.capacity = capacity;
+}
+
+/**
+ * l_pqueue_push:
+ * @pqueue: priority queue object
+ * @node: node of the object to queue
+ *
+ * Returns: #true if @node was queued, #false if @pqueue is invalid or
+ *          @node is already queued
+ **/
+LIB_EXPORT bool l_pqueue_push(struct l_pqueue *pqueue,
+					struct l_pqueue_node *node)
+{
+	struct l_pqueue_node **data;
+
+	if (unlikely(!pqueue || !node) || node->index)
+		return false;
+
+	if (pqueue->heap.used == pqueue->heap.capacity)
+		l_pqueue_reserve(pqueue, pqueue->heap.used + 1);
+
+	data = pqueue->heap.data;
+	data[pqueue->heap.used] = node;
+	node->index = ++pqueue->heap.used;
+	pqueue_sift_up(pqueue, node->index - 1);
+
+	return true;
+}
+
+/**
+ * l_pqueue_pop:
+ * @pqueue: priority queue object
+ *
+ * Remove the first object in priority order.
+ *
+ * Returns: the node of the removed object, or #NULL if @pqueue is empty
+ **/
+LIB_EXPORT struct l_pqueue_node *l_pqueue_pop(struct l_pqueue *pqueue)
+{
+	struct l_pqueue_node *node = l_pqueue_peek(pqueue);
+
+	if (node)
+		l_pqueue_remove(pqueue, node);
+
+	return node;
+}
+
+/**
+ * l_pqueue_remove:
+ * @pqueue: priority queue object
+ * @node: node of a queued object
+ *
+ * Returns: #true if @node was removed, #false if it wasn't queued
+ **/
+LIB_EXPORT bool l_pqueue_remove(struct l_pqueue *pqueue,
+					struct l_pqueue_node *node)
+{
+	struct l_pqueue_node **data;
+	uint32_t pos;
+
+	if (unlikely(!pqueue || !node) || !node->index)
+		return false;
+
+	data = pqueue->heap.data;
+	pos = node->index - 1;
+	node->index = 0;
+
+	if (pos == --pqueue->heap.used)
+		return true;
+
+	data[pos] = data[pqueue->heap.used];
+	data[pos]->index = pos + 1;
+	pqueue_sift(pqueue, pos);
+
+	return true;
+}
+
+/**
+ * l_pqueue_update:
+ * @pqueue: priority queue object
+ * @node: node of a queued object
+ *
+ * Restore the heap order after the priority of the object owning @node was
+ * changed, in either direction.
+ *
+ * Returns: #true on success, #false if @node isn't queued
+ **/
+LIB_EXPORT bool l_pqueue_update(struct l_pqueue *pqueue,
+					struct l_pqueue_node *node)
+{
+	if (unlikely(!pqueue || !node) || !node->index)
+		return false;
+
+	pqueue_sift(pqueue, node->index - 1);
+
+	return true;
+}
@@ -0,0 +1,218 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef __ELL_PQUEUE_H
+#define __ELL_PQUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ell/util.h>
+#include <ell/minheap.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Embedded in each queued object.  It doubles as the handle used to remove
+ * or reposition the object and must be zeroed before the first push.
+ */
+struct l_pqueue_node {
+	uint32_t index;
+};
+
+typedef bool (*l_pqueue_less_func_t)(const struct l_pqueue_node *a,
+					const struct l_pqueue_node *b);
+
+/* Exposed for the L_PQUEUE_DEFINE() accessors only */
+struct l_pqueue {
+	struct l_minheap heap;
+	l_pqueue_less_func_t less;
+};
+
+struct l_pqueue *l_pqueue_new(l_pqueue_less_func_t less);
+void l_pqueue_free(struct l_pqueue *pqueue);
+void l_pqueue_reserve(struct l_pqueue *pqueue, unsigned int count);
+
+bool l_pqueue_push(struct l_pqueue *pqueue, struct l_pqueue_node *node);
+struct l_pqueue_node *l_pqueue_pop(struct l_pqueue *pqueue);
+bool l_pqueue_remove(struct l_pqueue *pqueue, struct l_pqueue_node *node);
+bool l_pqueue_update(struct l_pqueue *pqueue, struct l_pqueue_node *node);
+
+static inline struct l_pqueue_node *l_pqueue_peek(struct l_pqueue *pqueue)
+{
+	struct l_pqueue_node **data;
+
+	if (!pqueue || !pqueue->heap.used)
+		return NULL;
+
+	data = pqueue->heap.data;
+	return data[0];
+}
+
+static inline unsigned int l_pqueue_length(struct l_pqueue *pqueue)
+{
+	return pqueue ? pqueue->heap.used : 0;
+}
+
+static inline bool l_pqueue_node_is_queued(const struct l_pqueue_node *node)
+{
+	return node->index != 0;
+}
+
+/*
+ * The node index is the heap position plus one, so that zeroed nodes read
+ * as not queued.  It is updated before every heap operation that moves the
+ * node, the swaps done by the heap then keep it in sync.
+ */
+static inline void __l_pqueue_swap(void *lhs, void *rhs)
+{
+	struct l_pqueue_node **l = lhs;
+	struct l_pqueue_node **r = rhs;
+	struct l_pqueue_node *tmp = *l;
+	uint32_t index = tmp->index;
+
+	*l = *r;
+	*r = tmp;
+	tmp->index = (*l)->index;
+	(*l)->index = index;
+}
+
+static inline __attribute__((always_inline))
+bool __l_pqueue_push(struct l_pqueue *pqueue, struct l_pqueue_node *node,
+					const struct l_minheap_ops *ops)
+{
+	if (!pqueue || node->index)
+		return false;
+
+	if (pqueue->heap.used == pqueue->heap.capacity)
+		l_pqueue_reserve(pqueue, pqueue->heap.used + 1);
+
+	node->index = pqueue->heap.used + 1;
+	return l_minheap_push(&pqueue->heap, ops, &node);
+}
+
+static inline __attribute__((always_inline))
+bool __l_pqueue_remove(struct l_pqueue *pqueue, struct l_pqueue_node *node,
+					const struct l_minheap_ops *ops)
+{
+	struct l_pqueue_node **data;
+
+	if (!pqueue || !node->index)
+		return false;
+
+	/* The last node is moved into the vacated slot and sifted */
+	data = pqueue->heap.data;
+	data[pqueue->heap.used - 1]->index = node->index;
+	l_minheap_delete(&pqueue->heap, node->index - 1, ops);
+	node->index = 0;
+
+	return true;
+}
+
+static inline __attribute__((always_inline))
+struct l_pqueue_node *__l_pqueue_pop(struct l_pqueue *pqueue,
+					const struct l_minheap_ops *ops)
+{
+	struct l_pqueue_node *node = l_pqueue_peek(pqueue);
+
+	if (node)
+		__l_pqueue_remove(pqueue, node, ops);
+
+	return node;
+}
+
+static inline __attribute__((always_inline))
+bool __l_pqueue_update(struct l_pqueue *pqueue, struct l_pqueue_node *node,
+					const struct l_minheap_ops *ops)
+{
+	uint32_t pos;
+
+	if (!pqueue || !node->index)
+		return false;
+
+	pos = node->index - 1;
+
+	if (pos)
+		__minheap_sift_updown(pqueue->heap.data, pqueue->heap.used,
+								pos, ops);
+	else
+		__minheap_sift_down(pqueue->heap.data, pqueue->heap.used,
+								pos, ops);
+
+	return true;
+}
+
+/*
+ * Type-specialized accessors for a priority queue of @type objects that
+ * embed a struct l_pqueue_node as @member, ordered by
+ * bool @less_func(const @type *a, const @type *b).  Unlike the l_pqueue_*
+ * functions, which go through the function pointer given to l_pqueue_new,
+ * these let the compiler inline @less_func into the heap operations.  The
+ * queue is created with name_new() and freed with l_pqueue_free().
+ */
+#define L_PQUEUE_DEFINE(name, type, member, less_func)			\
+static inline bool name##_node_less(const struct l_pqueue_node *a,	\
+					const struct l_pqueue_node *b)	\
+{									\
+	return less_func(l_container_of(a, type, member),		\
+			l_container_of(b, type, member));		\
+}									\
+									\
+static inline bool name##_heap_less(const void *lhs, const void *rhs)	\
+{									\
+	return name##_node_less(*(struct l_pqueue_node * const *) lhs,	\
+				*(struct l_pqueue_node * const *) rhs);	\
+}									\
+									\
+static const struct l_minheap_ops name##_ops = {			\
+	.elem_size = sizeof(struct l_pqueue_node *),			\
+	.less = name##_heap_less,					\
+	.swap = __l_pqueue_swap,					\
+};									\
+									\
+static inline struct l_pqueue *name##_new(void)			\
+{									\
+	return l_pqueue_new(name##_node_less);				\
+}									\
+									\
+static inline type *name##_peek(struct l_pqueue *pqueue)		\
+{									\
+	struct l_pqueue_node *node = l_pqueue_peek(pqueue);		\
+									\
+	return node ? l_container_of(node, type, member) : NULL;	\
+}									\
+									\
+static inline bool name##_push(struct l_pqueue *pqueue, type *elem)	\
+{									\
+	return __l_pqueue_push(pqueue, &elem->member, &name##_ops);	\
+}									\
+									\
+static inline type *name##_pop(struct l_pqueue *pqueue)		\
+{									\
+	struct l_pqueue_node *node = __l_pqueue_pop(pqueue, &name##_ops);\
+									\
+	return node ? l_container_of(node, type, member) : NULL;	\
+}									\
+									\
+static inline bool name##_remove(struct l_pqueue *pqueue, type *elem)	\
+{									\
+	return __l_pqueue_remove(pqueue, &elem->member, &name##_ops);	\
+}									\
+									\
+static inline bool name##_update(struct l_pqueue *pqueue, type *elem)	\
+{									\
+	return __l_pqueue_update(pqueue, &elem->member, &name##_ops);	\
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ELL_PQUEUE_H */
@@ -0,0 +1,23 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * Statically defined tracepoints, enabled with --enable-usdt.  A probe
+ * site is a single nop until a tracer attaches to it, for example:
+ *
+ *   bpftrace -e 'usdt:/usr/lib/libell.so.0:ell:timeout_fire { ... }'
+ *
+ * Without --enable-usdt the probes, and their arguments, compile to
+ * nothing.
+ */
+#ifdef HAVE_USDT
+#include <sys/sdt.h>
+
+#define PROBE(name, ...) STAP_PROBEV(ell, name, ##__VA_ARGS__)
+#else
+#define PROBE(name, ...) do {} while (0)
+#endif
@@ -10,6 +10,7 @@
 #endif
 
 #include "queue.h"
+#include "pool.h"
 #include "private.h"
 #include "useful.h"
 
@@ -31,6 +32,36 @@ struct l_queue {
 	unsigned int entries;
 };
 
+/*
+ * Entries are recycled through a per-thread pool.  A queue is normally only
+ * used by the thread owning it, but since the pools are never destroyed an
+ * entry freed by another thread is still valid and simply gets reused by
+ * that thread.
+ */
+static __thread struct l_pool *entry_pool;
+
+static struct l_pool *entry_pool_get(void)
+{
+	if (unlikely(!entry_pool))
+		entry_pool = l_pool_new(sizeof(struct l_queue_entry));
+
+	return entry_pool;
+}
+
+static struct l_queue_entry *entry_new(void *data)
+{
+	struct l_queue_entry *entry = l_pool_alloc(entry_pool_get());
+
+	entry->data = data;
+
+	return entry;
+}
+
+static void entry_free(struct l_queue_entry *entry)
+{
+	l_pool_free(entry_pool_get(), entry);
+}
+
 /**
  * l_queue_new:
  *
@@ -93,7 +124,7 @@ LIB_EXPORT void l_queue_clear(struct l_queue *queue,
 
 		entry = entry->next;
 
-		l_free(tmp);
+		entry_free(tmp);
 	}
 
 	queue->head = NULL;
@@ -118,9 +149,7 @@ LIB_EXPORT bool l_queue_push_tail(struct l_queue *queue, void *data)
 	if (unlikely(!queue))
 		return false;
 
-	entry = l_new(struct l_queue_entry, 1);
-
-	entry->data = data;
+	entry = entry_new(data);
 	entry->next = NULL;
 
 	if (queue->tail)
@@ -153,9 +182,7 @@ LIB_EXPORT bool l_queue_push_head(struct l_queue *queue, void *data)
 	if (unlikely(!queue))
 		return false;
 
-	entry = l_new(struct l_queue_entry, 1);
-
-	entry->data = data;
+	entry = entry_new(data);
 	entry->next = queue->head;
 
 	queue->head = entry;
@@ -197,7 +224,7 @@ LIB_EXPORT void *l_queue_pop_head(struct l_queue *queue)
 
 	data = entry->data;
 
-	l_free(entry);
+	entry_free(entry);
 
 	queue->entries--;
 
@@ -271,9 +298,7 @@ LIB_EXPORT bool l_queue_insert(struct l_queue *queue, void *data,
 	if (unlikely(!queue || !function))
 		return false;
 
-	entry = l_new(struct l_queue_entry, 1);
-
-	entry->data = data;
+	entry = entry_new(data);
 	entry->next = NULL;
 
 	if (!queue->head) {
@@ -365,7 +390,7 @@ LIB_EXPORT bool l_queue_remove(struct l_queue *queue, void *data)
 		if (!entry->next)
 			queue->tail = prev;
 
-		l_free(entry);
+		entry_free(entry);
 
 		queue->entries--;
 
@@ -462,7 +487,7 @@ LIB_EXPORT unsigned int l_queue_foreach_remove(struct l_queue *queue,
 
 			entry = entry->next;
 
-			l_free(tmp);
+			entry_free(tmp);
 
 			count++;
 		} else {
@@ -513,7 +538,7 @@ LIB_EXPORT void *l_queue_remove_if(struct l_queue *queue,
 
 			data = tmp->data;
 
-			l_free(tmp);
+			entry_free(tmp);
 			queue->entries--;
 
 			return data;
@@ -13,9 +13,12 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <sys/syscall.h>
 
 #include "random.h"
+#include "useful.h"
 #include "private.h"
 #include "missing.h"
 
@@ -88,3 +91,170 @@ LIB_EXPORT uint32_t l_getrandom_uint32(void)
 
         return random() * RAND_MAX + random();
 }
+
+/*
+ * Per-thread ChaCha20 generator keyed from getrandom, for callers needing
+ * many random values where a syscall each would dominate.  It uses "fast
+ * key erasure": every refill of the output buffer starts with a new key
+ * taken from the previous refill's output, and served bytes are wiped, so
+ * a later compromise of the state does not reveal earlier output.  The key
+ * is replaced with fresh getrandom output every RNG_RESEED_BYTES and in
+ * the child after fork(), which would otherwise repeat the parent's
+ * output.
+ */
+#define RNG_BLOCKS		16
+#define RNG_KEY_SIZE		32
+#define RNG_RESEED_BYTES	(1024 * 1024)
+
+struct rng_state {
+	uint32_t key[RNG_KEY_SIZE / 4];
+	uint8_t buf[RNG_BLOCKS * 64];
+	size_t avail;
+	size_t generated;
+	unsigned int fork_generation;
+	bool seeded;
+};
+
+static __thread struct rng_state rng;
+static unsigned int rng_fork_generation;
+static pthread_once_t rng_atfork_once = PTHREAD_ONCE_INIT;
+
+static void rng_atfork_child(void)
+{
+	rng_fork_generation++;
+}
+
+static void rng_atfork_register(void)
+{
+	pthread_atfork(NULL, NULL, rng_atfork_child);
+}
+
+static inline uint32_t rol32(uint32_t x, unsigned int n)
+{
+	return (x << n) | (x >> (32 - n));
+}
+
+#define CHACHA_QUARTERROUND(a, b, c, d)				\
+	do {							\
+		a += b; d = rol32(d ^ a, 16);			\
+		c += d; b = rol32(b ^ c, 12);			\
+		a += b; d = rol32(d ^ a, 8);			\
+		c += d; b = rol32(b ^ c, 7);			\
+	} while (0)
+
+/* RFC 8439 Section 2.3 with a zero nonce */
+static void chacha20_block(const uint32_t key[8], uint32_t counter,
+				uint8_t *out)
+{
+	uint32_t in[16] = {
+		0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+		key[0], key[1], key[2], key[3],
+		key[4], key[5], key[6], key[7],
+		counter, 0, 0, 0,
+	};
+	uint32_t x[16];
+	unsigned int i;
+
+	memcpy(x, in, sizeof(x));
+
+	for (i = 0; i < 10; i++) {
+		CHACHA_QUARTERROUND(x[0], x[4], x[8], x[12]);
+		CHACHA_QUARTERROUND(x[1], x[5], x[9], x[13]);
+		CHACHA_QUARTERROUND(x[2], x[6], x[10], x[14]);
+		CHACHA_QUARTERROUND(x[3], x[7], x[11], x[15]);
+		CHACHA_QUARTERROUND(x[0], x[5], x[10], x[15]);
+		CHACHA_QUARTERROUND(x[1], x[6], x[11], x[12]);
+		CHACHA_QUARTERROUND(x[2], x[7], x[8], x[13]);
+		CHACHA_QUARTERROUND(x[3], x[4], x[9], x[14]);
+	}
+
+	for (i = 0; i < 16; i++)
+		l_put_le32(x[i] + in[i], out + i * 4);
+
+	explicit_bzero(x, sizeof(x));
+	explicit_bzero(in, sizeof(in));
+}
+
+static bool rng_refill(struct rng_state *state)
+{
+	unsigned int i;
+
+	if (!state->seeded || state->generated >= RNG_RESEED_BYTES) {
+		pthread_once(&rng_atfork_once, rng_atfork_register);
+
+		if (!l_getrandom(state->key, sizeof(state->key)))
+			return false;
+
+		state->seeded = true;
+		state->generated = 0;
+		state->fork_generation = rng_fork_generation;
+	}
+
+	for (i = 0; i < RNG_BLOCKS; i++)
+		chacha20_block(state->key, i, state->buf + i * 64);
+
+	memcpy(state->key, state->buf, RNG_KEY_SIZE);
+	explicit_bzero(state->buf, RNG_KEY_SIZE);
+
+	state->avail = sizeof(state->buf) - RNG_KEY_SIZE;
+	state->generated += state->avail;
+
+	return true;
+}
+
+/**
+ * l_getrandom_buffered:
+ * @buf: buffer to fill with random data
+ * @len: length of random data requested
+ *
+ * Like l_getrandom(), but the data comes from a per-thread ChaCha20 based
+ * generator seeded and periodically reseeded from the kernel, so that
+ * most calls make no syscall.  The output is suitable for cryptographic
+ * use.  Only fork() is detected, a process cloned by other means must
+ * not share the generator state with its parent.
+ *
+ * Returns: true if the random data could be generated, false otherwise.
+ **/
+LIB_EXPORT bool l_getrandom_buffered(void *buf, size_t len)
+{
+	struct rng_state *state = &rng;
+
+	if (state->seeded &&
+			state->fork_generation != rng_fork_generation)
+		explicit_bzero(state, sizeof(*state));
+
+	while (len) {
+		size_t n;
+		uint8_t *p;
+
+		if (!state->avail && !rng_refill(state))
+			return false;
+
+		n = minsize(len, state->avail);
+		p = state->buf + sizeof(state->buf) - state->avail;
+
+		memcpy(buf, p, n);
+		explicit_bzero(p, n);
+		state->avail -= n;
+		buf += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+/**
+ * l_getrandom_buffered_uint32:
+ *
+ * Returns a random 32-bit number from the generator used by
+ * l_getrandom_buffered(), or from random() if it could not be seeded.
+ **/
+LIB_EXPORT uint32_t l_getrandom_buffered_uint32(void)
+{
+	uint32_t u;
+
+	if (l_getrandom_buffered(&u, sizeof(u)))
+		return u;
+
+	return random() * RAND_MAX + random();
+}
@@ -21,6 +21,9 @@ bool l_getrandom_is_supported(void);
 
 uint32_t l_getrandom_uint32(void);
 
+bool l_getrandom_buffered(void *buf, size_t len);
+uint32_t l_getrandom_buffered_uint32(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,19 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+struct retransmit;
+
+typedef void (*retransmit_func_t)(struct retransmit *rt, void *user_data);
+
+struct retransmit *_retransmit_new(retransmit_func_t func, void *user_data);
+void _retransmit_free(struct retransmit *rt);
+void _retransmit_schedule_ms(struct retransmit *rt, uint64_t ms);
+void _retransmit_cancel(struct retransmit *rt);
+bool _retransmit_is_pending(const struct retransmit *rt);
+
+uint64_t _retransmit_backoff_ms(uint64_t prev_ms, uint64_t irt_ms,
+				uint64_t mrt_ms);
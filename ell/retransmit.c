@@ -0,0 +1,209 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "useful.h"
+#include "time.h"
+#include "timeout.h"
+#include "pqueue.h"
+#include "private.h"
+#include "time-private.h"
+#include "retransmit-private.h"
+
+/*
+ * Retransmissions of the DHCP, DHCPv6 and ICMPv6 clients, as well as the
+ * ACD probes and announcements, are driven from a single timer per thread.
+ * Besides saving a timer per client this lets the sends be paced: when
+ * many interfaces come up at once no more than RETRANSMIT_BURST
+ * retransmissions go out per RETRANSMIT_SLOT, the rest are pushed back to
+ * the following slots.
+ */
+#define RETRANSMIT_BURST 16
+#define RETRANSMIT_SLOT (10 * L_USEC_PER_MSEC)
+
+struct retransmit {
+	struct l_pqueue_node node;
+	uint64_t due;
+	retransmit_func_t func;
+	void *user_data;
+};
+
+static bool retransmit_before(const struct retransmit *a,
+				const struct retransmit *b)
+{
+	return a->due < b->due;
+}
+
+L_PQUEUE_DEFINE(retransmit_queue, struct retransmit, node, retransmit_before)
+
+static __thread struct l_pqueue *queue;
+static __thread struct l_timeout *timer;
+static __thread unsigned int n_retransmits;
+static __thread uint64_t slot_start;
+static __thread unsigned int slot_sent;
+static __thread bool dispatching;
+
+static void retransmit_timer_cb(struct l_timeout *timeout, void *user_data);
+
+/* Also called if the main loop goes away, a new timer is created later */
+static void retransmit_timer_destroy(void *user_data)
+{
+	timer = NULL;
+}
+
+static void retransmit_rearm(void)
+{
+	struct retransmit *next = retransmit_queue_peek(queue);
+	uint64_t now = l_time_now();
+	uint64_t due;
+	uint64_t ms;
+
+	if (!next || dispatching)
+		return;
+
+	due = next->due;
+
+	/* Over budget, wait for the next slot */
+	if (slot_sent >= RETRANSMIT_BURST && due < slot_start + RETRANSMIT_SLOT)
+		due = slot_start + RETRANSMIT_SLOT;
+
+	/* Round up so that the timer never fires ahead of the deadline */
+	ms = l_time_after(due, now) ?
+		l_time_to_msecs(l_time_diff(now, due) + L_USEC_PER_MSEC - 1) :
+		0;
+
+	if (timer)
+		l_timeout_modify_ms(timer, ms ?: 1);
+	else
+		timer = l_timeout_create_ms(ms ?: 1, retransmit_timer_cb, NULL,
+						retransmit_timer_destroy);
+}
+
+static void retransmit_teardown(void)
+{
+	l_timeout_remove(timer);
+	l_pqueue_free(queue);
+	queue = NULL;
+}
+
+static void retransmit_timer_cb(struct l_timeout *timeout, void *user_data)
+{
+	struct retransmit *rt;
+	uint64_t now = l_time_now();
+
+	if (l_time_diff(slot_start, now) >= RETRANSMIT_SLOT) {
+		slot_start = now;
+		slot_sent = 0;
+	}
+
+	dispatching = true;
+
+	while (slot_sent < RETRANSMIT_BURST &&
+			(rt = retransmit_queue_peek(queue)) &&
+			!l_time_after(rt->due, now)) {
+		retransmit_queue_remove(queue, rt);
+		slot_sent++;
+		rt->func(rt, rt->user_data);
+	}
+
+	dispatching = false;
+
+	if (!n_retransmits)
+		retransmit_teardown();
+	else
+		retransmit_rearm();
+}
+
+struct retransmit *_retransmit_new(retransmit_func_t func, void *user_data)
+{
+	struct retransmit *rt;
+
+	if (unlikely(!func))
+		return NULL;
+
+	if (!queue)
+		queue = retransmit_queue_new();
+
+	rt = l_new(struct retransmit, 1);
+	rt->func = func;
+	rt->user_data = user_data;
+	n_retransmits++;
+
+	return rt;
+}
+
+void _retransmit_free(struct retransmit *rt)
+{
+	if (!rt)
+		return;
+
+	_retransmit_cancel(rt);
+	l_free(rt);
+
+	if (--n_retransmits || dispatching)
+		return;
+
+	retransmit_teardown();
+}
+
+/* Run @rt in @ms milliseconds, replacing any earlier schedule */
+void _retransmit_schedule_ms(struct retransmit *rt, uint64_t ms)
+{
+	if (unlikely(!rt))
+		return;
+
+	rt->due = l_time_now() + ms * L_USEC_PER_MSEC;
+
+	if (!retransmit_queue_update(queue, rt))
+		retransmit_queue_push(queue, rt);
+
+	retransmit_rearm();
+}
+
+void _retransmit_cancel(struct retransmit *rt)
+{
+	if (unlikely(!rt))
+		return;
+
+	retransmit_queue_remove(queue, rt);
+}
+
+bool _retransmit_is_pending(const struct retransmit *rt)
+{
+	return rt && l_pqueue_node_is_queued(&rt->node);
+}
+
+/*
+ * RFC 8415 Section 15 and RFC 7559 Section 2 retransmission time, where
+ * RAND is uniformly distributed over [-0.1, 0.1]:
+ *
+ *	RT = IRT + RAND*IRT		for the first retransmission
+ *	RT = 2*RTprev + RAND*RTprev	for the following ones
+ *	RT = MRT + RAND*MRT		if RT > MRT and MRT is not 0
+ */
+uint64_t _retransmit_backoff_ms(uint64_t prev_ms, uint64_t irt_ms,
+				uint64_t mrt_ms)
+{
+	uint64_t rt;
+
+	if (!prev_ms)
+		return _time_fuzz_msecs(irt_ms);
+
+	rt = prev_ms + _time_fuzz_msecs(prev_ms);
+
+	if (mrt_ms && rt > mrt_ms)
+		rt = _time_fuzz_msecs(mrt_ms);
+
+	return rt;
+}
@@ -12,7 +12,9 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
 #include <sys/param.h>
 
 #include "private.h"
@@ -38,6 +40,7 @@ struct l_ringbuf {
 	size_t out;
 	l_ringbuf_tracing_func_t in_tracing;
 	void *in_data;
+	bool mirrored;
 };
 
 #define RINGBUF_RESET 0
@@ -83,6 +86,70 @@ LIB_EXPORT struct l_ringbuf *l_ringbuf_new(size_t size)
 	return ringbuf;
 }
 
+/**
+ * l_ringbuf_new_mirrored:
+ * @size: Minimum size of the ring buffer.
+ *
+ * Create a new ring buffer whose storage is mapped twice, back to back, in
+ * the address space.  Data that wraps around the end of the buffer can
+ * then be accessed as if it were contiguous: l_ringbuf_peek and
+ * l_ringbuf_reserve always return the whole occupied or free region in one
+ * piece.  The size is rounded up to a power of two that is also a multiple
+ * of the page size.
+ *
+ * Returns: a newly allocated #l_ringbuf object, or NULL if the mirrored
+ * mapping could not be set up.
+ **/
+LIB_EXPORT struct l_ringbuf *l_ringbuf_new_mirrored(size_t size)
+{
+	struct l_ringbuf *ringbuf;
+	size_t real_size;
+	void *addr;
+	int fd;
+
+	if (size < 2 || size > UINT_MAX / 2)
+		return NULL;
+
+	real_size = align_power2(maxsize(size, sysconf(_SC_PAGESIZE)));
+
+	fd = memfd_create("ell-ringbuf", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (ftruncate(fd, real_size) < 0)
+		goto close_fd;
+
+	/* Reserve room for both views, then map the buffer over each half */
+	addr = mmap(NULL, real_size * 2, PROT_NONE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		goto close_fd;
+
+	if (mmap(addr, real_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+			mmap(addr + real_size, real_size,
+				PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(addr, real_size * 2);
+		goto close_fd;
+	}
+
+	close(fd);
+
+	ringbuf = l_new(struct l_ringbuf, 1);
+	ringbuf->buffer = addr;
+	ringbuf->size = real_size;
+	ringbuf->in = RINGBUF_RESET;
+	ringbuf->out = RINGBUF_RESET;
+	ringbuf->mirrored = true;
+
+	return ringbuf;
+
+close_fd:
+	close(fd);
+	return NULL;
+}
+
 /**
  * l_ringbuf_free:
  * @ringbuf: Ring Buffer object
@@ -94,7 +161,11 @@ LIB_EXPORT void l_ringbuf_free(struct l_ringbuf *ringbuf)
 	if (!ringbuf)
 		return;
 
-	l_free(ringbuf->buffer);
+	if (ringbuf->mirrored)
+		munmap(ringbuf->buffer, ringbuf->size * 2);
+	else
+		l_free(ringbuf->buffer);
+
 	l_free(ringbuf);
 }
 
@@ -190,23 +261,31 @@ LIB_EXPORT size_t l_ringbuf_drain(struct l_ringbuf *ringbuf, size_t count)
  * locations.  Typically offset of 0 is used first.  Then, if len_nowrap
  * is less than the length returned by l_ringbuf_len, the rest of the data
  * can be obtained by calling l_ringbuf_peek with offset set to len_nowrap.
+ * With a buffer created by l_ringbuf_new_mirrored, all the stored bytes
+ * are always contiguous.
  *
  * Returns: Pointer into ring buffer internal storage
  **/
 LIB_EXPORT void *l_ringbuf_peek(struct l_ringbuf *ringbuf, size_t offset,
 							size_t *len_nowrap)
 {
+	size_t pos;
+
 	if (!ringbuf)
 		return NULL;
 
-	offset = (ringbuf->out + offset) & (ringbuf->size - 1);
+	pos = (ringbuf->out + offset) & (ringbuf->size - 1);
 
 	if (len_nowrap) {
 		size_t len = ringbuf->in - ringbuf->out;
-		*len_nowrap = minsize(len, ringbuf->size - offset);
+
+		/* Only count the bytes stored after @offset */
+		len -= minsize(len, offset);
+		*len_nowrap = ringbuf->mirrored ? len :
+					minsize(len, ringbuf->size - pos);
 	}
 
-	return ringbuf->buffer + offset;
+	return ringbuf->buffer + pos;
 }
 
 /**
@@ -234,7 +313,7 @@ LIB_EXPORT ssize_t l_ringbuf_write(struct l_ringbuf *ringbuf, int fd)
 
 	/* Grab data from buffer starting at offset until the end */
 	offset = ringbuf->out & (ringbuf->size - 1);
-	end = minsize(len, ringbuf->size - offset);
+	end = ringbuf->mirrored ? len : minsize(len, ringbuf->size - offset);
 
 	iov[0].iov_base = ringbuf->buffer + offset;
 	iov[0].iov_len = end;
@@ -243,7 +322,7 @@ LIB_EXPORT ssize_t l_ringbuf_write(struct l_ringbuf *ringbuf, int fd)
 	iov[1].iov_base = ringbuf->buffer;
 	iov[1].iov_len = len - end;
 
-	consumed = writev(fd, iov, 2);
+	consumed = writev(fd, iov, iov[1].iov_len ? 2 : 1);
 	if (consumed < 0)
 		return -1;
 
@@ -359,7 +438,8 @@ LIB_EXPORT ssize_t l_ringbuf_read(struct l_ringbuf *ringbuf, int fd)
 
 	/* Determine how much to consume before wrapping */
 	offset = ringbuf->in & (ringbuf->size - 1);
-	end = minsize(avail, ringbuf->size - offset);
+	end = ringbuf->mirrored ? avail :
+			minsize(avail, ringbuf->size - offset);
 
 	iov[0].iov_base = ringbuf->buffer + offset;
 	iov[0].iov_len = end;
@@ -368,24 +448,11 @@ LIB_EXPORT ssize_t l_ringbuf_read(struct l_ringbuf *ringbuf, int fd)
 	iov[1].iov_base = ringbuf->buffer;
 	iov[1].iov_len = avail - end;
 
-	consumed = readv(fd, iov, 2);
+	consumed = readv(fd, iov, iov[1].iov_len ? 2 : 1);
 	if (consumed < 0)
 		return -1;
 
-	if (ringbuf->in_tracing) {
-		size_t len = minsize((size_t) consumed, end);
-
-		ringbuf->in_tracing(ringbuf->buffer + offset, len,
-							ringbuf->in_data);
-
-		if (consumed - len > 0)
-			ringbuf->in_tracing(ringbuf->buffer, consumed - len,
-							ringbuf->in_data);
-	}
-
-	ringbuf->in += consumed;
-
-	return consumed;
+	return l_ringbuf_commit(ringbuf, consumed);
 }
 
 /**
@@ -401,40 +468,103 @@ LIB_EXPORT ssize_t l_ringbuf_read(struct l_ringbuf *ringbuf, int fd)
 LIB_EXPORT ssize_t l_ringbuf_append(struct l_ringbuf *ringbuf,
 						const void *data, size_t len)
 {
-	size_t avail;
-	size_t offset;
-	size_t end;
-	size_t left;
+	size_t done = 0;
+	size_t space;
+	size_t chunk;
+	void *dst;
 
 	if (!ringbuf || data == NULL)
 		return -1;
 
-	/* Determine how much can actually be appended */
-	avail = ringbuf->size - ringbuf->in + ringbuf->out;
+	if (!l_ringbuf_avail(ringbuf))
+		return -1;
 
+	/* Copies at most twice, once per side of the wrap */
+	while (done < len && (dst = l_ringbuf_reserve(ringbuf, &space))) {
+		chunk = minsize(space, len - done);
+		memcpy(dst, data + done, chunk);
+		done += l_ringbuf_commit(ringbuf, chunk);
+	}
+
+	return done;
+}
+
+/**
+ * l_ringbuf_reserve:
+ * @ringbuf: Ring Buffer object
+ * @len_nowrap: Number of contiguous free bytes at the returned location
+ *
+ * Gives direct access to the free space of the ring buffer, so that
+ * producers can generate data in place instead of copying it in with
+ * l_ringbuf_append.  Once the data has been written, it is made part of the
+ * ring buffer contents with l_ringbuf_commit.  Since the free space can
+ * wrap around, committing @len_nowrap bytes and reserving again gives
+ * access to the rest of it.  With a buffer created by
+ * l_ringbuf_new_mirrored, all free space is always contiguous.
+ *
+ * Returns: Pointer into ring buffer internal storage, or NULL if the ring
+ * buffer is full.
+ **/
+LIB_EXPORT void *l_ringbuf_reserve(struct l_ringbuf *ringbuf,
+							size_t *len_nowrap)
+{
+	size_t avail;
+	size_t offset;
+
+	if (!ringbuf)
+		return NULL;
+
+	avail = ringbuf->size - ringbuf->in + ringbuf->out;
 	if (!avail)
-		return -1;
+		return NULL;
 
-	/* Determine how much to append before wrapping */
 	offset = ringbuf->in & (ringbuf->size - 1);
-	end = minsize(len, ringbuf->size - offset);
-	memcpy(ringbuf->buffer + offset, data, end);
 
-	if (ringbuf->in_tracing)
-		ringbuf->in_tracing(ringbuf->buffer + offset, end,
-						ringbuf->in_data);
+	if (len_nowrap)
+		*len_nowrap = ringbuf->mirrored ? avail :
+				minsize(avail, ringbuf->size - offset);
+
+	return ringbuf->buffer + offset;
+}
+
+/**
+ * l_ringbuf_commit:
+ * @ringbuf: Ring Buffer object
+ * @len: Number of bytes written into the reserved space
+ *
+ * Adds @len bytes, previously written through the pointer returned by
+ * l_ringbuf_reserve, to the ring buffer contents.  The input tracing
+ * callback, if any, is called for them.
+ *
+ * Returns: Number of committed bytes, which is @len limited to the free
+ * space in the ring buffer.
+ **/
+LIB_EXPORT size_t l_ringbuf_commit(struct l_ringbuf *ringbuf, size_t len)
+{
+	size_t offset;
+	size_t end;
 
-	left = minsize(avail - end, len - end);
+	if (!ringbuf)
+		return 0;
+
+	len = minsize(len, ringbuf->size - ringbuf->in + ringbuf->out);
+	if (!len)
+		return 0;
 
-	if (left > 0) {
-		memcpy(ringbuf->buffer, data + end, left);
+	if (ringbuf->in_tracing) {
+		offset = ringbuf->in & (ringbuf->size - 1);
+		end = ringbuf->mirrored ? len :
+				minsize(len, ringbuf->size - offset);
 
-		if (ringbuf->in_tracing)
-			ringbuf->in_tracing(ringbuf->buffer, left,
-						ringbuf->in_data);
+		ringbuf->in_tracing(ringbuf->buffer + offset, end,
+							ringbuf->in_data);
+
+		if (len > end)
+			ringbuf->in_tracing(ringbuf->buffer, len - end,
+							ringbuf->in_data);
 	}
 
-	ringbuf->in += end + left;
+	ringbuf->in += len;
 
-	return (end + left);
+	return len;
 }
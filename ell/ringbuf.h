@@ -22,6 +22,7 @@ typedef void (*l_ringbuf_tracing_func_t)(const void *buf, size_t count,
 struct l_ringbuf;
 
 struct l_ringbuf *l_ringbuf_new(size_t size);
+struct l_ringbuf *l_ringbuf_new_mirrored(size_t size);
 void l_ringbuf_free(struct l_ringbuf *ringbuf);
 
 bool l_ringbuf_set_input_tracing(struct l_ringbuf *ringbuf,
@@ -45,6 +46,8 @@ ssize_t l_ringbuf_read(struct l_ringbuf *ringbuf, int fd);
 
 ssize_t l_ringbuf_append(struct l_ringbuf *ringbuf,
 					const void *data, size_t len);
+void *l_ringbuf_reserve(struct l_ringbuf *ringbuf, size_t *len_nowrap);
+size_t l_ringbuf_commit(struct l_ringbuf *ringbuf, size_t len);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,1227 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <asm/types.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+#include <linux/if.h>
+#include <arpa/inet.h>
+#include <errno.h>
+
+#include "useful.h"
+#include "netlink.h"
+#include "queue.h"
+#include "hashmap.h"
+#include "notifylist.h"
+#include "netlink-private.h"
+#include "rtnl-private.h"
+#include "rtnl.h"
+#include "net-private.h"
+#include "private.h"
+
+/*
+ * The initial dumps run one after another, the kernel only runs a single
+ * dump per socket at a time.  Notifications are subscribed to before the
+ * first dump so that nothing that changes in between is missed.
+ */
+enum cache_dump {
+	CACHE_DUMP_LINKS = 0,
+	CACHE_DUMP_ADDRESSES4,
+	CACHE_DUMP_ADDRESSES6,
+	CACHE_DUMP_ROUTES4,
+	CACHE_DUMP_ROUTES6,
+	CACHE_DUMP_DONE,
+};
+
+enum cache_watch_type {
+	CACHE_WATCH_LINK,
+	CACHE_WATCH_ADDRESS,
+	CACHE_WATCH_ROUTE,
+};
+
+struct cache_watch {
+	struct l_notifylist_entry super;
+	enum cache_watch_type type;
+	union {
+		l_rtnl_cache_link_func_t link_func;
+		l_rtnl_cache_address_func_t address_func;
+		l_rtnl_cache_route_func_t route_func;
+	};
+};
+
+struct cache_address {
+	uint32_t ifindex;
+	struct l_rtnl_address *address;
+};
+
+struct cache_route {
+	uint32_t ifindex;
+	struct l_rtnl_route *route;
+};
+
+struct l_rtnl_cache {
+	struct l_netlink *rtnl;
+	unsigned int notify_ids[5];
+	enum cache_dump dump;
+	uint32_t dump_id;
+	int dump_error;
+	struct l_hashmap *links;
+	struct l_queue *addresses;
+	struct l_queue *routes;
+	struct l_rtnl_route_table *route_table;
+	struct l_notifylist *watches;
+	l_rtnl_cache_ready_func_t ready_handler;
+	l_rtnl_cache_destroy_func_t ready_destroy;
+	void *ready_data;
+	bool freeing : 1;
+};
+
+static void cache_watch_free(struct l_notifylist_entry *e)
+{
+	struct cache_watch *watch = l_container_of(e, struct cache_watch, super);
+
+	l_free(watch);
+}
+
+static void cache_watch_notify(const struct l_notifylist_entry *e,
+						int type, va_list args)
+{
+	const struct cache_watch *watch =
+			l_container_of(e, struct cache_watch, super);
+	enum l_rtnl_cache_event event;
+	uint32_t ifindex;
+
+	if ((int) watch->type != type)
+		return;
+
+	event = va_arg(args, int);
+
+	switch (watch->type) {
+	case CACHE_WATCH_LINK:
+		watch->link_func(event,
+				va_arg(args, const struct l_rtnl_link *),
+				watch->super.notify_data);
+		break;
+	case CACHE_WATCH_ADDRESS:
+		ifindex = va_arg(args, uint32_t);
+		watch->address_func(event, ifindex,
+				va_arg(args, const struct l_rtnl_address *),
+				watch->super.notify_data);
+		break;
+	case CACHE_WATCH_ROUTE:
+		ifindex = va_arg(args, uint32_t);
+		watch->route_func(event, ifindex,
+				va_arg(args, const struct l_rtnl_route *),
+				watch->super.notify_data);
+		break;
+	}
+}
+
+static const struct l_notifylist_ops cache_watch_ops = {
+	.free_entry = cache_watch_free,
+	.notify = cache_watch_notify,
+};
+
+static void cache_address_free(void *data)
+{
+	struct cache_address *entry = data;
+
+	l_rtnl_address_free(entry->address);
+	l_free(entry);
+}
+
+static void cache_route_free(void *data)
+{
+	struct cache_route *entry = data;
+
+	l_rtnl_route_free(entry->route);
+	l_free(entry);
+}
+
+static const void *address_bytes(uint8_t family, const struct in_addr *v4,
+					const struct in6_addr *v6)
+{
+	return family == AF_INET ? (const void *) v4 : (const void *) v6;
+}
+
+static bool prefix_match(uint8_t family, const void *a, const void *b,
+						uint8_t prefix_len)
+{
+	const uint8_t *x = a, *y = b;
+	unsigned int max = family == AF_INET ? 32 : 128;
+	unsigned int bytes, bits;
+
+	if (prefix_len > max)
+		return false;
+
+	bytes = prefix_len / 8;
+	bits = prefix_len % 8;
+
+	if (memcmp(x, y, bytes))
+		return false;
+
+	if (!bits)
+		return true;
+
+	return !((x[bytes] ^ y[bytes]) & (0xff00 >> bits));
+}
+
+/*
+ * Longest prefix match table, a path compressed binary trie per address
+ * family.  A node exists for every prefix that has routes, plus branch
+ * nodes where two prefixes diverge, so the depth is bounded by the
+ * number of distinct prefixes rather than the address length.
+ */
+struct route_table_entry {
+	const struct l_rtnl_route *route;
+	void *user_data;
+};
+
+struct route_node {
+	uint8_t key[16];
+	uint8_t len;
+	struct route_node *parent;
+	struct route_node *child[2];
+	struct l_queue *entries;
+};
+
+struct l_rtnl_route_table {
+	struct route_node *root[2];
+	unsigned int count;
+};
+
+static inline unsigned int key_bit(const uint8_t *key, unsigned int bit)
+{
+	return (key[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+static unsigned int key_common_len(const uint8_t *a, const uint8_t *b,
+							unsigned int max)
+{
+	unsigned int i;
+
+	for (i = 0; i < max; i++)
+		if (key_bit(a, i) != key_bit(b, i))
+			break;
+
+	return i;
+}
+
+static struct route_node **route_table_root(struct l_rtnl_route_table *table,
+							uint8_t family)
+{
+	return &table->root[family == AF_INET6];
+}
+
+static struct route_node *route_node_new(const uint8_t *key, uint8_t len,
+						struct route_node *parent)
+{
+	struct route_node *node = l_new(struct route_node, 1);
+	unsigned int bytes = (len + 7) / 8;
+
+	memcpy(node->key, key, bytes);
+
+	/* Clear the host bits so equal prefixes have equal keys */
+	if (len % 8)
+		node->key[len / 8] &= 0xff00 >> (len % 8);
+
+	node->len = len;
+	node->parent = parent;
+
+	return node;
+}
+
+static struct route_node *route_node_get(struct route_node **link,
+						const uint8_t *key, uint8_t len)
+{
+	struct route_node *parent = NULL;
+
+	while (*link) {
+		struct route_node *node = *link;
+		unsigned int common = key_common_len(node->key, key,
+						minsize(node->len, len));
+		struct route_node *split;
+
+		if (common < node->len) {
+			split = route_node_new(key, common, parent);
+			split->child[key_bit(node->key, common)] = node;
+			node->parent = split;
+			*link = split;
+
+			if (common == len)
+				return split;
+
+			split->child[key_bit(key, common)] =
+					route_node_new(key, len, split);
+			return split->child[key_bit(key, common)];
+		}
+
+		if (node->len == len)
+			return node;
+
+		parent = node;
+		link = &node->child[key_bit(key, node->len)];
+	}
+
+	*link = route_node_new(key, len, parent);
+
+	return *link;
+}
+
+static struct route_node *route_node_find(struct route_node *node,
+						const uint8_t *key, uint8_t len)
+{
+	while (node && node->len <= len) {
+		if (key_common_len(node->key, key, node->len) < node->len)
+			return NULL;
+
+		if (node->len == len)
+			return node;
+
+		node = node->child[key_bit(key, node->len)];
+	}
+
+	return NULL;
+}
+
+/* Removes nodes that no longer carry routes or separate two branches */
+static void route_node_prune(struct route_node **root, struct route_node *node)
+{
+	while (node && l_queue_isempty(node->entries) &&
+				!(node->child[0] && node->child[1])) {
+		struct route_node *parent = node->parent;
+		struct route_node *child = node->child[0] ?: node->child[1];
+		struct route_node **link = root;
+
+		if (parent)
+			link = &parent->child[parent->child[1] == node];
+
+		*link = child;
+
+		if (child)
+			child->parent = parent;
+
+		l_queue_destroy(node->entries, l_free);
+		l_free(node);
+		node = parent;
+	}
+}
+
+static void route_node_free(struct route_node *node)
+{
+	if (!node)
+		return;
+
+	route_node_free(node->child[0]);
+	route_node_free(node->child[1]);
+	l_queue_destroy(node->entries, l_free);
+	l_free(node);
+}
+
+LIB_EXPORT struct l_rtnl_route_table *l_rtnl_route_table_new(void)
+{
+	return l_new(struct l_rtnl_route_table, 1);
+}
+
+LIB_EXPORT void l_rtnl_route_table_free(struct l_rtnl_route_table *table)
+{
+	if (unlikely(!table))
+		return;
+
+	route_node_free(table->root[0]);
+	route_node_free(table->root[1]);
+	l_free(table);
+}
+
+/*
+ * Adds @rt under its destination prefix.  The table only references @rt,
+ * which has to stay valid until it is removed again.  @user_data is
+ * returned by lookups that pick this route.
+ */
+LIB_EXPORT bool l_rtnl_route_table_add(struct l_rtnl_route_table *table,
+					const struct l_rtnl_route *rt,
+					void *user_data)
+{
+	struct route_table_entry *entry;
+	struct route_node *node;
+
+	if (unlikely(!table || !rt))
+		return false;
+
+	if (!L_IN_SET(rt->family, AF_INET, AF_INET6))
+		return false;
+
+	if (rt->dst_prefix_len > (rt->family == AF_INET ? 32 : 128))
+		return false;
+
+	node = route_node_get(route_table_root(table, rt->family),
+				(const uint8_t *) &rt->dst, rt->dst_prefix_len);
+
+	if (!node->entries)
+		node->entries = l_queue_new();
+
+	entry = l_new(struct route_table_entry, 1);
+	entry->route = rt;
+	entry->user_data = user_data;
+	l_queue_push_tail(node->entries, entry);
+	table->count++;
+
+	return true;
+}
+
+static bool match_table_entry(const void *a, const void *b)
+{
+	const struct route_table_entry *entry = a;
+
+	return entry->route == b;
+}
+
+LIB_EXPORT bool l_rtnl_route_table_remove(struct l_rtnl_route_table *table,
+					const struct l_rtnl_route *rt)
+{
+	struct route_node **root;
+	struct route_node *node;
+	struct route_table_entry *entry;
+
+	if (unlikely(!table || !rt))
+		return false;
+
+	if (!L_IN_SET(rt->family, AF_INET, AF_INET6))
+		return false;
+
+	root = route_table_root(table, rt->family);
+	node = route_node_find(*root, (const uint8_t *) &rt->dst,
+							rt->dst_prefix_len);
+	if (!node)
+		return false;
+
+	entry = l_queue_remove_if(node->entries, match_table_entry, rt);
+	if (!entry)
+		return false;
+
+	l_free(entry);
+	table->count--;
+	route_node_prune(root, node);
+
+	return true;
+}
+
+LIB_EXPORT unsigned int l_rtnl_route_table_get_count(
+				const struct l_rtnl_route_table *table)
+{
+	if (unlikely(!table))
+		return 0;
+
+	return table->count;
+}
+
+/*
+ * Finds the route with the longest prefix covering @in_addr, a struct
+ * in_addr or struct in6_addr depending on @family.  Among routes with the
+ * same prefix the one with the lowest priority value wins.
+ */
+LIB_EXPORT const struct l_rtnl_route *l_rtnl_route_table_lookup(
+				const struct l_rtnl_route_table *table,
+				uint8_t family, const void *in_addr,
+				void **out_user_data)
+{
+	const uint8_t *key = in_addr;
+	unsigned int max = family == AF_INET ? 32 : 128;
+	const struct route_node *node, *best = NULL;
+	const struct route_table_entry *found = NULL;
+	const struct l_queue_entry *entry;
+
+	if (unlikely(!table || !in_addr))
+		return NULL;
+
+	if (!L_IN_SET(family, AF_INET, AF_INET6))
+		return NULL;
+
+	for (node = table->root[family == AF_INET6]; node;
+				node = node->child[key_bit(key, node->len)]) {
+		if (key_common_len(node->key, key, node->len) < node->len)
+			break;
+
+		if (!l_queue_isempty(node->entries))
+			best = node;
+
+		if (node->len == max)
+			break;
+	}
+
+	if (!best)
+		return NULL;
+
+	for (entry = l_queue_get_entries(best->entries); entry;
+							entry = entry->next) {
+		const struct route_table_entry *e = entry->data;
+
+		if (!found || e->route->priority < found->route->priority)
+			found = e;
+	}
+
+	if (out_user_data)
+		*out_user_data = found->user_data;
+
+	return found->route;
+}
+
+static const struct l_netlink_attr_policy link_policy[] = {
+	[IFLA_ADDRESS] = { L_NETLINK_ATTR_POLICY_BINARY,
+						L_RTNL_LINK_ADDRESS_MAX },
+	[IFLA_IFNAME] = { L_NETLINK_ATTR_POLICY_STRING, IFNAMSIZ - 1 },
+	[IFLA_MTU] = { L_NETLINK_ATTR_POLICY_U32 },
+	[IFLA_OPERSTATE] = { L_NETLINK_ATTR_POLICY_U8 },
+};
+
+#define LINK_MAX_ATTR (L_ARRAY_SIZE(link_policy) - 1)
+
+static bool link_parse(const struct ifinfomsg *ifi, uint32_t len,
+						struct l_rtnl_link *link)
+{
+	struct l_netlink_attr_value table[LINK_MAX_ATTR + 1];
+	struct l_netlink_attr attr;
+
+	if (len < NLMSG_ALIGN(sizeof(*ifi)) || ifi->ifi_index <= 0)
+		return false;
+
+	memset(link, 0, sizeof(*link));
+	link->ifindex = ifi->ifi_index;
+	link->flags = ifi->ifi_flags;
+	link->type = ifi->ifi_type;
+
+	if (l_netlink_attr_init(&attr, sizeof(*ifi), ifi, len) < 0)
+		return true;
+
+	if (l_netlink_attr_parse(&attr, link_policy, LINK_MAX_ATTR, table) < 0)
+		return false;
+
+	if (table[IFLA_IFNAME].data)
+		l_strlcpy(link->ifname, table[IFLA_IFNAME].data,
+						sizeof(link->ifname));
+
+	if (table[IFLA_MTU].data)
+		link->mtu = l_get_u32(table[IFLA_MTU].data);
+
+	if (table[IFLA_OPERSTATE].data)
+		link->operstate = l_get_u8(table[IFLA_OPERSTATE].data);
+
+	if (table[IFLA_ADDRESS].data) {
+		memcpy(link->address, table[IFLA_ADDRESS].data,
+						table[IFLA_ADDRESS].len);
+		link->address_len = table[IFLA_ADDRESS].len;
+	}
+
+	return true;
+}
+
+static const struct l_netlink_attr_policy route_policy[] = {
+	[RTA_DST] = { L_NETLINK_ATTR_POLICY_BINARY, 16 },
+	[RTA_OIF] = { L_NETLINK_ATTR_POLICY_U32 },
+	[RTA_GATEWAY] = { L_NETLINK_ATTR_POLICY_BINARY, 16 },
+	[RTA_PRIORITY] = { L_NETLINK_ATTR_POLICY_U32 },
+	[RTA_PREFSRC] = { L_NETLINK_ATTR_POLICY_BINARY, 16 },
+	[RTA_TABLE] = { L_NETLINK_ATTR_POLICY_U32 },
+	[RTA_PREF] = { L_NETLINK_ATTR_POLICY_U8 },
+};
+
+#define ROUTE_MAX_ATTR (L_ARRAY_SIZE(route_policy) - 1)
+
+static void route_copy_address(void *dst, uint8_t family,
+				const struct l_netlink_attr_value *value)
+{
+	size_t size = family == AF_INET ? sizeof(struct in_addr) :
+						sizeof(struct in6_addr);
+
+	if (value->data && value->len == size)
+		memcpy(dst, value->data, size);
+}
+
+/* Only routes in the main table are cached, others are not looked up */
+static struct l_rtnl_route *route_parse(const struct rtmsg *rtm, uint32_t len,
+							uint32_t *ifindex)
+{
+	struct l_netlink_attr_value table[ROUTE_MAX_ATTR + 1];
+	struct l_netlink_attr attr;
+	struct l_rtnl_route *rt;
+	uint32_t table_id = rtm->rtm_table;
+
+	if (len < NLMSG_ALIGN(sizeof(*rtm)))
+		return NULL;
+
+	if (!L_IN_SET(rtm->rtm_family, AF_INET, AF_INET6))
+		return NULL;
+
+	if (rtm->rtm_type != RTN_UNICAST || (rtm->rtm_flags & RTM_F_CLONED))
+		return NULL;
+
+	if (l_netlink_attr_init(&attr, sizeof(*rtm), rtm, len) < 0)
+		return NULL;
+
+	if (l_netlink_attr_parse(&attr, route_policy, ROUTE_MAX_ATTR,
+								table) < 0)
+		return NULL;
+
+	if (table[RTA_TABLE].data)
+		table_id = l_get_u32(table[RTA_TABLE].data);
+
+	if (table_id != RT_TABLE_MAIN)
+		return NULL;
+
+	rt = l_new(struct l_rtnl_route, 1);
+	rt->family = rtm->rtm_family;
+	rt->scope = rtm->rtm_scope;
+	rt->protocol = rtm->rtm_protocol;
+	rt->dst_prefix_len = rtm->rtm_dst_len;
+
+	route_copy_address(&rt->dst, rt->family, &table[RTA_DST]);
+	route_copy_address(&rt->gw, rt->family, &table[RTA_GATEWAY]);
+	route_copy_address(&rt->prefsrc, rt->family, &table[RTA_PREFSRC]);
+
+	if (table[RTA_PRIORITY].data)
+		rt->priority = l_get_u32(table[RTA_PRIORITY].data);
+
+	if (table[RTA_PREF].data)
+		rt->preference = l_get_u8(table[RTA_PREF].data);
+
+	*ifindex = table[RTA_OIF].data ? l_get_u32(table[RTA_OIF].data) : 0;
+
+	return rt;
+}
+
+static void notify_link(struct l_rtnl_cache *cache,
+				enum l_rtnl_cache_event event,
+				const struct l_rtnl_link *link)
+{
+	l_notifylist_notify(cache->watches, CACHE_WATCH_LINK, event, link);
+}
+
+static void notify_address(struct l_rtnl_cache *cache,
+				enum l_rtnl_cache_event event,
+				const struct cache_address *entry)
+{
+	l_notifylist_notify(cache->watches, CACHE_WATCH_ADDRESS, event,
+					entry->ifindex, entry->address);
+}
+
+static void notify_route(struct l_rtnl_cache *cache,
+				enum l_rtnl_cache_event event,
+				const struct cache_route *entry)
+{
+	l_notifylist_notify(cache->watches, CACHE_WATCH_ROUTE, event,
+					entry->ifindex, entry->route);
+}
+
+static bool match_address(const void *a, const void *b)
+{
+	const struct cache_address *entry = a;
+	const struct cache_address *other = b;
+	const struct l_rtnl_address *x = entry->address;
+	const struct l_rtnl_address *y = other->address;
+
+	if (entry->ifindex != other->ifindex || x->family != y->family ||
+			x->prefix_len != y->prefix_len)
+		return false;
+
+	if (x->family == AF_INET)
+		return x->in_addr.s_addr == y->in_addr.s_addr;
+
+	return !memcmp(&x->in6_addr, &y->in6_addr, sizeof(x->in6_addr));
+}
+
+static bool match_route(const void *a, const void *b)
+{
+	const struct cache_route *entry = a;
+	const struct cache_route *other = b;
+	const struct l_rtnl_route *x = entry->route;
+	const struct l_rtnl_route *y = other->route;
+
+	return entry->ifindex == other->ifindex && x->family == y->family &&
+		x->dst_prefix_len == y->dst_prefix_len &&
+		x->priority == y->priority &&
+		!memcmp(&x->dst, &y->dst, sizeof(x->dst)) &&
+		!memcmp(&x->gw, &y->gw, sizeof(x->gw));
+}
+
+static bool match_address_ifindex(const void *a, const void *b)
+{
+	const struct cache_address *entry = a;
+
+	return entry->ifindex == L_PTR_TO_UINT(b);
+}
+
+static bool match_route_ifindex(const void *a, const void *b)
+{
+	const struct cache_route *entry = a;
+
+	return entry->ifindex == L_PTR_TO_UINT(b);
+}
+
+static bool match_route_ipv4_ifindex(const void *a, const void *b)
+{
+	const struct cache_route *entry = a;
+
+	return entry->route->family == AF_INET &&
+				entry->ifindex == L_PTR_TO_UINT(b);
+}
+
+static void remove_all_matching(struct l_rtnl_cache *cache,
+				struct l_queue *queue, l_queue_match_func_t match,
+				uint32_t ifindex, bool is_route)
+{
+	void *entry;
+
+	while ((entry = l_queue_remove_if(queue, match,
+						L_UINT_TO_PTR(ifindex)))) {
+		if (is_route) {
+			struct cache_route *route = entry;
+
+			l_rtnl_route_table_remove(cache->route_table,
+							route->route);
+			notify_route(cache, L_RTNL_CACHE_EVENT_DEL, entry);
+			cache_route_free(entry);
+		} else {
+			notify_address(cache, L_RTNL_CACHE_EVENT_DEL, entry);
+			cache_address_free(entry);
+		}
+	}
+}
+
+static void handle_link(struct l_rtnl_cache *cache, uint16_t type,
+				const struct ifinfomsg *ifi, uint32_t len)
+{
+	struct l_rtnl_link parsed, *link;
+	bool was_up;
+
+	if (!link_parse(ifi, len, &parsed))
+		return;
+
+	link = l_hashmap_lookup(cache->links, L_UINT_TO_PTR(parsed.ifindex));
+
+	if (type == RTM_DELLINK) {
+		if (!link)
+			return;
+
+		remove_all_matching(cache, cache->addresses,
+					match_address_ifindex, parsed.ifindex,
+					false);
+		remove_all_matching(cache, cache->routes, match_route_ifindex,
+					parsed.ifindex, true);
+
+		l_hashmap_remove(cache->links, L_UINT_TO_PTR(parsed.ifindex));
+		notify_link(cache, L_RTNL_CACHE_EVENT_DEL, link);
+		l_free(link);
+		return;
+	}
+
+	if (!link) {
+		link = l_memdup(&parsed, sizeof(parsed));
+		l_hashmap_insert(cache->links, L_UINT_TO_PTR(link->ifindex),
+									link);
+		notify_link(cache, L_RTNL_CACHE_EVENT_NEW, link);
+		return;
+	}
+
+	if (!memcmp(link, &parsed, sizeof(parsed)))
+		return;
+
+	was_up = link->flags & IFF_UP;
+	*link = parsed;
+
+	/* The kernel flushes IPv4 routes of a downed link without telling */
+	if (was_up && !(link->flags & IFF_UP))
+		remove_all_matching(cache, cache->routes,
+					match_route_ipv4_ifindex,
+					link->ifindex, true);
+
+	notify_link(cache, L_RTNL_CACHE_EVENT_CHANGED, link);
+}
+
+static void handle_address(struct l_rtnl_cache *cache, uint16_t type,
+				const struct ifaddrmsg *ifa, uint32_t len)
+{
+	struct cache_address parsed, *entry;
+	enum l_rtnl_cache_event event = L_RTNL_CACHE_EVENT_NEW;
+
+	if (len < NLMSG_ALIGN(sizeof(*ifa)))
+		return;
+
+	parsed.ifindex = ifa->ifa_index;
+	parsed.address = l_rtnl_ifaddr_extract(ifa,
+					len - NLMSG_ALIGN(sizeof(*ifa)));
+	if (!parsed.address)
+		return;
+
+	entry = l_queue_remove_if(cache->addresses, match_address, &parsed);
+
+	if (type == RTM_DELADDR) {
+		l_rtnl_address_free(parsed.address);
+
+		if (!entry)
+			return;
+
+		notify_address(cache, L_RTNL_CACHE_EVENT_DEL, entry);
+		cache_address_free(entry);
+		return;
+	}
+
+	if (entry) {
+		cache_address_free(entry);
+		event = L_RTNL_CACHE_EVENT_CHANGED;
+	}
+
+	entry = l_memdup(&parsed, sizeof(parsed));
+	l_queue_push_tail(cache->addresses, entry);
+	notify_address(cache, event, entry);
+}
+
+static void handle_route(struct l_rtnl_cache *cache, uint16_t type,
+				const struct rtmsg *rtm, uint32_t len)
+{
+	struct cache_route parsed, *entry;
+	enum l_rtnl_cache_event event = L_RTNL_CACHE_EVENT_NEW;
+
+	parsed.route = route_parse(rtm, len, &parsed.ifindex);
+	if (!parsed.route)
+		return;
+
+	entry = l_queue_remove_if(cache->routes, match_route, &parsed);
+
+	if (entry)
+		l_rtnl_route_table_remove(cache->route_table, entry->route);
+
+	if (type == RTM_DELROUTE) {
+		l_rtnl_route_free(parsed.route);
+
+		if (!entry)
+			return;
+
+		notify_route(cache, L_RTNL_CACHE_EVENT_DEL, entry);
+		cache_route_free(entry);
+		return;
+	}
+
+	if (entry) {
+		cache_route_free(entry);
+		event = L_RTNL_CACHE_EVENT_CHANGED;
+	}
+
+	entry = l_memdup(&parsed, sizeof(parsed));
+	l_queue_push_tail(cache->routes, entry);
+	l_rtnl_route_table_add(cache->route_table, entry->route, entry);
+	notify_route(cache, event, entry);
+}
+
+static void cache_notify(uint16_t type, const void *data, uint32_t len,
+							void *user_data)
+{
+	struct l_rtnl_cache *cache = user_data;
+
+	switch (type) {
+	case RTM_NEWLINK:
+	case RTM_DELLINK:
+		handle_link(cache, type, data, len);
+		break;
+	case RTM_NEWADDR:
+	case RTM_DELADDR:
+		handle_address(cache, type, data, len);
+		break;
+	case RTM_NEWROUTE:
+	case RTM_DELROUTE:
+		handle_route(cache, type, data, len);
+		break;
+	}
+}
+
+static void cache_dump_cb(int error, uint16_t type, const void *data,
+					uint32_t len, void *user_data)
+{
+	struct l_rtnl_cache *cache = user_data;
+
+	if (error) {
+		if (!cache->dump_error)
+			cache->dump_error = error;
+
+		return;
+	}
+
+	cache_notify(type, data, len, cache);
+}
+
+static void cache_dump_next(void *user_data);
+
+static uint32_t cache_dump_links(struct l_rtnl_cache *cache)
+{
+	struct l_netlink_message *nlm;
+	struct ifinfomsg ifi;
+
+	nlm = l_netlink_message_new_sized(RTM_GETLINK, NLM_F_DUMP, sizeof(ifi));
+
+	memset(&ifi, 0, sizeof(ifi));
+	l_netlink_message_add_header(nlm, &ifi, sizeof(ifi));
+
+	return l_netlink_send(cache->rtnl, nlm, cache_dump_cb, cache,
+							cache_dump_next);
+}
+
+static void cache_dump_next(void *user_data)
+{
+	struct l_rtnl_cache *cache = user_data;
+
+	cache->dump_id = 0;
+
+	if (cache->freeing)
+		return;
+
+	while (!cache->dump_id && ++cache->dump < CACHE_DUMP_DONE) {
+		switch (cache->dump) {
+		case CACHE_DUMP_LINKS:
+			break;
+		case CACHE_DUMP_ADDRESSES4:
+			cache->dump_id = l_rtnl_ifaddr4_dump(cache->rtnl,
+						cache_dump_cb, cache,
+						cache_dump_next);
+			break;
+		case CACHE_DUMP_ADDRESSES6:
+			cache->dump_id = l_rtnl_ifaddr6_dump(cache->rtnl,
+						cache_dump_cb, cache,
+						cache_dump_next);
+			break;
+		case CACHE_DUMP_ROUTES4:
+			cache->dump_id = l_rtnl_route_dump(cache->rtnl,
+						AF_INET, RT_TABLE_MAIN, 0,
+						cache_dump_cb, cache,
+						cache_dump_next);
+			break;
+		case CACHE_DUMP_ROUTES6:
+			cache->dump_id = l_rtnl_route_dump(cache->rtnl,
+						AF_INET6, RT_TABLE_MAIN, 0,
+						cache_dump_cb, cache,
+						cache_dump_next);
+			break;
+		case CACHE_DUMP_DONE:
+			break;
+		}
+	}
+
+	if (cache->dump_id)
+		return;
+
+	if (cache->ready_handler)
+		cache->ready_handler(cache->dump_error, cache->ready_data);
+}
+
+/*
+ * Creates a cache of the links, addresses and main table routes known to
+ * the kernel, kept up to date from rtnetlink notifications.  @ready is
+ * called once the initial dumps are complete, with a negative errno if
+ * any of them failed.
+ */
+LIB_EXPORT struct l_rtnl_cache *l_rtnl_cache_new(struct l_netlink *rtnl,
+					l_rtnl_cache_ready_func_t ready,
+					void *user_data,
+					l_rtnl_cache_destroy_func_t destroy)
+{
+	static const uint32_t groups[] = {
+		RTNLGRP_LINK,
+		RTNLGRP_IPV4_IFADDR,
+		RTNLGRP_IPV6_IFADDR,
+		RTNLGRP_IPV4_ROUTE,
+		RTNLGRP_IPV6_ROUTE,
+	};
+	struct l_rtnl_cache *cache;
+	unsigned int i;
+
+	if (unlikely(!rtnl))
+		return NULL;
+
+	cache = l_new(struct l_rtnl_cache, 1);
+	cache->rtnl = rtnl;
+	cache->links = l_hashmap_new();
+	cache->addresses = l_queue_new();
+	cache->routes = l_queue_new();
+	cache->route_table = l_rtnl_route_table_new();
+	cache->watches = l_notifylist_new(&cache_watch_ops);
+	cache->ready_handler = ready;
+	cache->ready_data = user_data;
+	cache->ready_destroy = destroy;
+
+	for (i = 0; i < L_ARRAY_SIZE(groups); i++) {
+		cache->notify_ids[i] = l_netlink_register(rtnl, groups[i],
+							cache_notify, cache,
+							NULL);
+		if (!cache->notify_ids[i])
+			goto error;
+	}
+
+	cache->dump = CACHE_DUMP_LINKS;
+	cache->dump_id = cache_dump_links(cache);
+	if (!cache->dump_id)
+		goto error;
+
+	return cache;
+
+error:
+	cache->ready_destroy = NULL;
+	l_rtnl_cache_free(cache);
+	return NULL;
+}
+
+LIB_EXPORT void l_rtnl_cache_free(struct l_rtnl_cache *cache)
+{
+	unsigned int i;
+
+	if (unlikely(!cache))
+		return;
+
+	cache->freeing = true;
+	_net_rtnl_cache_freed(cache);
+
+	if (cache->dump_id)
+		l_netlink_cancel(cache->rtnl, cache->dump_id);
+
+	for (i = 0; i < L_ARRAY_SIZE(cache->notify_ids); i++)
+		if (cache->notify_ids[i])
+			l_netlink_unregister(cache->rtnl,
+						cache->notify_ids[i]);
+
+	l_notifylist_free(cache->watches);
+	l_hashmap_destroy(cache->links, l_free);
+	l_queue_destroy(cache->addresses, cache_address_free);
+	l_rtnl_route_table_free(cache->route_table);
+	l_queue_destroy(cache->routes, cache_route_free);
+
+	if (cache->ready_destroy)
+		cache->ready_destroy(cache->ready_data);
+
+	l_free(cache);
+}
+
+LIB_EXPORT bool l_rtnl_cache_is_ready(const struct l_rtnl_cache *cache)
+{
+	if (unlikely(!cache))
+		return false;
+
+	return cache->dump == CACHE_DUMP_DONE;
+}
+
+static unsigned int cache_add_watch(struct l_rtnl_cache *cache,
+					struct cache_watch *watch,
+					void *user_data,
+					l_rtnl_cache_destroy_func_t destroy)
+{
+	watch->super.notify_data = user_data;
+	watch->super.destroy = destroy;
+
+	return l_notifylist_add_keyed(cache->watches, watch->type,
+							&watch->super);
+}
+
+/*
+ * Watches are called for every change applied to the cache, including
+ * the entries added by the initial dumps.
+ */
+LIB_EXPORT unsigned int l_rtnl_cache_add_link_watch(struct l_rtnl_cache *cache,
+					l_rtnl_cache_link_func_t function,
+					void *user_data,
+					l_rtnl_cache_destroy_func_t destroy)
+{
+	struct cache_watch *watch;
+
+	if (unlikely(!cache || !function))
+		return 0;
+
+	watch = l_new(struct cache_watch, 1);
+	watch->type = CACHE_WATCH_LINK;
+	watch->link_func = function;
+
+	return cache_add_watch(cache, watch, user_data, destroy);
+}
+
+LIB_EXPORT unsigned int l_rtnl_cache_add_address_watch(
+					struct l_rtnl_cache *cache,
+					l_rtnl_cache_address_func_t function,
+					void *user_data,
+					l_rtnl_cache_destroy_func_t destroy)
+{
+	struct cache_watch *watch;
+
+	if (unlikely(!cache || !function))
+		return 0;
+
+	watch = l_new(struct cache_watch, 1);
+	watch->type = CACHE_WATCH_ADDRESS;
+	watch->address_func = function;
+
+	return cache_add_watch(cache, watch, user_data, destroy);
+}
+
+LIB_EXPORT unsigned int l_rtnl_cache_add_route_watch(
+					struct l_rtnl_cache *cache,
+					l_rtnl_cache_route_func_t function,
+					void *user_data,
+					l_rtnl_cache_destroy_func_t destroy)
+{
+	struct cache_watch *watch;
+
+	if (unlikely(!cache || !function))
+		return 0;
+
+	watch = l_new(struct cache_watch, 1);
+	watch->type = CACHE_WATCH_ROUTE;
+	watch->route_func = function;
+
+	return cache_add_watch(cache, watch, user_data, destroy);
+}
+
+LIB_EXPORT bool l_rtnl_cache_remove_watch(struct l_rtnl_cache *cache,
+							unsigned int id)
+{
+	if (unlikely(!cache))
+		return false;
+
+	return l_notifylist_remove(cache->watches, id);
+}
+
+LIB_EXPORT const struct l_rtnl_link *l_rtnl_cache_get_link(
+					const struct l_rtnl_cache *cache,
+					uint32_t ifindex)
+{
+	if (unlikely(!cache))
+		return NULL;
+
+	return l_hashmap_lookup(cache->links, L_UINT_TO_PTR(ifindex));
+}
+
+struct find_link_data {
+	const char *ifname;
+	const struct l_rtnl_link *link;
+};
+
+static void find_link_by_name(const void *key, void *value, void *user_data)
+{
+	const struct l_rtnl_link *link = value;
+	struct find_link_data *data = user_data;
+
+	if (!strcmp(link->ifname, data->ifname))
+		data->link = link;
+}
+
+LIB_EXPORT const struct l_rtnl_link *l_rtnl_cache_find_link(
+					const struct l_rtnl_cache *cache,
+					const char *ifname)
+{
+	struct find_link_data data = { ifname, NULL };
+
+	if (unlikely(!cache || !ifname))
+		return NULL;
+
+	l_hashmap_foreach(cache->links, find_link_by_name, &data);
+
+	return data.link;
+}
+
+/*
+ * Calls @function for every address of @ifindex, or of all links if
+ * @ifindex is 0.
+ */
+LIB_EXPORT bool l_rtnl_cache_foreach_address(const struct l_rtnl_cache *cache,
+					uint32_t ifindex,
+					l_rtnl_cache_address_foreach_func_t function,
+					void *user_data)
+{
+	const struct l_queue_entry *entry;
+
+	if (unlikely(!cache || !function))
+		return false;
+
+	for (entry = l_queue_get_entries(cache->addresses); entry;
+							entry = entry->next) {
+		const struct cache_address *addr = entry->data;
+
+		if (ifindex && addr->ifindex != ifindex)
+			continue;
+
+		function(addr->ifindex, addr->address, user_data);
+	}
+
+	return true;
+}
+
+/*
+ * Finds the local address whose prefix covers @in_addr, a struct in_addr
+ * or struct in6_addr depending on @family, the one with the longest
+ * prefix if there are several.
+ */
+LIB_EXPORT const struct l_rtnl_address *l_rtnl_cache_find_address(
+					const struct l_rtnl_cache *cache,
+					uint8_t family, const void *in_addr,
+					uint32_t *out_ifindex)
+{
+	const struct l_queue_entry *entry;
+	const struct cache_address *found = NULL;
+
+	if (unlikely(!cache || !in_addr))
+		return NULL;
+
+	for (entry = l_queue_get_entries(cache->addresses); entry;
+							entry = entry->next) {
+		const struct cache_address *addr = entry->data;
+		const struct l_rtnl_address *a = addr->address;
+
+		if (a->family != family)
+			continue;
+
+		if (found && found->address->prefix_len >= a->prefix_len)
+			continue;
+
+		if (prefix_match(family, in_addr,
+				address_bytes(family, &a->in_addr,
+						&a->in6_addr),
+				a->prefix_len))
+			found = addr;
+	}
+
+	if (!found)
+		return NULL;
+
+	if (out_ifindex)
+		*out_ifindex = found->ifindex;
+
+	return found->address;
+}
+
+/*
+ * Returns the main table route with the longest prefix covering @in_addr,
+ * and the lowest priority value among those of the same length.
+ */
+LIB_EXPORT const struct l_rtnl_route *l_rtnl_cache_lookup_route(
+					const struct l_rtnl_cache *cache,
+					uint8_t family, const void *in_addr,
+					uint32_t *out_ifindex)
+{
+	const struct l_rtnl_route *rt;
+	void *data;
+
+	if (unlikely(!cache))
+		return NULL;
+
+	rt = l_rtnl_route_table_lookup(cache->route_table, family, in_addr,
+									&data);
+	if (!rt)
+		return NULL;
+
+	if (out_ifindex)
+		*out_ifindex = ((const struct cache_route *) data)->ifindex;
+
+	return rt;
+}
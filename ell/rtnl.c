@@ -21,6 +21,7 @@
 #include <net/if_arp.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <stdlib.h>
 
 #include "useful.h"
 #include "netlink.h"
@@ -1068,6 +1069,165 @@ LIB_EXPORT uint32_t l_rtnl_route6_dump(struct l_netlink *rtnl,
 	return l_netlink_send(rtnl, nlm, cb, user_data, destroy);
 }
 
+struct dump_filter {
+	uint32_t table;
+	uint32_t ifindex;
+	l_netlink_command_func_t cb;
+	void *user_data;
+	l_netlink_destroy_func_t destroy;
+};
+
+static void dump_filter_destroy(void *user_data)
+{
+	struct dump_filter *filter = user_data;
+
+	if (filter->destroy)
+		filter->destroy(filter->user_data);
+
+	l_free(filter);
+}
+
+static uint32_t dump_filter_send(struct l_netlink *rtnl,
+					struct l_netlink_message *nlm,
+					l_netlink_command_func_t filter_cb,
+					struct dump_filter *filter)
+{
+	uint32_t id;
+
+	id = l_netlink_send(rtnl, nlm, filter_cb, filter, dump_filter_destroy);
+	if (!id) {
+		l_netlink_message_unref(nlm);
+		l_free(filter);
+	}
+
+	return id;
+}
+
+/*
+ * Kernels without strict checking enabled, or too old to know a given
+ * filter, ignore it and dump everything.  The replies are checked here
+ * as well so that callers get the same results either way.
+ */
+static void ifaddr_dump_filter_cb(int error, uint16_t type, const void *data,
+					uint32_t len, void *user_data)
+{
+	struct dump_filter *filter = user_data;
+	const struct ifaddrmsg *ifa = data;
+
+	if (!error && filter->ifindex && ifa->ifa_index != filter->ifindex)
+		return;
+
+	if (filter->cb)
+		filter->cb(error, type, data, len, filter->user_data);
+}
+
+LIB_EXPORT uint32_t l_rtnl_ifaddr_dump(struct l_netlink *rtnl, int family,
+					int ifindex,
+					l_netlink_command_func_t cb,
+					void *user_data,
+					l_netlink_destroy_func_t destroy)
+{
+	struct dump_filter *filter;
+	struct l_netlink_message *nlm;
+	struct ifaddrmsg ifa;
+
+	if (unlikely(!rtnl || ifindex < 0))
+		return 0;
+
+	nlm = l_netlink_message_new_sized(RTM_GETADDR, NLM_F_DUMP,
+								sizeof(ifa));
+
+	memset(&ifa, 0, sizeof(ifa));
+	ifa.ifa_family = family;
+	ifa.ifa_index = ifindex;
+
+	l_netlink_message_add_header(nlm, &ifa, sizeof(ifa));
+
+	filter = l_new(struct dump_filter, 1);
+	filter->ifindex = ifindex;
+	filter->cb = cb;
+	filter->user_data = user_data;
+	filter->destroy = destroy;
+
+	return dump_filter_send(rtnl, nlm, ifaddr_dump_filter_cb, filter);
+}
+
+static void route_dump_filter_cb(int error, uint16_t type, const void *data,
+					uint32_t len, void *user_data)
+{
+	struct dump_filter *filter = user_data;
+	const struct rtmsg *rtm = data;
+	const struct rtattr *attr;
+	uint32_t table;
+	uint32_t ifindex = 0;
+	int attr_len;
+
+	if (error)
+		goto done;
+
+	table = rtm->rtm_table;
+	attr_len = len - NLMSG_ALIGN(sizeof(struct rtmsg));
+
+	for (attr = RTM_RTA(rtm); RTA_OK(attr, attr_len);
+					attr = RTA_NEXT(attr, attr_len)) {
+		switch (attr->rta_type) {
+		case RTA_TABLE:
+			table = l_get_u32(RTA_DATA(attr));
+			break;
+		case RTA_OIF:
+			ifindex = l_get_u32(RTA_DATA(attr));
+			break;
+		}
+	}
+
+	if (filter->table && table != filter->table)
+		return;
+
+	if (filter->ifindex && ifindex != filter->ifindex)
+		return;
+
+done:
+	if (filter->cb)
+		filter->cb(error, type, data, len, filter->user_data);
+}
+
+LIB_EXPORT uint32_t l_rtnl_route_dump(struct l_netlink *rtnl, int family,
+					uint32_t table, int ifindex,
+					l_netlink_command_func_t cb,
+					void *user_data,
+					l_netlink_destroy_func_t destroy)
+{
+	struct dump_filter *filter;
+	struct l_netlink_message *nlm;
+	struct rtmsg rtm;
+
+	if (unlikely(!rtnl || ifindex < 0))
+		return 0;
+
+	nlm = l_netlink_message_new(RTM_GETROUTE, NLM_F_DUMP);
+
+	memset(&rtm, 0, sizeof(rtm));
+	rtm.rtm_family = family;
+	rtm.rtm_table = table < 256 ? table : RT_TABLE_UNSPEC;
+
+	l_netlink_message_add_header(nlm, &rtm, sizeof(rtm));
+
+	if (table)
+		l_netlink_message_append_u32(nlm, RTA_TABLE, table);
+
+	if (ifindex)
+		l_netlink_message_append_u32(nlm, RTA_OIF, ifindex);
+
+	filter = l_new(struct dump_filter, 1);
+	filter->table = table;
+	filter->ifindex = ifindex;
+	filter->cb = cb;
+	filter->user_data = user_data;
+	filter->destroy = destroy;
+
+	return dump_filter_send(rtnl, nlm, route_dump_filter_cb, filter);
+}
+
 LIB_EXPORT uint32_t l_rtnl_route6_add_gateway(struct l_netlink *rtnl,
 					int ifindex,
 					const char *gateway,
@@ -1334,6 +1494,210 @@ LIB_EXPORT uint32_t l_rtnl_neighbor_set_hwaddr(struct l_netlink *rtnl,
 	return l_netlink_send(rtnl, nlm, cb, user_data, destroy);
 }
 
+struct rtnl_link_stats_data {
+	l_rtnl_link_stats_cb_t cb;
+	void *user_data;
+	l_netlink_destroy_func_t destroy;
+	struct l_rtnl_link_stats *stats;
+	unsigned int n_stats;
+	unsigned int max_stats;
+	int error;
+};
+
+static void rtnl_link_stats_cb(int error, uint16_t type, const void *data,
+					uint32_t len, void *user_data)
+{
+	struct rtnl_link_stats_data *cb_data = user_data;
+	const struct if_stats_msg *ifsm = data;
+	const struct rtattr *attr;
+	struct rtnl_link_stats64 s64;
+	struct l_rtnl_link_stats *stats;
+	bool found = false;
+	int attr_len;
+
+	if (error) {
+		if (!cb_data->error)
+			cb_data->error = error;
+
+		return;
+	}
+
+	if (type != RTM_NEWSTATS || len < NLMSG_ALIGN(sizeof(*ifsm)))
+		return;
+
+	memset(&s64, 0, sizeof(s64));
+	attr_len = len - NLMSG_ALIGN(sizeof(*ifsm));
+
+	for (attr = (void *) ifsm + NLMSG_ALIGN(sizeof(*ifsm));
+				RTA_OK(attr, attr_len);
+				attr = RTA_NEXT(attr, attr_len)) {
+		if (attr->rta_type != IFLA_STATS_LINK_64)
+			continue;
+
+		/* Older kernels have fewer counters at the end */
+		memcpy(&s64, RTA_DATA(attr),
+				minsize(RTA_PAYLOAD(attr), sizeof(s64)));
+		found = true;
+	}
+
+	if (!found)
+		return;
+
+	if (cb_data->n_stats == cb_data->max_stats) {
+		cb_data->max_stats = cb_data->max_stats ?
+						cb_data->max_stats * 2 : 16;
+		cb_data->stats = l_realloc(cb_data->stats,
+					cb_data->max_stats * sizeof(*stats));
+	}
+
+	stats = &cb_data->stats[cb_data->n_stats++];
+	stats->ifindex = ifsm->ifindex;
+	stats->rx_packets = s64.rx_packets;
+	stats->tx_packets = s64.tx_packets;
+	stats->rx_bytes = s64.rx_bytes;
+	stats->tx_bytes = s64.tx_bytes;
+	stats->rx_errors = s64.rx_errors;
+	stats->tx_errors = s64.tx_errors;
+	stats->rx_dropped = s64.rx_dropped;
+	stats->tx_dropped = s64.tx_dropped;
+	stats->multicast = s64.multicast;
+}
+
+static int link_stats_compare(const void *a, const void *b)
+{
+	const struct l_rtnl_link_stats *sa = a;
+	const struct l_rtnl_link_stats *sb = b;
+
+	return (sa->ifindex > sb->ifindex) - (sa->ifindex < sb->ifindex);
+}
+
+/* The request is released once the dump is over, report the results then */
+static void rtnl_link_stats_destroy_cb(void *user_data)
+{
+	struct rtnl_link_stats_data *cb_data = user_data;
+
+	if (!cb_data->cb)
+		goto done;
+
+	if (cb_data->error) {
+		cb_data->cb(cb_data->error, NULL, 0, cb_data->user_data);
+		goto done;
+	}
+
+	qsort(cb_data->stats, cb_data->n_stats,
+			sizeof(struct l_rtnl_link_stats), link_stats_compare);
+	cb_data->cb(0, cb_data->stats, cb_data->n_stats, cb_data->user_data);
+
+done:
+	if (cb_data->destroy)
+		cb_data->destroy(cb_data->user_data);
+
+	l_free(cb_data->stats);
+	l_free(cb_data);
+}
+
+/**
+ * l_rtnl_link_stats_dump:
+ * @rtnl: rtnetlink object
+ * @cb: function called with the counters of every link
+ * @user_data: user data for @cb and @destroy
+ * @destroy: function called once @user_data is no longer needed
+ *
+ * Fetch the 64-bit counters of all links with a single RTM_GETSTATS dump,
+ * asking the kernel for only those counters.  @cb is called once, when
+ * the dump is over, with an array sorted by ifindex that is only valid
+ * for the duration of the call.  As the end of a dump is only known once
+ * the request is released, @cb is also called with the counters received
+ * so far if the request is cancelled with l_netlink_cancel().
+ *
+ * Returns: the id of the request or 0 on failure
+ **/
+LIB_EXPORT uint32_t l_rtnl_link_stats_dump(struct l_netlink *rtnl,
+					l_rtnl_link_stats_cb_t cb,
+					void *user_data,
+					l_netlink_destroy_func_t destroy)
+{
+	struct l_netlink_message *nlm;
+	struct if_stats_msg ifsm;
+	__auto_type cb_data = struct_alloc(rtnl_link_stats_data,
+						cb, user_data, destroy);
+	uint32_t id;
+
+	nlm = l_netlink_message_new_sized(RTM_GETSTATS, NLM_F_DUMP,
+								sizeof(ifsm));
+
+	memset(&ifsm, 0, sizeof(ifsm));
+	ifsm.family = AF_UNSPEC;
+	ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+
+	l_netlink_message_add_header(nlm, &ifsm, sizeof(ifsm));
+
+	id = l_netlink_send(rtnl, nlm, rtnl_link_stats_cb, cb_data,
+					rtnl_link_stats_destroy_cb);
+	if (!id) {
+		l_netlink_message_unref(nlm);
+		l_free(cb_data);
+	}
+
+	return id;
+}
+
+static uint64_t counter_delta(uint64_t old, uint64_t cur)
+{
+	/* A counter going backwards was reset, e.g. by a driver reload */
+	return cur >= old ? cur - old : cur;
+}
+
+/**
+ * l_rtnl_link_stats_delta:
+ * @old: counters from an earlier l_rtnl_link_stats_dump()
+ * @n_old: number of entries in @old
+ * @cur: counters from a later l_rtnl_link_stats_dump()
+ * @n_cur: number of entries in @cur
+ * @out: array of @n_cur entries, may be the same as @cur
+ *
+ * Compute how much each counter of @cur increased since @old, matching
+ * the links by ifindex.  Both arrays must be sorted by ifindex, as they
+ * are when handed out by l_rtnl_link_stats_dump().  Links missing from
+ * @old are reported with their full counters.
+ **/
+LIB_EXPORT void l_rtnl_link_stats_delta(const struct l_rtnl_link_stats *old,
+					unsigned int n_old,
+					const struct l_rtnl_link_stats *cur,
+					unsigned int n_cur,
+					struct l_rtnl_link_stats *out)
+{
+	static const struct l_rtnl_link_stats zero;
+	unsigned int i;
+	unsigned int j = 0;
+
+	if (unlikely((!old && n_old) || (!cur && n_cur) || (!out && n_cur)))
+		return;
+
+	for (i = 0; i < n_cur; i++) {
+		const struct l_rtnl_link_stats *prev = &zero;
+		const struct l_rtnl_link_stats *c = &cur[i];
+		struct l_rtnl_link_stats *o = &out[i];
+
+		while (j < n_old && old[j].ifindex < c->ifindex)
+			j++;
+
+		if (j < n_old && old[j].ifindex == c->ifindex)
+			prev = &old[j];
+
+		o->ifindex = c->ifindex;
+		o->rx_packets = counter_delta(prev->rx_packets, c->rx_packets);
+		o->tx_packets = counter_delta(prev->tx_packets, c->tx_packets);
+		o->rx_bytes = counter_delta(prev->rx_bytes, c->rx_bytes);
+		o->tx_bytes = counter_delta(prev->tx_bytes, c->tx_bytes);
+		o->rx_errors = counter_delta(prev->rx_errors, c->rx_errors);
+		o->tx_errors = counter_delta(prev->tx_errors, c->tx_errors);
+		o->rx_dropped = counter_delta(prev->rx_dropped, c->rx_dropped);
+		o->tx_dropped = counter_delta(prev->tx_dropped, c->tx_dropped);
+		o->multicast = counter_delta(prev->multicast, c->multicast);
+	}
+}
+
 __attribute__((destructor(32000))) static void free_rtnl()
 {
 	l_netlink_destroy(rtnl);
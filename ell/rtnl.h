@@ -24,6 +24,23 @@ typedef void (*l_rtnl_neighbor_get_cb_t) (int error, const uint8_t *hwaddr,
 						size_t hwaddr_len,
 						void *user_data);
 
+struct l_rtnl_link_stats {
+	uint32_t ifindex;
+	uint64_t rx_packets;
+	uint64_t tx_packets;
+	uint64_t rx_bytes;
+	uint64_t tx_bytes;
+	uint64_t rx_errors;
+	uint64_t tx_errors;
+	uint64_t rx_dropped;
+	uint64_t tx_dropped;
+	uint64_t multicast;
+};
+
+typedef void (*l_rtnl_link_stats_cb_t) (int error,
+					const struct l_rtnl_link_stats *stats,
+					unsigned int n_stats, void *user_data);
+
 struct l_rtnl_address *l_rtnl_address_new(const char *ip, uint8_t prefix_len);
 struct l_rtnl_address *l_rtnl_address_clone(const struct l_rtnl_address *orig);
 void l_rtnl_address_free(struct l_rtnl_address *addr);
@@ -164,6 +181,13 @@ void l_rtnl_route6_extract(const struct rtmsg *rtmsg, uint32_t len,
 uint32_t l_rtnl_route6_dump(struct l_netlink *rtnl,
 				l_netlink_command_func_t cb, void *user_data,
 				l_netlink_destroy_func_t destroy);
+uint32_t l_rtnl_ifaddr_dump(struct l_netlink *rtnl, int family, int ifindex,
+				l_netlink_command_func_t cb, void *user_data,
+				l_netlink_destroy_func_t destroy);
+uint32_t l_rtnl_route_dump(struct l_netlink *rtnl, int family, uint32_t table,
+				int ifindex, l_netlink_command_func_t cb,
+				void *user_data,
+				l_netlink_destroy_func_t destroy);
 uint32_t l_rtnl_route6_add_gateway(struct l_netlink *rtnl, int ifindex,
 					const char *gateway,
 					uint32_t priority_offset,
@@ -217,8 +241,111 @@ uint32_t l_rtnl_neighbor_set_hwaddr(struct l_netlink *rtnl, int ifindex,
 					void *user_data,
 					l_netlink_destroy_func_t destroy);
 
+uint32_t l_rtnl_link_stats_dump(struct l_netlink *rtnl,
+					l_rtnl_link_stats_cb_t cb,
+					void *user_data,
+					l_netlink_destroy_func_t destroy);
+void l_rtnl_link_stats_delta(const struct l_rtnl_link_stats *old,
+				unsigned int n_old,
+				const struct l_rtnl_link_stats *cur,
+				unsigned int n_cur,
+				struct l_rtnl_link_stats *out);
+
 struct l_netlink *l_rtnl_get();
 
+struct l_rtnl_route_table;
+
+struct l_rtnl_route_table *l_rtnl_route_table_new(void);
+void l_rtnl_route_table_free(struct l_rtnl_route_table *table);
+bool l_rtnl_route_table_add(struct l_rtnl_route_table *table,
+				const struct l_rtnl_route *rt, void *user_data);
+bool l_rtnl_route_table_remove(struct l_rtnl_route_table *table,
+				const struct l_rtnl_route *rt);
+unsigned int l_rtnl_route_table_get_count(
+				const struct l_rtnl_route_table *table);
+const struct l_rtnl_route *l_rtnl_route_table_lookup(
+				const struct l_rtnl_route_table *table,
+				uint8_t family, const void *in_addr,
+				void **out_user_data);
+
+#define L_RTNL_LINK_ADDRESS_MAX 32
+
+struct l_rtnl_link {
+	uint32_t ifindex;
+	char ifname[16];
+	uint32_t flags;
+	uint32_t mtu;
+	uint8_t operstate;
+	uint8_t address[L_RTNL_LINK_ADDRESS_MAX];
+	uint8_t address_len;
+	uint16_t type;
+};
+
+enum l_rtnl_cache_event {
+	L_RTNL_CACHE_EVENT_NEW,
+	L_RTNL_CACHE_EVENT_CHANGED,
+	L_RTNL_CACHE_EVENT_DEL,
+};
+
+struct l_rtnl_cache;
+
+typedef void (*l_rtnl_cache_ready_func_t) (int error, void *user_data);
+typedef void (*l_rtnl_cache_destroy_func_t) (void *user_data);
+typedef void (*l_rtnl_cache_link_func_t) (enum l_rtnl_cache_event event,
+					const struct l_rtnl_link *link,
+					void *user_data);
+typedef void (*l_rtnl_cache_address_func_t) (enum l_rtnl_cache_event event,
+					uint32_t ifindex,
+					const struct l_rtnl_address *addr,
+					void *user_data);
+typedef void (*l_rtnl_cache_route_func_t) (enum l_rtnl_cache_event event,
+					uint32_t ifindex,
+					const struct l_rtnl_route *rt,
+					void *user_data);
+typedef void (*l_rtnl_cache_address_foreach_func_t) (uint32_t ifindex,
+					const struct l_rtnl_address *addr,
+					void *user_data);
+
+struct l_rtnl_cache *l_rtnl_cache_new(struct l_netlink *rtnl,
+					l_rtnl_cache_ready_func_t ready,
+					void *user_data,
+					l_rtnl_cache_destroy_func_t destroy);
+void l_rtnl_cache_free(struct l_rtnl_cache *cache);
+bool l_rtnl_cache_is_ready(const struct l_rtnl_cache *cache);
+
+unsigned int l_rtnl_cache_add_link_watch(struct l_rtnl_cache *cache,
+					l_rtnl_cache_link_func_t function,
+					void *user_data,
+					l_rtnl_cache_destroy_func_t destroy);
+unsigned int l_rtnl_cache_add_address_watch(struct l_rtnl_cache *cache,
+					l_rtnl_cache_address_func_t function,
+					void *user_data,
+					l_rtnl_cache_destroy_func_t destroy);
+unsigned int l_rtnl_cache_add_route_watch(struct l_rtnl_cache *cache,
+					l_rtnl_cache_route_func_t function,
+					void *user_data,
+					l_rtnl_cache_destroy_func_t destroy);
+bool l_rtnl_cache_remove_watch(struct l_rtnl_cache *cache, unsigned int id);
+
+const struct l_rtnl_link *l_rtnl_cache_get_link(
+					const struct l_rtnl_cache *cache,
+					uint32_t ifindex);
+const struct l_rtnl_link *l_rtnl_cache_find_link(
+					const struct l_rtnl_cache *cache,
+					const char *ifname);
+bool l_rtnl_cache_foreach_address(const struct l_rtnl_cache *cache,
+				uint32_t ifindex,
+				l_rtnl_cache_address_foreach_func_t function,
+				void *user_data);
+const struct l_rtnl_address *l_rtnl_cache_find_address(
+					const struct l_rtnl_cache *cache,
+					uint8_t family, const void *in_addr,
+					uint32_t *out_ifindex);
+const struct l_rtnl_route *l_rtnl_cache_lookup_route(
+					const struct l_rtnl_cache *cache,
+					uint8_t family, const void *in_addr,
+					uint32_t *out_ifindex);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,361 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "useful.h"
+#include "util.h"
+#include "hashmap.h"
+#include "settings.h"
+#include "file.h"
+#include "path.h"
+#include "time.h"
+#include "private.h"
+#include "settings-private.h"
+
+/*
+ * A single file holding the compiled form of many settings files, each
+ * stamped with the modification time of its source.  Loading a file whose
+ * source is unchanged then costs a stat() and a copy of its compiled data
+ * instead of reading and parsing the source.
+ */
+static const char cache_sig[8] = { 'E', 'L', 'L', 'S', 'E', 'T', 'C', 'H' };
+
+#define CACHE_VERSION	1
+
+struct cache_header {
+	uint8_t  signature[8];
+	uint32_t version;
+	uint32_t n_entries;
+	uint64_t file_size;
+
+	/* followed by n_entries entries */
+} __attribute__ ((packed));
+
+struct cache_entry {
+	uint64_t mtime;			/* Source mtime in usec */
+	uint32_t path_len;		/* Source path length, without NUL */
+	uint32_t data_len;		/* Compiled settings length */
+
+	/* followed by the NUL terminated path */
+	/* followed by data_len bytes of compiled settings */
+} __attribute__ ((packed));
+
+struct cache_item {
+	uint64_t mtime;
+	const void *data;
+	size_t len;
+	void *compiled;
+};
+
+struct l_settings_cache {
+	char *path;
+	void *addr;
+	size_t size;
+	struct l_hashmap *items;
+	bool dirty;
+};
+
+static void cache_item_free(void *data)
+{
+	struct cache_item *item = data;
+
+	l_free(item->compiled);
+	l_free(item);
+}
+
+static bool cache_map(struct l_settings_cache *cache)
+{
+	const struct cache_header *hdr;
+	struct stat st;
+	size_t pos;
+	uint32_t i;
+	int fd;
+
+	fd = open(cache->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) < 0 ||
+			(size_t) st.st_size < sizeof(struct cache_header)) {
+		close(fd);
+		return false;
+	}
+
+	cache->addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (cache->addr == MAP_FAILED) {
+		cache->addr = NULL;
+		return false;
+	}
+
+	cache->size = st.st_size;
+	hdr = cache->addr;
+
+	if (memcmp(hdr->signature, cache_sig, sizeof(cache_sig)) ||
+			L_LE32_TO_CPU(hdr->version) != CACHE_VERSION ||
+			L_LE64_TO_CPU(hdr->file_size) != cache->size)
+		return false;
+
+	pos = sizeof(struct cache_header);
+
+	for (i = 0; i < L_LE32_TO_CPU(hdr->n_entries); i++) {
+		const struct cache_entry *entry;
+		const char *path;
+		struct cache_item *item;
+		size_t path_len;
+		size_t data_len;
+
+		if (cache->size - pos < sizeof(struct cache_entry))
+			return false;
+
+		entry = cache->addr + pos;
+		path_len = L_LE32_TO_CPU(entry->path_len);
+		data_len = L_LE32_TO_CPU(entry->data_len);
+		pos += sizeof(struct cache_entry);
+
+		if (cache->size - pos <= path_len ||
+				cache->size - pos - path_len - 1 < data_len)
+			return false;
+
+		path = cache->addr + pos;
+		if (path[path_len] != '\0')
+			return false;
+
+		if (l_hashmap_lookup(cache->items, path))
+			return false;
+
+		item = l_new(struct cache_item, 1);
+		item->mtime = L_LE64_TO_CPU(entry->mtime);
+		item->data = path + path_len + 1;
+		item->len = data_len;
+		l_hashmap_insert(cache->items, path, item);
+
+		pos += path_len + 1 + data_len;
+	}
+
+	return pos == cache->size;
+}
+
+static void cache_unmap(struct l_settings_cache *cache)
+{
+	if (!cache->addr)
+		return;
+
+	munmap(cache->addr, cache->size);
+	cache->addr = NULL;
+	cache->size = 0;
+}
+
+/**
+ * l_settings_cache_new:
+ * @path: Path of the cache file
+ *
+ * Opens the settings cache stored in @path.  A missing or invalid cache
+ * file is not an error, the cache then starts out empty and is filled as
+ * settings files are loaded through it.
+ *
+ * Returns: a newly allocated #l_settings_cache object
+ **/
+LIB_EXPORT struct l_settings_cache *l_settings_cache_new(const char *path)
+{
+	struct l_settings_cache *cache;
+
+	if (unlikely(!path))
+		return NULL;
+
+	cache = l_new(struct l_settings_cache, 1);
+	cache->path = l_strdup(path);
+	cache->items = l_hashmap_string_new();
+
+	if (!cache_map(cache)) {
+		l_hashmap_destroy(cache->items, cache_item_free);
+		cache->items = l_hashmap_string_new();
+		cache_unmap(cache);
+	}
+
+	return cache;
+}
+
+/**
+ * l_settings_cache_free:
+ * @cache: settings cache object
+ *
+ * Frees the cache without writing out changes, see l_settings_cache_write().
+ **/
+LIB_EXPORT void l_settings_cache_free(struct l_settings_cache *cache)
+{
+	if (unlikely(!cache))
+		return;
+
+	l_hashmap_destroy(cache->items, cache_item_free);
+	cache_unmap(cache);
+	l_free(cache->path);
+	l_free(cache);
+}
+
+/**
+ * l_settings_cache_load:
+ * @cache: settings cache object
+ * @filename: Settings file to load
+ *
+ * Loads @filename like l_settings_load_from_file() does into a new
+ * #l_settings object, from the cache if the file has not been modified
+ * since it was cached.  Otherwise the file is parsed and the cache is
+ * updated, to be saved with l_settings_cache_write().
+ *
+ * Returns: a newly allocated #l_settings object or NULL if the file could
+ * not be loaded
+ **/
+LIB_EXPORT struct l_settings *l_settings_cache_load(
+					struct l_settings_cache *cache,
+					const char *filename)
+{
+	struct l_settings *settings;
+	struct cache_item *item;
+	uint64_t mtime;
+
+	if (unlikely(!cache || !filename))
+		return NULL;
+
+	/* Taken before reading so a concurrent change is seen next time */
+	mtime = l_path_get_mtime(filename);
+	if (mtime == L_TIME_INVALID)
+		return NULL;
+
+	item = l_hashmap_lookup(cache->items, filename);
+	if (item && item->mtime == mtime) {
+		settings = settings_new_compiled(item->data, item->len);
+		if (settings)
+			return settings;
+	}
+
+	settings = l_settings_new();
+
+	if (!l_settings_load_from_file(settings, filename)) {
+		l_settings_free(settings);
+		return NULL;
+	}
+
+	if (!item) {
+		item = l_new(struct cache_item, 1);
+		l_hashmap_insert(cache->items, filename, item);
+	}
+
+	l_free(item->compiled);
+	item->compiled = settings_compile(settings, &item->len);
+	item->data = item->compiled;
+	item->mtime = mtime;
+	cache->dirty = true;
+
+	return settings;
+}
+
+struct write_data {
+	uint8_t *buf;
+	size_t len;
+	uint32_t n_entries;
+};
+
+static void cache_size_foreach(const void *key, void *value, void *user_data)
+{
+	const struct cache_item *item = value;
+	struct write_data *data = user_data;
+
+	data->len += sizeof(struct cache_entry) + strlen(key) + 1 + item->len;
+}
+
+static void cache_write_foreach(const void *key, void *value,
+					void *user_data)
+{
+	const struct cache_item *item = value;
+	struct write_data *data = user_data;
+	struct cache_entry *entry = (void *) data->buf + data->len;
+	size_t path_len = strlen(key);
+
+	entry->mtime = L_CPU_TO_LE64(item->mtime);
+	entry->path_len = L_CPU_TO_LE32(path_len);
+	entry->data_len = L_CPU_TO_LE32(item->len);
+	data->len += sizeof(struct cache_entry);
+
+	memcpy(data->buf + data->len, key, path_len + 1);
+	data->len += path_len + 1;
+
+	memcpy(data->buf + data->len, item->data, item->len);
+	data->len += item->len;
+	data->n_entries++;
+}
+
+static bool cache_prune_foreach(const void *key, void *value, void *user_data)
+{
+	const struct cache_item *item = value;
+
+	if (l_path_get_mtime(key) == item->mtime)
+		return false;
+
+	cache_item_free(value);
+	return true;
+}
+
+/**
+ * l_settings_cache_write:
+ * @cache: settings cache object
+ *
+ * Rebuilds the cache file if any settings file was loaded from its source,
+ * dropping the entries of sources that changed or no longer exist.  This
+ * does not affect the loading of settings and can be deferred, e.g. with
+ * l_idle_oneshot(), until startup is done.
+ *
+ * Returns: 0 if the cache file is up to date, a negative errno otherwise
+ **/
+LIB_EXPORT int l_settings_cache_write(struct l_settings_cache *cache)
+{
+	struct write_data data = {};
+	struct cache_header *hdr;
+	int r;
+
+	if (unlikely(!cache))
+		return -EINVAL;
+
+	if (!cache->dirty)
+		return 0;
+
+	l_hashmap_foreach_remove(cache->items, cache_prune_foreach, NULL);
+
+	data.len = sizeof(struct cache_header);
+	l_hashmap_foreach(cache->items, cache_size_foreach, &data);
+
+	data.buf = l_malloc(data.len);
+	data.len = sizeof(struct cache_header);
+	l_hashmap_foreach(cache->items, cache_write_foreach, &data);
+
+	hdr = (struct cache_header *) data.buf;
+	memcpy(hdr->signature, cache_sig, sizeof(cache_sig));
+	hdr->version = L_CPU_TO_LE32(CACHE_VERSION);
+	hdr->n_entries = L_CPU_TO_LE32(data.n_entries);
+	hdr->file_size = L_CPU_TO_LE64(data.len);
+
+	r = l_file_set_contents(cache->path, data.buf, data.len);
+	l_free(data.buf);
+
+	if (r < 0)
+		return r;
+
+	cache->dirty = false;
+	return 0;
+}
@@ -0,0 +1,9 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+void *settings_compile(const struct l_settings *settings, size_t *out_len);
+struct l_settings *settings_new_compiled(const void *data, size_t len);
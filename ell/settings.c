@@ -28,18 +28,35 @@
 #include <sys/mman.h>
 
 #include "useful.h"
+#include "util.h"
 #include "strv.h"
 #include "utf8.h"
 #include "string.h"
 #include "queue.h"
+#include "hashmap.h"
 #include "settings.h"
+#include "arena.h"
 #include "private.h"
 #include "missing.h"
 #include "pem-private.h"
+#include "settings-private.h"
+#include "memory-private.h"
 
+/*
+ * Keys, values and group names loaded from data point into a copy of that
+ * data kept by l_settings, instead of each being a separate allocation.
+ * Only the ones created or replaced later on are allocated.
+ */
 struct setting_data {
 	char *key;
 	char *value;
+	bool key_borrowed : 1;
+	bool value_borrowed : 1;
+};
+
+struct loaded_data {
+	size_t len;
+	char data[];
 };
 
 struct embedded_group_data {
@@ -49,9 +66,16 @@ struct embedded_group_data {
 	char data[];
 };
 
+/*
+ * The queues keep groups and keys in file order for l_settings_to_data,
+ * the indexes map names to the same entries for lookups.  Both list
+ * duplicates in the same order so that the first one is always found.
+ */
 struct group_data {
 	char *name;
 	struct l_queue *settings;
+	struct l_hashmap *index;
+	bool name_borrowed;
 };
 
 struct l_settings {
@@ -59,16 +83,71 @@ struct l_settings {
 	l_settings_destroy_cb_t debug_destroy;
 	void *debug_data;
 	struct l_queue *groups;
+	struct l_hashmap *group_index;
 	struct l_queue *embedded_groups;
+	struct l_queue *loaded;
 };
 
+static struct l_hashmap *name_index_new(void)
+{
+	struct l_hashmap *index = l_hashmap_new();
+
+	l_hashmap_set_hash_function(index, l_str_hash_fast);
+	l_hashmap_set_compare_function(index,
+					(l_hashmap_compare_func_t) strcmp);
+
+	return index;
+}
+
+static struct group_data *group_new(struct l_settings *settings, char *name)
+{
+	struct group_data *group = l_new(struct group_data, 1);
+
+	group->name = name;
+	group->settings = l_queue_new();
+	group->index = name_index_new();
+
+	l_queue_push_tail(settings->groups, group);
+	l_hashmap_insert(settings->group_index, group->name, group);
+
+	return group;
+}
+
+static struct group_data *group_find(const struct l_settings *settings,
+					const char *name)
+{
+	return l_hashmap_lookup(settings->group_index, name);
+}
+
+static void group_add_setting(struct group_data *group,
+				struct setting_data *pair)
+{
+	l_queue_push_tail(group->settings, pair);
+	l_hashmap_insert(group->index, pair->key, pair);
+}
+
+static struct setting_data *group_find_setting(const struct group_data *group,
+						const char *key)
+{
+	return l_hashmap_lookup(group->index, key);
+}
+
+static void setting_free_value(struct setting_data *pair)
+{
+	explicit_bzero(pair->value, strlen(pair->value));
+
+	if (!pair->value_borrowed)
+		l_free(pair->value);
+}
+
 static void setting_destroy(void *data)
 {
 	struct setting_data *pair = data;
 
-	l_free(pair->key);
-	explicit_bzero(pair->value, strlen(pair->value));
-	l_free(pair->value);
+	if (!pair->key_borrowed)
+		l_free(pair->key);
+
+	setting_free_value(pair);
 	l_free(pair);
 }
 
@@ -76,9 +155,12 @@ static void group_destroy(void *data)
 {
 	struct group_data *group = data;
 
-	l_free(group->name);
+	l_hashmap_destroy(group->index, NULL);
 	l_queue_destroy(group->settings, setting_destroy);
 
+	if (!group->name_borrowed)
+		l_free(group->name);
+
 	l_free(group);
 }
 
@@ -90,13 +172,24 @@ static void embedded_group_destroy(void *data)
 	l_free(group);
 }
 
+static void loaded_data_destroy(void *data)
+{
+	struct loaded_data *loaded = data;
+
+	explicit_bzero(loaded->data, loaded->len);
+	l_free(loaded);
+}
+
 LIB_EXPORT struct l_settings *l_settings_new(void)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_SETTINGS);
 	struct l_settings *settings;
 
 	settings = l_new(struct l_settings, 1);
 	settings->groups = l_queue_new();
+	settings->group_index = name_index_new();
 	settings->embedded_groups = l_queue_new();
+	settings->loaded = l_queue_new();
 
 	return settings;
 }
@@ -104,28 +197,22 @@ LIB_EXPORT struct l_settings *l_settings_new(void)
 static void copy_key_value_foreach(void *data, void *user_data)
 {
 	struct setting_data *s = data;
-	struct l_queue *settings = user_data;
+	struct group_data *group = user_data;
 	struct setting_data *copy = l_new(struct setting_data, 1);
 
 	copy->key = l_strdup(s->key);
 	copy->value = l_strdup(s->value);
 
-	l_queue_push_head(settings, copy);
+	group_add_setting(group, copy);
 }
 
 static void copy_group_foreach(void *data, void *user_data)
 {
 	struct group_data *group = data;
-	struct l_queue *groups = user_data;
-	struct group_data *copy = l_new(struct group_data, 1);
+	struct l_settings *settings = user_data;
+	struct group_data *copy = group_new(settings, l_strdup(group->name));
 
-	copy->name = l_strdup(group->name);
-	copy->settings = l_queue_new();
-
-	l_queue_push_head(groups, copy);
-
-	l_queue_foreach(group->settings, copy_key_value_foreach,
-				copy->settings);
+	l_queue_foreach(group->settings, copy_key_value_foreach, copy);
 }
 
 static void copy_embedded_foreach(void *data, void *user_data)
@@ -151,7 +238,7 @@ LIB_EXPORT struct l_settings *l_settings_clone(
 
 	copy = l_settings_new();
 
-	l_queue_foreach(settings->groups, copy_group_foreach, copy->groups);
+	l_queue_foreach(settings->groups, copy_group_foreach, copy);
 	l_queue_foreach(settings->embedded_groups, copy_embedded_foreach,
 				copy->embedded_groups);
 
@@ -166,21 +253,20 @@ LIB_EXPORT void l_settings_free(struct l_settings *settings)
 	if (settings->debug_destroy)
 		settings->debug_destroy(settings->debug_data);
 
+	l_hashmap_destroy(settings->group_index, NULL);
 	l_queue_destroy(settings->groups, group_destroy);
 	l_queue_destroy(settings->embedded_groups, embedded_group_destroy);
+	l_queue_destroy(settings->loaded, loaded_data_destroy);
 
 	l_free(settings);
 }
 
-static char *unescape_value(const char *value)
+static bool unescape_into(char *dst, const char *value)
 {
-	char *ret;
 	char *n;
 	const char *o;
 
-	ret = l_new(char, strlen(value) + 1);
-
-	for (n = ret, o = value; *o; o++, n++) {
+	for (n = dst, o = value; *o; o++, n++) {
 		if (*o != '\\') {
 			*n = *o;
 			continue;
@@ -205,12 +291,25 @@ static char *unescape_value(const char *value)
 			*n = '\\';
 			break;
 		default:
-			explicit_bzero(ret, n - ret);
-			l_free(ret);
-			return NULL;
+			explicit_bzero(dst, n - dst);
+			return false;
 		}
 	}
 
+	*n = '\0';
+
+	return true;
+}
+
+static char *unescape_value(const char *value)
+{
+	char *ret = l_malloc(strlen(value) + 1);
+
+	if (!unescape_into(ret, value)) {
+		l_free(ret);
+		return NULL;
+	}
+
 	return ret;
 }
 
@@ -419,7 +518,7 @@ invalid_group:
 	return -EINVAL;
 }
 
-static bool parse_group(struct l_settings *settings, const char *data,
+static bool parse_group(struct l_settings *settings, char *data,
 			size_t len, size_t line)
 {
 	size_t i = 1;
@@ -455,11 +554,9 @@ static bool parse_group(struct l_settings *settings, const char *data,
 		return false;
 	}
 
-	group = l_new(struct group_data, 1);
-	group->name = l_strndup(data + 1, end - 1);
-	group->settings = l_queue_new();
-
-	l_queue_push_tail(settings->groups, group);
+	data[end] = '\0';
+	group = group_new(settings, data + 1);
+	group->name_borrowed = true;
 
 	return true;
 }
@@ -475,7 +572,7 @@ static bool validate_key_character(char c)
 	return false;
 }
 
-static unsigned int parse_key(struct l_settings *settings, const char *data,
+static unsigned int parse_key(struct l_settings *settings, char *data,
 				size_t len, size_t line)
 {
 	unsigned int i;
@@ -511,13 +608,15 @@ static unsigned int parse_key(struct l_settings *settings, const char *data,
 
 	group = l_queue_peek_tail(settings->groups);
 	pair = l_new(struct setting_data, 1);
-	pair->key = l_strndup(data, end);
+	pair->key = data;
+	pair->key_borrowed = true;
+	data[end] = '\0';
 	l_queue_push_head(group->settings, pair);
 
 	return end;
 }
 
-static bool parse_value(struct l_settings *settings, const char *data,
+static bool parse_value(struct l_settings *settings, char *data,
 			size_t len, size_t line)
 {
 	unsigned int end = len;
@@ -531,22 +630,23 @@ static bool parse_value(struct l_settings *settings, const char *data,
 		l_util_debug(settings->debug_handler, settings->debug_data,
 				"Invalid UTF8 in value on line: %zd", line);
 
-		l_free(pair->key);
 		l_free(pair);
 
 		return false;
 	}
 
-	pair->value = l_strndup(data, end);
-	l_queue_push_tail(group->settings, pair);
+	pair->value = data;
+	pair->value_borrowed = true;
+	data[end] = '\0';
+	group_add_setting(group, pair);
 
 	return true;
 }
 
-static bool parse_keyvalue(struct l_settings *settings, const char *data,
+static bool parse_keyvalue(struct l_settings *settings, char *data,
 				size_t len, size_t line)
 {
-	const char *equal = memchr(data, '=', len);
+	char *equal = memchr(data, '=', len);
 
 	if (!equal) {
 		l_util_debug(settings->debug_handler, settings->debug_data,
@@ -570,8 +670,12 @@ static bool parse_keyvalue(struct l_settings *settings, const char *data,
 	return parse_value(settings, equal, len - (equal - data), line);
 }
 
-LIB_EXPORT bool l_settings_load_from_data(struct l_settings *settings,
-						const char *data, size_t len)
+/*
+ * Parses a private copy of the data in place, terminating names and values
+ * in the buffer itself, which is why the newline ending each line has to
+ * be consumed here rather than looked at again.
+ */
+static bool parse_data(struct l_settings *settings, char *data, size_t len)
 {
 	size_t pos = 0;
 	bool r = true;
@@ -580,9 +684,6 @@ LIB_EXPORT bool l_settings_load_from_data(struct l_settings *settings,
 	size_t line = 1;
 	size_t line_len;
 
-	if (unlikely(!settings || !data || !len))
-		return false;
-
 	while (pos < len && r) {
 		if (l_ascii_isblank(data[pos])) {
 			pos += 1;
@@ -614,8 +715,11 @@ LIB_EXPORT bool l_settings_load_from_data(struct l_settings *settings,
 			 * This is the offset for the actual raw data, the
 			 * group line will be offset below
 			 */
-			pos += ret;
-		} else if (data[pos] == '[') {
+			pos += ret + line_len;
+			continue;
+		}
+
+		if (data[pos] == '[') {
 			r = parse_group(settings, data + pos, line_len, line);
 			if (r)
 				has_group = true;
@@ -628,11 +732,35 @@ LIB_EXPORT bool l_settings_load_from_data(struct l_settings *settings,
 		}
 
 		pos += line_len;
+
+		if (pos < len) {
+			line += 1;
+			pos += 1;
+		}
 	}
 
 	return r;
 }
 
+LIB_EXPORT bool l_settings_load_from_data(struct l_settings *settings,
+						const char *data, size_t len)
+{
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_SETTINGS);
+	struct loaded_data *loaded;
+
+	if (unlikely(!settings || !data || !len))
+		return false;
+
+	/* Kept even on failure, groups parsed until then point into it */
+	loaded = l_malloc(sizeof(struct loaded_data) + len + 1);
+	loaded->len = len;
+	memcpy(loaded->data, data, len);
+	loaded->data[len] = '\0';
+	l_queue_push_tail(settings->loaded, loaded);
+
+	return parse_data(settings, loaded->data, len);
+}
+
 LIB_EXPORT char *l_settings_to_data(const struct l_settings *settings,
 								size_t *len)
 {
@@ -746,6 +874,359 @@ LIB_EXPORT bool l_settings_load_from_file(struct l_settings *settings,
 	return r;
 }
 
+static void report_group_changes(const struct group_data *old_group,
+					const struct group_data *new_group,
+					l_settings_change_cb_t callback,
+					void *user_data)
+{
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(old_group->settings); entry;
+						entry = entry->next) {
+		const struct setting_data *pair = entry->data;
+		const struct setting_data *new_pair;
+
+		/* Only the first of duplicate keys is visible */
+		if (group_find_setting(old_group, pair->key) != pair)
+			continue;
+
+		new_pair = group_find_setting(new_group, pair->key);
+		if (!new_pair)
+			callback(L_SETTINGS_KEY_REMOVED, old_group->name,
+					pair->key, user_data);
+		else if (strcmp(pair->value, new_pair->value))
+			callback(L_SETTINGS_KEY_CHANGED, old_group->name,
+					pair->key, user_data);
+	}
+
+	for (entry = l_queue_get_entries(new_group->settings); entry;
+						entry = entry->next) {
+		const struct setting_data *pair = entry->data;
+
+		if (group_find_setting(new_group, pair->key) != pair)
+			continue;
+
+		if (!group_find_setting(old_group, pair->key))
+			callback(L_SETTINGS_KEY_ADDED, new_group->name,
+					pair->key, user_data);
+	}
+}
+
+static void report_changes(const struct l_settings *old,
+				const struct l_settings *new,
+				l_settings_change_cb_t callback,
+				void *user_data)
+{
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(old->groups); entry;
+						entry = entry->next) {
+		const struct group_data *group = entry->data;
+		const struct group_data *new_group;
+
+		if (group_find(old, group->name) != group)
+			continue;
+
+		new_group = group_find(new, group->name);
+		if (!new_group)
+			callback(L_SETTINGS_GROUP_REMOVED, group->name, NULL,
+					user_data);
+		else
+			report_group_changes(group, new_group,
+						callback, user_data);
+	}
+
+	for (entry = l_queue_get_entries(new->groups); entry;
+						entry = entry->next) {
+		const struct group_data *group = entry->data;
+
+		if (group_find(new, group->name) != group)
+			continue;
+
+		if (!group_find(old, group->name))
+			callback(L_SETTINGS_GROUP_ADDED, group->name, NULL,
+					user_data);
+	}
+}
+
+/*
+ * Replaces the contents of @settings with those of @filename, leaving them
+ * untouched if the file can't be loaded.  Once replaced, @callback is told
+ * about each group that was added or removed and each key that was added,
+ * removed or given a new value in the groups found in both.  Embedded
+ * groups are replaced without being reported.
+ */
+LIB_EXPORT bool l_settings_reload(struct l_settings *settings,
+					const char *filename,
+					l_settings_change_cb_t callback,
+					void *user_data)
+{
+	struct l_settings *spare;
+
+	if (unlikely(!settings || !filename))
+		return false;
+
+	spare = l_settings_new();
+	spare->debug_handler = settings->debug_handler;
+	spare->debug_data = settings->debug_data;
+
+	/* Load into the spare object first, then swap the contents */
+	if (!l_settings_load_from_file(spare, filename)) {
+		l_settings_free(spare);
+		return false;
+	}
+
+	SWAP(spare->groups, settings->groups);
+	SWAP(spare->group_index, settings->group_index);
+	SWAP(spare->embedded_groups, settings->embedded_groups);
+	SWAP(spare->loaded, settings->loaded);
+
+	if (callback)
+		report_changes(spare, settings, callback, user_data);
+
+	l_settings_free(spare);
+	return true;
+}
+
+/*
+ * Compiled form of the settings, used by the settings cache.  Counts and
+ * lengths are little endian 32 bit numbers, strings are NUL terminated:
+ *
+ *	n_groups, then for each group:
+ *		name_len, n_keys, name, and for each key:
+ *			key_len, value_len, key, value
+ *	n_embedded, then for each embedded group:
+ *		type_len, name_len, data_len, type, name, data
+ */
+static uint8_t *put_string(uint8_t *ptr, const char *str, size_t len)
+{
+	memcpy(ptr, str, len);
+	ptr[len] = '\0';
+
+	return ptr + len + 1;
+}
+
+void *settings_compile(const struct l_settings *settings, size_t *out_len)
+{
+	const struct l_queue_entry *group_entry;
+	const struct l_queue_entry *entry;
+	size_t len = 8;
+	uint8_t *buf;
+	uint8_t *ptr;
+
+	for (group_entry = l_queue_get_entries(settings->groups); group_entry;
+					group_entry = group_entry->next) {
+		const struct group_data *group = group_entry->data;
+
+		len += 8 + strlen(group->name) + 1;
+
+		for (entry = l_queue_get_entries(group->settings); entry;
+							entry = entry->next) {
+			const struct setting_data *pair = entry->data;
+
+			len += 8 + strlen(pair->key) + strlen(pair->value) + 2;
+		}
+	}
+
+	for (entry = l_queue_get_entries(settings->embedded_groups); entry;
+							entry = entry->next) {
+		const struct embedded_group_data *group = entry->data;
+
+		len += 12 + strlen(group->type) + strlen(group->name) +
+			group->len + 3;
+	}
+
+	buf = l_malloc(len);
+	ptr = buf;
+
+	l_put_le32(l_queue_length(settings->groups), ptr);
+	ptr += 4;
+
+	for (group_entry = l_queue_get_entries(settings->groups); group_entry;
+					group_entry = group_entry->next) {
+		const struct group_data *group = group_entry->data;
+		size_t name_len = strlen(group->name);
+
+		l_put_le32(name_len, ptr);
+		l_put_le32(l_queue_length(group->settings), ptr + 4);
+		ptr = put_string(ptr + 8, group->name, name_len);
+
+		for (entry = l_queue_get_entries(group->settings); entry;
+							entry = entry->next) {
+			const struct setting_data *pair = entry->data;
+			size_t key_len = strlen(pair->key);
+			size_t value_len = strlen(pair->value);
+
+			l_put_le32(key_len, ptr);
+			l_put_le32(value_len, ptr + 4);
+			ptr = put_string(ptr + 8, pair->key, key_len);
+			ptr = put_string(ptr, pair->value, value_len);
+		}
+	}
+
+	l_put_le32(l_queue_length(settings->embedded_groups), ptr);
+	ptr += 4;
+
+	for (entry = l_queue_get_entries(settings->embedded_groups); entry;
+							entry = entry->next) {
+		const struct embedded_group_data *group = entry->data;
+		size_t type_len = strlen(group->type);
+		size_t name_len = strlen(group->name);
+
+		l_put_le32(type_len, ptr);
+		l_put_le32(name_len, ptr + 4);
+		l_put_le32(group->len, ptr + 8);
+		ptr = put_string(ptr + 12, group->type, type_len);
+		ptr = put_string(ptr, group->name, name_len);
+		ptr = put_string(ptr, group->data, group->len);
+	}
+
+	*out_len = len;
+	return buf;
+}
+
+struct compiled_reader {
+	char *data;
+	size_t len;
+	size_t pos;
+};
+
+static bool get_u32(struct compiled_reader *reader, uint32_t *out)
+{
+	if (reader->len - reader->pos < 4)
+		return false;
+
+	*out = l_get_le32(reader->data + reader->pos);
+	reader->pos += 4;
+	return true;
+}
+
+static char *get_string(struct compiled_reader *reader, uint32_t len)
+{
+	char *str = reader->data + reader->pos;
+
+	if (reader->len - reader->pos <= len || str[len] != '\0')
+		return NULL;
+
+	reader->pos += len + 1;
+	return str;
+}
+
+static bool read_compiled(struct l_settings *settings,
+				struct compiled_reader *reader)
+{
+	uint32_t n_groups;
+	uint32_t n_embedded;
+	uint32_t i;
+	uint32_t j;
+
+	if (!get_u32(reader, &n_groups))
+		return false;
+
+	for (i = 0; i < n_groups; i++) {
+		struct group_data *group;
+		uint32_t name_len;
+		uint32_t n_keys;
+		char *name;
+
+		if (!get_u32(reader, &name_len) || !get_u32(reader, &n_keys))
+			return false;
+
+		name = get_string(reader, name_len);
+		if (!name)
+			return false;
+
+		group = group_new(settings, name);
+		group->name_borrowed = true;
+
+		for (j = 0; j < n_keys; j++) {
+			struct setting_data *pair;
+			uint32_t key_len;
+			uint32_t value_len;
+			char *key;
+			char *value;
+
+			if (!get_u32(reader, &key_len) ||
+					!get_u32(reader, &value_len))
+				return false;
+
+			key = get_string(reader, key_len);
+			value = key ? get_string(reader, value_len) : NULL;
+			if (!value)
+				return false;
+
+			pair = l_new(struct setting_data, 1);
+			pair->key = key;
+			pair->value = value;
+			pair->key_borrowed = true;
+			pair->value_borrowed = true;
+			group_add_setting(group, pair);
+		}
+	}
+
+	if (!get_u32(reader, &n_embedded))
+		return false;
+
+	for (i = 0; i < n_embedded; i++) {
+		struct embedded_group_data *group;
+		uint32_t type_len;
+		uint32_t name_len;
+		uint32_t data_len;
+		const char *type;
+		const char *name;
+		const char *data;
+
+		if (!get_u32(reader, &type_len) ||
+				!get_u32(reader, &name_len) ||
+				!get_u32(reader, &data_len))
+			return false;
+
+		if (type_len >= sizeof(group->type))
+			return false;
+
+		type = get_string(reader, type_len);
+		name = type ? get_string(reader, name_len) : NULL;
+		data = name ? get_string(reader, data_len) : NULL;
+		if (!data)
+			return false;
+
+		group = l_malloc(sizeof(struct embedded_group_data) +
+					data_len + 1);
+		group->name = l_strdup(name);
+		memcpy(group->type, type, type_len + 1);
+		group->len = data_len;
+		memcpy(group->data, data, data_len + 1);
+
+		l_queue_push_tail(settings->embedded_groups, group);
+	}
+
+	return reader->pos == reader->len;
+}
+
+/* Builds settings from the output of settings_compile, NULL if malformed */
+struct l_settings *settings_new_compiled(const void *data, size_t len)
+{
+	struct l_settings *settings = l_settings_new();
+	struct compiled_reader reader;
+	struct loaded_data *loaded;
+
+	loaded = l_malloc(sizeof(struct loaded_data) + len);
+	loaded->len = len;
+	memcpy(loaded->data, data, len);
+	l_queue_push_tail(settings->loaded, loaded);
+
+	reader.data = loaded->data;
+	reader.len = len;
+	reader.pos = 0;
+
+	if (!read_compiled(settings, &reader)) {
+		l_settings_free(settings);
+		return NULL;
+	}
+
+	return settings;
+}
+
 LIB_EXPORT bool l_settings_set_debug(struct l_settings *settings,
 					l_settings_debug_cb_t callback,
 					void *user_data,
@@ -764,14 +1245,6 @@ LIB_EXPORT bool l_settings_set_debug(struct l_settings *settings,
 	return true;
 }
 
-static bool group_match(const void *a, const void *b)
-{
-	const struct group_data *group = a;
-	const char *name = b;
-
-	return !strcmp(group->name, name);
-}
-
 struct gather_data {
 	int cur;
 	char **v;
@@ -810,19 +1283,11 @@ LIB_EXPORT bool l_settings_has_group(const struct l_settings *settings,
 	if (unlikely(!settings))
 		return false;
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = group_find(settings, group_name);
 
 	return !!group;
 }
 
-static bool key_match(const void *a, const void *b)
-{
-	const struct setting_data *setting = a;
-	const char *key = b;
-
-	return !strcmp(setting->key, key);
-}
-
 static void gather_keys(void *data, void *user_data)
 {
 	struct setting_data *setting_data = data;
@@ -841,7 +1306,7 @@ LIB_EXPORT char **l_settings_get_keys(const struct l_settings *settings,
 	if (unlikely(!settings))
 		return NULL;
 
-	group_data = l_queue_find(settings->groups, group_match, group_name);
+	group_data = group_find(settings, group_name);
 	if (!group_data)
 		return NULL;
 
@@ -863,11 +1328,11 @@ LIB_EXPORT bool l_settings_has_key(const struct l_settings *settings,
 	if (unlikely(!settings))
 		return false;
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = group_find(settings, group_name);
 	if (!group)
 		return false;
 
-	setting = l_queue_find(group->settings, key_match, key);
+	setting = group_find_setting(group, key);
 
 	return !!setting;
 }
@@ -882,11 +1347,11 @@ LIB_EXPORT const char *l_settings_get_value(const struct l_settings *settings,
 	if (unlikely(!settings))
 		return NULL;
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = group_find(settings, group_name);
 	if (!group)
 		return NULL;
 
-	setting = l_queue_find(group->settings, key_match, key);
+	setting = group_find_setting(group, key);
 	if (!setting)
 		return NULL;
 
@@ -922,17 +1387,14 @@ LIB_EXPORT bool l_settings_add_group(struct l_settings *settings,
 		return false;
 	}
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = group_find(settings, group_name);
 	if (group) {
 		l_util_debug(settings->debug_handler, settings->debug_data,
 				"Group %s exists", group_name);
 		return true;
 	}
 
-	group = l_new(struct group_data, 1);
-	group->name = l_strdup(group_name);
-	group->settings = l_queue_new();
-	l_queue_push_tail(settings->groups, group);
+	group_new(settings, l_strdup(group_name));
 	return true;
 }
 
@@ -951,6 +1413,7 @@ static bool validate_key(const char *key)
 static bool set_value(struct l_settings *settings, const char *group_name,
 			const char *key, char *value)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_SETTINGS);
 	struct group_data *group;
 	struct setting_data *pair;
 
@@ -966,30 +1429,26 @@ static bool set_value(struct l_settings *settings, const char *group_name,
 		goto error;
 	}
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = group_find(settings, group_name);
 	if (!group) {
-		group = l_new(struct group_data, 1);
-		group->name = l_strdup(group_name);
-		group->settings = l_queue_new();
-
-		l_queue_push_tail(settings->groups, group);
+		group = group_new(settings, l_strdup(group_name));
 		goto add_pair;
 	}
 
-	pair = l_queue_find(group->settings, key_match, key);
+	pair = group_find_setting(group, key);
 	if (!pair) {
 add_pair:
 		pair = l_new(struct setting_data, 1);
 		pair->key = l_strdup(key);
 		pair->value = value;
-		l_queue_push_tail(group->settings, pair);
+		group_add_setting(group, pair);
 
 		return true;
 	}
 
-	explicit_bzero(pair->value, strlen(pair->value));
-	l_free(pair->value);
+	setting_free_value(pair);
 	pair->value = value;
+	pair->value_borrowed = false;
 
 	return true;
 
@@ -1009,16 +1468,9 @@ LIB_EXPORT bool l_settings_set_value(struct l_settings *settings,
 	return set_value(settings, group_name, key, l_strdup(value));
 }
 
-LIB_EXPORT bool l_settings_get_bool(const struct l_settings *settings,
-					const char *group_name, const char *key,
-					bool *out)
+static bool value_to_bool(const struct l_settings *settings,
+				const char *value, bool *out)
 {
-	const char *value;
-
-	value = l_settings_get_value(settings, group_name, key);
-	if (!value)
-		return false;
-
 	if (!strcasecmp(value, "true") || !strcmp(value, "1")) {
 		if (out)
 			*out = true;
@@ -1039,6 +1491,19 @@ LIB_EXPORT bool l_settings_get_bool(const struct l_settings *settings,
 	return false;
 }
 
+LIB_EXPORT bool l_settings_get_bool(const struct l_settings *settings,
+					const char *group_name, const char *key,
+					bool *out)
+{
+	const char *value;
+
+	value = l_settings_get_value(settings, group_name, key);
+	if (!value)
+		return false;
+
+	return value_to_bool(settings, value, out);
+}
+
 LIB_EXPORT bool l_settings_set_bool(struct l_settings *settings,
 					const char *group_name, const char *key,
 					bool in)
@@ -1055,18 +1520,13 @@ LIB_EXPORT bool l_settings_set_bool(struct l_settings *settings,
 	return l_settings_set_value(settings, group_name, key, v);
 }
 
-LIB_EXPORT bool l_settings_get_int(const struct l_settings *settings,
-					const char *group_name,
-					const char *key, int *out)
+static bool value_to_int(const struct l_settings *settings,
+				const char *value, int *out)
 {
-	const char *value = l_settings_get_value(settings, group_name, key);
 	long int r;
 	int t;
 	char *endp;
 
-	if (!value)
-		return false;
-
 	if (*value == '\0')
 		goto error;
 
@@ -1091,6 +1551,18 @@ error:
 	return false;
 }
 
+LIB_EXPORT bool l_settings_get_int(const struct l_settings *settings,
+					const char *group_name,
+					const char *key, int *out)
+{
+	const char *value = l_settings_get_value(settings, group_name, key);
+
+	if (!value)
+		return false;
+
+	return value_to_int(settings, value, out);
+}
+
 LIB_EXPORT bool l_settings_set_int(struct l_settings *settings,
 					const char *group_name, const char *key,
 					int in)
@@ -1102,6 +1574,18 @@ LIB_EXPORT bool l_settings_set_int(struct l_settings *settings,
 	return l_settings_set_value(settings, group_name, key, buf);
 }
 
+static bool value_to_uint(const struct l_settings *settings,
+				const char *value, unsigned int *out)
+{
+	if (l_safe_atou32(value, out) < 0) {
+		l_util_debug(settings->debug_handler, settings->debug_data,
+				"Could not interpret %s as a uint", value);
+		return false;
+	}
+
+	return true;
+}
+
 LIB_EXPORT bool l_settings_get_uint(const struct l_settings *settings,
 					const char *group_name,
 					const char *key,
@@ -1112,16 +1596,7 @@ LIB_EXPORT bool l_settings_get_uint(const struct l_settings *settings,
 	if (!value)
 		return false;
 
-	if (l_safe_atou32(value, out) < 0)
-		goto error;
-
-	return true;
-
-error:
-	l_util_debug(settings->debug_handler, settings->debug_data,
-			"Could not interpret %s as a uint", value);
-
-	return false;
+	return value_to_uint(settings, value, out);
 }
 
 LIB_EXPORT bool l_settings_set_uint(struct l_settings *settings,
@@ -1135,17 +1610,12 @@ LIB_EXPORT bool l_settings_set_uint(struct l_settings *settings,
 	return l_settings_set_value(settings, group_name, key, buf);
 }
 
-LIB_EXPORT bool l_settings_get_int64(const struct l_settings *settings,
-					const char *group_name, const char *key,
-					int64_t *out)
+static bool value_to_int64(const struct l_settings *settings,
+				const char *value, int64_t *out)
 {
-	const char *value = l_settings_get_value(settings, group_name, key);
 	int64_t r;
 	char *endp;
 
-	if (!value)
-		return false;
-
 	if (*value == '\0')
 		goto error;
 
@@ -1170,6 +1640,18 @@ error:
 	return false;
 }
 
+LIB_EXPORT bool l_settings_get_int64(const struct l_settings *settings,
+					const char *group_name, const char *key,
+					int64_t *out)
+{
+	const char *value = l_settings_get_value(settings, group_name, key);
+
+	if (!value)
+		return false;
+
+	return value_to_int64(settings, value, out);
+}
+
 LIB_EXPORT bool l_settings_set_int64(struct l_settings *settings,
 					const char *group_name, const char *key,
 					int64_t in)
@@ -1181,18 +1663,12 @@ LIB_EXPORT bool l_settings_set_int64(struct l_settings *settings,
 	return l_settings_set_value(settings, group_name, key, buf);
 }
 
-LIB_EXPORT bool l_settings_get_uint64(const struct l_settings *settings,
-					const char *group_name,
-					const char *key,
-					uint64_t *out)
+static bool value_to_uint64(const struct l_settings *settings,
+				const char *value, uint64_t *out)
 {
-	const char *value = l_settings_get_value(settings, group_name, key);
 	uint64_t r;
 	char *endp;
 
-	if (!value)
-		return false;
-
 	/* Do not allow '+' or '-' or empty string */
 	if (!l_ascii_isdigit(*value))
 		goto error;
@@ -1218,6 +1694,19 @@ error:
 	return false;
 }
 
+LIB_EXPORT bool l_settings_get_uint64(const struct l_settings *settings,
+					const char *group_name,
+					const char *key,
+					uint64_t *out)
+{
+	const char *value = l_settings_get_value(settings, group_name, key);
+
+	if (!value)
+		return false;
+
+	return value_to_uint64(settings, value, out);
+}
+
 LIB_EXPORT bool l_settings_set_uint64(struct l_settings *settings,
 					const char *group_name, const char *key,
 					uint64_t in)
@@ -1240,6 +1729,28 @@ LIB_EXPORT char *l_settings_get_string(const struct l_settings *settings,
 	return unescape_value(value);
 }
 
+/*
+ * Same as l_settings_get_string, but the string is allocated from @arena so
+ * that it can be released together with the rest of the arena contents.
+ */
+LIB_EXPORT char *l_settings_get_string_arena(const struct l_settings *settings,
+					const char *group_name, const char *key,
+					struct l_arena *arena)
+{
+	const char *value = l_settings_get_value(settings, group_name, key);
+	char *ret;
+
+	if (!value || !arena)
+		return NULL;
+
+	ret = l_arena_alloc(arena, strlen(value) + 1);
+
+	if (!unescape_into(ret, value))
+		return NULL;
+
+	return ret;
+}
+
 LIB_EXPORT bool l_settings_set_string(struct l_settings *settings,
 					const char *group_name, const char *key,
 					const char *value)
@@ -1293,17 +1804,12 @@ LIB_EXPORT bool l_settings_set_string_list(struct l_settings *settings,
 	return set_value(settings, group_name, key, buf);
 }
 
-LIB_EXPORT bool l_settings_get_double(const struct l_settings *settings,
-					const char *group_name, const char *key,
-					double *out)
+static bool value_to_double(const struct l_settings *settings,
+				const char *value, double *out)
 {
-	const char *value = l_settings_get_value(settings, group_name, key);
 	char *endp;
 	double r;
 
-	if (!value)
-		return NULL;
-
 	if (*value == '\0')
 		goto error;
 
@@ -1328,6 +1834,18 @@ error:
 	return false;
 }
 
+LIB_EXPORT bool l_settings_get_double(const struct l_settings *settings,
+					const char *group_name, const char *key,
+					double *out)
+{
+	const char *value = l_settings_get_value(settings, group_name, key);
+
+	if (!value)
+		return false;
+
+	return value_to_double(settings, value, out);
+}
+
 LIB_EXPORT bool l_settings_set_double(struct l_settings *settings,
 					const char *group_name, const char *key,
 					double in)
@@ -1430,15 +1948,154 @@ LIB_EXPORT bool l_settings_remove_group(struct l_settings *settings,
 	if (unlikely(!settings))
 		return false;
 
-	group = l_queue_remove_if(settings->groups, group_match, group_name);
+	group = l_hashmap_remove(settings->group_index, group_name);
 	if (!group)
 		return false;
 
+	l_queue_remove(settings->groups, group);
+
 	group_destroy(group);
 
 	return true;
 }
 
+/* Schema entries of the same group are usually next to each other */
+struct schema_cursor {
+	const char *group_name;
+	struct group_data *group;
+};
+
+static const char *schema_lookup(const struct l_settings *settings,
+					struct schema_cursor *cursor,
+					const struct l_settings_schema *entry)
+{
+	struct setting_data *setting = NULL;
+
+	if (!cursor->group_name || (cursor->group_name != entry->group &&
+				strcmp(cursor->group_name, entry->group))) {
+		cursor->group_name = entry->group;
+		cursor->group = group_find(settings, entry->group);
+	}
+
+	if (cursor->group)
+		setting = group_find_setting(cursor->group, entry->key);
+
+	return setting ? setting->value : entry->default_value;
+}
+
+static bool schema_store(const struct l_settings *settings,
+				const struct l_settings_schema *entry,
+				const char *value, void *out,
+				struct l_arena *arena)
+{
+	void *field = (uint8_t *) out + entry->offset;
+	char *str;
+
+	switch (entry->type) {
+	case L_SETTINGS_TYPE_BOOL:
+		return value_to_bool(settings, value, field);
+	case L_SETTINGS_TYPE_INT:
+		return value_to_int(settings, value, field);
+	case L_SETTINGS_TYPE_UINT:
+		return value_to_uint(settings, value, field);
+	case L_SETTINGS_TYPE_INT64:
+		return value_to_int64(settings, value, field);
+	case L_SETTINGS_TYPE_UINT64:
+		return value_to_uint64(settings, value, field);
+	case L_SETTINGS_TYPE_DOUBLE:
+		return value_to_double(settings, value, field);
+	case L_SETTINGS_TYPE_STRING:
+		if (arena) {
+			str = l_arena_alloc(arena, strlen(value) + 1);
+
+			if (!unescape_into(str, value))
+				return false;
+		} else {
+			str = unescape_value(value);
+
+			if (!str)
+				return false;
+		}
+
+		*(char **) field = str;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * l_settings_load_schema:
+ * @settings: settings object
+ * @schema: array of entries describing where each key is stored
+ * @n_entries: number of entries in @schema
+ * @out: structure the entries' offsets refer to
+ * @arena: arena to allocate strings from, or #NULL
+ *
+ * Convert every key described by @schema and store it at the entry's
+ * offset in @out, in a single call instead of one getter call per key.
+ * Keys missing from @settings take the entry's default value, which is
+ * parsed as if it had been read from a file, and leave their field
+ * untouched if that is #NULL.  Strings are allocated from @arena when
+ * given, otherwise they are owned by the caller and must be freed with
+ * l_free().  Keeping the entries of each group together makes for fewer
+ * lookups.
+ *
+ * Returns: #true if all the values could be converted.  On failure the
+ * strings already allocated outside of @arena are freed and their fields
+ * set to #NULL, other fields may have been written to.
+ **/
+LIB_EXPORT bool l_settings_load_schema(const struct l_settings *settings,
+					const struct l_settings_schema *schema,
+					size_t n_entries, void *out,
+					struct l_arena *arena)
+{
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_SETTINGS);
+	struct schema_cursor cursor = {};
+	size_t i;
+
+	if (unlikely(!settings || (!schema && n_entries) || !out))
+		return false;
+
+	for (i = 0; i < n_entries; i++) {
+		const char *value;
+
+		value = schema_lookup(settings, &cursor, &schema[i]);
+		if (!value)
+			continue;
+
+		if (!schema_store(settings, &schema[i], value, out, arena))
+			goto error;
+	}
+
+	return true;
+
+error:
+	l_util_debug(settings->debug_handler, settings->debug_data,
+			"Could not load %s.%s", schema[i].group, schema[i].key);
+
+	if (arena)
+		return false;
+
+	memset(&cursor, 0, sizeof(cursor));
+
+	while (i--) {
+		char **field;
+
+		if (schema[i].type != L_SETTINGS_TYPE_STRING)
+			continue;
+
+		if (!schema_lookup(settings, &cursor, &schema[i]))
+			continue;
+
+		field = (char **) ((uint8_t *) out + schema[i].offset);
+		l_free(*field);
+		*field = NULL;
+	}
+
+	return false;
+}
+
 LIB_EXPORT bool l_settings_remove_key(struct l_settings *settings,
 					const char *group_name,
 					const char *key)
@@ -1449,14 +2106,16 @@ LIB_EXPORT bool l_settings_remove_key(struct l_settings *settings,
 	if (unlikely(!settings))
 		return false;
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = group_find(settings, group_name);
 	if (!group)
 		return false;
 
-	setting = l_queue_remove_if(group->settings, key_match, key);
+	setting = l_hashmap_remove(group->index, key);
 	if (!setting)
 		return false;
 
+	l_queue_remove(group->settings, setting);
+
 	setting_destroy(setting);
 
 	return true;
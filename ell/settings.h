@@ -17,10 +17,41 @@ extern "C" {
 #endif
 
 struct l_settings;
+struct l_arena;
 
 typedef void (*l_settings_debug_cb_t) (const char *str, void *user_data);
 typedef void (*l_settings_destroy_cb_t) (void *user_data);
 
+enum l_settings_change {
+	L_SETTINGS_GROUP_ADDED,
+	L_SETTINGS_GROUP_REMOVED,
+	L_SETTINGS_KEY_ADDED,
+	L_SETTINGS_KEY_REMOVED,
+	L_SETTINGS_KEY_CHANGED,
+};
+
+enum l_settings_type {
+	L_SETTINGS_TYPE_BOOL,
+	L_SETTINGS_TYPE_INT,
+	L_SETTINGS_TYPE_UINT,
+	L_SETTINGS_TYPE_INT64,
+	L_SETTINGS_TYPE_UINT64,
+	L_SETTINGS_TYPE_DOUBLE,
+	L_SETTINGS_TYPE_STRING,
+};
+
+struct l_settings_schema {
+	const char *group;
+	const char *key;
+	enum l_settings_type type;
+	size_t offset;
+	const char *default_value;
+};
+
+typedef void (*l_settings_change_cb_t) (enum l_settings_change change,
+					const char *group_name,
+					const char *key, void *user_data);
+
 struct l_settings *l_settings_new(void);
 struct l_settings *l_settings_clone(const struct l_settings *settings);
 
@@ -33,6 +64,9 @@ char *l_settings_to_data(const struct l_settings *settings, size_t *len);
 
 bool l_settings_load_from_file(struct l_settings *settings,
 					const char *filename);
+bool l_settings_reload(struct l_settings *settings, const char *filename,
+				l_settings_change_cb_t callback,
+				void *user_data);
 
 bool l_settings_set_debug(struct l_settings *settings,
 				l_settings_debug_cb_t callback,
@@ -87,6 +121,9 @@ bool l_settings_set_uint64(struct l_settings *settings, const char *group_name,
 
 char *l_settings_get_string(const struct l_settings *settings,
 				const char *group_name, const char *key);
+char *l_settings_get_string_arena(const struct l_settings *settings,
+					const char *group_name, const char *key,
+					struct l_arena *arena);
 bool l_settings_set_string(struct l_settings *settings, const char *group_name,
 				const char *key, const char *value);
 
@@ -117,6 +154,11 @@ bool l_settings_set_bytes(struct l_settings *settings, const char *group_name,
 				const char *key,
 				const uint8_t *value, size_t value_len);
 
+bool l_settings_load_schema(const struct l_settings *settings,
+				const struct l_settings_schema *schema,
+				size_t n_entries, void *out,
+				struct l_arena *arena);
+
 bool l_settings_remove_key(struct l_settings *settings, const char *group_name,
 				const char *key);
 bool l_settings_remove_group(struct l_settings *settings,
@@ -129,6 +171,17 @@ bool l_settings_has_embedded_group(struct l_settings *settings,
 const char *l_settings_get_embedded_value(struct l_settings *settings,
 						const char *group_name,
 						const char **out_type);
+
+struct l_settings_cache;
+
+struct l_settings_cache *l_settings_cache_new(const char *path);
+void l_settings_cache_free(struct l_settings_cache *cache);
+DEFINE_CLEANUP_FUNC(l_settings_cache_free);
+
+struct l_settings *l_settings_cache_load(struct l_settings_cache *cache,
+						const char *filename);
+int l_settings_cache_write(struct l_settings_cache *cache);
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,10 +16,14 @@
 #include <signal.h>
 #include <sys/epoll.h>
 #include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 
+#include "useful.h"
 #include "util.h"
 #include "io.h"
 #include "queue.h"
+#include "idle.h"
 #include "signal.h"
 #include "private.h"
 
@@ -47,9 +51,16 @@ struct signal_desc {
 	struct l_queue *callbacks;
 };
 
-static struct l_io *signalfd_io = NULL;
-static struct l_queue *signal_list = NULL;
-static sigset_t signal_mask;
+/*
+ * Signals are handled by the main loop of the thread that registered them,
+ * the signalfd only reports signals blocked by that thread.
+ */
+static __thread struct l_io *signalfd_io = NULL;
+static __thread struct signal_desc *signal_table[_NSIG];
+static __thread sigset_t signal_mask;
+
+/* Enough for a burst of different signals in one read() */
+#define SIGNALFD_BATCH	16
 
 static void handle_callback(struct signal_desc *desc)
 {
@@ -64,29 +75,36 @@ static void handle_callback(struct signal_desc *desc)
 	}
 }
 
-static bool desc_match_signo(const void *a, const void *b)
-{
-	const struct signal_desc *desc = a;
-	uint32_t signo = L_PTR_TO_UINT(b);
-
-	return (desc->signo == signo);
-}
-
 static bool signalfd_read_cb(struct l_io *io, void *user_data)
 {
 	int fd = l_io_get_fd(io);
-	struct signal_desc *desc;
-	struct signalfd_siginfo si;
+	struct signalfd_siginfo si[SIGNALFD_BATCH];
+	sigset_t seen;
 	ssize_t result;
+	unsigned int i;
 
-	result = read(fd, &si, sizeof(si));
-	if (result != sizeof(si))
+	result = read(fd, si, sizeof(si));
+	if (result < (ssize_t) sizeof(si[0]))
 		return true;
 
-	desc = l_queue_find(signal_list, desc_match_signo,
-						L_UINT_TO_PTR(si.ssi_signo));
-	if (desc)
-		handle_callback(desc);
+	/*
+	 * Callbacks get no siginfo, so each signal is dispatched once per
+	 * batch no matter how many times it was queued, in order of arrival.
+	 */
+	sigemptyset(&seen);
+
+	for (i = 0; i < result / sizeof(si[0]); i++) {
+		uint32_t signo = si[i].ssi_signo;
+
+		if (signo >= _NSIG || sigismember(&seen, signo))
+			continue;
+
+		sigaddset(&seen, signo);
+
+		/* Looked up each time, a callback may remove another signal */
+		if (signal_table[signo])
+			handle_callback(signal_table[signo]);
+	}
 
 	return true;
 }
@@ -120,11 +138,10 @@ static bool signalfd_add(int signo)
 
 	if (!l_io_set_read_handler(signalfd_io, signalfd_read_cb, NULL, NULL)) {
 		l_io_destroy(signalfd_io);
+		signalfd_io = NULL;
 		return false;
 	}
 
-	signal_list = l_queue_new();
-
 	return true;
 }
 
@@ -142,9 +159,6 @@ static void signalfd_remove(int signo)
 
 	l_io_destroy(signalfd_io);
 	signalfd_io = NULL;
-
-	l_queue_destroy(signal_list, NULL);
-	signal_list = NULL;
 }
 
 /**
@@ -173,8 +187,7 @@ LIB_EXPORT struct l_signal *l_signal_create(uint32_t signo,
 	signal->destroy = destroy;
 	signal->user_data = user_data;
 
-	desc = l_queue_find(signal_list, desc_match_signo,
-						L_UINT_TO_PTR(signo));
+	desc = signal_table[signo];
 	if (desc)
 		goto done;
 
@@ -196,7 +209,7 @@ LIB_EXPORT struct l_signal *l_signal_create(uint32_t signo,
 	desc->signo = signo;
 	desc->callbacks = l_queue_new();
 
-	l_queue_push_tail(signal_list, desc);
+	signal_table[signo] = desc;
 
 done:
 	l_queue_push_tail(desc->callbacks, signal);
@@ -228,9 +241,11 @@ LIB_EXPORT void l_signal_remove(struct l_signal *signal)
 	if (!l_queue_isempty(desc->callbacks))
 		goto done;
 
-	if (!l_queue_remove(signal_list, desc))
+	if (signal_table[desc->signo] != desc)
 		goto done;
 
+	signal_table[desc->signo] = NULL;
+
 	sigemptyset(&mask);
 	sigaddset(&mask, desc->signo);
 
@@ -251,3 +266,147 @@ done:
 
 	l_free(signal);
 }
+
+/**
+ * l_pidfd_watch:
+ *
+ * Opaque object watching a child process for its exit.
+ */
+struct l_pidfd_watch {
+	struct l_io *io;
+	struct l_idle *exit_work;
+	pid_t pid;
+	int status;
+	l_pidfd_watch_cb_t callback;
+	void *user_data;
+	l_pidfd_watch_destroy_cb_t destroy;
+};
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+static void pidfd_exit(struct l_idle *idle, void *user_data)
+{
+	struct l_pidfd_watch *watch = user_data;
+
+	l_idle_remove(l_steal_ptr(watch->exit_work));
+
+	if (watch->callback)
+		watch->callback(watch->pid, watch->status, watch->user_data);
+}
+
+static bool pidfd_read_cb(struct l_io *io, void *user_data)
+{
+	struct l_pidfd_watch *watch = user_data;
+	siginfo_t info;
+	int status = -1;
+
+	memset(&info, 0, sizeof(info));
+
+	/* Reaps the child, unlike waitpid() this can't race with pid reuse */
+	if (L_TFR(waitid(P_PIDFD, l_io_get_fd(io), &info,
+					WEXITED | WNOHANG)) < 0) {
+		if (errno != ECHILD)
+			return true;
+	} else if (!info.si_pid) {
+		/* Spurious wakeup, still running */
+		return true;
+	} else if (info.si_code == CLD_EXITED) {
+		status = (info.si_status & 0xff) << 8;
+	} else {
+		status = info.si_status & 0x7f;
+
+		if (info.si_code == CLD_DUMPED)
+			status |= 0x80;
+	}
+
+	/*
+	 * Report from an idle callback so that the watch can be destroyed
+	 * from @callback, the l_io is still in use here.
+	 */
+	watch->status = status;
+	watch->exit_work = l_idle_create(pidfd_exit, watch, NULL);
+
+	return false;
+}
+
+/**
+ * l_pidfd_watch_new:
+ * @pid: process id of a child process
+ * @callback: called once the child has exited
+ * @user_data: user data passed to @callback
+ * @destroy: called to free @user_data when the watch is destroyed
+ *
+ * Watches the child process @pid through a pidfd, so that supervising
+ * processes does not need SIGCHLD.  Once @pid exits it is reaped and
+ * @callback is called with its status, as returned by waitpid(), or -1
+ * if @pid isn't a child of this process and its status is unknown.  The
+ * watch should then be destroyed.
+ *
+ * Returns: a newly allocated #l_pidfd_watch object, or NULL if @pid does
+ * not exist or pidfds are not supported
+ **/
+LIB_EXPORT struct l_pidfd_watch *l_pidfd_watch_new(pid_t pid,
+					l_pidfd_watch_cb_t callback,
+					void *user_data,
+					l_pidfd_watch_destroy_cb_t destroy)
+{
+	struct l_pidfd_watch *watch;
+	int fd;
+
+	if (unlikely(pid <= 0))
+		return NULL;
+
+#ifdef __NR_pidfd_open
+	fd = syscall(__NR_pidfd_open, pid, 0);
+#else
+	fd = -1;
+#endif
+	if (fd < 0)
+		return NULL;
+
+	watch = l_new(struct l_pidfd_watch, 1);
+	watch->pid = pid;
+	watch->callback = callback;
+	watch->user_data = user_data;
+	watch->destroy = destroy;
+
+	watch->io = l_io_new(fd);
+	if (!watch->io) {
+		close(fd);
+		l_free(watch);
+		return NULL;
+	}
+
+	l_io_set_close_on_destroy(watch->io, true);
+
+	if (!l_io_set_read_handler(watch->io, pidfd_read_cb, watch, NULL)) {
+		l_io_destroy(watch->io);
+		l_free(watch);
+		return NULL;
+	}
+
+	return watch;
+}
+
+/**
+ * l_pidfd_watch_destroy:
+ * @watch: pidfd watch object
+ *
+ * Stops watching the process.  If it has not exited yet it is left
+ * running and will have to be reaped by other means.
+ **/
+LIB_EXPORT void l_pidfd_watch_destroy(struct l_pidfd_watch *watch)
+{
+	if (!watch)
+		return;
+
+	l_idle_remove(watch->exit_work);
+	l_io_destroy(watch->io);
+
+	if (watch->destroy)
+		watch->destroy(watch->user_data);
+
+	l_free(watch);
+}
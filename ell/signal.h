@@ -9,6 +9,7 @@
 #define __ELL_SIGNAL_H
 
 #include <stdint.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,6 +24,17 @@ struct l_signal *l_signal_create(uint32_t signo, l_signal_notify_cb_t callback,
 				void *user_data, l_signal_destroy_cb_t destroy);
 void l_signal_remove(struct l_signal *signal);
 
+struct l_pidfd_watch;
+
+typedef void (*l_pidfd_watch_cb_t) (pid_t pid, int status, void *user_data);
+typedef void (*l_pidfd_watch_destroy_cb_t) (void *user_data);
+
+struct l_pidfd_watch *l_pidfd_watch_new(pid_t pid,
+					l_pidfd_watch_cb_t callback,
+					void *user_data,
+					l_pidfd_watch_destroy_cb_t destroy);
+void l_pidfd_watch_destroy(struct l_pidfd_watch *watch);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,435 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+
+#include "skiplist.h"
+#include "random.h"
+#include "private.h"
+#include "useful.h"
+
+/**
+ * SECTION:skiplist
+ * @short_description: Ordered map support
+ *
+ * Ordered map support
+ */
+
+/*
+ * Each level links every fourth node of the level below on average, 16
+ * levels keep lookups logarithmic up to about 4^16 nodes.
+ */
+#define SKIPLIST_MAX_LEVEL 16
+
+struct l_skiplist_node {
+	const void *key;
+	void *value;
+	unsigned int level;
+	struct l_skiplist_node *next[];
+};
+
+/**
+ * l_skiplist:
+ *
+ * Opaque object representing the ordered map.
+ */
+struct l_skiplist {
+	l_skiplist_compare_func_t compare;
+	unsigned int level;
+	unsigned int entries;
+	uint32_t seed;
+	struct l_skiplist_node *head[SKIPLIST_MAX_LEVEL];
+};
+
+static unsigned int skiplist_random_level(struct l_skiplist *list)
+{
+	uint32_t x = list->seed;
+	unsigned int level = 1;
+
+	/* xorshift32, only needs to be well spread, not unpredictable */
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	list->seed = x;
+
+	while ((x & 3) == 0 && level < SKIPLIST_MAX_LEVEL) {
+		level += 1;
+		x >>= 2;
+	}
+
+	return level;
+}
+
+/*
+ * Returns the first node with a key not less than @key.  If @prev is not
+ * NULL it is filled, for every level in use, with the link pointing past
+ * the last node with a smaller key.
+ */
+static struct l_skiplist_node *skiplist_search(struct l_skiplist *list,
+					const void *key,
+					struct l_skiplist_node ***prev)
+{
+	struct l_skiplist_node **next = list->head;
+	int level;
+
+	for (level = list->level - 1; level >= 0; level--) {
+		while (next[level] &&
+				list->compare(next[level]->key, key) < 0)
+			next = next[level]->next;
+
+		if (prev)
+			prev[level] = &next[level];
+	}
+
+	return next[0];
+}
+
+/**
+ * l_skiplist_new:
+ * @compare: function ordering the keys, returning a negative value, 0 or
+ *           a positive value if the first key is smaller than, equal to or
+ *           greater than the second
+ *
+ * Create a new map that keeps its entries ordered by key.  Inserting,
+ * removing and looking up entries, including the first entry at or after
+ * a given key, take O(log n) on average, unlike l_queue_insert() which is
+ * O(n).  The keys are not copied and must stay valid while in the map.
+ *
+ * Returns: a newly allocated #l_skiplist object
+ **/
+LIB_EXPORT struct l_skiplist *l_skiplist_new(l_skiplist_compare_func_t compare)
+{
+	struct l_skiplist *list;
+
+	if (unlikely(!compare))
+		return NULL;
+
+	list = l_new(struct l_skiplist, 1);
+	list->compare = compare;
+	list->level = 1;
+	list->seed = l_getrandom_uint32() | 1;
+
+	return list;
+}
+
+/**
+ * l_skiplist_destroy:
+ * @list: skip list object
+ * @destroy: destroy function for the values
+ *
+ * Free @list, calling @destroy, if given, on the values of its entries.
+ **/
+LIB_EXPORT void l_skiplist_destroy(struct l_skiplist *list,
+					l_skiplist_destroy_func_t destroy)
+{
+	struct l_skiplist_node *node;
+	struct l_skiplist_node *next;
+
+	if (unlikely(!list))
+		return;
+
+	for (node = list->head[0]; node; node = next) {
+		next = node->next[0];
+
+		if (destroy)
+			destroy(node->value);
+
+		l_free(node);
+	}
+
+	l_free(list);
+}
+
+/**
+ * l_skiplist_insert:
+ * @list: skip list object
+ * @key: key of the entry
+ * @value: value of the entry
+ *
+ * Returns: #true if the entry was inserted, #false if @list already has an
+ *          entry for @key
+ **/
+LIB_EXPORT bool l_skiplist_insert(struct l_skiplist *list, const void *key,
+							void *value)
+{
+	struct l_skiplist_node **prev[SKIPLIST_MAX_LEVEL];
+	struct l_skiplist_node *node;
+	unsigned int level;
+	unsigned int i;
+
+	if (unlikely(!list))
+		return false;
+
+	node = skiplist_search(list, key, prev);
+	if (node && !list->compare(node->key, key))
+		return false;
+
+	level = skiplist_random_level(list);
+
+	for (; list->level < level; list->level++)
+		prev[list->level] = &list->head[list->level];
+
+	node = l_malloc(sizeof(struct l_skiplist_node) +
+				level * sizeof(struct l_skiplist_node *));
+	node->key = key;
+	node->value = value;
+	node->level = level;
+
+	for (i = 0; i < level; i++) {
+		node->next[i] = *prev[i];
+		*prev[i] = node;
+	}
+
+	list->entries += 1;
+
+	return true;
+}
+
+/**
+ * l_skiplist_remove:
+ * @list: skip list object
+ * @key: key of the entry
+ *
+ * Returns: the value of the removed entry, or #NULL if there was none
+ **/
+LIB_EXPORT void *l_skiplist_remove(struct l_skiplist *list, const void *key)
+{
+	struct l_skiplist_node **prev[SKIPLIST_MAX_LEVEL];
+	struct l_skiplist_node *node;
+	void *value;
+	unsigned int i;
+
+	if (unlikely(!list))
+		return NULL;
+
+	node = skiplist_search(list, key, prev);
+	if (!node || list->compare(node->key, key))
+		return NULL;
+
+	for (i = 0; i < node->level; i++)
+		*prev[i] = node->next[i];
+
+	while (list->level > 1 && !list->head[list->level - 1])
+		list->level -= 1;
+
+	value = node->value;
+	l_free(node);
+	list->entries -= 1;
+
+	return value;
+}
+
+/**
+ * l_skiplist_lookup:
+ * @list: skip list object
+ * @key: key of the entry
+ *
+ * Returns: the value of the entry for @key, or #NULL if there is none
+ **/
+LIB_EXPORT void *l_skiplist_lookup(struct l_skiplist *list, const void *key)
+{
+	struct l_skiplist_node *node;
+
+	if (unlikely(!list))
+		return NULL;
+
+	node = skiplist_search(list, key, NULL);
+	if (!node || list->compare(node->key, key))
+		return NULL;
+
+	return node->value;
+}
+
+/**
+ * l_skiplist_lower_bound:
+ * @list: skip list object
+ * @key: key to look for
+ * @found_key: set to the key of the entry found, if not #NULL
+ *
+ * Find the first entry whose key is not less than @key.
+ *
+ * Returns: the value of that entry, or #NULL if there is none
+ **/
+LIB_EXPORT void *l_skiplist_lower_bound(struct l_skiplist *list,
+					const void *key,
+					const void **found_key)
+{
+	struct l_skiplist_node *node;
+
+	if (unlikely(!list))
+		return NULL;
+
+	node = skiplist_search(list, key, NULL);
+	if (!node)
+		return NULL;
+
+	if (found_key)
+		*found_key = node->key;
+
+	return node->value;
+}
+
+/**
+ * l_skiplist_first:
+ * @list: skip list object
+ * @key: set to the smallest key, if not #NULL
+ *
+ * Returns: the value of the entry with the smallest key, or #NULL if @list
+ *          is empty
+ **/
+LIB_EXPORT void *l_skiplist_first(struct l_skiplist *list, const void **key)
+{
+	struct l_skiplist_node *node;
+
+	if (unlikely(!list) || !list->head[0])
+		return NULL;
+
+	node = list->head[0];
+
+	if (key)
+		*key = node->key;
+
+	return node->value;
+}
+
+/**
+ * l_skiplist_foreach:
+ * @list: skip list object
+ * @function: callback function
+ * @user_data: user data given to @function
+ *
+ * Call @function for every entry of @list, in key order.  @function must
+ * not add or remove entries.
+ **/
+LIB_EXPORT void l_skiplist_foreach(struct l_skiplist *list,
+					l_skiplist_foreach_func_t function,
+					void *user_data)
+{
+	struct l_skiplist_node *node;
+
+	if (unlikely(!list || !function))
+		return;
+
+	for (node = list->head[0]; node; node = node->next[0])
+		function(node->key, node->value, user_data);
+}
+
+/**
+ * l_skiplist_foreach_range:
+ * @list: skip list object
+ * @from: smallest key to visit, #NULL to start with the first entry
+ * @to: key to stop at, which is not visited, #NULL to visit up to the end
+ * @function: callback function
+ * @user_data: user data given to @function
+ *
+ * Call @function, in key order, for the entries of @list with keys in the
+ * range [@from, @to).  @function must not add or remove entries.
+ **/
+LIB_EXPORT void l_skiplist_foreach_range(struct l_skiplist *list,
+					const void *from, const void *to,
+					l_skiplist_foreach_func_t function,
+					void *user_data)
+{
+	struct l_skiplist_node *node;
+
+	if (unlikely(!list || !function))
+		return;
+
+	node = from ? skiplist_search(list, from, NULL) : list->head[0];
+
+	for (; node; node = node->next[0]) {
+		if (to && list->compare(node->key, to) >= 0)
+			break;
+
+		function(node->key, node->value, user_data);
+	}
+}
+
+/**
+ * l_skiplist_iter_init:
+ * @iter: iterator
+ * @list: skip list object
+ * @from: key to start at, #NULL to start with the first entry
+ *
+ * Set up @iter to go through the entries of @list in key order, starting
+ * with the first one whose key is not less than @from.  The iterator
+ * stays valid as long as the entry it is about to return is not removed.
+ **/
+LIB_EXPORT void l_skiplist_iter_init(struct l_skiplist_iter *iter,
+					struct l_skiplist *list,
+					const void *from)
+{
+	if (unlikely(!iter))
+		return;
+
+	if (unlikely(!list)) {
+		iter->node = NULL;
+		return;
+	}
+
+	iter->node = from ? skiplist_search(list, from, NULL) : list->head[0];
+}
+
+/**
+ * l_skiplist_iter_next:
+ * @iter: iterator
+ * @key: set to the key of the next entry, if not #NULL
+ * @value: set to the value of the next entry, if not #NULL
+ *
+ * Returns: #false once there are no more entries
+ **/
+LIB_EXPORT bool l_skiplist_iter_next(struct l_skiplist_iter *iter,
+					const void **key, void **value)
+{
+	struct l_skiplist_node *node;
+
+	if (unlikely(!iter) || !iter->node)
+		return false;
+
+	node = iter->node;
+	iter->node = node->next[0];
+
+	if (key)
+		*key = node->key;
+
+	if (value)
+		*value = node->value;
+
+	return true;
+}
+
+/**
+ * l_skiplist_size:
+ * @list: skip list object
+ *
+ * Returns: the number of entries in @list
+ **/
+LIB_EXPORT unsigned int l_skiplist_size(struct l_skiplist *list)
+{
+	if (unlikely(!list))
+		return 0;
+
+	return list->entries;
+}
+
+/**
+ * l_skiplist_isempty:
+ * @list: skip list object
+ *
+ * Returns: #true if @list has no entries
+ **/
+LIB_EXPORT bool l_skiplist_isempty(struct l_skiplist *list)
+{
+	if (unlikely(!list))
+		return true;
+
+	return list->entries == 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef __ELL_SKIPLIST_H
+#define __ELL_SKIPLIST_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int (*l_skiplist_compare_func_t) (const void *a, const void *b);
+typedef void (*l_skiplist_foreach_func_t) (const void *key, void *value,
+							void *user_data);
+typedef void (*l_skiplist_destroy_func_t) (void *value);
+
+struct l_skiplist;
+struct l_skiplist_node;
+
+struct l_skiplist_iter {
+	struct l_skiplist_node *node;
+};
+
+struct l_skiplist *l_skiplist_new(l_skiplist_compare_func_t compare);
+void l_skiplist_destroy(struct l_skiplist *list,
+				l_skiplist_destroy_func_t destroy);
+
+bool l_skiplist_insert(struct l_skiplist *list, const void *key, void *value);
+void *l_skiplist_remove(struct l_skiplist *list, const void *key);
+void *l_skiplist_lookup(struct l_skiplist *list, const void *key);
+void *l_skiplist_lower_bound(struct l_skiplist *list, const void *key,
+				const void **found_key);
+void *l_skiplist_first(struct l_skiplist *list, const void **key);
+
+void l_skiplist_foreach(struct l_skiplist *list,
+			l_skiplist_foreach_func_t function, void *user_data);
+void l_skiplist_foreach_range(struct l_skiplist *list,
+				const void *from, const void *to,
+				l_skiplist_foreach_func_t function,
+				void *user_data);
+
+void l_skiplist_iter_init(struct l_skiplist_iter *iter,
+				struct l_skiplist *list, const void *from);
+bool l_skiplist_iter_next(struct l_skiplist_iter *iter, const void **key,
+				void **value);
+
+unsigned int l_skiplist_size(struct l_skiplist *list);
+bool l_skiplist_isempty(struct l_skiplist *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ELL_SKIPLIST_H */
@@ -10,6 +10,7 @@
 #endif
 
 #include <stdio.h>
+#include <sys/uio.h>
 
 #include "strv.h"
 #include "string.h"
@@ -23,6 +24,17 @@
  * Growable string buffer support
  */
 
+/*
+ * A chunked string, see l_string_new_chunked(), only appends to the last
+ * buffer, @str.  Once that is full it is moved to @chunks as is and a new
+ * one is started, so earlier contents are never copied.
+ */
+struct string_chunk {
+	char *data;
+	size_t len;
+	size_t max;
+};
+
 /**
  * l_string:
  *
@@ -32,19 +44,56 @@ struct l_string {
 	size_t max;
 	size_t len;
 	char *str;
+	size_t chunk_size;
+	struct string_chunk *chunks;
+	unsigned int n_chunks;
+	size_t chunks_len;
+	struct iovec *iov;
 };
 
+static void seal_chunk(struct l_string *str)
+{
+	/* Array sized in powers of two */
+	if (!(str->n_chunks & (str->n_chunks - 1)))
+		str->chunks = l_realloc(str->chunks,
+				sizeof(struct string_chunk) *
+				maxsize(str->n_chunks * 2, 1));
+
+	str->chunks[str->n_chunks].data = str->str;
+	str->chunks[str->n_chunks].len = str->len;
+	str->chunks[str->n_chunks].max = str->max;
+	str->n_chunks++;
+	str->chunks_len += str->len;
+
+	str->str = NULL;
+	str->len = 0;
+	str->max = 0;
+}
+
 static void grow_string(struct l_string *str, size_t extra)
 {
+	size_t pagesize;
+
 	if (str->len + extra < str->max)
 		return;
 
-	str->max = str->len + extra + 1;
+	if (str->chunk_size) {
+		if (str->len)
+			seal_chunk(str);
+
+		str->max = maxsize(str->chunk_size, extra + 1);
+		str->str = l_realloc(str->str, str->max);
+		return;
+	}
+
+	/* Grow by at least half, copying is amortized over the appends */
+	str->max = maxsize(str->len + extra + 1, str->max + str->max / 2);
+	pagesize = l_util_pagesize();
 
-	if (str->max < l_util_pagesize())
+	if (str->max < pagesize)
 		str->max = roundup_pow_of_two(str->max);
 	else
-		str->max = align_len(str->max, l_util_pagesize());
+		str->max = align_len(str->max, pagesize);
 
 	str->str = l_realloc(str->str, str->max);
 }
@@ -74,6 +123,34 @@ LIB_EXPORT struct l_string *l_string_new(size_t initial_length)
 	return ret;
 }
 
+/**
+ * l_string_new_chunked:
+ * @chunk_size: Size of the buffers making up the string
+ *
+ * Create a new growable string that is kept in buffers of at least
+ * @chunk_size bytes instead of a single one.  Growing it never moves the
+ * existing contents, which suits large outputs that are written out with
+ * writev() through l_string_get_iovec().  l_string_unwrap() joins the
+ * buffers into one.  If @chunk_size is 0, the page size is used.
+ *
+ * Returns: a newly allocated #l_string object.
+ **/
+LIB_EXPORT struct l_string *l_string_new_chunked(size_t chunk_size)
+{
+	struct l_string *ret;
+
+	ret = l_new(struct l_string, 1);
+
+	if (chunk_size == 0)
+		chunk_size = l_util_pagesize();
+
+	ret->chunk_size = chunk_size;
+	grow_string(ret, chunk_size - 1);
+	ret->str[0] = '\0';
+
+	return ret;
+}
+
 /**
  * l_string_free:
  * @string: growable string object
@@ -85,6 +162,11 @@ LIB_EXPORT void l_string_free(struct l_string *string)
 	if (unlikely(!string))
 		return;
 
+	while (string->n_chunks)
+		l_free(string->chunks[--string->n_chunks].data);
+
+	l_free(string->chunks);
+	l_free(string->iov);
 	l_free(string->str);
 	l_free(string);
 }
@@ -106,9 +188,28 @@ LIB_EXPORT char *l_string_unwrap(struct l_string *string)
 	if (unlikely(!string))
 		return NULL;
 
+	if (string->n_chunks) {
+		size_t pos = 0;
+		unsigned int i;
+
+		result = l_malloc(string->chunks_len + string->len + 1);
+
+		for (i = 0; i < string->n_chunks; i++) {
+			memcpy(result + pos, string->chunks[i].data,
+				string->chunks[i].len);
+			pos += string->chunks[i].len;
+		}
+
+		memcpy(result + pos, string->str, string->len);
+		result[pos + string->len] = '\0';
+		l_free(string->str);
+		string->str = result;
+	}
+
 	result = string->str;
+	string->str = NULL;
 
-	l_free(string);
+	l_string_free(string);
 
 	return result;
 }
@@ -272,7 +373,7 @@ LIB_EXPORT unsigned int l_string_length(struct l_string *string)
 	if (unlikely(!string))
 		return 0;
 
-	return string->len;
+	return string->chunks_len + string->len;
 }
 
 LIB_EXPORT struct l_string *l_string_truncate(struct l_string *string,
@@ -281,15 +382,85 @@ LIB_EXPORT struct l_string *l_string_truncate(struct l_string *string,
 	if (unlikely(!string))
 		return NULL;
 
-	if (new_size >= string->len)
+	if (new_size >= string->chunks_len + string->len)
 		return string;
 
-	string->len = new_size;
-	string->str[new_size] = '\0';
+	/* The buffer holding the new end becomes the last one again */
+	while (new_size < string->chunks_len) {
+		struct string_chunk *chunk =
+				&string->chunks[--string->n_chunks];
+
+		l_free(string->str);
+		string->str = chunk->data;
+		string->len = chunk->len;
+		string->max = chunk->max;
+		string->chunks_len -= chunk->len;
+	}
+
+	string->len = new_size - string->chunks_len;
+	string->str[string->len] = '\0';
+
+	return string;
+}
+
+/**
+ * l_string_reserve:
+ * @string: growable string object
+ * @extra: Number of bytes about to be appended
+ *
+ * Makes room for appending at least @extra bytes to @string without it
+ * growing more than once.  This is only a hint to avoid the intermediate
+ * buffer sizes when the final length is known or can be estimated.
+ *
+ * Returns: @string
+ **/
+LIB_EXPORT struct l_string *l_string_reserve(struct l_string *string,
+							size_t extra)
+{
+	if (unlikely(!string))
+		return NULL;
+
+	grow_string(string, extra);
+	string->str[string->len] = '\0';
 
 	return string;
 }
 
+/**
+ * l_string_get_iovec:
+ * @string: growable string object
+ * @out_n_iov: Number of entries in the returned array
+ *
+ * Describes the contents of @string, without the terminating NUL, as an
+ * array of buffers that can be passed to writev() or similar.  The array
+ * and the buffers belong to @string and are valid until it is modified or
+ * freed.
+ *
+ * Returns: an array of @out_n_iov buffers
+ **/
+LIB_EXPORT const struct iovec *l_string_get_iovec(struct l_string *string,
+							size_t *out_n_iov)
+{
+	unsigned int i;
+
+	if (unlikely(!string || !out_n_iov))
+		return NULL;
+
+	string->iov = l_realloc(string->iov,
+				sizeof(struct iovec) * (string->n_chunks + 1));
+
+	for (i = 0; i < string->n_chunks; i++) {
+		string->iov[i].iov_base = string->chunks[i].data;
+		string->iov[i].iov_len = string->chunks[i].len;
+	}
+
+	string->iov[i].iov_base = string->str;
+	string->iov[i].iov_len = string->len;
+	*out_n_iov = string->n_chunks + (string->len ? 1 : 0);
+
+	return string->iov;
+}
+
 struct arg {
 	size_t max_len;
 	size_t cur_len;
@@ -9,6 +9,7 @@
 #define __ELL_STRING_H
 
 #include <stdarg.h>
+#include <sys/uio.h>
 #include <ell/cleanup.h>
 
 #ifdef __cplusplus
@@ -18,6 +19,7 @@ extern "C" {
 struct l_string;
 
 struct l_string *l_string_new(size_t initial_length);
+struct l_string *l_string_new_chunked(size_t chunk_size);
 void l_string_free(struct l_string *string);
 DEFINE_CLEANUP_FUNC(l_string_free);
 char *l_string_unwrap(struct l_string *string);
@@ -34,6 +36,10 @@ void l_string_append_printf(struct l_string *dest, const char *format, ...)
 					__attribute__((format(printf, 2, 3)));
 
 struct l_string *l_string_truncate(struct l_string *string, size_t new_size);
+struct l_string *l_string_reserve(struct l_string *string, size_t extra);
+
+const struct iovec *l_string_get_iovec(struct l_string *string,
+					size_t *out_n_iov);
 
 unsigned int l_string_length(struct l_string *string);
 
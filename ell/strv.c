@@ -48,10 +48,23 @@ LIB_EXPORT void l_strfreev(char **strlist)
  * Returns: A newly allocated %NULL terminated string array.  This array
  * should be freed using l_strfreev().
  **/
+/* Number of pieces l_strsplit() splits a non-empty @str into */
+static unsigned int strsplit_count(const char *str, const char sep)
+{
+	unsigned int n = 1;
+
+	/* strchr() is vectorized by the C library unlike a byte loop */
+	if (sep)
+		for (; (str = strchr(str, sep)); str++)
+			n += 1;
+
+	return n;
+}
+
 LIB_EXPORT char **l_strsplit(const char *str, const char sep)
 {
-	int len;
-	int i;
+	unsigned int n;
+	unsigned int i;
 	const char *p;
 	char **ret;
 
@@ -61,28 +74,60 @@ LIB_EXPORT char **l_strsplit(const char *str, const char sep)
 	if (str[0] == '\0')
 		return l_new(char *, 1);
 
-	for (p = str, len = 1; *p; p++)
-		if (*p == sep)
-			len += 1;
+	n = strsplit_count(str, sep);
+	ret = l_new(char *, n + 1);
 
-	ret = l_new(char *, len + 1);
+	for (i = 0, p = str; i < n; i++) {
+		const char *end = strchrnul(p, sep);
 
-	i = 0;
-	p = str;
-	len = 0;
+		ret[i] = l_strndup(p, end - p);
+		p = end + 1;
+	}
 
-	while (p[len]) {
-		if (p[len] != sep) {
-			len += 1;
-			continue;
-		}
+	return ret;
+}
 
-		ret[i++] = l_strndup(p, len);
-		p += len + 1;
-		len = 0;
+/**
+ * l_strsplit_packed:
+ * @str: String to split
+ * @sep: The delimiter character
+ *
+ * Same as l_strsplit(), but the array and the strings are stored in a
+ * single allocation.  This suits read-only lists as the strings cannot
+ * be freed or replaced individually.
+ *
+ * Returns: A newly allocated %NULL terminated string array.  This array
+ * should be freed using l_free(), not l_strfreev().
+ **/
+LIB_EXPORT char **l_strsplit_packed(const char *str, const char sep)
+{
+	unsigned int n;
+	unsigned int i;
+	size_t len;
+	char *p;
+	char **ret;
+
+	if (unlikely(!str))
+		return NULL;
+
+	if (str[0] == '\0')
+		return l_new(char *, 1);
+
+	n = strsplit_count(str, sep);
+	len = strlen(str) + 1;
+
+	ret = l_malloc((n + 1) * sizeof(char *) + len);
+	p = memcpy(ret + n + 1, str, len);
+
+	for (i = 0; i < n; i++) {
+		char *end = strchrnul(p, sep);
+
+		ret[i] = p;
+		*end = '\0';
+		p = end + 1;
 	}
 
-	ret[i++] = l_strndup(p, len);
+	ret[n] = NULL;
 
 	return ret;
 }
@@ -104,11 +149,10 @@ LIB_EXPORT char **l_strsplit(const char *str, const char sep)
  **/
 LIB_EXPORT char **l_strsplit_set(const char *str, const char *separators)
 {
-	int len;
-	int i;
+	unsigned int n;
+	unsigned int i;
 	const char *p;
 	char **ret;
-	bool sep_table[256];
 
 	if (unlikely(!str))
 		return NULL;
@@ -116,34 +160,18 @@ LIB_EXPORT char **l_strsplit_set(const char *str, const char *separators)
 	if (str[0] == '\0')
 		return l_new(char *, 1);
 
-	memset(sep_table, 0, sizeof(sep_table));
-
-	for (p = separators; *p; p++)
-		sep_table[(unsigned char) *p] = true;
-
-	for (p = str, len = 1; *p; p++)
-		if (sep_table[(unsigned char) *p] == true)
-			len += 1;
-
-	ret = l_new(char *, len + 1);
+	for (p = str, n = 1; *(p += strcspn(p, separators)); p++)
+		n += 1;
 
-	i = 0;
-	p = str;
-	len = 0;
+	ret = l_new(char *, n + 1);
 
-	while (p[len]) {
-		if (sep_table[(unsigned char) p[len]] != true) {
-			len += 1;
-			continue;
-		}
+	for (i = 0, p = str; i < n; i++) {
+		size_t len = strcspn(p, separators);
 
-		ret[i++] = l_strndup(p, len);
+		ret[i] = l_strndup(p, len);
 		p += len + 1;
-		len = 0;
 	}
 
-	ret[i++] = l_strndup(p, len);
-
 	return ret;
 }
 
@@ -268,20 +296,16 @@ LIB_EXPORT bool l_strv_contains(char **str_array, const char *item)
 LIB_EXPORT char **l_strv_append(char **str_array, const char *str)
 {
 	char **ret;
-	unsigned int i, len;
+	unsigned int len;
 
 	if (unlikely(!str))
 		return str_array;
 
+	/* Often grows in place, see l_strv_builder for repeated appends */
 	len = l_strv_length(str_array);
-	ret = l_new(char *, len + 2);
-
-	for (i = 0; i < len; i++)
-		ret[i] = str_array[i];
-
-	ret[i] = l_strdup(str);
-
-	l_free(str_array);
+	ret = l_realloc(str_array, sizeof(char *) * (len + 2));
+	ret[len] = l_strdup(str);
+	ret[len + 1] = NULL;
 
 	return ret;
 }
@@ -303,20 +327,15 @@ LIB_EXPORT char **l_strv_append_vprintf(char **str_array,
 					const char *format, va_list args)
 {
 	char **ret;
-	unsigned int i, len;
+	unsigned int len;
 
 	if (unlikely(!format))
 		return str_array;
 
 	len = l_strv_length(str_array);
-	ret = l_new(char *, len + 2);
-
-	for (i = 0; i < len; i++)
-		ret[i] = str_array[i];
-
-	ret[i] = l_strdup_vprintf(format, args);
-
-	l_free(str_array);
+	ret = l_realloc(str_array, sizeof(char *) * (len + 2));
+	ret[len] = l_strdup_vprintf(format, args);
+	ret[len + 1] = NULL;
 
 	return ret;
 }
@@ -364,3 +383,141 @@ LIB_EXPORT bool l_strv_eq(char **a, char **b)
 
 	return !*b;
 }
+
+/**
+ * l_strv_builder:
+ *
+ * Opaque object for building a string array with many appends, growing
+ * the array geometrically rather than by one entry at a time.
+ */
+struct l_strv_builder {
+	char **strv;
+	unsigned int len;
+	unsigned int max;
+};
+
+static void strv_builder_grow(struct l_strv_builder *builder)
+{
+	if (builder->len + 1 < builder->max)
+		return;
+
+	builder->max = builder->max * 2;
+	builder->strv = l_realloc(builder->strv,
+					sizeof(char *) * builder->max);
+}
+
+/**
+ * l_strv_builder_new:
+ * @initial_size: Expected number of strings, or 0 for a default
+ *
+ * Returns: a new empty #l_strv_builder
+ **/
+LIB_EXPORT struct l_strv_builder *l_strv_builder_new(
+						unsigned int initial_size)
+{
+	struct l_strv_builder *builder = l_new(struct l_strv_builder, 1);
+
+	builder->max = maxsize(initial_size + 1, 8);
+	builder->strv = l_new(char *, builder->max);
+
+	return builder;
+}
+
+/**
+ * l_strv_builder_free:
+ * @builder: string array builder
+ *
+ * Frees @builder together with the strings appended so far.
+ **/
+LIB_EXPORT void l_strv_builder_free(struct l_strv_builder *builder)
+{
+	if (unlikely(!builder))
+		return;
+
+	l_strv_free(builder->strv);
+	l_free(builder);
+}
+
+/**
+ * l_strv_builder_append:
+ * @builder: string array builder
+ * @str: String to copy to the end of the array
+ *
+ * Returns: #true on success or #false if either argument is %NULL
+ **/
+LIB_EXPORT bool l_strv_builder_append(struct l_strv_builder *builder,
+					const char *str)
+{
+	if (unlikely(!builder || !str))
+		return false;
+
+	strv_builder_grow(builder);
+	builder->strv[builder->len++] = l_strdup(str);
+	builder->strv[builder->len] = NULL;
+
+	return true;
+}
+
+/**
+ * l_strv_builder_append_printf:
+ * @builder: string array builder
+ * @format: the string format.  See the sprintf() documentation
+ * @...: the parameters to insert
+ *
+ * Returns: #true on success or #false if @builder or @format is %NULL
+ **/
+LIB_EXPORT bool l_strv_builder_append_printf(struct l_strv_builder *builder,
+						const char *format, ...)
+{
+	va_list args;
+
+	if (unlikely(!builder || !format))
+		return false;
+
+	strv_builder_grow(builder);
+
+	va_start(args, format);
+	builder->strv[builder->len++] = l_strdup_vprintf(format, args);
+	va_end(args);
+
+	builder->strv[builder->len] = NULL;
+
+	return true;
+}
+
+/**
+ * l_strv_builder_length:
+ * @builder: string array builder
+ *
+ * Returns: the number of strings appended to @builder
+ **/
+LIB_EXPORT unsigned int l_strv_builder_length(
+					struct l_strv_builder *builder)
+{
+	if (unlikely(!builder))
+		return 0;
+
+	return builder->len;
+}
+
+/**
+ * l_strv_builder_unwrap:
+ * @builder: string array builder
+ *
+ * Frees @builder and returns the string array built, which is always
+ * %NULL terminated and possibly empty.
+ *
+ * Returns: The string array, to be freed using l_strv_free()
+ **/
+LIB_EXPORT char **l_strv_builder_unwrap(struct l_strv_builder *builder)
+{
+	char **strv;
+
+	if (unlikely(!builder))
+		return NULL;
+
+	strv = l_realloc(builder->strv, sizeof(char *) * (builder->len + 1));
+	l_free(builder);
+
+	return strv;
+}
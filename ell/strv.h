@@ -19,6 +19,7 @@ extern "C" {
 void l_strfreev(char **strlist);
 char **l_strsplit(const char *str, const char sep);
 char **l_strsplit_set(const char *str, const char *separators);
+char **l_strsplit_packed(const char *str, const char sep);
 char *l_strjoinv(char **str_array, const char delim);
 
 char **l_strv_new(void);
@@ -35,6 +36,18 @@ char **l_strv_append_vprintf(char **str_array, const char *format,
 char **l_strv_copy(char **str_array);
 bool l_strv_eq(char **a, char **b);
 
+struct l_strv_builder;
+
+struct l_strv_builder *l_strv_builder_new(unsigned int initial_size);
+void l_strv_builder_free(struct l_strv_builder *builder);
+DEFINE_CLEANUP_FUNC(l_strv_builder_free);
+bool l_strv_builder_append(struct l_strv_builder *builder, const char *str);
+bool l_strv_builder_append_printf(struct l_strv_builder *builder,
+					const char *format, ...)
+					__attribute__((format(printf, 2, 3)));
+unsigned int l_strv_builder_length(struct l_strv_builder *builder);
+char **l_strv_builder_unwrap(struct l_strv_builder *builder);
+
 #ifdef __cplusplus
 }
 #endif
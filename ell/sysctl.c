@@ -21,21 +21,43 @@
 #include "util.h"
 #include "private.h"
 
+struct l_sysctl {
+	int fd;
+};
+
+static int sysctl_write_fd(int fd, const void *value, size_t len)
+{
+	ssize_t r;
+
+	/* sysctl files parse each write from offset 0, no need to seek */
+	r = L_TFR(pwrite(fd, value, len, 0));
+	if (r < 0)
+		return -errno;
+
+	return 0;
+}
+
+static int sysctl_read_fd(int fd, void *dest, size_t len)
+{
+	ssize_t r;
+
+	r = L_TFR(pread(fd, dest, len, 0));
+	if (unlikely(r < 0))
+		return -errno;
+
+	return r;
+}
+
 static int sysctl_write(const char *file, const void *value, size_t len)
 {
 	int fd;
-	ssize_t r;
+	int r;
 
 	fd = L_TFR(open(file, O_WRONLY));
 	if (unlikely(fd < 0))
 		return -errno;
 
-	r = L_TFR(write(fd, value, len));
-	if (r < 0)
-		r = -errno;
-	else
-		r = 0;
-
+	r = sysctl_write_fd(fd, value, len);
 	close(fd);
 	return r;
 }
@@ -43,20 +65,27 @@ static int sysctl_write(const char *file, const void *value, size_t len)
 static int sysctl_read(const char *file, void *dest, size_t len)
 {
 	int fd;
-	ssize_t r;
+	int r;
 
 	fd = L_TFR(open(file, O_RDONLY));
 	if (unlikely(fd < 0))
 		return -errno;
 
-	r = L_TFR(read(fd, dest, len));
-	if (unlikely(r < 0))
-		r = -errno;
-
+	r = sysctl_read_fd(fd, dest, len);
 	close(fd);
 	return r;
 }
 
+static int sysctl_parse_u32(char *valuestr, int len, uint32_t *out_v)
+{
+	while (len > 0 && L_IN_SET(valuestr[len - 1], '\n', '\r', '\t', ' '))
+		len--;
+
+	valuestr[len] = '\0';
+
+	return l_safe_atou32(valuestr, out_v);
+}
+
 LIB_EXPORT int l_sysctl_get_u32(uint32_t *out_v, const char *format, ...)
 {
 	_auto_(l_free) char *filename = NULL;
@@ -72,12 +101,7 @@ LIB_EXPORT int l_sysctl_get_u32(uint32_t *out_v, const char *format, ...)
 	if (r < 0)
 		return r;
 
-	while (r > 0 && L_IN_SET(valuestr[r - 1], '\n', '\r', '\t', ' '))
-		r--;
-
-	valuestr[r] = '\0';
-
-	return l_safe_atou32(valuestr, out_v);
+	return sysctl_parse_u32(valuestr, r, out_v);
 }
 
 LIB_EXPORT int l_sysctl_set_u32(uint32_t v, const char *format, ...)
@@ -119,3 +143,137 @@ LIB_EXPORT int l_sysctl_set_char(char c, const char *format, ...)
 
 	return sysctl_write(filename, &c, sizeof(char));
 }
+
+/**
+ * l_sysctl_set_u32_batch:
+ * @settings: Array of settings to apply, in order
+ * @n_settings: Number of entries in @settings
+ * @dir_format: printf-style format of the directory the setting names
+ *	are relative to, e.g. "/proc/sys/net/ipv6/conf/%s"
+ *
+ * Applies several settings living in the same sysctl directory.  The
+ * directory is resolved once and each setting is opened relative to it,
+ * which is considerably cheaper than one l_sysctl_set_u32() per setting.
+ * All settings are attempted even if some of them fail.
+ *
+ * Returns: 0 on success, or the negative errno of the first failure
+ **/
+LIB_EXPORT int l_sysctl_set_u32_batch(
+				const struct l_sysctl_u32_setting *settings,
+				unsigned int n_settings,
+				const char *dir_format, ...)
+{
+	_auto_(l_free) char *dirname = NULL;
+	va_list ap;
+	char valuestr[64];
+	unsigned int i;
+	int dirfd;
+	int ret = 0;
+
+	if (unlikely(!settings || !n_settings))
+		return -EINVAL;
+
+	va_start(ap, dir_format);
+	dirname = l_strdup_vprintf(dir_format, ap);
+	va_end(ap);
+
+	dirfd = L_TFR(open(dirname, O_PATH | O_DIRECTORY | O_CLOEXEC));
+	if (dirfd < 0)
+		return -errno;
+
+	for (i = 0; i < n_settings; i++) {
+		size_t len;
+		int fd;
+		int r;
+
+		fd = L_TFR(openat(dirfd, settings[i].name,
+						O_WRONLY | O_CLOEXEC));
+		if (fd < 0) {
+			r = -errno;
+			goto next;
+		}
+
+		len = snprintf(valuestr, sizeof(valuestr), "%u",
+							settings[i].value);
+		r = sysctl_write_fd(fd, valuestr, len);
+		close(fd);
+next:
+		if (r < 0 && !ret)
+			ret = r;
+	}
+
+	close(dirfd);
+	return ret;
+}
+
+/**
+ * l_sysctl_new:
+ * @format: printf-style format of the sysctl file path
+ *
+ * Opens a sysctl file and keeps it open, so that settings that are read
+ * or toggled frequently can be accessed through l_sysctl_read_u32() and
+ * l_sysctl_write_u32() without reopening the file each time.  The file
+ * is opened for writing if possible and read-only otherwise.
+ *
+ * Returns: A newly allocated #l_sysctl or NULL if the file can't be opened
+ **/
+LIB_EXPORT struct l_sysctl *l_sysctl_new(const char *format, ...)
+{
+	_auto_(l_free) char *filename = NULL;
+	struct l_sysctl *sysctl;
+	va_list ap;
+	int fd;
+
+	va_start(ap, format);
+	filename = l_strdup_vprintf(format, ap);
+	va_end(ap);
+
+	fd = L_TFR(open(filename, O_RDWR | O_CLOEXEC));
+	if (fd < 0 && (errno == EACCES || errno == EPERM))
+		fd = L_TFR(open(filename, O_RDONLY | O_CLOEXEC));
+
+	if (fd < 0)
+		return NULL;
+
+	sysctl = l_new(struct l_sysctl, 1);
+	sysctl->fd = fd;
+
+	return sysctl;
+}
+
+LIB_EXPORT void l_sysctl_free(struct l_sysctl *sysctl)
+{
+	if (unlikely(!sysctl))
+		return;
+
+	close(sysctl->fd);
+	l_free(sysctl);
+}
+
+LIB_EXPORT int l_sysctl_read_u32(struct l_sysctl *sysctl, uint32_t *out_v)
+{
+	char valuestr[64];
+	int r;
+
+	if (unlikely(!sysctl))
+		return -EINVAL;
+
+	r = sysctl_read_fd(sysctl->fd, valuestr, sizeof(valuestr) - 1);
+	if (r < 0)
+		return r;
+
+	return sysctl_parse_u32(valuestr, r, out_v);
+}
+
+LIB_EXPORT int l_sysctl_write_u32(struct l_sysctl *sysctl, uint32_t v)
+{
+	char valuestr[64];
+	size_t len;
+
+	if (unlikely(!sysctl))
+		return -EINVAL;
+
+	len = snprintf(valuestr, sizeof(valuestr), "%u", v);
+
+	return sysctl_write_fd(sysctl->fd, valuestr, len);
+}
@@ -15,6 +15,13 @@
 extern "C" {
 #endif
 
+struct l_sysctl;
+
+struct l_sysctl_u32_setting {
+	const char *name;
+	uint32_t value;
+};
+
 int l_sysctl_get_u32(uint32_t *out_v, const char *format, ...)
 			__attribute__((format(printf, 2, 3)));
 int l_sysctl_set_u32(uint32_t v, const char *format, ...)
@@ -25,6 +32,17 @@ int l_sysctl_get_char(char *out_c, const char *format, ...)
 int l_sysctl_set_char(char c, const char *format, ...)
 			__attribute__((format(printf, 2, 3)));
 
+int l_sysctl_set_u32_batch(const struct l_sysctl_u32_setting *settings,
+				unsigned int n_settings,
+				const char *dir_format, ...)
+			__attribute__((format(printf, 3, 4)));
+
+struct l_sysctl *l_sysctl_new(const char *format, ...)
+			__attribute__((format(printf, 1, 2)));
+void l_sysctl_free(struct l_sysctl *sysctl);
+int l_sysctl_read_u32(struct l_sysctl *sysctl, uint32_t *out_v);
+int l_sysctl_write_u32(struct l_sysctl *sysctl, uint32_t v);
+
 #ifdef __cplusplus
 }
 #endif
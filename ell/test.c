@@ -12,6 +12,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
 
 #include "log.h"
 #include "test.h"
@@ -35,38 +38,338 @@ struct test {
 static struct test *test_head;
 static struct test *test_tail;
 
+struct bench_result {
+	const char *name;
+	unsigned int iterations;
+	uint64_t min_ns;
+	uint64_t median_ns;
+	uint64_t p99_ns;
+	double ops_per_sec;
+};
+
+static struct {
+	bool enabled;
+	unsigned int iterations;
+	unsigned int warmup;
+	unsigned int duration_ms;
+	unsigned int threshold;
+	const char *json_path;
+	const char *baseline_path;
+	struct bench_result *results;
+	unsigned int n_results;
+} bench;
+
+static bool parse_uint_option(const char *arg, const char *option,
+							unsigned int *out)
+{
+	size_t len = strlen(option);
+	char *end;
+	unsigned long v;
+
+	if (strncmp(arg, option, len) || arg[len] != '=')
+		return false;
+
+	v = strtoul(arg + len + 1, &end, 10);
+	if (*end == '\0' && v <= UINT32_MAX)
+		*out = v;
+
+	return true;
+}
+
+static bool parse_str_option(const char *arg, const char *option,
+							const char **out)
+{
+	size_t len = strlen(option);
+
+	if (strncmp(arg, option, len) || arg[len] != '=')
+		return false;
+
+	*out = arg + len + 1;
+	return true;
+}
+
+static bool parse_bench_option(const char *arg)
+{
+	if (!strcmp(arg, "--bench")) {
+		bench.enabled = true;
+		return true;
+	}
+
+	return parse_uint_option(arg, "--iterations", &bench.iterations) ||
+		parse_uint_option(arg, "--warmup", &bench.warmup) ||
+		parse_uint_option(arg, "--duration", &bench.duration_ms) ||
+		parse_uint_option(arg, "--threshold", &bench.threshold) ||
+		parse_str_option(arg, "--json", &bench.json_path) ||
+		parse_str_option(arg, "--baseline", &bench.baseline_path);
+}
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void bench_test(const struct test *test)
+{
+	struct bench_result *result;
+	unsigned int capacity;
+	unsigned int n = 0;
+	uint64_t *samples;
+	uint64_t deadline = 0;
+	uint64_t total = 0;
+	unsigned int i;
+
+	for (i = 0; i < bench.warmup; i++)
+		test->function(test->test_data);
+
+	/*
+	 * With a time budget keep going until it runs out, using the
+	 * iteration count only as an upper bound if one was given.
+	 */
+	capacity = bench.iterations ? bench.iterations : 1024;
+	samples = malloc(capacity * sizeof(uint64_t));
+	if (!samples)
+		return;
+
+	if (bench.duration_ms)
+		deadline = bench_now() + bench.duration_ms * 1000000ULL;
+
+	while (true) {
+		uint64_t start;
+
+		if (bench.duration_ms && n && bench_now() >= deadline)
+			break;
+
+		if (n == capacity) {
+			uint64_t *tmp;
+
+			if (!bench.duration_ms || bench.iterations)
+				break;
+
+			tmp = realloc(samples, capacity * 2 * sizeof(uint64_t));
+			if (!tmp)
+				break;
+
+			samples = tmp;
+			capacity *= 2;
+		}
+
+		start = bench_now();
+		test->function(test->test_data);
+		samples[n] = bench_now() - start;
+		total += samples[n++];
+	}
+
+	qsort(samples, n, sizeof(uint64_t), bench_compare);
+
+	result = realloc(bench.results,
+			(bench.n_results + 1) * sizeof(struct bench_result));
+	if (!result) {
+		free(samples);
+		return;
+	}
+
+	bench.results = result;
+	result = &bench.results[bench.n_results++];
+	result->name = test->name;
+	result->iterations = n;
+	result->min_ns = samples[0];
+	result->median_ns = samples[(n - 1) / 2];
+	result->p99_ns = samples[(n - 1) * 99 / 100];
+	result->ops_per_sec = total ? n * 1e9 / total : 0;
+
+	free(samples);
+
+	printf("BENCH: %s: %u iterations, min %" PRIu64 " ns, "
+		"median %" PRIu64 " ns, p99 %" PRIu64 " ns, %.0f ops/s\n",
+		result->name, result->iterations, result->min_ns,
+		result->median_ns, result->p99_ns, result->ops_per_sec);
+}
+
+static void bench_write_json(void)
+{
+	FILE *f = fopen(bench.json_path, "w");
+	unsigned int i;
+
+	if (!f) {
+		fprintf(stderr, "Unable to write %s\n", bench.json_path);
+		return;
+	}
+
+	/* One result per line, which is what bench_load_baseline expects */
+	fprintf(f, "[\n");
+
+	for (i = 0; i < bench.n_results; i++) {
+		const struct bench_result *r = &bench.results[i];
+		const char *c;
+
+		fprintf(f, "  { \"name\": \"");
+
+		for (c = r->name; *c; c++) {
+			if (*c == '"' || *c == '\\')
+				fputc('\\', f);
+
+			fputc(*c, f);
+		}
+
+		fprintf(f, "\", \"iterations\": %u, \"min_ns\": %" PRIu64
+			", \"median_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64
+			", \"ops_per_sec\": %.1f }%s\n",
+			r->iterations, r->min_ns, r->median_ns, r->p99_ns,
+			r->ops_per_sec, i + 1 < bench.n_results ? "," : "");
+	}
+
+	fprintf(f, "]\n");
+	fclose(f);
+}
+
+static bool bench_find_baseline(FILE *f, const char *name, uint64_t *out)
+{
+	char *line = NULL;
+	size_t size = 0;
+	bool found = false;
+
+	rewind(f);
+
+	while (!found && getline(&line, &size, f) > 0) {
+		const char *p = strstr(line, "\"name\": \"");
+		const char *n = name;
+
+		if (!p)
+			continue;
+
+		for (p += 9; *p && *p != '"'; p++, n++) {
+			if (*p == '\\')
+				p++;
+
+			if (*p != *n)
+				break;
+		}
+
+		if (*p != '"' || *n)
+			continue;
+
+		p = strstr(p, "\"median_ns\": ");
+		if (!p)
+			continue;
+
+		*out = strtoull(p + 13, NULL, 10);
+		found = true;
+	}
+
+	free(line);
+	return found;
+}
+
+static int bench_compare_baseline(void)
+{
+	FILE *f = fopen(bench.baseline_path, "r");
+	unsigned int i;
+	int ret = 0;
+
+	if (!f) {
+		fprintf(stderr, "Unable to read %s\n", bench.baseline_path);
+		return 1;
+	}
+
+	for (i = 0; i < bench.n_results; i++) {
+		const struct bench_result *r = &bench.results[i];
+		uint64_t base;
+
+		if (!bench_find_baseline(f, r->name, &base) || !base)
+			continue;
+
+		if (r->median_ns * 100 <= base * (100 + bench.threshold))
+			continue;
+
+		printf("REGRESSION: %s: median %" PRIu64 " ns, "
+			"baseline %" PRIu64 " ns (+%" PRIu64 "%%)\n",
+			r->name, r->median_ns, base,
+			(r->median_ns - base) * 100 / base);
+		ret = 1;
+	}
+
+	fclose(f);
+	return ret;
+}
+
 /**
  * l_test_init:
  * @argc: pointer to @argc parameter of main() function
  * @argv: pointer to @argv parameter of main() function
  *
  * Initialize testing framework.
+ *
+ * Passing --bench on the command line turns the tests into benchmarks.
+ * Each test is run --warmup=N times (default 10) and then timed over
+ * --iterations=N runs (default 1000), or for --duration=MS milliseconds
+ * if given.  The minimum, median and 99th percentile run time and the
+ * throughput are printed for each test.  --json=FILE saves the results
+ * and --baseline=FILE compares the medians against previously saved
+ * results, failing the run if any test is more than --threshold=PERCENT
+ * (default 10) slower.  The options are removed from @argv.
  **/
 LIB_EXPORT void l_test_init(int *argc, char ***argv)
 {
+	int i;
+	int n = 1;
+
 	test_head = NULL;
 	test_tail = NULL;
 
+	memset(&bench, 0, sizeof(bench));
+	bench.warmup = 10;
+	bench.threshold = 10;
+
+	for (i = 1; argc && argv && i < *argc; i++) {
+		if (!parse_bench_option((*argv)[i]))
+			(*argv)[n++] = (*argv)[i];
+	}
+
+	if (argc && argv && *argc > 0) {
+		*argc = n;
+		(*argv)[n] = NULL;
+	}
+
+	if (!bench.iterations && !bench.duration_ms)
+		bench.iterations = 1000;
+
 	l_log_set_stderr();
 }
 
 /**
  * l_test_run:
  *
- * Run all configured tests.
+ * Run all configured tests, or benchmark them if requested in
+ * l_test_init().
  *
  * Returns: 0 on success
  **/
 LIB_EXPORT int l_test_run(void)
 {
 	struct test *test = test_head;
+	int ret = 0;
 
 	while (test) {
 		struct test *tmp = test;
 
 		printf("TEST: %s\n", test->name);
 
-		test->function(test->test_data);
+		if (bench.enabled)
+			bench_test(test);
+		else
+			test->function(test->test_data);
 
 		test = test->next;
 
@@ -76,7 +379,17 @@ LIB_EXPORT int l_test_run(void)
 	test_head = NULL;
 	test_tail = NULL;
 
-	return 0;
+	if (bench.json_path)
+		bench_write_json();
+
+	if (bench.baseline_path)
+		ret = bench_compare_baseline();
+
+	free(bench.results);
+	bench.results = NULL;
+	bench.n_results = 0;
+
+	return ret;
 }
 
 /**
@@ -13,3 +13,5 @@ uint64_t _time_fuzz_secs(uint32_t secs, uint32_t max_offset);
 uint64_t _time_realtime_to_boottime(const struct timeval *ts);
 uint64_t time_realtime_now(void);
 uint64_t _time_from_timespec(const struct timespec *ts);
+void _time_cache_refresh(void);
+void _time_cache_clear(void);
@@ -43,6 +43,59 @@ LIB_EXPORT uint64_t l_time_now(void)
 	return _time_from_timespec(&now);
 }
 
+/* Set by the main loop of the thread for the duration of an iteration */
+static __thread uint64_t cached_now;
+
+void _time_cache_refresh(void)
+{
+	cached_now = l_time_now();
+}
+
+void _time_cache_clear(void)
+{
+	cached_now = 0;
+}
+
+/**
+ * l_time_now_cached:
+ *
+ * Get the running clocktime in microseconds, as of the time the current
+ * main loop iteration woke up.  Callbacks dispatched from the same
+ * iteration all see the same value, without reading the clock.  Outside
+ * of an iteration this is the same as l_time_now().
+ *
+ * The value is on the same clock as l_time_now() and may lag it by as
+ * much as the time spent in the iteration so far, so it is suited to
+ * expiry checks rather than to measuring short intervals.
+ *
+ * Returns: Clock time in microseconds
+ **/
+LIB_EXPORT uint64_t l_time_now_cached(void)
+{
+	if (cached_now)
+		return cached_now;
+
+	return l_time_now();
+}
+
+/**
+ * l_time_now_coarse:
+ *
+ * Get the coarse monotonic clocktime in microseconds.  Reading it is
+ * cheaper than l_time_now(), but it only advances once per scheduler tick
+ * and does not count time spent in suspend, so values are not comparable
+ * with those of l_time_now().
+ *
+ * Returns: Coarse monotonic clock time in microseconds
+ **/
+LIB_EXPORT uint64_t l_time_now_coarse(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	return _time_from_timespec(&now);
+}
+
 uint64_t time_realtime_now(void)
 {
 	struct timespec now;
@@ -81,7 +134,7 @@ uint64_t _time_fuzz_msecs(uint64_t ms)
 {
 	/* We do this by subtracting 0.1ms and adding 0.1ms * rand[0 .. 2] */
 	return ms - ms / 10 +
-			(l_getrandom_uint32() % (2 * L_MSEC_PER_SEC)) *
+			(l_getrandom_buffered_uint32() % (2 * L_MSEC_PER_SEC)) *
 						ms / 10 / L_MSEC_PER_SEC;
 }
 
@@ -90,14 +143,14 @@ uint64_t _time_pick_interval_secs(uint32_t min_secs, uint32_t max_secs)
 	uint64_t min_ms = min_secs * L_MSEC_PER_SEC;
 	uint64_t max_ms = max_secs * L_MSEC_PER_SEC;
 
-	return l_getrandom_uint32() % (max_ms + 1 - min_ms) + min_ms;
+	return l_getrandom_buffered_uint32() % (max_ms + 1 - min_ms) + min_ms;
 }
 
 /* Compute a time in ms based on seconds + max_offset * [-1.0 .. 1.0] */
 uint64_t _time_fuzz_secs(uint32_t secs, uint32_t max_offset)
 {
 	uint64_t ms = secs * L_MSEC_PER_SEC;
-	uint64_t r = l_getrandom_uint32();
+	uint64_t r = l_getrandom_buffered_uint32();
 
 	max_offset *= L_MSEC_PER_SEC;
 
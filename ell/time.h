@@ -24,6 +24,8 @@ extern "C" {
 #define L_TIME_INVALID ((uint64_t) -1)
 
 uint64_t l_time_now(void);
+uint64_t l_time_now_cached(void);
+uint64_t l_time_now_coarse(void);
 
 static inline bool l_time_after(uint64_t a, uint64_t b)
 {
@@ -21,9 +21,12 @@
 
 #include "useful.h"
 #include "timeout.h"
+#include "time.h"
+#include "pqueue.h"
 #include "main-private.h"
 #include "private.h"
 #include "time-private.h"
+#include "probe-private.h"
 
 /**
  * SECTION:timeout
@@ -38,48 +41,235 @@
  * Opaque object representing the timeout.
  */
 struct l_timeout {
-	int fd;
+	struct timeout_queue *queue;
+	uint64_t expiry;
+	uint64_t slack;
+	struct l_pqueue_node heap_node;
+	struct l_timeout *prev;
+	struct l_timeout *next;
 	l_timeout_notify_cb_t callback;
 	l_timeout_destroy_cb_t destroy;
 	void *user_data;
 };
 
-static void timeout_destroy(void *user_data)
+/*
+ * All timeouts of a main loop are multiplexed onto a single timerfd.  Armed
+ * timeouts are kept in a minimum heap ordered by their deadline, which is
+ * the expiry time plus the slack the timeout tolerates, and the timerfd is
+ * programmed with the deadline of the heap root.  On wakeup, every timeout
+ * whose expiry has passed is dispatched, so timeouts with overlapping
+ * windows share a single wakeup.  All timeouts, armed or not, are also kept
+ * on a list so that they can be detached when the main loop is torn down.
+ */
+struct timeout_queue {
+	struct l_main_loop *loop;
+	int fd;
+	uint64_t armed;
+	bool dispatching;
+	struct l_pqueue *heap;
+	struct l_timeout *list;
+};
+
+static bool timer_less(const struct l_timeout *l, const struct l_timeout *r)
 {
-	struct l_timeout *timeout = user_data;
+	return l->expiry + l->slack < r->expiry + r->slack;
+}
 
-	close(timeout->fd);
-	timeout->fd = -1;
+L_PQUEUE_DEFINE(timer_heap, struct l_timeout, heap_node, timer_less)
 
-	if (timeout->destroy)
-		timeout->destroy(timeout->user_data);
+static uint64_t timer_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return _time_from_timespec(&now);
+}
+
+static void timer_rearm(struct timeout_queue *queue)
+{
+	struct l_timeout *first = timer_heap_peek(queue->heap);
+	struct itimerspec itimer;
+	uint64_t deadline;
+
+	if (!first || queue->dispatching)
+		return;
+
+	deadline = first->expiry + first->slack;
+
+	/*
+	 * If the timerfd is already set to go off no later than the first
+	 * timeout, leave it alone.  A spurious wakeup is cheaper than
+	 * reprogramming the timer every time the heap root changes.
+	 */
+	if (queue->armed && queue->armed <= deadline)
+		return;
+
+	memset(&itimer, 0, sizeof(itimer));
+	itimer.it_value.tv_sec = deadline / L_USEC_PER_SEC;
+	itimer.it_value.tv_nsec = (deadline % L_USEC_PER_SEC) *
+							L_NSEC_PER_USEC;
+
+	if (timerfd_settime(queue->fd, TFD_TIMER_ABSTIME, &itimer, NULL) < 0)
+		return;
+
+	queue->armed = deadline;
+}
+
+static void timer_dispatch(struct timeout_queue *queue, uint64_t now)
+{
+	struct l_timeout *timeout;
+
+	queue->dispatching = true;
+
+	/*
+	 * Timeouts re-armed from within a callback always expire after
+	 * 'now', so they will not be dispatched again in this pass.  Walking
+	 * in deadline order may stop ahead of an expired timeout with a
+	 * later deadline.  It is then dispatched within its slack anyway.
+	 */
+	while ((timeout = timer_heap_peek(queue->heap)) &&
+						timeout->expiry <= now) {
+		timer_heap_remove(queue->heap, timeout);
+
+		PROBE(timeout_fire, timeout, now - timeout->expiry);
+
+		if (timeout->callback)
+			timeout->callback(timeout, timeout->user_data);
+	}
+
+	queue->dispatching = false;
+	timer_rearm(queue);
 }
 
-static void timeout_callback(int fd, uint32_t events, void *user_data)
+static void timer_callback(int fd, uint32_t events, void *user_data)
 {
-	struct l_timeout *timeout = user_data;
+	struct timeout_queue *queue = user_data;
 	uint64_t expired;
-	ssize_t result;
 
-	result = read(timeout->fd, &expired, sizeof(expired));
-	if (result != sizeof(expired))
+	if (read(queue->fd, &expired, sizeof(expired)) < 0 && errno != EAGAIN)
 		return;
 
-	if (timeout->callback)
-		timeout->callback(timeout, timeout->user_data);
+	queue->armed = 0;
+	timer_dispatch(queue, timer_now());
 }
 
-static inline int timeout_set(int fd, unsigned int seconds, long nanoseconds)
+bool timeout_queue_next_deadline(struct timeout_queue *queue,
+							uint64_t *out_deadline)
 {
-	struct itimerspec itimer;
+	struct l_timeout *first = timer_heap_peek(queue->heap);
 
-	memset(&itimer, 0, sizeof(itimer));
-	itimer.it_interval.tv_sec = 0;
-	itimer.it_interval.tv_nsec = 0;
-	itimer.it_value.tv_sec = seconds;
-	itimer.it_value.tv_nsec = nanoseconds;
+	if (!first)
+		return false;
+
+	*out_deadline = first->expiry + first->slack;
+	return true;
+}
+
+/*
+ * Used when the loop is driven from outside and the host noticed that the
+ * next deadline has passed before the timerfd made it through epoll.
+ */
+void timeout_queue_dispatch_expired(struct timeout_queue *queue)
+{
+	struct l_timeout *first = timer_heap_peek(queue->heap);
+	uint64_t now;
+	uint64_t expired;
+
+	if (!first || queue->dispatching)
+		return;
+
+	now = timer_now();
+	if (first->expiry > now)
+		return;
+
+	/* Consume the expiration so that the epoll fd doesn't stay readable */
+	if (queue->armed && queue->armed <= now) {
+		if (read(queue->fd, &expired, sizeof(expired)) < 0 &&
+							errno != EAGAIN)
+			return;
+
+		queue->armed = 0;
+	}
+
+	timer_dispatch(queue, now);
+}
+
+static void timer_destroy(void *user_data)
+{
+	struct timeout_queue *queue = user_data;
+	struct l_timeout *timeout;
+
+	close(queue->fd);
+	main_loop_set_timeouts(queue->loop, NULL);
+
+	/*
+	 * The main loop is going away.  Detach all remaining timeouts, they
+	 * can still be freed with l_timeout_remove but will never fire.
+	 * The heap goes first since destroy callbacks may free timeouts.
+	 */
+	l_pqueue_free(queue->heap);
+
+	while ((timeout = queue->list)) {
+		queue->list = timeout->next;
+		timeout->prev = NULL;
+		timeout->next = NULL;
+		timeout->queue = NULL;
 
-	return timerfd_settime(fd, 0, &itimer, NULL);
+		if (timeout->destroy)
+			timeout->destroy(timeout->user_data);
+	}
+
+	l_free(queue);
+}
+
+static struct timeout_queue *timer_get_queue(void)
+{
+	struct l_main_loop *loop = main_loop_get();
+	struct timeout_queue *queue;
+	int err;
+
+	if (!loop)
+		return NULL;
+
+	queue = main_loop_get_timeouts(loop);
+	if (queue)
+		return queue;
+
+	queue = l_new(struct timeout_queue, 1);
+	queue->loop = loop;
+	queue->heap = timer_heap_new();
+
+	queue->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (queue->fd < 0)
+		goto free_queue;
+
+	err = watch_add(loop, queue->fd, EPOLLIN, timer_callback, queue,
+							timer_destroy);
+	if (err < 0)
+		goto close_fd;
+
+	main_loop_set_timeouts(loop, queue);
+
+	return queue;
+
+close_fd:
+	close(queue->fd);
+free_queue:
+	l_pqueue_free(queue->heap);
+	l_free(queue);
+
+	return NULL;
+}
+
+static void timeout_schedule(struct l_timeout *timeout, uint64_t usec)
+{
+	struct timeout_queue *queue = timeout->queue;
+
+	timer_heap_remove(queue->heap, timeout);
+
+	timeout->expiry = timer_now() + usec;
+	timer_heap_push(queue->heap, timeout);
+	timer_rearm(queue);
 }
 
 static bool convert_ms(uint64_t milliseconds, unsigned int *seconds,
@@ -116,40 +306,32 @@ static struct l_timeout *timeout_create_with_nanoseconds(unsigned int seconds,
 			long nanoseconds, l_timeout_notify_cb_t callback,
 			void *user_data, l_timeout_destroy_cb_t destroy)
 {
+	struct timeout_queue *queue;
 	struct l_timeout *timeout;
-	int err;
 
 	if (unlikely(!callback))
 		return NULL;
 
+	queue = timer_get_queue();
+	if (!queue)
+		return NULL;
+
 	timeout = l_new(struct l_timeout, 1);
 
+	timeout->queue = queue;
 	timeout->callback = callback;
 	timeout->destroy = destroy;
 	timeout->user_data = user_data;
 
-	timeout->fd = timerfd_create(CLOCK_MONOTONIC,
-					TFD_NONBLOCK | TFD_CLOEXEC);
-	if (timeout->fd < 0) {
-		l_free(timeout);
-		return NULL;
-	}
+	timeout->next = queue->list;
+	if (queue->list)
+		queue->list->prev = timeout;
 
-	if (seconds > 0 || nanoseconds > 0) {
-		if (timeout_set(timeout->fd, seconds, nanoseconds) < 0) {
-			close(timeout->fd);
-			l_free(timeout);
-			return NULL;
-		}
-	}
+	queue->list = timeout;
 
-	err = watch_add(timeout->fd, EPOLLIN | EPOLLONESHOT, timeout_callback,
-			timeout, timeout_destroy);
-
-	if (err < 0) {
-		l_free(timeout);
-		return NULL;
-	}
+	if (seconds > 0 || nanoseconds > 0)
+		timeout_schedule(timeout, seconds * L_USEC_PER_SEC +
+					nanoseconds / L_NSEC_PER_USEC);
 
 	return timeout;
 }
@@ -219,15 +401,11 @@ LIB_EXPORT void l_timeout_modify(struct l_timeout *timeout,
 	if (unlikely(!timeout))
 		return;
 
-	if (unlikely(timeout->fd < 0))
+	if (unlikely(!timeout->queue))
 		return;
 
-	if (seconds > 0) {
-		if (timeout_set(timeout->fd, seconds, 0) < 0)
-			return;
-	}
-
-	watch_modify(timeout->fd, EPOLLIN | EPOLLONESHOT, true);
+	if (seconds > 0)
+		timeout_schedule(timeout, seconds * L_USEC_PER_SEC);
 }
 
 /**
@@ -243,19 +421,51 @@ LIB_EXPORT void l_timeout_modify_ms(struct l_timeout *timeout,
 	if (unlikely(!timeout))
 		return;
 
-	if (unlikely(timeout->fd < 0))
+	if (unlikely(!timeout->queue))
 		return;
 
 	if (milliseconds > 0) {
 		unsigned int sec;
 		long nanosec;
 
-		if (!convert_ms(milliseconds, &sec, &nanosec) ||
-			timeout_set(timeout->fd, sec, nanosec) < 0)
+		if (!convert_ms(milliseconds, &sec, &nanosec))
 			return;
+
+		timeout_schedule(timeout, milliseconds * L_USEC_PER_MSEC);
 	}
+}
+
+/**
+ * l_timeout_set_slack_ms:
+ * @timeout: timeout object
+ * @milliseconds: number of milliseconds
+ *
+ * Allow @timeout to fire up to @milliseconds late.  Timeouts that are due
+ * within each other's slack are dispatched from the same wakeup, which keeps
+ * the system idle for longer.  Timeouts have no slack by default.  The slack
+ * applies to the current and all future expirations of @timeout.
+ **/
+LIB_EXPORT void l_timeout_set_slack_ms(struct l_timeout *timeout,
+					uint64_t milliseconds)
+{
+	struct timeout_queue *queue;
 
-	watch_modify(timeout->fd, EPOLLIN | EPOLLONESHOT, true);
+	if (unlikely(!timeout))
+		return;
+
+	queue = timeout->queue;
+	if (unlikely(!queue))
+		return;
+
+	if (milliseconds > UINT64_MAX / L_USEC_PER_MSEC)
+		return;
+
+	timeout->slack = milliseconds * L_USEC_PER_MSEC;
+
+	if (!timer_heap_update(queue->heap, timeout))
+		return;
+
+	timer_rearm(queue);
 }
 
 /**
@@ -269,8 +479,23 @@ LIB_EXPORT void l_timeout_remove(struct l_timeout *timeout)
 	if (unlikely(!timeout))
 		return;
 
-	watch_remove(timeout->fd, false);
+	if (!timeout->queue)
+		goto done;
+
+	timer_heap_remove(timeout->queue->heap, timeout);
+
+	if (timeout->prev)
+		timeout->prev->next = timeout->next;
+	else
+		timeout->queue->list = timeout->next;
 
+	if (timeout->next)
+		timeout->next->prev = timeout->prev;
+
+	if (timeout->destroy)
+		timeout->destroy(timeout->user_data);
+
+done:
 	l_free(timeout);
 }
 
@@ -314,16 +539,24 @@ LIB_EXPORT void l_timeout_set_callback(struct l_timeout *timeout,
 LIB_EXPORT bool l_timeout_remaining(struct l_timeout *timeout,
 						uint64_t *remaining)
 {
-	struct itimerspec current;
+	uint64_t now;
 
 	if (unlikely(!timeout))
 		return false;
 
-	if (timerfd_gettime(timeout->fd, &current) < 0)
+	if (unlikely(!timeout->queue))
 		return false;
 
-	if (remaining)
-		*remaining = _time_from_timespec(&current.it_value);
+	if (!remaining)
+		return true;
+
+	if (!l_pqueue_node_is_queued(&timeout->heap_node)) {
+		*remaining = 0;
+		return true;
+	}
+
+	now = timer_now();
+	*remaining = timeout->expiry > now ? timeout->expiry - now : 0;
 
 	return true;
 }
@@ -30,6 +30,8 @@ void l_timeout_modify(struct l_timeout *timeout,
 				unsigned int seconds);
 void l_timeout_modify_ms(struct l_timeout *timeout,
 				uint64_t milliseconds);
+void l_timeout_set_slack_ms(struct l_timeout *timeout,
+				uint64_t milliseconds);
 void l_timeout_remove(struct l_timeout *timeout);
 void l_timeout_set_callback(struct l_timeout *timeout,
 				l_timeout_notify_cb_t callback, void *user_data,
@@ -0,0 +1,393 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "useful.h"
+#include "private.h"
+#include "missing.h"
+#include "tls.h"
+#include "checksum.h"
+#include "cipher.h"
+#include "hashmap.h"
+#include "settings.h"
+#include "strv.h"
+#include "time.h"
+#include "time-private.h"
+#include "cert.h"
+#include "tls-private.h"
+
+/*
+ * Server-side session cache kept in memory as an alternative to the
+ * l_settings based one.  Sessions are indexed by Session ID and also
+ * kept on a list in most recently used order.  When the cache is full
+ * the least recently used session is evicted, expired sessions are
+ * dropped when looked up or when they reach the end of the list.
+ */
+struct l_tls_session_cache {
+	struct l_hashmap *sessions;
+	struct tls_cached_session *head;
+	struct tls_cached_session *tail;
+	unsigned int max_sessions;
+	uint64_t lifetime;
+};
+
+static unsigned int session_id_hash(const void *p)
+{
+	const uint8_t *id = p;
+	unsigned int hash = 2166136261u;
+	unsigned int i;
+
+	for (i = 0; i <= id[0]; i++)
+		hash = (hash ^ id[i]) * 16777619u;
+
+	return hash;
+}
+
+static int session_id_compare(const void *a, const void *b)
+{
+	const uint8_t *id1 = a;
+	const uint8_t *id2 = b;
+
+	if (id1[0] != id2[0])
+		return id1[0] - id2[0];
+
+	return memcmp(id1 + 1, id2 + 1, id1[0]);
+}
+
+static void session_unlink(struct l_tls_session_cache *cache,
+				struct tls_cached_session *session)
+{
+	if (session->prev)
+		session->prev->next = session->next;
+	else
+		cache->head = session->next;
+
+	if (session->next)
+		session->next->prev = session->prev;
+	else
+		cache->tail = session->prev;
+
+	session->prev = NULL;
+	session->next = NULL;
+}
+
+static void session_link_head(struct l_tls_session_cache *cache,
+				struct tls_cached_session *session)
+{
+	session->next = cache->head;
+
+	if (cache->head)
+		cache->head->prev = session;
+	else
+		cache->tail = session;
+
+	cache->head = session;
+}
+
+static void session_free(void *data)
+{
+	struct tls_cached_session *session = data;
+
+	l_free(session->peer_identity);
+	explicit_bzero(session, sizeof(*session));
+	l_free(session);
+}
+
+static void session_remove(struct l_tls_session_cache *cache,
+				struct tls_cached_session *session)
+{
+	session_unlink(cache, session);
+	l_hashmap_remove(cache->sessions, session->id);
+	session_free(session);
+}
+
+/**
+ * l_tls_session_cache_new:
+ * @max_sessions: limit on the number of sessions in the cache, the least
+ *   recently used session is evicted to make room for a new one.  0 for
+ *   unlimited.
+ * @lifetime: a CLOCK_REALTIME-based microsecond resolution lifetime for
+ *   cached sessions.  The RFC recommends 24 hours.
+ *
+ * Returns: a new session cache to pass to l_tls_set_server_session_cache.
+ * It can be shared by any number of server l_tls objects in one thread and
+ * must outlive them.
+ */
+LIB_EXPORT struct l_tls_session_cache *l_tls_session_cache_new(
+						unsigned int max_sessions,
+						uint64_t lifetime)
+{
+	struct l_tls_session_cache *cache;
+
+	if (unlikely(!lifetime))
+		return NULL;
+
+	cache = l_new(struct l_tls_session_cache, 1);
+	cache->max_sessions = max_sessions;
+	cache->lifetime = lifetime;
+	cache->sessions = l_hashmap_new_sized(max_sessions ?: 64);
+	l_hashmap_set_hash_function(cache->sessions, session_id_hash);
+	l_hashmap_set_compare_function(cache->sessions, session_id_compare);
+
+	return cache;
+}
+
+LIB_EXPORT void l_tls_session_cache_free(struct l_tls_session_cache *cache)
+{
+	if (unlikely(!cache))
+		return;
+
+	l_hashmap_destroy(cache->sessions, session_free);
+	l_free(cache);
+}
+
+LIB_EXPORT unsigned int l_tls_session_cache_get_size(
+					struct l_tls_session_cache *cache)
+{
+	if (unlikely(!cache))
+		return 0;
+
+	return l_hashmap_size(cache->sessions);
+}
+
+uint64_t tls_session_cache_get_lifetime(
+				const struct l_tls_session_cache *cache)
+{
+	return cache->lifetime;
+}
+
+/* Returns the unexpired session with the given ID and marks it as used */
+const struct tls_cached_session *tls_session_cache_lookup(
+					struct l_tls_session_cache *cache,
+					const uint8_t *session_id,
+					size_t session_id_size)
+{
+	uint8_t key[33];
+	struct tls_cached_session *session;
+
+	if (!session_id_size || session_id_size > 32)
+		return NULL;
+
+	key[0] = session_id_size;
+	memcpy(key + 1, session_id, session_id_size);
+
+	session = l_hashmap_lookup(cache->sessions, key);
+	if (!session)
+		return NULL;
+
+	if (session->expiry_time <= time_realtime_now()) {
+		session_remove(cache, session);
+		return NULL;
+	}
+
+	session_unlink(cache, session);
+	session_link_head(cache, session);
+	return session;
+}
+
+/* Takes ownership of @session, replacing any session with the same ID */
+void tls_session_cache_add(struct l_tls_session_cache *cache,
+				struct tls_cached_session *session)
+{
+	uint64_t now = time_realtime_now();
+	struct tls_cached_session *old;
+
+	old = l_hashmap_lookup(cache->sessions, session->id);
+	if (old)
+		session_remove(cache, old);
+
+	/* Drop sessions at the end of the list that are expired or too many */
+	while (cache->tail && (cache->tail->expiry_time <= now ||
+				(cache->max_sessions &&
+				 l_hashmap_size(cache->sessions) >=
+				 cache->max_sessions)))
+		session_remove(cache, cache->tail);
+
+	l_hashmap_insert(cache->sessions, session->id, session);
+	session_link_head(cache, session);
+}
+
+void tls_session_cache_remove(struct l_tls_session_cache *cache,
+				const uint8_t *session_id,
+				size_t session_id_size)
+{
+	uint8_t key[33];
+	struct tls_cached_session *session;
+
+	if (!session_id_size || session_id_size > 32)
+		return;
+
+	key[0] = session_id_size;
+	memcpy(key + 1, session_id, session_id_size);
+
+	session = l_hashmap_lookup(cache->sessions, key);
+	if (session)
+		session_remove(cache, session);
+}
+
+/**
+ * l_tls_session_cache_save:
+ * @cache: session cache
+ * @settings: settings object to write the unexpired sessions to
+ * @group_prefix: prefix to build the group names from, existing groups
+ *   starting with the prefix are removed
+ *
+ * Writes the cache contents in the same format l_tls_set_session_cache
+ * uses so that it can be persisted and later restored with
+ * l_tls_session_cache_load.
+ */
+LIB_EXPORT bool l_tls_session_cache_save(struct l_tls_session_cache *cache,
+						struct l_settings *settings,
+						const char *group_prefix)
+{
+	_auto_(l_strv_free) char **groups = NULL;
+	char **group;
+	size_t prefix_len;
+	uint64_t now = time_realtime_now();
+	struct tls_cached_session *session;
+
+	if (unlikely(!cache || !settings || !group_prefix))
+		return false;
+
+	groups = l_settings_get_groups(settings);
+	prefix_len = strlen(group_prefix);
+
+	for (group = groups; *group; group++)
+		if (!strncmp(*group, group_prefix, prefix_len) &&
+				(*group)[prefix_len] == '-')
+			l_settings_remove_group(settings, *group);
+
+	/* Least recently used first so that loading restores the order */
+	for (session = cache->tail; session; session = session->prev) {
+		_auto_(l_free) char *id_str = NULL;
+		char group_name[256];
+
+		if (session->expiry_time <= now)
+			continue;
+
+		id_str = l_util_hexstring(session->id + 1, session->id[0]);
+		snprintf(group_name, sizeof(group_name), "%s-%s",
+				group_prefix, id_str);
+
+		l_settings_set_bytes(settings, group_name,
+					"SessionMasterSecret",
+					session->master_secret, 48);
+		l_settings_set_int(settings, group_name, "SessionVersion",
+					session->version);
+		l_settings_set_bytes(settings, group_name,
+					"SessionCipherSuite",
+					session->cipher_suite_id, 2);
+		l_settings_set_uint(settings, group_name,
+					"SessionCompressionMethod",
+					session->compression_method_id);
+		l_settings_set_uint64(settings, group_name,
+					"SessionExpiryTime",
+					session->expiry_time);
+
+		if (session->peer_identity)
+			l_settings_set_string(settings, group_name,
+						"SessionPeerIdentity",
+						session->peer_identity);
+	}
+
+	return true;
+}
+
+/**
+ * l_tls_session_cache_load:
+ * @cache: session cache
+ * @settings: settings object written by l_tls_session_cache_save or used
+ *   with l_tls_set_session_cache in server mode
+ * @group_prefix: prefix of the session groups in @settings
+ *
+ * Adds the unexpired sessions found in @settings to @cache.  Entries that
+ * can't be parsed are skipped.
+ */
+LIB_EXPORT bool l_tls_session_cache_load(struct l_tls_session_cache *cache,
+					const struct l_settings *settings,
+					const char *group_prefix)
+{
+	_auto_(l_strv_free) char **groups = NULL;
+	char **group;
+	size_t prefix_len;
+	uint64_t now = time_realtime_now();
+
+	if (unlikely(!cache || !settings || !group_prefix))
+		return false;
+
+	groups = l_settings_get_groups(settings);
+	prefix_len = strlen(group_prefix);
+
+	for (group = groups; *group; group++) {
+		_auto_(l_free) uint8_t *id = NULL;
+		_auto_(l_free) uint8_t *master_secret = NULL;
+		_auto_(l_free) uint8_t *cipher_suite_id = NULL;
+		struct tls_cached_session *session;
+		size_t id_size;
+		size_t size;
+		uint64_t expiry_time;
+		int version;
+		unsigned int compression_method_id;
+
+		if (strncmp(*group, group_prefix, prefix_len) ||
+				(*group)[prefix_len] != '-')
+			continue;
+
+		id = l_util_from_hexstring(*group + prefix_len + 1, &id_size);
+		if (!id || !id_size || id_size > 32)
+			continue;
+
+		if (!l_settings_get_uint64(settings, *group,
+						"SessionExpiryTime",
+						&expiry_time) ||
+				expiry_time <= now)
+			continue;
+
+		if (!l_settings_get_int(settings, *group, "SessionVersion",
+						&version) ||
+				!l_settings_get_uint(settings, *group,
+						"SessionCompressionMethod",
+						&compression_method_id) ||
+				compression_method_id > 0xff)
+			continue;
+
+		master_secret = l_settings_get_bytes(settings, *group,
+							"SessionMasterSecret",
+							&size);
+		if (!master_secret || size != 48)
+			continue;
+
+		cipher_suite_id = l_settings_get_bytes(settings, *group,
+							"SessionCipherSuite",
+							&size);
+		if (!cipher_suite_id || size != 2)
+			continue;
+
+		session = l_new(struct tls_cached_session, 1);
+		session->id[0] = id_size;
+		memcpy(session->id + 1, id, id_size);
+		session->version = version;
+		memcpy(session->cipher_suite_id, cipher_suite_id, 2);
+		session->compression_method_id = compression_method_id;
+		memcpy(session->master_secret, master_secret, 48);
+		session->expiry_time = expiry_time;
+		session->peer_identity = l_settings_get_string(settings,
+							*group,
+							"SessionPeerIdentity");
+		explicit_bzero(master_secret, 48);
+
+		tls_session_cache_add(cache, session);
+	}
+
+	return true;
+}
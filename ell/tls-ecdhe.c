@@ -0,0 +1,411 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "useful.h"
+#include "private.h"
+#include "tls.h"
+#include "checksum.h"
+#include "cipher.h"
+#include "ecc.h"
+#include "ecdh.h"
+#include "time.h"
+#include "key.h"
+#include "idle.h"
+#include "cert.h"
+#include "tls-private.h"
+
+/*
+ * Server ECDHE key pairs reused for a limited time.  Generating the key
+ * pair is the most expensive step of an ECDHE handshake on the server
+ * after the signature, so busy servers may trade some forward secrecy,
+ * limited to the reuse window, for CPU time.  There's one key pair per
+ * curve, replaced once it has been in use for the configured lifetime.
+ */
+#define ECDHE_KEY_CACHE_SIZE	8
+
+struct ecdhe_cached_key {
+	const struct l_ecc_curve *curve;
+	struct l_ecc_scalar *private;
+	struct l_ecc_point *public;
+	uint64_t expiry;
+};
+
+struct l_tls_ecdhe_key_cache {
+	uint64_t lifetime;
+	struct ecdhe_cached_key keys[ECDHE_KEY_CACHE_SIZE];
+};
+
+static void ecdhe_cached_key_clear(struct ecdhe_cached_key *key)
+{
+	l_ecc_scalar_free(key->private);
+	l_ecc_point_free(key->public);
+	key->curve = NULL;
+	key->private = NULL;
+	key->public = NULL;
+}
+
+/**
+ * l_tls_ecdhe_key_cache_new:
+ * @lifetime: time in microseconds for which one ECDHE key pair is used in
+ *   successive handshakes before a new one is generated
+ *
+ * Returns: a new key cache to pass to l_tls_set_ecdhe_key_cache.  It can
+ * be shared by any number of server l_tls objects in one thread and must
+ * outlive them.
+ */
+LIB_EXPORT struct l_tls_ecdhe_key_cache *l_tls_ecdhe_key_cache_new(
+							uint64_t lifetime)
+{
+	struct l_tls_ecdhe_key_cache *cache;
+
+	if (unlikely(!lifetime))
+		return NULL;
+
+	cache = l_new(struct l_tls_ecdhe_key_cache, 1);
+	cache->lifetime = lifetime;
+	return cache;
+}
+
+LIB_EXPORT void l_tls_ecdhe_key_cache_free(
+					struct l_tls_ecdhe_key_cache *cache)
+{
+	unsigned int i;
+
+	if (unlikely(!cache))
+		return;
+
+	for (i = 0; i < ECDHE_KEY_CACHE_SIZE; i++)
+		ecdhe_cached_key_clear(&cache->keys[i]);
+
+	l_free(cache);
+}
+
+/*
+ * Returns copies of the current key pair for @curve, generating a new one
+ * if there's none or it has expired.
+ */
+bool tls_ecdhe_key_cache_get(struct l_tls_ecdhe_key_cache *cache,
+				const struct l_ecc_curve *curve,
+				struct l_ecc_scalar **out_private,
+				struct l_ecc_point **out_public)
+{
+	uint64_t now = l_time_now();
+	struct ecdhe_cached_key *key = NULL;
+	struct ecdhe_cached_key *oldest = &cache->keys[0];
+	unsigned int i;
+
+	for (i = 0; i < ECDHE_KEY_CACHE_SIZE; i++) {
+		if (cache->keys[i].curve == curve) {
+			key = &cache->keys[i];
+			break;
+		}
+
+		if (!cache->keys[i].curve ||
+				(oldest->curve &&
+				 cache->keys[i].expiry < oldest->expiry))
+			oldest = &cache->keys[i];
+	}
+
+	if (key && l_time_after(now, key->expiry))
+		ecdhe_cached_key_clear(key);
+	else if (!key) {
+		ecdhe_cached_key_clear(oldest);
+		key = oldest;
+	}
+
+	if (!key->curve) {
+		if (!l_ecdh_generate_key_pair(curve, &key->private,
+						&key->public))
+			return false;
+
+		key->curve = curve;
+		key->expiry = now + cache->lifetime;
+	}
+
+	*out_private = l_ecc_scalar_clone(key->private);
+	*out_public = l_ecc_point_clone(key->public);
+	return true;
+}
+
+/*
+ * Ephemeral key pairs generated ahead of time, while the main loop is
+ * idle, for the TLS named groups added to the pool.  Unlike with the key
+ * cache above every key pair is used once, so this only moves the cost
+ * of generating it out of the handshake.  Handshakes that find the pool
+ * empty generate their key pair as usual.
+ */
+#define TLS_KEY_POOL_MAX_GROUPS	8
+
+struct key_pool_entry {
+	struct l_ecc_scalar *ec_private;
+	struct l_ecc_point *ec_public;
+	struct l_key *ff_private;
+	uint8_t *ff_public;
+};
+
+struct key_pool_group {
+	const struct tls_named_group *group;
+	const struct l_ecc_curve *curve;
+	struct l_key *prime;
+	struct l_key *generator;
+	struct key_pool_entry *entries;
+	unsigned int head;
+	unsigned int count;
+};
+
+struct l_tls_key_pool {
+	unsigned int depth;
+	struct key_pool_group groups[TLS_KEY_POOL_MAX_GROUPS];
+	unsigned int n_groups;
+	struct l_idle *refill;
+};
+
+static void key_pool_entry_clear(struct key_pool_entry *entry)
+{
+	l_ecc_scalar_free(entry->ec_private);
+	l_ecc_point_free(entry->ec_public);
+	l_key_free(entry->ff_private);
+	l_free(entry->ff_public);
+	memset(entry, 0, sizeof(*entry));
+}
+
+static bool key_pool_generate(struct key_pool_group *group,
+				struct key_pool_entry *entry)
+{
+	size_t public_len;
+
+	if (group->curve)
+		return l_ecdh_generate_key_pair(group->curve,
+						&entry->ec_private,
+						&entry->ec_public);
+
+	entry->ff_private = l_key_generate_dh_private(group->group->ff.prime,
+						group->group->ff.prime_len);
+	if (!entry->ff_private)
+		return false;
+
+	public_len = group->group->ff.prime_len;
+	entry->ff_public = l_malloc(public_len);
+
+	if (!l_key_compute_dh_public(group->generator, entry->ff_private,
+					group->prime, entry->ff_public,
+					&public_len) ||
+			public_len != group->group->ff.prime_len) {
+		key_pool_entry_clear(entry);
+		return false;
+	}
+
+	return true;
+}
+
+/* Generate one key pair per main loop iteration until the pool is full */
+static void key_pool_refill(struct l_idle *idle, void *user_data)
+{
+	struct l_tls_key_pool *pool = user_data;
+	struct key_pool_group *group = NULL;
+	unsigned int i;
+
+	for (i = 0; i < pool->n_groups && !group; i++)
+		if (pool->groups[i].count < pool->depth)
+			group = &pool->groups[i];
+
+	if (group) {
+		struct key_pool_entry *entry = &group->entries[
+			(group->head + group->count) % pool->depth];
+
+		if (key_pool_generate(group, entry)) {
+			group->count++;
+			return;
+		}
+	}
+
+	/* Full, or generation is failing, restarted by the next get */
+	l_idle_remove(pool->refill);
+	pool->refill = NULL;
+}
+
+static void key_pool_schedule_refill(struct l_tls_key_pool *pool)
+{
+	if (!pool->refill)
+		pool->refill = l_idle_create(key_pool_refill, pool, NULL);
+}
+
+static struct key_pool_entry *key_pool_pop(struct l_tls_key_pool *pool,
+					const struct tls_named_group *group)
+{
+	struct key_pool_entry *entry;
+	unsigned int i;
+
+	for (i = 0; i < pool->n_groups; i++)
+		if (pool->groups[i].group == group)
+			break;
+
+	if (i == pool->n_groups)
+		return NULL;
+
+	key_pool_schedule_refill(pool);
+
+	if (!pool->groups[i].count)
+		return NULL;
+
+	entry = &pool->groups[i].entries[pool->groups[i].head];
+	pool->groups[i].head = (pool->groups[i].head + 1) % pool->depth;
+	pool->groups[i].count--;
+	return entry;
+}
+
+/**
+ * l_tls_key_pool_new:
+ * @depth: number of key pairs kept ready for each group
+ *
+ * Returns: a new, empty, ephemeral key pool to pass to
+ * l_tls_set_key_pool.  Key pairs are generated from idle callbacks of
+ * the main loop of the thread that adds the groups.  The pool can be
+ * shared by any number of l_tls objects in that thread and must outlive
+ * them.
+ */
+LIB_EXPORT struct l_tls_key_pool *l_tls_key_pool_new(unsigned int depth)
+{
+	struct l_tls_key_pool *pool;
+
+	if (unlikely(!depth))
+		return NULL;
+
+	pool = l_new(struct l_tls_key_pool, 1);
+	pool->depth = depth;
+	return pool;
+}
+
+LIB_EXPORT void l_tls_key_pool_free(struct l_tls_key_pool *pool)
+{
+	unsigned int i;
+	unsigned int j;
+
+	if (unlikely(!pool))
+		return;
+
+	l_idle_remove(pool->refill);
+
+	for (i = 0; i < pool->n_groups; i++) {
+		struct key_pool_group *group = &pool->groups[i];
+
+		for (j = 0; j < pool->depth; j++)
+			key_pool_entry_clear(&group->entries[j]);
+
+		l_free(group->entries);
+		l_key_free(group->prime);
+		l_key_free(group->generator);
+	}
+
+	l_free(pool);
+}
+
+/**
+ * l_tls_key_pool_add_group:
+ * @pool: ephemeral key pool
+ * @group_id: TLS NamedGroup value of an elliptic curve, e.g. 23 for
+ *   secp256r1, or of an RFC 7919 finite field group, e.g. 256 for
+ *   ffdhe2048
+ *
+ * Starts keeping key pairs for @group_id ready.  The pool is filled in
+ * the background, starting with the next main loop iteration.
+ *
+ * Returns: true on success, false if the group is unknown, already in
+ * @pool or the pool has no room for more groups.
+ */
+LIB_EXPORT bool l_tls_key_pool_add_group(struct l_tls_key_pool *pool,
+						uint16_t group_id)
+{
+	const struct tls_named_group *named_group = tls_find_group(group_id);
+	struct key_pool_group *group;
+	uint8_t generator;
+	unsigned int i;
+
+	if (unlikely(!pool || !named_group))
+		return false;
+
+	if (pool->n_groups == TLS_KEY_POOL_MAX_GROUPS)
+		return false;
+
+	for (i = 0; i < pool->n_groups; i++)
+		if (pool->groups[i].group == named_group)
+			return false;
+
+	group = &pool->groups[pool->n_groups];
+	memset(group, 0, sizeof(*group));
+	group->group = named_group;
+
+	if (named_group->type == TLS_GROUP_TYPE_EC) {
+		group->curve = l_ecc_curve_from_tls_group(group_id);
+		if (!group->curve)
+			return false;
+	} else {
+		generator = named_group->ff.generator;
+		group->prime = l_key_new(L_KEY_RAW, named_group->ff.prime,
+						named_group->ff.prime_len);
+		group->generator = l_key_new(L_KEY_RAW, &generator, 1);
+
+		if (!group->prime || !group->generator) {
+			l_key_free(group->prime);
+			l_key_free(group->generator);
+			return false;
+		}
+	}
+
+	group->entries = l_new(struct key_pool_entry, pool->depth);
+	pool->n_groups++;
+	key_pool_schedule_refill(pool);
+	return true;
+}
+
+/*
+ * Moves a pre-generated EC key pair for @group out of @pool.  Returns
+ * false if the group isn't pooled or all its key pairs have been used.
+ */
+bool tls_key_pool_get_ec(struct l_tls_key_pool *pool,
+				const struct tls_named_group *group,
+				struct l_ecc_scalar **out_private,
+				struct l_ecc_point **out_public)
+{
+	struct key_pool_entry *entry = key_pool_pop(pool, group);
+
+	if (!entry)
+		return false;
+
+	*out_private = entry->ec_private;
+	*out_public = entry->ec_public;
+	entry->ec_private = NULL;
+	entry->ec_public = NULL;
+	return true;
+}
+
+/*
+ * Same for an FF DH private key and its public value, which is written to
+ * @out_public, the size of the group's prime.
+ */
+struct l_key *tls_key_pool_get_ff(struct l_tls_key_pool *pool,
+					const struct tls_named_group *group,
+					uint8_t *out_public)
+{
+	struct key_pool_entry *entry = key_pool_pop(pool, group);
+	struct l_key *private;
+
+	if (!entry)
+		return NULL;
+
+	private = entry->ff_private;
+	memcpy(out_public, entry->ff_public, group->ff.prime_len);
+	entry->ff_private = NULL;
+	key_pool_entry_clear(entry);
+	return private;
+}
@@ -17,6 +17,9 @@
 #include "checksum.h"
 #include "cert.h"
 #include "tls-private.h"
+#include "ecc.h"
+#include "ecc-private.h"
+#include "ecdh.h"
 
 /* Most extensions are not used when resuming a cached session */
 #define SKIP_ON_RESUMPTION()	\
@@ -319,6 +322,7 @@ static const uint8_t tls_dh14_prime[] = {
 };
 
 static const struct tls_named_group tls_group_pref[] = {
+	{ "x25519", 29, TLS_GROUP_TYPE_EC },
 	{ "secp256r1", 23, TLS_GROUP_TYPE_EC },
 	{ "secp384r1", 24, TLS_GROUP_TYPE_EC },
 	{
@@ -608,6 +612,8 @@ ssize_t tls_write_signature_algorithms(struct l_tls *tls,
 	uint8_t hash_ids[16];
 	unsigned int sig_alg_cnt = 0;
 	unsigned int hash_cnt = 0;
+	const struct tls13_signature_scheme *scheme;
+	unsigned int scheme_cnt = 0;
 
 	for (suite = tls->cipher_suite_pref_list; *suite; suite++) {
 		uint8_t id;
@@ -650,18 +656,37 @@ ssize_t tls_write_signature_algorithms(struct l_tls *tls,
 			hash_ids[hash_cnt++] = hash->tls_id;
 	}
 
-	if (len < 2 + sig_alg_cnt * hash_cnt * 2)
+	/* The TLS 1.3 SignatureSchemes go first when we offer 1.3 */
+	if (tls->tls13_offered)
+		for (scheme = tls13_signature_schemes; scheme->name; scheme++)
+			if (l_checksum_is_supported(scheme->hash, false))
+				scheme_cnt++;
+
+	if (len < 2 + (scheme_cnt + sig_alg_cnt * hash_cnt) * 2)
 		return -ENOMEM;
 
-	l_put_be16(sig_alg_cnt * hash_cnt * 2, ptr);
 	ptr += 2;
 
+	if (scheme_cnt)
+		for (scheme = tls13_signature_schemes; scheme->name; scheme++)
+			if (l_checksum_is_supported(scheme->hash, false)) {
+				l_put_be16(scheme->id, ptr);
+				ptr += 2;
+			}
+
 	for (i = 0; i < sig_alg_cnt; i++)
 		for (j = 0; j < hash_cnt; j++) {
-			*ptr++ = hash_ids[j];
-			*ptr++ = sig_alg_ids[i];
+			uint16_t id = (hash_ids[j] << 8) | sig_alg_ids[i];
+
+			/* ECDSA schemes reuse the 1.2 ids, skip duplicates */
+			if (scheme_cnt && tls13_find_signature_scheme(id))
+				continue;
+
+			l_put_be16(id, ptr);
+			ptr += 2;
 		}
 
+	l_put_be16(ptr - buf - 2, buf);
 	return ptr - buf;
 }
 
@@ -837,6 +862,115 @@ static bool tls_signature_algorithms_client_absent(struct l_tls *tls)
 	return true;
 }
 
+/* RFC 5077, Section 3.2 */
+static ssize_t tls_session_ticket_client_write(struct l_tls *tls,
+						uint8_t *buf, size_t len)
+{
+	/* Tickets are kept in the session cache */
+	if (!tls->session_settings)
+		return -ENOMSG;
+
+	if (len < tls->session_ticket_len)
+		return -ENOMEM;
+
+	if (tls->session_ticket_len)
+		memcpy(buf, tls->session_ticket, tls->session_ticket_len);
+
+	return tls->session_ticket_len;
+}
+
+static bool tls_session_ticket_client_handle(struct l_tls *tls,
+						const uint8_t *buf, size_t len)
+{
+	if (!tls->ticket_keys)
+		return true;
+
+	tls->session_ticket_send = true;
+
+	if (len) {
+		l_free(tls->session_ticket);
+		tls->session_ticket = l_memdup(buf, len);
+		tls->session_ticket_len = len;
+	}
+
+	return true;
+}
+
+static ssize_t tls_session_ticket_server_write(struct l_tls *tls,
+						uint8_t *buf, size_t len)
+{
+	if (!tls->session_ticket_send)
+		return -ENOMSG;
+
+	return 0;
+}
+
+static bool tls_session_ticket_server_handle(struct l_tls *tls,
+						const uint8_t *buf, size_t len)
+{
+	/* The server's extension is always empty, RFC 5077 Section 3.2 */
+	if (len)
+		return false;
+
+	tls->session_ticket_expected = true;
+	return true;
+}
+
+/* RFC 6066, Section 8 */
+static ssize_t tls_status_request_client_write(struct l_tls *tls,
+						uint8_t *buf, size_t len)
+{
+	if (tls->ocsp_stapling == L_TLS_OCSP_STAPLING_OFF)
+		return -ENOMSG;
+
+	if (len < 5)
+		return -ENOMEM;
+
+	/* ocsp(1), no responder IDs and no request extensions */
+	buf[0] = 1;
+	l_put_be16(0, buf + 1);
+	l_put_be16(0, buf + 3);
+	return 5;
+}
+
+static bool tls_status_request_client_handle(struct l_tls *tls,
+						const uint8_t *buf, size_t len)
+{
+	size_t response_len;
+
+	if (len < 1)
+		return false;
+
+	/* Ignore status types other than OCSP */
+	if (buf[0] != 1 || !tls->ocsp_cache || !tls->cert)
+		return true;
+
+	tls->ocsp_status_send = tls_ocsp_cache_lookup(tls->ocsp_cache,
+					l_certchain_get_leaf(tls->cert),
+					&response_len) != NULL;
+	return true;
+}
+
+static ssize_t tls_status_request_server_write(struct l_tls *tls,
+						uint8_t *buf, size_t len)
+{
+	if (!tls->ocsp_status_send)
+		return -ENOMSG;
+
+	return 0;
+}
+
+static bool tls_status_request_server_handle(struct l_tls *tls,
+						const uint8_t *buf, size_t len)
+{
+	/* The server's extension is always empty */
+	if (len)
+		return false;
+
+	tls->ocsp_status_expected = true;
+	return true;
+}
+
 /* RFC 5746, Section 3.2 */
 static ssize_t tls_renegotiation_info_client_write(struct l_tls *tls,
 						uint8_t *buf, size_t len)
@@ -961,7 +1095,237 @@ static bool tls_renegotiation_info_absent(struct l_tls *tls)
 	return !tls->ready || !tls->renegotiation_info.secure_renegotiation;
 }
 
+/* RFC 8446 Section 4.2.1 */
+static ssize_t tls_supported_versions_client_write(struct l_tls *tls,
+						uint8_t *buf, size_t len)
+{
+	uint8_t *ptr = buf + 1;
+	enum l_tls_version version;
+
+	if (!tls->tls13_offered)
+		return -ENOMSG;
+
+	if (len < 1 + 2 * (tls->max_version - tls->min_version + 1))
+		return -ENOMEM;
+
+	for (version = tls->max_version; version >= tls->min_version;
+			version--) {
+		l_put_be16(version, ptr);
+		ptr += 2;
+	}
+
+	buf[0] = ptr - buf - 1;
+	return ptr - buf;
+}
+
+/*
+ * Our server only does TLS 1.2 and lower so the TLS 1.3 extensions in
+ * a Client Hello are ignored.
+ */
+static bool tls13_extension_client_handle(struct l_tls *tls,
+						const uint8_t *buf, size_t len)
+{
+	return true;
+}
+
+/* RFC 8446 Section 4.2.2, echo the HelloRetryRequest's cookie */
+static ssize_t tls_cookie_client_write(struct l_tls *tls,
+					uint8_t *buf, size_t len)
+{
+	if (!tls->tls13_offered || !tls->tls13_cookie_len)
+		return -ENOMSG;
+
+	if (len < 2 + tls->tls13_cookie_len)
+		return -ENOMEM;
+
+	l_put_be16(tls->tls13_cookie_len, buf);
+	memcpy(buf + 2, tls->tls13_cookie, tls->tls13_cookie_len);
+	return 2 + tls->tls13_cookie_len;
+}
+
+void tls13_key_share_free(struct l_tls *tls)
+{
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(tls->tls13_key_share); i++) {
+		l_ecc_scalar_free(tls->tls13_key_share[i].private);
+		l_ecc_point_free(tls->tls13_key_share[i].public);
+		tls->tls13_key_share[i].private = NULL;
+		tls->tls13_key_share[i].public = NULL;
+		tls->tls13_key_share[i].group = NULL;
+	}
+}
+
+static bool tls13_key_share_generate(struct l_tls *tls)
+{
+	unsigned int i;
+	unsigned int n = 0;
+
+	tls13_key_share_free(tls);
+
+	for (i = 0; i < L_ARRAY_SIZE(tls_group_pref) &&
+			n < L_ARRAY_SIZE(tls->tls13_key_share); i++) {
+		const struct tls_named_group *group = &tls_group_pref[i];
+		const struct l_ecc_curve *curve;
+		struct l_ecc_scalar *private;
+		struct l_ecc_point *public;
+
+		if (group->type != TLS_GROUP_TYPE_EC)
+			continue;
+
+		if (tls->tls13_hrr_group && group != tls->tls13_hrr_group)
+			continue;
+
+		curve = l_ecc_curve_from_tls_group(group->id);
+		if (!curve)
+			continue;
+
+		if ((!tls->key_pool ||
+				!tls_key_pool_get_ec(tls->key_pool, group,
+							&private, &public)) &&
+				!l_ecdh_generate_key_pair(curve, &private,
+								&public))
+			return false;
+
+		tls->tls13_key_share[n].group = group;
+		tls->tls13_key_share[n].private = private;
+		tls->tls13_key_share[n++].public = public;
+	}
+
+	return n > 0;
+}
+
+/*
+ * RFC 8446 Section 4.2.8: send shares for our two most preferred elliptic
+ * curve groups, the server can ask for another group from the Supported
+ * Groups extension in a HelloRetryRequest and then only that group's
+ * share is sent.  A HelloRetryRequest without a key_share keeps the
+ * shares unchanged.
+ */
+static ssize_t tls_key_share_client_write(struct l_tls *tls,
+						uint8_t *buf, size_t len)
+{
+	uint8_t *ptr = buf + 2;
+	unsigned int i;
+
+	if (!tls->tls13_offered)
+		return -ENOMSG;
+
+	if ((!tls->tls13_hrr || tls->tls13_hrr_group) &&
+			!tls13_key_share_generate(tls))
+		return -EIO;
+
+	for (i = 0; i < L_ARRAY_SIZE(tls->tls13_key_share); i++) {
+		struct l_ecc_point *public = tls->tls13_key_share[i].public;
+		const struct l_ecc_curve *curve;
+		size_t point_len;
+
+		if (!public)
+			continue;
+
+		/* KeyShareEntry, RFC 8446 Section 4.2.8.2 */
+		curve = l_ecc_point_get_curve(public);
+		point_len = l_ecc_curve_get_scalar_bytes(curve);
+		if (!curve->montgomery)
+			point_len = 1 + 2 * point_len;
+
+		if (len < (size_t) (ptr - buf) + 4 + point_len)
+			return -ENOMEM;
+
+		l_put_be16(tls->tls13_key_share[i].group->id, ptr);
+		l_put_be16(point_len, ptr + 2);
+		ptr += 4;
+
+		if (!curve->montgomery)
+			*ptr++ = 4;	/* uncompressed */
+
+		ptr += l_ecc_point_get_data(public, ptr, buf + len - ptr);
+	}
+
+	l_put_be16(ptr - buf - 2, buf);
+	return ptr - buf;
+}
+
+/*
+ * Computes the (EC)DHE shared secret from the KeyShareEntry in the Server
+ * Hello.  Returns -EBADMSG on decode errors and -EINVAL if the entry
+ * doesn't match a share we sent or the public value is invalid.
+ */
+int tls13_key_share_get_secret(struct l_tls *tls,
+				const uint8_t *buf, size_t len,
+				uint8_t *out, size_t *out_len)
+{
+	struct l_ecc_scalar *private = NULL;
+	const struct l_ecc_curve *curve;
+	struct l_ecc_point *public;
+	struct l_ecc_scalar *secret;
+	uint16_t group_id;
+	size_t point_len;
+	unsigned int i;
+	ssize_t r;
+
+	if (len < 4 || l_get_be16(buf + 2) != len - 4)
+		return -EBADMSG;
+
+	group_id = l_get_be16(buf);
+	buf += 4;
+	len -= 4;
+
+	for (i = 0; i < L_ARRAY_SIZE(tls->tls13_key_share); i++)
+		if (tls->tls13_key_share[i].group &&
+				tls->tls13_key_share[i].group->id == group_id)
+			private = tls->tls13_key_share[i].private;
+
+	if (!private)
+		return -EINVAL;
+
+	curve = l_ecc_curve_from_tls_group(group_id);
+	point_len = l_ecc_curve_get_scalar_bytes(curve);
+
+	if (!curve->montgomery) {
+		if (len < 1 || buf[0] != 4)
+			return -EINVAL;
+
+		buf++;
+		len--;
+		point_len *= 2;
+	}
+
+	if (len != point_len)
+		return -EINVAL;
+
+	public = l_ecc_point_from_data(curve, curve->montgomery ?
+					L_ECC_POINT_TYPE_COMPLIANT :
+					L_ECC_POINT_TYPE_FULL, buf, len);
+	if (!public)
+		return -EINVAL;
+
+	if (!l_ecdh_generate_shared_secret(private, public, &secret)) {
+		l_ecc_point_free(public);
+		return -EINVAL;
+	}
+
+	l_ecc_point_free(public);
+	r = l_ecc_scalar_get_data(secret, out, *out_len);
+	l_ecc_scalar_free(secret);
+
+	if (r < 0)
+		return r;
+
+	*out_len = r;
+	return 0;
+}
+
 const struct tls_hello_extension tls_extensions[] = {
+	{
+		"Certificate Status Request", "status_request", 5,
+		tls_status_request_client_write,
+		tls_status_request_client_handle,
+		NULL,
+		tls_status_request_server_write,
+		tls_status_request_server_handle,
+		NULL,
+	},
 	{
 		"Supported Groups", "elliptic_curves", 10,
 		tls_elliptic_curves_client_write,
@@ -984,6 +1348,36 @@ const struct tls_hello_extension tls_extensions[] = {
 		tls_signature_algorithms_client_absent,
 		NULL, NULL, NULL,
 	},
+	{
+		"Session Ticket", "SessionTicket", 35,
+		tls_session_ticket_client_write,
+		tls_session_ticket_client_handle,
+		NULL,
+		tls_session_ticket_server_write,
+		tls_session_ticket_server_handle,
+		NULL,
+	},
+	{
+		"Supported Versions", "supported_versions", 43,
+		tls_supported_versions_client_write,
+		tls13_extension_client_handle,
+		NULL,
+		NULL, NULL, NULL,
+	},
+	{
+		"Cookie", "cookie", 44,
+		tls_cookie_client_write,
+		tls13_extension_client_handle,
+		NULL,
+		NULL, NULL, NULL,
+	},
+	{
+		"Key Share", "key_share", 51,
+		tls_key_share_client_write,
+		tls13_extension_client_handle,
+		NULL,
+		NULL, NULL, NULL,
+	},
 	{
 		"Secure Renegotiation", "renegotiation_info", 0xff01,
 		tls_renegotiation_info_client_write,
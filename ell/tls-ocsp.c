@@ -0,0 +1,963 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "useful.h"
+#include "private.h"
+#include "tls.h"
+#include "checksum.h"
+#include "cipher.h"
+#include "queue.h"
+#include "timeout.h"
+#include "time.h"
+#include "time-private.h"
+#include "asn1-private.h"
+#include "cert.h"
+#include "cert-private.h"
+#include "tls-private.h"
+
+/*
+ * OCSP (RFC 6960) responses for the RFC 6066 status_request extension.
+ * Servers keep one response per certificate, fetched by the application
+ * through a callback and refreshed in the background well before it
+ * expires, so that the handshake never waits for the OCSP responder.
+ * Clients check a stapled response against the server certificate and
+ * its issuer.
+ */
+#define OCSP_CLOCK_SKEW		(5 * 60 * L_USEC_PER_SEC)
+/* Validity assumed for responses without a nextUpdate */
+#define OCSP_DEFAULT_VALIDITY	(24 * 3600 * L_USEC_PER_SEC)
+#define OCSP_RETRY_INTERVAL	300
+#define OCSP_MIN_REFRESH	60
+#define OCSP_MAX_REFRESH	(24 * 3600)
+
+#define ASN1_ID_ENUMERATED	ASN1_ID(ASN1_CLASS_UNIVERSAL, 0, 0x0a)
+#define OCSP_ID_EXPLICIT(n)	ASN1_ID(ASN1_CLASS_CONTEXT, 1, (n))
+#define OCSP_ID_IMPLICIT(n)	ASN1_ID(ASN1_CLASS_CONTEXT, 0, (n))
+
+static const struct asn1_oid ocsp_basic_oid = {
+	9, { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x30, 0x01, 0x01 }
+};
+
+static const struct asn1_oid ocsp_signing_oid = {
+	8, { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x03, 0x09 }
+};
+
+static const struct asn1_oid ext_key_usage_oid = {
+	3, { 0x55, 0x1d, 0x25 }
+};
+
+static const struct asn1_oid authority_info_access_oid = {
+	8, { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x01, 0x01 }
+};
+
+static const struct asn1_oid ad_ocsp_oid = {
+	8, { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x30, 0x01 }
+};
+
+static const struct ocsp_hash_alg {
+	enum l_checksum_type type;
+	struct asn1_oid oid;
+} ocsp_hash_algs[] = {
+	{ L_CHECKSUM_SHA1, { 5, { 0x2b, 0x0e, 0x03, 0x02, 0x1a } } },
+	{ L_CHECKSUM_SHA256, { 9, {
+		0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01 } } },
+};
+
+/*
+ * Return the contents of the next element in @buf and advance @buf and
+ * @len past it.  Unlike asn1_der_find_elem this walks the elements in
+ * order, which OCSP needs because some of its context tags are reused.
+ */
+static const uint8_t *ocsp_next_elem(const uint8_t **buf, size_t *len,
+					uint8_t tag, size_t *out_len)
+{
+	const uint8_t *ptr = *buf;
+	size_t left = *len;
+	int elem_len;
+
+	if (left < 2 || *ptr != tag)
+		return NULL;
+
+	ptr++;
+	left--;
+
+	elem_len = asn1_parse_definite_length(&ptr, &left);
+	if (elem_len < 0 || (size_t) elem_len > left)
+		return NULL;
+
+	/* @out_len may alias @len when descending into the element */
+	*buf = ptr + elem_len;
+	*len = left - elem_len;
+	*out_len = elem_len;
+	return ptr;
+}
+
+static size_t ocsp_header_len(size_t len)
+{
+	size_t n = 2;
+
+	for (; len >= 0x80; len >>= 8)
+		n++;
+
+	return n;
+}
+
+static void ocsp_write_header(uint8_t **buf, uint8_t tag, size_t len)
+{
+	*(*buf)++ = tag;
+	asn1_write_definite_length(buf, len);
+}
+
+static bool ocsp_digest(enum l_checksum_type type, uint8_t *out,
+			size_t iovcnt, ...)
+{
+	struct l_checksum *checksum = l_checksum_new(type);
+	struct iovec iov[2];
+	va_list args;
+	size_t i;
+	bool r;
+
+	if (!checksum)
+		return false;
+
+	va_start(args, iovcnt);
+
+	for (i = 0; i < iovcnt; i++) {
+		iov[i].iov_base = va_arg(args, void *);
+		iov[i].iov_len = va_arg(args, size_t);
+	}
+
+	va_end(args);
+
+	r = l_checksum_updatev(checksum, iov, iovcnt) &&
+		l_checksum_get_digest(checksum, out,
+				l_checksum_digest_length(type)) > 0;
+	l_checksum_free(checksum);
+	return r;
+}
+
+/* The CertID hashes of RFC 6960 Section 4.1.1 over the whole issuer DN */
+static bool ocsp_issuer_hashes(struct l_cert *issuer,
+				enum l_checksum_type type,
+				uint8_t *name_hash, uint8_t *key_hash)
+{
+	const uint8_t *dn;
+	const uint8_t *key;
+	size_t dn_len;
+	size_t key_len;
+	uint8_t header[8];
+	uint8_t *ptr = header;
+
+	dn = l_cert_get_dn(issuer, &dn_len);
+	key = cert_get_pubkey_bits(issuer, &key_len);
+	if (!dn || !key)
+		return false;
+
+	ocsp_write_header(&ptr, ASN1_ID_SEQUENCE, dn_len);
+
+	return ocsp_digest(type, name_hash, 2, header, ptr - header,
+				dn, dn_len) &&
+		ocsp_digest(type, key_hash, 1, key, key_len);
+}
+
+static bool ocsp_match_cert_id(const uint8_t *cert_id, size_t len,
+				struct l_cert *cert, struct l_cert *issuer)
+{
+	const uint8_t *alg_id;
+	const uint8_t *oid;
+	const uint8_t *name_hash;
+	const uint8_t *key_hash;
+	const uint8_t *serial;
+	const uint8_t *cert_serial;
+	size_t alg_id_len;
+	size_t oid_len;
+	size_t name_hash_len;
+	size_t key_hash_len;
+	size_t serial_len;
+	size_t cert_serial_len;
+	uint8_t expected[2][64];
+	unsigned int i;
+
+	alg_id = ocsp_next_elem(&cert_id, &len, ASN1_ID_SEQUENCE, &alg_id_len);
+	name_hash = ocsp_next_elem(&cert_id, &len, ASN1_ID_OCTET_STRING,
+					&name_hash_len);
+	key_hash = ocsp_next_elem(&cert_id, &len, ASN1_ID_OCTET_STRING,
+					&key_hash_len);
+	serial = ocsp_next_elem(&cert_id, &len, ASN1_ID_INTEGER, &serial_len);
+	if (!alg_id || !name_hash || !key_hash || !serial)
+		return false;
+
+	cert_serial = cert_get_serial(cert, &cert_serial_len);
+	if (!cert_serial || serial_len != cert_serial_len ||
+			memcmp(serial, cert_serial, serial_len))
+		return false;
+
+	oid = ocsp_next_elem(&alg_id, &alg_id_len, ASN1_ID_OID, &oid_len);
+	if (!oid)
+		return false;
+
+	for (i = 0; i < L_ARRAY_SIZE(ocsp_hash_algs); i++)
+		if (asn1_oid_eq(&ocsp_hash_algs[i].oid, oid_len, oid))
+			break;
+
+	if (i == L_ARRAY_SIZE(ocsp_hash_algs))
+		return false;
+
+	if ((ssize_t) name_hash_len !=
+			l_checksum_digest_length(ocsp_hash_algs[i].type) ||
+			key_hash_len != name_hash_len)
+		return false;
+
+	if (!ocsp_issuer_hashes(issuer, ocsp_hash_algs[i].type,
+				expected[0], expected[1]))
+		return false;
+
+	return !memcmp(name_hash, expected[0], name_hash_len) &&
+		!memcmp(key_hash, expected[1], key_hash_len);
+}
+
+static bool ocsp_cert_is_responder(struct l_cert *cert,
+					const uint8_t *name, size_t name_len,
+					const uint8_t *key_hash,
+					size_t key_hash_len)
+{
+	const uint8_t *dn;
+	const uint8_t *key;
+	size_t dn_len;
+	size_t key_len;
+	uint8_t hash[20];
+
+	if (name) {
+		dn = l_cert_get_dn(cert, &dn_len);
+		return dn && dn_len == name_len && !memcmp(dn, name, dn_len);
+	}
+
+	key = cert_get_pubkey_bits(cert, &key_len);
+
+	return key && key_hash_len == sizeof(hash) &&
+		ocsp_digest(L_CHECKSUM_SHA1, hash, 1, key, key_len) &&
+		!memcmp(hash, key_hash, sizeof(hash));
+}
+
+/*
+ * RFC 6960 Section 4.2.2.2: the response is signed either by the issuer
+ * itself or by a responder certificate issued by it for OCSP signing.
+ */
+static bool ocsp_responder_is_authorized(struct l_cert *responder,
+						struct l_cert *issuer,
+						uint64_t now)
+{
+	const uint8_t *dn;
+	const uint8_t *issuer_dn;
+	const uint8_t *ext;
+	const uint8_t *seq;
+	const uint8_t *der;
+	size_t dn_len;
+	size_t issuer_dn_len;
+	size_t ext_len;
+	size_t seq_len;
+	size_t der_len;
+	uint64_t not_before;
+	uint64_t not_after;
+
+	dn = l_cert_get_dn(issuer, &dn_len);
+	issuer_dn = cert_get_issuer_dn(responder, &issuer_dn_len);
+	if (!dn || !issuer_dn || dn_len != issuer_dn_len ||
+			memcmp(dn, issuer_dn, dn_len))
+		return false;
+
+	if (!l_cert_get_valid_times(responder, &not_before, &not_after) ||
+			now < not_before || (not_after && now > not_after))
+		return false;
+
+	ext = cert_get_extension(responder, &ext_key_usage_oid, NULL,
+					&ext_len);
+	seq = ext ? ocsp_next_elem(&ext, &ext_len, ASN1_ID_SEQUENCE,
+					&seq_len) : NULL;
+	if (!seq)
+		return false;
+
+	while (seq_len) {
+		const uint8_t *oid;
+		size_t oid_len;
+
+		oid = ocsp_next_elem(&seq, &seq_len, ASN1_ID_OID, &oid_len);
+		if (!oid)
+			return false;
+
+		if (asn1_oid_eq(&ocsp_signing_oid, oid_len, oid)) {
+			der = l_cert_get_der_data(responder, &der_len);
+			return cert_verify_signed_data(der, der_len, issuer);
+		}
+	}
+
+	return false;
+}
+
+static bool ocsp_find_signer(const uint8_t *responder_id, uint8_t tag,
+				size_t id_len, const uint8_t *certs,
+				size_t certs_len, struct l_cert *issuer,
+				uint64_t now, struct l_cert **out_signer)
+{
+	const uint8_t *name = NULL;
+	const uint8_t *key_hash = NULL;
+	size_t name_len = 0;
+	size_t key_hash_len = 0;
+
+	if (tag == OCSP_ID_EXPLICIT(1))
+		name = ocsp_next_elem(&responder_id, &id_len,
+					ASN1_ID_SEQUENCE, &name_len);
+	else
+		key_hash = ocsp_next_elem(&responder_id, &id_len,
+					ASN1_ID_OCTET_STRING, &key_hash_len);
+
+	if (!name && !key_hash)
+		return false;
+
+	if (ocsp_cert_is_responder(issuer, name, name_len,
+					key_hash, key_hash_len)) {
+		*out_signer = NULL;
+		return true;
+	}
+
+	while (certs_len) {
+		const uint8_t *start = certs;
+		const uint8_t *seq;
+		size_t seq_len;
+		struct l_cert *cert;
+
+		seq = ocsp_next_elem(&certs, &certs_len, ASN1_ID_SEQUENCE,
+					&seq_len);
+		if (!seq)
+			return false;
+
+		cert = l_cert_new_from_der(start, certs - start);
+		if (!cert)
+			continue;
+
+		if (ocsp_cert_is_responder(cert, name, name_len,
+						key_hash, key_hash_len) &&
+				ocsp_responder_is_authorized(cert, issuer,
+								now)) {
+			*out_signer = cert;
+			return true;
+		}
+
+		l_cert_free(cert);
+	}
+
+	return false;
+}
+
+static uint64_t ocsp_parse_time(const uint8_t **buf, size_t *len)
+{
+	const uint8_t *time;
+	size_t time_len;
+
+	time = ocsp_next_elem(buf, len, ASN1_ID_GENERALIZEDTIME, &time_len);
+	if (!time)
+		return L_TIME_INVALID;
+
+	return cert_parse_asn1_time(time, time_len, ASN1_ID_GENERALIZEDTIME);
+}
+
+/*
+ * Find the SingleResponse for @cert in @responses and check that it's
+ * current.  Returns 0 if the certificate is good, -EKEYREVOKED if it's
+ * revoked or -ENOKEY if its status is unknown.
+ */
+static int ocsp_check_single_response(const uint8_t *responses, size_t len,
+					struct l_cert *cert,
+					struct l_cert *issuer, uint64_t now,
+					uint64_t *out_next_update,
+					const char **error)
+{
+	while (len) {
+		const uint8_t *single;
+		const uint8_t *cert_id;
+		const uint8_t *status;
+		size_t single_len;
+		size_t cert_id_len;
+		size_t status_len;
+		uint64_t this_update;
+		uint64_t next_update = 0;
+		int r;
+
+		single = ocsp_next_elem(&responses, &len, ASN1_ID_SEQUENCE,
+					&single_len);
+		if (!single)
+			goto decode_error;
+
+		cert_id = ocsp_next_elem(&single, &single_len,
+					ASN1_ID_SEQUENCE, &cert_id_len);
+		if (!cert_id)
+			goto decode_error;
+
+		if (!ocsp_match_cert_id(cert_id, cert_id_len, cert, issuer))
+			continue;
+
+		if ((status = ocsp_next_elem(&single, &single_len,
+						OCSP_ID_IMPLICIT(0),
+						&status_len)))
+			r = 0;
+		else if ((status = ocsp_next_elem(&single, &single_len,
+						OCSP_ID_EXPLICIT(1),
+						&status_len)))
+			r = -EKEYREVOKED;
+		else if ((status = ocsp_next_elem(&single, &single_len,
+						OCSP_ID_IMPLICIT(2),
+						&status_len)))
+			r = -ENOKEY;
+		else
+			goto decode_error;
+
+		this_update = ocsp_parse_time(&single, &single_len);
+		if (this_update == L_TIME_INVALID)
+			goto decode_error;
+
+		if (single_len && *single == OCSP_ID_EXPLICIT(0)) {
+			const uint8_t *inner;
+			size_t inner_len;
+
+			inner = ocsp_next_elem(&single, &single_len,
+						OCSP_ID_EXPLICIT(0),
+						&inner_len);
+			if (!inner)
+				goto decode_error;
+
+			next_update = ocsp_parse_time(&inner, &inner_len);
+			if (next_update == L_TIME_INVALID)
+				goto decode_error;
+		} else
+			next_update = this_update + OCSP_DEFAULT_VALIDITY;
+
+		if (this_update > now + OCSP_CLOCK_SKEW ||
+				next_update + OCSP_CLOCK_SKEW < now) {
+			*error = "OCSP response is not current";
+			return -ESTALE;
+		}
+
+		if (out_next_update)
+			*out_next_update = next_update;
+
+		if (r == -EKEYREVOKED)
+			*error = "Certificate revoked";
+		else if (r == -ENOKEY)
+			*error = "Certificate status unknown to the responder";
+
+		return r;
+	}
+
+	*error = "No status for the certificate in OCSP response";
+	return -ENOKEY;
+
+decode_error:
+	*error = "Can't parse OCSP SingleResponse";
+	return -EBADMSG;
+}
+
+/*
+ * Check an OCSPResponse for @cert issued by @issuer.  Returns 0 if the
+ * response is authentic and current and the certificate is good,
+ * -EKEYREVOKED if it's revoked, -ENOKEY if its status is unknown and
+ * other negative errors if the response can't be trusted, with @error
+ * set to a static string.  @out_next_update is set when the response
+ * can be used, i.e. on 0 and -EKEYREVOKED.
+ */
+int tls_ocsp_verify(const uint8_t *response, size_t len,
+			struct l_cert *cert, struct l_cert *issuer,
+			uint64_t now, uint64_t *out_next_update,
+			const char **error)
+{
+	const uint8_t *seq;
+	const uint8_t *status;
+	const uint8_t *bytes;
+	const uint8_t *oid;
+	const uint8_t *basic;
+	const uint8_t *tbs;
+	const uint8_t *tbs_start;
+	const uint8_t *alg_id;
+	const uint8_t *sig;
+	const uint8_t *certs = NULL;
+	const uint8_t *responder_id;
+	const uint8_t *responses;
+	size_t seq_len;
+	size_t status_len;
+	size_t bytes_len;
+	size_t oid_len;
+	size_t basic_len;
+	size_t tbs_len;
+	size_t alg_id_len;
+	size_t sig_len;
+	size_t certs_len = 0;
+	size_t responder_id_len;
+	size_t responses_len;
+	uint8_t responder_tag;
+	struct l_cert *signer;
+	bool verified;
+
+	seq = ocsp_next_elem(&response, &len, ASN1_ID_SEQUENCE, &seq_len);
+	if (!seq)
+		goto decode_error;
+
+	status = ocsp_next_elem(&seq, &seq_len, ASN1_ID_ENUMERATED,
+				&status_len);
+	if (!status || status_len != 1)
+		goto decode_error;
+
+	if (status[0] != 0) {
+		*error = "OCSP responder returned an error";
+		return -EPROTO;
+	}
+
+	/* ResponseBytes are [0] EXPLICIT and contain an OCTET STRING */
+	bytes = ocsp_next_elem(&seq, &seq_len, OCSP_ID_EXPLICIT(0),
+				&bytes_len);
+	bytes = bytes ? ocsp_next_elem(&bytes, &bytes_len, ASN1_ID_SEQUENCE,
+					&bytes_len) : NULL;
+	if (!bytes)
+		goto decode_error;
+
+	oid = ocsp_next_elem(&bytes, &bytes_len, ASN1_ID_OID, &oid_len);
+	if (!oid || !asn1_oid_eq(&ocsp_basic_oid, oid_len, oid)) {
+		*error = "Unsupported OCSP response type";
+		return -EBADMSG;
+	}
+
+	bytes = ocsp_next_elem(&bytes, &bytes_len, ASN1_ID_OCTET_STRING,
+				&bytes_len);
+	basic = bytes ? ocsp_next_elem(&bytes, &bytes_len, ASN1_ID_SEQUENCE,
+					&basic_len) : NULL;
+	if (!basic)
+		goto decode_error;
+
+	/* BasicOCSPResponse */
+	tbs_start = basic;
+	tbs = ocsp_next_elem(&basic, &basic_len, ASN1_ID_SEQUENCE, &tbs_len);
+	alg_id = ocsp_next_elem(&basic, &basic_len, ASN1_ID_SEQUENCE,
+				&alg_id_len);
+	sig = ocsp_next_elem(&basic, &basic_len, ASN1_ID_BIT_STRING, &sig_len);
+	if (!tbs || !alg_id || !sig)
+		goto decode_error;
+
+	if (basic_len) {
+		certs = ocsp_next_elem(&basic, &basic_len,
+					OCSP_ID_EXPLICIT(0), &certs_len);
+		certs = certs ? ocsp_next_elem(&certs, &certs_len,
+						ASN1_ID_SEQUENCE,
+						&certs_len) : NULL;
+		if (!certs)
+			goto decode_error;
+	}
+
+	/* ResponseData, only v1 is defined */
+	if (tbs_len && *tbs == OCSP_ID_EXPLICIT(0)) {
+		const uint8_t *version;
+		size_t version_len;
+
+		version = ocsp_next_elem(&tbs, &tbs_len, OCSP_ID_EXPLICIT(0),
+						&version_len);
+		if (!version || version_len != 3 || version[2] != 0)
+			goto decode_error;
+	}
+
+	if (tbs_len < 2)
+		goto decode_error;
+
+	responder_tag = *tbs;
+	if (responder_tag != OCSP_ID_EXPLICIT(1) &&
+			responder_tag != OCSP_ID_EXPLICIT(2))
+		goto decode_error;
+
+	responder_id = ocsp_next_elem(&tbs, &tbs_len, responder_tag,
+					&responder_id_len);
+	if (!responder_id || ocsp_parse_time(&tbs, &tbs_len) == L_TIME_INVALID)
+		goto decode_error;
+
+	responses = ocsp_next_elem(&tbs, &tbs_len, ASN1_ID_SEQUENCE,
+					&responses_len);
+	if (!responses)
+		goto decode_error;
+
+	if (!ocsp_find_signer(responder_id, responder_tag, responder_id_len,
+				certs, certs_len, issuer, now, &signer)) {
+		*error = "OCSP responder not authorized by the issuer";
+		return -EKEYREJECTED;
+	}
+
+	verified = cert_verify_signature(signer ?: issuer, alg_id, alg_id_len,
+					tbs_start, tbs - tbs_start +
+					tbs_len, sig, sig_len);
+	l_cert_free(signer);
+
+	if (!verified) {
+		*error = "OCSP response signature verification failed";
+		return -EKEYREJECTED;
+	}
+
+	return ocsp_check_single_response(responses, responses_len, cert,
+						issuer, now, out_next_update,
+						error);
+
+decode_error:
+	*error = "Can't parse OCSP response";
+	return -EBADMSG;
+}
+
+struct ocsp_cache_entry {
+	struct l_tls_ocsp_cache *cache;
+	struct l_cert *cert;
+	struct l_cert *issuer;
+	char *url;
+	uint8_t *request;
+	size_t request_len;
+	uint8_t *response;
+	size_t response_len;
+	uint64_t next_update;
+	struct l_timeout *refresh;
+};
+
+struct l_tls_ocsp_cache {
+	struct l_queue *entries;
+	l_tls_ocsp_fetch_cb_t fetch;
+	void *user_data;
+	l_tls_destroy_cb_t destroy;
+};
+
+static void ocsp_cache_entry_free(void *data)
+{
+	struct ocsp_cache_entry *entry = data;
+
+	l_timeout_remove(entry->refresh);
+	l_cert_free(entry->cert);
+	l_cert_free(entry->issuer);
+	l_free(entry->url);
+	l_free(entry->request);
+	l_free(entry->response);
+	l_free(entry);
+}
+
+static bool ocsp_cache_entry_match(const void *a, const void *b)
+{
+	const struct ocsp_cache_entry *entry = a;
+	struct l_cert *cert = (struct l_cert *) b;
+	const uint8_t *der1;
+	const uint8_t *der2;
+	size_t len1;
+	size_t len2;
+
+	der1 = l_cert_get_der_data(entry->cert, &len1);
+	der2 = l_cert_get_der_data(cert, &len2);
+
+	return len1 == len2 && !memcmp(der1, der2, len1);
+}
+
+static void ocsp_cache_fetch(struct ocsp_cache_entry *entry)
+{
+	struct l_tls_ocsp_cache *cache = entry->cache;
+
+	/* Try again later unless a response arrives first */
+	l_timeout_modify(entry->refresh, OCSP_RETRY_INTERVAL);
+
+	cache->fetch(cache, entry->cert, entry->url, entry->request,
+			entry->request_len, cache->user_data);
+}
+
+static void ocsp_cache_refresh(struct l_timeout *timeout, void *user_data)
+{
+	ocsp_cache_fetch(user_data);
+}
+
+/* The responder URI from the Authority Information Access extension */
+static char *ocsp_get_url(struct l_cert *cert)
+{
+	const uint8_t *ext;
+	const uint8_t *seq;
+	size_t ext_len;
+	size_t seq_len;
+
+	ext = cert_get_extension(cert, &authority_info_access_oid, NULL,
+					&ext_len);
+	seq = ext ? ocsp_next_elem(&ext, &ext_len, ASN1_ID_SEQUENCE,
+					&seq_len) : NULL;
+	if (!seq)
+		return NULL;
+
+	while (seq_len) {
+		const uint8_t *desc;
+		const uint8_t *oid;
+		const uint8_t *uri;
+		size_t desc_len;
+		size_t oid_len;
+		size_t uri_len;
+
+		desc = ocsp_next_elem(&seq, &seq_len, ASN1_ID_SEQUENCE,
+					&desc_len);
+		if (!desc)
+			return NULL;
+
+		oid = ocsp_next_elem(&desc, &desc_len, ASN1_ID_OID, &oid_len);
+		if (!oid || !asn1_oid_eq(&ad_ocsp_oid, oid_len, oid))
+			continue;
+
+		/* GeneralName uniformResourceIdentifier, [6] IMPLICIT */
+		uri = ocsp_next_elem(&desc, &desc_len, OCSP_ID_IMPLICIT(6),
+					&uri_len);
+		if (uri)
+			return l_strndup((const char *) uri, uri_len);
+	}
+
+	return NULL;
+}
+
+/* An OCSPRequest for one certificate, with a SHA-1 CertID and no nonce */
+static uint8_t *ocsp_build_request(struct l_cert *cert, struct l_cert *issuer,
+					size_t *out_len)
+{
+	static const uint8_t sha1_alg_id[] = {
+		0x30, 0x09, 0x06, 0x05, 0x2b, 0x0e, 0x03, 0x02, 0x1a, 0x05, 0x00
+	};
+	const uint8_t *serial;
+	size_t serial_len;
+	size_t cert_id_len;
+	size_t req_len;
+	size_t list_len;
+	size_t tbs_len;
+	size_t ocsp_req_len;
+	uint8_t name_hash[20];
+	uint8_t key_hash[20];
+	uint8_t *buf;
+	uint8_t *ptr;
+
+	serial = cert_get_serial(cert, &serial_len);
+	if (!serial || !ocsp_issuer_hashes(issuer, L_CHECKSUM_SHA1,
+						name_hash, key_hash))
+		return NULL;
+
+	cert_id_len = sizeof(sha1_alg_id) + 2 * (2 + 20) +
+		ocsp_header_len(serial_len) + serial_len;
+	req_len = ocsp_header_len(cert_id_len) + cert_id_len;
+	list_len = ocsp_header_len(req_len) + req_len;
+	tbs_len = ocsp_header_len(list_len) + list_len;
+	ocsp_req_len = ocsp_header_len(tbs_len) + tbs_len;
+	*out_len = ocsp_header_len(ocsp_req_len) + ocsp_req_len;
+
+	buf = ptr = l_malloc(*out_len);
+	ocsp_write_header(&ptr, ASN1_ID_SEQUENCE, ocsp_req_len);
+	ocsp_write_header(&ptr, ASN1_ID_SEQUENCE, tbs_len);
+	ocsp_write_header(&ptr, ASN1_ID_SEQUENCE, list_len);
+	ocsp_write_header(&ptr, ASN1_ID_SEQUENCE, req_len);
+	ocsp_write_header(&ptr, ASN1_ID_SEQUENCE, cert_id_len);
+	memcpy(ptr, sha1_alg_id, sizeof(sha1_alg_id));
+	ptr += sizeof(sha1_alg_id);
+	ocsp_write_header(&ptr, ASN1_ID_OCTET_STRING, 20);
+	memcpy(ptr, name_hash, 20);
+	ptr += 20;
+	ocsp_write_header(&ptr, ASN1_ID_OCTET_STRING, 20);
+	memcpy(ptr, key_hash, 20);
+	ptr += 20;
+	ocsp_write_header(&ptr, ASN1_ID_INTEGER, serial_len);
+	memcpy(ptr, serial, serial_len);
+
+	return buf;
+}
+
+/**
+ * l_tls_ocsp_cache_new:
+ * @fetch: called when a certificate needs a new OCSP response
+ * @user_data: user data for @fetch
+ * @destroy: destroy function for @user_data
+ *
+ * The application owns the transport to the OCSP responders: @fetch is
+ * given the certificate, the responder URL from its Authority Information
+ * Access extension, if any, and a DER-encoded OCSPRequest ready to be
+ * POSTed as application/ocsp-request.  The response is handed back with
+ * l_tls_ocsp_cache_set_response at any later time.  Responses are
+ * refreshed half way to their nextUpdate time and fetches that don't
+ * produce a valid response are retried every 5 minutes.  The cache uses
+ * the main loop of the thread that creates it.
+ *
+ * Returns: a new OCSP response cache to pass to l_tls_set_ocsp_cache.  It
+ * can be shared by any number of server l_tls objects in one thread and
+ * must outlive them.
+ */
+LIB_EXPORT struct l_tls_ocsp_cache *l_tls_ocsp_cache_new(
+						l_tls_ocsp_fetch_cb_t fetch,
+						void *user_data,
+						l_tls_destroy_cb_t destroy)
+{
+	struct l_tls_ocsp_cache *cache;
+
+	if (unlikely(!fetch))
+		return NULL;
+
+	cache = l_new(struct l_tls_ocsp_cache, 1);
+	cache->entries = l_queue_new();
+	cache->fetch = fetch;
+	cache->user_data = user_data;
+	cache->destroy = destroy;
+
+	return cache;
+}
+
+LIB_EXPORT void l_tls_ocsp_cache_free(struct l_tls_ocsp_cache *cache)
+{
+	if (unlikely(!cache))
+		return;
+
+	l_queue_destroy(cache->entries, ocsp_cache_entry_free);
+
+	if (cache->destroy)
+		cache->destroy(cache->user_data);
+
+	l_free(cache);
+}
+
+static bool ocsp_get_issuer(struct l_cert *cert, void *user_data)
+{
+	struct l_cert **certs = user_data;
+
+	if (!certs[0]) {
+		certs[0] = cert;
+		return false;
+	}
+
+	certs[1] = cert;
+	return true;
+}
+
+/**
+ * l_tls_ocsp_cache_add:
+ * @cache: OCSP response cache
+ * @chain: a server certificate chain including at least the issuer of
+ *   the leaf certificate
+ *
+ * Starts keeping an OCSP response for the leaf certificate of @chain.
+ * The first fetch is requested immediately, from within this call.  The
+ * chain isn't referenced after the call returns.
+ *
+ * Returns: true on success, false if @chain doesn't include the issuer
+ * or the leaf certificate is already in @cache.
+ */
+LIB_EXPORT bool l_tls_ocsp_cache_add(struct l_tls_ocsp_cache *cache,
+					struct l_certchain *chain)
+{
+	struct l_cert *certs[2] = {};
+	struct ocsp_cache_entry *entry;
+	const uint8_t *der;
+	size_t der_len;
+
+	if (unlikely(!cache || !chain))
+		return false;
+
+	l_certchain_walk_from_leaf(chain, ocsp_get_issuer, certs);
+	if (!certs[1])
+		return false;
+
+	if (l_queue_find(cache->entries, ocsp_cache_entry_match, certs[0]))
+		return false;
+
+	entry = l_new(struct ocsp_cache_entry, 1);
+	entry->cache = cache;
+	der = l_cert_get_der_data(certs[0], &der_len);
+	entry->cert = l_cert_new_from_der(der, der_len);
+	der = l_cert_get_der_data(certs[1], &der_len);
+	entry->issuer = l_cert_new_from_der(der, der_len);
+	entry->request = ocsp_build_request(entry->cert, entry->issuer,
+						&entry->request_len);
+	if (!entry->request) {
+		ocsp_cache_entry_free(entry);
+		return false;
+	}
+
+	entry->url = ocsp_get_url(entry->cert);
+	entry->refresh = l_timeout_create(OCSP_RETRY_INTERVAL,
+						ocsp_cache_refresh, entry,
+						NULL);
+	l_queue_push_tail(cache->entries, entry);
+
+	ocsp_cache_fetch(entry);
+	return true;
+}
+
+/**
+ * l_tls_ocsp_cache_set_response:
+ * @cache: OCSP response cache
+ * @cert: certificate passed to the fetch callback
+ * @response: DER-encoded OCSPResponse
+ * @len: length of @response
+ *
+ * Replaces the cached response for @cert if @response is authentic and
+ * current.  Responses saying that @cert is revoked are also stapled.
+ *
+ * Returns: true if @response was accepted.
+ */
+LIB_EXPORT bool l_tls_ocsp_cache_set_response(struct l_tls_ocsp_cache *cache,
+						struct l_cert *cert,
+						const uint8_t *response,
+						size_t len)
+{
+	struct ocsp_cache_entry *entry;
+	uint64_t now = time_realtime_now();
+	uint64_t next_update;
+	uint64_t refresh;
+	const char *error;
+	int r;
+
+	if (unlikely(!cache || !cert || !response || !len))
+		return false;
+
+	entry = l_queue_find(cache->entries, ocsp_cache_entry_match, cert);
+	if (!entry)
+		return false;
+
+	r = tls_ocsp_verify(response, len, entry->cert, entry->issuer, now,
+				&next_update, &error);
+	if (r && r != -EKEYREVOKED)
+		return false;
+
+	l_free(entry->response);
+	entry->response = l_memdup(response, len);
+	entry->response_len = len;
+	entry->next_update = next_update;
+
+	refresh = next_update > now ?
+		(next_update - now) / 2 / L_USEC_PER_SEC : 0;
+
+	if (refresh < OCSP_MIN_REFRESH)
+		refresh = OCSP_MIN_REFRESH;
+	else if (refresh > OCSP_MAX_REFRESH)
+		refresh = OCSP_MAX_REFRESH;
+
+	l_timeout_modify(entry->refresh, refresh);
+
+	return true;
+}
+
+const uint8_t *tls_ocsp_cache_lookup(struct l_tls_ocsp_cache *cache,
+					struct l_cert *cert, size_t *out_len)
+{
+	struct ocsp_cache_entry *entry;
+
+	entry = l_queue_find(cache->entries, ocsp_cache_entry_match, cert);
+	if (!entry || !entry->response ||
+			entry->next_update <= time_realtime_now())
+		return NULL;
+
+	*out_len = entry->response_len;
+	return entry->response;
+}
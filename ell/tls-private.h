@@ -5,7 +5,7 @@
  * SPDX-License-Identifier: LGPL-2.1-or-later
  */
 
-#define TLS_MAX_VERSION	L_TLS_V12
+#define TLS_MAX_VERSION	L_TLS_V13
 #define TLS_MIN_VERSION	L_TLS_V10
 
 enum tls_cipher_type {
@@ -104,6 +104,11 @@ struct tls_cipher_suite {
 	struct tls_key_exchange_algorithm *key_xchg;
 	struct tls_mac_algorithm *mac;
 	enum l_checksum_type prf_hmac;
+	/*
+	 * TLS 1.3 suites only define the AEAD and the HKDF hash, the key
+	 * exchange and signature are negotiated in extensions.
+	 */
+	bool tls13;
 };
 
 extern struct tls_cipher_suite *tls_cipher_suite_pref[];
@@ -133,6 +138,16 @@ struct tls_hello_extension {
 
 extern const struct tls_hello_extension tls_extensions[];
 
+/* RFC 8446 Section 4.2.3 SignatureScheme */
+struct tls13_signature_scheme {
+	uint16_t id;
+	const char *name;
+	enum l_cert_key_type key_type;
+	enum l_checksum_type hash;
+};
+
+extern const struct tls13_signature_scheme tls13_signature_schemes[];
+
 struct tls_named_group {
 	const char *name;
 	uint16_t id;
@@ -152,6 +167,7 @@ struct tls_named_group {
 enum tls_handshake_state {
 	TLS_HANDSHAKE_WAIT_START,
 	TLS_HANDSHAKE_WAIT_HELLO,
+	TLS_HANDSHAKE_WAIT_ENCRYPTED_EXTENSIONS,
 	TLS_HANDSHAKE_WAIT_CERTIFICATE,
 	TLS_HANDSHAKE_WAIT_KEY_EXCHANGE,
 	TLS_HANDSHAKE_WAIT_HELLO_DONE,
@@ -172,6 +188,8 @@ enum tls_handshake_type {
 	TLS_HELLO_REQUEST	= 0,
 	TLS_CLIENT_HELLO	= 1,
 	TLS_SERVER_HELLO	= 2,
+	TLS_NEW_SESSION_TICKET	= 4,
+	TLS_ENCRYPTED_EXTENSIONS = 8,
 	TLS_CERTIFICATE		= 11,
 	TLS_SERVER_KEY_EXCHANGE	= 12,
 	TLS_CERTIFICATE_REQUEST	= 13,
@@ -179,6 +197,9 @@ enum tls_handshake_type {
 	TLS_CERTIFICATE_VERIFY	= 15,
 	TLS_CLIENT_KEY_EXCHANGE	= 16,
 	TLS_FINISHED		= 20,
+	TLS_CERTIFICATE_STATUS	= 22,
+	TLS_KEY_UPDATE		= 24,
+	TLS_MESSAGE_HASH	= 254,
 };
 
 struct l_tls {
@@ -196,7 +217,12 @@ struct l_tls {
 	enum l_tls_version max_version;
 
 	struct l_queue *ca_certs;
+	struct l_cert_verify_cache *cert_verify_cache;
+	struct l_cert_store *cert_store;
+	struct l_crl_store *crl_store;
 	struct l_certchain *cert;
+	uint8_t *cert_msg;
+	size_t cert_msg_len;
 	struct l_key *priv_key;
 	size_t priv_key_size;
 	char **subject_mask;
@@ -209,6 +235,12 @@ struct l_tls {
 	unsigned int session_count_max;
 	l_tls_session_update_cb_t session_update_cb;
 	void *session_update_user_data;
+	struct l_tls_ticket_keys *ticket_keys;
+	struct l_tls_session_cache *session_cache;
+	struct l_tls_ecdhe_key_cache *ecdhe_key_cache;
+	struct l_tls_key_pool *key_pool;
+	struct l_tls_ocsp_cache *ocsp_cache;
+	enum l_tls_ocsp_stapling ocsp_stapling;
 
 	bool in_callback;
 	bool pending_destroy;
@@ -220,11 +252,31 @@ struct l_tls {
 	int record_buf_max_len;
 	bool record_flush;
 
+	/*
+	 * Application data sent since the connection start or the last
+	 * idle period, used to size the records in the dynamic mode.
+	 */
+	enum l_tls_record_size record_size;
+	size_t tx_burst_bytes;
+	uint64_t tx_last_time;
+
 	uint8_t *message_buf;
 	int message_buf_len;
 	int message_buf_max_len;
 	enum tls_content_type message_content_type;
 
+	/*
+	 * Kernel TLS offload: the AES-GCM keys are kept until the
+	 * handshake is done and then handed to the socket @ktls_fd.
+	 */
+	int ktls_fd;
+	bool ktls_ulp;
+	bool ktls_tx;
+	bool ktls_rx;
+	bool ktls_rx_pending;
+	uint8_t ktls_key[2][32];
+	size_t ktls_key_length[2];
+
 	/* Handshake protocol layer */
 
 	enum tls_handshake_state state;
@@ -252,6 +304,25 @@ struct l_tls {
 	uint8_t session_compression_method_id;
 	char *session_peer_identity;
 	bool session_resumed;
+	uint64_t session_expiry;
+	/*
+	 * RFC 5077 ticket: on the client the cached or newly issued one, on
+	 * the server the one from the Client Hello.
+	 */
+	uint8_t *session_ticket;
+	size_t session_ticket_len;
+	bool session_ticket_new;
+	bool session_ticket_send;
+	bool session_ticket_expected;
+	/*
+	 * RFC 6066 status_request: on the server whether a stapled OCSP
+	 * response is sent, on the client whether one may follow the
+	 * Certificate and the issuer it's checked against.
+	 */
+	bool ocsp_status_send;
+	bool ocsp_status_expected;
+	bool ocsp_status_verified;
+	struct l_cert *ocsp_issuer;
 
 	struct {
 		bool secure_renegotiation;
@@ -260,6 +331,26 @@ struct l_tls {
 		uint8_t server_verify_data[12];
 	} renegotiation_info;
 
+	/*
+	 * TLS 1.3 (client only): the key shares sent in the Client Hello,
+	 * the group and cookie from a HelloRetryRequest, the signature
+	 * scheme for our CertificateVerify, the Master Secret and the
+	 * traffic secrets the current keys were derived from.
+	 */
+	bool tls13_offered;
+	struct {
+		const struct tls_named_group *group;
+		struct l_ecc_scalar *private;
+		struct l_ecc_point *public;
+	} tls13_key_share[2];
+	bool tls13_hrr;
+	const struct tls_named_group *tls13_hrr_group;
+	uint8_t *tls13_cookie;
+	size_t tls13_cookie_len;
+	const struct tls13_signature_scheme *tls13_sign_scheme;
+	uint8_t tls13_secret[HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t tls13_traffic_secret[2][HANDSHAKE_HASH_MAX_SIZE];
+
 	/* SecurityParameters current and pending */
 
 	struct {
@@ -298,6 +389,14 @@ struct l_tls {
 	 */
 
 	bool ready;
+
+	/*
+	 * RFC 7918 False Start: the client has called ready_handle after
+	 * sending its Finished and may send application data before the
+	 * server's Finished is received.
+	 */
+	bool false_start;
+	bool false_started;
 };
 
 bool tls10_prf(const void *secret, size_t secret_len,
@@ -311,13 +410,22 @@ bool tls12_prf(enum l_checksum_type type,
 		const void *seed, size_t seed_len,
 		uint8_t *out, size_t out_len);
 
+bool tls13_hkdf_expand_label(enum l_checksum_type type,
+				const void *secret, size_t secret_len,
+				const char *label,
+				const void *context, size_t context_len,
+				uint8_t *out, size_t out_len);
+
 void tls_disconnect(struct l_tls *tls, enum l_tls_alert_desc desc,
 			enum l_tls_alert_desc local_desc);
 
 void tls_tx_record(struct l_tls *tls, enum tls_content_type type,
 			const uint8_t *data, size_t len);
+void tls_tx_recordv(struct l_tls *tls, enum tls_content_type type,
+			const struct iovec *iov, size_t iovcnt);
 bool tls_handle_message(struct l_tls *tls, const uint8_t *message,
 			int len, enum tls_content_type type, uint16_t version);
+bool tls_ktls_enable(struct l_tls *tls, bool txrx);
 
 #define TLS_HANDSHAKE_HEADER_SIZE	4
 
@@ -347,12 +455,92 @@ ssize_t tls_write_signature_algorithms(struct l_tls *tls,
 ssize_t tls_parse_signature_algorithms(struct l_tls *tls,
 					const uint8_t *buf, size_t len);
 
+int tls13_key_share_get_secret(struct l_tls *tls,
+				const uint8_t *buf, size_t len,
+				uint8_t *out, size_t *out_len);
+void tls13_key_share_free(struct l_tls *tls);
+
+const struct tls13_signature_scheme *tls13_find_signature_scheme(
+								uint16_t id);
+ssize_t tls13_sign(struct l_tls *tls,
+			const struct tls13_signature_scheme *scheme,
+			const uint8_t *data, size_t data_len,
+			uint8_t *out, size_t out_len);
+bool tls13_verify(struct l_tls *tls,
+			const struct tls13_signature_scheme *scheme,
+			const uint8_t *data, size_t data_len,
+			const uint8_t *sig, size_t sig_len);
+
+#define TLS_TICKET_OVERHEAD	(16 + 12 + 16)
+
+uint64_t tls_ticket_lifetime(const struct l_tls_ticket_keys *ticket_keys);
+uint8_t *tls_ticket_seal(struct l_tls_ticket_keys *ticket_keys,
+				const uint8_t *state, size_t state_len,
+				size_t *out_len);
+uint8_t *tls_ticket_open(struct l_tls_ticket_keys *ticket_keys,
+				const uint8_t *ticket, size_t len,
+				size_t *out_len);
+
+int tls_ocsp_verify(const uint8_t *response, size_t len,
+			struct l_cert *cert, struct l_cert *issuer,
+			uint64_t now, uint64_t *out_next_update,
+			const char **error);
+const uint8_t *tls_ocsp_cache_lookup(struct l_tls_ocsp_cache *cache,
+					struct l_cert *cert, size_t *out_len);
+
+struct tls_cached_session {
+	uint8_t id[33];		/* Length-prefixed Session ID */
+	enum l_tls_version version;
+	uint8_t cipher_suite_id[2];
+	uint8_t compression_method_id;
+	uint8_t master_secret[48];
+	uint64_t expiry_time;
+	char *peer_identity;
+	struct tls_cached_session *prev;
+	struct tls_cached_session *next;
+};
+
+uint64_t tls_session_cache_get_lifetime(
+				const struct l_tls_session_cache *cache);
+const struct tls_cached_session *tls_session_cache_lookup(
+					struct l_tls_session_cache *cache,
+					const uint8_t *session_id,
+					size_t session_id_size);
+void tls_session_cache_add(struct l_tls_session_cache *cache,
+				struct tls_cached_session *session);
+void tls_session_cache_remove(struct l_tls_session_cache *cache,
+				const uint8_t *session_id,
+				size_t session_id_size);
+
+struct l_ecc_curve;
+struct l_ecc_scalar;
+struct l_ecc_point;
+
+bool tls_ecdhe_key_cache_get(struct l_tls_ecdhe_key_cache *cache,
+				const struct l_ecc_curve *curve,
+				struct l_ecc_scalar **out_private,
+				struct l_ecc_point **out_public);
+bool tls_key_pool_get_ec(struct l_tls_key_pool *pool,
+				const struct tls_named_group *group,
+				struct l_ecc_scalar **out_private,
+				struct l_ecc_point **out_public);
+struct l_key *tls_key_pool_get_ff(struct l_tls_key_pool *pool,
+					const struct tls_named_group *group,
+					uint8_t *out_public);
+
 int tls_parse_certificate_list(const void *data, size_t len,
 				struct l_certchain **out_certchain);
 
 #define TLS_DEBUG(fmt, args...)	\
 	l_util_debug(tls->debug_handler, tls->debug_data, "%s:%i " fmt,	\
 			__func__, __LINE__, ## args)
+#define TLS_DEBUG_RATELIMITED(fmt, args...)	\
+	do {	\
+		static struct l_log_ratelimit ratelimit;	\
+		l_util_debug_ratelimited(&ratelimit, tls->debug_handler,\
+				tls->debug_data, "%s:%i " fmt,	\
+				__func__, __LINE__, ## args);	\
+	} while (0)
 #define TLS_SET_STATE(new_state)	\
 	do {	\
 		TLS_DEBUG("New state %s",	\
@@ -11,18 +11,49 @@
 
 #define _GNU_SOURCE
 #include <alloca.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
+#ifdef HAVE_LINUX_TLS_H
+#include <linux/tls.h>
+#endif
+
+#include "useful.h"
 #include "private.h"
 #include "tls.h"
 #include "checksum.h"
 #include "cipher.h"
 #include "cert.h"
 #include "tls-private.h"
+#include "memory-private.h"
 #include "random.h"
+#include "missing.h"
+#include "log.h"
+#include "time.h"
+#include "probe-private.h"
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
 
 /* Implementation-specific max Record Layer fragment size (must be < 16kB) */
 #define TX_RECORD_MAX_LEN	4096
 
+/*
+ * Dynamic record sizing: fragments that fit a 1460-byte TCP MSS together
+ * with the worst case header, IV, MAC and padding until this many bytes
+ * have been sent without the connection going idle for the given time.
+ */
+#define TX_RECORD_SMALL_LEN	(1460 - 5 - 16 - 64 - 16)
+#define TX_RECORD_RAMP_BYTES	(64 * 1024)
+#define TX_RECORD_IDLE_USEC	(1 * L_USEC_PER_SEC)
+
 /* TLSPlaintext + TLSCompressed + TLSCiphertext headers + seq_num sizes */
 #define TX_RECORD_MAX_HEADERS	(5 + 5 + 8 + 5)
 #define TX_RECORD_MAX_MAC	64
@@ -49,6 +80,19 @@ static void tls_write_mac(struct l_tls *tls, uint8_t *compressed,
 	}
 }
 
+/* RFC 8446 Section 5.3: the static IV XORed with the sequence number */
+static void tls13_build_nonce(struct l_tls *tls, bool txrx, uint8_t *iv)
+{
+	size_t len = tls->fixed_iv_length[txrx];
+	uint64_t seq_num = tls->seq_num[txrx]++;
+	int i;
+
+	memcpy(iv, tls->fixed_iv[txrx], len);
+
+	for (i = 0; i < 8; i++)
+		iv[len - 1 - i] ^= seq_num >> (8 * i);
+}
+
 static void tls_tx_record_plaintext(struct l_tls *tls,
 					uint8_t *plaintext,
 					uint16_t plaintext_len)
@@ -63,9 +107,15 @@ static void tls_tx_record_plaintext(struct l_tls *tls,
 	uint8_t buf[TX_RECORD_HEADROOM + TX_RECORD_MAX_LEN +
 				TX_RECORD_TAILROOM];
 	uint8_t iv[32];
-	uint8_t *assocdata;
+	uint8_t aad[13];
+	uint8_t header[3];
 	int offset;
 
+	PROBE(tls_record_tx, tls, plaintext[0], plaintext_len - 5);
+
+	/* Copy type and version fields, AEAD overwrites them in place */
+	memcpy(header, plaintext, 3);
+
 	/*
 	 * TODO: if DEFLATE is selected in current state, use a new buffer
 	 * on stack to write a TLSCompressed structure there, otherwise use
@@ -145,9 +195,36 @@ static void tls_tx_record_plaintext(struct l_tls *tls,
 		break;
 
 	case TLS_CIPHER_AEAD:
-		/* Prepend seq_num to TLSCompressed.type + .version + .length */
-		assocdata = compressed - 8;
-		l_put_be64(tls->seq_num[1]++, assocdata);
+		if (tls->negotiated_version >= L_TLS_V13) {
+			/*
+			 * RFC 8446 Section 5.2: the real content type follows
+			 * the fragment in TLSInnerPlaintext, the outer record
+			 * pretends to be application data and its header is
+			 * the additional data.
+			 */
+			cipher_input = compressed + 5;
+			cipher_input[compressed_len] = header[0];
+			cipher_input_len = compressed_len + 1;
+			ciphertext = cipher_input;
+			ciphertext_len = cipher_input_len +
+				tls->auth_tag_length[1];
+
+			header[0] = TLS_CT_APPLICATION_DATA;
+			memcpy(aad, header, 3);
+			l_put_be16(ciphertext_len, aad + 3);
+
+			tls13_build_nonce(tls, true, iv);
+			l_aead_cipher_encrypt(tls->aead_cipher[1],
+						cipher_input, cipher_input_len,
+						aad, 5,
+						iv, tls->fixed_iv_length[1],
+						ciphertext, ciphertext_len);
+			break;
+		}
+
+		/* seq_num + TLSCompressed.type + .version + .length */
+		l_put_be64(tls->seq_num[1]++, aad);
+		memcpy(aad + 8, compressed, 5);
 
 		cipher_input = compressed + 5;
 		cipher_input_len = compressed_len;
@@ -170,18 +247,21 @@ static void tls_tx_record_plaintext(struct l_tls *tls,
 			memset(iv + tls->fixed_iv_length[1] + 8, 42,
 				tls->record_iv_length[1] - 8);
 
-		/* Build the GenericAEADCipher struct */
-		ciphertext = buf + TX_RECORD_HEADROOM;
-		memcpy(ciphertext, iv + tls->fixed_iv_length[1],
-			tls->record_iv_length[1]);
+		/*
+		 * Build the GenericAEADCipher struct encrypting in place,
+		 * the explicit nonce fits in the TLSCompressed header and
+		 * TX_RECORD_HEADROOM space before the fragment.
+		 */
+		ciphertext = cipher_input - tls->record_iv_length[1];
 		l_aead_cipher_encrypt(tls->aead_cipher[1],
 					cipher_input, cipher_input_len,
-					assocdata, 13,
+					aad, 13,
 					iv, tls->fixed_iv_length[1] +
 					tls->record_iv_length[1],
-					ciphertext + tls->record_iv_length[1],
-					cipher_input_len +
+					cipher_input, cipher_input_len +
 					tls->auth_tag_length[1]);
+		memcpy(ciphertext, iv + tls->fixed_iv_length[1],
+			tls->record_iv_length[1]);
 
 		ciphertext_len = tls->record_iv_length[1] +
 			cipher_input_len + tls->auth_tag_length[1];
@@ -194,31 +274,198 @@ static void tls_tx_record_plaintext(struct l_tls *tls,
 
 	/* Build a TLSCiphertext struct */
 	ciphertext -= 5;
-	ciphertext[0] = plaintext[0]; /* Copy type and version fields */
-	ciphertext[1] = plaintext[1];
-	ciphertext[2] = plaintext[2];
+	memcpy(ciphertext, header, 3);
 	ciphertext[3] = ciphertext_len >> 8;
 	ciphertext[4] = ciphertext_len >> 0;
 
 	tls->tx(ciphertext, ciphertext_len + 5, tls->user_data);
 }
 
-void tls_tx_record(struct l_tls *tls, enum tls_content_type type,
-			const uint8_t *data, size_t len)
+#ifdef HAVE_LINUX_TLS_H
+bool tls_ktls_enable(struct l_tls *tls, bool txrx)
+{
+	union {
+		struct tls12_crypto_info_aes_gcm_128 gcm128;
+		struct tls12_crypto_info_aes_gcm_256 gcm256;
+	} info;
+	struct tls_crypto_info *hdr = &info.gcm128.info;
+	size_t info_len;
+	uint8_t *key, *iv, *salt, *rec_seq;
+	size_t key_len = tls->ktls_key_length[txrx];
+	int r = -1;
+
+	memset(&info, 0, sizeof(info));
+	hdr->version = TLS_1_2_VERSION;
+
+	if (key_len == TLS_CIPHER_AES_GCM_128_KEY_SIZE) {
+		hdr->cipher_type = TLS_CIPHER_AES_GCM_128;
+		key = info.gcm128.key;
+		iv = info.gcm128.iv;
+		salt = info.gcm128.salt;
+		rec_seq = info.gcm128.rec_seq;
+		info_len = sizeof(info.gcm128);
+	} else if (key_len == TLS_CIPHER_AES_GCM_256_KEY_SIZE) {
+		hdr->cipher_type = TLS_CIPHER_AES_GCM_256;
+		key = info.gcm256.key;
+		iv = info.gcm256.iv;
+		salt = info.gcm256.salt;
+		rec_seq = info.gcm256.rec_seq;
+		info_len = sizeof(info.gcm256);
+	} else
+		goto done;
+
+	if (tls->negotiated_version != L_TLS_V12 ||
+			tls->fixed_iv_length[txrx] !=
+			TLS_CIPHER_AES_GCM_128_SALT_SIZE)
+		goto done;
+
+	memcpy(key, tls->ktls_key[txrx], key_len);
+	memcpy(salt, tls->fixed_iv[txrx], tls->fixed_iv_length[txrx]);
+	l_put_be64(tls->seq_num[txrx], rec_seq);
+
+	/*
+	 * The kernel uses @iv as the explicit nonce of the next record and
+	 * increments it, our own nonces had the sequence number in little
+	 * endian so starting at the big endian sequence number can't
+	 * repeat any of them.
+	 */
+	l_put_be64(tls->seq_num[txrx], iv);
+
+	if (!tls->ktls_ulp) {
+		r = setsockopt(tls->ktls_fd, IPPROTO_TCP, TCP_ULP,
+				"tls", sizeof("tls"));
+		if (r < 0) {
+			TLS_DEBUG("TCP_ULP: %s", strerror(errno));
+			goto done;
+		}
+
+		tls->ktls_ulp = true;
+	}
+
+	r = setsockopt(tls->ktls_fd, SOL_TLS, txrx ? TLS_TX : TLS_RX,
+			&info, info_len);
+	if (r < 0)
+		TLS_DEBUG("%s: %s", txrx ? "TLS_TX" : "TLS_RX",
+				strerror(errno));
+
+done:
+	explicit_bzero(&info, sizeof(info));
+	explicit_bzero(tls->ktls_key[txrx], sizeof(tls->ktls_key[txrx]));
+	tls->ktls_key_length[txrx] = 0;
+
+	if (r < 0) {
+		TLS_DEBUG("kTLS %s offload unavailable", txrx ? "Tx" : "Rx");
+		return false;
+	}
+
+	TLS_DEBUG("kTLS %s offload enabled", txrx ? "Tx" : "Rx");
+
+	if (txrx)
+		tls->ktls_tx = true;
+	else
+		tls->ktls_rx = true;
+
+	return true;
+}
+
+/* Non application data records need their type passed in a cmsg */
+static void tls_ktls_tx_control(struct l_tls *tls, enum tls_content_type type,
+				const struct iovec *iov, size_t iovcnt)
+{
+	uint8_t cbuf[CMSG_SPACE(sizeof(uint8_t))] = {};
+	struct msghdr msg = {
+		.msg_iov = (struct iovec *) iov,
+		.msg_iovlen = iovcnt,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint8_t));
+	*CMSG_DATA(cmsg) = type;
+
+	if (sendmsg(tls->ktls_fd, &msg, MSG_NOSIGNAL) < 0)
+		TLS_DEBUG_RATELIMITED("sendmsg: %s", strerror(errno));
+}
+#else
+bool tls_ktls_enable(struct l_tls *tls, bool txrx)
+{
+	explicit_bzero(tls->ktls_key[txrx], sizeof(tls->ktls_key[txrx]));
+	tls->ktls_key_length[txrx] = 0;
+	return false;
+}
+
+static void tls_ktls_tx_control(struct l_tls *tls, enum tls_content_type type,
+				const struct iovec *iov, size_t iovcnt)
+{
+}
+#endif
+
+void tls_tx_recordv(struct l_tls *tls, enum tls_content_type type,
+			const struct iovec *iov, size_t iovcnt)
 {
 	uint8_t buf[TX_RECORD_HEADROOM + TX_RECORD_MAX_LEN +
 				TX_RECORD_TAILROOM];
 	uint8_t *fragment, *plaintext;
 	uint16_t fragment_len;
 	uint16_t version = tls->negotiated_version ?: tls->min_version;
+	size_t iov_offset = 0;
+	size_t len = 0;
+	size_t i;
+	bool app_data = type == TLS_CT_APPLICATION_DATA;
+	bool dynamic = app_data &&
+		tls->record_size == L_TLS_RECORD_SIZE_DYNAMIC;
+
+	/* RFC 8446 Section 5.1: legacy_record_version stays at 1.2 */
+	if (version > L_TLS_V12)
+		version = L_TLS_V12;
 
 	if (type == TLS_CT_ALERT)
 		tls->record_flush = true;
 
+	/*
+	 * With the Tx offload the kernel builds the records, application
+	 * data goes to the socket as is through the usual tx handler.
+	 */
+	if (tls->ktls_tx) {
+		if (type != TLS_CT_APPLICATION_DATA) {
+			tls_ktls_tx_control(tls, type, iov, iovcnt);
+			return;
+		}
+
+		for (i = 0; i < iovcnt; i++)
+			if (iov[i].iov_len)
+				tls->tx(iov[i].iov_base, iov[i].iov_len,
+					tls->user_data);
+
+		return;
+	}
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	if (dynamic) {
+		uint64_t now = l_time_now_cached();
+
+		if (l_time_diff(now, tls->tx_last_time) > TX_RECORD_IDLE_USEC)
+			tls->tx_burst_bytes = 0;
+
+		tls->tx_last_time = now;
+	}
+
 	while (len) {
+		size_t copied = 0;
+		size_t max_len = TX_RECORD_MAX_LEN;
+
+		if (app_data && tls->record_size == L_TLS_RECORD_SIZE_SMALL)
+			max_len = TX_RECORD_SMALL_LEN;
+		else if (dynamic && tls->tx_burst_bytes < TX_RECORD_RAMP_BYTES)
+			max_len = TX_RECORD_SMALL_LEN;
+
 		fragment = buf + TX_RECORD_HEADROOM;
-		fragment_len = len < TX_RECORD_MAX_LEN ?
-			len : TX_RECORD_MAX_LEN;
+		fragment_len = minsize(len, max_len);
 
 		/* Build a TLSPlaintext struct */
 		plaintext = fragment - 5;
@@ -227,15 +474,40 @@ void tls_tx_record(struct l_tls *tls, enum tls_content_type type,
 		plaintext[2] = (uint8_t) (version >> 0);
 		plaintext[3] = fragment_len >> 8;
 		plaintext[4] = fragment_len >> 0;
-		memcpy(plaintext + 5, data, fragment_len);
+
+		/* Gather the fragment, records may span several iovecs */
+		while (copied < fragment_len) {
+			const uint8_t *data = iov->iov_base;
+			size_t n = minsize(iov->iov_len - iov_offset,
+						fragment_len - copied);
+
+			memcpy(fragment + copied, data + iov_offset, n);
+			copied += n;
+			iov_offset += n;
+
+			if (iov_offset == iov->iov_len) {
+				iov++;
+				iov_offset = 0;
+			}
+		}
 
 		tls_tx_record_plaintext(tls, plaintext, fragment_len + 5);
 
-		data += fragment_len;
 		len -= fragment_len;
+
+		if (app_data)
+			tls->tx_burst_bytes += fragment_len;
 	}
 }
 
+void tls_tx_record(struct l_tls *tls, enum tls_content_type type,
+			const uint8_t *data, size_t len)
+{
+	struct iovec iov = { .iov_base = (void *) data, .iov_len = len };
+
+	tls_tx_recordv(tls, type, &iov, 1);
+}
+
 static bool tls_handle_plaintext(struct l_tls *tls, const uint8_t *plaintext,
 					int len, uint8_t type, uint16_t version)
 {
@@ -356,7 +628,85 @@ static bool tls_handle_plaintext(struct l_tls *tls, const uint8_t *plaintext,
 	return true;
 }
 
-static bool tls_handle_ciphertext(struct l_tls *tls)
+/*
+ * RFC 8446 Section 5.2.  Only the ChangeCipherSpec records sent for
+ * middlebox compatibility are not protected once the handshake keys
+ * are in use.
+ */
+static bool tls13_handle_ciphertext(struct l_tls *tls, uint8_t *record,
+					bool in_place)
+{
+	uint8_t type = record[0];
+	uint16_t version = l_get_be16(record + 1);
+	uint16_t fragment_len = l_get_be16(record + 3);
+	uint8_t *plaintext;
+	int plaintext_len;
+	uint8_t iv[32];
+
+	if (type == TLS_CT_CHANGE_CIPHER_SPEC)
+		return tls_handle_plaintext(tls, record + 5, fragment_len,
+						type, version);
+
+	if (type != TLS_CT_APPLICATION_DATA) {
+		TLS_DISCONNECT(TLS_ALERT_UNEXPECTED_MESSAGE, 0,
+				"Unprotected record of type %i", type);
+		return false;
+	}
+
+	if (fragment_len > (1 << 14) + 256) {
+		TLS_DISCONNECT(TLS_ALERT_RECORD_OVERFLOW, 0,
+				"Record fragment too long: %u", fragment_len);
+		return false;
+	}
+
+	if (fragment_len <= tls->auth_tag_length[0]) {
+		TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+				"Record fragment too short: %u", fragment_len);
+		return false;
+	}
+
+	plaintext_len = fragment_len - tls->auth_tag_length[0];
+	plaintext = in_place ? record + 5 : alloca(plaintext_len);
+
+	tls13_build_nonce(tls, false, iv);
+
+	if (!l_aead_cipher_decrypt(tls->aead_cipher[0], record + 5,
+					fragment_len, record, 5,
+					iv, tls->fixed_iv_length[0],
+					plaintext, plaintext_len)) {
+		TLS_DISCONNECT(TLS_ALERT_BAD_RECORD_MAC, 0,
+				"Decrypting record fragment failed");
+		return false;
+	}
+
+	/* The content type is the last non-zero byte, padding follows */
+	while (plaintext_len && !plaintext[plaintext_len - 1])
+		plaintext_len--;
+
+	if (!plaintext_len) {
+		TLS_DISCONNECT(TLS_ALERT_UNEXPECTED_MESSAGE, 0,
+				"No content type in TLSInnerPlaintext");
+		return false;
+	}
+
+	type = plaintext[--plaintext_len];
+
+	if (type == TLS_CT_CHANGE_CIPHER_SPEC) {
+		TLS_DISCONNECT(TLS_ALERT_UNEXPECTED_MESSAGE, 0,
+				"Protected ChangeCipherSpec record");
+		return false;
+	}
+
+	return tls_handle_plaintext(tls, plaintext, plaintext_len,
+					type, version);
+}
+
+/*
+ * With @in_place the AEAD ciphers decrypt @record in place, otherwise
+ * it's left untouched.
+ */
+static bool tls_handle_ciphertext(struct l_tls *tls, uint8_t *record,
+					bool in_place)
 {
 	uint8_t type;
 	uint16_t version;
@@ -367,10 +717,14 @@ static bool tls_handle_ciphertext(struct l_tls *tls)
 	int compressed_len;
 	uint8_t iv[32];
 	uint8_t *assocdata;
+	uint16_t record_version = tls->negotiated_version > L_TLS_V12 ?
+					L_TLS_V12 : tls->negotiated_version;
+
+	type = record[0];
+	version = l_get_be16(record + 1);
+	fragment_len = l_get_be16(record + 3);
 
-	type = tls->record_buf[0];
-	version = l_get_be16(tls->record_buf + 1);
-	fragment_len = l_get_be16(tls->record_buf + 3);
+	PROBE(tls_record_rx, tls, type, fragment_len);
 
 	if (fragment_len > (1 << 14) + 2048) {
 		TLS_DISCONNECT(TLS_ALERT_RECORD_OVERFLOW, 0,
@@ -378,9 +732,9 @@ static bool tls_handle_ciphertext(struct l_tls *tls)
 		return false;
 	}
 
-	if ((tls->negotiated_version && tls->negotiated_version != version) ||
+	if ((record_version && record_version != version) ||
 			(!tls->negotiated_version &&
-			 tls->record_buf[1] != 0x03 /* Appending E.1 */)) {
+			 record[1] != 0x03 /* Appending E.1 */)) {
 		TLS_DISCONNECT(TLS_ALERT_PROTOCOL_VERSION, 0,
 				"Record version mismatch: %02x", version);
 		return false;
@@ -392,7 +746,12 @@ static bool tls_handle_ciphertext(struct l_tls *tls)
 		return false;
 	}
 
-	compressed = alloca(8 + 5 + fragment_len);
+	if (tls->negotiated_version >= L_TLS_V13 &&
+			tls->cipher_type[0] == TLS_CIPHER_AEAD)
+		return tls13_handle_ciphertext(tls, record, in_place);
+
+	in_place = in_place && tls->cipher_type[0] == TLS_CIPHER_AEAD;
+	compressed = alloca(8 + 5 + (in_place ? 0 : fragment_len));
 	/* Copy the type and version fields */
 	compressed[8] = type;
 	l_put_be16(version, compressed + 9);
@@ -404,9 +763,9 @@ static bool tls_handle_ciphertext(struct l_tls *tls)
 		l_put_be16(compressed_len, compressed + 11);
 
 		if (!tls->cipher[0])
-			memcpy(compressed + 13, tls->record_buf + 5,
+			memcpy(compressed + 13, record + 5,
 					cipher_output_len);
-		else if (!l_cipher_decrypt(tls->cipher[0], tls->record_buf + 5,
+		else if (!l_cipher_decrypt(tls->cipher[0], record + 5,
 						compressed + 13,
 						cipher_output_len)) {
 			TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
@@ -459,7 +818,7 @@ static bool tls_handle_ciphertext(struct l_tls *tls)
 
 		if (tls->negotiated_version >= L_TLS_V12) {
 			if (!l_cipher_set_iv(tls->cipher[0],
-						tls->record_buf + 5,
+						record + 5,
 						tls->record_iv_length[0])) {
 				TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
 						"Setting fragment IV failed");
@@ -467,14 +826,14 @@ static bool tls_handle_ciphertext(struct l_tls *tls)
 			}
 		} else if (tls->negotiated_version >= L_TLS_V11)
 			if (!l_cipher_decrypt(tls->cipher[0],
-						tls->record_buf + 5, iv,
+						record + 5, iv,
 						tls->record_iv_length[0])) {
 				TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
 						"Setting fragment IV failed");
 				return false;
 			}
 
-		if (!l_cipher_decrypt(tls->cipher[0], tls->record_buf + 5 + i,
+		if (!l_cipher_decrypt(tls->cipher[0], record + 5 + i,
 					compressed + 13, cipher_output_len)) {
 			TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
 					"Fragment decryption failed");
@@ -545,15 +904,19 @@ static bool tls_handle_ciphertext(struct l_tls *tls)
 		/* Prepend seq_num to TLSCompressed.type + .version + .length */
 		assocdata = compressed;
 		l_put_be64(tls->seq_num[0]++, assocdata);
-		compressed += 13;
+
+		if (in_place)
+			compressed = record + 5 + tls->record_iv_length[0];
+		else
+			compressed += 13;
 
 		/* Build the IV */
 		memcpy(iv, tls->fixed_iv[0], tls->fixed_iv_length[0]);
-		memcpy(iv + tls->fixed_iv_length[0], tls->record_buf + 5,
+		memcpy(iv + tls->fixed_iv_length[0], record + 5,
 			tls->record_iv_length[0]);
 
 		if (!l_aead_cipher_decrypt(tls->aead_cipher[0],
-				tls->record_buf + 5 + tls->record_iv_length[0],
+				record + 5 + tls->record_iv_length[0],
 				fragment_len - tls->record_iv_length[0],
 				assocdata, 13, iv, tls->fixed_iv_length[0] +
 				tls->record_iv_length[0],
@@ -575,8 +938,9 @@ static bool tls_handle_ciphertext(struct l_tls *tls)
 					type, version);
 }
 
-LIB_EXPORT void l_tls_handle_rx(struct l_tls *tls, const uint8_t *data,
-				size_t len)
+/* @data is only written to if @in_place is set */
+static void tls_handle_rx(struct l_tls *tls, uint8_t *data, size_t len,
+				bool in_place)
 {
 	int need_len;
 	int chunk_len;
@@ -586,27 +950,46 @@ LIB_EXPORT void l_tls_handle_rx(struct l_tls *tls, const uint8_t *data,
 	/* Reassemble TLSCiphertext structures from the received chunks */
 
 	while (1) {
+		/* Complete records don't need to go through tls->record_buf */
+		if (!tls->record_buf_len && len >= 5 &&
+				len >= 5 + (size_t) l_get_be16(data + 3)) {
+			need_len = 5 + l_get_be16(data + 3);
+
+			if (!tls_handle_ciphertext(tls, data, in_place))
+				return;
+
+			data += need_len;
+			len -= need_len;
+
+			if (tls->record_flush)
+				break;
+
+			continue;
+		}
+
 		/* Do we have a full header in tls->record_buf? */
 		if (tls->record_buf_len >= 5) {
 			need_len = 5 + l_get_be16(tls->record_buf + 3);
 
 			/* Do we have a full structure? */
 			if (tls->record_buf_len == need_len) {
-				if (!tls_handle_ciphertext(tls))
+				if (!tls_handle_ciphertext(tls,
+							tls->record_buf, true))
 					return;
 
 				tls->record_buf_len = 0;
-				need_len = 5;
 
 				if (tls->record_flush)
 					break;
-			}
 
-			if (!len)
-				break;
+				continue;
+			}
 		} else
 			need_len = 5;
 
+		if (!len)
+			break;
+
 		/* Try to fill up tls->record_buf up to need_len */
 		if (tls->record_buf_max_len < need_len) {
 			tls->record_buf_max_len = need_len;
@@ -626,4 +1009,101 @@ LIB_EXPORT void l_tls_handle_rx(struct l_tls *tls, const uint8_t *data,
 		if (chunk_len < need_len)
 			break;
 	}
+
+	/*
+	 * Records following the peer's Finished that were already read
+	 * from the socket can't be handed back to the kernel, keep doing
+	 * Rx in userspace in that case.
+	 */
+	if (tls->ktls_rx_pending) {
+		tls->ktls_rx_pending = false;
+
+		if (!tls->record_buf_len && !len)
+			tls_ktls_enable(tls, false);
+		else {
+			TLS_DEBUG("Rx data already buffered, no kTLS Rx");
+			explicit_bzero(tls->ktls_key[0],
+					sizeof(tls->ktls_key[0]));
+			tls->ktls_key_length[0] = 0;
+		}
+	}
+}
+
+LIB_EXPORT void l_tls_handle_rx(struct l_tls *tls, const uint8_t *data,
+				size_t len)
+{
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_TLS);
+	tls_handle_rx(tls, (uint8_t *) data, len, false);
+}
+
+/*
+ * Same as l_tls_handle_rx but the records are decrypted in @data itself,
+ * saving a copy of each record.  The contents of @data are undefined
+ * afterwards.
+ */
+LIB_EXPORT void l_tls_handle_rx_inplace(struct l_tls *tls, uint8_t *data,
+					size_t len)
+{
+	tls_handle_rx(tls, data, len, true);
+}
+
+/*
+ * To be called instead of l_tls_handle_rx when the socket is readable
+ * once l_tls_get_ktls_rx returns true.  Reads one record, the kernel has
+ * already decrypted it.
+ */
+LIB_EXPORT void l_tls_handle_ktls_rx(struct l_tls *tls)
+{
+#ifdef HAVE_LINUX_TLS_H
+	uint8_t cbuf[CMSG_SPACE(sizeof(uint8_t))];
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	uint8_t type = TLS_CT_APPLICATION_DATA;
+	ssize_t len;
+
+	if (unlikely(!tls || !tls->ktls_rx))
+		return;
+
+	if (tls->record_buf_max_len < 1 << 14) {
+		tls->record_buf_max_len = 1 << 14;
+		tls->record_buf = l_realloc(tls->record_buf, 1 << 14);
+	}
+
+	iov.iov_base = tls->record_buf;
+	iov.iov_len = tls->record_buf_max_len;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	len = recvmsg(tls->ktls_fd, &msg, MSG_DONTWAIT);
+	if (len < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return;
+
+		if (errno == EBADMSG)
+			TLS_DISCONNECT(TLS_ALERT_BAD_RECORD_MAC, 0,
+					"Record fragment MAC mismatch");
+		else
+			TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+					"recvmsg: %s", strerror(errno));
+
+		return;
+	}
+
+	/* End of stream is left for the application to handle */
+	if (!len)
+		return;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		if (cmsg->cmsg_level == SOL_TLS &&
+				cmsg->cmsg_type == TLS_GET_RECORD_TYPE)
+			type = *CMSG_DATA(cmsg);
+
+	tls->record_flush = false;
+	tls_handle_plaintext(tls, tls->record_buf, len, type,
+				tls->negotiated_version);
+#endif
 }
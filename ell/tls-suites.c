@@ -15,6 +15,7 @@
 #include <string.h>
 #include <strings.h>
 
+#include "useful.h"
 #include "util.h"
 #include "tls.h"
 #include "cipher.h"
@@ -24,6 +25,7 @@
 #include "key.h"
 #include "random.h"
 #include "ecc.h"
+#include "ecc-private.h"
 #include "ecdh.h"
 #include "missing.h"
 
@@ -154,6 +156,51 @@ error:
 	return result;
 }
 
+/*
+ * RFC 8446 Section 4.2.3: the rsa_pss_rsae schemes we offer for TLS 1.3
+ * may also be picked by a TLS 1.2 server for its ServerKeyExchange.
+ */
+static bool tls_rsa_pss_verify(struct l_tls *tls,
+				const uint8_t *in, size_t in_len,
+				const uint8_t *params, size_t params_len)
+{
+	const struct tls13_signature_scheme *scheme =
+		tls13_find_signature_scheme(l_get_be16(in));
+	uint8_t *content;
+	bool success;
+
+	if (in_len < 4 || l_get_be16(in + 2) != in_len - 4) {
+		TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+				"Signature msg too short (%zi) or signature "
+				"length doesn't match", in_len);
+		return false;
+	}
+
+	if (!scheme || scheme->key_type != L_CERT_KEY_RSA) {
+		TLS_DISCONNECT(TLS_ALERT_DECRYPT_ERROR, 0,
+				"Unknown signature scheme %04x",
+				l_get_be16(in));
+		return false;
+	}
+
+	content = l_malloc(64 + params_len);
+	memcpy(content + 0, tls->pending.client_random, 32);
+	memcpy(content + 32, tls->pending.server_random, 32);
+	memcpy(content + 64, params, params_len);
+
+	success = tls13_verify(tls, scheme, content, 64 + params_len,
+				in + 4, in_len - 4);
+	l_free(content);
+
+	if (!success)
+		TLS_DISCONNECT(TLS_ALERT_DECRYPT_ERROR, 0,
+				"Peer signature verification failed");
+	else
+		TLS_DEBUG("Peer signature verified");
+
+	return success;
+}
+
 static bool tls_rsa_verify(struct l_tls *tls, const uint8_t *in, size_t in_len,
 				tls_get_hash_t get_hash,
 				const uint8_t *data, size_t data_len)
@@ -165,6 +212,11 @@ static bool tls_rsa_verify(struct l_tls *tls, const uint8_t *in, size_t in_len,
 	uint16_t opaque_len;
 	bool success;
 
+	/* Only the key exchange signature comes with the signed @data */
+	if (tls->negotiated_version >= L_TLS_V12 && data &&
+			in_len >= 2 && in[0] == 8)
+		return tls_rsa_pss_verify(tls, in, in_len, data, data_len);
+
 	opaque = validate_digitally_signed(tls, in, in_len,
 				SIGNATURE_ALGORITHM_RSA, &opaque_len);
 	if (!opaque)
@@ -324,6 +376,206 @@ static struct tls_signature_algorithm tls_ecdsa_signature = {
 	.verify = tls_ecdsa_verify,
 };
 
+/* RFC 8446 Section 4.2.3, in our order of preference */
+const struct tls13_signature_scheme tls13_signature_schemes[] = {
+	{ 0x0804, "rsa_pss_rsae_sha256", L_CERT_KEY_RSA, L_CHECKSUM_SHA256 },
+	{ 0x0805, "rsa_pss_rsae_sha384", L_CERT_KEY_RSA, L_CHECKSUM_SHA384 },
+	{ 0x0806, "rsa_pss_rsae_sha512", L_CERT_KEY_RSA, L_CHECKSUM_SHA512 },
+	{ 0x0403, "ecdsa_secp256r1_sha256", L_CERT_KEY_ECC, L_CHECKSUM_SHA256 },
+	{ 0x0503, "ecdsa_secp384r1_sha384", L_CERT_KEY_ECC, L_CHECKSUM_SHA384 },
+	{}
+};
+
+const struct tls13_signature_scheme *tls13_find_signature_scheme(uint16_t id)
+{
+	const struct tls13_signature_scheme *scheme;
+
+	for (scheme = tls13_signature_schemes; scheme->name; scheme++)
+		if (scheme->id == id)
+			return scheme;
+
+	return NULL;
+}
+
+/* RFC 8017 Section B.2.1 MGF1, XORs the mask into @buf */
+static void tls13_mgf1_xor(enum l_checksum_type type,
+				const uint8_t *seed, size_t seed_len,
+				uint8_t *buf, size_t len)
+{
+	struct l_checksum *hash = l_checksum_new(type);
+	size_t hash_len = l_checksum_digest_length(type);
+	uint8_t counter[4];
+	uint8_t mask[64];
+	uint32_t i;
+	size_t j;
+
+	for (i = 0; len; i++) {
+		size_t chunk_len = minsize(len, hash_len);
+
+		l_put_be32(i, counter);
+		l_checksum_reset(hash);
+		l_checksum_update(hash, seed, seed_len);
+		l_checksum_update(hash, counter, 4);
+		l_checksum_get_digest(hash, mask, hash_len);
+
+		for (j = 0; j < chunk_len; j++)
+			buf[j] ^= mask[j];
+
+		buf += chunk_len;
+		len -= chunk_len;
+	}
+
+	explicit_bzero(mask, sizeof(mask));
+	l_checksum_free(hash);
+}
+
+/* H = Hash(0x00 * 8 || mHash || salt), RFC 8017 Section 9.1.1 */
+static void tls13_pss_hash(enum l_checksum_type type,
+				const uint8_t *m_hash, const uint8_t *salt,
+				uint8_t *out)
+{
+	struct l_checksum *hash = l_checksum_new(type);
+	size_t hash_len = l_checksum_digest_length(type);
+	static const uint8_t zeros[8];
+
+	l_checksum_update(hash, zeros, 8);
+	l_checksum_update(hash, m_hash, hash_len);
+	l_checksum_update(hash, salt, hash_len);
+	l_checksum_get_digest(hash, out, hash_len);
+	l_checksum_free(hash);
+}
+
+static bool tls13_hash_data(enum l_checksum_type type,
+				const uint8_t *data, size_t data_len,
+				uint8_t *out)
+{
+	struct l_checksum *hash = l_checksum_new(type);
+
+	if (!hash)
+		return false;
+
+	l_checksum_update(hash, data, data_len);
+	l_checksum_get_digest(hash, out, l_checksum_digest_length(type));
+	l_checksum_free(hash);
+	return true;
+}
+
+/*
+ * RSASSA-PSS with MGF1 using the same hash and a salt of the hash length
+ * as required by RFC 8446 Section 4.2.3.  The modulus length is assumed
+ * to be a multiple of 8 bits so emLen equals the key size and the top
+ * bit of the encoded message is the one cleared.
+ */
+ssize_t tls13_sign(struct l_tls *tls,
+			const struct tls13_signature_scheme *scheme,
+			const uint8_t *data, size_t data_len,
+			uint8_t *out, size_t out_len)
+{
+	size_t em_len = tls->priv_key_size;
+	size_t hash_len = l_checksum_digest_length(scheme->hash);
+	uint8_t m_hash[64];
+	uint8_t salt[64];
+	uint8_t em[512];
+	size_t db_len = em_len - hash_len - 1;
+	ssize_t r;
+
+	if (scheme->key_type != L_CERT_KEY_RSA || !tls->priv_key)
+		return -ENOKEY;
+
+	if (out_len < em_len || em_len > sizeof(em))
+		return -EMSGSIZE;
+
+	if (em_len < 2 * hash_len + 2)
+		return -EINVAL;
+
+	if (!tls13_hash_data(scheme->hash, data, data_len, m_hash))
+		return -ENOTSUP;
+
+	l_getrandom(salt, hash_len);
+
+	/* DB = PS || 0x01 || salt, EM = maskedDB || H || 0xbc */
+	memset(em, 0, db_len - hash_len - 1);
+	em[db_len - hash_len - 1] = 0x01;
+	memcpy(em + db_len - hash_len, salt, hash_len);
+	tls13_pss_hash(scheme->hash, m_hash, salt, em + db_len);
+	tls13_mgf1_xor(scheme->hash, em + db_len, hash_len, em, db_len);
+	em[0] &= 0x7f;
+	em[em_len - 1] = 0xbc;
+
+	r = l_key_decrypt(tls->priv_key, L_KEY_RSA_RAW, L_CHECKSUM_NONE,
+				em, out, em_len, em_len);
+	explicit_bzero(em, em_len);
+	explicit_bzero(salt, sizeof(salt));
+
+	if (r < 0)
+		return r;
+
+	return r == (ssize_t) em_len ? r : -EIO;
+}
+
+static bool tls13_rsa_pss_verify(struct l_tls *tls,
+				enum l_checksum_type type,
+				const uint8_t *m_hash,
+				const uint8_t *sig, size_t sig_len)
+{
+	size_t em_len = tls->peer_pubkey_size;
+	size_t hash_len = l_checksum_digest_length(type);
+	size_t db_len = em_len - hash_len - 1;
+	uint8_t em[512];
+	uint8_t h[64];
+	size_t i;
+
+	if (sig_len != em_len || em_len > sizeof(em) ||
+			em_len < 2 * hash_len + 2)
+		return false;
+
+	if (l_key_encrypt(tls->peer_pubkey, L_KEY_RSA_RAW, L_CHECKSUM_NONE,
+				sig, em, sig_len, em_len) != (ssize_t) em_len)
+		return false;
+
+	if (em[em_len - 1] != 0xbc || (em[0] & 0x80))
+		return false;
+
+	tls13_mgf1_xor(type, em + db_len, hash_len, em, db_len);
+	em[0] &= 0x7f;
+
+	for (i = 0; i < db_len - hash_len - 1; i++)
+		if (em[i])
+			return false;
+
+	if (em[i] != 0x01)
+		return false;
+
+	tls13_pss_hash(type, m_hash, em + db_len - hash_len, h);
+	return !memcmp(h, em + db_len, hash_len);
+}
+
+bool tls13_verify(struct l_tls *tls,
+			const struct tls13_signature_scheme *scheme,
+			const uint8_t *data, size_t data_len,
+			const uint8_t *sig, size_t sig_len)
+{
+	uint8_t m_hash[64];
+	size_t hash_len = l_checksum_digest_length(scheme->hash);
+
+	if (l_cert_get_pubkey_type(tls->peer_cert) != scheme->key_type)
+		return false;
+
+	if (!tls13_hash_data(scheme->hash, data, data_len, m_hash))
+		return false;
+
+	if (scheme->key_type == L_CERT_KEY_RSA)
+		return tls13_rsa_pss_verify(tls, scheme->hash, m_hash,
+						sig, sig_len);
+
+	/* In TLS 1.3 the ECDSA scheme also fixes the curve */
+	if (tls->peer_pubkey_size != hash_len)
+		return false;
+
+	return l_key_verify(tls->peer_pubkey, L_KEY_ECDSA_X962, scheme->hash,
+				m_hash, sig, hash_len, sig_len);
+}
+
 static bool tls_send_rsa_client_key_xchg(struct l_tls *tls)
 {
 	uint8_t buf[1024 + 32];
@@ -507,6 +759,16 @@ static size_t tls_write_ecpoint(uint8_t *buf, size_t len,
 {
 	size_t point_bytes;
 
+	/*
+	 * RFC 8422, Section 5.11: X25519 public values are the plain u
+	 * coordinate without the form byte.
+	 */
+	if (point->curve->montgomery) {
+		point_bytes = l_ecc_point_get_data(point, buf + 1, len - 1);
+		buf[0] = point_bytes;			/* length */
+		return 1 + point_bytes;
+	}
+
 	/* RFC 8422, Section 5.4.1 */
 	point_bytes = l_ecc_point_get_data(point, buf + 2, len - 2);
 	buf[0] = 1 + point_bytes;		/* length */
@@ -514,6 +776,44 @@ static size_t tls_write_ecpoint(uint8_t *buf, size_t len,
 	return 2 + point_bytes;
 }
 
+/*
+ * Parses the contents of an ECPoint, returning the size of the public
+ * value itself and moving @buf past the uncompressed form byte, if any.
+ */
+static ssize_t tls_parse_ecpoint_form(struct l_tls *tls,
+					const struct l_ecc_curve *curve,
+					const uint8_t **buf, size_t len)
+{
+	if (curve->montgomery)
+		return len;
+
+	if (len < 1)
+		return -EBADMSG;
+
+	if (**buf != 4) {	/* uncompressed */
+		TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+				"Unsupported (deprecated?) PointConversionForm "
+				"%u", **buf);
+		return -EINVAL;
+	}
+
+	*buf += 1;
+	return len - 1;
+}
+
+static enum l_ecc_point_type tls_ecpoint_type(const struct l_ecc_curve *curve)
+{
+	return curve->montgomery ? L_ECC_POINT_TYPE_COMPLIANT :
+					L_ECC_POINT_TYPE_FULL;
+}
+
+static size_t tls_ecpoint_size(const struct l_ecc_curve *curve)
+{
+	size_t scalar_bytes = l_ecc_curve_get_scalar_bytes(curve);
+
+	return curve->montgomery ? scalar_bytes : 2 * scalar_bytes;
+}
+
 static size_t tls_write_server_ecdh_params(struct l_tls *tls, uint8_t *buf, size_t len)
 {
 	struct tls_ecdhe_params *params = tls->pending.key_xchg_params;
@@ -545,8 +845,23 @@ static bool tls_send_ecdhe_server_key_xchg(struct l_tls *tls)
 	params->curve = l_ecc_curve_from_tls_group(tls->negotiated_curve->id);
 	tls->pending.key_xchg_params = params;
 
-	if (!l_ecdh_generate_key_pair(params->curve,
-					&params->private, &params->public)) {
+	if (tls->ecdhe_key_cache) {
+		if (!tls_ecdhe_key_cache_get(tls->ecdhe_key_cache,
+						params->curve,
+						&params->private,
+						&params->public)) {
+			TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+					"Getting cached ECDH key pair failed");
+			return false;
+		}
+	} else if ((!tls->key_pool ||
+			!tls_key_pool_get_ec(tls->key_pool,
+						tls->negotiated_curve,
+						&params->private,
+						&params->public)) &&
+			!l_ecdh_generate_key_pair(params->curve,
+						&params->private,
+						&params->public)) {
 		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
 				"Generating ECDH key pair failed");
 		return false;
@@ -578,7 +893,9 @@ static void tls_handle_ecdhe_server_key_xchg(struct l_tls *tls,
 	struct tls_ecdhe_params *params;
 	uint16_t namedcurve;
 	const uint8_t *server_ecdh_params_ptr = buf;
-	size_t point_bytes;
+	const struct l_ecc_curve *curve;
+	size_t ecpoint_len;
+	ssize_t point_bytes;
 
 	/* RFC 8422, Section 5.4 */
 
@@ -607,42 +924,38 @@ static void tls_handle_ecdhe_server_key_xchg(struct l_tls *tls,
 
 	TLS_DEBUG("Negotiated %s", tls->negotiated_curve->name);
 
-	if (*buf < 1)
-		goto decode_error;
-
-	point_bytes = *buf++ - 1;
-
-	if (*buf != 4) {	/* uncompressed */
-		TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
-				"Unsupported (deprecated?) PointConversionForm "
-				"%u", *buf);
-		return;
-	}
+	curve = l_ecc_curve_from_tls_group(tls->negotiated_curve->id);
+	ecpoint_len = *buf++;
+	len -= 1;
 
-	buf++;
-	len -= 2;
+	if (len < ecpoint_len)
+		goto decode_error;
 
-	if (len < point_bytes)
+	point_bytes = tls_parse_ecpoint_form(tls, curve, &buf, ecpoint_len);
+	if (point_bytes == -EBADMSG)
 		goto decode_error;
+	else if (point_bytes < 0)
+		return;
 
 	/*
 	 * RFC 8422, Section 5.11: "A receiving party MUST check that the
 	 * x and y parameters from the peer's public value satisfy the
 	 * curve equation, y^2 = x^3 + ax + b mod p."
 	 * This happens in l_ecc_point_from_data when the L_ECC_POINT_TYPE_FULL
-	 * format is used.
+	 * format is used.  For X25519 any 32-byte value is accepted and a
+	 * low-order point is caught when computing the shared secret.
 	 */
 	params = l_new(struct tls_ecdhe_params, 1);
-	params->curve = l_ecc_curve_from_tls_group(tls->negotiated_curve->id);
+	params->curve = curve;
 	params->public = l_ecc_point_from_data(params->curve,
-						L_ECC_POINT_TYPE_FULL,
+						tls_ecpoint_type(curve),
 						buf, point_bytes);
 	tls->pending.key_xchg_params = params;
 	buf += point_bytes;
-	len -= point_bytes;
+	len -= ecpoint_len;
 
-	if (!params->public || point_bytes !=
-			2 * l_ecc_curve_get_scalar_bytes(params->curve)) {
+	if (!params->public ||
+			(size_t) point_bytes != tls_ecpoint_size(curve)) {
 		TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
 				"ServerKeyExchange.params.public decode error");
 		return;
@@ -680,8 +993,14 @@ static bool tls_send_ecdhe_client_key_xchg(struct l_tls *tls)
 
 	/* RFC 8422, Section 5.7 */
 
-	if (!l_ecdh_generate_key_pair(params->curve,
-					&params->private, &our_public)) {
+	if ((!tls->key_pool ||
+			!tls_key_pool_get_ec(tls->key_pool,
+						tls->negotiated_curve,
+						&params->private,
+						&our_public)) &&
+			!l_ecdh_generate_key_pair(params->curve,
+							&params->private,
+							&our_public)) {
 		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
 				"Generating ECDH key pair failed");
 		return false;
@@ -737,27 +1056,20 @@ static void tls_handle_ecdhe_client_key_xchg(struct l_tls *tls,
 	ssize_t pre_master_secret_len;
 	struct l_ecc_point *other_public;
 	struct l_ecc_scalar *secret;
-	size_t point_bytes = 2 * l_ecc_curve_get_scalar_bytes(params->curve);
+	ssize_t point_bytes;
 
 	/* RFC 8422, Section 5.7 */
 
-	if (len < 2)
+	if (len < 1 || *buf++ != len - 1)
 		goto decode_error;
 
-	if (*buf++ != 1 + point_bytes)
+	point_bytes = tls_parse_ecpoint_form(tls, params->curve, &buf, --len);
+	if (point_bytes == -EBADMSG)
 		goto decode_error;
-
-	if (*buf != 4) {	/* uncompressed */
-		TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
-				"Unsupported (deprecated?) PointConversionForm "
-				"%u", *buf);
+	else if (point_bytes < 0)
 		return;
-	}
 
-	buf++;
-	len -= 2;
-
-	if (len != point_bytes)
+	if ((size_t) point_bytes != tls_ecpoint_size(params->curve))
 		goto decode_error;
 
 	/*
@@ -768,8 +1080,8 @@ static void tls_handle_ecdhe_client_key_xchg(struct l_tls *tls,
 	 * format is used.
 	 */
 	other_public = l_ecc_point_from_data(params->curve,
-						L_ECC_POINT_TYPE_FULL,
-						buf, len);
+					tls_ecpoint_type(params->curve),
+					buf, point_bytes);
 	if (!other_public) {
 		TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
 				"ClientKeyExchange.exchange_keys.ecdh_Yc "
@@ -869,22 +1181,30 @@ static bool tls_send_dhe_server_key_xchg(struct l_tls *tls)
 		goto free_params;
 	}
 
-	params->private = l_key_generate_dh_private(prime_buf, params->prime_len);
-	if (!params->private) {
-		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
-				"l_key_generate_dh_private failed");
-		goto free_params;
-	}
-
 	memset(public_buf, 0, sizeof(public_buf));
 	public_len = params->prime_len;
 
-	if (!l_key_compute_dh_public(params->generator, params->private,
-					params->prime, public_buf,
-					&public_len)) {
-		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
-				"l_key_compute_dh_public failed");
-		goto free_params;
+	if (tls->key_pool)
+		params->private = tls_key_pool_get_ff(tls->key_pool,
+						tls->negotiated_ff_group,
+						public_buf);
+
+	if (!params->private) {
+		params->private = l_key_generate_dh_private(prime_buf,
+							params->prime_len);
+		if (!params->private) {
+			TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+					"l_key_generate_dh_private failed");
+			goto free_params;
+		}
+
+		if (!l_key_compute_dh_public(params->generator,
+						params->private, params->prime,
+						public_buf, &public_len)) {
+			TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+					"l_key_compute_dh_public failed");
+			goto free_params;
+		}
 	}
 
 	while (zeros < public_len && public_buf[zeros] == 0x00)
@@ -1230,6 +1550,21 @@ static struct tls_bulk_encryption_algorithm tls_aes128 = {
 	.iv_length = 12,
 	.fixed_iv_length = 4,
 	.auth_tag_length = 16,
+}, tls13_aes128_gcm = {
+	/* RFC 8446 Section 5.3: the whole nonce is derived per record */
+	.cipher_type = TLS_CIPHER_AEAD,
+	.l_aead_id = L_AEAD_CIPHER_AES_GCM,
+	.key_length = 16,
+	.iv_length = 12,
+	.fixed_iv_length = 12,
+	.auth_tag_length = 16,
+}, tls13_aes256_gcm = {
+	.cipher_type = TLS_CIPHER_AEAD,
+	.l_aead_id = L_AEAD_CIPHER_AES_GCM,
+	.key_length = 32,
+	.iv_length = 12,
+	.fixed_iv_length = 12,
+	.auth_tag_length = 16,
 };
 
 static struct tls_mac_algorithm tls_sha = {
@@ -1425,9 +1760,23 @@ static struct tls_cipher_suite tls_rsa_with_3des_ede_cbc_sha = {
 	.prf_hmac = L_CHECKSUM_SHA384,
 	.signature = &tls_ecdsa_signature,
 	.key_xchg = &tls_ecdhe,
+}, tls_aes_128_gcm_sha256 = {
+	.id = { 0x13, 0x01 },
+	.name = "TLS_AES_128_GCM_SHA256",
+	.encryption = &tls13_aes128_gcm,
+	.prf_hmac = L_CHECKSUM_SHA256,
+	.tls13 = true,
+}, tls_aes_256_gcm_sha384 = {
+	.id = { 0x13, 0x02 },
+	.name = "TLS_AES_256_GCM_SHA384",
+	.encryption = &tls13_aes256_gcm,
+	.prf_hmac = L_CHECKSUM_SHA384,
+	.tls13 = true,
 };
 
 struct tls_cipher_suite *tls_cipher_suite_pref[] = {
+	&tls_aes_256_gcm_sha384,
+	&tls_aes_128_gcm_sha256,
 	&tls_ecdhe_rsa_with_aes_256_cbc_sha,
 	&tls_ecdhe_ecdsa_with_aes_256_cbc_sha,
 	&tls_ecdhe_rsa_with_aes_128_cbc_sha,
@@ -0,0 +1,268 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include "useful.h"
+#include "private.h"
+#include "missing.h"
+#include "tls.h"
+#include "checksum.h"
+#include "cipher.h"
+#include "random.h"
+#include "time.h"
+#include "time-private.h"
+#include "cert.h"
+#include "tls-private.h"
+
+/*
+ * Session tickets use the format recommended in RFC 5077 Section 4 with
+ * AES-256-GCM in place of AES-CBC + HMAC:
+ *
+ *	key_name[16] | iv[12] | encrypted_state | tag[16]
+ *
+ * The ticket keys are derived from a secret and the number of the current
+ * rotation period so that servers sharing the secret can open each other's
+ * tickets without sharing any other state.  Tickets are always sealed with
+ * the current period's key and the previous period's key is still
+ * accepted so a ticket is valid for at least one rotation interval.  The
+ * first half of the key name is the period number, used to find the key.
+ */
+#define TICKET_KEY_NAME_SIZE	16
+#define TICKET_IV_SIZE		12
+#define TICKET_TAG_SIZE		16
+
+struct tls_ticket_key {
+	uint64_t period;
+	uint8_t name[TICKET_KEY_NAME_SIZE];
+	struct l_aead_cipher *cipher;
+};
+
+struct l_tls_ticket_keys {
+	struct l_checksum *hmac;
+	uint64_t interval;
+	struct tls_ticket_key keys[2];
+};
+
+static bool tls_ticket_key_derive(struct l_tls_ticket_keys *ticket_keys,
+					uint64_t period,
+					struct tls_ticket_key *key)
+{
+	static const char name_label[] = "ell ticket key name";
+	static const char key_label[] = "ell ticket key";
+	uint8_t period_buf[8];
+	uint8_t digest[32];
+	struct l_aead_cipher *cipher;
+
+	l_put_be64(period, period_buf);
+
+	l_checksum_reset(ticket_keys->hmac);
+	l_checksum_update(ticket_keys->hmac, key_label, strlen(key_label));
+	l_checksum_update(ticket_keys->hmac, period_buf, 8);
+
+	if (l_checksum_get_digest(ticket_keys->hmac, digest, 32) != 32)
+		return false;
+
+	cipher = l_aead_cipher_new(L_AEAD_CIPHER_AES_GCM, digest, 32,
+					TICKET_TAG_SIZE);
+	explicit_bzero(digest, 32);
+
+	if (!cipher)
+		return false;
+
+	l_checksum_reset(ticket_keys->hmac);
+	l_checksum_update(ticket_keys->hmac, name_label, strlen(name_label));
+	l_checksum_update(ticket_keys->hmac, period_buf, 8);
+
+	if (l_checksum_get_digest(ticket_keys->hmac, digest, 32) != 32) {
+		l_aead_cipher_free(cipher);
+		return false;
+	}
+
+	l_aead_cipher_free(key->cipher);
+	key->cipher = cipher;
+	key->period = period;
+	memcpy(key->name, period_buf, 8);
+	memcpy(key->name + 8, digest, TICKET_KEY_NAME_SIZE - 8);
+	return true;
+}
+
+static struct tls_ticket_key *tls_ticket_key_get(
+					struct l_tls_ticket_keys *ticket_keys,
+					uint64_t period)
+{
+	uint64_t now = time_realtime_now() / ticket_keys->interval;
+	struct tls_ticket_key *key;
+	unsigned int i;
+
+	if (period != now && period + 1 != now)
+		return NULL;
+
+	for (i = 0; i < L_ARRAY_SIZE(ticket_keys->keys); i++) {
+		key = &ticket_keys->keys[i];
+
+		if (key->cipher && key->period == period)
+			return key;
+	}
+
+	/* Replace a key that's not valid anymore, there's always one */
+	for (i = 0; i < L_ARRAY_SIZE(ticket_keys->keys); i++) {
+		key = &ticket_keys->keys[i];
+
+		if (!key->cipher ||
+				(key->period != now && key->period + 1 != now))
+			break;
+	}
+
+	if (!tls_ticket_key_derive(ticket_keys, period, key))
+		return NULL;
+
+	return key;
+}
+
+/**
+ * l_tls_ticket_keys_new:
+ * @secret: key material the ticket keys are derived from or NULL to
+ *   generate a random secret.  Servers that need to resume each other's
+ *   sessions must use the same secret.
+ * @secret_len: length of @secret in bytes
+ * @rotation_interval: a CLOCK_REALTIME-based microsecond resolution
+ *   interval at which a new ticket key is taken into use.  Tickets are
+ *   accepted for between one and two intervals after they're issued.
+ *
+ * Returns: a new ticket key set to pass to l_tls_set_session_tickets.  It
+ * can be shared by any number of l_tls objects in one thread and must
+ * outlive them.  Servers with one loop per thread create one set per thread
+ * from the same @secret, tickets issued by any of them are then accepted by
+ * all.
+ */
+LIB_EXPORT struct l_tls_ticket_keys *l_tls_ticket_keys_new(
+						const void *secret,
+						size_t secret_len,
+						uint64_t rotation_interval)
+{
+	struct l_tls_ticket_keys *ticket_keys;
+	uint8_t random_secret[32];
+	struct l_checksum *hmac;
+
+	if (unlikely(!rotation_interval || (secret && !secret_len)))
+		return NULL;
+
+	if (!secret) {
+		if (!l_getrandom(random_secret, sizeof(random_secret)))
+			return NULL;
+
+		secret = random_secret;
+		secret_len = sizeof(random_secret);
+	}
+
+	hmac = l_checksum_new_hmac(L_CHECKSUM_SHA256, secret, secret_len);
+	explicit_bzero(random_secret, sizeof(random_secret));
+
+	if (!hmac)
+		return NULL;
+
+	ticket_keys = l_new(struct l_tls_ticket_keys, 1);
+	ticket_keys->hmac = hmac;
+	ticket_keys->interval = rotation_interval;
+	return ticket_keys;
+}
+
+LIB_EXPORT void l_tls_ticket_keys_free(struct l_tls_ticket_keys *ticket_keys)
+{
+	unsigned int i;
+
+	if (unlikely(!ticket_keys))
+		return;
+
+	for (i = 0; i < L_ARRAY_SIZE(ticket_keys->keys); i++)
+		l_aead_cipher_free(ticket_keys->keys[i].cipher);
+
+	l_checksum_free(ticket_keys->hmac);
+	l_free(ticket_keys);
+}
+
+uint64_t tls_ticket_lifetime(const struct l_tls_ticket_keys *ticket_keys)
+{
+	return ticket_keys->interval;
+}
+
+/* Returns the ticket for @state in a new buffer */
+uint8_t *tls_ticket_seal(struct l_tls_ticket_keys *ticket_keys,
+				const uint8_t *state, size_t state_len,
+				size_t *out_len)
+{
+	uint64_t period = time_realtime_now() / ticket_keys->interval;
+	struct tls_ticket_key *key = tls_ticket_key_get(ticket_keys, period);
+	size_t len = state_len + TLS_TICKET_OVERHEAD;
+	uint8_t *ticket;
+
+	if (!key)
+		return NULL;
+
+	ticket = l_malloc(len);
+	memcpy(ticket, key->name, TICKET_KEY_NAME_SIZE);
+	l_getrandom(ticket + TICKET_KEY_NAME_SIZE, TICKET_IV_SIZE);
+
+	if (!l_aead_cipher_encrypt(key->cipher, state, state_len,
+					ticket, TICKET_KEY_NAME_SIZE,
+					ticket + TICKET_KEY_NAME_SIZE,
+					TICKET_IV_SIZE,
+					ticket + TICKET_KEY_NAME_SIZE +
+					TICKET_IV_SIZE,
+					state_len + TICKET_TAG_SIZE)) {
+		l_free(ticket);
+		return NULL;
+	}
+
+	*out_len = len;
+	return ticket;
+}
+
+/*
+ * Returns the state from @ticket in a new buffer or NULL if the ticket
+ * was not issued with one of the currently accepted keys or has been
+ * modified.  The caller should wipe the state before freeing it.
+ */
+uint8_t *tls_ticket_open(struct l_tls_ticket_keys *ticket_keys,
+				const uint8_t *ticket, size_t len,
+				size_t *out_len)
+{
+	struct tls_ticket_key *key;
+	size_t state_len;
+	uint8_t *state;
+
+	if (len <= TLS_TICKET_OVERHEAD)
+		return NULL;
+
+	key = tls_ticket_key_get(ticket_keys, l_get_be64(ticket));
+	if (!key || memcmp(key->name, ticket, TICKET_KEY_NAME_SIZE))
+		return NULL;
+
+	state_len = len - TLS_TICKET_OVERHEAD;
+	state = l_malloc(state_len);
+
+	if (!l_aead_cipher_decrypt(key->cipher,
+					ticket + TICKET_KEY_NAME_SIZE +
+					TICKET_IV_SIZE,
+					state_len + TICKET_TAG_SIZE,
+					ticket, TICKET_KEY_NAME_SIZE,
+					ticket + TICKET_KEY_NAME_SIZE,
+					TICKET_IV_SIZE,
+					state, state_len)) {
+		l_free(state);
+		return NULL;
+	}
+
+	*out_len = state_len;
+	return state;
+}
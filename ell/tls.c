@@ -30,12 +30,14 @@
 #include "cert-private.h"
 #include "tls-private.h"
 #include "key.h"
+#include "ecc.h"
 #include "strv.h"
 #include "missing.h"
 #include "string.h"
 #include "settings.h"
 #include "time.h"
 #include "time-private.h"
+#include "memory-private.h"
 
 bool tls10_prf(const void *secret, size_t secret_len,
 		const char *label,
@@ -115,6 +117,87 @@ bool tls12_prf(enum l_checksum_type type,
 	return true;
 }
 
+/* RFC 8446 Section 7.1 HKDF-Expand-Label */
+bool tls13_hkdf_expand_label(enum l_checksum_type type,
+				const void *secret, size_t secret_len,
+				const char *label,
+				const void *context, size_t context_len,
+				uint8_t *out, size_t out_len)
+{
+	size_t label_len = strlen(label);
+	uint8_t info[2 + 1 + 255 + 1 + 255];
+	uint8_t *ptr = info;
+
+	if (6 + label_len > 255 || context_len > 255 || out_len > 0xffff)
+		return false;
+
+	l_put_be16(out_len, ptr);
+	ptr += 2;
+	*ptr++ = 6 + label_len;
+	memcpy(ptr, "tls13 ", 6);
+	memcpy(ptr + 6, label, label_len);
+	ptr += 6 + label_len;
+	*ptr++ = context_len;
+
+	if (context_len) {
+		memcpy(ptr, context, context_len);
+		ptr += context_len;
+	}
+
+	return l_checksum_hkdf_expand(type, secret, secret_len,
+					info, ptr - info, out, out_len);
+}
+
+/* Derive-Secret, a NULL @transcript_hash stands for Hash("") */
+static bool tls13_derive_secret(struct l_tls *tls, const uint8_t *secret,
+				const char *label,
+				const uint8_t *transcript_hash, uint8_t *out)
+{
+	enum l_checksum_type type = tls->prf_hmac->l_id;
+	size_t hash_len = l_checksum_digest_length(type);
+	uint8_t empty_hash[HANDSHAKE_HASH_MAX_SIZE];
+
+	if (!transcript_hash) {
+		struct l_checksum *hash = l_checksum_new(type);
+
+		if (!hash)
+			return false;
+
+		l_checksum_get_digest(hash, empty_hash, hash_len);
+		l_checksum_free(hash);
+		transcript_hash = empty_hash;
+	}
+
+	return tls13_hkdf_expand_label(type, secret, hash_len, label,
+					transcript_hash, hash_len,
+					out, hash_len);
+}
+
+/* RFC 8446 Section 7.5 TLS-Exporter with an empty context */
+static bool tls13_export(struct l_tls *tls, const char *label,
+				uint8_t *buf, size_t len)
+{
+	enum l_checksum_type type = tls->prf_hmac->l_id;
+	size_t hash_len = l_checksum_digest_length(type);
+	uint8_t secret[HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t empty_hash[HANDSHAKE_HASH_MAX_SIZE];
+	struct l_checksum *hash = l_checksum_new(type);
+	bool r;
+
+	if (!hash)
+		return false;
+
+	l_checksum_get_digest(hash, empty_hash, hash_len);
+	l_checksum_free(hash);
+
+	r = tls13_derive_secret(tls, tls->pending.master_secret, label,
+				empty_hash, secret) &&
+		tls13_hkdf_expand_label(type, secret, hash_len, "exporter",
+					empty_hash, hash_len, buf, len);
+	explicit_bzero(secret, sizeof(secret));
+	return r;
+}
+
 static bool tls_prf_get_bytes(struct l_tls *tls,
 				const void *secret, size_t secret_len,
 				const char *label,
@@ -138,6 +221,13 @@ LIB_EXPORT bool l_tls_prf_get_bytes(struct l_tls *tls, bool use_master_secret,
 	if (unlikely(!tls || !tls->prf_hmac))
 		return false;
 
+	/*
+	 * TLS 1.3 has no PRF, the exporter master secret is kept in
+	 * pending.master_secret until the ready callback returns.
+	 */
+	if (tls->negotiated_version >= L_TLS_V13)
+		return use_master_secret && tls13_export(tls, label, buf, len);
+
 	memcpy(seed +  0, tls->pending.client_random, 32);
 	memcpy(seed + 32, tls->pending.server_random, 32);
 
@@ -175,7 +265,7 @@ static void tls_reset_handshake(struct l_tls *tls)
 
 	explicit_bzero(tls->pending.key_block, sizeof(tls->pending.key_block));
 
-	if (tls->pending.cipher_suite &&
+	if (tls->pending.cipher_suite && tls->pending.cipher_suite->key_xchg &&
 			tls->pending.cipher_suite->key_xchg->free_params)
 		tls->pending.cipher_suite->key_xchg->free_params(tls);
 
@@ -201,6 +291,27 @@ static void tls_reset_handshake(struct l_tls *tls)
 	tls->session_id_new = false;
 	l_free(l_steal_ptr(tls->session_peer_identity));
 	tls->session_resumed = false;
+	tls->session_expiry = 0;
+
+	l_free(l_steal_ptr(tls->session_ticket));
+	tls->session_ticket_len = 0;
+	tls->session_ticket_new = false;
+	tls->session_ticket_send = false;
+	tls->session_ticket_expected = false;
+
+	tls->ocsp_status_send = false;
+	tls->ocsp_status_expected = false;
+	tls->ocsp_status_verified = false;
+	l_cert_free(l_steal_ptr(tls->ocsp_issuer));
+
+	tls13_key_share_free(tls);
+	tls->tls13_offered = false;
+	tls->tls13_hrr = false;
+	tls->tls13_hrr_group = NULL;
+	l_free(l_steal_ptr(tls->tls13_cookie));
+	tls->tls13_cookie_len = 0;
+	tls->tls13_sign_scheme = NULL;
+	explicit_bzero(tls->tls13_secret, sizeof(tls->tls13_secret));
 }
 
 static void tls_cleanup_handshake(struct l_tls *tls)
@@ -210,14 +321,8 @@ static void tls_cleanup_handshake(struct l_tls *tls)
 	explicit_bzero(tls->pending.master_secret, 48);
 }
 
-static bool tls_change_cipher_spec(struct l_tls *tls, bool txrx,
-					const char **error)
+static void tls_clear_cipher_spec(struct l_tls *tls, bool txrx)
 {
-	struct tls_bulk_encryption_algorithm *enc;
-	struct tls_mac_algorithm *mac;
-	int key_offset;
-	static char error_buf[200];
-
 	if (tls->cipher_type[txrx] == TLS_CIPHER_AEAD) {
 		if (tls->aead_cipher[txrx]) {
 			l_aead_cipher_free(tls->aead_cipher[txrx]);
@@ -249,6 +354,26 @@ static bool tls_change_cipher_spec(struct l_tls *tls, bool txrx,
 	tls->auth_tag_length[txrx] = 0;
 	tls->seq_num[txrx] = 0;
 
+	if (tls->ktls_key_length[txrx]) {
+		explicit_bzero(tls->ktls_key[txrx], tls->ktls_key_length[txrx]);
+		tls->ktls_key_length[txrx] = 0;
+	}
+
+	explicit_bzero(tls->tls13_traffic_secret[txrx],
+			sizeof(tls->tls13_traffic_secret[txrx]));
+	tls->cipher_suite[txrx] = NULL;
+}
+
+static bool tls_change_cipher_spec(struct l_tls *tls, bool txrx,
+					const char **error)
+{
+	struct tls_bulk_encryption_algorithm *enc;
+	struct tls_mac_algorithm *mac;
+	int key_offset;
+	static __thread char error_buf[200];
+
+	tls_clear_cipher_spec(tls, txrx);
+
 	tls->cipher_suite[txrx] = tls->pending.cipher_suite;
 	if (!tls->cipher_suite[txrx])
 		return true;
@@ -302,6 +427,17 @@ static bool tls_change_cipher_spec(struct l_tls *tls, bool txrx,
 						key_offset, enc->key_length,
 						enc->auth_tag_length);
 			tls->aead_cipher[txrx] = cipher;
+
+			/* The kernel only takes the key once we're done */
+			if (tls->ktls_fd >= 0 && enc->l_aead_id ==
+					L_AEAD_CIPHER_AES_GCM &&
+					enc->key_length <=
+					sizeof(tls->ktls_key[txrx])) {
+				memcpy(tls->ktls_key[txrx],
+					tls->pending.key_block + key_offset,
+					enc->key_length);
+				tls->ktls_key_length[txrx] = enc->key_length;
+			}
 		} else {
 			cipher = l_cipher_new(enc->l_id,
 						tls->pending.key_block +
@@ -382,17 +518,77 @@ static void tls_reset_cipher_spec(struct l_tls *tls, bool txrx)
 	tls_change_cipher_spec(tls, txrx, NULL);
 }
 
+/*
+ * RFC 8446 Section 7.3: switch the Tx or Rx direction to the keys derived
+ * from @secret, a handshake, application or updated traffic secret.
+ */
+static bool tls13_set_traffic_secret(struct l_tls *tls, bool txrx,
+					const uint8_t *secret)
+{
+	struct tls_bulk_encryption_algorithm *enc =
+		tls->pending.cipher_suite->encryption;
+	enum l_checksum_type type = tls->prf_hmac->l_id;
+	size_t hash_len = l_checksum_digest_length(type);
+	uint8_t key[32];
+
+	tls_clear_cipher_spec(tls, txrx);
+
+	if (!tls13_hkdf_expand_label(type, secret, hash_len, "key", NULL, 0,
+					key, enc->key_length) ||
+			!tls13_hkdf_expand_label(type, secret, hash_len, "iv",
+						NULL, 0, tls->fixed_iv[txrx],
+						enc->iv_length))
+		return false;
+
+	tls->aead_cipher[txrx] = l_aead_cipher_new(enc->l_aead_id, key,
+						enc->key_length,
+						enc->auth_tag_length);
+	explicit_bzero(key, sizeof(key));
+
+	if (!tls->aead_cipher[txrx])
+		return false;
+
+	memcpy(tls->tls13_traffic_secret[txrx], secret, hash_len);
+	tls->cipher_suite[txrx] = tls->pending.cipher_suite;
+	tls->cipher_type[txrx] = TLS_CIPHER_AEAD;
+	tls->fixed_iv_length[txrx] = enc->iv_length;
+	tls->auth_tag_length[txrx] = enc->auth_tag_length;
+	return true;
+}
+
 static bool tls_cipher_suite_is_compatible_no_key_xchg(struct l_tls *tls,
 					const struct tls_cipher_suite *suite,
 					const char **error)
 {
-	static char error_buf[200];
+	static __thread char error_buf[200];
 	struct l_cert *leaf;
 	enum l_tls_version min_version =
 		tls->negotiated_version ?: tls->min_version;
 	enum l_tls_version max_version =
 		tls->negotiated_version ?: tls->max_version;
 
+	if (suite->tls13 && (tls->server || max_version < L_TLS_V13)) {
+		if (error) {
+			*error = error_buf;
+			snprintf(error_buf, sizeof(error_buf),
+					"Cipher suite %s is for TLS 1.3 client "
+					"mode only", suite->name);
+		}
+
+		return false;
+	}
+
+	if (!suite->tls13 && min_version >= L_TLS_V13) {
+		if (error) {
+			*error = error_buf;
+			snprintf(error_buf, sizeof(error_buf),
+					"Cipher suite %s can't be used with "
+					"TLS 1.3", suite->name);
+		}
+
+		return false;
+	}
+
 	if (suite->encryption &&
 			suite->encryption->cipher_type == TLS_CIPHER_AEAD) {
 		if (max_version < L_TLS_V12) {
@@ -501,11 +697,15 @@ bool tls_cipher_suite_is_compatible(struct l_tls *tls,
 					const struct tls_cipher_suite *suite,
 					const char **error)
 {
-	static char error_buf[200];
+	static __thread char error_buf[200];
 
 	if (!tls_cipher_suite_is_compatible_no_key_xchg(tls, suite, error))
 		return false;
 
+	/* The TLS 1.3 key exchange is negotiated in the extensions */
+	if (suite->tls13)
+		return true;
+
 	if (suite->key_xchg->need_ffdh &&
 			!l_key_is_supported(L_KEY_FEATURE_DH)) {
 		if (error) {
@@ -841,7 +1041,7 @@ static const char *tls_get_cache_group_name(struct l_tls *tls,
 						size_t session_id_size)
 {
 	_auto_(l_free) char *session_id_str = NULL;
-	static char group_name[256];
+	static __thread char group_name[256];
 
 	if (!tls->server)
 		return tls->session_prefix;
@@ -882,11 +1082,10 @@ static bool tls_load_cached_session(struct l_tls *tls, const char *group_name,
 	_auto_(l_free) char *peer_identity = NULL;
 	size_t size;
 	const char *error;
+	uint64_t expiry_time = 0;
 
 	if (l_settings_has_key(tls->session_settings, group_name,
 				"SessionExpiryTime")) {
-		uint64_t expiry_time;
-
 		if (unlikely(!l_settings_get_uint64(tls->session_settings,
 							group_name,
 							"SessionExpiryTime",
@@ -905,7 +1104,7 @@ static bool tls_load_cached_session(struct l_tls *tls, const char *group_name,
 						group_name,
 						"SessionVersion",
 						&version) ||
-			version < TLS_MIN_VERSION || version > TLS_MAX_VERSION))
+			version < TLS_MIN_VERSION || version > L_TLS_V12))
 		goto warn_corrupt;
 
 	master_secret = l_settings_get_bytes(tls->session_settings,
@@ -974,6 +1173,7 @@ static bool tls_load_cached_session(struct l_tls *tls, const char *group_name,
 	tls->session_compression_method_id = compression_method_id;
 	l_free(tls->session_peer_identity);
 	tls->session_peer_identity = l_steal_ptr(peer_identity);
+	tls->session_expiry = expiry_time;
 	return true;
 
 warn_corrupt:
@@ -996,9 +1196,10 @@ static bool tls_load_cached_client_session(struct l_tls *tls)
 	 *   SessionVersion,
 	 *   SessionCipherSuite,
 	 *   SessionCompressionMethod,
-	 * and these two are optional:
+	 * and these are optional:
 	 *   SessionExpiryTime,
-	 *   SessionPeerIdentity.
+	 *   SessionPeerIdentity,
+	 *   SessionTicket.
 	 */
 	_auto_(l_free) uint8_t *session_id = NULL;
 	size_t session_id_size;
@@ -1025,8 +1226,18 @@ static bool tls_load_cached_client_session(struct l_tls *tls)
 
 	session_id_str = l_util_hexstring(session_id, session_id_size);
 
-	return tls_load_cached_session(tls, group_name, session_id,
-					session_id_size, session_id_str);
+	if (!tls_load_cached_session(tls, group_name, session_id,
+					session_id_size, session_id_str))
+		return false;
+
+	l_free(tls->session_ticket);
+	tls->session_ticket = l_settings_get_bytes(tls->session_settings,
+						group_name, "SessionTicket",
+						&tls->session_ticket_len);
+	if (!tls->session_ticket)
+		tls->session_ticket_len = 0;
+
+	return true;
 }
 
 static bool tls_load_cached_server_session(struct l_tls *tls,
@@ -1142,18 +1353,158 @@ call_back:
 	return loaded;
 }
 
+/*
+ * Session state inside a ticket:
+ *   version[2] | cipher_suite[2] | compression_method[1] |
+ *   master_secret[48] | expiry_time[8] | peer_identity<0..2^16-1>
+ * with an expiry_time of 0 meaning no expiry other than the ticket key's.
+ */
+#define TLS_TICKET_STATE_SIZE	63
+
+static bool tls_load_session_ticket(struct l_tls *tls,
+					const uint8_t *session_id,
+					size_t session_id_size)
+{
+	uint8_t *state;
+	size_t state_len;
+	int version;
+	struct tls_cipher_suite *cipher_suite;
+	uint64_t expiry_time;
+	size_t peer_identity_len;
+	const char *error;
+	bool loaded = false;
+
+	state = tls_ticket_open(tls->ticket_keys, tls->session_ticket,
+				tls->session_ticket_len, &state_len);
+	if (!state) {
+		TLS_DEBUG("Session ticket not valid or its key has expired, "
+				"will start a new session");
+		return false;
+	}
+
+	if (unlikely(state_len < TLS_TICKET_STATE_SIZE))
+		goto corrupt;
+
+	version = l_get_be16(state);
+	cipher_suite = tls_find_cipher_suite(state + 2);
+	expiry_time = l_get_be64(state + 53);
+	peer_identity_len = l_get_be16(state + 61);
+
+	if (unlikely(version < TLS_MIN_VERSION || version > L_TLS_V12 ||
+			!cipher_suite ||
+			!tls_find_compression_method(state[4]) ||
+			state_len != TLS_TICKET_STATE_SIZE +
+						peer_identity_len ||
+			(peer_identity_len && !cipher_suite->signature)))
+		goto corrupt;
+
+	if (expiry_time && time_realtime_now() > expiry_time) {
+		TLS_DEBUG("Session ticket is expired, will start a new "
+				"session");
+		goto done;
+	}
+
+	if (unlikely(!tls_cipher_suite_is_compatible_no_key_xchg(tls,
+								cipher_suite,
+								&error))) {
+		TLS_DEBUG("Session ticket cipher suite not compatible: %s",
+				error);
+		goto done;
+	}
+
+	/*
+	 * RFC 5077 Section 3.4: the server echoes the client's Session ID
+	 * in the Server Hello to signal that it accepted the ticket.
+	 */
+	tls->session_id_size = session_id_size;
+	memcpy(tls->session_id, session_id, session_id_size);
+	tls->session_id_new = false;
+	tls->client_version = version;
+	memcpy(tls->pending.master_secret, state + 5, 48);
+	memcpy(tls->session_cipher_suite_id, state + 2, 2);
+	tls->session_compression_method_id = state[4];
+	l_free(tls->session_peer_identity);
+	tls->session_peer_identity = peer_identity_len ?
+		l_strndup((const char *) state + TLS_TICKET_STATE_SIZE,
+				peer_identity_len) : NULL;
+	tls->session_expiry = expiry_time;
+	loaded = true;
+	goto done;
+
+corrupt:
+	TLS_DEBUG("Session ticket has unsupported parameters, will start a "
+			"new session");
+
+done:
+	explicit_bzero(state, state_len);
+	l_free(state);
+	return loaded;
+}
+
+static bool tls_load_memory_cached_session(struct l_tls *tls,
+						const uint8_t *session_id,
+						size_t session_id_size)
+{
+	_auto_(l_free) char *session_id_str =
+		l_util_hexstring(session_id, session_id_size);
+	const struct tls_cached_session *session =
+		tls_session_cache_lookup(tls->session_cache, session_id,
+						session_id_size);
+	struct tls_cipher_suite *cipher_suite;
+	const char *error;
+
+	tls->session_id_size = 0;
+	tls->session_id_new = false;
+
+	if (!session) {
+		TLS_DEBUG("Requested session %s not found in cache, will "
+				"start a new session", session_id_str);
+		return false;
+	}
+
+	cipher_suite = tls_find_cipher_suite(session->cipher_suite_id);
+
+	/* See tls_load_cached_session */
+	if (unlikely(!cipher_suite ||
+			!tls_cipher_suite_is_compatible_no_key_xchg(tls,
+								cipher_suite,
+								&error) ||
+			!tls_find_compression_method(
+					session->compression_method_id))) {
+		TLS_DEBUG("Cached session %s parameters not compatible, "
+				"removing it, will start a new session",
+				session_id_str);
+		tls_session_cache_remove(tls->session_cache, session_id,
+						session_id_size);
+		return false;
+	}
+
+	tls->session_id_size = session_id_size;
+	memcpy(tls->session_id, session_id, session_id_size);
+	tls->client_version = session->version;
+	memcpy(tls->pending.master_secret, session->master_secret, 48);
+	memcpy(tls->session_cipher_suite_id, session->cipher_suite_id, 2);
+	tls->session_compression_method_id = session->compression_method_id;
+	l_free(tls->session_peer_identity);
+	tls->session_peer_identity = l_strdup(session->peer_identity);
+	tls->session_expiry = session->expiry_time;
+	return true;
+}
+
 #define SWITCH_ENUM_TO_STR(val) \
 	case (val):		\
 		return L_STRINGIFY(val);
 
 static const char *tls_handshake_type_to_str(enum tls_handshake_type type)
 {
-	static char buf[100];
+	static __thread char buf[100];
 
 	switch (type) {
 	SWITCH_ENUM_TO_STR(TLS_HELLO_REQUEST)
 	SWITCH_ENUM_TO_STR(TLS_CLIENT_HELLO)
 	SWITCH_ENUM_TO_STR(TLS_SERVER_HELLO)
+	SWITCH_ENUM_TO_STR(TLS_NEW_SESSION_TICKET)
+	SWITCH_ENUM_TO_STR(TLS_ENCRYPTED_EXTENSIONS)
 	SWITCH_ENUM_TO_STR(TLS_CERTIFICATE)
 	SWITCH_ENUM_TO_STR(TLS_SERVER_KEY_EXCHANGE)
 	SWITCH_ENUM_TO_STR(TLS_CERTIFICATE_REQUEST)
@@ -1161,6 +1512,9 @@ static const char *tls_handshake_type_to_str(enum tls_handshake_type type)
 	SWITCH_ENUM_TO_STR(TLS_CERTIFICATE_VERIFY)
 	SWITCH_ENUM_TO_STR(TLS_CLIENT_KEY_EXCHANGE)
 	SWITCH_ENUM_TO_STR(TLS_FINISHED)
+	SWITCH_ENUM_TO_STR(TLS_CERTIFICATE_STATUS)
+	SWITCH_ENUM_TO_STR(TLS_KEY_UPDATE)
+	SWITCH_ENUM_TO_STR(TLS_MESSAGE_HASH)
 	}
 
 	snprintf(buf, sizeof(buf), "tls_handshake_type(%i)", type);
@@ -1213,6 +1567,11 @@ void tls_disconnect(struct l_tls *tls, enum l_tls_alert_desc desc,
 		 */
 		forget_session = true;
 
+	if ((desc || local_desc) && tls->session_cache &&
+			session_id_size && !tls->session_id_new)
+		tls_session_cache_remove(tls->session_cache, tls->session_id,
+						session_id_size);
+
 	tls_send_alert(tls, true, desc);
 
 	tls_reset_handshake(tls);
@@ -1223,6 +1582,8 @@ void tls_disconnect(struct l_tls *tls, enum l_tls_alert_desc desc,
 
 	tls->negotiated_version = 0;
 	tls->ready = false;
+	tls->false_started = false;
+	tls->ktls_rx_pending = false;
 	tls->renegotiation_info.secure_renegotiation = false;
 
 	if (forget_session) {
@@ -1360,7 +1721,13 @@ static bool tls_send_client_hello(struct l_tls *tls)
 	*ptr++ = (uint8_t) (tls->client_version >> 8);
 	*ptr++ = (uint8_t) (tls->client_version >> 0);
 
-	tls_write_random(tls->pending.client_random);
+	/* The ClientHello after a HelloRetryRequest keeps the random */
+	if (!tls->tls13_hrr) {
+		tls->tls13_offered = !tls->ready &&
+			tls->max_version >= L_TLS_V13;
+		tls_write_random(tls->pending.client_random);
+	}
+
 	memcpy(ptr, tls->pending.client_random, 32);
 	ptr += 32;
 
@@ -1377,6 +1744,9 @@ static bool tls_send_client_hello(struct l_tls *tls)
 	for (suite = tls->cipher_suite_pref_list; *suite; suite++) {
 		const char *error;
 
+		if ((*suite)->tls13 && !tls->tls13_offered)
+			continue;
+
 		if (!tls_cipher_suite_is_compatible(tls, *suite, &error)) {
 			TLS_DEBUG("non-fatal: %s", error);
 			continue;
@@ -1480,7 +1850,7 @@ static bool tls_cert_list_append(struct l_cert *cert, void *user_data)
 
 static bool tls_send_certificate(struct l_tls *tls)
 {
-	uint8_t *buf, *ptr;
+	uint8_t *ptr;
 	size_t total;
 
 	if (tls->server && !tls->cert) {
@@ -1506,22 +1876,31 @@ static bool tls_send_certificate(struct l_tls *tls)
 	 *    anything in our cert chain.
 	 */
 
-	total = 0;
-	l_certchain_walk_from_leaf(tls->cert, tls_cert_list_add_size, &total);
+	/*
+	 * The message only depends on tls->cert so it's built on first use
+	 * and kept until l_tls_set_auth_data is called again.
+	 */
+	if (!tls->cert_msg) {
+		total = 0;
+		l_certchain_walk_from_leaf(tls->cert, tls_cert_list_add_size,
+						&total);
 
-	buf = l_malloc(128 + total);
-	ptr = buf + TLS_HANDSHAKE_HEADER_SIZE;
+		tls->cert_msg = l_malloc(TLS_HANDSHAKE_HEADER_SIZE + 3 + total);
+		ptr = tls->cert_msg + TLS_HANDSHAKE_HEADER_SIZE;
 
-	/* Fill in the Certificate body */
+		/* Fill in the Certificate body */
 
-	*ptr++ = total >> 16;
-	*ptr++ = total >>  8;
-	*ptr++ = total >>  0;
-	l_certchain_walk_from_leaf(tls->cert, tls_cert_list_append, &ptr);
+		*ptr++ = total >> 16;
+		*ptr++ = total >>  8;
+		*ptr++ = total >>  0;
+		l_certchain_walk_from_leaf(tls->cert, tls_cert_list_append,
+						&ptr);
 
-	tls_tx_handshake(tls, TLS_CERTIFICATE, buf, ptr - buf);
+		tls->cert_msg_len = ptr - tls->cert_msg;
+	}
 
-	l_free(buf);
+	tls_tx_handshake(tls, TLS_CERTIFICATE, tls->cert_msg,
+				tls->cert_msg_len);
 
 	if (tls->cert)
 		tls->cert_sent = true;
@@ -1529,6 +1908,42 @@ static bool tls_send_certificate(struct l_tls *tls)
 	return true;
 }
 
+/* RFC 6066 Section 8, sent when the Server Hello had status_request */
+static void tls_send_certificate_status(struct l_tls *tls)
+{
+	const uint8_t *response;
+	size_t response_len;
+	uint8_t *buf;
+	uint8_t *ptr;
+
+	/* The message is optional so a response that just expired is fine */
+	response = tls_ocsp_cache_lookup(tls->ocsp_cache,
+					l_certchain_get_leaf(tls->cert),
+					&response_len);
+	if (!response)
+		return;
+
+	buf = l_malloc(TLS_HANDSHAKE_HEADER_SIZE + 4 + response_len);
+	ptr = buf + TLS_HANDSHAKE_HEADER_SIZE;
+
+	*ptr++ = 1;	/* CertificateStatusType.ocsp */
+	*ptr++ = response_len >> 16;
+	*ptr++ = response_len >>  8;
+	*ptr++ = response_len >>  0;
+	memcpy(ptr, response, response_len);
+	ptr += response_len;
+
+	tls_tx_handshake(tls, TLS_CERTIFICATE_STATUS, buf, ptr - buf);
+	l_free(buf);
+
+	TLS_DEBUG("Sent a stapled OCSP response");
+}
+
+static bool tls_have_ca_certs(struct l_tls *tls)
+{
+	return tls->ca_certs || tls->cert_store;
+}
+
 /*
  * Note: ClientCertificateType.rsa_sign value coincides with the
  * SignatureAlgorithm.rsa value but other values in those enum are
@@ -1812,6 +2227,108 @@ static bool tls_send_finished(struct l_tls *tls)
 	return true;
 }
 
+static char *tls_get_peer_identity_str(struct l_cert *cert);
+
+/* RFC 5077 Section 3.3 */
+static bool tls_send_new_session_ticket(struct l_tls *tls)
+{
+	bool resuming = tls->session_id_size && !tls->session_id_new;
+	_auto_(l_free) char *peer_cert_identity = NULL;
+	const char *peer_identity = NULL;
+	size_t peer_identity_len;
+	uint64_t now = time_realtime_now();
+	uint64_t expiry;
+	uint64_t lifetime;
+	uint8_t *state;
+	size_t state_len;
+	_auto_(l_free) uint8_t *ticket = NULL;
+	size_t ticket_len = 0;
+	_auto_(l_free) uint8_t *buf = NULL;
+	uint8_t *ptr;
+
+	if (resuming) {
+		/* Reissued tickets don't extend the session's lifetime */
+		peer_identity = tls->session_peer_identity;
+		expiry = tls->session_expiry;
+	} else {
+		expiry = tls->session_lifetime ?
+			now + tls->session_lifetime : 0;
+
+		if (tls->peer_authenticated) {
+			uint64_t peer_cert_expiry;
+
+			peer_cert_identity =
+				tls_get_peer_identity_str(tls->peer_cert);
+			if (!peer_cert_identity ||
+					!l_cert_get_valid_times(tls->peer_cert,
+							NULL,
+							&peer_cert_expiry)) {
+				TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+						"Can't get peer identity or "
+						"certificate expiry");
+				return false;
+			}
+
+			peer_identity = peer_cert_identity;
+
+			if (!expiry || peer_cert_expiry < expiry)
+				expiry = peer_cert_expiry;
+		}
+	}
+
+	peer_identity_len = peer_identity ? strlen(peer_identity) : 0;
+	state_len = TLS_TICKET_STATE_SIZE + peer_identity_len;
+
+	/*
+	 * If the ticket wouldn't fit we still have to send the message
+	 * as we've included the SessionTicket extension in the Server
+	 * Hello, an empty ticket means no ticket.
+	 */
+	if (state_len + TLS_TICKET_OVERHEAD <= 0xffff) {
+		state = l_malloc(state_len);
+		l_put_be16(tls->negotiated_version, state);
+		memcpy(state + 2, tls->pending.cipher_suite->id, 2);
+		state[4] = tls->pending.compression_method->id;
+		memcpy(state + 5, tls->pending.master_secret, 48);
+		l_put_be64(expiry, state + 53);
+		l_put_be16(peer_identity_len, state + 61);
+
+		if (peer_identity_len)
+			memcpy(state + TLS_TICKET_STATE_SIZE, peer_identity,
+				peer_identity_len);
+
+		ticket = tls_ticket_seal(tls->ticket_keys, state, state_len,
+						&ticket_len);
+		explicit_bzero(state, state_len);
+		l_free(state);
+	}
+
+	if (!ticket)
+		TLS_DEBUG("Can't build the session ticket, sending an empty "
+				"one");
+
+	/* The lifetime hint is in seconds */
+	lifetime = tls_ticket_lifetime(tls->ticket_keys) / L_USEC_PER_SEC;
+
+	if (expiry && expiry < now + lifetime * L_USEC_PER_SEC)
+		lifetime = expiry > now ? (expiry - now) / L_USEC_PER_SEC : 0;
+
+	buf = l_malloc(TLS_HANDSHAKE_HEADER_SIZE + 6 + ticket_len);
+	ptr = buf + TLS_HANDSHAKE_HEADER_SIZE;
+
+	l_put_be32(lifetime > UINT32_MAX ? UINT32_MAX : lifetime, ptr);
+	l_put_be16(ticket_len, ptr + 4);
+	ptr += 6;
+
+	if (ticket_len) {
+		memcpy(ptr, ticket, ticket_len);
+		ptr += ticket_len;
+	}
+
+	tls_tx_handshake(tls, TLS_NEW_SESSION_TICKET, buf, ptr - buf);
+	return true;
+}
+
 static bool tls_verify_finished(struct l_tls *tls, const uint8_t *received,
 				size_t len)
 {
@@ -2079,9 +2596,13 @@ static void tls_handle_client_hello(struct l_tls *tls,
 
 	len -= compression_methods_size;
 
-	if (session_id_size && tls->session_settings &&
-			tls_load_cached_server_session(tls, buf + 35,
-							session_id_size)) {
+	if (session_id_size &&
+			((tls->session_cache &&
+			  tls_load_memory_cached_session(tls, buf + 35,
+							session_id_size)) ||
+			 (tls->session_settings &&
+			  tls_load_cached_server_session(tls, buf + 35,
+							session_id_size)))) {
 		/*
 		 * Attempt a session resumption but note later checks may
 		 * spoil this.
@@ -2101,6 +2622,14 @@ static void tls_handle_client_hello(struct l_tls *tls,
 					len, extensions_offered))
 		goto cleanup;
 
+	if (!resuming && session_id_size && tls->session_ticket_len &&
+			tls_load_session_ticket(tls, buf + 35,
+						session_id_size)) {
+		resuming = true;
+		session_id_str = l_util_hexstring(tls->session_id,
+							tls->session_id_size);
+	}
+
 	/* Save client_version for Premaster Secret verification */
 	tls->client_version = l_get_be16(buf);
 
@@ -2114,6 +2643,10 @@ static void tls_handle_client_hello(struct l_tls *tls,
 	tls->negotiated_version = tls->client_version > tls->max_version ?
 		tls->max_version : tls->client_version;
 
+	/* TLS 1.3 is only supported in client mode */
+	if (tls->negotiated_version > L_TLS_V12)
+		tls->negotiated_version = L_TLS_V12;
+
 	/* Stop maintaining handshake message hashes other than MD1 and SHA. */
 	if (tls->negotiated_version < L_TLS_V12)
 		for (i = 0; i < __HANDSHAKE_HASH_COUNT; i++)
@@ -2273,7 +2806,7 @@ static void tls_handle_client_hello(struct l_tls *tls,
 	TLS_DEBUG("Negotiated %s", tls->pending.cipher_suite->name);
 	TLS_DEBUG("Negotiated %s", tls->pending.compression_method->name);
 
-	if (!resuming && tls->session_settings) {
+	if (!resuming && (tls->session_settings || tls->session_cache)) {
 		tls->session_id_new = true;
 		tls->session_id_size = 32;
 		l_getrandom(tls->session_id, 32);
@@ -2288,6 +2821,11 @@ static void tls_handle_client_hello(struct l_tls *tls,
 		const char *error;
 
 		tls_update_key_block(tls);
+
+		if (tls->session_ticket_send &&
+				!tls_send_new_session_ticket(tls))
+			return;
+
 		tls_send_change_cipher_spec(tls);
 
 		if (!tls_change_cipher_spec(tls, 1, &error)) {
@@ -2303,23 +2841,27 @@ static void tls_handle_client_hello(struct l_tls *tls,
 		return;
 	}
 
-	if (tls->pending.cipher_suite->signature && tls->cert)
+	if (tls->pending.cipher_suite->signature && tls->cert) {
 		if (!tls_send_certificate(tls))
 			return;
 
+		if (tls->ocsp_status_send)
+			tls_send_certificate_status(tls);
+	}
+
 	if (tls->pending.cipher_suite->key_xchg->send_server_key_exchange)
 		if (!tls->pending.cipher_suite->key_xchg->
 				send_server_key_exchange(tls))
 			return;
 
 	/* TODO: don't bother if configured to not authenticate client */
-	if (tls->pending.cipher_suite->signature && tls->ca_certs)
+	if (tls->pending.cipher_suite->signature && tls_have_ca_certs(tls))
 		if (!tls_send_certificate_request(tls))
 			return;
 
 	tls_send_server_hello_done(tls);
 
-	if (tls->pending.cipher_suite->signature && tls->ca_certs)
+	if (tls->pending.cipher_suite->signature && tls_have_ca_certs(tls))
 		TLS_SET_STATE(TLS_HANDSHAKE_WAIT_CERTIFICATE);
 	else
 		TLS_SET_STATE(TLS_HANDSHAKE_WAIT_KEY_EXCHANGE);
@@ -2334,32 +2876,373 @@ cleanup:
 	l_queue_destroy(extensions_offered, NULL);
 }
 
-static void tls_handle_server_hello(struct l_tls *tls,
-					const uint8_t *buf, size_t len)
-{
-	uint8_t session_id_size, cipher_suite_id[2], compression_method_id;
-	const char *error;
-	struct tls_cipher_suite **iter;
-	int i;
-	struct l_queue *extensions_seen;
-	bool result;
-	uint16_t version;
-	bool resuming = false;
+/* RFC 8446 Section 4.1.3, SHA-256 of "HelloRetryRequest" */
+static const uint8_t tls13_hrr_random[32] = {
+	0xcf, 0x21, 0xad, 0x74, 0xe5, 0x9a, 0x61, 0x11,
+	0xbe, 0x1d, 0x8c, 0x02, 0x1e, 0x65, 0xb8, 0x91,
+	0xc2, 0xa2, 0x11, 0x16, 0x7a, 0xbb, 0x8c, 0x5e,
+	0x07, 0x9e, 0x09, 0xe2, 0xc8, 0xa8, 0x33, 0x9c,
+};
 
-	/* Do we have enough for ProtocolVersion + Random + SessionID len ? */
-	if (len < 2 + 32 + 1)
-		goto decode_error;
+/*
+ * Check the structure of a TLS 1.3 extension block, including its length
+ * field, and that no extension is repeated.  The contents of the
+ * extensions listed in @ids are returned in @data and @data_len, NULL if
+ * absent.  Any other extension is ignored unless @strict is set.
+ */
+static bool tls13_parse_extensions(struct l_tls *tls, const char *msg,
+					const uint8_t *buf, size_t len,
+					bool strict, const uint16_t *ids,
+					unsigned int n_ids,
+					const uint8_t **data, size_t *data_len)
+{
+	struct l_queue *seen;
+	unsigned int i;
 
-	version = l_get_be16(buf);
-	memcpy(tls->pending.server_random, buf + 2, 32);
-	session_id_size = buf[34];
-	len -= 35;
+	for (i = 0; i < n_ids; i++)
+		data[i] = NULL;
 
-	/* Do we have enough for SessionID + CipherSuite ID + Compression ID */
-	if (len < (size_t) session_id_size + 2 + 1)
+	if (len < 2 || l_get_be16(buf) != len - 2)
 		goto decode_error;
 
-	cipher_suite_id[0] = buf[35 + session_id_size + 0];
+	buf += 2;
+	len -= 2;
+	seen = l_queue_new();
+
+	while (len) {
+		uint16_t ext_id;
+		size_t ext_len;
+
+		if (len < 4)
+			goto decode_error_free;
+
+		ext_id = l_get_be16(buf + 0);
+		ext_len = l_get_be16(buf + 2);
+		buf += 4;
+		len -= 4;
+
+		if (ext_len > len ||
+				l_queue_find(seen, tls_ptr_match,
+						L_UINT_TO_PTR(ext_id)))
+			goto decode_error_free;
+
+		l_queue_push_tail(seen, L_UINT_TO_PTR(ext_id));
+
+		for (i = 0; i < n_ids; i++)
+			if (ids[i] == ext_id)
+				break;
+
+		if (i < n_ids) {
+			data[i] = buf;
+			data_len[i] = ext_len;
+		} else if (strict) {
+			l_queue_destroy(seen, NULL);
+			TLS_DISCONNECT(TLS_ALERT_UNSUPPORTED_EXTENSION, 0,
+					"Extension %u not allowed in %s",
+					ext_id, msg);
+			return false;
+		}
+
+		buf += ext_len;
+		len -= ext_len;
+	}
+
+	l_queue_destroy(seen, NULL);
+	return true;
+
+decode_error_free:
+	l_queue_destroy(seen, NULL);
+decode_error:
+	TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+			"%s extensions decode error", msg);
+	return false;
+}
+
+/*
+ * RFC 8446 Section 4.1.4: restart the handshake with a new ClientHello
+ * after replacing the first ClientHello in the transcript with its hash.
+ */
+static void tls13_handle_hello_retry_request(struct l_tls *tls,
+						const uint8_t *buf, size_t len,
+						const uint8_t *key_share,
+						size_t key_share_len,
+						const uint8_t *cookie,
+						size_t cookie_len)
+{
+	enum handshake_hash_type hash = tls->prf_hmac->type;
+	size_t hash_len = l_checksum_digest_length(tls->prf_hmac->l_id);
+	const struct tls_named_group *group = NULL;
+	uint8_t message_hash[TLS_HANDSHAKE_HEADER_SIZE +
+				HANDSHAKE_HASH_MAX_SIZE];
+	enum handshake_hash_type i;
+	unsigned int j;
+
+	if (tls->tls13_hrr) {
+		TLS_DISCONNECT(TLS_ALERT_UNEXPECTED_MESSAGE, 0,
+				"Second HelloRetryRequest");
+		return;
+	}
+
+	if (key_share) {
+		if (key_share_len != 2)
+			goto decode_error;
+
+		group = tls_find_group(l_get_be16(key_share));
+
+		if (group && (group->type != TLS_GROUP_TYPE_EC ||
+				!l_ecc_curve_from_tls_group(group->id)))
+			group = NULL;
+
+		for (j = 0; j < L_ARRAY_SIZE(tls->tls13_key_share); j++)
+			if (group && tls->tls13_key_share[j].group == group)
+				group = NULL;
+
+		if (!group) {
+			TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+					"HelloRetryRequest group %u not "
+					"supported or already offered",
+					l_get_be16(key_share));
+			return;
+		}
+	}
+
+	if (cookie) {
+		if (cookie_len < 3 || l_get_be16(cookie) != cookie_len - 2)
+			goto decode_error;
+
+		tls->tls13_cookie = l_memdup(cookie + 2, cookie_len - 2);
+		tls->tls13_cookie_len = cookie_len - 2;
+	}
+
+	if (!group && !cookie) {
+		TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+				"HelloRetryRequest would not change the "
+				"ClientHello");
+		return;
+	}
+
+	tls->tls13_hrr = true;
+	tls->tls13_hrr_group = group;
+
+	for (i = 0; i < __HANDSHAKE_HASH_COUNT; i++)
+		if (i != hash)
+			tls_drop_handshake_hash(tls, i);
+
+	message_hash[0] = TLS_MESSAGE_HASH;
+	message_hash[1] = 0;
+	message_hash[2] = 0;
+	message_hash[3] = hash_len;
+	memcpy(message_hash + TLS_HANDSHAKE_HEADER_SIZE,
+		tls->prev_digest[hash], hash_len);
+
+	l_checksum_reset(tls->handshake_hash[hash]);
+	l_checksum_update(tls->handshake_hash[hash], message_hash,
+				TLS_HANDSHAKE_HEADER_SIZE + hash_len);
+	l_checksum_update(tls->handshake_hash[hash],
+				buf - TLS_HANDSHAKE_HEADER_SIZE,
+				len + TLS_HANDSHAKE_HEADER_SIZE);
+
+	TLS_DEBUG("HelloRetryRequest with %s%s%s",
+			group ? "group " : "", group ? group->name : "",
+			cookie ? (group ? " and a cookie" : "a cookie") : "");
+
+	if (!tls_send_client_hello(tls))
+		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+				"Error sending the second ClientHello");
+
+	return;
+
+decode_error:
+	TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+			"HelloRetryRequest decode error");
+}
+
+/*
+ * RFC 8446 Section 7.1: derive the Handshake Secret from the ECDHE shared
+ * secret and switch both directions to the handshake traffic keys.  The
+ * Master Secret is derived right away and kept in tls->tls13_secret.
+ */
+static bool tls13_start_key_schedule(struct l_tls *tls,
+					const uint8_t *ecdhe, size_t ecdhe_len)
+{
+	static const uint8_t zeros[HANDSHAKE_HASH_MAX_SIZE];
+	enum l_checksum_type type = tls->prf_hmac->l_id;
+	size_t hash_len = l_checksum_digest_length(type);
+	uint8_t transcript[HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t secret[HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t derived[HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t c_hs[HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t s_hs[HANDSHAKE_HASH_MAX_SIZE];
+	bool r;
+
+	tls_get_handshake_hash(tls, tls->prf_hmac->type, transcript);
+
+	r = l_checksum_hkdf_extract(type, NULL, 0, zeros, hash_len,
+					secret) &&
+		tls13_derive_secret(tls, secret, "derived", NULL, derived) &&
+		l_checksum_hkdf_extract(type, derived, hash_len,
+					ecdhe, ecdhe_len, secret) &&
+		tls13_derive_secret(tls, secret, "c hs traffic", transcript,
+					c_hs) &&
+		tls13_derive_secret(tls, secret, "s hs traffic", transcript,
+					s_hs) &&
+		tls13_derive_secret(tls, secret, "derived", NULL, derived) &&
+		l_checksum_hkdf_extract(type, derived, hash_len,
+					zeros, hash_len, tls->tls13_secret) &&
+		tls13_set_traffic_secret(tls, 0, s_hs) &&
+		tls13_set_traffic_secret(tls, 1, c_hs);
+
+	explicit_bzero(secret, sizeof(secret));
+	explicit_bzero(derived, sizeof(derived));
+	explicit_bzero(c_hs, sizeof(c_hs));
+	explicit_bzero(s_hs, sizeof(s_hs));
+	return r;
+}
+
+/*
+ * A ServerHello or HelloRetryRequest that selected TLS 1.3, the caller
+ * has checked the lengths up to and including the compression method.
+ */
+static void tls13_handle_server_hello(struct l_tls *tls,
+					const uint8_t *buf, size_t len)
+{
+	static const uint16_t ext_ids[] = { 43, 51, 44 };
+	const uint8_t *ext[L_ARRAY_SIZE(ext_ids)];
+	size_t ext_len[L_ARRAY_SIZE(ext_ids)];
+	uint8_t session_id_size = buf[34];
+	const uint8_t *cipher_suite_id = buf + 35 + session_id_size;
+	bool hrr = !memcmp(buf + 2, tls13_hrr_random, 32);
+	const char *msg = hrr ? "HelloRetryRequest" : "ServerHello";
+	struct tls_cipher_suite *suite;
+	struct tls_cipher_suite **iter;
+	const char *error;
+	uint8_t ecdhe[L_ECC_SCALAR_MAX_BYTES];
+	size_t ecdhe_len = sizeof(ecdhe);
+	enum handshake_hash_type hash;
+	bool r;
+	int err;
+
+	if (l_get_be16(buf) != L_TLS_V12 ||
+			session_id_size != tls->session_id_size ||
+			memcmp(buf + 35, tls->session_id, session_id_size) ||
+			cipher_suite_id[2] != 0) {
+		TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+				"%s legacy fields don't match the ClientHello",
+				msg);
+		return;
+	}
+
+	if (!tls13_parse_extensions(tls, msg, cipher_suite_id + 3,
+					len - (38 + session_id_size), true,
+					ext_ids, L_ARRAY_SIZE(ext_ids),
+					ext, ext_len))
+		return;
+
+	if (ext[2] && !hrr) {
+		TLS_DISCONNECT(TLS_ALERT_UNSUPPORTED_EXTENSION, 0,
+				"Cookie extension in a ServerHello");
+		return;
+	}
+
+	suite = tls_find_cipher_suite(cipher_suite_id);
+
+	for (iter = tls->cipher_suite_pref_list; suite && *iter; iter++)
+		if (*iter == suite)
+			break;
+
+	if (!suite || !suite->tls13 || !*iter ||
+			!tls_cipher_suite_is_compatible(tls, suite, &error) ||
+			(tls->tls13_hrr &&
+			 suite != tls->pending.cipher_suite)) {
+		TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+				"%s cipher suite %04x not offered", msg,
+				l_get_be16(cipher_suite_id));
+		return;
+	}
+
+	tls->pending.cipher_suite = suite;
+
+	if (!tls_set_prf_hmac(tls)) {
+		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+				"Error selecting the PRF HMAC");
+		return;
+	}
+
+	if (hrr) {
+		tls13_handle_hello_retry_request(tls, buf, len,
+							ext[1], ext_len[1],
+							ext[2], ext_len[2]);
+		return;
+	}
+
+	if (!ext[1]) {
+		TLS_DISCONNECT(TLS_ALERT_MISSING_EXTENSION, 0,
+				"ServerHello without a key_share");
+		return;
+	}
+
+	err = tls13_key_share_get_secret(tls, ext[1], ext_len[1],
+						ecdhe, &ecdhe_len);
+	if (err < 0) {
+		TLS_DISCONNECT(err == -EBADMSG ? TLS_ALERT_DECODE_ERROR :
+				TLS_ALERT_ILLEGAL_PARAM, 0,
+				"ServerHello key_share not usable");
+		return;
+	}
+
+	tls->negotiated_version = L_TLS_V13;
+	tls->session_id_size = 0;
+	tls->pending.compression_method = tls_find_compression_method(0);
+	tls->ocsp_status_expected =
+		tls->ocsp_stapling != L_TLS_OCSP_STAPLING_OFF;
+
+	TLS_DEBUG("Negotiated TLS " TLS_VER_FMT,
+			TLS_VER_ARGS(tls->negotiated_version));
+	TLS_DEBUG("Negotiated %s", tls->pending.cipher_suite->name);
+
+	for (hash = 0; hash < __HANDSHAKE_HASH_COUNT; hash++)
+		if (hash != tls->prf_hmac->type)
+			tls_drop_handshake_hash(tls, hash);
+
+	r = tls13_start_key_schedule(tls, ecdhe, ecdhe_len);
+	explicit_bzero(ecdhe, sizeof(ecdhe));
+	tls13_key_share_free(tls);
+
+	if (!r) {
+		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+				"Error deriving the handshake keys");
+		return;
+	}
+
+	TLS_SET_STATE(TLS_HANDSHAKE_WAIT_ENCRYPTED_EXTENSIONS);
+}
+
+static void tls_handle_server_hello(struct l_tls *tls,
+					const uint8_t *buf, size_t len)
+{
+	uint8_t session_id_size, cipher_suite_id[2], compression_method_id;
+	const char *error;
+	struct tls_cipher_suite **iter;
+	int i;
+	struct l_queue *extensions_seen;
+	bool result;
+	uint16_t version;
+	bool resuming = false;
+
+	/* Do we have enough for ProtocolVersion + Random + SessionID len ? */
+	if (len < 2 + 32 + 1)
+		goto decode_error;
+
+	version = l_get_be16(buf);
+	memcpy(tls->pending.server_random, buf + 2, 32);
+	session_id_size = buf[34];
+	len -= 35;
+
+	/* Do we have enough for SessionID + CipherSuite ID + Compression ID */
+	if (len < (size_t) session_id_size + 2 + 1)
+		goto decode_error;
+
+	cipher_suite_id[0] = buf[35 + session_id_size + 0];
 	cipher_suite_id[1] = buf[35 + session_id_size + 1];
 	compression_method_id = buf[35 + session_id_size + 2];
 	len -= session_id_size + 2 + 1;
@@ -2367,6 +3250,50 @@ static void tls_handle_server_hello(struct l_tls *tls,
 	if (session_id_size > 32)
 		goto decode_error;
 
+	/*
+	 * RFC 8446 Section 4.1.3: TLS 1.3 is only selected in the
+	 * supported_versions extension, a server that picked an older
+	 * version while supporting 1.3 signals it in the random.
+	 */
+	if (tls->tls13_offered) {
+		static const uint16_t supported_versions_id = 43;
+		const uint8_t *sv = NULL;
+		size_t sv_len;
+
+		if (len && !tls13_parse_extensions(tls, "ServerHello",
+						buf + 38 + session_id_size, len,
+						false, &supported_versions_id,
+						1, &sv, &sv_len))
+			return;
+
+		if (sv) {
+			if (sv_len != 2 || l_get_be16(sv) != L_TLS_V13) {
+				TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+						"Bad supported_versions in "
+						"ServerHello");
+				return;
+			}
+
+			tls13_handle_server_hello(tls, buf,
+						38 + session_id_size + len);
+			return;
+		}
+
+		if (tls->tls13_hrr) {
+			TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+					"TLS 1.3 not selected after a "
+					"HelloRetryRequest");
+			return;
+		}
+
+		if (!memcmp(tls->pending.server_random + 24, "DOWNGRD", 7) &&
+				tls->pending.server_random[31] <= 1) {
+			TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+					"TLS 1.3 downgrade detected");
+			return;
+		}
+	}
+
 	if (tls->session_id_size) {
 		_auto_(l_free) char *session_id_str =
 			l_util_hexstring(tls->session_id, tls->session_id_size);
@@ -2500,92 +3427,207 @@ decode_error:
 			"ServerHello decode error");
 }
 
-static void tls_handle_certificate(struct l_tls *tls,
-					const uint8_t *buf, size_t len)
+static void tls_handle_new_session_ticket(struct l_tls *tls,
+						const uint8_t *buf, size_t len)
 {
-	size_t total;
-	_auto_(l_certchain_free) struct l_certchain *certchain = NULL;
-	struct l_cert *leaf;
-	size_t der_len;
-	const uint8_t *der;
-	bool dummy;
-	const char *error_str;
-	char *subject_str;
+	size_t ticket_len;
 
-	if (len < 3)
+	/* The lifetime hint is ignored, the cache has its own expiry */
+	if (len < 6)
 		goto decode_error;
 
-	/* Length checks */
-	total = *buf++ << 16;
-	total |= *buf++ << 8;
-	total |= *buf++ << 0;
-	if (total + 3 != len)
+	ticket_len = l_get_be16(buf + 4);
+	if (len != 6 + ticket_len)
 		goto decode_error;
 
-	if (tls_parse_certificate_list(buf, total, &certchain) < 0) {
-		TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
-				"Error decoding peer certificate chain");
-
-		return;
-	}
+	l_free(tls->session_ticket);
+	tls->session_ticket = ticket_len ? l_memdup(buf + 6, ticket_len) :
+						NULL;
+	tls->session_ticket_len = ticket_len;
+	tls->session_ticket_new = true;
+	tls->session_ticket_expected = false;
 
 	/*
-	 * "Note that a client MAY send no certificates if it does not have any
-	 * appropriate certificate to send in response to the server's
-	 * authentication request." -- for now we unconditionally accept
-	 * an empty certificate chain from the client.  Later on we need to
-	 * make this configurable, if we don't want to authenticate the
-	 * client then also don't bother sending a Certificate Request.
+	 * RFC 5077 Section 3.4: we'll send a Session ID of our own choosing
+	 * with the ticket to be able to tell whether the server accepted
+	 * it.  Only needed if the server didn't assign one.
 	 */
-	if (!certchain) {
-		if (!tls->server) {
-			TLS_DISCONNECT(TLS_ALERT_HANDSHAKE_FAIL, 0,
-					"Server sent no certificate chain");
+	if (ticket_len && !tls->session_id_size && tls->session_settings) {
+		tls->session_id_new = true;
+		tls->session_id_size = 32;
+		l_getrandom(tls->session_id, 32);
+	}
 
-			return;
-		}
+	return;
 
-		TLS_SET_STATE(TLS_HANDSHAKE_WAIT_KEY_EXCHANGE);
+decode_error:
+	TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+			"NewSessionTicket decode error");
+}
 
-		return;
-	}
+struct tls_trusted_cas_data {
+	struct l_cert_store *store;
+	struct l_queue *ca_certs;
+};
 
-	if (tls->cert_dump_path) {
-		int r = pem_write_certificate_chain(certchain,
-							tls->cert_dump_path);
+static bool tls_cert_match(const void *a, const void *b)
+{
+	return a == b;
+}
 
-		if (r < 0)
-			TLS_DEBUG("Error %i (%s) writing the peer certchain "
-					"to %s",
-					-r, strerror(-r), tls->cert_dump_path);
-		else
-			TLS_DEBUG("Peer certchain written to %s",
-					tls->cert_dump_path);
-	}
+static bool tls_add_trusted_issuers(struct l_cert *cert, void *user_data)
+{
+	struct tls_trusted_cas_data *data = user_data;
+	struct l_queue *issuers = l_cert_store_find_issuers(data->store, cert);
+	struct l_cert *issuer;
 
-	/*
-	 * Validate the certificate chain's consistency and validate it
-	 * against our CAs if we have any.
-	 */
-	if (!l_certchain_verify(certchain, tls->ca_certs, &error_str)) {
-		if (tls->ca_certs) {
-			TLS_DISCONNECT(TLS_ALERT_BAD_CERT, 0,
-					"Peer certchain verification failed "
-					"consistency check%s: %s",
-					tls->ca_certs ?
-					" or against local CA certs" : "",
-					error_str);
+	while ((issuer = l_queue_pop_head(issuers)))
+		if (!l_queue_find(data->ca_certs, tls_cert_match, issuer))
+			l_queue_push_tail(data->ca_certs, issuer);
 
-			return;
-		}
+	l_queue_destroy(issuers, NULL);
+	return false;
+}
 
-		/*
-		 * Until the mainstream kernel can handle the occasionally
-		 * used certificates without the AKID extension (both root,
-		 * which is legal, and non-root, which is iffy but still
-		 * happens) don't fail on peer certificate chain verification
-		 * failure when CA certificates were not provided.  Knowing
-		 * that the chain is self-consistent alone doesn't
+/*
+ * With a certificate store only the store's certificates that issued a
+ * certificate in @chain are used as the trusted CAs, plus any CAs from
+ * l_tls_set_cacert, instead of loading the whole store into the kernel.
+ * Returns NULL if there's no store.
+ */
+static struct l_queue *tls_cert_find_trusted_cas(struct l_tls *tls,
+						struct l_certchain *chain)
+{
+	struct tls_trusted_cas_data data;
+	const struct l_queue_entry *entry;
+
+	if (!tls->cert_store)
+		return NULL;
+
+	data.store = tls->cert_store;
+	data.ca_certs = l_queue_new();
+
+	for (entry = l_queue_get_entries(tls->ca_certs); entry;
+			entry = entry->next)
+		l_queue_push_tail(data.ca_certs, entry->data);
+
+	l_certchain_walk_from_ca(chain, tls_add_trusted_issuers, &data);
+	return data.ca_certs;
+}
+
+static bool tls_get_issuer(struct l_cert *cert, void *user_data)
+{
+	struct l_cert **certs = user_data;
+
+	if (!certs[0]) {
+		certs[0] = cert;
+		return false;
+	}
+
+	certs[1] = cert;
+	return true;
+}
+
+/*
+ * A copy of the leaf certificate's issuer to check OCSP responses
+ * against, from the peer's chain or from the trusted CAs if the peer
+ * only sent the leaf certificate.
+ */
+static struct l_cert *tls_find_ocsp_issuer(struct l_certchain *chain,
+						struct l_queue *ca_certs)
+{
+	struct l_cert *certs[2] = {};
+	struct l_cert *issuer;
+	const uint8_t *der;
+	size_t der_len;
+
+	l_certchain_walk_from_leaf(chain, tls_get_issuer, certs);
+
+	if (certs[1] && cert_issued_by(certs[1], certs[0]))
+		issuer = certs[1];
+	else
+		issuer = l_queue_find(ca_certs, cert_issued_by, certs[0]);
+
+	if (!issuer)
+		return NULL;
+
+	der = l_cert_get_der_data(issuer, &der_len);
+	return l_cert_new_from_der(der, der_len);
+}
+
+/*
+ * Runs the checks on the peer's certificate chain common to all versions
+ * and saves the end-entity certificate and its public key.
+ */
+static bool tls_set_peer_certchain(struct l_tls *tls,
+					struct l_certchain *certchain)
+{
+	struct l_cert *leaf;
+	size_t der_len;
+	const uint8_t *der;
+	bool dummy;
+	const char *error_str;
+	char *subject_str;
+	struct l_queue *ca_certs;
+	bool verified;
+	const char *revoked_str;
+	bool revoked;
+
+	if (tls->cert_dump_path) {
+		int r = pem_write_certificate_chain(certchain,
+							tls->cert_dump_path);
+
+		if (r < 0)
+			TLS_DEBUG("Error %i (%s) writing the peer certchain "
+					"to %s",
+					-r, strerror(-r), tls->cert_dump_path);
+		else
+			TLS_DEBUG("Peer certchain written to %s",
+					tls->cert_dump_path);
+	}
+
+	/*
+	 * Validate the certificate chain's consistency and validate it
+	 * against our CAs if we have any.
+	 */
+	ca_certs = tls_cert_find_trusted_cas(tls, certchain);
+	verified = l_certchain_verify_cached(certchain,
+						ca_certs ?: tls->ca_certs,
+						tls->cert_verify_cache,
+						&error_str);
+
+	if (!tls->server && tls->ocsp_status_expected) {
+		l_cert_free(tls->ocsp_issuer);
+		tls->ocsp_issuer = tls_find_ocsp_issuer(certchain,
+						ca_certs ?: tls->ca_certs);
+	}
+
+	revoked = tls->crl_store &&
+		!l_certchain_check_revocation(certchain,
+						ca_certs ?: tls->ca_certs,
+						tls->crl_store, &revoked_str);
+
+	l_queue_destroy(ca_certs, NULL);
+
+	if (!verified) {
+		if (tls_have_ca_certs(tls)) {
+			TLS_DISCONNECT(TLS_ALERT_BAD_CERT, 0,
+					"Peer certchain verification failed "
+					"consistency check%s: %s",
+					tls_have_ca_certs(tls) ?
+					" or against local CA certs" : "",
+					error_str);
+
+			return false;
+		}
+
+		/*
+		 * Until the mainstream kernel can handle the occasionally
+		 * used certificates without the AKID extension (both root,
+		 * which is legal, and non-root, which is iffy but still
+		 * happens) don't fail on peer certificate chain verification
+		 * failure when CA certificates were not provided.  Knowing
+		 * that the chain is self-consistent alone doesn't
 		 * authenticate the peer in any way.  Only warn when it looks
 		 * like the chain is bad but parses and we can get the peer
 		 * public key from it below.
@@ -2597,21 +3639,33 @@ static void tls_handle_certificate(struct l_tls *tls,
 				error_str);
 	}
 
+	if (revoked) {
+		TLS_DISCONNECT(TLS_ALERT_CERT_REVOKED, 0,
+				"Peer certchain revocation check failed: %s",
+				revoked_str);
+
+		return false;
+	}
+
 	/*
 	 * RFC5246 7.4.2:
 	 * "The end entity certificate's public key (and associated
 	 * restrictions) MUST be compatible with the selected key exchange
 	 * algorithm."
+	 *
+	 * In TLS 1.3 the key type is only checked against the signature
+	 * scheme in the CertificateVerify.
 	 */
 	leaf = l_certchain_get_leaf(certchain);
-	if (!tls->pending.cipher_suite->signature->
+	if (tls->pending.cipher_suite->signature &&
+			!tls->pending.cipher_suite->signature->
 			validate_cert_key_type(leaf)) {
 		TLS_DISCONNECT(TLS_ALERT_UNSUPPORTED_CERT, 0,
 				"Peer certificate key type incompatible with "
 				"pending cipher suite %s",
 				tls->pending.cipher_suite->name);
 
-		return;
+		return false;
 	}
 
 	if (tls->subject_mask && !tls_cert_domains_match_mask(leaf,
@@ -2625,7 +3679,7 @@ static void tls_handle_certificate(struct l_tls *tls,
 		l_free(mask);
 		l_free(subject_str);
 
-		return;
+		return false;
 	}
 
 	/* Save the end-entity certificate and free the chain */
@@ -2637,7 +3691,7 @@ static void tls_handle_certificate(struct l_tls *tls,
 		TLS_DISCONNECT(TLS_ALERT_UNSUPPORTED_CERT, 0,
 				"Error loading peer public key to kernel");
 
-		return;
+		return false;
 	}
 
 	switch (l_cert_get_pubkey_type(tls->peer_cert)) {
@@ -2656,10 +3710,64 @@ static void tls_handle_certificate(struct l_tls *tls,
 	case L_CERT_KEY_UNKNOWN:
 		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
 				"Unknown public key type");
-		return;
+		return false;
 	}
 
 	tls->peer_pubkey_size /= 8;
+	return true;
+
+pubkey_unsupported:
+	TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+				"Can't l_key_get_info for peer public key");
+	return false;
+}
+
+static void tls_handle_certificate(struct l_tls *tls,
+					const uint8_t *buf, size_t len)
+{
+	size_t total;
+	_auto_(l_certchain_free) struct l_certchain *certchain = NULL;
+
+	if (len < 3)
+		goto decode_error;
+
+	/* Length checks */
+	total = *buf++ << 16;
+	total |= *buf++ << 8;
+	total |= *buf++ << 0;
+	if (total + 3 != len)
+		goto decode_error;
+
+	if (tls_parse_certificate_list(buf, total, &certchain) < 0) {
+		TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+				"Error decoding peer certificate chain");
+
+		return;
+	}
+
+	/*
+	 * "Note that a client MAY send no certificates if it does not have any
+	 * appropriate certificate to send in response to the server's
+	 * authentication request." -- for now we unconditionally accept
+	 * an empty certificate chain from the client.  Later on we need to
+	 * make this configurable, if we don't want to authenticate the
+	 * client then also don't bother sending a Certificate Request.
+	 */
+	if (!certchain) {
+		if (!tls->server) {
+			TLS_DISCONNECT(TLS_ALERT_HANDSHAKE_FAIL, 0,
+					"Server sent no certificate chain");
+
+			return;
+		}
+
+		TLS_SET_STATE(TLS_HANDSHAKE_WAIT_KEY_EXCHANGE);
+
+		return;
+	}
+
+	if (!tls_set_peer_certchain(tls, certchain))
+		return;
 
 	if (tls->server || tls->pending.cipher_suite->key_xchg->
 			handle_server_key_exchange)
@@ -2669,10 +3777,6 @@ static void tls_handle_certificate(struct l_tls *tls,
 
 	return;
 
-pubkey_unsupported:
-	TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
-				"Can't l_key_get_info for peer public key");
-	return;
 decode_error:
 	TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
 			"TLS_CERTIFICATE decode error");
@@ -2746,6 +3850,103 @@ decode_error:
 			"CertificateRequest decode error");
 }
 
+/*
+ * RFC 7918 Section 4: False Start is only used in full handshakes with a
+ * key exchange that provides forward secrecy and an AEAD cipher.  It
+ * doesn't apply to renegotiations where application data can be
+ * exchanged throughout.
+ */
+static bool tls_false_start_allowed(struct l_tls *tls)
+{
+	return tls->false_start && !tls->ready &&
+		tls->pending.cipher_suite->key_xchg->send_server_key_exchange &&
+		tls->cipher_type[1] == TLS_CIPHER_AEAD;
+}
+
+static void tls_false_start(struct l_tls *tls)
+{
+	_auto_(l_free) char *peer_identity = NULL;
+
+	/*
+	 * Same identity as tls_finished would report.  The server has
+	 * already signed the key exchange parameters with its certified
+	 * key, only the Finished check is still pending.
+	 */
+	if (tls->pending.cipher_suite->signature && tls_have_ca_certs(tls)) {
+		peer_identity = tls_get_peer_identity_str(tls->peer_cert);
+		if (!peer_identity) {
+			TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+					"tls_get_peer_identity_str failed");
+			return;
+		}
+	}
+
+	TLS_DEBUG("False Start, ready before the server's Finished");
+	tls->false_started = true;
+
+	tls->in_callback = true;
+	tls->ready_handle(peer_identity, tls->user_data);
+	tls->in_callback = false;
+}
+
+static void tls_handle_certificate_status(struct l_tls *tls,
+						const uint8_t *buf, size_t len)
+{
+	size_t response_len;
+	const char *error;
+	int r;
+
+	tls->ocsp_status_expected = false;
+
+	if (len < 4 || buf[0] != 1)
+		goto decode_error;
+
+	response_len = (buf[1] << 16) | (buf[2] << 8) | buf[3];
+	if (!response_len || response_len + 4 != len)
+		goto decode_error;
+
+	if (!tls->ocsp_issuer) {
+		if (tls->ocsp_stapling == L_TLS_OCSP_STAPLING_REQUIRE) {
+			TLS_DISCONNECT(TLS_ALERT_BAD_CERT_STATUS_RESPONSE, 0,
+					"Peer certificate's issuer unknown, "
+					"can't check the OCSP response");
+			return;
+		}
+
+		TLS_DEBUG("Peer certificate's issuer unknown, ignoring the "
+				"OCSP response");
+		return;
+	}
+
+	r = tls_ocsp_verify(buf + 4, response_len, tls->peer_cert,
+				tls->ocsp_issuer, time_realtime_now(), NULL,
+				&error);
+	if (r == -EKEYREVOKED) {
+		TLS_DISCONNECT(TLS_ALERT_CERT_REVOKED, 0, "OCSP: %s", error);
+		return;
+	}
+
+	if (r == -ENOKEY &&
+			tls->ocsp_stapling != L_TLS_OCSP_STAPLING_REQUIRE) {
+		TLS_DEBUG("OCSP: %s", error);
+		return;
+	}
+
+	if (r) {
+		TLS_DISCONNECT(TLS_ALERT_BAD_CERT_STATUS_RESPONSE, 0,
+				"OCSP: %s", error);
+		return;
+	}
+
+	tls->ocsp_status_verified = true;
+	TLS_DEBUG("Peer certificate status verified with OCSP");
+	return;
+
+decode_error:
+	TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+			"CertificateStatus decode error");
+}
+
 static void tls_handle_server_hello_done(struct l_tls *tls,
 						const uint8_t *buf, size_t len)
 {
@@ -2757,6 +3958,13 @@ static void tls_handle_server_hello_done(struct l_tls *tls,
 		return;
 	}
 
+	if (tls->ocsp_stapling == L_TLS_OCSP_STAPLING_REQUIRE &&
+			!tls->ocsp_status_verified) {
+		TLS_DISCONNECT(TLS_ALERT_BAD_CERT_STATUS_RESPONSE, 0,
+				"No valid OCSP response stapled");
+		return;
+	}
+
 	if (tls->cert_requested)
 		if (!tls_send_certificate(tls))
 			return;
@@ -2780,6 +3988,9 @@ static void tls_handle_server_hello_done(struct l_tls *tls,
 		return;
 
 	TLS_SET_STATE(TLS_HANDSHAKE_WAIT_CHANGE_CIPHER_SPEC);
+
+	if (tls_false_start_allowed(tls))
+		tls_false_start(tls);
 }
 
 static bool tls_get_prev_digest_by_type(struct l_tls *tls,
@@ -2977,6 +4188,34 @@ static void tls_finished(struct l_tls *tls)
 	} else if (tls->peer_authenticated && resuming)
 		peer_identity = tls->session_peer_identity;
 
+	if (tls->session_cache && tls->session_id_new) {
+		struct tls_cached_session *session =
+			l_new(struct tls_cached_session, 1);
+
+		session->id[0] = tls->session_id_size;
+		memcpy(session->id + 1, tls->session_id, tls->session_id_size);
+		session->version = tls->negotiated_version;
+		memcpy(session->cipher_suite_id,
+			tls->pending.cipher_suite->id, 2);
+		session->compression_method_id =
+			tls->pending.compression_method->id;
+		memcpy(session->master_secret, tls->pending.master_secret, 48);
+		session->expiry_time = time_realtime_now() +
+			tls_session_cache_get_lifetime(tls->session_cache);
+		session->peer_identity = l_strdup(peer_identity);
+
+		if (tls->peer_authenticated &&
+				peer_cert_expiry < session->expiry_time)
+			session->expiry_time = peer_cert_expiry;
+
+		tls_session_cache_add(tls->session_cache, session);
+
+		if (tls->session_id_size_replaced)
+			tls_session_cache_remove(tls->session_cache,
+						tls->session_id_replaced,
+						tls->session_id_size_replaced);
+	}
+
 	if (tls->session_settings && tls->session_id_new) {
 		_auto_(l_free) char *session_id_str =
 			l_util_hexstring(tls->session_id, tls->session_id_size);
@@ -2995,75 +4234,664 @@ static void tls_finished(struct l_tls *tls)
 						"SessionID", tls->session_id,
 						tls->session_id_size);
 
-		l_settings_set_bytes(tls->session_settings, group_name,
-					"SessionMasterSecret",
-					tls->pending.master_secret, 48);
-		l_settings_set_int(tls->session_settings, group_name,
-					"SessionVersion",
-					tls->negotiated_version);
-		l_settings_set_bytes(tls->session_settings, group_name,
-					"SessionCipherSuite",
-					tls->pending.cipher_suite->id, 2);
-		l_settings_set_uint(tls->session_settings, group_name,
-					"SessionCompressionMethod",
-					tls->pending.compression_method->id);
+		l_settings_set_bytes(tls->session_settings, group_name,
+					"SessionMasterSecret",
+					tls->pending.master_secret, 48);
+		l_settings_set_int(tls->session_settings, group_name,
+					"SessionVersion",
+					tls->negotiated_version);
+		l_settings_set_bytes(tls->session_settings, group_name,
+					"SessionCipherSuite",
+					tls->pending.cipher_suite->id, 2);
+		l_settings_set_uint(tls->session_settings, group_name,
+					"SessionCompressionMethod",
+					tls->pending.compression_method->id);
+
+		if (expiry)
+			l_settings_set_uint64(tls->session_settings,
+						group_name,
+						"SessionExpiryTime", expiry);
+		else
+			/* We may be overwriting an older session's data */
+			l_settings_remove_key(tls->session_settings,
+						group_name,
+						"SessionExpiryTime");
+
+		if (tls->peer_authenticated)
+			l_settings_set_string(tls->session_settings,
+						group_name,
+						"SessionPeerIdentity",
+						peer_identity);
+		else
+			/* We may be overwriting an older session's data */
+			l_settings_remove_key(tls->session_settings,
+						group_name,
+						"SessionPeerIdentity");
+
+		if (!tls->server && tls->session_ticket_new &&
+				tls->session_ticket_len)
+			l_settings_set_bytes(tls->session_settings, group_name,
+						"SessionTicket",
+						tls->session_ticket,
+						tls->session_ticket_len);
+		else if (!tls->server)
+			/* We may be overwriting an older session's data */
+			l_settings_remove_key(tls->session_settings,
+						group_name, "SessionTicket");
+
+		TLS_DEBUG("Saving new session %s to cache", session_id_str);
+		session_update = true;
+
+		if (tls->session_id_size_replaced) {
+			tls_forget_cached_session(tls, NULL,
+						tls->session_id_replaced,
+						tls->session_id_size_replaced,
+						false);
+			tls->session_id_size_replaced = 0;
+		}
+	} else if (tls->session_settings && !tls->server &&
+			tls->session_ticket_new) {
+		/* Resumed session, the server has issued a new ticket */
+		const char *group_name = tls_get_cache_group_name(tls, NULL, 0);
+
+		if (tls->session_ticket_len)
+			l_settings_set_bytes(tls->session_settings, group_name,
+						"SessionTicket",
+						tls->session_ticket,
+						tls->session_ticket_len);
+		else
+			l_settings_remove_key(tls->session_settings,
+						group_name, "SessionTicket");
+
+		TLS_DEBUG("Saving new session ticket to cache");
+		session_update = true;
+	}
+
+	/* Free up the resources used in the handshake */
+	tls_reset_handshake(tls);
+
+	TLS_SET_STATE(TLS_HANDSHAKE_DONE);
+	tls->ready = true;
+	tls->session_resumed = resuming;
+
+	/*
+	 * Records written from the ready callback on already go through
+	 * the kernel.  Receive offload has to wait until l_tls_handle_rx
+	 * has consumed its input so that no record is left behind.
+	 */
+	if (!renegotiation && tls->ktls_key_length[1])
+		tls_ktls_enable(tls, true);
+
+	tls->ktls_rx_pending = !renegotiation && tls->ktls_key_length[0];
+
+	if (session_update && tls->session_update_cb) {
+		tls->in_callback = true;
+		tls->session_update_cb(tls->session_update_user_data);
+		tls->in_callback = false;
+
+		if (tls->pending_destroy)
+			return;
+	}
+
+	/* With False Start the application has been told already */
+	if (!renegotiation && !tls->false_started) {
+		tls->in_callback = true;
+		tls->ready_handle(peer_identity, tls->user_data);
+		tls->in_callback = false;
+	}
+
+	tls->false_started = false;
+
+	tls_cleanup_handshake(tls);
+}
+
+static void tls13_handle_encrypted_extensions(struct l_tls *tls,
+						const uint8_t *buf, size_t len)
+{
+	/* None of the extensions we send needs a response here */
+	if (!tls13_parse_extensions(tls, "EncryptedExtensions", buf, len,
+					false, NULL, 0, NULL, NULL))
+		return;
+
+	TLS_SET_STATE(TLS_HANDSHAKE_WAIT_CERTIFICATE);
+}
+
+static void tls13_handle_certificate_request(struct l_tls *tls,
+						const uint8_t *buf, size_t len)
+{
+	static const uint16_t signature_algorithms_id = 13;
+	struct l_cert *leaf = l_certchain_get_leaf(tls->cert);
+	const uint8_t *sig_algs;
+	size_t sig_algs_len;
+	size_t i;
+
+	/* The context is only used in post-handshake authentication */
+	if (len < 1 || buf[0] != 0)
+		goto decode_error;
+
+	if (!tls13_parse_extensions(tls, "CertificateRequest", buf + 1,
+					len - 1, false,
+					&signature_algorithms_id, 1,
+					&sig_algs, &sig_algs_len))
+		return;
+
+	if (!sig_algs) {
+		TLS_DISCONNECT(TLS_ALERT_MISSING_EXTENSION, 0,
+				"CertificateRequest without "
+				"signature_algorithms");
+		return;
+	}
+
+	if (sig_algs_len < 2 || (sig_algs_len & 1) ||
+			l_get_be16(sig_algs) != sig_algs_len - 2)
+		goto decode_error;
+
+	tls->cert_requested = 1;
+	tls->tls13_sign_scheme = NULL;
+
+	/*
+	 * Use the server's most preferred scheme that we can sign with,
+	 * without one an empty Certificate is sent.
+	 */
+	for (i = 2; leaf && tls->priv_key && i < sig_algs_len; i += 2) {
+		const struct tls13_signature_scheme *scheme =
+			tls13_find_signature_scheme(l_get_be16(sig_algs + i));
+
+		if (!scheme || scheme->key_type != L_CERT_KEY_RSA ||
+				l_cert_get_pubkey_type(leaf) !=
+				scheme->key_type ||
+				!l_checksum_is_supported(scheme->hash, false))
+			continue;
+
+		tls->tls13_sign_scheme = scheme;
+		break;
+	}
+
+	return;
+
+decode_error:
+	TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+			"CertificateRequest decode error");
+}
+
+static void tls13_handle_certificate(struct l_tls *tls,
+					const uint8_t *buf, size_t len)
+{
+	static const uint16_t status_request_id = 5;
+	_auto_(l_certchain_free) struct l_certchain *certchain = NULL;
+	const uint8_t *status = NULL;
+	size_t status_len = 0;
+	size_t total;
+
+	/* Empty certificate_request_context, then the certificate_list */
+	if (len < 4 || buf[0] != 0)
+		goto decode_error;
+
+	total = (buf[1] << 16) | (buf[2] << 8) | buf[3];
+	if (total + 4 != len)
+		goto decode_error;
+
+	buf += 4;
+	len -= 4;
+
+	while (len) {
+		struct l_cert *cert;
+		size_t cert_len;
+		size_t ext_len;
+
+		if (len < 3)
+			goto decode_error;
+
+		cert_len = (buf[0] << 16) | (buf[1] << 8) | buf[2];
+		if (len < 3 + cert_len + 2)
+			goto decode_error;
+
+		ext_len = l_get_be16(buf + 3 + cert_len);
+		if (len < 3 + cert_len + 2 + ext_len)
+			goto decode_error;
+
+		cert = l_cert_new_from_der(buf + 3, cert_len);
+		if (!cert)
+			goto decode_error;
+
+		if (!certchain) {
+			certchain = certchain_new_from_leaf(cert);
+			if (!certchain)
+				goto decode_error;
+
+			/* Only the end-entity status is checked */
+			if (!tls13_parse_extensions(tls, "Certificate",
+							buf + 3 + cert_len,
+							2 + ext_len, false,
+							&status_request_id, 1,
+							&status, &status_len))
+				return;
+		} else
+			certchain_link_issuer(certchain, cert);
+
+		buf += 3 + cert_len + 2 + ext_len;
+		len -= 3 + cert_len + 2 + ext_len;
+	}
+
+	if (!certchain) {
+		TLS_DISCONNECT(TLS_ALERT_HANDSHAKE_FAIL, 0,
+				"Server sent no certificate chain");
+		return;
+	}
+
+	if (!tls_set_peer_certchain(tls, certchain))
+		return;
+
+	TLS_SET_STATE(TLS_HANDSHAKE_WAIT_CERTIFICATE_VERIFY);
+
+	/* RFC 8446 Section 4.4.2.1, same CertificateStatus as in TLS 1.2 */
+	if (status && tls->ocsp_status_expected)
+		tls_handle_certificate_status(tls, status, status_len);
+
+	return;
+
+decode_error:
+	TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+			"TLS 1.3 Certificate decode error");
+}
+
+/* RFC 8446 Section 4.4.3, the content covered by a CertificateVerify */
+static size_t tls13_certificate_verify_content(struct l_tls *tls,
+						bool server,
+						const uint8_t *transcript_hash,
+						uint8_t *out)
+{
+	const char *context = server ? "TLS 1.3, server CertificateVerify" :
+		"TLS 1.3, client CertificateVerify";
+	size_t context_len = strlen(context) + 1;
+	size_t hash_len = l_checksum_digest_length(tls->prf_hmac->l_id);
+
+	memset(out, 0x20, 64);
+	memcpy(out + 64, context, context_len);
+	memcpy(out + 64 + context_len, transcript_hash, hash_len);
+
+	return 64 + context_len + hash_len;
+}
+
+static void tls13_handle_certificate_verify(struct l_tls *tls,
+						const uint8_t *buf, size_t len)
+{
+	uint8_t content[128 + HANDSHAKE_HASH_MAX_SIZE];
+	size_t content_len;
+	const struct tls13_signature_scheme *scheme;
+
+	if (tls->ocsp_stapling == L_TLS_OCSP_STAPLING_REQUIRE &&
+			!tls->ocsp_status_verified) {
+		TLS_DISCONNECT(TLS_ALERT_BAD_CERT_STATUS_RESPONSE, 0,
+				"No valid OCSP response stapled");
+		return;
+	}
+
+	if (len < 4 || l_get_be16(buf + 2) != len - 4) {
+		TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+				"CertificateVerify decode error");
+		return;
+	}
+
+	/* We offered the schemes with a supported hash */
+	scheme = tls13_find_signature_scheme(l_get_be16(buf));
+	if (!scheme || !l_checksum_is_supported(scheme->hash, false)) {
+		TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+				"Signature scheme %04x not offered",
+				l_get_be16(buf));
+		return;
+	}
+
+	content_len = tls13_certificate_verify_content(tls, true,
+				tls->prev_digest[tls->prf_hmac->type],
+				content);
+
+	if (!tls13_verify(tls, scheme, content, content_len,
+				buf + 4, len - 4)) {
+		TLS_DISCONNECT(TLS_ALERT_DECRYPT_ERROR, 0,
+				"Peer %s signature verification failed",
+				scheme->name);
+		return;
+	}
+
+	TLS_SET_STATE(TLS_HANDSHAKE_WAIT_FINISHED);
+}
+
+/* RFC 8446 Section 4.4.4 */
+static bool tls13_finished_mac(struct l_tls *tls, const uint8_t *base_key,
+				const uint8_t *transcript_hash, uint8_t *out)
+{
+	enum l_checksum_type type = tls->prf_hmac->l_id;
+	size_t hash_len = l_checksum_digest_length(type);
+	uint8_t key[HANDSHAKE_HASH_MAX_SIZE];
+	struct l_checksum *hmac;
+	bool r;
+
+	if (!tls13_hkdf_expand_label(type, base_key, hash_len, "finished",
+					NULL, 0, key, hash_len))
+		return false;
+
+	hmac = l_checksum_new_hmac(type, key, hash_len);
+	explicit_bzero(key, sizeof(key));
+
+	if (!hmac)
+		return false;
+
+	r = l_checksum_update(hmac, transcript_hash, hash_len) &&
+		l_checksum_get_digest(hmac, out, hash_len) ==
+		(ssize_t) hash_len;
+	l_checksum_free(hmac);
+	return r;
+}
+
+static bool tls13_cert_list_add_size(struct l_cert *cert, void *user_data)
+{
+	size_t *total = user_data;
+	size_t der_len;
+
+	l_cert_get_der_data(cert, &der_len);
+	*total += 3 + der_len + 2;
+
+	return false;
+}
+
+static bool tls13_cert_list_append(struct l_cert *cert, void *user_data)
+{
+	uint8_t **ptr = user_data;
+
+	tls_cert_list_append(cert, ptr);
+
+	/* No extensions */
+	*(*ptr)++ = 0;
+	*(*ptr)++ = 0;
+
+	return false;
+}
+
+/*
+ * Sent after a CertificateRequest, empty unless a signature scheme was
+ * found for our certificate's key.
+ */
+static void tls13_send_certificate(struct l_tls *tls)
+{
+	bool send = tls->cert && tls->tls13_sign_scheme;
+	size_t total = 0;
+	uint8_t *buf;
+	uint8_t *ptr;
+
+	if (send)
+		l_certchain_walk_from_leaf(tls->cert,
+						tls13_cert_list_add_size,
+						&total);
+
+	buf = l_malloc(TLS_HANDSHAKE_HEADER_SIZE + 4 + total);
+	ptr = buf + TLS_HANDSHAKE_HEADER_SIZE;
+
+	*ptr++ = 0;	/* certificate_request_context */
+	*ptr++ = total >> 16;
+	*ptr++ = total >>  8;
+	*ptr++ = total >>  0;
+
+	if (send)
+		l_certchain_walk_from_leaf(tls->cert,
+						tls13_cert_list_append, &ptr);
+
+	tls_tx_handshake(tls, TLS_CERTIFICATE, buf, ptr - buf);
+	l_free(buf);
+
+	tls->cert_sent = send;
+}
+
+static bool tls13_send_certificate_verify(struct l_tls *tls)
+{
+	const struct tls13_signature_scheme *scheme = tls->tls13_sign_scheme;
+	uint8_t buf[TLS_HANDSHAKE_HEADER_SIZE + 4 + 512];
+	uint8_t transcript_hash[HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t content[128 + HANDSHAKE_HASH_MAX_SIZE];
+	size_t content_len;
+	ssize_t sig_len;
+
+	tls_get_handshake_hash(tls, tls->prf_hmac->type, transcript_hash);
+	content_len = tls13_certificate_verify_content(tls, false,
+							transcript_hash,
+							content);
+
+	sig_len = tls13_sign(tls, scheme, content, content_len,
+				buf + TLS_HANDSHAKE_HEADER_SIZE + 4,
+				sizeof(buf) - TLS_HANDSHAKE_HEADER_SIZE - 4);
+	if (sig_len < 0) {
+		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+				"%s signing failed: %s", scheme->name,
+				strerror(-sig_len));
+		return false;
+	}
+
+	l_put_be16(scheme->id, buf + TLS_HANDSHAKE_HEADER_SIZE);
+	l_put_be16(sig_len, buf + TLS_HANDSHAKE_HEADER_SIZE + 2);
+
+	tls_tx_handshake(tls, TLS_CERTIFICATE_VERIFY, buf,
+				TLS_HANDSHAKE_HEADER_SIZE + 4 + sig_len);
+	return true;
+}
+
+static bool tls13_send_finished(struct l_tls *tls)
+{
+	uint8_t buf[TLS_HANDSHAKE_HEADER_SIZE + HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t transcript_hash[HANDSHAKE_HASH_MAX_SIZE];
+	size_t hash_len = l_checksum_digest_length(tls->prf_hmac->l_id);
+
+	tls_get_handshake_hash(tls, tls->prf_hmac->type, transcript_hash);
+
+	if (!tls13_finished_mac(tls, tls->tls13_traffic_secret[1],
+				transcript_hash,
+				buf + TLS_HANDSHAKE_HEADER_SIZE)) {
+		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+				"Error computing the Finished MAC");
+		return false;
+	}
+
+	tls_tx_handshake(tls, TLS_FINISHED, buf,
+				TLS_HANDSHAKE_HEADER_SIZE + hash_len);
+	return true;
+}
+
+static void tls13_handle_finished(struct l_tls *tls,
+					const uint8_t *buf, size_t len)
+{
+	enum l_checksum_type type = tls->prf_hmac->l_id;
+	size_t hash_len = l_checksum_digest_length(type);
+	uint8_t expected[HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t transcript_hash[HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t c_ap[HANDSHAKE_HASH_MAX_SIZE];
+	uint8_t s_ap[HANDSHAKE_HASH_MAX_SIZE];
+	bool r;
+
+	if (!tls13_finished_mac(tls, tls->tls13_traffic_secret[0],
+				tls->prev_digest[tls->prf_hmac->type],
+				expected)) {
+		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+				"Error computing the Finished MAC");
+		return;
+	}
+
+	if (len != hash_len || l_secure_memcmp(buf, expected, len)) {
+		TLS_DISCONNECT(TLS_ALERT_DECRYPT_ERROR, 0,
+				"TLS_FINISHED contents don't match");
+		return;
+	}
+
+	/*
+	 * The application traffic secrets and the exporter secret cover
+	 * the transcript up to the server Finished, the exporter secret is
+	 * kept where l_tls_prf_get_bytes expects it.
+	 */
+	tls_get_handshake_hash(tls, tls->prf_hmac->type, transcript_hash);
+
+	r = tls13_derive_secret(tls, tls->tls13_secret, "c ap traffic",
+				transcript_hash, c_ap) &&
+		tls13_derive_secret(tls, tls->tls13_secret, "s ap traffic",
+					transcript_hash, s_ap) &&
+		tls13_derive_secret(tls, tls->tls13_secret, "exp master",
+					transcript_hash,
+					tls->pending.master_secret) &&
+		tls13_set_traffic_secret(tls, 0, s_ap);
+	explicit_bzero(s_ap, sizeof(s_ap));
+
+	if (!r) {
+		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+				"Error deriving the application keys");
+		goto done;
+	}
+
+	if (tls->cert_requested)
+		tls13_send_certificate(tls);
+
+	if (tls->cert_sent && !tls13_send_certificate_verify(tls))
+		goto done;
+
+	if (!tls13_send_finished(tls))
+		goto done;
+
+	if (!tls13_set_traffic_secret(tls, 1, c_ap)) {
+		TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+				"Error switching to the application keys");
+		goto done;
+	}
+
+	/*
+	 * As in TLS 1.2 the server is authenticated if its certificate
+	 * chain was verified against our CAs, the CertificateVerify
+	 * proves the possession of the key.
+	 */
+	if (tls_have_ca_certs(tls))
+		tls->peer_authenticated = true;
+
+	explicit_bzero(c_ap, sizeof(c_ap));
+	tls_finished(tls);
+	return;
+
+done:
+	explicit_bzero(c_ap, sizeof(c_ap));
+}
+
+/* RFC 8446 Section 7.2 */
+static bool tls13_update_traffic_secret(struct l_tls *tls, bool txrx)
+{
+	enum l_checksum_type type = tls->prf_hmac->l_id;
+	size_t hash_len = l_checksum_digest_length(type);
+	uint8_t secret[HANDSHAKE_HASH_MAX_SIZE];
+	bool r;
+
+	r = tls13_hkdf_expand_label(type, tls->tls13_traffic_secret[txrx],
+					hash_len, "traffic upd", NULL, 0,
+					secret, hash_len) &&
+		tls13_set_traffic_secret(tls, txrx, secret);
+	explicit_bzero(secret, sizeof(secret));
+	return r;
+}
+
+static void tls13_handle_key_update(struct l_tls *tls,
+					const uint8_t *buf, size_t len)
+{
+	uint8_t msg[TLS_HANDSHAKE_HEADER_SIZE + 1];
+
+	if (len != 1) {
+		TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
+				"KeyUpdate decode error");
+		return;
+	}
+
+	if (buf[0] > 1) {
+		TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+				"KeyUpdate request_update %u", buf[0]);
+		return;
+	}
+
+	if (!tls13_update_traffic_secret(tls, 0))
+		goto error;
+
+	/* update_requested, answer with update_not_requested */
+	if (buf[0] == 1) {
+		msg[TLS_HANDSHAKE_HEADER_SIZE] = 0;
+		tls_tx_handshake(tls, TLS_KEY_UPDATE, msg, sizeof(msg));
+
+		if (!tls13_update_traffic_secret(tls, 1))
+			goto error;
+	}
+
+	return;
+
+error:
+	TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
+			"Error updating the traffic keys");
+}
+
+/* The client side of the TLS 1.3 handshake after the ServerHello */
+static void tls13_handle_handshake(struct l_tls *tls, int type,
+					const uint8_t *buf, size_t len)
+{
+	switch (type) {
+	case TLS_ENCRYPTED_EXTENSIONS:
+		if (tls->state != TLS_HANDSHAKE_WAIT_ENCRYPTED_EXTENSIONS)
+			goto unexpected;
+
+		tls13_handle_encrypted_extensions(tls, buf, len);
+		break;
+
+	case TLS_CERTIFICATE_REQUEST:
+		if (tls->state != TLS_HANDSHAKE_WAIT_CERTIFICATE ||
+				tls->cert_requested)
+			goto unexpected;
+
+		tls13_handle_certificate_request(tls, buf, len);
+		break;
+
+	case TLS_CERTIFICATE:
+		if (tls->state != TLS_HANDSHAKE_WAIT_CERTIFICATE)
+			goto unexpected;
+
+		tls13_handle_certificate(tls, buf, len);
+		break;
 
-		if (expiry)
-			l_settings_set_uint64(tls->session_settings,
-						group_name,
-						"SessionExpiryTime", expiry);
-		else
-			/* We may be overwriting an older session's data */
-			l_settings_remove_key(tls->session_settings,
-						group_name,
-						"SessionExpiryTime");
+	case TLS_CERTIFICATE_VERIFY:
+		if (tls->state != TLS_HANDSHAKE_WAIT_CERTIFICATE_VERIFY)
+			goto unexpected;
 
-		if (tls->peer_authenticated)
-			l_settings_set_string(tls->session_settings,
-						group_name,
-						"SessionPeerIdentity",
-						peer_identity);
-		else
-			/* We may be overwriting an older session's data */
-			l_settings_remove_key(tls->session_settings,
-						group_name,
-						"SessionPeerIdentity");
+		tls13_handle_certificate_verify(tls, buf, len);
+		break;
 
-		TLS_DEBUG("Saving new session %s to cache", session_id_str);
-		session_update = true;
+	case TLS_FINISHED:
+		if (tls->state != TLS_HANDSHAKE_WAIT_FINISHED)
+			goto unexpected;
 
-		if (tls->session_id_size_replaced) {
-			tls_forget_cached_session(tls, NULL,
-						tls->session_id_replaced,
-						tls->session_id_size_replaced,
-						false);
-			tls->session_id_size_replaced = 0;
-		}
-	}
+		tls13_handle_finished(tls, buf, len);
+		break;
 
-	/* Free up the resources used in the handshake */
-	tls_reset_handshake(tls);
+	case TLS_NEW_SESSION_TICKET:
+		if (tls->state != TLS_HANDSHAKE_DONE)
+			goto unexpected;
 
-	TLS_SET_STATE(TLS_HANDSHAKE_DONE);
-	tls->ready = true;
-	tls->session_resumed = resuming;
+		/* No PSK resumption support */
+		TLS_DEBUG("Ignoring the NewSessionTicket");
+		break;
 
-	if (session_update && tls->session_update_cb) {
-		tls->in_callback = true;
-		tls->session_update_cb(tls->session_update_user_data);
-		tls->in_callback = false;
+	case TLS_KEY_UPDATE:
+		if (tls->state != TLS_HANDSHAKE_DONE)
+			goto unexpected;
 
-		if (tls->pending_destroy)
-			return;
-	}
+		tls13_handle_key_update(tls, buf, len);
+		break;
 
-	if (!renegotiation) {
-		tls->in_callback = true;
-		tls->ready_handle(peer_identity, tls->user_data);
-		tls->in_callback = false;
+	default:
+		goto unexpected;
 	}
 
-	tls_cleanup_handshake(tls);
+	return;
+
+unexpected:
+	TLS_DISCONNECT(TLS_ALERT_UNEXPECTED_MESSAGE, 0,
+			"Message invalid in state %s",
+			tls_handshake_state_to_str(tls->state));
 }
 
 static void tls_handle_handshake(struct l_tls *tls, int type,
@@ -3074,6 +4902,11 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 	TLS_DEBUG("Handling a %s of %zi bytes",
 			tls_handshake_type_to_str(type), len);
 
+	if (tls->negotiated_version >= L_TLS_V13) {
+		tls13_handle_handshake(tls, type, buf, len);
+		return;
+	}
+
 	switch (type) {
 	case TLS_HELLO_REQUEST:
 		if (tls->server) {
@@ -3100,6 +4933,12 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 			break;
 		}
 
+		/* The kernel can't switch keys */
+		if (tls->ktls_tx || tls->ktls_rx) {
+			TLS_DEBUG("Ignoring HelloRequest with kTLS enabled");
+			break;
+		}
+
 		if (!tls_send_client_hello(tls))
 			break;
 
@@ -3121,6 +4960,12 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 			break;
 		}
 
+		if (tls->ktls_tx || tls->ktls_rx) {
+			TLS_DISCONNECT(TLS_ALERT_NO_RENEGOTIATION, 0,
+					"Renegotiation with kTLS enabled");
+			break;
+		}
+
 		tls_handle_client_hello(tls, buf, len);
 
 		break;
@@ -3170,6 +5015,7 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 		}
 
 		TLS_SET_STATE(TLS_HANDSHAKE_WAIT_HELLO_DONE);
+		tls->ocsp_status_expected = false;
 
 		tls->pending.cipher_suite->key_xchg->handle_server_key_exchange(
 								tls, buf, len);
@@ -3197,10 +5043,31 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 			break;
 		}
 
+		tls->ocsp_status_expected = false;
 		tls_handle_certificate_request(tls, buf, len);
 
 		break;
 
+	case TLS_CERTIFICATE_STATUS:
+		/*
+		 * Server sends this optionally after its Certificate if it
+		 * acknowledged our status_request.
+		 */
+		if (tls->server || !tls->ocsp_status_expected ||
+				!tls->peer_cert ||
+				(tls->state !=
+				 TLS_HANDSHAKE_WAIT_KEY_EXCHANGE &&
+				 tls->state != TLS_HANDSHAKE_WAIT_HELLO_DONE)) {
+			TLS_DISCONNECT(TLS_ALERT_UNEXPECTED_MESSAGE, 0,
+					"Message invalid in state %s",
+					tls_handshake_state_to_str(tls->state));
+			break;
+		}
+
+		tls_handle_certificate_status(tls, buf, len);
+
+		break;
+
 	case TLS_SERVER_HELLO_DONE:
 		if (tls->state != TLS_HANDSHAKE_WAIT_HELLO_DONE) {
 			TLS_DISCONNECT(TLS_ALERT_UNEXPECTED_MESSAGE, 0,
@@ -3256,6 +5123,19 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 
 		break;
 
+	case TLS_NEW_SESSION_TICKET:
+		if (tls->server || !tls->session_ticket_expected ||
+				tls->state !=
+				TLS_HANDSHAKE_WAIT_CHANGE_CIPHER_SPEC) {
+			TLS_DISCONNECT(TLS_ALERT_UNEXPECTED_MESSAGE, 0,
+					"Message invalid in state %s",
+					tls_handshake_state_to_str(tls->state));
+			break;
+		}
+
+		tls_handle_new_session_ticket(tls, buf, len);
+		break;
+
 	case TLS_FINISHED:
 		if (tls->state != TLS_HANDSHAKE_WAIT_FINISHED) {
 			TLS_DISCONNECT(TLS_ALERT_UNEXPECTED_MESSAGE, 0,
@@ -3272,6 +5152,10 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 		if ((tls->server && !resuming) || (!tls->server && resuming)) {
 			const char *error;
 
+			if (tls->server && tls->session_ticket_send &&
+					!tls_send_new_session_ticket(tls))
+				break;
+
 			tls_send_change_cipher_spec(tls);
 			if (!tls_change_cipher_spec(tls, 1, &error)) {
 				TLS_DISCONNECT(TLS_ALERT_INTERNAL_ERROR, 0,
@@ -3318,7 +5202,8 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 		 * message confirms their identity hasn't changed.
 		 */
 		if (tls->cipher_suite[0]->signature &&
-				((!tls->server && !resuming && tls->ca_certs) ||
+				((!tls->server && !resuming &&
+				  tls_have_ca_certs(tls)) ||
 				 (resuming && tls->session_peer_identity)))
 			tls->peer_authenticated = true;
 
@@ -3332,6 +5217,15 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 	}
 }
 
+/*
+ * An l_tls object and the l_io or callbacks that feed it belong to one
+ * thread and its main loop.  A server running a loop on each core gives
+ * every thread its own objects, but the immutable parts of the setup can
+ * be shared: l_certchain and l_key objects, the CA certificate queue once
+ * built and an l_cert_store once populated.  The session cache, the ECDHE
+ * key cache, the certificate verification cache and the ticket key set
+ * are mutable and must be created for each thread.
+ */
 LIB_EXPORT struct l_tls *l_tls_new(bool server,
 				l_tls_write_cb_t app_data_handler,
 				l_tls_write_cb_t tx_handler,
@@ -3339,6 +5233,7 @@ LIB_EXPORT struct l_tls *l_tls_new(bool server,
 				l_tls_disconnect_cb_t disconnect_handler,
 				void *user_data)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_TLS);
 	struct l_tls *tls;
 
 	if (!l_key_is_supported(L_KEY_FEATURE_CRYPTO))
@@ -3355,6 +5250,7 @@ LIB_EXPORT struct l_tls *l_tls_new(bool server,
 	tls->min_version = TLS_MIN_VERSION;
 	tls->max_version = TLS_MAX_VERSION;
 	tls->session_lifetime = 24 * 3600 * L_USEC_PER_SEC;
+	tls->ktls_fd = -1;
 
 	/* If we're the server wait for the Client Hello already */
 	if (tls->server)
@@ -3409,13 +5305,29 @@ LIB_EXPORT void l_tls_free(struct l_tls *tls)
 
 LIB_EXPORT void l_tls_write(struct l_tls *tls, const uint8_t *data, size_t len)
 {
-	if (unlikely(!tls->ready)) {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_TLS);
+	if (unlikely(!tls->ready && !tls->false_started)) {
 		return;
 	}
 
 	tls_tx_record(tls, TLS_CT_APPLICATION_DATA, data, len);
 }
 
+/*
+ * Same as l_tls_write for data scattered over @iovcnt buffers, the
+ * records are filled straight from @iov and encrypted in place.
+ */
+LIB_EXPORT void l_tls_writev(struct l_tls *tls, const struct iovec *iov,
+				size_t iovcnt)
+{
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_TLS);
+	if (unlikely(!tls->ready && !tls->false_started) ||
+			unlikely(!iov && iovcnt))
+		return;
+
+	tls_tx_recordv(tls, TLS_CT_APPLICATION_DATA, iov, iovcnt);
+}
+
 bool tls_handle_message(struct l_tls *tls, const uint8_t *message,
 			int len, enum tls_content_type type, uint16_t version)
 {
@@ -3431,7 +5343,21 @@ bool tls_handle_message(struct l_tls *tls, const uint8_t *message,
 			return false;
 		}
 
-		if (tls->state != TLS_HANDSHAKE_WAIT_CHANGE_CIPHER_SPEC) {
+		/*
+		 * RFC 8446 Section 5: a TLS 1.3 server in middlebox
+		 * compatibility mode sends one during the handshake.
+		 */
+		if (!tls->server && tls->state != TLS_HANDSHAKE_DONE &&
+				(tls->negotiated_version >= L_TLS_V13 ||
+				 tls->tls13_hrr))
+			return true;
+
+		/*
+		 * RFC 5077 Section 3.3: after a SessionTicket extension in
+		 * the Server Hello a NewSessionTicket must come first.
+		 */
+		if (tls->state != TLS_HANDSHAKE_WAIT_CHANGE_CIPHER_SPEC ||
+				tls->session_ticket_expected) {
 			TLS_DISCONNECT(TLS_ALERT_UNEXPECTED_MESSAGE, 0,
 					"ChangeCipherSpec invalid in state %s",
 					tls_handshake_state_to_str(tls->state));
@@ -3500,7 +5426,8 @@ bool tls_handle_message(struct l_tls *tls, const uint8_t *message,
 		 * out of order.
 		 */
 		if (message[0] == TLS_CERTIFICATE_VERIFY ||
-				message[0] == TLS_FINISHED)
+				message[0] == TLS_FINISHED ||
+				message[0] == TLS_SERVER_HELLO)
 			for (hash = 0; hash < __HANDSHAKE_HASH_COUNT; hash++) {
 				if (!tls->handshake_hash[hash])
 					continue;
@@ -3564,6 +5491,7 @@ bool tls_handle_message(struct l_tls *tls, const uint8_t *message,
 
 LIB_EXPORT bool l_tls_start(struct l_tls *tls)
 {
+	MEMORY_TAG_SCOPE(L_MEMORY_TAG_TLS);
 	if (tls->max_version < tls->min_version)
 		return false;
 
@@ -3595,8 +5523,12 @@ LIB_EXPORT bool l_tls_start(struct l_tls *tls)
 	 * Don't directly set tls->{min,max}_version as that would make the
 	 * handshake fail if the server decides to start a new session with
 	 * a new version instead of resuming, which it is allowed to do.
+	 *
+	 * TLS 1.3 is offered in the supported_versions extension instead,
+	 * RFC 8446 Section 4.1.2.
 	 */
-	tls->client_version = tls->max_version;
+	tls->client_version = tls->max_version > L_TLS_V12 ?
+		L_TLS_V12 : tls->max_version;
 	tls_load_cached_client_session(tls);
 
 	if (tls->pending_destroy) {
@@ -3634,9 +5566,56 @@ LIB_EXPORT void l_tls_reset(struct l_tls *tls)
 
 	tls->negotiated_version = 0;
 	tls->ready = false;
+	tls->false_started = false;
+	tls->ktls_rx_pending = false;
 	tls->record_flush = true;
 	tls->record_buf_len = 0;
 	tls->message_buf_len = 0;
+	tls->tx_burst_bytes = 0;
+}
+
+/*
+ * Offload the record layer of AES-GCM sessions to the kernel once the
+ * handshake completes.  @fd is the connected TCP socket the TLS payloads
+ * are written to and read from, -1 disables the offload.  Must be called
+ * before l_tls_start.
+ */
+LIB_EXPORT bool l_tls_set_ktls_fd(struct l_tls *tls, int fd)
+{
+	if (unlikely(!tls))
+		return false;
+
+	if (tls->ready || (tls->state != TLS_HANDSHAKE_WAIT_START &&
+				tls->state != TLS_HANDSHAKE_WAIT_HELLO) ||
+			tls->negotiated_version)
+		return false;
+
+#ifndef HAVE_LINUX_TLS_H
+	if (fd >= 0)
+		return false;
+#endif
+
+	tls->ktls_fd = fd < 0 ? -1 : fd;
+	tls->ktls_ulp = false;
+	tls->ktls_tx = false;
+	tls->ktls_rx = false;
+	return true;
+}
+
+LIB_EXPORT bool l_tls_get_ktls_tx(struct l_tls *tls)
+{
+	if (unlikely(!tls))
+		return false;
+
+	return tls->ktls_tx;
+}
+
+LIB_EXPORT bool l_tls_get_ktls_rx(struct l_tls *tls)
+{
+	if (unlikely(!tls))
+		return false;
+
+	return tls->ktls_rx;
 }
 
 LIB_EXPORT bool l_tls_set_cacert(struct l_tls *tls, struct l_queue *ca_certs)
@@ -3669,6 +5648,9 @@ LIB_EXPORT bool l_tls_set_auth_data(struct l_tls *tls,
 		tls->cert = NULL;
 	}
 
+	l_free(tls->cert_msg);
+	tls->cert_msg = NULL;
+
 	if (tls->priv_key) {
 		l_key_free(tls->priv_key);
 		tls->priv_key = NULL;
@@ -3830,6 +5812,264 @@ LIB_EXPORT void l_tls_set_session_cache(struct l_tls *tls,
 	tls->session_prefix = l_strdup(group_prefix);
 }
 
+/**
+ * l_tls_set_session_tickets:
+ * @tls: TLS server object being configured
+ * @ticket_keys: ticket keys from l_tls_ticket_keys_new or NULL to stop
+ *   issuing and accepting session tickets.  Must remain valid until
+ *   this method is called with a different value.
+ *
+ * Enables RFC 5077 session tickets in server mode: instead of the server
+ * caching session states, clients supporting the SessionTicket extension
+ * are given their session state encrypted with the current ticket key and
+ * present it back to resume the session.  Can be used together with
+ * l_tls_set_session_cache, the lifetime set there also applies to the
+ * tickets.  Clients with a session cache always support tickets.
+ */
+LIB_EXPORT bool l_tls_set_session_tickets(struct l_tls *tls,
+					struct l_tls_ticket_keys *ticket_keys)
+{
+	if (unlikely(!tls || !tls->server))
+		return false;
+
+	tls->ticket_keys = ticket_keys;
+	return true;
+}
+
+/**
+ * l_tls_set_ecdhe_key_cache:
+ * @tls: TLS server object being configured
+ * @cache: cache from l_tls_ecdhe_key_cache_new or NULL to generate a new
+ *   ECDHE key pair in every handshake.  Must remain valid until this
+ *   method is called with a different value.
+ *
+ * Reuses the server's ECDHE key pair in handshakes during the lifetime
+ * set in @cache.  Traffic of all sessions that used one key pair can be
+ * decrypted by an attacker who obtains its private key, so the lifetime
+ * should be kept short.
+ */
+LIB_EXPORT bool l_tls_set_ecdhe_key_cache(struct l_tls *tls,
+					struct l_tls_ecdhe_key_cache *cache)
+{
+	if (unlikely(!tls || !tls->server))
+		return false;
+
+	tls->ecdhe_key_cache = cache;
+	return true;
+}
+
+/**
+ * l_tls_set_key_pool:
+ * @tls: TLS object being configured
+ * @pool: pool from l_tls_key_pool_new or NULL.  Must remain valid until
+ *   this method is called with a different value.
+ *
+ * Takes the ephemeral ECDHE and DHE key pairs for the negotiated group
+ * from @pool when it has one ready, instead of generating them during
+ * the handshake.  A server using l_tls_set_ecdhe_key_cache takes its
+ * ECDHE key pairs from the cache.
+ */
+LIB_EXPORT bool l_tls_set_key_pool(struct l_tls *tls,
+					struct l_tls_key_pool *pool)
+{
+	if (unlikely(!tls))
+		return false;
+
+	tls->key_pool = pool;
+	return true;
+}
+
+/**
+ * l_tls_set_ocsp_cache:
+ * @tls: TLS server object being configured
+ * @cache: cache from l_tls_ocsp_cache_new or NULL to not staple OCSP
+ *   responses.  Must remain valid until this method is called with a
+ *   different value.
+ *
+ * Enables RFC 6066 OCSP stapling in server mode: clients sending the
+ * status_request extension get the cached OCSP response for the leaf
+ * certificate set with l_tls_set_auth_data in a CertificateStatus
+ * message, if @cache has a current one, saving them a connection to the
+ * OCSP responder.
+ */
+LIB_EXPORT bool l_tls_set_ocsp_cache(struct l_tls *tls,
+					struct l_tls_ocsp_cache *cache)
+{
+	if (unlikely(!tls || !tls->server))
+		return false;
+
+	tls->ocsp_cache = cache;
+	return true;
+}
+
+/**
+ * l_tls_set_ocsp_stapling:
+ * @tls: TLS client object being configured
+ * @mode: whether to request and require the server certificate's status
+ *
+ * Sends the RFC 6066 status_request extension so that the server may
+ * staple an OCSP response for its certificate.  A stapled response is
+ * checked against the certificate and its issuer, taken from the
+ * server's chain or the CA certificates, and the handshake fails if it
+ * isn't authentic and current or says the certificate is revoked.  In
+ * L_TLS_OCSP_STAPLING_REQUIRE mode the handshake also fails if no
+ * response saying the certificate is good is received in a full
+ * handshake.  Must be called before l_tls_start.
+ */
+LIB_EXPORT bool l_tls_set_ocsp_stapling(struct l_tls *tls,
+					enum l_tls_ocsp_stapling mode)
+{
+	if (unlikely(!tls || tls->server))
+		return false;
+
+	switch (mode) {
+	case L_TLS_OCSP_STAPLING_OFF:
+	case L_TLS_OCSP_STAPLING_REQUEST:
+	case L_TLS_OCSP_STAPLING_REQUIRE:
+		tls->ocsp_stapling = mode;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * l_tls_set_false_start:
+ * @tls: TLS client object being configured
+ * @enabled: whether to use False Start
+ *
+ * Enables RFC 7918 False Start in client mode: in full handshakes using
+ * ECDHE or DHE key exchange and an AEAD cipher the ready callback is
+ * called as soon as the client's Finished message is sent, without
+ * waiting for the server's Finished, and data written from then on goes
+ * out in the same flight.  This saves one round-trip before the first
+ * application data reaches the server.  The server's Finished is still
+ * verified and its application data only accepted after that.  Must be
+ * called before l_tls_start.
+ */
+LIB_EXPORT bool l_tls_set_false_start(struct l_tls *tls, bool enabled)
+{
+	if (unlikely(!tls || tls->server))
+		return false;
+
+	tls->false_start = enabled;
+	return true;
+}
+
+/**
+ * l_tls_set_record_size:
+ * @tls: TLS object being configured
+ * @mode: how to size the application data records
+ *
+ * A record can only be used by the peer once it has been received in
+ * full, so large records delay the first bytes of a response by several
+ * TCP segments while small records cost more overhead per byte.  In the
+ * default L_TLS_RECORD_SIZE_DYNAMIC mode the records fit one TCP segment
+ * at the connection start and after the connection has been idle, and
+ * grow to the maximum once a bulk transfer is under way.  The other modes
+ * pin one size.  Has no effect on records built by the kernel, see
+ * l_tls_set_ktls_fd.
+ */
+LIB_EXPORT bool l_tls_set_record_size(struct l_tls *tls,
+					enum l_tls_record_size mode)
+{
+	if (unlikely(!tls))
+		return false;
+
+	tls->record_size = mode;
+	return true;
+}
+
+/**
+ * l_tls_set_cert_store:
+ * @tls: TLS object being configured
+ * @store: store from l_cert_store_new or NULL.  Must remain valid until
+ *   this method is called with a different value.
+ *
+ * Trusts the certificates in @store in addition to those set with
+ * l_tls_set_cacert.  Only the certificates that issued one of the peer's
+ * certificates are looked up and used for each validation, so @store may
+ * be large, e.g. the system's CA directory.  In server mode the
+ * Certificate Request lists only the DNs of the l_tls_set_cacert
+ * certificates.
+ */
+LIB_EXPORT bool l_tls_set_cert_store(struct l_tls *tls,
+					struct l_cert_store *store)
+{
+	if (unlikely(!tls))
+		return false;
+
+	if (store && !l_key_is_supported(L_KEY_FEATURE_RESTRICT)) {
+		TLS_DEBUG("keyctl restrict support missing, "
+				"check kernel configuration");
+		return false;
+	}
+
+	tls->cert_store = store;
+	return true;
+}
+
+/**
+ * l_tls_set_crl_store:
+ * @tls: TLS object being configured
+ * @store: CRLs from l_crl_store_new or NULL.  Must remain valid until
+ *   this method is called with a different value.
+ *
+ * Rejects peer certificate chains in which a certificate is listed as
+ * revoked by a CRL in @store, see l_certchain_check_revocation.  The
+ * handshake fails with a certificate_revoked alert.
+ */
+LIB_EXPORT bool l_tls_set_crl_store(struct l_tls *tls,
+					struct l_crl_store *store)
+{
+	if (unlikely(!tls))
+		return false;
+
+	tls->crl_store = store;
+	return true;
+}
+
+/**
+ * l_tls_set_cert_verify_cache:
+ * @tls: TLS object being configured
+ * @cache: cache from l_cert_verify_cache_new or NULL.  Must remain valid
+ *   until this method is called with a different value.
+ *
+ * Remembers the signatures checked when validating the peer's
+ * certificate chain in @cache so that connections presenting the same
+ * certificates, or certificates issued by the same intermediates, are
+ * validated faster.
+ */
+LIB_EXPORT bool l_tls_set_cert_verify_cache(struct l_tls *tls,
+					struct l_cert_verify_cache *cache)
+{
+	if (unlikely(!tls))
+		return false;
+
+	tls->cert_verify_cache = cache;
+	return true;
+}
+
+/**
+ * l_tls_set_server_session_cache:
+ * @tls: TLS server object being configured
+ * @cache: cache from l_tls_session_cache_new or NULL to disable it.  Must
+ *   remain valid until this method is called with a different value.
+ *
+ * Same as l_tls_set_session_cache in server mode but with the sessions
+ * kept in @cache, which uses hashed lookups and evicts the least recently
+ * used sessions.  Can be persisted with l_tls_session_cache_save.
+ */
+LIB_EXPORT bool l_tls_set_server_session_cache(struct l_tls *tls,
+					struct l_tls_session_cache *cache)
+{
+	if (unlikely(!tls || !tls->server))
+		return false;
+
+	tls->session_cache = cache;
+	return true;
+}
+
 LIB_EXPORT bool l_tls_get_session_resumed(struct l_tls *tls)
 {
 	if (unlikely(!tls || !tls->ready))
@@ -3889,8 +6129,12 @@ LIB_EXPORT const char *l_tls_alert_to_str(enum l_tls_alert_desc desc)
 		return "user_canceled";
 	case TLS_ALERT_NO_RENEGOTIATION:
 		return "no_renegotiation";
+	case TLS_ALERT_MISSING_EXTENSION:
+		return "missing_extension";
 	case TLS_ALERT_UNSUPPORTED_EXTENSION:
 		return "unsupported_extension";
+	case TLS_ALERT_BAD_CERT_STATUS_RESPONSE:
+		return "bad_certificate_status_response";
 	}
 
 	return NULL;
@@ -3898,11 +6142,12 @@ LIB_EXPORT const char *l_tls_alert_to_str(enum l_tls_alert_desc desc)
 
 const char *tls_handshake_state_to_str(enum tls_handshake_state state)
 {
-	static char buf[100];
+	static __thread char buf[100];
 
 	switch (state) {
 	SWITCH_ENUM_TO_STR(TLS_HANDSHAKE_WAIT_START)
 	SWITCH_ENUM_TO_STR(TLS_HANDSHAKE_WAIT_HELLO)
+	SWITCH_ENUM_TO_STR(TLS_HANDSHAKE_WAIT_ENCRYPTED_EXTENSIONS)
 	SWITCH_ENUM_TO_STR(TLS_HANDSHAKE_WAIT_CERTIFICATE)
 	SWITCH_ENUM_TO_STR(TLS_HANDSHAKE_WAIT_KEY_EXCHANGE)
 	SWITCH_ENUM_TO_STR(TLS_HANDSHAKE_WAIT_HELLO_DONE)
@@ -16,14 +16,24 @@ enum l_tls_version {
 	L_TLS_V10 = ((3 << 8) | 1),
 	L_TLS_V11 = ((3 << 8) | 2),
 	L_TLS_V12 = ((3 << 8) | 3),
-	L_TLS_V13 = ((3 << 8) | 4),	/* Not supported */
+	L_TLS_V13 = ((3 << 8) | 4),	/* Client mode only */
 };
 
 struct l_tls;
 struct l_key;
+struct l_cert;
 struct l_certchain;
+struct l_cert_verify_cache;
+struct l_cert_store;
+struct l_crl_store;
 struct l_queue;
 struct l_settings;
+struct l_tls_ticket_keys;
+struct l_tls_session_cache;
+struct l_tls_ecdhe_key_cache;
+struct l_tls_key_pool;
+struct l_tls_ocsp_cache;
+struct iovec;
 
 enum l_tls_alert_desc {
 	TLS_ALERT_CLOSE_NOTIFY		= 0,
@@ -50,7 +60,21 @@ enum l_tls_alert_desc {
 	TLS_ALERT_INTERNAL_ERROR	= 80,
 	TLS_ALERT_USER_CANCELED		= 90,
 	TLS_ALERT_NO_RENEGOTIATION	= 100,
+	TLS_ALERT_MISSING_EXTENSION	= 109,
 	TLS_ALERT_UNSUPPORTED_EXTENSION	= 110,
+	TLS_ALERT_BAD_CERT_STATUS_RESPONSE = 113,
+};
+
+enum l_tls_record_size {
+	L_TLS_RECORD_SIZE_DYNAMIC,	/* Default, small first then ramp up */
+	L_TLS_RECORD_SIZE_SMALL,	/* Always fit one TCP segment */
+	L_TLS_RECORD_SIZE_MAX,		/* Always fill records up */
+};
+
+enum l_tls_ocsp_stapling {
+	L_TLS_OCSP_STAPLING_OFF,	/* Default, don't request a status */
+	L_TLS_OCSP_STAPLING_REQUEST,	/* Check the status if stapled */
+	L_TLS_OCSP_STAPLING_REQUIRE,	/* Fail without a good status */
 };
 
 typedef void (*l_tls_write_cb_t)(const uint8_t *data, size_t len,
@@ -61,6 +85,10 @@ typedef void (*l_tls_disconnect_cb_t)(enum l_tls_alert_desc reason,
 typedef void (*l_tls_debug_cb_t)(const char *str, void *user_data);
 typedef void (*l_tls_destroy_cb_t)(void *user_data);
 typedef void (*l_tls_session_update_cb_t)(void *user_data);
+typedef void (*l_tls_ocsp_fetch_cb_t)(struct l_tls_ocsp_cache *cache,
+					struct l_cert *cert, const char *url,
+					const uint8_t *request,
+					size_t request_len, void *user_data);
 
 /*
  * app_data_handler gets called with newly received decrypted data.
@@ -86,9 +114,11 @@ void l_tls_reset(struct l_tls *tls);
 
 /* Submit plaintext data to be encrypted and transmitted */
 void l_tls_write(struct l_tls *tls, const uint8_t *data, size_t len);
+void l_tls_writev(struct l_tls *tls, const struct iovec *iov, size_t iovcnt);
 
 /* Submit TLS payload from underlying transport to be decrypted */
 void l_tls_handle_rx(struct l_tls *tls, const uint8_t *data, size_t len);
+void l_tls_handle_rx_inplace(struct l_tls *tls, uint8_t *data, size_t len);
 
 /*
  * If peer is to be authenticated, supply the CA certificates.  On success
@@ -123,6 +153,57 @@ void l_tls_set_session_cache(struct l_tls *tls, struct l_settings *settings,
 				void *user_data);
 bool l_tls_get_session_resumed(struct l_tls *tls);
 
+struct l_tls_ticket_keys *l_tls_ticket_keys_new(const void *secret,
+						size_t secret_len,
+						uint64_t rotation_interval);
+void l_tls_ticket_keys_free(struct l_tls_ticket_keys *ticket_keys);
+bool l_tls_set_session_tickets(struct l_tls *tls,
+				struct l_tls_ticket_keys *ticket_keys);
+
+struct l_tls_session_cache *l_tls_session_cache_new(unsigned int max_sessions,
+							uint64_t lifetime);
+void l_tls_session_cache_free(struct l_tls_session_cache *cache);
+unsigned int l_tls_session_cache_get_size(struct l_tls_session_cache *cache);
+bool l_tls_session_cache_save(struct l_tls_session_cache *cache,
+				struct l_settings *settings,
+				const char *group_prefix);
+bool l_tls_session_cache_load(struct l_tls_session_cache *cache,
+				const struct l_settings *settings,
+				const char *group_prefix);
+bool l_tls_set_server_session_cache(struct l_tls *tls,
+					struct l_tls_session_cache *cache);
+
+struct l_tls_ecdhe_key_cache *l_tls_ecdhe_key_cache_new(uint64_t lifetime);
+void l_tls_ecdhe_key_cache_free(struct l_tls_ecdhe_key_cache *cache);
+bool l_tls_set_ecdhe_key_cache(struct l_tls *tls,
+				struct l_tls_ecdhe_key_cache *cache);
+
+struct l_tls_key_pool *l_tls_key_pool_new(unsigned int depth);
+void l_tls_key_pool_free(struct l_tls_key_pool *pool);
+bool l_tls_key_pool_add_group(struct l_tls_key_pool *pool,
+				uint16_t group_id);
+bool l_tls_set_key_pool(struct l_tls *tls, struct l_tls_key_pool *pool);
+
+struct l_tls_ocsp_cache *l_tls_ocsp_cache_new(l_tls_ocsp_fetch_cb_t fetch,
+						void *user_data,
+						l_tls_destroy_cb_t destroy);
+void l_tls_ocsp_cache_free(struct l_tls_ocsp_cache *cache);
+bool l_tls_ocsp_cache_add(struct l_tls_ocsp_cache *cache,
+				struct l_certchain *chain);
+bool l_tls_ocsp_cache_set_response(struct l_tls_ocsp_cache *cache,
+					struct l_cert *cert,
+					const uint8_t *response, size_t len);
+bool l_tls_set_ocsp_cache(struct l_tls *tls, struct l_tls_ocsp_cache *cache);
+bool l_tls_set_ocsp_stapling(struct l_tls *tls,
+				enum l_tls_ocsp_stapling mode);
+
+bool l_tls_set_false_start(struct l_tls *tls, bool enabled);
+bool l_tls_set_record_size(struct l_tls *tls, enum l_tls_record_size mode);
+bool l_tls_set_cert_verify_cache(struct l_tls *tls,
+				struct l_cert_verify_cache *cache);
+bool l_tls_set_cert_store(struct l_tls *tls, struct l_cert_store *store);
+bool l_tls_set_crl_store(struct l_tls *tls, struct l_crl_store *store);
+
 const char *l_tls_alert_to_str(enum l_tls_alert_desc desc);
 
 enum l_checksum_type;
@@ -130,6 +211,17 @@ enum l_checksum_type;
 bool l_tls_prf_get_bytes(struct l_tls *tls, bool use_master_secret,
 				const char *label, uint8_t *buf, size_t len);
 
+/*
+ * Kernel TLS offload.  With Tx offloaded the tx_handler gets the
+ * application data unencrypted and the application may also write, splice
+ * or sendfile to the socket directly.  With Rx offloaded
+ * l_tls_handle_ktls_rx replaces l_tls_handle_rx.
+ */
+bool l_tls_set_ktls_fd(struct l_tls *tls, int fd);
+bool l_tls_get_ktls_tx(struct l_tls *tls);
+bool l_tls_get_ktls_rx(struct l_tls *tls);
+void l_tls_handle_ktls_rx(struct l_tls *tls);
+
 bool l_tls_set_debug(struct l_tls *tls, l_tls_debug_cb_t function,
 			void *user_data, l_tls_destroy_cb_t destroy);
 bool l_tls_set_cert_dump_path(struct l_tls *tls, const char *path);
@@ -10,162 +10,481 @@
 #endif
 
 #define _GNU_SOURCE
+#include <stddef.h>
+#include <string.h>
 #include <limits.h>
 
 #include "uintset.h"
 #include "useful.h"
 #include "private.h"
 
-#define BITS_PER_LONG (sizeof(unsigned long) * 8)
+/*
+ * The set is a tree of 64-way nodes.  Leaves hold 64 words of 64 bits and
+ * each node keeps two summary masks with a bit per slot: one for slots that
+ * contain any number and one for slots that are completely populated.
+ * Searching for the first used or unused number only follows the summary
+ * masks, so it costs one step per level, and there are at most five levels
+ * for a 32-bit range.  Subtrees with no numbers in them are not allocated.
+ * A set whose range fits in a single leaf only allocates the words of that
+ * leaf that the range covers, the slots past them are never accessed.
+ */
+#define NODE_SHIFT	6
+#define NODE_SLOTS	(1U << NODE_SHIFT)
+#define MAX_HEIGHT	4
+
+struct uintset_node {
+	uint64_t full;
+	uint64_t nonempty;
+	union {
+		struct uintset_node *children[NODE_SLOTS];
+		uint64_t words[NODE_SLOTS];
+	};
+};
 
-static inline int __ffz(unsigned long word)
+/* Number of bits covered by each slot of a node at @level */
+static inline unsigned int slot_shift(unsigned int level)
 {
-	return __builtin_ctzl(~word);
+	return NODE_SHIFT * (level + 1);
 }
 
-static inline int __fls(unsigned long word)
+/* Number of bits covered by a node at @level */
+static inline uint64_t node_span(unsigned int level)
 {
-	return word ? sizeof(word) * 8 - __builtin_clzl(word) : 0;
+	return 1ULL << (NODE_SHIFT * (level + 2));
 }
 
-static inline int __ffs(unsigned long word)
+static inline uint64_t slot_offset(uint64_t bit, unsigned int level)
 {
-	return __builtin_ctzl(word);
+	return bit & ((1ULL << slot_shift(level)) - 1);
 }
 
-static unsigned long find_first_zero_bit(const unsigned long *addr,
-							unsigned long size,
-							unsigned long start)
+/* Mask of the slots after @slot */
+static inline uint64_t slots_after(unsigned int slot)
 {
-	unsigned long i;
-	unsigned long mask = ~0UL << (start & (BITS_PER_LONG - 1));
-	unsigned long p;
+	return slot + 1 < NODE_SLOTS ? ~0ULL << (slot + 1) : 0;
+}
+
+static size_t node_size(unsigned int level, unsigned int words)
+{
+	if (level)
+		return sizeof(struct uintset_node);
+
+	return offsetof(struct uintset_node, words) + words * sizeof(uint64_t);
+}
+
+static struct uintset_node *node_new(unsigned int level, unsigned int words)
+{
+	size_t size = node_size(level, words);
+	struct uintset_node *node = l_malloc(size);
+
+	memset(node, 0, size);
+	return node;
+}
+
+static void node_free(struct uintset_node *node, unsigned int level)
+{
+	uint64_t mask;
+
+	if (!node)
+		return;
+
+	for (mask = node->nonempty; level && mask; mask &= mask - 1)
+		node_free(node->children[__builtin_ctzll(mask)], level - 1);
 
-	for (i = start / BITS_PER_LONG; i * BITS_PER_LONG < size; i++) {
-		p = addr[i];
+	l_free(node);
+}
 
-		if (mask) {
-			p |= ~mask;
-			mask = 0;
-		}
+static struct uintset_node *node_clone(const struct uintset_node *node,
+					unsigned int level, unsigned int words)
+{
+	struct uintset_node *clone;
+	uint64_t mask;
+	unsigned int slot;
 
-		if (p == ~0UL)
-			continue;
+	if (!node)
+		return NULL;
 
-		return i * BITS_PER_LONG + __ffz(p);
+	clone = l_memdup(node, node_size(level, words));
+
+	for (mask = node->nonempty; level && mask; mask &= mask - 1) {
+		slot = __builtin_ctzll(mask);
+		clone->children[slot] = node_clone(node->children[slot],
+							level - 1, words);
 	}
 
-	return size;
+	return clone;
 }
 
-static unsigned long find_first_bit(const unsigned long *addr,
-							unsigned long size)
+static uint64_t node_count(const struct uintset_node *node,
+							unsigned int level)
 {
-	unsigned long result = 0;
-	unsigned long tmp;
+	uint64_t count = 0;
+	uint64_t mask;
+	unsigned int slot;
 
-	while (size >= BITS_PER_LONG) {
-		tmp = *addr;
-		addr += 1;
+	for (mask = node ? node->nonempty : 0; mask; mask &= mask - 1) {
+		slot = __builtin_ctzll(mask);
 
-		if (tmp)
-			goto found;
+		if (!level)
+			count += __builtin_popcountll(node->words[slot]);
+		else
+			count += node_count(node->children[slot], level - 1);
+	}
+
+	return count;
+}
 
-		result += BITS_PER_LONG;
-		size -= BITS_PER_LONG;
+/* Returns true if @bit was not in the set yet */
+static bool node_put(struct uintset_node **nodep, unsigned int level,
+					unsigned int words, uint64_t bit)
+{
+	struct uintset_node *node = *nodep;
+	unsigned int slot = bit >> slot_shift(level);
+	bool added;
+	bool full;
+
+	if (!node)
+		node = *nodep = node_new(level, words);
+
+	if (!level) {
+		uint64_t mask = 1ULL << (bit % 64);
+
+		added = !(node->words[slot] & mask);
+		node->words[slot] |= mask;
+		full = node->words[slot] == ~0ULL;
+	} else {
+		struct uintset_node **child = &node->children[slot];
+
+		added = node_put(child, level - 1, words,
+						slot_offset(bit, level));
+		full = (*child)->full == ~0ULL;
 	}
 
-	if (!size)
-		return result;
+	node->nonempty |= 1ULL << slot;
 
-	tmp = *addr;
-	if (!tmp)
-		return result + size;
+	if (full)
+		node->full |= 1ULL << slot;
 
-found:
-	return result + __ffs(tmp);
+	return added;
 }
 
-static unsigned long find_last_bit(const unsigned long *addr, unsigned int size)
+/* Returns true if @bit was in the set, frees nodes that become empty */
+static bool node_take(struct uintset_node **nodep, unsigned int level,
+								uint64_t bit)
 {
-	unsigned long words;
-	unsigned long tmp;
-	long i;
+	struct uintset_node *node = *nodep;
+	unsigned int slot = bit >> slot_shift(level);
+	bool removed;
+	bool empty;
+
+	if (!node)
+		return false;
+
+	if (!level) {
+		uint64_t mask = 1ULL << (bit % 64);
 
-	/* Bits out of bounds are always zero, start at last word */
-	words = (size + BITS_PER_LONG - 1) / BITS_PER_LONG;
+		removed = node->words[slot] & mask;
+		node->words[slot] &= ~mask;
+		empty = !node->words[slot];
+	} else {
+		struct uintset_node **child = &node->children[slot];
 
-	for (i = words - 1; i >= 0; i -= 1) {
-		tmp = addr[i];
+		removed = node_take(child, level - 1, slot_offset(bit, level));
+		empty = !*child;
+	}
+
+	node->full &= ~(1ULL << slot);
 
-		if (!tmp)
-			continue;
+	if (empty)
+		node->nonempty &= ~(1ULL << slot);
 
-		return i * BITS_PER_LONG + __fls(tmp) - 1;
+	if (!node->nonempty) {
+		l_free(node);
+		*nodep = NULL;
 	}
 
-	/* Not found */
-	return size;
+	return removed;
 }
 
-static unsigned long find_next_bit(const unsigned long *addr,
-							unsigned long size,
-							unsigned long bit)
+static bool node_contains(const struct uintset_node *node,
+					unsigned int level, uint64_t bit)
 {
-	unsigned long mask;
-	unsigned long offset;
+	unsigned int slot;
 
-	if (bit >= size)
-		return size;
+	for (; node; level--) {
+		slot = bit >> slot_shift(level);
 
-	addr += bit / BITS_PER_LONG;
-	offset = bit % BITS_PER_LONG;
-	bit -= offset;
+		if (!level)
+			return node->words[slot] & (1ULL << (bit % 64));
 
-	if (offset) {
-		mask = *addr & ~(~0UL >> (BITS_PER_LONG - offset));
-		if (mask)
-			return bit + __ffs(mask);
+		if (node->full & (1ULL << slot))
+			return true;
 
-		bit += BITS_PER_LONG;
-		addr++;
+		node = node->children[slot];
+		bit = slot_offset(bit, level);
 	}
 
-	for (size -= bit; size >= BITS_PER_LONG;
-			size -= BITS_PER_LONG, bit += BITS_PER_LONG, addr++) {
-		if (!*addr)
-			continue;
+	return false;
+}
 
-		return bit + __ffs(*addr);
+/* First number at or after @start, or node_span(level) if there is none */
+static uint64_t node_find_next(const struct uintset_node *node,
+					unsigned int level, uint64_t start)
+{
+	unsigned int shift = slot_shift(level);
+	unsigned int slot = start >> shift;
+	uint64_t candidates;
+	uint64_t r;
+
+	if (!node)
+		return node_span(level);
+
+	if (!level) {
+		uint64_t word = node->words[slot] & (~0ULL << (start % 64));
+
+		if (word)
+			return slot * 64 + __builtin_ctzll(word);
+	} else if (node->nonempty & (1ULL << slot)) {
+		r = node_find_next(node->children[slot], level - 1,
+					slot_offset(start, level));
+		if (r < node_span(level - 1))
+			return ((uint64_t) slot << shift) + r;
 	}
 
-	if (!size)
-		return bit;
+	candidates = node->nonempty & slots_after(slot);
+	if (!candidates)
+		return node_span(level);
 
-	mask = *addr & (~0UL >> (BITS_PER_LONG - size));
-	if (mask)
-		bit += __ffs(mask);
-	else
-		bit += size;
+	slot = __builtin_ctzll(candidates);
+
+	if (!level)
+		return slot * 64 + __builtin_ctzll(node->words[slot]);
+
+	return ((uint64_t) slot << shift) +
+			node_find_next(node->children[slot], level - 1, 0);
+}
+
+/* First number missing at or after @start, or node_span(level) */
+static uint64_t node_find_next_unused(const struct uintset_node *node,
+					unsigned int level, uint64_t start)
+{
+	unsigned int shift = slot_shift(level);
+	unsigned int slot = start >> shift;
+	uint64_t candidates;
+	uint64_t r;
+
+	if (!node)
+		return start;
+
+	if (!level) {
+		uint64_t word = node->words[slot] |
+					~(~0ULL << (start % 64));
+
+		if (word != ~0ULL)
+			return slot * 64 + __builtin_ctzll(~word);
+	} else if (!(node->full & (1ULL << slot))) {
+		r = node_find_next_unused(node->children[slot], level - 1,
+						slot_offset(start, level));
+		if (r < node_span(level - 1))
+			return ((uint64_t) slot << shift) + r;
+	}
+
+	candidates = ~node->full & slots_after(slot);
+	if (!candidates)
+		return node_span(level);
+
+	slot = __builtin_ctzll(candidates);
+
+	/* Empty slots may lie past the words allocated for a short leaf */
+	if (!(node->nonempty & (1ULL << slot)))
+		return (uint64_t) slot << shift;
+
+	if (!level)
+		return slot * 64 + __builtin_ctzll(~node->words[slot]);
+
+	return ((uint64_t) slot << shift) +
+			node_find_next_unused(node->children[slot],
+						level - 1, 0);
+}
+
+static uint64_t node_find_last(const struct uintset_node *node,
+							unsigned int level)
+{
+	unsigned int slot = 63 - __builtin_clzll(node->nonempty);
+
+	if (!level)
+		return slot * 64 + 63 - __builtin_clzll(node->words[slot]);
+
+	return ((uint64_t) slot << slot_shift(level)) +
+			node_find_last(node->children[slot], level - 1);
+}
+
+static struct uintset_node *leaf_finish(struct uintset_node *leaf,
+							unsigned int words)
+{
+	unsigned int i;
+
+	for (i = 0; i < words; i++) {
+		leaf->nonempty |= (uint64_t) !!leaf->words[i] << i;
+		leaf->full |= (uint64_t) (leaf->words[i] == ~0ULL) << i;
+	}
+
+	if (leaf->nonempty)
+		return leaf;
+
+	l_free(leaf);
+	return NULL;
+}
+
+static void node_set_child(struct uintset_node *node, unsigned int slot,
+					struct uintset_node *child)
+{
+	if (!child)
+		return;
+
+	node->children[slot] = child;
+	node->nonempty |= 1ULL << slot;
+
+	if (child->full == ~0ULL)
+		node->full |= 1ULL << slot;
+}
+
+static struct uintset_node *node_intersect(const struct uintset_node *a,
+						const struct uintset_node *b,
+						unsigned int level,
+						unsigned int words)
+{
+	struct uintset_node *r;
+	uint64_t mask;
+	unsigned int slot;
+	unsigned int i;
+
+	if (!a || !b)
+		return NULL;
+
+	r = node_new(level, words);
+
+	/* Plain loops over the whole leaf so that they get vectorized */
+	if (!level) {
+		for (i = 0; i < words; i++)
+			r->words[i] = a->words[i] & b->words[i];
+
+		return leaf_finish(r, words);
+	}
+
+	for (mask = a->nonempty & b->nonempty; mask; mask &= mask - 1) {
+		slot = __builtin_ctzll(mask);
+
+		if (a->full & (1ULL << slot))
+			node_set_child(r, slot,
+					node_clone(b->children[slot],
+							level - 1, words));
+		else if (b->full & (1ULL << slot))
+			node_set_child(r, slot,
+					node_clone(a->children[slot],
+							level - 1, words));
+		else
+			node_set_child(r, slot,
+					node_intersect(a->children[slot],
+							b->children[slot],
+							level - 1, words));
+	}
+
+	if (r->nonempty)
+		return r;
+
+	l_free(r);
+	return NULL;
+}
+
+static struct uintset_node *node_subtract(const struct uintset_node *a,
+						const struct uintset_node *b,
+						unsigned int level,
+						unsigned int words)
+{
+	struct uintset_node *r;
+	uint64_t mask;
+	unsigned int slot;
+	unsigned int i;
+
+	if (!a || !b)
+		return node_clone(a, level, words);
+
+	r = node_new(level, words);
+
+	if (!level) {
+		for (i = 0; i < words; i++)
+			r->words[i] = a->words[i] & ~b->words[i];
 
-	return bit;
+		return leaf_finish(r, words);
+	}
+
+	for (mask = a->nonempty & ~b->full; mask; mask &= mask - 1) {
+		slot = __builtin_ctzll(mask);
+		node_set_child(r, slot, node_subtract(a->children[slot],
+							b->children[slot],
+							level - 1, words));
+	}
+
+	if (r->nonempty)
+		return r;
+
+	l_free(r);
+	return NULL;
 }
 
 struct l_uintset {
-	unsigned long *bits;
-	uint16_t size;
+	struct uintset_node *root;
+	uint64_t size;
+	uint64_t count;
 	uint32_t min;
 	uint32_t max;
+	unsigned int height;
+	unsigned int leaf_words;
 };
 
+/* First number at or after @start, or set->size */
+static uint64_t set_find_next(const struct l_uintset *set, uint64_t start)
+{
+	if (start >= set->size)
+		return set->size;
+
+	return minsize(node_find_next(set->root, set->height, start),
+								set->size);
+}
+
+static uint64_t set_find_next_unused(const struct l_uintset *set,
+							uint64_t start)
+{
+	if (start >= set->size)
+		return set->size;
+
+	return minsize(node_find_next_unused(set->root, set->height, start),
+								set->size);
+}
+
+static struct l_uintset *set_new_like(const struct l_uintset *set)
+{
+	struct l_uintset *ret = l_new(struct l_uintset, 1);
+
+	ret->size = set->size;
+	ret->min = set->min;
+	ret->max = set->max;
+	ret->height = set->height;
+	ret->leaf_words = set->leaf_words;
+
+	return ret;
+}
+
 /**
  * l_uintset_new_from_range:
  * @min: The minimum value of the set of numbers contained in the set
  * @max: The maximum value of the set of numbers contained
  *
- * Creates a new empty collection of unsigned integers.  The size of the set
- * is limited to roughly 2^16 entries.  @min and @max give the minimum and
- * maximum elements of the set.
+ * Creates a new empty collection of unsigned integers.  @min and @max give
+ * the minimum and maximum elements of the set.  Storage is only allocated
+ * for the parts of the range that contain numbers, so large and sparse
+ * ranges are cheap.
  *
  * Returns: A newly allocated l_uintset object, and NULL otherwise.
  **/
@@ -173,18 +492,23 @@ LIB_EXPORT struct l_uintset *l_uintset_new_from_range(uint32_t min,
 								uint32_t max)
 {
 	struct l_uintset *ret;
-	unsigned int size = max - min + 1;
 
-	if (size > USHRT_MAX)
+	if (unlikely(max < min))
 		return NULL;
 
 	ret = l_new(struct l_uintset, 1);
-	ret->bits = l_new(unsigned long,
-				(size + BITS_PER_LONG - 1) / BITS_PER_LONG);
-	ret->size = size;
+	ret->size = (uint64_t) max - min + 1;
 	ret->min = min;
 	ret->max = max;
 
+	while (ret->height < MAX_HEIGHT && node_span(ret->height) < ret->size)
+		ret->height++;
+
+	if (ret->height)
+		ret->leaf_words = NODE_SLOTS;
+	else
+		ret->leaf_words = (ret->size + 63) / 64;
+
 	return ret;
 }
 
@@ -192,9 +516,8 @@ LIB_EXPORT struct l_uintset *l_uintset_new_from_range(uint32_t min,
  * l_uintset_new:
  * @size: The maximum size of the set
  *
- * Creates a new empty collection of unsigned integers.  The size of the set
- * is limited to roughly 2^16 entries.  The set is created with minimum value
- * of 1 and maximum value equal to size.
+ * Creates a new empty collection of unsigned integers.  The set is created
+ * with minimum value of 1 and maximum value equal to size.
  *
  * Returns: A newly allocated l_uintset object, and NULL otherwise.
  **/
@@ -214,7 +537,7 @@ LIB_EXPORT void l_uintset_free(struct l_uintset *set)
 	if (unlikely(!set))
 		return;
 
-	l_free(set->bits);
+	node_free(set->root, set->height);
 	l_free(set);
 }
 
@@ -231,21 +554,17 @@ LIB_EXPORT void l_uintset_free(struct l_uintset *set)
  **/
 LIB_EXPORT bool l_uintset_take(struct l_uintset *set, uint32_t number)
 {
-	uint32_t offset;
+	uint32_t bit;
 
 	if (unlikely(!set))
 		return false;
 
-	offset = (number - set->min) / BITS_PER_LONG;
-
-	number -= set->min;
-
-	if (number > set->size)
+	bit = number - set->min;
+	if (bit >= set->size)
 		return false;
 
-	number %= BITS_PER_LONG;
-
-	set->bits[offset] &= ~(1UL << number);
+	if (node_take(&set->root, set->height, bit))
+		set->count--;
 
 	return true;
 }
@@ -265,7 +584,6 @@ LIB_EXPORT bool l_uintset_take(struct l_uintset *set, uint32_t number)
 LIB_EXPORT bool l_uintset_put(struct l_uintset *set, uint32_t number)
 {
 	uint32_t bit;
-	uint32_t offset;
 
 	if (unlikely(!set))
 		return false;
@@ -274,8 +592,8 @@ LIB_EXPORT bool l_uintset_put(struct l_uintset *set, uint32_t number)
 	if (bit >= set->size)
 		return false;
 
-	offset = bit / BITS_PER_LONG;
-	set->bits[offset] |= 1UL << (bit % BITS_PER_LONG);
+	if (node_put(&set->root, set->height, set->leaf_words, bit))
+		set->count++;
 
 	return true;
 }
@@ -290,7 +608,6 @@ LIB_EXPORT bool l_uintset_put(struct l_uintset *set, uint32_t number)
 LIB_EXPORT bool l_uintset_contains(struct l_uintset *set, uint32_t number)
 {
 	uint32_t bit;
-	uint32_t offset;
 
 	if (unlikely(!set))
 		return false;
@@ -299,11 +616,7 @@ LIB_EXPORT bool l_uintset_contains(struct l_uintset *set, uint32_t number)
 	if (bit >= set->size)
 		return false;
 
-	offset = bit / BITS_PER_LONG;
-	if (set->bits[offset] & (1UL << (bit % BITS_PER_LONG)))
-		return true;
-
-	return false;
+	return node_contains(set->root, set->height, bit);
 }
 
 /**
@@ -346,12 +659,12 @@ LIB_EXPORT uint32_t l_uintset_get_max(struct l_uintset *set)
  **/
 LIB_EXPORT uint32_t l_uintset_find_unused_min(struct l_uintset *set)
 {
-	unsigned int bit;
+	uint64_t bit;
 
 	if (unlikely(!set))
 		return UINT_MAX;
 
-	bit = find_first_zero_bit(set->bits, set->size, 0);
+	bit = set_find_next_unused(set, 0);
 
 	if (bit >= set->size)
 		return set->max + 1;
@@ -372,7 +685,7 @@ LIB_EXPORT uint32_t l_uintset_find_unused_min(struct l_uintset *set)
  **/
 LIB_EXPORT uint32_t l_uintset_find_unused(struct l_uintset *set, uint32_t start)
 {
-	unsigned int bit;
+	uint64_t bit;
 
 	if (unlikely(!set))
 		return UINT_MAX;
@@ -380,9 +693,9 @@ LIB_EXPORT uint32_t l_uintset_find_unused(struct l_uintset *set, uint32_t start)
 	if (start < set->min || start > set->max)
 		return set->max + 1;
 
-	bit = find_first_zero_bit(set->bits, set->size, start - set->min);
+	bit = set_find_next_unused(set, start - set->min);
 	if (bit >= set->size)
-		bit = find_first_zero_bit(set->bits, set->size, 0);
+		bit = set_find_next_unused(set, 0);
 
 	if (bit >= set->size)
 		return set->max + 1;
@@ -399,17 +712,13 @@ LIB_EXPORT uint32_t l_uintset_find_unused(struct l_uintset *set, uint32_t start)
  **/
 LIB_EXPORT uint32_t l_uintset_find_max(struct l_uintset *set)
 {
-	unsigned int bit;
-
 	if (unlikely(!set))
 		return UINT_MAX;
 
-	bit = find_last_bit(set->bits, set->size);
-
-	if (bit >= set->size)
+	if (!set->root)
 		return set->max + 1;
 
-	return bit + set->min;
+	return node_find_last(set->root, set->height) + set->min;
 }
 
 /**
@@ -421,12 +730,12 @@ LIB_EXPORT uint32_t l_uintset_find_max(struct l_uintset *set)
  **/
 LIB_EXPORT uint32_t l_uintset_find_min(struct l_uintset *set)
 {
-	unsigned int bit;
+	uint64_t bit;
 
 	if (unlikely(!set))
 		return UINT_MAX;
 
-	bit = find_first_bit(set->bits, set->size);
+	bit = set_find_next(set, 0);
 
 	if (bit >= set->size)
 		return set->max + 1;
@@ -446,13 +755,13 @@ LIB_EXPORT void l_uintset_foreach(const struct l_uintset *set,
 					l_uintset_foreach_func_t function,
 					void *user_data)
 {
-	unsigned int bit;
+	uint64_t bit;
 
 	if (unlikely(!set || !function))
 		return;
 
-	for (bit = find_first_bit(set->bits, set->size); bit < set->size;
-			bit = find_next_bit(set->bits, set->size, bit + 1))
+	for (bit = set_find_next(set, 0); bit < set->size;
+			bit = set_find_next(set, bit + 1))
 		function(set->min + bit, user_data);
 }
 
@@ -466,16 +775,14 @@ LIB_EXPORT void l_uintset_foreach(const struct l_uintset *set,
 LIB_EXPORT struct l_uintset *l_uintset_clone(const struct l_uintset *original)
 {
 	struct l_uintset *clone;
-	size_t bitmap_size;
 
 	if (unlikely(!original))
 		return NULL;
 
-	bitmap_size = sizeof(unsigned long) *
-		((original->size + BITS_PER_LONG - 1) / BITS_PER_LONG);
-
-	clone = l_uintset_new_from_range(original->min, original->max);
-	memcpy(clone->bits, original->bits, bitmap_size);
+	clone = set_new_like(original);
+	clone->root = node_clone(original->root, original->height,
+							original->leaf_words);
+	clone->count = original->count;
 
 	return clone;
 }
@@ -497,8 +804,6 @@ LIB_EXPORT struct l_uintset *l_uintset_intersect(const struct l_uintset *set_a,
 						const struct l_uintset *set_b)
 {
 	struct l_uintset *intersection;
-	uint32_t offset;
-	uint32_t offset_max;
 
 	if (unlikely(!set_a || !set_b))
 		return NULL;
@@ -506,13 +811,11 @@ LIB_EXPORT struct l_uintset *l_uintset_intersect(const struct l_uintset *set_a,
 	if (unlikely(set_a->min != set_b->min || set_a->max != set_b->max))
 		return NULL;
 
-	intersection = l_uintset_new_from_range(set_a->min, set_a->max);
-
-	offset_max = (set_a->size + BITS_PER_LONG - 1) / BITS_PER_LONG;
-
-	for (offset = 0; offset < offset_max; offset++)
-		intersection->bits[offset] =
-				set_a->bits[offset] & set_b->bits[offset];
+	intersection = set_new_like(set_a);
+	intersection->root = node_intersect(set_a->root, set_b->root,
+							set_a->height,
+							set_a->leaf_words);
+	intersection->count = node_count(intersection->root, set_a->height);
 
 	return intersection;
 }
@@ -532,8 +835,6 @@ LIB_EXPORT struct l_uintset *l_uintset_subtract(const struct l_uintset *set_a,
 						const struct l_uintset *set_b)
 {
 	struct l_uintset *subtraction;
-	uint32_t offset;
-	uint32_t offset_max;
 
 	if (unlikely(!set_a || !set_b))
 		return NULL;
@@ -541,15 +842,12 @@ LIB_EXPORT struct l_uintset *l_uintset_subtract(const struct l_uintset *set_a,
 	if (unlikely(set_a->min != set_b->min || set_a->max != set_b->max))
 		return NULL;
 
-	subtraction = l_uintset_new_from_range(set_a->min, set_a->max);
-
-	offset_max = (set_a->size + BITS_PER_LONG - 1) / BITS_PER_LONG;
-
 	/* Subtract by: set_a & ~set_b */
-	for (offset = 0; offset < offset_max; offset++) {
-		subtraction->bits[offset] =
-				set_a->bits[offset] & ~(set_b->bits[offset]);
-	}
+	subtraction = set_new_like(set_a);
+	subtraction->root = node_subtract(set_a->root, set_b->root,
+							set_a->height,
+							set_a->leaf_words);
+	subtraction->count = node_count(subtraction->root, set_a->height);
 
 	return subtraction;
 }
@@ -562,20 +860,10 @@ LIB_EXPORT struct l_uintset *l_uintset_subtract(const struct l_uintset *set_a,
  */
 LIB_EXPORT bool l_uintset_isempty(const struct l_uintset *set)
 {
-	uint16_t i;
-	uint32_t offset_max;
-
 	if (unlikely(!set))
 		return true;
 
-	offset_max = (set->size + BITS_PER_LONG - 1) / BITS_PER_LONG;
-
-	for (i = 0; i < offset_max; i++) {
-		if (set->bits[i])
-			return false;
-	}
-
-	return true;
+	return set->count == 0;
 }
 
 /**
@@ -587,17 +875,8 @@ LIB_EXPORT bool l_uintset_isempty(const struct l_uintset *set)
  */
 LIB_EXPORT uint32_t l_uintset_size(const struct l_uintset *set)
 {
-	uint16_t i;
-	uint32_t offset_max;
-	uint32_t count = 0;
-
 	if (unlikely(!set))
 		return 0;
 
-	offset_max = (set->size + BITS_PER_LONG - 1) / BITS_PER_LONG;
-
-	for (i = 0; i < offset_max; i++)
-		count += __builtin_popcountl(set->bits[i]);
-
-	return count;
+	return set->count;
 }
@@ -0,0 +1,22 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+struct uring;
+
+struct uring *uring_new(unsigned int entries);
+void uring_free(struct uring *ring);
+
+int uring_get_fd(struct uring *ring);
+
+int uring_poll_add(struct uring *ring, int fd, uint32_t events,
+					bool multishot, uint64_t user_data);
+int uring_poll_remove(struct uring *ring, uint64_t user_data);
+
+int uring_submit(struct uring *ring);
+int uring_wait(struct uring *ring, int timeout);
+bool uring_next_cqe(struct uring *ring, uint64_t *user_data, int32_t *res,
+								bool *more);
@@ -0,0 +1,371 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <endian.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#include "useful.h"
+#include "private.h"
+#include "uring-private.h"
+
+#ifdef HAVE_LINUX_IO_URING
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring wrapper used by the main loop.  Only the operations the
+ * watch layer needs are supported, which is why this does not depend on
+ * liburing.  A ring is owned by a single main loop and thus by a single
+ * thread.
+ */
+
+/* Multishot poll was added along with resource tags, in Linux 5.13 */
+#define URING_REQUIRED_FEATURES (IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | \
+				IORING_FEAT_POLL_32BITS | IORING_FEAT_RSRC_TAGS)
+
+struct uring {
+	int fd;
+	void *sq_map;
+	size_t sq_map_size;
+	void *cq_map;
+	size_t cq_map_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t *sq_array;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+	uint32_t sq_local_tail;
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+static int uring_enter(struct uring *ring, unsigned int to_submit,
+				unsigned int min_complete, unsigned int flags,
+				void *arg, size_t arg_size)
+{
+	long ret;
+
+	ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete,
+						flags, arg, arg_size);
+	if (ret < 0)
+		return -errno;
+
+	return ret;
+}
+
+static unsigned int uring_sq_pending(struct uring *ring)
+{
+	return ring->sq_local_tail - __atomic_load_n(ring->sq_head,
+							__ATOMIC_ACQUIRE);
+}
+
+static bool uring_cq_ready(struct uring *ring)
+{
+	return *ring->cq_head != __atomic_load_n(ring->cq_tail,
+							__ATOMIC_ACQUIRE);
+}
+
+struct uring *uring_new(unsigned int entries)
+{
+	struct io_uring_params params;
+	struct uring *ring;
+	void *sq_map;
+	size_t sq_size;
+	size_t cq_size;
+	uint32_t i;
+	int fd;
+
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+	params.cq_entries = entries * 4;
+
+	fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (fd < 0)
+		return NULL;
+
+	if ((params.features & URING_REQUIRED_FEATURES) !=
+						URING_REQUIRED_FEATURES) {
+		close(fd);
+		return NULL;
+	}
+
+	sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	cq_size = params.cq_off.cqes +
+			params.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		sq_size = cq_size = maxsize(sq_size, cq_size);
+
+	sq_map = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_map == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+
+	ring = l_new(struct uring, 1);
+	ring->fd = fd;
+	ring->sq_map = sq_map;
+	ring->sq_map_size = sq_size;
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_map = sq_map;
+	else {
+		ring->cq_map = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, fd,
+					IORING_OFF_CQ_RING);
+		if (ring->cq_map == MAP_FAILED)
+			goto fail;
+
+		ring->cq_map_size = cq_size;
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto fail;
+	}
+
+	ring->sq_head = sq_map + params.sq_off.head;
+	ring->sq_tail = sq_map + params.sq_off.tail;
+	ring->sq_array = sq_map + params.sq_off.array;
+	ring->sq_mask = *(uint32_t *) (sq_map + params.sq_off.ring_mask);
+	ring->sq_entries = *(uint32_t *) (sq_map + params.sq_off.ring_entries);
+	ring->sq_local_tail = *ring->sq_tail;
+
+	/* The SQ array is an identity mapping onto the SQE array */
+	for (i = 0; i < ring->sq_entries; i++)
+		ring->sq_array[i] = i;
+
+	ring->cq_head = ring->cq_map + params.cq_off.head;
+	ring->cq_tail = ring->cq_map + params.cq_off.tail;
+	ring->cq_mask = *(uint32_t *) (ring->cq_map + params.cq_off.ring_mask);
+	ring->cqes = ring->cq_map + params.cq_off.cqes;
+
+	return ring;
+
+fail:
+	if (ring->cq_map && ring->cq_map != MAP_FAILED &&
+						ring->cq_map != sq_map)
+		munmap(ring->cq_map, cq_size);
+
+	munmap(sq_map, sq_size);
+	close(fd);
+	l_free(ring);
+
+	return NULL;
+}
+
+void uring_free(struct uring *ring)
+{
+	if (!ring)
+		return;
+
+	munmap(ring->sqes, ring->sqes_size);
+
+	if (ring->cq_map != ring->sq_map)
+		munmap(ring->cq_map, ring->cq_map_size);
+
+	munmap(ring->sq_map, ring->sq_map_size);
+	close(ring->fd);
+	l_free(ring);
+}
+
+int uring_get_fd(struct uring *ring)
+{
+	return ring->fd;
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct uring *ring)
+{
+	struct io_uring_sqe *sqe;
+
+	/* Make room by handing the queued entries to the kernel */
+	if (uring_sq_pending(ring) >= ring->sq_entries &&
+				(uring_submit(ring) < 0 ||
+				uring_sq_pending(ring) >= ring->sq_entries))
+		return NULL;
+
+	sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_local_tail += 1;
+
+	return sqe;
+}
+
+int uring_poll_add(struct uring *ring, int fd, uint32_t events,
+					bool multishot, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(ring);
+
+	if (!sqe)
+		return -EBUSY;
+
+	/* Trigger mode is selected with command flags, not with events */
+	events &= ~(EPOLLET | EPOLLONESHOT);
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+	events = (events << 16) | (events >> 16);
+#endif
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = events;
+	sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+	sqe->user_data = user_data;
+
+	return 0;
+}
+
+int uring_poll_remove(struct uring *ring, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(ring);
+
+	if (!sqe)
+		return -EBUSY;
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = user_data;
+	sqe->user_data = 0;
+
+	return 0;
+}
+
+int uring_submit(struct uring *ring)
+{
+	unsigned int pending = uring_sq_pending(ring);
+	int err;
+
+	if (!pending)
+		return 0;
+
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+	err = uring_enter(ring, pending, 0, 0, NULL, 0);
+	if (err < 0 && err != -EINTR)
+		return err;
+
+	return 0;
+}
+
+/*
+ * Submits everything that was queued and waits up to @timeout milliseconds
+ * for a completion, like epoll_wait() does.  A negative timeout waits for
+ * as long as it takes.
+ */
+int uring_wait(struct uring *ring, int timeout)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int pending = uring_sq_pending(ring);
+	unsigned int min_complete = 1;
+	int err;
+
+	if (!timeout || uring_cq_ready(ring)) {
+		if (!pending)
+			return 0;
+
+		min_complete = 0;
+	}
+
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+	memset(&arg, 0, sizeof(arg));
+
+	if (min_complete && timeout > 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000LL;
+		arg.ts = (uint64_t) (uintptr_t) &ts;
+	}
+
+	err = uring_enter(ring, pending, min_complete,
+				IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+				&arg, sizeof(arg));
+	if (err < 0 && err != -ETIME && err != -EINTR)
+		return err;
+
+	return 0;
+}
+
+bool uring_next_cqe(struct uring *ring, uint64_t *user_data, int32_t *res,
+								bool *more)
+{
+	struct io_uring_cqe *cqe;
+	uint32_t head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return false;
+
+	cqe = &ring->cqes[head & ring->cq_mask];
+	*user_data = cqe->user_data;
+	*res = cqe->res;
+	*more = cqe->flags & IORING_CQE_F_MORE;
+
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+#else
+
+struct uring *uring_new(unsigned int entries)
+{
+	return NULL;
+}
+
+void uring_free(struct uring *ring)
+{
+}
+
+int uring_get_fd(struct uring *ring)
+{
+	return -1;
+}
+
+int uring_poll_add(struct uring *ring, int fd, uint32_t events,
+					bool multishot, uint64_t user_data)
+{
+	return -ENOTSUP;
+}
+
+int uring_poll_remove(struct uring *ring, uint64_t user_data)
+{
+	return -ENOTSUP;
+}
+
+int uring_submit(struct uring *ring)
+{
+	return -ENOTSUP;
+}
+
+int uring_wait(struct uring *ring, int timeout)
+{
+	return -ENOTSUP;
+}
+
+bool uring_next_cqe(struct uring *ring, uint64_t *user_data, int32_t *res,
+								bool *more)
+{
+	return false;
+}
+
+#endif
@@ -11,8 +11,13 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <wchar.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
 #include "strv.h"
 #include "utf8.h"
 #include "private.h"
@@ -179,6 +184,143 @@ error:
 	return -1;
 }
 
+/*
+ * Byte classes and transitions of a DFA accepting the well-formed UTF-8
+ * sequences of RFC 3629, i.e. without overlong forms, surrogates or values
+ * above U+10FFFF.  The rejecting state is 0 so that unlisted transitions
+ * reject.
+ */
+enum utf8_class {
+	UTF8_CLASS_ASCII = 0,
+	UTF8_CLASS_CONT_80,	/* 0x80 - 0x8f */
+	UTF8_CLASS_CONT_90,	/* 0x90 - 0x9f */
+	UTF8_CLASS_CONT_A0,	/* 0xa0 - 0xbf */
+	UTF8_CLASS_LEAD2,	/* 0xc2 - 0xdf */
+	UTF8_CLASS_E0,
+	UTF8_CLASS_LEAD3,	/* 0xe1 - 0xec, 0xee - 0xef */
+	UTF8_CLASS_ED,
+	UTF8_CLASS_F0,
+	UTF8_CLASS_LEAD4,	/* 0xf1 - 0xf3 */
+	UTF8_CLASS_F4,
+	UTF8_CLASS_INVALID,
+	__UTF8_CLASS_COUNT,
+};
+
+enum utf8_state {
+	UTF8_REJECT = 0,
+	UTF8_ACCEPT,
+	UTF8_NEED1,
+	UTF8_NEED2,
+	UTF8_NEED3,
+	UTF8_AFTER_E0,
+	UTF8_AFTER_ED,
+	UTF8_AFTER_F0,
+	UTF8_AFTER_F4,
+	__UTF8_STATE_COUNT,
+};
+
+static const uint8_t utf8_class[256] = {
+	[0x00 ... 0x7f] = UTF8_CLASS_ASCII,
+	[0x80 ... 0x8f] = UTF8_CLASS_CONT_80,
+	[0x90 ... 0x9f] = UTF8_CLASS_CONT_90,
+	[0xa0 ... 0xbf] = UTF8_CLASS_CONT_A0,
+	[0xc0 ... 0xc1] = UTF8_CLASS_INVALID,
+	[0xc2 ... 0xdf] = UTF8_CLASS_LEAD2,
+	[0xe0] = UTF8_CLASS_E0,
+	[0xe1 ... 0xec] = UTF8_CLASS_LEAD3,
+	[0xed] = UTF8_CLASS_ED,
+	[0xee ... 0xef] = UTF8_CLASS_LEAD3,
+	[0xf0] = UTF8_CLASS_F0,
+	[0xf1 ... 0xf3] = UTF8_CLASS_LEAD4,
+	[0xf4] = UTF8_CLASS_F4,
+	[0xf5 ... 0xff] = UTF8_CLASS_INVALID,
+};
+
+static const uint8_t utf8_transitions[__UTF8_STATE_COUNT]
+					[__UTF8_CLASS_COUNT] = {
+	[UTF8_ACCEPT] = {
+		[UTF8_CLASS_LEAD2] = UTF8_NEED1,
+		[UTF8_CLASS_E0] = UTF8_AFTER_E0,
+		[UTF8_CLASS_LEAD3] = UTF8_NEED2,
+		[UTF8_CLASS_ED] = UTF8_AFTER_ED,
+		[UTF8_CLASS_F0] = UTF8_AFTER_F0,
+		[UTF8_CLASS_LEAD4] = UTF8_NEED3,
+		[UTF8_CLASS_F4] = UTF8_AFTER_F4,
+	},
+	[UTF8_NEED1] = {
+		[UTF8_CLASS_CONT_80] = UTF8_ACCEPT,
+		[UTF8_CLASS_CONT_90] = UTF8_ACCEPT,
+		[UTF8_CLASS_CONT_A0] = UTF8_ACCEPT,
+	},
+	[UTF8_NEED2] = {
+		[UTF8_CLASS_CONT_80] = UTF8_NEED1,
+		[UTF8_CLASS_CONT_90] = UTF8_NEED1,
+		[UTF8_CLASS_CONT_A0] = UTF8_NEED1,
+	},
+	[UTF8_NEED3] = {
+		[UTF8_CLASS_CONT_80] = UTF8_NEED2,
+		[UTF8_CLASS_CONT_90] = UTF8_NEED2,
+		[UTF8_CLASS_CONT_A0] = UTF8_NEED2,
+	},
+	[UTF8_AFTER_E0] = {
+		[UTF8_CLASS_CONT_A0] = UTF8_NEED1,
+	},
+	[UTF8_AFTER_ED] = {
+		[UTF8_CLASS_CONT_80] = UTF8_NEED1,
+		[UTF8_CLASS_CONT_90] = UTF8_NEED1,
+	},
+	[UTF8_AFTER_F0] = {
+		[UTF8_CLASS_CONT_90] = UTF8_NEED2,
+		[UTF8_CLASS_CONT_A0] = UTF8_NEED2,
+	},
+	[UTF8_AFTER_F4] = {
+		[UTF8_CLASS_CONT_80] = UTF8_NEED2,
+	},
+};
+
+/*
+ * The DFA accepts the noncharacters U+FDD0 - U+FDEF and U+xFFFE - U+xFFFF,
+ * which valid_unicode() rejects.  They are all encoded with a lead byte of
+ * 0xef or above.
+ */
+static inline bool __attribute__ ((always_inline))
+			utf8_is_noncharacter(const uint8_t *seq)
+{
+	if (seq[0] == 0xef)
+		return (seq[1] == 0xb7 && seq[2] >= 0x90 && seq[2] <= 0xaf) ||
+			(seq[1] == 0xbf && seq[2] >= 0xbe);
+
+	if (seq[0] >= 0xf0)
+		return (seq[1] & 0x0f) == 0x0f && seq[2] == 0xbf &&
+			seq[3] >= 0xbe;
+
+	return false;
+}
+
+/* Returns the number of leading bytes of @s that are ASCII but not NUL */
+static size_t ascii_span(const uint8_t *s, size_t len)
+{
+	size_t i = 0;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+		int mask;
+
+		/* Sets the top bit of bytes that are either >= 0x80 or NUL */
+		v = _mm_or_si128(v, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		mask = _mm_movemask_epi8(v);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+
+	while (i < len && (int8_t) s[i] > 0)
+		i++;
+
+	return i;
+}
+
 /**
  * l_utf8_validate:
  * @str: a pointer to character data
@@ -194,20 +336,29 @@ error:
  **/
 LIB_EXPORT bool l_utf8_validate(const char *str, size_t len, const char **end)
 {
+	const uint8_t *s = (const uint8_t *) str;
 	size_t pos = 0;
-	int ret;
-	wchar_t val;
+	size_t start;
+	uint8_t state;
 
-	while (pos < len && str[pos]) {
-		ret = l_utf8_get_codepoint(str + pos, len - pos, &val);
+	while (pos < len) {
+		pos += ascii_span(s + pos, len - pos);
+		if (pos == len || !s[pos])
+			break;
 
-		if (ret < 0)
-			goto error;
+		start = pos;
+		state = UTF8_ACCEPT;
 
-		pos += ret;
+		do {
+			state = utf8_transitions[state][utf8_class[s[pos++]]];
+		} while (state > UTF8_ACCEPT && pos < len);
+
+		if (state != UTF8_ACCEPT || utf8_is_noncharacter(s + start)) {
+			pos = start;
+			break;
+		}
 	}
 
-error:
 	if (end)
 		*end = str + pos;
 
@@ -257,22 +408,14 @@ static inline int __attribute__ ((always_inline))
 	return 4;
 }
 
-static inline uint16_t __attribute__ ((always_inline))
+static inline wchar_t __attribute__ ((always_inline))
 			surrogate_value(uint16_t h, uint16_t l)
 {
 	return 0x10000 + (h - 0xd800) * 0x400 + l - 0xdc00;
 }
 
-/*
- * l_utf8_from_wchar:
- * @c: a wide-character to convert
- * @out_buf: Buffer to write out to
- *
- * Assumes c is valid unicode and out_buf contains enough space for a single
- * utf8 character (maximum 4 bytes)
- * Returns: number of characters written
- */
-LIB_EXPORT size_t l_utf8_from_wchar(wchar_t c, char *out_buf)
+static inline size_t __attribute__ ((always_inline))
+			utf8_put(wchar_t c, char *out_buf)
 {
 	int len = utf8_length(c);
 	int i;
@@ -291,6 +434,108 @@ LIB_EXPORT size_t l_utf8_from_wchar(wchar_t c, char *out_buf)
 	return len;
 }
 
+/* Decodes a character from UTF-8 input that is known to be valid */
+static inline int __attribute__ ((always_inline))
+			utf8_get_valid(const uint8_t *s, wchar_t *cp)
+{
+	if (s[0] < 0x80) {
+		*cp = s[0];
+		return 1;
+	}
+
+	if (s[0] < 0xe0) {
+		*cp = ((s[0] & 0x1f) << 6) | (s[1] & 0x3f);
+		return 2;
+	}
+
+	if (s[0] < 0xf0) {
+		*cp = ((s[0] & 0x0f) << 12) | ((s[1] & 0x3f) << 6) |
+			(s[2] & 0x3f);
+		return 3;
+	}
+
+	*cp = ((s[0] & 0x07) << 18) | ((s[1] & 0x3f) << 12) |
+		((s[2] & 0x3f) << 6) | (s[3] & 0x3f);
+	return 4;
+}
+
+/*
+ * l_utf8_from_wchar:
+ * @c: a wide-character to convert
+ * @out_buf: Buffer to write out to
+ *
+ * Assumes c is valid unicode and out_buf contains enough space for a single
+ * utf8 character (maximum 4 bytes)
+ * Returns: number of characters written
+ */
+LIB_EXPORT size_t l_utf8_from_wchar(wchar_t c, char *out_buf)
+{
+	return utf8_put(c, out_buf);
+}
+
+/*
+ * Number of code units in @utf16 before the first NUL, up to @utf16_size
+ * bytes or without a limit if @utf16_size is negative.
+ */
+static size_t utf16_units(const void *utf16, ssize_t utf16_size)
+{
+	size_t max = utf16_size < 0 ? SIZE_MAX : (size_t) utf16_size / 2;
+	size_t i = 0;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	/* Unsized input may end right before an unmapped page */
+	if (utf16_size >= 0) {
+		for (; i + 8 <= max; i += 8) {
+			__m128i v = _mm_loadu_si128(utf16 + i * 2);
+			int mask;
+
+			mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v,
+							_mm_setzero_si128()));
+			if (mask)
+				return i + __builtin_ctz(mask) / 2;
+		}
+	}
+#endif
+
+	while (i < max && l_get_u16(utf16 + i * 2))
+		i++;
+
+	return i;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/*
+ * Returns the UTF-8 length of the 8 code units at @utf16, or 0 if any of
+ * them is a surrogate or possibly a noncharacter and needs a closer look.
+ * Each unit takes 3 bytes, less one if below 0x800 and another if ASCII.
+ */
+static inline size_t __attribute__ ((always_inline))
+			utf16_block_utf8_length(const void *utf16)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_loadu_si128(utf16);
+	__m128i below_80, below_800, sum;
+
+	if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(v,
+						_mm_set1_epi16((short) 0xd7ff)),
+						zero)) != 0xffff)
+		return 0;
+
+	below_80 = _mm_cmpeq_epi16(_mm_subs_epu16(v, _mm_set1_epi16(0x7f)),
+					zero);
+	below_800 = _mm_cmpeq_epi16(_mm_subs_epu16(v, _mm_set1_epi16(0x7ff)),
+					zero);
+	sum = _mm_add_epi16(below_80, below_800);
+
+	/* Horizontal sum of 8 values in -2..0 */
+	sum = _mm_madd_epi16(sum, _mm_set1_epi16(1));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+
+	return 24 + _mm_cvtsi128_si32(sum);
+}
+#endif
+
 /**
  * l_utf8_from_utf16:
  * @utf16: Array of UTF16 characters
@@ -304,70 +549,89 @@ LIB_EXPORT char *l_utf8_from_utf16(const void *utf16, ssize_t utf16_size)
 {
 	char *utf8;
 	size_t utf8_len = 0;
-	wchar_t high_surrogate = 0;
-	ssize_t i = 0;
+	size_t n_units;
+	size_t i;
 	uint16_t in;
 	wchar_t c;
 
 	if (unlikely(utf16_size % 2))
 		return NULL;
 
-	while (utf16_size < 0 || i < utf16_size) {
-		in = l_get_u16(utf16 + i);
+	n_units = utf16_units(utf16, utf16_size);
 
-		if (!in)
-			break;
+	/* Validate and compute the exact output size first */
+	for (i = 0; i < n_units;) {
+		size_t block_end = minsize(i + 8, n_units);
 
-		if (in >= 0xdc00 && in < 0xe000) {
-			if (high_surrogate)
-				c = surrogate_value(high_surrogate, in);
-			else
-				return NULL;
+#if defined(__x86_64__) && defined(__GNUC__)
+		if (block_end - i == 8) {
+			size_t len = utf16_block_utf8_length(utf16 + i * 2);
+
+			if (len) {
+				utf8_len += len;
+				i += 8;
+				continue;
+			}
+		}
+#endif
+
+		while (i < block_end) {
+			in = l_get_u16(utf16 + i++ * 2);
 
-			high_surrogate = 0;
-		} else {
-			if (high_surrogate)
+			if (in >= 0xdc00 && in < 0xe000)
 				return NULL;
 
 			if (in >= 0xd800 && in < 0xdc00) {
-				high_surrogate = in;
-				goto next;
-			}
+				uint16_t low;
 
-			c = in;
-		}
+				if (i == n_units)
+					return NULL;
 
-		if (!valid_unicode(c))
-			return NULL;
+				low = l_get_u16(utf16 + i++ * 2);
+				if (low < 0xdc00 || low >= 0xe000)
+					return NULL;
 
-		utf8_len += utf8_length(c);
-next:
-		i += 2;
-	}
+				c = surrogate_value(in, low);
+			} else
+				c = in;
 
-	if (high_surrogate)
-		return NULL;
+			if (!valid_unicode(c))
+				return NULL;
+
+			utf8_len += utf8_length(c);
+		}
+	}
 
 	utf8 = l_malloc(utf8_len + 1);
 	utf8_len = 0;
-	i = 0;
 
-	while (utf16_size < 0 || i < utf16_size) {
-		in = l_get_u16(utf16 + i);
+	for (i = 0; i < n_units;) {
+#if defined(__x86_64__) && defined(__GNUC__)
+		if (i + 8 <= n_units) {
+			__m128i v = _mm_loadu_si128(utf16 + i * 2);
+			__m128i high = _mm_and_si128(v,
+					_mm_set1_epi16((short) 0xff80));
+			int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(high,
+							_mm_setzero_si128()));
+
+			if (mask == 0xffff) {
+				_mm_storel_epi64((__m128i *) (utf8 + utf8_len),
+						_mm_packus_epi16(v, v));
+				utf8_len += 8;
+				i += 8;
+				continue;
+			}
+		}
+#endif
 
-		if (!in)
-			break;
+		in = l_get_u16(utf16 + i++ * 2);
 
-		if (in >= 0xd800 && in < 0xdc00) {
-			high_surrogate = in;
-			i += 2;
-			in = l_get_u16(utf16 + i);
-			c = surrogate_value(high_surrogate, in);
-		} else
+		if (in >= 0xd800 && in < 0xdc00)
+			c = surrogate_value(in, l_get_u16(utf16 + i++ * 2));
+		else
 			c = in;
 
-		utf8_len += l_utf8_from_wchar(c, utf8 + utf8_len);
-		i += 2;
+		utf8_len += utf8_put(c, utf8 + utf8_len);
 	}
 
 	utf8[utf8_len] = '\0';
@@ -375,58 +639,80 @@ next:
 	return utf8;
 }
 
+/*
+ * Number of UTF-16 code units needed for @len bytes of valid UTF-8: one
+ * for every character plus another for those encoded in 4 bytes.
+ */
+static size_t utf16_length(const uint8_t *s, size_t len)
+{
+	size_t n = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		n += ((s[i] & 0xc0) != 0x80) + (s[i] >= 0xf0);
+
+	return n;
+}
+
 /**
  * l_utf8_to_utf16:
  * @utf8: UTF8 formatted string
  * @out_size: The size in bytes of the converted utf16 string
  *
- * Converts a UTF8 formatted string to UTF16.  It is assumed that the string
- * is valid UTF8 and no sanity checking is performed.
+ * Converts a UTF8 formatted string to UTF16.
  *
  * Returns: A newly-allocated buffer containing UTF8 encoded string converted
- * to UTF16.  The UTF16 string will always be null terminated.
+ * to UTF16, or NULL if @utf8 is not valid UTF8.  The UTF16 string will always
+ * be null terminated.
  **/
 LIB_EXPORT void *l_utf8_to_utf16(const char *utf8, size_t *out_size)
 {
-	const char *c;
-	wchar_t wc;
-	int len;
+	const uint8_t *s = (const uint8_t *) utf8;
 	uint16_t *utf16;
 	size_t n_utf16;
+	size_t len;
+	size_t i;
+	wchar_t wc;
 
 	if (unlikely(!utf8))
 		return NULL;
 
-	c = utf8;
-	n_utf16 = 0;
+	len = strlen(utf8);
 
-	while (*c) {
-		len = l_utf8_get_codepoint(c, 4, &wc);
-		if (len < 0)
-			return NULL;
-
-		if (wc < 0x10000)
-			n_utf16 += 1;
-		else
-			n_utf16 += 2;
-
-		c += len;
-	}
+	if (!l_utf8_validate(utf8, len, NULL))
+		return NULL;
 
-	utf16 = l_malloc((n_utf16 + 1) * 2);
-	c = utf8;
+	utf16 = l_malloc((utf16_length(s, len) + 1) * 2);
 	n_utf16 = 0;
+	i = 0;
 
-	while (*c) {
-		len = l_utf8_get_codepoint(c, 4, &wc);
+	while (i < len) {
+#if defined(__x86_64__) && defined(__GNUC__)
+		if (i + 16 <= len) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+
+			if (!_mm_movemask_epi8(v)) {
+				__m128i zero = _mm_setzero_si128();
+
+				_mm_storeu_si128((__m128i *) (utf16 + n_utf16),
+						_mm_unpacklo_epi8(v, zero));
+				_mm_storeu_si128((__m128i *)
+							(utf16 + n_utf16 + 8),
+						_mm_unpackhi_epi8(v, zero));
+				n_utf16 += 16;
+				i += 16;
+				continue;
+			}
+		}
+#endif
+
+		i += utf8_get_valid(s + i, &wc);
 
 		if (wc >= 0x10000) {
-			utf16[n_utf16++] = (wc - 0x1000) / 0x400 + 0xd800;
-			utf16[n_utf16++] = (wc - 0x1000) % 0x400 + 0xdc00;
+			utf16[n_utf16++] = (wc - 0x10000) / 0x400 + 0xd800;
+			utf16[n_utf16++] = (wc - 0x10000) % 0x400 + 0xdc00;
 		} else
 			utf16[n_utf16++] = wc;
-
-		c += len;
 	}
 
 	utf16[n_utf16] = 0;
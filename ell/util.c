@@ -21,6 +21,8 @@
 #include "util.h"
 #include "useful.h"
 #include "private.h"
+#include "log-private.h"
+#include "memory-private.h"
 
 /**
  * SECTION:util
@@ -48,8 +50,12 @@ LIB_EXPORT void *l_malloc(size_t size)
 		void *ptr;
 
 		ptr = malloc(size);
-		if (ptr)
+		if (ptr) {
+			if (unlikely(memory_accounting_enabled()))
+				memory_account_add(ptr, size, -1);
+
 			return ptr;
+		}
 
 		fprintf(stderr, "%s:%s(): failed to allocate %zd bytes\n",
 					STRLOC, __func__, size);
@@ -75,11 +81,19 @@ LIB_EXPORT void *l_malloc(size_t size)
 LIB_EXPORT void *l_realloc(void *mem, size_t size)
 {
 	if (likely(size)) {
+		int tag = -1;
 		void *ptr;
 
+		if (unlikely(memory_accounting_enabled()) && mem)
+			tag = memory_account_take(mem);
+
 		ptr = realloc(mem, size);
-		if (ptr)
+		if (ptr) {
+			if (unlikely(memory_accounting_enabled()))
+				memory_account_add(ptr, size, tag);
+
 			return ptr;
+		}
 
 		fprintf(stderr, "%s:%s(): failed to re-allocate %zd bytes\n",
 					STRLOC, __func__, size);
@@ -121,6 +135,9 @@ LIB_EXPORT void *l_memdup(const void *mem, size_t size)
  **/
 LIB_EXPORT void l_free(void *ptr)
 {
+	if (unlikely(memory_accounting_enabled()) && ptr)
+		memory_account_take(ptr);
+
 	free(ptr);
 }
 
@@ -138,8 +155,12 @@ LIB_EXPORT char *l_strdup(const char *str)
 		char *tmp;
 
 		tmp = strdup(str);
-		if (tmp)
+		if (tmp) {
+			if (unlikely(memory_accounting_enabled()))
+				memory_account_add(tmp, strlen(tmp) + 1, -1);
+
 			return tmp;
+		}
 
 		fprintf(stderr, "%s:%s(): failed to allocate string\n",
 						STRLOC, __func__);
@@ -166,8 +187,12 @@ LIB_EXPORT char *l_strndup(const char *str, size_t max)
 		char *tmp;
 
 		tmp = strndup(str, max);
-		if (tmp)
+		if (tmp) {
+			if (unlikely(memory_accounting_enabled()))
+				memory_account_add(tmp, strlen(tmp) + 1, -1);
+
 			return tmp;
+		}
 
 		fprintf(stderr, "%s:%s(): failed to allocate string\n",
 						STRLOC, __func__);
@@ -202,6 +227,9 @@ LIB_EXPORT char *l_strdup_printf(const char *format, ...)
 		return NULL;
 	}
 
+	if (unlikely(memory_accounting_enabled()))
+		memory_account_add(str, len + 1, -1);
+
 	return str;
 }
 
@@ -227,6 +255,9 @@ LIB_EXPORT char *l_strdup_vprintf(const char *format, va_list args)
 		return NULL;
 	}
 
+	if (unlikely(memory_accounting_enabled()))
+		memory_account_add(str, len + 1, -1);
+
 	return str;
 }
 
@@ -668,6 +699,67 @@ LIB_EXPORT void l_util_debug(l_util_hexdump_func_t function, void *user_data,
 	free(str);
 }
 
+/**
+ * l_util_debug_ratelimited:
+ * @ratelimit: rate limiting state of the call site
+ * @function: debug function
+ * @user_data: user data for @function
+ * @format: format string
+ * @...: format arguments
+ *
+ * Like l_util_debug() but rate limited and collapsing repeats, as done by
+ * l_log_ratelimited_with_location().  This is meant for debug output on
+ * paths that may be hit for every packet received.
+ **/
+LIB_EXPORT void l_util_debug_ratelimited(struct l_log_ratelimit *ratelimit,
+				l_util_hexdump_func_t function, void *user_data,
+				const char *format, ...)
+{
+	unsigned int repeated;
+	unsigned int suppressed;
+	uint64_t now;
+	char buf[64];
+	va_list args;
+	char *str;
+	int len;
+
+	if (likely(!function))
+		return;
+
+	if (unlikely(!format))
+		return;
+
+	if (!log_ratelimit_begin(ratelimit, &now))
+		return;
+
+	va_start(args, format);
+	len = vasprintf(&str, format, args);
+	va_end(args);
+
+	if (unlikely(len < 0))
+		return;
+
+	if (!log_ratelimit_end(ratelimit, now, str, &repeated, &suppressed))
+		goto done;
+
+	if (repeated) {
+		snprintf(buf, sizeof(buf), "last message repeated %u times",
+								repeated);
+		function(buf, user_data);
+	}
+
+	if (suppressed) {
+		snprintf(buf, sizeof(buf), "%u messages suppressed",
+								suppressed);
+		function(buf, user_data);
+	}
+
+	function(str, user_data);
+
+done:
+	free(str);
+}
+
 /**
  * l_util_get_debugfs_path:
  *
@@ -312,6 +312,29 @@ char *l_strdup_printf(const char *format, ...)
 char *l_strdup_vprintf(const char *format, va_list args)
 			__attribute__((format(printf, 1, 0)));
 
+enum l_memory_tag {
+	L_MEMORY_TAG_OTHER = 0,
+	L_MEMORY_TAG_DBUS,
+	L_MEMORY_TAG_NETLINK,
+	L_MEMORY_TAG_TLS,
+	L_MEMORY_TAG_DHCP,
+	L_MEMORY_TAG_SETTINGS,
+};
+
+struct l_memory_stats {
+	size_t live_bytes;
+	size_t live_allocs;
+	size_t peak_bytes;
+	uint64_t total_allocs;
+};
+
+void l_memory_accounting_enable(void);
+bool l_memory_accounting_is_enabled(void);
+enum l_memory_tag l_memory_tag_push(enum l_memory_tag tag);
+void l_memory_tag_pop(enum l_memory_tag saved);
+bool l_memory_get_stats(enum l_memory_tag tag, struct l_memory_stats *out);
+const char *l_memory_tag_to_string(enum l_memory_tag tag);
+
 size_t l_strlcpy(char* dst, const char *src, size_t len);
 
 bool l_str_has_prefix(const char *str, const char *prefix);
@@ -338,6 +361,13 @@ void l_util_debug(l_util_hexdump_func_t function, void *user_data,
 						const char *format, ...)
 			__attribute__((format(printf, 3, 4)));
 
+struct l_log_ratelimit;
+
+void l_util_debug_ratelimited(struct l_log_ratelimit *ratelimit,
+				l_util_hexdump_func_t function, void *user_data,
+				const char *format, ...)
+			__attribute__((format(printf, 4, 5)));
+
 const char *l_util_get_debugfs_path(void);
 
 #define L_TFR(expression)                          \
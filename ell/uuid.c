@@ -128,7 +128,7 @@ LIB_EXPORT bool l_uuid_v4(uint8_t out_uuid[16])
 	if (unlikely(!out_uuid))
 		return false;
 
-	if (!l_getrandom(out_uuid, 16))
+	if (!l_getrandom_buffered(out_uuid, 16))
 		return false;
 
 	/*
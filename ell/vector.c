@@ -0,0 +1,525 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "vector.h"
+#include "private.h"
+#include "useful.h"
+
+/**
+ * SECTION:vector
+ * @short_description: Array backed vector support
+ *
+ * Array backed vector support
+ */
+
+#define VECTOR_MIN_SIZE 8
+
+/**
+ * l_vector:
+ *
+ * Opaque object representing the vector.  The pointers are kept in a
+ * circular array so that they can be added and removed at both ends in
+ * amortised constant time, while still being indexable.
+ */
+struct l_vector {
+	void **data;
+	unsigned int head;
+	unsigned int len;
+	unsigned int size;
+};
+
+static inline unsigned int vector_slot(const struct l_vector *vector,
+						unsigned int index)
+{
+	return (vector->head + index) & (vector->size - 1);
+}
+
+/* Copy the entries into @size slots, starting at slot 0 */
+static void vector_resize(struct l_vector *vector, unsigned int size)
+{
+	void **data = l_new(void *, size);
+	unsigned int first = minsize(vector->len, vector->size - vector->head);
+
+	if (vector->len) {
+		memcpy(data, vector->data + vector->head,
+						first * sizeof(void *));
+		memcpy(data + first, vector->data,
+				(vector->len - first) * sizeof(void *));
+	}
+
+	l_free(vector->data);
+	vector->data = data;
+	vector->head = 0;
+	vector->size = size;
+}
+
+static void vector_reserve(struct l_vector *vector)
+{
+	if (vector->len < vector->size)
+		return;
+
+	vector_resize(vector, vector->size ? vector->size * 2 :
+							VECTOR_MIN_SIZE);
+}
+
+/**
+ * l_vector_new:
+ * @size_hint: number of entries to reserve room for, or 0
+ *
+ * Create a new vector.
+ *
+ * No error handling is needed since. In case of real memory allocation
+ * problems abort() will be called.
+ *
+ * Returns: a newly allocated #l_vector object
+ **/
+LIB_EXPORT struct l_vector *l_vector_new(unsigned int size_hint)
+{
+	struct l_vector *vector;
+	unsigned int size = VECTOR_MIN_SIZE;
+
+	vector = l_new(struct l_vector, 1);
+
+	if (!size_hint)
+		return vector;
+
+	while (size < size_hint && size < 1U << 31)
+		size <<= 1;
+
+	vector_resize(vector, size);
+
+	return vector;
+}
+
+/**
+ * l_vector_destroy:
+ * @vector: vector object
+ * @destroy: destroy function
+ *
+ * Free vector and call @destroy on all remaining entries.
+ **/
+LIB_EXPORT void l_vector_destroy(struct l_vector *vector,
+				l_vector_destroy_func_t destroy)
+{
+	if (unlikely(!vector))
+		return;
+
+	l_vector_clear(vector, destroy);
+	l_free(vector->data);
+	l_free(vector);
+}
+
+/**
+ * l_vector_clear:
+ * @vector: vector object
+ * @destroy: destroy function
+ *
+ * Clear vector and call @destroy on all remaining entries.  The storage is
+ * kept for reuse.
+ **/
+LIB_EXPORT void l_vector_clear(struct l_vector *vector,
+				l_vector_destroy_func_t destroy)
+{
+	unsigned int i;
+
+	if (unlikely(!vector))
+		return;
+
+	if (destroy)
+		for (i = 0; i < vector->len; i++)
+			destroy(vector->data[vector_slot(vector, i)]);
+
+	vector->head = 0;
+	vector->len = 0;
+}
+
+/**
+ * l_vector_push_tail:
+ * @vector: vector object
+ * @data: pointer to data
+ *
+ * Adds @data pointer at the end of the vector.
+ *
+ * Returns: #true when data has been added and #false in case an invalid
+ *          @vector object has been provided
+ **/
+LIB_EXPORT bool l_vector_push_tail(struct l_vector *vector, void *data)
+{
+	if (unlikely(!vector))
+		return false;
+
+	vector_reserve(vector);
+	vector->data[vector_slot(vector, vector->len)] = data;
+	vector->len++;
+
+	return true;
+}
+
+/**
+ * l_vector_push_head:
+ * @vector: vector object
+ * @data: pointer to data
+ *
+ * Adds @data pointer at the start of the vector.
+ *
+ * Returns: #true when data has been added and #false in case an invalid
+ *          @vector object has been provided
+ **/
+LIB_EXPORT bool l_vector_push_head(struct l_vector *vector, void *data)
+{
+	if (unlikely(!vector))
+		return false;
+
+	vector_reserve(vector);
+	vector->head = (vector->head - 1) & (vector->size - 1);
+	vector->data[vector->head] = data;
+	vector->len++;
+
+	return true;
+}
+
+/**
+ * l_vector_pop_tail:
+ * @vector: vector object
+ *
+ * Removes the last element of the vector and returns it.
+ *
+ * Returns: data pointer to last element or #NULL in case of an empty vector
+ **/
+LIB_EXPORT void *l_vector_pop_tail(struct l_vector *vector)
+{
+	if (unlikely(!vector) || !vector->len)
+		return NULL;
+
+	vector->len--;
+
+	return vector->data[vector_slot(vector, vector->len)];
+}
+
+/**
+ * l_vector_pop_head:
+ * @vector: vector object
+ *
+ * Removes the first element of the vector and returns it.
+ *
+ * Returns: data pointer to first element or #NULL in case of an empty vector
+ **/
+LIB_EXPORT void *l_vector_pop_head(struct l_vector *vector)
+{
+	void *data;
+
+	if (unlikely(!vector) || !vector->len)
+		return NULL;
+
+	data = vector->data[vector->head];
+	vector->head = vector_slot(vector, 1);
+	vector->len--;
+
+	return data;
+}
+
+/**
+ * l_vector_peek_tail:
+ * @vector: vector object
+ *
+ * Peeks at the last element of the vector and returns it.
+ *
+ * Returns: data pointer to last element or #NULL in case of an empty vector
+ **/
+LIB_EXPORT void *l_vector_peek_tail(struct l_vector *vector)
+{
+	if (unlikely(!vector) || !vector->len)
+		return NULL;
+
+	return vector->data[vector_slot(vector, vector->len - 1)];
+}
+
+/**
+ * l_vector_peek_head:
+ * @vector: vector object
+ *
+ * Peeks at the first element of the vector and returns it.
+ *
+ * Returns: data pointer to first element or #NULL in case of an empty vector
+ **/
+LIB_EXPORT void *l_vector_peek_head(struct l_vector *vector)
+{
+	if (unlikely(!vector) || !vector->len)
+		return NULL;
+
+	return vector->data[vector->head];
+}
+
+/**
+ * l_vector_at:
+ * @vector: vector object
+ * @index: position of the element, counting from the head
+ *
+ * Returns: data pointer of the element at @index or #NULL if @index is out
+ *          of range
+ **/
+LIB_EXPORT void *l_vector_at(struct l_vector *vector, unsigned int index)
+{
+	if (unlikely(!vector) || index >= vector->len)
+		return NULL;
+
+	return vector->data[vector_slot(vector, index)];
+}
+
+/**
+ * l_vector_remove_at:
+ * @vector: vector object
+ * @index: position of the element, counting from the head
+ *
+ * Remove the element at @index, moving whichever side of the vector is
+ * shorter to close the gap.
+ *
+ * Returns: data pointer of the removed element or #NULL if @index is out
+ *          of range
+ **/
+LIB_EXPORT void *l_vector_remove_at(struct l_vector *vector,
+							unsigned int index)
+{
+	void *data;
+	unsigned int i;
+
+	if (unlikely(!vector) || index >= vector->len)
+		return NULL;
+
+	data = vector->data[vector_slot(vector, index)];
+
+	if (index < vector->len / 2) {
+		for (i = index; i > 0; i--)
+			vector->data[vector_slot(vector, i)] =
+				vector->data[vector_slot(vector, i - 1)];
+
+		vector->head = vector_slot(vector, 1);
+	} else {
+		for (i = index; i + 1 < vector->len; i++)
+			vector->data[vector_slot(vector, i)] =
+				vector->data[vector_slot(vector, i + 1)];
+	}
+
+	vector->len--;
+
+	return data;
+}
+
+/**
+ * l_vector_remove:
+ * @vector: vector object
+ * @data: pointer to data
+ *
+ * Remove the first element whose data pointer is @data.
+ *
+ * Returns: #true if @data was found and removed, #false otherwise
+ **/
+LIB_EXPORT bool l_vector_remove(struct l_vector *vector, void *data)
+{
+	unsigned int i;
+
+	if (unlikely(!vector))
+		return false;
+
+	for (i = 0; i < vector->len; i++) {
+		if (vector->data[vector_slot(vector, i)] != data)
+			continue;
+
+		l_vector_remove_at(vector, i);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * l_vector_find:
+ * @vector: vector object
+ * @function: match function
+ * @user_data: user data given to match function
+ *
+ * Finds the first element for which @function returns #true.
+ *
+ * Returns: data pointer of the element found or #NULL
+ **/
+LIB_EXPORT void *l_vector_find(struct l_vector *vector,
+				l_vector_match_func_t function,
+				const void *user_data)
+{
+	unsigned int i;
+	void *data;
+
+	if (unlikely(!vector || !function))
+		return NULL;
+
+	for (i = 0; i < vector->len; i++) {
+		data = vector->data[vector_slot(vector, i)];
+
+		if (function(data, user_data))
+			return data;
+	}
+
+	return NULL;
+}
+
+/**
+ * l_vector_foreach:
+ * @vector: vector object
+ * @function: callback function
+ * @user_data: user data given to callback function
+ *
+ * Call @function for every element of the vector, from head to tail.  The
+ * vector must not be modified from @function.
+ **/
+LIB_EXPORT void l_vector_foreach(struct l_vector *vector,
+				l_vector_foreach_func_t function,
+				void *user_data)
+{
+	unsigned int i;
+
+	if (unlikely(!vector || !function))
+		return;
+
+	for (i = 0; i < vector->len; i++)
+		function(vector->data[vector_slot(vector, i)], user_data);
+}
+
+/**
+ * l_vector_sort:
+ * @vector: vector object
+ * @function: compare function
+ * @user_data: user data given to compare function
+ *
+ * Sort the vector in place using @function.  The sort is stable.
+ *
+ * Returns: #true on success and #false in case of an invalid @vector or
+ *          @function
+ **/
+LIB_EXPORT bool l_vector_sort(struct l_vector *vector,
+				l_vector_compare_func_t function,
+				void *user_data)
+{
+	void **src, **dst, **tmp;
+	unsigned int width, start, mid, end, i, j, k;
+
+	if (unlikely(!vector || !function))
+		return false;
+
+	if (vector->len < 2)
+		return true;
+
+	/* Bottom-up merge sort, which needs the entries to start at slot 0 */
+	if (vector->head)
+		vector_resize(vector, vector->size);
+
+	src = vector->data;
+	dst = l_new(void *, vector->size);
+
+	for (width = 1; width < vector->len; width *= 2) {
+		for (start = 0; start < vector->len; start += 2 * width) {
+			mid = minsize(start + width, vector->len);
+			end = minsize(start + 2 * width, vector->len);
+
+			for (i = start, j = mid, k = start; k < end; k++) {
+				if (i < mid && (j >= end ||
+						function(src[i], src[j],
+							user_data) <= 0))
+					dst[k] = src[i++];
+				else
+					dst[k] = src[j++];
+			}
+		}
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	/* The sorted entries are in src, dst is the spare buffer */
+	l_free(dst);
+	vector->data = src;
+
+	return true;
+}
+
+/**
+ * l_vector_bsearch:
+ * @vector: vector object, sorted according to @function
+ * @key: key to search for
+ * @function: compare function, called with @key and an element
+ * @user_data: user data given to compare function
+ *
+ * Binary search a vector previously sorted with l_vector_sort() using a
+ * compatible compare function.
+ *
+ * Returns: data pointer of a matching element or #NULL
+ **/
+LIB_EXPORT void *l_vector_bsearch(struct l_vector *vector, const void *key,
+					l_vector_compare_func_t function,
+					void *user_data)
+{
+	unsigned int lo = 0;
+	unsigned int hi;
+	unsigned int mid;
+	void *data;
+	int r;
+
+	if (unlikely(!vector || !function))
+		return NULL;
+
+	hi = vector->len;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		data = vector->data[vector_slot(vector, mid)];
+		r = function(key, data, user_data);
+
+		if (!r)
+			return data;
+
+		if (r < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+/**
+ * l_vector_length:
+ * @vector: vector object
+ *
+ * Returns: entries of the vector
+ **/
+LIB_EXPORT unsigned int l_vector_length(struct l_vector *vector)
+{
+	if (unlikely(!vector))
+		return 0;
+
+	return vector->len;
+}
+
+/**
+ * l_vector_isempty:
+ * @vector: vector object
+ *
+ * Returns: #true if @vector is empty and #false is not
+ **/
+LIB_EXPORT bool l_vector_isempty(struct l_vector *vector)
+{
+	if (unlikely(!vector))
+		return true;
+
+	return vector->len == 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef __ELL_VECTOR_H
+#define __ELL_VECTOR_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*l_vector_foreach_func_t) (void *data, void *user_data);
+typedef void (*l_vector_destroy_func_t) (void *data);
+typedef int (*l_vector_compare_func_t) (const void *a, const void *b,
+							void *user_data);
+typedef bool (*l_vector_match_func_t) (const void *data,
+							const void *user_data);
+
+struct l_vector;
+
+struct l_vector *l_vector_new(unsigned int size_hint);
+void l_vector_destroy(struct l_vector *vector,
+			l_vector_destroy_func_t destroy);
+void l_vector_clear(struct l_vector *vector,
+			l_vector_destroy_func_t destroy);
+
+bool l_vector_push_tail(struct l_vector *vector, void *data);
+bool l_vector_push_head(struct l_vector *vector, void *data);
+void *l_vector_pop_tail(struct l_vector *vector);
+void *l_vector_pop_head(struct l_vector *vector);
+void *l_vector_peek_tail(struct l_vector *vector);
+void *l_vector_peek_head(struct l_vector *vector);
+
+void *l_vector_at(struct l_vector *vector, unsigned int index);
+void *l_vector_remove_at(struct l_vector *vector, unsigned int index);
+bool l_vector_remove(struct l_vector *vector, void *data);
+
+void *l_vector_find(struct l_vector *vector,
+			l_vector_match_func_t function,
+			const void *user_data);
+void l_vector_foreach(struct l_vector *vector,
+			l_vector_foreach_func_t function, void *user_data);
+
+bool l_vector_sort(struct l_vector *vector,
+			l_vector_compare_func_t function, void *user_data);
+void *l_vector_bsearch(struct l_vector *vector, const void *key,
+			l_vector_compare_func_t function, void *user_data);
+
+unsigned int l_vector_length(struct l_vector *vector);
+bool l_vector_isempty(struct l_vector *vector);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ELL_VECTOR_H */
@@ -0,0 +1,15 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+struct l_main_loop;
+
+typedef void (*work_func_t)(void *data);
+
+uint32_t work_submit(work_func_t func, work_func_t done, work_func_t destroy,
+			void *data);
+void *work_cancel(uint32_t id);
+void work_drain(struct l_main_loop *loop);
@@ -0,0 +1,301 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "useful.h"
+#include "private.h"
+#include "hashmap.h"
+#include "main.h"
+#include "main-private.h"
+#include "work-private.h"
+
+/*
+ * Pool of worker threads for blocking operations, such as the kernel
+ * keyring's public key operations, which can take milliseconds and would
+ * otherwise stall the event loop.  The threads are started on demand and
+ * never exit.  Each job runs @func on a worker, then @done and @destroy
+ * on the main loop of the thread that submitted it.  Job ids are per
+ * submitting thread and can only be cancelled from that thread.  A
+ * cancelled job still runs to completion on the worker, only @done is
+ * skipped.  l_main_exit waits for the jobs of its loop that are running
+ * and drops the queued ones.
+ */
+#define WORK_MAX_THREADS	4
+
+struct work_item {
+	uint32_t id;
+	work_func_t func;
+	work_func_t done;
+	work_func_t destroy;
+	void *data;
+	struct l_main_loop *loop;
+	struct work_item *next;
+};
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t running_cond = PTHREAD_COND_INITIALIZER;
+static struct work_item *queue_head;
+static struct work_item *queue_tail;
+static struct work_item *running;
+static unsigned int n_queued;
+static unsigned int n_threads;
+static unsigned int n_idle;
+static bool atfork_registered;
+
+static __thread struct l_hashmap *pending;
+static __thread uint32_t next_id;
+
+/* The workers don't survive fork(), neither do the jobs they'd have run */
+static void work_atfork_child(void)
+{
+	pthread_mutex_init(&queue_lock, NULL);
+	pthread_cond_init(&queue_cond, NULL);
+	pthread_cond_init(&running_cond, NULL);
+	queue_head = NULL;
+	queue_tail = NULL;
+	running = NULL;
+	n_queued = 0;
+	n_threads = 0;
+	n_idle = 0;
+}
+
+static struct work_item *pending_remove(uint32_t id)
+{
+	struct work_item *item = l_hashmap_remove(pending, L_UINT_TO_PTR(id));
+
+	if (pending && l_hashmap_isempty(pending)) {
+		l_hashmap_destroy(pending, NULL);
+		pending = NULL;
+	}
+
+	return item;
+}
+
+static void work_complete(void *user_data)
+{
+	struct work_item *item = user_data;
+
+	if (pending_remove(item->id) && item->done)
+		item->done(item->data);
+}
+
+static void work_item_free(void *user_data)
+{
+	struct work_item *item = user_data;
+
+	if (item->destroy)
+		item->destroy(item->data);
+
+	l_free(item);
+}
+
+static void running_unlink(struct work_item *item)
+{
+	struct work_item **p;
+
+	for (p = &running; *p != item; p = &(*p)->next)
+		;
+
+	*p = item->next;
+}
+
+static bool loop_has_running(struct l_main_loop *loop)
+{
+	struct work_item *item;
+
+	for (item = running; item; item = item->next)
+		if (item->loop == loop)
+			return true;
+
+	return false;
+}
+
+static void *work_thread(void *user_data)
+{
+	while (true) {
+		struct work_item *item;
+
+		pthread_mutex_lock(&queue_lock);
+
+		while (!queue_head) {
+			n_idle++;
+			pthread_cond_wait(&queue_cond, &queue_lock);
+			n_idle--;
+		}
+
+		item = queue_head;
+		queue_head = item->next;
+		n_queued--;
+
+		if (!queue_head)
+			queue_tail = NULL;
+
+		item->next = running;
+		running = item;
+		pthread_mutex_unlock(&queue_lock);
+
+		item->func(item->data);
+
+		pthread_mutex_lock(&queue_lock);
+		running_unlink(item);
+		l_main_invoke(item->loop, work_complete, item,
+				work_item_free);
+		pthread_cond_broadcast(&running_cond);
+		pthread_mutex_unlock(&queue_lock);
+	}
+
+	return NULL;
+}
+
+static bool work_thread_start(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int err;
+
+	/* Enough idle workers for the queued jobs plus the new one */
+	if (n_idle > n_queued || n_threads >=
+			minsize(maxsize(n_cpus, 1), WORK_MAX_THREADS))
+		return n_threads > 0;
+
+	if (!atfork_registered) {
+		if (pthread_atfork(NULL, NULL, work_atfork_child))
+			return n_threads > 0;
+
+		atfork_registered = true;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	err = pthread_create(&thread, &attr, work_thread, NULL);
+	pthread_attr_destroy(&attr);
+
+	if (!err)
+		n_threads++;
+
+	return n_threads > 0;
+}
+
+/*
+ * Runs @func(@data) on a worker thread.  Returns a job id, or 0 if the
+ * calling thread has no main loop or no worker could be started.
+ */
+uint32_t work_submit(work_func_t func, work_func_t done, work_func_t destroy,
+			void *data)
+{
+	struct l_main_loop *loop = main_loop_get();
+	struct work_item *item;
+
+	if (unlikely(!func || !loop))
+		return 0;
+
+	item = l_new(struct work_item, 1);
+	item->func = func;
+	item->done = done;
+	item->destroy = destroy;
+	item->data = data;
+	item->loop = loop;
+
+	pthread_mutex_lock(&queue_lock);
+
+	if (!work_thread_start()) {
+		pthread_mutex_unlock(&queue_lock);
+		l_free(item);
+		return 0;
+	}
+
+	if (!pending)
+		pending = l_hashmap_new();
+
+	do {
+		item->id = ++next_id;
+	} while (!item->id || l_hashmap_lookup(pending,
+						L_UINT_TO_PTR(item->id)));
+
+	l_hashmap_insert(pending, L_UINT_TO_PTR(item->id), item);
+
+	if (queue_tail)
+		queue_tail->next = item;
+	else
+		queue_head = item;
+
+	queue_tail = item;
+	n_queued++;
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&queue_lock);
+
+	return item->id;
+}
+
+/*
+ * Stops the completion callback for job @id from being called.  Returns
+ * the job's data, which is still passed to its destroy callback once the
+ * worker is done with it, or NULL if there's no such pending job.
+ */
+void *work_cancel(uint32_t id)
+{
+	struct work_item *item;
+
+	if (unlikely(!id || !pending))
+		return NULL;
+
+	item = pending_remove(id);
+	if (!item)
+		return NULL;
+
+	return item->data;
+}
+
+/* Called by l_main_exit before @loop goes away */
+void work_drain(struct l_main_loop *loop)
+{
+	struct work_item **p;
+	struct work_item *dropped = NULL;
+
+	pthread_mutex_lock(&queue_lock);
+
+	for (p = &queue_head; *p;) {
+		struct work_item *item = *p;
+
+		if (item->loop != loop) {
+			queue_tail = item;
+			p = &item->next;
+			continue;
+		}
+
+		*p = item->next;
+		n_queued--;
+		item->next = dropped;
+		dropped = item;
+	}
+
+	if (!queue_head)
+		queue_tail = NULL;
+
+	while (loop_has_running(loop))
+		pthread_cond_wait(&running_cond, &queue_lock);
+
+	pthread_mutex_unlock(&queue_lock);
+
+	while (dropped) {
+		struct work_item *item = dropped;
+
+		dropped = item->next;
+		pending_remove(item->id);
+		work_item_free(item);
+	}
+}
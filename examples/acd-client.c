@@ -74,12 +74,14 @@ static void usage(void)
 			"\t\tdefend: defend once (default)\n"
 			"\t\tinfinite: defend infinitely\n"
 		"\t-n, --no-probes       Disable initial probe stage\n"
+		"\t-p, --parallel-probes Use the address while probing\n"
 		"\t-d, --debug           Run with debugging on\n");
 }
 
 static const struct option main_options[] = {
 	{ "defend",	 optional_argument,	NULL, 'D' },
 	{ "no-probes",	 no_argument,		NULL, 'n' },
+	{ "parallel-probes", no_argument,	NULL, 'p' },
 	{ "debug",	 no_argument,		NULL, 'd' },
 	{ }
 };
@@ -89,7 +91,7 @@ int main(int argc, char *argv[])
 	struct l_acd *acd;
 	int ifindex;
 	bool debug = false;
-	bool no_probe = false;
+	enum l_acd_probe_mode probe_mode = L_ACD_PROBE_MODE_FULL;
 
 	l_log_set_stderr();
 	l_debug_enable("*");
@@ -102,7 +104,7 @@ int main(int argc, char *argv[])
 	for (;;) {
 		int opt;
 
-		opt = getopt_long(argc - 2, argv + 2, "ndD::",
+		opt = getopt_long(argc - 2, argv + 2, "npdD::",
 					main_options, NULL);
 		if (opt < 0)
 			break;
@@ -118,7 +120,10 @@ int main(int argc, char *argv[])
 
 			break;
 		case 'n':
-			no_probe = true;
+			probe_mode = L_ACD_PROBE_MODE_SKIP;
+			break;
+		case 'p':
+			probe_mode = L_ACD_PROBE_MODE_PARALLEL;
 			break;
 		case 'd':
 			debug = true;
@@ -132,7 +137,7 @@ int main(int argc, char *argv[])
 		return -1;
 
 	acd = l_acd_new(ifindex);
-	l_acd_set_skip_probes(acd, no_probe);
+	l_acd_set_probe_mode(acd, probe_mode);
 	l_acd_set_defend_policy(acd, policy);
 
 	if (debug) {
@@ -26,21 +26,49 @@ struct ell_event_source {
 
 static gboolean event_prepare(GSource *source, gint *timeout)
 {
-	int r = l_main_prepare();
-	*timeout = r;
+	uint64_t deadline;
+	uint64_t now;
 
+	if (!l_main_get_next_deadline(&deadline)) {
+		*timeout = -1;
+		return FALSE;
+	}
+
+	now = l_time_now();
+	if (deadline <= now) {
+		*timeout = 0;
+		return TRUE;
+	}
+
+	/* Round up so that the deadline has passed on wakeup */
+	*timeout = MIN((deadline - now + 999) / 1000, G_MAXINT);
 	return FALSE;
 }
 
 static gboolean event_check(GSource *source)
 {
-	l_main_iterate(0);
-	return FALSE;
+	struct ell_event_source *ell = (struct ell_event_source *) source;
+	uint64_t deadline;
+
+	if (ell->pollfd.revents)
+		return TRUE;
+
+	return l_main_get_next_deadline(&deadline) && deadline <= l_time_now();
+}
+
+static gboolean event_dispatch(GSource *source, GSourceFunc callback,
+							gpointer user_data)
+{
+	struct ell_event_source *ell = (struct ell_event_source *) source;
+
+	l_main_dispatch_ready(ell->pollfd.revents != 0);
+	return G_SOURCE_CONTINUE;
 }
 
 static GSourceFuncs event_funcs = {
 	.prepare = event_prepare,
 	.check = event_check,
+	.dispatch = event_dispatch,
 };
 
 static void do_debug(const char *str, void *user_data)
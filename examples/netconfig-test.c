@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <signal.h>
 #include <net/if.h>
@@ -25,6 +26,9 @@
 #include <ell/ell.h>
 
 static bool apply;
+static bool trace;
+static uint64_t trace_start;
+static uint64_t trace_last[2];
 
 static void do_debug(const char *str, void *user_data)
 {
@@ -89,6 +93,78 @@ static void log_routes(const char *af_str, const char *action,
 	}
 }
 
+static const char *trace_point_to_str(enum l_netconfig_trace_point point)
+{
+	switch (point) {
+	case L_NETCONFIG_TRACE_START:
+		return "start";
+	case L_NETCONFIG_TRACE_DHCP_DISCOVER:
+		return "dhcp-discover";
+	case L_NETCONFIG_TRACE_DHCP_OFFER:
+		return "dhcp-offer";
+	case L_NETCONFIG_TRACE_DHCP_ACK:
+		return "dhcp-ack";
+	case L_NETCONFIG_TRACE_ACD_DONE:
+		return "acd-done";
+	case L_NETCONFIG_TRACE_LINK_LOCAL:
+		return "link-local";
+	case L_NETCONFIG_TRACE_DAD_DONE:
+		return "dad-done";
+	case L_NETCONFIG_TRACE_ROUTER_FOUND:
+		return "router-found";
+	case L_NETCONFIG_TRACE_DHCP6_LEASE:
+		return "dhcp6-lease";
+	case L_NETCONFIG_TRACE_CONFIGURE:
+		return "configure";
+	}
+
+	return "unknown";
+}
+
+/*
+ * Latency breakdown: time since l_netconfig_start() and since the previous
+ * step of the same family
+ */
+static void trace_print(uint8_t family, const char *step, uint64_t timestamp)
+{
+	uint64_t *last = &trace_last[family == AF_INET6];
+
+	if (!*last)
+		*last = trace_start;
+
+	l_info("[trace%s] %-14s +%9.3f ms (step %9.3f ms)",
+		family == AF_INET ? "v4" : family == AF_INET6 ? "v6" : "  ",
+		step, l_time_diff(trace_start, timestamp) / 1000.0,
+		l_time_diff(*last, timestamp) / 1000.0);
+
+	*last = timestamp;
+}
+
+static void trace_handler(struct l_netconfig *netconfig, uint8_t family,
+				enum l_netconfig_trace_point point,
+				uint64_t timestamp, void *user_data)
+{
+	if (point == L_NETCONFIG_TRACE_START)
+		trace_start = timestamp;
+
+	trace_print(family, trace_point_to_str(point), timestamp);
+}
+
+static void apply_done(int error, void *user_data)
+{
+	const char *af_str = user_data;
+
+	if (trace)
+		trace_print(strcmp(af_str, "v4") ? AF_INET6 : AF_INET,
+				"applied", l_time_now());
+
+	if (error < 0)
+		l_info("[netconfig%s] Apply failed: %s", af_str,
+			strerror(-error));
+	else
+		l_info("[netconfig%s] Applied", af_str);
+}
+
 static void event_handler(struct l_netconfig *netconfig, uint8_t family,
 				enum l_netconfig_event event, void *user_data)
 {
@@ -125,21 +201,29 @@ static void event_handler(struct l_netconfig *netconfig, uint8_t family,
 	log_routes(af_str, "expired", expired);
 
 	if (apply)
-		l_netconfig_apply_rtnl(netconfig);
+		l_netconfig_apply_rtnl_full(netconfig, apply_done,
+						(void *) af_str, NULL);
 }
 
 static const struct option main_options[] = {
 	{ "apply",	 no_argument,		NULL, 'a' },
+	{ "trace",	 no_argument,		NULL, 't' },
+	{ "optimistic-dad", no_argument,	NULL, 'o' },
 	{ }
 };
 
 int main(int argc, char *argv[])
 {
 	struct l_netconfig *netconfig;
+	bool optimistic_dad = false;
 	int ifindex;
 
 	if (argc < 2) {
-                printf("Usage: %s <interface> [options]\n", argv[0]);
+                printf("Usage: %s <interface> [options]\n"
+			"\t-a, --apply\t\tApply the configuration\n"
+			"\t-t, --trace\t\tPrint the time of each step\n"
+			"\t-o, --optimistic-dad\tUse optimistic DAD\n",
+			argv[0]);
 		return EXIT_SUCCESS;
         }
 
@@ -151,7 +235,7 @@ int main(int argc, char *argv[])
 	}
 
 	for (;;) {
-		int opt = getopt_long(argc - 2, argv + 2, "a", main_options,
+		int opt = getopt_long(argc - 1, argv + 1, "ato", main_options,
 					NULL);
 
 		if (opt < 0)
@@ -161,6 +245,12 @@ int main(int argc, char *argv[])
 		case 'a':
 			apply = true;
 			break;
+		case 't':
+			trace = true;
+			break;
+		case 'o':
+			optimistic_dad = true;
+			break;
 		}
 	}
 
@@ -172,6 +262,12 @@ int main(int argc, char *argv[])
 
 	netconfig = l_netconfig_new(ifindex);
 	l_netconfig_set_event_handler(netconfig, event_handler, NULL, NULL);
+	l_netconfig_set_optimistic_dad_enabled(netconfig, optimistic_dad);
+
+	if (trace)
+		l_netconfig_set_trace_handler(netconfig, trace_handler,
+						NULL, NULL);
+
 	l_dhcp_client_set_debug(l_netconfig_get_dhcp_client(netconfig),
 				do_debug, "[DHCPv4] ", NULL, L_LOG_DEBUG);
 	l_netconfig_start(netconfig);
@@ -0,0 +1,47 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+
+#include "bench.h"
+
+/* One JSON object per line so that results can be compared by scripts */
+void bench_report(const char *name, double value, const char *unit)
+{
+	printf("{\"name\": \"%s\", \"value\": %.1f, \"unit\": \"%s\"}\n",
+							name, value, unit);
+}
+
+/* Same, for benchmarks that group their results by suite */
+void bench_suite_report(const char *suite, const char *name, double value,
+							const char *unit)
+{
+	printf("{\"suite\": \"%s\", \"name\": \"%s\", \"value\": %.1f, "
+			"\"unit\": \"%s\"}\n", suite, name, value, unit);
+}
+
+uint64_t bench_now_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* For sorting samples with qsort() */
+int bench_compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
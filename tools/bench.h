@@ -0,0 +1,15 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+void bench_report(const char *name, double value, const char *unit);
+void bench_suite_report(const char *suite, const char *name, double value,
+							const char *unit);
+uint64_t bench_now_ns(clockid_t clock);
+int bench_compare_u64(const void *a, const void *b);
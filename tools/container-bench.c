@@ -0,0 +1,407 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <malloc.h>
+
+#include <ell/ell.h>
+#include "bench.h"
+
+/* Each phase is repeated until it covers at least this many operations */
+#define MIN_OPS 1000000
+
+/*
+ * Backends with linear lookups are not run past this size, and their
+ * phases are repeated based on n * n rather than n operations.
+ */
+#define LINEAR_MAX 10000
+
+struct backend {
+	const char *workload;
+	const char *name;
+	unsigned int max_size;
+	void *(*create)(unsigned int n);
+	void (*insert)(void *c, uint32_t key);
+	bool (*lookup)(void *c, uint32_t key);
+	void (*remove)(void *c, uint32_t key);
+	void (*destroy)(void *c);
+};
+
+static const char *filter;
+static unsigned int max_size = 1000000;
+
+/*
+ * Memory use is taken from the allocator statistics.  Chunks sitting in
+ * the glibc per-thread cache count as in use, which skews the numbers for
+ * small containers, so memory is only reported from MEMORY_MIN elements.
+ */
+#define MEMORY_MIN 1000
+
+static size_t heap_in_use(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 mi = mallinfo2();
+
+	return mi.uordblks + mi.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+static void *hashmap_create(unsigned int n)
+{
+	return l_hashmap_new();
+}
+
+static void hashmap_insert(void *c, uint32_t key)
+{
+	l_hashmap_insert(c, L_UINT_TO_PTR(key), L_UINT_TO_PTR(key));
+}
+
+static bool hashmap_lookup(void *c, uint32_t key)
+{
+	return l_hashmap_lookup(c, L_UINT_TO_PTR(key));
+}
+
+static void hashmap_remove(void *c, uint32_t key)
+{
+	l_hashmap_remove(c, L_UINT_TO_PTR(key));
+}
+
+static void hashmap_destroy(void *c)
+{
+	l_hashmap_destroy(c, NULL);
+}
+
+static void *uintset_create(unsigned int n)
+{
+	return l_uintset_new_from_range(1, n);
+}
+
+static void uintset_insert(void *c, uint32_t key)
+{
+	l_uintset_put(c, key);
+}
+
+static bool uintset_lookup(void *c, uint32_t key)
+{
+	return l_uintset_contains(c, key);
+}
+
+static void uintset_remove(void *c, uint32_t key)
+{
+	l_uintset_take(c, key);
+}
+
+static void uintset_destroy(void *c)
+{
+	l_uintset_free(c);
+}
+
+static void *queue_create(unsigned int n)
+{
+	return l_queue_new();
+}
+
+static void queue_insert(void *c, uint32_t key)
+{
+	l_queue_push_tail(c, L_UINT_TO_PTR(key));
+}
+
+static bool queue_match(const void *a, const void *b)
+{
+	return a == b;
+}
+
+static bool queue_lookup(void *c, uint32_t key)
+{
+	return l_queue_find(c, queue_match, L_UINT_TO_PTR(key));
+}
+
+static void queue_remove(void *c, uint32_t key)
+{
+	l_queue_remove(c, L_UINT_TO_PTR(key));
+}
+
+static void queue_pop(void *c, uint32_t key)
+{
+	l_queue_pop_head(c);
+}
+
+static void queue_destroy(void *c)
+{
+	l_queue_destroy(c, NULL);
+}
+
+static int sorted_compare(const void *a, const void *b, void *user_data)
+{
+	return L_PTR_TO_UINT(a) < L_PTR_TO_UINT(b) ? -1 : 1;
+}
+
+static void sorted_insert(void *c, uint32_t key)
+{
+	l_queue_insert(c, L_UINT_TO_PTR(key), sorted_compare, NULL);
+}
+
+static void *ringbuf_create(unsigned int n)
+{
+	return l_ringbuf_new(n * sizeof(uint32_t));
+}
+
+static void ringbuf_insert(void *c, uint32_t key)
+{
+	l_ringbuf_append(c, &key, sizeof(key));
+}
+
+static void ringbuf_pop(void *c, uint32_t key)
+{
+	l_ringbuf_drain(c, sizeof(key));
+}
+
+static void ringbuf_destroy(void *c)
+{
+	l_ringbuf_free(c);
+}
+
+static bool heap_less(const void *lhs, const void *rhs)
+{
+	return *(const uint32_t *) lhs < *(const uint32_t *) rhs;
+}
+
+static void heap_swap(void *lhs, void *rhs)
+{
+	uint32_t *l = lhs;
+	uint32_t *r = rhs;
+	uint32_t tmp = *l;
+
+	*l = *r;
+	*r = tmp;
+}
+
+static const struct l_minheap_ops heap_ops = {
+	.elem_size = sizeof(uint32_t),
+	.less = heap_less,
+	.swap = heap_swap,
+};
+
+static void *minheap_create(unsigned int n)
+{
+	struct l_minheap *heap = l_new(struct l_minheap, 1);
+
+	l_minheap_init(heap, l_new(uint32_t, n), 0, n, &heap_ops);
+
+	return heap;
+}
+
+static void minheap_insert(void *c, uint32_t key)
+{
+	l_minheap_push(c, &heap_ops, &key);
+}
+
+static void minheap_pop(void *c, uint32_t key)
+{
+	l_minheap_pop(c, &heap_ops, NULL);
+}
+
+static void minheap_destroy(void *c)
+{
+	struct l_minheap *heap = c;
+
+	l_free(heap->data);
+	l_free(heap);
+}
+
+static const struct backend backends[] = {
+	{ "set", "hashmap", 0, hashmap_create, hashmap_insert,
+		hashmap_lookup, hashmap_remove, hashmap_destroy },
+	{ "set", "uintset", 0, uintset_create, uintset_insert,
+		uintset_lookup, uintset_remove, uintset_destroy },
+	{ "set", "queue", LINEAR_MAX, queue_create, queue_insert,
+		queue_lookup, queue_remove, queue_destroy },
+	{ "fifo", "queue", 0, queue_create, queue_insert,
+		NULL, queue_pop, queue_destroy },
+	{ "fifo", "ringbuf", 0, ringbuf_create, ringbuf_insert,
+		NULL, ringbuf_pop, ringbuf_destroy },
+	{ "pqueue", "minheap", 0, minheap_create, minheap_insert,
+		NULL, minheap_pop, minheap_destroy },
+	{ "pqueue", "sorted-queue", LINEAR_MAX, queue_create, sorted_insert,
+		NULL, queue_pop, queue_destroy },
+	{ }
+};
+
+/* A random permutation of 1..n, the same one on every run */
+static uint32_t *make_keys(unsigned int n)
+{
+	uint32_t *keys = l_new(uint32_t, n);
+	uint32_t state = 0x9e3779b9;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		keys[i] = i + 1;
+
+	for (i = n - 1; i > 0; i--) {
+		unsigned int j;
+		uint32_t tmp;
+
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		j = state % (i + 1);
+
+		tmp = keys[i];
+		keys[i] = keys[j];
+		keys[j] = tmp;
+	}
+
+	return keys;
+}
+
+static void run_backend(const struct backend *b, const uint32_t *keys,
+							unsigned int n)
+{
+	uint64_t work = b->max_size ? (uint64_t) n * n : n;
+	unsigned int rounds = work < MIN_OPS ? MIN_OPS / work : 1;
+	uint64_t insert_ns = 0, lookup_ns = 0, remove_ns = 0;
+	size_t bytes = 0;
+	unsigned int volatile sink = 0;
+	unsigned int r, i;
+
+	for (r = 0; r < rounds; r++) {
+		size_t before = heap_in_use();
+		void *c = b->create(n);
+		uint64_t start;
+
+		start = bench_now_ns(CLOCK_MONOTONIC);
+
+		for (i = 0; i < n; i++)
+			b->insert(c, keys[i]);
+
+		insert_ns += bench_now_ns(CLOCK_MONOTONIC) - start;
+
+		if (!r)
+			bytes = heap_in_use() - before;
+
+		if (b->lookup) {
+			start = bench_now_ns(CLOCK_MONOTONIC);
+
+			for (i = 0; i < n; i++)
+				sink += b->lookup(c, keys[n - 1 - i]);
+
+			lookup_ns += bench_now_ns(CLOCK_MONOTONIC) - start;
+		}
+
+		start = bench_now_ns(CLOCK_MONOTONIC);
+
+		for (i = 0; i < n; i++)
+			b->remove(c, keys[i]);
+
+		remove_ns += bench_now_ns(CLOCK_MONOTONIC) - start;
+
+		b->destroy(c);
+	}
+
+	printf("%-7s %-13s %9u %9.1f ", b->workload, b->name, n,
+			(double) insert_ns / rounds / n);
+
+	if (b->lookup)
+		printf("%9.1f ", (double) lookup_ns / rounds / n);
+	else
+		printf("%9s ", "-");
+
+	printf("%9.1f ", (double) remove_ns / rounds / n);
+
+	if (n >= MEMORY_MIN && heap_in_use())
+		printf("%9.1f\n", (double) bytes / n);
+	else
+		printf("%9s\n", "-");
+}
+
+static void usage(const char *bin)
+{
+	printf("usage: %s [options]\n"
+		"\t-f, --filter <text>\tOnly run benchmarks whose workload or "
+		"backend contains text\n"
+		"\t-m, --max <size>\tLargest container size "
+		"(default 1000000)\n"
+		"\t-h, --help\t\tShow help options\n", bin);
+}
+
+static const struct option main_options[] = {
+	{ "filter",	required_argument,	NULL, 'f' },
+	{ "max",	required_argument,	NULL, 'm' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	const struct backend *b;
+	unsigned int n;
+
+	for (;;) {
+		int opt = getopt_long(argc, argv, "f:m:h", main_options, NULL);
+
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'f':
+			filter = optarg;
+			break;
+		case 'm':
+			max_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc != optind || max_size < 10) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-7s %-13s %9s %9s %9s %9s %9s\n", "", "", "size",
+			"insert", "lookup", "remove", "bytes");
+	printf("%-7s %-13s %9s %9s %9s %9s %9s\n", "", "", "",
+			"ns/op", "ns/op", "ns/op", "/elem");
+
+	for (n = 10; n <= max_size; n *= 10) {
+		uint32_t *keys = make_keys(n);
+
+		for (b = backends; b->workload; b++) {
+			if (b->max_size && n > b->max_size)
+				continue;
+
+			if (filter && !strstr(b->workload, filter) &&
+					!strstr(b->name, filter))
+				continue;
+
+			run_backend(b, keys, n);
+		}
+
+		l_free(keys);
+
+		if (n > UINT32_MAX / 10)
+			break;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,593 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/types.h>
+
+#include <ell/ell.h>
+#include "ell/alg-private.h"
+#include "bench.h"
+
+/*
+ * Per-operation cost of the crypto primitives, along with the backend
+ * that ended up being used for each, since the kernel drivers and the
+ * in-process implementations perform very differently across platforms.
+ */
+#define BACKEND_ALG	"af_alg"
+#define BACKEND_LOCAL	"in-process"
+#define BACKEND_KEYCTL	"keyctl"
+
+static const size_t buf_sizes[] = { 64, 1024, 16384 };
+
+static unsigned int bench_ms = 500;
+static const char *filter;
+
+struct bench {
+	bool (*func)(void *data);
+	void *data;
+};
+
+static bool selected(const char *suite, const char *name)
+{
+	return !filter || strstr(suite, filter) || strstr(name, filter);
+}
+
+/*
+ * Runs the operation in growing batches until bench_ms have passed,
+ * returns operations per second or a negative value if one failed.
+ */
+static double run(const struct bench *bench)
+{
+	uint64_t start = l_time_now();
+	uint64_t elapsed;
+	uint64_t n = 0;
+	unsigned int batch = 1;
+	unsigned int i;
+
+	/* Warm up: lazily built tables, pooled sockets, caches */
+	if (!bench->func(bench->data))
+		return -1;
+
+	do {
+		for (i = 0; i < batch; i++)
+			if (!bench->func(bench->data))
+				return -1;
+
+		n += batch;
+		elapsed = l_time_diff(start, l_time_now());
+
+		if (batch < 4096)
+			batch *= 2;
+	} while (elapsed < bench_ms * 1000ull);
+
+	return n * 1000000.0 / elapsed;
+}
+
+static void run_and_report(const char *suite, const char *name,
+				const char *backend, const struct bench *bench,
+				size_t bytes_per_op)
+{
+	char *label;
+	double ops;
+
+	if (!selected(suite, name))
+		return;
+
+	ops = run(bench);
+	if (ops < 0) {
+		fprintf(stderr, "%s %s failed\n", suite, name);
+		return;
+	}
+
+	/* Results from different backends are never compared directly */
+	label = l_strdup_printf("%s/%s", suite, backend);
+	bench_suite_report(label, name, ops, "ops/s");
+
+	if (bytes_per_op)
+		bench_suite_report(label, name, ops * bytes_per_op / 1000000,
+								"MB/s");
+
+	l_free(label);
+}
+
+struct buf_op {
+	void *obj;
+	uint8_t *buf;
+	size_t len;
+};
+
+static const struct {
+	enum l_checksum_type type;
+	const char *name;
+} checksums[] = {
+	{ L_CHECKSUM_MD4,	"md4" },
+	{ L_CHECKSUM_MD5,	"md5" },
+	{ L_CHECKSUM_SHA1,	"sha1" },
+	{ L_CHECKSUM_SHA224,	"sha224" },
+	{ L_CHECKSUM_SHA256,	"sha256" },
+	{ L_CHECKSUM_SHA384,	"sha384" },
+	{ L_CHECKSUM_SHA512,	"sha512" },
+};
+
+static bool checksum_op(void *data)
+{
+	struct buf_op *op = data;
+	uint8_t digest[64];
+
+	return l_checksum_update(op->obj, op->buf, op->len) &&
+		l_checksum_get_digest(op->obj, digest, sizeof(digest)) > 0;
+}
+
+static void bench_checksums(uint8_t *buf)
+{
+	static const uint8_t key[32];
+	struct buf_op op = { .buf = buf };
+	struct bench bench = { checksum_op, &op };
+	unsigned int i;
+	unsigned int j;
+	unsigned int hmac;
+
+	for (i = 0; i < L_ARRAY_SIZE(checksums); i++) {
+		for (hmac = 0; hmac < 2; hmac++) {
+			const char *backend;
+
+			if (!l_checksum_is_supported(checksums[i].type, hmac))
+				continue;
+
+			op.obj = hmac ? l_checksum_new_hmac(checksums[i].type,
+							key, sizeof(key)) :
+					l_checksum_new(checksums[i].type);
+			if (!op.obj)
+				continue;
+
+			backend = checksum_uses_alg(op.obj) ? BACKEND_ALG :
+								BACKEND_LOCAL;
+
+			for (j = 0; j < L_ARRAY_SIZE(buf_sizes); j++) {
+				char *name = l_strdup_printf("%s%s/%zu",
+						hmac ? "hmac-" : "",
+						checksums[i].name,
+						buf_sizes[j]);
+
+				op.len = buf_sizes[j];
+				run_and_report("checksum", name, backend,
+						&bench, op.len);
+				l_free(name);
+			}
+
+			l_checksum_free(op.obj);
+		}
+	}
+}
+
+static const struct {
+	enum l_cipher_type type;
+	const char *name;
+	size_t key_len;
+	size_t iv_len;
+} ciphers[] = {
+	{ L_CIPHER_AES,			"aes-128-ecb",	16, 0 },
+	{ L_CIPHER_AES_CBC,		"aes-128-cbc",	16, 16 },
+	{ L_CIPHER_AES_CBC,		"aes-256-cbc",	32, 16 },
+	{ L_CIPHER_AES_CTR,		"aes-128-ctr",	16, 16 },
+	{ L_CIPHER_ARC4,		"arc4",		16, 0 },
+	{ L_CIPHER_DES,			"des-ecb",	8, 0 },
+	{ L_CIPHER_DES_CBC,		"des-cbc",	8, 8 },
+	{ L_CIPHER_DES3_EDE_CBC,	"des3-ede-cbc",	24, 8 },
+	{ L_CIPHER_RC2_CBC,		"rc2-cbc",	16, 8 },
+};
+
+static bool cipher_op(void *data)
+{
+	struct buf_op *op = data;
+
+	return l_cipher_encrypt(op->obj, op->buf, op->buf, op->len);
+}
+
+static void bench_ciphers(uint8_t *buf)
+{
+	static const uint8_t key[32] = { 0x01, 0x23, 0x45, 0x67, 0x89 };
+	static const uint8_t iv[16];
+	struct buf_op op = { .buf = buf };
+	struct bench bench = { cipher_op, &op };
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0; i < L_ARRAY_SIZE(ciphers); i++) {
+		const char *backend;
+
+		if (!l_cipher_is_supported(ciphers[i].type))
+			continue;
+
+		op.obj = l_cipher_new(ciphers[i].type, key, ciphers[i].key_len);
+		if (!op.obj)
+			continue;
+
+		if (ciphers[i].iv_len && !l_cipher_set_iv(op.obj, iv,
+							ciphers[i].iv_len)) {
+			l_cipher_free(op.obj);
+			continue;
+		}
+
+		backend = cipher_uses_alg(op.obj) ? BACKEND_ALG : BACKEND_LOCAL;
+
+		for (j = 0; j < L_ARRAY_SIZE(buf_sizes); j++) {
+			char *name = l_strdup_printf("%s/%zu",
+							ciphers[i].name,
+							buf_sizes[j]);
+
+			op.len = buf_sizes[j];
+			run_and_report("cipher", name, backend, &bench, op.len);
+			l_free(name);
+		}
+
+		l_cipher_free(op.obj);
+	}
+}
+
+static const struct {
+	enum l_aead_cipher_type type;
+	const char *name;
+	size_t key_len;
+	size_t nonce_len;
+} aead_ciphers[] = {
+	{ L_AEAD_CIPHER_AES_CCM,	"aes-128-ccm",	16, 13 },
+	{ L_AEAD_CIPHER_AES_GCM,	"aes-128-gcm",	16, 12 },
+	{ L_AEAD_CIPHER_AES_GCM,	"aes-256-gcm",	32, 12 },
+};
+
+#define AEAD_TAG_LEN	16
+#define AEAD_AD_LEN	13
+
+struct aead_op {
+	struct l_aead_cipher *cipher;
+	uint8_t *buf;
+	size_t len;
+	size_t nonce_len;
+	uint8_t *out;
+};
+
+static bool aead_op(void *data)
+{
+	static const uint8_t nonce[16];
+	static const uint8_t ad[AEAD_AD_LEN];
+	struct aead_op *op = data;
+
+	return l_aead_cipher_encrypt(op->cipher, op->buf, op->len,
+					ad, sizeof(ad), nonce, op->nonce_len,
+					op->out, op->len + AEAD_TAG_LEN);
+}
+
+static void bench_aead_ciphers(uint8_t *buf)
+{
+	static const uint8_t key[32] = { 0x01, 0x23, 0x45, 0x67, 0x89 };
+	struct aead_op op = { .buf = buf };
+	struct bench bench = { aead_op, &op };
+	unsigned int i;
+	unsigned int j;
+
+	op.out = l_malloc(buf_sizes[L_ARRAY_SIZE(buf_sizes) - 1] +
+				AEAD_TAG_LEN);
+
+	for (i = 0; i < L_ARRAY_SIZE(aead_ciphers); i++) {
+		const char *backend;
+
+		if (!l_aead_cipher_is_supported(aead_ciphers[i].type))
+			continue;
+
+		op.cipher = l_aead_cipher_new(aead_ciphers[i].type, key,
+						aead_ciphers[i].key_len,
+						AEAD_TAG_LEN);
+		if (!op.cipher)
+			continue;
+
+		op.nonce_len = aead_ciphers[i].nonce_len;
+		backend = aead_cipher_uses_alg(op.cipher) ? BACKEND_ALG :
+								BACKEND_LOCAL;
+
+		for (j = 0; j < L_ARRAY_SIZE(buf_sizes); j++) {
+			char *name = l_strdup_printf("%s/%zu",
+							aead_ciphers[i].name,
+							buf_sizes[j]);
+
+			op.len = buf_sizes[j];
+			run_and_report("aead", name, backend, &bench, op.len);
+			l_free(name);
+		}
+
+		l_aead_cipher_free(op.cipher);
+	}
+
+	l_free(op.out);
+}
+
+struct ecc_op {
+	const struct l_ecc_curve *curve;
+	struct l_ecc_scalar *scalar;
+	struct l_ecc_point *point;
+	struct l_ecc_point *result;
+};
+
+static bool ecc_multiply_op(void *data)
+{
+	struct ecc_op *op = data;
+
+	return l_ecc_point_multiply(op->result, op->scalar, op->point);
+}
+
+static bool ecc_multiply_g_op(void *data)
+{
+	struct ecc_op *op = data;
+
+	return l_ecc_point_multiply_g(op->result, op->scalar);
+}
+
+static bool ecdh_key_pair_op(void *data)
+{
+	struct ecc_op *op = data;
+	struct l_ecc_scalar *private;
+	struct l_ecc_point *public;
+
+	if (!l_ecdh_generate_key_pair(op->curve, &private, &public))
+		return false;
+
+	l_ecc_scalar_free(private);
+	l_ecc_point_free(public);
+	return true;
+}
+
+static bool ecdh_shared_secret_op(void *data)
+{
+	struct ecc_op *op = data;
+	struct l_ecc_scalar *secret;
+
+	if (!l_ecdh_generate_shared_secret(op->scalar, op->point, &secret))
+		return false;
+
+	l_ecc_scalar_free(secret);
+	return true;
+}
+
+static void bench_ecc(void)
+{
+	static const struct {
+		const char *name;
+		bool (*func)(void *data);
+	} ops[] = {
+		{ "point-multiply",	ecc_multiply_op },
+		{ "point-multiply-g",	ecc_multiply_g_op },
+		{ "ecdh-key-pair",	ecdh_key_pair_op },
+		{ "ecdh-shared-secret",	ecdh_shared_secret_op },
+	};
+	const unsigned int *groups = l_ecc_supported_tls_groups();
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0; groups[i]; i++) {
+		struct ecc_op op;
+		struct l_ecc_scalar *peer_private;
+
+		op.curve = l_ecc_curve_from_tls_group(groups[i]);
+
+		if (!l_ecdh_generate_key_pair(op.curve, &op.scalar,
+						&op.result))
+			continue;
+
+		if (!l_ecdh_generate_key_pair(op.curve, &peer_private,
+						&op.point)) {
+			l_ecc_scalar_free(op.scalar);
+			l_ecc_point_free(op.result);
+			continue;
+		}
+
+		for (j = 0; j < L_ARRAY_SIZE(ops); j++) {
+			struct bench bench = { ops[j].func, &op };
+			char *name = l_strdup_printf("%s/%s",
+					l_ecc_curve_get_name(op.curve),
+					ops[j].name);
+
+			run_and_report("ecc", name, BACKEND_LOCAL, &bench, 0);
+			l_free(name);
+		}
+
+		l_ecc_scalar_free(peer_private);
+		l_ecc_scalar_free(op.scalar);
+		l_ecc_point_free(op.point);
+		l_ecc_point_free(op.result);
+	}
+}
+
+struct key_op {
+	struct l_key *key;
+	uint8_t digest[32];
+	uint8_t sig[1024];
+	size_t sig_len;
+};
+
+static bool key_sign_op(void *data)
+{
+	struct key_op *op = data;
+
+	return l_key_sign(op->key, L_KEY_RSA_PKCS1_V1_5, L_CHECKSUM_SHA256,
+				op->digest, op->sig, sizeof(op->digest),
+				op->sig_len) == (ssize_t) op->sig_len;
+}
+
+static bool key_verify_op(void *data)
+{
+	struct key_op *op = data;
+
+	return l_key_verify(op->key, L_KEY_RSA_PKCS1_V1_5, L_CHECKSUM_SHA256,
+				op->digest, op->sig, sizeof(op->digest),
+				op->sig_len);
+}
+
+static void bench_key(const char *key_path)
+{
+	struct key_op op = {};
+	struct bench sign = { key_sign_op, &op };
+	struct bench verify = { key_verify_op, &op };
+	char *name;
+	size_t bits;
+
+	op.key = l_pem_load_private_key(key_path, NULL, NULL);
+	if (!op.key) {
+		fprintf(stderr, "Failed to load %s\n", key_path);
+		return;
+	}
+
+	if (!l_key_get_info(op.key, L_KEY_RSA_PKCS1_V1_5, L_CHECKSUM_SHA256,
+				&bits, NULL) || bits / 8 > sizeof(op.sig)) {
+		fprintf(stderr, "Only RSA keys up to 8192 bits are handled\n");
+		goto done;
+	}
+
+	op.sig_len = bits / 8;
+
+	/* The signature verified in the loop */
+	if (!key_sign_op(&op)) {
+		fprintf(stderr, "Signing with %s failed\n", key_path);
+		goto done;
+	}
+
+	name = l_strdup_printf("rsa-%zu-sha256/sign", bits);
+	run_and_report("key", name, BACKEND_KEYCTL, &sign, 0);
+	l_free(name);
+
+	name = l_strdup_printf("rsa-%zu-sha256/verify", bits);
+	run_and_report("key", name, BACKEND_KEYCTL, &verify, 0);
+	l_free(name);
+
+done:
+	l_key_free(op.key);
+}
+
+#define PBKDF2_ITERATIONS	4096
+
+static bool pbkdf2_op(void *data)
+{
+	const enum l_checksum_type *type = data;
+	static const char password[] = "password";
+	static const char salt[] = "salt";
+	uint8_t dk[32];
+
+	return l_checksum_pbkdf2(*type, password, strlen(password),
+					salt, strlen(salt), PBKDF2_ITERATIONS,
+					dk, sizeof(dk));
+}
+
+static void bench_pbkdf2(void)
+{
+	static const uint8_t key[8];
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(checksums); i++) {
+		enum l_checksum_type type = checksums[i].type;
+		struct bench bench = { pbkdf2_op, &type };
+		struct l_checksum *hmac;
+		char *name;
+		const char *backend;
+
+		if (type != L_CHECKSUM_SHA1 && type != L_CHECKSUM_SHA256)
+			continue;
+
+		/* PBKDF2 runs on the same backend as the HMAC */
+		hmac = l_checksum_new_hmac(type, key, sizeof(key));
+		if (!hmac)
+			continue;
+
+		backend = checksum_uses_alg(hmac) ? BACKEND_ALG : BACKEND_LOCAL;
+		l_checksum_free(hmac);
+
+		name = l_strdup_printf("%s/%u", checksums[i].name,
+					PBKDF2_ITERATIONS);
+		run_and_report("pbkdf2", name, backend, &bench, 0);
+		l_free(name);
+	}
+}
+
+static void usage(const char *bin)
+{
+	printf("usage: %s [options]\n"
+		"\t-f, --filter <text>\tOnly run benchmarks whose suite or "
+		"name contains text\n"
+		"\t-t, --time <ms>\t\tTime spent on each benchmark "
+		"(default 500)\n"
+		"\t-k, --key <key.pem>\tRSA private key for the sign and "
+		"verify benchmarks\n"
+		"\t-h, --help\t\tShow help options\n", bin);
+}
+
+static const struct option main_options[] = {
+	{ "filter",	required_argument,	NULL, 'f' },
+	{ "time",	required_argument,	NULL, 't' },
+	{ "key",	required_argument,	NULL, 'k' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	const char *key_path = NULL;
+	uint8_t *buf;
+
+	for (;;) {
+		int opt = getopt_long(argc, argv, "f:t:k:h", main_options,
+									NULL);
+
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'f':
+			filter = optarg;
+			break;
+		case 't':
+			bench_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			key_path = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc != optind || !bench_ms) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	buf = l_malloc(buf_sizes[L_ARRAY_SIZE(buf_sizes) - 1]);
+	memset(buf, 0x5a, buf_sizes[L_ARRAY_SIZE(buf_sizes) - 1]);
+
+	bench_checksums(buf);
+	bench_ciphers(buf);
+	bench_aead_ciphers(buf);
+	bench_ecc();
+	bench_pbkdf2();
+
+	if (key_path)
+		bench_key(key_path);
+	else
+		fprintf(stderr, "No --key given, skipping key benchmarks\n");
+
+	l_free(buf);
+	return EXIT_SUCCESS;
+}
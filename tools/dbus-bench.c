@@ -0,0 +1,370 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <ell/ell.h>
+#include "ell/dbus-private.h"
+#include "bench.h"
+
+#define N_MESSAGES 20000
+#define N_CALLS 5000
+#define N_WARMUP 20
+#define N_PROPERTIES 64
+#define N_OBJECTS 256
+
+#define BENCH_INTERFACE "org.ell.Bench"
+#define BENCH_PATH "/org/ell/bench"
+
+static struct l_dbus_message *build_message(uint8_t version)
+{
+	struct l_dbus_message *msg;
+
+	msg = _dbus_message_new_method_call(version, "org.ell.Bench",
+						BENCH_PATH, BENCH_INTERFACE,
+						"Method");
+
+	l_dbus_message_set_arguments(msg, "sa{sv}as", "bench", 4,
+					"Name", "s", "wlan0",
+					"Frequency", "u", 5180,
+					"Connected", "b", true,
+					"RxBytes", "t", (uint64_t) 1 << 40,
+					3, "first", "second", "third");
+
+	return msg;
+}
+
+static bool parse_message(struct l_dbus_message *msg)
+{
+	struct l_dbus_message_iter dict, array, variant;
+	const char *str, *key;
+	unsigned int n = 0;
+
+	if (!l_dbus_message_get_arguments(msg, "sa{sv}as", &str, &dict,
+								&array))
+		return false;
+
+	while (l_dbus_message_iter_next_entry(&dict, &key, &variant))
+		n++;
+
+	while (l_dbus_message_iter_next_entry(&array, &str))
+		n++;
+
+	return n == 7;
+}
+
+static void bench_marshal(const char *format, uint8_t version)
+{
+	struct l_dbus_message *msg;
+	const void *header, *footer;
+	size_t header_size, footer_size;
+	uint8_t *blob;
+	uint64_t start, build_time, parse_time;
+	char name[64];
+	unsigned int i;
+
+	start = l_time_now();
+
+	for (i = 0; i < N_MESSAGES; i++)
+		l_dbus_message_unref(build_message(version));
+
+	build_time = l_time_now() - start;
+
+	/* Parse from the wire format, as a received message would be */
+	msg = build_message(version);
+	header = _dbus_message_get_header(msg, &header_size);
+	footer = _dbus_message_get_footer(msg, &footer_size);
+
+	blob = l_malloc(header_size + footer_size);
+	memcpy(blob, header, header_size);
+	memcpy(blob + header_size, footer, footer_size);
+	l_dbus_message_unref(msg);
+
+	start = l_time_now();
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		msg = dbus_message_from_blob(blob, header_size + footer_size,
+								NULL, 0);
+		if (!msg || !parse_message(msg)) {
+			fprintf(stderr, "Failed to parse %s message\n", format);
+			exit(EXIT_FAILURE);
+		}
+
+		l_dbus_message_unref(msg);
+	}
+
+	parse_time = l_time_now() - start;
+
+	l_free(blob);
+
+	snprintf(name, sizeof(name), "%s-marshal", format);
+	bench_report(name, build_time * 1000.0 / N_MESSAGES, "ns/msg");
+
+	snprintf(name, sizeof(name), "%s-unmarshal", format);
+	bench_report(name, parse_time * 1000.0 / N_MESSAGES, "ns/msg");
+}
+
+/*
+ * The peer of the private connection.  It plays the server side of the
+ * authentication and then sends every byte straight back, so each call
+ * the connection makes to itself is dispatched by its own object tree.
+ */
+static void echo_peer(int fd)
+{
+	static const char *responses[] = {
+		"OK 0123456789abcdef0123456789abcdef\r\n",
+		"AGREE_UNIX_FD\r\n",
+		NULL,
+	};
+	char buf[65536];
+	size_t len = 0, lines = 0;
+	ssize_t n;
+
+	while (1) {
+		char *end;
+
+		n = L_TFR(read(fd, buf + len, sizeof(buf) - len));
+		if (n <= 0)
+			_exit(EXIT_SUCCESS);
+
+		len += n;
+
+		while ((end = memmem(buf, len, "\r\n", 2))) {
+			size_t line_len = end - buf + 2;
+			const char *response = responses[lines++];
+
+			memmove(buf, buf + line_len, len - line_len);
+			len -= line_len;
+
+			/* BEGIN, everything from here on is D-Bus messages */
+			if (!response)
+				goto echo;
+
+			if (write(fd, response, strlen(response)) < 0)
+				_exit(EXIT_FAILURE);
+		}
+	}
+
+echo:
+	while (1) {
+		size_t pos = 0;
+
+		while (pos < len) {
+			n = L_TFR(write(fd, buf + pos, len - pos));
+			if (n <= 0)
+				_exit(EXIT_FAILURE);
+
+			pos += n;
+		}
+
+		n = L_TFR(read(fd, buf, sizeof(buf)));
+		if (n <= 0)
+			_exit(EXIT_SUCCESS);
+
+		len = n;
+	}
+}
+
+static struct l_dbus_message *bench_ping(struct l_dbus *dbus,
+						struct l_dbus_message *message,
+						void *user_data)
+{
+	return l_dbus_message_new_method_return(message);
+}
+
+static bool bench_property_get(struct l_dbus *dbus,
+					struct l_dbus_message *message,
+					struct l_dbus_message_builder *builder,
+					void *user_data)
+{
+	uint32_t value = 42;
+
+	return l_dbus_message_builder_append_basic(builder, 'u', &value);
+}
+
+static void setup_bench_interface(struct l_dbus_interface *interface)
+{
+	unsigned int i;
+
+	l_dbus_interface_method(interface, "Ping", 0, bench_ping, "", "");
+
+	for (i = 0; i < N_PROPERTIES; i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "Property%u", i);
+		l_dbus_interface_property(interface, name, 0, "u",
+						bench_property_get, NULL);
+	}
+}
+
+struct round_trip {
+	const char *name;
+	const char *path;
+	const char *interface;
+	const char *method;
+	l_dbus_message_func_t setup;
+	unsigned int calls;
+	unsigned int count;
+	uint64_t start;
+};
+
+static void get_all_setup(struct l_dbus_message *message, void *user_data)
+{
+	l_dbus_message_set_arguments(message, "s", BENCH_INTERFACE);
+}
+
+static const struct round_trip round_trips[] = {
+	{ "round-trip", BENCH_PATH, BENCH_INTERFACE, "Ping",
+							NULL, N_CALLS },
+	{ "dispatch-get-all", BENCH_PATH, L_DBUS_INTERFACE_PROPERTIES,
+							"GetAll",
+							get_all_setup,
+							N_CALLS },
+	{ "dispatch-get-managed-objects", "/",
+					L_DBUS_INTERFACE_OBJECT_MANAGER,
+					"GetManagedObjects", NULL,
+					N_CALLS / 50 },
+	{ }
+};
+
+static struct l_dbus *dbus;
+static struct round_trip current;
+static const struct round_trip *next_round_trip = round_trips;
+
+static void round_trip_next(void);
+
+static void round_trip_reply(struct l_dbus_message *message, void *user_data)
+{
+	if (l_dbus_message_is_error(message)) {
+		fprintf(stderr, "%s failed\n", current.method);
+		exit(EXIT_FAILURE);
+	}
+
+	current.count++;
+
+	if (current.count == N_WARMUP)
+		current.start = l_time_now();
+
+	if (current.count == N_WARMUP + current.calls) {
+		bench_report(current.name,
+			(l_time_now() - current.start) * 1.0 / current.calls,
+			"us/call");
+		round_trip_next();
+		return;
+	}
+
+	l_dbus_method_call(dbus, NULL, current.path, current.interface,
+				current.method, current.setup,
+				round_trip_reply, NULL, NULL);
+}
+
+static void round_trip_next(void)
+{
+	if (!next_round_trip->name) {
+		l_main_quit();
+		return;
+	}
+
+	current = *next_round_trip++;
+
+	l_dbus_method_call(dbus, NULL, current.path, current.interface,
+				current.method, current.setup,
+				round_trip_reply, NULL, NULL);
+}
+
+static void ready_callback(void *user_data)
+{
+	round_trip_next();
+}
+
+static void disconnect_callback(void *user_data)
+{
+	fprintf(stderr, "Echo peer disconnected\n");
+	exit(EXIT_FAILURE);
+}
+
+static void bench_round_trips(void)
+{
+	unsigned int i;
+	int fds[2];
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+		perror("socketpair");
+		exit(EXIT_FAILURE);
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		echo_peer(fds[1]);
+	}
+
+	close(fds[1]);
+
+	l_main_init();
+
+	dbus = l_dbus_new_private(fds[0]);
+	if (!dbus) {
+		fprintf(stderr, "Failed to set up private connection\n");
+		exit(EXIT_FAILURE);
+	}
+
+	l_dbus_set_ready_handler(dbus, ready_callback, NULL, NULL);
+	l_dbus_set_disconnect_handler(dbus, disconnect_callback, NULL, NULL);
+
+	l_dbus_register_interface(dbus, BENCH_INTERFACE, setup_bench_interface,
+								NULL, false);
+	l_dbus_object_manager_enable(dbus, "/");
+	l_dbus_object_add_interface(dbus, BENCH_PATH, BENCH_INTERFACE, NULL);
+	l_dbus_object_add_interface(dbus, BENCH_PATH,
+					L_DBUS_INTERFACE_PROPERTIES, NULL);
+
+	for (i = 0; i < N_OBJECTS; i++) {
+		char path[64];
+
+		snprintf(path, sizeof(path), BENCH_PATH "/%u", i);
+		l_dbus_object_add_interface(dbus, path, BENCH_INTERFACE, NULL);
+		l_dbus_object_add_interface(dbus, path,
+					L_DBUS_INTERFACE_PROPERTIES, NULL);
+	}
+
+	l_main_run();
+
+	l_dbus_set_disconnect_handler(dbus, NULL, NULL, NULL);
+	l_dbus_destroy(dbus);
+	l_main_exit();
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char *argv[])
+{
+	bench_marshal("dbus1", 1);
+	bench_marshal("gvariant", 2);
+
+	bench_round_trips();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,360 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <linux/types.h>
+
+#include <ell/ell.h>
+#include "ell/dhcp-private.h"
+#include "bench.h"
+
+#define SERVER_ADDRESS "10.0.0.1"
+#define SERVER_NETMASK "255.255.0.0"
+#define POOL_START "10.0.0.2"
+#define POOL_END "10.0.255.254"
+
+struct bench_client {
+	uint8_t mac[6];
+	uint32_t address;
+};
+
+struct bench_stats {
+	uint64_t *latency;
+	unsigned int count;
+	unsigned int failed;
+	uint64_t elapsed;
+};
+
+static uint32_t server_address;
+static uint8_t reply_type;
+static uint32_t reply_yiaddr;
+static uint32_t next_mac;
+
+static size_t rss_bytes(void)
+{
+	unsigned long size, resident;
+	FILE *f = fopen("/proc/self/statm", "r");
+	int r;
+
+	if (!f)
+		return 0;
+
+	r = fscanf(f, "%lu %lu", &size, &resident);
+	fclose(f);
+
+	return r == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+/* Replies are not sent anywhere, only the type and address are kept */
+static int fake_l2_send(struct dhcp_transport *transport,
+			uint32_t saddr, uint16_t sport,
+			uint32_t daddr, uint16_t dport,
+			const uint8_t *dest_mac,
+			const void *data, size_t len)
+{
+	const struct dhcp_message *reply = data;
+	struct dhcp_message_iter iter;
+	uint8_t t, l;
+	const void *v;
+
+	reply_type = 0;
+	reply_yiaddr = reply->yiaddr;
+
+	if (!_dhcp_message_iter_init(&iter, reply, len))
+		return 0;
+
+	while (_dhcp_message_iter_next(&iter, &t, &l, &v))
+		if (t == DHCP_OPTION_MESSAGE_TYPE && l == 1)
+			reply_type = l_get_u8(v);
+
+	return 0;
+}
+
+static void client_receive(struct l_dhcp_server *server,
+				struct dhcp_transport *transport,
+				const struct bench_client *client,
+				uint8_t type, uint32_t ciaddr,
+				uint32_t requested_ip, bool server_id)
+{
+	uint8_t buf[sizeof(struct dhcp_message) + DHCP_MIN_OPTIONS_SIZE] = {};
+	struct dhcp_message *msg = (struct dhcp_message *) buf;
+	struct dhcp_message_builder builder;
+	size_t len = sizeof(buf);
+
+	_dhcp_message_builder_init(&builder, msg, len, type);
+
+	msg->xid = l_getrandom_uint32();
+	msg->ciaddr = ciaddr;
+	memcpy(msg->chaddr, client->mac, 6);
+
+	if (requested_ip)
+		_dhcp_message_builder_append(&builder,
+					L_DHCP_OPTION_REQUESTED_IP_ADDRESS,
+					4, &requested_ip);
+
+	if (server_id)
+		_dhcp_message_builder_append(&builder,
+					L_DHCP_OPTION_SERVER_IDENTIFIER,
+					4, &server_address);
+
+	_dhcp_message_builder_finalize(&builder, &len);
+
+	reply_type = 0;
+	transport->rx_cb(msg, len, transport->rx_data, client->mac,
+				l_time_now());
+}
+
+static void client_new(struct bench_client *client)
+{
+	next_mac++;
+
+	client->mac[0] = 0x02;
+	client->mac[1] = 0x00;
+	l_put_be32(next_mac, client->mac + 2);
+	client->address = 0;
+}
+
+/* DISCOVER/OFFER followed by REQUEST/ACK */
+static bool client_join(struct l_dhcp_server *server,
+			struct dhcp_transport *transport,
+			struct bench_client *client)
+{
+	client_receive(server, transport, client, DHCP_MESSAGE_TYPE_DISCOVER,
+			0, 0, false);
+	if (reply_type != DHCP_MESSAGE_TYPE_OFFER)
+		return false;
+
+	client_receive(server, transport, client, DHCP_MESSAGE_TYPE_REQUEST,
+			0, reply_yiaddr, true);
+	if (reply_type != DHCP_MESSAGE_TYPE_ACK)
+		return false;
+
+	client->address = reply_yiaddr;
+	return true;
+}
+
+static bool client_renew(struct l_dhcp_server *server,
+				struct dhcp_transport *transport,
+				struct bench_client *client)
+{
+	client_receive(server, transport, client, DHCP_MESSAGE_TYPE_REQUEST,
+			client->address, 0, false);
+
+	return reply_type == DHCP_MESSAGE_TYPE_ACK;
+}
+
+static void client_leave(struct l_dhcp_server *server,
+				struct dhcp_transport *transport,
+				struct bench_client *client)
+{
+	client_receive(server, transport, client, DHCP_MESSAGE_TYPE_RELEASE,
+			client->address, 0, true);
+}
+
+static void stats_report(const char *prefix, struct bench_stats *stats)
+{
+	static const unsigned int percentiles[] = { 50, 90, 99 };
+	char name[64];
+	unsigned int i;
+
+	if (!stats->count)
+		return;
+
+	qsort(stats->latency, stats->count, sizeof(uint64_t),
+							bench_compare_u64);
+
+	snprintf(name, sizeof(name), "%s-rate", prefix);
+	bench_report(name, stats->count * 1000000000.0 / stats->elapsed,
+								"tx/s");
+
+	for (i = 0; i < L_ARRAY_SIZE(percentiles); i++) {
+		snprintf(name, sizeof(name), "%s-p%u", prefix, percentiles[i]);
+		bench_report(name, stats->latency[(stats->count - 1) *
+						percentiles[i] / 100], "ns");
+	}
+
+	snprintf(name, sizeof(name), "%s-max", prefix);
+	bench_report(name, stats->latency[stats->count - 1], "ns");
+
+	if (stats->failed) {
+		snprintf(name, sizeof(name), "%s-failed", prefix);
+		bench_report(name, stats->failed, "tx");
+	}
+}
+
+static struct l_dhcp_server *server_init(struct dhcp_transport **out)
+{
+	struct l_dhcp_server *server = l_dhcp_server_new(1);
+	struct dhcp_transport *transport = l_new(struct dhcp_transport, 1);
+
+	l_dhcp_server_set_interface_name(server, "bench");
+	l_dhcp_server_set_ip_address(server, SERVER_ADDRESS);
+	l_dhcp_server_set_netmask(server, SERVER_NETMASK);
+	l_dhcp_server_set_gateway(server, SERVER_ADDRESS);
+	l_dhcp_server_set_ip_range(server, POOL_START, POOL_END);
+	l_dhcp_server_set_enable_rapid_commit(server, false);
+
+	/* Measure the protocol path, not the flood protection */
+	_dhcp_server_set_rate_limit(server, 0, 0, 0, 0);
+	_dhcp_server_set_max_offers(server, 65536);
+
+	transport->ifindex = 1;
+	transport->l2_send = fake_l2_send;
+	_dhcp_server_set_transport(server, transport);
+
+	if (!l_dhcp_server_start(server)) {
+		fprintf(stderr, "Failed to start the server\n");
+		exit(EXIT_FAILURE);
+	}
+
+	inet_pton(AF_INET, SERVER_ADDRESS, &server_address);
+	*out = transport;
+	return server;
+}
+
+static void usage(const char *bin)
+{
+	printf("usage: %s [options]\n"
+		"\t-c, --clients <n>\tNumber of clients (default 10000)\n"
+		"\t-r, --rounds <n>\tRenewal rounds (default 5)\n"
+		"\t-p, --churn <percent>\tClients replaced per round "
+		"(default 10)\n"
+		"\t-h, --help\t\tShow help options\n", bin);
+}
+
+static const struct option main_options[] = {
+	{ "clients",	required_argument,	NULL, 'c' },
+	{ "rounds",	required_argument,	NULL, 'r' },
+	{ "churn",	required_argument,	NULL, 'p' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	unsigned int n_clients = 10000;
+	unsigned int n_rounds = 5;
+	unsigned int churn = 10;
+	struct l_dhcp_server *server;
+	struct dhcp_transport *transport;
+	struct bench_client *clients;
+	struct bench_stats join = {};
+	struct bench_stats renew = {};
+	struct bench_stats *stats;
+	size_t rss_before, rss_after;
+	unsigned int round, i;
+	uint64_t start, t;
+
+	for (;;) {
+		int opt = getopt_long(argc, argv, "c:r:p:h", main_options,
+									NULL);
+
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'c':
+			n_clients = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			n_rounds = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			churn = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!n_clients || n_clients > 65000 || churn > 100) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!l_main_init())
+		return EXIT_FAILURE;
+
+	clients = l_new(struct bench_client, n_clients);
+	join.latency = l_new(uint64_t, n_clients * (n_rounds + 1));
+	renew.latency = l_new(uint64_t, n_clients * n_rounds);
+
+	server = server_init(&transport);
+	rss_before = rss_bytes();
+
+	/* Initial population, then every round some clients leave */
+	for (round = 0; round <= n_rounds; round++) {
+		unsigned int n_churn = round ? n_clients * churn / 100 : 0;
+
+		for (i = 0; i < n_churn; i++) {
+			struct bench_client *client =
+				&clients[l_getrandom_uint32() % n_clients];
+
+			client_leave(server, transport, client);
+			client->address = 0;
+		}
+
+		for (i = 0; i < n_clients; i++) {
+			struct bench_client *client = &clients[i];
+			bool ok;
+
+			start = bench_now_ns(CLOCK_MONOTONIC);
+
+			if (client->address) {
+				ok = client_renew(server, transport, client);
+				stats = &renew;
+			} else {
+				client_new(client);
+				ok = client_join(server, transport, client);
+				stats = &join;
+			}
+
+			t = bench_now_ns(CLOCK_MONOTONIC) - start;
+			stats->elapsed += t;
+
+			if (!ok) {
+				stats->failed++;
+				continue;
+			}
+
+			stats->latency[stats->count++] = t;
+		}
+
+		if (!round)
+			rss_after = rss_bytes();
+	}
+
+	bench_report("clients", n_clients, "clients");
+	bench_report("memory-per-lease", (double) (rss_after - rss_before) /
+					n_clients, "bytes");
+	stats_report("join", &join);
+	stats_report("renew", &renew);
+
+	l_dhcp_server_destroy(server);
+	l_free(join.latency);
+	l_free(renew.latency);
+	l_free(clients);
+
+	l_main_exit();
+
+	return EXIT_SUCCESS;
+}
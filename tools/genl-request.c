@@ -65,7 +65,9 @@ static void usage(const char *bin)
 {
 	printf("%s - genl family autoload utility\n\n", bin);
 	printf("Usage: %s <family_name>\n"
-		"  <family_name> - Name of the family to request\n",
+		"  <family_name> - Name of the family to request\n\n"
+		"Set GENL_FAMILY_CACHE to a file to keep family information "
+		"across runs\n",
 		bin);
 }
 
@@ -88,6 +90,9 @@ int main(int argc, char *argv[])
 	if (getenv("GENL_DEBUG"))
 		l_genl_set_debug(genl, do_debug, "[GENL] ", NULL);
 
+	if (getenv("GENL_FAMILY_CACHE"))
+		l_genl_set_family_cache(genl, getenv("GENL_FAMILY_CACHE"));
+
 	if (!l_genl_request_family(genl, argv[1],
 					family_requested, NULL, NULL)) {
 		l_info("Unable to request family: %s", argv[1]);
@@ -0,0 +1,157 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ell/ell.h>
+#include "bench.h"
+
+#define N_KEYS 50000
+#define N_ROUNDS 20
+
+struct preset {
+	const char *name;
+	l_hashmap_hash_func_t func;
+};
+
+static const struct preset str_presets[] = {
+	{ "superfast", l_str_hash },
+	{ "wyhash", l_str_hash_fast },
+	{ "siphash", l_str_hash_keyed },
+	{ }
+};
+
+static const struct preset ptr_presets[] = {
+	{ "direct", NULL },
+	{ "ptr", l_ptr_hash },
+	{ }
+};
+
+static unsigned int direct_hash(const void *p)
+{
+	return L_PTR_TO_UINT(p);
+}
+
+static char **make_keys(const char *set)
+{
+	char **keys = l_new(char *, N_KEYS + 1);
+	unsigned int i;
+
+	for (i = 0; i < N_KEYS; i++) {
+		if (!strcmp(set, "ifname"))
+			keys[i] = l_strdup_printf("wlan%u", i);
+		else if (!strcmp(set, "dbus-name"))
+			keys[i] = l_strdup_printf(":1.%u", i);
+		else if (!strcmp(set, "object-path"))
+			keys[i] = l_strdup_printf("/net/connman/iwd/%u/%u/"
+						"%02x%02x%02x%02x%02x%02x_psk",
+						i % 8, i / 8,
+						i & 0xff, (i >> 8) & 0xff,
+						(i >> 16) & 0xff, i % 7,
+						i % 13, i % 251);
+		else
+			keys[i] = l_strdup_printf("org.freedesktop.DBus."
+						"Properties.Interface%u", i);
+	}
+
+	return keys;
+}
+
+static void bench_hash(const char *set, const char *name,
+				l_hashmap_hash_func_t func,
+				const void **keys, bool strings)
+{
+	struct l_hashmap *hashmap;
+	unsigned int volatile sink = 0;
+	uint64_t start, hash_time, map_time;
+	unsigned int i, r;
+	char *label;
+
+	start = bench_now_ns(CLOCK_MONOTONIC);
+
+	for (r = 0; r < N_ROUNDS; r++)
+		for (i = 0; i < N_KEYS; i++)
+			sink += func(keys[i]);
+
+	hash_time = bench_now_ns(CLOCK_MONOTONIC) - start;
+
+	hashmap = l_hashmap_new();
+	l_hashmap_set_hash_function(hashmap, func);
+
+	if (strings)
+		l_hashmap_set_compare_function(hashmap,
+					(l_hashmap_compare_func_t) strcmp);
+
+	start = bench_now_ns(CLOCK_MONOTONIC);
+
+	for (i = 0; i < N_KEYS; i++)
+		l_hashmap_insert(hashmap, keys[i], L_UINT_TO_PTR(i + 1));
+
+	for (r = 0; r < N_ROUNDS; r++)
+		for (i = 0; i < N_KEYS; i++)
+			sink += L_PTR_TO_UINT(l_hashmap_lookup(hashmap,
+								keys[i]));
+
+	map_time = bench_now_ns(CLOCK_MONOTONIC) - start;
+
+	l_hashmap_destroy(hashmap, NULL);
+
+	label = l_strdup_printf("%s-hash", name);
+	bench_suite_report(set, label,
+			(double) hash_time / (N_ROUNDS * N_KEYS), "ns/op");
+	l_free(label);
+
+	label = l_strdup_printf("%s-lookup", name);
+	bench_suite_report(set, label,
+			(double) map_time / ((N_ROUNDS + 1) * N_KEYS), "ns/op");
+	l_free(label);
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *sets[] = {
+		"ifname", "dbus-name", "object-path", "interface", NULL
+	};
+	const struct preset *preset;
+	void **ptrs;
+	unsigned int i;
+
+	for (i = 0; sets[i]; i++) {
+		char **keys = make_keys(sets[i]);
+
+		for (preset = str_presets; preset->name; preset++)
+			bench_hash(sets[i], preset->name, preset->func,
+						(const void **) keys, true);
+
+		l_strv_free(keys);
+	}
+
+	/* Pointer keys, as used by maps created with l_hashmap_new() */
+	ptrs = l_new(void *, N_KEYS);
+
+	for (i = 0; i < N_KEYS; i++)
+		ptrs[i] = l_malloc(48);
+
+	for (preset = ptr_presets; preset->name; preset++)
+		bench_hash("pointer", preset->name,
+				preset->func ? preset->func : direct_hash,
+				(const void **) ptrs, false);
+
+	for (i = 0; i < N_KEYS; i++)
+		l_free(ptrs[i]);
+
+	l_free(ptrs);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,932 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include <ell/ell.h>
+#include <ell/useful.h>
+#include "bench.h"
+
+/*
+ * End-to-end load on l_tls, l_io, l_timeout and the main loop together:
+ * as a client it keeps a number of HTTPS connections open at the same time
+ * against a target and replaces every connection that is done until all
+ * the requests have been made, all on one main loop.  With --serve it is
+ * an HTTPS server for the client side to run against, possibly in another
+ * process or on another machine, reporting its own numbers on exit.
+ *
+ * Several loops are obtained by running several instances.
+ */
+
+#define MAX_HEADER_SIZE 4096
+#define READ_BUF_SIZE 16384
+
+struct bench;
+
+struct conn {
+	struct bench *bench;
+	struct l_io *io;
+	struct l_tls *tls;
+	struct l_timeout *timeout;
+	uint8_t *tx_buf;
+	size_t tx_len;
+	size_t tx_size;
+	char header[MAX_HEADER_SIZE + 1];
+	size_t header_len;
+	size_t body_left;
+	bool in_body;
+	bool until_close;
+	bool close_after;
+	unsigned int requests_left;
+	uint64_t handshake_start;
+	uint64_t request_start;
+	bool done;
+};
+
+struct bench {
+	bool serve;
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	const char *host;
+	const char *path;
+	unsigned int n_connections;
+	unsigned int n_requests;
+	unsigned int keep_alive;
+	unsigned int timeout;
+	bool resume;
+	size_t body_size;
+	void *ca_data;
+	size_t ca_len;
+	void *cert_data;
+	size_t cert_len;
+	void *key_data;
+	size_t key_len;
+	struct l_settings *client_cache;
+	struct l_tls_session_cache *server_cache;
+	char *request;
+	char *response;
+	struct l_io *listen_io;
+	unsigned int active;
+	unsigned int assigned;
+	unsigned int connections;
+	unsigned int handshakes;
+	unsigned int resumed;
+	unsigned int completed;
+	unsigned int failed;
+	unsigned int bad_status;
+	uint64_t *handshake_times;
+	uint64_t *latencies;
+	uint64_t start;
+	struct rusage usage;
+};
+
+static void report_percentiles(const char *prefix, uint64_t *values,
+				unsigned int n)
+{
+	static const struct {
+		const char *name;
+		unsigned int permille;
+	} points[] = {
+		{ "p50", 500 }, { "p90", 900 }, { "p99", 990 },
+		{ "p99.9", 999 }, { "max", 1000 },
+	};
+	unsigned int i;
+
+	if (!n)
+		return;
+
+	qsort(values, n, sizeof(uint64_t), bench_compare_u64);
+
+	for (i = 0; i < L_ARRAY_SIZE(points); i++) {
+		unsigned int idx = (uint64_t) n * points[i].permille / 1000;
+		char name[64];
+
+		snprintf(name, sizeof(name), "%s-%s", prefix, points[i].name);
+		bench_report(name, values[idx < n ? idx : n - 1], "us");
+	}
+}
+
+static uint64_t cpu_usec_since(const struct rusage *start)
+{
+	struct rusage now;
+
+	getrusage(RUSAGE_SELF, &now);
+
+	return (now.ru_utime.tv_sec - start->ru_utime.tv_sec) * 1000000ULL +
+		(now.ru_stime.tv_sec - start->ru_stime.tv_sec) * 1000000ULL +
+		now.ru_utime.tv_usec - start->ru_utime.tv_usec +
+		now.ru_stime.tv_usec - start->ru_stime.tv_usec;
+}
+
+static void client_start_connections(struct bench *bench);
+static void client_response_done(struct conn *conn);
+
+static void conn_free(void *user_data)
+{
+	struct conn *conn = user_data;
+
+	l_timeout_remove(conn->timeout);
+	l_tls_free(conn->tls);
+	l_io_destroy(conn->io);
+	l_free(conn->tx_buf);
+	l_free(conn);
+}
+
+/*
+ * Called from inside the l_tls and l_io callbacks so the objects are only
+ * freed once those have returned.
+ */
+static void conn_finish(struct conn *conn)
+{
+	struct bench *bench = conn->bench;
+
+	if (conn->done)
+		return;
+
+	conn->done = true;
+	bench->active -= 1;
+	bench->failed += conn->requests_left;
+
+	l_io_set_read_handler(conn->io, NULL, NULL, NULL);
+	l_io_set_write_handler(conn->io, NULL, NULL, NULL);
+	l_io_set_disconnect_handler(conn->io, NULL, NULL, NULL);
+	l_idle_oneshot(conn_free, conn, NULL);
+
+	if (bench->serve)
+		return;
+
+	client_start_connections(bench);
+
+	if (!bench->active)
+		l_main_quit();
+}
+
+static bool conn_flush(struct l_io *io, void *user_data)
+{
+	struct conn *conn = user_data;
+	ssize_t r;
+
+	r = send(l_io_get_fd(io), conn->tx_buf, conn->tx_len, MSG_NOSIGNAL);
+	if (r < 0) {
+		if (errno == EAGAIN)
+			return true;
+
+		conn_finish(conn);
+		return false;
+	}
+
+	conn->tx_len -= r;
+	memmove(conn->tx_buf, conn->tx_buf + r, conn->tx_len);
+
+	return conn->tx_len > 0;
+}
+
+/* Whatever the socket doesn't take right away waits for a write event */
+static void conn_tls_tx(const uint8_t *data, size_t len, void *user_data)
+{
+	struct conn *conn = user_data;
+	ssize_t r = 0;
+
+	if (conn->done)
+		return;
+
+	if (!conn->tx_len) {
+		r = send(l_io_get_fd(conn->io), data, len, MSG_NOSIGNAL);
+		if (r < 0 && errno != EAGAIN) {
+			conn_finish(conn);
+			return;
+		}
+
+		if (r == (ssize_t) len)
+			return;
+
+		if (r < 0)
+			r = 0;
+
+		l_io_set_write_handler(conn->io, conn_flush, conn, NULL);
+	}
+
+	if (conn->tx_len + len - r > conn->tx_size) {
+		conn->tx_size = (conn->tx_len + len - r) * 2;
+		conn->tx_buf = l_realloc(conn->tx_buf, conn->tx_size);
+	}
+
+	memcpy(conn->tx_buf + conn->tx_len, data + r, len - r);
+	conn->tx_len += len - r;
+}
+
+static bool conn_read(struct l_io *io, void *user_data)
+{
+	struct conn *conn = user_data;
+	uint8_t buf[READ_BUF_SIZE];
+	ssize_t r;
+
+	r = read(l_io_get_fd(io), buf, sizeof(buf));
+	if (r < 0 && errno == EAGAIN)
+		return true;
+
+	if (r <= 0) {
+		/* A remote close counts like a close_notify */
+		if (conn->in_body && conn->until_close)
+			client_response_done(conn);
+
+		conn_finish(conn);
+
+		return false;
+	}
+
+	l_tls_handle_rx(conn->tls, buf, r);
+
+	return true;
+}
+
+static void conn_disconnected(struct l_io *io, void *user_data)
+{
+	conn_finish(user_data);
+}
+
+static void conn_timeout(struct l_timeout *timeout, void *user_data)
+{
+	struct conn *conn = user_data;
+
+	fprintf(stderr, "Connection timed out\n");
+	conn_finish(conn);
+}
+
+/*
+ * Accumulates the header of an HTTP message, returns the number of bytes
+ * of @data that belong to it or -1 if it doesn't fit.  conn->in_body is
+ * set once the header is complete.
+ */
+static ssize_t conn_parse_header(struct conn *conn, const uint8_t *data,
+					size_t len)
+{
+	size_t prev_len = conn->header_len;
+	size_t copy = minsize(len, MAX_HEADER_SIZE - prev_len);
+	char *end;
+
+	memcpy(conn->header + prev_len, data, copy);
+	conn->header_len += copy;
+	conn->header[conn->header_len] = '\0';
+
+	end = strstr(conn->header + (prev_len > 3 ? prev_len - 3 : 0),
+			"\r\n\r\n");
+	if (!end)
+		return conn->header_len < MAX_HEADER_SIZE ? (ssize_t) len : -1;
+
+	end += 4;
+	conn->header_len = end - conn->header;
+	*end = '\0';
+	conn->in_body = true;
+
+	return conn->header_len - prev_len;
+}
+
+static void client_send_request(struct conn *conn)
+{
+	conn->request_start = l_time_now();
+	l_tls_write(conn->tls, (const uint8_t *) conn->bench->request,
+			strlen(conn->bench->request));
+}
+
+static void client_response_done(struct conn *conn)
+{
+	struct bench *bench = conn->bench;
+
+	bench->latencies[bench->completed++] =
+				l_time_now() - conn->request_start;
+	conn->requests_left -= 1;
+	conn->header_len = 0;
+	conn->in_body = false;
+}
+
+static void client_next_request(struct conn *conn)
+{
+	struct bench *bench = conn->bench;
+
+	if (conn->requests_left) {
+		l_timeout_modify(conn->timeout, bench->timeout);
+		client_send_request(conn);
+	} else
+		l_tls_close(conn->tls);
+}
+
+static void client_tls_rx(const uint8_t *data, size_t len, void *user_data)
+{
+	struct conn *conn = user_data;
+	struct bench *bench = conn->bench;
+
+	while (len && !conn->done) {
+		ssize_t used;
+		const char *value;
+
+		if (conn->in_body) {
+			size_t n = minsize(len, conn->until_close ?
+							len : conn->body_left);
+
+			data += n;
+			len -= n;
+			conn->body_left -= conn->until_close ? 0 : n;
+
+			if (!conn->until_close && !conn->body_left) {
+				client_response_done(conn);
+				client_next_request(conn);
+			}
+
+			continue;
+		}
+
+		used = conn_parse_header(conn, data, len);
+		if (used < 0) {
+			fprintf(stderr, "Response header too long\n");
+			l_tls_close(conn->tls);
+			return;
+		}
+
+		data += used;
+		len -= used;
+
+		if (!conn->in_body)
+			break;
+
+		if (strncmp(conn->header, "HTTP/1.1 2", 10) &&
+				strncmp(conn->header, "HTTP/1.0 2", 10))
+			bench->bad_status += 1;
+
+		value = strcasestr(conn->header, "\r\nContent-Length:");
+		if (value) {
+			conn->body_left = strtoul(value + 17, NULL, 10);
+			conn->until_close = false;
+		} else
+			conn->until_close = true;
+
+		if (!conn->until_close && !conn->body_left) {
+			client_response_done(conn);
+			client_next_request(conn);
+		}
+	}
+}
+
+static void client_tls_ready(const char *peer_identity, void *user_data)
+{
+	struct conn *conn = user_data;
+	struct bench *bench = conn->bench;
+
+	bench->handshake_times[bench->handshakes++] =
+				l_time_now() - conn->handshake_start;
+
+	if (l_tls_get_session_resumed(conn->tls))
+		bench->resumed += 1;
+
+	client_send_request(conn);
+}
+
+static void client_tls_disconnected(enum l_tls_alert_desc reason,
+					bool remote, void *user_data)
+{
+	struct conn *conn = user_data;
+
+	if (reason)
+		fprintf(stderr, "TLS error: %s\n", l_tls_alert_to_str(reason));
+	else if (conn->in_body && conn->until_close)
+		client_response_done(conn);
+
+	conn_finish(conn);
+}
+
+static bool client_connected(struct l_io *io, void *user_data)
+{
+	struct conn *conn = user_data;
+	struct bench *bench = conn->bench;
+	int err = 0;
+
+	getsockopt(l_io_get_fd(io), SOL_SOCKET, SO_ERROR, &err,
+			&(socklen_t) { sizeof(err) });
+	if (err) {
+		fprintf(stderr, "connect: %s\n", strerror(err));
+		conn_finish(conn);
+		return false;
+	}
+
+	conn->tls = l_tls_new(false, client_tls_rx, conn_tls_tx,
+				client_tls_ready, client_tls_disconnected,
+				conn);
+
+	if (bench->ca_data)
+		l_tls_set_cacert(conn->tls,
+				l_pem_load_certificate_list_from_data(
+						bench->ca_data,
+						bench->ca_len));
+
+	if (bench->resume)
+		l_tls_set_session_cache(conn->tls, bench->client_cache,
+					"bench", 3600 * L_USEC_PER_SEC, 0,
+					NULL, NULL);
+
+	l_io_set_read_handler(io, conn_read, conn, NULL);
+	conn->handshake_start = l_time_now();
+
+	if (!l_tls_start(conn->tls)) {
+		conn_finish(conn);
+		return false;
+	}
+
+	/* conn_tls_tx replaces this handler if the socket is full already */
+	return !conn->done && conn->tx_len;
+}
+
+static bool client_connect(struct bench *bench, unsigned int n_requests)
+{
+	struct conn *conn;
+	int fd;
+
+	fd = socket(bench->addr.ss_family,
+			SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		fprintf(stderr, "socket: %s\n", strerror(errno));
+		return false;
+	}
+
+	if (connect(fd, (struct sockaddr *) &bench->addr,
+			bench->addr_len) < 0 && errno != EINPROGRESS) {
+		fprintf(stderr, "connect: %s\n", strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	conn = l_new(struct conn, 1);
+	conn->bench = bench;
+	conn->requests_left = n_requests;
+	conn->io = l_io_new(fd);
+	l_io_set_close_on_destroy(conn->io, true);
+	l_io_set_write_handler(conn->io, client_connected, conn, NULL);
+	l_io_set_disconnect_handler(conn->io, conn_disconnected, conn, NULL);
+	conn->timeout = l_timeout_create(bench->timeout, conn_timeout,
+						conn, NULL);
+
+	bench->active += 1;
+	bench->connections += 1;
+
+	return true;
+}
+
+/* Keeps n_connections open until all the requests are handed out */
+static void client_start_connections(struct bench *bench)
+{
+	while (bench->active < bench->n_connections &&
+			bench->assigned < bench->n_requests) {
+		unsigned int n = minsize(bench->keep_alive,
+					bench->n_requests - bench->assigned);
+
+		bench->assigned += n;
+
+		if (!client_connect(bench, n)) {
+			bench->failed += n;
+			break;
+		}
+	}
+}
+
+static int client_run(struct bench *bench)
+{
+	uint64_t elapsed;
+	uint64_t cpu;
+
+	bench->client_cache = l_settings_new();
+	bench->handshake_times = l_new(uint64_t, bench->n_requests);
+	bench->latencies = l_new(uint64_t, bench->n_requests);
+	bench->request = l_strdup_printf("GET %s HTTP/1.1\r\n"
+					"Host: %s\r\n"
+					"Connection: %s\r\n"
+					"\r\n", bench->path, bench->host,
+					bench->keep_alive > 1 ?
+					"keep-alive" : "close");
+
+	bench->start = l_time_now();
+	getrusage(RUSAGE_SELF, &bench->usage);
+
+	client_start_connections(bench);
+
+	if (bench->active)
+		l_main_run();
+
+	elapsed = l_time_now() - bench->start;
+	cpu = cpu_usec_since(&bench->usage);
+
+	bench_report("connections", bench->connections, "conn");
+	bench_report("completed-requests", bench->completed, "req");
+	bench_report("failed-requests", bench->failed, "req");
+	bench_report("bad-status", bench->bad_status, "req");
+	bench_report("handshakes", bench->handshakes * 1000000.0 / elapsed,
+								"hs/s");
+	bench_report("resumed", bench->handshakes ?
+		bench->resumed * 100.0 / bench->handshakes : 0, "%");
+	bench_report("requests", bench->completed * 1000000.0 / elapsed,
+								"req/s");
+	bench_report("cpu", bench->connections ?
+		(double) cpu / bench->connections : 0, "us/conn");
+	report_percentiles("handshake", bench->handshake_times,
+				bench->handshakes);
+	report_percentiles("latency", bench->latencies, bench->completed);
+
+	l_free(bench->request);
+	l_free(bench->latencies);
+	l_free(bench->handshake_times);
+	l_settings_free(bench->client_cache);
+
+	return bench->completed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void server_tls_rx(const uint8_t *data, size_t len, void *user_data)
+{
+	struct conn *conn = user_data;
+	struct bench *bench = conn->bench;
+
+	/* Requests are expected to have no body, as GET requests */
+	while (len && !conn->done) {
+		ssize_t used = conn_parse_header(conn, data, len);
+
+		if (used < 0) {
+			l_tls_close(conn->tls);
+			return;
+		}
+
+		data += used;
+		len -= used;
+
+		if (!conn->in_body)
+			break;
+
+		conn->close_after = strcasestr(conn->header,
+						"\r\nConnection: close");
+		conn->header_len = 0;
+		conn->in_body = false;
+		bench->completed += 1;
+
+		l_tls_write(conn->tls, (const uint8_t *) bench->response,
+				strlen(bench->response));
+
+		if (conn->close_after) {
+			l_tls_close(conn->tls);
+			return;
+		}
+
+		l_timeout_modify(conn->timeout, bench->timeout);
+	}
+}
+
+static void server_tls_ready(const char *peer_identity, void *user_data)
+{
+	struct conn *conn = user_data;
+	struct bench *bench = conn->bench;
+
+	bench->handshakes += 1;
+
+	if (l_tls_get_session_resumed(conn->tls))
+		bench->resumed += 1;
+}
+
+static void server_tls_disconnected(enum l_tls_alert_desc reason,
+					bool remote, void *user_data)
+{
+	struct conn *conn = user_data;
+
+	if (reason)
+		conn->bench->failed += 1;
+
+	conn_finish(conn);
+}
+
+/* The l_tls objects take ownership so every connection parses its copy */
+static bool server_new_tls(struct conn *conn)
+{
+	struct bench *bench = conn->bench;
+	struct l_certchain *cert =
+		l_pem_load_certificate_chain_from_data(bench->cert_data,
+							bench->cert_len);
+	struct l_key *key =
+		l_pem_load_private_key_from_data(bench->key_data,
+							bench->key_len,
+							NULL, NULL);
+
+	conn->tls = l_tls_new(true, server_tls_rx, conn_tls_tx,
+				server_tls_ready, server_tls_disconnected,
+				conn);
+
+	if (!cert || !key || !l_tls_set_auth_data(conn->tls, cert, key)) {
+		l_certchain_free(cert);
+		l_key_free(key);
+		return false;
+	}
+
+	l_tls_set_server_session_cache(conn->tls, bench->server_cache);
+
+	return l_tls_start(conn->tls);
+}
+
+static bool server_accept(struct l_io *io, void *user_data)
+{
+	struct bench *bench = user_data;
+	int fd;
+
+	while ((fd = accept4(l_io_get_fd(io), NULL, NULL,
+				SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		struct conn *conn = l_new(struct conn, 1);
+
+		conn->bench = bench;
+		conn->io = l_io_new(fd);
+		l_io_set_close_on_destroy(conn->io, true);
+		l_io_set_read_handler(conn->io, conn_read, conn, NULL);
+		l_io_set_disconnect_handler(conn->io, conn_disconnected,
+						conn, NULL);
+		conn->timeout = l_timeout_create(bench->timeout,
+							conn_timeout, conn,
+							NULL);
+
+		bench->active += 1;
+		bench->connections += 1;
+
+		if (!server_new_tls(conn)) {
+			fprintf(stderr, "Failed to set up the TLS server\n");
+			conn_finish(conn);
+		}
+	}
+
+	if (errno != EAGAIN && errno != ECONNABORTED)
+		fprintf(stderr, "accept: %s\n", strerror(errno));
+
+	return true;
+}
+
+static void server_signal(uint32_t signo, void *user_data)
+{
+	switch (signo) {
+	case SIGINT:
+	case SIGTERM:
+		l_main_quit();
+		break;
+	}
+}
+
+static int server_run(struct bench *bench)
+{
+	char *body;
+	uint64_t elapsed;
+	uint64_t cpu;
+	int fd;
+
+	fd = socket(bench->addr.ss_family,
+			SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		fprintf(stderr, "socket: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &(int) { 1 }, sizeof(int));
+
+	if (bind(fd, (struct sockaddr *) &bench->addr, bench->addr_len) < 0 ||
+			listen(fd, SOMAXCONN) < 0) {
+		fprintf(stderr, "bind/listen: %s\n", strerror(errno));
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	bench->server_cache = l_tls_session_cache_new(0,
+						3600 * L_USEC_PER_SEC);
+
+	body = l_malloc(bench->body_size + 1);
+	memset(body, 'x', bench->body_size);
+	body[bench->body_size] = '\0';
+	bench->response = l_strdup_printf("HTTP/1.1 200 OK\r\n"
+					"Content-Type: text/plain\r\n"
+					"Content-Length: %zu\r\n"
+					"\r\n%s", bench->body_size, body);
+	l_free(body);
+
+	bench->listen_io = l_io_new(fd);
+	l_io_set_close_on_destroy(bench->listen_io, true);
+	l_io_set_read_handler(bench->listen_io, server_accept, bench, NULL);
+
+	bench->start = l_time_now();
+	getrusage(RUSAGE_SELF, &bench->usage);
+
+	l_main_run_with_signal(server_signal, NULL);
+
+	elapsed = l_time_now() - bench->start;
+	cpu = cpu_usec_since(&bench->usage);
+
+	bench_report("server-connections", bench->connections, "conn");
+	bench_report("server-requests", bench->completed, "req");
+	bench_report("server-tls-errors", bench->failed, "conn");
+	bench_report("server-handshakes",
+			bench->handshakes * 1000000.0 / elapsed, "hs/s");
+	bench_report("server-resumed", bench->handshakes ?
+		bench->resumed * 100.0 / bench->handshakes : 0, "%");
+	bench_report("server-cpu", bench->connections ?
+		(double) cpu / bench->connections : 0, "us/conn");
+
+	l_io_destroy(bench->listen_io);
+	l_free(bench->response);
+	l_tls_session_cache_free(bench->server_cache);
+
+	return EXIT_SUCCESS;
+}
+
+static bool resolve(struct bench *bench, const char *host, const char *port)
+{
+	struct addrinfo hints = {
+		.ai_socktype = SOCK_STREAM,
+		.ai_flags = bench->serve ? AI_PASSIVE : 0,
+	};
+	struct addrinfo *res;
+	int err;
+
+	err = getaddrinfo(host, port, &hints, &res);
+	if (err) {
+		fprintf(stderr, "%s: %s\n", host ?: port, gai_strerror(err));
+		return false;
+	}
+
+	memcpy(&bench->addr, res->ai_addr, res->ai_addrlen);
+	bench->addr_len = res->ai_addrlen;
+	freeaddrinfo(res);
+
+	return true;
+}
+
+/* Thousands of connections are more than the usual soft limit allows */
+static void raise_fd_limit(void)
+{
+	struct rlimit rlim;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0)
+		return;
+
+	rlim.rlim_cur = rlim.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rlim);
+}
+
+static void usage(const char *bin)
+{
+	printf("usage: %s [options] <host> <port>\n"
+		"       %s --serve [options] <server-chain.pem> "
+		"<server-key.pem> <port>\n"
+		"\t-c, --connections <n>\tConcurrent connections "
+		"(default 1000)\n"
+		"\t-n, --requests <n>\tTotal requests (default 10000)\n"
+		"\t-k, --keep-alive <n>\tRequests per connection "
+		"(default 1)\n"
+		"\t-p, --path <path>\tRequest path (default /)\n"
+		"\t-a, --cacert <file>\tVerify the server against these CAs\n"
+		"\t-R, --no-resume\t\tDon't resume TLS sessions\n"
+		"\t-t, --timeout <s>\tConnection idle timeout (default 10)\n"
+		"\t-S, --serve\t\tRun the server side\n"
+		"\t-b, --body <n>\t\tServer response body size "
+		"(default 64)\n"
+		"\t-h, --help\t\tShow help options\n", bin, bin);
+}
+
+static const struct option main_options[] = {
+	{ "connections",	required_argument,	NULL, 'c' },
+	{ "requests",		required_argument,	NULL, 'n' },
+	{ "keep-alive",		required_argument,	NULL, 'k' },
+	{ "path",		required_argument,	NULL, 'p' },
+	{ "cacert",		required_argument,	NULL, 'a' },
+	{ "no-resume",		no_argument,		NULL, 'R' },
+	{ "timeout",		required_argument,	NULL, 't' },
+	{ "serve",		no_argument,		NULL, 'S' },
+	{ "body",		required_argument,	NULL, 'b' },
+	{ "help",		no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	struct bench bench = {
+		.path = "/",
+		.n_connections = 1000,
+		.n_requests = 10000,
+		.keep_alive = 1,
+		.timeout = 10,
+		.resume = true,
+		.body_size = 64,
+	};
+	const char *ca_path = NULL;
+	int status = EXIT_FAILURE;
+
+	for (;;) {
+		int opt = getopt_long(argc, argv, "c:n:k:p:a:Rt:Sb:h",
+							main_options, NULL);
+
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'c':
+			bench.n_connections = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			bench.n_requests = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			bench.keep_alive = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			bench.path = optarg;
+			break;
+		case 'a':
+			ca_path = optarg;
+			break;
+		case 'R':
+			bench.resume = false;
+			break;
+		case 't':
+			bench.timeout = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			bench.serve = true;
+			break;
+		case 'b':
+			bench.body_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind != (bench.serve ? 3 : 2) || !bench.n_connections ||
+			!bench.n_requests || !bench.keep_alive ||
+			!bench.timeout) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!l_main_init()) {
+		fprintf(stderr, "Failed to initialize main loop\n");
+		return EXIT_FAILURE;
+	}
+
+	raise_fd_limit();
+
+	/* Loaded once, parsed by every connection, see server_new_tls */
+	if (bench.serve) {
+		bench.cert_data = l_file_get_contents(argv[optind],
+							&bench.cert_len);
+		bench.key_data = l_file_get_contents(argv[optind + 1],
+							&bench.key_len);
+
+		if (!bench.cert_data || !bench.key_data) {
+			fprintf(stderr, "Failed to read the certificate or "
+					"key\n");
+			goto done;
+		}
+
+		if (resolve(&bench, NULL, argv[optind + 2]))
+			status = server_run(&bench);
+
+		goto done;
+	}
+
+	if (ca_path) {
+		bench.ca_data = l_file_get_contents(ca_path, &bench.ca_len);
+		if (!bench.ca_data) {
+			fprintf(stderr, "Failed to read %s\n", ca_path);
+			goto done;
+		}
+	}
+
+	bench.host = argv[optind];
+
+	if (resolve(&bench, bench.host, argv[optind + 1]))
+		status = client_run(&bench);
+
+done:
+	l_free(bench.ca_data);
+	l_free(bench.cert_data);
+	l_free(bench.key_data);
+	l_main_exit();
+
+	return status;
+}
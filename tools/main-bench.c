@@ -0,0 +1,330 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include <ell/ell.h>
+#include "bench.h"
+
+#define N_DISPATCHES 1000000
+#define N_IDLES 1000
+#define N_TIMEOUTS 100000
+#define N_HOPS 200000
+#define N_ROUND_TRIPS 50000
+#define N_WATCHES 100000
+
+static unsigned int n_dispatched;
+
+static void idle_callback(struct l_idle *idle, void *user_data)
+{
+	n_dispatched++;
+}
+
+static void bench_idle(unsigned int n_idles, const char *name)
+{
+	struct l_idle **idles = l_new(struct l_idle *, n_idles);
+	uint64_t start;
+	unsigned int i;
+
+	for (i = 0; i < n_idles; i++)
+		idles[i] = l_idle_create(idle_callback, NULL, NULL);
+
+	n_dispatched = 0;
+	start = bench_now_ns(CLOCK_MONOTONIC);
+
+	while (n_dispatched < N_DISPATCHES)
+		l_main_iterate(0);
+
+	bench_report(name, (double) (bench_now_ns(CLOCK_MONOTONIC) - start) /
+						n_dispatched, "ns/dispatch");
+
+	for (i = 0; i < n_idles; i++)
+		l_idle_remove(idles[i]);
+
+	l_free(idles);
+}
+
+static void timeout_callback(struct l_timeout *timeout, void *user_data)
+{
+	n_dispatched++;
+	l_timeout_remove(timeout);
+}
+
+static void bench_timeouts(void)
+{
+	struct l_timeout **timeouts = l_new(struct l_timeout *, N_TIMEOUTS);
+	uint32_t state = 0x9e3779b9;
+	uint64_t start;
+	unsigned int i;
+
+	start = bench_now_ns(CLOCK_MONOTONIC);
+
+	for (i = 0; i < N_TIMEOUTS; i++)
+		timeouts[i] = l_timeout_create_ms(60000 + i % 1000,
+						timeout_callback, NULL, NULL);
+
+	bench_report("timeout-create",
+			(double) (bench_now_ns(CLOCK_MONOTONIC) - start) /
+			N_TIMEOUTS, "ns/op");
+
+	start = bench_now_ns(CLOCK_MONOTONIC);
+
+	for (i = 0; i < N_TIMEOUTS; i++) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		l_timeout_modify_ms(timeouts[i], 30000 + state % 60000);
+	}
+
+	bench_report("timeout-modify",
+			(double) (bench_now_ns(CLOCK_MONOTONIC) - start) /
+			N_TIMEOUTS, "ns/op");
+
+	start = bench_now_ns(CLOCK_MONOTONIC);
+
+	for (i = 0; i < N_TIMEOUTS; i++)
+		l_timeout_remove(timeouts[i]);
+
+	bench_report("timeout-remove",
+			(double) (bench_now_ns(CLOCK_MONOTONIC) - start) /
+			N_TIMEOUTS, "ns/op");
+
+	/*
+	 * Expiry is spread over 10ms.  The loop spends most of that time
+	 * waiting, so the CPU time of the thread is what gets reported.
+	 */
+	for (i = 0; i < N_TIMEOUTS; i++)
+		l_timeout_create_ms(1 + i % 10, timeout_callback, NULL, NULL);
+
+	n_dispatched = 0;
+	start = bench_now_ns(CLOCK_THREAD_CPUTIME_ID);
+
+	while (n_dispatched < N_TIMEOUTS)
+		l_main_iterate(-1);
+
+	bench_report("timeout-expiry",
+			(double) (bench_now_ns(CLOCK_THREAD_CPUTIME_ID) -
+			start) / N_TIMEOUTS, "cpu-ns/op");
+
+	l_free(timeouts);
+}
+
+struct hop {
+	struct l_io *io;
+	int peer_fd;
+};
+
+static bool hop_read(struct l_io *io, void *user_data)
+{
+	struct hop *hop = user_data;
+	uint64_t value;
+
+	if (read(l_io_get_fd(io), &value, sizeof(value)) < 0)
+		return true;
+
+	if (++n_dispatched < N_HOPS)
+		L_WARN_ON(write(hop->peer_fd, &value, sizeof(value)) < 0);
+
+	return true;
+}
+
+static void bench_ping_pong(const char *name)
+{
+	struct hop hops[2];
+	uint64_t one = 1;
+	uint64_t start;
+	int fds[2];
+	unsigned int i;
+
+	for (i = 0; i < 2; i++)
+		fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	for (i = 0; i < 2; i++) {
+		hops[i].io = l_io_new(fds[i]);
+		hops[i].peer_fd = fds[!i];
+		l_io_set_close_on_destroy(hops[i].io, true);
+		l_io_set_read_handler(hops[i].io, hop_read, &hops[i], NULL);
+	}
+
+	n_dispatched = 0;
+	start = bench_now_ns(CLOCK_MONOTONIC);
+	L_WARN_ON(write(fds[0], &one, sizeof(one)) < 0);
+
+	while (n_dispatched < N_HOPS)
+		l_main_iterate(-1);
+
+	bench_report(name, (double) (bench_now_ns(CLOCK_MONOTONIC) - start) /
+							N_HOPS, "ns/hop");
+
+	for (i = 0; i < 2; i++)
+		l_io_destroy(hops[i].io);
+}
+
+struct round_trip {
+	int request_fd;
+	int reply_fd;
+	uint64_t *samples;
+};
+
+static void *round_trip_thread(void *user_data)
+{
+	struct round_trip *rt = user_data;
+	uint64_t value = 1;
+	unsigned int i;
+
+	for (i = 0; i < N_ROUND_TRIPS; i++) {
+		uint64_t start = bench_now_ns(CLOCK_MONOTONIC);
+
+		if (write(rt->request_fd, &value, sizeof(value)) < 0 ||
+				read(rt->reply_fd, &value, sizeof(value)) < 0)
+			break;
+
+		rt->samples[i] = bench_now_ns(CLOCK_MONOTONIC) - start;
+	}
+
+	return NULL;
+}
+
+static bool round_trip_read(struct l_io *io, void *user_data)
+{
+	struct round_trip *rt = user_data;
+	uint64_t value;
+
+	if (read(l_io_get_fd(io), &value, sizeof(value)) < 0)
+		return true;
+
+	L_WARN_ON(write(rt->reply_fd, &value, sizeof(value)) < 0);
+	n_dispatched++;
+
+	return true;
+}
+
+/* Wakeup latency of the loop as seen from another thread */
+static void bench_cross_thread(void)
+{
+	struct round_trip rt;
+	struct l_io *io;
+	pthread_t thread;
+
+	rt.request_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	rt.reply_fd = eventfd(0, EFD_CLOEXEC);
+	rt.samples = l_new(uint64_t, N_ROUND_TRIPS);
+
+	io = l_io_new(rt.request_fd);
+	l_io_set_close_on_destroy(io, true);
+	l_io_set_read_handler(io, round_trip_read, &rt, NULL);
+
+	n_dispatched = 0;
+
+	if (pthread_create(&thread, NULL, round_trip_thread, &rt)) {
+		fprintf(stderr, "Failed to start thread\n");
+		exit(EXIT_FAILURE);
+	}
+
+	while (n_dispatched < N_ROUND_TRIPS)
+		l_main_iterate(-1);
+
+	pthread_join(thread, NULL);
+
+	qsort(rt.samples, N_ROUND_TRIPS, sizeof(uint64_t), bench_compare_u64);
+	bench_report("cross-thread-median", rt.samples[N_ROUND_TRIPS / 2],
+							"ns/round-trip");
+	bench_report("cross-thread-p99", rt.samples[N_ROUND_TRIPS * 99 / 100],
+							"ns/round-trip");
+
+	l_io_destroy(io);
+	close(rt.reply_fd);
+	l_free(rt.samples);
+}
+
+static bool idle_read(struct l_io *io, void *user_data)
+{
+	return true;
+}
+
+static void bench_many_watches(void)
+{
+	struct l_io **watches = l_new(struct l_io *, N_WATCHES);
+	unsigned int n_watches = N_WATCHES;
+	struct rlimit rlim;
+	uint64_t start;
+	unsigned int i;
+
+	/* Each watch needs its own fd, use as many as the hard limit allows */
+	if (!getrlimit(RLIMIT_NOFILE, &rlim)) {
+		rlim.rlim_cur = rlim.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rlim);
+
+		if (rlim.rlim_cur < N_WATCHES + 64)
+			n_watches = rlim.rlim_cur > 1088 ?
+						rlim.rlim_cur - 64 : 1024;
+	}
+
+	start = bench_now_ns(CLOCK_MONOTONIC);
+
+	for (i = 0; i < n_watches; i++) {
+		int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+		if (fd < 0)
+			break;
+
+		watches[i] = l_io_new(fd);
+		l_io_set_close_on_destroy(watches[i], true);
+		l_io_set_read_handler(watches[i], idle_read, NULL, NULL);
+	}
+
+	n_watches = i;
+	fprintf(stderr, "Registered %u watches\n", n_watches);
+
+	bench_report("watch-add",
+			(double) (bench_now_ns(CLOCK_MONOTONIC) - start) /
+			n_watches, "ns/op");
+
+	bench_ping_pong("ping-pong-many-watches");
+
+	start = bench_now_ns(CLOCK_MONOTONIC);
+
+	for (i = 0; i < n_watches; i++)
+		l_io_destroy(watches[i]);
+
+	bench_report("watch-remove",
+			(double) (bench_now_ns(CLOCK_MONOTONIC) - start) /
+			n_watches, "ns/op");
+
+	l_free(watches);
+}
+
+int main(int argc, char *argv[])
+{
+	if (!l_main_init()) {
+		fprintf(stderr, "Failed to initialize main loop\n");
+		return EXIT_FAILURE;
+	}
+
+	bench_idle(1, "idle-single");
+	bench_idle(N_IDLES, "idle-many");
+	bench_timeouts();
+	bench_ping_pong("ping-pong");
+	bench_cross_thread();
+	bench_many_watches();
+
+	l_main_exit();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,536 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <ell/ell.h>
+#include "ell/tls-private.h"
+#include "bench.h"
+
+/*
+ * Client and server l_tls objects in one process, connected through
+ * memory buffers, so that the numbers only reflect the TLS code and the
+ * crypto backend underneath it.
+ */
+struct bench_peer {
+	struct l_tls *tls;
+	struct bench_peer *other;
+	uint8_t *buf;
+	size_t buf_len;
+	size_t buf_size;
+	uint64_t rx_bytes;
+	bool ready;
+	bool failed;
+};
+
+struct bench_config {
+	const char *cert_path;
+	const char *key_path;
+	const char *ca_path;
+	struct l_certchain *server_cert;
+	struct l_key *server_key;
+	struct l_queue *ca_certs;
+	unsigned int n_handshakes;
+	size_t n_bytes;
+};
+
+#define MAX_RECORD_SIZE 16384
+
+static const size_t record_sizes[] = { 64, 512, 1400, 4096, MAX_RECORD_SIZE };
+
+static void peer_rx(const uint8_t *data, size_t len, void *user_data)
+{
+	struct bench_peer *peer = user_data;
+
+	peer->rx_bytes += len;
+}
+
+static void peer_tx(const uint8_t *data, size_t len, void *user_data)
+{
+	struct bench_peer *peer = user_data;
+
+	if (peer->buf_len + len > peer->buf_size) {
+		peer->buf_size = (peer->buf_len + len) * 2;
+		peer->buf = l_realloc(peer->buf, peer->buf_size);
+	}
+
+	memcpy(peer->buf + peer->buf_len, data, len);
+	peer->buf_len += len;
+}
+
+static void peer_ready(const char *peer_identity, void *user_data)
+{
+	struct bench_peer *peer = user_data;
+
+	peer->ready = true;
+}
+
+static void peer_disconnected(enum l_tls_alert_desc reason, bool remote,
+				void *user_data)
+{
+	struct bench_peer *peer = user_data;
+
+	peer->failed = true;
+}
+
+/* Deliver whatever either side has written until both go quiet */
+static void pump(struct bench_peer *peers)
+{
+	while (!peers[0].failed && !peers[1].failed) {
+		struct bench_peer *from;
+
+		if (peers[0].buf_len)
+			from = &peers[0];
+		else if (peers[1].buf_len)
+			from = &peers[1];
+		else
+			break;
+
+		l_tls_handle_rx(from->other->tls, from->buf, from->buf_len);
+		from->buf_len = 0;
+	}
+}
+
+static void ca_certs_free(struct l_queue *ca_certs)
+{
+	l_queue_destroy(ca_certs, (l_queue_destroy_func_t) l_cert_free);
+}
+
+/*
+ * The l_tls objects take ownership of the certificates and the key so each
+ * connection loads its own copies, this is done before the clock starts.
+ */
+static bool new_server_auth(struct l_tls *tls,
+				const struct bench_config *config)
+{
+	struct l_certchain *cert =
+		l_pem_load_certificate_chain(config->cert_path);
+	struct l_key *key = l_pem_load_private_key(config->key_path,
+							NULL, NULL);
+
+	if (cert && key && l_tls_set_auth_data(tls, cert, key))
+		return true;
+
+	l_certchain_free(cert);
+	l_key_free(key);
+	return false;
+}
+
+static bool new_peers(struct bench_peer *peers,
+			const struct bench_config *config,
+			const char *suite_name,
+			struct l_tls_session_cache *server_cache,
+			struct l_settings *client_cache)
+{
+	const char *suites[] = { suite_name, NULL };
+	struct l_queue *ca_certs;
+	unsigned int i;
+
+	for (i = 0; i < 2; i++) {
+		peers[i].buf_len = 0;
+		peers[i].rx_bytes = 0;
+		peers[i].ready = false;
+		peers[i].failed = false;
+		peers[i].other = &peers[!i];
+		peers[i].tls = l_tls_new(i == 0, peer_rx, peer_tx, peer_ready,
+						peer_disconnected, &peers[i]);
+		if (!peers[i].tls)
+			return false;
+	}
+
+	if (!new_server_auth(peers[0].tls, config) ||
+			!l_tls_set_server_session_cache(peers[0].tls,
+							server_cache) ||
+			!tls_set_cipher_suites(peers[1].tls, suites))
+		return false;
+
+	ca_certs = l_pem_load_certificate_list(config->ca_path);
+	if (!ca_certs || !l_tls_set_cacert(peers[1].tls, ca_certs)) {
+		ca_certs_free(ca_certs);
+		return false;
+	}
+
+	if (client_cache)
+		l_tls_set_session_cache(peers[1].tls, client_cache, "bench",
+					3600 * L_USEC_PER_SEC, 1, NULL, NULL);
+
+	return true;
+}
+
+static bool connect_peers(struct bench_peer *peers)
+{
+	if (!l_tls_start(peers[0].tls) || !l_tls_start(peers[1].tls))
+		return false;
+
+	pump(peers);
+
+	return peers[0].ready && peers[1].ready;
+}
+
+static void free_peers(struct bench_peer *peers)
+{
+	l_tls_free(peers[0].tls);
+	l_tls_free(peers[1].tls);
+	peers[0].tls = NULL;
+	peers[1].tls = NULL;
+}
+
+static bool bench_handshakes(const struct bench_config *config,
+				const char *suite, bool resumed)
+{
+	struct l_tls_session_cache *server_cache =
+		l_tls_session_cache_new(16, 3600 * L_USEC_PER_SEC);
+	struct l_settings *client_cache = resumed ? l_settings_new() : NULL;
+	struct bench_peer peers[2] = {};
+	uint64_t start, elapsed = 0;
+	unsigned int i;
+	bool ok = true;
+
+	/* Prime both caches, not counted */
+	if (resumed) {
+		ok = new_peers(peers, config, suite, server_cache,
+				client_cache) && connect_peers(peers);
+		free_peers(peers);
+	}
+
+	for (i = 0; ok && i < config->n_handshakes; i++) {
+		ok = new_peers(peers, config, suite, server_cache,
+				client_cache);
+
+		if (ok) {
+			start = l_time_now();
+			ok = connect_peers(peers);
+			elapsed += l_time_now() - start;
+		}
+
+		if (ok && resumed)
+			ok = l_tls_get_session_resumed(peers[1].tls);
+
+		free_peers(peers);
+	}
+
+	if (ok)
+		bench_suite_report(suite, resumed ? "resumed-handshakes" :
+				"full-handshakes",
+				config->n_handshakes * 1000000.0 / elapsed,
+				"hs/s");
+
+	l_free(peers[0].buf);
+	l_free(peers[1].buf);
+	l_settings_free(client_cache);
+	l_tls_session_cache_free(server_cache);
+	return ok;
+}
+
+static bool bench_records(const struct bench_config *config,
+				const char *suite)
+{
+	struct l_tls_session_cache *server_cache =
+		l_tls_session_cache_new(1, 3600 * L_USEC_PER_SEC);
+	struct bench_peer peers[2] = {};
+	uint8_t *data = l_malloc(MAX_RECORD_SIZE);
+	unsigned int i;
+	bool ok;
+
+	memset(data, 0x5a, MAX_RECORD_SIZE);
+
+	ok = new_peers(peers, config, suite, server_cache, NULL) &&
+		connect_peers(peers);
+
+	for (i = 0; ok && i < L_ARRAY_SIZE(record_sizes); i++) {
+		size_t size = record_sizes[i];
+		size_t count = config->n_bytes / size ?: 1;
+		uint64_t start = l_time_now();
+		uint64_t elapsed;
+		char name[64];
+		size_t n;
+
+		peers[0].rx_bytes = 0;
+
+		for (n = 0; n < count; n++) {
+			l_tls_write(peers[1].tls, data, size);
+			pump(peers);
+		}
+
+		elapsed = l_time_now() - start;
+		ok = peers[0].rx_bytes == count * size;
+
+		snprintf(name, sizeof(name), "records-%zu", size);
+		bench_suite_report(suite, name,
+				(double) count * size / elapsed, "MB/s");
+	}
+
+	free_peers(peers);
+	l_free(peers[0].buf);
+	l_free(peers[1].buf);
+	l_free(data);
+	l_tls_session_cache_free(server_cache);
+	return ok;
+}
+
+/*
+ * The handshake phases are timed separately with the same primitives the
+ * TLS code uses since the library has no instrumentation points: the
+ * key_block derivation for the PRF, one key exchange as done by the two
+ * sides together, and the chain verification done by the client.  The
+ * record crypto cost is what bench_records reports.
+ */
+#define PHASE_ROUNDS 100
+
+static void bench_phase_prf(const char *suite_name,
+				const struct tls_cipher_suite *suite)
+{
+	enum l_checksum_type hmac = suite->prf_hmac != L_CHECKSUM_NONE ?
+					suite->prf_hmac : L_CHECKSUM_SHA256;
+	uint8_t master_secret[48] = {};
+	uint8_t seed[64] = {};
+	uint8_t key_block[136];
+	uint64_t start = l_time_now();
+	unsigned int i;
+
+	for (i = 0; i < PHASE_ROUNDS; i++)
+		if (!tls12_prf(hmac, master_secret, sizeof(master_secret),
+				"key expansion", seed, sizeof(seed),
+				key_block, sizeof(key_block)))
+			return;
+
+	bench_suite_report(suite_name, "phase-prf",
+		(double) (l_time_now() - start) / PHASE_ROUNDS, "us");
+}
+
+static bool kex_ecdhe(const struct bench_config *config)
+{
+	const struct l_ecc_curve *curve = l_ecc_curve_from_tls_group(23);
+	struct l_ecc_scalar *priv[2] = {};
+	struct l_ecc_point *pub[2] = {};
+	struct l_ecc_scalar *secret[2] = {};
+	unsigned int i;
+	bool ok;
+
+	ok = l_ecdh_generate_key_pair(curve, &priv[0], &pub[0]) &&
+		l_ecdh_generate_key_pair(curve, &priv[1], &pub[1]) &&
+		l_ecdh_generate_shared_secret(priv[0], pub[1], &secret[0]) &&
+		l_ecdh_generate_shared_secret(priv[1], pub[0], &secret[1]);
+
+	for (i = 0; i < 2; i++) {
+		l_ecc_scalar_free(priv[i]);
+		l_ecc_point_free(pub[i]);
+		l_ecc_scalar_free(secret[i]);
+	}
+
+	return ok;
+}
+
+static bool kex_rsa(const struct bench_config *config)
+{
+	struct l_cert *cert = l_certchain_get_leaf(config->server_cert);
+	struct l_key *pubkey = l_cert_get_pubkey(cert);
+	uint8_t pre_master_secret[48] = { 0x03, 0x03 };
+	uint8_t encrypted[1024];
+	uint8_t decrypted[1024];
+	size_t bits;
+	ssize_t len;
+	bool ok = false;
+
+	if (!pubkey || !l_key_get_info(pubkey, L_KEY_RSA_PKCS1_V1_5,
+					L_CHECKSUM_NONE, &bits, NULL) ||
+			bits / 8 > sizeof(encrypted))
+		goto done;
+
+	len = l_key_encrypt(pubkey, L_KEY_RSA_PKCS1_V1_5, L_CHECKSUM_NONE,
+				pre_master_secret, encrypted,
+				sizeof(pre_master_secret), bits / 8);
+	if (len < 0)
+		goto done;
+
+	len = l_key_decrypt(config->server_key, L_KEY_RSA_PKCS1_V1_5,
+				L_CHECKSUM_NONE, encrypted, decrypted,
+				len, sizeof(decrypted));
+	ok = len == sizeof(pre_master_secret);
+
+done:
+	l_key_free(pubkey);
+	return ok;
+}
+
+static void bench_phase_kex(const struct bench_config *config,
+				const char *suite_name,
+				const struct tls_cipher_suite *suite)
+{
+	bool (*kex)(const struct bench_config *config);
+	uint64_t start;
+	unsigned int i;
+
+	/* No standalone equivalent for the FFDH exchange, left out */
+	if (suite->key_xchg->need_ffdh)
+		return;
+
+	kex = suite->key_xchg->need_ecc ? kex_ecdhe : kex_rsa;
+	start = l_time_now();
+
+	for (i = 0; i < PHASE_ROUNDS; i++)
+		if (!kex(config))
+			return;
+
+	bench_suite_report(suite_name, "phase-key-exchange",
+		(double) (l_time_now() - start) / PHASE_ROUNDS, "us");
+}
+
+static void bench_phase_cert_verify(const struct bench_config *config)
+{
+	uint64_t start = l_time_now();
+	unsigned int i;
+
+	for (i = 0; i < PHASE_ROUNDS; i++)
+		if (!l_certchain_verify(config->server_cert, config->ca_certs,
+					NULL))
+			return;
+
+	bench_suite_report("*", "phase-cert-verify",
+		(double) (l_time_now() - start) / PHASE_ROUNDS, "us");
+}
+
+static bool suite_is_usable(const struct bench_config *config,
+				const struct tls_cipher_suite *suite)
+{
+	struct tls_bulk_encryption_algorithm *alg = suite->encryption;
+	struct l_tls *tls;
+	bool usable;
+
+	if (alg->cipher_type == TLS_CIPHER_AEAD) {
+		if (!l_aead_cipher_is_supported(alg->l_aead_id))
+			return false;
+	} else if (!l_cipher_is_supported(alg->l_id))
+		return false;
+
+	/* Make sure the suite can be used with the server's key */
+	tls = l_tls_new(true, peer_rx, peer_tx, peer_ready,
+			peer_disconnected, NULL);
+	usable = tls && new_server_auth(tls, config) &&
+		tls_cipher_suite_is_compatible(tls, suite, NULL);
+	l_tls_free(tls);
+
+	return usable;
+}
+
+static void usage(const char *bin)
+{
+	printf("usage: %s [options] <server-chain.pem> <server-key.pem> "
+		"<ca.pem>\n"
+		"\t-s, --suite <name>\tOnly benchmark this cipher suite\n"
+		"\t-n, --handshakes <n>\tHandshakes per suite and type "
+		"(default 100)\n"
+		"\t-b, --bytes <n>\t\tBytes sent per record size "
+		"(default 4194304)\n"
+		"\t-h, --help\t\tShow help options\n", bin);
+}
+
+static const struct option main_options[] = {
+	{ "suite",	required_argument,	NULL, 's' },
+	{ "handshakes",	required_argument,	NULL, 'n' },
+	{ "bytes",	required_argument,	NULL, 'b' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	struct bench_config config = {
+		.n_handshakes = 100,
+		.n_bytes = 4 * 1024 * 1024,
+	};
+	const char *only_suite = NULL;
+	unsigned int i;
+	int status = EXIT_SUCCESS;
+
+	for (;;) {
+		int opt = getopt_long(argc, argv, "s:n:b:h", main_options,
+									NULL);
+
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 's':
+			only_suite = optarg;
+			break;
+		case 'n':
+			config.n_handshakes = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			config.n_bytes = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind != 3 || !config.n_handshakes || !config.n_bytes) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	config.cert_path = argv[optind];
+	config.key_path = argv[optind + 1];
+	config.ca_path = argv[optind + 2];
+
+	/* Copies for the phase benchmarks */
+	config.server_cert = l_pem_load_certificate_chain(config.cert_path);
+	config.server_key = l_pem_load_private_key(config.key_path, NULL,
+							NULL);
+	config.ca_certs = l_pem_load_certificate_list(config.ca_path);
+
+	if (!config.server_cert || !config.server_key || !config.ca_certs) {
+		fprintf(stderr, "Failed to load the certificates or key\n");
+		status = EXIT_FAILURE;
+		goto done;
+	}
+
+	bench_phase_cert_verify(&config);
+
+	for (i = 0; tls_cipher_suite_pref[i]; i++) {
+		struct tls_cipher_suite *suite = tls_cipher_suite_pref[i];
+
+		if (only_suite && strcmp(only_suite, suite->name))
+			continue;
+
+		if (!suite_is_usable(&config, suite)) {
+			fprintf(stderr, "Skipping %s\n", suite->name);
+			continue;
+		}
+
+		if (!bench_handshakes(&config, suite->name, false) ||
+				!bench_handshakes(&config, suite->name, true) ||
+				!bench_records(&config, suite->name)) {
+			fprintf(stderr, "%s failed\n", suite->name);
+			status = EXIT_FAILURE;
+			continue;
+		}
+
+		bench_phase_prf(suite->name, suite);
+		bench_phase_kex(&config, suite->name, suite);
+	}
+
+done:
+	l_certchain_free(config.server_cert);
+	l_key_free(config.server_key);
+	ca_certs_free(config.ca_certs);
+
+	return status;
+}
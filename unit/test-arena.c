@@ -0,0 +1,158 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ell/ell.h>
+
+static void test_alloc(const void *data)
+{
+	struct l_arena *arena;
+	uint64_t *words[500];
+	uint8_t *big;
+	unsigned int i;
+
+	arena = l_arena_new(0);
+	assert(arena);
+
+	for (i = 0; i < L_ARRAY_SIZE(words); i++) {
+		words[i] = l_arena_alloc(arena, (i % 5 + 1) * sizeof(uint64_t));
+		assert(words[i]);
+		assert(((uintptr_t) words[i] & (__alignof__(max_align_t) - 1))
+								== 0);
+		words[i][0] = i;
+	}
+
+	/* Larger than a chunk, gets a block of its own */
+	big = l_arena_alloc0(arena, 10000);
+	assert(big);
+	assert(!big[0] && !big[9999]);
+
+	for (i = 0; i < L_ARRAY_SIZE(words); i++)
+		assert(words[i][0] == i);
+
+	assert(!l_arena_alloc(NULL, 8));
+
+	l_arena_free(arena);
+	l_arena_free(NULL);
+}
+
+static void test_mark_reset(const void *data)
+{
+	struct l_arena *arena;
+	const void *mark;
+	char *keep;
+	char *first;
+	char *str;
+	unsigned int i;
+
+	arena = l_arena_new(256);
+
+	/* Resetting an unused arena is fine */
+	l_arena_reset(arena, l_arena_mark(arena));
+
+	keep = l_arena_strdup(arena, "keep");
+	mark = l_arena_mark(arena);
+
+	first = l_arena_strdup(arena, "first");
+
+	/* Spill over a few chunks */
+	for (i = 0; i < 100; i++) {
+		str = l_arena_strdup_printf(arena, "string %u", i);
+		assert(!strcmp(str, l_arena_strdup_printf(arena, "string %u",
+									i)));
+	}
+
+	l_arena_reset(arena, mark);
+	assert(!strcmp(keep, "keep"));
+
+	/* Allocation restarts from the mark */
+	assert(l_arena_strdup(arena, "again") == first);
+
+	l_arena_reset(arena, NULL);
+	assert(!l_arena_mark(arena));
+
+	str = l_arena_strdup(arena, "reused");
+	assert(!strcmp(str, "reused"));
+
+	l_arena_free(arena);
+}
+
+static void test_strings(const void *data)
+{
+	static const uint8_t blob[5] = { 1, 2, 3, 4, 5 };
+	struct l_arena *arena;
+	char **strv;
+	char *str;
+	uint8_t *mem;
+
+	arena = l_arena_new(0);
+
+	str = l_arena_strndup(arena, "abcdef", 3);
+	assert(!strcmp(str, "abc"));
+	assert(!l_arena_strdup(arena, NULL));
+
+	mem = l_arena_memdup(arena, blob, sizeof(blob));
+	assert(!memcmp(mem, blob, sizeof(blob)));
+
+	str = l_arena_strdup_printf(arena, "%s-%d", "x", 42);
+	assert(!strcmp(str, "x-42"));
+
+	strv = l_arena_strsplit(arena, "a,,bc,", ',');
+	assert(l_strv_length(strv) == 4);
+	assert(!strcmp(strv[0], "a"));
+	assert(!strcmp(strv[1], ""));
+	assert(!strcmp(strv[2], "bc"));
+	assert(!strcmp(strv[3], ""));
+
+	strv = l_arena_strsplit(arena, "", ',');
+	assert(strv && !strv[0]);
+
+	l_arena_free(arena);
+}
+
+static void test_settings(const void *data)
+{
+	static const char config[] = "[Group]\n"
+					"Key=Value\\swith\\tescapes\n"
+					"Bad=Value\\q\n";
+	struct l_settings *settings;
+	struct l_arena *arena;
+	char *str;
+
+	settings = l_settings_new();
+	assert(l_settings_load_from_data(settings, config, strlen(config)));
+
+	arena = l_arena_new(0);
+
+	str = l_settings_get_string_arena(settings, "Group", "Key", arena);
+	assert(!strcmp(str, "Value with\tescapes"));
+
+	assert(!l_settings_get_string_arena(settings, "Group", "Bad", arena));
+	assert(!l_settings_get_string_arena(settings, "Group", "None", arena));
+
+	l_arena_free(arena);
+	l_settings_free(settings);
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Arena alloc", test_alloc, NULL);
+	l_test_add("Arena mark and reset", test_mark_reset, NULL);
+	l_test_add("Arena strings", test_strings, NULL);
+	l_test_add("Arena settings", test_settings, NULL);
+
+	return l_test_run();
+}
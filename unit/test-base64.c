@@ -10,9 +10,12 @@
 #endif
 
 #include <assert.h>
+#include <errno.h>
 
 #include <ell/ell.h>
 
+#include "ell/useful.h"
+
 struct base64_decode_test {
 	const char *input;
 	size_t input_size;
@@ -151,6 +154,98 @@ static void test_base64_encode(const void *data)
 	l_free(encoded);
 }
 
+static void test_base64_decode_into(const void *data)
+{
+	const struct base64_decode_test *test = data;
+	uint8_t buf[16];
+	ssize_t r;
+
+	r = l_base64_decode_into(test->input, strlen(test->input),
+					buf, sizeof(buf));
+	assert(r == (ssize_t) test->output_size);
+	assert(!memcmp(buf, test->output, r));
+
+	r = l_base64_decode_into(test->input, strlen(test->input),
+					buf, test->output_size - 1);
+	assert(r == -ENOSPC);
+}
+
+/* Long enough for the vectorized paths, with lines split at odd places */
+static void test_base64_long(const void *data)
+{
+	uint8_t input[1000];
+	uint8_t output[1000];
+	struct l_base64_decoder *decoder;
+	size_t encoded_len;
+	size_t decoded_len;
+	size_t pos, chunk;
+	char *encoded;
+	uint8_t *decoded;
+	unsigned int i;
+	ssize_t r;
+
+	for (i = 0; i < sizeof(input); i++)
+		input[i] = i * 7 + (i >> 3);
+
+	encoded = l_base64_encode(input, sizeof(input), 64);
+	assert(encoded);
+	encoded_len = strlen(encoded);
+	assert(encoded_len == 1336 + (1336 - 4) / 64);
+
+	for (i = 0; i < encoded_len; i++) {
+		if ((i + 1) % 65)
+			assert(encoded[i] != '\n');
+		else
+			assert(encoded[i] == '\n');
+	}
+
+	decoded = l_base64_decode(encoded, encoded_len, &decoded_len);
+	assert(decoded);
+	assert(decoded_len == sizeof(input));
+	assert(!memcmp(decoded, input, sizeof(input)));
+	l_free(decoded);
+
+	r = l_base64_decode_into(encoded, encoded_len, output, sizeof(output));
+	assert(r == sizeof(input));
+	assert(!memcmp(output, input, sizeof(input)));
+
+	decoder = l_base64_decoder_new();
+
+	for (chunk = 1; chunk < 100; chunk += 13) {
+		decoded_len = 0;
+
+		for (pos = 0; pos < encoded_len; pos += chunk) {
+			size_t len = minsize(chunk, encoded_len - pos);
+
+			r = l_base64_decoder_update(decoder, encoded + pos, len,
+						output + decoded_len,
+						(len + 3) / 4 * 3);
+			assert(r >= 0);
+			decoded_len += r;
+		}
+
+		r = l_base64_decoder_finish(decoder, output + decoded_len, 2);
+		assert(r == 1);
+		decoded_len += r;
+
+		assert(decoded_len == sizeof(input));
+		assert(!memcmp(output, input, sizeof(input)));
+	}
+
+	/* Truncated input */
+	r = l_base64_decoder_update(decoder, encoded, 6, output, 6);
+	assert(r == 3);
+	assert(l_base64_decoder_finish(decoder, output, 2) == -EINVAL);
+	l_base64_decoder_free(decoder);
+
+	/* Bad character in the middle of a vectorized block */
+	encoded[500] = '.';
+	assert(l_base64_decode_into(encoded, encoded_len, output,
+					sizeof(output)) == -EINVAL);
+
+	l_free(encoded);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -165,10 +260,17 @@ int main(int argc, char *argv[])
 	l_test_add("base64/decode/test8", test_base64_error, &error_4);
 	l_test_add("base64/decode/test9", test_base64_error, &error_5);
 
+	l_test_add("base64/decode-into/test1", test_base64_decode_into,
+								&decode_1);
+	l_test_add("base64/decode-into/test2", test_base64_decode_into,
+								&decode_3);
+
 	l_test_add("base64/encode/test1", test_base64_encode, &encode_1);
 	l_test_add("base64/encode/test2", test_base64_encode, &encode_2);
 	l_test_add("base64/encode/test3", test_base64_encode, &encode_3);
 	l_test_add("base64/encode/test4", test_base64_encode, &encode_4);
 
+	l_test_add("base64/long", test_base64_long, NULL);
+
 	return l_test_run();
 }
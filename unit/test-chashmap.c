@@ -0,0 +1,204 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+#include <ell/ell.h>
+
+#define N_KEYS		256
+#define N_READERS	4
+#define FREED		0xdeadbeef
+
+static void test_ptr(const void *test_data)
+{
+	struct l_chashmap *chashmap;
+	void *old;
+	unsigned int i;
+
+	chashmap = l_chashmap_new();
+	assert(chashmap);
+	assert(l_chashmap_isempty(chashmap));
+
+	for (i = 1; i <= 10000; i++)
+		assert(l_chashmap_insert(chashmap, L_UINT_TO_PTR(i),
+							L_UINT_TO_PTR(i)));
+
+	assert(l_chashmap_size(chashmap) == 10000);
+
+	for (i = 1; i <= 10000; i++)
+		assert(l_chashmap_lookup(chashmap, L_UINT_TO_PTR(i)) ==
+							L_UINT_TO_PTR(i));
+
+	assert(!l_chashmap_lookup(chashmap, L_UINT_TO_PTR(10001)));
+
+	assert(l_chashmap_replace(chashmap, L_UINT_TO_PTR(5),
+						L_UINT_TO_PTR(50), &old));
+	assert(old == L_UINT_TO_PTR(5));
+	assert(l_chashmap_lookup(chashmap, L_UINT_TO_PTR(5)) ==
+							L_UINT_TO_PTR(50));
+	assert(l_chashmap_replace(chashmap, L_UINT_TO_PTR(10001),
+						L_UINT_TO_PTR(1), &old));
+	assert(!old);
+	assert(l_chashmap_size(chashmap) == 10001);
+
+	for (i = 1; i <= 10000; i += 2)
+		assert(l_chashmap_remove(chashmap, L_UINT_TO_PTR(i)));
+
+	assert(!l_chashmap_remove(chashmap, L_UINT_TO_PTR(1)));
+	assert(l_chashmap_size(chashmap) == 5001);
+
+	for (i = 1; i <= 10000; i++)
+		assert(!!l_chashmap_lookup(chashmap, L_UINT_TO_PTR(i)) ==
+								!(i & 1));
+
+	l_chashmap_destroy(chashmap, NULL);
+}
+
+static void count_entries(const void *key, void *value, void *user_data)
+{
+	unsigned int *count = user_data;
+
+	*count += L_PTR_TO_UINT(value);
+}
+
+static void test_string(const void *test_data)
+{
+	struct l_chashmap *chashmap;
+	char key[] = "key";
+	unsigned int count = 0;
+
+	chashmap = l_chashmap_string_new();
+	assert(chashmap);
+
+	assert(l_chashmap_insert(chashmap, key, L_UINT_TO_PTR(1)));
+	assert(l_chashmap_insert(chashmap, "key", L_UINT_TO_PTR(2)));
+	assert(l_chashmap_insert(chashmap, "other", L_UINT_TO_PTR(4)));
+
+	/* Keys are copied */
+	key[0] = 'x';
+	assert(!l_chashmap_lookup(chashmap, key));
+
+	/* Of duplicate keys, the first inserted is found and removed first */
+	assert(l_chashmap_lookup(chashmap, "key") == L_UINT_TO_PTR(1));
+
+	l_chashmap_foreach(chashmap, count_entries, &count);
+	assert(count == 7);
+
+	assert(l_chashmap_remove(chashmap, "key") == L_UINT_TO_PTR(1));
+	assert(l_chashmap_lookup(chashmap, "key") == L_UINT_TO_PTR(2));
+
+	assert(!l_chashmap_set_hash_function(chashmap, l_str_hash));
+
+	l_chashmap_destroy(chashmap, NULL);
+}
+
+struct concurrent_data {
+	struct l_chashmap *chashmap;
+	bool done;
+	unsigned int lookups;
+};
+
+static void *reader_thread(void *user_data)
+{
+	struct concurrent_data *data = user_data;
+	unsigned int lookups = 0;
+	unsigned int i = 0;
+
+	do {
+		unsigned int token = l_chashmap_read_lock(data->chashmap);
+		unsigned int *value;
+
+		value = l_chashmap_lookup(data->chashmap, L_UINT_TO_PTR(i + 1));
+
+		/* A removed or replaced value is never freed under our feet */
+		if (value)
+			assert(*value == i + 1);
+
+		l_chashmap_read_unlock(data->chashmap, token);
+
+		i = (i + 1) % N_KEYS;
+		lookups++;
+	} while (!__atomic_load_n(&data->done, __ATOMIC_ACQUIRE));
+
+	__atomic_fetch_add(&data->lookups, lookups, __ATOMIC_RELAXED);
+
+	return NULL;
+}
+
+static void free_value(void *value)
+{
+	unsigned int *v = value;
+
+	*v = FREED;
+	l_free(v);
+}
+
+static unsigned int *new_value(unsigned int i)
+{
+	unsigned int *v = l_new(unsigned int, 1);
+
+	*v = i;
+
+	return v;
+}
+
+static void test_concurrent(const void *test_data)
+{
+	struct concurrent_data data = {};
+	pthread_t threads[N_READERS];
+	unsigned int round;
+	unsigned int i;
+
+	data.chashmap = l_chashmap_new();
+
+	for (i = 0; i < N_READERS; i++)
+		assert(!pthread_create(&threads[i], NULL, reader_thread,
+									&data));
+
+	for (round = 0; round < 20; round++) {
+		for (i = 1; i <= N_KEYS; i++) {
+			void *old;
+
+			assert(l_chashmap_replace(data.chashmap,
+						L_UINT_TO_PTR(i),
+						new_value(i), &old));
+
+			if (old)
+				free_value(old);
+		}
+
+		for (i = 1; i <= N_KEYS; i += round % 3 + 1)
+			free_value(l_chashmap_remove(data.chashmap,
+							L_UINT_TO_PTR(i)));
+	}
+
+	__atomic_store_n(&data.done, true, __ATOMIC_RELEASE);
+
+	for (i = 0; i < N_READERS; i++)
+		assert(!pthread_join(threads[i], NULL));
+
+	assert(data.lookups >= N_READERS);
+
+	l_chashmap_destroy(data.chashmap, free_value);
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Pointer test", test_ptr, NULL);
+	l_test_add("String test", test_string, NULL);
+	l_test_add("Concurrent test", test_concurrent, NULL);
+
+	return l_test_run();
+}
@@ -11,6 +11,8 @@
 
 #include <alloca.h>
 #include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include <ell/ell.h>
 
@@ -109,7 +111,11 @@ static void test_sha256(const void *data)
 	checksum = l_checksum_new(L_CHECKSUM_SHA256);
 	assert(checksum);
 
-	l_checksum_update(checksum, FIXED_STR, FIXED_LEN);
+	/* Empty updates change nothing, with or without a partial block */
+	assert(l_checksum_update(checksum, NULL, 0));
+	l_checksum_update(checksum, FIXED_STR, 3);
+	assert(l_checksum_update(checksum, NULL, 0));
+	l_checksum_update(checksum, FIXED_STR + 3, FIXED_LEN - 3);
 
 	l_checksum_get_digest(checksum, digest, sizeof(digest));
 
@@ -123,6 +129,57 @@ static void test_sha256(const void *data)
 	l_checksum_free(checksum);
 }
 
+static void test_sha384(const void *data)
+{
+	struct l_checksum *checksum;
+	unsigned char digest[48];
+	unsigned char *expected;
+	size_t expectlen;
+
+	checksum = l_checksum_new(L_CHECKSUM_SHA384);
+	assert(checksum);
+
+	l_checksum_update(checksum, FIXED_STR, FIXED_LEN);
+
+	l_checksum_get_digest(checksum, digest, sizeof(digest));
+
+	expected = l_util_from_hexstring(
+		"396d84c9c1a2ee76b0163c38533cbc8b"
+		"c453089e87b9790a62bf5175e614713f"
+		"ea4f16378b416fd8650351345cd44c07", &expectlen);
+	assert(expectlen == sizeof(digest));
+	assert(!memcmp(digest, expected, expectlen));
+
+	l_free(expected);
+	l_checksum_free(checksum);
+}
+
+static void test_sha512(const void *data)
+{
+	struct l_checksum *checksum;
+	unsigned char digest[64];
+	unsigned char *expected;
+	size_t expectlen;
+
+	checksum = l_checksum_new(L_CHECKSUM_SHA512);
+	assert(checksum);
+
+	l_checksum_update(checksum, FIXED_STR, FIXED_LEN);
+
+	l_checksum_get_digest(checksum, digest, sizeof(digest));
+
+	expected = l_util_from_hexstring(
+		"9da644c289075656b5339317f7100d95"
+		"4b49e67e6c3f981451bf7982c52f0030"
+		"16470c781fa0af61a965fc0ae50f1bbc"
+		"8d94ffe91e10dc09f27dbe5b1fc2827c", &expectlen);
+	assert(expectlen == sizeof(digest));
+	assert(!memcmp(digest, expected, expectlen));
+
+	l_free(expected);
+	l_checksum_free(checksum);
+}
+
 static void test_reset(const void *data)
 {
 	struct l_checksum *checksum;
@@ -166,6 +223,252 @@ static void test_updatev(const void *data)
 	l_checksum_free(checksum);
 }
 
+struct hmac_test_vector {
+	enum l_checksum_type type;
+	char *key;
+	char *data;
+	char *digest;
+};
+
+/* RFC 4231 Test Case 2 */
+static const struct hmac_test_vector hmac_sha256_test1 = {
+	.type = L_CHECKSUM_SHA256,
+	.key = "4a656665",
+	.data = "7768617420646f2079612077616e7420"
+		"666f72206e6f7468696e673f",
+	.digest = "5bdcc146bf60754e6a042426089575c7"
+		"5a003f089d2739839dec58b964ec3843",
+};
+
+/* RFC 4231 Test Case 6, the key is longer than the block */
+#define HMAC_LONG_KEY							\
+	"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa" \
+	"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa" \
+	"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa" \
+	"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa" \
+	"aaaaaa"
+#define HMAC_LONG_KEY_DATA						\
+	"54657374205573696e67204c61726765"				\
+	"72205468616e20426c6f636b2d53697a"				\
+	"65204b6579202d2048617368204b6579"				\
+	"204669727374"
+
+static const struct hmac_test_vector hmac_sha256_test2 = {
+	.type = L_CHECKSUM_SHA256,
+	.key = HMAC_LONG_KEY,
+	.data = HMAC_LONG_KEY_DATA,
+	.digest = "60e431591ee0b67f0d8a26aacbf5b77f"
+		"8e0bc6213728c5140546040f0ee37f54",
+};
+
+static const struct hmac_test_vector hmac_sha512_test1 = {
+	.type = L_CHECKSUM_SHA512,
+	.key = HMAC_LONG_KEY,
+	.data = HMAC_LONG_KEY_DATA,
+	.digest = "80b24263c7c1a3ebb71493c1dd7be8b4"
+		"9b46d1f41b4aeec1121b013783f8f352"
+		"6b56d037e05f2598bd0fd2215d6a1e52"
+		"95e64f73f63f0aec8b915a985d786598",
+};
+
+static void test_hmac(const void *data)
+{
+	const struct hmac_test_vector *tv = data;
+	struct l_checksum *checksum;
+	unsigned char digest[64];
+	size_t key_len, data_len, expect_len;
+	uint8_t *key = l_util_from_hexstring(tv->key, &key_len);
+	uint8_t *msg = l_util_from_hexstring(tv->data, &data_len);
+	uint8_t *expected = l_util_from_hexstring(tv->digest, &expect_len);
+	unsigned int i;
+
+	assert(key && msg && expected);
+
+	checksum = l_checksum_new_hmac(tv->type, key, key_len);
+	assert(checksum);
+
+	/* The second round checks that the key survives get_digest */
+	for (i = 0; i < 2; i++) {
+		l_checksum_update(checksum, msg, data_len);
+		assert(l_checksum_get_digest(checksum, digest,
+						sizeof(digest)) ==
+						(ssize_t) expect_len);
+		assert(!memcmp(digest, expected, expect_len));
+	}
+
+	l_checksum_free(checksum);
+	l_free(key);
+	l_free(msg);
+	l_free(expected);
+}
+
+/* More data than one read or splice, from a file and from a pipe */
+static void test_update_fd(const void *data)
+{
+	struct l_checksum *checksum;
+	size_t len = 200000;
+	uint8_t *buf = l_malloc(len);
+	uint8_t digest[32];
+	uint8_t expected[32];
+	FILE *f = tmpfile();
+	int pipefd[2];
+	size_t i;
+
+	assert(f);
+
+	for (i = 0; i < len; i++)
+		buf[i] = FIXED_STR[i % FIXED_LEN];
+
+	assert(fwrite(buf, 1, len, f) == len);
+	assert(!fflush(f));
+
+	checksum = l_checksum_new(L_CHECKSUM_SHA256);
+	assert(checksum);
+
+	l_checksum_update(checksum, buf + 7, len - 10);
+	l_checksum_get_digest(checksum, expected, sizeof(expected));
+
+	assert(l_checksum_update_fd(checksum, fileno(f), 7, len - 10));
+	l_checksum_get_digest(checksum, digest, sizeof(digest));
+	assert(!memcmp(digest, expected, sizeof(digest)));
+
+	/* Past the end of the file */
+	assert(!l_checksum_update_fd(checksum, fileno(f), 7, len));
+	l_checksum_reset(checksum);
+
+	l_checksum_update(checksum, buf, 1000);
+	l_checksum_get_digest(checksum, expected, sizeof(expected));
+
+	assert(!pipe(pipefd));
+	assert(write(pipefd[1], buf, 1000) == 1000);
+	assert(l_checksum_update_fd(checksum, pipefd[0], -1, 1000));
+	l_checksum_get_digest(checksum, digest, sizeof(digest));
+	assert(!memcmp(digest, expected, sizeof(digest)));
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+	fclose(f);
+	l_checksum_free(checksum);
+	l_free(buf);
+}
+
+struct hkdf_test_vector {
+	enum l_checksum_type type;
+	char *ikm;
+	char *salt;
+	char *info;
+	char *prk;
+	char *okm;
+};
+
+/* RFC 5869 Test Cases 1, 3 and 4 */
+static const struct hkdf_test_vector hkdf_sha256_test1 = {
+	.type = L_CHECKSUM_SHA256,
+	.ikm = "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b",
+	.salt = "000102030405060708090a0b0c",
+	.info = "f0f1f2f3f4f5f6f7f8f9",
+	.prk = "077709362c2e32df0ddc3f0dc47bba63"
+		"90b6c73bb50f9c3122ec844ad7c2b3e5",
+	.okm = "3cb25f25faacd57a90434f64d0362f2a"
+		"2d2d0a90cf1a5a4c5db02d56ecc4c5bf"
+		"34007208d5b887185865",
+};
+
+static const struct hkdf_test_vector hkdf_sha256_test3 = {
+	.type = L_CHECKSUM_SHA256,
+	.ikm = "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b",
+	.prk = "19ef24a32c717b167f33a91d6f648bdf"
+		"96596776afdb6377ac434c1c293ccb04",
+	.okm = "8da4e775a563c18f715f802a063c5a31"
+		"b8a11f5c5ee1879ec3454e5f3c738d2d"
+		"9d201395faa4b61a96c8",
+};
+
+static const struct hkdf_test_vector hkdf_sha1_test4 = {
+	.type = L_CHECKSUM_SHA1,
+	.ikm = "0b0b0b0b0b0b0b0b0b0b0b",
+	.salt = "000102030405060708090a0b0c",
+	.info = "f0f1f2f3f4f5f6f7f8f9",
+	.prk = "9b6c18c432a7bf8f0e71c8eb88f4b30baa2ba243",
+	.okm = "085a01ea1b10f36933068b56efa5ad81"
+		"a4f14b822f5b091568a9cdd4f155fda2"
+		"c22e422478d305f3f896",
+};
+
+static void test_hkdf(const void *data)
+{
+	const struct hkdf_test_vector *tv = data;
+	size_t ikm_len, salt_len = 0, info_len = 0, prk_len, okm_len;
+	uint8_t *ikm = l_util_from_hexstring(tv->ikm, &ikm_len);
+	uint8_t *salt = tv->salt ?
+			l_util_from_hexstring(tv->salt, &salt_len) : NULL;
+	uint8_t *info = tv->info ?
+			l_util_from_hexstring(tv->info, &info_len) : NULL;
+	uint8_t *prk = l_util_from_hexstring(tv->prk, &prk_len);
+	uint8_t *okm = l_util_from_hexstring(tv->okm, &okm_len);
+	uint8_t out[64];
+
+	assert(ikm && prk && okm);
+
+	assert(l_checksum_hkdf_extract(tv->type, salt, salt_len,
+					ikm, ikm_len, out));
+	assert(!memcmp(out, prk, prk_len));
+
+	assert(l_checksum_hkdf_expand(tv->type, prk, prk_len, info, info_len,
+					out, okm_len));
+	assert(!memcmp(out, okm, okm_len));
+
+	/* Output limited to 255 blocks */
+	assert(!l_checksum_hkdf_expand(tv->type, prk, prk_len, NULL, 0, out,
+					255 * prk_len + 1));
+
+	l_free(ikm);
+	l_free(salt);
+	l_free(info);
+	l_free(prk);
+	l_free(okm);
+}
+
+/* More messages than lanes, of lengths around the block boundaries */
+static void test_batch(const void *data)
+{
+	const enum l_checksum_type *type = data;
+	struct l_checksum *checksums[2];
+	struct iovec iov[11];
+	size_t digest_len = l_checksum_digest_length(*type);
+	uint8_t digests[11 * 64];
+	uint8_t digest[64];
+	unsigned int i, j;
+
+	checksums[0] = l_checksum_new(*type);
+	checksums[1] = l_checksum_new_hmac(*type, FIXED_STR, 16);
+	assert(checksums[0] && checksums[1]);
+
+	for (i = 0; i < L_ARRAY_SIZE(iov); i++) {
+		iov[i].iov_base = FIXED_STR + i;
+		iov[i].iov_len = (i * 23) % FIXED_LEN;
+	}
+
+	for (j = 0; j < L_ARRAY_SIZE(checksums); j++) {
+		/* Pending data is discarded */
+		l_checksum_update(checksums[j], FIXED_STR, 3);
+
+		assert(l_checksum_batch(checksums[j], iov, L_ARRAY_SIZE(iov),
+						digests));
+
+		for (i = 0; i < L_ARRAY_SIZE(iov); i++) {
+			l_checksum_update(checksums[j], iov[i].iov_base,
+						iov[i].iov_len);
+			l_checksum_get_digest(checksums[j], digest,
+						digest_len);
+			assert(!memcmp(digest, digests + i * digest_len,
+					digest_len));
+		}
+
+		l_checksum_free(checksums[j]);
+	}
+}
+
 struct aes_cmac_test_vector {
 	char *plaintext;
 	char *key;
@@ -255,6 +558,36 @@ int main(int argc, char *argv[])
 	if (l_checksum_is_supported(L_CHECKSUM_SHA256, false))
 		l_test_add("sha256-1", test_sha256, NULL);
 
+	if (l_checksum_is_supported(L_CHECKSUM_SHA384, false))
+		l_test_add("sha384-1", test_sha384, NULL);
+
+	if (l_checksum_is_supported(L_CHECKSUM_SHA512, false))
+		l_test_add("sha512-1", test_sha512, NULL);
+
+	if (l_checksum_is_supported(L_CHECKSUM_SHA256, true)) {
+		l_test_add("hmac-sha256-1", test_hmac, &hmac_sha256_test1);
+		l_test_add("hmac-sha256-2", test_hmac, &hmac_sha256_test2);
+	}
+
+	if (l_checksum_is_supported(L_CHECKSUM_SHA512, true))
+		l_test_add("hmac-sha512-1", test_hmac, &hmac_sha512_test1);
+
+	if (l_checksum_is_supported(L_CHECKSUM_SHA1, true)) {
+		static const enum l_checksum_type sha1 = L_CHECKSUM_SHA1;
+
+		l_test_add("batch-sha1", test_batch, &sha1);
+		l_test_add("hkdf-sha1-4", test_hkdf, &hkdf_sha1_test4);
+	}
+
+	if (l_checksum_is_supported(L_CHECKSUM_SHA256, true)) {
+		static const enum l_checksum_type sha256 = L_CHECKSUM_SHA256;
+
+		l_test_add("batch-sha256", test_batch, &sha256);
+		l_test_add("update-fd", test_update_fd, NULL);
+		l_test_add("hkdf-sha256-1", test_hkdf, &hkdf_sha256_test1);
+		l_test_add("hkdf-sha256-3", test_hkdf, &hkdf_sha256_test3);
+	}
+
 	if (l_checksum_cmac_aes_supported()) {
 		l_test_add("aes-cmac-1", test_aes_cmac, &aes_cmac_test1);
 		l_test_add("aes-cmac-2", test_aes_cmac, &aes_cmac_test2);
@@ -364,6 +364,45 @@ static void test_aead(const void *data)
 	l_free(tag);
 }
 
+static void test_aead_bad_tag(const void *data)
+{
+	const struct aead_test_vector *tv = data;
+	struct l_aead_cipher *cipher;
+	size_t keylen, noncelen, aadlen, ctlen, taglen;
+	uint8_t *key = l_util_from_hexstring(tv->key, &keylen);
+	uint8_t *nonce = l_util_from_hexstring(tv->nonce, &noncelen);
+	uint8_t *aad = l_util_from_hexstring(tv->aad, &aadlen);
+	uint8_t *ct = l_util_from_hexstring(tv->ciphertext, &ctlen);
+	uint8_t *tag = l_util_from_hexstring(tv->tag, &taglen);
+	uint8_t *in = l_malloc(ctlen + taglen);
+	uint8_t *out = l_malloc(ctlen);
+
+	memcpy(in, ct, ctlen);
+	memcpy(in + ctlen, tag, taglen);
+	in[ctlen + taglen - 1] ^= 0x01;
+
+	cipher = l_aead_cipher_new(tv->type, key, keylen, taglen);
+	assert(cipher);
+
+	assert(!l_aead_cipher_decrypt(cipher, in, ctlen + taglen, aad, aadlen,
+					nonce, noncelen, out, ctlen));
+
+	/* Also rejects a modified ciphertext */
+	in[ctlen + taglen - 1] ^= 0x01;
+	in[0] ^= 0x80;
+	assert(!l_aead_cipher_decrypt(cipher, in, ctlen + taglen, aad, aadlen,
+					nonce, noncelen, out, ctlen));
+
+	l_aead_cipher_free(cipher);
+	l_free(out);
+	l_free(in);
+	l_free(tag);
+	l_free(ct);
+	l_free(aad);
+	l_free(nonce);
+	l_free(key);
+}
+
 struct rc2_test_vector {
 	const char *key;
 	const char *plaintext;
@@ -446,6 +485,7 @@ int main(int argc, char *argv[])
 		l_test_add("aes_gcm test 4", test_aead, &gcm_test4);
 		l_test_add("aes_gcm test 5", test_aead, &gcm_test5);
 		l_test_add("aes_gcm test 6", test_aead, &gcm_test6);
+		l_test_add("aes_gcm bad tag", test_aead_bad_tag, &gcm_test1);
 	}
 
 	l_test_add("rc2/test 1", test_rc2, &rc2_test_1);
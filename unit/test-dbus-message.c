@@ -1944,6 +1944,45 @@ static void check_fixed_array_2(const void *data)
 	l_dbus_message_unref(msg);
 }
 
+static void check_fixed_array_shared(const void *data)
+{
+	const struct message_data *msg_data = data;
+	const struct dbus_header *hdr = (const void *) msg_data->binary;
+	size_t header_size = (DBUS_HEADER_SIZE + hdr->dbus1.field_length +
+								7) & ~7;
+	struct _dbus_buffer *buffer;
+	struct l_dbus_message *msg;
+	struct l_dbus_message_iter iter;
+	const uint32_t *array = NULL;
+	uint32_t n_elem;
+	uint8_t *start;
+
+	/* Leave the message misaligned, as it may be in a receive buffer */
+	buffer = _dbus_buffer_new(msg_data->binary_len + 1);
+	start = buffer->data + 1;
+	memcpy(start, msg_data->binary, msg_data->binary_len);
+	((struct dbus_header *) start)->dbus1.serial = 1;
+
+	msg = dbus_message_build(start, header_size, start + header_size,
+					msg_data->binary_len - header_size,
+					NULL, 0, buffer);
+	assert(msg);
+
+	/* The message keeps the buffer alive */
+	_dbus_buffer_unref(buffer);
+
+	assert(l_dbus_message_get_arguments(msg, "ab", &iter));
+	assert(l_dbus_message_iter_get_fixed_array(&iter, &array, &n_elem));
+	assert(n_elem == 3);
+	assert(!((uintptr_t) array & (sizeof(uint32_t) - 1)));
+
+	assert(array[0] == 0x1);
+	assert(array[1] == 0x1);
+	assert(array[2] == 0x0);
+
+	l_dbus_message_unref(msg);
+}
+
 static void build_array_2(const void *data)
 {
 	struct l_dbus_message *msg = build_message(data);
@@ -2853,6 +2892,270 @@ static void message_fds_build(const void *data)
 	assert(count_fds() == open_fds);
 }
 
+static struct l_dbus_message *build_fixed_arrays(bool bulk)
+{
+	static const uint8_t bytes[5] = { 1, 2, 3, 4, 5 };
+	static const uint16_t words[3] = { 0x1234, 0x5678, 0x9abc };
+	static const uint64_t quads[2] = { 0x0102030405060708ULL, 42 };
+	static const bool bools[3] = { true, false, true };
+	struct l_dbus_message *msg;
+	struct l_dbus_message_builder *builder;
+	uint8_t y = 0xff;
+	unsigned int i;
+
+	msg = _dbus_message_new_method_call(1, "com.example",
+						"/com/example", "com.example",
+						"Method");
+	builder = l_dbus_message_builder_new(msg);
+	assert(builder);
+
+	/* Start off unaligned so that array padding comes into play */
+	assert(l_dbus_message_builder_append_basic(builder, 'y', &y));
+
+	assert(l_dbus_message_builder_enter_array(builder, "y"));
+
+	if (bulk) {
+		/* Can be done in several steps */
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'y',
+								bytes, 2));
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'y',
+								bytes + 2, 3));
+		assert(!l_dbus_message_builder_append_fixed_array(builder, 'q',
+								words, 3));
+	} else
+		for (i = 0; i < L_ARRAY_SIZE(bytes); i++)
+			assert(l_dbus_message_builder_append_basic(builder,
+							'y', &bytes[i]));
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	assert(l_dbus_message_builder_enter_array(builder, "q"));
+
+	if (bulk)
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'q',
+								words, 3));
+	else
+		for (i = 0; i < L_ARRAY_SIZE(words); i++)
+			assert(l_dbus_message_builder_append_basic(builder,
+							'q', &words[i]));
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	assert(l_dbus_message_builder_enter_array(builder, "t"));
+
+	if (bulk)
+		assert(l_dbus_message_builder_append_fixed_array(builder, 't',
+								quads, 2));
+	else
+		for (i = 0; i < L_ARRAY_SIZE(quads); i++)
+			assert(l_dbus_message_builder_append_basic(builder,
+							't', &quads[i]));
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	assert(l_dbus_message_builder_enter_array(builder, "b"));
+
+	if (bulk)
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'b',
+								bools, 3));
+	else
+		for (i = 0; i < L_ARRAY_SIZE(bools); i++)
+			assert(l_dbus_message_builder_append_basic(builder,
+							'b', &bools[i]));
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	assert(l_dbus_message_builder_enter_array(builder, "u"));
+
+	if (bulk)
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'u',
+								NULL, 0));
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	/* Only valid inside of an array */
+	if (bulk)
+		assert(!l_dbus_message_builder_append_fixed_array(builder, 'y',
+								bytes, 5));
+
+	assert(l_dbus_message_builder_finalize(builder));
+	l_dbus_message_builder_destroy(builder);
+
+	return msg;
+}
+
+static void build_fixed_array(const void *data)
+{
+	struct l_dbus_message *bulk = build_fixed_arrays(true);
+	struct l_dbus_message *single = build_fixed_arrays(false);
+	const void *bulk_body, *single_body;
+	size_t bulk_size, single_size;
+
+	assert(!strcmp(l_dbus_message_get_signature(bulk), "yayaqatabau"));
+
+	bulk_body = _dbus_message_get_body(bulk, &bulk_size);
+	single_body = _dbus_message_get_body(single, &single_size);
+	assert(bulk_size == single_size);
+	assert(!memcmp(bulk_body, single_body, bulk_size));
+
+	l_dbus_message_unref(bulk);
+	l_dbus_message_unref(single);
+}
+
+static void check_blob(struct l_dbus_message_iter *variant,
+				const uint8_t *bytes, size_t len)
+{
+	struct l_dbus_blob *blob;
+	const void *data;
+	size_t blob_len;
+
+	blob = l_dbus_message_iter_get_blob(variant);
+	assert(blob);
+
+	data = l_dbus_blob_get_data(blob, &blob_len);
+	assert(blob_len == len);
+	assert(!memcmp(data, bytes, len));
+
+	l_dbus_blob_free(blob);
+}
+
+static void build_blob(const void *data)
+{
+	uint8_t version = L_PTR_TO_UINT(data);
+	static const uint8_t small[16] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	size_t large_len = 256 * 1024;
+	uint8_t *large = l_malloc(large_len);
+	struct l_dbus_message *msg;
+	struct l_dbus_message_builder *builder;
+	struct l_dbus_message_iter inline_blob, memfd_blob;
+	int open_fds = count_fds();
+	uint32_t num_fds;
+	size_t i;
+
+	for (i = 0; i < large_len; i++)
+		large[i] = i * 7;
+
+	msg = _dbus_message_new_method_call(version, "com.example",
+						"/com/example", "com.example",
+						"Method");
+	builder = l_dbus_message_builder_new(msg);
+	assert(l_dbus_message_builder_append_blob(builder, small,
+							sizeof(small)));
+	assert(l_dbus_message_builder_append_blob(builder, large, large_len));
+	assert(l_dbus_message_builder_finalize(builder));
+	l_dbus_message_builder_destroy(builder);
+
+	/* Only the large blob goes out of band */
+	_dbus_message_get_fds(msg, &num_fds);
+	assert(num_fds == 1);
+
+	assert(l_dbus_message_get_arguments(msg, "vv", &inline_blob,
+							&memfd_blob));
+	check_blob(&inline_blob, small, sizeof(small));
+	check_blob(&memfd_blob, large, large_len);
+
+	l_dbus_message_unref(msg);
+	l_free(large);
+
+	assert(count_fds() == open_fds);
+}
+
+static void compare_built(struct l_dbus_message *a, struct l_dbus_message *b)
+{
+	const void *a_data, *b_data;
+	size_t a_size, b_size;
+
+	a_data = _dbus_message_get_header(a, &a_size);
+	b_data = _dbus_message_get_header(b, &b_size);
+	assert(a_size == b_size);
+	assert(!memcmp(a_data, b_data, a_size));
+
+	/* Without arguments there is no footer to compare */
+	a_data = _dbus_message_get_footer(a, &a_size);
+	b_data = _dbus_message_get_footer(b, &b_size);
+	assert(a_size == b_size);
+	assert(!a_size || !memcmp(a_data, b_data, a_size));
+
+	l_dbus_message_unref(a);
+	l_dbus_message_unref(b);
+}
+
+static void build_template(const void *data)
+{
+	uint8_t version = L_PTR_TO_UINT(data);
+	struct l_dbus_message_template *tmpl;
+	struct l_dbus_message *msg, *ref;
+
+	tmpl = _dbus_message_template_new_signal(version, "/com/example",
+						"com.example.Test", "Changed",
+						"su");
+	assert(tmpl);
+
+	msg = l_dbus_message_new_from_template(tmpl);
+	assert(!strcmp(l_dbus_message_get_path(msg), "/com/example"));
+	assert(!strcmp(l_dbus_message_get_member(msg), "Changed"));
+	assert(l_dbus_message_get_no_reply(msg));
+	assert(l_dbus_message_set_arguments(msg, "su", "Linus", 42));
+	assert(!strcmp(l_dbus_message_get_interface(msg), "com.example.Test"));
+
+	ref = _dbus_message_new_signal(version, "/com/example",
+					"com.example.Test", "Changed");
+	assert(l_dbus_message_set_arguments(ref, "su", "Linus", 42));
+	compare_built(msg, ref);
+
+	/* A different signature falls back to building the header */
+	msg = l_dbus_message_new_from_template(tmpl);
+	l_dbus_message_template_unref(tmpl);
+	assert(l_dbus_message_set_arguments(msg, "as", 1, "Torvalds"));
+	assert(!strcmp(l_dbus_message_get_path(msg), "/com/example"));
+
+	ref = _dbus_message_new_signal(version, "/com/example",
+					"com.example.Test", "Changed");
+	assert(l_dbus_message_set_arguments(ref, "as", 1, "Torvalds"));
+	compare_built(msg, ref);
+
+	tmpl = _dbus_message_template_new_method_call(version, "com.example",
+							"/", NULL, "Ping",
+							NULL);
+	msg = l_dbus_message_new_from_template(tmpl);
+	l_dbus_message_template_unref(tmpl);
+	assert(!l_dbus_message_get_no_reply(msg));
+	assert(l_dbus_message_set_no_reply(msg, true));
+	assert(l_dbus_message_set_arguments(msg, ""));
+
+	ref = _dbus_message_new_method_call(version, "com.example", "/", NULL,
+						"Ping");
+	assert(l_dbus_message_set_no_reply(ref, true));
+	assert(l_dbus_message_set_arguments(ref, ""));
+	compare_built(msg, ref);
+}
+
+static void nth_string_argument(const void *data)
+{
+	uint8_t version = L_PTR_TO_UINT(data);
+	struct l_dbus_message *msg;
+
+	msg = _dbus_message_new_signal(version, "/com/example",
+					"com.example.Test", "Changed");
+	assert(!_dbus_message_get_nth_string_argument(msg, 0));
+	assert(l_dbus_message_set_arguments(msg, "sa{sv}uos", "first", 1,
+						"Key", "s", "value", 42,
+						"/com/example", "last"));
+
+	assert(!strcmp(_dbus_message_get_nth_string_argument(msg, 4), "last"));
+	assert(!strcmp(_dbus_message_get_nth_string_argument(msg, 0),
+								"first"));
+	assert(!strcmp(_dbus_message_get_nth_string_argument(msg, 3),
+							"/com/example"));
+	assert(!_dbus_message_get_nth_string_argument(msg, 1));
+	assert(!_dbus_message_get_nth_string_argument(msg, 2));
+	assert(!_dbus_message_get_nth_string_argument(msg, 5));
+	assert(!_dbus_message_get_nth_string_argument(msg, -1));
+	assert(!strcmp(_dbus_message_get_nth_string_argument(msg, 4), "last"));
+
+	l_dbus_message_unref(msg);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -2893,7 +3196,10 @@ int main(int argc, char *argv[])
 	l_test_add("Array 2 (parse)", check_array_2, &message_data_array_2);
 	l_test_add("Array 2 (checkfixed)", check_fixed_array_2,
 							&message_data_array_2);
+	l_test_add("Array 2 (checkfixed shared)", check_fixed_array_shared,
+						&message_data_array_2);
 	l_test_add("Array 2 (build)", build_array_2, &message_data_array_2);
+	l_test_add("Fixed array (build)", build_fixed_array, NULL);
 	l_test_add("Array 3 (parse)", check_array_3, &message_data_array_3);
 	l_test_add("Array 3 (build)", build_array_3, &message_data_array_3);
 	l_test_add("Array 4 (parse)", check_array_4, &message_data_array_4);
@@ -2955,5 +3261,16 @@ int main(int argc, char *argv[])
 	l_test_add("FDs (parse)", message_fds_parse, NULL);
 	l_test_add("FDs (build)", message_fds_build, NULL);
 
+	l_test_add("Blob 1 (build)", build_blob, L_UINT_TO_PTR(1));
+	l_test_add("Blob 2 (build)", build_blob, L_UINT_TO_PTR(2));
+
+	l_test_add("Template 1 (build)", build_template, L_UINT_TO_PTR(1));
+	l_test_add("Template 2 (build)", build_template, L_UINT_TO_PTR(2));
+
+	l_test_add("Nth string argument 1", nth_string_argument,
+							L_UINT_TO_PTR(1));
+	l_test_add("Nth string argument 2", nth_string_argument,
+							L_UINT_TO_PTR(2));
+
 	return l_test_run();
 }
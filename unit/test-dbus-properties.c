@@ -924,6 +924,412 @@ static void test_object_manager_signals(struct l_dbus *dbus, void *test_data)
 						"org.test", NULL));
 }
 
+#define OM_LARGE_COUNT 200
+
+static unsigned int om_large_watch;
+static bool om_large_seen[OM_LARGE_COUNT];
+static unsigned int om_large_announced;
+static unsigned int om_large_pending;
+static bool om_large_replied;
+
+static bool om_large_index(const char *path, unsigned int *index)
+{
+	static const char prefix[] = ROOT_PATH "/large/";
+	char *end;
+
+	if (strncmp(path, prefix, strlen(prefix)))
+		return false;
+
+	*index = strtoul(path + strlen(prefix), &end, 10);
+
+	return *end == '\0' && *index < OM_LARGE_COUNT;
+}
+
+static void om_large_finish(void *user_data)
+{
+	l_dbus_remove_signal_watch(dbus, om_large_watch);
+	l_dbus_object_manager_set_max_reply_size(dbus, ROOT_PATH, 0);
+	test_next();
+}
+
+static void om_large_callback(struct l_dbus_message *message,
+				void *user_data)
+{
+	struct l_dbus_message_iter objects, interfaces;
+	const char *path;
+	unsigned int index;
+	unsigned int in_reply = 0;
+
+	test_assert(!l_dbus_message_get_error(message, NULL, NULL));
+	test_assert(l_dbus_message_get_arguments(message, "a{oa{sa{sv}}}",
+							&objects));
+
+	while (l_dbus_message_iter_next_entry(&objects, &path, &interfaces)) {
+		if (!om_large_index(path, &index))
+			continue;
+
+		test_assert(!om_large_seen[index]);
+		om_large_seen[index] = true;
+		in_reply += 1;
+	}
+
+	/* The size limit must have moved the rest to InterfacesAdded */
+	test_assert(in_reply > 0 && in_reply < OM_LARGE_COUNT);
+
+	om_large_replied = true;
+	om_large_pending = OM_LARGE_COUNT - in_reply;
+}
+
+static void om_large_signal_callback(struct l_dbus_message *message,
+					void *user_data)
+{
+	struct l_dbus_message_iter interfaces;
+	const char *path;
+	unsigned int index;
+
+	test_assert(l_dbus_message_get_arguments(message, "oa{sa{sv}}",
+							&path, &interfaces));
+
+	if (!om_large_index(path, &index))
+		return;
+
+	if (om_large_announced < OM_LARGE_COUNT) {
+		struct l_dbus_message *call;
+
+		/* Wait for the objects to be announced before asking */
+		if (++om_large_announced < OM_LARGE_COUNT)
+			return;
+
+		call = l_dbus_message_new_method_call(dbus, "org.test",
+					ROOT_PATH,
+					"org.freedesktop.DBus.ObjectManager",
+					"GetManagedObjects");
+		test_assert(l_dbus_message_set_arguments(call, ""));
+		test_assert(l_dbus_send_with_reply(dbus, call,
+						om_large_callback,
+						NULL, NULL));
+		return;
+	}
+
+	test_assert(om_large_replied);
+	test_assert(!om_large_seen[index]);
+	om_large_seen[index] = true;
+
+	/* Watches can't be removed from their own callback */
+	if (--om_large_pending == 0)
+		l_idle_oneshot(om_large_finish, NULL, NULL);
+}
+
+static void test_object_manager_large_get(struct l_dbus *dbus,
+							void *test_data)
+{
+	char path[64];
+	unsigned int i;
+
+	om_large_watch = l_dbus_add_signal_watch(dbus, "org.test", ROOT_PATH,
+					"org.freedesktop.DBus.ObjectManager",
+					"InterfacesAdded", L_DBUS_MATCH_NONE,
+					om_large_signal_callback, NULL);
+	test_assert(om_large_watch);
+
+	test_assert(l_dbus_object_manager_set_max_reply_size(dbus, ROOT_PATH,
+								8192));
+	test_assert(!l_dbus_object_manager_set_max_reply_size(dbus,
+						ROOT_PATH"/test", 8192));
+
+	for (i = 0; i < OM_LARGE_COUNT; i++) {
+		snprintf(path, sizeof(path), ROOT_PATH "/large/%u", i);
+		test_assert(l_dbus_object_add_interface(dbus, path,
+							"org.test", NULL));
+	}
+}
+
+#define COALESCE_INTERVAL 100
+
+static struct l_timeout *coalesce_timeout;
+static uint32_t coalesce_counter;
+static unsigned int coalesce_signals;
+static uint64_t coalesce_first;
+
+static bool test_counter_getter(struct l_dbus *dbus,
+				struct l_dbus_message *message,
+				struct l_dbus_message_builder *builder,
+				void *user_data)
+{
+	return l_dbus_message_builder_append_basic(builder, 'u',
+							&coalesce_counter);
+}
+
+static void setup_coalesce_interface(struct l_dbus_interface *interface)
+{
+	l_dbus_interface_property(interface, "Counter",
+					L_DBUS_PROPERTY_FLAG_AUTO_EMIT, "u",
+					test_counter_getter, NULL);
+	l_dbus_interface_set_coalesce_interval(interface, COALESCE_INTERVAL);
+}
+
+static void coalesce_timeout_callback(struct l_timeout *timeout,
+					void *user_data)
+{
+	coalesce_timeout = NULL;
+	test_assert(false);
+}
+
+static void coalesce_signal_callback(struct l_dbus_message *message,
+					void *user_data)
+{
+	const char *interface, *property;
+	struct l_dbus_message_iter variant, changed, invalidated;
+	uint32_t value;
+
+	if (!coalesce_timeout)
+		return;
+
+	test_assert(l_dbus_message_get_arguments(message, "sa{sv}as",
+							&interface, &changed,
+							&invalidated));
+
+	test_assert(l_dbus_message_iter_next_entry(&changed, &property,
+							&variant));
+	test_assert(!strcmp(property, "Counter"));
+	test_assert(l_dbus_message_iter_get_variant(&variant, "u", &value));
+	test_assert(!l_dbus_message_iter_next_entry(&changed, &property,
+							&variant));
+
+	/* Only the latest value is expected */
+	test_assert(value == coalesce_counter);
+
+	if (++coalesce_signals == 1) {
+		coalesce_first = l_time_now();
+
+		/* These come in too soon and are sent together, later */
+		coalesce_counter = 2;
+		test_assert(l_dbus_property_changed(dbus, ROOT_PATH"/coalesce",
+					"org.test.Coalesce", "Counter"));
+		coalesce_counter = 3;
+		test_assert(l_dbus_property_changed(dbus, ROOT_PATH"/coalesce",
+					"org.test.Coalesce", "Counter"));
+		return;
+	}
+
+	test_assert(coalesce_signals == 2);
+	test_assert(l_time_diff(coalesce_first, l_time_now()) >=
+				COALESCE_INTERVAL * L_USEC_PER_MSEC / 2);
+
+	l_timeout_remove(coalesce_timeout);
+	coalesce_timeout = NULL;
+
+	test_next();
+}
+
+static void test_property_coalesce(struct l_dbus *dbus, void *test_data)
+{
+	coalesce_timeout = l_timeout_create(2, coalesce_timeout_callback,
+						NULL, NULL);
+	test_assert(coalesce_timeout);
+
+	coalesce_counter = 1;
+	test_assert(l_dbus_property_changed(dbus, ROOT_PATH"/coalesce",
+					"org.test.Coalesce", "Counter"));
+}
+
+static struct l_dbus_client *client;
+static struct l_dbus_proxy *client_proxy;
+static unsigned int client_changes;
+
+static void client_proxy_added(struct l_dbus_proxy *proxy, void *user_data)
+{
+	if (strcmp(l_dbus_proxy_get_path(proxy), ROOT_PATH"/test") ||
+			strcmp(l_dbus_proxy_get_interface(proxy), "org.test"))
+		return;
+
+	client_proxy = proxy;
+}
+
+static void client_done(void *user_data)
+{
+	l_dbus_client_destroy(client);
+	client = NULL;
+
+	test_next();
+}
+
+static void client_property_changed(struct l_dbus_proxy *proxy,
+					const char *name,
+					struct l_dbus_message *msg,
+					void *user_data)
+{
+	const char *value;
+
+	if (proxy != client_proxy || strcmp(name, "String"))
+		return;
+
+	client_changes++;
+
+	/* First the invalidation, then the value fetched with GetAll */
+	if (client_changes == 1) {
+		test_assert(!msg);
+		test_assert(!l_dbus_proxy_get_property(proxy, "String", "s",
+								&value));
+		return;
+	}
+
+	test_assert(client_changes == 2);
+	test_assert(msg);
+	test_assert(l_dbus_proxy_get_property(proxy, "String", "s", &value));
+	test_assert(!strcmp(value, "foo"));
+
+	/* Not from within the client's own callback */
+	test_assert(l_idle_oneshot(client_done, NULL, NULL));
+}
+
+static void client_ready(struct l_dbus_client *client, void *user_data)
+{
+	struct l_dbus_message *signal;
+	struct l_dbus_message_builder *builder;
+	const char *value;
+
+	test_assert(client_proxy);
+	test_assert(l_dbus_proxy_get_property(client_proxy, "String", "s",
+								&value));
+	test_assert(!strcmp(value, "foo"));
+
+	signal = l_dbus_message_new_signal(dbus, ROOT_PATH"/test",
+					"org.freedesktop.DBus.Properties",
+					"PropertiesChanged");
+	test_assert(signal);
+
+	builder = l_dbus_message_builder_new(signal);
+	l_dbus_message_builder_append_basic(builder, 's', "org.test");
+	l_dbus_message_builder_enter_array(builder, "{sv}");
+	l_dbus_message_builder_leave_array(builder);
+	l_dbus_message_builder_enter_array(builder, "s");
+	l_dbus_message_builder_append_basic(builder, 's', "String");
+	l_dbus_message_builder_leave_array(builder);
+	l_dbus_message_builder_finalize(builder);
+	l_dbus_message_builder_destroy(builder);
+
+	test_assert(l_dbus_send(dbus, signal));
+}
+
+static void test_client_property_cache(struct l_dbus *dbus, void *test_data)
+{
+	client_proxy = NULL;
+	client_changes = 0;
+
+	test_assert(l_dbus_object_manager_enable(dbus, "/"));
+
+	client = l_dbus_client_new(dbus, "org.test", "/");
+	test_assert(client);
+
+	l_dbus_client_set_proxy_handlers(client, client_proxy_added, NULL,
+						client_property_changed,
+						NULL, NULL);
+	l_dbus_client_set_ready_handler(client, client_ready, NULL, NULL);
+}
+
+static uint32_t cached_value;
+static unsigned int cached_getter_calls;
+static unsigned int cached_step;
+
+static bool test_cached_getter(struct l_dbus *dbus,
+				struct l_dbus_message *message,
+				struct l_dbus_message_builder *builder,
+				void *user_data)
+{
+	cached_getter_calls++;
+
+	return l_dbus_message_builder_append_basic(builder, 'u',
+							&cached_value);
+}
+
+static void setup_cached_interface(struct l_dbus_interface *interface)
+{
+	l_dbus_interface_property(interface, "Value",
+					L_DBUS_PROPERTY_FLAG_CACHED, "u",
+					test_cached_getter, NULL);
+	l_dbus_interface_property(interface, "Plain", 0, "s",
+					test_string_getter, NULL);
+}
+
+static void cached_get_all(void);
+
+static void cached_get_all_callback(struct l_dbus_message *message,
+					void *user_data)
+{
+	struct l_dbus_message_iter dict, variant;
+	const char *name, *strval;
+	uint32_t value;
+
+	test_assert(!l_dbus_message_get_error(message, NULL, NULL));
+	test_assert(l_dbus_message_get_arguments(message, "a{sv}", &dict));
+
+	test_assert(l_dbus_message_iter_next_entry(&dict, &name, &variant));
+	test_assert(!strcmp(name, "Value"));
+	test_assert(l_dbus_message_iter_get_variant(&variant, "u", &value));
+	test_assert(value == cached_value);
+
+	test_assert(l_dbus_message_iter_next_entry(&dict, &name, &variant));
+	test_assert(!strcmp(name, "Plain"));
+	test_assert(l_dbus_message_iter_get_variant(&variant, "s", &strval));
+	test_assert(!strcmp(strval, "foo"));
+
+	test_assert(!l_dbus_message_iter_next_entry(&dict, &name, &variant));
+
+	switch (++cached_step) {
+	case 1:
+		/* The second GetAll is served from the cache */
+		test_assert(cached_getter_calls == 1);
+		cached_get_all();
+		return;
+	case 2:
+		test_assert(cached_getter_calls == 1);
+
+		/* A change drops the cached value, the getter runs again */
+		cached_value = 7;
+		test_assert(l_dbus_property_changed(dbus, ROOT_PATH"/cached",
+						"org.test.Cached", "Value"));
+		cached_get_all();
+		return;
+	case 3:
+		test_assert(cached_getter_calls == 2);
+		cached_get_all();
+		return;
+	}
+
+	test_assert(cached_getter_calls == 2);
+
+	test_next();
+}
+
+static void cached_get_all(void)
+{
+	struct l_dbus_message *call =
+		l_dbus_message_new_method_call(dbus, "org.test",
+					ROOT_PATH"/cached",
+					"org.freedesktop.DBus.Properties",
+					"GetAll");
+
+	test_assert(call);
+	test_assert(l_dbus_message_set_arguments(call, "s",
+							"org.test.Cached"));
+
+	test_assert(l_dbus_send_with_reply(dbus, call, cached_get_all_callback,
+						NULL, NULL));
+}
+
+static void test_cached_property(struct l_dbus *dbus, void *test_data)
+{
+	/* Earlier tests may have filled the cache already, start afresh */
+	cached_value = 5;
+	test_assert(l_dbus_property_changed(dbus, ROOT_PATH"/cached",
+						"org.test.Cached", "Value"));
+	cached_getter_calls = 0;
+	cached_step = 0;
+
+	cached_get_all();
+}
+
 static void test_run(void)
 {
 	success = false;
@@ -949,6 +1355,26 @@ static void test_run(void)
 		return;
 	}
 
+	if (!l_dbus_register_interface(dbus, "org.test.Coalesce",
+				setup_coalesce_interface, NULL, false) ||
+			!l_dbus_object_add_interface(dbus, ROOT_PATH"/coalesce",
+						"org.test.Coalesce", NULL) ||
+			!l_dbus_object_add_interface(dbus, ROOT_PATH"/coalesce",
+				"org.freedesktop.DBus.Properties", NULL)) {
+		l_info("Unable to instantiate the coalescing interface");
+		return;
+	}
+
+	if (!l_dbus_register_interface(dbus, "org.test.Cached",
+				setup_cached_interface, NULL, false) ||
+			!l_dbus_object_add_interface(dbus, ROOT_PATH"/cached",
+						"org.test.Cached", NULL) ||
+			!l_dbus_object_add_interface(dbus, ROOT_PATH"/cached",
+				"org.freedesktop.DBus.Properties", NULL)) {
+		l_info("Unable to instantiate the cached interface");
+		return;
+	}
+
 	l_dbus_add_signal_watch(dbus, "org.test", ROOT_PATH"/test", "org.test",
 				"PropertyChanged", L_DBUS_MATCH_NONE,
 				test_old_signal_callback, NULL);
@@ -957,6 +1383,11 @@ static void test_run(void)
 				"PropertiesChanged", L_DBUS_MATCH_ARGUMENT(0),
 				"org.test", L_DBUS_MATCH_NONE,
 				test_new_signal_callback, NULL);
+	l_dbus_add_signal_watch(dbus, "org.test", ROOT_PATH"/coalesce",
+				"org.freedesktop.DBus.Properties",
+				"PropertiesChanged", L_DBUS_MATCH_ARGUMENT(0),
+				"org.test.Coalesce", L_DBUS_MATCH_NONE,
+				coalesce_signal_callback, NULL);
 
 	if (!l_dbus_object_manager_enable(dbus, ROOT_PATH)) {
 		l_info("Unable to enable Object Manager");
@@ -985,10 +1416,15 @@ int main(int argc, char *argv[])
 	test_add("org.freedesktop.DBus.Properties get", test_new_get, NULL);
 	test_add("org.freedesktop.DBus.Properties set", test_new_set, NULL);
 	test_add("Property changed signals", test_property_signals, NULL);
+	test_add("Property changed coalescing", test_property_coalesce, NULL);
 	test_add("org.freedesktop.DBus.ObjectManager get",
 			test_object_manager_get, NULL);
 	test_add("org.freedesktop.DBus.ObjectManager signals",
 			test_object_manager_signals, NULL);
+	test_add("org.freedesktop.DBus.ObjectManager large get",
+			test_object_manager_large_get, NULL);
+	test_add("Client property cache", test_client_property_cache, NULL);
+	test_add("Cached property getter", test_cached_property, NULL);
 
 	sigchld = l_signal_create(SIGCHLD, sigchld_handler, NULL, NULL);
 
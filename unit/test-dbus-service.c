@@ -11,6 +11,7 @@
 
 #define _GNU_SOURCE
 #include <assert.h>
+#include <stdio.h>
 #include <stdbool.h>
 
 #include <ell/ell.h>
@@ -212,6 +213,60 @@ static void test_dbus_object_tree_1(const void *test_data)
 	_dbus_object_tree_free(tree);
 }
 
+#define TEST_WIDE_COUNT 1000
+static void test_dbus_object_tree_wide(const void *test_data)
+{
+	struct _dbus_object_tree *tree;
+	struct object_node *nodes[TEST_WIDE_COUNT];
+	struct object_node *tmp;
+	char path[64];
+	unsigned int i;
+
+	tree = _dbus_object_tree_new();
+	assert(tree);
+
+	for (i = 0; i < TEST_WIDE_COUNT; i++) {
+		sprintf(path, "/net/peer%u/link", i);
+		nodes[i] = _dbus_object_tree_makepath(tree, path);
+		assert(nodes[i]);
+	}
+
+	for (i = 0; i < TEST_WIDE_COUNT; i++) {
+		sprintf(path, "/net/peer%u/link", i);
+		assert(_dbus_object_tree_lookup(tree, path) == nodes[i]);
+		assert(_dbus_object_tree_makepath(tree, path) == nodes[i]);
+
+		sprintf(path, "/net/peer%u", i);
+		tmp = _dbus_object_tree_lookup(tree, path);
+		assert(tmp);
+		assert(tmp == _dbus_object_tree_makepath(tree, path));
+		assert(tmp != nodes[i]);
+	}
+
+	assert(!_dbus_object_tree_lookup(tree, "/net/peer"));
+	assert(!_dbus_object_tree_lookup(tree, "/net/peer1000"));
+	assert(!_dbus_object_tree_lookup(tree, "/net/peer1/lin"));
+
+	for (i = 0; i < TEST_WIDE_COUNT; i += 2)
+		_dbus_object_tree_prune_node(nodes[i]);
+
+	for (i = 0; i < TEST_WIDE_COUNT; i++) {
+		sprintf(path, "/net/peer%u", i);
+
+		if (i % 2)
+			assert(_dbus_object_tree_lookup(tree, path));
+		else
+			assert(!_dbus_object_tree_lookup(tree, path));
+	}
+
+	for (i = 1; i < TEST_WIDE_COUNT; i += 2)
+		_dbus_object_tree_prune_node(nodes[i]);
+
+	assert(!_dbus_object_tree_lookup(tree, "/net"));
+
+	_dbus_object_tree_free(tree);
+}
+
 static void setup_dummy_interface(struct l_dbus_interface *iface)
 {
 }
@@ -426,6 +481,7 @@ static const char *ofono_manager_introspection =
 static void test_dbus_object_tree_introspection(const void *test_data)
 {
 	struct _dbus_object_tree *tree;
+	struct object_node *node;
 	struct l_string *buf;
 	char *xml;
 
@@ -444,6 +500,23 @@ static void test_dbus_object_tree_introspection(const void *test_data)
 	assert(!strcmp(ofono_manager_introspection, xml));
 	l_free(xml);
 
+	/* The cached child list follows changes to the tree */
+	node = _dbus_object_tree_makepath(tree, "/modem");
+
+	buf = l_string_new(1024);
+	_dbus_object_tree_introspect(tree, "/", buf);
+	xml = l_string_unwrap(buf);
+	assert(strstr(xml, "\t<node name=\"modem\"/>\n"));
+	l_free(xml);
+
+	_dbus_object_tree_prune_node(node);
+
+	buf = l_string_new(1024);
+	_dbus_object_tree_introspect(tree, "/", buf);
+	xml = l_string_unwrap(buf);
+	assert(!strcmp(ofono_manager_introspection, xml));
+	l_free(xml);
+
 	_dbus_object_tree_free(tree);
 }
 
@@ -468,6 +541,17 @@ static void test_dbus_object_tree_dispatch(const void *test_data)
 	_dbus_object_tree_dispatch(tree, NULL, message);
 	assert(callback_called);
 
+	/* Repeated calls are served from the per-object cache */
+	callback_called = false;
+	_dbus_object_tree_dispatch(tree, NULL, message);
+	assert(callback_called);
+
+	_dbus_object_tree_remove_interface(tree, "/", "org.ofono.Manager");
+
+	callback_called = false;
+	assert(!_dbus_object_tree_dispatch(tree, NULL, message));
+	assert(!callback_called);
+
 	l_dbus_message_unref(message);
 
 	_dbus_object_tree_free(tree);
@@ -531,6 +615,9 @@ int main(int argc, char *argv[])
 	l_test_add("_dbus_object_tree Sanity Tests 1",
 					test_dbus_object_tree_1, NULL);
 
+	l_test_add("_dbus_object_tree Wide Tests",
+					test_dbus_object_tree_wide, NULL);
+
 	l_test_add("_dbus_object_tree Sanity Tests 2",
 					test_dbus_object_tree_2, NULL);
 
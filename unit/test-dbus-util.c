@@ -13,6 +13,7 @@
 
 #include <ell/ell.h>
 #include "ell/dbus-private.h"
+#include "ell/gvariant-private.h"
 
 struct signature_test {
 	bool valid;
@@ -52,6 +53,28 @@ static void test_signature(const void *test_data)
 	assert(valid == test->valid);
 }
 
+static void test_signature_cache(const void *test_data)
+{
+	static const char *long_sig = "(ssssssssssssssssssssssssssssssss)";
+	int i;
+
+	/* Lookups must give the same answer whether cached or not */
+	for (i = 0; i < 2; i++) {
+		assert(!_dbus_valid_signature("a"));
+		assert(_dbus_num_children("a") == -1);
+		assert(_dbus_num_children("(sa{sv})sa{ss}us") == 5);
+		assert(_dbus_num_children(long_sig) == 1);
+		assert(!_dbus_valid_signature(""));
+
+		/* The same key is valid in one format but not the other */
+		assert(!_dbus_valid_signature("()"));
+		assert(_gvariant_valid_signature("()"));
+		assert(_gvariant_num_children("(sa{sv})sa{ss}us") == 5);
+		assert(_gvariant_get_alignment("(yt)") == 8);
+		assert(_gvariant_get_alignment(long_sig) == 1);
+	}
+}
+
 struct interface_test {
 	bool valid;
 	const char *interface;
@@ -156,6 +179,7 @@ int main(int argc, char *argv[])
 	l_test_add("Signature test 14", test_signature, &sig_test14);
 	l_test_add("Signature test 15", test_signature, &sig_test15);
 	l_test_add("Signature test 16", test_signature, &sig_test16);
+	l_test_add("Signature cache", test_signature_cache, NULL);
 
 	l_test_add("Interface Test 1", test_interface, &iface_test1);
 	l_test_add("Interface Test 2", test_interface, &iface_test2);
@@ -9,6 +9,7 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 
@@ -268,6 +269,354 @@ static void test_filter_tree(const void *test_data)
 			test.calls[4] == 1);
 }
 
+static bool test_index_add_match(struct l_dbus *dbus, unsigned int id,
+				const struct _dbus_filter_condition *rule,
+				int rule_len)
+{
+	return true;
+}
+
+static bool test_index_remove_match(struct l_dbus *dbus, unsigned int id)
+{
+	return true;
+}
+
+static void test_index_cb(struct l_dbus_message *message, void *user_data)
+{
+	int *calls = user_data;
+
+	(*calls)++;
+}
+
+static void test_filter_index(const void *test_data)
+{
+	static const struct _dbus_filter_ops filter_ops = {
+		.skip_register = true,
+		.add_match = test_index_add_match,
+		.remove_match = test_index_remove_match,
+	};
+	struct l_dbus dbus;
+	struct _dbus_filter *filter;
+	struct _dbus_filter_condition rule[3] = {
+		{ L_DBUS_MATCH_TYPE, "signal" },
+		{ L_DBUS_MATCH_PATH, "/" },
+		{ L_DBUS_MATCH_MEMBER, NULL },
+	};
+	static const struct _dbus_filter_condition path_rule[] = {
+		{ L_DBUS_MATCH_PATH, "/other" },
+	};
+	char members[64][16];
+	unsigned int ids[64];
+	unsigned int path_id;
+	int calls[64] = {};
+	int path_calls = 0;
+	struct l_dbus_message *message;
+	unsigned int i;
+
+	filter = _dbus_filter_new(&dbus, &filter_ops, NULL);
+	assert(filter);
+
+	for (i = 0; i < L_ARRAY_SIZE(ids); i++) {
+		snprintf(members[i], sizeof(members[i]), "Member%u", i);
+		rule[2].value = members[i];
+
+		ids[i] = _dbus_filter_add_rule(filter, rule, 3,
+						test_index_cb, &calls[i]);
+		assert(ids[i]);
+	}
+
+	/* A rule that doesn't share the type='signal' node at the top */
+	path_id = _dbus_filter_add_rule(filter, path_rule, 1,
+						test_index_cb, &path_calls);
+	assert(path_id);
+
+	message = _dbus_message_new_signal(2, "/", "org.test", "Member42");
+	l_dbus_message_set_arguments(message, "");
+	_dbus_filter_dispatch(message, filter);
+	l_dbus_message_unref(message);
+
+	for (i = 0; i < L_ARRAY_SIZE(calls); i++)
+		assert(calls[i] == (i == 42));
+
+	assert(path_calls == 0);
+
+	message = _dbus_message_new_signal(2, "/other", "org.test",
+						"Member42");
+	l_dbus_message_set_arguments(message, "");
+	_dbus_filter_dispatch(message, filter);
+
+	assert(path_calls == 1);
+	assert(calls[42] == 1);
+
+	assert(_dbus_filter_remove_rule(filter, path_id));
+	_dbus_filter_dispatch(message, filter);
+	assert(path_calls == 1);
+	l_dbus_message_unref(message);
+
+	assert(_dbus_filter_remove_rule(filter, ids[42]));
+
+	message = _dbus_message_new_signal(2, "/", "org.test", "Member42");
+	l_dbus_message_set_arguments(message, "");
+	_dbus_filter_dispatch(message, filter);
+	l_dbus_message_unref(message);
+
+	assert(calls[42] == 1);
+
+	for (i = 0; i < L_ARRAY_SIZE(ids); i++)
+		if (i != 42)
+			assert(_dbus_filter_remove_rule(filter, ids[i]));
+
+	assert(!_dbus_filter_remove_rule(filter, ids[42]));
+
+	_dbus_filter_free(filter);
+}
+
+static void test_filter_args(const void *test_data)
+{
+	static const struct _dbus_filter_ops filter_ops = {
+		.skip_register = true,
+		.add_match = test_index_add_match,
+		.remove_match = test_index_remove_match,
+	};
+	static const struct _dbus_filter_condition member_rule[] = {
+		{ L_DBUS_MATCH_MEMBER, "Changed" },
+		{ L_DBUS_MATCH_ARGUMENT(1), "on" },
+	};
+	static const struct _dbus_filter_condition path_rule[] = {
+		{ L_DBUS_MATCH_PATH, "/" },
+		{ L_DBUS_MATCH_ARGUMENT(1), "on" },
+	};
+	static const struct _dbus_filter_condition missing_rule[] = {
+		{ L_DBUS_MATCH_PATH, "/" },
+		{ L_DBUS_MATCH_ARGUMENT(2), "on" },
+	};
+	struct l_dbus dbus;
+	struct _dbus_filter *filter;
+	struct l_dbus_message *message;
+	int calls[3] = {};
+
+	filter = _dbus_filter_new(&dbus, &filter_ops, NULL);
+	assert(filter);
+
+	assert(_dbus_filter_add_rule(filter, member_rule, 2,
+						test_index_cb, &calls[0]));
+	assert(_dbus_filter_add_rule(filter, path_rule, 2,
+						test_index_cb, &calls[1]));
+	assert(_dbus_filter_add_rule(filter, missing_rule, 2,
+						test_index_cb, &calls[2]));
+
+	/* The same argument is compared in two branches of the tree */
+	message = _dbus_message_new_signal(2, "/", "org.test", "Changed");
+	l_dbus_message_set_arguments(message, "ss", "power", "on");
+	_dbus_filter_dispatch(message, filter);
+	_dbus_filter_dispatch(message, filter);
+	l_dbus_message_unref(message);
+
+	assert(calls[0] == 2 && calls[1] == 2 && calls[2] == 0);
+
+	message = _dbus_message_new_signal(2, "/", "org.test", "Changed");
+	l_dbus_message_set_arguments(message, "ss", "power", "off");
+	_dbus_filter_dispatch(message, filter);
+	l_dbus_message_unref(message);
+
+	assert(calls[0] == 2 && calls[1] == 2 && calls[2] == 0);
+
+	_dbus_filter_free(filter);
+}
+
+struct merge_test_state {
+	struct l_dbus dbus;
+	unsigned int active[4];
+	int n_active;
+	int add_calls, remove_calls;
+};
+
+static bool test_merge_add_match(struct l_dbus *dbus, unsigned int id,
+				const struct _dbus_filter_condition *rule,
+				int rule_len)
+{
+	struct merge_test_state *test =
+		l_container_of(dbus, struct merge_test_state, dbus);
+
+	assert(test->n_active < (int) L_ARRAY_SIZE(test->active));
+
+	test->active[test->n_active++] = id;
+	test->add_calls++;
+
+	return true;
+}
+
+static bool test_merge_remove_match(struct l_dbus *dbus, unsigned int id)
+{
+	struct merge_test_state *test =
+		l_container_of(dbus, struct merge_test_state, dbus);
+	int i;
+
+	for (i = 0; i < test->n_active; i++)
+		if (test->active[i] == id)
+			break;
+
+	assert(i < test->n_active);
+
+	test->active[i] = test->active[--test->n_active];
+	test->remove_calls++;
+
+	return true;
+}
+
+static void test_filter_merge(const void *test_data)
+{
+	static const struct _dbus_filter_ops filter_ops = {
+		.skip_register = true,
+		.add_match = test_merge_add_match,
+		.remove_match = test_merge_remove_match,
+	};
+	static const struct _dbus_filter_condition narrow[] = {
+		{ L_DBUS_MATCH_TYPE, "signal" },
+		{ L_DBUS_MATCH_SENDER, "org.foo" },
+		{ L_DBUS_MATCH_MEMBER, "Changed" },
+	};
+	static const struct _dbus_filter_condition broad[] = {
+		{ L_DBUS_MATCH_MEMBER, "Changed" },
+		{ L_DBUS_MATCH_TYPE, "signal" },
+	};
+	struct merge_test_state test = {};
+	struct _dbus_filter *filter;
+	struct l_dbus_message *message;
+	unsigned int narrow_id, broad_id;
+	int calls[2] = {};
+
+	filter = _dbus_filter_new(&test.dbus, &filter_ops, NULL);
+	assert(filter);
+
+	narrow_id = _dbus_filter_add_rule(filter, narrow, 3,
+						test_index_cb, &calls[0]);
+	assert(narrow_id);
+	assert(test.n_active == 1 && test.add_calls == 1);
+
+	/* The broader rule replaces the narrower one on the bus */
+	broad_id = _dbus_filter_add_rule(filter, broad, 2,
+						test_index_cb, &calls[1]);
+	assert(broad_id);
+	assert(test.n_active == 1 && test.add_calls == 2);
+	assert(test.remove_calls == 1);
+
+	message = _dbus_message_new_signal(2, "/", "org.test", "Changed");
+	l_dbus_message_set_arguments(message, "");
+	_dbus_message_set_sender(message, "org.foo");
+	_dbus_filter_dispatch(message, filter);
+	_dbus_message_set_sender(message, NULL);
+	l_dbus_message_unref(message);
+
+	assert(calls[0] == 1 && calls[1] == 1);
+
+	/* Removing it has to bring the narrower rule back */
+	assert(_dbus_filter_remove_rule(filter, broad_id));
+	assert(test.n_active == 1 && test.add_calls == 3);
+	assert(test.remove_calls == 2);
+
+	assert(_dbus_filter_remove_rule(filter, narrow_id));
+	assert(test.n_active == 0 && test.remove_calls == 3);
+
+	_dbus_filter_free(filter);
+}
+
+static int name_owner_calls, list_names_calls;
+
+static bool test_get_name_owner(struct l_dbus *bus, const char *name)
+{
+	name_owner_calls++;
+
+	return true;
+}
+
+static bool test_list_names(struct l_dbus *bus)
+{
+	list_names_calls++;
+
+	return true;
+}
+
+static void test_name_connect(struct l_dbus *dbus, void *user_data)
+{
+	int *connected = user_data;
+
+	(*connected)++;
+}
+
+static void test_name_disconnect(struct l_dbus *dbus, void *user_data)
+{
+	int *connected = user_data;
+
+	(*connected)--;
+}
+
+static void test_name_cache(const void *test_data)
+{
+	static const struct _dbus_name_ops name_ops = {
+		.get_name_owner = test_get_name_owner,
+		.list_names = test_list_names,
+	};
+	static const char *bus_names[] = {
+		DBUS_SERVICE_DBUS, ":1.1", "org.foo", ":1.2", "org.bar", NULL
+	};
+	struct l_dbus dbus;
+	struct _dbus_name_cache *cache;
+	struct l_dbus_name_cache_stats stats;
+	int connected[5] = {};
+
+	cache = _dbus_name_cache_new(&dbus, &name_ops);
+	assert(cache);
+
+	assert(_dbus_name_cache_add_watch(cache, "org.foo", test_name_connect,
+						test_name_disconnect,
+						&connected[0], NULL));
+	assert(list_names_calls == 1 && name_owner_calls == 1);
+
+	_dbus_name_cache_notify(cache, "org.foo", ":1.1");
+	assert(connected[0] == 1);
+
+	_dbus_name_cache_set_bus_names(cache, (char **) bus_names);
+
+	/* Names missing from the list need no round-trip */
+	assert(_dbus_name_cache_add_watch(cache, "org.absent",
+						test_name_connect, NULL,
+						&connected[1], NULL));
+	assert(connected[1] == 0 && name_owner_calls == 1);
+
+	/* Neither do unique names */
+	assert(_dbus_name_cache_add_watch(cache, ":1.2", test_name_connect,
+						NULL, &connected[2], NULL));
+	assert(connected[2] == 1 && name_owner_calls == 1);
+
+	/* Owners of listed well-known names still have to be asked for */
+	assert(_dbus_name_cache_add_watch(cache, "org.bar", test_name_connect,
+						NULL, &connected[3], NULL));
+	assert(connected[3] == 0 && name_owner_calls == 2);
+
+	_dbus_name_cache_notify(cache, "org.bar", ":1.2");
+	assert(connected[3] == 1);
+
+	/* Names appearing later are tracked even when nobody watches them */
+	_dbus_name_cache_notify(cache, "org.new", ":1.3");
+	assert(_dbus_name_cache_add_watch(cache, "org.new", test_name_connect,
+						NULL, &connected[4], NULL));
+	assert(connected[4] == 1 && name_owner_calls == 2);
+
+	_dbus_name_cache_notify(cache, "org.foo", "");
+	assert(connected[0] == 0);
+	assert(!_dbus_name_cache_lookup(cache, "org.foo"));
+	assert(!strcmp(_dbus_name_cache_lookup(cache, "org.new"), ":1.3"));
+
+	assert(_dbus_name_cache_get_stats(cache, &stats));
+	assert(stats.lookups == 5 && stats.hits == 3);
+	assert(stats.negative_hits == 1 && stats.requests == 2);
+
+	assert(list_names_calls == 1);
+
+	_dbus_name_cache_free(cache);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -275,6 +624,10 @@ int main(int argc, char *argv[])
 	l_test_add("_dbus_filter_rule_to_str", test_rule_to_str, NULL);
 
 	l_test_add("DBus filter tree", test_filter_tree, NULL);
+	l_test_add("DBus filter index", test_filter_index, NULL);
+	l_test_add("DBus filter arguments", test_filter_args, NULL);
+	l_test_add("DBus filter rule merging", test_filter_merge, NULL);
+	l_test_add("DBus name cache", test_name_cache, NULL);
 
 	return l_test_run();
 }
@@ -11,7 +11,10 @@
 
 #define _GNU_SOURCE
 #include <unistd.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <sys/wait.h>
 
 #include <ell/ell.h>
@@ -264,6 +267,630 @@ static void test_dbus(const void *data)
 	tests_completed++;
 }
 
+#define BATCH_SIGNALS 32
+#define BATCH_LARGE_SIZE 49152
+
+static unsigned int batch_signals;
+static bool batch_large_received;
+static unsigned int batch_congestion_changes;
+static bool batch_congested;
+static bool batch_call_replied;
+
+static void batch_check_done(void)
+{
+	if (batch_large_received && batch_congestion_changes == 2 &&
+			batch_call_replied)
+		l_main_quit();
+}
+
+static void batch_call_reply(struct l_dbus_message *message,
+							void *user_data)
+{
+	test_assert(!l_dbus_message_is_error(message));
+
+	/* Sent after all of the signals but overtook them */
+	test_assert(batch_signals == 0);
+
+	batch_call_replied = true;
+	batch_check_done();
+}
+
+static void batch_backpressure(bool congested, void *user_data)
+{
+	test_assert(congested != batch_congested);
+
+	batch_congested = congested;
+	batch_congestion_changes++;
+	batch_check_done();
+}
+
+static void batch_signal(struct l_dbus_message *message, void *user_data)
+{
+	const char *interface = l_dbus_message_get_interface(message);
+	const char *str;
+
+	if (!interface || strcmp(interface, "org.test.Batch"))
+		return;
+
+	test_assert(l_dbus_message_get_arguments(message, "s", &str));
+
+	/* The large signal is sent last, after all of the small ones */
+	if (!strcmp(l_dbus_message_get_member(message), "Large")) {
+		test_assert(batch_signals == BATCH_SIGNALS);
+		test_assert(strlen(str) == BATCH_LARGE_SIZE);
+		test_assert(str[0] == 'x' && str[BATCH_LARGE_SIZE - 1] == 'x');
+		batch_large_received = true;
+		batch_check_done();
+		return;
+	}
+
+	test_assert(strtoul(str, NULL, 10) == batch_signals);
+	batch_signals++;
+}
+
+static void batch_match_setup(struct l_dbus_message *message,
+							void *user_data)
+{
+	l_dbus_message_set_arguments(message, "s",
+				"type=signal,interface=org.test.Batch");
+}
+
+static void batch_ready_callback(void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+	struct l_dbus_message *signal;
+	char *large;
+	unsigned int i;
+
+	test_assert(l_dbus_method_call(dbus, "org.freedesktop.DBus",
+					"/org/freedesktop/DBus",
+					"org.freedesktop.DBus", "AddMatch",
+					batch_match_setup, NULL, NULL, NULL));
+
+	/* All of these get queued up and written out together */
+	for (i = 0; i < BATCH_SIGNALS; i++) {
+		char str[16];
+
+		signal = l_dbus_message_new_signal(dbus, "/test",
+						"org.test.Batch", "Small");
+		snprintf(str, sizeof(str), "%u", i);
+		l_dbus_message_set_arguments(signal, "s", str);
+		test_assert(l_dbus_send(dbus, signal));
+	}
+
+	/* Larger than the receive buffer */
+	large = l_malloc(BATCH_LARGE_SIZE + 1);
+	memset(large, 'x', BATCH_LARGE_SIZE);
+	large[BATCH_LARGE_SIZE] = '\0';
+
+	signal = l_dbus_message_new_signal(dbus, "/test", "org.test.Batch",
+								"Large");
+	l_dbus_message_set_arguments(signal, "s", large);
+	test_assert(l_dbus_send(dbus, signal));
+
+	l_free(large);
+
+	test_assert(l_dbus_method_call(dbus, "org.freedesktop.DBus",
+					"/org/freedesktop/DBus",
+					"org.freedesktop.DBus", "GetId",
+					NULL, batch_call_reply, NULL, NULL));
+}
+
+static void test_dbus_batch(const void *data)
+{
+	const char *address = data;
+	struct l_dbus *dbus;
+	int i;
+
+	batch_signals = 0;
+	batch_large_received = false;
+	batch_congestion_changes = 0;
+	batch_congested = false;
+	batch_call_replied = false;
+
+	test_assert(l_main_init());
+
+	for (i = 0; i < 10; i++) {
+		dbus = l_dbus_new(address);
+		if (dbus)
+			break;
+
+		usleep(200 * 1000);
+	}
+
+	test_assert(dbus);
+
+	l_dbus_set_ready_handler(dbus, batch_ready_callback, dbus, NULL);
+	l_dbus_set_disconnect_handler(dbus, disconnect_callback, NULL, NULL);
+
+	l_dbus_register(dbus, batch_signal, NULL, NULL);
+
+	test_assert(l_dbus_set_priority_lanes(dbus, true));
+
+	/* The signals queued in one go should trip this once and clear it */
+	l_dbus_set_signal_backpressure_handler(dbus, BATCH_SIGNALS / 2,
+						batch_backpressure, NULL, NULL);
+
+	l_main_run_with_signal(signal_handler, NULL);
+
+	test_assert(batch_large_received);
+	test_assert(batch_congestion_changes == 2 && !batch_congested);
+	test_assert(batch_call_replied);
+
+	l_dbus_destroy(dbus);
+	l_main_exit();
+	tests_completed++;
+}
+
+static bool timeout_reply_received;
+static bool timeout_cancelled_destroyed;
+static unsigned int timeout_slow_hangs;
+
+static struct l_dbus_message *timeout_hang(struct l_dbus *dbus,
+						struct l_dbus_message *message,
+						void *user_data)
+{
+	/* Never reply, the caller has to give up on its own */
+	return NULL;
+}
+
+static void setup_timeout_interface(struct l_dbus_interface *interface)
+{
+	l_dbus_interface_method(interface, "Hang", 0, timeout_hang, "", "");
+}
+
+static void timeout_slow_handler(const char *interface, const char *member,
+					uint64_t duration, void *user_data)
+{
+	if (!strcmp(interface, "org.test.Timeout") && !strcmp(member, "Hang"))
+		timeout_slow_hangs++;
+}
+
+static void timeout_member_stats(const struct l_dbus_member_stats *stats,
+							void *user_data)
+{
+	const struct l_dbus_member_stats **hang = user_data;
+
+	if (!strcmp(stats->interface, "org.test.Timeout") &&
+					!strcmp(stats->member, "Hang"))
+		*hang = stats;
+}
+
+static void timeout_reply(struct l_dbus_message *message, void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+	struct l_dbus_reply_stats stats;
+	struct l_dbus_traffic_stats traffic;
+	const struct l_dbus_member_stats *hang = NULL;
+	const char *name, *text;
+
+	test_assert(l_dbus_message_get_error(message, &name, &text));
+	test_assert(!strcmp(name, "org.freedesktop.DBus.Error.NoReply"));
+
+	test_assert(l_dbus_get_reply_stats(dbus, "org.test.Timeout", &stats));
+	test_assert(stats.in_flight == 0);
+	test_assert(stats.timeouts == 1);
+	test_assert(stats.replies == 0);
+
+	test_assert(l_dbus_get_reply_stats(dbus, "org.freedesktop.DBus",
+								&stats));
+	test_assert(stats.in_flight == 0);
+	test_assert(stats.replies >= 1);
+
+	/* The cancelled call never went out, the other one came back to us */
+	test_assert(l_dbus_get_traffic_stats(dbus, &traffic));
+	test_assert(traffic.method_calls_out.messages >= 2);
+	test_assert(traffic.method_calls_in.messages == 1);
+	test_assert(traffic.method_returns_in.messages >= 1);
+
+	test_assert(l_dbus_foreach_member_stats(dbus, timeout_member_stats,
+								&hang));
+	test_assert(hang);
+	test_assert(hang->messages_out == 1);
+	test_assert(hang->messages_in == 1);
+	test_assert(hang->bytes_out > 0 && hang->bytes_in > 0);
+	test_assert(hang->handler_calls == 1);
+	test_assert(hang->slow_calls == 1);
+	test_assert(timeout_slow_hangs == 1);
+
+	timeout_reply_received = true;
+	l_main_quit();
+}
+
+static void timeout_cancelled_reply(struct l_dbus_message *message,
+							void *user_data)
+{
+	test_assert(false);
+}
+
+static void timeout_cancelled_destroy(void *user_data)
+{
+	timeout_cancelled_destroyed = true;
+}
+
+static void timeout_name_acquired(struct l_dbus *dbus, bool success,
+					bool queued, void *user_data)
+{
+	struct l_dbus_message *message;
+	uint32_t serial;
+
+	test_assert(success);
+
+	message = l_dbus_message_new_method_call(dbus, "org.test.Timeout",
+						"/test", "org.test.Timeout",
+						"Hang");
+	l_dbus_message_set_arguments(message, "");
+	test_assert(l_dbus_send_with_reply_timeout(dbus, message,
+						timeout_reply, dbus, NULL,
+						100));
+
+	/* Cancelled while still queued, so it never goes out */
+	message = l_dbus_message_new_method_call(dbus, "org.test.Timeout",
+						"/test", "org.test.Timeout",
+						"Hang");
+	l_dbus_message_set_arguments(message, "");
+	serial = l_dbus_send_with_reply_timeout(dbus, message,
+						timeout_cancelled_reply, NULL,
+						timeout_cancelled_destroy, 50);
+	test_assert(serial);
+	test_assert(l_dbus_cancel(dbus, serial));
+	test_assert(timeout_cancelled_destroyed);
+	test_assert(!l_dbus_cancel(dbus, serial));
+}
+
+static void timeout_ready_callback(void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+
+	test_assert(l_dbus_name_acquire(dbus, "org.test.Timeout", false, false,
+					false, timeout_name_acquired, NULL));
+}
+
+static void test_dbus_reply_timeout(const void *data)
+{
+	const char *address = data;
+	struct l_dbus *dbus;
+	int i;
+
+	timeout_reply_received = false;
+	timeout_cancelled_destroyed = false;
+	timeout_slow_hangs = 0;
+
+	test_assert(l_main_init());
+
+	for (i = 0; i < 10; i++) {
+		dbus = l_dbus_new(address);
+		if (dbus)
+			break;
+
+		usleep(200 * 1000);
+	}
+
+	test_assert(dbus);
+
+	test_assert(l_dbus_register_interface(dbus, "org.test.Timeout",
+						setup_timeout_interface,
+						NULL, false));
+	test_assert(l_dbus_object_add_interface(dbus, "/test",
+						"org.test.Timeout", NULL));
+
+	test_assert(l_dbus_set_traffic_stats(dbus, true));
+	test_assert(l_dbus_set_slow_handler(dbus, 0, timeout_slow_handler,
+								NULL, NULL));
+
+	l_dbus_set_ready_handler(dbus, timeout_ready_callback, dbus, NULL);
+	l_dbus_set_disconnect_handler(dbus, disconnect_callback, NULL, NULL);
+
+	l_main_run_with_signal(signal_handler, NULL);
+
+	test_assert(timeout_reply_received);
+
+	l_dbus_destroy(dbus);
+	l_main_exit();
+	tests_completed++;
+}
+
+static struct l_dbus *peer_client;
+static bool peer_linked_echo;
+static bool peer_bus_echo;
+
+static struct l_dbus_message *peer_echo(struct l_dbus *dbus,
+					struct l_dbus_message *message,
+					void *user_data)
+{
+	struct l_dbus_message *reply;
+	const char *sender = l_dbus_message_get_sender(message);
+	const char *str;
+	bool linked;
+
+	if (!l_dbus_message_get_arguments(message, "s", &str))
+		return NULL;
+
+	/* The sender is the client's unique name either way */
+	linked = sender && sender[0] == ':' &&
+			l_dbus_peer_link_is_active(dbus, sender);
+
+	reply = l_dbus_message_new_method_return(message);
+	l_dbus_message_set_arguments(reply, "sb", str, linked);
+
+	return reply;
+}
+
+static void setup_peer_interface(struct l_dbus_interface *interface)
+{
+	l_dbus_interface_method(interface, "Echo", 0, peer_echo,
+					"sb", "s", "str", "linked", "str");
+}
+
+static void peer_echo_send(struct l_dbus *dbus, const char *str,
+				l_dbus_message_func_t function)
+{
+	struct l_dbus_message *message;
+
+	message = l_dbus_message_new_method_call(dbus, "org.test.Peer",
+						"/test", "org.test.Peer",
+						"Echo");
+	l_dbus_message_set_arguments(message, "s", str);
+	test_assert(l_dbus_send_with_reply(dbus, message, function,
+								dbus, NULL));
+}
+
+static void peer_bus_reply(struct l_dbus_message *message, void *user_data)
+{
+	const char *str;
+	bool linked;
+
+	test_assert(l_dbus_message_get_arguments(message, "sb", &str,
+								&linked));
+	test_assert(!strcmp(str, "bus"));
+	test_assert(!linked);
+
+	peer_bus_echo = true;
+	l_main_quit();
+}
+
+static void peer_linked_reply(struct l_dbus_message *message,
+							void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+	struct l_dbus_traffic_stats traffic;
+	const char *str;
+	bool linked;
+
+	test_assert(l_dbus_message_get_arguments(message, "sb", &str,
+								&linked));
+	test_assert(!strcmp(str, "link"));
+	test_assert(linked);
+
+	/* Only the Connect call went through the bus */
+	test_assert(l_dbus_get_traffic_stats(dbus, &traffic));
+	test_assert(traffic.method_calls_out.messages == 1);
+
+	peer_linked_echo = true;
+
+	test_assert(l_dbus_peer_link_close(dbus, "org.test.Peer"));
+	test_assert(!l_dbus_peer_link_is_active(dbus, "org.test.Peer"));
+
+	peer_echo_send(dbus, "bus", peer_bus_reply);
+}
+
+static void peer_link_done(struct l_dbus *dbus, bool success,
+							void *user_data)
+{
+	test_assert(success);
+	test_assert(l_dbus_peer_link_is_active(dbus, "org.test.Peer"));
+
+	peer_echo_send(dbus, "link", peer_linked_reply);
+}
+
+static void peer_client_ready(void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+
+	test_assert(l_dbus_set_traffic_stats(dbus, true));
+	test_assert(l_dbus_peer_link_request(dbus, "org.test.Peer",
+						peer_link_done, NULL, NULL));
+	test_assert(!l_dbus_peer_link_is_active(dbus, "org.test.Peer"));
+}
+
+static void peer_name_acquired(struct l_dbus *dbus, bool success,
+					bool queued, void *user_data)
+{
+	const char *address = user_data;
+
+	test_assert(success);
+
+	peer_client = l_dbus_new(address);
+	test_assert(peer_client);
+
+	l_dbus_set_ready_handler(peer_client, peer_client_ready,
+							peer_client, NULL);
+	l_dbus_set_disconnect_handler(peer_client, disconnect_callback,
+								NULL, NULL);
+}
+
+static void peer_server_ready(void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+
+	test_assert(l_dbus_name_acquire(dbus, "org.test.Peer", false, false,
+					false, peer_name_acquired,
+					TEST_BUS_ADDRESS_UNIX));
+}
+
+static void test_dbus_peer_link(const void *data)
+{
+	const char *address = data;
+	struct l_dbus *dbus;
+	int i;
+
+	peer_client = NULL;
+	peer_linked_echo = false;
+	peer_bus_echo = false;
+
+	test_assert(l_main_init());
+
+	for (i = 0; i < 10; i++) {
+		dbus = l_dbus_new(address);
+		if (dbus)
+			break;
+
+		usleep(200 * 1000);
+	}
+
+	test_assert(dbus);
+
+	test_assert(l_dbus_register_interface(dbus, "org.test.Peer",
+						setup_peer_interface,
+						NULL, false));
+	test_assert(l_dbus_object_add_interface(dbus, "/test",
+						"org.test.Peer", NULL));
+	test_assert(l_dbus_peer_link_accept(dbus, true));
+
+	l_dbus_set_ready_handler(dbus, peer_server_ready, dbus, NULL);
+	l_dbus_set_disconnect_handler(dbus, disconnect_callback, NULL, NULL);
+
+	l_main_run_with_signal(signal_handler, NULL);
+
+	test_assert(peer_linked_echo);
+	test_assert(peer_bus_echo);
+
+	l_dbus_destroy(peer_client);
+	l_dbus_destroy(dbus);
+	l_main_exit();
+	tests_completed++;
+}
+
+#define THREAD_SIGNALS 64
+
+static unsigned int thread_signals;
+
+static void *thread_send_signals(void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+	unsigned int i;
+
+	for (i = 0; i < THREAD_SIGNALS; i++) {
+		struct l_dbus_message *signal;
+		struct l_dbus_message_builder *builder;
+		unsigned int j;
+
+		signal = l_dbus_message_new_signal(dbus, "/test",
+						"org.test.Thread", "Data");
+		builder = l_dbus_message_builder_new(signal);
+		l_dbus_message_builder_append_basic(builder, 'u', &i);
+		l_dbus_message_builder_enter_array(builder, "u");
+
+		for (j = 0; j < 256; j++)
+			l_dbus_message_builder_append_basic(builder, 'u', &j);
+
+		l_dbus_message_builder_leave_array(builder);
+		l_dbus_message_builder_finalize(builder);
+		l_dbus_message_builder_destroy(builder);
+
+		if (!l_dbus_send_from_thread(dbus, signal))
+			break;
+	}
+
+	return NULL;
+}
+
+static void thread_signal(struct l_dbus_message *message, void *user_data)
+{
+	const char *interface = l_dbus_message_get_interface(message);
+	struct l_dbus_message_iter iter;
+	uint32_t index;
+	uint32_t value;
+	unsigned int count = 0;
+
+	if (!interface || strcmp(interface, "org.test.Thread"))
+		return;
+
+	test_assert(l_dbus_message_get_arguments(message, "uau", &index,
+								&iter));
+
+	/* Sends from one thread keep their order */
+	test_assert(index == thread_signals);
+
+	while (l_dbus_message_iter_next_entry(&iter, &value))
+		test_assert(value == count++);
+
+	test_assert(count == 256);
+
+	if (++thread_signals == THREAD_SIGNALS)
+		l_main_quit();
+}
+
+static void thread_match_setup(struct l_dbus_message *message,
+							void *user_data)
+{
+	l_dbus_message_set_arguments(message, "s",
+				"type=signal,interface=org.test.Thread");
+}
+
+static pthread_t thread_sender;
+static bool thread_started;
+
+static void thread_match_reply(struct l_dbus_message *message,
+							void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+
+	test_assert(!l_dbus_message_is_error(message));
+	test_assert(!pthread_create(&thread_sender, NULL,
+						thread_send_signals, dbus));
+	thread_started = true;
+}
+
+static void thread_ready_callback(void *user_data)
+{
+	struct l_dbus *dbus = user_data;
+
+	test_assert(l_dbus_method_call(dbus, "org.freedesktop.DBus",
+					"/org/freedesktop/DBus",
+					"org.freedesktop.DBus", "AddMatch",
+					thread_match_setup, thread_match_reply,
+					dbus, NULL));
+}
+
+static void test_dbus_send_from_thread(const void *data)
+{
+	const char *address = data;
+	struct l_dbus *dbus;
+	int i;
+
+	thread_signals = 0;
+	thread_started = false;
+
+	test_assert(l_main_init());
+
+	for (i = 0; i < 10; i++) {
+		dbus = l_dbus_new(address);
+		if (dbus)
+			break;
+
+		usleep(200 * 1000);
+	}
+
+	test_assert(dbus);
+
+	l_dbus_set_ready_handler(dbus, thread_ready_callback, dbus, NULL);
+	l_dbus_set_disconnect_handler(dbus, disconnect_callback, NULL, NULL);
+
+	l_dbus_register(dbus, thread_signal, NULL, NULL);
+
+	l_main_run_with_signal(signal_handler, NULL);
+
+	if (thread_started)
+		pthread_join(thread_sender, NULL);
+
+	test_assert(thread_signals == THREAD_SIGNALS);
+
+	l_dbus_destroy(dbus);
+	l_main_exit();
+	tests_completed++;
+}
+
 int main(int argc, char *argv[])
 {
 	struct l_signal *sigchld;
@@ -272,6 +899,12 @@ int main(int argc, char *argv[])
 
 	l_test_add("Using a unix socket", test_dbus, TEST_BUS_ADDRESS_UNIX);
 	l_test_add("Using a tcp socket", test_dbus, TEST_BUS_ADDRESS_TCP);
+	l_test_add("Batched messages", test_dbus_batch, TEST_BUS_ADDRESS_UNIX);
+	l_test_add("Reply timeout", test_dbus_reply_timeout,
+						TEST_BUS_ADDRESS_UNIX);
+	l_test_add("Peer link", test_dbus_peer_link, TEST_BUS_ADDRESS_UNIX);
+	l_test_add("Send from thread", test_dbus_send_from_thread,
+						TEST_BUS_ADDRESS_UNIX);
 
 	sigchld = l_signal_create(SIGCHLD, sigchld_handler, NULL, NULL);
 
@@ -285,7 +918,7 @@ int main(int argc, char *argv[])
 
 	l_signal_remove(sigchld);
 
-	if (tests_completed == 2)
+	if (tests_completed == 6)
 		return 0;
 
 	return -1;
@@ -0,0 +1,213 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <ell/ell.h>
+
+struct recv_data {
+	unsigned int n_received;
+	unsigned int n_destroys;
+	bool echo;
+	bool free_on_recv;
+	bool has_timestamp;
+};
+
+static void recv_cb(struct l_dgram *dgram, const struct l_dgram_msg *msg,
+							void *user_data)
+{
+	struct recv_data *data = user_data;
+	char expected[16];
+
+	sprintf(expected, "msg %u", data->n_received++);
+	assert(msg->len == strlen(expected));
+	assert(!memcmp(msg->data, expected, msg->len));
+	assert(!msg->truncated);
+	assert(msg->timestamp);
+
+	if (l_dgram_msg_get_cmsg(msg, SOL_SOCKET, SCM_TIMESTAMP,
+						sizeof(struct timeval)))
+		data->has_timestamp = true;
+
+	if (data->echo)
+		assert(!l_dgram_send(dgram, NULL, 0, msg->data, msg->len));
+
+	if (data->free_on_recv)
+		l_dgram_free(dgram);
+}
+
+static void recv_destroy(void *user_data)
+{
+	struct recv_data *data = user_data;
+
+	data->n_destroys++;
+}
+
+static void send_messages(int fd, unsigned int n)
+{
+	char buf[16];
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		sprintf(buf, "msg %u", i);
+		assert(send(fd, buf, strlen(buf), 0) == (ssize_t) strlen(buf));
+	}
+}
+
+static unsigned int drain(int fd)
+{
+	char buf[64];
+	unsigned int n = 0;
+
+	while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+		n++;
+
+	return n;
+}
+
+static void test_recv_batch(const void *test_data)
+{
+	struct recv_data data = { .echo = true };
+	struct l_dgram *dgram;
+	int one = 1;
+	int fds[2];
+
+	assert(l_main_init());
+	assert(!socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds));
+	assert(!setsockopt(fds[0], SOL_SOCKET, SO_TIMESTAMP,
+							&one, sizeof(one)));
+
+	dgram = l_dgram_new(fds[0], 4, 64);
+	assert(dgram);
+	assert(l_dgram_set_close_on_free(dgram, true));
+	assert(l_dgram_set_budget(dgram, 6, 0));
+	assert(l_dgram_set_recv_handler(dgram, recv_cb, &data,
+							recv_destroy));
+
+	send_messages(fds[1], 10);
+
+	/* Only the budget is handled per wakeup, the replies go out after */
+	l_main_iterate(0);
+	assert(data.n_received == 6);
+	assert(drain(fds[1]) == 6);
+
+	l_main_iterate(0);
+	assert(data.n_received == 10);
+	assert(drain(fds[1]) == 4);
+	assert(data.has_timestamp);
+
+	l_dgram_free(dgram);
+	assert(data.n_destroys == 1);
+
+	close(fds[1]);
+	assert(l_main_exit());
+}
+
+static void test_send_queue(const void *test_data)
+{
+	struct l_dgram *dgram;
+	char big[65] = {};
+	unsigned int n_queued = 0;
+	unsigned int n_received = 0;
+	int err = 0;
+	int fds[2];
+
+	assert(l_main_init());
+	assert(!socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds));
+
+	dgram = l_dgram_new(fds[0], 4, 64);
+	assert(dgram);
+	assert(l_dgram_set_close_on_free(dgram, true));
+	assert(l_dgram_set_budget(dgram, 0, 8));
+
+	assert(l_dgram_send(dgram, NULL, 0, big, sizeof(big)) == -EMSGSIZE);
+
+	/* Less than a batch is held back until the loop runs */
+	assert(!l_dgram_send(dgram, NULL, 0, "a", 1));
+	assert(!l_dgram_send(dgram, NULL, 0, "b", 1));
+	assert(!drain(fds[1]));
+
+	l_main_iterate(0);
+	assert(drain(fds[1]) == 2);
+
+	/* Without a reader the queue fills up to the budget */
+	while (n_queued < 10000) {
+		err = l_dgram_send(dgram, NULL, 0, "c", 1);
+		if (err)
+			break;
+
+		n_queued++;
+	}
+
+	assert(err == -ENOBUFS);
+
+	/* Everything that was accepted is sent once the reader catches up */
+	while (n_received < n_queued) {
+		n_received += drain(fds[1]);
+		l_main_iterate(0);
+	}
+
+	assert(n_received == n_queued);
+	assert(!l_dgram_get_tx_dropped(dgram));
+	assert(!l_dgram_flush(dgram));
+
+	l_dgram_free(dgram);
+	close(fds[1]);
+	assert(l_main_exit());
+}
+
+static void test_free_in_callback(const void *test_data)
+{
+	struct recv_data data = { .echo = true, .free_on_recv = true };
+	struct l_dgram *dgram;
+	int fds[2];
+
+	assert(l_main_init());
+	assert(!socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds));
+
+	dgram = l_dgram_new(fds[0], 0, 0);
+	assert(dgram);
+	assert(l_dgram_set_close_on_free(dgram, true));
+	assert(l_dgram_set_recv_handler(dgram, recv_cb, &data,
+							recv_destroy));
+
+	send_messages(fds[1], 3);
+
+	l_main_iterate(0);
+	assert(data.n_received == 1);
+	assert(data.n_destroys == 1);
+
+	/* The reply queued before the free is still sent */
+	assert(drain(fds[1]) == 1);
+
+	l_main_iterate(0);
+	close(fds[1]);
+	assert(l_main_exit());
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("l_dgram batched receive", test_recv_batch, NULL);
+	l_test_add("l_dgram send queue", test_send_queue, NULL);
+	l_test_add("l_dgram free from callback", test_free_in_callback,
+									NULL);
+
+	return l_test_run();
+}
@@ -12,8 +12,10 @@
 #include <assert.h>
 #include <linux/types.h>
 #include <netinet/ip.h>
+#include <arpa/inet.h>
 #include <linux/if_arp.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include <ell/ell.h>
 #include "ell/dhcp-private.h"
@@ -850,7 +852,7 @@ static void client_connect(struct l_dhcp_client *client,
 	assert(event_handler_called);
 }
 
-static struct l_dhcp_server *server_init()
+static struct l_dhcp_server *server_init_with_lease_file(const char *path)
 {
 	char *dns[] = { "192.168.1.1", "192.168.1.254", NULL };
 	struct l_dhcp_server *server = l_dhcp_server_new(41);
@@ -872,11 +874,19 @@ static struct l_dhcp_server *server_init()
 
 	assert(_dhcp_server_set_transport(server, srv_transport));
 
+	if (path)
+		assert(l_dhcp_server_set_lease_file(server, path));
+
 	assert(l_dhcp_server_start(server));
 
 	return server;
 }
 
+static struct l_dhcp_server *server_init()
+{
+	return server_init_with_lease_file(NULL);
+}
+
 static void test_complete_run(const void *data)
 {
 	bool rapid_commit = L_PTR_TO_UINT(data);
@@ -895,6 +905,7 @@ static void test_complete_run(const void *data)
 	char *srv_addr;
 	char *tmp_addr;
 	char **dns_list;
+	const uint32_t *dns_u32;
 
 	server = server_init();
 	l_dhcp_server_set_enable_rapid_commit(server, rapid_commit);
@@ -939,6 +950,12 @@ static void test_complete_run(const void *data)
 	assert(!strcmp(dns_list[1], "192.168.1.254"));
 	l_strv_free(dns_list);
 
+	dns_u32 = l_dhcp_lease_get_dns_u32(cli_lease);
+	assert(dns_u32);
+	assert(dns_u32[0] == htonl(0xc0a80101));
+	assert(dns_u32[1] == htonl(0xc0a801fe));
+	assert(!dns_u32[2]);
+
 	client2 = client_init(addr2);
 
 	client_connect(client2, server, rapid_commit);
@@ -1043,6 +1060,475 @@ static void test_expired_ip_reuse(const void *data)
 	l_dhcp_server_destroy(server);
 }
 
+static void test_lease_file(const void *data)
+{
+	static const uint8_t addr1[6] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 };
+	static const uint8_t addr2[6] = { 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c };
+	static const uint8_t addr3[6] = { 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12 };
+	static const char *path = "/tmp/ell-test-dhcp-leases";
+	struct l_dhcp_server *server;
+	struct l_dhcp_lease *lease;
+	char *cli_addr;
+
+	unlink(path);
+
+	/* Bind two leases, then release the second one */
+	server = server_init_with_lease_file(path);
+
+	lease = l_dhcp_server_discover(server, 0, NULL, addr1);
+	assert(lease);
+	assert(l_dhcp_server_request(server, lease));
+	l_free(new_client);
+	new_client = NULL;
+
+	lease = l_dhcp_server_discover(server, 0, NULL, addr2);
+	assert(lease);
+	assert(l_dhcp_server_request(server, lease));
+	l_free(new_client);
+	new_client = NULL;
+
+	assert(l_dhcp_server_release(server, lease));
+	l_free(expired_client);
+	expired_client = NULL;
+
+	l_dhcp_server_destroy(server);
+
+	/* Only the first binding is restored on restart */
+	server = server_init_with_lease_file(path);
+
+	lease = l_dhcp_server_discover(server, 0, NULL, addr3);
+	assert(lease);
+	cli_addr = l_dhcp_lease_get_address(lease);
+	assert(!strcmp(cli_addr, "192.168.1.3"));
+	l_free(cli_addr);
+
+	lease = l_dhcp_server_discover(server, 0, NULL, addr1);
+	assert(lease);
+	cli_addr = l_dhcp_lease_get_address(lease);
+	assert(!strcmp(cli_addr, "192.168.1.2"));
+	l_free(cli_addr);
+
+	l_dhcp_server_destroy(server);
+	unlink(path);
+}
+
+static uint8_t client_message_type(void)
+{
+	struct dhcp_message_iter iter;
+	uint8_t t, l;
+	const void *v;
+
+	assert(_dhcp_message_iter_init(&iter,
+				(const struct dhcp_message *) client_packet,
+				client_packet_len));
+
+	while (_dhcp_message_iter_next(&iter, &t, &l, &v))
+		if (t == DHCP_OPTION_MESSAGE_TYPE && l == 1)
+			return l_get_u8(v);
+
+	return 0;
+}
+
+static void test_init_reboot(const void *data)
+{
+	static const uint8_t addr1[6] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 };
+	static const uint8_t addr2[6] = { 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c };
+	struct l_dhcp_server *server = server_init();
+	struct dhcp_transport *srv_transport =
+					_dhcp_server_get_transport(server);
+	struct dhcp_transport *cli_transport;
+	struct l_settings *settings = l_settings_new();
+	struct l_dhcp_client *client;
+	struct l_dhcp_lease *lease;
+	const struct dhcp_message *msg =
+				(const struct dhcp_message *) client_packet;
+	struct dhcp_message_iter iter;
+	char *cli_addr;
+
+	assert(l_dhcp_server_set_ip_range(server, "192.168.1.2",
+						"192.168.1.100"));
+	l_dhcp_server_set_enable_rapid_commit(server, false);
+
+	client = client_init(addr1);
+	client_connect(client, server, false);
+	l_free(new_client);
+	new_client = NULL;
+
+	assert(l_dhcp_lease_save(l_dhcp_client_get_lease(client), settings,
+								"Lease"));
+
+	l_dhcp_client_destroy(client);
+	assert(client_send_called);
+	client_send_called = false;
+	srv_transport->rx_cb(client_packet, client_packet_len, server, addr1,
+				0);
+	l_free(expired_client);
+	expired_client = NULL;
+
+	lease = l_dhcp_lease_load(settings, "Lease");
+	assert(lease);
+	assert(l_dhcp_lease_get_address_u32(lease) == htonl(0xc0a80102));
+	assert(l_dhcp_lease_get_gateway_u32(lease) == htonl(0xc0a80101));
+	assert(l_dhcp_lease_get_dns_u32(lease)[1] == htonl(0xc0a801fe));
+	assert(!l_dhcp_lease_load(settings, "Other"));
+
+	/* A single REQUEST for the remembered address gets it back */
+	client = client_init(addr1);
+	cli_transport = _dhcp_client_get_transport(client);
+	assert(l_dhcp_client_set_lease(client, lease));
+	assert(l_dhcp_client_start(client));
+	assert(client_send_called);
+	client_send_called = false;
+
+	assert(client_message_type() == DHCP_MESSAGE_TYPE_REQUEST);
+	assert(!msg->ciaddr);
+	assert(_dhcp_message_iter_init(&iter, msg, client_packet_len));
+	assert(dhcp_message_has_option(&iter,
+				L_DHCP_OPTION_SERVER_IDENTIFIER, 0, NULL) ==
+				-ENOENT);
+
+	srv_transport->rx_cb(client_packet, client_packet_len, server, addr1,
+				0);
+	assert(l2_send_called);
+	l2_send_called = false;
+
+	event_handler_called = false;
+	cli_transport->rx_cb(server_packet, server_packet_len, client, NULL, 0);
+	assert(!client_send_called);
+	assert(event_handler_called);
+
+	cli_addr = l_dhcp_lease_get_address(l_dhcp_client_get_lease(client));
+	assert(!strcmp(cli_addr, "192.168.1.2"));
+	l_free(cli_addr);
+	l_free(new_client);
+	new_client = NULL;
+
+	l_dhcp_client_destroy(client);
+	assert(client_send_called);
+	client_send_called = false;
+
+	/* Another client is refused the address and falls back to DISCOVER */
+	client = client_init(addr2);
+	cli_transport = _dhcp_client_get_transport(client);
+	assert(l_dhcp_client_set_lease(client, lease));
+	assert(l_dhcp_client_start(client));
+	assert(client_send_called);
+	client_send_called = false;
+	assert(client_message_type() == DHCP_MESSAGE_TYPE_REQUEST);
+
+	srv_transport->rx_cb(client_packet, client_packet_len, server, addr2,
+				0);
+	assert(l2_send_called);
+	l2_send_called = false;
+
+	cli_transport->rx_cb(server_packet, server_packet_len, client, NULL, 0);
+	assert(client_send_called);
+	client_send_called = false;
+	assert(client_message_type() == DHCP_MESSAGE_TYPE_DISCOVER);
+
+	l_dhcp_client_destroy(client);
+	assert(!client_send_called);
+
+	l_dhcp_lease_free(lease);
+	l_settings_free(settings);
+	l_dhcp_server_destroy(server);
+}
+
+/* Feed a raw client message to the server and return the reply type */
+static uint8_t server_rx(struct l_dhcp_server *server, const uint8_t *mac,
+				uint8_t type, uint32_t requested_ip)
+{
+	struct dhcp_transport *srv_transport =
+					_dhcp_server_get_transport(server);
+	uint8_t buf[sizeof(struct dhcp_message) + DHCP_MIN_OPTIONS_SIZE] = {};
+	struct dhcp_message *msg = (struct dhcp_message *) buf;
+	struct dhcp_message_builder builder;
+	struct dhcp_message_iter iter;
+	uint32_t server_id = htonl(0xc0a80101);
+	size_t len = sizeof(buf);
+	uint8_t reply_type = 0;
+	uint8_t t, l;
+	const void *v;
+
+	_dhcp_message_builder_init(&builder, msg, len, type);
+	memcpy(msg->chaddr, mac, ETH_ALEN);
+
+	if (requested_ip) {
+		_dhcp_message_builder_append(&builder,
+					L_DHCP_OPTION_REQUESTED_IP_ADDRESS,
+					4, &requested_ip);
+		_dhcp_message_builder_append(&builder,
+					L_DHCP_OPTION_SERVER_IDENTIFIER,
+					4, &server_id);
+	}
+
+	_dhcp_message_builder_finalize(&builder, &len);
+
+	srv_transport->rx_cb(msg, len, server, mac, 0);
+	if (!l2_send_called)
+		return 0;
+
+	l2_send_called = false;
+	assert(_dhcp_message_iter_init(&iter,
+				(struct dhcp_message *) server_packet,
+				server_packet_len));
+
+	while (_dhcp_message_iter_next(&iter, &t, &l, &v))
+		if (t == DHCP_OPTION_MESSAGE_TYPE && l == 1)
+			reply_type = l_get_u8(v);
+
+	return reply_type;
+}
+
+static void test_rate_limit(const void *data)
+{
+	uint8_t addr[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	struct l_dhcp_server *server = server_init();
+	const struct dhcp_message *reply =
+				(struct dhcp_message *) server_packet;
+	uint32_t offered;
+	unsigned int replies = 0;
+	int i;
+
+	/* A single client only gets its burst answered */
+	assert(_dhcp_server_set_rate_limit(server, 1, 4, 0, 0));
+
+	for (i = 0; i < 10; i++)
+		if (server_rx(server, addr, DHCP_MESSAGE_TYPE_DISCOVER, 0))
+			replies++;
+
+	assert(replies >= 4 && replies < 10);
+
+	/* New clients are limited globally, known clients are not */
+	assert(_dhcp_server_set_rate_limit(server, 0, 0, 1, 4));
+	replies = 0;
+
+	for (i = 1; i <= 10; i++) {
+		addr[5] = i;
+
+		if (server_rx(server, addr, DHCP_MESSAGE_TYPE_DISCOVER, 0) ==
+				DHCP_MESSAGE_TYPE_OFFER)
+			replies++;
+	}
+
+	assert(replies >= 4 && replies < 10);
+
+	for (i = 10; i > 0; i--) {
+		addr[5] = i;
+
+		if (server_rx(server, addr, DHCP_MESSAGE_TYPE_DISCOVER, 0))
+			break;
+	}
+
+	offered = reply->yiaddr;
+
+	assert(server_rx(server, addr, DHCP_MESSAGE_TYPE_REQUEST, offered) ==
+			DHCP_MESSAGE_TYPE_ACK);
+	l_free(new_client);
+	new_client = NULL;
+
+	l_dhcp_server_destroy(server);
+}
+
+static void test_max_offers(const void *data)
+{
+	uint8_t addr[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	struct l_dhcp_server *server = server_init();
+	const struct dhcp_message *reply =
+				(struct dhcp_message *) server_packet;
+	uint32_t offered[3];
+	int i;
+
+	assert(_dhcp_server_set_max_offers(server, 2));
+
+	for (i = 0; i < 3; i++) {
+		addr[5] = i;
+		assert(server_rx(server, addr, DHCP_MESSAGE_TYPE_DISCOVER, 0) ==
+				DHCP_MESSAGE_TYPE_OFFER);
+		offered[i] = reply->yiaddr;
+	}
+
+	/* The first offer was dropped to make room for the third */
+	addr[5] = 0;
+	assert(server_rx(server, addr, DHCP_MESSAGE_TYPE_REQUEST,
+				offered[0]) == DHCP_MESSAGE_TYPE_NAK);
+
+	addr[5] = 2;
+	assert(server_rx(server, addr, DHCP_MESSAGE_TYPE_REQUEST,
+				offered[2]) == DHCP_MESSAGE_TYPE_ACK);
+	l_free(new_client);
+	new_client = NULL;
+
+	l_dhcp_server_destroy(server);
+}
+
+static uint8_t relay_packet[1024];
+static size_t relay_packet_len;
+static struct sockaddr_in relay_dest;
+
+static int fake_transport_relay_send(struct dhcp_transport *transport,
+					const struct sockaddr_in *dest,
+					const void *data, size_t len)
+{
+	assert(len <= sizeof(relay_packet));
+	assert(!relay_packet_len);
+	memcpy(relay_packet, data, len);
+	relay_packet_len = len;
+	relay_dest = *dest;
+
+	return 0;
+}
+
+static const uint8_t agent_info[] = { 0x01, 0x04, 'e', 't', 'h', '1' };
+
+/* Relay a client message and return the relayed reply's type */
+static uint8_t relay_rx(struct dhcp_transport *transport, const uint8_t *mac,
+				uint8_t type, const char *giaddr,
+				uint32_t requested_ip)
+{
+	uint8_t buf[sizeof(struct dhcp_message) + DHCP_MIN_OPTIONS_SIZE] = {};
+	struct dhcp_message *msg = (struct dhcp_message *) buf;
+	struct dhcp_message_builder builder;
+	struct dhcp_message_iter iter;
+	uint32_t server_id = htonl(0xc0a80101);
+	size_t len = sizeof(buf);
+	uint8_t reply_type = 0;
+	bool echoed = false;
+	uint8_t t, l;
+	const void *v;
+
+	_dhcp_message_builder_init(&builder, msg, len, type);
+	memcpy(msg->chaddr, mac, ETH_ALEN);
+	assert(inet_pton(AF_INET, giaddr, &msg->giaddr) == 1);
+
+	if (requested_ip) {
+		_dhcp_message_builder_append(&builder,
+					L_DHCP_OPTION_REQUESTED_IP_ADDRESS,
+					4, &requested_ip);
+		_dhcp_message_builder_append(&builder,
+					L_DHCP_OPTION_SERVER_IDENTIFIER,
+					4, &server_id);
+	}
+
+	_dhcp_message_builder_append(&builder,
+					DHCP_OPTION_RELAY_AGENT_INFORMATION,
+					sizeof(agent_info), agent_info);
+	_dhcp_message_builder_finalize(&builder, &len);
+
+	transport->rx_cb(msg, len, transport->rx_data, NULL, 0);
+	if (!relay_packet_len)
+		return 0;
+
+	assert(relay_dest.sin_addr.s_addr == msg->giaddr);
+	assert(relay_dest.sin_port == htons(DHCP_PORT_SERVER));
+	assert(!l2_send_called);
+
+	relay_packet_len = 0;
+	assert(_dhcp_message_iter_init(&iter,
+				(struct dhcp_message *) relay_packet,
+				sizeof(relay_packet)));
+
+	while (_dhcp_message_iter_next(&iter, &t, &l, &v)) {
+		if (t == DHCP_OPTION_MESSAGE_TYPE && l == 1)
+			reply_type = l_get_u8(v);
+
+		if (t == DHCP_OPTION_RELAY_AGENT_INFORMATION)
+			echoed = l == sizeof(agent_info) &&
+					!memcmp(v, agent_info, l);
+	}
+
+	assert(echoed);
+	return reply_type;
+}
+
+static void test_relay_subnets(const void *data)
+{
+	uint8_t addr[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+	struct l_dhcp_server *server = l_dhcp_server_new(41);
+	struct dhcp_transport *srv_transport = l_new(struct dhcp_transport, 1);
+	struct dhcp_transport *relay_transport =
+					l_new(struct dhcp_transport, 1);
+	const struct dhcp_message *reply =
+				(struct dhcp_message *) relay_packet;
+	struct l_dhcp_lease *lease;
+	uint32_t offered;
+	char *str;
+
+	assert(l_dhcp_server_set_interface_name(server, "fake"));
+	assert(l_dhcp_server_set_ip_address(server, "192.168.1.1"));
+	assert(l_dhcp_server_set_event_handler(server, server_event,
+						NULL, NULL));
+
+	if (verbose)
+		l_dhcp_server_set_debug(server, do_debug, "[DHCP SERV] ", NULL);
+
+	assert(l_dhcp_server_add_relay_subnet(server, "10.1.0.0/16",
+						NULL, NULL, NULL));
+	assert(l_dhcp_server_add_relay_subnet(server, "10.1.2.0/24",
+						"10.1.2.100", "10.1.2.110",
+						"10.1.2.1"));
+	assert(!l_dhcp_server_add_relay_subnet(server, "10.1.2.5/24",
+						NULL, NULL, NULL));
+	assert(!l_dhcp_server_add_relay_subnet(server, "10.1.3.0/31",
+						NULL, NULL, NULL));
+	assert(!l_dhcp_server_add_relay_subnet(server, "10.1.3.0",
+						NULL, NULL, NULL));
+	assert(!l_dhcp_server_add_relay_subnet(server, "10.1.3.0/24",
+						"10.1.4.1", "10.1.4.2", NULL));
+
+	srv_transport->ifindex = 41;
+	srv_transport->l2_send = fake_transport_server_l2_send;
+	relay_transport->send = fake_transport_relay_send;
+	assert(_dhcp_server_set_transport(server, srv_transport));
+	assert(_dhcp_server_set_relay_transport(server, relay_transport));
+	assert(l_dhcp_server_start(server));
+
+	/* The longest prefix matching giaddr wins */
+	assert(relay_rx(relay_transport, addr, DHCP_MESSAGE_TYPE_DISCOVER,
+				"10.1.2.1", 0) == DHCP_MESSAGE_TYPE_OFFER);
+	assert(reply->yiaddr == htonl(0x0a010264));
+	offered = reply->yiaddr;
+
+	assert(relay_rx(relay_transport, addr, DHCP_MESSAGE_TYPE_REQUEST,
+				"10.1.2.1", offered) == DHCP_MESSAGE_TYPE_ACK);
+	assert(!strcmp(new_client, "10.1.2.100"));
+	l_free(new_client);
+	new_client = NULL;
+
+	lease = l_dhcp_server_discover(server, 0, NULL, addr);
+	assert(lease);
+	str = l_dhcp_lease_get_address(lease);
+	assert(!strcmp(str, "192.168.1.2"));
+	l_free(str);
+	str = l_dhcp_lease_get_netmask(lease);
+	assert(!strcmp(str, "255.255.255.0"));
+	l_free(str);
+
+	addr[5] = 2;
+	assert(relay_rx(relay_transport, addr, DHCP_MESSAGE_TYPE_DISCOVER,
+				"10.1.9.1", 0) == DHCP_MESSAGE_TYPE_OFFER);
+	assert(reply->yiaddr == htonl(0x0a010001));
+
+	/* Unknown relays are ignored */
+	addr[5] = 3;
+	assert(!relay_rx(relay_transport, addr, DHCP_MESSAGE_TYPE_DISCOVER,
+				"10.2.0.1", 0));
+
+	/* The client moved, its old address is refused */
+	addr[5] = 1;
+	assert(relay_rx(relay_transport, addr, DHCP_MESSAGE_TYPE_REQUEST,
+				"10.1.9.1", offered) == DHCP_MESSAGE_TYPE_NAK);
+
+	/* Local clients are still served from the local subnet */
+	addr[5] = 4;
+	assert(server_rx(server, addr, DHCP_MESSAGE_TYPE_DISCOVER, 0) ==
+			DHCP_MESSAGE_TYPE_OFFER);
+	assert(((struct dhcp_message *) server_packet)->yiaddr ==
+			htonl(0xc0a80103));
+
+	l_dhcp_server_destroy(server);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -1069,6 +1555,11 @@ int main(int argc, char *argv[])
 	l_test_add("complete run", test_complete_run, L_UINT_TO_PTR(false));
 	l_test_add("rapid commit", test_complete_run, L_UINT_TO_PTR(true));
 	l_test_add("expired IP reuse", test_expired_ip_reuse, NULL);
+	l_test_add("lease file", test_lease_file, NULL);
+	l_test_add("init reboot", test_init_reboot, NULL);
+	l_test_add("rate limit", test_rate_limit, NULL);
+	l_test_add("max offers", test_max_offers, NULL);
+	l_test_add("relay subnets", test_relay_subnets, NULL);
 
 	return l_test_run();
 }
@@ -156,6 +156,8 @@ static void test_lease_parsing(const void *data)
 	struct l_dhcp6_lease *lease;
 	char *address;
 	char **dns;
+	const uint8_t *dns_raw;
+	unsigned int n_dns;
 
 	assert(_dhcp6_option_iter_init(&iter, message, len));
 
@@ -174,6 +176,11 @@ static void test_lease_parsing(const void *data)
 	assert(!strcmp(dns[0], "2605:6000:1025:60eb::1"));
 	l_strfreev(dns);
 
+	dns_raw = l_dhcp6_lease_peek_dns(lease, &n_dns);
+	assert(dns_raw);
+	assert(n_dns == 1);
+	assert(dns_raw[0] == 0x26 && dns_raw[1] == 0x05 && dns_raw[15] == 0x01);
+
 	_dhcp6_lease_free(lease);
 }
 
@@ -303,17 +310,128 @@ static void test_obtain_lease_rc(const void *data)
 	assert(!strcmp(domains[0], "example.com"));
 	l_strfreev(domains);
 
+	assert(!strcmp(l_dhcp6_lease_peek_domains(lease)[0], "example.com"));
+
 	l_dhcp6_client_destroy(client);
 }
 
+static const uint8_t reply_pd[] = {
+	0x07, 0x01, 0x02, 0x03,
+	/* Server ID */
+	0x00, 0x02, 0x00, 0x0a, 0x00, 0x03, 0x00, 0x01,
+	0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+	/* IA_PD with an IA Prefix for 2001:db8:1200::/56 */
+	0x00, 0x19, 0x00, 0x29, 0x03, 0x04, 0x05, 0x06,
+	0x00, 0x00, 0x0e, 0x10, 0x00, 0x00, 0x15, 0x18,
+	0x00, 0x1a, 0x00, 0x19, 0x00, 0x00, 0x1c, 0x20,
+	0x00, 0x00, 0x38, 0x40, 0x38, 0x20, 0x01, 0x0d,
+	0xb8, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static void test_lease_parsing_pd(const void *data)
+{
+	struct dhcp6_option_iter iter;
+	struct l_dhcp6_lease *lease;
+	char *prefix;
+
+	assert(_dhcp6_option_iter_init(&iter,
+				(const struct dhcp6_message *) reply_pd,
+				sizeof(reply_pd)));
+
+	lease = _dhcp6_lease_parse_options(&iter, expected_iaid);
+	assert(lease);
+
+	assert(!l_dhcp6_lease_get_address(lease));
+
+	prefix = l_dhcp6_lease_get_delegated_prefix(lease);
+	assert(prefix);
+	assert(!strcmp(prefix, "2001:db8:1200::"));
+	l_free(prefix);
+
+	assert(l_dhcp6_lease_get_delegated_prefix_length(lease) == 56);
+	assert(l_dhcp6_lease_get_valid_lifetime(lease) == 14400);
+
+	_dhcp6_lease_free(lease);
+}
+
+static void test_prefix_pool(const void *data)
+{
+	struct l_dhcp6_prefix_pool *pool;
+	char *prefixes[256];
+	char *prefix;
+	unsigned int i;
+
+	assert(!l_dhcp6_prefix_pool_new("2001:db8::", 64, 64));
+	assert(!l_dhcp6_prefix_pool_new("2001:db8::", 32, 64));
+	assert(!l_dhcp6_prefix_pool_new("2001:db8::", 64, 129));
+	assert(!l_dhcp6_prefix_pool_new("192.168.1.0", 56, 64));
+
+	/* Host bits of the delegated prefix are ignored */
+	pool = l_dhcp6_prefix_pool_new("2001:db8:1200::1", 56, 64);
+	assert(pool);
+
+	for (i = 0; i < 256; i++) {
+		prefixes[i] = l_dhcp6_prefix_pool_alloc(pool);
+		assert(prefixes[i]);
+	}
+
+	assert(!strcmp(prefixes[0], "2001:db8:1200::"));
+	assert(!strcmp(prefixes[1], "2001:db8:1200:1::"));
+	assert(!strcmp(prefixes[255], "2001:db8:1200:ff::"));
+	assert(!l_dhcp6_prefix_pool_alloc(pool));
+
+	assert(!l_dhcp6_prefix_pool_release(pool, "2001:db8:1300::"));
+	assert(!l_dhcp6_prefix_pool_release(pool, "2001:db8:1200:10::1"));
+
+	/* The lowest free sub-prefix is handed out first */
+	assert(l_dhcp6_prefix_pool_release(pool, prefixes[200]));
+	assert(l_dhcp6_prefix_pool_release(pool, prefixes[16]));
+	assert(!l_dhcp6_prefix_pool_release(pool, prefixes[16]));
+
+	prefix = l_dhcp6_prefix_pool_alloc(pool);
+	assert(!strcmp(prefix, "2001:db8:1200:10::"));
+	l_free(prefix);
+
+	prefix = l_dhcp6_prefix_pool_alloc(pool);
+	assert(!strcmp(prefix, "2001:db8:1200:c8::"));
+	l_free(prefix);
+
+	for (i = 0; i < 256; i++)
+		l_free(prefixes[i]);
+
+	l_dhcp6_prefix_pool_free(pool);
+
+	/* Sub-prefixes that straddle the two 64 bit halves */
+	pool = l_dhcp6_prefix_pool_new("2001:db8::", 60, 68);
+	assert(pool);
+
+	for (i = 0; i < 18; i++) {
+		prefix = l_dhcp6_prefix_pool_alloc(pool);
+		assert(prefix);
+
+		if (i < 17)
+			l_free(prefix);
+	}
+
+	assert(!strcmp(prefix, "2001:db8:0:1:1000::"));
+	assert(l_dhcp6_prefix_pool_release(pool, prefix));
+	l_free(prefix);
+
+	l_dhcp6_prefix_pool_free(pool);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
 
 	l_test_add("option parsing", test_option_parsing, NULL);
 	l_test_add("lease parsing", test_lease_parsing, NULL);
+	l_test_add("lease parsing - prefix delegation",
+					test_lease_parsing_pd, NULL);
 	l_test_add("obtain lease - no rapid commit", test_obtain_lease, NULL);
 	l_test_add("obtain lease - rapid commit", test_obtain_lease_rc, NULL);
+	l_test_add("prefix pool", test_prefix_pool, NULL);
 
 	return l_test_run();
 }
@@ -579,6 +579,116 @@ static const struct test_data test_data_4[] = {
 	{ }
 };
 
+#define DIR_3	"/tmp/ell-test-dir-3"
+
+static struct l_hashmap *recursive_events;
+static unsigned int n_recursive_events;
+
+static void recursive_callback(const char *pathname,
+					enum l_dir_watch_event event,
+					void *user_data)
+{
+	l_debug("recursive event:%d pathname:%s", event, pathname);
+
+	/* Each file is reported once per interval */
+	assert(!l_hashmap_lookup(recursive_events, pathname));
+	l_hashmap_insert(recursive_events, pathname, L_UINT_TO_PTR(event + 1));
+	n_recursive_events++;
+}
+
+static void recursive_timeout(struct l_timeout *timeout, void *user_data)
+{
+	bool *done = user_data;
+
+	*done = true;
+}
+
+static void wait_recursive_events(void)
+{
+	bool done = false;
+	struct l_timeout *timeout;
+
+	l_hashmap_destroy(recursive_events, NULL);
+	recursive_events = l_hashmap_string_new();
+	n_recursive_events = 0;
+
+	timeout = l_timeout_create_ms(300, recursive_timeout, &done, NULL);
+
+	while (!done)
+		l_main_iterate(-1);
+
+	l_timeout_remove(timeout);
+}
+
+static enum l_dir_watch_event recursive_event(const char *pathname)
+{
+	void *event = l_hashmap_lookup(recursive_events, pathname);
+
+	assert(event);
+	return L_PTR_TO_UINT(event) - 1;
+}
+
+static void test_recursive_coalesce(const char *backend)
+{
+	struct l_dir_watch *watch;
+	char *pathname;
+	unsigned int i;
+
+	l_info("[Recursive watch with %s]", backend);
+
+	mkdir(DIR_3, 0700);
+	watch = l_dir_watch_new_recursive(DIR_3, recursive_callback, NULL,
+									NULL);
+	assert(watch);
+	assert(l_dir_watch_set_coalesce_interval(watch, 50));
+
+	/* The file is there before its directory can be watched */
+	mkdir(DIR_3 "/sub", 0700);
+	op_creat(DIR_3 "/sub", FILE_1, "ABC");
+
+	for (i = 0; i < 100; i++) {
+		pathname = l_strdup_printf("file-%u", i);
+		op_creat(DIR_3, pathname, "ABC");
+		op_creat(DIR_3, pathname, "XYZ");
+		op_open(DIR_3, pathname, 3);
+		l_free(pathname);
+	}
+
+	op_creat(DIR_3, "transient", NULL);
+	op_unlink(DIR_3, "transient");
+
+	wait_recursive_events();
+	assert(n_recursive_events == 102);
+	assert(recursive_event("sub") == L_DIR_WATCH_EVENT_CREATED);
+	assert(recursive_event("sub/" FILE_1) == L_DIR_WATCH_EVENT_CREATED);
+	assert(recursive_event("file-42") == L_DIR_WATCH_EVENT_CREATED);
+
+	/* The new directory is watched as well */
+	op_creat(DIR_3 "/sub", FILE_1, "XYZ");
+	wait_recursive_events();
+	assert(n_recursive_events == 1);
+	assert(recursive_event("sub/" FILE_1) == L_DIR_WATCH_EVENT_MODIFIED);
+
+	op_unlink(DIR_3 "/sub", FILE_1);
+	rmdir(DIR_3 "/sub");
+
+	for (i = 0; i < 100; i++) {
+		pathname = l_strdup_printf("file-%u", i);
+		op_unlink(DIR_3, pathname);
+		l_free(pathname);
+	}
+
+	wait_recursive_events();
+	assert(n_recursive_events == 102);
+	assert(recursive_event("sub/" FILE_1) == L_DIR_WATCH_EVENT_REMOVED);
+	assert(recursive_event("sub") == L_DIR_WATCH_EVENT_REMOVED);
+
+	l_dir_watch_destroy(watch);
+	l_hashmap_destroy(recursive_events, NULL);
+	recursive_events = NULL;
+	rmdir(DIR_3);
+}
+
 int main(int argc, char *argv[])
 {
 	int opt, exit_status;
@@ -603,6 +713,14 @@ int main(int argc, char *argv[])
 	l_idle_oneshot(process_test_queue, NULL, NULL);
 	exit_status = l_main_run();
 
+	test_recursive_coalesce("inotify");
+
+	/* Needs privileges, skip if not available */
+	if (l_dir_watch_set_backend(L_DIR_WATCH_BACKEND_FANOTIFY)) {
+		test_recursive_coalesce("fanotify");
+		assert(l_dir_watch_set_backend(L_DIR_WATCH_BACKEND_INOTIFY));
+	}
+
 	l_queue_destroy(test_queue, free_test_entry);
 	l_main_exit();
 
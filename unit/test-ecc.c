@@ -25,6 +25,9 @@
 #define CURVE_P_32_STR "ffffffffffffffffffffffff00000000"\
 			"000000000000000001000000ffffffff"
 
+#define CURVE_P256_STR "ffffffff000000010000000000000000"\
+			"00000000ffffffffffffffffffffffff"
+
 enum ecc_test_type {
 	TEST_ADD = 0,
 	TEST_SUB,
@@ -111,9 +114,9 @@ struct ecc_test_data exp_test = {
 	.type = TEST_EXP,
 	.a = "cae1d5624344984073fd955a72d4ebacedc084679333e4beebff94869e9f6ca8",
 	.b = "93a02ae89d15e38a33bf3fea4c99937825b279fa8fa81dded1ccb687cec88461",
-	.mod = CURVE_P_32_STR,
-	.result = "e7488e3a4d56938bbddc2a615c768d48"
-			"9e5634aced9ceee37249fae1caa36fec"
+	.mod = CURVE_P256_STR,
+	.result = "415b2e00b2dfd0bf4889a64398c0fe6f"
+			"b4960df8e18c95799e08bfffb5814d5a"
 
 };
 
@@ -340,6 +343,125 @@ static void run_test_reduce(const void *arg)
 	l_ecc_scalar_free(reduced);
 }
 
+/*
+ * Operands close to the P-384 prime where a column of the product
+ * overflows 128 bits with the high word of the accumulator wrapping
+ */
+static void run_test_mult_carry(const void *arg)
+{
+	const struct l_ecc_curve *curve = l_ecc_curve_from_ike_group(20);
+	uint64_t a[L_ECC_MAX_DIGITS], b[L_ECC_MAX_DIGITS];
+	uint64_t result[L_ECC_MAX_DIGITS], check[L_ECC_MAX_DIGITS];
+
+	HEX2BUF("ffffffffffffffffffffffffffffffffffffffffffffffff"
+		"ffffffffffffff7effffffff0000000000000000ffffffff", a);
+	_ecc_be2native(a, a, curve->ndigits);
+	HEX2BUF("ffffffffffffffffffffffffffffffffffffffffffffffff"
+		"fffffffefffffffeffffffff0000000000000000ffffffff", b);
+	_ecc_be2native(b, b, curve->ndigits);
+	HEX2BUF("000000000000000000000080000000000000000000000000"
+		"000000000000000000000000000000000000000000000000", check);
+	_ecc_be2native(check, check, curve->ndigits);
+
+	_vli_mod_mult_fast(result, a, b, curve->p, curve->ndigits);
+	assert(!memcmp(result, check, curve->ndigits * 8));
+
+	_vli_mod_square_fast(result, a, curve->p, curve->ndigits);
+	_vli_mod_mult_fast(check, a, a, curve->p, curve->ndigits);
+	assert(!memcmp(result, check, curve->ndigits * 8));
+}
+
+static void run_test_mult_g(const void *arg)
+{
+	static const unsigned int groups[] = { 19, 20 };
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0; i < L_ARRAY_SIZE(groups); i++) {
+		const struct l_ecc_curve *curve =
+				l_ecc_curve_from_ike_group(groups[i]);
+		unsigned int ndigits = curve->ndigits;
+		struct l_ecc_point *result = l_ecc_point_new(curve);
+		struct l_ecc_point *check = l_ecc_point_new(curve);
+		uint64_t scalar[L_ECC_MAX_DIGITS] = { 1 };
+		uint64_t neg_y[L_ECC_MAX_DIGITS];
+
+		/* The ladder can't be used as the reference for 1 and n - 1 */
+		_ecc_point_mult_g(result, curve, scalar);
+		assert(!memcmp(result->x, curve->g.x, ndigits * 8));
+		assert(!memcmp(result->y, curve->g.y, ndigits * 8));
+
+		memcpy(scalar, curve->n, ndigits * 8);
+		scalar[0] -= 1;
+		_vli_sub(neg_y, curve->p, curve->g.y, ndigits);
+		_ecc_point_mult_g(result, curve, scalar);
+		assert(!memcmp(result->x, curve->g.x, ndigits * 8));
+		assert(!memcmp(result->y, neg_y, ndigits * 8));
+
+		for (j = 0; j < 8; j++) {
+			if (j) {
+				l_getrandom(scalar, ndigits * 8);
+				scalar[ndigits - 1] >>= 1;
+			} else {
+				/* Zero digits between non-zero ones */
+				memset(scalar, 0, sizeof(scalar));
+				scalar[0] = 0x10;
+				scalar[ndigits - 1] = 0x0f00000000000000ull;
+			}
+
+			_ecc_point_mult_g(result, curve, scalar);
+			_ecc_point_mult(check, &curve->g, scalar, NULL,
+								curve->p);
+
+			assert(!memcmp(result->x, check->x, ndigits * 8));
+			assert(!memcmp(result->y, check->y, ndigits * 8));
+		}
+
+		l_ecc_point_free(result);
+		l_ecc_point_free(check);
+	}
+}
+
+static void run_test_inv(const void *arg)
+{
+	static const unsigned int groups[] = { 19, 20 };
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0; i < L_ARRAY_SIZE(groups); i++) {
+		const struct l_ecc_curve *curve =
+				l_ecc_curve_from_ike_group(groups[i]);
+		unsigned int ndigits = curve->ndigits;
+		uint64_t x[L_ECC_MAX_DIGITS] = { };
+		uint64_t inv[L_ECC_MAX_DIGITS];
+		uint64_t check[L_ECC_MAX_DIGITS];
+		uint64_t _1[L_ECC_MAX_DIGITS] = { 1ull };
+
+		/* inv0: zero maps to zero */
+		_vli_mod_inv(inv, x, curve->p, ndigits);
+		assert(l_memeqzero(inv, ndigits * 8));
+
+		/* p - 1 is its own inverse */
+		_vli_sub(x, curve->p, _1, ndigits);
+		_vli_mod_inv(inv, x, curve->p, ndigits);
+		assert(!memcmp(inv, x, ndigits * 8));
+
+		for (j = 0; j < 32; j++) {
+			l_getrandom(x, ndigits * 8);
+			x[ndigits - 1] >>= 1;
+
+			_vli_mod_inv(inv, x, curve->p, ndigits);
+			_vli_mod_mult_fast(check, x, inv, curve->p, ndigits);
+			assert(!memcmp(check, _1, ndigits * 8));
+
+			/* Any odd modulus works, e.g. the curve order */
+			_vli_mod_inv(inv, x, curve->n, ndigits);
+			_vli_mod_inv(check, inv, curve->n, ndigits);
+			assert(!memcmp(check, x, ndigits * 8));
+		}
+	}
+}
+
 static void run_test_zero_or_one(const void *arg)
 {
 	uint64_t zero[L_ECC_MAX_DIGITS] = { };
@@ -411,6 +533,100 @@ static void run_test_compressed_points(const void *arg)
 	}
 }
 
+struct sswu_data {
+	unsigned int group;
+	char *u;
+	char *x;
+	char *y;
+};
+
+static struct sswu_data sswu_tests[] = {
+	{
+		/* gx1 is not a square, x = x2 */
+		.group = 19,
+		.u = "985f316c56518a03112f09f85f92e1189dd0d5276f204862e3905ac2c2ab3ecf",
+		.x = "3ff803efa087033410313357507eda1dbb1f844a7a1338473cfce6dca2acff48",
+		.y = "6ce2fa6dafc1a4ba03e41e371f0b1c1c2135c987f955b8af1b5322d53cc8ed0b",
+	},
+	{
+		/* gx1 is a square, x = x1 */
+		.group = 19,
+		.u = "95daac84f1a17a53b777fb673f0122c60c979a3d9d677a5bd8d58b39c3bc421c",
+		.x = "2ae280d773c4d8256981722d5ecd7aab654c8131bb739b12c60b7ebe9697e554",
+		.y = "85c0735169001588825d57cfaf3cd13a62f8c9db03558edb12b53c604c8ce6b0",
+	},
+	{
+		/* z^2 * u^4 + z * u^2 = 0 */
+		.group = 19,
+		.u = "95d527d249c8dc5cadbf4c70bb59aaab72c14fffbad5622bd147b86a639ec6d9",
+		.x = "a528bd8696bdaf996c65b982d94959d3146fe6a020693090bdba13132375f224",
+		.y = "f1a048c1e986e31da704a524d2cc9975c4dbf661272bfe0997a1f166b04b28a9",
+	},
+	{
+		.group = 20,
+		.u = "985f316c56518a03112f09f85f92e1189dd0d5276f204862"
+			"e3905ac2c2ab3ecff7a8b4f6b6d46f2952336673572a0cca",
+		.x = "da7b7b980ba7e7a2a7cf76f4f05fde0dccb11b5e1fe25a22"
+			"4d36ed1c103fb185ef46aae47ad3cda698ca351fa0fdc98f",
+		.y = "515b1eb2abd77f5ba7959c04c66d6c638b5f1c0f95af32af"
+			"3f4524f6564a11bf0b539e8c060d2b6bd8b5388582da42f2",
+	},
+	{
+		.group = 20,
+		.u = "95daac84f1a17a53b777fb673f0122c60c979a3d9d677a5b"
+			"d8d58b39c3bc421c6990b55110d67922f05815b369c8df81",
+		.x = "fdeba3a5530dab341a14a8189cd964d1c92ab1733b2411c4"
+			"cc197cf41fed36e4d8d57825c10c30237925cfcbf25b8064",
+		.y = "69d175090f0786746a0ad26166ede5cb953e2c8e7ef1f3c4"
+			"523379a5ce2e8df4feeed06171bb12a70996fc100dec2561",
+	},
+	{
+		.group = 20,
+		.u = "43910f0ddc8eadb7b4295c0135a783fd1ff7684afc8b9c4b"
+			"42a09950f7bba0102fabd2d478abf52cc1bd93b3bf232de4",
+		.x = "533324e11b9e311baee780268d718f799600d2914e2e41ce"
+			"b8f97203fb1cfca5c58265272e814cef084ad3ce05e30131",
+		.y = "0bf600b6070ed397168c364b85c7a53e32644c636590b388"
+			"ec8a685253a9e72d4f41d9290e65f865553840f71c95ab9c",
+	},
+};
+
+static void run_test_sswu(const void *arg)
+{
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(sswu_tests); i++) {
+		struct sswu_data *data = &sswu_tests[i];
+		const struct l_ecc_curve *curve =
+				l_ecc_curve_from_ike_group(data->group);
+		size_t bytes = l_ecc_curve_get_scalar_bytes(curve);
+		uint8_t u[L_ECC_SCALAR_MAX_BYTES];
+		uint8_t x[L_ECC_SCALAR_MAX_BYTES];
+		uint8_t y[L_ECC_SCALAR_MAX_BYTES];
+		uint8_t buf[L_ECC_SCALAR_MAX_BYTES];
+		struct l_ecc_scalar *scalar;
+		struct l_ecc_point *p;
+
+		HEX2BUF(data->u, u);
+		HEX2BUF(data->x, x);
+		HEX2BUF(data->y, y);
+
+		scalar = l_ecc_scalar_new_modp(curve, u, bytes);
+		assert(scalar);
+
+		p = l_ecc_point_from_sswu(scalar);
+		assert(p);
+
+		assert(l_ecc_point_get_x(p, buf, bytes) == (ssize_t) bytes);
+		assert(!memcmp(buf, x, bytes));
+		assert(l_ecc_point_get_y(p, buf, bytes) == (ssize_t) bytes);
+		assert(!memcmp(buf, y, bytes));
+
+		l_ecc_point_free(p);
+		l_ecc_scalar_free(scalar);
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -431,8 +647,12 @@ int main(int argc, char *argv[])
 	l_test_add("ECC legendre", run_test_p256, &legendre_test6);
 
 	l_test_add("ECC reduce test", run_test_reduce, NULL);
+	l_test_add("ECC mult carry test", run_test_mult_carry, NULL);
+	l_test_add("ECC generator mult test", run_test_mult_g, NULL);
+	l_test_add("ECC constant time inv test", run_test_inv, NULL);
 	l_test_add("ECC zero or one test", run_test_zero_or_one, NULL);
 	l_test_add("ECC compressed points", run_test_compressed_points, NULL);
+	l_test_add("ECC SSWU map", run_test_sswu, NULL);
 
 	return l_test_run();
 }
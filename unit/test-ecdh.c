@@ -200,6 +200,131 @@ static void test_vector_p384(const void *data)
 	l_ecc_scalar_free(b_shared);
 }
 
+/* RFC 7748 Section 6.1 */
+static void test_vector_x25519(const void *data)
+{
+	const struct l_ecc_curve *curve = l_ecc_curve_from_tls_group(29);
+	static const uint8_t a_sec_buf[32] = {
+		0x77, 0x07, 0x6d, 0x0a, 0x73, 0x18, 0xa5, 0x7d,
+		0x3c, 0x16, 0xc1, 0x72, 0x51, 0xb2, 0x66, 0x45,
+		0xdf, 0x4c, 0x2f, 0x87, 0xeb, 0xc0, 0x99, 0x2a,
+		0xb1, 0x77, 0xfb, 0xa5, 0x1d, 0xb9, 0x2c, 0x2a,
+	};
+	static const uint8_t a_pub_buf[32] = {
+		0x85, 0x20, 0xf0, 0x09, 0x89, 0x30, 0xa7, 0x54,
+		0x74, 0x8b, 0x7d, 0xdc, 0xb4, 0x3e, 0xf7, 0x5a,
+		0x0d, 0xbf, 0x3a, 0x0d, 0x26, 0x38, 0x1a, 0xf4,
+		0xeb, 0xa4, 0xa9, 0x8e, 0xaa, 0x9b, 0x4e, 0x6a,
+	};
+	static const uint8_t b_sec_buf[32] = {
+		0x5d, 0xab, 0x08, 0x7e, 0x62, 0x4a, 0x8a, 0x4b,
+		0x79, 0xe1, 0x7f, 0x8b, 0x83, 0x80, 0x0e, 0xe6,
+		0x6f, 0x3b, 0xb1, 0x29, 0x26, 0x18, 0xb6, 0xfd,
+		0x1c, 0x2f, 0x8b, 0x27, 0xff, 0x88, 0xe0, 0xeb,
+	};
+	static const uint8_t b_pub_buf[32] = {
+		0xde, 0x9e, 0xdb, 0x7d, 0x7b, 0x7d, 0xc1, 0xb4,
+		0xd3, 0x5b, 0x61, 0xc2, 0xec, 0xe4, 0x35, 0x37,
+		0x3f, 0x83, 0x43, 0xc8, 0x5b, 0x78, 0x67, 0x4d,
+		0xad, 0xfc, 0x7e, 0x14, 0x6f, 0x88, 0x2b, 0x4f,
+	};
+	static const uint8_t ss_buf[32] = {
+		0x4a, 0x5d, 0x9d, 0x5b, 0xa4, 0xce, 0x2d, 0xe1,
+		0x72, 0x8e, 0x3b, 0xf4, 0x80, 0x35, 0x0f, 0x25,
+		0xe0, 0x7e, 0x21, 0xc9, 0x47, 0xd1, 0x9e, 0x33,
+		0x76, 0xf0, 0x9b, 0x3c, 0x1e, 0x16, 0x17, 0x42,
+	};
+	static const uint8_t zero_buf[32];
+	struct l_ecc_scalar *a_secret;
+	struct l_ecc_scalar *b_secret;
+	struct l_ecc_point *a_public;
+	struct l_ecc_point *b_public;
+	struct l_ecc_point *low_order;
+	struct l_ecc_scalar *shared;
+	uint8_t buf[32];
+
+	assert(curve);
+	assert(!strcmp(l_ecc_curve_get_name(curve), "x25519"));
+
+	a_secret = l_ecc_scalar_new(curve, a_sec_buf, sizeof(a_sec_buf));
+	b_secret = l_ecc_scalar_new(curve, b_sec_buf, sizeof(b_sec_buf));
+	a_public = l_ecc_point_new(curve);
+	assert(a_secret && b_secret);
+
+	assert(l_ecc_point_multiply_g(a_public, a_secret));
+	assert(l_ecc_point_get_data(a_public, buf, sizeof(buf)) == 32);
+	assert(!memcmp(buf, a_pub_buf, 32));
+
+	b_public = l_ecc_point_from_data(curve, L_ECC_POINT_TYPE_COMPLIANT,
+						b_pub_buf, sizeof(b_pub_buf));
+	assert(b_public);
+
+	assert(l_ecdh_generate_shared_secret(a_secret, b_public, &shared));
+	assert(l_ecc_scalar_get_data(shared, buf, sizeof(buf)) == 32);
+	assert(!memcmp(buf, ss_buf, 32));
+	l_ecc_scalar_free(shared);
+
+	assert(l_ecdh_generate_shared_secret(b_secret, a_public, &shared));
+	assert(l_ecc_scalar_get_data(shared, buf, sizeof(buf)) == 32);
+	assert(!memcmp(buf, ss_buf, 32));
+	l_ecc_scalar_free(shared);
+
+	/* The all-zero output must be rejected */
+	low_order = l_ecc_point_from_data(curve, L_ECC_POINT_TYPE_COMPLIANT,
+						zero_buf, sizeof(zero_buf));
+	assert(low_order);
+	assert(!l_ecdh_generate_shared_secret(a_secret, low_order, &shared));
+
+	assert(!l_ecc_point_from_data(curve, L_ECC_POINT_TYPE_FULL,
+						b_pub_buf, sizeof(b_pub_buf)));
+
+	l_ecc_scalar_free(a_secret);
+	l_ecc_scalar_free(b_secret);
+	l_ecc_point_free(a_public);
+	l_ecc_point_free(b_public);
+	l_ecc_point_free(low_order);
+}
+
+/* RFC 7748 Section 5.2, the first 1000 iterations */
+static void test_x25519_iterations(const void *data)
+{
+	const struct l_ecc_curve *curve = l_ecc_curve_from_tls_group(29);
+	static const uint8_t one_iteration[32] = {
+		0x42, 0x2c, 0x8e, 0x7a, 0x62, 0x27, 0xd7, 0xbc,
+		0xa1, 0x35, 0x0b, 0x3e, 0x2b, 0xb7, 0x27, 0x9f,
+		0x78, 0x97, 0xb8, 0x7b, 0xb6, 0x85, 0x4b, 0x78,
+		0x3c, 0x60, 0xe8, 0x03, 0x11, 0xae, 0x30, 0x79,
+	};
+	static const uint8_t thousand_iterations[32] = {
+		0x68, 0x4c, 0xf5, 0x9b, 0xa8, 0x33, 0x09, 0x55,
+		0x28, 0x00, 0xef, 0x56, 0x6f, 0x2f, 0x4d, 0x3c,
+		0x1c, 0x38, 0x87, 0xc4, 0x93, 0x60, 0xe3, 0x87,
+		0x5f, 0x2e, 0xb9, 0x4d, 0x99, 0x53, 0x2c, 0x51,
+	};
+	uint8_t k[32] = { 9 };
+	uint8_t u[32] = { 9 };
+	unsigned int i;
+
+	for (i = 1; i <= 1000; i++) {
+		struct l_ecc_scalar *scalar = l_ecc_scalar_new(curve, k, 32);
+		struct l_ecc_point *point = l_ecc_point_from_data(curve,
+						L_ECC_POINT_TYPE_COMPLIANT,
+						u, 32);
+
+		assert(l_ecc_point_multiply(point, scalar, point));
+		memcpy(u, k, 32);
+		assert(l_ecc_point_get_data(point, k, 32) == 32);
+
+		l_ecc_scalar_free(scalar);
+		l_ecc_point_free(point);
+
+		if (i == 1)
+			assert(!memcmp(k, one_iteration, 32));
+	}
+
+	assert(!memcmp(k, thousand_iterations, 32));
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -209,6 +334,8 @@ int main(int argc, char *argv[])
 
 	l_test_add("ECDH test vector P256", test_vector_p256, NULL);
 	l_test_add("ECDH test vector P384", test_vector_p384, NULL);
+	l_test_add("ECDH test vector X25519", test_vector_x25519, NULL);
+	l_test_add("X25519 iterations", test_x25519_iterations, NULL);
 
 	return l_test_run();
 }
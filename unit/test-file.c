@@ -0,0 +1,176 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+
+#include <ell/ell.h>
+
+static void check_contents(const char *filename, const char *expected)
+{
+	size_t len;
+	char *contents = l_file_get_contents(filename, &len);
+
+	assert(contents);
+	assert(len == strlen(expected));
+	assert(!memcmp(contents, expected, len));
+	l_free(contents);
+}
+
+static void test_set_contents(const void *data)
+{
+	char dir[] = "/tmp/ell-file-XXXXXX";
+	char *path;
+
+	assert(mkdtemp(dir));
+	path = l_strdup_printf("%s/file", dir);
+
+	assert(l_file_set_contents(path, "foo", 3) == 0);
+	check_contents(path, "foo");
+	assert(l_file_set_contents(path, "barbaz", 6) == 0);
+	check_contents(path, "barbaz");
+
+	assert(l_file_set_contents("/nonexistent/file", "foo", 3) == -ENOENT);
+	assert(l_file_set_contents(path, NULL, 0) == -EINVAL);
+
+	unlink(path);
+	rmdir(dir);
+	l_free(path);
+}
+
+struct write_data {
+	int result;
+	unsigned int n_callbacks;
+	unsigned int n_destroys;
+	unsigned int order;
+};
+
+static unsigned int n_completed;
+
+static void write_cb(int result, void *user_data)
+{
+	struct write_data *data = user_data;
+
+	data->result = result;
+	data->n_callbacks++;
+	data->order = ++n_completed;
+}
+
+static void write_destroy(void *user_data)
+{
+	struct write_data *data = user_data;
+
+	data->n_destroys++;
+}
+
+static unsigned int count_dir_entries(const char *path)
+{
+	DIR *dir = opendir(path);
+	struct dirent *entry;
+	unsigned int n = 0;
+
+	assert(dir);
+
+	while ((entry = readdir(dir)))
+		if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+			n++;
+
+	closedir(dir);
+	return n;
+}
+
+static void test_set_contents_async(const void *data)
+{
+	char dir[] = "/tmp/ell-file-XXXXXX";
+	char *path1;
+	char *path2;
+	struct write_data writes[5] = {};
+	struct write_data fail = {};
+	char buf[16];
+	unsigned int i;
+
+	assert(mkdtemp(dir));
+	path1 = l_strdup_printf("%s/file1", dir);
+	path2 = l_strdup_printf("%s/file2", dir);
+
+	/* No main loop to report the result on */
+	assert(!l_file_set_contents_async(path1, "foo", 3, false, write_cb,
+						&fail, write_destroy));
+	assert(!fail.n_destroys);
+
+	assert(l_main_init());
+
+	/* Several updates of the same file, the last one wins */
+	for (i = 0; i < 4; i++) {
+		sprintf(buf, "contents %u", i);
+		assert(l_file_set_contents_async(path1, buf, strlen(buf),
+						i == 2, write_cb, &writes[i],
+						write_destroy));
+	}
+
+	assert(l_file_set_contents_async(path2, "other", 5, false, write_cb,
+						&writes[4], write_destroy));
+	assert(l_file_set_contents_async("/nonexistent/file", "foo", 3, false,
+						write_cb, &fail,
+						write_destroy));
+
+	while (fail.n_destroys < 1 || writes[4].n_destroys < 1)
+		l_main_iterate(-1);
+
+	for (i = 0; i < L_ARRAY_SIZE(writes); i++) {
+		assert(writes[i].n_callbacks == 1);
+		assert(writes[i].n_destroys == 1);
+		assert(writes[i].result == 0);
+	}
+
+	/* Callbacks come in submission order */
+	for (i = 1; i < L_ARRAY_SIZE(writes); i++)
+		assert(writes[i].order > writes[i - 1].order);
+
+	assert(fail.n_callbacks == 1 && fail.result == -ENOENT);
+
+	check_contents(path1, "contents 3");
+	check_contents(path2, "other");
+
+	/* No temporary files left over */
+	assert(count_dir_entries(dir) == 2);
+
+	/* Whether or not the write makes it, its user data is freed on exit */
+	memset(writes, 0, sizeof(writes));
+	assert(l_file_set_contents_async(path1, "foo", 3, false, write_cb,
+						&writes[0], write_destroy));
+	l_main_exit();
+	assert(writes[0].n_destroys == 1);
+
+	unlink(path1);
+	unlink(path2);
+	assert(count_dir_entries(dir) == 0);
+	rmdir(dir);
+	l_free(path1);
+	l_free(path2);
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("l_file_set_contents", test_set_contents, NULL);
+	l_test_add("l_file_set_contents_async", test_set_contents_async,
+									NULL);
+
+	return l_test_run();
+}
@@ -10,8 +10,10 @@
 #endif
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <linux/genetlink.h>
+#include <linux/rtnetlink.h>
 #include <ell/ell.h>
 
 #include "ell/netlink-private.h"
@@ -96,6 +98,52 @@ static void parse_set_station(const void *data)
 	l_genl_msg_unref(msg);
 }
 
+static void parse_set_station_table(const void *data)
+{
+	const struct set_station_test *test = data;
+	struct l_netlink_attr_policy policy[68] = {
+		[3] = { L_NETLINK_ATTR_POLICY_U32 },
+		[6] = { L_NETLINK_ATTR_POLICY_BINARY, 6 },
+		[67] = { L_NETLINK_ATTR_POLICY_UNSPEC, 8 },
+	};
+	struct l_netlink_attr_value table[68];
+	struct l_genl_msg *msg;
+	struct l_genl_attr attr;
+
+	msg = l_genl_msg_new_from_data((struct nlmsghdr *) set_station_request,
+						sizeof(set_station_request));
+	assert(msg);
+	assert(l_genl_attr_init(&attr, msg));
+
+	assert(l_genl_attr_parse(&attr, policy, 67, table));
+
+	assert(table[3].len == 4);
+	assert(l_get_u32(table[3].data) == test->ifindex);
+	assert(table[6].len == sizeof(test->mac));
+	assert(!memcmp(table[6].data, test->mac, sizeof(test->mac)));
+	assert(table[67].len == sizeof(test->flags));
+	assert(!memcmp(table[67].data, test->flags, sizeof(test->flags)));
+	assert(!table[1].data && !table[2].data);
+
+	/* Attributes above the table size are skipped */
+	assert(l_genl_attr_parse(&attr, policy, 6, table));
+	assert(table[3].data && table[6].data);
+
+	/* The iterator itself is left untouched */
+	assert(l_genl_attr_next(&attr, NULL, NULL, NULL));
+
+	/* A length mismatch fails the whole parse */
+	policy[3].type = L_NETLINK_ATTR_POLICY_U16;
+	assert(l_genl_attr_init(&attr, msg));
+	assert(!l_genl_attr_parse(&attr, policy, 67, table));
+
+	policy[3].type = L_NETLINK_ATTR_POLICY_U32;
+	policy[6].len = 4;
+	assert(!l_genl_attr_parse(&attr, policy, 67, table));
+
+	l_genl_msg_unref(msg);
+}
+
 static void build_set_station(const void *data)
 {
 	const struct set_station_test *test = data;
@@ -128,6 +176,68 @@ static void build_set_station(const void *data)
 	l_genl_msg_unref(msg);
 }
 
+static void reuse_set_station(const void *data)
+{
+	const struct set_station_test *test = data;
+	struct l_genl_msg *msg;
+	struct l_netlink_message *m;
+	struct genlmsghdr genlhdr = { .cmd = 18, .version = 0, .reserved = 0 };
+	uint8_t junk[300] = {};
+	const void *raw;
+	size_t size;
+
+	/* A message used for something else first, then rebuilt */
+	msg = l_genl_msg_new(5);
+	assert(l_genl_msg_append_attr(msg, 1, sizeof(junk), junk));
+	assert(l_genl_msg_enter_nested(msg, 2));
+
+	/* Not while somebody else still holds on to it */
+	l_genl_msg_ref(msg);
+	assert(!l_genl_msg_reset(msg, 18));
+	l_genl_msg_unref(msg);
+
+	assert(l_genl_msg_reset(msg, 18));
+	assert(l_genl_msg_get_command(msg) == 18);
+	assert(l_genl_msg_append_attr(msg, 3,
+					sizeof(test->ifindex), &test->ifindex));
+	assert(l_genl_msg_append_attr(msg, 6, sizeof(test->mac), test->mac));
+	assert(l_genl_msg_append_attr(msg, 67,
+					sizeof(test->flags), test->flags));
+
+	raw = l_genl_msg_to_data(msg, 0x17, NLM_F_REQUEST | NLM_F_ACK,
+					test->seq, test->pid, &size);
+	assert(size == sizeof(set_station_request));
+	assert(!memcmp(raw, set_station_request, size));
+
+	l_genl_msg_unref(msg);
+
+	m = l_netlink_message_new(RTM_GETLINK, NLM_F_DUMP);
+	assert(!l_netlink_message_append(m, 1, junk, sizeof(junk)));
+
+	l_netlink_message_ref(m);
+	assert(l_netlink_message_reset(m, 0x17, 0) == -EBUSY);
+	l_netlink_message_unref(m);
+
+	assert(l_netlink_message_reset(m, 0x17, NLM_F_ACK) == -EINVAL);
+	assert(!l_netlink_message_reset(m, 0x17, 0));
+	assert(m->hdr->nlmsg_len == NLMSG_HDRLEN);
+
+	assert(!l_netlink_message_add_header(m, &genlhdr, sizeof(genlhdr)));
+	assert(!l_netlink_message_append_u32(m, 3, test->ifindex));
+	assert(!l_netlink_message_append_mac(m, 6, test->mac));
+	assert(!l_netlink_message_append(m, 67,
+					test->flags, sizeof(test->flags)));
+
+	m->hdr->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+	m->hdr->nlmsg_seq = test->seq;
+	m->hdr->nlmsg_pid = test->pid;
+
+	assert(m->hdr->nlmsg_len == sizeof(set_station_request));
+	assert(!memcmp(m->data, set_station_request, m->hdr->nlmsg_len));
+
+	l_netlink_message_unref(m);
+}
+
 static void build_set_station_netlink(const void *data)
 {
 	const struct set_station_test *test = data;
@@ -509,10 +619,13 @@ int main(int argc, char *argv[])
 		goto done;
 
 	l_test_add("Parse Set Station Request", parse_set_station, &set_station);
+	l_test_add("Parse Set Station Request (Table)", parse_set_station_table,
+								&set_station);
 	l_test_add("Parse Set Rekey Offload Request",
 				parse_set_rekey_offload, &rekey_offload);
 
 	l_test_add("Build Set Station Request", build_set_station, &set_station);
+	l_test_add("Reuse Set Station Request", reuse_set_station, &set_station);
 	l_test_add("Build Set Station Request (Netlink)",
 			build_set_station_netlink, &set_station);
 	l_test_add("Build Set Rekey Offload Request",
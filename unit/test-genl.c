@@ -0,0 +1,236 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/genetlink.h>
+
+#include <ell/ell.h>
+
+static char *get_boot_id(void)
+{
+	char buf[64] = {};
+	FILE *f = fopen("/proc/sys/kernel/random/boot_id", "r");
+
+	assert(f);
+	assert(fgets(buf, sizeof(buf), f));
+	fclose(f);
+
+	return l_strndup(buf, strcspn(buf, "\n"));
+}
+
+static char *write_cache(const char *boot_id)
+{
+	char *path = l_strdup("/tmp/ell-test-genl-XXXXXX");
+	char *data;
+	int fd;
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+
+	data = l_strdup_printf("[Cache]\nBootId=%s\n\n"
+				"[Family ell-test]\nId=4000\nVersion=2\n"
+				"Ops=1:10,2:4\nGroups=config:4001,scan:4002\n",
+				boot_id);
+	assert(write(fd, data, strlen(data)) == (ssize_t) strlen(data));
+	close(fd);
+	l_free(data);
+
+	return path;
+}
+
+static void family_requested(const struct l_genl_family_info *info,
+							void *user_data)
+{
+	const struct l_genl_family_info **out = user_data;
+
+	*out = info;
+}
+
+static void test_family_cache(const void *test_data)
+{
+	const struct l_genl_family_info *info = NULL;
+	struct l_genl_family *family;
+	struct l_settings *settings;
+	struct l_genl *genl;
+	char *boot_id = get_boot_id();
+	char *path = write_cache(boot_id);
+	char *value;
+
+	assert(l_main_init());
+
+	genl = l_genl_new();
+	assert(genl);
+	assert(!l_genl_family_new(genl, "ell-test"));
+	assert(l_genl_set_family_cache(genl, path));
+
+	family = l_genl_family_new(genl, "ell-test");
+	assert(family);
+
+	info = l_genl_family_get_info(family);
+	assert(l_genl_family_info_get_id(info) == 4000);
+	assert(l_genl_family_info_get_version(info) == 2);
+	assert(l_genl_family_info_can_send(info, 1));
+	assert(l_genl_family_info_can_dump(info, 2));
+	assert(l_genl_family_info_has_group(info, "scan"));
+	l_genl_family_free(family);
+
+	/* Cached families are answered without asking the kernel */
+	info = NULL;
+	assert(l_genl_request_family(genl, "ell-test", family_requested,
+								&info, NULL));
+	assert(!info);
+	l_main_iterate(0);
+	assert(info);
+	assert(l_genl_family_info_get_id(info) == 4000);
+
+	l_genl_unref(genl);
+
+	/* The nlctrl family is always known and never written out */
+	settings = l_settings_new();
+	assert(l_settings_load_from_file(settings, path));
+	value = l_settings_get_string(settings, "Cache", "BootId");
+	assert(!strcmp(value, boot_id));
+	l_free(value);
+	assert(l_settings_has_group(settings, "Family ell-test"));
+	assert(!l_settings_has_group(settings, "Family nlctrl"));
+	l_settings_free(settings);
+
+	unlink(path);
+	l_free(path);
+	l_free(boot_id);
+
+	assert(l_main_exit());
+}
+
+static void test_family_cache_boot_id(const void *test_data)
+{
+	struct l_settings *settings;
+	struct l_genl *genl;
+	char *path = write_cache("00000000-0000-0000-0000-000000000000");
+
+	assert(l_main_init());
+
+	genl = l_genl_new();
+	assert(genl);
+	assert(l_genl_set_family_cache(genl, path));
+	assert(!l_genl_family_new(genl, "ell-test"));
+	l_genl_unref(genl);
+
+	/* The outdated file is replaced */
+	settings = l_settings_new();
+	assert(l_settings_load_from_file(settings, path));
+	assert(!l_settings_has_group(settings, "Family ell-test"));
+	l_settings_free(settings);
+
+	unlink(path);
+	l_free(path);
+
+	assert(l_main_exit());
+}
+
+struct dump_data {
+	struct l_genl_msg *retained;
+	char name[GENL_NAMSIZ];
+	unsigned int count;
+	bool done;
+};
+
+static bool get_family_name(struct l_genl_msg *msg, char *out)
+{
+	struct l_genl_attr attr;
+	uint16_t type, len;
+	const void *data;
+
+	if (!l_genl_attr_init(&attr, msg))
+		return false;
+
+	while (l_genl_attr_next(&attr, &type, &len, &data)) {
+		if (type != CTRL_ATTR_FAMILY_NAME || len > GENL_NAMSIZ)
+			continue;
+
+		memcpy(out, data, len);
+		return true;
+	}
+
+	return false;
+}
+
+static void family_dumped(struct l_genl_msg *msg, void *user_data)
+{
+	struct dump_data *dump = user_data;
+
+	dump->count++;
+
+	if (dump->retained)
+		return;
+
+	assert(get_family_name(msg, dump->name));
+	dump->retained = l_genl_msg_ref(msg);
+}
+
+static void family_dump_done(void *user_data)
+{
+	struct dump_data *dump = user_data;
+
+	dump->done = true;
+}
+
+static void test_retain_received(const void *test_data)
+{
+	struct dump_data dump = {};
+	struct l_genl_family *family;
+	struct l_genl *genl;
+	char name[GENL_NAMSIZ] = {};
+
+	assert(l_main_init());
+
+	genl = l_genl_new();
+	assert(genl);
+
+	family = l_genl_family_new(genl, "nlctrl");
+	assert(family);
+	assert(l_genl_family_dump(family, l_genl_msg_new(CTRL_CMD_GETFAMILY),
+					family_dumped, &dump,
+					family_dump_done));
+
+	while (!dump.done)
+		l_main_iterate(-1);
+
+	/* Still valid after the receive buffer has been reused */
+	assert(dump.count);
+	assert(dump.retained);
+	assert(l_genl_msg_get_command(dump.retained) == CTRL_CMD_NEWFAMILY);
+	assert(get_family_name(dump.retained, name));
+	assert(!strcmp(name, dump.name));
+	l_genl_msg_unref(dump.retained);
+
+	l_genl_family_free(family);
+	l_genl_unref(genl);
+
+	assert(l_main_exit());
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("genl family cache", test_family_cache, NULL);
+	l_test_add("genl family cache boot id", test_family_cache_boot_id,
+									NULL);
+	l_test_add("genl retain received message", test_retain_received,
+									NULL);
+
+	return l_test_run();
+}
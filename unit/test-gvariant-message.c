@@ -384,6 +384,227 @@ static void builder_rewind(const void *data)
 	compare_message(msg, data);
 }
 
+static struct l_dbus_message *build_fixed_arrays(bool bulk)
+{
+	static const uint8_t bytes[5] = { 1, 2, 3, 4, 5 };
+	static const uint16_t words[3] = { 0x1234, 0x5678, 0x9abc };
+	static const uint64_t quads[2] = { 0x0102030405060708ULL, 42 };
+	static const bool bools[3] = { true, false, true };
+	struct l_dbus_message *msg;
+	struct l_dbus_message_builder *builder;
+	uint8_t y = 0xff;
+	unsigned int i;
+
+	msg = _dbus_message_new_method_call(2, "com.example",
+						"/com/example", "com.example",
+						"Method");
+	builder = l_dbus_message_builder_new(msg);
+	assert(builder);
+
+	/* Start off unaligned so that array padding comes into play */
+	assert(l_dbus_message_builder_append_basic(builder, 'y', &y));
+
+	assert(l_dbus_message_builder_enter_array(builder, "y"));
+
+	if (bulk) {
+		/* Can be done in several steps */
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'y',
+								bytes, 2));
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'y',
+								bytes + 2, 3));
+		assert(!l_dbus_message_builder_append_fixed_array(builder, 'q',
+								words, 3));
+	} else
+		for (i = 0; i < L_ARRAY_SIZE(bytes); i++)
+			assert(l_dbus_message_builder_append_basic(builder,
+							'y', &bytes[i]));
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	assert(l_dbus_message_builder_enter_array(builder, "q"));
+
+	if (bulk)
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'q',
+								words, 3));
+	else
+		for (i = 0; i < L_ARRAY_SIZE(words); i++)
+			assert(l_dbus_message_builder_append_basic(builder,
+							'q', &words[i]));
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	assert(l_dbus_message_builder_enter_array(builder, "t"));
+
+	if (bulk)
+		assert(l_dbus_message_builder_append_fixed_array(builder, 't',
+								quads, 2));
+	else
+		for (i = 0; i < L_ARRAY_SIZE(quads); i++)
+			assert(l_dbus_message_builder_append_basic(builder,
+							't', &quads[i]));
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	assert(l_dbus_message_builder_enter_array(builder, "b"));
+
+	if (bulk)
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'b',
+								bools, 3));
+	else
+		for (i = 0; i < L_ARRAY_SIZE(bools); i++)
+			assert(l_dbus_message_builder_append_basic(builder,
+							'b', &bools[i]));
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	assert(l_dbus_message_builder_enter_array(builder, "u"));
+
+	if (bulk)
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'u',
+								NULL, 0));
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	/* Only valid inside of an array */
+	if (bulk)
+		assert(!l_dbus_message_builder_append_fixed_array(builder, 'y',
+								bytes, 5));
+
+	assert(l_dbus_message_builder_finalize(builder));
+	l_dbus_message_builder_destroy(builder);
+
+	return msg;
+}
+
+static void build_fixed_array(const void *data)
+{
+	struct l_dbus_message *bulk = build_fixed_arrays(true);
+	struct l_dbus_message *single = build_fixed_arrays(false);
+	const void *bulk_body, *single_body;
+	size_t bulk_size, single_size;
+
+	assert(!strcmp(l_dbus_message_get_signature(bulk), "yayaqatabau"));
+
+	bulk_body = _dbus_message_get_body(bulk, &bulk_size);
+	single_body = _dbus_message_get_body(single, &single_size);
+	assert(bulk_size == single_size);
+	assert(!memcmp(bulk_body, single_body, bulk_size));
+
+	l_dbus_message_unref(bulk);
+	l_dbus_message_unref(single);
+}
+
+static void parse_fixed_array(const void *data)
+{
+	struct l_dbus_message *msg = build_fixed_arrays(true);
+	struct l_dbus_message_iter bytes, words, quads, bools, empty;
+	const uint8_t *y_array;
+	const uint16_t *q_array;
+	const uint64_t *t_array;
+	const uint8_t *b_array;
+	const uint32_t *u_array;
+	uint32_t n;
+	uint8_t y;
+
+	assert(l_dbus_message_get_arguments(msg, "yayaqatabau", &y, &bytes,
+						&words, &quads, &bools,
+						&empty));
+	assert(y == 0xff);
+
+	assert(l_dbus_message_iter_get_fixed_array(&bytes, &y_array, &n));
+	assert(n == 5);
+	assert(y_array[0] == 1 && y_array[4] == 5);
+
+	assert(l_dbus_message_iter_get_fixed_array(&words, &q_array, &n));
+	assert(n == 3);
+	assert(q_array[0] == 0x1234 && q_array[2] == 0x9abc);
+
+	assert(l_dbus_message_iter_get_fixed_array(&quads, &t_array, &n));
+	assert(n == 2);
+	assert(t_array[0] == 0x0102030405060708ULL && t_array[1] == 42);
+
+	assert(l_dbus_message_iter_get_fixed_array(&bools, &b_array, &n));
+	assert(n == 3);
+	assert(b_array[0] && !b_array[1] && b_array[2]);
+
+	assert(l_dbus_message_iter_get_fixed_array(&empty, &u_array, &n));
+	assert(n == 0);
+
+	l_dbus_message_unref(msg);
+}
+
+static void parse_struct_array(const void *data)
+{
+	struct l_dbus_message *msg;
+	struct l_dbus_message_builder *builder;
+	struct l_dbus_message_iter fixed, variable;
+	uint32_t u1, u2;
+	uint8_t y;
+	const char *str;
+	unsigned int i;
+
+	msg = _dbus_message_new_method_call(2, "com.example",
+						"/com/example", "com.example",
+						"Method");
+	builder = l_dbus_message_builder_new(msg);
+	assert(builder);
+
+	assert(l_dbus_message_builder_enter_array(builder, "(uuy)"));
+
+	for (i = 0; i < 3; i++) {
+		u1 = i;
+		u2 = i * 100;
+		y = i + 1;
+
+		assert(l_dbus_message_builder_enter_struct(builder, "uuy"));
+		assert(l_dbus_message_builder_append_basic(builder, 'u', &u1));
+		assert(l_dbus_message_builder_append_basic(builder, 'u', &u2));
+		assert(l_dbus_message_builder_append_basic(builder, 'y', &y));
+		assert(l_dbus_message_builder_leave_struct(builder));
+	}
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	assert(l_dbus_message_builder_enter_array(builder, "(sy)"));
+
+	for (i = 0; i < 3; i++) {
+		y = i;
+
+		assert(l_dbus_message_builder_enter_struct(builder, "sy"));
+		assert(l_dbus_message_builder_append_basic(builder, 's',
+							i ? "foo" : ""));
+		assert(l_dbus_message_builder_append_basic(builder, 'y', &y));
+		assert(l_dbus_message_builder_leave_struct(builder));
+	}
+
+	assert(l_dbus_message_builder_leave_array(builder));
+
+	assert(l_dbus_message_builder_finalize(builder));
+	l_dbus_message_builder_destroy(builder);
+
+	assert(l_dbus_message_get_arguments(msg, "a(uuy)a(sy)", &fixed,
+								&variable));
+
+	/* Fixed size elements are 12 bytes each, no framing offsets */
+	for (i = 0; l_dbus_message_iter_next_entry(&fixed, &u1, &u2, &y); i++) {
+		assert(u1 == i);
+		assert(u2 == i * 100);
+		assert(y == i + 1);
+	}
+
+	assert(i == 3);
+
+	for (i = 0; l_dbus_message_iter_next_entry(&variable, &str, &y);
+									i++) {
+		assert(!strcmp(str, i ? "foo" : ""));
+		assert(y == i);
+	}
+
+	assert(i == 3);
+
+	l_dbus_message_unref(msg);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -404,5 +625,9 @@ int main(int argc, char *argv[])
 	l_test_add("Message Builder Rewind Complex 1", builder_rewind,
 						&message_data_complex_1);
 
+	l_test_add("Fixed array (build)", build_fixed_array, NULL);
+	l_test_add("Fixed array (parse)", parse_fixed_array, NULL);
+	l_test_add("Struct array (parse)", parse_struct_array, NULL);
+
 	return l_test_run();
 }
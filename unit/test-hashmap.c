@@ -284,6 +284,204 @@ static void test_foreach_remove(const void *test_data)
 	l_hashmap_destroy(hashmap, NULL);
 };
 
+static unsigned int high_slot(const void *p)
+{
+	/* Maps to the last slot of a table with 8 slots, runs wrap around */
+	return 0x1b8d5a61 * (L_PTR_TO_UINT(p) % 4);
+}
+
+static bool remove_odd(const void *key, void *value, void *user_data)
+{
+	unsigned int *seen = user_data;
+
+	seen[L_PTR_TO_UINT(key)] += 1;
+
+	return L_PTR_TO_UINT(key) % 2;
+}
+
+static void test_grow(const void *test_data)
+{
+	static unsigned int seen[4096];
+	struct l_hashmap *hashmap;
+	unsigned int values[3];
+	unsigned int i;
+
+	hashmap = l_hashmap_new();
+	assert(hashmap);
+
+	l_hashmap_set_hash_function(hashmap, high_slot);
+
+	/* Duplicates keep their order as the table grows */
+	for (i = 0; i < 3; i++)
+		assert(l_hashmap_insert(hashmap, L_UINT_TO_PTR(1000),
+								&values[i]));
+
+	for (i = 1; i < L_ARRAY_SIZE(seen); i++)
+		if (i != 1000)
+			assert(l_hashmap_insert(hashmap, L_UINT_TO_PTR(i),
+							L_UINT_TO_PTR(i)));
+
+	for (i = 0; i < 3; i++)
+		assert(l_hashmap_remove(hashmap, L_UINT_TO_PTR(1000)) ==
+								&values[i]);
+
+	assert(l_hashmap_size(hashmap) == L_ARRAY_SIZE(seen) - 2);
+
+	/* Every entry is visited once, even when removals shift others */
+	i = l_hashmap_foreach_remove(hashmap, remove_odd, seen);
+	assert(i == L_ARRAY_SIZE(seen) / 2);
+
+	for (i = 1; i < L_ARRAY_SIZE(seen); i++) {
+		void *value = l_hashmap_lookup(hashmap, L_UINT_TO_PTR(i));
+
+		if (i == 1000)
+			continue;
+
+		assert(seen[i] == 1);
+		assert(value == (i % 2 ? NULL : L_UINT_TO_PTR(i)));
+	}
+
+	l_hashmap_destroy(hashmap, NULL);
+}
+
+static void test_sized(const void *test_data)
+{
+	struct l_hashmap *hashmap;
+	unsigned int i;
+
+	hashmap = l_hashmap_new_sized(50000);
+	assert(hashmap);
+
+	for (i = 1; i <= 50000; i++)
+		assert(l_hashmap_insert(hashmap, L_UINT_TO_PTR(i),
+							L_UINT_TO_PTR(i)));
+
+	for (i = 1; i <= 50000; i++)
+		assert(l_hashmap_lookup(hashmap, L_UINT_TO_PTR(i)) ==
+							L_UINT_TO_PTR(i));
+
+	assert(!l_hashmap_lookup(hashmap, L_UINT_TO_PTR(50001)));
+	assert(l_hashmap_size(hashmap) == 50000);
+
+	l_hashmap_destroy(hashmap, NULL);
+}
+
+static void test_hash_presets(const void *test_data)
+{
+	static const l_hashmap_hash_func_t presets[] = {
+		l_str_hash, l_str_hash_fast, l_str_hash_keyed,
+	};
+	static const char *keys[] = {
+		"", "a", "ab", "abc", "wlan0", "org.freedesktop.DBus",
+		"/net/connman/iwd/0/4/6d79_psk",
+		"a key long enough to take the 48 byte block path, twice over",
+		NULL
+	};
+	struct l_hashmap *hashmap;
+	unsigned int i, j;
+
+	for (i = 0; i < L_ARRAY_SIZE(presets); i++) {
+		hashmap = l_hashmap_string_new();
+		assert(l_hashmap_set_hash_function(hashmap, presets[i]));
+
+		for (j = 0; keys[j]; j++) {
+			char *copy = l_strdup(keys[j]);
+
+			/* Hashes only depend on content */
+			assert(presets[i](keys[j]) == presets[i](copy));
+			l_free(copy);
+
+			assert(l_hashmap_insert(hashmap, keys[j],
+							L_UINT_TO_PTR(j + 1)));
+		}
+
+		for (j = 0; keys[j]; j++)
+			assert(l_hashmap_lookup(hashmap, keys[j]) ==
+							L_UINT_TO_PTR(j + 1));
+
+		l_hashmap_destroy(hashmap, NULL);
+	}
+
+	assert(l_str_hash_fast("wlan0") != l_str_hash_fast("wlan1"));
+	assert(l_str_hash_keyed("wlan0") != l_str_hash_keyed("wlan1"));
+	assert(l_ptr_hash(keys) == l_ptr_hash(keys));
+	assert(l_ptr_hash(keys) != l_ptr_hash(keys + 1));
+}
+
+static void test_iter(const void *test_data)
+{
+	struct l_hashmap *hashmap;
+	struct l_hashmap_iter iter;
+	unsigned int seen[200] = {};
+	const void *key;
+	void *value;
+	unsigned int i;
+
+	hashmap = l_hashmap_new();
+
+	l_hashmap_iter_init(&iter, hashmap);
+	assert(!l_hashmap_iter_next(&iter, &key, &value));
+
+	for (i = 1; i < L_ARRAY_SIZE(seen); i++)
+		assert(l_hashmap_insert(hashmap, L_UINT_TO_PTR(i),
+						L_UINT_TO_PTR(i * 2)));
+
+	l_hashmap_iter_init(&iter, hashmap);
+
+	while (l_hashmap_iter_next(&iter, &key, &value)) {
+		assert(L_PTR_TO_UINT(value) == L_PTR_TO_UINT(key) * 2);
+		seen[L_PTR_TO_UINT(key)] += 1;
+	}
+
+	for (i = 1; i < L_ARRAY_SIZE(seen); i++)
+		assert(seen[i] == 1);
+
+	l_hashmap_destroy(hashmap, NULL);
+}
+
+static void scan_count(const void *key, void *value, void *user_data)
+{
+	unsigned int *seen = user_data;
+	unsigned int i = L_PTR_TO_UINT(key);
+
+	if (i < 1000)
+		seen[i] += 1;
+}
+
+static void test_scan(const void *test_data)
+{
+	static unsigned int seen[1000];
+	struct l_hashmap *hashmap;
+	unsigned int cursor = 0;
+	unsigned int steps = 0;
+	unsigned int added = 1000;
+	unsigned int i;
+
+	hashmap = l_hashmap_new();
+
+	assert(!l_hashmap_scan(hashmap, 0, 10, scan_count, seen));
+
+	for (i = 0; i < L_ARRAY_SIZE(seen); i++)
+		assert(l_hashmap_insert(hashmap, L_UINT_TO_PTR(i), NULL));
+
+	/* Keep growing the table while the scan is in progress */
+	do {
+		cursor = l_hashmap_scan(hashmap, cursor, 10, scan_count, seen);
+		steps += 1;
+
+		for (i = 0; i < 50; i++, added++)
+			assert(l_hashmap_insert(hashmap,
+						L_UINT_TO_PTR(added), NULL));
+	} while (cursor);
+
+	assert(steps > 1);
+
+	for (i = 0; i < L_ARRAY_SIZE(seen); i++)
+		assert(seen[i] == 1);
+
+	l_hashmap_destroy(hashmap, NULL);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -293,6 +491,11 @@ int main(int argc, char *argv[])
 	l_test_add("Duplicate Test", test_duplicate, NULL);
 	l_test_add("Replace Test", test_replace, NULL);
 	l_test_add("Foreach Remove Test", test_foreach_remove, NULL);
+	l_test_add("Grow Test", test_grow, NULL);
+	l_test_add("Sized Test", test_sized, NULL);
+	l_test_add("Hash Presets Test", test_hash_presets, NULL);
+	l_test_add("Iterator Test", test_iter, NULL);
+	l_test_add("Scan Test", test_scan, NULL);
 
 	return l_test_run();
 }
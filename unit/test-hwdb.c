@@ -58,6 +58,41 @@ static void check_entry(const char *modalias, struct l_hwdb_entry *entries,
 	}
 }
 
+static void check_batch(struct l_hwdb *hwdb)
+{
+	static const char * const modaliases[] = {
+		"OUI:000F79", "bluetooth:v003F", "bluetooth:v0078p0001",
+		"sdio:c02", "OUI:000F79", "nonexistent:",
+	};
+	struct l_arena *arena = l_arena_new(0);
+	struct l_hwdb_entry **results;
+	unsigned int i;
+
+	results = l_hwdb_lookup_batch(hwdb, modaliases,
+					L_ARRAY_SIZE(modaliases), arena);
+	assert(results);
+
+	/* Same entries in the same order as one by one */
+	for (i = 0; i < L_ARRAY_SIZE(modaliases); i++) {
+		struct l_hwdb_entry *entries, *entry, *batch_entry;
+
+		entries = l_hwdb_lookup(hwdb, "%s", modaliases[i]);
+
+		for (entry = entries, batch_entry = results[i];
+				entry && batch_entry;
+				entry = entry->next,
+				batch_entry = batch_entry->next) {
+			assert(entry->key == batch_entry->key);
+			assert(entry->value == batch_entry->value);
+		}
+
+		assert(!entry && !batch_entry);
+		l_hwdb_lookup_free(entries);
+	}
+
+	l_arena_free(arena);
+}
+
 int main(int argc, char *argv[])
 {
 	struct l_hwdb *hwdb;
@@ -85,6 +120,8 @@ int main(int argc, char *argv[])
 	/* Bluetooth Type-A standard interface */
 	print_modalias(hwdb, "sdio:c02");
 
+	check_batch(hwdb);
+
 	l_hwdb_unref(hwdb);
 
 	return 0;
@@ -0,0 +1,150 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+
+#include <ell/ell.h>
+
+#define N_THREADS	4
+#define N_ROUNDS	20000
+
+static void test_range(const void *test_data)
+{
+	struct l_idalloc *ida;
+	unsigned int i;
+
+	assert(!l_idalloc_new(10, 9));
+
+	ida = l_idalloc_new(100, 199);
+	assert(ida);
+	assert(l_idalloc_get_min(ida) == 100);
+	assert(l_idalloc_get_max(ida) == 199);
+
+	for (i = 100; i <= 199; i++) {
+		assert(l_idalloc_get(ida) == i);
+		assert(l_idalloc_contains(ida, i));
+	}
+
+	/* Exhausted, the bits past the range are never handed out */
+	assert(l_idalloc_get(ida) == 200);
+	assert(!l_idalloc_contains(ida, 200));
+	assert(!l_idalloc_put(ida, 99));
+	assert(!l_idalloc_put(ida, 200));
+
+	assert(l_idalloc_put(ida, 150));
+	assert(!l_idalloc_put(ida, 150));
+	assert(!l_idalloc_contains(ida, 150));
+	assert(l_idalloc_get(ida) == 150);
+
+	l_idalloc_free(ida);
+}
+
+static void test_reuse(const void *test_data)
+{
+	struct l_idalloc *ida = l_idalloc_new(1, 1000);
+	unsigned int i;
+
+	assert(l_idalloc_get(ida) == 1);
+	assert(l_idalloc_get(ida) == 2);
+
+	/* Released IDs only come back once the range wraps around */
+	assert(l_idalloc_put(ida, 1));
+	assert(l_idalloc_get(ida) == 3);
+
+	assert(l_idalloc_take(ida, 4));
+	assert(!l_idalloc_take(ida, 4));
+	assert(l_idalloc_get(ida) == 5);
+
+	for (i = 6; i <= 1000; i++)
+		assert(l_idalloc_get(ida) == i);
+
+	assert(l_idalloc_get(ida) == 1);
+	assert(l_idalloc_get(ida) == 1001);
+
+	l_idalloc_free(ida);
+}
+
+struct thread_data {
+	struct l_idalloc *ida;
+	uint8_t *owners;
+	unsigned int id;
+};
+
+static void *alloc_thread(void *user_data)
+{
+	struct thread_data *data = user_data;
+	uint32_t held[16];
+	unsigned int round;
+	unsigned int i;
+
+	for (round = 0; round < N_ROUNDS; round++) {
+		for (i = 0; i < L_ARRAY_SIZE(held); i++) {
+			held[i] = l_idalloc_get(data->ida);
+			assert(held[i] <= l_idalloc_get_max(data->ida));
+
+			/* No other thread holds the same ID */
+			assert(!__atomic_exchange_n(&data->owners[held[i]],
+							data->id + 1,
+							__ATOMIC_RELAXED));
+		}
+
+		for (i = 0; i < L_ARRAY_SIZE(held); i++) {
+			__atomic_store_n(&data->owners[held[i]], 0,
+							__ATOMIC_RELAXED);
+			assert(l_idalloc_put(data->ida, held[i]));
+		}
+	}
+
+	return NULL;
+}
+
+static void test_concurrent(const void *test_data)
+{
+	struct thread_data data[N_THREADS];
+	pthread_t threads[N_THREADS];
+	struct l_idalloc *ida;
+	uint8_t *owners;
+	unsigned int i;
+
+	/* Barely enough IDs for all threads, so that they contend */
+	ida = l_idalloc_new(0, N_THREADS * 16 + 7);
+	owners = l_new(uint8_t, N_THREADS * 16 + 8);
+
+	for (i = 0; i < N_THREADS; i++) {
+		data[i].ida = ida;
+		data[i].owners = owners;
+		data[i].id = i;
+
+		assert(!pthread_create(&threads[i], NULL, alloc_thread,
+								&data[i]));
+	}
+
+	for (i = 0; i < N_THREADS; i++)
+		assert(!pthread_join(threads[i], NULL));
+
+	for (i = 0; i <= l_idalloc_get_max(ida); i++)
+		assert(!l_idalloc_contains(ida, i));
+
+	l_free(owners);
+	l_idalloc_free(ida);
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Bounded range", test_range, NULL);
+	l_test_add("Delayed reuse", test_reuse, NULL);
+	l_test_add("Concurrent", test_concurrent, NULL);
+
+	return l_test_run();
+}
@@ -646,6 +646,99 @@ static void test_key_crypto(const void *data)
 	l_key_free(pubkey);
 }
 
+struct key_async_data {
+	ssize_t result;
+	uint8_t out[256];
+	unsigned int n_callbacks;
+	unsigned int n_destroys;
+};
+
+static void key_async_cb(ssize_t result, const void *out, void *user_data)
+{
+	struct key_async_data *data = user_data;
+
+	data->result = result;
+	data->n_callbacks++;
+
+	if (result >= 0)
+		memcpy(data->out, out, result);
+	else
+		assert(!out);
+}
+
+static void key_async_destroy(void *user_data)
+{
+	struct key_async_data *data = user_data;
+
+	data->n_destroys++;
+}
+
+static void test_key_async(const void *data)
+{
+	struct l_cert *cert;
+	struct l_key *privkey;
+	struct l_key *pubkey;
+	struct key_async_data sign = {};
+	struct key_async_data fail = {};
+	struct key_async_data cancelled = {};
+	uint32_t id;
+	int hash = L_CHECKSUM_NONE;
+	int rsa = L_KEY_RSA_PKCS1_V1_5;
+
+	cert = load_cert_file(CERTDIR "cert-client.pem");
+	assert(cert);
+	pubkey = l_cert_get_pubkey(cert);
+	assert(pubkey);
+	l_cert_free(cert);
+
+	/* No main loop to deliver the result on */
+	assert(!l_key_sign_async(pubkey, rsa, hash, plaintext,
+					strlen(plaintext), 256, key_async_cb,
+					&fail, key_async_destroy));
+	assert(!fail.n_destroys);
+
+	assert(l_main_init());
+
+	/* Can't sign with public key */
+	assert(l_key_sign_async(pubkey, rsa, hash, plaintext,
+					strlen(plaintext), 256, key_async_cb,
+					&fail, key_async_destroy));
+
+	id = l_key_sign_async(pubkey, rsa, hash, plaintext, strlen(plaintext),
+				256, key_async_cb, &cancelled,
+				key_async_destroy);
+	assert(id);
+	l_key_cancel_async(id);
+	assert(cancelled.n_destroys == 1);
+
+	privkey = l_pem_load_private_key(CERTDIR "cert-client-key-pkcs8.pem",
+						NULL, NULL);
+	if (privkey)
+		assert(l_key_sign_async(privkey, rsa, hash, plaintext,
+						strlen(plaintext), 256,
+						key_async_cb, &sign,
+						key_async_destroy));
+	else
+		sign.n_destroys = 1;
+
+	while (!fail.n_destroys || !sign.n_destroys)
+		l_main_iterate(-1);
+
+	assert(fail.n_callbacks == 1 && fail.result < 0);
+
+	if (privkey) {
+		assert(sign.n_callbacks == 1 && sign.result == 256);
+		assert(l_key_verify(pubkey, rsa, hash, plaintext, sign.out,
+					strlen(plaintext), sign.result));
+		l_key_free(privkey);
+	}
+
+	/* Waits for the cancelled job if it's still running */
+	l_main_exit();
+	assert(!cancelled.n_callbacks && cancelled.n_destroys == 1);
+	l_key_free(pubkey);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -667,8 +760,10 @@ int main(int argc, char *argv[])
 		l_test_add("trust chain", test_trust_chain, NULL);
 	}
 
-	if (l_key_is_supported(L_KEY_FEATURE_CRYPTO))
+	if (l_key_is_supported(L_KEY_FEATURE_CRYPTO)) {
+		l_test_add("key async", test_key_async, NULL);
 		l_test_add("key crypto", test_key_crypto, NULL);
+	}
 
 	return l_test_run();
 }
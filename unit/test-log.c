@@ -0,0 +1,504 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <ell/ell.h>
+
+#include "ell/log-private.h"
+
+static void test_trace(const void *data)
+{
+	static const char long_str[] =
+		"0123456789abcdefghijklmnopqrstuvwxyz"
+		"0123456789abcdefghijklmnopqrstuvwxyz"
+		"0123456789abcdefghijklmnopqrstuvwxyz";
+	char expected[128];
+	char buf[4096];
+	ssize_t len = 0;
+	ssize_t r;
+	int fds[2];
+
+	l_debug_trace_enable("test_trace");
+
+	l_debug("int %d unsigned %u hex %02x", -5, 7u, 0xab);
+	l_debug("long %ld size %zu ll %lld", -1234567890123L, (size_t) 42,
+							1LL << 40);
+	l_debug("string '%s' precision '%.3s' star '%.*s' width '%*d'",
+					"hello", "abcdef", 2, "xyz", 4, 9);
+	l_debug("double %.2f char %c %%", 3.14159, 'q');
+	errno = ENOENT;
+	l_debug("errno %m");
+	l_debug("long %s end", long_str);
+
+	l_debug_trace_disable();
+	l_debug("not traced %d", 1);
+
+	assert(!pipe(fds));
+	l_debug_trace_dump(fds[1]);
+	close(fds[1]);
+
+	while ((r = read(fds[0], buf + len, sizeof(buf) - 1 - len)) > 0)
+		len += r;
+
+	close(fds[0]);
+	buf[len] = '\0';
+
+	assert(strstr(buf, "test_trace() int -5 unsigned 7 hex ab\n"));
+	assert(strstr(buf, "() long -1234567890123 size 42 "
+						"ll 1099511627776\n"));
+	assert(strstr(buf, "() string 'hello' precision 'abc' star 'xy' "
+							"width '   9'\n"));
+	assert(strstr(buf, "() double 3.14 char q %\n"));
+	assert(strstr(buf, "() errno No such file or directory\n"));
+	assert(!strstr(buf, "not traced"));
+
+	/* Only as much of the string as fits in the record is kept */
+	snprintf(expected, sizeof(expected), "() long %.*s...\n",
+						87, long_str);
+	assert(strstr(buf, expected));
+}
+
+static unsigned int n_logged;
+
+__attribute__((format(printf, 5, 0)))
+static void count_log(int priority, const char *file, const char *line,
+			const char *func, const char *format, va_list ap)
+{
+	n_logged++;
+}
+
+static void site_alpha(void)
+{
+	l_debug("alpha");
+}
+
+static void site_beta(void)
+{
+	l_debug("beta");
+	l_debug("beta again");
+}
+
+static unsigned int run_sites(void)
+{
+	n_logged = 0;
+	site_alpha();
+	site_beta();
+
+	return n_logged;
+}
+
+static void test_set_enabled(const void *data)
+{
+	l_log_set_handler(count_log);
+	/* Adds this binary's debug section if libell is a shared library */
+	l_debug_enable("none");
+	l_debug_disable();
+	assert(run_sites() == 0);
+
+	assert(l_debug_set_enabled("site_alpha", true) == 1);
+	assert(run_sites() == 1);
+
+	assert(l_debug_set_enabled("site_*", true) == 3);
+	assert(run_sites() == 3);
+
+	assert(l_debug_set_enabled("*_beta", false) == 2);
+	assert(run_sites() == 1);
+
+	assert(l_debug_set_enabled("*test-log.c", false) >= 3);
+	assert(run_sites() == 0);
+
+	assert(l_debug_set_enabled("site_[b]eta,site_alpha", true) == 3);
+	assert(run_sites() == 3);
+
+	assert(l_debug_set_enabled("no_such_site", true) == 0);
+
+	l_debug_disable();
+	assert(run_sites() == 0);
+	l_log_set_null();
+}
+
+static char logged[16][128];
+
+__attribute__((format(printf, 5, 0)))
+static void capture_log(int priority, const char *file, const char *line,
+			const char *func, const char *format, va_list ap)
+{
+	if (n_logged < L_ARRAY_SIZE(logged))
+		vsnprintf(logged[n_logged], sizeof(logged[0]), format, ap);
+
+	n_logged++;
+}
+
+static void log_storm(unsigned int count, bool same)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		l_error_ratelimited("storm %u", same ? 0 : i);
+}
+
+static void test_ratelimited(const void *data)
+{
+	l_log_set_handler(capture_log);
+
+	/* Bursts of 10, then the rest is counted */
+	n_logged = 0;
+	log_storm(100, false);
+	assert(n_logged == 10);
+	assert(!strcmp(logged[9], "storm 9\n"));
+
+	/* One token comes back every 500 ms */
+	usleep(600 * 1000);
+	n_logged = 0;
+	log_storm(1, false);
+	assert(n_logged == 2);
+	assert(!strcmp(logged[0], "90 messages suppressed\n"));
+	assert(!strcmp(logged[1], "storm 0\n"));
+
+	n_logged = 0;
+	log_storm(5, false);
+	assert(n_logged == 0);
+
+	l_log_set_null();
+}
+
+static void log_repeated(const char *str)
+{
+	l_warn_ratelimited("%s", str);
+}
+
+static void test_ratelimited_repeats(const void *data)
+{
+	unsigned int i;
+
+	l_log_set_handler(capture_log);
+	n_logged = 0;
+
+	/* Repeats take no tokens */
+	for (i = 0; i < 50; i++)
+		log_repeated("same");
+
+	assert(n_logged == 1);
+	assert(!strcmp(logged[0], "same\n"));
+
+	log_repeated("different");
+	assert(n_logged == 3);
+	assert(!strcmp(logged[1], "last message repeated 49 times\n"));
+	assert(!strcmp(logged[2], "different\n"));
+
+	l_log_set_null();
+}
+
+/*
+ * Collects what the syslog backend sends on a socketpair, standing in for
+ * /dev/log, from a separate thread so that the log writer never blocks
+ * for good.  The dropped message notices are added up instead of kept.
+ */
+struct log_reader {
+	int fd;
+	pthread_t thread;
+	char **msgs;
+	unsigned int n_msgs;
+	unsigned int dropped;
+	bool started;
+};
+
+static void *log_reader_thread(void *user_data)
+{
+	struct log_reader *reader = user_data;
+	char buf[4096];
+	ssize_t len;
+
+	while ((len = recv(reader->fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		char *msg;
+		unsigned int dropped;
+
+		buf[len] = '\0';
+		msg = strstr(buf, "]: ");
+		assert(buf[0] == '<' && msg);
+		msg = l_strdup(msg + 3);
+
+		if (sscanf(msg, "%u log messages dropped", &dropped) == 1) {
+			reader->dropped += dropped;
+			l_free(msg);
+			continue;
+		}
+
+		if (!(reader->n_msgs & (reader->n_msgs + 1)))
+			reader->msgs = l_realloc(reader->msgs,
+						(reader->n_msgs * 2 + 1) *
+						sizeof(char *));
+
+		reader->msgs[reader->n_msgs++] = msg;
+	}
+
+	assert(len == 0);
+
+	return NULL;
+}
+
+static void log_reader_start(struct log_reader *reader)
+{
+	assert(!pthread_create(&reader->thread, NULL, log_reader_thread,
+								reader));
+	reader->started = true;
+}
+
+static void log_reader_init(struct log_reader *reader, bool start)
+{
+	int fds[2];
+
+	memset(reader, 0, sizeof(*reader));
+
+	assert(!socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds));
+	log_set_syslog_fd(fds[0]);
+	reader->fd = fds[1];
+
+	if (start)
+		log_reader_start(reader);
+}
+
+/* Stops buffering, then waits for everything sent to be collected */
+static void log_reader_finish(struct log_reader *reader)
+{
+	assert(l_log_set_buffered(0, L_LOG_OVERFLOW_DROP));
+
+	if (!reader->started)
+		log_reader_start(reader);
+
+	l_log_set_null();
+	assert(!pthread_join(reader->thread, NULL));
+	close(reader->fd);
+}
+
+static void log_reader_free(struct log_reader *reader)
+{
+	unsigned int i;
+
+	for (i = 0; i < reader->n_msgs; i++)
+		l_free(reader->msgs[i]);
+
+	l_free(reader->msgs);
+}
+
+#define N_LOG_THREADS	4
+#define N_LOG_MSGS	5000
+
+struct log_thread {
+	pthread_t thread;
+	unsigned int id;
+	unsigned int n_msgs;
+};
+
+static bool log_threads_stop;
+
+/* Logs n_msgs messages, or until told to stop if n_msgs is 0 */
+static void *log_thread(void *user_data)
+{
+	struct log_thread *thread = user_data;
+	unsigned int i;
+
+	for (i = 0; thread->n_msgs ? i < thread->n_msgs :
+			!__atomic_load_n(&log_threads_stop, __ATOMIC_RELAXED);
+									i++)
+		l_info("thread %u seq %u", thread->id, i);
+
+	thread->n_msgs = i;
+
+	return NULL;
+}
+
+static void log_threads_start(struct log_thread *threads,
+						unsigned int n_msgs)
+{
+	unsigned int i;
+
+	for (i = 0; i < N_LOG_THREADS; i++) {
+		threads[i].id = i;
+		threads[i].n_msgs = n_msgs;
+		assert(!pthread_create(&threads[i].thread, NULL,
+						log_thread, &threads[i]));
+	}
+}
+
+/* Returns the number of messages logged */
+static unsigned int log_threads_join(struct log_thread *threads)
+{
+	unsigned int i;
+	unsigned int n_msgs = 0;
+
+	for (i = 0; i < N_LOG_THREADS; i++) {
+		assert(!pthread_join(threads[i].thread, NULL));
+		n_msgs += threads[i].n_msgs;
+	}
+
+	return n_msgs;
+}
+
+/*
+ * Checks that every message came from log_thread() and, if @ordered, that
+ * the ones from one thread arrived in the order they were logged.
+ */
+static void log_reader_check(struct log_reader *reader, bool ordered)
+{
+	unsigned int next[N_LOG_THREADS] = {};
+	unsigned int i;
+
+	for (i = 0; i < reader->n_msgs; i++) {
+		unsigned int id, seq;
+
+		assert(sscanf(reader->msgs[i], "thread %u seq %u\n",
+							&id, &seq) == 2);
+		assert(id < N_LOG_THREADS);
+
+		if (ordered) {
+			assert(seq >= next[id]);
+			next[id] = seq + 1;
+		}
+	}
+}
+
+static void test_buffered_order(const void *data)
+{
+	struct log_thread threads[N_LOG_THREADS];
+	struct log_reader reader;
+
+	log_reader_init(&reader, true);
+	assert(l_log_set_buffered(64, L_LOG_OVERFLOW_COUNT));
+
+	log_threads_start(threads, N_LOG_MSGS);
+	log_threads_join(threads);
+
+	log_reader_finish(&reader);
+
+	/* Gaps are allowed for dropped messages, but no reordering */
+	log_reader_check(&reader, true);
+	assert(reader.n_msgs + reader.dropped ==
+					N_LOG_THREADS * N_LOG_MSGS);
+
+	log_reader_free(&reader);
+}
+
+static void test_buffered_truncate(const void *data)
+{
+	struct log_reader reader;
+	char long_msg[3000];
+	size_t len;
+
+	memset(long_msg, 'x', sizeof(long_msg) - 1);
+	long_msg[sizeof(long_msg) - 1] = '\0';
+
+	log_reader_init(&reader, true);
+	assert(l_log_set_buffered(4, L_LOG_OVERFLOW_DROP));
+
+	l_info("%s", long_msg);
+	l_info("short");
+
+	log_reader_finish(&reader);
+
+	assert(reader.n_msgs == 2);
+
+	/* The whole message, header included, fits in a 1 KiB slot */
+	len = strlen(reader.msgs[0]);
+	assert(len > 900 && len < 1024);
+	assert(strspn(reader.msgs[0], "x") == len);
+
+	/* The slot after it isn't affected */
+	assert(!strcmp(reader.msgs[1], "short\n"));
+
+	log_reader_free(&reader);
+}
+
+static void test_buffered_overflow(const void *data)
+{
+	static const enum l_log_overflow policies[] = {
+		L_LOG_OVERFLOW_COUNT, L_LOG_OVERFLOW_DROP,
+	};
+	unsigned int i, j;
+
+	for (i = 0; i < L_ARRAY_SIZE(policies); i++) {
+		struct log_reader reader;
+
+		/*
+		 * Nothing is read until the end, so the writer blocks once
+		 * the socket is full and the ring overflows behind it.
+		 */
+		log_reader_init(&reader, false);
+		assert(l_log_set_buffered(4, policies[i]));
+
+		for (j = 0; j < N_LOG_MSGS; j++)
+			l_info("thread 0 seq %u", j);
+
+		log_reader_finish(&reader);
+		log_reader_check(&reader, true);
+
+		assert(reader.n_msgs < N_LOG_MSGS);
+
+		if (policies[i] == L_LOG_OVERFLOW_COUNT)
+			assert(reader.n_msgs + reader.dropped == N_LOG_MSGS);
+		else
+			assert(!reader.dropped);
+
+		log_reader_free(&reader);
+	}
+}
+
+static void test_buffered_toggle(const void *data)
+{
+	struct log_thread threads[N_LOG_THREADS];
+	struct log_reader reader;
+	unsigned int i;
+	unsigned int n_msgs;
+
+	log_reader_init(&reader, true);
+	log_threads_stop = false;
+	log_threads_start(threads, 0);
+
+	/* Nothing may get lost while buffering comes and goes */
+	for (i = 0; i < 1000; i++) {
+		assert(l_log_set_buffered(16, L_LOG_OVERFLOW_COUNT));
+		assert(l_log_set_buffered(0, L_LOG_OVERFLOW_COUNT));
+	}
+
+	__atomic_store_n(&log_threads_stop, true, __ATOMIC_RELAXED);
+	n_msgs = log_threads_join(threads);
+	log_reader_finish(&reader);
+
+	log_reader_check(&reader, false);
+	assert(reader.n_msgs + reader.dropped == n_msgs);
+
+	log_reader_free(&reader);
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Debug trace", test_trace, NULL);
+	l_test_add("Debug set enabled", test_set_enabled, NULL);
+	l_test_add("Rate limited logging", test_ratelimited, NULL);
+	l_test_add("Rate limited repeats", test_ratelimited_repeats, NULL);
+	l_test_add("Buffered ordering", test_buffered_order, NULL);
+	l_test_add("Buffered truncation", test_buffered_truncate, NULL);
+	l_test_add("Buffered overflow", test_buffered_overflow, NULL);
+	l_test_add("Buffered enable and disable", test_buffered_toggle, NULL);
+
+	return l_test_run();
+}
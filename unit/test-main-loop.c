@@ -0,0 +1,778 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_LINUX_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#include <ell/ell.h>
+
+#include "ell/main-private.h"
+
+#define N_LOOPS 4
+
+/* Set while a test runs on the io_uring backend */
+static bool uring_backend;
+
+struct loop_data {
+	pthread_t thread;
+	struct l_main_loop *loop;
+	unsigned int expired;
+	unsigned int idled;
+};
+
+static void loop_timeout_cb(struct l_timeout *timeout, void *user_data)
+{
+	struct loop_data *data = user_data;
+
+	/* Callbacks run on the loop of the thread that created the timeout */
+	assert(l_main_get_loop() == data->loop);
+
+	if (++data->expired < 5) {
+		l_timeout_modify_ms(timeout, 2);
+		return;
+	}
+
+	l_main_quit();
+}
+
+static void loop_idle_cb(void *user_data)
+{
+	struct loop_data *data = user_data;
+
+	assert(l_main_get_loop() == data->loop);
+	data->idled += 1;
+}
+
+static void *loop_thread(void *user_data)
+{
+	struct loop_data *data = user_data;
+	struct l_timeout *timeout;
+
+	assert(!l_main_get_loop());
+	assert(l_main_init());
+
+	data->loop = l_main_get_loop();
+	assert(data->loop);
+
+	timeout = l_timeout_create_ms(2, loop_timeout_cb, data, NULL);
+	assert(timeout);
+
+	assert(l_idle_oneshot(loop_idle_cb, data, NULL));
+
+	assert(l_main_run() == EXIT_SUCCESS);
+
+	l_timeout_remove(timeout);
+
+	assert(l_main_exit());
+	assert(!l_main_get_loop());
+
+	return NULL;
+}
+
+static void test_threads(const void *test_data)
+{
+	struct loop_data data[N_LOOPS] = {};
+	unsigned int i;
+
+	for (i = 0; i < N_LOOPS; i++)
+		assert(!pthread_create(&data[i].thread, NULL,
+						loop_thread, &data[i]));
+
+	for (i = 0; i < N_LOOPS; i++) {
+		assert(!pthread_join(data[i].thread, NULL));
+		assert(data[i].expired == 5);
+		assert(data[i].idled == 1);
+	}
+
+	/* This thread's loop is independent of the others */
+	assert(!l_main_get_loop());
+}
+
+#define N_WORKERS 4
+#define N_INVOKES 10000
+
+struct invoke_test {
+	struct l_main_loop *loop;
+	pthread_t owner;
+	unsigned int invoked;
+	unsigned int destroyed;
+	unsigned int last[N_WORKERS];
+};
+
+struct invoke_worker {
+	struct invoke_test *test;
+	unsigned int id;
+	pthread_t thread;
+};
+
+struct invoke_item {
+	struct invoke_test *test;
+	unsigned int worker;
+	unsigned int seq;
+};
+
+static void invoke_cb(void *user_data)
+{
+	struct invoke_item *item = user_data;
+	struct invoke_test *test = item->test;
+
+	assert(pthread_equal(pthread_self(), test->owner));
+
+	/* Submissions from one thread are dispatched in order */
+	assert(item->seq == test->last[item->worker] + 1);
+	test->last[item->worker] = item->seq;
+
+	if (++test->invoked == N_WORKERS * N_INVOKES)
+		l_main_quit();
+}
+
+static void invoke_destroy(void *user_data)
+{
+	struct invoke_item *item = user_data;
+
+	item->test->destroyed += 1;
+	l_free(item);
+}
+
+static void *invoke_worker_thread(void *user_data)
+{
+	struct invoke_worker *worker = user_data;
+	unsigned int i;
+
+	for (i = 1; i <= N_INVOKES; i++) {
+		struct invoke_item *item = l_new(struct invoke_item, 1);
+
+		item->test = worker->test;
+		item->worker = worker->id;
+		item->seq = i;
+
+		assert(l_main_invoke(worker->test->loop, invoke_cb, item,
+							invoke_destroy));
+	}
+
+	return NULL;
+}
+
+static void test_invoke(const void *test_data)
+{
+	struct invoke_test test = {};
+	struct invoke_worker workers[N_WORKERS];
+	unsigned int i;
+
+	assert(l_main_init());
+
+	test.loop = l_main_get_loop();
+	test.owner = pthread_self();
+
+	for (i = 0; i < N_WORKERS; i++) {
+		workers[i].test = &test;
+		workers[i].id = i;
+		assert(!pthread_create(&workers[i].thread, NULL,
+					invoke_worker_thread, &workers[i]));
+	}
+
+	l_main_run();
+
+	for (i = 0; i < N_WORKERS; i++)
+		assert(!pthread_join(workers[i].thread, NULL));
+
+	assert(test.invoked == N_WORKERS * N_INVOKES);
+	assert(test.destroyed == N_WORKERS * N_INVOKES);
+
+	assert(l_main_exit());
+}
+
+static void invoke_not_called(void *user_data)
+{
+	assert(false);
+}
+
+static void invoke_pending_destroy(void *user_data)
+{
+	unsigned int *destroyed = user_data;
+
+	*destroyed += 1;
+}
+
+static void test_invoke_pending(const void *test_data)
+{
+	unsigned int destroyed = 0;
+
+	assert(!l_main_invoke(NULL, invoke_not_called, NULL, NULL));
+
+	assert(l_main_init());
+
+	assert(l_main_invoke(l_main_get_loop(), invoke_not_called,
+					&destroyed, invoke_pending_destroy));
+	assert(l_main_invoke(l_main_get_loop(), invoke_not_called,
+					&destroyed, invoke_pending_destroy));
+
+	/* Submissions never dispatched are destroyed with the loop */
+	assert(l_main_exit());
+	assert(destroyed == 2);
+}
+
+#define N_IDLES 8
+
+struct idle_test {
+	struct l_idle *idles[N_IDLES];
+	unsigned int calls[N_IDLES];
+	unsigned int destroyed;
+	unsigned int oneshots;
+};
+
+static void idle_test_oneshot(void *user_data)
+{
+	struct idle_test *test = user_data;
+
+	test->oneshots += 1;
+}
+
+static void idle_test_cb(struct l_idle *idle, void *user_data)
+{
+	struct idle_test *test = user_data;
+	unsigned int i;
+
+	for (i = 0; i < N_IDLES; i++)
+		if (test->idles[i] == idle)
+			break;
+
+	assert(i < N_IDLES);
+	test->calls[i] += 1;
+
+	switch (i) {
+	case 0:
+		/* Remove a later idle before it gets dispatched */
+		l_idle_remove(test->idles[5]);
+		test->idles[5] = NULL;
+		break;
+	case 2:
+		/* Remove ourselves while being dispatched */
+		l_idle_remove(idle);
+		test->idles[2] = NULL;
+		break;
+	case 3:
+		/* Remove an earlier idle that was already dispatched */
+		if (test->idles[1]) {
+			l_idle_remove(test->idles[1]);
+			test->idles[1] = NULL;
+		}
+
+		assert(l_idle_oneshot(idle_test_oneshot, test, NULL));
+		break;
+	}
+}
+
+static void idle_test_destroy(void *user_data)
+{
+	struct idle_test *test = user_data;
+
+	test->destroyed += 1;
+}
+
+static void test_idle(const void *test_data)
+{
+	struct idle_test test = {};
+	unsigned int i;
+
+	assert(l_main_init());
+
+	for (i = 0; i < N_IDLES; i++) {
+		test.idles[i] = l_idle_create(idle_test_cb, &test,
+							idle_test_destroy);
+		assert(test.idles[i]);
+	}
+
+	assert(l_main_prepare() == 0);
+
+	l_main_iterate(0);
+	l_main_iterate(0);
+
+	assert(test.calls[0] == 2);
+	assert(test.calls[1] == 1);
+	assert(test.calls[2] == 1);
+	assert(test.calls[3] == 2);
+	assert(test.calls[4] == 2);
+	assert(test.calls[5] == 0);
+	assert(test.calls[7] == 2);
+	assert(test.destroyed == 3);
+
+	/* Oneshots added during dispatch run in the same pass */
+	assert(test.oneshots == 2);
+
+	for (i = 0; i < N_IDLES; i++)
+		l_idle_remove(test.idles[i]);
+
+	assert(test.destroyed == N_IDLES);
+	assert(l_main_prepare() == -1);
+
+	assert(l_main_exit());
+}
+
+static bool stats_read_cb(struct l_io *io, void *user_data)
+{
+	uint64_t count;
+
+	assert(read(l_io_get_fd(io), &count, sizeof(count)) == sizeof(count));
+	usleep(2000);
+
+	return true;
+}
+
+static void stats_idle_cb(void *user_data)
+{
+}
+
+static void test_stats(const void *test_data)
+{
+	struct l_main_watch_stats wstats;
+	struct l_main_stats stats;
+	struct l_io *io;
+	uint64_t one = 1;
+	unsigned int i;
+	uint64_t sum;
+
+	assert(l_main_init());
+
+	io = l_io_new(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+	assert(io);
+	l_io_set_close_on_destroy(io, true);
+	assert(l_io_set_read_handler(io, stats_read_cb, NULL, NULL));
+
+	/* Statistics are opt-in */
+	assert(!l_main_get_stats(&stats));
+	assert(!l_io_get_stats(io, &wstats));
+
+	assert(l_main_set_stats_enabled(true, false));
+
+	for (i = 0; i < 3; i++) {
+		assert(write(l_io_get_fd(io), &one, sizeof(one)) ==
+								sizeof(one));
+		l_main_iterate(-1);
+	}
+
+	assert(l_idle_oneshot(stats_idle_cb, NULL, NULL));
+	l_main_iterate(0);
+
+	assert(l_main_get_stats(&stats));
+	assert(stats.wakeups == 4);
+	assert(stats.events == 3);
+	assert(stats.max_events == 1);
+	assert(stats.events_histogram[1] == 3);
+	assert(stats.idle_dispatches == 1);
+	assert(stats.longest_stall >= 2000);
+	assert(stats.longest_stall_fd == l_io_get_fd(io));
+
+	for (i = 0, sum = 0; i < L_MAIN_HISTOGRAM_SIZE; i++)
+		sum += stats.callback_histogram[i];
+
+	assert(sum == 3);
+
+	assert(l_io_get_stats(io, &wstats));
+	assert(wstats.dispatches == 3);
+	assert(wstats.longest_time >= 2000);
+	assert(wstats.total_time >= 3 * 2000);
+
+	l_main_reset_stats();
+	assert(l_main_get_stats(&stats));
+	assert(!stats.wakeups && stats.longest_stall_fd == -1);
+	assert(l_io_get_stats(io, &wstats));
+	assert(!wstats.dispatches);
+
+	assert(l_main_set_stats_enabled(false, false));
+	assert(!l_main_get_stats(&stats));
+
+	l_io_destroy(io);
+	assert(l_main_exit());
+}
+
+static bool edge_read_cb(struct l_io *io, void *user_data)
+{
+	unsigned int *calls = user_data;
+
+	/* Deliberately leave the eventfd readable */
+	*calls += 1;
+
+	return true;
+}
+
+static void test_edge_triggered(const void *test_data)
+{
+	struct l_io *io;
+	uint64_t one = 1;
+	unsigned int calls = 0;
+
+	assert(l_main_init());
+
+	io = l_io_new(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+	assert(io);
+	l_io_set_close_on_destroy(io, true);
+	assert(l_io_set_edge_triggered(io, true));
+	assert(l_io_set_read_handler(io, edge_read_cb, &calls, NULL));
+
+	assert(write(l_io_get_fd(io), &one, sizeof(one)) == sizeof(one));
+	l_main_iterate(0);
+	assert(calls == 1);
+
+	/* Without a new edge the handler is not called again */
+	l_main_iterate(0);
+	assert(calls == 1);
+
+	/* Installing a handler picks up pending readiness */
+	assert(l_io_set_read_handler(io, edge_read_cb, &calls, NULL));
+	l_main_iterate(0);
+	assert(calls == 2);
+
+	/* Back to level-triggered, the handler runs on every iteration */
+	assert(l_io_set_edge_triggered(io, false));
+	l_main_iterate(0);
+	l_main_iterate(0);
+	assert(calls == 4);
+
+	assert(l_io_set_exclusive(io, true));
+	l_main_iterate(0);
+	assert(calls == 5);
+
+	assert(l_io_set_read_handler(io, NULL, NULL, NULL));
+	l_main_iterate(0);
+	assert(calls == 5);
+
+	l_io_destroy(io);
+	assert(l_main_exit());
+}
+
+#define N_SPARSE 4
+
+static bool sparse_read_cb(struct l_io *io, void *user_data)
+{
+	unsigned int *calls = user_data;
+	uint64_t count;
+
+	assert(read(l_io_get_fd(io), &count, sizeof(count)) == sizeof(count));
+	*calls += 1;
+
+	return true;
+}
+
+static void test_sparse_fds(const void *test_data)
+{
+	static const int fds[N_SPARSE] = { 200, 600, 601, 1000 };
+	struct l_io *io[N_SPARSE];
+	uint64_t one = 1;
+	unsigned int calls = 0;
+	unsigned int i;
+
+	assert(l_main_init());
+
+	/* Watches on high, sparse descriptors */
+	for (i = 0; i < N_SPARSE; i++) {
+		int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		int high;
+
+		assert(fd >= 0);
+		high = fcntl(fd, F_DUPFD_CLOEXEC, fds[i]);
+		assert(high >= fds[i]);
+		close(fd);
+
+		io[i] = l_io_new(high);
+		assert(io[i]);
+		l_io_set_close_on_destroy(io[i], true);
+		assert(l_io_set_read_handler(io[i], sparse_read_cb,
+							&calls, NULL));
+	}
+
+	assert(write(l_io_get_fd(io[2]), &one, sizeof(one)) == sizeof(one));
+	l_main_iterate(0);
+	assert(calls == 1);
+
+	l_io_destroy(io[1]);
+	l_io_destroy(io[2]);
+
+	/* The page holding 600 and 601 is gone, neighbours are not */
+	assert(write(l_io_get_fd(io[0]), &one, sizeof(one)) == sizeof(one));
+	assert(write(l_io_get_fd(io[3]), &one, sizeof(one)) == sizeof(one));
+	l_main_iterate(0);
+	assert(calls == 3);
+
+	l_io_destroy(io[0]);
+	l_io_destroy(io[3]);
+
+	assert(l_main_exit());
+}
+
+#define N_READY 40
+
+static bool ready_read_cb(struct l_io *io, void *user_data)
+{
+	unsigned int *calls = user_data;
+
+	/* Leave the eventfd readable so it is reported on every iteration */
+	*calls += 1;
+
+	return true;
+}
+
+static unsigned int max_events_iterate(unsigned int *calls)
+{
+	unsigned int before = *calls;
+
+	l_main_iterate(0);
+
+	return *calls - before;
+}
+
+static void test_max_events(const void *test_data)
+{
+	struct l_io *io[N_READY];
+	uint64_t one = 1;
+	unsigned int calls = 0;
+	unsigned int i;
+
+	assert(!l_main_set_max_events(0, true));
+
+	/* Starts out with the default of 10 events and grows up to 64 */
+	assert(l_main_set_max_events(64, true));
+	assert(l_main_init());
+	assert(l_main_get_saturated_iterations() == 0);
+
+	for (i = 0; i < N_READY; i++) {
+		io[i] = l_io_new(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+		assert(io[i]);
+		l_io_set_close_on_destroy(io[i], true);
+		assert(l_io_set_read_handler(io[i], ready_read_cb,
+							&calls, NULL));
+		assert(write(l_io_get_fd(io[i]), &one, sizeof(one)) ==
+								sizeof(one));
+	}
+
+	/* Every full array doubles the next one */
+	assert(max_events_iterate(&calls) == 10);
+	assert(l_main_get_saturated_iterations() == 1);
+	assert(max_events_iterate(&calls) == 20);
+	assert(l_main_get_saturated_iterations() == 2);
+	assert(max_events_iterate(&calls) == 40);
+	assert(l_main_get_saturated_iterations() == 3);
+
+	/* All ready descriptors fit now */
+	assert(max_events_iterate(&calls) == N_READY);
+	assert(l_main_get_saturated_iterations() == 3);
+
+	/* A fixed size applies on the next iteration and never grows */
+	assert(l_main_set_max_events(8, false));
+	assert(max_events_iterate(&calls) == 8);
+	assert(max_events_iterate(&calls) == 8);
+	assert(l_main_get_saturated_iterations() == 5);
+
+	for (i = 0; i < N_READY; i++)
+		l_io_destroy(io[i]);
+
+	assert(l_main_exit());
+	assert(l_main_get_saturated_iterations() == 0);
+
+	assert(l_main_set_max_events(10, false));
+}
+
+static void external_timeout_cb(struct l_timeout *timeout, void *user_data)
+{
+	unsigned int *calls = user_data;
+
+	*calls += 1;
+}
+
+static void external_idle_cb(void *user_data)
+{
+	unsigned int *calls = user_data;
+
+	*calls += 1;
+}
+
+static bool external_poll(int timeout)
+{
+	struct pollfd pfd = { .fd = l_main_get_epoll_fd(), .events = POLLIN };
+
+	assert(poll(&pfd, 1, timeout) >= 0);
+
+	return pfd.revents != 0;
+}
+
+static void test_external(const void *test_data)
+{
+	struct l_timeout *timeout;
+	struct l_io *io;
+	unsigned int calls = 0;
+	uint64_t deadline;
+	uint64_t start;
+	uint64_t one = 1;
+
+	assert(l_main_init());
+	assert(!l_main_get_next_deadline(&deadline));
+
+	/* Idle work is due right away */
+	assert(l_idle_oneshot(external_idle_cb, &calls, NULL));
+	assert(l_main_get_next_deadline(&deadline) && deadline == 0);
+	l_main_dispatch_ready(false);
+	assert(calls == 1);
+	assert(!l_main_get_next_deadline(&deadline));
+
+	start = l_time_now();
+	timeout = l_timeout_create_ms(5, external_timeout_cb, &calls, NULL);
+	assert(l_main_get_next_deadline(&deadline));
+	assert(deadline >= start + 5000 && deadline <= l_time_now() + 5000);
+
+	/* Nothing is due yet */
+	l_main_dispatch_ready(false);
+	assert(calls == 1);
+
+	/* Dispatched from the deadline alone, without polling the fd */
+	while (l_time_now() < deadline)
+		usleep(deadline - l_time_now());
+
+	l_main_dispatch_ready(false);
+	assert(calls == 2);
+	assert(!l_main_get_next_deadline(&deadline));
+
+	/* With io_uring the timer's completion is still queued, collect it */
+	if (uring_backend) {
+		assert(external_poll(0));
+		l_main_dispatch_ready(true);
+		assert(calls == 2);
+	}
+
+	/* The expiration was consumed, the fd does not stay readable */
+	assert(!external_poll(0));
+
+	/*
+	 * Timeouts still wake the host through the fd, once it has asked for
+	 * the deadline as it must before going to sleep
+	 */
+	l_timeout_modify_ms(timeout, 1);
+	assert(l_main_get_next_deadline(&deadline));
+	assert(external_poll(1000));
+	l_main_dispatch_ready(true);
+	assert(calls == 3);
+	l_timeout_remove(timeout);
+
+	io = l_io_new(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+	assert(io);
+	l_io_set_close_on_destroy(io, true);
+	assert(l_io_set_read_handler(io, sparse_read_cb, &calls, NULL));
+
+	/* Events are only collected when the host says the fd is ready */
+	assert(write(l_io_get_fd(io), &one, sizeof(one)) == sizeof(one));
+	l_main_dispatch_ready(false);
+	assert(calls == 3);
+	assert(!l_main_get_next_deadline(&deadline));
+	assert(external_poll(0));
+	l_main_dispatch_ready(true);
+	assert(calls == 4);
+
+	l_io_destroy(io);
+	assert(l_main_exit());
+}
+
+/*
+ * The tests run once with the epoll watch layer and once more with the
+ * io_uring one, unless the kernel doesn't let us use io_uring.
+ */
+static const struct main_loop_test {
+	const char *name;
+	const char *uring_name;
+	l_test_func_t function;
+} main_loop_tests[] = {
+	{ "main-loop/idle", "main-loop/uring/idle", test_idle },
+	{ "main-loop/threads", "main-loop/uring/threads", test_threads },
+	{ "main-loop/invoke", "main-loop/uring/invoke", test_invoke },
+	{ "main-loop/invoke_pending", "main-loop/uring/invoke_pending",
+						test_invoke_pending },
+	{ "main-loop/stats", "main-loop/uring/stats", test_stats },
+	{ "main-loop/edge_triggered", "main-loop/uring/edge_triggered",
+						test_edge_triggered },
+	{ "main-loop/sparse_fds", "main-loop/uring/sparse_fds",
+						test_sparse_fds },
+	{ "main-loop/max_events", "main-loop/uring/max_events",
+						test_max_events },
+	{ "main-loop/external", "main-loop/uring/external", test_external },
+};
+
+static bool uring_is_usable(void)
+{
+#ifdef HAVE_LINUX_IO_URING
+	struct io_uring_params params = {};
+	int fd;
+
+	fd = syscall(__NR_io_uring_setup, 1, &params);
+	if (fd < 0) {
+		assert(errno == ENOSYS || errno == EPERM);
+		return false;
+	}
+
+	close(fd);
+
+	/* The newest of the features the backend requires */
+	return params.features & IORING_FEAT_RSRC_TAGS;
+#else
+	return false;
+#endif
+}
+
+static void test_epoll(const void *test_data)
+{
+	const struct main_loop_test *test = test_data;
+
+	/* Not left to MAIN_BACKEND_AUTO which picks io_uring if enabled */
+	main_set_backend(MAIN_BACKEND_EPOLL);
+	test->function(NULL);
+	main_set_backend(MAIN_BACKEND_AUTO);
+}
+
+static void test_uring(const void *test_data)
+{
+	const struct main_loop_test *test = test_data;
+
+	/* l_main_init() fails rather than falling back to epoll */
+	main_set_backend(MAIN_BACKEND_URING);
+	uring_backend = true;
+	test->function(NULL);
+	uring_backend = false;
+	main_set_backend(MAIN_BACKEND_AUTO);
+}
+
+int main(int argc, char *argv[])
+{
+	bool uring = uring_is_usable();
+	unsigned int i;
+
+	l_test_init(&argc, &argv);
+
+	for (i = 0; i < L_ARRAY_SIZE(main_loop_tests); i++)
+		l_test_add(main_loop_tests[i].name, test_epoll,
+						&main_loop_tests[i]);
+
+	if (!uring)
+		printf("io_uring not available, skipping uring tests...\n");
+
+	for (i = 0; uring && i < L_ARRAY_SIZE(main_loop_tests); i++)
+		l_test_add(main_loop_tests[i].uring_name, test_uring,
+						&main_loop_tests[i]);
+
+	return l_test_run();
+}
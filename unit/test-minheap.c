@@ -13,6 +13,7 @@
 #include <assert.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <inttypes.h>
 
 #include <ell/ell.h>
 #include "ell/useful.h"
@@ -39,11 +40,19 @@ static const struct l_minheap_ops ops = {
 	.elem_size = sizeof(int),
 };
 
+static const struct l_minheap_ops ops4 = {
+	.less = less,
+	.swap = swap_int,
+	.elem_size = sizeof(int),
+	.arity = 4,
+};
+
 static const int test_values[] = {
 	3, 1, 2, 4, INT_MAX, INT_MIN, -4, -2, -1, -3, 0, INT_MIN, INT_MAX
 };
 
-static void verify_pop(struct l_minheap *minheap)
+static void verify_pop_ops(struct l_minheap *minheap,
+				const struct l_minheap_ops *heap_ops)
 {
 	size_t size = minheap->used;
 	int *values = minheap->data;
@@ -53,11 +62,16 @@ static void verify_pop(struct l_minheap *minheap)
 	while (size) {
 		assert(last <= values[0]);
 		last = values[0];
-		assert(l_minheap_pop(minheap, &ops, NULL));
+		assert(l_minheap_pop(minheap, heap_ops, NULL));
 		size -= 1;
 	}
 }
 
+static void verify_pop(struct l_minheap *minheap)
+{
+	verify_pop_ops(minheap, &ops);
+}
+
 static void test_minheap_init(const void *data)
 {
 	struct l_minheap minheap;
@@ -141,6 +155,174 @@ static void test_minheap_delete(const void *data)
 	}
 }
 
+static void test_minheap_delete_sift_up(const void *data)
+{
+	static const int sift_up_values[] = { 0, 10, 1, 11, 12, 2, 3 };
+	struct l_minheap minheap;
+	int *values = alloca(sizeof(sift_up_values));
+
+	memcpy(values, sift_up_values, sizeof(sift_up_values));
+
+	l_minheap_init(&minheap, values, L_ARRAY_SIZE(sift_up_values),
+			L_ARRAY_SIZE(sift_up_values), &ops);
+
+	/* The last element replaces 11 and must move above its parent 10 */
+	assert(l_minheap_delete(&minheap, 3, &ops));
+	assert(values[1] == 3);
+
+	verify_pop(&minheap);
+}
+
+static void test_minheap_4ary(const void *data)
+{
+	struct l_minheap minheap;
+	unsigned int n_items = 1024 * 1024;
+	int *values = l_malloc(sizeof(int) * n_items);
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(test_values); i++) {
+		memcpy(values, test_values, sizeof(test_values));
+		l_minheap_init(&minheap, values, L_ARRAY_SIZE(test_values),
+				L_ARRAY_SIZE(test_values), &ops4);
+		assert(l_minheap_delete(&minheap, i, &ops4));
+		verify_pop_ops(&minheap, &ops4);
+	}
+
+	l_minheap_init(&minheap, values, 0, n_items, &ops4);
+
+	for (i = 0; i < n_items; i++) {
+		unsigned int r = random();
+
+		assert(l_minheap_push(&minheap, &ops4, &r));
+	}
+
+	verify_pop_ops(&minheap, &ops4);
+	l_free(values);
+}
+
+struct timer {
+	uint64_t expiry;
+	unsigned int id;
+};
+
+L_MINHEAP_DEFINE_OPS(timer2, struct timer, expiry, 2);
+L_MINHEAP_DEFINE_OPS(timer4, struct timer, expiry, 4);
+
+static void test_radixheap(const void *data)
+{
+	unsigned int n_items = 64 * 1024;
+	struct l_radixheap *heap = l_radixheap_new();
+	uint64_t key, last = 0;
+	void *value;
+	unsigned int i;
+
+	assert(!l_radixheap_peek(heap, &key, NULL));
+	assert(!l_radixheap_pop(heap, &key, NULL));
+
+	for (i = 0; i < n_items / 2; i++) {
+		key = random() % 100000;
+		assert(l_radixheap_push(heap, key, L_UINT_TO_PTR(key)));
+	}
+
+	/* Keep adding keys no smaller than the last one taken out */
+	for (; i < n_items; i++) {
+		assert(l_radixheap_pop(heap, &key, &value));
+		assert(key >= last);
+		assert(L_PTR_TO_UINT(value) == key % 100000);
+		last = key;
+
+		key = last + random() % 100000;
+		value = L_UINT_TO_PTR(key % 100000);
+		assert(l_radixheap_push(heap, key, value));
+	}
+
+	assert(l_radixheap_length(heap) == n_items / 2);
+
+	if (last)
+		assert(!l_radixheap_push(heap, last - 1, NULL));
+
+	while (l_radixheap_pop(heap, &key, NULL)) {
+		assert(key >= last);
+		last = key;
+	}
+
+	assert(!l_radixheap_length(heap));
+	l_radixheap_free(heap);
+}
+
+#define BENCH_ITEMS (1024 * 1024)
+#define BENCH_ROUNDS 2
+
+/*
+ * Timer like workload: each round pushes the whole set with expiry times
+ * spread over the next hour and pops them all.
+ */
+static void test_minheap_bench(const void *data)
+{
+	struct timer *timers = l_new(struct timer, BENCH_ITEMS);
+	uint64_t *expiry = l_new(uint64_t, BENCH_ITEMS);
+	uint64_t start, binary = 0, quad = 0, radix_time = 0;
+	uint64_t now = 0;
+	struct l_minheap minheap;
+	struct l_radixheap *heap = l_radixheap_new();
+	struct timer t;
+	unsigned int i, round;
+
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		for (i = 0; i < BENCH_ITEMS; i++)
+			expiry[i] = now + random() % (3600ULL * L_USEC_PER_SEC);
+
+		start = l_time_now();
+		l_minheap_init(&minheap, timers, 0, BENCH_ITEMS, &timer2_ops);
+
+		for (i = 0; i < BENCH_ITEMS; i++) {
+			t.expiry = expiry[i];
+			t.id = i;
+			l_minheap_push(&minheap, &timer2_ops, &t);
+		}
+
+		while (l_minheap_pop(&minheap, &timer2_ops, &t))
+			;
+
+		binary += l_time_diff(start, l_time_now());
+
+		start = l_time_now();
+		l_minheap_init(&minheap, timers, 0, BENCH_ITEMS, &timer4_ops);
+
+		for (i = 0; i < BENCH_ITEMS; i++) {
+			t.expiry = expiry[i];
+			t.id = i;
+			l_minheap_push(&minheap, &timer4_ops, &t);
+		}
+
+		while (l_minheap_pop(&minheap, &timer4_ops, &t))
+			;
+
+		quad += l_time_diff(start, l_time_now());
+
+		start = l_time_now();
+
+		for (i = 0; i < BENCH_ITEMS; i++)
+			l_radixheap_push(heap, expiry[i], &timers[i]);
+
+		while (l_radixheap_pop(heap, &now, NULL))
+			;
+
+		radix_time += l_time_diff(start, l_time_now());
+
+		/* The next round is scheduled after the last expiry */
+		assert(t.expiry == now);
+	}
+
+	printf("%u x %u timers: binary %" PRIu64 " ms, 4-ary %" PRIu64
+		" ms, radix %" PRIu64 " ms\n", BENCH_ROUNDS, BENCH_ITEMS,
+		binary / 1000, quad / 1000, radix_time / 1000);
+
+	l_radixheap_free(heap);
+	l_free(expiry);
+	l_free(timers);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -150,6 +332,10 @@ int main(int argc, char *argv[])
 	l_test_add("minheap/push_random", test_minheap_push_random, NULL);
 	l_test_add("minheap/pop_push", test_minheap_pop_push, NULL);
 	l_test_add("minheap/delete", test_minheap_delete, NULL);
+	l_test_add("minheap/delete_sift_up", test_minheap_delete_sift_up, NULL);
+	l_test_add("minheap/4ary", test_minheap_4ary, NULL);
+	l_test_add("minheap/radixheap", test_radixheap, NULL);
+	l_test_add("minheap/bench", test_minheap_bench, NULL);
 
 	return l_test_run();
 }
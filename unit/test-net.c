@@ -11,6 +11,9 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
 
 #include <ell/ell.h>
 #include "ell/net-private.h"
@@ -130,6 +133,87 @@ static void test_net_domain_list_parse(const void *data)
 	l_strfreev(domains);
 }
 
+static void cache_ready(int error, void *user_data)
+{
+	int *result = user_data;
+
+	*result = error ?: 1;
+}
+
+static void check_interface(uint32_t ifindex)
+{
+	char *name;
+	uint8_t mac[2][6];
+	struct in_addr v4[2];
+	struct in6_addr v6[2];
+	bool has_mac, has_v4, has_v6;
+
+	has_mac = l_net_get_mac_address(ifindex, mac[0]);
+	has_v4 = l_net_get_address(ifindex, &v4[0]);
+	has_v6 = l_net_get_link_local_address(ifindex, &v6[0]);
+	name = l_net_get_name(ifindex);
+
+	l_net_set_rtnl_cache(NULL);
+
+	/* The same answers as the kernel gives through ioctls */
+	assert(l_net_get_mac_address(ifindex, mac[1]) == has_mac);
+	assert(!has_mac || !memcmp(mac[0], mac[1], 6));
+	assert(l_net_get_address(ifindex, &v4[1]) == has_v4);
+	assert(!has_v4 || v4[0].s_addr == v4[1].s_addr);
+	assert(l_net_get_link_local_address(ifindex, &v6[1]) == has_v6);
+	assert(!has_v6 || !memcmp(&v6[0], &v6[1], sizeof(v6[0])));
+
+	if (name) {
+		char *expected = l_net_get_name(ifindex);
+
+		assert(expected && !strcmp(name, expected));
+		l_free(expected);
+	} else
+		assert(!l_net_get_name(ifindex));
+
+	l_free(name);
+}
+
+static void test_net_rtnl_cache(const void *data)
+{
+	struct l_netlink *rtnl;
+	struct l_rtnl_cache *cache;
+	int ready = 0;
+	unsigned int i;
+
+	assert(l_main_init());
+
+	rtnl = l_netlink_new(NETLINK_ROUTE);
+	if (!rtnl) {
+		l_info("rtnetlink not available, skipping");
+		goto done;
+	}
+
+	cache = l_rtnl_cache_new(rtnl, cache_ready, &ready, NULL);
+	assert(cache);
+
+	for (i = 0; i < 1000 && !ready; i++)
+		l_main_iterate(10);
+
+	assert(ready == 1);
+
+	/* The loopback device and one that does not exist */
+	l_net_set_rtnl_cache(cache);
+	check_interface(1);
+	l_net_set_rtnl_cache(cache);
+	check_interface(0x7fffffff);
+
+	/* Freeing the cache makes the queries go to the kernel again */
+	l_net_set_rtnl_cache(cache);
+	l_rtnl_cache_free(cache);
+	assert(!l_net_get_name(0x7fffffff));
+
+	l_netlink_destroy(rtnl);
+
+done:
+	assert(l_main_exit());
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -141,6 +225,7 @@ int main(int argc, char *argv[])
 
 	l_test_add("net/domain_name_parse", test_net_domain_name_parse, NULL);
 	l_test_add("net/domain_list_parse", test_net_domain_list_parse, NULL);
+	l_test_add("net/rtnl_cache", test_net_rtnl_cache, NULL);
 
 	return l_test_run();
 }
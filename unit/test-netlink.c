@@ -12,10 +12,15 @@
 #include <sys/socket.h>
 #include <linux/rtnetlink.h>
 #include <net/if.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
 #include <assert.h>
 
 #include <ell/ell.h>
 
+#define CAPTURE_PATH "/tmp/ell-test-netlink.pcap"
+
 static void do_debug(const char *str, void *user_data)
 {
 	const char *prefix = user_data;
@@ -61,11 +66,71 @@ done:
 	l_main_quit();
 }
 
+static unsigned int loopback_replies;
+
+static void getlink_loopback_callback(int error, uint16_t type,
+					const void *data, uint32_t len,
+					void *user_data)
+{
+	const struct ifinfomsg *ifi = data;
+
+	assert(!error);
+	assert(type == RTM_NEWLINK);
+	assert(ifi->ifi_index == 1);
+
+	loopback_replies++;
+}
+
+static void type_stats_callback(const struct l_netlink_type_stats *stats,
+							void *user_data)
+{
+	unsigned int *getlink_requests = user_data;
+
+	if (stats->type == RTM_GETLINK)
+		*getlink_requests = stats->requests;
+}
+
 static void link_notification(uint16_t type, void const * data,
 					uint32_t len, void * user_data)
 {
 }
 
+static unsigned int dump_links;
+static bool dump_done;
+
+/* Takes a single entry per main loop iteration, like a slow consumer */
+static void dump_take(void *user_data)
+{
+	struct l_netlink_dump *dump = user_data;
+	const struct ifinfomsg *ifi;
+	uint16_t type;
+	uint32_t len;
+	int r;
+
+	r = l_netlink_dump_next(dump, &type, (const void **) &ifi, &len);
+	if (r == -EAGAIN)
+		return;
+
+	if (!r) {
+		dump_done = true;
+		return;
+	}
+
+	assert(r == 1);
+	assert(type == RTM_NEWLINK);
+	assert(len >= sizeof(*ifi));
+	assert(ifi->ifi_index > 0);
+
+	dump_links++;
+
+	assert(l_idle_oneshot(dump_take, dump, NULL));
+}
+
+static void dump_ready(struct l_netlink_dump *dump, void *user_data)
+{
+	assert(l_idle_oneshot(dump_take, dump, NULL));
+}
+
 int main(int argc, char *argv[])
 {
 	struct l_netlink *netlink;
@@ -73,7 +138,13 @@ int main(int argc, char *argv[])
 	struct l_netlink_message *nlm =
 			l_netlink_message_new_sized(RTM_GETLINK,
 							NLM_F_DUMP, sizeof(ifi));
+	struct l_netlink_stats stats;
+	struct l_netlink_dump *dump;
+	struct stat st;
 	unsigned int link_id;
+	unsigned int getlink_requests = 0;
+	uint64_t replies = 0;
+	unsigned int i;
 
 	if (!l_main_init())
 		return -1;
@@ -84,6 +155,24 @@ int main(int argc, char *argv[])
 
 	l_netlink_set_debug(netlink, do_debug, "[NETLINK] ", NULL);
 
+	assert(l_netlink_set_rcvbuf(netlink, 1024 * 1024));
+	assert(l_netlink_set_stats(netlink, true));
+	assert(l_netlink_set_capture(netlink, CAPTURE_PATH));
+
+	/* These go out in one datagram together with the dump below */
+	for (i = 0; i < 4; i++) {
+		struct l_netlink_message *get =
+				l_netlink_message_new_sized(RTM_GETLINK, 0,
+								sizeof(ifi));
+
+		memset(&ifi, 0, sizeof(ifi));
+		ifi.ifi_index = 1;
+		l_netlink_message_add_header(get, &ifi, sizeof(ifi));
+
+		assert(l_netlink_send(netlink, get, getlink_loopback_callback,
+								NULL, NULL));
+	}
+
 	memset(&ifi, 0, sizeof(ifi));
 	l_netlink_message_add_header(nlm, &ifi, sizeof(ifi));
 
@@ -92,10 +181,58 @@ int main(int argc, char *argv[])
 	link_id = l_netlink_register(netlink, RTNLGRP_LINK,
 					link_notification, NULL, NULL);
 
+	/* Link notifications get a socket of their own, the rest share one */
+	assert(l_netlink_set_notify_socket(netlink, RTNLGRP_LINK, 256 * 1024));
+	assert(!l_netlink_set_notify_socket(netlink, RTNLGRP_LINK, 0));
+	assert(l_netlink_set_notify_socket(netlink, 0, 0));
+
 	l_main_run();
 
+	assert(loopback_replies == 4);
+
+	/*
+	 * Four single link requests and the dump, which ends the loop on
+	 * its first reply and so may still be running
+	 */
+	assert(l_netlink_get_stats(netlink, &stats));
+	assert(stats.requests == 5);
+	assert(stats.errors == 0);
+	assert(stats.dump_messages > 0);
+	assert(stats.queue_depth_max == 5);
+
+	for (i = 0; i < L_NETLINK_LATENCY_BUCKETS; i++)
+		replies += stats.latency[i];
+
+	assert(replies >= 4);
+
+	assert(l_netlink_foreach_type_stats(netlink, type_stats_callback,
+							&getlink_requests));
+	assert(getlink_requests == 5);
+
+	/* The file header and at least one record each way */
+	assert(l_netlink_set_capture(netlink, NULL));
+	assert(stat(CAPTURE_PATH, &st) == 0);
+	assert(st.st_size > 24 + 2 * 32);
+	unlink(CAPTURE_PATH);
+
 	assert(l_netlink_unregister(netlink, link_id));
 
+	/* A queue of one stops reading after every datagram */
+	nlm = l_netlink_message_new_sized(RTM_GETLINK, NLM_F_DUMP, sizeof(ifi));
+	memset(&ifi, 0, sizeof(ifi));
+	l_netlink_message_add_header(nlm, &ifi, sizeof(ifi));
+
+	dump = l_netlink_dump_new(netlink, nlm, 1, dump_ready, NULL, NULL);
+	assert(dump);
+
+	/* The first dump may still be quitting the main loop, iterate */
+	while (!dump_done)
+		l_main_iterate(-1);
+
+	assert(dump_links > 0);
+	assert(l_netlink_dump_next(dump, NULL, NULL, NULL) == 0);
+	l_netlink_dump_free(dump);
+
 	l_netlink_destroy(netlink);
 
 	l_main_exit();
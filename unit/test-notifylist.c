@@ -191,6 +191,128 @@ static void test_notify_and_free(const void *test_data)
 	assert(notify3_flags == DESTROYED);
 }
 
+struct order_entry {
+	struct l_notifylist_entry super;
+	unsigned int tag;
+};
+
+static unsigned int order[16];
+static unsigned int n_order;
+
+static void order_notify(const struct l_notifylist_entry *e,
+						int type, va_list args)
+{
+	const struct order_entry *oe =
+		l_container_of(e, struct order_entry, super);
+
+	order[n_order++] = oe->tag;
+
+	/* Entries added from a callback wait for the next notification */
+	if (oe->tag == 1 && va_arg(args, int)) {
+		struct order_entry *new = l_new(struct order_entry, 1);
+
+		new->tag = 9;
+		l_notifylist_add(list, &new->super);
+	}
+}
+
+static void order_free_entry(struct l_notifylist_entry *e)
+{
+	l_free(l_container_of(e, struct order_entry, super));
+}
+
+static struct l_notifylist_ops order_ops = {
+	.free_entry = order_free_entry,
+	.notify = order_notify,
+};
+
+static uint32_t add_order_entry(int type, unsigned int tag)
+{
+	struct order_entry *oe = l_new(struct order_entry, 1);
+
+	oe->tag = tag;
+
+	if (type < 0)
+		return l_notifylist_add(list, &oe->super);
+
+	return l_notifylist_add_keyed(list, type, &oe->super);
+}
+
+static void test_keyed(const void *test_data)
+{
+	list = l_notifylist_new(&order_ops);
+
+	add_order_entry(-1, 1);
+	add_order_entry(1, 2);
+	add_order_entry(2, 3);
+	add_order_entry(-1, 4);
+	assert(l_notifylist_remove(list, add_order_entry(1, 5)));
+	add_order_entry(1, 6);
+
+	n_order = 0;
+	l_notifylist_notify(list, 1, 1);
+	assert(n_order == 4);
+	assert(order[0] == 1 && order[1] == 2 && order[2] == 4 &&
+							order[3] == 6);
+
+	n_order = 0;
+	l_notifylist_notify(list, 2, 0);
+	assert(n_order == 4);
+	assert(order[0] == 1 && order[1] == 3 && order[2] == 4 &&
+							order[3] == 9);
+
+	n_order = 0;
+	l_notifylist_notify(list, 3, 0);
+	assert(n_order == 3);
+	assert(order[0] == 1 && order[1] == 4 && order[2] == 9);
+
+	l_notifylist_free(list);
+}
+
+static void count_notify(const struct l_notifylist_entry *e,
+						int type, va_list args)
+{
+	n_order++;
+}
+
+static struct l_notifylist_ops count_ops = {
+	.free_entry = simple_free_entry,
+	.notify = count_notify,
+};
+
+static uint32_t add_simple_entry(void)
+{
+	struct simple_watch_entry *swe = l_new(struct simple_watch_entry, 1);
+
+	return l_notifylist_add(list, &swe->super);
+}
+
+static void test_many_removals(const void *test_data)
+{
+	uint32_t ids[1000];
+	unsigned int i;
+
+	list = l_notifylist_new(&count_ops);
+
+	for (i = 0; i < L_ARRAY_SIZE(ids); i++)
+		ids[i] = add_simple_entry();
+
+	for (i = 0; i < L_ARRAY_SIZE(ids); i += 2)
+		assert(l_notifylist_remove(list, ids[i]));
+
+	for (i = 0; i < L_ARRAY_SIZE(ids); i++)
+		assert(l_notifylist_remove(list, ids[i]) == (i & 1));
+
+	assert(!l_notifylist_remove(list, 0));
+	assert(add_simple_entry());
+
+	n_order = 0;
+	l_notifylist_notify(list, 0);
+	assert(n_order == 1);
+
+	l_notifylist_free(list);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -201,6 +323,8 @@ int main(int argc, char *argv[])
 	l_test_add("notifylist/notify_and_remove_other",
 			test_notify_and_remove_other, NULL);
 	l_test_add("notifylist/notify_and_free", test_notify_and_free, NULL);
+	l_test_add("notifylist/keyed", test_keyed, NULL);
+	l_test_add("notifylist/many_removals", test_many_removals, NULL);
 
 	return l_test_run();
 }
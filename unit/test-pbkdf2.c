@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <inttypes.h>
 #include <ell/ell.h>
 
 struct pbkdf2_data {
@@ -140,6 +141,73 @@ static const struct pbkdf2_data athena_test_vector_7 = {
 	.key		= "6b9cf26d45455a43a5b8bb276a403b39",
 };
 
+/* RFC 7914 Section 11 */
+static const struct pbkdf2_data pbkdf2_sha256_test_vector_1 = {
+	.password	= "passwd",
+	.salt		= "salt",
+	.count		= 1,
+	.key		= "55ac046e56e3089fec1691c22544b605"
+			  "f94185216dde0465e68b9d57c20dacbc"
+			  "49ca9cccf179b645991664b39d77ef31"
+			  "7c71b845b1e30bd509112041d3a19783",
+};
+
+static const struct pbkdf2_data pbkdf2_sha256_test_vector_2 = {
+	.password	= "Password",
+	.salt		= "NaCl",
+	.count		= 80000,
+	.key		= "4ddcd8f60b98be21830cee5ef22701f9"
+			  "641a4418d04c0414aeff08876b34ab56"
+			  "a1d425a1225833549adb841b51c9b317"
+			  "6a272bdebba1d078478f62b397f33c8d",
+};
+
+static void pbkdf2_sha256_test(const void *data)
+{
+	const struct pbkdf2_data *test = data;
+	size_t key_len = strlen(test->key) / 2;
+	unsigned char output[64];
+	char *key;
+
+	assert(l_checksum_pbkdf2(L_CHECKSUM_SHA256, test->password,
+					strlen(test->password),
+					test->salt, strlen(test->salt),
+					test->count, output, key_len));
+
+	key = l_util_hexstring(output, key_len);
+	assert(strcmp(test->key, key) == 0);
+	l_free(key);
+}
+
+/* WPA-PSK PMK derivation, IEEE 802.11-2020 Annex J.4 */
+static void pbkdf2_benchmark(const void *data)
+{
+	static const uint8_t expected[32] = {
+		0xf4, 0x2c, 0x6f, 0xc5, 0x2d, 0xf0, 0xeb, 0xef,
+		0x9e, 0xbb, 0x4b, 0x90, 0xb3, 0x8a, 0x5f, 0x90,
+		0x2e, 0x83, 0xfe, 0x1b, 0x13, 0x5a, 0x70, 0xe2,
+		0x3a, 0xed, 0x76, 0x2e, 0x97, 0x10, 0xa1, 0x2e,
+	};
+	unsigned int n = 50;
+	uint8_t pmk[32];
+	uint64_t start;
+	uint64_t elapsed;
+	unsigned int i;
+
+	start = l_time_now();
+
+	for (i = 0; i < n; i++)
+		assert(l_cert_pkcs5_pbkdf2(L_CHECKSUM_SHA1, "password",
+						(const uint8_t *) "IEEE", 4,
+						4096, pmk, sizeof(pmk)));
+
+	elapsed = l_time_diff(start, l_time_now());
+	assert(!memcmp(pmk, expected, sizeof(pmk)));
+
+	printf("%u PMKs in %" PRIu64 " us, %" PRIu64 " us each\n",
+			n, elapsed, elapsed / n);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -175,6 +243,17 @@ int main(int argc, char *argv[])
 	l_test_add("/pbkdf2-sha1/ATHENA Test vector 7",
 					pbkdf2_test, &athena_test_vector_7);
 
+	l_test_add("/pbkdf2-sha1/WPA-PSK benchmark", pbkdf2_benchmark, NULL);
+
+	if (l_checksum_is_supported(L_CHECKSUM_SHA256, true)) {
+		l_test_add("/pbkdf2-sha256/RFC 7914 Test vector 1",
+						pbkdf2_sha256_test,
+						&pbkdf2_sha256_test_vector_1);
+		l_test_add("/pbkdf2-sha256/RFC 7914 Test vector 2",
+						pbkdf2_sha256_test,
+						&pbkdf2_sha256_test_vector_2);
+	}
+
 done:
 	return l_test_run();
 }
@@ -10,6 +10,7 @@
 #endif
 
 #include <assert.h>
+#include <errno.h>
 
 #include <ell/ell.h>
 
@@ -161,6 +162,56 @@ static void test_chain_from_data(const void *data)
 	l_queue_destroy(twocas, destroy_cert);
 }
 
+static void test_certificate_iter(const void *data)
+{
+	const struct pem_from_data_test *test = data;
+	struct l_pem_certificate_iter *iter;
+	struct l_queue *list;
+	const struct l_queue_entry *entry;
+	struct l_cert *cert;
+	char *bad;
+
+	list = l_pem_load_certificate_list_from_data(test->list,
+							strlen(test->list));
+	assert(list);
+	assert(l_queue_length(list) == 2);
+
+	iter = l_pem_certificate_iter_new_from_data(test->list,
+							strlen(test->list));
+	assert(iter);
+
+	for (entry = l_queue_get_entries(list); entry; entry = entry->next) {
+		const uint8_t *der1, *der2;
+		size_t der1_len, der2_len;
+
+		assert(l_pem_certificate_iter_next(iter, &cert) == 0);
+
+		der1 = l_cert_get_der_data(entry->data, &der1_len);
+		der2 = l_cert_get_der_data(cert, &der2_len);
+		assert(der1_len == der2_len);
+		assert(!memcmp(der1, der2, der1_len));
+		l_cert_free(cert);
+	}
+
+	assert(l_pem_certificate_iter_next(iter, &cert) == -ENOENT);
+	l_pem_certificate_iter_free(iter);
+	l_queue_destroy(list, destroy_cert);
+
+	/* A block that is not a certificate ends the iteration */
+	bad = l_strdup_printf("%s-----BEGIN PUBLIC KEY-----\n"
+				"-----END PUBLIC KEY-----\n%s",
+				test->ca, test->ca);
+	iter = l_pem_certificate_iter_new_from_data(bad, strlen(bad));
+	assert(l_pem_certificate_iter_next(iter, &cert) == 0);
+	l_cert_free(cert);
+	assert(l_pem_certificate_iter_next(iter, &cert) == -EBADMSG);
+	assert(l_pem_certificate_iter_next(iter, &cert) == -ENOENT);
+	l_pem_certificate_iter_free(iter);
+
+	assert(!l_pem_load_certificate_list_from_data(bad, strlen(bad)));
+	l_free(bad);
+}
+
 static void test_priv_key_from_data(const void *data)
 {
 	bool is_encrypted = false;
@@ -382,6 +433,26 @@ static void test_load_file(const void *data)
 		l_key_free(privkey);
 }
 
+static void test_load_file_partial(const void *data)
+{
+	const char *path = data;
+	struct l_certchain *certchain;
+	struct l_key *privkey;
+	bool encrypted;
+
+	assert(l_cert_load_container_file(path, "abc", &certchain, NULL,
+						&encrypted));
+	assert(encrypted);
+	assert(certchain);
+	l_certchain_free(certchain);
+
+	assert(l_cert_load_container_file(path, "abc", NULL, &privkey,
+						&encrypted));
+	assert(encrypted);
+	assert(privkey);
+	l_key_free(privkey);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -394,6 +465,8 @@ int main(int argc, char *argv[])
 	l_test_add("pem/empty label", test_pem, &empty_label);
 	l_test_add("pem/cert chain from data", test_chain_from_data,
 			&single_line_cert_chain);
+	l_test_add("pem/certificate iter", test_certificate_iter,
+			&single_line_cert_chain);
 	l_test_add("pem/private key from data", test_priv_key_from_data, NULL);
 
 	if (!l_checksum_is_supported(L_CHECKSUM_MD5, false) ||
@@ -503,6 +576,9 @@ int main(int argc, char *argv[])
 			test_load_file,
 			TEST_LOAD_PARAMS("cert-entity-pkcs12-pkcs5-sha512.p12",
 						true, true, true, true));
+	l_test_add("pkcs#12/Certificates or private key only",
+			test_load_file_partial,
+			CERTDIR "cert-entity-pkcs12-rc2-sha1.p12");
 
 done:
 	return l_test_run();
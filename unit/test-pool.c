@@ -0,0 +1,98 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ell/ell.h>
+
+struct test_object {
+	uint64_t id;
+	char name[20];
+};
+
+static void test_alloc_free(const void *data)
+{
+	struct l_pool *pool;
+	struct test_object *objects[1000];
+	struct test_object *reused;
+	unsigned int i;
+
+	pool = l_pool_new(sizeof(struct test_object));
+	assert(pool);
+
+	for (i = 0; i < L_ARRAY_SIZE(objects); i++) {
+		objects[i] = l_pool_alloc(pool);
+		assert(objects[i]);
+		assert(!objects[i]->id && !objects[i]->name[0]);
+		assert(((uintptr_t) objects[i] & (sizeof(uint64_t) - 1)) == 0);
+
+		objects[i]->id = i;
+		memset(objects[i]->name, 'x', sizeof(objects[i]->name));
+	}
+
+	for (i = 0; i < L_ARRAY_SIZE(objects); i++)
+		assert(objects[i]->id == i);
+
+	/* Freed objects are handed out again, zeroed */
+	l_pool_free(pool, objects[500]);
+	reused = l_pool_alloc(pool);
+	assert(reused == objects[500]);
+	assert(!reused->id && !reused->name[0]);
+
+	for (i = 0; i < L_ARRAY_SIZE(objects); i += 2)
+		l_pool_free(pool, objects[i]);
+
+	for (i = 1; i < L_ARRAY_SIZE(objects); i += 2)
+		assert(objects[i]->id == i);
+
+	l_pool_destroy(pool);
+}
+
+static void test_small_large(const void *data)
+{
+	struct l_pool *pool;
+	void *a, *b;
+
+	/* Objects smaller than a pointer still get room for the free list */
+	pool = l_pool_new(1);
+	a = l_pool_alloc(pool);
+	b = l_pool_alloc(pool);
+	assert(a && b && a != b);
+	l_pool_free(pool, a);
+	l_pool_free(pool, b);
+	assert(l_pool_alloc(pool) == b);
+	l_pool_destroy(pool);
+
+	/* Objects larger than a slab */
+	pool = l_pool_new(10000);
+	a = l_pool_alloc(pool);
+	b = l_pool_alloc(pool);
+	assert(a && b);
+	memset(a, 0xff, 10000);
+	memset(b, 0xff, 10000);
+	l_pool_destroy(pool);
+
+	assert(!l_pool_alloc(NULL));
+	l_pool_free(NULL, NULL);
+	l_pool_destroy(NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Pool alloc and free", test_alloc_free, NULL);
+	l_test_add("Pool object sizes", test_small_large, NULL);
+
+	return l_test_run();
+}
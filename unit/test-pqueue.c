@@ -0,0 +1,145 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+
+#include <ell/ell.h>
+
+struct job {
+	unsigned int priority;
+	struct l_pqueue_node node;
+};
+
+static bool job_less(const struct job *a, const struct job *b)
+{
+	return a->priority < b->priority;
+}
+
+static bool job_node_less(const struct l_pqueue_node *a,
+				const struct l_pqueue_node *b)
+{
+	return job_less(l_container_of(a, struct job, node),
+			l_container_of(b, struct job, node));
+}
+
+L_PQUEUE_DEFINE(job_queue, struct job, node, job_less)
+
+#define N_JOBS 256
+
+static void jobs_init(struct job *jobs)
+{
+	unsigned int i;
+
+	for (i = 0; i < N_JOBS; i++) {
+		jobs[i].priority = (i * 97) % N_JOBS;
+		jobs[i].node.index = 0;
+	}
+}
+
+static void test_generic(const void *data)
+{
+	struct job jobs[N_JOBS];
+	struct l_pqueue *pqueue;
+	struct l_pqueue_node *node;
+	unsigned int prev = 0;
+	unsigned int i;
+
+	jobs_init(jobs);
+
+	pqueue = l_pqueue_new(job_node_less);
+	assert(pqueue);
+	assert(!l_pqueue_peek(pqueue));
+	assert(!l_pqueue_pop(pqueue));
+
+	for (i = 0; i < N_JOBS; i++)
+		assert(l_pqueue_push(pqueue, &jobs[i].node));
+
+	assert(!l_pqueue_push(pqueue, &jobs[0].node));
+	assert(l_pqueue_length(pqueue) == N_JOBS);
+
+	/* Decrease one key to the front, increase another to the back */
+	jobs[101].priority = 0;
+	assert(l_pqueue_update(pqueue, &jobs[101].node));
+	jobs[0].priority = N_JOBS * 2;
+	assert(l_pqueue_update(pqueue, &jobs[0].node));
+
+	/* Remove every third job through its handle */
+	for (i = 1; i < N_JOBS; i += 3) {
+		assert(l_pqueue_remove(pqueue, &jobs[i].node));
+		assert(!l_pqueue_node_is_queued(&jobs[i].node));
+		assert(!l_pqueue_remove(pqueue, &jobs[i].node));
+	}
+
+	node = l_pqueue_peek(pqueue);
+	assert(node == &jobs[101].node);
+
+	while ((node = l_pqueue_pop(pqueue))) {
+		struct job *job = l_container_of(node, struct job, node);
+
+		assert(job->priority >= prev);
+		assert(!l_pqueue_node_is_queued(node));
+		prev = job->priority;
+	}
+
+	assert(prev == N_JOBS * 2);
+	assert(!l_pqueue_length(pqueue));
+
+	l_pqueue_free(pqueue);
+}
+
+static void test_typed(const void *data)
+{
+	struct job jobs[N_JOBS];
+	struct l_pqueue *pqueue;
+	struct job *job;
+	unsigned int count = 0;
+	unsigned int prev = 0;
+	unsigned int i;
+
+	jobs_init(jobs);
+
+	pqueue = job_queue_new();
+	assert(pqueue);
+	l_pqueue_reserve(pqueue, N_JOBS);
+
+	for (i = 0; i < N_JOBS; i++)
+		assert(job_queue_push(pqueue, &jobs[i]));
+
+	jobs[5].priority = N_JOBS * 2;
+	assert(job_queue_update(pqueue, &jobs[5]));
+	assert(job_queue_remove(pqueue, &jobs[0]));
+
+	while ((job = job_queue_pop(pqueue))) {
+		assert(job->priority >= prev);
+		prev = job->priority;
+		count++;
+	}
+
+	assert(count == N_JOBS - 1);
+	assert(prev == N_JOBS * 2);
+
+	/* Queued nodes are released when the queue is freed */
+	assert(job_queue_push(pqueue, &jobs[1]));
+	assert(l_pqueue_peek(pqueue) == &jobs[1].node);
+	assert(job_queue_peek(pqueue) == &jobs[1]);
+	l_pqueue_free(pqueue);
+	assert(!l_pqueue_node_is_queued(&jobs[1].node));
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Priority queue", test_generic, NULL);
+	l_test_add("Typed priority queue", test_typed, NULL);
+
+	return l_test_run();
+}
@@ -11,6 +11,8 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include <ell/ell.h>
 
@@ -33,6 +35,52 @@ static void test_random(const void *data)
 	assert(memcmp(buf1, buf2, 128));
 }
 
+static void test_random_buffered(const void *data)
+{
+	uint8_t buf1[128];
+	uint8_t buf2[128];
+	uint8_t zero[128] = {};
+	uint8_t *big;
+	int fds[2];
+	pid_t pid;
+	int status;
+
+	assert(l_getrandom_buffered(buf1, 128));
+	assert(l_getrandom_buffered(buf2, 128));
+	assert(memcmp(buf1, buf2, 128));
+	assert(memcmp(buf1, zero, 128));
+
+	/* Larger than the output buffer, crossing several refills */
+	big = l_malloc(10000);
+	memset(big, 0, 10000);
+	assert(l_getrandom_buffered(big, 10000));
+	assert(memcmp(big + 10000 - 128, zero, 128));
+	assert(memcmp(big, big + 5000, 128));
+	l_free(big);
+
+	/* A child must not repeat what the parent gets next */
+	assert(!pipe(fds));
+	pid = fork();
+	assert(pid >= 0);
+
+	if (pid == 0) {
+		l_getrandom_buffered(buf2, 128);
+		_exit(write(fds[1], buf2, 128) == 128 ? 0 : 1);
+	}
+
+	assert(l_getrandom_buffered(buf1, 128));
+	assert(read(fds[0], buf2, 128) == 128);
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	assert(memcmp(buf1, buf2, 128));
+
+	close(fds[0]);
+	close(fds[1]);
+
+	assert(l_getrandom_buffered_uint32() != l_getrandom_buffered_uint32() ||
+		l_getrandom_buffered_uint32() != l_getrandom_buffered_uint32());
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -43,6 +91,7 @@ int main(int argc, char *argv[])
 	}
 
 	l_test_add("l_getrandom sanity check", test_random, NULL);
+	l_test_add("l_getrandom_buffered", test_random_buffered, NULL);
 
 done:
 	return l_test_run();
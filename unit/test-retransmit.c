@@ -0,0 +1,117 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+
+#include <ell/ell.h>
+#include "ell/retransmit-private.h"
+
+#define N_CLIENTS 64
+
+struct pacing_data {
+	struct retransmit *rts[N_CLIENTS];
+	uint64_t fired_at[N_CLIENTS];
+	unsigned int fired;
+};
+
+static void pacing_cb(struct retransmit *rt, void *user_data)
+{
+	struct pacing_data *data = user_data;
+	unsigned int i;
+
+	for (i = 0; i < N_CLIENTS; i++)
+		if (data->rts[i] == rt)
+			break;
+
+	assert(i < N_CLIENTS);
+	assert(!data->fired_at[i]);
+	assert(!_retransmit_is_pending(rt));
+
+	data->fired_at[i] = l_time_now();
+	data->fired += 1;
+
+	/* The last one is cancelled */
+	if (data->fired == N_CLIENTS - 1)
+		l_main_quit();
+}
+
+static void test_pacing(const void *test_data)
+{
+	struct pacing_data data = {};
+	uint64_t first = UINT64_MAX;
+	uint64_t last = 0;
+	unsigned int i;
+
+	assert(l_main_init());
+
+	/* All clients want to retransmit at the same time */
+	for (i = 0; i < N_CLIENTS; i++) {
+		data.rts[i] = _retransmit_new(pacing_cb, &data);
+		_retransmit_schedule_ms(data.rts[i], 5);
+		assert(_retransmit_is_pending(data.rts[i]));
+	}
+
+	_retransmit_cancel(data.rts[N_CLIENTS - 1]);
+	assert(!_retransmit_is_pending(data.rts[N_CLIENTS - 1]));
+
+	l_main_run();
+
+	assert(data.fired == N_CLIENTS - 1);
+	assert(!data.fired_at[N_CLIENTS - 1]);
+
+	for (i = 0; i < N_CLIENTS - 1; i++) {
+		if (data.fired_at[i] < first)
+			first = data.fired_at[i];
+
+		if (data.fired_at[i] > last)
+			last = data.fired_at[i];
+	}
+
+	/* 63 sends at up to 16 per 10 ms slot need at least 4 slots */
+	assert(l_time_diff(first, last) >= 30 * L_USEC_PER_MSEC);
+
+	for (i = 0; i < N_CLIENTS; i++)
+		_retransmit_free(data.rts[i]);
+
+	assert(l_main_exit());
+}
+
+static void test_backoff(const void *test_data)
+{
+	uint64_t rt;
+	unsigned int i;
+
+	/* IRT + RAND*IRT */
+	rt = _retransmit_backoff_ms(0, 1000, 0);
+	assert(rt >= 900 && rt <= 1100);
+
+	/* 2*RTprev + RAND*RTprev */
+	rt = _retransmit_backoff_ms(1000, 1000, 0);
+	assert(rt >= 1900 && rt <= 2100);
+
+	/* MRT + RAND*MRT */
+	for (i = 0, rt = 0; i < 20; i++) {
+		rt = _retransmit_backoff_ms(rt, 1000, 30000);
+		assert(rt <= 33000);
+	}
+
+	assert(rt >= 27000);
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("pacing", test_pacing, NULL);
+	l_test_add("backoff", test_backoff, NULL);
+
+	return l_test_run();
+}
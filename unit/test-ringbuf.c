@@ -201,6 +201,129 @@ static void test_append2(const void *unused)
 	l_ringbuf_free(rb);
 }
 
+static void trace_count(const void *buf, size_t count, void *user_data)
+{
+	size_t *traced = user_data;
+
+	*traced += count;
+}
+
+static void test_reserve(const void *unused)
+{
+	static const uint8_t data[10] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+	struct l_ringbuf *rb;
+	size_t traced = 0;
+	size_t len_no_wrap;
+	uint8_t *ptr;
+
+	rb = l_ringbuf_new(16);
+	assert(rb != NULL);
+	assert(l_ringbuf_set_input_tracing(rb, trace_count, &traced));
+
+	ptr = l_ringbuf_reserve(rb, &len_no_wrap);
+	assert(ptr != NULL);
+	assert(len_no_wrap == 16);
+
+	memcpy(ptr, data, 10);
+	assert(l_ringbuf_commit(rb, 10) == 10);
+	assert(l_ringbuf_len(rb) == 10);
+	assert(traced == 10);
+
+	l_ringbuf_drain(rb, 8);
+
+	/* Free space now wraps, only the tail end is returned */
+	ptr = l_ringbuf_reserve(rb, &len_no_wrap);
+	assert(ptr != NULL);
+	assert(len_no_wrap == 6);
+
+	/* Commit is limited to the total free space */
+	assert(l_ringbuf_commit(rb, 20) == 14);
+	assert(l_ringbuf_avail(rb) == 0);
+	assert(traced == 24);
+	assert(l_ringbuf_reserve(rb, &len_no_wrap) == NULL);
+	assert(l_ringbuf_commit(rb, 1) == 0);
+
+	l_ringbuf_free(rb);
+}
+
+static void test_append_wrapped(const void *unused)
+{
+	static const uint8_t data[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+						10, 11 };
+	struct l_ringbuf *rb;
+	size_t len_no_wrap;
+	uint8_t *ptr;
+
+	rb = l_ringbuf_new(16);
+	assert(rb != NULL);
+
+	/* Leave the unread data wrapped around the end of the buffer */
+	assert(l_ringbuf_append(rb, data, 10) == 10);
+	l_ringbuf_drain(rb, 8);
+	assert(l_ringbuf_append(rb, data, 10) == 10);
+	l_ringbuf_drain(rb, 4);
+
+	/* Only 8 bytes are free, the unread data must not be overwritten */
+	assert(l_ringbuf_append(rb, data, 12) == 8);
+	assert(l_ringbuf_append(rb, data, 12) == -1);
+
+	ptr = l_ringbuf_peek(rb, 0, &len_no_wrap);
+	assert(len_no_wrap == 4);
+	assert(!memcmp(ptr, data + 2, 4));
+
+	ptr = l_ringbuf_peek(rb, 4, &len_no_wrap);
+	assert(len_no_wrap == 12);
+	assert(!memcmp(ptr, data + 6, 4));
+	assert(!memcmp(ptr + 4, data, 8));
+
+	l_ringbuf_free(rb);
+}
+
+static void test_mirrored(const void *unused)
+{
+	static const char data[] = "0123456789abcdef";
+	struct l_ringbuf *rb;
+	size_t capacity;
+	size_t len_no_wrap;
+	char *ptr;
+
+	rb = l_ringbuf_new_mirrored(100);
+	if (!rb) {
+		l_info("mirrored mapping not supported, skipping...");
+		return;
+	}
+
+	capacity = l_ringbuf_capacity(rb);
+	assert(capacity >= 100);
+	assert(!(capacity & (capacity - 1)));
+
+	/* Move the positions close to the end of the buffer */
+	ptr = l_ringbuf_reserve(rb, &len_no_wrap);
+	assert(ptr != NULL);
+	assert(len_no_wrap == capacity);
+	assert(l_ringbuf_commit(rb, capacity - 4) == capacity - 4);
+	l_ringbuf_drain(rb, capacity - 4);
+
+	/* Free space, and later the data, is seen in a single piece */
+	ptr = l_ringbuf_reserve(rb, &len_no_wrap);
+	assert(len_no_wrap == capacity);
+	memcpy(ptr, data, 16);
+	assert(l_ringbuf_commit(rb, 16) == 16);
+
+	ptr = l_ringbuf_peek(rb, 0, &len_no_wrap);
+	assert(len_no_wrap == 16);
+	assert(!memcmp(ptr, data, 16));
+
+	ptr = l_ringbuf_peek(rb, 4, &len_no_wrap);
+	assert(len_no_wrap == 12);
+	assert(!memcmp(ptr, data + 4, 12));
+
+	assert(l_ringbuf_printf(rb, "%s", data) == 16);
+	assert(l_ringbuf_len(rb) == 32);
+
+	l_ringbuf_free(rb);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -210,6 +333,9 @@ int main(int argc, char *argv[])
 	l_test_add("/ringbuf/printf", test_printf, NULL);
 	l_test_add("/ringbuf/append", test_append, NULL);
 	l_test_add("/ringbuf/append2", test_append2, NULL);
+	l_test_add("/ringbuf/reserve", test_reserve, NULL);
+	l_test_add("/ringbuf/append-wrapped", test_append_wrapped, NULL);
+	l_test_add("/ringbuf/mirrored", test_mirrored, NULL);
 
 	return l_test_run();
 }
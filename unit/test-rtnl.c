@@ -297,6 +297,93 @@ static void test_address(const void *data)
 }
 _Pragma("GCC diagnostic pop")
 
+static const struct l_rtnl_route *route_table_lookup(
+					const struct l_rtnl_route_table *table,
+					const char *ip)
+{
+	struct in6_addr in6_addr;
+	struct in_addr in_addr;
+
+	if (inet_pton(AF_INET, ip, &in_addr) == 1)
+		return l_rtnl_route_table_lookup(table, AF_INET, &in_addr,
+									NULL);
+
+	assert(inet_pton(AF_INET6, ip, &in6_addr) == 1);
+
+	return l_rtnl_route_table_lookup(table, AF_INET6, &in6_addr, NULL);
+}
+
+static void test_route_table(const void *data)
+{
+	struct l_rtnl_route_table *table = l_rtnl_route_table_new();
+	struct l_rtnl_route *def = l_rtnl_route_new_gateway("192.168.1.1");
+	struct l_rtnl_route *net16 = l_rtnl_route_new_prefix("10.1.0.0", 16);
+	struct l_rtnl_route *net24 = l_rtnl_route_new_prefix("10.1.2.0", 24);
+	struct l_rtnl_route *net24b = l_rtnl_route_new_static("10.1.2.254",
+							"10.1.2.7", 24);
+	struct l_rtnl_route *host = l_rtnl_route_new_prefix("10.1.2.3", 32);
+	struct l_rtnl_route *net6 = l_rtnl_route_new_prefix("2001:db8::", 32);
+	struct l_rtnl_route *def6 = l_rtnl_route_new_gateway("fe80::1");
+	void *user_data;
+	struct in_addr in_addr;
+
+	assert(!route_table_lookup(table, "10.1.2.3"));
+
+	assert(l_rtnl_route_table_add(table, net24, NULL));
+	assert(l_rtnl_route_table_add(table, host, NULL));
+	assert(l_rtnl_route_table_add(table, def, L_INT_TO_PTR(42)));
+	assert(l_rtnl_route_table_add(table, net16, NULL));
+	assert(l_rtnl_route_table_add(table, net6, NULL));
+	assert(l_rtnl_route_table_get_count(table) == 5);
+
+	assert(route_table_lookup(table, "10.1.2.3") == host);
+	assert(route_table_lookup(table, "10.1.2.4") == net24);
+	assert(route_table_lookup(table, "10.1.3.4") == net16);
+	assert(route_table_lookup(table, "10.2.0.1") == def);
+	assert(route_table_lookup(table, "2001:db8::1") == net6);
+	assert(!route_table_lookup(table, "2001:db9::1"));
+
+	inet_pton(AF_INET, "8.8.8.8", &in_addr);
+	assert(l_rtnl_route_table_lookup(table, AF_INET, &in_addr,
+						&user_data) == def);
+	assert(L_PTR_TO_INT(user_data) == 42);
+
+	/* Same prefix, with host bits set, the lower priority value wins */
+	l_rtnl_route_set_priority(net24, 100);
+	l_rtnl_route_set_priority(net24b, 10);
+	assert(l_rtnl_route_table_add(table, net24b, NULL));
+	assert(route_table_lookup(table, "10.1.2.4") == net24b);
+
+	assert(l_rtnl_route_table_remove(table, net24b));
+	assert(!l_rtnl_route_table_remove(table, net24b));
+	assert(route_table_lookup(table, "10.1.2.4") == net24);
+
+	/* Removing the middle prefixes falls back to the shorter ones */
+	assert(l_rtnl_route_table_remove(table, net24));
+	assert(route_table_lookup(table, "10.1.2.4") == net16);
+	assert(route_table_lookup(table, "10.1.2.3") == host);
+	assert(l_rtnl_route_table_remove(table, net16));
+	assert(route_table_lookup(table, "10.1.2.4") == def);
+	assert(l_rtnl_route_table_remove(table, def));
+	assert(!route_table_lookup(table, "10.1.2.4"));
+	assert(route_table_lookup(table, "10.1.2.3") == host);
+
+	assert(l_rtnl_route_table_add(table, def6, NULL));
+	assert(route_table_lookup(table, "2001:db9::1") == def6);
+	assert(route_table_lookup(table, "2001:db8::1") == net6);
+	assert(l_rtnl_route_table_get_count(table) == 3);
+
+	l_rtnl_route_table_free(table);
+
+	l_rtnl_route_free(def);
+	l_rtnl_route_free(net16);
+	l_rtnl_route_free(net24);
+	l_rtnl_route_free(net24b);
+	l_rtnl_route_free(host);
+	l_rtnl_route_free(net6);
+	l_rtnl_route_free(def6);
+}
+
 static void signal_handler(uint32_t signo, void *user_data)
 {
 	switch (signo) {
@@ -310,6 +397,41 @@ static void signal_handler(uint32_t signo, void *user_data)
 
 static struct l_netlink *rtnl;
 
+static void test_link_stats_delta(const void *data)
+{
+	static const struct l_rtnl_link_stats old[] = {
+		{ .ifindex = 1, .rx_packets = 10, .tx_bytes = 1000 },
+		{ .ifindex = 2, .rx_packets = 20, .multicast = 5 },
+		{ .ifindex = 4, .rx_packets = 40 },
+	};
+	struct l_rtnl_link_stats cur[] = {
+		{ .ifindex = 1, .rx_packets = 15, .tx_bytes = 1500 },
+		{ .ifindex = 3, .rx_packets = 30 },
+		{ .ifindex = 4, .rx_packets = 4 },
+	};
+	struct l_rtnl_link_stats out[3];
+
+	memset(out, 0, sizeof(out));
+	l_rtnl_link_stats_delta(old, L_ARRAY_SIZE(old),
+					cur, L_ARRAY_SIZE(cur), out);
+	assert(out[0].ifindex == 1);
+	assert(out[0].rx_packets == 5);
+	assert(out[0].tx_bytes == 500);
+
+	/* New link, counted from zero */
+	assert(out[1].ifindex == 3);
+	assert(out[1].rx_packets == 30);
+
+	/* Counter reset */
+	assert(out[2].ifindex == 4);
+	assert(out[2].rx_packets == 4);
+
+	/* In place */
+	l_rtnl_link_stats_delta(old, L_ARRAY_SIZE(old),
+					cur, L_ARRAY_SIZE(cur), cur);
+	assert(!memcmp(cur, out, sizeof(out)));
+}
+
 struct rtnl_test {
 	const char *name;
 	void (*start)(struct l_netlink *rtnl, void *);
@@ -500,6 +622,152 @@ static void test_ifaddr6_dump(struct l_netlink *rntl, void *user_data)
 					NULL, ifaddr6_dump_destroy_cb));
 }
 
+static void route_dump_filtered_cb(int error,
+				uint16_t type, const void *data,
+				uint32_t len, void *user_data)
+{
+	const struct rtmsg *rtmsg = data;
+	uint32_t table = rtmsg->rtm_table, ifindex = 0;
+
+	test_assert(!error);
+	test_assert(type == RTM_NEWROUTE);
+	test_assert(rtmsg->rtm_family == AF_INET);
+
+	l_rtnl_route4_extract(rtmsg, len, &table, &ifindex, NULL, NULL, NULL);
+	test_assert(table == RT_TABLE_MAIN);
+}
+
+static void route_dump_filtered_destroy_cb(void *user_data)
+{
+	test_next();
+}
+
+static void test_route_dump_filtered(struct l_netlink *rtnl, void *user_data)
+{
+	test_assert(l_netlink_set_strict_check(rtnl, true));
+	test_assert(l_rtnl_route_dump(rtnl, AF_INET, RT_TABLE_MAIN, 0,
+					route_dump_filtered_cb, NULL,
+					route_dump_filtered_destroy_cb));
+}
+
+static void ifaddr_dump_filtered_cb(int error,
+				uint16_t type, const void *data,
+				uint32_t len, void *user_data)
+{
+	const struct ifaddrmsg *ifa = data;
+
+	test_assert(!error);
+	test_assert(type == RTM_NEWADDR);
+	test_assert(ifa->ifa_index == 1);
+}
+
+static void ifaddr_dump_filtered_destroy_cb(void *user_data)
+{
+	test_next();
+}
+
+static void test_ifaddr_dump_filtered(struct l_netlink *rtnl,
+							void *user_data)
+{
+	test_assert(l_rtnl_ifaddr_dump(rtnl, AF_UNSPEC, 1,
+					ifaddr_dump_filtered_cb, NULL,
+					ifaddr_dump_filtered_destroy_cb));
+}
+
+static void link_stats_dump_cb(int error,
+				const struct l_rtnl_link_stats *stats,
+				unsigned int n_stats, void *user_data)
+{
+	bool *called = user_data;
+	bool saw_loopback = false;
+	unsigned int i;
+
+	*called = true;
+
+	test_assert(!error);
+
+	for (i = 0; i < n_stats; i++) {
+		if (i)
+			test_assert(stats[i - 1].ifindex < stats[i].ifindex);
+
+		if (stats[i].ifindex == 1)
+			saw_loopback = true;
+	}
+
+	test_assert(saw_loopback);
+}
+
+static void link_stats_dump_destroy_cb(void *user_data)
+{
+	bool *called = user_data;
+
+	test_assert(*called);
+	test_next();
+}
+
+static void test_link_stats_dump(struct l_netlink *rtnl, void *user_data)
+{
+	static bool called;
+
+	called = false;
+	test_assert(l_rtnl_link_stats_dump(rtnl, link_stats_dump_cb, &called,
+						link_stats_dump_destroy_cb));
+}
+
+static struct l_rtnl_cache *cache;
+static bool cache_saw_loopback;
+
+static void cache_link_cb(enum l_rtnl_cache_event event,
+				const struct l_rtnl_link *link, void *user_data)
+{
+	if (event == L_RTNL_CACHE_EVENT_NEW && link->ifindex == 1)
+		cache_saw_loopback = true;
+}
+
+static void cache_ready_cb(int error, void *user_data)
+{
+	const struct l_rtnl_link *link;
+	const struct l_rtnl_address *addr;
+	struct in_addr in_addr;
+	uint32_t ifindex = 0;
+
+	test_assert(!error);
+	test_assert(l_rtnl_cache_is_ready(cache));
+	test_assert(cache_saw_loopback);
+
+	link = l_rtnl_cache_get_link(cache, 1);
+	test_assert(link);
+	test_assert(!strcmp(link->ifname, "lo"));
+	test_assert(l_rtnl_cache_find_link(cache, "lo") == link);
+	test_assert(!l_rtnl_cache_get_link(cache, 0));
+
+	/* Anything in 127.0.0.0/8 belongs to the loopback address */
+	if (link->flags & IFF_UP) {
+		inet_pton(AF_INET, "127.1.2.3", &in_addr);
+		addr = l_rtnl_cache_find_address(cache, AF_INET, &in_addr,
+								&ifindex);
+		test_assert(addr);
+		test_assert(ifindex == 1);
+		test_assert(l_rtnl_address_get_prefix_length(addr) == 8);
+	}
+
+	l_rtnl_cache_free(cache);
+	cache = NULL;
+
+	test_next();
+}
+
+static void test_cache(struct l_netlink *rtnl, void *user_data)
+{
+	cache_saw_loopback = false;
+
+	cache = l_rtnl_cache_new(rtnl, cache_ready_cb, NULL, NULL);
+	test_assert(cache);
+	test_assert(!l_rtnl_cache_is_ready(cache));
+	test_assert(l_rtnl_cache_add_link_watch(cache, cache_link_cb,
+							NULL, NULL));
+}
+
 static void test_run(void)
 {
 	success = false;
@@ -517,12 +785,19 @@ int main(int argc, char *argv[])
 	l_test_init(&argc, &argv);
 	l_test_add("route", test_route, NULL);
 	l_test_add("address", test_address, NULL);
+	l_test_add("route table", test_route_table, NULL);
+	l_test_add("link stats delta", test_link_stats_delta, NULL);
 	l_test_run();
 
 	test_add("Dump IPv4 routing table", test_route4_dump, NULL);
 	test_add("Dump IPv6 routing table", test_route6_dump, NULL);
 	test_add("Dump IPv4 addresses", test_ifaddr4_dump, NULL);
 	test_add("Dump IPv6 addresses", test_ifaddr6_dump, NULL);
+	test_add("Dump main IPv4 routing table", test_route_dump_filtered,
+									NULL);
+	test_add("Dump loopback addresses", test_ifaddr_dump_filtered, NULL);
+	test_add("Link, address and route cache", test_cache, NULL);
+	test_add("Dump link statistics", test_link_stats_dump, NULL);
 
 	l_log_set_stderr();
 
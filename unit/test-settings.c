@@ -12,6 +12,10 @@
 #include <assert.h>
 #include <stdio.h>
 #include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include <ell/ell.h>
 
@@ -588,6 +592,355 @@ static void test_clone(const void *data)
 	l_settings_free(settings);
 }
 
+static void test_many_groups(const void *data)
+{
+	static const char raw_data[] =
+			"[dup]\n"
+			"key=first\n"
+			"key=second\n"
+			"other=value\n"
+			"[dup]\n"
+			"key=third\n";
+	struct l_settings *settings = l_settings_new();
+	struct l_settings *copy;
+	char group[32];
+	char key[32];
+	char **groups;
+	char *out;
+	char *copy_out;
+	size_t len;
+	size_t copy_len;
+	unsigned int i;
+	unsigned int j;
+
+	assert(l_settings_load_from_data(settings, raw_data,
+						strlen(raw_data)));
+
+	/* The first of duplicate groups and keys is the one looked up */
+	assert(!strcmp(l_settings_get_value(settings, "dup", "key"), "first"));
+	assert(l_settings_remove_key(settings, "dup", "key"));
+	assert(!strcmp(l_settings_get_value(settings, "dup", "key"),
+								"second"));
+	assert(l_settings_remove_group(settings, "dup"));
+	assert(!strcmp(l_settings_get_value(settings, "dup", "key"), "third"));
+	assert(!l_settings_has_key(settings, "dup", "other"));
+	assert(l_settings_remove_group(settings, "dup"));
+	assert(!l_settings_has_group(settings, "dup"));
+
+	for (i = 0; i < 200; i++) {
+		sprintf(group, "group%u", i);
+
+		for (j = 0; j < 20; j++) {
+			sprintf(key, "key%u", j);
+			assert(l_settings_set_uint(settings, group, key,
+								i * j));
+		}
+	}
+
+	for (i = 0; i < 200; i += 2) {
+		sprintf(group, "group%u", i);
+		assert(l_settings_remove_group(settings, group));
+	}
+
+	copy = l_settings_clone(settings);
+
+	for (i = 0; i < 200; i++) {
+		sprintf(group, "group%u", i);
+		assert(l_settings_has_group(copy, group) == (i & 1));
+
+		for (j = 0; j < 20 && (i & 1); j++) {
+			unsigned int v;
+
+			sprintf(key, "key%u", j);
+			assert(l_settings_get_uint(copy, group, key, &v));
+			assert(v == i * j);
+		}
+	}
+
+	/* Clones keep the file order */
+	groups = l_settings_get_groups(copy);
+	assert(groups);
+
+	for (i = 0; groups[i]; i++) {
+		sprintf(group, "group%u", i * 2 + 1);
+		assert(!strcmp(groups[i], group));
+	}
+
+	assert(i == 100);
+	l_strfreev(groups);
+
+	out = l_settings_to_data(settings, &len);
+	copy_out = l_settings_to_data(copy, &copy_len);
+	assert(out && copy_out);
+	assert(len == copy_len && !memcmp(out, copy_out, len));
+	l_free(copy_out);
+	l_free(out);
+
+	l_settings_free(copy);
+	l_settings_free(settings);
+}
+
+static void write_file(const char *path, const char *data)
+{
+	FILE *f = fopen(path, "w");
+
+	assert(f);
+	assert(fputs(data, f) >= 0);
+	assert(!fclose(f));
+}
+
+static void reload_changed(enum l_settings_change change,
+				const char *group_name, const char *key,
+				void *user_data)
+{
+	struct l_string *changes = user_data;
+
+	l_string_append_printf(changes, "%d %s %s\n", change, group_name,
+				key ?: "-");
+}
+
+static void test_reload(const void *data)
+{
+	static const char before[] =
+			"[Kept]\n"
+			"Same=1\n"
+			"Changed=old\n"
+			"Removed=x\n"
+			"[Gone]\n"
+			"Key=value\n";
+	static const char after[] =
+			"[New]\n"
+			"Key=value\n"
+			"[Kept]\n"
+			"Added=y\n"
+			"Changed=new\n"
+			"Same=1\n";
+	char path[] = "/tmp/settings-reloadXXXXXX";
+	struct l_settings *settings = l_settings_new();
+	struct l_string *changes = l_string_new(64);
+	char *str;
+	int fd;
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+
+	write_file(path, before);
+	assert(l_settings_load_from_file(settings, path));
+
+	write_file(path, after);
+	assert(l_settings_reload(settings, path, reload_changed, changes));
+
+	str = l_string_unwrap(changes);
+	assert(!strcmp(str, "4 Kept Changed\n"
+				"3 Kept Removed\n"
+				"2 Kept Added\n"
+				"1 Gone -\n"
+				"0 New -\n"));
+	l_free(str);
+
+	assert(!l_settings_has_group(settings, "Gone"));
+	assert(!strcmp(l_settings_get_value(settings, "Kept", "Changed"),
+								"new"));
+
+	/* A file that fails to load leaves the settings as they were */
+	write_file(path, "Key=value\n");
+	assert(!l_settings_reload(settings, path, NULL, NULL));
+	assert(l_settings_has_group(settings, "New"));
+
+	unlink(path);
+	assert(!l_settings_reload(settings, path, NULL, NULL));
+	assert(l_settings_has_group(settings, "New"));
+
+	l_settings_free(settings);
+}
+
+static void set_mtime(const char *path, time_t sec)
+{
+	struct timespec times[2] = { { sec, 0 }, { sec, 0 } };
+
+	assert(!utimensat(AT_FDCWD, path, times, 0));
+}
+
+static void check_cached(struct l_settings_cache *cache, const char *path,
+				const char *expected)
+{
+	struct l_settings *settings = l_settings_cache_load(cache, path);
+	struct l_settings *parsed = l_settings_new();
+	char *data;
+	char *parsed_data;
+
+	assert(settings);
+	assert(l_settings_load_from_data(parsed, expected, strlen(expected)));
+
+	data = l_settings_to_data(settings, NULL);
+	parsed_data = l_settings_to_data(parsed, NULL);
+	assert(!strcmp(data, parsed_data));
+
+	l_free(parsed_data);
+	l_free(data);
+	l_settings_free(parsed);
+	l_settings_free(settings);
+}
+
+static void test_cache(const void *data)
+{
+	static const char first[] =
+			"[normal]\n"
+			"key=value\n"
+			"escaped=a\\nb\n"
+			"[@pem@single_cert]\n"
+			TEST_CERTIFICATE;
+	static const char second[] =
+			"[other]\n"
+			"key=1\n";
+	static const char changed[] =
+			"[other]\n"
+			"key=2\n";
+	char first_path[] = "/tmp/settings-cache-1XXXXXX";
+	char second_path[] = "/tmp/settings-cache-2XXXXXX";
+	char cache_path[] = "/tmp/settings-cacheXXXXXX";
+	struct l_settings_cache *cache;
+	int fd;
+
+	assert((fd = mkstemp(first_path)) >= 0);
+	close(fd);
+	assert((fd = mkstemp(second_path)) >= 0);
+	close(fd);
+	assert((fd = mkstemp(cache_path)) >= 0);
+	close(fd);
+
+	write_file(first_path, first);
+	write_file(second_path, second);
+	set_mtime(first_path, 1000000);
+	set_mtime(second_path, 1000000);
+
+	/* The empty file isn't a valid cache, it starts out empty */
+	cache = l_settings_cache_new(cache_path);
+	assert(cache);
+	check_cached(cache, first_path, first);
+	check_cached(cache, second_path, second);
+	assert(!l_settings_cache_load(cache, "/nonexistent/settings"));
+	assert(!l_settings_cache_write(cache));
+	l_settings_cache_free(cache);
+
+	/* Served from the cache file, the sources are no longer read */
+	write_file(first_path, second);
+	set_mtime(first_path, 1000000);
+	write_file(second_path, changed);
+	set_mtime(second_path, 2000000);
+
+	cache = l_settings_cache_new(cache_path);
+	check_cached(cache, first_path, first);
+	check_cached(cache, second_path, changed);
+	assert(!l_settings_cache_write(cache));
+	l_settings_cache_free(cache);
+
+	cache = l_settings_cache_new(cache_path);
+	check_cached(cache, second_path, changed);
+	l_settings_cache_free(cache);
+
+	/* A damaged cache is ignored */
+	write_file(cache_path, "ELLSETCH garbage");
+	cache = l_settings_cache_new(cache_path);
+	check_cached(cache, second_path, changed);
+	l_settings_cache_free(cache);
+
+	unlink(first_path);
+	unlink(second_path);
+	unlink(cache_path);
+}
+
+struct schema_profile {
+	char *name;
+	bool autoconnect;
+	int priority;
+	unsigned int retries;
+	int64_t offset;
+	uint64_t bytes;
+	double ratio;
+	char *comment;
+	int untouched;
+};
+
+static const struct l_settings_schema profile_schema[] = {
+	{ "Profile", "Name", L_SETTINGS_TYPE_STRING,
+		offsetof(struct schema_profile, name), NULL },
+	{ "Profile", "AutoConnect", L_SETTINGS_TYPE_BOOL,
+		offsetof(struct schema_profile, autoconnect), "true" },
+	{ "Profile", "Priority", L_SETTINGS_TYPE_INT,
+		offsetof(struct schema_profile, priority), "0" },
+	{ "Limits", "Retries", L_SETTINGS_TYPE_UINT,
+		offsetof(struct schema_profile, retries), "3" },
+	{ "Limits", "Offset", L_SETTINGS_TYPE_INT64,
+		offsetof(struct schema_profile, offset), NULL },
+	{ "Limits", "Bytes", L_SETTINGS_TYPE_UINT64,
+		offsetof(struct schema_profile, bytes), NULL },
+	{ "Limits", "Ratio", L_SETTINGS_TYPE_DOUBLE,
+		offsetof(struct schema_profile, ratio), "0.5" },
+	{ "Missing", "Comment", L_SETTINGS_TYPE_STRING,
+		offsetof(struct schema_profile, comment), "none\\tset" },
+	{ "Missing", "Untouched", L_SETTINGS_TYPE_INT,
+		offsetof(struct schema_profile, untouched), NULL },
+};
+
+static void test_schema(const void *data)
+{
+	static const char profile[] =
+			"[Profile]\n"
+			"Name=home\\snet\n"
+			"Priority=-5\n"
+			"[Limits]\n"
+			"Offset=-4294967296\n"
+			"Bytes=18446744073709551615\n";
+	static const char invalid[] =
+			"[Profile]\n"
+			"Name=home\n"
+			"Priority=high\n";
+	struct l_settings *settings;
+	struct schema_profile p = { .untouched = 42 };
+	struct l_arena *arena;
+
+	settings = l_settings_new();
+	assert(l_settings_load_from_data(settings, profile, strlen(profile)));
+
+	assert(l_settings_load_schema(settings, profile_schema,
+					L_ARRAY_SIZE(profile_schema), &p,
+					NULL));
+	assert(!strcmp(p.name, "home net"));
+	assert(p.autoconnect);
+	assert(p.priority == -5);
+	assert(p.retries == 3);
+	assert(p.offset == -4294967296ll);
+	assert(p.bytes == UINT64_MAX);
+	assert(p.ratio == 0.5);
+	assert(!strcmp(p.comment, "none\tset"));
+	assert(p.untouched == 42);
+	l_free(p.name);
+	l_free(p.comment);
+
+	arena = l_arena_new(0);
+	memset(&p, 0, sizeof(p));
+	assert(l_settings_load_schema(settings, profile_schema,
+					L_ARRAY_SIZE(profile_schema), &p,
+					arena));
+	assert(!strcmp(p.name, "home net"));
+	assert(!strcmp(p.comment, "none\tset"));
+	l_arena_free(arena);
+
+	l_settings_free(settings);
+
+	/* Strings stored before the failure are released */
+	settings = l_settings_new();
+	assert(l_settings_load_from_data(settings, invalid, strlen(invalid)));
+	memset(&p, 0, sizeof(p));
+	assert(!l_settings_load_schema(settings, profile_schema,
+					L_ARRAY_SIZE(profile_schema), &p,
+					NULL));
+	assert(!p.name);
+	l_settings_free(settings);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -601,6 +954,10 @@ int main(int argc, char *argv[])
 	l_test_add("Test valid ext group", test_valid_extended_group, NULL);
 	l_test_add("Test invalid ext group", test_invalid_extended_group, NULL);
 	l_test_add("Test clone", test_clone, NULL);
+	l_test_add("Test many groups", test_many_groups, NULL);
+	l_test_add("Test reload", test_reload, NULL);
+	l_test_add("Test cache", test_cache, NULL);
+	l_test_add("Test schema", test_schema, NULL);
 
 	return l_test_run();
 }
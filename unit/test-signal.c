@@ -0,0 +1,169 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <ell/ell.h>
+
+struct signal_data {
+	unsigned int n_calls;
+	struct l_signal *remove;
+};
+
+static void signal_cb(void *user_data)
+{
+	struct signal_data *data = user_data;
+
+	data->n_calls++;
+
+	if (data->remove) {
+		l_signal_remove(data->remove);
+		data->remove = NULL;
+	}
+}
+
+static void test_signal_batch(const void *test_data)
+{
+	struct signal_data usr1 = {};
+	struct signal_data usr2 = {};
+	struct signal_data usr2_other = {};
+	struct l_signal *sig1;
+	struct l_signal *sig2;
+	struct l_signal *sig2_other;
+
+	assert(l_main_init());
+
+	sig1 = l_signal_create(SIGUSR1, signal_cb, &usr1, NULL);
+	sig2 = l_signal_create(SIGUSR2, signal_cb, &usr2, NULL);
+	sig2_other = l_signal_create(SIGUSR2, signal_cb, &usr2_other, NULL);
+	assert(sig1 && sig2 && sig2_other);
+
+	/* Both pending signals are read and dispatched in one go */
+	raise(SIGUSR1);
+	raise(SIGUSR2);
+
+	while (!usr1.n_calls || !usr2.n_calls)
+		l_main_iterate(-1);
+
+	assert(usr1.n_calls == 1);
+	assert(usr2.n_calls == 1 && usr2_other.n_calls == 1);
+
+	/* Removing the other signal from a callback in the same batch */
+	usr1.remove = sig2;
+	raise(SIGUSR1);
+	raise(SIGUSR2);
+
+	while (usr1.n_calls < 2)
+		l_main_iterate(-1);
+
+	assert(usr2_other.n_calls == 2);
+
+	l_signal_remove(sig1);
+	l_signal_remove(sig2_other);
+
+	assert(l_main_exit());
+}
+
+struct exit_data {
+	pid_t pid;
+	int status;
+	bool exited;
+	unsigned int n_destroys;
+};
+
+static void exit_cb(pid_t pid, int status, void *user_data)
+{
+	struct exit_data *data = user_data;
+
+	assert(pid == data->pid);
+	data->status = status;
+	data->exited = true;
+}
+
+static void exit_destroy(void *user_data)
+{
+	struct exit_data *data = user_data;
+
+	data->n_destroys++;
+}
+
+static void test_pidfd_watch(const void *test_data)
+{
+	struct exit_data exited = {};
+	struct exit_data killed = {};
+	struct l_pidfd_watch *watch1;
+	struct l_pidfd_watch *watch2;
+
+	assert(!l_pidfd_watch_new(0, exit_cb, &exited, exit_destroy));
+
+	assert(l_main_init());
+
+	exited.pid = fork();
+	assert(exited.pid >= 0);
+
+	if (!exited.pid)
+		_exit(3);
+
+	killed.pid = fork();
+	assert(killed.pid >= 0);
+
+	if (!killed.pid) {
+		pause();
+		_exit(0);
+	}
+
+	watch1 = l_pidfd_watch_new(exited.pid, exit_cb, &exited,
+							exit_destroy);
+	if (!watch1) {
+		l_info("pidfd not supported, skipping");
+		kill(killed.pid, SIGKILL);
+		waitpid(exited.pid, NULL, 0);
+		waitpid(killed.pid, NULL, 0);
+		assert(l_main_exit());
+		return;
+	}
+
+	watch2 = l_pidfd_watch_new(killed.pid, exit_cb, &killed,
+							exit_destroy);
+	assert(watch2);
+
+	kill(killed.pid, SIGTERM);
+
+	while (!exited.exited || !killed.exited)
+		l_main_iterate(-1);
+
+	assert(WIFEXITED(exited.status) && WEXITSTATUS(exited.status) == 3);
+	assert(WIFSIGNALED(killed.status) &&
+			WTERMSIG(killed.status) == SIGTERM);
+
+	/* Both children have been reaped */
+	assert(waitpid(-1, NULL, WNOHANG) < 0);
+
+	l_pidfd_watch_destroy(watch1);
+	l_pidfd_watch_destroy(watch2);
+	assert(exited.n_destroys == 1 && killed.n_destroys == 1);
+
+	assert(l_main_exit());
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("l_signal batched dispatch", test_signal_batch, NULL);
+	l_test_add("l_pidfd_watch", test_pidfd_watch, NULL);
+
+	return l_test_run();
+}
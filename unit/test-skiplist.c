@@ -0,0 +1,152 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ell/ell.h>
+
+#define N_KEYS	10000
+
+static int uint_compare(const void *a, const void *b)
+{
+	unsigned int ua = L_PTR_TO_UINT(a);
+	unsigned int ub = L_PTR_TO_UINT(b);
+
+	return ua < ub ? -1 : ua > ub;
+}
+
+struct range_data {
+	unsigned int next;
+	unsigned int count;
+};
+
+static void range_cb(const void *key, void *value, void *user_data)
+{
+	struct range_data *data = user_data;
+
+	assert(L_PTR_TO_UINT(key) == data->next);
+	assert(value == key);
+
+	data->next += 2;
+	data->count++;
+}
+
+static void test_uint(const void *test_data)
+{
+	struct l_skiplist *list = l_skiplist_new(uint_compare);
+	struct l_skiplist_iter iter;
+	struct range_data range;
+	const void *key;
+	void *value;
+	unsigned int i;
+
+	assert(list);
+	assert(l_skiplist_isempty(list));
+	assert(!l_skiplist_first(list, NULL));
+
+	/* Even keys only, in an order unrelated to theirs */
+	for (i = 0; i < N_KEYS; i++) {
+		unsigned int k = (i * 7919) % N_KEYS * 2 + 2;
+
+		assert(l_skiplist_insert(list, L_UINT_TO_PTR(k),
+							L_UINT_TO_PTR(k)));
+	}
+
+	assert(l_skiplist_size(list) == N_KEYS);
+	assert(!l_skiplist_insert(list, L_UINT_TO_PTR(2), NULL));
+
+	assert(l_skiplist_first(list, &key) == L_UINT_TO_PTR(2));
+	assert(key == L_UINT_TO_PTR(2));
+
+	assert(l_skiplist_lookup(list, L_UINT_TO_PTR(100)) ==
+							L_UINT_TO_PTR(100));
+	assert(!l_skiplist_lookup(list, L_UINT_TO_PTR(101)));
+
+	assert(l_skiplist_lower_bound(list, L_UINT_TO_PTR(101), &key) ==
+							L_UINT_TO_PTR(102));
+	assert(key == L_UINT_TO_PTR(102));
+	assert(!l_skiplist_lower_bound(list, L_UINT_TO_PTR(N_KEYS * 2 + 1),
+							NULL));
+
+	range.next = 100;
+	range.count = 0;
+	l_skiplist_foreach_range(list, L_UINT_TO_PTR(99), L_UINT_TO_PTR(200),
+							range_cb, &range);
+	assert(range.count == 50);
+
+	range.next = 2;
+	range.count = 0;
+	l_skiplist_foreach(list, range_cb, &range);
+	assert(range.count == N_KEYS);
+
+	/* Remove every other entry while iterating */
+	l_skiplist_iter_init(&iter, list, NULL);
+	i = 0;
+
+	while (l_skiplist_iter_next(&iter, &key, &value)) {
+		assert(key == value);
+
+		if (i++ % 2)
+			assert(l_skiplist_remove(list, key) == value);
+	}
+
+	assert(i == N_KEYS);
+
+	assert(l_skiplist_size(list) == N_KEYS / 2);
+	assert(!l_skiplist_remove(list, L_UINT_TO_PTR(4)));
+	assert(!l_skiplist_lookup(list, L_UINT_TO_PTR(4)));
+	assert(l_skiplist_lookup(list, L_UINT_TO_PTR(6)));
+
+	for (i = 1; i <= N_KEYS; i++)
+		l_skiplist_remove(list, L_UINT_TO_PTR(i * 2));
+
+	assert(l_skiplist_isempty(list));
+
+	l_skiplist_destroy(list, NULL);
+}
+
+static int str_compare(const void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static void test_destroy(const void *test_data)
+{
+	static const char *keys[] = { "delta", "alpha", "charlie", "bravo" };
+	struct l_skiplist *list = l_skiplist_new(str_compare);
+	struct l_skiplist_iter iter;
+	const void *key;
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(keys); i++)
+		assert(l_skiplist_insert(list, keys[i], l_strdup(keys[i])));
+
+	l_skiplist_iter_init(&iter, list, "b");
+	assert(l_skiplist_iter_next(&iter, &key, NULL));
+	assert(!strcmp(key, "bravo"));
+	assert(l_skiplist_iter_next(&iter, &key, NULL));
+	assert(!strcmp(key, "charlie"));
+
+	/* The values are freed with the list */
+	l_skiplist_destroy(list, l_free);
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Unsigned keys", test_uint, NULL);
+	l_test_add("String keys", test_destroy, NULL);
+
+	return l_test_run();
+}
@@ -9,6 +9,7 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
 #include <assert.h>
 
 #include <ell/ell.h>
@@ -125,6 +126,92 @@ static void test_truncate(const void *test_data)
 	l_free(a);
 }
 
+static void test_chunked(const void *test_data)
+{
+	struct l_string *str;
+	const struct iovec *iov;
+	size_t n_iov;
+	size_t i;
+	size_t len;
+	char *a;
+
+	str = l_string_new_chunked(8);
+	assert(str);
+
+	iov = l_string_get_iovec(str, &n_iov);
+	assert(iov);
+	assert(n_iov == 0);
+
+	l_string_append(str, "Foobar7");
+	l_string_append(str, "BarFoo");
+	l_string_append_printf(str, "%d%s", 100, "0123456789");
+	l_string_append_c(str, 'x');
+	l_string_append_fixed(str, "abcdef", 3);
+	assert(l_string_length(str) == 30);
+
+	iov = l_string_get_iovec(str, &n_iov);
+	assert(n_iov > 1);
+
+	for (i = 0, len = 0; i < n_iov; i++) {
+		assert(iov[i].iov_len);
+		assert(!memcmp(iov[i].iov_base,
+				"Foobar7BarFoo1000123456789xabc" + len,
+				iov[i].iov_len));
+		len += iov[i].iov_len;
+	}
+
+	assert(len == l_string_length(str));
+
+	assert(l_string_truncate(str, 10));
+	l_string_append(str, "Baz");
+	assert(l_string_length(str) == strlen("Foobar7BarBaz"));
+
+	a = l_string_unwrap(str);
+	assert(a);
+	assert(!strcmp(a, "Foobar7BarBaz"));
+	l_free(a);
+
+	str = l_string_new_chunked(0);
+
+	for (i = 0; i < 10000; i++)
+		l_string_append_printf(str, "%zu,", i);
+
+	a = l_string_unwrap(str);
+	assert(a);
+
+	for (i = 0, len = 0; i < 10000; i++) {
+		char buf[16];
+
+		len += sprintf(buf, "%zu,", i);
+		assert(!strncmp(a + len - strlen(buf), buf, strlen(buf)));
+	}
+
+	assert(strlen(a) == len);
+	l_free(a);
+}
+
+static void test_reserve(const void *test_data)
+{
+	struct l_string *str;
+	unsigned int i;
+	char *a;
+
+	assert(!l_string_reserve(NULL, 10));
+
+	str = l_string_new(0);
+	assert(l_string_reserve(str, 100000) == str);
+
+	for (i = 0; i < 10000; i++)
+		l_string_append(str, "0123456789");
+
+	assert(l_string_length(str) == 100000);
+
+	a = l_string_unwrap(str);
+	assert(strlen(a) == 100000);
+	assert(!strncmp(a + 99990, "0123456789", 10));
+	l_free(a);
+}
+
 static void test_strsplit(const void *test_data)
 {
 	char **strv = l_strsplit("Foo:bar:bz", ':');
@@ -155,6 +242,27 @@ static void test_strsplit(const void *test_data)
 	l_strfreev(strv);
 }
 
+static void test_strsplit_packed(const void *test_data)
+{
+	char **strv = l_strsplit_packed(":bar:::bz", ':');
+
+	assert(strv);
+	assert(!strcmp(strv[0], ""));
+	assert(!strcmp(strv[1], "bar"));
+	assert(!strcmp(strv[2], ""));
+	assert(!strcmp(strv[3], ""));
+	assert(!strcmp(strv[4], "bz"));
+	assert(strv[5] == NULL);
+	l_free(strv);
+
+	strv = l_strsplit_packed("", ':');
+	assert(strv);
+	assert(strv[0] == NULL);
+	l_free(strv);
+
+	assert(!l_strsplit_packed(NULL, ':'));
+}
+
 static void test_strsplit_set(const void *test_data)
 {
 	char **strv = l_strsplit_set("Foo:bar,Baz Blu", ":, ");
@@ -256,6 +364,40 @@ static void test_strv_append(const void *test_data)
         l_strv_free(dst);
 }
 
+static void test_strv_builder(const void *test_data)
+{
+	struct l_strv_builder *builder;
+	char **strv;
+	unsigned int i;
+
+	builder = l_strv_builder_new(0);
+	strv = l_strv_builder_unwrap(builder);
+	assert(strv);
+	assert(strv[0] == NULL);
+	l_strv_free(strv);
+
+	builder = l_strv_builder_new(2);
+	assert(!l_strv_builder_append(builder, NULL));
+
+	for (i = 0; i < 100; i++) {
+		assert(l_strv_builder_append_printf(builder, "item%u", i));
+		assert(l_strv_builder_append(builder, "Foo"));
+	}
+
+	assert(l_strv_builder_length(builder) == 200);
+
+	strv = l_strv_builder_unwrap(builder);
+	assert(l_strv_length(strv) == 200);
+	assert(!strcmp(strv[0], "item0"));
+	assert(!strcmp(strv[198], "item99"));
+	assert(!strcmp(strv[199], "Foo"));
+	l_strv_free(strv);
+
+	builder = l_strv_builder_new(0);
+	l_strv_builder_append(builder, "Bar");
+	l_strv_builder_free(builder);
+}
+
 static void test_parse_args(const void *test_data)
 {
 	static struct test_case {
@@ -314,15 +456,19 @@ int main(int argc, char *argv[])
 	l_test_add("append_fixed test 3", test_fixed, &fixed_test3);
 
 	l_test_add("truncate", test_truncate, NULL);
+	l_test_add("chunked", test_chunked, NULL);
+	l_test_add("reserve", test_reserve, NULL);
 
 	l_test_add("strsplit", test_strsplit, NULL);
 	l_test_add("strsplit_set", test_strsplit_set, NULL);
+	l_test_add("strsplit_packed", test_strsplit_packed, NULL);
 
 	l_test_add("joinv", test_joinv, NULL);
 
 	l_test_add("strv_length", test_strv_length, NULL);
 	l_test_add("strv_contains", test_strv_contains, NULL);
 	l_test_add("strv_append", test_strv_append, NULL);
+	l_test_add("strv_builder", test_strv_builder, NULL);
 
 	l_test_add("parse_args", test_parse_args, NULL);
 
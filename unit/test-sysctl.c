@@ -54,6 +54,48 @@ static void test_sysctl_get_set(const void *data)
 	assert(!l_sysctl_set_u32(expected, "/proc/sys/net/core/somaxconn"));
 }
 
+static void test_sysctl_cached(const void *data)
+{
+	static const struct l_sysctl_u32_setting settings[] = {
+		{ "somaxconn", 4000 },
+		{ "somaxconn", 5000 },
+	};
+	struct l_sysctl *sysctl;
+	uint32_t expected;
+	uint32_t n;
+	int r;
+
+	assert(!l_sysctl_new("/proc/sys/net/core/nonexistent"));
+
+	assert(!l_sysctl_get_u32(&expected, "/proc/sys/net/core/somaxconn"));
+
+	sysctl = l_sysctl_new("/proc/sys/net/core/%s", "somaxconn");
+	assert(sysctl);
+
+	/* Repeated reads of the same fd see the whole value each time */
+	assert(!l_sysctl_read_u32(sysctl, &n));
+	assert(n == expected);
+	assert(!l_sysctl_read_u32(sysctl, &n));
+	assert(n == expected);
+
+	r = l_sysctl_set_u32_batch(settings, L_ARRAY_SIZE(settings),
+						"/proc/sys/net/%s", "core");
+	if (r == -EACCES)
+		goto done;
+
+	assert(!r);
+	assert(!l_sysctl_read_u32(sysctl, &n));
+	assert(n == 5000);
+
+	assert(!l_sysctl_write_u32(sysctl, 4000));
+	assert(!l_sysctl_write_u32(sysctl, expected));
+	assert(!l_sysctl_get_u32(&n, "/proc/sys/net/core/somaxconn"));
+	assert(n == expected);
+
+done:
+	l_sysctl_free(sysctl);
+}
+
 int main(int argc, char *argv[])
 {
 	int ret;
@@ -65,8 +107,10 @@ int main(int argc, char *argv[])
 	* a namespace where sysfs is not mounted
 	*/
 	ret = access("/proc/sys/net/core/somaxconn", F_OK);
-	if (!ret)
+	if (!ret) {
 		l_test_add("sysctl/get_set", test_sysctl_get_set, NULL);
+		l_test_add("sysctl/cached", test_sysctl_cached, NULL);
+	}
 
 
 	return l_test_run();
@@ -10,6 +10,7 @@
 #endif
 
 #include <assert.h>
+#include <unistd.h>
 
 #include <ell/ell.h>
 
@@ -34,12 +35,59 @@ static void test_offset(const void *data)
 	assert(l_time_offset(max_minus, 1001) == UINT64_MAX);
 }
 
+static void cached_idle(struct l_idle *idle, void *user_data)
+{
+	uint64_t *seen = user_data;
+
+	seen[0] = l_time_now_cached();
+	usleep(2000);
+	seen[1] = l_time_now_cached();
+	assert(l_time_now() > seen[1]);
+
+	l_idle_remove(idle);
+}
+
+static void test_cached(const void *data)
+{
+	uint64_t before = l_time_now();
+	uint64_t seen[2];
+
+	/* Without a loop iteration in progress the clock is read */
+	assert(l_time_now_cached() >= before);
+
+	assert(l_main_init());
+	assert(l_idle_create(cached_idle, seen, NULL));
+
+	l_main_iterate(0);
+	assert(seen[0] >= before);
+	assert(seen[0] == seen[1]);
+
+	/* The cached value goes away at the end of the iteration */
+	assert(l_time_now_cached() >= seen[1] + 2000);
+
+	assert(l_main_exit());
+}
+
+static void test_coarse(const void *data)
+{
+	uint64_t a = l_time_now_coarse();
+	uint64_t b;
+
+	usleep(20000);
+	b = l_time_now_coarse();
+
+	assert(a);
+	assert(l_time_after(b, a));
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
 
 	l_test_add("Test before/after/diff", test_before_after_diff, NULL);
 	l_test_add("Test offset", test_offset, NULL);
+	l_test_add("Test cached time", test_cached, NULL);
+	l_test_add("Test coarse time", test_coarse, NULL);
 
 	return l_test_run();
 }
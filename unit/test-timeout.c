@@ -0,0 +1,226 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+
+#include <ell/ell.h>
+
+#define N_TIMEOUTS 1000
+
+struct order_data {
+	struct l_timeout *timeouts[N_TIMEOUTS];
+	unsigned int fired;
+	unsigned int last;
+};
+
+static void order_cb(struct l_timeout *timeout, void *user_data)
+{
+	struct order_data *data = user_data;
+	unsigned int i;
+
+	for (i = 0; i < N_TIMEOUTS; i++)
+		if (data->timeouts[i] == timeout)
+			break;
+
+	assert(i < N_TIMEOUTS);
+	assert(i >= data->last || i / 20 == data->last / 20);
+
+	data->last = i;
+	data->fired += 1;
+
+	if (data->fired == N_TIMEOUTS)
+		l_main_quit();
+}
+
+static void test_order(const void *test_data)
+{
+	struct order_data data = {};
+	unsigned int i;
+
+	assert(l_main_init());
+
+	/*
+	 * Many timeouts, all multiplexed onto the same timerfd.  They are
+	 * created in order of increasing expiry, in groups of 20.
+	 */
+	for (i = 0; i < N_TIMEOUTS; i++) {
+		data.timeouts[i] = l_timeout_create_ms(10 + (i / 20) * 2,
+							order_cb, &data, NULL);
+		assert(data.timeouts[i]);
+	}
+
+	l_main_run();
+
+	assert(data.fired == N_TIMEOUTS);
+
+	for (i = 0; i < N_TIMEOUTS; i++)
+		l_timeout_remove(data.timeouts[i]);
+
+	assert(l_main_exit());
+}
+
+struct modify_data {
+	struct l_timeout *early;
+	struct l_timeout *late;
+	struct l_timeout *removed;
+	unsigned int rearm;
+	bool late_fired;
+};
+
+static void modify_removed_cb(struct l_timeout *timeout, void *user_data)
+{
+	assert(false);
+}
+
+static void modify_late_cb(struct l_timeout *timeout, void *user_data)
+{
+	struct modify_data *data = user_data;
+
+	assert(data->rearm == 3);
+	data->late_fired = true;
+	l_main_quit();
+}
+
+static void modify_early_cb(struct l_timeout *timeout, void *user_data)
+{
+	struct modify_data *data = user_data;
+	uint64_t remaining;
+
+	if (data->removed) {
+		l_timeout_remove(data->removed);
+		data->removed = NULL;
+	}
+
+	assert(!data->late_fired);
+	assert(l_timeout_remaining(data->late, &remaining));
+	assert(remaining > 0);
+
+	if (++data->rearm < 3)
+		l_timeout_modify_ms(timeout, 5);
+}
+
+static void test_modify(const void *test_data)
+{
+	struct modify_data data = {};
+	uint64_t remaining;
+
+	assert(l_main_init());
+
+	data.late = l_timeout_create_ms(10, modify_late_cb, &data, NULL);
+	data.early = l_timeout_create_ms(500, modify_early_cb, &data, NULL);
+	data.removed = l_timeout_create_ms(20, modify_removed_cb, &data, NULL);
+
+	/* Move the late timeout behind the early one and vice versa */
+	l_timeout_modify_ms(data.late, 200);
+	l_timeout_modify_ms(data.early, 5);
+
+	assert(l_timeout_remaining(data.early, &remaining));
+	assert(remaining <= 5000);
+
+	l_main_run();
+
+	assert(data.late_fired);
+	assert(!data.removed);
+
+	assert(l_timeout_remaining(data.late, &remaining));
+	assert(remaining == 0);
+
+	l_timeout_remove(data.early);
+	l_timeout_remove(data.late);
+
+	assert(l_main_exit());
+}
+
+static void detach_destroy(void *user_data)
+{
+	bool *destroyed = user_data;
+
+	*destroyed = true;
+}
+
+static void test_detach(const void *test_data)
+{
+	struct l_timeout *timeout;
+	bool destroyed = false;
+
+	assert(!l_timeout_create(1, modify_removed_cb, NULL, NULL));
+
+	assert(l_main_init());
+
+	timeout = l_timeout_create(1, modify_removed_cb, &destroyed,
+							detach_destroy);
+	assert(timeout);
+
+	/* Tearing down the loop detaches any remaining timeouts */
+	assert(l_main_exit());
+	assert(destroyed);
+
+	assert(!l_timeout_remaining(timeout, NULL));
+	l_timeout_modify(timeout, 1);
+	l_timeout_remove(timeout);
+}
+
+struct slack_data {
+	struct l_timeout *relaxed;
+	struct l_timeout *strict;
+	bool strict_fired;
+	bool relaxed_fired;
+};
+
+static void slack_strict_cb(struct l_timeout *timeout, void *user_data)
+{
+	struct slack_data *data = user_data;
+
+	data->strict_fired = true;
+}
+
+static void slack_relaxed_cb(struct l_timeout *timeout, void *user_data)
+{
+	struct slack_data *data = user_data;
+
+	/* Deferred within its slack to share the wakeup of the strict one */
+	assert(data->strict_fired);
+	data->relaxed_fired = true;
+	l_main_quit();
+}
+
+static void test_slack(const void *test_data)
+{
+	struct slack_data data = {};
+
+	assert(l_main_init());
+
+	data.relaxed = l_timeout_create_ms(5, slack_relaxed_cb, &data, NULL);
+	data.strict = l_timeout_create_ms(30, slack_strict_cb, &data, NULL);
+	l_timeout_set_slack_ms(data.relaxed, 200);
+
+	l_main_run();
+
+	assert(data.strict_fired);
+	assert(data.relaxed_fired);
+
+	l_timeout_remove(data.relaxed);
+	l_timeout_remove(data.strict);
+
+	assert(l_main_exit());
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("timeout/order", test_order, NULL);
+	l_test_add("timeout/modify", test_modify, NULL);
+	l_test_add("timeout/detach", test_detach, NULL);
+	l_test_add("timeout/slack", test_slack, NULL);
+
+	return l_test_run();
+}
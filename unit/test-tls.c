@@ -10,14 +10,21 @@
 #endif
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include <ell/ell.h>
 
 #include "ell/tls-private.h"
 #include "ell/asn1-private.h"
 #include "ell/cert-private.h"
+#include "ell/time-private.h"
 
 static void test_tls10_prf(const void *data)
 {
@@ -193,6 +200,83 @@ static void test_tls12_prf(const void *data)
 	assert(!memcmp(out_buf, test->expected, test->out_len));
 }
 
+static void assert_hexstring(const uint8_t *buf, size_t len,
+				const char *expected)
+{
+	char *str = l_util_hexstring(buf, len);
+
+	assert(!strcmp(str, expected));
+	l_free(str);
+}
+
+/* RFC 8448 Section 3, handshake traffic secrets of a 1-RTT handshake */
+static void test_tls13_key_schedule(const void *data)
+{
+	static const uint8_t zeros[32];
+	struct l_checksum *sha256;
+	uint8_t empty_hash[32];
+	uint8_t secret[32];
+	uint8_t derived[32];
+	uint8_t traffic[32];
+	uint8_t key[16];
+	uint8_t iv[12];
+	uint8_t *ecdhe;
+	uint8_t *transcript;
+	size_t len;
+
+	sha256 = l_checksum_new(L_CHECKSUM_SHA256);
+	l_checksum_get_digest(sha256, empty_hash, 32);
+	l_checksum_free(sha256);
+
+	assert(l_checksum_hkdf_extract(L_CHECKSUM_SHA256, NULL, 0, zeros, 32,
+					secret));
+	assert_hexstring(secret, 32, "33ad0a1c607ec03b09e6cd9893680ce2"
+					"10adf300aa1f2660e1b22e10f170f92a");
+
+	assert(tls13_hkdf_expand_label(L_CHECKSUM_SHA256, secret, 32,
+					"derived", empty_hash, 32,
+					derived, 32));
+	assert_hexstring(derived, 32, "6f2615a108c702c5678f54fc9dbab697"
+					"16c076189c48250cebeac3576c3611ba");
+
+	ecdhe = l_util_from_hexstring("8bd4054fb55b9d63fdfbacf9f04b9f0d"
+					"35e6d63f537563efd46272900f89492d",
+					&len);
+	assert(ecdhe && len == 32);
+	assert(l_checksum_hkdf_extract(L_CHECKSUM_SHA256, derived, 32,
+					ecdhe, len, secret));
+	l_free(ecdhe);
+	assert_hexstring(secret, 32, "1dc826e93606aa6fdc0aadc12f741b01"
+					"046aa6b99f691ed221a9f0ca043fbeac");
+
+	/* Hash of the ClientHello and ServerHello */
+	transcript = l_util_from_hexstring("860c06edc07858ee8e78f0e7428c58ed"
+					"d6b43f2ca3e6e95f02ed063cf0e1cad8",
+					&len);
+	assert(transcript && len == 32);
+
+	assert(tls13_hkdf_expand_label(L_CHECKSUM_SHA256, secret, 32,
+					"c hs traffic", transcript, 32,
+					traffic, 32));
+	assert_hexstring(traffic, 32, "b3eddb126e067f35a780b3abf45e2d8f"
+					"3b1a950738f52e9600746a0e27a55a21");
+
+	assert(tls13_hkdf_expand_label(L_CHECKSUM_SHA256, secret, 32,
+					"s hs traffic", transcript, 32,
+					traffic, 32));
+	assert_hexstring(traffic, 32, "b67b7d690cc16c4e75e54213cb2d37b4"
+					"e9c912bcded9105d42befd59d391ad38");
+	l_free(transcript);
+
+	assert(tls13_hkdf_expand_label(L_CHECKSUM_SHA256, traffic, 32,
+					"key", NULL, 0, key, 16));
+	assert_hexstring(key, 16, "3fce516009c21727d0f2e4e86ee403bc");
+
+	assert(tls13_hkdf_expand_label(L_CHECKSUM_SHA256, traffic, 32,
+					"iv", NULL, 0, iv, 12));
+	assert_hexstring(iv, 12, "5d313eb2671276ee13000b30");
+}
+
 static struct l_cert *load_cert_file(const char *filename)
 {
 	uint8_t *der;
@@ -328,6 +412,77 @@ static void test_certificates(const void *data)
 	l_queue_destroy(mixedcas, (l_queue_destroy_func_t) l_cert_free);
 }
 
+static void test_certificates_cached(const void *data)
+{
+	struct l_cert_verify_cache *cache = l_cert_verify_cache_new(16);
+	struct l_cert_verify_cache *small_cache = l_cert_verify_cache_new(1);
+	struct l_queue *cacert;
+	struct l_queue *wrongca2;
+	struct l_certchain *chain;
+	struct l_certchain *badchain;
+	int i;
+
+	assert(cache && small_cache);
+	assert(!l_cert_verify_cache_new(0));
+
+	cacert = l_pem_load_certificate_list(CERTDIR "cert-ca.pem");
+	assert(cacert && !l_queue_isempty(cacert));
+
+	wrongca2 = l_pem_load_certificate_list(CERTDIR "cert-server.pem");
+	assert(wrongca2 && !l_queue_isempty(wrongca2));
+
+	chain = certchain_new_from_leaf(
+			load_cert_file(CERTDIR "cert-entity-int.pem"));
+	certchain_link_issuer(chain,
+			load_cert_file(CERTDIR "cert-intca.pem"));
+	assert(chain);
+
+	/* Server cert not issued by cert-entity-int.pem's key */
+	badchain = certchain_new_from_leaf(
+			load_cert_file(CERTDIR "cert-server.pem"));
+	certchain_link_issuer(badchain,
+			load_cert_file(CERTDIR "cert-entity-int.pem"));
+	certchain_link_issuer(badchain,
+			load_cert_file(CERTDIR "cert-intca.pem"));
+	assert(badchain);
+
+	/* The second round comes from the cache, results must not change */
+	for (i = 0; i < 2; i++) {
+		assert(!l_certchain_verify_cached(chain, wrongca2, cache,
+							NULL));
+		assert(l_certchain_verify_cached(chain, cacert, cache, NULL));
+		assert(l_certchain_verify_cached(chain, NULL, cache, NULL));
+		assert(!l_certchain_verify_cached(badchain, cacert, cache,
+							NULL));
+		assert(!l_certchain_verify_cached(badchain, NULL, cache,
+							NULL));
+
+		assert(l_certchain_verify_cached(chain, cacert, small_cache,
+							NULL));
+		assert(!l_certchain_verify_cached(badchain, cacert,
+							small_cache, NULL));
+	}
+
+	l_certchain_free(chain);
+	l_certchain_free(badchain);
+	l_queue_destroy(cacert, (l_queue_destroy_func_t) l_cert_free);
+	l_queue_destroy(wrongca2, (l_queue_destroy_func_t) l_cert_free);
+	l_cert_verify_cache_free(cache);
+	l_cert_verify_cache_free(small_cache);
+}
+
+/* The kernel may lack ECDSA even when it handles RSA certificates */
+static bool ec_certificates_supported(void)
+{
+	struct l_cert *cert = load_cert_file(CERTDIR "ec-cert-ca.pem");
+	struct l_key *pubkey = l_cert_get_pubkey(cert);
+	bool supported = pubkey != NULL;
+
+	l_key_free(pubkey);
+	l_cert_free(cert);
+	return supported;
+}
+
 static void test_ec_certificates(const void *data)
 {
 	struct l_queue *cacert;
@@ -491,6 +646,9 @@ struct tls_test_state {
 
 	bool expect_alert;
 	enum l_tls_alert_desc alert_desc;
+
+	int fd;
+	bool writev;
 };
 
 static void tls_test_new_data(const uint8_t *data, size_t len, void *user_data)
@@ -530,6 +688,21 @@ static void tls_test_ready(const char *peer_identity, void *user_data)
 			 !strcmp(s->expect_peer, peer_identity)));
 	s->ready = true;
 
+	if (s->writev) {
+		size_t len = strlen(s->send_data);
+		struct iovec iov[3] = {
+			{ .iov_base = (void *) s->send_data, .iov_len = 3 },
+			{ .iov_base = NULL, .iov_len = 0 },
+			{
+				.iov_base = (void *) (s->send_data + 3),
+				.iov_len = len - 3,
+			},
+		};
+
+		l_tls_writev(s->tls, iov, L_ARRAY_SIZE(iov));
+		return;
+	}
+
 	l_tls_write(s->tls, (const uint8_t *) s->send_data,
 			strlen(s->send_data));
 }
@@ -561,6 +734,7 @@ static void test_tls_with_ver(const struct tls_conn_test *test,
 			.send_data = "server to client",
 			.expect_data = "client to server",
 			.expect_peer = test->server_expect_identity,
+			.writev = true,
 			.expect_alert = test->expect_alert,
 			.alert_desc = test->alert_desc,
 		},
@@ -668,8 +842,9 @@ static void test_tls_with_ver(const struct tls_conn_test *test,
 
 	while (!(test->expect_alert && s[0].success && s[1].success)) {
 		if (s[0].raw_buf_len) {
-			l_tls_handle_rx(s[1].tls, s[0].raw_buf,
-					s[0].raw_buf_len);
+			/* The client decrypts in place, the server doesn't */
+			l_tls_handle_rx_inplace(s[1].tls, s[0].raw_buf,
+						s[0].raw_buf_len);
 			s[0].raw_buf_len = 0;
 		} else if (s[1].raw_buf_len) {
 			l_tls_handle_rx(s[0].tls, s[1].raw_buf,
@@ -916,6 +1091,132 @@ static const struct tls_conn_test tls_conn_test_domain_mismatch6 = {
 	.alert_desc = TLS_ALERT_BAD_CERT,
 };
 
+static void tls_test_write_fd(const uint8_t *data, size_t len,
+				void *user_data)
+{
+	struct tls_test_state *s = user_data;
+	int fd = s->fd;
+
+	while (len) {
+		ssize_t r = write(fd, data, len);
+
+		assert(r > 0);
+		data += r;
+		len -= r;
+	}
+}
+
+static void tcp_socket_pair(int fds[static 2])
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t addr_len = sizeof(addr);
+	int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	assert(listen_fd >= 0);
+	assert(!bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)));
+	assert(!listen(listen_fd, 1));
+	assert(!getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len));
+
+	fds[1] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	assert(fds[1] >= 0);
+	assert(!connect(fds[1], (struct sockaddr *) &addr, addr_len));
+
+	fds[0] = accept(listen_fd, NULL, NULL);
+	assert(fds[0] >= 0);
+	close(listen_fd);
+}
+
+/*
+ * Runs over a TCP connection with the kernel offload requested, the data
+ * must go through whether or not the kernel supports it.
+ */
+static void test_tls_ktls(const void *data)
+{
+	const char *suites[] = { data, NULL };
+	struct tls_test_state s[2] = {
+		{
+			.send_data = "server to client",
+			.expect_data = "client to server",
+		},
+		{
+			.send_data = "client to server",
+			.expect_data = "server to client",
+		},
+	};
+	struct l_certchain *server_cert =
+		l_pem_load_certificate_chain(CERTDIR "cert-server.pem");
+	struct l_key *server_key =
+		l_pem_load_private_key(CERTDIR "cert-server-key-pkcs8.pem",
+					NULL, NULL);
+	struct l_queue *client_ca =
+		l_pem_load_certificate_list(CERTDIR "cert-ca.pem");
+	int fds[2];
+	unsigned int i;
+
+	assert(server_cert && server_key && client_ca);
+
+	tcp_socket_pair(fds);
+
+	for (i = 0; i < 2; i++) {
+		s[i].fd = fds[i];
+		s[i].tls = l_tls_new(i == 0, tls_test_new_data,
+					tls_test_write_fd, tls_test_ready,
+					tls_test_disconnected, &s[i]);
+		assert(s[i].tls);
+		assert(tls_set_cipher_suites(s[i].tls, suites));
+		assert(l_tls_set_ktls_fd(s[i].tls, fds[i]));
+
+		if (getenv("TLS_DEBUG"))
+			l_tls_set_debug(s[i].tls, tls_debug_cb,
+					i ? "client" : "server", NULL);
+	}
+
+	s[1].expect_peer = "/O=Bar Example Organization"
+		"/CN=Bar Example Organization/emailAddress=bar@mail.example";
+	assert(l_tls_set_auth_data(s[0].tls, server_cert, server_key));
+	assert(l_tls_set_cacert(s[1].tls, client_ca));
+
+	assert(l_tls_start(s[0].tls));
+	assert(l_tls_start(s[1].tls));
+
+	while (!s[0].success || !s[1].success) {
+		struct pollfd pfd[2] = {
+			{ .fd = fds[0], .events = POLLIN },
+			{ .fd = fds[1], .events = POLLIN },
+		};
+
+		assert(poll(pfd, 2, 5000) > 0);
+
+		for (i = 0; i < 2; i++) {
+			uint8_t buf[4096];
+			ssize_t len;
+
+			if (!(pfd[i].revents & POLLIN))
+				continue;
+
+			if (l_tls_get_ktls_rx(s[i].tls)) {
+				l_tls_handle_ktls_rx(s[i].tls);
+				continue;
+			}
+
+			len = read(fds[i], buf, sizeof(buf));
+			assert(len > 0);
+			l_tls_handle_rx(s[i].tls, buf, len);
+		}
+	}
+
+	if (l_tls_get_ktls_tx(s[0].tls))
+		l_info("kTLS Tx offload was used");
+
+	for (i = 0; i < 2; i++) {
+		l_tls_free(s[i].tls);
+		close(fds[i]);
+	}
+}
+
 static void test_tls_suite_test(const void *data)
 {
 	const char *suite_name = data;
@@ -926,6 +1227,731 @@ static void test_tls_suite_test(const void *data)
 	test_tls_with_ver(&test, 0, 0);
 }
 
+/*
+ * The client's ready callback, which also writes its data, must run before
+ * the server has seen the client's Finished.
+ */
+static void test_tls_false_start(const void *data)
+{
+	const char *suites[] = { data, NULL };
+	struct tls_test_state s[2] = {
+		{
+			.send_data = "server to client",
+			.expect_data = "client to server",
+		},
+		{
+			.send_data = "client to server",
+			.expect_data = "server to client",
+			.expect_peer = "/O=Foo Example Organization"
+				"/CN=Foo Example Organization"
+				"/emailAddress=foo@mail.example",
+		},
+	};
+	struct l_certchain *server_cert =
+		l_pem_load_certificate_chain(CERTDIR "cert-server.pem");
+	struct l_key *server_key =
+		l_pem_load_private_key(CERTDIR "cert-server-key-pkcs8.pem",
+					NULL, NULL);
+	struct l_queue *client_ca =
+		l_pem_load_certificate_list(CERTDIR "cert-ca.pem");
+	bool false_started = false;
+
+	assert(server_cert && server_key && client_ca);
+
+	s[0].tls = l_tls_new(true, tls_test_new_data, tls_test_write,
+				tls_test_ready, tls_test_disconnected, &s[0]);
+	s[1].tls = l_tls_new(false, tls_test_new_data, tls_test_write,
+				tls_test_ready, tls_test_disconnected, &s[1]);
+	assert(s[0].tls && s[1].tls);
+
+	assert(!l_tls_set_false_start(s[0].tls, true));
+	assert(l_tls_set_false_start(s[1].tls, true));
+	assert(tls_set_cipher_suites(s[1].tls, suites));
+	assert(l_tls_set_auth_data(s[0].tls, server_cert, server_key));
+	assert(l_tls_set_cacert(s[1].tls, client_ca));
+
+	assert(l_tls_start(s[0].tls));
+	assert(l_tls_start(s[1].tls));
+
+	while (1) {
+		if (s[0].raw_buf_len) {
+			l_tls_handle_rx(s[1].tls, s[0].raw_buf,
+					s[0].raw_buf_len);
+			s[0].raw_buf_len = 0;
+
+			if (s[1].ready && !s[0].ready)
+				false_started = true;
+		} else if (s[1].raw_buf_len) {
+			l_tls_handle_rx(s[0].tls, s[1].raw_buf,
+					s[1].raw_buf_len);
+			s[1].raw_buf_len = 0;
+		} else
+			break;
+	}
+
+	assert(false_started);
+	assert(s[0].success && s[1].success);
+
+	l_tls_free(s[0].tls);
+	l_tls_free(s[1].tls);
+}
+
+/* Returns the longest record written by @s and discards the records */
+static size_t tls_test_max_record_len(struct tls_test_state *s)
+{
+	size_t max_len = 0;
+	int offset = 0;
+
+	while (offset + 5 <= s->raw_buf_len) {
+		size_t len = l_get_be16(s->raw_buf + offset + 3);
+
+		if (len > max_len)
+			max_len = len;
+
+		offset += 5 + len;
+	}
+
+	assert(offset == s->raw_buf_len);
+	s->raw_buf_len = 0;
+
+	return max_len;
+}
+
+static void test_tls_record_size(const void *data)
+{
+	const char *suites[] = { data, NULL };
+	struct tls_test_state s[2] = {
+		{
+			.send_data = "server to client",
+			.expect_data = "client to server",
+		},
+		{
+			.send_data = "client to server",
+			.expect_data = "server to client",
+			.expect_peer = "/O=Foo Example Organization"
+				"/CN=Foo Example Organization"
+				"/emailAddress=foo@mail.example",
+		},
+	};
+	struct l_certchain *server_cert =
+		l_pem_load_certificate_chain(CERTDIR "cert-server.pem");
+	struct l_key *server_key =
+		l_pem_load_private_key(CERTDIR "cert-server-key-pkcs8.pem",
+					NULL, NULL);
+	struct l_queue *client_ca =
+		l_pem_load_certificate_list(CERTDIR "cert-ca.pem");
+	uint8_t chunk[4000] = {};
+	size_t sent;
+
+	assert(server_cert && server_key && client_ca);
+
+	s[0].tls = l_tls_new(true, tls_test_new_data, tls_test_write,
+				tls_test_ready, tls_test_disconnected, &s[0]);
+	s[1].tls = l_tls_new(false, tls_test_new_data, tls_test_write,
+				tls_test_ready, tls_test_disconnected, &s[1]);
+	assert(s[0].tls && s[1].tls);
+
+	assert(tls_set_cipher_suites(s[1].tls, suites));
+	assert(l_tls_set_auth_data(s[0].tls, server_cert, server_key));
+	assert(l_tls_set_cacert(s[1].tls, client_ca));
+
+	assert(l_tls_start(s[0].tls));
+	assert(l_tls_start(s[1].tls));
+
+	while (1) {
+		if (s[0].raw_buf_len) {
+			l_tls_handle_rx(s[1].tls, s[0].raw_buf,
+					s[0].raw_buf_len);
+			s[0].raw_buf_len = 0;
+		} else if (s[1].raw_buf_len) {
+			l_tls_handle_rx(s[0].tls, s[1].raw_buf,
+					s[1].raw_buf_len);
+			s[1].raw_buf_len = 0;
+		} else
+			break;
+	}
+
+	assert(s[0].success && s[1].success);
+
+	/* Records fit a TCP segment until a bulk transfer is under way */
+	for (sent = 0; sent < 64 * 1024; sent += sizeof(chunk)) {
+		l_tls_write(s[1].tls, chunk, sizeof(chunk));
+		assert(tls_test_max_record_len(&s[1]) < 1460);
+	}
+
+	l_tls_write(s[1].tls, chunk, sizeof(chunk));
+	assert(tls_test_max_record_len(&s[1]) > sizeof(chunk));
+
+	assert(l_tls_set_record_size(s[1].tls, L_TLS_RECORD_SIZE_SMALL));
+	l_tls_write(s[1].tls, chunk, sizeof(chunk));
+	assert(tls_test_max_record_len(&s[1]) < 1460);
+
+	/* Pinned to the maximum even though nothing has been sent yet */
+	assert(l_tls_set_record_size(s[0].tls, L_TLS_RECORD_SIZE_MAX));
+	l_tls_write(s[0].tls, chunk, sizeof(chunk));
+	assert(tls_test_max_record_len(&s[0]) > sizeof(chunk));
+
+	l_tls_free(s[0].tls);
+	l_tls_free(s[1].tls);
+}
+
+static void tls_ticket_connect(struct l_tls_ticket_keys *ticket_keys,
+				struct l_settings *client_cache,
+				bool expect_resumed)
+{
+	struct tls_test_state s[2] = {
+		{
+			.send_data = "server to client",
+			.expect_data = "client to server",
+		},
+		{
+			.send_data = "client to server",
+			.expect_data = "server to client",
+			.expect_peer = "/O=Foo Example Organization"
+				"/CN=Foo Example Organization"
+				"/emailAddress=foo@mail.example",
+		},
+	};
+	struct l_certchain *server_cert =
+		l_pem_load_certificate_chain(CERTDIR "cert-server.pem");
+	struct l_key *server_key =
+		l_pem_load_private_key(CERTDIR "cert-server-key-pkcs8.pem",
+					NULL, NULL);
+	struct l_queue *client_ca =
+		l_pem_load_certificate_list(CERTDIR "cert-ca.pem");
+
+	assert(server_cert && server_key && client_ca);
+
+	s[0].tls = l_tls_new(true, tls_test_new_data, tls_test_write,
+				tls_test_ready, tls_test_disconnected, &s[0]);
+	s[1].tls = l_tls_new(false, tls_test_new_data, tls_test_write,
+				tls_test_ready, tls_test_disconnected, &s[1]);
+	assert(s[0].tls && s[1].tls);
+
+	assert(l_tls_set_auth_data(s[0].tls, server_cert, server_key));
+	assert(l_tls_set_session_tickets(s[0].tls, ticket_keys));
+	assert(l_tls_set_cacert(s[1].tls, client_ca));
+	l_tls_set_session_cache(s[1].tls, client_cache, "tls-test",
+				600 * L_USEC_PER_SEC, 0, NULL, NULL);
+
+	assert(l_tls_start(s[0].tls));
+	assert(l_tls_start(s[1].tls));
+
+	while (1) {
+		if (s[0].raw_buf_len) {
+			l_tls_handle_rx(s[1].tls, s[0].raw_buf,
+					s[0].raw_buf_len);
+			s[0].raw_buf_len = 0;
+		} else if (s[1].raw_buf_len) {
+			l_tls_handle_rx(s[0].tls, s[1].raw_buf,
+					s[1].raw_buf_len);
+			s[1].raw_buf_len = 0;
+		} else
+			break;
+	}
+
+	assert(s[0].success && s[1].success);
+	assert(l_tls_get_session_resumed(s[0].tls) == expect_resumed);
+	assert(l_tls_get_session_resumed(s[1].tls) == expect_resumed);
+
+	l_tls_free(s[0].tls);
+	l_tls_free(s[1].tls);
+}
+
+static void test_tls_session_ticket(const void *data)
+{
+	struct l_tls_ticket_keys *ticket_keys =
+		l_tls_ticket_keys_new(NULL, 0, 3600 * L_USEC_PER_SEC);
+	struct l_tls_ticket_keys *other_keys =
+		l_tls_ticket_keys_new(NULL, 0, 3600 * L_USEC_PER_SEC);
+	struct l_settings *client_cache = l_settings_new();
+
+	assert(ticket_keys && other_keys);
+
+	/* Full handshake, the client gets a ticket */
+	tls_ticket_connect(ticket_keys, client_cache, false);
+	assert(l_settings_has_key(client_cache, "tls-test", "SessionTicket"));
+
+	/* Resumed from the ticket alone, no state on the server */
+	tls_ticket_connect(ticket_keys, client_cache, true);
+	tls_ticket_connect(ticket_keys, client_cache, true);
+
+	/* A server with different keys starts a new session */
+	tls_ticket_connect(other_keys, client_cache, false);
+	tls_ticket_connect(other_keys, client_cache, true);
+
+	l_settings_free(client_cache);
+	l_tls_ticket_keys_free(ticket_keys);
+	l_tls_ticket_keys_free(other_keys);
+}
+
+static struct tls_cached_session *cached_session_new(uint8_t id,
+							uint64_t expiry_time)
+{
+	struct tls_cached_session *session =
+		l_new(struct tls_cached_session, 1);
+
+	session->id[0] = 32;
+	memset(session->id + 1, id, 32);
+	session->version = L_TLS_V12;
+	session->cipher_suite_id[1] = 0x3c;
+	memset(session->master_secret, id, 48);
+	session->expiry_time = expiry_time;
+	return session;
+}
+
+static bool cached_session_present(struct l_tls_session_cache *cache,
+					uint8_t id)
+{
+	const struct tls_cached_session *session;
+	uint8_t session_id[32];
+
+	memset(session_id, id, 32);
+	session = tls_session_cache_lookup(cache, session_id, 32);
+
+	if (session) {
+		assert(session->master_secret[47] == id);
+		assert(session->version == L_TLS_V12);
+	}
+
+	return session;
+}
+
+static void test_session_cache(const void *data)
+{
+	uint64_t expiry = time_realtime_now() + 3600 * L_USEC_PER_SEC;
+	struct l_tls_session_cache *cache =
+		l_tls_session_cache_new(2, 3600 * L_USEC_PER_SEC);
+	struct l_tls_session_cache *restored =
+		l_tls_session_cache_new(10, 3600 * L_USEC_PER_SEC);
+	struct l_settings *settings = l_settings_new();
+
+	assert(cache && restored);
+
+	tls_session_cache_add(cache, cached_session_new(1, expiry));
+	tls_session_cache_add(cache, cached_session_new(2, expiry));
+	assert(l_tls_session_cache_get_size(cache) == 2);
+
+	/* Session 1 becomes the most recently used, 2 gets evicted */
+	assert(cached_session_present(cache, 1));
+	tls_session_cache_add(cache, cached_session_new(3, expiry));
+	assert(l_tls_session_cache_get_size(cache) == 2);
+	assert(!cached_session_present(cache, 2));
+	assert(cached_session_present(cache, 1));
+	assert(cached_session_present(cache, 3));
+
+	/* Expired sessions are dropped on lookup */
+	tls_session_cache_add(cache, cached_session_new(4, 1));
+	assert(!cached_session_present(cache, 4));
+	assert(l_tls_session_cache_get_size(cache) == 1);
+
+	tls_session_cache_add(cache, cached_session_new(5, expiry));
+	assert(l_tls_session_cache_save(cache, settings, "tls-test"));
+	assert(l_tls_session_cache_load(restored, settings, "tls-test"));
+	assert(l_tls_session_cache_get_size(restored) == 2);
+	assert(cached_session_present(restored, 3));
+	assert(cached_session_present(restored, 5));
+
+	tls_session_cache_remove(restored, (const uint8_t *) "\x05", 1);
+	assert(l_tls_session_cache_get_size(restored) == 2);
+
+	l_settings_free(settings);
+	l_tls_session_cache_free(cache);
+	l_tls_session_cache_free(restored);
+}
+
+static bool cert_store_issuer_is(struct l_cert_store *store,
+					const char *path,
+					const char *issuer_path)
+{
+	struct l_cert *cert = load_cert_file(path);
+	struct l_cert *expected = load_cert_file(issuer_path);
+	struct l_queue *issuers = l_cert_store_find_issuers(store, cert);
+	const uint8_t *der1, *der2;
+	size_t der1_len, der2_len;
+	bool ret;
+
+	assert(cert && expected);
+
+	if (l_queue_length(issuers) != 1) {
+		ret = false;
+		goto done;
+	}
+
+	der1 = l_cert_get_der_data(l_queue_peek_head(issuers), &der1_len);
+	der2 = l_cert_get_der_data(expected, &der2_len);
+	ret = der1_len == der2_len && !memcmp(der1, der2, der1_len);
+
+done:
+	l_queue_destroy(issuers, NULL);
+	l_cert_free(cert);
+	l_cert_free(expected);
+	return ret;
+}
+
+static void test_cert_store(const void *data)
+{
+	struct l_cert_store *store = l_cert_store_new();
+	struct l_cert *cert;
+	struct l_queue *issuers;
+
+	assert(l_cert_store_add_path(store, CERTDIR "cert-ca.pem"));
+	assert(l_cert_store_add_path(store, CERTDIR "cert-intca.pem"));
+	assert(l_cert_store_add_path(store, CERTDIR "cert-ca.pem"));
+	assert(l_cert_store_add_path(store, CERTDIR "nonexistent.pem"));
+	assert(l_cert_store_get_size(store) == 2);
+
+	assert(cert_store_issuer_is(store, CERTDIR "cert-server.pem",
+					CERTDIR "cert-ca.pem"));
+	assert(cert_store_issuer_is(store, CERTDIR "cert-entity-int.pem",
+					CERTDIR "cert-intca.pem"));
+	assert(cert_store_issuer_is(store, CERTDIR "cert-intca.pem",
+					CERTDIR "cert-ca.pem"));
+	assert(cert_store_issuer_is(store, CERTDIR "cert-ca.pem",
+					CERTDIR "cert-ca.pem"));
+
+	cert = load_cert_file(CERTDIR "ec-cert-ca.pem");
+	assert(!l_cert_store_find_issuers(store, cert));
+	assert(l_cert_store_add(store, cert));
+	assert(l_cert_store_get_size(store) == 3);
+
+	cert = load_cert_file(CERTDIR "cert-ca.pem");
+	assert(l_cert_store_add(store, cert));
+	assert(l_cert_store_get_size(store) == 3);
+	l_cert_store_free(store);
+
+	/* Every certificate in the directory, loaded on first lookup */
+	store = l_cert_store_new();
+	assert(l_cert_store_add_path(store, CERTDIR));
+	cert = load_cert_file(CERTDIR "cert-entity-int.pem");
+	issuers = l_cert_store_find_issuers(store, cert);
+	assert(issuers);
+	assert(l_cert_store_get_size(store) > 3);
+	l_queue_destroy(issuers, NULL);
+	l_cert_free(cert);
+	l_cert_store_free(store);
+}
+
+static bool ecdhe_cached_public_equal(struct l_tls_ecdhe_key_cache *cache,
+					const struct l_ecc_curve *curve,
+					uint8_t *last)
+{
+	struct l_ecc_scalar *private;
+	struct l_ecc_point *public;
+	uint8_t data[132];
+	ssize_t len;
+	bool equal;
+
+	assert(tls_ecdhe_key_cache_get(cache, curve, &private, &public));
+	len = l_ecc_point_get_data(public, data, sizeof(data));
+	assert(len > 0);
+
+	equal = !memcmp(last, data, len);
+	memcpy(last, data, len);
+
+	l_ecc_scalar_free(private);
+	l_ecc_point_free(public);
+	return equal;
+}
+
+static void test_ecdhe_key_cache(const void *data)
+{
+	const struct l_ecc_curve *p256 = l_ecc_curve_from_ike_group(19);
+	const struct l_ecc_curve *p384 = l_ecc_curve_from_ike_group(20);
+	struct l_tls_ecdhe_key_cache *cache;
+	uint8_t last256[132] = {};
+	uint8_t last384[132] = {};
+
+	assert(!l_tls_ecdhe_key_cache_new(0));
+
+	cache = l_tls_ecdhe_key_cache_new(3600 * L_USEC_PER_SEC);
+	assert(cache);
+
+	/* One key pair per curve, reused until it expires */
+	assert(!ecdhe_cached_public_equal(cache, p256, last256));
+	assert(!ecdhe_cached_public_equal(cache, p384, last384));
+	assert(ecdhe_cached_public_equal(cache, p256, last256));
+	assert(ecdhe_cached_public_equal(cache, p384, last384));
+	l_tls_ecdhe_key_cache_free(cache);
+
+	cache = l_tls_ecdhe_key_cache_new(1);
+	assert(!ecdhe_cached_public_equal(cache, p256, last256));
+	usleep(10);
+	assert(!ecdhe_cached_public_equal(cache, p256, last256));
+	l_tls_ecdhe_key_cache_free(cache);
+}
+
+static void test_crl(const void *data)
+{
+	struct l_crl_store *store = l_crl_store_new();
+	struct l_queue *cacert;
+	struct l_certchain *chain;
+	const char *error;
+	uint8_t *der;
+	char *label;
+	size_t len;
+
+	cacert = l_pem_load_certificate_list(CERTDIR "cert-ca.pem");
+	assert(cacert);
+
+	assert(!l_crl_store_add_file(store, CERTDIR "cert-ca.pem"));
+	assert(l_crl_store_add_file(store, CERTDIR "cert-ca-crl.pem"));
+	assert(l_crl_store_get_size(store) == 1);
+
+	/* The issuer of the leaf comes from the trusted CAs */
+	chain = l_pem_load_certificate_chain(CERTDIR "cert-server.pem");
+	assert(chain);
+	assert(!l_certchain_check_revocation(chain, cacert, store, &error));
+	assert(!strcmp(error, "Certificate 1 / 1 revoked by its issuer"));
+
+	/* The CRL is only trusted if the issuer is known */
+	assert(l_certchain_check_revocation(chain, NULL, store, NULL));
+	l_certchain_free(chain);
+
+	chain = certchain_new_from_leaf(
+			load_cert_file(CERTDIR "cert-server.pem"));
+	certchain_link_issuer(chain, load_cert_file(CERTDIR "cert-ca.pem"));
+	assert(!l_certchain_check_revocation(chain, NULL, store, &error));
+	assert(!strcmp(error, "Certificate 2 / 2 revoked by its issuer"));
+	l_certchain_free(chain);
+
+	chain = l_pem_load_certificate_chain(CERTDIR "cert-client.pem");
+	assert(l_certchain_check_revocation(chain, cacert, store, NULL));
+	l_certchain_free(chain);
+	l_crl_store_free(store);
+
+	/* A CRL whose signature doesn't verify is ignored */
+	der = l_pem_load_file(CERTDIR "cert-ca-crl.pem", &label, &len);
+	assert(der);
+	der[len - 1] ^= 1;
+	store = l_crl_store_new();
+	assert(l_crl_store_add(store, der, len));
+	chain = l_pem_load_certificate_chain(CERTDIR "cert-server.pem");
+	assert(l_certchain_check_revocation(chain, cacert, store, NULL));
+	l_certchain_free(chain);
+	l_crl_store_free(store);
+	l_free(der);
+	l_free(label);
+
+	l_queue_destroy(cacert, (l_queue_destroy_func_t) l_cert_free);
+}
+
+/* Flip a bit in the first 2048-bit BIT STRING, the response signature */
+static void ocsp_tamper_signature(uint8_t *response, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 32 < len; i++)
+		if (!memcmp(response + i, "\x03\x82\x01\x01\x00", 5))
+			break;
+
+	assert(i + 32 < len);
+	response[i + 16] ^= 1;
+}
+
+static void test_ocsp_verify(const void *data)
+{
+	struct l_cert *cert = load_cert_file(CERTDIR "cert-server.pem");
+	struct l_cert *issuer = load_cert_file(CERTDIR "cert-ca.pem");
+	struct l_cert *other = load_cert_file(CERTDIR "cert-client.pem");
+	uint64_t now = time_realtime_now();
+	uint64_t next_update;
+	const char *error;
+	uint8_t *good;
+	uint8_t *revoked;
+	size_t good_len;
+	size_t revoked_len;
+
+	assert(cert && issuer && other);
+
+	good = l_file_get_contents(CERTDIR "cert-server-ocsp-good.der",
+					&good_len);
+	revoked = l_file_get_contents(CERTDIR "cert-server-ocsp-revoked.der",
+					&revoked_len);
+	assert(good && revoked);
+
+	assert(!tls_ocsp_verify(good, good_len, cert, issuer, now,
+				&next_update, &error));
+	assert(next_update > now);
+	assert(tls_ocsp_verify(revoked, revoked_len, cert, issuer, now,
+				&next_update, &error) == -EKEYREVOKED);
+
+	/* No status for this certificate */
+	assert(tls_ocsp_verify(good, good_len, other, issuer, now,
+				&next_update, &error) == -ENOKEY);
+
+	/* Past nextUpdate */
+	assert(tls_ocsp_verify(good, good_len, cert, issuer,
+				next_update + 3600 * L_USEC_PER_SEC,
+				&next_update, &error) == -ESTALE);
+
+	/* Signed by someone other than the issuer */
+	assert(tls_ocsp_verify(good, good_len, other, other, now,
+				&next_update, &error) < 0);
+
+	ocsp_tamper_signature(good, good_len);
+	assert(tls_ocsp_verify(good, good_len, cert, issuer, now,
+				&next_update, &error) == -EKEYREJECTED);
+
+	assert(tls_ocsp_verify(good, 10, cert, issuer, now,
+				&next_update, &error) < 0);
+
+	l_free(good);
+	l_free(revoked);
+	l_cert_free(cert);
+	l_cert_free(issuer);
+	l_cert_free(other);
+}
+
+struct ocsp_fetch_data {
+	struct l_cert *cert;
+	uint8_t *request;
+	size_t request_len;
+	unsigned int n_fetches;
+};
+
+static void ocsp_fetch(struct l_tls_ocsp_cache *cache, struct l_cert *cert,
+			const char *url, const uint8_t *request,
+			size_t request_len, void *user_data)
+{
+	struct ocsp_fetch_data *fetch = user_data;
+
+	fetch->n_fetches++;
+	fetch->cert = cert;
+	l_free(fetch->request);
+	fetch->request = l_memdup(request, request_len);
+	fetch->request_len = request_len;
+}
+
+static void test_ocsp_cache(const void *data)
+{
+	struct ocsp_fetch_data fetch = {};
+	struct l_tls_ocsp_cache *cache;
+	struct l_certchain *chain;
+	struct l_cert *cert;
+	uint8_t *request;
+	uint8_t *response;
+	size_t request_len;
+	size_t response_len;
+	size_t len;
+
+	assert(l_main_init());
+
+	request = l_file_get_contents(CERTDIR "cert-server-ocsp-req.der",
+					&request_len);
+	response = l_file_get_contents(CERTDIR "cert-server-ocsp-good.der",
+					&response_len);
+	assert(request && response);
+
+	cache = l_tls_ocsp_cache_new(ocsp_fetch, &fetch, NULL);
+	assert(cache);
+
+	/* The issuer must be part of the chain */
+	chain = l_pem_load_certificate_chain(CERTDIR "cert-server.pem");
+	assert(!l_tls_ocsp_cache_add(cache, chain));
+	l_certchain_free(chain);
+	assert(!fetch.n_fetches);
+
+	chain = certchain_new_from_leaf(
+			load_cert_file(CERTDIR "cert-server.pem"));
+	certchain_link_issuer(chain, load_cert_file(CERTDIR "cert-ca.pem"));
+
+	/* The first fetch happens right away */
+	assert(l_tls_ocsp_cache_add(cache, chain));
+	assert(!l_tls_ocsp_cache_add(cache, chain));
+	l_certchain_free(chain);
+	assert(fetch.n_fetches == 1);
+	assert(fetch.request_len == request_len);
+	assert(!memcmp(fetch.request, request, request_len));
+
+	cert = fetch.cert;
+	assert(!tls_ocsp_cache_lookup(cache, cert, &len));
+
+	ocsp_tamper_signature(response, response_len);
+	assert(!l_tls_ocsp_cache_set_response(cache, cert, response,
+						response_len));
+	assert(!tls_ocsp_cache_lookup(cache, cert, &len));
+
+	ocsp_tamper_signature(response, response_len);
+	assert(l_tls_ocsp_cache_set_response(cache, cert, response,
+						response_len));
+	assert(tls_ocsp_cache_lookup(cache, cert, &len) &&
+			len == response_len);
+
+	l_tls_ocsp_cache_free(cache);
+	l_free(fetch.request);
+	l_free(request);
+	l_free(response);
+
+	assert(l_main_exit());
+}
+
+static void test_key_pool(const void *data)
+{
+	const struct tls_named_group *p256 = tls_find_group(23);
+	const struct tls_named_group *ffdhe2048 = tls_find_group(256);
+	struct l_tls_key_pool *pool;
+	struct l_ecc_scalar *private[3];
+	struct l_ecc_point *public[3];
+	uint8_t buf[2][256];
+	struct l_key *ff_private;
+	unsigned int i;
+
+	assert(l_main_init());
+
+	assert(!l_tls_key_pool_new(0));
+	pool = l_tls_key_pool_new(2);
+	assert(pool);
+
+	assert(l_tls_key_pool_add_group(pool, 23));
+	assert(!l_tls_key_pool_add_group(pool, 23));
+	assert(!l_tls_key_pool_add_group(pool, 0xffff));
+
+	/* Filled from idle callbacks, one key pair per iteration */
+	assert(!tls_key_pool_get_ec(pool, p256, &private[0], &public[0]));
+	assert(!tls_key_pool_get_ec(pool, ffdhe2048, &private[0], &public[0]));
+
+	for (i = 0; i < 4; i++)
+		l_main_iterate(0);
+
+	for (i = 0; i < 2; i++)
+		assert(tls_key_pool_get_ec(pool, p256, &private[i],
+						&public[i]));
+
+	assert(!tls_key_pool_get_ec(pool, p256, &private[2], &public[2]));
+	l_ecc_point_get_data(public[0], buf[0], sizeof(buf[0]));
+	l_ecc_point_get_data(public[1], buf[1], sizeof(buf[1]));
+	assert(memcmp(buf[0], buf[1], 64));
+
+	for (i = 0; i < 2; i++) {
+		l_ecc_scalar_free(private[i]);
+		l_ecc_point_free(public[i]);
+	}
+
+	/* Refilled after use */
+	for (i = 0; i < 4; i++)
+		l_main_iterate(0);
+
+	assert(tls_key_pool_get_ec(pool, p256, &private[0], &public[0]));
+	l_ecc_scalar_free(private[0]);
+	l_ecc_point_free(public[0]);
+
+	if (l_key_is_supported(L_KEY_FEATURE_DH) &&
+			l_tls_key_pool_add_group(pool, 256)) {
+		for (i = 0; i < 4; i++)
+			l_main_iterate(0);
+
+		memset(buf[0], 0, sizeof(buf[0]));
+		ff_private = tls_key_pool_get_ff(pool, ffdhe2048, buf[0]);
+		assert(ff_private);
+		assert(!l_memeqzero(buf[0], sizeof(buf[0])));
+		l_key_free(ff_private);
+	}
+
+	l_tls_key_pool_free(pool);
+	assert(l_main_exit());
+}
+
 int main(int argc, char *argv[])
 {
 	unsigned int i;
@@ -934,6 +1960,12 @@ int main(int argc, char *argv[])
 
 	l_test_init(&argc, &argv);
 
+	/* No kernel crypto needed */
+	l_test_add("TLS session cache", test_session_cache, NULL);
+	l_test_add("TLS ECDHE key cache", test_ecdhe_key_cache, NULL);
+	l_test_add("TLS ephemeral key pool", test_key_pool, NULL);
+	l_test_add("Certificate store", test_cert_store, NULL);
+
 	if (!l_checksum_is_supported(L_CHECKSUM_MD5, false) ||
 			!l_checksum_is_supported(L_CHECKSUM_SHA1, false) ||
 			!l_checksum_is_supported(L_CHECKSUM_SHA256, false) ||
@@ -954,9 +1986,20 @@ int main(int argc, char *argv[])
 	l_test_add("TLS 1.2 PRF with SHA512", test_tls12_prf,
 			&tls12_prf_sha512_0);
 
+	l_test_add("TLS 1.3 key schedule", test_tls13_key_schedule, NULL);
+
 	if (l_key_is_supported(L_KEY_FEATURE_RESTRICT)) {
 		l_test_add("Certificate chains", test_certificates, NULL);
-		l_test_add("ECDSA Certificates", test_ec_certificates, NULL);
+		l_test_add("Certificate chains cached",
+				test_certificates_cached, NULL);
+
+		if (ec_certificates_supported())
+			l_test_add("ECDSA Certificates", test_ec_certificates,
+					NULL);
+
+		l_test_add("TLS OCSP response verify", test_ocsp_verify, NULL);
+		l_test_add("TLS OCSP cache", test_ocsp_cache, NULL);
+		l_test_add("Certificate revocation", test_crl, NULL);
 	}
 
 	if (!l_getrandom_is_supported()) {
@@ -1054,6 +2097,19 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (l_aead_cipher_is_supported(L_AEAD_CIPHER_AES_GCM)) {
+		l_test_add("TLS connection kTLS offload", test_tls_ktls,
+				"TLS_RSA_WITH_AES_128_GCM_SHA256");
+		l_test_add("TLS connection session ticket",
+				test_tls_session_ticket, NULL);
+		l_test_add("TLS connection False Start",
+				test_tls_false_start,
+				"TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256");
+		l_test_add("TLS connection record size",
+				test_tls_record_size,
+				"TLS_RSA_WITH_AES_128_GCM_SHA256");
+	}
+
 done:
 	return l_test_run();
 }
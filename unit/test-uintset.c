@@ -429,6 +429,210 @@ static void test_uintset_subtract(const void *data)
 	l_uintset_free(set_a);
 }
 
+static void test_uintset_large_range(const void *data)
+{
+	struct l_uintset *set;
+	uint32_t i;
+
+	set = l_uintset_new_from_range(0, UINT32_MAX);
+	assert(set);
+	assert(l_uintset_isempty(set));
+	assert(l_uintset_find_min(set) == 0);
+	assert(l_uintset_find_unused_min(set) == 0);
+
+	assert(l_uintset_put(set, UINT32_MAX));
+	assert(l_uintset_put(set, 0x80000000));
+	assert(l_uintset_contains(set, UINT32_MAX));
+	assert(!l_uintset_contains(set, UINT32_MAX - 1));
+	assert(l_uintset_find_min(set) == 0x80000000);
+	assert(l_uintset_find_max(set) == UINT32_MAX);
+	assert(l_uintset_find_unused(set, 0x80000000) == 0x80000001);
+	assert(l_uintset_find_unused(set, UINT32_MAX) == 0);
+
+	/* Fill a few leaves so the summary of full slots gets used */
+	for (i = 0; i < 3 * 4096 + 5; i++)
+		assert(l_uintset_put(set, i));
+
+	assert(l_uintset_find_unused_min(set) == 3 * 4096 + 5);
+	assert(l_uintset_size(set) == 3 * 4096 + 5 + 2);
+
+	assert(l_uintset_take(set, 4096));
+	assert(l_uintset_find_unused_min(set) == 4096);
+	assert(l_uintset_find_unused(set, 4097) == 3 * 4096 + 5);
+
+	for (i = 0; i < 3 * 4096 + 5; i++)
+		l_uintset_take(set, i);
+
+	assert(l_uintset_size(set) == 2);
+	assert(l_uintset_find_min(set) == 0x80000000);
+
+	l_uintset_take(set, 0x80000000);
+	l_uintset_take(set, UINT32_MAX);
+	assert(l_uintset_isempty(set));
+	assert(l_uintset_find_max(set) == 0);
+
+	l_uintset_free(set);
+
+	assert(!l_uintset_new_from_range(10, 9));
+}
+
+static void test_uintset_small_range(const void *data)
+{
+	struct l_uintset *a;
+	struct l_uintset *b;
+	struct l_uintset *r;
+	uint32_t i;
+
+	/* Only one word of the leaf is allocated for these */
+	a = l_uintset_new_from_range(1, 8);
+	b = l_uintset_new_from_range(1, 8);
+
+	assert(l_uintset_find_unused_min(a) == 1);
+	assert(l_uintset_find_min(a) == 9);
+	assert(!l_uintset_put(a, 9));
+
+	for (i = 1; i <= 8; i++)
+		assert(l_uintset_put(a, i));
+
+	assert(l_uintset_size(a) == 8);
+	assert(l_uintset_find_unused_min(a) == 9);
+	assert(l_uintset_find_unused(a, 5) == 9);
+	assert(l_uintset_find_max(a) == 8);
+
+	assert(l_uintset_take(a, 3));
+	assert(l_uintset_find_unused(a, 5) == 3);
+
+	assert(l_uintset_put(b, 3));
+	assert(l_uintset_put(b, 8));
+
+	r = l_uintset_intersect(a, b);
+	assert(l_uintset_size(r) == 1);
+	assert(l_uintset_contains(r, 8));
+	l_uintset_free(r);
+
+	r = l_uintset_subtract(a, b);
+	assert(l_uintset_size(r) == 6);
+	assert(!l_uintset_contains(r, 8));
+	assert(l_uintset_find_unused_min(r) == 3);
+	l_uintset_free(r);
+
+	r = l_uintset_clone(b);
+	assert(l_uintset_find_min(r) == 3);
+	assert(l_uintset_find_max(r) == 8);
+	l_uintset_free(r);
+
+	l_uintset_free(b);
+	l_uintset_free(a);
+
+	/* A range that ends right after a word boundary */
+	a = l_uintset_new_from_range(0, 64);
+
+	for (i = 0; i < 64; i++)
+		assert(l_uintset_put(a, i));
+
+	assert(l_uintset_find_unused_min(a) == 64);
+	assert(l_uintset_put(a, 64));
+	assert(l_uintset_find_unused_min(a) == 65);
+	assert(l_uintset_find_unused(a, 10) == 65);
+
+	l_uintset_free(a);
+}
+
+#define MODEL_SIZE 300000
+
+static void model_compare(struct l_uintset *set, const bool *model)
+{
+	uint32_t count = 0;
+	uint32_t first_unused = MODEL_SIZE;
+	uint32_t first = MODEL_SIZE;
+	uint32_t last = MODEL_SIZE;
+	uint32_t i;
+
+	for (i = 0; i < MODEL_SIZE; i++) {
+		assert(l_uintset_contains(set, i) == model[i]);
+
+		if (model[i]) {
+			count++;
+			last = i;
+
+			if (first == MODEL_SIZE)
+				first = i;
+		} else if (first_unused == MODEL_SIZE)
+			first_unused = i;
+	}
+
+	assert(l_uintset_size(set) == count);
+	assert(l_uintset_find_min(set) == first);
+	assert(l_uintset_find_max(set) == last);
+	assert(l_uintset_find_unused_min(set) == first_unused);
+}
+
+static void test_uintset_model(const void *data)
+{
+	static bool model_a[MODEL_SIZE];
+	static bool model_b[MODEL_SIZE];
+	static bool expected[MODEL_SIZE];
+	struct l_uintset *a = l_uintset_new_from_range(0, MODEL_SIZE - 1);
+	struct l_uintset *b = l_uintset_new_from_range(0, MODEL_SIZE - 1);
+	struct l_uintset *r;
+	uint32_t seed = 1;
+	uint32_t i;
+
+	/* Dense runs mixed with sparse values, with some removed again */
+	for (i = 0; i < 120000; i++) {
+		model_a[i] = true;
+		l_uintset_put(a, i);
+	}
+
+	for (i = 0; i < 20000; i++) {
+		uint32_t v;
+
+		seed = seed * 1103515245 + 12345;
+		v = (seed >> 8) % MODEL_SIZE;
+
+		if (i & 1) {
+			model_a[v] = !model_a[v];
+
+			if (model_a[v])
+				l_uintset_put(a, v);
+			else
+				l_uintset_take(a, v);
+		}
+
+		model_b[v] = true;
+		l_uintset_put(b, v);
+	}
+
+	for (i = 200000; i < 270000; i++) {
+		model_b[i] = true;
+		l_uintset_put(b, i);
+	}
+
+	model_compare(a, model_a);
+	model_compare(b, model_b);
+
+	for (i = 0; i < MODEL_SIZE; i++)
+		expected[i] = model_a[i] && model_b[i];
+
+	r = l_uintset_intersect(a, b);
+	model_compare(r, expected);
+	l_uintset_free(r);
+
+	for (i = 0; i < MODEL_SIZE; i++)
+		expected[i] = model_a[i] && !model_b[i];
+
+	r = l_uintset_subtract(a, b);
+	model_compare(r, expected);
+	l_uintset_free(r);
+
+	r = l_uintset_clone(b);
+	model_compare(r, model_b);
+	l_uintset_free(r);
+
+	l_uintset_free(a);
+	l_uintset_free(b);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -449,6 +653,9 @@ int main(int argc, char *argv[])
 	l_test_add("l_uintset isempty", test_uintset_isempty, NULL);
 	l_test_add("l_uintset size", test_uintset_size, NULL);
 	l_test_add("l_uintset_subtract", test_uintset_subtract, NULL);
+	l_test_add("l_uintset large range", test_uintset_large_range, NULL);
+	l_test_add("l_uintset small range", test_uintset_small_range, NULL);
+	l_test_add("l_uintset model", test_uintset_model, NULL);
 
 	return l_test_run();
 }
@@ -891,6 +891,28 @@ static struct utf8_from_utf16_test utf8_from_utf16_test4 = {
 	.utf16_size = 8,
 };
 
+static struct utf8_from_utf16_test utf8_from_utf16_test5 = {
+	.utf16 = { 0x61, 0xd83d, 0xde00, 0x62, 0x00 },
+	.utf16_size = 10,
+	.utf8 = "a\360\237\230\200b",
+};
+
+static struct utf8_from_utf16_test utf8_from_utf16_test6 = {
+	.utf16 = { 'T', 'h', 'e', ' ', 'q', 'u', 'i', 'c', 'k', ' ',
+			0x03b1, 0x03b2, 0x03b3, ' ', 'b', 'r', 'o', 'w', 'n',
+			' ', 0x4e2d, 0x6587, ' ', 'f', 'o', 'x', ' ', 'j',
+			'u', 'm', 'p', 's', ' ', 0xd83d, 0xde00, 0x00 },
+	.utf16_size = 72,
+	.utf8 = "The quick \316\261\316\262\316\263 brown "
+		"\344\270\255\346\226\207 fox jumps \360\237\230\200",
+};
+
+static struct utf8_from_utf16_test utf8_from_utf16_test7 = {
+	.utf16 = { 'T', 'h', 'e', ' ', 'q', 'u', 'i', 'c', 'k', ' ',
+			'b', 'r', 'o', 'w', 'n', 0xfdd0, 0x00 },
+	.utf16_size = 34,
+};
+
 static void test_utf8_from_utf16(const void *test_data)
 {
 	const struct utf8_from_utf16_test *test = test_data;
@@ -906,6 +928,38 @@ static void test_utf8_from_utf16(const void *test_data)
 		assert(!utf8);
 }
 
+/* Long enough to take the vectorized paths, with the error past them */
+static void test_utf8_validate_long(const void *test_data)
+{
+	static const char valid[] = "The quick brown fox jumps over the lazy "
+					"dog \344\270\255\346\226\207 "
+					"The quick brown fox jumps \360\237"
+					"\230\200 over the lazy dog";
+	char buf[sizeof(valid) + 3];
+	const char *end;
+	size_t len = strlen(valid);
+
+	assert(l_utf8_validate(valid, len, &end));
+	assert(end == valid + len);
+
+	/* Truncated in the middle of a character */
+	assert(!l_utf8_validate(valid, 46, &end));
+	assert(end == valid + 44);
+
+	/* Noncharacter after a block of ASCII */
+	memcpy(buf, valid, 40);
+	memcpy(buf + 40, "\357\277\276", 3);
+	memcpy(buf + 43, valid + 40, len - 40 + 1);
+	assert(!l_utf8_validate(buf, len + 3, &end));
+	assert(end == buf + 40);
+
+	/* NUL after a block of ASCII */
+	memcpy(buf, valid, len + 1);
+	buf[35] = '\0';
+	assert(!l_utf8_validate(buf, len, &end));
+	assert(end == buf + 35);
+}
+
 static void test_utf8_to_utf16(const void *test_data)
 {
 	const struct utf8_from_utf16_test *test = test_data;
@@ -1142,6 +1196,7 @@ int main(int argc, char *argv[])
 					&utf8_validate_test79);
 	l_test_add("Validate UTF 80", test_utf8_validate,
 					&utf8_validate_test80);
+	l_test_add("Validate UTF long", test_utf8_validate_long, NULL);
 
 	l_test_add("Strlen UTF 1", test_utf8_strlen,
 					&utf8_strlen_test1);
@@ -1154,11 +1209,21 @@ int main(int argc, char *argv[])
 					&utf8_from_utf16_test3);
 	l_test_add("utf8_from_utf16 4", test_utf8_from_utf16,
 					&utf8_from_utf16_test4);
+	l_test_add("utf8_from_utf16 5", test_utf8_from_utf16,
+					&utf8_from_utf16_test5);
+	l_test_add("utf8_from_utf16 6", test_utf8_from_utf16,
+					&utf8_from_utf16_test6);
+	l_test_add("utf8_from_utf16 7", test_utf8_from_utf16,
+					&utf8_from_utf16_test7);
 
 	l_test_add("utf8_to_utf16 1", test_utf8_to_utf16,
 					&utf8_from_utf16_test1);
 	l_test_add("utf8_to_utf16 2", test_utf8_to_utf16,
 					&utf8_from_utf16_test2);
+	l_test_add("utf8_to_utf16 3", test_utf8_to_utf16,
+					&utf8_from_utf16_test5);
+	l_test_add("utf8_to_utf16 4", test_utf8_to_utf16,
+					&utf8_from_utf16_test6);
 
 	l_test_add("ascii/toupper", test_ascii_toupper, NULL);
 	l_test_add("ascii/tolower", test_ascii_tolower, NULL);
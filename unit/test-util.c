@@ -300,6 +300,62 @@ static void test_l_memcpy(const void *test_data)
 	assert(l_memcpy(dst, NULL, 0) == dst);
 }
 
+static void test_memory_accounting(const void *test_data)
+{
+	struct l_memory_stats before;
+	struct l_memory_stats stats;
+	struct l_settings *settings;
+	enum l_memory_tag saved;
+	void *a;
+	void *b;
+	char *str;
+
+	l_memory_accounting_enable();
+	assert(l_memory_accounting_is_enabled());
+
+	assert(l_memory_get_stats(L_MEMORY_TAG_TLS, &before));
+
+	saved = l_memory_tag_push(L_MEMORY_TAG_TLS);
+	a = l_malloc(100);
+	b = l_malloc(50);
+	str = l_strdup_printf("%u", 12345);
+	l_memory_tag_pop(saved);
+
+	assert(l_memory_get_stats(L_MEMORY_TAG_TLS, &stats));
+	assert(stats.live_bytes == before.live_bytes + 156);
+	assert(stats.live_allocs == before.live_allocs + 3);
+	assert(stats.total_allocs == before.total_allocs + 3);
+
+	/* Growing a block keeps it under the tag it was allocated with */
+	a = l_realloc(a, 1000);
+	assert(l_memory_get_stats(L_MEMORY_TAG_TLS, &stats));
+	assert(stats.live_bytes == before.live_bytes + 1056);
+	assert(stats.live_allocs == before.live_allocs + 3);
+
+	l_free(a);
+	l_free(b);
+	l_free(str);
+
+	assert(l_memory_get_stats(L_MEMORY_TAG_TLS, &stats));
+	assert(stats.live_bytes == before.live_bytes);
+	assert(stats.live_allocs == before.live_allocs);
+	assert(stats.peak_bytes >= before.live_bytes + 1056);
+
+	/* ell subsystems tag their own allocations */
+	assert(l_memory_get_stats(L_MEMORY_TAG_SETTINGS, &before));
+	settings = l_settings_new();
+	assert(l_settings_set_string(settings, "group", "key", "value"));
+	assert(l_memory_get_stats(L_MEMORY_TAG_SETTINGS, &stats));
+	assert(stats.live_bytes > before.live_bytes);
+	l_settings_free(settings);
+	assert(l_memory_get_stats(L_MEMORY_TAG_SETTINGS, &stats));
+	assert(stats.live_bytes == before.live_bytes);
+
+	assert(!strcmp(l_memory_tag_to_string(L_MEMORY_TAG_DBUS), "dbus"));
+	assert(!l_memory_tag_to_string(L_MEMORY_TAG_SETTINGS + 1));
+	assert(!l_memory_get_stats(L_MEMORY_TAG_SETTINGS + 1, &stats));
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -327,5 +383,7 @@ int main(int argc, char *argv[])
 
 	l_test_add("l_memcpy", test_l_memcpy, NULL);
 
+	l_test_add("Memory accounting", test_memory_accounting, NULL);
+
 	return l_test_run();
 }
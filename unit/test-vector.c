@@ -0,0 +1,148 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  Intel Corporation
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+
+#include <ell/ell.h>
+
+static void test_push_pop(const void *data)
+{
+	struct l_vector *vector;
+	unsigned int i;
+
+	vector = l_vector_new(0);
+	assert(vector);
+	assert(l_vector_isempty(vector));
+	assert(!l_vector_pop_head(vector));
+	assert(!l_vector_pop_tail(vector));
+
+	/* Mix both ends so that the entries wrap around the array */
+	for (i = 1; i <= 100; i++) {
+		l_vector_push_tail(vector, L_UINT_TO_PTR(i));
+		l_vector_push_head(vector, L_UINT_TO_PTR(1000 + i));
+	}
+
+	assert(l_vector_length(vector) == 200);
+	assert(L_PTR_TO_UINT(l_vector_peek_head(vector)) == 1100);
+	assert(L_PTR_TO_UINT(l_vector_peek_tail(vector)) == 100);
+
+	for (i = 0; i < 100; i++) {
+		assert(L_PTR_TO_UINT(l_vector_at(vector, i)) == 1100 - i);
+		assert(L_PTR_TO_UINT(l_vector_at(vector, 100 + i)) == i + 1);
+	}
+
+	assert(!l_vector_at(vector, 200));
+
+	for (i = 100; i > 0; i--) {
+		assert(L_PTR_TO_UINT(l_vector_pop_tail(vector)) == i);
+		assert(L_PTR_TO_UINT(l_vector_pop_head(vector)) == 1000 + i);
+	}
+
+	assert(l_vector_isempty(vector));
+	l_vector_destroy(vector, NULL);
+}
+
+static void test_remove(const void *data)
+{
+	struct l_vector *vector;
+	unsigned int i;
+
+	vector = l_vector_new(16);
+
+	for (i = 0; i < 10; i++)
+		l_vector_push_tail(vector, L_UINT_TO_PTR(i));
+
+	/* One removal in each half */
+	assert(L_PTR_TO_UINT(l_vector_remove_at(vector, 2)) == 2);
+	assert(L_PTR_TO_UINT(l_vector_remove_at(vector, 7)) == 8);
+	assert(l_vector_remove(vector, L_UINT_TO_PTR(0)));
+	assert(!l_vector_remove(vector, L_UINT_TO_PTR(42)));
+	assert(!l_vector_remove_at(vector, 7));
+
+	assert(l_vector_length(vector) == 7);
+	assert(L_PTR_TO_UINT(l_vector_at(vector, 0)) == 1);
+	assert(L_PTR_TO_UINT(l_vector_at(vector, 1)) == 3);
+	assert(L_PTR_TO_UINT(l_vector_at(vector, 5)) == 7);
+	assert(L_PTR_TO_UINT(l_vector_at(vector, 6)) == 9);
+
+	l_vector_clear(vector, NULL);
+	assert(l_vector_isempty(vector));
+
+	l_vector_destroy(vector, NULL);
+}
+
+static int uint_compare(const void *a, const void *b, void *user_data)
+{
+	unsigned int ua = L_PTR_TO_UINT(a) % 1000;
+	unsigned int ub = L_PTR_TO_UINT(b) % 1000;
+
+	return ua < ub ? -1 : (ua > ub ? 1 : 0);
+}
+
+static bool match_uint(const void *data, const void *user_data)
+{
+	return data == user_data;
+}
+
+static void test_sort_search(const void *data)
+{
+	struct l_vector *vector;
+	unsigned int i;
+	unsigned int prev = 0;
+
+	vector = l_vector_new(0);
+
+	/* Push to the head to have the entries wrap before sorting */
+	for (i = 0; i < 500; i++)
+		l_vector_push_head(vector, L_UINT_TO_PTR((i * 7919) % 500));
+
+	/* Equal keys in the compare function, checks that sort is stable */
+	l_vector_push_tail(vector, L_UINT_TO_PTR(1250));
+	l_vector_push_head(vector, L_UINT_TO_PTR(2250));
+
+	assert(l_vector_find(vector, match_uint, L_UINT_TO_PTR(1250)));
+	assert(!l_vector_find(vector, match_uint, L_UINT_TO_PTR(500)));
+
+	assert(l_vector_sort(vector, uint_compare, NULL));
+	assert(l_vector_length(vector) == 502);
+
+	for (i = 0; i < l_vector_length(vector); i++) {
+		unsigned int v = L_PTR_TO_UINT(l_vector_at(vector, i)) % 1000;
+
+		assert(v >= prev);
+		prev = v;
+	}
+
+	assert(L_PTR_TO_UINT(l_vector_at(vector, 250)) == 2250);
+	assert(L_PTR_TO_UINT(l_vector_at(vector, 251)) == 250);
+	assert(L_PTR_TO_UINT(l_vector_at(vector, 252)) == 1250);
+
+	for (i = 0; i < 500; i++)
+		assert(L_PTR_TO_UINT(l_vector_bsearch(vector,
+					L_UINT_TO_PTR(i), uint_compare,
+					NULL)) % 1000 == i);
+
+	assert(!l_vector_bsearch(vector, L_UINT_TO_PTR(500), uint_compare,
+					NULL));
+
+	l_vector_destroy(vector, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Vector push and pop", test_push_pop, NULL);
+	l_test_add("Vector remove", test_remove, NULL);
+	l_test_add("Vector sort and search", test_sort_search, NULL);
+
+	return l_test_run();
+}